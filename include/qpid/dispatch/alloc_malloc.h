@@ -49,6 +49,8 @@ static inline uint32_t qd_alloc_sequence(void *p) { return 0; }
 static inline void qd_alloc_initialize(void) {}
 static inline void qd_alloc_debug_dump(const char *file) {}
 static inline void qd_alloc_finalize(void) {}
+static inline void qd_alloc_set_trim_high_water(size_t bytes) {}
+static inline void qd_alloc_trim(void) {}
 
 
 #endif // ALLOC_MALLOC_H
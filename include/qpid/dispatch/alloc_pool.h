@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <qpid/dispatch/threading.h>
 #include <qpid/dispatch/ctools.h>
 
@@ -36,13 +37,24 @@
 /** Allocation pool */
 typedef struct qd_alloc_pool_t qd_alloc_pool_t;
 
+/** Slab backing store for the items of one type */
+typedef struct qd_alloc_slab_t qd_alloc_slab_t;
+
 DEQ_DECLARE(qd_alloc_pool_t, qd_alloc_pool_list_t);
 
-/** Allocation configuration. */
+/**
+ * Allocation configuration.
+ *
+ * If max_transfer_batch_size is non-zero each thread's batch size adapts at run time:
+ * it grows (up to max_transfer_batch_size) while the thread keeps going to the global
+ * pool and shrinks back towards transfer_batch_size when it stops.  The thread's local
+ * free list limit scales with its batch size.
+ */
 typedef struct {
     int  transfer_batch_size;
     int  local_free_list_max;
     int  global_free_list_max;
+    int  max_transfer_batch_size;
 } qd_alloc_config_t;
 
 /** Allocation statistics. */
@@ -66,6 +78,7 @@ typedef struct {
     qd_alloc_pool_t      *global_pool;
     sys_mutex_t          *lock;
     qd_alloc_pool_list_t  tpool_list;
+    qd_alloc_slab_t      *slab;
     uint32_t              trailer;
 } qd_alloc_type_desc_t;
 
@@ -74,6 +87,11 @@ void *qd_alloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool);
 /** De-allocate from a thread pool. Use via ALLOC_DECLARE */
 void qd_dealloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool, char *p);
 uint32_t qd_alloc_sequence(void *p);
+/**
+ * Get the batch size and local free list limit a thread pool is using, as adapted
+ * to its thread's demand.  A null pool reports the type's configured values.
+ */
+void qd_alloc_pool_limits(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool, int *batch, int *local_max);
 
 /**
  * Declare functions new_T and alloc_T
@@ -88,7 +106,7 @@ uint32_t qd_alloc_sequence(void *p);
  *@internal
  */
 #define ALLOC_DEFINE_CONFIG(T,S,A,C)                                \
-    qd_alloc_type_desc_t __desc_##T  __attribute__((aligned(64))) = {0, #T, S, A, 0, C, 0, 0, 0, {0,0}, 0}; \
+    qd_alloc_type_desc_t __desc_##T  __attribute__((aligned(64))) = {0, #T, S, A, 0, C, 0, 0, 0, {0,0}, 0, 0}; \
     __thread qd_alloc_pool_t *__local_pool_##T = 0;                     \
     T *new_##T(void) { return (T*) qd_alloc(&__desc_##T, &__local_pool_##T); }  \
     void free_##T(T *p) { qd_dealloc(&__desc_##T, &__local_pool_##T, (char*) p); } \
@@ -104,4 +122,39 @@ void qd_alloc_initialize(void);
 void qd_alloc_debug_dump(const char *file);
 void qd_alloc_finalize(void);
 
+/**
+ * Set the number of bytes of free items each type may keep cached in its global
+ * pool.  Zero (the default) disables trimming.
+ */
+void qd_alloc_set_trim_high_water(size_t bytes);
+
+/**
+ * Release the free items each type caches in its global pool beyond the high-water
+ * mark.  Memory goes back to the heap a slab chunk at a time, once none of the
+ * chunk's items are in use or cached.
+ */
+void qd_alloc_trim(void);
+
+/**
+ * Enable or disable allocation tracking for a type.  While enabled, the type's
+ * allocator entity reports per-thread allocation and free rates and a sample of
+ * the call sites allocating (and still holding) its objects.
+ */
+void qd_alloc_set_tracking(qd_alloc_type_desc_t *desc, bool enable);
+
+/**
+ * Back a type's memory with huge pages where the system provides them, falling back
+ * to normal pages where it does not.  This only takes effect before the type's first
+ * allocation.
+ *
+ * @return True if huge pages were requested in time.
+ */
+bool qd_alloc_use_huge_pages(qd_alloc_type_desc_t *desc);
+
+/**
+ * Return the number of bytes taken by a type's items that are in use, not
+ * counting the free items cached in its pools.
+ */
+size_t qd_alloc_in_use_bytes(qd_alloc_type_desc_t *desc);
+
 #endif
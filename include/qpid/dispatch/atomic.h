@@ -20,10 +20,15 @@
  */
 
 /**@file
- * Portable atomic operations on uint32_t.
+ * Portable atomic operations on uint32_t and pointers.
+ *
+ * sys_atomic_set and sys_atomic_ptr_swap return the value that was replaced.
+ * sys_atomic_ptr_cas returns true if *ref was equal to 'expected' and has been
+ * replaced by 'value'.
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /******************************************************************************
  * C11 atomics                                                                *
@@ -53,8 +58,37 @@ static inline uint32_t sys_atomic_get(sys_atomic_t *ref)
     return atomic_load(ref);
 }
 
+static inline uint32_t sys_atomic_set(sys_atomic_t *ref, uint32_t value)
+{
+    return atomic_exchange(ref, value);
+}
+
 static inline void sys_atomic_destroy(sys_atomic_t *ref) {}
 
+typedef _Atomic(void*) sys_atomic_ptr_t;
+
+static inline void sys_atomic_ptr_init(sys_atomic_ptr_t *ref, void *value)
+{
+    atomic_store(ref, value);
+}
+
+static inline void *sys_atomic_ptr_get(sys_atomic_ptr_t *ref)
+{
+    return atomic_load(ref);
+}
+
+static inline void *sys_atomic_ptr_swap(sys_atomic_ptr_t *ref, void *value)
+{
+    return atomic_exchange(ref, value);
+}
+
+static inline bool sys_atomic_ptr_cas(sys_atomic_ptr_t *ref, void *expected, void *value)
+{
+    return atomic_compare_exchange_strong(ref, &expected, value);
+}
+
+static inline void sys_atomic_ptr_destroy(sys_atomic_ptr_t *ref) {}
+
 
 #elif defined(__GNUC__) || defined(__clang__)
 
@@ -84,8 +118,47 @@ static inline uint32_t sys_atomic_get(sys_atomic_t *ref)
     return *ref;
 }
 
+static inline uint32_t sys_atomic_set(sys_atomic_t *ref, uint32_t value)
+{
+    uint32_t old;
+    do {
+        old = *ref;
+    } while (!__sync_bool_compare_and_swap(ref, old, value));
+    return old;
+}
+
 static inline void sys_atomic_destroy(sys_atomic_t *ref) {}
 
+typedef void * volatile sys_atomic_ptr_t;
+
+static inline void sys_atomic_ptr_init(sys_atomic_ptr_t *ref, void *value)
+{
+    *ref = value;
+    __sync_synchronize();
+}
+
+static inline void *sys_atomic_ptr_get(sys_atomic_ptr_t *ref)
+{
+    __sync_synchronize();
+    return *ref;
+}
+
+static inline void *sys_atomic_ptr_swap(sys_atomic_ptr_t *ref, void *value)
+{
+    void *old;
+    do {
+        old = *ref;
+    } while (!__sync_bool_compare_and_swap(ref, old, value));
+    return old;
+}
+
+static inline bool sys_atomic_ptr_cas(sys_atomic_ptr_t *ref, void *expected, void *value)
+{
+    return __sync_bool_compare_and_swap(ref, expected, value);
+}
+
+static inline void sys_atomic_ptr_destroy(sys_atomic_ptr_t *ref) {}
+
 
 #elif defined(__sun)
 
@@ -120,8 +193,39 @@ static inline uint32_t sys_atomic_get(sys_atomic_t *ref)
     return *ref;
 }
 
+static inline uint32_t sys_atomic_set(sys_atomic_t *ref, uint32_t value)
+{
+    return atomic_swap_32(ref, value);
+}
+
 static inline void sys_atomic_destroy(sys_atomic_t *ref) {}
 
+typedef void * volatile sys_atomic_ptr_t;
+
+static inline void sys_atomic_ptr_init(sys_atomic_ptr_t *ref, void *value)
+{
+    *ref = value;
+    membar_producer();
+}
+
+static inline void *sys_atomic_ptr_get(sys_atomic_ptr_t *ref)
+{
+    membar_consumer();
+    return *ref;
+}
+
+static inline void *sys_atomic_ptr_swap(sys_atomic_ptr_t *ref, void *value)
+{
+    return atomic_swap_ptr(ref, value);
+}
+
+static inline bool sys_atomic_ptr_cas(sys_atomic_ptr_t *ref, void *expected, void *value)
+{
+    return atomic_cas_ptr(ref, expected, value) == expected;
+}
+
+static inline void sys_atomic_ptr_destroy(sys_atomic_ptr_t *ref) {}
+
 #else
 
 /******************************************************************************
@@ -167,12 +271,66 @@ static inline uint32_t sys_atomic_get(sys_atomic_t *ref)
     return value;
 }
 
+static inline uint32_t sys_atomic_set(sys_atomic_t *ref, uint32_t value)
+{
+    sys_mutex_lock(ref->lock);
+    uint32_t prev = ref->value;
+    ref->value = value;
+    sys_mutex_unlock(ref->lock);
+    return prev;
+}
+
 static inline void sys_atomic_destroy(sys_atomic_t *ref)
 {
     sys_mutex_lock(ref->lock);
     sys_mutex_free(ref->lock);
 }
 
+struct sys_atomic_ptr_t {
+    sys_mutex_t *lock;
+    void        *value;
+};
+typedef struct sys_atomic_ptr_t sys_atomic_ptr_t;
+
+static inline void sys_atomic_ptr_init(sys_atomic_ptr_t *ref, void *value)
+{
+    ref->lock = sys_mutex();
+    ref->value = value;
+}
+
+static inline void *sys_atomic_ptr_get(sys_atomic_ptr_t *ref)
+{
+    sys_mutex_lock(ref->lock);
+    void *value = ref->value;
+    sys_mutex_unlock(ref->lock);
+    return value;
+}
+
+static inline void *sys_atomic_ptr_swap(sys_atomic_ptr_t *ref, void *value)
+{
+    sys_mutex_lock(ref->lock);
+    void *prev = ref->value;
+    ref->value = value;
+    sys_mutex_unlock(ref->lock);
+    return prev;
+}
+
+static inline bool sys_atomic_ptr_cas(sys_atomic_ptr_t *ref, void *expected, void *value)
+{
+    sys_mutex_lock(ref->lock);
+    bool swapped = ref->value == expected;
+    if (swapped)
+        ref->value = value;
+    sys_mutex_unlock(ref->lock);
+    return swapped;
+}
+
+static inline void sys_atomic_ptr_destroy(sys_atomic_ptr_t *ref)
+{
+    sys_mutex_lock(ref->lock);
+    sys_mutex_free(ref->lock);
+}
+
 #endif
 
 /** Atomic increase: NOTE returns value *before* increase, like i++ */
@@ -28,6 +28,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /** A bit mask */
 typedef struct qd_bitmask_t qd_bitmask_t;
@@ -48,6 +49,15 @@ int qd_bitmask_value(qd_bitmask_t *b, int bitnum);
 int qd_bitmask_first_set(qd_bitmask_t *b, int *bitnum);
 int qd_bitmask_cardinality(const qd_bitmask_t *b);
 
+/** Set b to the same bits as src. */
+void qd_bitmask_copy(qd_bitmask_t *b, const qd_bitmask_t *src);
+
+/** True if a and b have the same bits set. */
+bool qd_bitmask_equal(const qd_bitmask_t *a, const qd_bitmask_t *b);
+
+/** A hash of the bits set in b; equal masks hash to the same value. */
+uint32_t qd_bitmask_hash(const qd_bitmask_t *b);
+
 bool qd_bitmask_valid_bit_value(int bitnum);
 
 int _qdbm_start(qd_bitmask_t *b);
@@ -39,20 +39,56 @@ extern size_t BUFFER_SIZE;
 struct qd_buffer_t {
     DEQ_LINKS(qd_buffer_t);
     unsigned int size;          ///< Size of data content
+    unsigned int capacity;      ///< Size of the data area (depends on the size class)
     sys_atomic_t bfanout;        // The number of receivers for this buffer
+    sys_atomic_t refs;          ///< Holders of this buffer's data: itself and the buffers viewing it
+    qd_buffer_t *shared;        ///< The buffer whose data this one views, zero if it has its own
+    unsigned int offset;        ///< Where the viewed data starts in the shared buffer
+    bool         spilled;       ///< The buffer is held in a spill file (see qd_buffer_spill)
 };
 
+/**
+ * Buffers come in size classes.  The smallest (base) class has the capacity set by
+ * qd_buffer_set_size; each larger class is a fixed multiple of it.
+ */
+#define QD_BUFFER_SIZE_CLASSES 3
+
 /**
  * Set the initial buffer capacity to be allocated by future calls to qp_buffer.
+ * The capacities of the larger size classes follow from it.
  */
 void qd_buffer_set_size(size_t size);
 
+/**
+ * Back the buffers of all size classes with huge pages where the system provides
+ * them.  This must be called before the first buffer is allocated.
+ *
+ * @return True if huge pages were requested for every size class.
+ */
+bool qd_buffer_use_huge_pages(void);
+
+/**
+ * Return the number of bytes taken by the buffers of all size classes that are
+ * in use, not counting free buffers kept for reuse.
+ */
+size_t qd_buffer_in_use_bytes(void);
+
 /**
  * Create a buffer with capacity set by last call to qd_buffer_set_size(), and data
  * content size of 0 bytes.
  */
 qd_buffer_t *qd_buffer(void);
 
+/**
+ * Create an empty buffer suited to holding a payload of 'hint' octets.  The buffer
+ * is taken from the largest size class whose capacity does not exceed the hint, or
+ * from the base class if the hint is smaller than that, so long payloads occupy few
+ * buffers without leaving much of the last one unused.
+ *
+ * @param hint The number of octets expected to be written
+ */
+qd_buffer_t *qd_buffer_sized(size_t hint);
+
 /**
  * Free a buffer
  * @param buf A pointer to an allocated buffer
@@ -80,6 +116,13 @@ unsigned char *qd_buffer_cursor(qd_buffer_t *buf);
  */
 size_t qd_buffer_capacity(qd_buffer_t *buf);
 
+/**
+ * Return the buffer's total capacity in multiples of the base buffer size.  This is
+ * used to account for buffers of differing size classes in base-buffer units.
+ * @param buf A pointer to an allocated buffer
+ */
+size_t qd_buffer_units(qd_buffer_t *buf);
+
 /**
  * Return the size of the buffers data content.
  * @param buf A pointer to an allocated buffer
@@ -97,7 +140,20 @@ size_t qd_buffer_size(qd_buffer_t *buf);
 void qd_buffer_insert(qd_buffer_t *buf, size_t len);
 
 /**
- * Create a new buffer list by cloning an existing one.
+ * Create a buffer that views len octets of another buffer's data, starting at
+ * offset, without copying them.  The data stays allocated until the buffer and
+ * all of its views are freed.  A view is full, nothing can be appended to it, and
+ * the octets it views must not be modified in place while it exists.
+ *
+ * @param buf A pointer to an allocated buffer, which may itself be a view
+ * @param offset The offset of the first viewed octet in buf's data
+ * @param len The number of octets to view
+ */
+qd_buffer_t *qd_buffer_view(qd_buffer_t *buf, size_t offset, size_t len);
+
+/**
+ * Create a new buffer list by cloning an existing one.  The new buffers are
+ * views of the existing ones, so no data is copied.
  *
  * @param dst A pointer to a list to contain the new buffers
  * @param src A pointer to an existing buffer list
@@ -131,6 +187,46 @@ void qd_buffer_add_fanout(qd_buffer_t *buf);
  */
 size_t qd_buffer_fanout(qd_buffer_t *buf);
 
+/**
+ * A spill file holds buffers whose contents need not stay resident in memory.  It
+ * is an unlinked temporary file, so it disappears when the router exits.
+ */
+typedef struct qd_buffer_spill_t qd_buffer_spill_t;
+
+/**
+ * Create a spill file in the given directory.
+ *
+ * @param directory Directory for the file, /tmp if null
+ * @return The spill file, or null if it could not be created
+ */
+qd_buffer_spill_t *qd_buffer_spill(const char *directory);
+
+/**
+ * Release the caller's hold on a spill file.  The file is closed once every buffer
+ * allocated from it has also been freed.
+ */
+void qd_buffer_spill_free(qd_buffer_spill_t *spill);
+
+/**
+ * Allocate an empty buffer of the largest size class backed by a spill file.  Only
+ * the owner of the spill file may allocate from it; the buffer is freed with
+ * qd_buffer_free like any other and may be freed from any thread.
+ *
+ * @return The buffer, or null if the file could not be extended
+ */
+qd_buffer_t *qd_buffer_spill_alloc(qd_buffer_spill_t *spill);
+
+/**
+ * Drop the resident pages of a spilled buffer once it has been filled.  They are
+ * read back from the file when next touched.  Does nothing for other buffers.
+ */
+void qd_buffer_spill_evict(qd_buffer_t *buf);
+
+/**
+ * Return true if the buffer was allocated from a spill file.
+ */
+bool qd_buffer_is_spilled(const qd_buffer_t *buf);
+
 /**
  * Advance the buffer by len. Does not manipulate the contents of the buffer
  * @param buf A pointer to an allocated buffer
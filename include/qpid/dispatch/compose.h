@@ -24,6 +24,7 @@
 
 /** A linked list of buffers composing a sequence of AMQP data objects. */
 typedef struct qd_composed_field_t qd_composed_field_t;
+typedef struct qd_compose_template_t qd_compose_template_t;
 
 
 /**@file
@@ -238,6 +239,35 @@ void qd_compose_take_buffers(qd_composed_field_t *field,
  */
 void qd_compose_insert_buffers(qd_composed_field_t *field, qd_buffer_list_t *list);
 
+/**
+ * Capture the encoding of a composed field as a reusable template.
+ *
+ * The field may be left with lists or maps still open (for instance a properties
+ * list whose leading constant elements have been inserted).  A field started from
+ * the template resumes composing inside those open composites, and ending them sizes
+ * them as if the whole field had been composed from scratch.  A template is immutable
+ * and may be shared between threads.
+ *
+ * @param field The field to capture.  It is not modified and remains owned by the caller.
+ * @return A new template, freed with ::qd_compose_template_free().
+ */
+qd_compose_template_t *qd_compose_template(const qd_composed_field_t *field);
+
+/**
+ * Begin composing a field with a copy of a template's pre-encoded octets.
+ *
+ * @param tmpl The template.
+ * @param extend An existing field (with no open composites) onto which to append the
+ *        template, or NULL to create a standalone field.
+ * @return A pointer to the field, positioned as the template's field was when captured.
+ */
+qd_composed_field_t *qd_compose_from_template(const qd_compose_template_t *tmpl, qd_composed_field_t *extend);
+
+/**
+ * Free a template created by ::qd_compose_template().
+ */
+void qd_compose_template_free(qd_compose_template_t *tmpl);
+
 /**
  * Bump map field's count and size to reflect opaque bytes that
  * the caller will insert later. The caller knows how many map items
@@ -77,6 +77,7 @@ typedef int  (*qd_container_link_handler_t)        (void *node_context, qd_link_
 typedef int  (*qd_container_link_detach_handler_t) (void *node_context, qd_link_t *link, qd_detach_type_t dt);
 typedef void (*qd_container_node_handler_t)        (void *type_context, qd_node_t *node);
 typedef int  (*qd_container_conn_handler_t)        (void *type_context, qd_connection_t *conn, void *context);
+typedef void (*qd_container_batch_handler_t)       (void *node_context);
 
 /**
  * A set  of Node handlers for deliveries, links and container events.
@@ -115,6 +116,9 @@ typedef struct {
     /** Invoked when a link receives a flow event */
     qd_container_link_handler_t link_flow_handler;
 
+    /** Invoked on the default node when a server thread finishes processing a batch of events */
+    qd_container_batch_handler_t batch_complete_handler;
+
     /** @name Node-Type Handlers
      * @{
      */
@@ -181,6 +185,34 @@ void policy_notify_opened(void *container, qd_connection_t *conn, void *context)
 qd_direction_t qd_link_direction(const qd_link_t *link);
 bool qd_link_is_q2_limit_unbounded(qd_link_t *link);
 void qd_link_set_q2_limit_unbounded(qd_link_t *link, bool q2_limit_unbounded);
+
+/**
+ * Q2 (buffers held by an incoming message, in base-size buffer units) and Q3 (session
+ * outgoing bytes) watermarks for the link, inherited from its listener or connector.
+ */
+size_t qd_link_q2_upper(const qd_link_t *link);
+size_t qd_link_q2_lower(const qd_link_t *link);
+size_t qd_link_q3_upper(const qd_link_t *link);
+
+/**
+ * The link's compression context, created on first use, or 0 if the link's connection
+ * does not compress messages (see qd_connection_compression).
+ */
+struct qd_deflater_t *qd_link_deflater(qd_link_t *link);
+struct qd_inflater_t *qd_link_inflater(qd_link_t *link);
+
+/**
+ * Count a Q2 input holdoff on a receiving link.  The count accumulates until taken.
+ */
+void qd_link_q2_stalled(qd_link_t *link);
+uint32_t qd_link_take_q2_stalls(qd_link_t *link);
+
+/**
+ * Hold back credit from a receiving link whose connection is over its memory limit
+ * (see qd_connection_memory_blocked).  The withheld credit accumulates until taken.
+ */
+void qd_link_withhold_credit(qd_link_t *link, int credit);
+int qd_link_take_withheld_credit(qd_link_t *link);
 pn_snd_settle_mode_t qd_link_remote_snd_settle_mode(const qd_link_t *link);
 qd_connection_t *qd_link_connection(qd_link_t *link);
 pn_link_t *qd_link_pn(qd_link_t *link);
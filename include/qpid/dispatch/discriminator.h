@@ -23,9 +23,17 @@
 #define QD_DISCRIMINATOR_SIZE 16
 
 /**
- * Generate a random discriminator in the supplied string, not to exceed
+ * Draw the per-boot salt that distinguishes this router's discriminators from
+ * those of other routers.  Call once, after seeding random(), before any other
+ * thread generates a discriminator.
+ */
+void qd_discriminator_initialize(void);
+
+/**
+ * Generate a unique discriminator in the supplied string, not to exceed
  * QD_DISCRIMINATOR_SIZE characters.  Such a discriminator may be used in
  * identifiers, addresses, and other situations where a unique string is needed.
+ * Discriminators are never repeated within a process and take no lock.
  */
 void qd_generate_discriminator(char *string);
 
@@ -30,6 +30,11 @@
 typedef struct qd_hash_t        qd_hash_t;
 typedef struct qd_hash_handle_t qd_hash_handle_t;
 
+/**
+ * Create a hash table with an initial capacity of 2^bucket_exponent slots.
+ * The table grows as needed, migrating to the larger size a few slots at a
+ * time during later inserts and removes.  batch_size is unused.
+ */
 qd_hash_t *qd_hash(int bucket_exponent, int batch_size, int value_is_const);
 void qd_hash_free(qd_hash_t *h);
 
@@ -40,6 +45,13 @@ qd_error_t qd_hash_retrieve(qd_hash_t *h, qd_iterator_t *key, void **val);
 qd_error_t qd_hash_retrieve_const(qd_hash_t *h, qd_iterator_t *key, const void **val);
 qd_error_t qd_hash_remove(qd_hash_t *h, qd_iterator_t *key);
 
+/**
+ * Retrieve and insert with a hash already computed by qd_iterator_hash_view on
+ * the key, so that a lookup followed by an insert of the same key hashes it once.
+ */
+qd_error_t qd_hash_retrieve_with_hash(qd_hash_t *h, uint32_t hash, qd_iterator_t *key, void **val);
+qd_error_t qd_hash_insert_with_hash(qd_hash_t *h, uint32_t hash, qd_iterator_t *key, void *val, qd_hash_handle_t **handle);
+
 void qd_hash_handle_free(qd_hash_handle_t *handle);
 const unsigned char *qd_hash_key_by_handle(const qd_hash_handle_t *handle);
 qd_error_t qd_hash_remove_by_handle(qd_hash_t *h, qd_hash_handle_t *handle);
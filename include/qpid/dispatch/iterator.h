@@ -43,6 +43,7 @@
  * @{
  */
 typedef struct qd_iterator_t qd_iterator_t;
+typedef struct qd_iterator_space_t qd_iterator_space_t;
 
 /**
  * Address Hash Prefix Values
@@ -380,18 +381,47 @@ void qd_iterator_annotate_prefix(qd_iterator_t *iter, char prefix);
  */
 void qd_iterator_annotate_space(qd_iterator_t *iter, const char* space, int space_len);
 
+/**
+ * A tenant namespace together with the hash state of the view annotations
+ * that end with it, computed once so that hashing an annotated view only has
+ * to hash the address itself.  Like qd_iterator_annotate_space, the space
+ * string is not copied and must outlive the object.
+ *
+ * @param space Pointer to the first character of the namespace
+ * @param space_len The number of characters in the space string
+ * @return A new qd_iterator_space_t, released with qd_iterator_space_free
+ */
+qd_iterator_space_t *qd_iterator_space(const char *space, int space_len);
+void qd_iterator_space_free(qd_iterator_space_t *space);
+
+/**
+ * Annotate a mobile address view with a tenant namespace as
+ * qd_iterator_annotate_space does, using its precomputed hash state.
+ *
+ * @param iter Pointer to an iterator
+ * @param space The namespace, which must outlive the iterator
+ */
+void qd_iterator_annotate_space_hash(qd_iterator_t *iter, const qd_iterator_space_t *space);
+
 
 /** @} */
 /** \name hash
  * Methods to calculate hash values for iterator views
  *
- * All hashing functions use the djb2 algorithm (http://www.cse.yorku.ca/~oz/hash.html).
+ * All hashing functions consume the view in 64-bit stripes using the xxHash64 round and
+ * avalanche functions.  The hash of any prefix of a view equals the hash of a view trimmed to
+ * that prefix, so segment hashes can be computed in one pass.
  * @{
  */
 
 /**
  * Generate the hash of the view of the iterator.
  *
+ * The result is memoized on the iterator until its view or annotations
+ * change, so repeated lookups with the same iterator hash it only once.
+ * Re-selecting the iterator's current view with qd_iterator_reset_view keeps
+ * the memoized hash.
+ *
  * @param iter A field iterator
  * @return The hash value of the iterator's view
  */
@@ -439,6 +469,20 @@ void qd_iterator_get_view_cursor(
     const qd_iterator_t   *iter,
     qd_iterator_pointer_t *ptr);
 
+/**
+ * Expose the run of view octets that can be read directly from memory.
+ *
+ * Returns the number of octets, starting at the cursor, that lie in the current
+ * buffer (or string) and carry no view annotation (prefix, phase or space).
+ * Zero is returned when the next octet must be read with qd_iterator_octet.
+ * The iterator is not moved; use qd_iterator_advance to consume the octets.
+ *
+ * @param iter A field iterator
+ * @param cursor (output) Address of the first contiguous octet
+ * @return The number of octets readable through cursor
+ */
+uint32_t qd_iterator_contiguous(const qd_iterator_t *iter, const unsigned char **cursor);
+
 /** @} */
 /** @} */
 
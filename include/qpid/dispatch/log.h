@@ -18,6 +18,8 @@
  * specific language governing permissions and limitations
  * under the License.
  */
+#include "config.h"
+#include <qpid/dispatch/atomic.h>
 #include <stdbool.h>
 #include <stdarg.h>
 
@@ -41,14 +43,37 @@ typedef struct qd_log_source_t qd_log_source_t;
 
 qd_log_source_t* qd_log_source(const char *module);
 
+/**@internal
+ * Leading member of every qd_log_source_t.  Holds the source's effective
+ * enable mask (its own, or the DEFAULT source's if it has none) so that the
+ * level check can be made inline without a call into the log module.
+ */
+typedef struct qd_log_source_head_t {
+    sys_atomic_t enabled_mask;
+} qd_log_source_head_t;
+
+/**@internal
+ * True if levels below INFO are compiled out of this build (QD_LOG_COMPILE_OUT_DEBUG).
+ */
+#if QD_LOG_COMPILE_OUT_DEBUG
+#define QD_LOG_LEVEL_COMPILED(level) (((level) & (QD_LOG_TRACE | QD_LOG_DEBUG)) == 0)
+#else
+#define QD_LOG_LEVEL_COMPILED(level) 1
+#endif
+
 /**@internal*/
-bool qd_log_enabled(qd_log_source_t *source, qd_log_level_t level);
+static inline bool qd_log_enabled(qd_log_source_t *source, qd_log_level_t level)
+{
+    if (!QD_LOG_LEVEL_COMPILED(level) || !source) return false;
+    return (sys_atomic_get(&((qd_log_source_head_t *) source)->enabled_mask) & level) != 0;
+}
 /**@internal*/
 void qd_log_impl(qd_log_source_t *source, qd_log_level_t level, const char *file, int line, const char *fmt, ...);
 void qd_vlog_impl(qd_log_source_t *source, qd_log_level_t level, const char *file, int line, const char *fmt, va_list ap);
 
 /** Log a message
  * Note: does not evaluate the format args unless the log message is enabled.
+ * TRACE and DEBUG messages cost nothing when built with QD_LOG_COMPILE_OUT_DEBUG.
  * @param source qd_log_source_t* source of log message.
  * @param level qd_log_level_t log level of message.
  * @param ... printf style format string and arguments.
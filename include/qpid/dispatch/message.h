@@ -39,7 +39,12 @@
 // DISPATCH-807 Queue depth limits
 // upper and lower limits for bang bang hysteresis control
 //
-// Q2 defines the number of buffers allowed in a message's buffer chain
+// These are the defaults.  A listener or connector may set its own with the
+// q2HighWatermark, q2LowWatermark and q3HighWatermark attributes, and the links
+// of its connections inherit them (see qd_link_q2_upper).
+//
+// Q2 defines the number of buffers allowed in a message's buffer chain,
+// counted in base-size buffers (see qd_buffer_units)
 #define QD_QLIMIT_Q2_UPPER 256
 #define QD_QLIMIT_Q2_LOWER 128
 //
@@ -184,6 +189,16 @@ void qd_message_set_trace_annotation(qd_message_t *msg, qd_composed_field_t *tra
  */
 void qd_message_set_to_override_annotation(qd_message_t *msg, qd_composed_field_t *to_field);
 
+/**
+ * Set the to-override annotation from an address composed in advance.  The
+ * buffers are copied, so the same list can be applied to any number of
+ * messages.
+ *
+ * @param msg Pointer to an outgoing message.
+ * @param to_buffers The encoded address string, as taken from a composed field.
+ */
+void qd_message_set_to_override_buffers(qd_message_t *msg, const qd_buffer_list_t *to_buffers);
+
 /**
  * Set a phase for the phase annotation in the message.
  *
@@ -210,6 +225,33 @@ int  qd_message_get_phase_annotation(const qd_message_t *msg);
  */
 void qd_message_set_ingress_annotation(qd_message_t *msg, qd_composed_field_t *ingress_field);
 
+/**
+ * Set the compact encodings of the QD_MA_TRACE and QD_MA_INGRESS fields, sent
+ * in place of the string encodings on links whose connection negotiated
+ * compact annotations.  Ownership of the fields is transferred to the message.
+ *
+ * @param msg Pointer to an outgoing message.
+ * @param trace_field The trace list of compact router identifiers, or null.
+ * @param ingress_field The compact identifier of the ingress router, or null.
+ */
+void qd_message_set_compact_annotations(qd_message_t *msg, qd_composed_field_t *trace_field, qd_composed_field_t *ingress_field);
+
+/**
+ * Set the value for the QD_MA_SEQUENCE field in the outgoing message
+ * annotations for the message.  Ownership of sequence_field is transferred to
+ * the message.
+ *
+ * @param msg Pointer to an outgoing message.
+ * @param sequence_field Pointer to a composed string identifying this multicast
+ * message: the assigning router's id and its sequence number.
+ */
+void qd_message_set_sequence_annotation(qd_message_t *msg, qd_composed_field_t *sequence_field);
+
+/**
+ * True if an outgoing QD_MA_SEQUENCE annotation has been set on the message.
+ */
+bool qd_message_has_sequence_annotation(const qd_message_t *msg);
+
 /**
  * Receive message data frame by frame via a delivery.  This function may be called more than once on the same
  * delivery if the message spans multiple frames. Always returns a message. The message buffers are filled up to the point with the data that was been received so far.
@@ -263,6 +305,18 @@ ssize_t qd_message_field_copy(qd_message_t *msg, qd_message_field_t field, char
 // Functions for composed messages
 //
 
+/**
+ * Begin composing a message originated by the router: a non-durable header section
+ * followed by a properties list that is left open after its null message-id and
+ * user-id.  The caller continues with the "to" field and ends the list.
+ *
+ * The fixed part is copied from an encoding prepared once at startup rather than
+ * composed for each message.
+ *
+ * @return A new composed field.
+ */
+qd_composed_field_t *qd_message_start_properties(void);
+
 // Convenience Functions
 void qd_message_compose_1(qd_message_t *msg, const char *to, qd_buffer_list_t *buffers);
 void qd_message_compose_2(qd_message_t *msg, qd_composed_field_t *content);
@@ -276,6 +330,16 @@ char* qd_message_repr(qd_message_t *msg, char* buffer, size_t len, qd_log_bits l
 /** Recommended buffer length for qd_message_repr */
 int qd_message_repr_len();
 
+/**
+ * A message holding copies of only msg's properties and application-properties
+ * sections, which qd_message_repr formats as it would msg.  It shares nothing
+ * with msg, so it may be formatted on another thread after msg's buffers have
+ * been sent and freed.
+ *
+ * @return The copy, or 0 if the sections have not all arrived.
+ */
+qd_message_t *qd_message_repr_snapshot(qd_message_t *msg);
+
 qd_log_source_t* qd_message_log_source();
 
 /**
@@ -310,6 +374,14 @@ qd_parsed_field_t *qd_message_get_to_override(qd_message_t *msg);
  */
 qd_parsed_field_t *qd_message_get_trace      (qd_message_t *msg);
 
+/**
+ * Accessor for message field sequence
+ *
+ * @param msg A pointer to the message
+ * @return the parsed field
+ */
+qd_parsed_field_t *qd_message_get_sequence   (qd_message_t *msg);
+
 /**
  * Accessor for message field phase
  * 
@@ -343,6 +415,14 @@ void qd_message_set_discard(qd_message_t *msg, bool discard);
  */
 bool qd_message_receive_complete(qd_message_t *msg);
 
+/**
+ * Return an identifier for the message content, shared by the inbound message
+ * and all of its copies.  Used to correlate delivery trace events.
+ *
+ * @param msg A pointer to the message.
+ */
+uint64_t qd_message_trace_id(const qd_message_t *msg);
+
 /**
  * Returns true if the message has been completely received AND the message has been completely sent.
  */
@@ -359,6 +439,21 @@ bool qd_message_tag_sent(qd_message_t *msg);
  */
 void qd_message_set_tag_sent(qd_message_t *msg, bool tag_sent);
 
+/**
+ * Get the number of octets of content the message holds in its buffer chain.
+ *
+ * @param msg A pointer to the message.
+ */
+size_t qd_message_buffered_size(qd_message_t *msg);
+
+/**
+ * Get the number of octets of the message written to the outgoing link so far,
+ * counted before any compression.
+ *
+ * @param msg A pointer to the message.
+ */
+size_t qd_message_octets_sent(qd_message_t *msg);
+
 /**
  * Get the number of receivers for this message.
  *
@@ -379,6 +474,18 @@ void qd_message_add_fanout(qd_message_t *msg);
  */
 void qd_message_add_num_closed_receivers(qd_message_t *in_msg);
 
+/**
+ * Enable spill mode for messages being received.  Once the buffers held by a
+ * message exceed the threshold, further buffers are allocated from a temporary
+ * file and dropped from memory once filled, so that a large message forwarded to
+ * a slow consumer does not stay resident.  Buffers are still released as soon
+ * as they have been sent to every receiver.
+ *
+ * @param threshold Bytes held in memory per message before spilling, or 0 to disable
+ * @param directory Directory for the spill files (/tmp if null).  Must remain valid.
+ */
+void qd_message_set_spill(size_t threshold, const char *directory);
+
 /**
  * Disable the Q2-holdoff for this message.
  *
@@ -426,6 +533,15 @@ bool qd_message_aborted(const qd_message_t *msg);
  */
 void qd_message_set_aborted(const qd_message_t *msg, bool aborted);
 
+/**
+ * Hash the message's group-id, locating it through the properties index.
+ *
+ * @param msg A pointer to the message
+ * @param hash Set to the hash of the group-id's value
+ * @return False if the message has no group-id or its properties have not arrived yet.
+ */
+bool qd_message_group_hash(qd_message_t *msg, uint32_t *hash);
+
 /**
  * Return message priority
  * @param msg A pointer to the message
@@ -433,6 +549,16 @@ void qd_message_set_aborted(const qd_message_t *msg, bool aborted);
  */
 uint8_t qd_message_get_priority(qd_message_t *msg);
 
+/**
+ * Return when the message expires, in milliseconds since the epoch as
+ * qd_timer_now() counts them: the earlier of its absolute-expiry-time and
+ * the end of its header ttl, measured from the first call.  The result is
+ * worked out once and kept with the message content.
+ * @param msg A pointer to the message
+ * @return The expiry time, or 0 if the message does not expire
+ */
+int64_t qd_message_expiry(qd_message_t *msg);
+
 
 ///@}
 
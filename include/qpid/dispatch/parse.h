@@ -89,6 +89,46 @@ const char * qd_parse_turbo(
                        uint32_t               *user_entries,
                        uint32_t               *user_bytes);
 
+/**
+ * Locate the values of a set of keys in an AMQP map in a single skeletal pass.
+ * Like qd_parse_turbo it builds no parse tree and allocates nothing, so it
+ * suits lookups of a few keys in properties maps such as application-properties.
+ *
+ * Only string and symbol keys are compared; other keys are skipped.  If a key
+ * appears more than once the first occurrence is returned.
+ *
+ * @param iter Field iterator for the map, positioned at its tag
+ * @param keys The keys to look for
+ * @param key_count Number of keys
+ * @param values Array of key_count descriptors: values[i] describes the value
+ *        of keys[i] with bufptr at its tag, or is zeroed if the map does not
+ *        hold the key
+ * @return 0 if success else pointer to error string
+ */
+const char *qd_parse_map_locate(qd_iterator_t      *iter,
+                                const char * const *keys,
+                                int                 key_count,
+                                qd_parsed_turbo_t  *values);
+
+/**
+ * True if a value located by qd_parse_map_locate is a string or symbol equal
+ * to text.
+ */
+bool qd_parse_turbo_equal(const qd_parsed_turbo_t *value, const unsigned char *text);
+
+/**
+ * Locate the payload of a located value: the octets after its tag, size and
+ * count, as qd_parse_raw would iterate.
+ */
+void qd_parse_turbo_raw(const qd_parsed_turbo_t *value, qd_iterator_pointer_t *raw);
+
+/**
+ * Parse a value located by qd_parse_map_locate.
+ *
+ * @return A parsed field, freed with qd_parse_free, or 0 if the value is absent.
+ */
+qd_parsed_field_t *qd_parse_turbo_value(const qd_parsed_turbo_t *value);
+
 /**
  * Free the resources associated with a parsed field.
  *
@@ -301,6 +341,43 @@ void qd_parse_annotations(
     qd_iterator_pointer_t *blob_pointer,
     uint32_t              *blob_item_count);
 
+/**
+ * Locate the router entries of a message annotation map without parsing them.
+ * This is the skeletal scan behind qd_parse_annotations: it returns the same
+ * blob pointer and count for the user entries, and a pointer to the encoded
+ * value of each router entry (buffer is null if the entry is absent), but it
+ * builds no parse trees.  A value may be parsed later with
+ * qd_parse_annotation_value.
+ *
+ * @param strip_annotations_in strip inbound annotations
+ * @param ma_iter_in Field iterator for the annotation map field being parsed.
+ * @param ma_ingress returned value pointer: ingress
+ * @param ma_phase returned value pointer: phase
+ * @param ma_to_override returned value pointer: override
+ * @param ma_trace returned value pointer: trace
+ * @param ma_sequence returned value pointer: multicast sequence
+ * @param blob_pointer returned buffer pointer to user's annotation blob
+ * @param blob_item_count number of map entries referenced by blob_iterator
+ */
+void qd_parse_annotations_locate(
+    bool                   strip_annotations_in,
+    qd_iterator_t         *ma_iter_in,
+    qd_iterator_pointer_t *ma_ingress,
+    qd_iterator_pointer_t *ma_phase,
+    qd_iterator_pointer_t *ma_to_override,
+    qd_iterator_pointer_t *ma_trace,
+    qd_iterator_pointer_t *ma_sequence,
+    qd_iterator_pointer_t *blob_pointer,
+    uint32_t              *blob_item_count);
+
+/**
+ * Parse a router annotation value located by qd_parse_annotations_locate.
+ *
+ * @param value Value pointer returned by qd_parse_annotations_locate.
+ * @return A parsed field owned by the caller, or null if the value is absent.
+ */
+qd_parsed_field_t *qd_parse_annotation_value(const qd_iterator_pointer_t *value);
+
 ///@}
 
 #endif
@@ -77,12 +77,31 @@ qd_error_t qd_py_to_composed(PyObject *value, qd_composed_field_t *field);
 PyObject *qd_field_to_py(qd_parsed_field_t *field);
 
 /**
- * These are temporary and will eventually be replaced by having an internal python
- * work queue that feeds a dedicated embedded-python thread.
+ * The parts of the router that run embedded python.  The time each holds the
+ * python lock is accounted separately: a single long hold is logged as a warning
+ * and the totals are logged periodically at debug level.
+ */
+typedef enum {
+    QD_PYTHON_CALLER_STARTUP,  ///< Module setup and configuration loading
+    QD_PYTHON_CALLER_ROUTER,   ///< The routing protocol: its tick, link loss and messages
+    QD_PYTHON_CALLER_AGENT,    ///< The management agent, on the python worker thread
+    QD_PYTHON_CALLER_POLICY,   ///< Connection policy lookups and closes
+    QD_PYTHON_CALLER_COUNT
+} qd_python_caller_t;
+
+/**
+ * The lock serializing all use of the embedded interpreter.
  */
 typedef PyGILState_STATE qd_python_lock_state_t;
-qd_python_lock_state_t qd_python_lock(void);
+qd_python_lock_state_t qd_python_lock(qd_python_caller_t caller);
 void qd_python_unlock(qd_python_lock_state_t state);
 void qd_python_check_lock(void);
 
+/**
+ * Stop the python worker thread, which runs the handlers of IoAdapters created
+ * with threaded=True (the management agent).  Messages still queued for it are
+ * dropped.  Called before the router core is freed.
+ */
+void qd_python_worker_stop(void);
+
 #endif
@@ -71,6 +71,44 @@ void qdr_core_free(qdr_core_t *core);
  */
 void qdr_process_tick(qdr_core_t *core);
 
+/**
+ * qdr_action_batch_begin
+ *
+ * Start holding the core actions generated by the calling thread so they can be
+ * handed to the core thread together.  Until qdr_action_batch_end is called, actions are kept in thread-local
+ * storage in the order they were issued.  Long batches are handed over in
+ * bounded chunks so the core is not starved.  Calling this function while a batch is
+ * already open on the thread has no effect.
+ *
+ * This is intended for I/O threads processing a proactor event batch.  The caller
+ * must guarantee that qdr_action_batch_end is called on the same thread before it
+ * blocks waiting for more events.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ */
+void qdr_action_batch_begin(qdr_core_t *core);
+
+/**
+ * qdr_action_batch_end
+ *
+ * Hand all actions held by the calling thread to the core thread in a single
+ * operation, waking the core at most once, and close the thread's batch.  This is
+ * a no-op if no batch is open on the calling thread.
+ */
+void qdr_action_batch_end(void);
+
+/**
+ * qdr_delivery_cleanup_drain
+ *
+ * Free the messages of settled deliveries that were received on the calling server
+ * thread and have since been released by the core.  Doing this on the receiving
+ * thread returns the message buffers to that thread's local allocation pool.
+ * Server threads should call this after every event batch.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ */
+void qdr_delivery_cleanup_drain(qdr_core_t *core);
+
 
 /**
  ******************************************************************************
@@ -85,9 +123,31 @@ void qdr_core_set_next_hop(qdr_core_t *core, int router_maskbit, int nh_router_m
 void qdr_core_remove_next_hop(qdr_core_t *core, int router_maskbit);
 void qdr_core_set_cost(qdr_core_t *core, int router_maskbit, int cost);
 void qdr_core_set_valid_origins(qdr_core_t *core, int router_maskbit, qd_bitmask_t *routers);
+
+/**
+ * Set the neighbors that begin the equal-cost shortest paths to a router, for
+ * anycast forwarding.  The core takes ownership of next_hops; a set with fewer
+ * than two routers leaves the router with its single next hop.
+ */
+void qdr_core_set_equal_cost_hops(qdr_core_t *core, int router_maskbit, qd_bitmask_t *next_hops);
 void qdr_core_map_destination(qdr_core_t *core, int router_maskbit, const char *address_hash, int treatment_hint);
 void qdr_core_unmap_destination(qdr_core_t *core, int router_maskbit, const char *address_hash);
 
+/**
+ * qdr_core_route_table_begin
+ *
+ * Start a route table transaction.  Until the matching qdr_core_route_table_commit, the
+ * route table maintenance calls above are held instead of being handed to the core one
+ * action at a time.  The commit passes them to the core as a single action that applies
+ * them in order, so forwarding never sees a partly updated table.  Transactions nest;
+ * only the outermost commit passes the updates on.  Both calls must be made on the
+ * thread that makes the updates.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ */
+void qdr_core_route_table_begin(qdr_core_t *core);
+void qdr_core_route_table_commit(qdr_core_t *core);
+
 typedef void (*qdr_mobile_added_t)   (void *context, const char *address_hash, qd_address_treatment_t treatment);
 typedef void (*qdr_mobile_removed_t) (void *context, const char *address_hash);
 typedef void (*qdr_link_lost_t)      (void *context, int link_maskbit);
@@ -98,6 +158,68 @@ void qdr_core_route_table_handlers(qdr_core_t           *core,
                                    qdr_mobile_removed_t  mobile_removed,
                                    qdr_link_lost_t       link_lost);
 
+/**
+ ******************************************************************************
+ * Configuration snapshot functions
+ ******************************************************************************
+ */
+typedef struct qdr_config_snapshot_t qdr_config_snapshot_t;
+
+/**
+ * What a configured address pattern says about the addresses it matches.
+ */
+typedef struct qdr_address_config_info_t {
+    qd_address_treatment_t treatment;
+    int                    in_phase;
+    int                    out_phase;
+    int                    priority;
+} qdr_address_config_info_t;
+
+/**
+ * qdr_config_snapshot
+ *
+ * Take a reference to the current snapshot of the configured address and
+ * link-route patterns.  A snapshot never changes, so it may be searched on any
+ * thread without calling into the core; the core publishes a new one after
+ * the patterns change.  Release the reference with qdr_config_snapshot_decref.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ * @return The current snapshot, never null
+ */
+qdr_config_snapshot_t *qdr_config_snapshot(qdr_core_t *core);
+void qdr_config_snapshot_decref(qdr_config_snapshot_t *snap);
+
+/**
+ * qdr_config_snapshot_address
+ *
+ * Find the configured address pattern that best matches an address, as the
+ * core would when binding a link to it.  The iterator's view is left as it was.
+ *
+ * @param snap A snapshot returned by qdr_config_snapshot
+ * @param address The address to look up
+ * @param space The vhost of the connection, or null if none
+ * @param space_len The length of space
+ * @param info If not null, filled in with the matching pattern's settings
+ * @return True if a pattern matches the address
+ */
+bool qdr_config_snapshot_address(qdr_config_snapshot_t     *snap,
+                                 qd_iterator_t             *address,
+                                 const char                *space,
+                                 int                        space_len,
+                                 qdr_address_config_info_t *info);
+
+/**
+ * qdr_config_snapshot_link_routed
+ *
+ * Report whether a link route pattern for a direction matches an address.
+ * Arguments are as for qdr_config_snapshot_address.
+ */
+bool qdr_config_snapshot_link_routed(qdr_config_snapshot_t *snap,
+                                     qd_iterator_t         *address,
+                                     const char            *space,
+                                     int                    space_len,
+                                     qd_direction_t         dir);
+
 /**
  ******************************************************************************
  * In-process messaging functions
@@ -153,7 +275,8 @@ typedef enum {
     QDR_ROLE_NORMAL,
     QDR_ROLE_INTER_ROUTER,
     QDR_ROLE_ROUTE_CONTAINER,
-    QDR_ROLE_EDGE_CONNECTION
+    QDR_ROLE_EDGE_CONNECTION,
+    QDR_ROLE_INTER_ROUTER_DATA  ///< Extra data-only connection to a peer already reached by an inter-router connection
 } qdr_connection_role_t;
 
 typedef void (*qdr_connection_bind_context_t) (qdr_connection_t *context, void* token);
@@ -229,6 +352,24 @@ void *qdr_connection_get_context(const qdr_connection_t *conn);
  */
 const char *qdr_connection_get_tenant_space(const qdr_connection_t *conn, int *len);
 
+/**
+ * qdr_connection_set_compression_stats
+ *
+ * Record the compression counts of a connection for management, as the
+ * {message, wire} bytes received and sent compressed.  Called from the
+ * thread that owns the connection.
+ */
+void qdr_connection_set_compression_stats(qdr_connection_t *conn, const uint64_t in[2], const uint64_t out[2]);
+
+/**
+ * qdr_connection_set_frame_stats
+ *
+ * Record the frame size a connection advertised and the {in, out} counts of
+ * its frames and of the message octets they carried, for management.  Called
+ * from the thread that owns the connection.
+ */
+void qdr_connection_set_frame_stats(qdr_connection_t *conn, uint32_t max_frame_size, const uint64_t frames[2], const uint64_t octets[2]);
+
 /**
  * qdr_connection_process
  *
@@ -568,6 +709,13 @@ bool qdr_link_strip_annotations_out(const qdr_link_t *link);
  */
 void qdr_link_stalled_outbound(qdr_link_t *link);
 
+/**
+ * qdr_link_stalled_inbound
+ *
+ * Count Q2 input holdoffs taken by messages arriving on this link.
+ */
+void qdr_link_stalled_inbound(qdr_link_t *link, uint32_t count);
+
 /**
  * qdr_link_name
  *
@@ -656,6 +804,20 @@ qdr_delivery_t *qdr_link_deliver(qdr_link_t *link, qd_message_t *msg, qd_iterato
 qdr_delivery_t *qdr_link_deliver_to(qdr_link_t *link, qd_message_t *msg,
                                     qd_iterator_t *ingress, qd_iterator_t *addr,
                                     bool settled, qd_bitmask_t *link_exclusion, int ingress_index);
+
+/**
+ * qdr_link_deliver_presettled
+ *
+ * Deliver a pre-settled, completely received message to the router core for forwarding.
+ * No qdr_delivery is returned: the caller settles the proton delivery right away and
+ * the router core is the delivery's only owner.
+ *
+ * @param addr The destination address for an anonymous link, or 0 to use the link's address.
+ *             Other parameters are as for qdr_link_deliver.
+ */
+void qdr_link_deliver_presettled(qdr_link_t *link, qd_message_t *msg,
+                                 qd_iterator_t *ingress, qd_iterator_t *addr,
+                                 qd_bitmask_t *link_exclusion, int ingress_index);
 qdr_delivery_t *qdr_link_deliver_to_routed_link(qdr_link_t *link, qd_message_t *msg, bool settled,
                                                 const uint8_t *tag, int tag_length,
                                                 uint64_t disposition, pn_data_t* disposition_state);
@@ -700,6 +862,18 @@ void qdr_connection_handlers(qdr_core_t             *core,
 void qdr_delivery_update_disposition(qdr_core_t *core, qdr_delivery_t *delivery, uint64_t disp,
                                      bool settled, qdr_error_t *error, pn_data_t *ext_state, bool ref_given);
 
+/**
+ * qdr_delivery_update_dispositions
+ *
+ * Like qdr_delivery_update_disposition, but when called inside an action batch
+ * (see qdr_action_batch_begin) the update joins a single vector action shared by
+ * the consecutive updates from the same connection.  Runs of updates from one link
+ * with the same outcome are carried as one range.  The caller keeps its own
+ * reference to the delivery.
+ */
+void qdr_delivery_update_dispositions(qdr_core_t *core, qdr_delivery_t *delivery, uint64_t disp,
+                                      bool settled, qdr_error_t *error, pn_data_t *ext_state);
+
 void qdr_delivery_set_context(qdr_delivery_t *delivery, void *context);
 void *qdr_delivery_get_context(qdr_delivery_t *delivery);
 qdr_link_t *qdr_delivery_link(const qdr_delivery_t *delivery);
@@ -736,7 +910,8 @@ typedef enum {
     QD_ROUTER_EXCHANGE,
     QD_ROUTER_BINDING,
     QD_ROUTER_FORBIDDEN,
-    QD_ROUTER_CONN_LINK_ROUTE
+    QD_ROUTER_CONN_LINK_ROUTE,
+    QD_ROUTER_CORE_ACTION
 } qd_router_entity_type_t;
 
 typedef struct qdr_query_t qdr_query_t;
@@ -773,6 +948,61 @@ void qdr_manage_create(qdr_core_t *core, void *context, qd_router_entity_type_t
 void qdr_manage_delete(qdr_core_t *core, void *context, qd_router_entity_type_t type,
                        qd_iterator_t *name, qd_iterator_t *identity, uint64_t in_conn);
 
+/**
+ * qdr_manage_bulk_create
+ *
+ * Request that each entity of a list be created in the router core, all in one
+ * core action.  Each is created as by qdr_manage_create, named by its own name
+ * attribute.  The response body is a list holding, in the order of the
+ * request, a map for each entity with its statusCode and statusDescription and,
+ * if it was created, its attributes.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ * @param context An opaque context that will be passed back in the invocation of the response callback
+ * @param type The entity type of the entities to create
+ * @param in_body The body of the request message, a list of attribute maps, freed by the core
+ * @param out_body A composed field for the body of the response message
+ * @param in_conn The identity of the connection over which the mgmt message arrived
+ */
+void qdr_manage_bulk_create(qdr_core_t *core, void *context, qd_router_entity_type_t type,
+                            qd_parsed_field_t *in_body, qd_composed_field_t *out_body, uint64_t in_conn);
+
+/**
+ * qdr_manage_bulk_delete
+ *
+ * Request the deletion of each entity of a list in one core action.  Each map
+ * of the list names the entity to delete by its identity or name, and the
+ * response body is a list of results as for qdr_manage_bulk_create.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ * @param context An opaque context that will be passed back in the invocation of the response callback
+ * @param type The entity type of the entities to delete
+ * @param in_body The body of the request message, a list of maps, freed by the core
+ * @param out_body A composed field for the body of the response message
+ * @param in_conn The identity of the connection over which the mgmt message arrived
+ */
+void qdr_manage_bulk_delete(qdr_core_t *core, void *context, qd_router_entity_type_t type,
+                            qd_parsed_field_t *in_body, qd_composed_field_t *out_body, uint64_t in_conn);
+
+/**
+ * qdr_manage_summary
+ *
+ * Request a compact summary of the router's traffic: its connection, link and
+ * address counts, delivery counters and rates, and settlement latency
+ * percentiles, as a map.  With edges set, an interior router asks each of its
+ * connected edge routers for its summary and answers with their merge, along
+ * with the number of edges asked and the ids of any that did not answer.
+ *
+ * @param core Pointer to the core object returned by qd_core()
+ * @param context An opaque context that will be passed back in the invocation of the response callback
+ * @param type The entity type, which must be the router
+ * @param edges True to merge the summaries of the connected edges
+ * @param out_body A composed field for the body of the response message
+ * @param in_conn The identity of the connection over which the mgmt message arrived
+ */
+void qdr_manage_summary(qdr_core_t *core, void *context, qd_router_entity_type_t type, bool edges,
+                        qd_composed_field_t *out_body, uint64_t in_conn);
+
 /**
  * qdr_manage_read
  *
@@ -815,7 +1045,8 @@ void qdr_manage_update(qdr_core_t *core, void *context, qd_router_entity_type_t
  *
  * 1) Locate the attributeNames field in the body of the QUERY request
  * 2) Create a composed field for the body of the reply message
- * 3) Call qdr_manage_query with the attributeNames field and the response body
+ * 3) Call qdr_manage_query with the attributeNames field and the response body,
+ *    then qdr_query_set_filter if the request carries a filter map
  * 4) Start the body map, add the "attributeNames" key
  * 5) Call qdr_query_add_attribute_names.  This will add the attribute names list
  * 6) Add the "results" key, start the outer list
@@ -829,6 +1060,14 @@ qdr_query_t *qdr_manage_query(qdr_core_t *core, void *context, qd_router_entity_
                               qd_parsed_field_t *attribute_names, qd_composed_field_t *body,
                               uint64_t in_conn);
 void qdr_query_add_attribute_names(qdr_query_t *query);
+
+/**
+ * Restrict the results of an address, link or connection query to the rows
+ * whose attributes equal every value of the filter map {attributeName: value}.
+ * Values are compared by their text form, so 5 matches any integer type.  An
+ * unknown attribute matches no rows.  Ignored for other entity types.
+ */
+void qdr_query_set_filter(qdr_query_t *query, qd_parsed_field_t *filter);
 void qdr_query_get_first(qdr_query_t *query, int offset);
 void qdr_query_get_next(qdr_query_t *query);
 void qdr_query_free(qdr_query_t *query);
@@ -851,6 +1090,10 @@ qdr_connection_info_t *qdr_connection_info(bool             is_encrypted,
                                            bool             ssl);
 
 
+/// Cumulative delivery latency buckets reported in qdr_global_stats_t: bucket i
+/// counts the deliveries settled less than 2^i microseconds after arrival.
+#define QDR_LATENCY_METRIC_BUCKETS 24
+
 typedef struct {
     size_t connections;
     size_t links;
@@ -869,9 +1112,55 @@ typedef struct {
     size_t deliveries_transit;
     size_t deliveries_ingress_route_container;
     size_t deliveries_egress_route_container;
+    size_t overload_level;
+    size_t credit_withheld;
+    uint64_t delivery_latency_count;
+    uint64_t delivery_latency_usec_sum;
+    uint64_t delivery_latency_buckets[QDR_LATENCY_METRIC_BUCKETS];
 }  qdr_global_stats_t;
 ALLOC_DECLARE(qdr_global_stats_t);
 typedef void (*qdr_global_stats_handler_t) (void *context);
 void qdr_request_global_stats(qdr_core_t *core, qdr_global_stats_t *stats, qdr_global_stats_handler_t callback, void *context);
 
+/// Per-entity metrics, read from the core a batch at a time so that a scrape
+/// never holds more than one batch of rows.
+#define QDR_ENTITY_METRICS_BATCH    32
+#define QDR_ENTITY_METRICS_LABEL    128
+#define QDR_ENTITY_METRICS_COUNTERS 9
+
+typedef enum {
+    QDR_ENTITY_METRICS_ADDRESS,     ///< deliveries ingress, egress, transit, to container, from container
+    QDR_ENTITY_METRICS_LINK,        ///< deliveries, undelivered, unsettled, presettled, dropped presettled,
+                                    ///< accepted, rejected, released, modified
+    QDR_ENTITY_METRICS_CONNECTION   ///< links, deliveries sent, bytes sent
+} qdr_entity_metrics_type_t;
+
+typedef struct {
+    uint64_t    identity;                         ///< Links and connections
+    char        name[QDR_ENTITY_METRICS_LABEL];   ///< Address; owning address of a link; host of a connection
+    const char *kind;                             ///< Static string: link direction, connection role
+    uint64_t    counters[QDR_ENTITY_METRICS_COUNTERS];
+    bool        has_latency;                      ///< Addresses and outgoing links that have settled deliveries
+    uint64_t    latency_count;
+    uint64_t    latency_usec_sum;
+    uint64_t    latency_buckets[QDR_LATENCY_METRIC_BUCKETS];  ///< As in qdr_global_stats_t
+} qdr_entity_metrics_t;
+
+typedef struct {
+    qdr_entity_metrics_type_t type;
+    int                       count;    ///< Rows filled by the last request
+    int                       total;    ///< Rows of this listing so far, at most the router's metricsSeriesLimit
+    bool                      more;     ///< False once the listing is complete
+    qdr_query_t              *cursor;   ///< Position in the listing, 0 to start one
+    qdr_entity_metrics_t      rows[QDR_ENTITY_METRICS_BATCH];
+} qdr_entity_metrics_batch_t;
+
+/**
+ * Fill batch with the next rows of its listing and invoke callback on a
+ * general work thread.  To start a listing set type, total = 0 and cursor = 0.
+ * The core releases the cursor when the listing completes; if it is abandoned
+ * before, free it with qdr_query_free.
+ */
+void qdr_request_entity_metrics(qdr_core_t *core, qdr_entity_metrics_batch_t *batch, qdr_global_stats_handler_t callback, void *context);
+
 #endif
@@ -24,6 +24,7 @@
 #include <proton/engine.h>
 #include <proton/event.h>
 #include <proton/ssl.h>
+#include <stdint.h>
 
 struct qd_container_t;
 
@@ -63,6 +64,45 @@ typedef void (*qd_deferred_t)(void *context, bool discard);
 void qd_server_run(qd_dispatch_t *qd);
 
 
+/**
+ * Return the index of the calling server worker thread.
+ *
+ * Worker threads are numbered from zero up to (but not including) the configured
+ * worker thread count.  This is useful for keeping per-thread state outside the
+ * server.
+ *
+ * @return The index of the calling thread or -1 if it is not a server worker thread.
+ */
+int qd_server_thread_index(void);
+
+
+#define QD_SERVER_EVENT_TYPES 64   ///< Event type counters, the last also counts higher types
+
+/**
+ * Utilization and event counters of one server thread.  Each thread updates its
+ * own counters after every event batch; they are exposed as the workerThread
+ * management entity and on the metrics endpoint.
+ */
+typedef struct qd_server_thread_stats_t {
+    int      index;             ///< qd_server_thread_index() of the thread
+    bool     dispatcher;        ///< Hands connection batches to the workers (workerConnectionAffinity)
+    uint64_t busy_usec;         ///< Time spent handling event batches
+    uint64_t idle_usec;         ///< Time between batches
+    uint64_t batch_usec_max;    ///< Longest batch
+    uint64_t batches;
+    uint64_t events;
+    uint64_t deliveries_in;     ///< Deliveries received from links
+    uint64_t deliveries_out;    ///< Deliveries sent on links
+    uint64_t event_types[QD_SERVER_EVENT_TYPES];  ///< Events by pn_event_type_t
+} qd_server_thread_stats_t;
+
+/**
+ * Count a delivery received (incoming) or sent by the calling server thread.
+ * No effect on other threads.
+ */
+void qd_server_count_delivery(bool incoming);
+
+
 /**
  * Tells the server to stop but doesn't wait for server to exit.
  * The call to qd_server_run() will exit when all server threads have exited.
@@ -128,10 +168,15 @@ typedef struct qd_server_config_t {
 
     /**
      * Protocol family that the socket will use when binding listener or connector.
-     * Possible values are IPv4 or IPv6. If not specified, the protocol family will be automatically determined from the address
+     * Possible values are IPv4, IPv6 or local. If not specified, the protocol family will be automatically determined from the address
      */
     char *protocol_family;
 
+    /**
+     * Listen on the Unix domain socket named by host rather than on a network address.
+     */
+    bool local;
+
     /**
      * Export metrics.
      */
@@ -174,6 +219,11 @@ typedef struct qd_server_config_t {
          * Hostname to set on sasl-init sent to authentication service.
          */
         char *sasl_init_hostname;
+        /**
+         * Seconds for which successful single-step authentications and the
+         * service's mechanisms are remembered, zero for no caching.
+         */
+        int cache_seconds;
         bool use_ssl;
         //ssl config for sasl auth plugin:
         char *ssl_certificate_file;
@@ -253,6 +303,36 @@ typedef struct qd_server_config_t {
      */
     int link_capacity;
 
+    /**
+     * Q2 watermarks: the number of base-size buffers an incoming message may hold before
+     * reading from its link is held off, and the number it must drain below before reading
+     * resumes.  Zero selects the compiled-in default (see message.h).
+     */
+    size_t q2_upper;
+    size_t q2_lower;
+
+    /**
+     * Q3 watermark: the number of outgoing bytes a session may buffer before senders on its
+     * links stall.  Zero selects the compiled-in default.
+     */
+    size_t q3_upper;
+
+    /**
+     * Offer compression of message bytes to the peer router.  Messages that have fully
+     * arrived and are smaller than compression_min_bytes are sent uncompressed.
+     */
+    bool   compression;
+    size_t compression_min_bytes;
+
+    /**
+     * Session window autotuning bounds, in octets.  With session_window_max set the
+     * connection sizes its links' Q3 watermark and its sessions' incoming capacity from
+     * the rate each direction drains and the round trip to the peer, between these
+     * bounds, in place of q3_upper and incoming_capacity.
+     */
+    size_t session_window_min;
+    size_t session_window_max;
+
     /**
      * Path to the file containing the PEM-formatted public certificate for the local end
      * of the connection.
@@ -289,6 +369,11 @@ typedef struct qd_server_config_t {
      */
     char *ssl_profile;
 
+    /**
+     * TLS session resumption counters of the related ssl profile, shared with it.
+     */
+    struct qd_tls_session_stats_t *ssl_session_stats;
+
     /**
      * Full path to the file that contains the uid to display name mapping.
      */
@@ -359,6 +444,13 @@ typedef struct qd_server_config_t {
      */
     uint32_t max_frame_size;
 
+    /**
+     * Frame size autotuning lower bound, for connectors.  When non-zero each new connection
+     * advertises the smallest power of two that carries most of the messages earlier
+     * connections received in one frame, between this and max_frame_size.
+     */
+    uint32_t max_frame_size_min;
+
     /**
      * The max_sessions value is the number of sessions allowed on the Connection. 
      */
@@ -378,6 +470,21 @@ typedef struct qd_server_config_t {
      */
     int idle_timeout_seconds;
 
+    /**
+     * If non-zero, the idle timeout in milliseconds, overriding idle_timeout_seconds.  The peer
+     * sends heartbeat frames at half this interval, so a short value detects a failed
+     * inter-router connection well within a second.
+     */
+    int liveness_timeout_ms;
+
+    /**
+     * If non-zero, a connector with several failover entries, or whose host resolves to several
+     * addresses, races connection attempts to them rather than trying one at a time.  A new
+     * attempt starts every connect_race_ms milliseconds (or as soon as the pending ones have all
+     * failed), the first to open is kept and the others are closed.
+     */
+    int connect_race_ms;
+
     /**
      * The timeout, in seconds, for the initial connection handshake.  If a connection is established
      * inbound (via a listener) and the timeout expires before the OPEN frame arrives, the connection
@@ -385,6 +492,21 @@ typedef struct qd_server_config_t {
      */
     int initial_handshake_timeout_seconds;
 
+    /**
+     * Admission pacing for listeners.  At most accept_rate new connections (and, on a listener
+     * with an SSL profile, tls_accept_rate TLS handshakes) are started per second; accepts beyond
+     * that wait, up to max_pending_accepts of them, and any further ones are refused.  A rate of
+     * zero disables the corresponding limit.
+     */
+    int accept_rate;
+    int tls_accept_rate;
+    int max_pending_accepts;
+
+    /**
+     * Run this listener's TLS connections on the worker threads reserved for TLS.
+     */
+    bool tls_offload;
+
     /**
      *  Holds comma separated list that indicates which components of the message should be logged.
      *  Defaults to 'none' (log nothing). If you want all properties and application properties of the message logged use 'all'.
@@ -412,6 +534,17 @@ typedef struct qd_server_config_t {
      */
     qd_log_bits log_bits;
 
+    /**
+     * Message logging sampling (see message_log.h): log one in every log_sample
+     * messages, at most log_rate_limit a second on each connection (zero for no
+     * limit), and only messages whose address matches the log_address pattern (all
+     * when null).  log_address_tree holds the compiled pattern.
+     */
+    int                  log_sample;
+    int                  log_rate_limit;
+    char                *log_address;
+    struct qd_parse_node *log_address_tree;
+
     /**
      * Configured failover list
      */
@@ -573,6 +706,16 @@ bool qd_connector_connect(qd_connector_t *ct);
  */
 qd_error_t qd_register_display_name_service(qd_dispatch_t *qd, void *display_name_service);
 
+/**
+ * Load the user id to display name mapping of an sslProfile into the server's
+ * native lookup table, replacing any previous mapping for that profile.
+ *
+ * @param qd The dispatch handle returned by qd_dispatch.
+ * @param profile Name of the sslProfile.
+ * @param names Python dict of user id to display name, or None to remove the profile.
+ */
+qd_error_t qd_display_name_load(qd_dispatch_t *qd, const char *profile, void *names);
+
 /**
  * Get the name of the connection, based on its IP address.
  */
@@ -586,8 +729,124 @@ const char* qd_connection_remote_ip(const qd_connection_t *c);
 
 bool qd_connection_strip_annotations_in(const qd_connection_t *c);
 
+/**
+ * True if message bytes on the connection's links are compressed: both routers
+ * offered the same compression method.
+ */
+bool qd_connection_compression(const qd_connection_t *c);
+
+/**
+ * Count bytes of messages that crossed the connection compressed, as message
+ * bytes and as the compressed bytes on the wire.
+ */
+void qd_connection_count_compressed(qd_connection_t *c, bool outbound, size_t message_bytes, size_t wire_bytes);
+
+/**
+ * The counts of qd_connection_count_compressed, {message, wire} for each direction.
+ */
+void qd_connection_compression_stats(const qd_connection_t *c, uint64_t in[2], uint64_t out[2]);
+
+/**
+ * Account message octets sent or received, for the connection's octets per frame.
+ */
+void qd_connection_count_frame_octets(qd_connection_t *c, bool outbound, size_t octets);
+
+/**
+ * Record the size of a message that arrived whole, from which a connector with
+ * max_frame_size_min set tunes the frame size of its next connection.
+ */
+void qd_connection_frame_sample(qd_connection_t *c, size_t message_octets);
+
+/**
+ * The frame size the connection advertised, and {in, out} counts of its frames
+ * and of the message octets they carried.
+ */
+void qd_connection_frame_stats(const qd_connection_t *c, uint32_t *max_frame_size, uint64_t frames[2], uint64_t octets[2]);
+
+/**
+ * Session window autotuning, for connections whose listener or connector sets
+ * sessionWindowMax.  Each direction's window is twice the product of its smoothed
+ * drain rate and the round trip to the peer, kept within the configured bounds
+ * (and under the policy's maxSessionWindow).  A window that limits the drain rate
+ * measures the window's own worth each round trip, so it doubles until the
+ * network or the peer is the limit.  The round trip is timed from sending a
+ * delivery to the peer's first disposition of it, one delivery at a time.
+ *
+ * For connections without autotuning these return the static value given.
+ */
+size_t qd_connection_window_outgoing(qd_connection_t *c, size_t q3_upper);
+size_t qd_connection_window_incoming(qd_connection_t *c, size_t incoming_capacity);
+
+/**
+ * Account octets given to or read from the connection's sessions.  A completed
+ * send may become the delivery timed for the round trip.
+ */
+void qd_connection_window_sent(qd_connection_t *c, pn_link_t *pnl, size_t octets, bool send_complete);
+void qd_connection_window_received(qd_connection_t *c, size_t octets);
+
+/**
+ * The peer updated a delivery sent on the connection.
+ */
+void qd_connection_window_updated(qd_connection_t *c, pn_delivery_t *pnd);
+
+/**
+ * True if the connection's peer router negotiated compact (ulong) encodings of
+ * the trace and ingress annotations.
+ */
+bool qd_connection_compact_annotations(const qd_connection_t *c);
+
 void qd_connection_wake(qd_connection_t *ctx);
 
+/**
+ * Memory account of a connection: the bytes of buffers held by the router for
+ * messages received on the connection.  Messages keep a reference to the account of
+ * the connection they arrived on, so an account can outlive its connection.
+ */
+typedef struct qd_memory_account_t qd_memory_account_t;
+
+/**
+ * Get a new reference to a connection's memory account.  Release it with
+ * qd_memory_account_decref.
+ */
+qd_memory_account_t *qd_connection_memory_account(qd_connection_t *conn);
+
+void qd_memory_account_decref(qd_memory_account_t *account);
+
+/**
+ * Charge bytes to an account, or release bytes charged earlier.  Either may be
+ * called from any thread.  A null account is ignored.
+ */
+void qd_memory_account_charge(qd_memory_account_t *account, size_t bytes);
+void qd_memory_account_release(qd_memory_account_t *account, size_t bytes);
+
+/**
+ * Limit the bytes a connection's account may hold.  While the account is over the
+ * limit, credit for the connection's receiving links is withheld (see
+ * qd_connection_memory_blocked).  It is issued once the account drops to three
+ * quarters of the limit.
+ *
+ * @param conn Connection object
+ * @param limit Limit in bytes, zero for no limit
+ */
+void qd_connection_set_memory_limit(qd_connection_t *conn, size_t limit);
+
+/**
+ * Return true if the connection is over its memory limit and credit for its
+ * receiving links must be withheld with qd_link_withhold_credit.  Must be called on
+ * the connection's thread.
+ */
+bool qd_connection_memory_blocked(const qd_connection_t *conn);
+
+/**
+ * Issue the credit withheld from a connection's receiving links after a delay, unless
+ * a limit still applies then.  Used by policy rate limits, which withhold credit with
+ * qd_link_withhold_credit.  Must be called on the connection's thread.
+ *
+ * @param conn Connection object
+ * @param msec Delay in milliseconds
+ */
+void qd_connection_hold_credit(qd_connection_t *conn, int msec);
+
 /**
  * @}
  */
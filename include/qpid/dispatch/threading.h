@@ -23,6 +23,8 @@
  * Portable threading and locking API.
  */
 
+#include <stdint.h>
+
 typedef struct sys_mutex_t sys_mutex_t;
 
 sys_mutex_t *sys_mutex(void);
@@ -36,6 +38,7 @@ typedef struct sys_cond_t sys_cond_t;
 sys_cond_t *sys_cond(void);
 void        sys_cond_free(sys_cond_t *cond);
 void        sys_cond_wait(sys_cond_t *cond, sys_mutex_t *held_mutex);
+void        sys_cond_timedwait(sys_cond_t *cond, sys_mutex_t *held_mutex, int64_t usec);  ///< Wait at most usec
 void        sys_cond_signal(sys_cond_t *cond);
 void        sys_cond_signal_all(sys_cond_t *cond);
 
@@ -61,4 +64,13 @@ long sys_thread_id(sys_thread_t *thread);
 /** Return the OS identifier for the current thread */
 long sys_thread_self();
 
+/**
+ * Restrict the current thread to a set of CPUs.
+ *
+ * @param cpus A comma-separated list of CPU numbers and ranges, e.g. "0-3,8".
+ * @return 0 on success, otherwise an errno value: EINVAL if the list cannot be
+ *         parsed, ENOTSUP if the platform does not support thread affinity.
+ */
+int sys_thread_set_affinity(const char *cpus);
+
 #endif
@@ -97,6 +97,12 @@ void qd_timer_cancel(qd_timer_t *timer);
  */
 qd_timestamp_t qd_timer_now() ;
 
+/**
+ * The current time on the monotonic clock, in microseconds.  For measuring
+ * intervals, it does not follow changes to the wall clock.
+ */
+int64_t qd_timer_now_usec(void);
+
 /**
  * @}
  */
@@ -22,6 +22,8 @@
 #include <qpid/dispatch/dispatch.h>
 #include <qpid/dispatch/parse.h>
 #include <qpid/dispatch/bitmask.h>
+#include <qpid/dispatch/compose.h>
+#include <qpid/dispatch/iterator.h>
 
 typedef struct qd_tracemask_t qd_tracemask_t;
 
@@ -39,6 +41,19 @@ qd_tracemask_t *qd_tracemask(void);
  */
 void qd_tracemask_free(qd_tracemask_t *tm);
 
+/**
+ * qd_tracemask_id_hash
+ *
+ * Compute the compact trace identifier of a router: a 64-bit hash that routers
+ * with compact annotations exchange, as ulong values, in place of the router ID
+ * strings in the trace and ingress annotations.  Mask bits are assigned by each
+ * router on its own, so only a value that every router derives alike can travel.
+ *
+ * @param iter The router's ID in the node-hash view, or its address in the hash view.
+ * @return The router's compact trace identifier.
+ */
+uint64_t qd_tracemask_id_hash(qd_iterator_t *iter);
+
 /**
  * qd_tracemask_add_router
  *
@@ -95,4 +110,18 @@ void qd_tracemask_remove_link(qd_tracemask_t *tm, int router_maskbit);
  */
 qd_bitmask_t *qd_tracemask_create(qd_tracemask_t *tm, qd_parsed_field_t *tracelist, int *ingress_index);
 
+/**
+ * qd_tracemask_resolve_id
+ *
+ * Resolve one entry of a trace list, or an ingress annotation, that may be in
+ * either the string or the compact encoding.
+ *
+ * @param tm Tracemask created by qd_tracemask()
+ * @param item A router ID string or a compact trace identifier.
+ * @param field If not null, the entry is appended to it as a router ID string.  A compact
+ *        identifier of an unknown router is not appended.
+ * @return The mask bit of the router for a compact identifier of a known router, else -1.
+ */
+int qd_tracemask_resolve_id(qd_tracemask_t *tm, qd_parsed_field_t *item, qd_composed_field_t *field);
+
 #endif
@@ -215,7 +215,22 @@ class Node(object):
         def __repr__(self):
             return "QueryResponse(attribute_names=%r, results=%r"%(self.attribute_names, self.results)
 
-    def query(self, type=None, attribute_names=None, offset=None, count=None):
+    def next_response(self, correlation_id, expect=OK):
+        """
+        Wait for a further response to a request that has been answered in
+        several messages, such as a paged query.
+        @return: Response message.
+        """
+        client = self.client
+        client.connection.wait(lambda: client.response and client.response.correlation_id == correlation_id,
+                               msg="Waiting for response")
+        response = client.response
+        client.response = None
+        client.receiver.flow(1)
+        self.check_response(response, expect=expect)
+        return response
+
+    def query(self, type=None, attribute_names=None, offset=None, count=None, filter=None, page_size=None):
         """
         Send an AMQP management query message and return the response.
         At least one of type, attribute_names must be specified.
@@ -223,14 +238,26 @@ class Node(object):
         @keyword attribute_names: A list of attribute names to query.
         @keyword offset: An integer offset into the list of results to return.
         @keyword count: A count of the maximum number of results to return.
+        @keyword filter: A map of attribute name to value; only entities whose
+            attributes have all these values are returned.  Supported by the
+            router for address, link and connection queries.
+        @keyword page_size: Ask for the results in several response messages of
+            at most this many rows each, sent as they are produced.  Agents that
+            do not page answer in one message as usual.
         @return: A L{QueryResponse}
         """
+        body = {u'attributeNames': attribute_names or []}
+        if filter:
+            body[u'filter'] = filter
         request = self.node_request(
-            {u'attributeNames': attribute_names or []},
-            operation=u'QUERY', entityType=type, offset=offset, count=count)
+            body, operation=u'QUERY', entityType=type, offset=offset, count=count, pageSize=page_size)
 
         response = self.call(request)
-        return Node.QueryResponse(self, response.body[u'attributeNames'], response.body[u'results'])
+        results = response.body[u'results']
+        while response.properties.get(u'partial'):
+            response = self.next_response(response.correlation_id)
+            results.extend(response.body[u'results'])
+        return Node.QueryResponse(self, response.body[u'attributeNames'], results)
 
     def create(self, attributes=None, type=None, name=None):
         """
@@ -298,6 +325,45 @@ class Node(object):
                                identity=identity)
         self.call(request, expect=NO_CONTENT)
 
+    def bulk_create(self, entities, type):
+        """
+        Create several entities of one type with one request.  The entities
+        are created independently: one failing does not stop the others.
+
+        @param entities: List of attribute maps, one for each new entity.
+        @param type: Entity type of all the entities.
+        @return: A list with the outcome for each entity, in order: a map of its
+            statusCode and statusDescription, and its attributes if it was created.
+        """
+        if not entities: return []
+        request = self.request(operation=u'BULK-CREATE', type=type, body=list(entities))
+        return self.call(request).body
+
+    def bulk_delete(self, entities, type):
+        """
+        Delete several entities of one type with one request.
+
+        @param entities: List of maps naming each entity by its name or identity.
+        @param type: Entity type of all the entities.
+        @return: A list with the outcome for each entity as for L{bulk_create}.
+        """
+        if not entities: return []
+        request = self.request(operation=u'BULK-DELETE', type=type, body=list(entities))
+        return self.call(request).body
+
+    def get_summary(self, edges=False):
+        """
+        A compact summary of the router's traffic: connection, link and address
+        counts, delivery counters and rates, and settlement latency percentiles.
+
+        @param edges: If true, ask an interior router for the merged summary of
+            all its connected edge routers instead of its own.
+        @return: A map of the summary.
+        """
+        operation = u'GET-EDGE-SUMMARY' if edges else u'GET-SUMMARY'
+        request = self.request(operation=operation, type=u'org.apache.qpid.dispatch.router')
+        return self.call(request).body
+
     def get_types(self, type=None):
         return self.call(self.node_request(operation=u"GET-TYPES", entityType=type)).body
 
@@ -315,3 +381,6 @@ class Node(object):
 
     def get_log(self, limit=None, type=None):
         return self.call(self.node_request(operation=u"GET-LOG", entityType=type, limit=limit)).body
+
+    def get_trace(self, limit=None, type=None):
+        return self.call(self.node_request(operation=u"GET-TRACE", entityType=type, limit=limit)).body
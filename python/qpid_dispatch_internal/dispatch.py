@@ -86,8 +86,10 @@ class QdDll(ctypes.PyDLL):
         self._prototype(self.qd_dispatch_policy_host_pattern_add, ctypes.c_bool, [self.qd_dispatch_p, py_object])
         self._prototype(self.qd_dispatch_policy_host_pattern_remove, None, [self.qd_dispatch_p, py_object])
         self._prototype(self.qd_dispatch_policy_host_pattern_lookup, c_char_p, [self.qd_dispatch_p, py_object])
+        self._prototype(self.qd_dispatch_policy_settings_cache_flush, None, [self.qd_dispatch_p])
 
         self._prototype(self.qd_dispatch_register_display_name_service, None, [self.qd_dispatch_p, py_object])
+        self._prototype(self.qd_dispatch_display_name_load, None, [self.qd_dispatch_p, py_object, py_object])
 
         self._prototype(self.qd_dispatch_set_agent, None, [self.qd_dispatch_p, py_object])
 
@@ -99,8 +101,10 @@ class QdDll(ctypes.PyDLL):
         self._prototype(self.qd_connection_manager_start, None, [self.qd_dispatch_p])
         self._prototype(self.qd_entity_refresh_begin, c_long, [py_object])
         self._prototype(self.qd_entity_refresh_end, None, [])
+        self._prototype(self.qd_entity_refresh_list, c_long, [c_char_p, py_object])
 
         self._prototype(self.qd_log_recent_py, py_object, [c_long])
+        self._prototype(self.qd_trace_ring_recent_py, py_object, [c_long])
 
     def _prototype(self, f, restype, argtypes, check=True):
         """Set up the return and argument types and the error checker for a
@@ -54,10 +54,14 @@ class SSLProfile(object):
 
 class DisplayNameService(object):
 
-    def __init__(self):
+    def __init__(self, qd=None, dispatch=None):
         super(DisplayNameService, self).__init__()
         # profile_dict will be a mapping from ssl_profile_name to the SSLProfile object
         self.profile_dict = {}
+        # When bound to the router the mappings are mirrored into a native table
+        # so user id translation on connection open does not need the Python lock.
+        self.qd = qd
+        self.dispatch = dispatch
         self.io_adapter = None
         self.log_adapter = LogAdapter("DISPLAYNAME")
 
@@ -65,19 +69,25 @@ class DisplayNameService(object):
         info = traceback.extract_stack(limit=2)[0] # Caller frame info
         self.log_adapter.log(level, text, info[0], info[1])
 
+    def _native_load(self, profile_name, names):
+        if self.qd and self.dispatch:
+            self.qd.qd_dispatch_display_name_load(self.dispatch, profile_name, names)
+
     def add(self, profile_name, profile_file_location):
         ssl_profile = SSLProfile(profile_name, profile_file_location)
         self.profile_dict[profile_name] = ssl_profile
+        self._native_load(profile_name, ssl_profile.cache)
         self.log(LOG_INFO, "Added profile name %s, profile file location %s to DisplayNameService" % (profile_name, profile_file_location))
 
     def remove(self, profile_name):
         try:
             del self.profile_dict[profile_name]
         except KeyError:
-            pass
+            return
+        self._native_load(profile_name, None)
 
     def reload_all(self):
-        for profile_name in self.profile_dict.keys():
+        for profile_name in list(self.profile_dict.keys()):
             self.add(profile_name, self.profile_dict[profile_name].profile_file)
 
     def reload(self, profile_name=None):
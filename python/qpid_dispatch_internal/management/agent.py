@@ -66,19 +66,11 @@ from __future__ import division
 from __future__ import absolute_import
 from __future__ import print_function
 
-import traceback, json, pstats
+import traceback, json
 import socket
 from traceback import format_exc
 from threading import Lock
-from cProfile import Profile
-try:
-    # py2
-    from cStringIO import StringIO
-except ImportError:
-    from io import StringIO
-
 from ctypes import c_void_p, py_object, c_long
-from subprocess import Popen
 try:
     # Python 2
     from future_builtins import filter
@@ -90,7 +82,7 @@ from ..dispatch import IoAdapter, LogAdapter, LOG_INFO, LOG_WARNING, LOG_DEBUG,
 from qpid_dispatch.management.error import ManagementError, OK, CREATED, NO_CONTENT, STATUS_TEXT, \
     BadRequestStatus, InternalServerErrorStatus, NotImplementedStatus, NotFoundStatus, ForbiddenStatus
 from qpid_dispatch.management.entity import camelcase
-from .schema import ValidationError, SchemaEntity, EntityType
+from .schema import ValidationError, SchemaEntity, EntityType, UniqueIndex
 from .qdrouter import QdSchema
 from ..router.message import Message
 from ..router.address import Address
@@ -134,10 +126,14 @@ class Implementation(object):
 
 class CImplementation(Implementation):
     """Wrapper for a C implementation pointer"""
+    _refreshfns = {}            # Refresh function by entity type, shared by all instances
+
     def __init__(self, qd, entity_type, pointer):
         super(CImplementation, self).__init__(entity_type, pointer)
         fname = "qd_entity_refresh_" + entity_type.short_name.replace('.', '_')
-        self.refreshfn = qd.function(fname, c_long, [py_object, c_void_p])
+        if fname not in CImplementation._refreshfns:
+            CImplementation._refreshfns[fname] = qd.function(fname, c_long, [py_object, c_void_p])
+        self.refreshfn = CImplementation._refreshfns[fname]
 
     def refresh_entity(self, attributes):
         return self.refreshfn(attributes, self.key) or True
@@ -374,7 +370,8 @@ class AuthServicePluginEntity(EntityAdapter):
 class ListenerEntity(EntityAdapter):
     def create(self):
         config_listener = self._qd.qd_dispatch_configure_listener(self._dispatch, self)
-        self._qd.qd_connection_manager_start(self._dispatch)
+        if self._agent.start_connections:
+            self._qd.qd_connection_manager_start(self._dispatch)
         return config_listener
 
     def _identifier(self):
@@ -391,7 +388,8 @@ class ListenerEntity(EntityAdapter):
 class ConnectorEntity(EntityAdapter):
     def create(self):
         config_connector = self._qd.qd_dispatch_configure_connector(self._dispatch, self)
-        self._qd.qd_connection_manager_start(self._dispatch)
+        if self._agent.start_connections:
+            self._qd.qd_connection_manager_start(self._dispatch)
         return config_connector
 
     def _delete(self):
@@ -459,6 +457,7 @@ class ConsoleEntity(EntityAdapter):
                             pargs += args.split()
 
                         #run the external program
+                        from subprocess import Popen
                         Popen(pargs)
                     except:
                         self._agent.log(LOG_ERROR, "Can't parse console entity: %s" % (format_exc()))
@@ -502,9 +501,20 @@ class AllocatorEntity(EntityAdapter):
     def _identifier(self):
         return self.attributes.get('typeName')
 
+    def _update(self):
+        configure = self._qd.function("qd_entity_configure_allocator", c_long, [py_object, c_void_p])
+        configure(self, self._implementations[0].key)
+
     def __str__(self):
         return super(AllocatorEntity, self).__str__().replace("Entity(", "AllocatorEntity(")
 
+class WorkerThreadEntity(EntityAdapter):
+    def _identifier(self):
+        return str(self.attributes.get('threadIndex'))
+
+    def __str__(self):
+        return super(WorkerThreadEntity, self).__str__().replace("Entity(", "WorkerThreadEntity(")
+
 class ExchangeEntity(EntityAdapter):
     def create(self):
         self._qd.qd_dispatch_configure_exchange(self._dispatch, self)
@@ -531,6 +541,7 @@ class EntityCache(object):
         self.agent = agent
         self.qd = self.agent.qd
         self.schema = agent.schema
+        self.index = UniqueIndex(self.schema)
         self.log = self.agent.log
 
     def map_filter(self, function, test):
@@ -557,8 +568,9 @@ class EntityCache(object):
         self.log(LOG_DEBUG, "Add entity: %s" % entity)
         entity.validate()       # Fill in defaults etc.
         # Validate in the context of the existing entities for uniqueness
-        self.schema.validate_add(entity, self.entities)
+        self.schema.validate_add(entity, self.entities, self.index)
         self.entities.append(entity)
+        self.index.add(entity)
 
     def _add_implementation(self, implementation, adapter=None):
         """Create an adapter to wrap the implementation object and add it"""
@@ -576,6 +588,7 @@ class EntityCache(object):
     def _remove(self, entity):
         try:
             self.entities.remove(entity)
+            self.index.remove(entity)
             self.log(LOG_DEBUG, "Remove %s entity: %s" %
                      (entity.entity_type.short_name, entity.attributes['identity']))
         except ValueError: pass
@@ -592,8 +605,28 @@ class EntityCache(object):
     def remove_implementation(self, key):
         self._remove_implementation(key)
 
-    def refresh_from_c(self):
-        """Refresh entities from the C dispatch runtime"""
+    def _refresh_entities(self, entity_type):
+        """Refresh the entities of entity_type, or all entities if it is None.
+        C implementations of the same type are refreshed with one call."""
+        batches = {}
+        for e in self.entities:
+            if entity_type is not None and not e.entity_type.is_a(entity_type):
+                continue
+            for impl in e._implementations:
+                if isinstance(impl, CImplementation):
+                    batches.setdefault(impl.entity_type.short_name, []).append((e, impl))
+                else:
+                    impl.refresh_entity(e.attributes)
+        for short_name, items in dict_iteritems(batches):
+            pairs = [(e.attributes, impl.key) for e, impl in items]
+            if self.qd.qd_entity_refresh_list(short_name.encode('utf-8'), pairs) < 0:
+                for e, impl in items:
+                    impl.refresh_entity(e.attributes)
+
+    def refresh_from_c(self, entity_type=None):
+        """Refresh entities from the C dispatch runtime.
+        Entities are added and removed as C reported, but only the values of
+        entities of entity_type are refreshed, or of all entities if None."""
         REMOVE, ADD = 0, 1
 
         def remove_redundant(events):
@@ -623,7 +656,7 @@ class EntityCache(object):
                     entity_type = self.schema.entity_type(type)
                     self._add_implementation(CImplementation(self.qd, entity_type, pointer))
             # Refresh the entity values while the lock is still held.
-            for e in self.entities: e._refresh()
+            self._refresh_entities(entity_type)
         finally:
             self.qd.qd_entity_refresh_end()
             self.qd.qd_dispatch_router_unlock(self.agent.dispatch)
@@ -718,8 +751,20 @@ class ManagementEntity(EntityAdapter):
         logs = self._qd.qd_log_recent_py(self._intprop(request, "limit") or -1)
         return (OK, logs)
 
+    def get_trace(self, request):
+        events = self._qd.qd_trace_ring_recent_py(self._intprop(request, "limit") or -1)
+        return (OK, events)
+
     def profile(self, request):
         """Start/stop the python profiler, returns profile results"""
+        # Imported here so that routers that never profile don't load the profiler
+        import pstats
+        from cProfile import Profile
+        try:
+            # py2
+            from cStringIO import StringIO
+        except ImportError:
+            from io import StringIO
         profile = self.__dict__.get("_profile")
         if "start" in request.properties:
             if not profile:
@@ -760,6 +805,9 @@ class Agent(object):
         self.request_lock = Lock()
         self.log_adapter = LogAdapter("AGENT")
         self.policy = PolicyManager(self)
+        # Start listeners and connectors as they are created; configure_dispatch
+        # starts those of the configuration file together instead
+        self.start_connections = True
         self.management = self.create_entity({"type": "management"})
         self.add_entity(self.management)
 
@@ -771,7 +819,8 @@ class Agent(object):
         """Register the management address to receive management requests"""
         self.entities.refresh_from_c()
         self.log(LOG_INFO, "Activating management agent on %s" % address)
-        self.io = IoAdapter(self.receive, address, 'L', '0', TREATMENT_ANYCAST_CLOSEST)
+        # Requests are handled on the python worker thread, not the router's threads
+        self.io = IoAdapter(self.receive, address, 'L', '0', TREATMENT_ANYCAST_CLOSEST, True)
 
     def entity_class(self, entity_type):
         """Return the class that implements entity_type"""
@@ -821,7 +870,7 @@ class Agent(object):
         # Coarse locking, handle one request at a time.
         with self.request_lock:
             try:
-                self.entities.refresh_from_c()
+                self.entities.refresh_from_c(self.refresh_type(request))
                 self.log(LOG_DEBUG, "Agent request %s"% request)
                 status, body = self.handle(request)
                 self.respond(request, status=status, body=body)
@@ -832,6 +881,17 @@ class Agent(object):
             except Exception as e:
                 error(InternalServerErrorStatus("%s: %s"%(type(e).__name__, e)), format_exc())
 
+    def refresh_type(self, request):
+        """The entity type whose values a request reads, None if it may read any.
+        A query reads its entityType, other operations the type they address."""
+        props = request.properties or {}
+        operation = (props.get('operation') or '').upper()
+        type = props.get('entityType') if operation == 'QUERY' else props.get('type')
+        if not type:
+            return None
+        try: return self.schema.entity_type(type)
+        except ValidationError: return None
+
     def entity_type(self, type):
         try: return self.schema.entity_type(type)
         except ValidationError as e: raise NotFoundStatus(str(e))
@@ -173,10 +173,13 @@ def configure_dispatch(dispatch, lib_handle, filename):
     agent = Agent(dispatch, qd)
     qd.qd_dispatch_set_agent(dispatch, agent)
 
+    # Entities already configured, skipped by the final pass over config.entities
+    configured = set()
+
     def configure(attributes):
-        """Configure an entity and remove it from config"""
+        """Configure an entity and mark it configured"""
         agent.configure(attributes)
-        config.remove(attributes)
+        configured.add(id(attributes))
 
     modules = set(agent.schema.entity_type("log").attributes["module"].atype.tags)
     for l in config.by_type('log'):
@@ -194,7 +197,7 @@ def configure_dispatch(dispatch, lib_handle, filename):
     agent.activate("$_management_internal")
 
     from qpid_dispatch_internal.display_name.display_name import DisplayNameService
-    displayname_service = DisplayNameService()
+    displayname_service = DisplayNameService(qd, dispatch)
     qd.qd_dispatch_register_display_name_service(dispatch, displayname_service)
 
     # Configure policy and policy manager before vhosts
@@ -206,7 +209,9 @@ def configure_dispatch(dispatch, lib_handle, filename):
     agent.policy.set_default_vhost(policyDefaultVhost)
     agent.policy.set_use_hostname_patterns(useHostnamePatterns)
 
-    # Remaining configuration
+    # Remaining configuration.  The listeners and connectors are started together
+    # once they are all configured rather than one at a time as each is created.
+    agent.start_connections = False
     for t in "sslProfile", "authServicePlugin", "listener", "connector", \
              "router.config.address", "router.config.linkRoute", "router.config.autoLink", \
              "router.config.exchange", "router.config.binding", \
@@ -219,8 +224,12 @@ def configure_dispatch(dispatch, lib_handle, filename):
                     ssl_profile_name = a.get('name')
                     displayname_service.add(ssl_profile_name, display_file_name)
 
+    agent.start_connections = True
+    qd.qd_connection_manager_start(dispatch)
+
     for e in config.entities:
-        configure(e)
+        if id(e) not in configured:
+            configure(e)
 
     # Load the vhosts from the .json files in policyDir
     # Only vhosts are loaded. Other entities are silently discarded.
@@ -48,20 +48,33 @@ class QdSchema(schema.Schema):
         self.configuration_entity = self.entity_type(self.CONFIGURATION_ENTITY)
         self.operational_entity = self.entity_type(self.OPERATIONAL_ENTITY)
 
-    def validate_add(self, attributes, entities):
+    def validate_add(self, attributes, entities, index=None):
         """
         Check that listeners and connectors can only have role=inter-router if the router has
         mode=interior.
         """
-        entities = list(entities) # Iterate twice
-        super(QdSchema, self).validate_add(attributes, entities)
+        if index is None:
+            entities = list(entities) # Iterate twice
+            super(QdSchema, self).validate_add(attributes, entities)
+        else:
+            super(QdSchema, self).validate_add(attributes, entities, index)
+            # Earlier entities were checked when they were added, so only those the
+            # new one can clash with need a look
+            short_type = self.short_name(attributes['type'])
+            if short_type == "router":
+                others = ("listener", "connector")
+            elif short_type in ["listener", "connector"]:
+                others = ("router",)
+            else:
+                return
+            entities = [e for t in others for e in index.of_type(self.long_name(t))]
         entities.append(attributes)
         inter_router = not_interior = None
         for e in entities:
             short_type = self.short_name(e['type'])
             if short_type == "router" and e['mode'] != "interior":
                 not_interior = e['mode']
-            if short_type in ["listener", "connector"] and e['role'] == "inter-router":
+            if short_type in ["listener", "connector"] and e['role'] in ["inter-router", "inter-router-data"]:
                 inter_router = e
             if not_interior and inter_router:
                 raise schema.ValidationError(
@@ -607,14 +607,17 @@ class Schema(object):
         Validate all the entities from entity_iter, return a list of valid entities.
         """
         entities = []
+        index = UniqueIndex(self)
         for a in attribute_maps:
-            self.validate_add(a, entities)
-            entities.append(a);
+            self.validate_add(a, entities, index)
+            entities.append(a)
+            index.add(a)
 
-    def validate_add(self, attributes, entities):
+    def validate_add(self, attributes, entities, index=None):
         """
         Validate that attributes would be valid when added to entities.
         Assumes entities are already valid
+        @param index: Optional L{UniqueIndex} of entities, checked instead of scanning them.
         @raise ValidationError if adding e violates a global constraint like uniqueness.
         """
         self.validate_entity(attributes)
@@ -623,6 +626,8 @@ class Schema(object):
         unique = [a for a in entity_type.attributes.values() if a.unique and a.name in attributes]
         if not unique and not entity_type.singleton:
             return              # Nothing to do
+        if index is not None:
+            entities = index.candidates(attributes, unique, entity_type.singleton)
         for e in entities:
             if entity_type.singleton and attributes['type'] == e['type']:
                 raise ValidationError("Adding %s singleton %s when %s already exists" %
@@ -658,6 +663,64 @@ class Schema(object):
         else:
             return self.filter(lambda t: t.is_a(type))
 
+class UniqueIndex(object):
+    """
+    Entities indexed by type and by the value of each unique attribute, so that
+    L{Schema.validate_add} looks only at the entities a new one could clash with.
+    Entities are indexed under the values they have when added: unique attribute
+    values are not expected to change after that.
+    """
+    def __init__(self, schema):
+        self.unique = set(a.name for t in schema.entity_types.values()
+                          for a in t.attributes.values() if a.unique)
+        self.entries = {}       # id(entity): (entity, keys it is indexed under)
+        self.by_key = {}        # key: {id(entity): entity}
+        self.unkeyed = {}       # Entities with a unique value that cannot be a key
+
+    def _keys(self, entity):
+        keys = [('type', entity['type'])]
+        for name in self.unique:
+            if name in entity:
+                keys.append((name, entity[name]))
+        return keys
+
+    def add(self, entity):
+        keys = []
+        for key in self._keys(entity):
+            try:
+                self.by_key.setdefault(key, {})[id(entity)] = entity
+                keys.append(key)
+            except TypeError:
+                self.unkeyed[id(entity)] = entity
+        self.entries[id(entity)] = (entity, keys)
+
+    def remove(self, entity):
+        entity, keys = self.entries.pop(id(entity), (entity, []))
+        for key in keys:
+            entities = self.by_key[key]
+            del entities[id(entity)]
+            if not entities:
+                del self.by_key[key]
+        self.unkeyed.pop(id(entity), None)
+
+    def of_type(self, type):
+        """Entities whose type is the long type name"""
+        return list(self.by_key.get(('type', type), {}).values())
+
+    def candidates(self, attributes, unique, singleton):
+        """Entities that may clash with attributes on the unique attribute types or
+        because the type is a singleton"""
+        keys = [(a.name, attributes[a.name]) for a in unique]
+        if singleton:
+            keys.append(('type', attributes['type']))
+        found = dict(self.unkeyed)
+        for key in keys:
+            try:
+                found.update(self.by_key.get(key, {}))
+            except TypeError:
+                return [e for e, _ in self.entries.values()]
+        return list(found.values())
+
 class SchemaEntity(EntityBase):
     """A map of attributes associated with an L{EntityType}"""
     def __init__(self, entity_type, attributes=None, validate=True, **kwattrs):
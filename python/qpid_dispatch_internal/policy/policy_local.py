@@ -26,7 +26,6 @@ from __future__ import absolute_import
 from __future__ import print_function
 
 import json
-import pdb
 from .policy_util import PolicyError, HostStruct, HostAddr, PolicyAppConnectionMgr, is_ipv6_enabled
 from ..compat import PY_STRING_TYPE
 from ..compat import PY_TEXT_TYPE
@@ -56,6 +55,8 @@ class PolicyKeys(object):
     KW_MAXCONNPERHOST              = "maxConnectionsPerHost"
     KW_MAXCONNPERUSER              = "maxConnectionsPerUser"
     KW_CONNECTION_ALLOW_DEFAULT    = "allowUnknownUser"
+    KW_VHOST_MAX_MESSAGE_RATE      = "maxMessageRate"
+    KW_VHOST_MAX_BYTE_RATE         = "maxByteRate"
     KW_GROUPS                      = "groups"
 
     # Policy settings key words
@@ -67,6 +68,9 @@ class PolicyKeys(object):
     KW_MAX_SESSIONS              = "maxSessions"
     KW_MAX_SENDERS               = "maxSenders"
     KW_MAX_RECEIVERS             = "maxReceivers"
+    KW_MAX_MEMORY                = "maxMemory"
+    KW_MAX_MESSAGE_RATE          = "maxMessageRate"
+    KW_MAX_BYTE_RATE             = "maxByteRate"
     KW_ALLOW_DYNAMIC_SRC         = "allowDynamicSource"
     KW_ALLOW_ANONYMOUS_SENDER    = "allowAnonymousSender"
     KW_ALLOW_USERID_PROXY        = "allowUserIdProxy"
@@ -100,6 +104,10 @@ class PolicyKeys(object):
     # policy stats controlled by C code but referenced by settings
     KW_CSTATS                   = "denialCounts"
 
+    # vhost rate limits handed to C code with the settings of each user group
+    KW_CSETTINGS_VHOST_MESSAGE_RATE = "vhostMaxMessageRate"
+    KW_CSETTINGS_VHOST_BYTE_RATE    = "vhostMaxByteRate"
+
     # Username subsitituion token in link source and target names and patterns
     KC_TOKEN_USER               = "${user}"
 
@@ -130,6 +138,8 @@ class PolicyCompiler(object):
         PolicyKeys.KW_MAXCONNPERHOST,
         PolicyKeys.KW_MAXCONNPERUSER,
         PolicyKeys.KW_CONNECTION_ALLOW_DEFAULT,
+        PolicyKeys.KW_VHOST_MAX_MESSAGE_RATE,
+        PolicyKeys.KW_VHOST_MAX_BYTE_RATE,
         PolicyKeys.KW_GROUPS
         ]
 
@@ -142,6 +152,9 @@ class PolicyCompiler(object):
         PolicyKeys.KW_MAX_SESSIONS,
         PolicyKeys.KW_MAX_SENDERS,
         PolicyKeys.KW_MAX_RECEIVERS,
+        PolicyKeys.KW_MAX_MEMORY,
+        PolicyKeys.KW_MAX_MESSAGE_RATE,
+        PolicyKeys.KW_MAX_BYTE_RATE,
         PolicyKeys.KW_ALLOW_DYNAMIC_SRC,
         PolicyKeys.KW_ALLOW_ANONYMOUS_SENDER,
         PolicyKeys.KW_ALLOW_USERID_PROXY,
@@ -245,6 +258,9 @@ class PolicyCompiler(object):
         policy_out[PolicyKeys.KW_MAX_SESSIONS] = 65536
         policy_out[PolicyKeys.KW_MAX_SENDERS] = 2147483647
         policy_out[PolicyKeys.KW_MAX_RECEIVERS] = 2147483647
+        policy_out[PolicyKeys.KW_MAX_MEMORY] = 0
+        policy_out[PolicyKeys.KW_MAX_MESSAGE_RATE] = 0
+        policy_out[PolicyKeys.KW_MAX_BYTE_RATE] = 0
         policy_out[PolicyKeys.KW_ALLOW_DYNAMIC_SRC] = False
         policy_out[PolicyKeys.KW_ALLOW_ANONYMOUS_SENDER] = False
         policy_out[PolicyKeys.KW_ALLOW_USERID_PROXY] = False
@@ -267,6 +283,9 @@ class PolicyCompiler(object):
             if key in [PolicyKeys.KW_MAX_FRAME_SIZE,
                        PolicyKeys.KW_MAX_MESSAGE_SIZE,
                        PolicyKeys.KW_MAX_RECEIVERS,
+                       PolicyKeys.KW_MAX_MEMORY,
+                       PolicyKeys.KW_MAX_MESSAGE_RATE,
+                       PolicyKeys.KW_MAX_BYTE_RATE,
                        PolicyKeys.KW_MAX_SENDERS,
                        PolicyKeys.KW_MAX_SESSION_WINDOW,
                        PolicyKeys.KW_MAX_SESSIONS
@@ -405,6 +424,8 @@ class PolicyCompiler(object):
         policy_out[PolicyKeys.KW_MAXCONNPERHOST] = 65535
         policy_out[PolicyKeys.KW_MAXCONNPERUSER] = 65535
         policy_out[PolicyKeys.KW_CONNECTION_ALLOW_DEFAULT] = False
+        policy_out[PolicyKeys.KW_VHOST_MAX_MESSAGE_RATE] = 0
+        policy_out[PolicyKeys.KW_VHOST_MAX_BYTE_RATE] = 0
         policy_out[PolicyKeys.KW_GROUPS] = {}
 
         # validate the options
@@ -422,6 +443,15 @@ class PolicyCompiler(object):
                     errors.append(msg)
                     return False
                 policy_out[key] = val
+            elif key in [PolicyKeys.KW_VHOST_MAX_MESSAGE_RATE,
+                         PolicyKeys.KW_VHOST_MAX_BYTE_RATE
+                         ]:
+                if not self.validateNumber(val, 0, 0, cerror):
+                    msg = ("Policy vhost '%s' option '%s' has error '%s'." %
+                           (name, key, cerror[0]))
+                    errors.append(msg)
+                    return False
+                policy_out[key] = int(val)
             elif key in [PolicyKeys.KW_CONNECTION_ALLOW_DEFAULT]:
                 if not type(val) is bool:
                     errors.append("Policy vhost '%s' option '%s' must be of type 'bool' but is '%s'" %
@@ -802,6 +832,8 @@ class PolicyLocal(object):
                 return False
 
             upolicy.update(ruleset[PolicyKeys.KW_GROUPS][groupname])
+            upolicy[PolicyKeys.KW_CSETTINGS_VHOST_MESSAGE_RATE] = ruleset.get(PolicyKeys.KW_VHOST_MAX_MESSAGE_RATE, 0)
+            upolicy[PolicyKeys.KW_CSETTINGS_VHOST_BYTE_RATE] = ruleset.get(PolicyKeys.KW_VHOST_MAX_BYTE_RATE, 0)
             upolicy[PolicyKeys.KW_CSTATS] = self.statsdb[vhost].get_cstats()
             return True
         except Exception as e:
@@ -830,12 +862,12 @@ class PolicyLocal(object):
         Test function to load a policy.
         @return:
         """
-        ruleset_str = '["vhost", {"hostname": "photoserver", "maxConnections": 50, "maxConnectionsPerUser": 5, "maxConnectionsPerHost": 20, "allowUnknownUser": true,'
+        ruleset_str = '["vhost", {"hostname": "photoserver", "maxConnections": 50, "maxConnectionsPerUser": 5, "maxConnectionsPerHost": 20, "maxMessageRate": 5000, "allowUnknownUser": true,'
         ruleset_str += '"groups": {'
         ruleset_str += '"anonymous":       { "users": "anonymous", "remoteHosts": "*", "maxFrameSize": 111111, "maxMessageSize": 111111, "maxSessionWindow": 111111, "maxSessions": 1, "maxSenders": 11, "maxReceivers": 11, "allowDynamicSource": false, "allowAnonymousSender": false, "sources": "public", "targets": "" },'
         ruleset_str += '"users":           { "users": "u1, u2", "remoteHosts": "*", "maxFrameSize": 222222, "maxMessageSize": 222222, "maxSessionWindow": 222222, "maxSessions": 2, "maxSenders": 22, "maxReceivers": 22, "allowDynamicSource": false, "allowAnonymousSender": false, "sources": "public, private", "targets": "public" },'
         ruleset_str += '"paidsubscribers": { "users": "p1, p2", "remoteHosts": "*", "maxFrameSize": 333333, "maxMessageSize": 333333, "maxSessionWindow": 333333, "maxSessions": 3, "maxSenders": 33, "maxReceivers": 33, "allowDynamicSource": true, "allowAnonymousSender": false, "sources": "public, private", "targets": "public, private" },'
-        ruleset_str += '"test":            { "users": "zeke, ynot", "remoteHosts": "10.48.0.0-10.48.255.255, 192.168.100.0-192.168.100.255", "maxFrameSize": 444444, "maxMessageSize": 444444, "maxSessionWindow": 444444, "maxSessions": 4, "maxSenders": 44, "maxReceivers": 44, "allowDynamicSource": true, "allowAnonymousSender": true, "sources": "private", "targets": "private" },'
+        ruleset_str += '"test":            { "users": "zeke, ynot", "remoteHosts": "10.48.0.0-10.48.255.255, 192.168.100.0-192.168.100.255", "maxFrameSize": 444444, "maxMessageSize": 444444, "maxSessionWindow": 444444, "maxSessions": 4, "maxSenders": 44, "maxReceivers": 44, "maxMemory": 4444444, "maxMessageRate": 4444, "maxByteRate": 444444, "allowDynamicSource": true, "allowAnonymousSender": true, "sources": "private", "targets": "private" },'
 
         if is_ipv6_enabled():
             ruleset_str += '"admin":           { "users": "alice, bob", "remoteHosts": "10.48.0.0-10.48.255.255, 192.168.100.0-192.168.100.255, 10.18.0.0-10.18.255.255, 127.0.0.1, ::1", "maxFrameSize": 555555, "maxMessageSize": 555555, "maxSessionWindow": 555555, "maxSessions": 5, "maxSenders": 55, "maxReceivers": 55, "allowDynamicSource": true, "allowAnonymousSender": true, "sources": "public, private, management", "targets": "public, private, management" },'
@@ -83,6 +83,15 @@ class PolicyManager(object):
     def set_use_hostname_patterns(self, v):
         self._use_hostname_patterns = v
         self._policy_local.use_hostname_patterns = v
+        self._flush_settings_cache()
+
+    def _flush_settings_cache(self):
+        """
+        Discard the user group settings the router has cached from earlier
+        lookups, after any change to the rulesets they came from.
+        """
+        if self._agent:
+            self._agent.qd.qd_dispatch_policy_settings_cache_flush(self._agent.dispatch)
 
     #
     # Management interface to create a ruleset
@@ -93,6 +102,7 @@ class PolicyManager(object):
         @param[in] attributes: from config
         """
         self._policy_local.create_ruleset(attributes)
+        self._flush_settings_cache()
 
     #
     # Management interface to delete a ruleset
@@ -103,6 +113,7 @@ class PolicyManager(object):
         @param[in] id: ruleset name
         """
         self._policy_local.policy_delete(id)
+        self._flush_settings_cache()
 
     #
     # Management interface to update a ruleset
@@ -113,6 +124,7 @@ class PolicyManager(object):
         @param[in] id: ruleset name
         """
         self._policy_local.create_ruleset(attributes)
+        self._flush_settings_cache()
 
     #
     # Management interface to set the default vhost
@@ -124,6 +136,7 @@ class PolicyManager(object):
         @return:
         """
         self._policy_local.set_default_vhost(name)
+        self._flush_settings_cache()
 
     #
     # Runtime query interface
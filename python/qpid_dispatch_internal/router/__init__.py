@@ -22,7 +22,9 @@ from __future__ import division
 from __future__ import absolute_import
 from __future__ import print_function
 
-from .engine import RouterEngine
+# The routing engine is imported from .engine by interior routers only, so that
+# edge and standalone routers, which use just the message and address helpers,
+# don't load the link-state modules.
 from .address import Address
 
-__all__ = ["RouterEngine", "Address"]
+__all__ = ["Address"]
@@ -30,8 +30,15 @@ from __future__ import print_function
 from ..compat import PY_LONG_TYPE
 from ..compat import LONG
 from ..compat import PY_TEXT_TYPE
+from ..compat import PY_BINARY_TYPE
+from ..compat import BINARY
+from ..compat import UNICODE
 
-ProtocolVersion = LONG(1)
+##
+## Version 2 adds the prefix-compressed address lists of MAU messages.
+##
+ProtocolVersion = LONG(2)
+CompressedMauVersion = LONG(2)
 
 def getMandatory(data, key, cls=None):
     """
@@ -57,6 +64,85 @@ def getOptional(data, key, default=None, cls=None):
     return default
 
 
+def compress_addresses(addrs):
+    """
+    Encode a list of addresses in sorted order with prefix compression.  Each
+    address is written as the number of bytes it shares with the one before it,
+    the number of bytes that follow, and those bytes, with the counts as unsigned
+    LEB128 varints over the UTF-8 encoding.  Returns the encoding and the order
+    in which the addresses were written, as indices into addrs.
+    """
+    order = sorted(range(len(addrs)), key=lambda i: addrs[i])
+    out   = bytearray()
+    prev  = b''
+
+    def varint(n):
+        while True:
+            b = n & 0x7F
+            n >>= 7
+            if n:
+                out.append(b | 0x80)
+            else:
+                out.append(b)
+                return
+
+    for i in order:
+        cur    = BINARY(addrs[i])
+        shared = 0
+        limit  = min(len(prev), len(cur))
+        while shared < limit and prev[shared:shared + 1] == cur[shared:shared + 1]:
+            shared += 1
+        varint(shared)
+        varint(len(cur) - shared)
+        out.extend(cur[shared:])
+        prev = cur
+    return bytes(out), order
+
+
+def expand_addresses(blob):
+    """
+    Decode a list of addresses encoded by compress_addresses.
+    """
+    data  = bytearray(blob)
+    addrs = []
+    prev  = bytearray()
+    pos   = 0
+
+    def varint():
+        n     = 0
+        shift = 0
+        while True:
+            b = data[pos + shift // 7]
+            n |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return n, shift // 7
+
+    while pos < len(data):
+        shared, size = varint()
+        pos += size
+        length, size = varint()
+        pos += size
+        if shared > len(prev) or pos + length > len(data):
+            raise Exception("Malformed compressed address list")
+        cur = prev[:shared] + data[pos:pos + length]
+        pos += length
+        addrs.append(UNICODE(bytes(cur)))
+        prev = cur
+    return addrs
+
+
+##
+## The decoder used for compressed address lists.  The router installs the one
+## implemented in C by its adapter.
+##
+_address_expander = expand_addresses
+
+def set_address_expander(expander):
+    global _address_expander
+    _address_expander = expander or expand_addresses
+
+
 class LinkState(object):
     """
     The link-state of a single router.  The link state consists of a list of neighbor routers reachable from
@@ -251,14 +337,15 @@ class MessageMAU(object):
     """
     """
     def __init__(self, body, _id=None, _seq=None, _add_list=None, _del_list=None, _exist_list=None, _hints=None):
+        self.compressed = False
         if body:
             self.id = getMandatory(body, 'id', PY_TEXT_TYPE)
             self.version = getOptional(body, 'pv', 0, PY_LONG_TYPE)
             self.area = '0'
             self.mobile_seq = getMandatory(body, 'mobile_seq', PY_LONG_TYPE)
-            self.add_list = getOptional(body, 'add', None, list)
-            self.del_list = getOptional(body, 'del', None, list)
-            self.exist_list = getOptional(body, 'exist', None, list)
+            self.add_list = self._get_list(body, 'add')
+            self.del_list = self._get_list(body, 'del')
+            self.exist_list = self._get_list(body, 'exist')
             self.hints = getOptional(body, 'hints', None, list)
         else:
             self.id = _id
@@ -270,6 +357,25 @@ class MessageMAU(object):
             self.exist_list = _exist_list
             self.hints = _hints
 
+    def _get_list(self, body, key):
+        blob = getOptional(body, key + '_pc', None, PY_BINARY_TYPE)
+        if blob is not None:
+            return _address_expander(blob)
+        return getOptional(body, key, None, list)
+
+    def _set_list(self, body, key, addrs, hints=None):
+        ##
+        ## Compressed lists are written in sorted order; hints follow their addresses.
+        ##
+        if not self.compressed:
+            body[key] = addrs
+            return hints
+        blob, order = compress_addresses(addrs)
+        body[key + '_pc'] = blob
+        if hints is not None:
+            return [hints[i] for i in order]
+        return None
+
     def get_opcode(self):
         return 'MAU'
 
@@ -290,10 +396,11 @@ class MessageMAU(object):
                 'pv'         : self.version,
                 'area'       : self.area,
                 'mobile_seq' : self.mobile_seq }
-        if self.add_list != None:   body['add']   = self.add_list
-        if self.del_list != None:   body['del']   = self.del_list
-        if self.exist_list != None: body['exist'] = self.exist_list
-        if self.hints != None: body['hints'] = self.hints
+        hints = self.hints
+        if self.add_list != None:   hints = self._set_list(body, 'add', self.add_list, hints)
+        if self.del_list != None:   self._set_list(body, 'del', self.del_list)
+        if self.exist_list != None: self._set_list(body, 'exist', self.exist_list)
+        if hints != None: body['hints'] = hints
         return body
 
 
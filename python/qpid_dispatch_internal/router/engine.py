@@ -23,11 +23,13 @@ from __future__ import absolute_import
 from __future__ import print_function
 
 from .data import MessageHELLO, MessageRA, MessageLSU, MessageMAU, MessageMAR, MessageLSR
+from .data import set_address_expander
 from .hello import HelloProtocol
 from .link import LinkStateEngine
 from .path import PathEngine
 from .mobile import MobileAddressEngine
 from .node import NodeTracker
+from .snapshot import RouteSnapshot
 from .message import Message
 
 from traceback import format_exc, extract_stack
@@ -53,6 +55,7 @@ class RouterEngine(object):
         ##
         self.domain         = "domain"
         self.router_adapter = router_adapter
+        set_address_expander(getattr(router_adapter, 'decode_addresses', None))
         self._config        = None # Not yet loaded
         self._log_hello     = LogAdapter("ROUTER_HELLO")
         self._log_ls        = LogAdapter("ROUTER_LS")
@@ -78,6 +81,10 @@ class RouterEngine(object):
         self.link_state_engine     = LinkStateEngine(self)
         self.path_engine           = PathEngine(self)
         self.mobile_address_engine = MobileAddressEngine(self, self.node_tracker)
+        self.route_snapshot        = RouteSnapshot(self, self.node_tracker,
+                                                   self.config.attributes.get('routeSnapshotFile'),
+                                                   self.config.attributes.get('routeSnapshotIntervalSeconds', 30))
+        self.route_snapshot.load(time.time())
 
 
     ##========================================================================================
@@ -116,26 +123,54 @@ class RouterEngine(object):
         except Exception:
             self.log_ma(LOG_ERROR, "Exception in del-address processing\n%s" % format_exc(LOG_STACK_LIMIT))
 
+    def addressesChanged(self, changes):
+        """
+        Apply a batch of local address changes, in order.  Each change is an
+        (address, treatment) tuple; a treatment of None removes the address.
+        """
+        for addr, treatment in changes:
+            if treatment is None:
+                self.addressRemoved(addr)
+            else:
+                self.addressAdded(addr, treatment)
+
     def linkLost(self, link_id):
         """
+        The topology is recomputed, and the RA announcing the change sent, at
+        once rather than at the next tick, so traffic is rerouted around the
+        lost link as soon as the connection failure is detected.
         """
-        self.node_tracker.link_lost(link_id)
+        self.router_adapter.begin_route_update()
+        try:
+            self.node_tracker.link_lost(link_id)
+            self.node_tracker.tick(time.time())
+        except Exception:
+            self.log(LOG_ERROR, "Exception in link-lost processing\n%s" % format_exc(LOG_STACK_LIMIT))
+        finally:
+            self.router_adapter.commit_route_update()
 
 
     def handleTimerTick(self):
         """
+        The route table updates made during a tick reach the core as one
+        transaction, so it never forwards on a partly recomputed topology.
         """
+        self.router_adapter.begin_route_update()
         try:
             now = time.time()
             self.hello_protocol.tick(now)
             self.link_state_engine.tick(now)
             self.node_tracker.tick(now)
+            self.route_snapshot.tick(now)
         except Exception:
             self.log(LOG_ERROR, "Exception in timer processing\n%s" % format_exc(LOG_STACK_LIMIT))
+        finally:
+            self.router_adapter.commit_route_update()
 
     def handleControlMessage(self, opcode, body, link_id, cost):
         """
         """
+        self.router_adapter.begin_route_update()
         try:
             now = time.time()
             if   opcode == 'HELLO':
@@ -171,6 +206,8 @@ class RouterEngine(object):
         except Exception:
             self.log(LOG_ERROR, "Exception in control message processing\n%s" % format_exc(LOG_STACK_LIMIT))
             self.log(LOG_ERROR, "Control message error: opcode=%s body=%r" % (opcode, body))
+        finally:
+            self.router_adapter.commit_route_update()
 
     def receive(self, message, link_id, cost):
         """
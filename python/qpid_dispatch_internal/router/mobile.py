@@ -22,8 +22,9 @@ from __future__ import division
 from __future__ import absolute_import
 from __future__ import print_function
 
-from .data import MessageMAR, MessageMAU
+from .data import MessageMAR, MessageMAU, CompressedMauVersion
 from ..dispatch import LOG_TRACE
+from ..compat import IS_PY2
 
 MAX_KEPT_DELTAS = 10
 
@@ -39,7 +40,7 @@ class MobileAddressEngine(object):
         self.node_tracker  = node_tracker
         self.id            = self.container.id
         self.mobile_seq    = 0
-        self.local_addrs   = []
+        self.local_addrs   = set()
         self.added_addrs   = []
         self.deleted_addrs = []
         self.sent_deltas   = {}
@@ -55,6 +56,7 @@ class MobileAddressEngine(object):
             self.mobile_seq += 1
             hints = [self.treatments[a] for a in self.added_addrs]
             msg = MessageMAU(None, self.id, self.mobile_seq, self.added_addrs, self.deleted_addrs, _hints=hints)
+            msg.compressed = self._compress_for(self.node_tracker.nodes.values())
 
             self.sent_deltas[self.mobile_seq] = msg
             if len(self.sent_deltas) > MAX_KEPT_DELTAS:
@@ -62,9 +64,8 @@ class MobileAddressEngine(object):
 
             self.container.send('amqp:/_topo/0/all/qdrouter.ma', msg)
             self.container.log_ma(LOG_TRACE, "SENT: %r" % msg)
-            self.local_addrs.extend(self.added_addrs)
-            for addr in self.deleted_addrs:
-                self.local_addrs.remove(addr)
+            self.local_addrs.update(self.added_addrs)
+            self.local_addrs.difference_update(self.deleted_addrs)
             self.added_addrs   = []
             self.deleted_addrs = []
         return self.mobile_seq
@@ -74,7 +75,7 @@ class MobileAddressEngine(object):
         """
         """
         self.treatments[addr] = treatment
-        if self.local_addrs.count(addr) == 0:
+        if addr not in self.local_addrs:
             if self.added_addrs.count(addr) == 0:
                 self.added_addrs.append(addr)
         else:
@@ -86,7 +87,7 @@ class MobileAddressEngine(object):
         """
         """
         del self.treatments[addr]
-        if self.local_addrs.count(addr) > 0:
+        if addr in self.local_addrs:
             if self.deleted_addrs.count(addr) == 0:
                 self.deleted_addrs.append(addr)
         else:
@@ -105,6 +106,14 @@ class MobileAddressEngine(object):
             return
         node = self.node_tracker.router_node(msg.id)
 
+        ##
+        ## Addresses loaded from a route snapshot cannot be patched by an update
+        ## that arrives before the RA that would have validated them.
+        ##
+        if node.snapshot_mobile_seq is not None:
+            node.unmap_all_addresses()
+            node.snapshot_mobile_seq = None
+
         if msg.exist_list != None:
             ##
             ## Absolute MAU
@@ -122,15 +131,8 @@ class MobileAddressEngine(object):
                 ## This message represents the next expected sequence, incorporate the deltas
                 ##
                 node.mobile_address_sequence += 1
-                treatments = msg.hints or []
-                for a in msg.add_list:
-                    if len(treatments):
-                        treatment = treatments.pop(0)
-                    else:
-                        treatment = -1
-                    node.map_address(a, treatment)
-                for a in msg.del_list:
-                    node.unmap_address(a)
+                node.map_addresses(msg.add_list or [], msg.hints)
+                node.unmap_addresses(msg.del_list or [])
 
             elif node.mobile_address_sequence == msg.mobile_seq:
                 ##
@@ -155,7 +157,9 @@ class MobileAddressEngine(object):
             ##
             ## We can catch the peer up with a series of stored differential updates
             ##
+            compressed = self._compress_for([self.node_tracker.nodes.get(msg.id)])
             for s in range(msg.have_seq + 1, self.mobile_seq + 1):
+                self.sent_deltas[s].compressed = compressed
                 self.container.send('amqp:/_topo/0/%s/qdrouter.ma' % msg.id, self.sent_deltas[s])
                 self.container.log_ma(LOG_TRACE, "SENT: %r" % self.sent_deltas[s])
             return
@@ -163,11 +167,25 @@ class MobileAddressEngine(object):
         ##
         ## The peer needs to be sent an absolute update with the whole address list
         ##
-        smsg = MessageMAU(None, self.id, self.mobile_seq, None, None, self.local_addrs)
+        smsg = MessageMAU(None, self.id, self.mobile_seq, None, None, list(self.local_addrs))
+        smsg.compressed = self._compress_for([self.node_tracker.nodes.get(msg.id)])
         self.container.send('amqp:/_topo/0/%s/qdrouter.ma' % msg.id, smsg)
         self.container.log_ma(LOG_TRACE, "SENT: %r" % smsg)
 
 
+    def _compress_for(self, nodes):
+        ##
+        ## Use the prefix-compressed address lists only if every receiver understands
+        ## them.  Python 2 cannot send binary containing zero octets, so it never does.
+        ##
+        if IS_PY2:
+            return False
+        for node in nodes:
+            if node is None or node.version is None or node.version < CompressedMauVersion:
+                return False
+        return True
+
+
     def send_mar(self, node_id, seq):
         msg = MessageMAR(None, self.id, seq)
         self.container.send('amqp:/_topo/0/%s/qdrouter.ma' % node_id, msg)
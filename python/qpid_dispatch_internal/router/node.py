@@ -55,6 +55,7 @@ class NodeTracker(object):
         self.neighbor_max_age = self.container.config.helloMaxAgeSeconds
         self.ls_max_age       = self.container.config.remoteLsMaxAgeSeconds
         self.flux_interval    = self.container.config.raIntervalFluxSeconds * 2
+        self.equal_cost_multipath = self.container.config.attributes.get('equalCostMultipath', False)
         self.container.router_adapter.get_agent().add_implementation(self, "router.node")
 
 
@@ -157,6 +158,9 @@ class NodeTracker(object):
             for node_id, node in self.nodes.items():
                 collection[node_id] = node.link_state
             next_hops, costs, valid_origins, radius = self.container.path_engine.calculate_routes(collection)
+            equal_cost_hops = {}
+            if self.equal_cost_multipath:
+                equal_cost_hops = self.container.path_engine.equal_cost_next_hops(collection, costs)
             self.container.log_ls(LOG_INFO, "Computed next hops: %r" % next_hops)
             self.container.log_ls(LOG_INFO, "Computed costs: %r" % costs)
             self.container.log_ls(LOG_INFO, "Computed valid origins: %r" % valid_origins)
@@ -178,6 +182,9 @@ class NodeTracker(object):
                 node.set_next_hop(next_hop)
                 node.set_valid_origins(vo)
                 node.set_cost(cost)
+                if self.equal_cost_multipath:
+                    hops = equal_cost_hops.get(node_id, [])
+                    node.set_equal_cost_hops(hops if next_hop_id in hops else [])
 
         ##
         ## Send link-state requests and mobile-address requests to the nodes
@@ -293,6 +300,16 @@ class NodeTracker(object):
             self.recompute_topology = True
             node.request_link_state()
 
+        ##
+        ## Validate addresses loaded from a route snapshot.
+        ##
+        if node.snapshot_mobile_seq is not None:
+            if node.instance == instance and node.snapshot_mobile_seq == mobile_seq:
+                node.mobile_address_sequence = mobile_seq
+            else:
+                node.unmap_all_addresses()
+            node.snapshot_mobile_seq = None
+
         ##
         ## Update the last seen time to now to control expiration of the link state.
         ##
@@ -321,6 +338,25 @@ class NodeTracker(object):
             self.nodes[node_id] = RouterNode(self, node_id, version, None)
 
 
+    def warm_start(self, node_id, instance, peers, addrs, mobile_seq, now):
+        """
+        Invoked when a remote router is loaded from a route snapshot.  Its link
+        state keeps sequence zero, so the first LSU from the router replaces it.
+        Its addresses are kept only if its first RA shows the same instance and
+        mobile sequence they were saved at.
+        """
+        if node_id == self.my_id or node_id in self.nodes:
+            return False
+        node = RouterNode(self, node_id, None, instance)
+        self.nodes[node_id] = node
+        node.link_state = LinkState(None, node_id, 0, peers)
+        node.link_state.last_seen = now
+        node.map_addresses(addrs)
+        node.snapshot_mobile_seq = mobile_seq
+        self.recompute_topology = True
+        return True
+
+
     def link_state_received(self, node_id, version, link_state, instance, now):
         """
         Invoked when a link state update is received from another router.
@@ -406,8 +442,10 @@ class RouterNode(object):
         self.next_hop_router         = None
         self.cost                    = None
         self.valid_origins           = None
-        self.mobile_addresses        = []
+        self.equal_cost_hops         = []
+        self.mobile_addresses        = set()
         self.mobile_address_sequence = 0
+        self.snapshot_mobile_seq     = None  # Set until addresses loaded from a snapshot are validated
         self.need_ls_request         = True
         self.need_mobile_request     = False
         self.keep_alive_count        = 0
@@ -489,6 +527,19 @@ class RouterNode(object):
         self.log(LOG_TRACE, "Node %s valid origins: %r" % (self.id, valid_origins))
 
 
+    def set_equal_cost_hops(self, hops):
+        ##
+        ## Only a choice of more than one neighbor is passed to the core.
+        ##
+        if len(hops) < 2:
+            hops = []
+        if self.equal_cost_hops == hops:
+            return
+        self.equal_cost_hops = hops
+        self.adapter.set_equal_cost_hops(self.maskbit, [self.parent.nodes[N].maskbit for N in hops])
+        self.log(LOG_TRACE, "Node %s equal-cost next hops: %r" % (self.id, hops))
+
+
     def set_cost(self, cost):
         if self.cost == cost:
             return
@@ -542,7 +593,7 @@ class RouterNode(object):
 
 
     def map_address(self, addr, treatment = -1):
-        self.mobile_addresses.append(addr)
+        self.mobile_addresses.add(addr)
         self.adapter.map_destination(addr, treatment, self.maskbit)
         self.log(LOG_DEBUG, "Remote destination %s mapped to router %s" % (self._logify(addr), self.id))
 
@@ -553,25 +604,46 @@ class RouterNode(object):
         self.log(LOG_DEBUG, "Remote destination %s unmapped from router %s" % (self._logify(addr), self.id))
 
 
+    def map_addresses(self, addrs, treatments=None):
+        """
+        Map a list of addresses with one call into the router.
+        """
+        treatments = treatments or []
+        hints      = []
+        new_addrs  = []
+        for i, a in enumerate(addrs):
+            if a not in self.mobile_addresses:
+                self.mobile_addresses.add(a)
+                new_addrs.append(a)
+                hints.append(treatments[i] if i < len(treatments) else -1)
+        if not new_addrs:
+            return
+        addrs = new_addrs
+        self.adapter.map_destinations(addrs, hints, self.maskbit)
+        self.log(LOG_DEBUG, "%d remote destinations mapped to router %s" % (len(addrs), self.id))
+
+
+    def unmap_addresses(self, addrs):
+        """
+        Unmap a list of addresses with one call into the router.
+        """
+        addrs = [a for a in set(addrs) if a in self.mobile_addresses]
+        if not addrs:
+            return
+        self.mobile_addresses.difference_update(addrs)
+        self.adapter.unmap_destinations(addrs, self.maskbit)
+        self.log(LOG_DEBUG, "%d remote destinations unmapped from router %s" % (len(addrs), self.id))
+
+
     def unmap_all_addresses(self):
         self.mobile_address_sequence = 0
-        while self.mobile_addresses:
-            self.unmap_address(self.mobile_addresses[0])
+        self.unmap_addresses(list(self.mobile_addresses))
 
 
     def overwrite_addresses(self, addrs):
-        added   = []
-        deleted = []
-        for a in addrs:
-            if a not in self.mobile_addresses:
-                added.append(a)
-        for a in self.mobile_addresses:
-            if a not in addrs:
-                deleted.append(a)
-        for a in added:
-            self.map_address(a)
-        for a in deleted:
-            self.unmap_address(a)
+        wanted = set(addrs)
+        self.map_addresses([a for a in addrs if a not in self.mobile_addresses])
+        self.unmap_addresses([a for a in self.mobile_addresses if a not in wanted])
 
 
     def update_instance(self, instance, version):
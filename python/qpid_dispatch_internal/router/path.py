@@ -130,6 +130,20 @@ class PathEngine(object):
 
 
     def calculate_routes(self, collection):
+        ##
+        ## Use the path engine in the router core when it is available.  It computes
+        ## the same results as the code below in C, which matters on large meshes
+        ## where the tree must be calculated from every router for the valid origins.
+        ##
+        adapter = getattr(self.container, 'router_adapter', None)
+        if adapter and hasattr(adapter, 'calculate_routes'):
+            link_states = {}
+            for _id, ls in collection.items():
+                link_states[_id] = ls.peers
+            result = adapter.calculate_routes(self.id, link_states)
+            if result is not None:
+                return result
+
         ##
         ## Generate the shortest-path tree with the local node as root
         ##
@@ -168,6 +182,41 @@ class PathEngine(object):
         return (next_hops, cost, valid_origins, radius)
 
 
+    def equal_cost_next_hops(self, collection, costs):
+        """
+        Return a map of each reachable remote router to the sorted list of
+        neighbors that begin one of its equal-cost shortest paths.  costs is the
+        cost map returned by calculate_routes.
+        """
+        ##
+        ## Collect the links into each node.  Peers with no link state of their
+        ## own are never used as intermediate hops here.
+        ##
+        links_in = {}
+        for _id, ls in collection.items():
+            for p, p_cost in ls.peers.items():
+                links_in.setdefault(p, []).append((_id, p_cost))
+
+        ##
+        ## A node's first hops are the union of those of every neighbor that is on
+        ## a shortest path to it.  Visiting the nodes in cost order means those
+        ## neighbors have been resolved first.
+        ##
+        first_hops = {}
+        for cost, v in sorted((c, _id) for _id, c in costs.items() if _id != self.id):
+            hops = set()
+            for u, u_cost in links_in.get(v, []):
+                cu = 0 if u == self.id else costs.get(u)
+                if cu is None or cu >= cost or cu + u_cost != cost:
+                    continue
+                if u == self.id:
+                    hops.add(v)
+                else:
+                    hops.update(first_hops.get(u, ()))
+            first_hops[v] = hops
+        return dict((v, sorted(hops)) for v, hops in first_hops.items())
+
+
 
 class NodeSet(object):
     """
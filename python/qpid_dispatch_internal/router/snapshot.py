@@ -0,0 +1,124 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import json
+import os
+
+from ..dispatch import LOG_INFO, LOG_WARNING
+
+SnapshotVersion = 1
+
+
+class RouteSnapshot(object):
+    """
+    This module periodically saves the topology and the remote mobile addresses
+    learned by this router, and seeds a restarted router from the saved copy so
+    that it can route before the link-state and mobile-address protocols have
+    converged.
+
+    Everything loaded from a snapshot is stale.  Link states carry sequence
+    zero, so the first RA from each router triggers the LSR that replaces
+    them.  Address sets are kept only if that RA shows the instance and mobile
+    sequence they were saved at; otherwise they are dropped and fetched again
+    with a MAR.  Stale link states that are never refreshed age out after
+    remoteLsMaxAgeSeconds as usual.
+    """
+    def __init__(self, container, node_tracker, path, interval):
+        self.container    = container
+        self.node_tracker = node_tracker
+        self.path         = path
+        self.interval     = interval
+        self.last_save    = 0
+        self.last_digest  = None
+
+
+    def tick(self, now):
+        if not self.path or now - self.last_save < self.interval:
+            return
+        self.last_save = now
+        self.save()
+
+
+    def _digest(self):
+        return sorted((node_id, node.instance, node.link_state.ls_seq, node.mobile_address_sequence)
+                      for node_id, node in self.node_tracker.nodes.items())
+
+
+    def save(self):
+        """
+        Write the snapshot if anything changed since the last one.  The file is
+        replaced atomically so a crash mid-write leaves the previous snapshot.
+        """
+        digest = self._digest()
+        if digest == self.last_digest:
+            return
+        nodes = {}
+        for node_id, node in self.node_tracker.nodes.items():
+            if node.link_state.ls_seq == 0:
+                continue    # never heard from this router, or itself stale
+            nodes[node_id] = {'instance'   : node.instance,
+                              'peers'      : node.link_state.peers,
+                              'mobile_seq' : node.mobile_address_sequence,
+                              'addrs'      : sorted(node.mobile_addresses)}
+        snapshot = {'version' : SnapshotVersion,
+                    'id'      : self.container.id,
+                    'nodes'   : nodes}
+        tmp = self.path + '.tmp'
+        try:
+            with open(tmp, 'w') as f:
+                json.dump(snapshot, f)
+            os.rename(tmp, self.path)
+            self.last_digest = digest
+        except (IOError, OSError) as e:
+            self.container.log_ls(LOG_WARNING, "Unable to write route snapshot %s: %s" % (self.path, e))
+
+
+    def load(self, now):
+        """
+        Seed the node tracker from the snapshot, if there is a usable one.
+        Returns the number of routers loaded.
+        """
+        if not self.path or not os.path.exists(self.path):
+            return 0
+        try:
+            with open(self.path) as f:
+                snapshot = json.load(f)
+            if snapshot.get('version') != SnapshotVersion or snapshot.get('id') != self.container.id:
+                self.container.log_ls(LOG_WARNING, "Ignoring route snapshot %s: not written by this router" % self.path)
+                return 0
+            nodes = snapshot['nodes']
+        except (IOError, OSError, ValueError, KeyError, AttributeError) as e:
+            self.container.log_ls(LOG_WARNING, "Ignoring route snapshot %s: %s" % (self.path, e))
+            return 0
+
+        count = 0
+        for node_id, entry in nodes.items():
+            if self.node_tracker.warm_start(node_id, entry.get('instance'), dict(entry.get('peers', {})),
+                                            entry.get('addrs', []), entry.get('mobile_seq', 0), now):
+                count += 1
+        for entry in nodes.values():
+            for peer in entry.get('peers', {}):
+                self.node_tracker.router_learned(peer, None)
+        self.container.log_ls(LOG_INFO, "Warm start: loaded %d routers from route snapshot %s" % (count, self.path))
+        return count
@@ -19,13 +19,20 @@
 
 #include <Python.h>
 #include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/atomic.h>
 #include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/log.h>
+#include <qpid/dispatch/server.h>
+#include <qpid/dispatch/timer.h>
+#include <execinfo.h>
 #include <memory.h>
+#include <sys/mman.h>
 #include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include "entity.h"
 #include "entity_cache.h"
+#include "stats_page.h"
 #include "config.h"
 
 const char *QD_ALLOCATOR_TYPE = "allocator";
@@ -44,29 +51,187 @@ DEQ_DECLARE(qd_alloc_type_t, qd_alloc_type_list_t);
 #define PATTERN_BACK  0xbabecafe
 
 struct qd_alloc_item_t {
-    DEQ_LINKS(qd_alloc_item_t);
+    qd_alloc_item_t      *next;
     uint32_t              sequence;
+    uint32_t              site;      ///< Index + 1 of the sampled call site, zero if not sampled
 #ifdef QD_MEMORY_DEBUG
     qd_alloc_type_desc_t *desc;
     uint32_t              header;
 #endif
 };
 
-DEQ_DECLARE(qd_alloc_item_t, qd_alloc_item_list_t);
+//
+// Free lists are singly-linked LIFO stacks.  Taking from and returning to the head
+// keeps recently used (cache-warm) items in play.
+//
+typedef struct {
+    qd_alloc_item_t *head;
+    int              size;
+} qd_alloc_item_list_t;
 
+static inline void item_list_push(qd_alloc_item_list_t *list, qd_alloc_item_t *item)
+{
+    item->next = list->head;
+    list->head = item;
+    list->size++;
+}
+
+static inline qd_alloc_item_t *item_list_pop(qd_alloc_item_list_t *list)
+{
+    qd_alloc_item_t *item = list->head;
+    if (item) {
+        list->head = item->next;
+        list->size--;
+    }
+    return item;
+}
+
+
+//
+// Full batches move between thread pools and the global pool through a small array of
+// exchange slots.  Each slot holds either nothing or one full batch, chained through
+// the items' next pointers with the batch's item count stored in the (free) payload
+// of its first item.  A thread takes a batch by swapping a slot to empty and gives one
+// by swapping an empty slot to its batch.  A swap does not depend on what the slot
+// held before, so the exchange is free of ABA hazards and needs no lock.  Only when the
+// exchange is empty (or full) does a thread fall back to the locked global free list.
+//
+#define EXCHANGE_SLOTS 16
+
+typedef union {
+    sys_atomic_ptr_t batch;
+    char             pad[64];  // One slot per cache line
+} qd_alloc_exchange_slot_t;
+
+//
+// Allocation tracking:  While tracking is enabled for a type, every ALLOC_SAMPLE_PERIOD'th
+// allocation on each thread records its call site in the type's site table and marks the
+// item with the site.  Freeing a marked item takes it out of the site's live count, so
+// sites with a growing live count are the likely leaks.  Sampled sites stay in the
+// table (and keep their live counts) until shutdown.  When the table fills up, further
+// sites are counted in its last entry.
+//
+// A site is the innermost ALLOC_SITE_DEPTH frames above qd_alloc.  Depending on whether
+// the compiler turned new_T's call into a tail call, the first of these is new_T or its
+// caller; two frames name the caller either way.
+//
+#define ALLOC_SAMPLE_PERIOD 64
+#define ALLOC_SITES         32
+#define ALLOC_SITE_DEPTH     2
+
+typedef struct {
+    void     *pc[ALLOC_SITE_DEPTH];  ///< Return addresses above qd_alloc; zero for the overflow entry
+    uint64_t  sampled;  ///< Sampled allocations since tracking was (re)enabled
+    uint64_t  live;     ///< Sampled allocations not yet freed
+} qd_alloc_site_t;
 
 struct qd_alloc_pool_t {
     DEQ_LINKS(qd_alloc_pool_t);
-    qd_alloc_item_list_t free_list;
+    qd_alloc_item_list_t      free_list;
+    qd_alloc_exchange_slot_t *exchange;      ///< Global pool only; zero if the global list is capped
+    sys_atomic_t              exchange_items; ///< Global pool only; items held in the exchange
+    int                       slot_hint;     ///< Thread pools: slot of the last exchange
+    uint64_t             local_hits;    ///< Allocations served from the local free list
+    uint64_t             local_misses;  ///< Allocations that had to go to the global pool
+    uint64_t             ops;           ///< Local allocations and frees
+    uint64_t             ops_at_trip;   ///< Value of ops at the last trip to the global pool
+    uint64_t             trip_interval; ///< Smoothed number of local ops between trips
+    int                  transfer_batch;   ///< Thread pools: batch size, adapted to this thread
+    int                  local_free_max;   ///< Thread pools: local free list limit, scaled with the batch
+    bool                 tracking;      ///< Sample allocations (see ALLOC_SAMPLE_PERIOD)
+    int                  sample_countdown; ///< Thread pools: allocations until the next sample
+    uint64_t             allocs_at_track;  ///< Thread pools: allocations when tracking started
+    uint64_t             frees_at_track;   ///< Thread pools: frees when tracking started
+    long                 thread_id;        ///< Thread pools: owning thread
+    int                  thread_index;     ///< Thread pools: server thread index, -1 for others
+    qd_alloc_site_t     *sites;            ///< Global pool only; sampled call sites
+    int                  site_count;       ///< Global pool only; entries used in sites
+    int64_t              track_start;      ///< Global pool only; usec when tracking started
+};
+
+//
+// Items are carved out of slab chunks rather than allocated from the heap one at a
+// time.  Each chunk is aligned on its own (power-of-two) size so the chunk owning an
+// item can be found by masking the item's address.  Items are only carved as needed,
+// so the heap statistics still count individual items.  An item released to the heap
+// is returned to its chunk; the chunk's memory goes back to the heap once all of its
+// items have been released.
+//
+// Items are placed so that their payloads (not their headers) start on a cache line.
+// Objects can then lay out their fields on cache-line boundaries.
+//
+// A type may ask for its chunks to be backed by huge pages to cut TLB misses.  Its
+// chunks are then one huge page in size, mapped from the hugetlbfs pool if pages
+// have been reserved there, otherwise allocated normally and advised for
+// transparent huge pages.  If neither is available the chunks use normal pages.
+//
+typedef struct qd_alloc_chunk_t qd_alloc_chunk_t;
+
+struct qd_alloc_chunk_t {
+    DEQ_LINKS(qd_alloc_chunk_t);
+    int  capacity;
+    int  carved;
+    int  released;
+    bool mapped;   ///< Mapped from hugetlbfs rather than allocated from the heap
+};
+
+DEQ_DECLARE(qd_alloc_chunk_t, qd_alloc_chunk_list_t);
+
+struct qd_alloc_slab_t {
+    qd_alloc_chunk_list_t  chunks;
+    qd_alloc_chunk_t      *current;      ///< Chunk items are currently carved from
+    size_t                 chunk_size;
+    size_t                 item_offset;  ///< Offset of the first item's header in a chunk
+    size_t                 item_stride;
+    size_t                 live_items;   ///< Carved and not yet released
+    bool                   huge_pages;   ///< Back chunks with huge pages where possible
+    int                    page_mode;    ///< How the most recent chunk is backed
+};
+
+enum {
+    PAGE_MODE_NORMAL,
+    PAGE_MODE_REQUESTED,
+    PAGE_MODE_HUGETLB,
+    PAGE_MODE_TRANSPARENT,
+    PAGE_MODE_UNAVAILABLE
 };
 
-qd_alloc_config_t qd_alloc_default_config_big   = {16,  32, 0};
-qd_alloc_config_t qd_alloc_default_config_small = {64, 128, 0};
+static const char *page_mode_names[] = {"normal", "requested", "hugetlb", "transparent", "unavailable"};
+
+#define SLAB_CHUNK_MIN 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define CACHE_LINE     64
+#define CACHE_ROUND(s) (((s) + CACHE_LINE - 1) & ~((size_t) CACHE_LINE - 1))
+
+qd_alloc_config_t qd_alloc_default_config_big   = {16,  32, 0, 128};
+qd_alloc_config_t qd_alloc_default_config_small = {64, 128, 0, 512};
 #define BIG_THRESHOLD 2000
 
+//
+// Batch size adaption:  Each thread pool keeps a smoothed count of the local operations
+// it performs between trips to the global pool.  A thread averaging fewer than
+// ADAPT_GROW_OPS batches' worth is churning, so the batch size is doubled.  A thread
+// averaging more than ADAPT_SHRINK_OPS batches' worth no longer needs the larger batch,
+// so it is halved.
+//
+#define ADAPT_GROW_OPS    2
+#define ADAPT_SHRINK_OPS 64
+
+//
+// Statistics are updated from both the locked and the lock-free paths.
+//
+#if QD_MEMORY_STATS
+#define STAT_ADD(d,f,n) __sync_fetch_and_add(&(d)->stats->f, (n))
+#define STAT_SUB(d,f,n) __sync_fetch_and_sub(&(d)->stats->f, (n))
+#else
+#define STAT_ADD(d,f,n)
+#define STAT_SUB(d,f,n)
+#endif
+
 static sys_mutex_t          *init_lock = 0;
 static qd_alloc_type_list_t  type_list;
 static char *debug_dump = 0;
+static size_t trim_high_water = 0;
 
 static void qd_alloc_init(qd_alloc_type_desc_t *desc)
 {
@@ -82,11 +247,45 @@ static void qd_alloc_init(qd_alloc_type_desc_t *desc)
                 &qd_alloc_default_config_big : &qd_alloc_default_config_small;
 
         assert (desc->config->local_free_list_max >= desc->config->transfer_batch_size);
+        assert (desc->config->max_transfer_batch_size == 0 ||
+                desc->config->max_transfer_batch_size >= desc->config->transfer_batch_size);
 
         desc->global_pool = NEW(qd_alloc_pool_t);
+        ZERO(desc->global_pool);
         DEQ_ITEM_INIT(desc->global_pool);
-        DEQ_INIT(desc->global_pool->free_list);
         desc->lock = sys_mutex();
+
+        //
+        // A capped global free list must see every batch to enforce the cap, so the
+        // exchange is only used when the global list is unbounded.  The batch count
+        // is kept in an item's payload, which must be large enough to hold it.
+        //
+        if (desc->config->global_free_list_max == 0 && desc->total_size >= sizeof(int)) {
+            ALLOC_CACHE_ALIGNED(sizeof(qd_alloc_exchange_slot_t) * EXCHANGE_SLOTS, desc->global_pool->exchange);
+            for (int i = 0; desc->global_pool->exchange && i < EXCHANGE_SLOTS; i++)
+                sys_atomic_ptr_init(&desc->global_pool->exchange[i].batch, 0);
+        }
+        sys_atomic_init(&desc->global_pool->exchange_items, 0);
+
+        //
+        // Size the slab chunks so that each holds at least one transfer batch.
+        //
+        size_t item_size = sizeof(qd_alloc_item_t) + desc->total_size;
+#ifdef QD_MEMORY_DEBUG
+        item_size += sizeof(uint32_t);
+#endif
+        qd_alloc_slab_t *slab = NEW(qd_alloc_slab_t);
+        DEQ_INIT(slab->chunks);
+        slab->current     = 0;
+        slab->live_items  = 0;
+        slab->huge_pages  = false;
+        slab->page_mode   = PAGE_MODE_NORMAL;
+        slab->item_offset = CACHE_ROUND(sizeof(qd_alloc_chunk_t) + sizeof(qd_alloc_item_t)) - sizeof(qd_alloc_item_t);
+        slab->item_stride = CACHE_ROUND(item_size);
+        slab->chunk_size  = SLAB_CHUNK_MIN;
+        while (slab->chunk_size < slab->item_offset + sizeof(qd_alloc_item_t) + slab->item_stride * desc->config->transfer_batch_size)
+            slab->chunk_size <<= 1;
+        desc->slab = slab;
         DEQ_INIT(desc->tpool_list);
 #if QD_MEMORY_STATS
         desc->stats = NEW(qd_alloc_stats_t);
@@ -107,6 +306,286 @@ static void qd_alloc_init(qd_alloc_type_desc_t *desc)
 }
 
 
+/**
+ * Get the memory for a new slab chunk, aligned on the chunk size.
+ */
+static void *qd_alloc_chunk_memory(qd_alloc_slab_t *slab, bool *mapped)
+{
+    void *mem = 0;
+
+    *mapped = false;
+    if (slab->huge_pages) {
+#ifdef MAP_HUGETLB
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        flags |= 21 << MAP_HUGE_SHIFT;  // 2MB pages, whatever the system default
+#endif
+        mem = mmap(0, slab->chunk_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mem != MAP_FAILED) {
+            if (((uintptr_t) mem & (slab->chunk_size - 1)) == 0) {
+                *mapped = true;
+                slab->page_mode = PAGE_MODE_HUGETLB;
+                return mem;
+            }
+            munmap(mem, slab->chunk_size);
+        }
+        mem = 0;
+#endif
+    }
+
+    if (posix_memalign(&mem, slab->chunk_size, slab->chunk_size) != 0)
+        return 0;
+
+    if (slab->huge_pages) {
+        slab->page_mode = PAGE_MODE_UNAVAILABLE;
+#ifdef MADV_HUGEPAGE
+        if (madvise(mem, slab->chunk_size, MADV_HUGEPAGE) == 0)
+            slab->page_mode = PAGE_MODE_TRANSPARENT;
+#endif
+    }
+    return mem;
+}
+
+
+/**
+ * Carve a new item out of the type's slab.  Must be called with desc->lock held.
+ */
+static qd_alloc_item_t *qd_alloc_carve_lh(qd_alloc_type_desc_t *desc)
+{
+    qd_alloc_slab_t  *slab  = desc->slab;
+    qd_alloc_chunk_t *chunk = slab->current;
+
+    if (!chunk || chunk->carved == chunk->capacity) {
+        bool  mapped;
+        void *mem = qd_alloc_chunk_memory(slab, &mapped);
+        if (!mem)
+            return 0;
+        chunk = (qd_alloc_chunk_t*) mem;
+        DEQ_ITEM_INIT(chunk);
+        chunk->mapped   = mapped;
+        chunk->capacity = (slab->chunk_size - slab->item_offset - sizeof(qd_alloc_item_t)) / slab->item_stride;
+        chunk->carved   = 0;
+        chunk->released = 0;
+        DEQ_INSERT_TAIL(slab->chunks, chunk);
+        slab->current = chunk;
+    }
+
+    qd_alloc_item_t *item = (qd_alloc_item_t*) ((char*) chunk + slab->item_offset + slab->item_stride * chunk->carved++);
+    slab->live_items++;
+    item->next     = 0;
+    item->sequence = 0;
+    item->site     = 0;
+    return item;
+}
+
+
+/**
+ * Give an item back to its slab chunk, freeing the chunk once all of its items
+ * have been given back.  Must be called with desc->lock held.
+ */
+static void qd_alloc_release_lh(qd_alloc_type_desc_t *desc, qd_alloc_item_t *item)
+{
+    qd_alloc_slab_t  *slab  = desc->slab;
+    qd_alloc_chunk_t *chunk = (qd_alloc_chunk_t*) ((uintptr_t) item & ~((uintptr_t) slab->chunk_size - 1));
+
+    slab->live_items--;
+    if (++chunk->released == chunk->capacity) {
+        DEQ_REMOVE(slab->chunks, chunk);
+        if (slab->current == chunk)
+            slab->current = 0;
+        if (chunk->mapped)
+            munmap(chunk, slab->chunk_size);
+        else
+            free(chunk);
+    }
+}
+
+
+/**
+ * Account for a thread's trip to the global pool and adapt the thread's batch size to
+ * how often it makes such trips.  Only the owning thread writes the batch size and
+ * limit; they are stored atomically for the management agent, which reads them.
+ */
+static void qd_alloc_adapt(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool)
+{
+    uint64_t ops_since = pool->ops - pool->ops_at_trip;
+    pool->trip_interval = pool->ops_at_trip == 0 ? ops_since : (pool->trip_interval * 3 + ops_since) / 4;
+    pool->ops_at_trip   = pool->ops;
+
+    qd_alloc_config_t *config = desc->config;
+    if (config->max_transfer_batch_size == 0)
+        return;
+
+    int current = pool->transfer_batch;
+    int batch   = current;
+    if (pool->trip_interval < (uint64_t) batch * ADAPT_GROW_OPS) {
+        batch *= 2;
+        if (batch > config->max_transfer_batch_size)
+            batch = config->max_transfer_batch_size;
+    } else if (pool->trip_interval > (uint64_t) batch * ADAPT_SHRINK_OPS) {
+        batch /= 2;
+        if (batch < config->transfer_batch_size)
+            batch = config->transfer_batch_size;
+    }
+
+    if (batch != current) {
+        __atomic_store_n(&pool->transfer_batch, batch, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->local_free_max,
+                         (int) (((int64_t) config->local_free_list_max * batch) / config->transfer_batch_size),
+                         __ATOMIC_RELAXED);
+    }
+}
+
+
+void qd_alloc_pool_limits(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool, int *batch, int *local_max)
+{
+    if (!pool) {
+        *batch     = desc->config->transfer_batch_size;
+        *local_max = desc->config->local_free_list_max;
+        return;
+    }
+    *batch     = __atomic_load_n(&pool->transfer_batch, __ATOMIC_RELAXED);
+    *local_max = __atomic_load_n(&pool->local_free_max, __ATOMIC_RELAXED);
+}
+
+
+static inline void batch_set_count(qd_alloc_item_t *batch, int count)
+{
+    *((int*) &batch[1]) = count;
+}
+
+
+static inline int batch_count(qd_alloc_item_t *batch)
+{
+    return *((int*) &batch[1]);
+}
+
+
+/**
+ * Take a full batch from the exchange onto the (empty) local free list.
+ */
+static bool qd_alloc_exchange_take(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool)
+{
+    qd_alloc_exchange_slot_t *exchange = desc->global_pool->exchange;
+    if (!exchange)
+        return false;
+
+    for (int i = 0; i < EXCHANGE_SLOTS; i++) {
+        int slot = (pool->slot_hint + i) & (EXCHANGE_SLOTS - 1);
+        if (sys_atomic_ptr_get(&exchange[slot].batch) == 0)
+            continue;
+        qd_alloc_item_t *batch = (qd_alloc_item_t*) sys_atomic_ptr_swap(&exchange[slot].batch, 0);
+        if (batch) {
+            pool->free_list.head = batch;
+            pool->free_list.size = batch_count(batch);
+            pool->slot_hint      = slot;
+            sys_atomic_sub(&desc->global_pool->exchange_items, pool->free_list.size);
+            STAT_ADD(desc, batches_rebalanced_to_threads, 1);
+            STAT_ADD(desc, held_by_threads, pool->free_list.size);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Offer a detached batch to the exchange.  Returns false if every slot is occupied.
+ */
+static bool qd_alloc_exchange_give(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool, qd_alloc_item_t *batch, int count)
+{
+    qd_alloc_exchange_slot_t *exchange = desc->global_pool->exchange;
+    if (!exchange)
+        return false;
+
+    batch_set_count(batch, count);
+    sys_atomic_add(&desc->global_pool->exchange_items, count);
+    for (int i = 0; i < EXCHANGE_SLOTS; i++) {
+        int slot = (pool->slot_hint + i) & (EXCHANGE_SLOTS - 1);
+        if (sys_atomic_ptr_get(&exchange[slot].batch) != 0)
+            continue;
+        if (sys_atomic_ptr_cas(&exchange[slot].batch, 0, batch)) {
+            pool->slot_hint = slot;
+            STAT_ADD(desc, batches_rebalanced_to_global, 1);
+            STAT_SUB(desc, held_by_threads, count);
+            return true;
+        }
+    }
+    sys_atomic_sub(&desc->global_pool->exchange_items, count);
+    return false;
+}
+
+
+/**
+ * Allocate the calling thread's pool for a type.
+ */
+static qd_alloc_pool_t *qd_alloc_pool(qd_alloc_type_desc_t *desc)
+{
+    qd_alloc_pool_t *pool;
+    NEW_CACHE_ALIGNED(qd_alloc_pool_t, pool);
+    ZERO(pool);
+    DEQ_ITEM_INIT(pool);
+    pool->thread_id        = sys_thread_self();
+    pool->thread_index     = qd_server_thread_index();
+    pool->sample_countdown = ALLOC_SAMPLE_PERIOD;
+    pool->transfer_batch   = desc->config->transfer_batch_size;
+    pool->local_free_max   = desc->config->local_free_list_max;
+    sys_mutex_lock(desc->lock);
+    pool->tracking = desc->global_pool->tracking;
+    DEQ_INSERT_TAIL(desc->tpool_list, pool);
+    sys_mutex_unlock(desc->lock);
+    return pool;
+}
+
+
+/**
+ * Record the call site of a sampled allocation.  This must not be inlined so that
+ * the site is found at a fixed depth of the stack, just above this function and
+ * qd_alloc.
+ */
+static __attribute__((noinline)) void qd_alloc_sample(qd_alloc_type_desc_t *desc, qd_alloc_pool_t *pool, qd_alloc_item_t *item)
+{
+    void *frames[2 + ALLOC_SITE_DEPTH] = {0};
+    void *pc[ALLOC_SITE_DEPTH];
+    int   idx;
+
+    backtrace(frames, 2 + ALLOC_SITE_DEPTH);
+    memcpy(pc, &frames[2], sizeof(pc));
+    pool->sample_countdown = ALLOC_SAMPLE_PERIOD;
+
+    sys_mutex_lock(desc->lock);
+    qd_alloc_pool_t *global = desc->global_pool;
+    if (global->sites) {
+        for (idx = 0; idx < global->site_count; idx++)
+            if (memcmp(global->sites[idx].pc, pc, sizeof(pc)) == 0)
+                break;
+        if (idx == global->site_count) {
+            if (global->site_count < ALLOC_SITES - 1 && pc[0]) {
+                memcpy(global->sites[idx].pc, pc, sizeof(pc));
+                global->site_count++;
+            } else
+                idx = ALLOC_SITES - 1;
+        }
+        global->sites[idx].sampled++;
+        global->sites[idx].live++;
+        item->site = idx + 1;
+    }
+    sys_mutex_unlock(desc->lock);
+}
+
+
+/**
+ * Take a sampled item out of its call site's live count.
+ */
+static void qd_alloc_unsample(qd_alloc_type_desc_t *desc, qd_alloc_item_t *item)
+{
+    sys_mutex_lock(desc->lock);
+    desc->global_pool->sites[item->site - 1].live--;
+    item->site = 0;
+    sys_mutex_unlock(desc->lock);
+}
+
+
 /* coverity[+alloc] */
 void *qd_alloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool)
 {
@@ -122,14 +601,8 @@ void *qd_alloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool)
     // If this is the thread's first pass through here, allocate the
     // thread-local pool for this type.
     //
-    if (*tpool == 0) {
-        NEW_CACHE_ALIGNED(qd_alloc_pool_t, *tpool);
-        DEQ_ITEM_INIT(*tpool);
-        DEQ_INIT((*tpool)->free_list);
-        sys_mutex_lock(desc->lock);
-        DEQ_INSERT_TAIL(desc->tpool_list, *tpool);
-        sys_mutex_unlock(desc->lock);
-    }
+    if (*tpool == 0)
+        *tpool = qd_alloc_pool(desc);
 
     qd_alloc_pool_t *pool = *tpool;
 
@@ -138,69 +611,66 @@ void *qd_alloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool)
     // list and return it.  Since everything we've touched is thread-local,
     // there is no need to acquire a lock.
     //
-    qd_alloc_item_t *item = DEQ_HEAD(pool->free_list);
+    qd_alloc_item_t *item = item_list_pop(&pool->free_list);
     if (item) {
-        DEQ_REMOVE_HEAD(pool->free_list);
+        pool->local_hits++;
+        pool->ops++;
 #ifdef QD_MEMORY_DEBUG
         item->desc   = desc;
         item->header = PATTERN_FRONT;
         *((uint32_t*) ((char*) &item[1] + desc->total_size))= PATTERN_BACK;
         QD_MEMORY_FILL(&item[1], QD_MEMORY_INIT, desc->total_size);
 #endif
+        if (pool->tracking && --pool->sample_countdown <= 0)
+            qd_alloc_sample(desc, pool, item);
         return &item[1];
     }
 
     //
     // The local free list is empty, we need to either rebalance a batch
-    // of items from the global list or go to the heap to get new memory.
+    // of items from the global pool or go to the heap to get new memory.
+    // Try the lock-free exchange first.
     //
-    sys_mutex_lock(desc->lock);
-    if (DEQ_SIZE(desc->global_pool->free_list) >= desc->config->transfer_batch_size) {
-        //
-        // Rebalance a full batch from the global free list to the thread list.
-        //
-#if QD_MEMORY_STATS
-        desc->stats->batches_rebalanced_to_threads++;
-        desc->stats->held_by_threads += desc->config->transfer_batch_size;
-#endif
-        for (idx = 0; idx < desc->config->transfer_batch_size; idx++) {
-            item = DEQ_HEAD(desc->global_pool->free_list);
-            DEQ_REMOVE_HEAD(desc->global_pool->free_list);
-            DEQ_INSERT_TAIL(pool->free_list, item);
-        }
-    } else {
-        //
-        // Allocate a full batch from the heap and put it on the thread list.
-        //
-        for (idx = 0; idx < desc->config->transfer_batch_size; idx++) {
-            size_t size = sizeof(qd_alloc_item_t) + desc->total_size
-#ifdef QD_MEMORY_DEBUG
-                                                  + sizeof(uint32_t)
-#endif
-                ;
-            ALLOC_CACHE_ALIGNED(size, item);
-            if (item == 0)
-                break;
-            DEQ_ITEM_INIT(item);
-            DEQ_INSERT_TAIL(pool->free_list, item);
-            item->sequence = 0;
-#if QD_MEMORY_STATS
-            desc->stats->held_by_threads++;
-            desc->stats->total_alloc_from_heap++;
-#endif
+    pool->local_misses++;
+    pool->ops++;
+    qd_alloc_adapt(desc, pool);
+    if (!qd_alloc_exchange_take(desc, pool)) {
+        int batch = pool->transfer_batch;
+        sys_mutex_lock(desc->lock);
+        if (desc->global_pool->free_list.size >= batch) {
+            //
+            // Rebalance a full batch from the global free list to the thread list.
+            //
+            STAT_ADD(desc, batches_rebalanced_to_threads, 1);
+            STAT_ADD(desc, held_by_threads, batch);
+            for (idx = 0; idx < batch; idx++)
+                item_list_push(&pool->free_list, item_list_pop(&desc->global_pool->free_list));
+        } else {
+            //
+            // Carve a full batch from the slab and put it on the thread list.
+            //
+            for (idx = 0; idx < batch; idx++) {
+                item = qd_alloc_carve_lh(desc);
+                if (item == 0)
+                    break;
+                item_list_push(&pool->free_list, item);
+                STAT_ADD(desc, held_by_threads, 1);
+                STAT_ADD(desc, total_alloc_from_heap, 1);
+            }
         }
+        sys_mutex_unlock(desc->lock);
     }
-    sys_mutex_unlock(desc->lock);
 
-    item = DEQ_HEAD(pool->free_list);
+    item = item_list_pop(&pool->free_list);
     if (item) {
-        DEQ_REMOVE_HEAD(pool->free_list);
 #ifdef QD_MEMORY_DEBUG
         item->desc = desc;
         item->header = PATTERN_FRONT;
         *((uint32_t*) ((char*) &item[1] + desc->total_size))= PATTERN_BACK;
         QD_MEMORY_FILL(&item[1], QD_MEMORY_INIT, desc->total_size);
 #endif
+        if (pool->tracking && --pool->sample_countdown <= 0)
+            qd_alloc_sample(desc, pool, item);
         return &item[1];
     }
 
@@ -229,50 +699,64 @@ void qd_dealloc(qd_alloc_type_desc_t *desc, qd_alloc_pool_t **tpool, char *p)
     // If this is the thread's first pass through here, allocate the
     // thread-local pool for this type.
     //
-    if (*tpool == 0) {
-        *tpool = NEW(qd_alloc_pool_t);
-        DEQ_ITEM_INIT(*tpool);
-        DEQ_INIT((*tpool)->free_list);
-        sys_mutex_lock(desc->lock);
-        DEQ_INSERT_TAIL(desc->tpool_list, *tpool);
-        sys_mutex_unlock(desc->lock);
-    }
+    if (*tpool == 0)
+        *tpool = qd_alloc_pool(desc);
 
     qd_alloc_pool_t *pool = *tpool;
 
+    if (item->site)
+        qd_alloc_unsample(desc, item);
     item->sequence++;
-    DEQ_INSERT_TAIL(pool->free_list, item);
+    item_list_push(&pool->free_list, item);
+    pool->ops++;
 
-    if (DEQ_SIZE(pool->free_list) <= desc->config->local_free_list_max)
+    if (pool->free_list.size <= pool->local_free_max)
         return;
 
     //
     // We've exceeded the maximum size of the local free list.  A batch must be
-    // rebalanced back to the global list.
+    // rebalanced back to the global pool.  Adapting may grow the batch past what
+    // was checked against the limit, so never move more than the local list holds.
     //
-    sys_mutex_lock(desc->lock);
-#if QD_MEMORY_STATS
-    desc->stats->batches_rebalanced_to_global++;
-    desc->stats->held_by_threads -= desc->config->transfer_batch_size;
-#endif
-    for (idx = 0; idx < desc->config->transfer_batch_size; idx++) {
-        item = DEQ_HEAD(pool->free_list);
-        DEQ_REMOVE_HEAD(pool->free_list);
-        DEQ_INSERT_TAIL(desc->global_pool->free_list, item);
+    qd_alloc_adapt(desc, pool);
+    int batch = pool->transfer_batch;
+    if (batch > pool->free_list.size)
+        batch = pool->free_list.size;
+
+    if (desc->global_pool->exchange) {
+        //
+        // Detach the batch from the head of the local list and offer it to the
+        // exchange.
+        //
+        qd_alloc_item_t *head = pool->free_list.head;
+        qd_alloc_item_t *tail = head;
+        for (idx = 1; idx < batch; idx++)
+            tail = tail->next;
+        qd_alloc_item_t *rest = tail->next;
+        tail->next = 0;
+
+        if (qd_alloc_exchange_give(desc, pool, head, batch)) {
+            pool->free_list.head  = rest;
+            pool->free_list.size -= batch;
+            return;
+        }
+        tail->next = rest;
     }
 
+    sys_mutex_lock(desc->lock);
+    STAT_ADD(desc, batches_rebalanced_to_global, 1);
+    STAT_SUB(desc, held_by_threads, batch);
+    for (idx = 0; idx < batch; idx++)
+        item_list_push(&desc->global_pool->free_list, item_list_pop(&pool->free_list));
+
     //
     // If there's a global_free_list size limit, remove items until the limit is
     // not exceeded.
     //
     if (desc->config->global_free_list_max != 0) {
-        while (DEQ_SIZE(desc->global_pool->free_list) > desc->config->global_free_list_max) {
-            item = DEQ_HEAD(desc->global_pool->free_list);
-            DEQ_REMOVE_HEAD(desc->global_pool->free_list);
-            free(item);
-#if QD_MEMORY_STATS
-            desc->stats->total_free_to_heap++;
-#endif
+        while (desc->global_pool->free_list.size > desc->config->global_free_list_max) {
+            qd_alloc_release_lh(desc, item_list_pop(&desc->global_pool->free_list));
+            STAT_ADD(desc, total_free_to_heap, 1);
         }
     }
 
@@ -290,6 +774,150 @@ uint32_t qd_alloc_sequence(void *p)
 }
 
 
+/**
+ * Release the items cached in a type's global pool beyond the high-water mark.
+ * Must be called with desc->lock held.
+ */
+static void qd_alloc_trim_lh(qd_alloc_type_desc_t *desc, size_t limit)
+{
+    qd_alloc_pool_t *global = desc->global_pool;
+    qd_alloc_item_t *item;
+
+    //
+    // Keep the most recently freed (cache-warm) items at the head of the global list
+    // and release the rest.
+    //
+    if ((size_t) global->free_list.size > limit) {
+        qd_alloc_item_t *tail = 0;
+        if (limit > 0) {
+            tail = global->free_list.head;
+            for (size_t idx = 1; idx < limit; idx++)
+                tail = tail->next;
+            item = tail->next;
+            tail->next = 0;
+        } else {
+            item = global->free_list.head;
+            global->free_list.head = 0;
+        }
+        global->free_list.size = (int) limit;
+
+        while (item) {
+            qd_alloc_item_t *next = item->next;
+            qd_alloc_release_lh(desc, item);
+            STAT_ADD(desc, total_free_to_heap, 1);
+            item = next;
+        }
+    }
+
+    //
+    // If the exchange pushes the total over the mark, release whole batches from it.
+    //
+    if (!global->exchange)
+        return;
+    for (int slot = 0; slot < EXCHANGE_SLOTS; slot++) {
+        if ((size_t) global->free_list.size + sys_atomic_get(&global->exchange_items) <= limit)
+            break;
+        if (sys_atomic_ptr_get(&global->exchange[slot].batch) == 0)
+            continue;
+        item = (qd_alloc_item_t*) sys_atomic_ptr_swap(&global->exchange[slot].batch, 0);
+        if (item)
+            sys_atomic_sub(&global->exchange_items, batch_count(item));
+        while (item) {
+            qd_alloc_item_t *next = item->next;
+            qd_alloc_release_lh(desc, item);
+            STAT_ADD(desc, total_free_to_heap, 1);
+            item = next;
+        }
+    }
+}
+
+
+void qd_alloc_set_trim_high_water(size_t bytes)
+{
+    trim_high_water = bytes;
+}
+
+
+void qd_alloc_trim(void)
+{
+    if (trim_high_water == 0)
+        return;
+
+    sys_mutex_lock(init_lock);
+    qd_alloc_type_t *type_item = DEQ_HEAD(type_list);
+    while (type_item) {
+        qd_alloc_type_desc_t *desc = type_item->desc;
+        sys_mutex_lock(desc->lock);
+        qd_alloc_trim_lh(desc, trim_high_water / desc->slab->item_stride);
+        sys_mutex_unlock(desc->lock);
+        type_item = DEQ_NEXT(type_item);
+    }
+    sys_mutex_unlock(init_lock);
+}
+
+
+void qd_alloc_set_tracking(qd_alloc_type_desc_t *desc, bool enable)
+{
+    if (desc->header != PATTERN_FRONT)
+        qd_alloc_init(desc);
+
+    sys_mutex_lock(desc->lock);
+    qd_alloc_pool_t *global = desc->global_pool;
+    if (enable && !global->tracking) {
+        if (!global->sites) {
+            global->sites = NEW_ARRAY(qd_alloc_site_t, ALLOC_SITES);
+            memset(global->sites, 0, sizeof(qd_alloc_site_t) * ALLOC_SITES);
+        }
+        for (int idx = 0; idx < ALLOC_SITES; idx++)
+            global->sites[idx].sampled = 0;
+        global->track_start = qd_timer_now_usec();
+
+        qd_alloc_pool_t *tpool = DEQ_HEAD(desc->tpool_list);
+        while (tpool) {
+            tpool->allocs_at_track = tpool->local_hits + tpool->local_misses;
+            tpool->frees_at_track  = tpool->ops - tpool->allocs_at_track;
+            tpool = DEQ_NEXT(tpool);
+        }
+    }
+
+    //
+    // The owning threads see the change on their next allocation.
+    //
+    global->tracking = enable;
+    qd_alloc_pool_t *tpool = DEQ_HEAD(desc->tpool_list);
+    while (tpool) {
+        tpool->tracking = enable;
+        tpool = DEQ_NEXT(tpool);
+    }
+    sys_mutex_unlock(desc->lock);
+}
+
+
+bool qd_alloc_use_huge_pages(qd_alloc_type_desc_t *desc)
+{
+    bool applied = false;
+
+    if (desc->header != PATTERN_FRONT)
+        qd_alloc_init(desc);
+
+    //
+    // The chunk size can only change while the slab has no chunks; items are matched
+    // to their chunks by masking with it.
+    //
+    sys_mutex_lock(desc->lock);
+    qd_alloc_slab_t *slab = desc->slab;
+    if (DEQ_IS_EMPTY(slab->chunks) && !slab->current) {
+        slab->huge_pages = true;
+        slab->page_mode  = PAGE_MODE_REQUESTED;
+        if (slab->chunk_size < HUGE_PAGE_SIZE)
+            slab->chunk_size = HUGE_PAGE_SIZE;
+        applied = true;
+    }
+    sys_mutex_unlock(desc->lock);
+    return applied;
+}
+
+
 void qd_alloc_initialize(void)
 {
     init_lock = sys_mutex();
@@ -329,15 +957,29 @@ void qd_alloc_finalize(void)
         //
         // Reclaim the items on the global free pool
         //
-        item = DEQ_HEAD(desc->global_pool->free_list);
-        while (item) {
-            DEQ_REMOVE_HEAD(desc->global_pool->free_list);
-            free(item);
+        while ((item = item_list_pop(&desc->global_pool->free_list))) {
+            qd_alloc_release_lh(desc, item);
 #if QD_MEMORY_STATS
             desc->stats->total_free_to_heap++;
 #endif
-            item = DEQ_HEAD(desc->global_pool->free_list);
         }
+        if (desc->global_pool->exchange) {
+            for (int slot = 0; slot < EXCHANGE_SLOTS; slot++) {
+                item = (qd_alloc_item_t*) sys_atomic_ptr_get(&desc->global_pool->exchange[slot].batch);
+                while (item) {
+                    qd_alloc_item_t *next = item->next;
+                    qd_alloc_release_lh(desc, item);
+#if QD_MEMORY_STATS
+                    desc->stats->total_free_to_heap++;
+#endif
+                    item = next;
+                }
+                sys_atomic_ptr_destroy(&desc->global_pool->exchange[slot].batch);
+            }
+            free(desc->global_pool->exchange);
+        }
+        sys_atomic_destroy(&desc->global_pool->exchange_items);
+        free(desc->global_pool->sites);
         free(desc->global_pool);
         desc->global_pool = 0;
 
@@ -346,14 +988,11 @@ void qd_alloc_finalize(void)
         //
         qd_alloc_pool_t *tpool = DEQ_HEAD(desc->tpool_list);
         while (tpool) {
-            item = DEQ_HEAD(tpool->free_list);
-            while (item) {
-                DEQ_REMOVE_HEAD(tpool->free_list);
-                free(item);
+            while ((item = item_list_pop(&tpool->free_list))) {
+                qd_alloc_release_lh(desc, item);
 #if QD_MEMORY_STATS
                 desc->stats->total_free_to_heap++;
 #endif
-                item = DEQ_HEAD(tpool->free_list);
             }
 
             DEQ_REMOVE_HEAD(desc->tpool_list);
@@ -361,6 +1000,25 @@ void qd_alloc_finalize(void)
             tpool = DEQ_HEAD(desc->tpool_list);
         }
 
+        //
+        // A chunk still present either was never fully carved or holds leaked
+        // items.  The former is freed; the latter is left in place.
+        //
+        qd_alloc_chunk_t *chunk = DEQ_HEAD(desc->slab->chunks);
+        while (chunk) {
+            qd_alloc_chunk_t *next = DEQ_NEXT(chunk);
+            if (chunk->released == chunk->carved) {
+                DEQ_REMOVE(desc->slab->chunks, chunk);
+                if (chunk->mapped)
+                    munmap(chunk, desc->slab->chunk_size);
+                else
+                    free(chunk);
+            }
+            chunk = next;
+        }
+        free(desc->slab);
+        desc->slab = 0;
+
         //
         // Check the stats for lost items
         //
@@ -392,13 +1050,219 @@ void qd_alloc_finalize(void)
 }
 
 
-qd_error_t qd_entity_refresh_allocator(qd_entity_t* entity, void *impl) {
+typedef struct {
+    long     thread_id;
+    int      thread_index;
+    uint64_t allocs;
+    uint64_t frees;
+} qd_alloc_thread_stats_t;
+
+
+/**
+ * Report the per-thread rates and sampled call sites of a tracked type.
+ */
+static qd_error_t qd_alloc_refresh_tracking(qd_entity_t *entity, qd_alloc_type_desc_t *desc)
+{
+    qd_alloc_thread_stats_t *threads      = 0;
+    int                      thread_count = 0;
+    qd_alloc_site_t          sites[ALLOC_SITES];
+    int                      site_count   = 0;
+    bool                     tracking;
+    int64_t                  elapsed;
+    char                     key[512];
+    qd_error_t               err = QD_ERROR_NONE;
+
+    //
+    // Take a snapshot under the lock; the entity is filled in after it is released.
+    //
+    sys_mutex_lock(desc->lock);
+    qd_alloc_pool_t *global = desc->global_pool;
+    tracking = global->tracking;
+    elapsed  = tracking ? qd_timer_now_usec() - global->track_start : 0;
+    if (tracking) {
+        threads = NEW_ARRAY(qd_alloc_thread_stats_t, DEQ_SIZE(desc->tpool_list) + 1);
+        qd_alloc_pool_t *tpool = DEQ_HEAD(desc->tpool_list);
+        while (tpool) {
+            qd_alloc_thread_stats_t *ts = &threads[thread_count++];
+            uint64_t allocs  = tpool->local_hits + tpool->local_misses;
+            ts->thread_id    = tpool->thread_id;
+            ts->thread_index = tpool->thread_index;
+            ts->allocs       = allocs - tpool->allocs_at_track;
+            ts->frees        = tpool->ops - allocs - tpool->frees_at_track;
+            tpool = DEQ_NEXT(tpool);
+        }
+    }
+    if (global->sites) {
+        memcpy(sites, global->sites, sizeof(sites));
+        site_count = ALLOC_SITES;
+    }
+    sys_mutex_unlock(desc->lock);
+
+    int64_t seconds = elapsed / 1000000;
+    if (seconds == 0)
+        seconds = 1;
+
+    if (qd_entity_set_bool(entity, "tracking", tracking) != 0 ||
+        qd_entity_set_long(entity, "trackingSeconds", elapsed / 1000000) != 0 ||
+        qd_entity_set_map(entity, "threadAllocRate") != 0 ||
+        qd_entity_set_map(entity, "threadFreeRate") != 0 ||
+        qd_entity_set_map(entity, "allocSites") != 0 ||
+        qd_entity_set_map(entity, "liveSites") != 0) {
+        free(threads);
+        return qd_error_code();
+    }
+
+    for (int idx = 0; idx < thread_count && err == QD_ERROR_NONE; idx++) {
+        qd_alloc_thread_stats_t *ts = &threads[idx];
+        if (ts->thread_index >= 0)
+            snprintf(key, sizeof(key), "worker-%d", ts->thread_index);
+        else
+            snprintf(key, sizeof(key), "thread-%lx", (unsigned long) ts->thread_id);
+        err = qd_entity_set_map_key_value_int(entity, "threadAllocRate", key, (int) (ts->allocs / seconds));
+        if (err == QD_ERROR_NONE)
+            err = qd_entity_set_map_key_value_int(entity, "threadFreeRate", key, (int) (ts->frees / seconds));
+    }
+    free(threads);
+
+    //
+    // Frames are named by object file, symbol and offset where the symbol is exported,
+    // otherwise by object file and address.  A site lists its frames innermost first.
+    //
+    void *pcs[ALLOC_SITES * ALLOC_SITE_DEPTH];
+    for (int idx = 0; idx < site_count; idx++)
+        memcpy(&pcs[idx * ALLOC_SITE_DEPTH], sites[idx].pc, sizeof(sites[idx].pc));
+    char **names = site_count ? backtrace_symbols(pcs, site_count * ALLOC_SITE_DEPTH) : 0;
+    for (int idx = 0; idx < site_count && err == QD_ERROR_NONE; idx++) {
+        if (sites[idx].sampled == 0 && sites[idx].live == 0)
+            continue;
+        if (!sites[idx].pc[0] || !names)
+            snprintf(key, sizeof(key), "other");
+        else {
+            size_t len = 0;
+            key[0] = '\0';
+            for (int depth = 0; depth < ALLOC_SITE_DEPTH && sites[idx].pc[depth] && len < sizeof(key); depth++)
+                len += snprintf(key + len, sizeof(key) - len, "%s%s", depth ? " <- " : "", names[idx * ALLOC_SITE_DEPTH + depth]);
+        }
+        err = qd_entity_set_map_key_value_int(entity, "allocSites", key, (int) sites[idx].sampled);
+        if (err == QD_ERROR_NONE)
+            err = qd_entity_set_map_key_value_int(entity, "liveSites", key, (int) sites[idx].live);
+    }
+    free(names);
+    return err;
+}
+
+
+qd_error_t qd_entity_configure_allocator(qd_entity_t *entity, void *impl)
+{
     qd_alloc_type_t *alloc_type = (qd_alloc_type_t*) impl;
-    if (qd_entity_set_string(entity, "typeName", alloc_type->desc->type_name) == 0 &&
-        qd_entity_set_long(entity, "typeSize", alloc_type->desc->total_size) == 0 &&
-        qd_entity_set_long(entity, "transferBatchSize", alloc_type->desc->config->transfer_batch_size) == 0 &&
-        qd_entity_set_long(entity, "localFreeListMax", alloc_type->desc->config->local_free_list_max) == 0 &&
-        qd_entity_set_long(entity, "globalFreeListMax", alloc_type->desc->config->global_free_list_max) == 0
+    bool             tracking   = qd_entity_opt_bool(entity, "tracking", false);
+    QD_ERROR_RET();
+    qd_alloc_set_tracking(alloc_type->desc, tracking);
+    return QD_ERROR_NONE;
+}
+
+
+typedef struct qd_alloc_counts_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t cached;
+    uint64_t live;
+    int      page_mode;
+    int      batch;      ///< Largest batch size of any thread
+    int      local_max;  ///< Largest local free list limit of any thread
+} qd_alloc_counts_t;
+
+
+static void qd_alloc_counts(qd_alloc_type_desc_t *desc, qd_alloc_counts_t *counts)
+{
+    ZERO(counts);
+
+    //
+    // The per-thread counters are updated without the lock; the totals are a
+    // snapshot and may be slightly behind.
+    //
+    qd_alloc_pool_limits(desc, 0, &counts->batch, &counts->local_max);
+    sys_mutex_lock(desc->lock);
+    qd_alloc_pool_t *tpool = DEQ_HEAD(desc->tpool_list);
+    while (tpool) {
+        int batch;
+        int local_max;
+        counts->hits   += tpool->local_hits;
+        counts->misses += tpool->local_misses;
+        counts->cached += tpool->free_list.size;
+        qd_alloc_pool_limits(desc, tpool, &batch, &local_max);
+        if (batch > counts->batch)
+            counts->batch = batch;
+        if (local_max > counts->local_max)
+            counts->local_max = local_max;
+        tpool = DEQ_NEXT(tpool);
+    }
+    counts->cached   += desc->global_pool->free_list.size + sys_atomic_get(&desc->global_pool->exchange_items);
+    counts->live      = desc->slab->live_items;
+    counts->page_mode = desc->slab->page_mode;
+    sys_mutex_unlock(desc->lock);
+    if (counts->cached > counts->live)
+        counts->cached = counts->live;
+}
+
+
+size_t qd_alloc_in_use_bytes(qd_alloc_type_desc_t *desc)
+{
+    if (desc->header != PATTERN_FRONT)
+        return 0;
+
+    qd_alloc_counts_t counts;
+    qd_alloc_counts(desc, &counts);
+    return (size_t) (counts.live - counts.cached) * desc->slab->item_stride;
+}
+
+
+int qd_alloc_write_stats_page(qd_stats_page_alloc_t *records, int capacity)
+{
+    int count = 0;
+    sys_mutex_lock(init_lock);
+    qd_alloc_type_t *type_item = DEQ_HEAD(type_list);
+    while (type_item && count < capacity) {
+        qd_alloc_type_desc_t  *desc   = type_item->desc;
+        qd_stats_page_alloc_t *record = &records[count++];
+        qd_alloc_counts_t      counts;
+        qd_alloc_counts(desc, &counts);
+        strncpy(record->type_name, desc->type_name, QD_STATS_PAGE_NAME - 1);
+        record->type_name[QD_STATS_PAGE_NAME - 1] = '\0';
+        record->type_size    = desc->total_size;
+        record->in_use_bytes = (counts.live - counts.cached) * desc->slab->item_stride;
+        record->cached_bytes = counts.cached * desc->slab->item_stride;
+        record->local_hits   = counts.hits;
+        record->local_misses = counts.misses;
+        type_item = DEQ_NEXT(type_item);
+    }
+    sys_mutex_unlock(init_lock);
+    return count;
+}
+
+
+qd_error_t qd_entity_refresh_allocator(qd_entity_t* entity, void *impl) {
+    qd_alloc_type_t      *alloc_type = (qd_alloc_type_t*) impl;
+    qd_alloc_type_desc_t *desc       = alloc_type->desc;
+    qd_alloc_counts_t     counts;
+    qd_alloc_counts(desc, &counts);
+    uint64_t hits   = counts.hits;
+    uint64_t misses = counts.misses;
+    uint64_t cached = counts.cached;
+    uint64_t live   = counts.live;
+    int page_mode   = counts.page_mode;
+
+    if (qd_entity_set_string(entity, "typeName", desc->type_name) == 0 &&
+        qd_entity_set_long(entity, "typeSize", desc->total_size) == 0 &&
+        qd_entity_set_long(entity, "transferBatchSize", counts.batch) == 0 &&
+        qd_entity_set_long(entity, "localFreeListMax", counts.local_max) == 0 &&
+        qd_entity_set_long(entity, "globalFreeListMax", desc->config->global_free_list_max) == 0 &&
+        qd_entity_set_long(entity, "maxTransferBatchSize", desc->config->max_transfer_batch_size) == 0 &&
+        qd_entity_set_long(entity, "localHits", hits) == 0 &&
+        qd_entity_set_long(entity, "localMisses", misses) == 0 &&
+        qd_entity_set_long(entity, "inUseBytes", (live - cached) * desc->slab->item_stride) == 0 &&
+        qd_entity_set_long(entity, "cachedBytes", cached * desc->slab->item_stride) == 0 &&
+        qd_entity_set_string(entity, "pageMode", page_mode_names[page_mode]) == 0
 #if QD_MEMORY_STATS
         && qd_entity_set_long(entity, "totalAllocFromHeap", alloc_type->desc->stats->total_alloc_from_heap) == 0 &&
         qd_entity_set_long(entity, "totalFreeToHeap", alloc_type->desc->stats->total_free_to_heap) == 0 &&
@@ -407,7 +1271,7 @@ qd_error_t qd_entity_refresh_allocator(qd_entity_t* entity, void *impl) {
         qd_entity_set_long(entity, "batchesRebalancedToGlobal", alloc_type->desc->stats->batches_rebalanced_to_global) == 0
 #endif
         )
-        return QD_ERROR_NONE;
+        return qd_alloc_refresh_tracking(entity, desc);
     return qd_error_code();
 }
 
@@ -28,9 +28,10 @@ const char * const QD_MA_TRACE   = "x-opt-qd.trace";
 const char * const QD_MA_TO      = "x-opt-qd.to";
 const char * const QD_MA_PHASE   = "x-opt-qd.phase";
 const char * const QD_MA_CLASS   = "x-opt-qd.class";
+const char * const QD_MA_SEQUENCE = "x-opt-qd.seq";
 const int          QD_MA_MAX_KEY_LEN = 16;
-const int          QD_MA_N_KEYS      = 4;  // max number of router annotations to send/receive
-const int          QD_MA_FILTER_LEN  = 5;  // N tailing inbound entries to search for stripping
+const int          QD_MA_N_KEYS      = 5;  // max number of router annotations to send/receive
+const int          QD_MA_FILTER_LEN  = 6;  // N tailing inbound entries to search for stripping
 
 const char * const QD_CAPABILITY_ROUTER_CONTROL   = "qd.router";
 const char * const QD_CAPABILITY_ROUTER_DATA      = "qd.router-data";
@@ -53,6 +54,9 @@ const char * const QD_CONNECTION_PROPERTY_PRODUCT_KEY           = "product";
 const char * const QD_CONNECTION_PROPERTY_PRODUCT_VALUE         = "qpid-dispatch-router";
 const char * const QD_CONNECTION_PROPERTY_VERSION_KEY           = "version";
 const char * const QD_CONNECTION_PROPERTY_COST_KEY              = "qd.inter-router-cost";
+const char * const QD_CONNECTION_PROPERTY_DATA_KEY              = "qd.inter-router-data";
+const char * const QD_CONNECTION_PROPERTY_COMPACT_ANNOTATIONS_KEY = "qd.compact-annotations";
+const char * const QD_CONNECTION_PROPERTY_COMPRESSION_KEY       = "qd.compression";
 const char * const QD_CONNECTION_PROPERTY_CONN_ID               = "qd.conn-id";
 const char * const QD_CONNECTION_PROPERTY_FAILOVER_LIST_KEY     = "failover-server-list";
 const char * const QD_CONNECTION_PROPERTY_FAILOVER_NETHOST_KEY  = "network-host";
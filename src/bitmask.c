@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "config.h"
 #include <qpid/dispatch/alloc.h>
 #include <qpid/dispatch/bitmask.h>
 #include <assert.h>
@@ -24,7 +25,13 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
-#define QD_BITMASK_LONGS 2
+// QD_BITMASK_WIDTH (the maximum number of routers in a network) is set at
+// configure time
+#if QD_BITMASK_WIDTH < 64 || QD_BITMASK_WIDTH % 64 != 0
+#error "QD_BITMASK_WIDTH must be a multiple of 64"
+#endif
+
+#define QD_BITMASK_LONGS (QD_BITMASK_WIDTH / 64)
 #define QD_BITMASK_BITS  (QD_BITMASK_LONGS * 64)
 
 struct qd_bitmask_t {
@@ -130,11 +137,7 @@ int qd_bitmask_first_set(qd_bitmask_t *b, int *bitnum)
         b->first_set = FIRST_NONE;
         for (int i = 0; i < QD_BITMASK_LONGS; i++)
             if (b->array[i]) {
-                for (int j = 0; j < 64; j++)
-                    if ((((uint64_t) 1) << j) & b->array[i]) {
-                        b->first_set = i * 64 + j;
-                        break;
-                    }
+                b->first_set = i * 64 + __builtin_ctzll(b->array[i]);
                 break;
             }
     }
@@ -152,6 +155,32 @@ int qd_bitmask_cardinality(const qd_bitmask_t *b)
 }
 
 
+void qd_bitmask_copy(qd_bitmask_t *b, const qd_bitmask_t *src)
+{
+    *b = *src;
+}
+
+
+bool qd_bitmask_equal(const qd_bitmask_t *a, const qd_bitmask_t *b)
+{
+    if (a->cardinality != b->cardinality)
+        return false;
+    for (int i = 0; i < QD_BITMASK_LONGS; i++)
+        if (a->array[i] != b->array[i])
+            return false;
+    return true;
+}
+
+
+uint32_t qd_bitmask_hash(const qd_bitmask_t *b)
+{
+    uint64_t h = 0;
+    for (int i = 0; i < QD_BITMASK_LONGS; i++)
+        h = (h ^ b->array[i]) * 0x100000001b3ULL;  // FNV-1a style mix, a word at a time
+    return (uint32_t) (h ^ (h >> 32));
+}
+
+
 bool qd_bitmask_valid_bit_value(int bitnum)
 {
     return (bitnum >= 0 && bitnum < QD_BITMASK_BITS);
@@ -174,25 +203,19 @@ void _qdbm_next(qd_bitmask_t *b, int *v)
         return;
     }
 
+    // skip whole words at a time, using the lowest set bit above *v
     int      idx  = MASK_INDEX(*v);
-    uint64_t bits = MASK_ONEHOT(*v);
-    int      next = *v;
-
-    while (1) {
-        next++;
-        if (bits & 0x8000000000000000LL) {
-            if (++idx == QD_BITMASK_LONGS) {
-                *v = -1;
-                return;
-            }
-            bits = 1;
-        } else
-            bits = bits << 1;
+    int      bit  = *v % 64;
+    uint64_t word = (bit == 63) ? 0 : b->array[idx] & (~((uint64_t) 0) << (bit + 1));
 
-        if (b->array[idx] & bits) {
-            *v = next;
+    while (!word) {
+        if (++idx == QD_BITMASK_LONGS) {
+            *v = -1;
             return;
         }
+        word = b->array[idx];
     }
+
+    *v = idx * 64 + __builtin_ctzll(word);
 }
 
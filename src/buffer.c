@@ -20,58 +20,159 @@
 #include <qpid/dispatch/buffer.h>
 #include <qpid/dispatch/alloc.h>
 
+#include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 
+//
+// The larger size classes are multiples of the base size (4K and 64K for the
+// default base of 512).  Each class has its own allocation pool.
+//
+#define MEDIUM_FACTOR   8
+#define LARGE_FACTOR  128
+
 size_t BUFFER_SIZE     = 512;
+static size_t BUFFER_SIZE_MEDIUM = 512 * MEDIUM_FACTOR;
+static size_t BUFFER_SIZE_LARGE  = 512 * LARGE_FACTOR;
 static int size_locked = 0;
 
+typedef qd_buffer_t qd_buffer_medium_t;
+typedef qd_buffer_t qd_buffer_large_t;
+typedef qd_buffer_t qd_buffer_view_t;    // A header without a data area
+
 ALLOC_DECLARE(qd_buffer_t);
 ALLOC_DEFINE_CONFIG(qd_buffer_t, sizeof(qd_buffer_t), &BUFFER_SIZE, 0);
+ALLOC_DECLARE(qd_buffer_medium_t);
+ALLOC_DEFINE_CONFIG(qd_buffer_medium_t, sizeof(qd_buffer_t), &BUFFER_SIZE_MEDIUM, 0);
+ALLOC_DECLARE(qd_buffer_large_t);
+ALLOC_DEFINE_CONFIG(qd_buffer_large_t, sizeof(qd_buffer_t), &BUFFER_SIZE_LARGE, 0);
+ALLOC_DECLARE(qd_buffer_view_t);
+ALLOC_DEFINE(qd_buffer_view_t);
 
 
 void qd_buffer_set_size(size_t size)
 {
     assert(!size_locked);
-    BUFFER_SIZE = size;
+    BUFFER_SIZE        = size;
+    BUFFER_SIZE_MEDIUM = size * MEDIUM_FACTOR;
+    BUFFER_SIZE_LARGE  = size * LARGE_FACTOR;
 }
 
 
-qd_buffer_t *qd_buffer(void)
+bool qd_buffer_use_huge_pages(void)
 {
-    size_locked = 1;
-    qd_buffer_t *buf = new_qd_buffer_t();
+#if USE_MEMORY_POOL
+    bool applied = qd_alloc_use_huge_pages(&__desc_qd_buffer_t);
+    applied = qd_alloc_use_huge_pages(&__desc_qd_buffer_medium_t) && applied;
+    applied = qd_alloc_use_huge_pages(&__desc_qd_buffer_large_t) && applied;
+    return applied;
+#else
+    return false;
+#endif
+}
+
 
+size_t qd_buffer_in_use_bytes(void)
+{
+#if USE_MEMORY_POOL
+    return qd_alloc_in_use_bytes(&__desc_qd_buffer_t)
+        + qd_alloc_in_use_bytes(&__desc_qd_buffer_medium_t)
+        + qd_alloc_in_use_bytes(&__desc_qd_buffer_large_t);
+#else
+    return 0;
+#endif
+}
+
+
+static inline qd_buffer_t *buffer_init(qd_buffer_t *buf, size_t capacity)
+{
     DEQ_ITEM_INIT(buf);
-    buf->size   = 0;
+    buf->size     = 0;
+    buf->capacity = capacity;
+    buf->spilled  = false;
+    buf->shared   = 0;
+    buf->offset   = 0;
     sys_atomic_init(&buf->bfanout, 0);
+    sys_atomic_init(&buf->refs, 1);
     return buf;
 }
 
 
+qd_buffer_t *qd_buffer(void)
+{
+    size_locked = 1;
+    return buffer_init(new_qd_buffer_t(), BUFFER_SIZE);
+}
+
+
+qd_buffer_t *qd_buffer_sized(size_t hint)
+{
+    size_locked = 1;
+    if (hint >= BUFFER_SIZE_LARGE)
+        return buffer_init(new_qd_buffer_large_t(), BUFFER_SIZE_LARGE);
+    if (hint >= BUFFER_SIZE_MEDIUM)
+        return buffer_init(new_qd_buffer_medium_t(), BUFFER_SIZE_MEDIUM);
+    return buffer_init(new_qd_buffer_t(), BUFFER_SIZE);
+}
+
+
+static void spill_buffer_free(qd_buffer_t *buf);
+
 void qd_buffer_free(qd_buffer_t *buf)
 {
     if (!buf) return;
-    free_qd_buffer_t(buf);
+    if (buf->shared) {
+        qd_buffer_t *shared = buf->shared;
+        free_qd_buffer_view_t(buf);
+        buf = shared;
+    }
+
+    //
+    // Only a buffer that is viewed needs its count of holders updated; without
+    // views no other thread can be taking a reference to it.
+    //
+    if (sys_atomic_get(&buf->refs) > 1 && sys_atomic_dec(&buf->refs) != 1)
+        return;
+    if (buf->spilled)
+        spill_buffer_free(buf);
+    else if (buf->capacity == BUFFER_SIZE)
+        free_qd_buffer_t(buf);
+    else if (buf->capacity == BUFFER_SIZE_MEDIUM)
+        free_qd_buffer_medium_t(buf);
+    else
+        free_qd_buffer_large_t(buf);
 }
 
 
 unsigned char *qd_buffer_base(qd_buffer_t *buf)
 {
+    if (buf->shared)
+        return ((unsigned char*) &buf->shared[1]) + buf->offset;
     return (unsigned char*) &buf[1];
 }
 
 
 unsigned char *qd_buffer_cursor(qd_buffer_t *buf)
 {
-    return ((unsigned char*) &buf[1]) + buf->size;
+    return qd_buffer_base(buf) + buf->size;
 }
 
 
 size_t qd_buffer_capacity(qd_buffer_t *buf)
 {
-    return BUFFER_SIZE - buf->size;
+    return buf->capacity - buf->size;
+}
+
+
+size_t qd_buffer_units(qd_buffer_t *buf)
+{
+    return buf->capacity / BUFFER_SIZE;
 }
 
 
@@ -84,7 +185,7 @@ size_t qd_buffer_size(qd_buffer_t *buf)
 void qd_buffer_insert(qd_buffer_t *buf, size_t len)
 {
     buf->size += len;
-    assert(buf->size <= BUFFER_SIZE);
+    assert(buf->size <= buf->capacity);
 }
 
 void qd_buffer_add_fanout(qd_buffer_t *buf)
@@ -102,30 +203,40 @@ unsigned char *qd_buffer_at(qd_buffer_t *buf, size_t len)
 {
     // If the len is greater than the buffer size, we might point to some garbage.
     // We dont want that to happen, so do the assert.
-    assert(len <= BUFFER_SIZE);
-    return ((unsigned char*) &buf[1]) + len;
+    assert(len <= buf->capacity);
+    return qd_buffer_base(buf) + len;
 }
 
+
+qd_buffer_t *qd_buffer_view(qd_buffer_t *buf, size_t offset, size_t len)
+{
+    assert(offset + len <= buf->size);
+    qd_buffer_t *shared = buf;
+    if (buf->shared) {
+        shared  = buf->shared;
+        offset += buf->offset;
+    }
+
+    qd_buffer_t *view = buffer_init(new_qd_buffer_view_t(), len);
+    view->size   = len;
+    view->shared = shared;
+    view->offset = offset;
+    sys_atomic_inc(&shared->refs);
+    return view;
+}
+
+
 unsigned int qd_buffer_list_clone(qd_buffer_list_t *dst, const qd_buffer_list_t *src)
 {
     uint32_t len = 0;
     DEQ_INIT(*dst);
     qd_buffer_t *buf = DEQ_HEAD(*src);
     while (buf) {
-        size_t to_copy = qd_buffer_size(buf);
-        unsigned char *src = qd_buffer_base(buf);
-        len += to_copy;
-        while (to_copy) {
-            qd_buffer_t *newbuf = qd_buffer();
-            size_t count = qd_buffer_capacity(newbuf);
-            // default buffer capacity may have changed,
-            // so don't assume it will fit:
-            if (count > to_copy) count = to_copy;
-            memcpy(qd_buffer_cursor(newbuf), src, count);
-            qd_buffer_insert(newbuf, count);
-            DEQ_INSERT_TAIL(*dst, newbuf);
-            src += count;
-            to_copy -= count;
+        size_t size = qd_buffer_size(buf);
+        if (size) {
+            qd_buffer_t *view = qd_buffer_view(buf, 0, size);
+            DEQ_INSERT_TAIL(*dst, view);
+            len += size;
         }
         buf = DEQ_NEXT(buf);
     }
@@ -154,3 +265,128 @@ unsigned int qd_buffer_list_length(const qd_buffer_list_t *list)
     }
     return len;
 }
+
+
+//
+// Spilled buffers.  Each one is its own shared mapping of a region of an unlinked
+// temporary file, laid out as a spill_header_t followed by the buffer and its data.
+// Once written, its pages can be dropped from memory and are read back from the file
+// when the buffer is sent.
+//
+struct qd_buffer_spill_t {
+    int          fd;
+    off_t        length;     // Offset of the next region; only advanced by the owner
+    sys_atomic_t ref_count;  // The owner plus each spilled buffer still allocated
+};
+
+typedef struct {
+    qd_buffer_spill_t *spill;
+    size_t             length;  // Length of the mapping
+} spill_header_t;
+
+// Keep the buffer that follows the header aligned as pool buffers are
+#define SPILL_HEADER_SIZE ((sizeof(spill_header_t) + 15) & ~((size_t) 15))
+
+static inline spill_header_t *spill_header(qd_buffer_t *buf)
+{
+    return (spill_header_t*) ((char*) buf - SPILL_HEADER_SIZE);
+}
+
+
+static void spill_decref(qd_buffer_spill_t *spill)
+{
+    if (sys_atomic_dec(&spill->ref_count) == 1) {
+        close(spill->fd);
+        sys_atomic_destroy(&spill->ref_count);
+        free(spill);
+    }
+}
+
+
+qd_buffer_spill_t *qd_buffer_spill(const char *directory)
+{
+    char path[PATH_MAX];
+    int  len = snprintf(path, sizeof(path), "%s/qdrouterd-spill-XXXXXX", directory ? directory : "/tmp");
+    if (len < 0 || len >= (int) sizeof(path))
+        return 0;
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    unlink(path);
+
+    qd_buffer_spill_t *spill = NEW(qd_buffer_spill_t);
+    if (!spill) {
+        close(fd);
+        return 0;
+    }
+    spill->fd     = fd;
+    spill->length = 0;
+    sys_atomic_init(&spill->ref_count, 1);
+    return spill;
+}
+
+
+void qd_buffer_spill_free(qd_buffer_spill_t *spill)
+{
+    if (spill)
+        spill_decref(spill);
+}
+
+
+qd_buffer_t *qd_buffer_spill_alloc(qd_buffer_spill_t *spill)
+{
+    size_locked = 1;
+
+    size_t page   = (size_t) sysconf(_SC_PAGESIZE);
+    size_t length = (SPILL_HEADER_SIZE + sizeof(qd_buffer_t) + BUFFER_SIZE_LARGE + page - 1) & ~(page - 1);
+    off_t  offset = spill->length;
+
+    if (ftruncate(spill->fd, offset + (off_t) length) != 0)
+        return 0;
+
+    void *map = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, spill->fd, offset);
+    if (map == MAP_FAILED)
+        return 0;
+    spill->length += length;
+
+    spill_header_t *header = (spill_header_t*) map;
+    header->spill  = spill;
+    header->length = length;
+    sys_atomic_inc(&spill->ref_count);
+
+    qd_buffer_t *buf = buffer_init((qd_buffer_t*) ((char*) map + SPILL_HEADER_SIZE), BUFFER_SIZE_LARGE);
+    buf->spilled = true;
+    return buf;
+}
+
+
+void qd_buffer_spill_evict(qd_buffer_t *buf)
+{
+#ifdef MADV_DONTNEED
+    //
+    // The mapping is shared, so the data stays in the file's page cache, from
+    // where the kernel can write it back and reclaim it.
+    //
+    if (buf && buf->spilled) {
+        spill_header_t *header = spill_header(buf);
+        (void) madvise((void*) header, header->length, MADV_DONTNEED);
+    }
+#endif
+}
+
+
+bool qd_buffer_is_spilled(const qd_buffer_t *buf)
+{
+    return buf->spilled;
+}
+
+
+static void spill_buffer_free(qd_buffer_t *buf)
+{
+    spill_header_t    *header = spill_header(buf);
+    qd_buffer_spill_t *spill  = header->spill;
+
+    munmap((void*) header, header->length);
+    spill_decref(spill);
+}
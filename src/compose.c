@@ -559,3 +559,122 @@ void qd_compose_insert_opaque_elements(qd_composed_field_t *field,
     bump_count_by_n(field, count);
     bump_length(field, size);
 }
+
+
+typedef struct {
+    int      isMap;
+    uint32_t count;
+    uint32_t length;
+    size_t   length_offset;
+    size_t   count_offset;
+} template_composite_t;
+
+struct qd_compose_template_t {
+    uint8_t              *octets;
+    size_t                size;
+    int                   depth;
+    template_composite_t *comps;   // outermost first
+};
+
+
+/**
+ * Return the octet offset of a location from the start of the field's buffer chain.
+ */
+static size_t location_offset(const qd_composed_field_t *field, const qd_field_location_t *loc)
+{
+    size_t       offset = 0;
+    qd_buffer_t *buf    = DEQ_HEAD(field->buffers);
+    while (buf && buf != loc->buffer) {
+        offset += qd_buffer_size(buf);
+        buf = DEQ_NEXT(buf);
+    }
+    return offset + loc->offset;
+}
+
+
+/**
+ * Point a location at the given octet offset from the start of the field's buffer chain.
+ * An offset at the end of a full buffer is left there; qd_overwrite moves on from it.
+ */
+static void location_at(qd_composed_field_t *field, size_t offset, qd_field_location_t *loc)
+{
+    qd_buffer_t *buf = DEQ_HEAD(field->buffers);
+    while (DEQ_NEXT(buf) && offset >= qd_buffer_size(buf)) {
+        offset -= qd_buffer_size(buf);
+        buf = DEQ_NEXT(buf);
+    }
+    loc->buffer = buf;
+    loc->offset = offset;
+    loc->length = 4;
+    loc->parsed = 1;
+}
+
+
+qd_compose_template_t *qd_compose_template(const qd_composed_field_t *field)
+{
+    qd_compose_template_t *tmpl = NEW(qd_compose_template_t);
+    ZERO(tmpl);
+
+    tmpl->size   = qd_buffer_list_length(&field->buffers);
+    tmpl->octets = (uint8_t*) malloc(tmpl->size ? tmpl->size : 1);
+    uint8_t     *cursor = tmpl->octets;
+    qd_buffer_t *buf    = DEQ_HEAD(field->buffers);
+    while (buf) {
+        memcpy(cursor, qd_buffer_base(buf), qd_buffer_size(buf));
+        cursor += qd_buffer_size(buf);
+        buf = DEQ_NEXT(buf);
+    }
+
+    tmpl->depth = DEQ_SIZE(field->fieldStack);
+    if (tmpl->depth) {
+        tmpl->comps = NEW_ARRAY(template_composite_t, tmpl->depth);
+        int             i    = tmpl->depth;
+        qd_composite_t *comp = DEQ_HEAD(field->fieldStack);   // innermost first
+        while (comp) {
+            template_composite_t *tc = &tmpl->comps[--i];
+            tc->isMap         = comp->isMap;
+            tc->count         = comp->count;
+            tc->length        = comp->length;
+            tc->length_offset = location_offset(field, &comp->length_location);
+            tc->count_offset  = location_offset(field, &comp->count_location);
+            comp = DEQ_NEXT(comp);
+        }
+    }
+
+    return tmpl;
+}
+
+
+qd_composed_field_t *qd_compose_from_template(const qd_compose_template_t *tmpl, qd_composed_field_t *extend)
+{
+    qd_composed_field_t *field = qd_compose_subfield(extend);
+    if (!field)
+        return 0;
+
+    size_t base = qd_buffer_list_length(&field->buffers);
+    qd_insert(field, tmpl->octets, tmpl->size);
+
+    for (int i = 0; i < tmpl->depth; i++) {
+        const template_composite_t *tc = &tmpl->comps[i];
+        qd_composite_t *comp = new_qd_composite_t();
+        DEQ_ITEM_INIT(comp);
+        comp->isMap  = tc->isMap;
+        comp->count  = tc->count;
+        comp->length = tc->length;
+        location_at(field, base + tc->length_offset, &comp->length_location);
+        location_at(field, base + tc->count_offset,  &comp->count_location);
+        DEQ_INSERT_HEAD(field->fieldStack, comp);
+    }
+
+    return field;
+}
+
+
+void qd_compose_template_free(qd_compose_template_t *tmpl)
+{
+    if (!tmpl)
+        return;
+    free(tmpl->octets);
+    free(tmpl->comps);
+    free(tmpl);
+}
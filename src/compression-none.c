@@ -0,0 +1,49 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "compression.h"
+
+/* No compression library available. */
+
+bool qd_compression_supported(void) { return false; }
+
+const char *qd_compression_method(void) { return 0; }
+
+qd_deflater_t *qd_deflater(void) { return 0; }
+
+void qd_deflater_free(qd_deflater_t *deflater) {}
+
+void qd_deflater_reset(qd_deflater_t *deflater) {}
+
+ssize_t qd_deflater_write(qd_deflater_t *deflater, const char *data, size_t length,
+                          qd_deflater_output_t output, void *context) { return -1; }
+
+qd_inflater_t *qd_inflater(void) { return 0; }
+
+void qd_inflater_free(qd_inflater_t *inflater) {}
+
+void qd_inflater_reset(qd_inflater_t *inflater) {}
+
+char *qd_inflater_input(qd_inflater_t *inflater, size_t *capacity) { *capacity = 0; return 0; }
+
+void qd_inflater_input_added(qd_inflater_t *inflater, size_t length) {}
+
+bool qd_inflater_pending(const qd_inflater_t *inflater) { return false; }
+
+ssize_t qd_inflater_read(qd_inflater_t *inflater, char *buffer, size_t capacity) { return -1; }
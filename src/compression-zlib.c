@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "compression.h"
+#include <qpid/dispatch/ctools.h>
+#include <zlib.h>
+#include <stdlib.h>
+
+//
+// Raw deflate streams (no zlib header or checksum: the AMQP transfer frames
+// already delimit the deliveries) at the fastest level, as the links this is
+// for are bandwidth bound but the router's threads are still the cost.
+//
+#define DEFLATE_WINDOW_BITS -15
+#define DEFLATE_LEVEL        Z_BEST_SPEED
+#define COMPRESSION_CHUNK    16384
+
+struct qd_deflater_t {
+    z_stream strm;
+    char     out[COMPRESSION_CHUNK];
+};
+
+struct qd_inflater_t {
+    z_stream strm;
+    bool     output_full;  ///< The last read filled the caller's buffer, more may follow
+    char     in[COMPRESSION_CHUNK];
+};
+
+
+bool qd_compression_supported(void)
+{
+    return true;
+}
+
+
+const char *qd_compression_method(void)
+{
+    return "deflate";
+}
+
+
+qd_deflater_t *qd_deflater(void)
+{
+    qd_deflater_t *deflater = NEW(qd_deflater_t);
+    ZERO(deflater);
+    if (deflateInit2(&deflater->strm, DEFLATE_LEVEL, Z_DEFLATED, DEFLATE_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(deflater);
+        return 0;
+    }
+    return deflater;
+}
+
+
+void qd_deflater_free(qd_deflater_t *deflater)
+{
+    if (!deflater)
+        return;
+    deflateEnd(&deflater->strm);
+    free(deflater);
+}
+
+
+void qd_deflater_reset(qd_deflater_t *deflater)
+{
+    deflateReset(&deflater->strm);
+}
+
+
+ssize_t qd_deflater_write(qd_deflater_t *deflater, const char *data, size_t length,
+                          qd_deflater_output_t output, void *context)
+{
+    z_stream *strm  = &deflater->strm;
+    ssize_t   total = 0;
+
+    strm->next_in  = (Bytef*) data;
+    strm->avail_in = length;
+    do {
+        strm->next_out  = (Bytef*) deflater->out;
+        strm->avail_out = COMPRESSION_CHUNK;
+        if (deflate(strm, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            return -1;
+        size_t produced = COMPRESSION_CHUNK - strm->avail_out;
+        if (produced > 0)
+            output(context, deflater->out, produced);
+        total += produced;
+    } while (strm->avail_out == 0);
+
+    return total;
+}
+
+
+qd_inflater_t *qd_inflater(void)
+{
+    qd_inflater_t *inflater = NEW(qd_inflater_t);
+    ZERO(inflater);
+    if (inflateInit2(&inflater->strm, DEFLATE_WINDOW_BITS) != Z_OK) {
+        free(inflater);
+        return 0;
+    }
+    return inflater;
+}
+
+
+void qd_inflater_free(qd_inflater_t *inflater)
+{
+    if (!inflater)
+        return;
+    inflateEnd(&inflater->strm);
+    free(inflater);
+}
+
+
+void qd_inflater_reset(qd_inflater_t *inflater)
+{
+    inflateReset(&inflater->strm);
+    inflater->strm.avail_in = 0;
+    inflater->output_full   = false;
+}
+
+
+char *qd_inflater_input(qd_inflater_t *inflater, size_t *capacity)
+{
+    if (inflater->strm.avail_in > 0) {
+        *capacity = 0;
+        return 0;
+    }
+    *capacity = COMPRESSION_CHUNK;
+    return inflater->in;
+}
+
+
+void qd_inflater_input_added(qd_inflater_t *inflater, size_t length)
+{
+    inflater->strm.next_in  = (Bytef*) inflater->in;
+    inflater->strm.avail_in = length;
+}
+
+
+bool qd_inflater_pending(const qd_inflater_t *inflater)
+{
+    return inflater->strm.avail_in > 0 || inflater->output_full;
+}
+
+
+ssize_t qd_inflater_read(qd_inflater_t *inflater, char *buffer, size_t capacity)
+{
+    z_stream *strm = &inflater->strm;
+
+    strm->next_out  = (Bytef*) buffer;
+    strm->avail_out = capacity;
+    int rc = inflate(strm, Z_SYNC_FLUSH);
+    if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END)
+        return -1;
+
+    inflater->output_full = strm->avail_out == 0;
+    return capacity - strm->avail_out;
+}
@@ -0,0 +1,77 @@
+#ifndef QD_COMPRESSION_H
+#define QD_COMPRESSION_H
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Compression of message bytes on links between routers that negotiated it
+ * (see the compression attribute of listeners and connectors).  A link keeps
+ * one deflater, or one inflater, for all of its deliveries.  Each delivery
+ * resets it, so an aborted delivery cannot put the two ends out of step.
+ */
+
+typedef struct qd_deflater_t qd_deflater_t;
+typedef struct qd_inflater_t qd_inflater_t;
+
+/* Receives each block of compressed output */
+typedef void (*qd_deflater_output_t)(void *context, const char *data, size_t length);
+
+/* True if the router was built with a compression library */
+bool qd_compression_supported(void);
+
+/* The name offered to peers for the supported compression, or 0 */
+const char *qd_compression_method(void);
+
+qd_deflater_t *qd_deflater(void);
+void qd_deflater_free(qd_deflater_t *deflater);
+void qd_deflater_reset(qd_deflater_t *deflater);
+
+/*
+ * Compress the data and flush, so the peer can decompress all that has been
+ * written so far.  Returns the number of compressed bytes output, or -1.
+ */
+ssize_t qd_deflater_write(qd_deflater_t *deflater, const char *data, size_t length,
+                          qd_deflater_output_t output, void *context);
+
+qd_inflater_t *qd_inflater(void);
+void qd_inflater_free(qd_inflater_t *inflater);
+void qd_inflater_reset(qd_inflater_t *inflater);
+
+/*
+ * The space for more compressed input, or 0 while earlier input is still
+ * held.  Report what was written there with qd_inflater_input_added.
+ */
+char *qd_inflater_input(qd_inflater_t *inflater, size_t *capacity);
+void qd_inflater_input_added(qd_inflater_t *inflater, size_t length);
+
+/* True while the inflater holds input or output that has not been read */
+bool qd_inflater_pending(const qd_inflater_t *inflater);
+
+/*
+ * Decompress into the buffer.  Returns the number of bytes produced, 0 if more
+ * input is needed, or -1 if the input is corrupt.
+ */
+ssize_t qd_inflater_read(qd_inflater_t *inflater, char *buffer, size_t capacity);
+
+#endif
@@ -22,6 +22,7 @@
 #include <qpid/dispatch/threading.h>
 #include <qpid/dispatch/atomic.h>
 #include <qpid/dispatch/failoverlist.h>
+#include <qpid/dispatch/message.h>
 #include <proton/listener.h>
 #include "dispatch_private.h"
 #include "connection_manager_private.h"
@@ -29,6 +30,7 @@
 #include "entity.h"
 #include "entity_cache.h"
 #include "schema_enum.h"
+#include "parse_tree.h"
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
@@ -45,6 +47,7 @@ struct qd_config_ssl_profile_t {
     char        *ssl_private_key_file;
     char        *ssl_ciphers;
     char        *ssl_protocols;
+    qd_tls_session_stats_t *session_stats;
 };
 
 DEQ_DECLARE(qd_config_ssl_profile_t, qd_config_ssl_profile_list_t);
@@ -55,6 +58,7 @@ struct qd_config_sasl_plugin_t {
     char        *auth_service;
     char        *sasl_init_hostname;
     char        *auth_ssl_profile;
+    int          cache_seconds;
 };
 
 DEQ_DECLARE(qd_config_sasl_plugin_t, qd_config_sasl_plugin_list_t);
@@ -132,8 +136,11 @@ void qd_server_config_free(qd_server_config_t *cf)
     if (cf->sasl_password)   free(cf->sasl_password);
     if (cf->sasl_mechanisms) free(cf->sasl_mechanisms);
     if (cf->ssl_profile)     free(cf->ssl_profile);
+    qd_tls_session_stats_decref(cf->ssl_session_stats);
     if (cf->failover_list)   qd_failover_list_free(cf->failover_list);
     if (cf->log_message)     free(cf->log_message);
+    if (cf->log_address)     free(cf->log_address);
+    if (cf->log_address_tree) qd_parse_tree_free(cf->log_address_tree);
 
     if (cf->ssl_certificate_file)       free(cf->ssl_certificate_file);
     if (cf->ssl_private_key_file)       free(cf->ssl_private_key_file);
@@ -205,6 +212,12 @@ static void set_config_host(qd_server_config_t *config, qd_entity_t* entity)
 
     assert(config->host);
 
+    if (config->local) {
+        // The host is the path of the socket, the port is not used
+        config->host_port = strdup(config->host);
+        return;
+    }
+
     int hplen = strlen(config->host) + strlen(config->port) + 2;
     config->host_port = malloc(hplen);
     snprintf(config->host_port, hplen, "%s:%s", config->host, config->port);
@@ -307,11 +320,16 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
     memset(config, 0, sizeof(*config));
     config->log_message          = qd_entity_opt_string(entity, "messageLoggingComponents", 0);     CHECK();
     config->log_bits             = populate_log_message(config);
+    config->log_sample           = qd_entity_opt_long(entity, "messageLoggingSample", 1);         CHECK();
+    config->log_rate_limit       = qd_entity_opt_long(entity, "messageLoggingRateLimit", 0);      CHECK();
+    config->log_address          = qd_entity_opt_string(entity, "messageLoggingAddress", 0);      CHECK();
     config->port                 = qd_entity_get_string(entity, "port");              CHECK();
     config->name                 = qd_entity_opt_string(entity, "name", 0);           CHECK();
     config->role                 = qd_entity_get_string(entity, "role");              CHECK();
     config->inter_router_cost    = qd_entity_opt_long(entity, "cost", 1);             CHECK();
-    config->protocol_family      = qd_entity_opt_string(entity, "protocolFamily", 0); CHECK();
+    config->protocol_family      = qd_entity_opt_string(entity, is_listener ? "socketAddressFamily" : "protocolFamily", 0); CHECK();
+    config->local                = is_listener && config->protocol_family
+                                   && strcmp(config->protocol_family, "local") == 0;
     config->metrics              = qd_entity_opt_bool(entity, "metrics", true);       CHECK();
     config->http                 = qd_entity_opt_bool(entity, "http", false);         CHECK();
     config->http_root_dir        = qd_entity_opt_string(entity, "httpRootDir", false);   CHECK();
@@ -332,8 +350,16 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
     config->max_sessions         = qd_entity_get_long(entity, "maxSessions");         CHECK();
     uint64_t ssn_frames          = qd_entity_opt_long(entity, "maxSessionFrames", 0); CHECK();
     config->idle_timeout_seconds = qd_entity_get_long(entity, "idleTimeoutSeconds");  CHECK();
+    config->liveness_timeout_ms  = qd_entity_opt_long(entity, "livenessTimeoutMillis", 0); CHECK();
     if (is_listener) {
         config->initial_handshake_timeout_seconds = qd_entity_get_long(entity, "initialHandshakeTimeoutSeconds");  CHECK();
+        config->accept_rate         = qd_entity_opt_long(entity, "maxAcceptRate", 0);       CHECK();
+        config->tls_accept_rate     = qd_entity_opt_long(entity, "maxTlsAcceptRate", 0);    CHECK();
+        config->max_pending_accepts = qd_entity_opt_long(entity, "maxPendingAccepts", 1000); CHECK();
+        config->tls_offload         = qd_entity_opt_bool(entity, "tlsOffload", false);      CHECK();
+    } else {
+        config->connect_race_ms     = qd_entity_opt_long(entity, "connectRaceMillis", 0);   CHECK();
+        config->max_frame_size_min  = qd_entity_opt_long(entity, "maxFrameSizeMin", 0);     CHECK();
     }
     config->sasl_username        = qd_entity_opt_string(entity, "saslUsername", 0);   CHECK();
     config->sasl_password        = qd_entity_opt_string(entity, "saslPassword", 0);   CHECK();
@@ -341,6 +367,13 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
     config->ssl_profile          = qd_entity_opt_string(entity, "sslProfile", 0);     CHECK();
     config->sasl_plugin          = qd_entity_opt_string(entity, "saslPlugin", 0);   CHECK();
     config->link_capacity        = qd_entity_opt_long(entity, "linkCapacity", 0);     CHECK();
+    config->q2_upper             = qd_entity_opt_long(entity, "q2HighWatermark", 0);  CHECK();
+    config->q2_lower             = qd_entity_opt_long(entity, "q2LowWatermark", 0);   CHECK();
+    config->q3_upper             = qd_entity_opt_long(entity, "q3HighWatermark", 0);  CHECK();
+    config->compression          = qd_entity_opt_bool(entity, "compression", false);  CHECK();
+    config->compression_min_bytes = qd_entity_opt_long(entity, "compressionMinBytes", 512); CHECK();
+    config->session_window_min   = qd_entity_opt_long(entity, "sessionWindowMin", 0);  CHECK();
+    config->session_window_max   = qd_entity_opt_long(entity, "sessionWindowMax", 0);  CHECK();
     config->multi_tenant         = qd_entity_opt_bool(entity, "multiTenant", false);  CHECK();
     set_config_host(config, entity);
 
@@ -350,6 +383,30 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
     if (config->link_capacity == 0)
         config->link_capacity = 250;
 
+    if (config->log_sample < 1)
+        config->log_sample = 1;
+
+    if (config->log_address && *config->log_address) {
+        // Never given a match cache, so every I/O thread may search it
+        config->log_address_tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+        qd_parse_tree_add_pattern_str(config->log_address_tree, config->log_address, config);
+    }
+
+    if (config->q2_upper || config->q2_lower) {
+        size_t upper = config->q2_upper ? config->q2_upper : QD_QLIMIT_Q2_UPPER;
+        size_t lower = config->q2_lower ? config->q2_lower : QD_QLIMIT_Q2_LOWER;
+        if (lower >= upper) {
+            if (upper < 2)
+                upper = 2;
+            qd_log(qd->connection_manager->log_source, QD_LOG_WARNING,
+                   "Server configuation for I/O adapter entity name:'%s', host:'%s', port:'%s', "
+                   "q2LowWatermark %zu is not below q2HighWatermark, using high %zu and low %zu",
+                   config->name, config->host, config->port, lower, upper, upper / 2);
+            config->q2_upper = upper;
+            config->q2_lower = upper / 2;
+        }
+    }
+
     if (config->max_sessions == 0 || config->max_sessions > 32768)
         // Proton disallows > 32768
         config->max_sessions = 32768;
@@ -360,6 +417,36 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
         // incoming capacity calculation.
         config->max_frame_size = QD_AMQP_MIN_MAX_FRAME_SIZE;
 
+    //
+    // Frame size autotuning stays within the configured maxFrameSize.
+    //
+    if (config->max_frame_size_min) {
+        if (config->max_frame_size_min < QD_AMQP_MIN_MAX_FRAME_SIZE)
+            config->max_frame_size_min = QD_AMQP_MIN_MAX_FRAME_SIZE;
+        if (config->max_frame_size_min > config->max_frame_size) {
+            qd_log(qd->connection_manager->log_source, QD_LOG_WARNING,
+                   "Server configuation for I/O adapter entity name:'%s', host:'%s', port:'%s', "
+                   "maxFrameSizeMin %"PRIu32" is above maxFrameSize, using %"PRIu32,
+                   config->name, config->host, config->port, config->max_frame_size_min, config->max_frame_size);
+            config->max_frame_size_min = config->max_frame_size;
+        }
+    }
+
+    //
+    // An autotuned session window is never less than a frame, nor its bounds crossed.
+    //
+    if (config->session_window_max) {
+        if (config->session_window_min < config->max_frame_size)
+            config->session_window_min = config->max_frame_size;
+        if (config->session_window_max < config->session_window_min) {
+            qd_log(qd->connection_manager->log_source, QD_LOG_WARNING,
+                   "Server configuation for I/O adapter entity name:'%s', host:'%s', port:'%s', "
+                   "sessionWindowMax %zu is below sessionWindowMin, using %zu",
+                   config->name, config->host, config->port, config->session_window_max, config->session_window_min);
+            config->session_window_max = config->session_window_min;
+        }
+    }
+
     //
     // Given session frame count and max frame size compute session incoming_capacity
     //
@@ -416,6 +503,8 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
             config->ssl_trusted_certificates = SSTRDUP(ssl_profile->ssl_trusted_certificates);
             config->ssl_uid_format = SSTRDUP(ssl_profile->ssl_uid_format);
             config->ssl_uid_name_mapping_file = SSTRDUP(ssl_profile->uid_name_mapping_file);
+            config->ssl_session_stats = ssl_profile->session_stats;
+            qd_tls_session_stats_incref(config->ssl_session_stats);
         }
     }
 
@@ -425,6 +514,7 @@ static qd_error_t load_server_config(qd_dispatch_t *qd, qd_server_config_t *conf
         if (sasl_plugin) {
             config->sasl_plugin_config.auth_service = SSTRDUP(sasl_plugin->auth_service);
             config->sasl_plugin_config.sasl_init_hostname = SSTRDUP(sasl_plugin->sasl_init_hostname);
+            config->sasl_plugin_config.cache_seconds = sasl_plugin->cache_seconds;
             qd_log(qd->connection_manager->log_source, QD_LOG_INFO, "Using auth service %s from  SASL Plugin %s", config->sasl_plugin_config.auth_service, config->sasl_plugin);
 
             if (sasl_plugin->auth_ssl_profile) {
@@ -485,6 +575,7 @@ static bool config_ssl_profile_free(qd_connection_manager_t *cm, qd_config_ssl_p
     free(ssl_profile->ssl_private_key_file);
     free(ssl_profile->ssl_ciphers);
     free(ssl_profile->ssl_protocols);
+    qd_tls_session_stats_decref(ssl_profile->session_stats);
     free(ssl_profile);
     return true;
 
@@ -510,8 +601,10 @@ qd_config_ssl_profile_t *qd_dispatch_configure_ssl_profile(qd_dispatch_t *qd, qd
     qd_connection_manager_t *cm = qd->connection_manager;
 
     qd_config_ssl_profile_t *ssl_profile = NEW(qd_config_ssl_profile_t);
+    ZERO(ssl_profile);
     DEQ_ITEM_INIT(ssl_profile);
     DEQ_INSERT_TAIL(cm->config_ssl_profiles, ssl_profile);
+    ssl_profile->session_stats              = qd_tls_session_stats();
     ssl_profile->name                       = qd_entity_opt_string(entity, "name", 0); CHECK();
     ssl_profile->ssl_certificate_file       = qd_entity_opt_string(entity, "certFile", 0); CHECK();
     ssl_profile->ssl_private_key_file       = qd_entity_opt_string(entity, "privateKeyFile", 0); CHECK();
@@ -611,6 +704,9 @@ qd_config_sasl_plugin_t *qd_dispatch_configure_sasl_plugin(qd_dispatch_t *qd, qd
 
     sasl_plugin->sasl_init_hostname         = qd_entity_opt_string(entity, "realm", 0); CHECK();
     sasl_plugin->auth_ssl_profile           = qd_entity_opt_string(entity, "sslProfile", 0); CHECK();
+    sasl_plugin->cache_seconds              = qd_entity_opt_long(entity, "cacheSeconds", 0); CHECK();
+    if (sasl_plugin->cache_seconds < 0)
+        sasl_plugin->cache_seconds = 0;
 
     qd_log(cm->log_source, QD_LOG_INFO, "Created SASL plugin config with name %s", sasl_plugin->name);
     return sasl_plugin;
@@ -660,9 +756,41 @@ qd_listener_t *qd_dispatch_configure_listener(qd_dispatch_t *qd, qd_entity_t *en
 }
 
 
+qd_error_t qd_entity_refresh_sslProfile(qd_entity_t* entity, void *impl)
+{
+    qd_config_ssl_profile_t *ssl_profile = (qd_config_ssl_profile_t*) impl;
+    qd_tls_session_stats_t  *stats       = ssl_profile->session_stats;
+    if (!stats)
+        return QD_ERROR_NONE;
+
+    if (qd_entity_set_long(entity, "resumedHandshakes", sys_atomic_get(&stats->resumed)) == 0 &&
+        qd_entity_set_long(entity, "fullHandshakes", sys_atomic_get(&stats->full)) == 0)
+        return QD_ERROR_NONE;
+
+    return qd_error_code();
+}
+
+
 qd_error_t qd_entity_refresh_listener(qd_entity_t* entity, void *impl)
 {
-    return QD_ERROR_NONE;
+    qd_listener_t *li = (qd_listener_t*) impl;
+
+    sys_mutex_lock(li->admission_lock);
+    uint64_t admitted = li->connections_admitted;
+    uint64_t deferred = li->connections_deferred;
+    uint64_t refused  = li->connections_refused;
+    int      pending  = li->pending_accepts;
+    int      peak     = li->pending_accepts_max;
+    sys_mutex_unlock(li->admission_lock);
+
+    if (qd_entity_set_long(entity, "connectionsAdmitted", admitted) == 0 &&
+        qd_entity_set_long(entity, "connectionsDeferred", deferred) == 0 &&
+        qd_entity_set_long(entity, "connectionsRefused", refused) == 0 &&
+        qd_entity_set_long(entity, "pendingAccepts", pending) == 0 &&
+        qd_entity_set_long(entity, "pendingAcceptsMax", peak) == 0)
+        return QD_ERROR_NONE;
+
+    return qd_error_code();
 }
 
 
@@ -873,14 +1001,21 @@ void qd_connection_manager_start(qd_dispatch_t *qd)
     qd_listener_t  *li = DEQ_HEAD(qd->connection_manager->listeners);
     qd_connector_t *ct = DEQ_HEAD(qd->connection_manager->connectors);
 
+    //
+    // The listeners and connectors of the configuration file are all started
+    // by one call, their listens and connects proceeding together on the
+    // proactor.  As when they were started one at a time, only the first
+    // listener is fatal if it fails.
+    //
     while (li) {
         if (!li->pn_listener) {
-            if (!qd_listener_listen(li) && first_start) {
+            bool fatal = first_start && li == DEQ_HEAD(qd->connection_manager->listeners);
+            if (!qd_listener_listen(li) && fatal) {
                 qd_log(qd->connection_manager->log_source, QD_LOG_CRITICAL,
                        "Listen on %s failed during initial config", li->config.host_port);
                 exit(1);
             } else {
-                li->exit_on_error = first_start;
+                li->exit_on_error = fatal;
             }
         }
         li = DEQ_NEXT(li);
@@ -908,6 +1043,9 @@ void qd_connection_manager_delete_listener(qd_dispatch_t *qd, void *impl)
         if (li->pn_listener) {
             pn_listener_close(li->pn_listener);
         }
+        if (li->local) {
+            qd_local_listener_close(li->local);
+        }
         DEQ_REMOVE(qd->connection_manager->listeners, li);
         qd_listener_decref(li);
     }
@@ -945,6 +1083,15 @@ void qd_connection_manager_delete_connector(qd_dispatch_t *qd, void *impl)
                 qd_connection_invoke_deferred(ct->ctx, deferred_close, ct->ctx->pn_conn);
 
         }
+        // Stop a connect race and close its pending attempts
+        ct->race_next = ct->race_target_count;
+        for (int i = 0; i < ct->racer_count; i++) {
+            qd_connection_t *racer = ct->racers[i];
+            racer->connector = 0;
+            if (racer->pn_conn)
+                qd_connection_invoke_deferred(racer, deferred_close, racer->pn_conn);
+        }
+        ct->racer_count = 0;
         sys_mutex_unlock(ct->lock);
         DEQ_REMOVE(qd->connection_manager->connectors, ct);
         qd_connector_decref(ct);
@@ -21,6 +21,7 @@
 #include <string.h>
 #include "dispatch_private.h"
 #include "policy.h"
+#include "compression.h"
 #include <qpid/dispatch/container.h>
 #include <qpid/dispatch/server.h>
 #include <qpid/dispatch/message.h>
@@ -62,6 +63,13 @@ struct qd_link_t {
     pn_snd_settle_mode_t        remote_snd_settle_mode;
     qd_link_ref_list_t          ref_list;
     bool                        q2_limit_unbounded;
+    int                         withheld_credit;
+    size_t                      q2_upper;
+    size_t                      q2_lower;
+    size_t                      q3_upper;
+    uint32_t                    q2_stalls;
+    qd_deflater_t              *deflater;  ///< Created on first use when the connection compresses
+    qd_inflater_t              *inflater;
 };
 
 DEQ_DECLARE(qd_link_t, qd_link_list_t);
@@ -91,6 +99,18 @@ struct qd_container_t {
 
 ALLOC_DEFINE(qd_pn_free_link_session_t);
 
+/**
+ * Take the link's Q2/Q3 watermarks from its connection's listener or connector, falling
+ * back to the compiled-in defaults for settings left at zero.
+ */
+static void link_inherit_watermarks(qd_link_t *link, const qd_server_config_t *cf)
+{
+    link->q2_upper = cf && cf->q2_upper ? cf->q2_upper : QD_QLIMIT_Q2_UPPER;
+    link->q2_lower = cf && cf->q2_lower ? cf->q2_lower : QD_QLIMIT_Q2_LOWER;
+    link->q3_upper = cf && cf->q3_upper ? cf->q3_upper : QD_QLIMIT_Q3_UPPER;
+}
+
+
 static void setup_outgoing_link(qd_container_t *container, pn_link_t *pn_link)
 {
     qd_node_t *node = container->default_node;
@@ -126,6 +146,8 @@ static void setup_outgoing_link(qd_container_t *container, pn_link_t *pn_link)
     link->drain_mode             = pn_link_get_drain(pn_link);
 
     pn_link_set_context(pn_link, link);
+    qd_connection_t *conn = qd_link_connection(link);
+    link_inherit_watermarks(link, conn ? qd_connection_config(conn) : 0);
     node->ntype->outgoing_handler(node->context, link);
 }
 
@@ -164,6 +186,8 @@ static void setup_incoming_link(qd_container_t *container, pn_link_t *pn_link)
     link->remote_snd_settle_mode = pn_link_remote_snd_settle_mode(pn_link);
 
     pn_link_set_context(pn_link, link);
+    qd_connection_t *conn = qd_link_connection(link);
+    link_inherit_watermarks(link, conn ? qd_connection_config(conn) : 0);
     node->ntype->incoming_handler(node->context, link);
 }
 
@@ -338,37 +362,25 @@ static void writable_handler(qd_container_t *container, pn_connection_t *conn, q
 }
 
 
-/**
- * Returns true if the free_link already exists in free_link_list, false otherwise
+/*
+ * A link or session may be reported closed more than once before the batch
+ * completes.  Rather than scanning the connection's free list for duplicates,
+ * mark the proton object itself when it is queued so the check is O(1).
  */
-static bool link_exists(qd_pn_free_link_session_list_t *free_list, pn_link_t *free_link)
-{
-    qd_pn_free_link_session_t *free_item = DEQ_HEAD(*free_list);
-    while(free_item) {
-        if (free_item->pn_link == free_link)
-            return true;
-        free_item = DEQ_NEXT(free_item);
-    }
-    return false;
-}
+PN_HANDLE(QD_FREE_PENDING)
 
-/**
- * Returns true if the free_session already exists in free_session_list, false otherwise
-*/
-static bool session_exists(qd_pn_free_link_session_list_t *free_list, pn_session_t *free_session)
+static bool free_pending(pn_record_t *record)
 {
-    qd_pn_free_link_session_t *free_item = DEQ_HEAD(*free_list);
-    while(free_item) {
-        if (free_item->pn_session == free_session)
-            return true;
-        free_item = DEQ_NEXT(free_item);
-    }
+    if (pn_record_has(record, QD_FREE_PENDING))
+        return true;
+    pn_record_def(record, QD_FREE_PENDING, PN_VOID);
+    pn_record_set(record, QD_FREE_PENDING, (void*) 1);
     return false;
 }
 
 static void add_session_to_free_list(qd_pn_free_link_session_list_t *free_link_session_list, pn_session_t *ssn)
 {
-    if (!session_exists(free_link_session_list, ssn)) {
+    if (!free_pending(pn_session_attachments(ssn))) {
         qd_pn_free_link_session_t *to_free = new_qd_pn_free_link_session_t();
         DEQ_ITEM_INIT(to_free);
         to_free->pn_session = ssn;
@@ -379,7 +391,7 @@ static void add_session_to_free_list(qd_pn_free_link_session_list_t *free_link_s
 
 static void add_link_to_free_list(qd_pn_free_link_session_list_t *free_link_session_list, pn_link_t *pn_link)
 {
-    if (!link_exists(free_link_session_list, pn_link)) {
+    if (!free_pending(pn_link_attachments(pn_link))) {
         qd_pn_free_link_session_t *to_free = new_qd_pn_free_link_session_t();
         DEQ_ITEM_INIT(to_free);
         to_free->pn_link = pn_link;
@@ -420,6 +432,14 @@ void qd_conn_event_batch_complete(qd_container_t *container, qd_connection_t *qd
 }
 
 
+void qd_container_batch_complete(qd_container_t *container)
+{
+    qd_node_t *node = container->default_node;
+    if (node && node->ntype && node->ntype->batch_complete_handler)
+        node->ntype->batch_complete_handler(node->context);
+}
+
+
 void qd_container_handle_event(qd_container_t *container, pn_event_t *event,
                                pn_connection_t *conn, qd_connection_t *qd_conn)
 {
@@ -637,6 +657,8 @@ void qd_container_handle_event(qd_container_t *container, pn_event_t *event,
             do_receive(delivery);
 
         if (pn_delivery_updated(delivery)) {
+            if (pn_link_is_sender(pn_link))
+                qd_connection_window_updated(qd_conn, delivery);
             do_updated(delivery);
             pn_delivery_clear(delivery);
         }
@@ -686,6 +708,8 @@ void qd_container_free(qd_container_t *container)
     qd_link_t *link = DEQ_HEAD(container->links);
     while (link) {
         DEQ_REMOVE_HEAD(container->links);
+        qd_deflater_free(link->deflater);
+        qd_inflater_free(link->inflater);
         free_qd_link_t(link);
         link = DEQ_HEAD(container->links);
     }
@@ -851,7 +875,7 @@ qd_link_t *qd_link(qd_node_t *node, qd_connection_t *conn, qd_direction_t dir, c
 
     if (!conn->pn_sess) {
         conn->pn_sess = pn_session(qd_connection_pn(conn));
-        pn_session_set_incoming_capacity(conn->pn_sess, cf->incoming_capacity);
+        pn_session_set_incoming_capacity(conn->pn_sess, qd_connection_window_incoming(conn, cf->incoming_capacity));
         pn_session_open(conn->pn_sess);
     }
 
@@ -869,6 +893,7 @@ qd_link_t *qd_link(qd_node_t *node, qd_connection_t *conn, qd_direction_t dir, c
     link->remote_snd_settle_mode = pn_link_remote_snd_settle_mode(link->pn_link);
 
     pn_link_set_context(link->pn_link, link);
+    link_inherit_watermarks(link, cf);
 
     return link;
 }
@@ -899,6 +924,8 @@ void qd_link_free(qd_link_t *link)
         }
     }
 
+    qd_deflater_free(link->deflater);
+    qd_inflater_free(link->inflater);
     free_qd_link_t(link);
 }
 
@@ -943,6 +970,68 @@ void qd_link_set_q2_limit_unbounded(qd_link_t *link, bool q2_limit_unbounded)
 }
 
 
+size_t qd_link_q2_upper(const qd_link_t *link)
+{
+    return link->q2_upper;
+}
+
+
+size_t qd_link_q2_lower(const qd_link_t *link)
+{
+    return link->q2_lower;
+}
+
+
+size_t qd_link_q3_upper(const qd_link_t *link)
+{
+    return qd_connection_window_outgoing(qd_link_connection((qd_link_t*) link), link->q3_upper);
+}
+
+
+qd_deflater_t *qd_link_deflater(qd_link_t *link)
+{
+    if (!link->deflater && qd_connection_compression(qd_link_connection(link)))
+        link->deflater = qd_deflater();
+    return link->deflater;
+}
+
+
+qd_inflater_t *qd_link_inflater(qd_link_t *link)
+{
+    if (!link->inflater && qd_connection_compression(qd_link_connection(link)))
+        link->inflater = qd_inflater();
+    return link->inflater;
+}
+
+
+void qd_link_q2_stalled(qd_link_t *link)
+{
+    link->q2_stalls++;
+}
+
+
+uint32_t qd_link_take_q2_stalls(qd_link_t *link)
+{
+    uint32_t stalls = link->q2_stalls;
+    link->q2_stalls = 0;
+    return stalls;
+}
+
+
+void qd_link_withhold_credit(qd_link_t *link, int credit)
+{
+    link->withheld_credit += credit;
+}
+
+
+int qd_link_take_withheld_credit(qd_link_t *link)
+{
+    int credit = link->withheld_credit;
+    link->withheld_credit = 0;
+    return credit;
+}
+
+
 qd_direction_t qd_link_direction(const qd_link_t *link)
 {
     return link->direction;
@@ -28,6 +28,9 @@
 #include <stdlib.h>
 
 #include "config.h"
+#include "trace_ring.h"
+#include "message_log.h"
+#include "stats_page.h"
 #include "dispatch_private.h"
 #include "http.h"
 #include "log_private.h"
@@ -68,6 +71,7 @@ qd_dispatch_t *qd_dispatch(const char *python_pkgdir, bool test_hooks)
     struct timeval time;
     gettimeofday(&time, NULL);
     srandom((unsigned int)time.tv_sec + ((unsigned int)time.tv_usec << 11));
+    qd_discriminator_initialize();
     
     qd_dispatch_t *qd = NEW(qd_dispatch_t);
     ZERO(qd);
@@ -75,6 +79,8 @@ qd_dispatch_t *qd_dispatch(const char *python_pkgdir, bool test_hooks)
     qd_entity_cache_initialize();   /* Must be first */
     qd_alloc_initialize();
     qd_log_initialize();
+    qd_trace_ring_initialize();
+    qd_message_log_initialize();
     qd_error_initialize();
     if (qd_error_code()) { qd_dispatch_free(qd); return 0; }
 
@@ -113,7 +119,7 @@ qd_error_t qd_dispatch_load_config(qd_dispatch_t *qd, const char *config_path)
     if (!qd->dl_handle)
         return qd_error(QD_ERROR_RUNTIME, "Cannot locate library %s", QPID_DISPATCH_LIB);
 
-    qd_python_lock_state_t lock_state = qd_python_lock();
+    qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_STARTUP);
     PyObject *module = PyImport_ImportModule("qpid_dispatch_internal.management.config");
     PyObject *configure_dispatch = module ? PyObject_GetAttrString(module, "configure_dispatch") : NULL;
     Py_XDECREF(module);
@@ -204,6 +210,65 @@ qd_error_t qd_dispatch_configure_router(qd_dispatch_t *qd, qd_entity_t *entity)
     qd->allow_resumable_link_route = qd_entity_opt_bool(entity, "allowResumableLinkRoute", true); QD_ERROR_RET();
     qd->timestamps_in_utc = qd_entity_opt_bool(entity, "timestampsInUTC", false); QD_ERROR_RET();
     qd->timestamp_format = qd_entity_opt_string(entity, "timestampFormat", 0); QD_ERROR_RET();
+    qd->log_queue_size   = qd_entity_opt_long(entity, "logQueueSize", 4096); QD_ERROR_RET();
+    char *log_overflow   = qd_entity_opt_string(entity, "logOverflow", "drop"); QD_ERROR_RET();
+    qd->log_overflow_block = log_overflow && strcmp(log_overflow, "block") == 0;
+    free(log_overflow);
+    qd->trace_ring_size  = qd_entity_opt_long(entity, "traceRingSize", 0); QD_ERROR_RET();
+    qd_trace_ring_configure(qd->trace_ring_size);
+    qd->core_action_budget        = qd_entity_opt_long(entity, "coreActionBudget", 256); QD_ERROR_RET();
+    qd->core_data_plane_weight    = qd_entity_opt_long(entity, "coreDataPlaneWeight", 8); QD_ERROR_RET();
+    qd->core_control_plane_weight = qd_entity_opt_long(entity, "coreControlPlaneWeight", 2); QD_ERROR_RET();
+    qd->core_management_weight    = qd_entity_opt_long(entity, "coreManagementWeight", 1); QD_ERROR_RET();
+    qd->core_spin_micros          = qd_entity_opt_long(entity, "coreSpinMicros", 0); QD_ERROR_RET();
+    qd->core_action_stats         = qd_entity_opt_bool(entity, "coreActionStats", false); QD_ERROR_RET();
+    qd->core_action_trace         = qd_entity_opt_string(entity, "coreActionTrace", 0); QD_ERROR_RET();
+    qd->balanced_latency_aware    = qd_entity_opt_bool(entity, "balancedLatencyAware", false); QD_ERROR_RET();
+    qd->delivery_latency_stats    = qd_entity_opt_bool(entity, "deliveryLatencyStats", true); QD_ERROR_RET();
+    qd->management_snapshot_msec  = qd_entity_opt_long(entity, "managementSnapshotMillis", 0); QD_ERROR_RET();
+    qd->metrics_series_limit      = qd_entity_opt_long(entity, "metricsSeriesLimit", 1000); QD_ERROR_RET();
+    qd->stats_page_msec           = qd_entity_opt_long(entity, "statsPageMillis", 100); QD_ERROR_RET();
+    qd->stats_page_links          = qd_entity_opt_long(entity, "statsPageLinks", 256); QD_ERROR_RET();
+    qd->stats_page_path           = qd_entity_opt_string(entity, "statsPagePath", 0); QD_ERROR_RET();
+    if (qd->stats_page_path && *qd->stats_page_path) {
+        qd_stats_page_open(qd->stats_page_path, qd->stats_page_links); QD_ERROR_RET();
+    }
+    qd->http_threads              = qd_entity_opt_long(entity, "httpThreads", 1); QD_ERROR_RET();
+    qd->edge_uplinks              = qd_entity_opt_long(entity, "edgeUplinks", 1); QD_ERROR_RET();
+    qd->edge_proxy_attach_rate    = qd_entity_opt_long(entity, "edgeProxyAttachRate", 0); QD_ERROR_RET();
+    qd->edge_update_window        = qd_entity_opt_long(entity, "edgeAddressUpdateWindowSeconds", 0); QD_ERROR_RET();
+    qd->addr_lookup_cache_ttl     = qd_entity_opt_long(entity, "addressLookupCacheSeconds", 0); QD_ERROR_RET();
+    qd->addr_grace_period         = qd_entity_opt_long(entity, "addressGracePeriodSeconds", 0); QD_ERROR_RET();
+    qd->producer_credit_release   = qd_entity_opt_long(entity, "producerCreditRelease", 0); QD_ERROR_RET();
+    qd->link_route_cache_size     = qd_entity_opt_long(entity, "linkRouteCacheSize", 256); QD_ERROR_RET();
+    qd->auto_link_activate_rate   = qd_entity_opt_long(entity, "autoLinkActivationRate", 0); QD_ERROR_RET();
+    qd->core_client_max_in_flight = qd_entity_opt_long(entity, "coreClientMaxInFlight", 0); QD_ERROR_RET();
+    qd->core_activation_batch_micros = qd_entity_opt_long(entity, "coreActivationBatchMicros", 0); QD_ERROR_RET();
+    qd->inter_router_settle_micros = qd_entity_opt_long(entity, "interRouterSettleMicros", 0); QD_ERROR_RET();
+    qd->outbound_scheduler        = qd_entity_opt_string(entity, "outboundScheduler", "strict"); QD_ERROR_RET();
+    qd->outbound_quantum          = qd_entity_opt_long(entity, "outboundQuantum", 4); QD_ERROR_RET();
+    qd->connection_delivery_budget = qd_entity_opt_long(entity, "connectionDeliveryBudget", 0); QD_ERROR_RET();
+    qd->connection_batch_events   = qd_entity_opt_long(entity, "connectionBatchEvents", 0); QD_ERROR_RET();
+    qd->adaptive_credit_min       = qd_entity_opt_long(entity, "adaptiveCreditMin", 10); QD_ERROR_RET();
+    qd->adaptive_credit_max       = qd_entity_opt_long(entity, "adaptiveCreditMax", 0); QD_ERROR_RET();
+    qd->overload_action_depth     = qd_entity_opt_long(entity, "overloadActionDepth", 0); QD_ERROR_RET();
+    qd->overload_buffer_mb        = qd_entity_opt_long(entity, "overloadBufferMegabytes", 0); QD_ERROR_RET();
+    qd->compact_annotations       = qd_entity_opt_bool(entity, "compactAnnotations", false); QD_ERROR_RET();
+    qd->overload_core_lag_msec    = qd_entity_opt_long(entity, "overloadCoreLagMillis", 0); QD_ERROR_RET();
+    qd->worker_thread_cpus        = qd_entity_opt_string(entity, "workerThreadCpus", 0); QD_ERROR_RET();
+    qd->worker_connection_affinity = qd_entity_opt_bool(entity, "workerConnectionAffinity", false); QD_ERROR_RET();
+    qd->tls_offload_threads       = qd_entity_opt_long(entity, "tlsOffloadThreads", 0); QD_ERROR_RET();
+    qd->core_thread_cpus          = qd_entity_opt_string(entity, "coreThreadCpus", 0); QD_ERROR_RET();
+    qd->allocator_high_water      = qd_entity_opt_long(entity, "allocatorHighWater", 0); QD_ERROR_RET();
+    qd->allocator_trim_interval   = qd_entity_opt_long(entity, "allocatorTrimInterval", 10); QD_ERROR_RET();
+    qd_alloc_set_trim_high_water(qd->allocator_high_water > 0 ? (size_t) qd->allocator_high_water : 0);
+    qd->buffer_huge_pages         = qd_entity_opt_bool(entity, "bufferHugePages", false); QD_ERROR_RET();
+    if (qd->buffer_huge_pages)
+        qd_buffer_use_huge_pages();
+    qd->message_spill_threshold   = qd_entity_opt_long(entity, "messageSpillThreshold", 0); QD_ERROR_RET();
+    qd->message_spill_directory   = qd_entity_opt_string(entity, "messageSpillDirectory", "/tmp"); QD_ERROR_RET();
+    if (qd->message_spill_threshold > 0)
+        qd_message_set_spill((size_t) qd->message_spill_threshold, qd->message_spill_directory);
 
     if (! qd->sasl_config_path) {
         qd->sasl_config_path = qd_entity_opt_string(entity, "saslConfigDir", 0); QD_ERROR_RET();
@@ -274,6 +339,17 @@ qd_error_t qd_dispatch_register_display_name_service(qd_dispatch_t *qd, void *ob
 }
 
 
+qd_error_t qd_dispatch_display_name_load(qd_dispatch_t *qd, void *py_profile, void *py_names)
+{
+    char *profile = py_string_2_c(py_profile);
+    if (!profile)
+        return qd_error(QD_ERROR_VALUE, "display name profile is not a string");
+    qd_error_t err = qd_display_name_load(qd, profile, py_names);
+    free(profile);
+    return err;
+}
+
+
 long qd_dispatch_policy_c_counts_alloc()
 {
     return qd_policy_c_counts_alloc();
@@ -305,6 +381,11 @@ void qd_dispatch_policy_host_pattern_remove(qd_dispatch_t *qd, void *py_obj)
     free(hostPattern);
 }
 
+void qd_dispatch_policy_settings_cache_flush(qd_dispatch_t *qd)
+{
+    qd_policy_settings_cache_flush(qd->policy);
+}
+
 char * qd_dispatch_policy_host_pattern_lookup(qd_dispatch_t *qd, void *py_obj)
 {
     char *hostPattern = py_string_2_c(py_obj);
@@ -315,7 +396,7 @@ char * qd_dispatch_policy_host_pattern_lookup(qd_dispatch_t *qd, void *py_obj)
 
 qd_error_t qd_dispatch_prepare(qd_dispatch_t *qd)
 {
-    qd_log_global_options(qd->timestamp_format, qd->timestamps_in_utc);
+    qd_log_global_options(qd->timestamp_format, qd->timestamps_in_utc, qd->log_queue_size, qd->log_overflow_block);
     qd->server             = qd_server(qd, qd->thread_count, qd->router_id, qd->sasl_config_path, qd->sasl_config_name);
     qd->container          = qd_container(qd);
     qd->router             = qd_router(qd, qd->router_mode, qd->router_area, qd->router_id);
@@ -349,6 +430,7 @@ static void qd_dispatch_set_router_area(qd_dispatch_t *qd, char *_area) {
 void qd_dispatch_free(qd_dispatch_t *qd)
 {
     if (!qd) return;
+    qd_python_worker_stop();
     qd_dispatch_set_router_id(qd, NULL);
     qd_dispatch_set_router_area(qd, NULL);
     free(qd->sasl_config_path);
@@ -359,6 +441,17 @@ void qd_dispatch_free(qd_dispatch_t *qd)
     qd_router_free(qd->router);
     qd_container_free(qd->container);
     qd_server_free(qd->server);
+    qd_stats_page_close();
+    qd_message_log_finalize();
+    free(qd->stats_page_path);
+    free(qd->core_action_trace);
+    free(qd->worker_thread_cpus);
+    qd_message_set_spill(0, 0);
+    qd_message_finalize();
+    free(qd->message_spill_directory);
+    free(qd->core_thread_cpus);
+    free(qd->outbound_scheduler);
+    qd_trace_ring_finalize();
     qd_log_finalize();
     qd_alloc_finalize();
     qd_python_finalize();
@@ -60,6 +60,54 @@ struct qd_dispatch_t {
     bool   test_hooks;
     bool   timestamps_in_utc;
     char*  timestamp_format;
+    int    log_queue_size;
+    bool   log_overflow_block;
+    int    trace_ring_size;
+    int    core_action_budget;
+    int    core_data_plane_weight;
+    int    core_control_plane_weight;
+    int    core_management_weight;
+    int    core_spin_micros;
+    bool   core_action_stats;
+    char  *core_action_trace;
+    bool   balanced_latency_aware;
+    bool   delivery_latency_stats;
+    int    management_snapshot_msec;
+    int    metrics_series_limit;
+    int    stats_page_msec;
+    int    stats_page_links;
+    char  *stats_page_path;
+    int    http_threads;
+    int    edge_uplinks;
+    int    edge_proxy_attach_rate;
+    int    edge_update_window;
+    int    addr_lookup_cache_ttl;
+    int    addr_grace_period;
+    int    producer_credit_release;
+    int    link_route_cache_size;
+    int    auto_link_activate_rate;
+    int    core_client_max_in_flight;
+    long   allocator_high_water;
+    int    allocator_trim_interval;
+    bool   buffer_huge_pages;
+    long   message_spill_threshold;
+    char  *message_spill_directory;
+    int    core_activation_batch_micros;
+    int    inter_router_settle_micros;
+    char  *outbound_scheduler;
+    int    outbound_quantum;
+    int    connection_delivery_budget;
+    int    connection_batch_events;
+    int    adaptive_credit_min;
+    int    adaptive_credit_max;
+    int    overload_action_depth;
+    int    overload_buffer_mb;
+    bool   compact_annotations;
+    int    overload_core_lag_msec;
+    bool   worker_connection_affinity;
+    int    tls_offload_threads;
+    char  *worker_thread_cpus;
+    char  *core_thread_cpus;
 };
 
 /**
@@ -104,6 +152,11 @@ qd_error_t qd_dispatch_register_policy_manager(qd_dispatch_t *qd, qd_entity_t *e
  */
 qd_error_t qd_dispatch_register_display_name_service(qd_dispatch_t *qd, void *object);
 
+/**
+ * Push the display name mapping of an sslProfile into the native lookup table
+ */
+qd_error_t qd_dispatch_display_name_load(qd_dispatch_t *qd, void *py_profile, void *py_names);
+
 /**
  * \brief Configure the logging module from the
  *        parsed configuration file.  This must be called after the
@@ -27,6 +27,7 @@
 #include "router_private.h"
 
 #include <stdbool.h>
+#include <string.h>
 #include <pthread.h>
 
 
@@ -95,3 +96,58 @@ qd_error_t qd_entity_refresh_begin(PyObject *list) {
 void qd_entity_refresh_end() {
     sys_mutex_unlock(event_lock);
 }
+
+typedef qd_error_t (*qd_entity_refresh_t)(qd_entity_t *entity, void *impl);
+
+qd_error_t qd_entity_refresh_allocator(qd_entity_t *entity, void *impl);
+qd_error_t qd_entity_refresh_logStats(qd_entity_t *entity, void *impl);
+qd_error_t qd_entity_refresh_router(qd_entity_t *entity, void *impl);
+qd_error_t qd_entity_refresh_connector(qd_entity_t *entity, void *impl);
+qd_error_t qd_entity_refresh_listener(qd_entity_t *entity, void *impl);
+qd_error_t qd_entity_refresh_workerThread(qd_entity_t *entity, void *impl);
+
+// Entity types whose attributes are all refreshed in a single call
+static const struct {
+    const char          *type;
+    qd_entity_refresh_t  refresh;
+} batch_refresh[] = {
+    { "allocator", qd_entity_refresh_allocator },
+    { "logStats",  qd_entity_refresh_logStats },
+    { "router",    qd_entity_refresh_router },
+    { "connector", qd_entity_refresh_connector },
+    { "listener",  qd_entity_refresh_listener },
+    { "workerThread", qd_entity_refresh_workerThread },
+    { 0, 0 }
+};
+
+// Refresh a python list of (attributes, pointer) of one entity type in a
+// single call from the agent, rather than one ctypes call per entity.
+// Returns the number refreshed, or -1 if the type is not refreshed in batches
+// and each entity must be refreshed by its own function.
+// Called with the entity cache locked (see qd_entity_refresh_begin).
+long qd_entity_refresh_list(const char *type, PyObject *list) {
+    qd_entity_refresh_t refresh = 0;
+    for (int i = 0; batch_refresh[i].type; i++) {
+        if (strcmp(batch_refresh[i].type, type) == 0) {
+            refresh = batch_refresh[i].refresh;
+            break;
+        }
+    }
+    if (!refresh)
+        return -1;
+
+    qd_error_clear();
+    Py_ssize_t size = PyList_Size(list);
+    if (size < 0) { qd_error_py(); return -1; }
+    for (Py_ssize_t i = 0; i < size; i++) {
+        PyObject *item = PyList_GetItem(list, i);   // borrowed
+        PyObject *attributes = 0;
+        PyObject *pointer = 0;
+        if (!item || !PyArg_ParseTuple(item, "OO", &attributes, &pointer)) { qd_error_py(); return -1; }
+        void *impl = PyLong_AsVoidPtr(pointer);
+        if (PyErr_Occurred()) { qd_error_py(); return -1; }
+        if (refresh((qd_entity_t*) attributes, impl))
+            return -1;
+    }
+    return (long) size;
+}
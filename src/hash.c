@@ -21,41 +21,71 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <qpid/dispatch/alloc.h>
 #include <qpid/dispatch/hash.h>
 #include <qpid/dispatch/ctools.h>
 
+//
+// Keys shorter than this are stored inside the item rather than in a separate
+// allocation.  The size keeps a qd_hash_item_t within one 64-byte cache line.
+//
+#define QD_HASH_INLINE_KEY 40
+
 typedef struct qd_hash_item_t {
-    DEQ_LINKS(struct qd_hash_item_t);
+    uint32_t       hash;
+    uint32_t       key_length;
     unsigned char *key;
     union {
         void       *val;
         const void *val_const;
     } v;
+    unsigned char  inline_key[QD_HASH_INLINE_KEY];
 } qd_hash_item_t;
 
 ALLOC_DECLARE(qd_hash_item_t);
 ALLOC_DEFINE(qd_hash_item_t);
-DEQ_DECLARE(qd_hash_item_t, items_t);
-
-
-typedef struct bucket_t {
-    items_t items;
-} bucket_t;
 
 
+//
+// A table is an open-addressed array of slots probed linearly.  Each slot
+// carries the full hash of its item so most mismatches are rejected without
+// touching the item or comparing keys.
+//
+typedef struct slot_t {
+    uint32_t        hash;
+    qd_hash_item_t *item;
+} slot_t;
+
+typedef struct table_t {
+    slot_t       *slots;
+    unsigned int  count;
+    unsigned int  mask;
+} table_t;
+
+
+//
+// When the table must grow, a table of twice the size replaces it and the old
+// one is kept as the draining table.  Its slots are migrated a few at a time
+// by each subsequent insert or remove, starting just after an empty slot, so
+// no single operation pays for a full rehash.  Lookups check both tables
+// until draining completes.  Items removed from the draining table are marked
+// with REMOVED rather than shifted so that the migrated region stays empty.
+//
 struct qd_hash_t {
-    bucket_t     *buckets;
-    unsigned int  bucket_count;
-    unsigned int  bucket_mask;
-    int           batch_size;
+    table_t       table;
+    table_t       draining;
+    unsigned int  drain_start;  // first draining slot to be migrated
+    unsigned int  drained;      // number of draining slots migrated so far
     size_t        size;
     int           is_const;
 };
 
+static qd_hash_item_t removed_item;
+#define REMOVED (&removed_item)
+
 
 struct qd_hash_handle_t {
-    bucket_t    *bucket;
     qd_hash_item_t *item;
 };
 
@@ -63,53 +93,159 @@ ALLOC_DECLARE(qd_hash_handle_t);
 ALLOC_DEFINE(qd_hash_handle_t);
 
 
+//
+// Grow the table when it would otherwise be more than three quarters full.
+//
+#define QD_HASH_MAX_LOAD(count) (((size_t) (count) * 3) / 4)
+
+//
+// Draining slots migrated per insert or remove.  Growth starts at 3/4 load
+// and the new table reaches that load after count * 3/4 more inserts, so any
+// rate above 4/3 finishes draining first.
+//
+#define QD_HASH_DRAIN_STEP 8
+
+
+static bool table_init(table_t *t, unsigned int count)
+{
+    t->slots = NEW_ARRAY(slot_t, count);
+    if (!t->slots)
+        return false;
+    memset(t->slots, 0, sizeof(slot_t) * count);
+    t->count = count;
+    t->mask  = count - 1;
+    return true;
+}
+
+
+static void table_place(table_t *t, const slot_t *slot)
+{
+    unsigned int idx = slot->hash & t->mask;
+    while (t->slots[idx].item)
+        idx = (idx + 1) & t->mask;
+    t->slots[idx] = *slot;
+}
+
+
 qd_hash_t *qd_hash(int bucket_exponent, int batch_size, int value_is_const)
 {
-    int i;
     qd_hash_t *h = NEW(qd_hash_t);
 
     if (!h)
         return 0;
 
-    h->bucket_count = 1 << bucket_exponent;
-    h->bucket_mask  = h->bucket_count - 1;
-    h->batch_size   = batch_size;
-    h->size         = 0;
-    h->is_const     = value_is_const;
-    h->buckets = NEW_ARRAY(bucket_t, h->bucket_count);
-    for (i = 0; i < h->bucket_count; i++) {
-        DEQ_INIT(h->buckets[i].items);
+    ZERO(h);
+    if (bucket_exponent < 3)
+        bucket_exponent = 3;
+
+    h->is_const = value_is_const;
+    if (!table_init(&h->table, 1 << bucket_exponent)) {
+        free(h);
+        return 0;
     }
 
     return h;
 }
 
-//remove the given item from the given bucket of the given hash
-//return the key if non-null key pointer given, otherwise, free the memory
-static void qd_hash_internal_remove_item(qd_hash_t *h, bucket_t *bucket, qd_hash_item_t *item, unsigned char **key) {
-    if (key)
-        *key = item->key;
-    else
+
+static void qd_hash_internal_free_item(qd_hash_item_t *item)
+{
+    if (item->key != item->inline_key)
         free(item->key);
-    DEQ_REMOVE(bucket->items, item);
     free_qd_hash_item_t(item);
+}
+
+
+//
+// Hand the item's key to the caller, copying it out if it is stored inline.
+//
+static void qd_hash_internal_take_key(qd_hash_item_t *item, unsigned char **key)
+{
+    if (item->key == item->inline_key) {
+        *key = (unsigned char*) malloc(item->key_length + 1);
+        memcpy(*key, item->inline_key, item->key_length + 1);
+    } else {
+        *key = item->key;
+        item->key = item->inline_key;
+    }
+}
+
+
+//
+// Empty the slot at idx and shift any following members of its probe run back
+// so that lookups never need tombstones.
+//
+static void qd_hash_internal_clear_slot(table_t *t, unsigned int idx)
+{
+    unsigned int next = idx;
+
+    while (true) {
+        t->slots[idx].item = 0;
+
+        while (true) {
+            next = (next + 1) & t->mask;
+            if (!t->slots[next].item)
+                return;
+
+            //
+            // The item at next may move to idx only if its home slot does not
+            // lie cyclically within (idx, next].
+            //
+            unsigned int home = t->slots[next].hash & t->mask;
+            if (((next - home) & t->mask) >= ((next - idx) & t->mask))
+                break;
+        }
+
+        t->slots[idx] = t->slots[next];
+        idx = next;
+    }
+}
+
+
+//remove the item in the given slot of the current table
+//return the key if non-null key pointer given, otherwise, free the memory
+static void qd_hash_internal_remove_item(qd_hash_t *h, unsigned int idx, unsigned char **key)
+{
+    qd_hash_item_t *item = h->table.slots[idx].item;
+
+    if (key)
+        qd_hash_internal_take_key(item, key);
+
+    qd_hash_internal_clear_slot(&h->table, idx);
+    qd_hash_internal_free_item(item);
     h->size--;
 }
 
+
+//remove the item in the given slot of the draining table
+static void qd_hash_internal_remove_drained_item(qd_hash_t *h, slot_t *slot, unsigned char **key)
+{
+    qd_hash_item_t *item = slot->item;
+
+    if (key)
+        qd_hash_internal_take_key(item, key);
+
+    slot->item = REMOVED;
+    qd_hash_internal_free_item(item);
+    h->size--;
+}
+
+
 void qd_hash_free(qd_hash_t *h)
 {
     if (!h) return;
-    qd_hash_item_t *item;
-    int             idx;
 
-    for (idx = 0; idx < h->bucket_count; idx++) {
-        item = DEQ_HEAD(h->buckets[idx].items);
-        while (item) {
-            qd_hash_internal_remove_item(h, &h->buckets[idx], item, 0);
-            item = DEQ_HEAD(h->buckets[idx].items);
-        }
+    for (unsigned int idx = 0; idx < h->table.count; idx++) {
+        if (h->table.slots[idx].item)
+            qd_hash_internal_free_item(h->table.slots[idx].item);
     }
-    free(h->buckets);
+    for (unsigned int idx = 0; idx < h->draining.count; idx++) {
+        qd_hash_item_t *item = h->draining.slots[idx].item;
+        if (item && item != REMOVED)
+            qd_hash_internal_free_item(item);
+    }
+    free(h->table.slots);
+    free(h->draining.slots);
     free(h);
 }
 
@@ -120,32 +256,136 @@ size_t qd_hash_size(qd_hash_t *h)
 }
 
 
-static qd_hash_item_t *qd_hash_internal_insert(qd_hash_t *h, qd_iterator_t *key, int *exists, qd_hash_handle_t **handle)
+static void qd_hash_internal_drain(qd_hash_t *h, unsigned int slots)
+{
+    while (h->draining.slots && slots--) {
+        slot_t *slot = &h->draining.slots[(h->drain_start + h->drained) & h->draining.mask];
+        if (slot->item && slot->item != REMOVED)
+            table_place(&h->table, slot);
+        slot->item = 0;
+
+        if (++h->drained == h->draining.count) {
+            free(h->draining.slots);
+            ZERO(&h->draining);
+        }
+    }
+}
+
+
+static bool qd_hash_internal_grow(qd_hash_t *h)
 {
-    unsigned long   idx  = qd_iterator_hash_view(key) & h->bucket_mask;
-    qd_hash_item_t *item = DEQ_HEAD(h->buckets[idx].items);
+    table_t bigger;
+
+    qd_hash_internal_drain(h, UINT_MAX);
+    if (!table_init(&bigger, h->table.count << 1))
+        return false;
 
-    while (item) {
-        if (qd_iterator_equal(key, item->key))
+    h->draining = h->table;
+    h->table    = bigger;
+    h->drained  = 0;
+
+    //
+    // Migration starts after an empty slot, so every probe run that remains
+    // in the draining table starts at or after the migration point.
+    //
+    unsigned int empty = 0;
+    while (h->draining.slots[empty].item)
+        empty++;
+    h->drain_start = (empty + 1) & h->draining.mask;
+
+    return true;
+}
+
+
+//
+// First slot of the draining table to probe for an item whose home is idx.
+// Slots already migrated are empty, so probing resumes at the migration point.
+//
+static unsigned int qd_hash_internal_drain_probe_start(const qd_hash_t *h, unsigned int idx)
+{
+    if (((idx - h->drain_start) & h->draining.mask) < h->drained)
+        return (h->drain_start + h->drained) & h->draining.mask;
+    return idx;
+}
+
+
+//
+// Find the slot of the current table holding key, or the empty slot that
+// ends its probe run.
+//
+static unsigned int qd_hash_internal_find_slot(qd_hash_t *h, uint32_t hash, qd_iterator_t *key)
+{
+    unsigned int idx = hash & h->table.mask;
+
+    while (h->table.slots[idx].item) {
+        if (h->table.slots[idx].hash == hash && qd_iterator_equal(key, h->table.slots[idx].item->key))
             break;
-        item = DEQ_NEXT(item);
+        idx = (idx + 1) & h->table.mask;
     }
 
-    if (item) {
+    return idx;
+}
+
+
+//
+// Find the draining-table slot holding key, if any.
+//
+static slot_t *qd_hash_internal_find_drained(qd_hash_t *h, uint32_t hash, qd_iterator_t *key)
+{
+    if (!h->draining.slots)
+        return 0;
+
+    unsigned int idx = qd_hash_internal_drain_probe_start(h, hash & h->draining.mask);
+
+    while (h->draining.slots[idx].item) {
+        slot_t *slot = &h->draining.slots[idx];
+        if (slot->hash == hash && slot->item != REMOVED && qd_iterator_equal(key, slot->item->key))
+            return slot;
+        idx = (idx + 1) & h->draining.mask;
+    }
+
+    return 0;
+}
+
+
+static qd_hash_item_t *qd_hash_internal_insert(qd_hash_t *h, uint32_t hash, qd_iterator_t *key, int *exists, qd_hash_handle_t **handle)
+{
+    qd_hash_internal_drain(h, QD_HASH_DRAIN_STEP);
+
+    unsigned int    idx     = qd_hash_internal_find_slot(h, hash, key);
+    qd_hash_item_t *item    = h->table.slots[idx].item;
+    slot_t         *drained = item ? 0 : qd_hash_internal_find_drained(h, hash, key);
+
+    if (item || drained) {
         *exists = 1;
         if (handle)
             *handle = 0;
-        return item;
+        return item ? item : drained->item;
+    }
+
+    if (h->size + 1 > QD_HASH_MAX_LOAD(h->table.count)) {
+        if (!qd_hash_internal_grow(h))
+            return 0;
+        idx = qd_hash_internal_find_slot(h, hash, key);
     }
 
     item = new_qd_hash_item_t();
     if (!item)
         return 0;
 
-    DEQ_ITEM_INIT(item);
-    item->key = qd_iterator_copy(key);
+    item->hash = hash;
+    int length = qd_iterator_length(key);
+    if (length < QD_HASH_INLINE_KEY) {
+        item->key_length = qd_iterator_ncopy(key, item->inline_key, length);
+        item->inline_key[item->key_length] = '\0';
+        item->key = item->inline_key;
+    } else {
+        item->key        = qd_iterator_copy(key);
+        item->key_length = strlen((const char*) item->key);
+    }
 
-    DEQ_INSERT_TAIL(h->buckets[idx].items, item);
+    h->table.slots[idx].hash = hash;
+    h->table.slots[idx].item = item;
     h->size++;
     *exists = 0;
 
@@ -154,8 +394,7 @@ static qd_hash_item_t *qd_hash_internal_insert(qd_hash_t *h, qd_iterator_t *key,
     //
     if (handle) {
         *handle = new_qd_hash_handle_t();
-        (*handle)->bucket = &h->buckets[idx];
-        (*handle)->item   = item;
+        (*handle)->item = item;
     }
 
     return item;
@@ -163,9 +402,15 @@ static qd_hash_item_t *qd_hash_internal_insert(qd_hash_t *h, qd_iterator_t *key,
 
 
 qd_error_t qd_hash_insert(qd_hash_t *h, qd_iterator_t *key, void *val, qd_hash_handle_t **handle)
+{
+    return qd_hash_insert_with_hash(h, qd_iterator_hash_view(key), key, val, handle);
+}
+
+
+qd_error_t qd_hash_insert_with_hash(qd_hash_t *h, uint32_t hash, qd_iterator_t *key, void *val, qd_hash_handle_t **handle)
 {
     int             exists = 0;
-    qd_hash_item_t *item   = qd_hash_internal_insert(h, key, &exists, handle);
+    qd_hash_item_t *item   = qd_hash_internal_insert(h, hash, key, &exists, handle);
 
     if (!item)
         return QD_ERROR_ALLOC;
@@ -184,7 +429,7 @@ qd_error_t qd_hash_insert_const(qd_hash_t *h, qd_iterator_t *key, const void *va
     assert(h->is_const);
 
     int             exists = 0;
-    qd_hash_item_t *item  = qd_hash_internal_insert(h, key, &exists, handle);
+    qd_hash_item_t *item  = qd_hash_internal_insert(h, qd_iterator_hash_view(key), key, &exists, handle);
 
     if (!item)
         return QD_ERROR_ALLOC;
@@ -200,16 +445,12 @@ qd_error_t qd_hash_insert_const(qd_hash_t *h, qd_iterator_t *key, const void *va
 
 static qd_hash_item_t *qd_hash_internal_retrieve_with_hash(qd_hash_t *h, uint32_t hash, qd_iterator_t *key)
 {
-    uint32_t        idx  = hash & h->bucket_mask;
-	qd_hash_item_t *item = DEQ_HEAD(h->buckets[idx].items);
-
-	while (item) {
-		if (qd_iterator_equal(key, item->key))
-			break;
-		item = DEQ_NEXT(item);
-	}
-
-	return item;
+    qd_hash_item_t *item = h->table.slots[qd_hash_internal_find_slot(h, hash, key)].item;
+    if (!item) {
+        slot_t *drained = qd_hash_internal_find_drained(h, hash, key);
+        item = drained ? drained->item : 0;
+    }
+    return item;
 }
 
 
@@ -227,7 +468,7 @@ void qd_hash_retrieve_prefix(qd_hash_t *h, qd_iterator_t *iter, void **val)
 
 	uint32_t hash = 0;
 
-	qd_hash_item_t *item;
+	qd_hash_item_t *item = 0;
 	while (qd_iterator_next_segment(iter, &hash)) {
 		item = qd_hash_internal_retrieve_with_hash(h, hash, iter);
 		if (item)
@@ -250,7 +491,7 @@ void qd_hash_retrieve_prefix_const(qd_hash_t *h, qd_iterator_t *iter, const void
 
     uint32_t hash = 0;
 
-    qd_hash_item_t *item;
+    qd_hash_item_t *item = 0;
 
     while (qd_iterator_next_segment(iter, &hash)) {
         item = qd_hash_internal_retrieve_with_hash(h, hash, iter);
@@ -277,6 +518,18 @@ qd_error_t qd_hash_retrieve(qd_hash_t *h, qd_iterator_t *key, void **val)
 }
 
 
+qd_error_t qd_hash_retrieve_with_hash(qd_hash_t *h, uint32_t hash, qd_iterator_t *key, void **val)
+{
+    qd_hash_item_t *item = qd_hash_internal_retrieve_with_hash(h, hash, key);
+    if (item)
+        *val = item->v.val;
+    else
+        *val = 0;
+
+    return QD_ERROR_NONE;
+}
+
+
 qd_error_t qd_hash_retrieve_const(qd_hash_t *h, qd_iterator_t *key, const void **val)
 {
     assert(h->is_const);
@@ -293,14 +546,20 @@ qd_error_t qd_hash_retrieve_const(qd_hash_t *h, qd_iterator_t *key, const void *
 
 qd_error_t qd_hash_remove(qd_hash_t *h, qd_iterator_t *key)
 {
-    //the retrieve function will re-apply the bucket_mask, but that is ok
-    //we apply it here because we need the bucket index to do the remove
-    uint32_t        idx  = qd_iterator_hash_view(key) & h->bucket_mask;
-    qd_hash_item_t *item = qd_hash_internal_retrieve_with_hash(h, idx, key);
-    if (!item)
+    qd_hash_internal_drain(h, QD_HASH_DRAIN_STEP);
+
+    uint32_t     hash = qd_iterator_hash_view(key);
+    unsigned int idx  = qd_hash_internal_find_slot(h, hash, key);
+    if (h->table.slots[idx].item) {
+        qd_hash_internal_remove_item(h, idx, 0);
+        return QD_ERROR_NONE;
+    }
+
+    slot_t *drained = qd_hash_internal_find_drained(h, hash, key);
+    if (!drained)
         return QD_ERROR_NOT_FOUND;
 
-    qd_hash_internal_remove_item(h, &h->buckets[idx], item, 0);
+    qd_hash_internal_remove_drained_item(h, drained, 0);
     return QD_ERROR_NONE;
 }
 
@@ -322,11 +581,7 @@ const unsigned char *qd_hash_key_by_handle(const qd_hash_handle_t *handle)
 
 qd_error_t qd_hash_remove_by_handle(qd_hash_t *h, qd_hash_handle_t *handle)
 {
-    unsigned char *key   = 0;
-    qd_error_t     error = qd_hash_remove_by_handle2(h, handle, &key);
-    if (key)
-        free(key);
-    return error;
+    return qd_hash_remove_by_handle2(h, handle, 0);
 }
 
 
@@ -334,6 +589,30 @@ qd_error_t qd_hash_remove_by_handle2(qd_hash_t *h, qd_hash_handle_t *handle, uns
 {
     if (!handle)
         return QD_ERROR_NOT_FOUND;
-    qd_hash_internal_remove_item(h, handle->bucket, handle->item, key);
+
+    qd_hash_internal_drain(h, QD_HASH_DRAIN_STEP);
+
+    //
+    // The item's slot may have moved since the handle was issued; it is found
+    // along the probe run from the item's home slot in one of the tables.
+    //
+    qd_hash_item_t *item = handle->item;
+    unsigned int    idx  = item->hash & h->table.mask;
+    while (h->table.slots[idx].item) {
+        if (h->table.slots[idx].item == item) {
+            qd_hash_internal_remove_item(h, idx, key);
+            return QD_ERROR_NONE;
+        }
+        idx = (idx + 1) & h->table.mask;
+    }
+
+    assert(h->draining.slots);
+    idx = qd_hash_internal_drain_probe_start(h, item->hash & h->draining.mask);
+    while (h->draining.slots[idx].item != item) {
+        assert(h->draining.slots[idx].item);
+        idx = (idx + 1) & h->draining.mask;
+    }
+
+    qd_hash_internal_remove_drained_item(h, &h->draining.slots[idx], key);
     return QD_ERROR_NONE;
 }
@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include <qpid/dispatch/alloc.h>
 #include <qpid/dispatch/atomic.h>
 #include <qpid/dispatch/amqp.h>
 #include <qpid/dispatch/router_core.h>
@@ -31,9 +32,11 @@
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "http.h"
 #include "server_private.h"
+#include "dispatch_private.h"
 #include "config.h"
 
 static const char *CIPHER_LIST = "ALL:aNULL:!eNULL:@STRENGTH"; /* Default */
@@ -88,13 +91,22 @@ static void buffer_set_size(buffer_t *buf, size_t size) {
     }
 }
 
+/* Largest WebSocket message sent or received at once on an AMQPWS connection */
+#define WS_FRAME_MAX 65536
+
+typedef struct service_thread_t service_thread_t;
+
 /* AMQPWS connection: set as lws user data and qd_conn->context */
-typedef struct connection_t {
+typedef struct connection_t connection_t;
+struct connection_t {
+    DEQ_LINKS(connection_t);          /* In thread->connections */
     pn_connection_driver_t driver;
     qd_connection_t* qd_conn;
-    buffer_t wbuf;   /* LWS requires allocated header space at start of buffer */
+    buffer_t wbuf;   /* LWS_PRE header space + WS_FRAME_MAX, allocated once */
     struct lws *wsi;
-} connection_t;
+    service_thread_t *thread;         /* Service thread that owns wsi */
+};
+DEQ_DECLARE(connection_t, connection_list_t);
 
 typedef struct stats_t {
     size_t current;
@@ -102,6 +114,18 @@ typedef struct stats_t {
     qdr_global_stats_t stats;
     qd_http_server_t *server;
     struct lws *wsi;
+    service_thread_t *thread;
+    /* Per-entity series, streamed a batch at a time */
+    size_t family;          /* index in entity_metrics */
+    int row;                /* next row of the batch */
+    int line;               /* next line of a histogram row */
+    bool family_started;    /* TYPE line written */
+    bool batch_ready;
+    bool pending;           /* batch requested from core thread */
+    qdr_entity_metrics_batch_t *batch;
+    /* Server thread counters, copied when the request arrives */
+    qd_server_thread_stats_t *threads;
+    int thread_count;
 } stats_t;
 
 /* Navigating from WSI pointer to qd objects */
@@ -130,6 +154,7 @@ static struct lws_protocols protocols[] = {
         "amqp",
         callback_amqpws,
         sizeof(connection_t),
+        WS_FRAME_MAX,
     },
     /* "binary" is an alias for "amqp", for compatibility with clients designed
      * to work with a WebSocket proxy
@@ -138,6 +163,7 @@ static struct lws_protocols protocols[] = {
         "binary",
         callback_amqpws,
         sizeof(connection_t),
+        WS_FRAME_MAX,
     },
     {
         "http",
@@ -175,70 +201,83 @@ static int handle_events(connection_t* c) {
     return 0;
 }
 
-/* The server has a bounded, thread-safe queue for external work */
+/* Work for a service thread from other threads */
 typedef struct work_t {
     enum { W_NONE, W_LISTEN, W_CLOSE, W_WAKE, W_STOP, W_HANDLE_STATS } type;
     void *value;
 } work_t;
 
-#define WORK_MAX 8              /* Just decouple threads, not a big buffer */
+typedef struct qd_http_work_t qd_http_work_t;
+struct qd_http_work_t {
+    qd_http_work_t *next;
+    work_t work;
+};
+
+ALLOC_DECLARE(qd_http_work_t);
+ALLOC_DEFINE(qd_http_work_t);
 
-typedef struct work_queue_t {
-    sys_mutex_t *lock;
-    sys_cond_t *cond;
-    work_t work[WORK_MAX];
-    size_t head, len;          /* Ring buffer */
-} work_queue_t;
+#define HTTP_MAX_THREADS 16
+
+/* One libwebsockets service thread.  A connection is serviced by the thread
+ * that accepted it for its whole life, so only work for its wsi goes to that
+ * thread; listener changes and stop go to thread 0.
+ */
+struct service_thread_t {
+    qd_http_server_t *server;
+    int tsi;                    /* LWS service thread index */
+    sys_thread_t *thread;
+    sys_atomic_ptr_t work;      /* Lock-free stack of qd_http_work_t, newest first */
+    pn_timestamp_t now;         /* Cache current time in thread_run */
+    pn_timestamp_t next_tick;   /* Next requested tick service */
+    connection_list_t connections;
+};
 
-/* HTTP Server runs in a single thread, communication from other threads via work_queue */
 struct qd_http_server_t {
     qd_server_t *server;
     qdr_core_t *core;
-    sys_thread_t *thread;
-    work_queue_t work;
+    sys_mutex_t *lock;          /* Serializes starting the threads */
+    bool started;
     qd_log_source_t *log;
     struct lws_context *context;
-    pn_timestamp_t now;         /* Cache current time in thread_run */
-    pn_timestamp_t next_tick;   /* Next requested tick service */
+    int thread_count;
+    service_thread_t threads[HTTP_MAX_THREADS];
 };
 
-static void work_queue_destroy(work_queue_t *wq) {
-    if (wq->lock) sys_mutex_free(wq->lock);
-    if (wq->cond) sys_cond_free(wq->cond);
-}
+/* The service thread running on this thread, 0 on other threads */
+static __thread service_thread_t *current_thread;
 
-static void work_queue_init(work_queue_t *wq) {
-    wq->lock = sys_mutex();
-    wq->cond = sys_cond();
-}
-
- /* Block till there is space */
-static void work_push(qd_http_server_t *hs, work_t w) {
-    work_queue_t *wq = &hs->work;
-    sys_mutex_lock(wq->lock);
-    while (wq->len == WORK_MAX) {
-        lws_cancel_service(hs->context); /* Wake up the run thread to clear space */
-        sys_cond_wait(wq->cond, wq->lock);
+/* Never blocks.  wsi, if not null, is the connection the work is for: only
+ * its thread is woken.
+ */
+static void work_push(service_thread_t *st, work_t w, struct lws *wsi) {
+    qd_http_work_t *item = new_qd_http_work_t();
+    item->work = w;
+    void *head;
+    do {
+        head = sys_atomic_ptr_get(&st->work);
+        item->next = (qd_http_work_t*) head;
+    } while (!sys_atomic_ptr_cas(&st->work, head, item));
+
+    /* A non-empty stack already has a wake-up pending */
+    if (!head) {
+        if (wsi)
+            lws_cancel_service_pt(wsi);
+        else
+            lws_cancel_service(st->server->context);
     }
-    wq->work[(wq->head + wq->len) % WORK_MAX] = w;
-    ++wq->len;
-    sys_mutex_unlock(wq->lock);
-    lws_cancel_service(hs->context); /* Wake up the run thread to handle my work */
 }
 
-/* Non-blocking, return { W_NONE, NULL } if empty */
-static work_t work_pop(qd_http_server_t *hs) {
-    work_t w = { W_NONE, NULL };
-    work_queue_t *wq = &hs->work;
-    sys_mutex_lock(wq->lock);
-    if (wq->len > 0) {
-        w = wq->work[wq->head];
-        wq->head = (wq->head + 1) % WORK_MAX;
-        --wq->len;
-        sys_cond_signal(wq->cond);
+/* Take all queued work, oldest first */
+static qd_http_work_t *work_take(service_thread_t *st) {
+    qd_http_work_t *item = (qd_http_work_t*) sys_atomic_ptr_swap(&st->work, 0);
+    qd_http_work_t *fifo = 0;
+    while (item) {
+        qd_http_work_t *next = item->next;
+        item->next = fifo;
+        fifo = item;
+        item = next;
     }
-    sys_mutex_unlock(wq->lock);
-    return w;
+    return fifo;
 }
 
 /* Each qd_http_listener_t is associated with an lws_vhost */
@@ -380,23 +419,29 @@ static int callback_http(struct lws *wsi, enum lws_callback_reasons reason,
 static void connection_wake(qd_connection_t *qd_conn)
 {
     connection_t *c = qd_conn->context;
-    if (c && qd_conn->listener->http) {
-        qd_http_server_t *hs = qd_conn->listener->http->server;
+    if (c && c->thread && qd_conn->listener->http) {
         work_t w = { W_WAKE, c };
-        work_push(hs, w);
+        work_push(c->thread, w, c->wsi);
     }
 }
 
 static void handle_stats_results(void *context)
 {
     stats_t* stats = (stats_t*) context;
-    qd_http_server_t *hs = stats->server;
-    if (hs) {
+    if (stats->thread) {
         work_t w = { W_HANDLE_STATS, stats->wsi };
-        work_push(hs, w);
+        work_push(stats->thread, w, stats->wsi);
     }
 }
 
+static void handle_entity_results(void *context)
+{
+    stats_t* stats = (stats_t*) context;
+    stats->pending = false;
+    stats->batch_ready = true;
+    handle_stats_results(context);
+}
+
 typedef int (*int_metric) (qdr_global_stats_t *stats);
 typedef struct metric_definition {
     const char* name;
@@ -421,6 +466,8 @@ static int stats_get_deliveries_egress(qdr_global_stats_t *stats) { return stats
 static int stats_get_deliveries_transit(qdr_global_stats_t *stats) { return stats->deliveries_transit; }
 static int stats_get_deliveries_ingress_route_container(qdr_global_stats_t *stats) { return stats->deliveries_ingress_route_container; }
 static int stats_get_deliveries_egress_route_container(qdr_global_stats_t *stats) { return stats->deliveries_egress_route_container; }
+static int stats_get_overload_level(qdr_global_stats_t *stats) { return stats->overload_level; }
+static int stats_get_credit_withheld(qdr_global_stats_t *stats) { return stats->credit_withheld; }
 
 static struct metric_definition metrics[] = {
     {"connections", "gauge", stats_get_connections},
@@ -439,7 +486,9 @@ static struct metric_definition metrics[] = {
     {"deliveries_egress", "counter", stats_get_deliveries_egress},
     {"deliveries_transit", "counter", stats_get_deliveries_transit},
     {"deliveries_ingress_route_container", "counter", stats_get_deliveries_ingress_route_container},
-    {"deliveries_egress_route_container", "counter", stats_get_deliveries_egress_route_container}
+    {"deliveries_egress_route_container", "counter", stats_get_deliveries_egress_route_container},
+    {"overload_level", "gauge", stats_get_overload_level},
+    {"credit_withheld", "counter", stats_get_credit_withheld}
 };
 static size_t metrics_length = sizeof(metrics)/sizeof(metrics[0]);
 
@@ -461,6 +510,247 @@ static bool write_metric(uint8_t **position, const uint8_t * const end, metric_d
     return write_stats(position, end, definition->name, definition->type, definition->value(stats));
 }
 
+/* The delivery latency histogram follows the int metrics, one line per item:
+ * the type, the buckets, the +Inf bucket, the sum and the count.
+ */
+#define LATENCY_METRIC "delivery_settle_latency_microseconds"
+#define LATENCY_METRIC_LINES (QDR_LATENCY_METRIC_BUCKETS + 4)
+
+static bool write_latency_line(uint8_t **position, const uint8_t * const end, size_t line, qdr_global_stats_t* stats)
+{
+    //name + 40 chars for label and suffix + 20 chars for value
+    size_t length = strlen(LATENCY_METRIC) + 60;
+    if (end - *position < length)
+        return false;
+    char *out = (char*) *position;
+    size_t size = end - *position;
+    if (line == 0)
+        *position += lws_snprintf(out, size, "# TYPE %s histogram\n", LATENCY_METRIC);
+    else if (line <= QDR_LATENCY_METRIC_BUCKETS)
+        *position += lws_snprintf(out, size, "%s_bucket{le=\"%"PRIu64"\"} %"PRIu64"\n", LATENCY_METRIC,
+                                  ((uint64_t) 1 << (line - 1)), stats->delivery_latency_buckets[line - 1]);
+    else if (line == QDR_LATENCY_METRIC_BUCKETS + 1)
+        *position += lws_snprintf(out, size, "%s_bucket{le=\"+Inf\"} %"PRIu64"\n", LATENCY_METRIC, stats->delivery_latency_count);
+    else if (line == QDR_LATENCY_METRIC_BUCKETS + 2)
+        *position += lws_snprintf(out, size, "%s_sum %"PRIu64"\n", LATENCY_METRIC, stats->delivery_latency_usec_sum);
+    else
+        *position += lws_snprintf(out, size, "%s_count %"PRIu64"\n", LATENCY_METRIC, stats->delivery_latency_count);
+    return true;
+}
+
+/* The server thread families follow the latency histogram: for each family a
+ * type line and a line per thread, then the events by type, leaving out the
+ * types a thread has not seen.
+ */
+typedef struct thread_metric_definition {
+    const char* name;
+    const char* type;
+    size_t offset;  /* of the uint64_t in qd_server_thread_stats_t */
+} thread_metric_definition;
+
+static struct thread_metric_definition thread_metrics[] = {
+    {"worker_thread_busy_microseconds", "counter", offsetof(qd_server_thread_stats_t, busy_usec)},
+    {"worker_thread_idle_microseconds", "counter", offsetof(qd_server_thread_stats_t, idle_usec)},
+    {"worker_thread_batch_microseconds_max", "gauge", offsetof(qd_server_thread_stats_t, batch_usec_max)},
+    {"worker_thread_batches", "counter", offsetof(qd_server_thread_stats_t, batches)},
+    {"worker_thread_events", "counter", offsetof(qd_server_thread_stats_t, events)},
+    {"worker_thread_deliveries_in", "counter", offsetof(qd_server_thread_stats_t, deliveries_in)},
+    {"worker_thread_deliveries_out", "counter", offsetof(qd_server_thread_stats_t, deliveries_out)}
+};
+static size_t thread_metrics_length = sizeof(thread_metrics)/sizeof(thread_metrics[0]);
+
+#define THREAD_EVENTS_METRIC "worker_thread_events_by_type"
+
+static size_t thread_metric_lines(const stats_t *stats)
+{
+    return thread_metrics_length * (1 + stats->thread_count) + 1 + stats->thread_count * QD_SERVER_EVENT_TYPES;
+}
+
+static bool write_thread_line(uint8_t **position, const uint8_t * const end, size_t line, const stats_t *stats)
+{
+    //40 chars for name + 60 chars for labels + 20 chars for value
+    size_t length = 120;
+    if (end - *position < length)
+        return false;
+    char *out = (char*) *position;
+    size_t size = end - *position;
+    size_t rows = 1 + stats->thread_count;
+    if (line < thread_metrics_length * rows) {
+        const thread_metric_definition *definition = &thread_metrics[line / rows];
+        size_t row = line % rows;
+        if (row == 0) {
+            *position += lws_snprintf(out, size, "# TYPE %s %s\n", definition->name, definition->type);
+        } else {
+            const qd_server_thread_stats_t *thread = &stats->threads[row - 1];
+            uint64_t value = *(const uint64_t*) ((const char*) thread + definition->offset);
+            *position += lws_snprintf(out, size, "%s{thread=\"%d\"} %"PRIu64"\n", definition->name, thread->index, value);
+        }
+        return true;
+    }
+    line -= thread_metrics_length * rows;
+    if (line == 0) {
+        *position += lws_snprintf(out, size, "# TYPE %s counter\n", THREAD_EVENTS_METRIC);
+        return true;
+    }
+    const qd_server_thread_stats_t *thread = &stats->threads[(line - 1) / QD_SERVER_EVENT_TYPES];
+    int type = (int) ((line - 1) % QD_SERVER_EVENT_TYPES);
+    const char *name = type < QD_SERVER_EVENT_TYPES - 1 ? pn_event_type_name((pn_event_type_t) type) : "OTHER";
+    if (thread->event_types[type] && name)
+        *position += lws_snprintf(out, size, "%s{thread=\"%d\",type=\"%s\"} %"PRIu64"\n", THREAD_EVENTS_METRIC,
+                                  thread->index, name, thread->event_types[type]);
+    return true;
+}
+
+/* Per-entity metric families.  Prometheus requires the samples of a family to
+ * be contiguous, so each family is a separate pass over the listing.
+ */
+typedef struct entity_metric_definition {
+    qdr_entity_metrics_type_t entity;
+    const char* name;
+    const char* type;
+    int counter;    /* index in qdr_entity_metrics_t.counters, -1 for the latency histogram */
+} entity_metric_definition;
+
+static struct entity_metric_definition entity_metrics[] = {
+    {QDR_ENTITY_METRICS_ADDRESS, "address_deliveries_ingress", "counter", 0},
+    {QDR_ENTITY_METRICS_ADDRESS, "address_deliveries_egress", "counter", 1},
+    {QDR_ENTITY_METRICS_ADDRESS, "address_deliveries_transit", "counter", 2},
+    {QDR_ENTITY_METRICS_ADDRESS, "address_deliveries_to_container", "counter", 3},
+    {QDR_ENTITY_METRICS_ADDRESS, "address_deliveries_from_container", "counter", 4},
+    {QDR_ENTITY_METRICS_ADDRESS, "address_" LATENCY_METRIC, "histogram", -1},
+    {QDR_ENTITY_METRICS_LINK, "link_deliveries", "counter", 0},
+    {QDR_ENTITY_METRICS_LINK, "link_undelivered", "gauge", 1},
+    {QDR_ENTITY_METRICS_LINK, "link_unsettled", "gauge", 2},
+    {QDR_ENTITY_METRICS_LINK, "link_presettled_deliveries", "counter", 3},
+    {QDR_ENTITY_METRICS_LINK, "link_dropped_presettled_deliveries", "counter", 4},
+    {QDR_ENTITY_METRICS_LINK, "link_accepted_deliveries", "counter", 5},
+    {QDR_ENTITY_METRICS_LINK, "link_rejected_deliveries", "counter", 6},
+    {QDR_ENTITY_METRICS_LINK, "link_released_deliveries", "counter", 7},
+    {QDR_ENTITY_METRICS_LINK, "link_modified_deliveries", "counter", 8},
+    {QDR_ENTITY_METRICS_LINK, "link_" LATENCY_METRIC, "histogram", -1},
+    {QDR_ENTITY_METRICS_CONNECTION, "connection_links", "gauge", 0},
+    {QDR_ENTITY_METRICS_CONNECTION, "connection_deliveries_sent", "counter", 1},
+    {QDR_ENTITY_METRICS_CONNECTION, "connection_bytes_sent", "counter", 2}
+};
+static size_t entity_metrics_length = sizeof(entity_metrics)/sizeof(entity_metrics[0]);
+
+/* Label value with backslash, double-quote and newline escaped */
+static void escape_label(char *out, size_t size, const char *value)
+{
+    size_t i = 0;
+    for (; value && *value && i + 2 < size; value++) {
+        if (*value == '\\' || *value == '"' || *value == '\n') {
+            out[i++] = '\\';
+            out[i++] = *value == '\n' ? 'n' : *value;
+        } else {
+            out[i++] = *value;
+        }
+    }
+    out[i] = '\0';
+}
+
+static void entity_labels(char *out, size_t size, qdr_entity_metrics_type_t entity, const qdr_entity_metrics_t *row)
+{
+    char name[2 * QDR_ENTITY_METRICS_LABEL];
+    escape_label(name, sizeof(name), row->name);
+    switch (entity) {
+    case QDR_ENTITY_METRICS_ADDRESS:
+        lws_snprintf(out, size, "address=\"%s\"", name);
+        break;
+    case QDR_ENTITY_METRICS_LINK:
+        lws_snprintf(out, size, "link=\"%"PRIu64"\",dir=\"%s\",address=\"%s\"", row->identity, row->kind ? row->kind : "", name);
+        break;
+    case QDR_ENTITY_METRICS_CONNECTION:
+        lws_snprintf(out, size, "connection=\"%"PRIu64"\",host=\"%s\",role=\"%s\"", row->identity, name, row->kind ? row->kind : "");
+        break;
+    }
+}
+
+/* Write the next line of the current family, false if it does not fit */
+static bool write_entity_line(uint8_t **position, const uint8_t * const end, stats_t *stats)
+{
+    entity_metric_definition *definition = &entity_metrics[stats->family];
+    const qdr_entity_metrics_t *row = &stats->batch->rows[stats->row];
+    char labels[3 * QDR_ENTITY_METRICS_LABEL];
+    char line[4 * QDR_ENTITY_METRICS_LABEL];
+    int  length;
+
+    if (!stats->family_started) {
+        length = lws_snprintf(line, sizeof(line), "# TYPE %s %s\n", definition->name, definition->type);
+    } else if (definition->counter >= 0) {
+        entity_labels(labels, sizeof(labels), definition->entity, row);
+        length = lws_snprintf(line, sizeof(line), "%s{%s} %"PRIu64"\n", definition->name, labels, row->counters[definition->counter]);
+    } else if (!row->has_latency) {
+        stats->row++;
+        return true;
+    } else {
+        entity_labels(labels, sizeof(labels), definition->entity, row);
+        if (stats->line < QDR_LATENCY_METRIC_BUCKETS)
+            length = lws_snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%"PRIu64"\"} %"PRIu64"\n", definition->name, labels,
+                                  ((uint64_t) 1 << stats->line), row->latency_buckets[stats->line]);
+        else if (stats->line == QDR_LATENCY_METRIC_BUCKETS)
+            length = lws_snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %"PRIu64"\n", definition->name, labels, row->latency_count);
+        else if (stats->line == QDR_LATENCY_METRIC_BUCKETS + 1)
+            length = lws_snprintf(line, sizeof(line), "%s_sum{%s} %"PRIu64"\n", definition->name, labels, row->latency_usec_sum);
+        else
+            length = lws_snprintf(line, sizeof(line), "%s_count{%s} %"PRIu64"\n", definition->name, labels, row->latency_count);
+    }
+
+    if (end - *position < length)
+        return false;
+    memcpy(*position, line, length);
+    *position += length;
+
+    if (!stats->family_started) {
+        stats->family_started = true;
+    } else if (definition->counter >= 0 || ++stats->line == QDR_LATENCY_METRIC_BUCKETS + 3) {
+        stats->line = 0;
+        stats->row++;
+    }
+    return true;
+}
+
+/* Write the per-entity families, requesting batches from the core as needed.
+ * Returns true when every family is written.
+ */
+static bool write_entity_metrics(uint8_t **position, const uint8_t * const end, stats_t *stats)
+{
+    qd_http_server_t *hs = stats->server;
+
+    while (stats->family < entity_metrics_length) {
+        if (stats->pending)
+            return false;
+        if (!stats->batch) {
+            stats->batch = calloc(1, sizeof(qdr_entity_metrics_batch_t));
+            if (!stats->batch)
+                return true;
+            stats->batch->type = entity_metrics[stats->family].entity;
+        }
+        qdr_entity_metrics_batch_t *batch = stats->batch;
+        if (!stats->batch_ready) {
+            stats->pending = true;
+            qdr_request_entity_metrics(hs->core, batch, handle_entity_results, (void*) stats);
+            return false;
+        }
+        while (stats->row < batch->count) {
+            if (!write_entity_line(position, end, stats))
+                return false;
+        }
+        stats->row = 0;
+        stats->batch_ready = false;
+        if (!batch->more) {
+            // Next family, from the start of its listing
+            stats->family++;
+            stats->family_started = false;
+            if (stats->family < entity_metrics_length) {
+                batch->type  = entity_metrics[stats->family].entity;
+                batch->total = 0;
+            }
+        }
+    }
+    return true;
+}
+
 static int add_header_by_name(struct lws *wsi, const char* name, const char* value, uint8_t** position, uint8_t* end)
 {
     return lws_add_http_header_by_name(wsi, (unsigned char*) name, (unsigned char*) value, strlen(value), position, end);
@@ -479,6 +769,10 @@ static int callback_metrics(struct lws *wsi, enum lws_callback_reasons reason,
     case LWS_CALLBACK_HTTP: {
         stats->wsi = wsi;
         stats->server = hs;
+        stats->thread = current_thread;
+        int max = qd_server_dispatch(hs->server)->thread_count + 1;
+        stats->threads = (qd_server_thread_stats_t*) calloc(max, sizeof(qd_server_thread_stats_t));
+        stats->thread_count = stats->threads ? qd_server_thread_stats(hs->server, stats->threads, max) : 0;
         //request stats from core thread
         qdr_request_global_stats(hs->core, &stats->stats, handle_stats_results, (void*) stats);
         return 0;
@@ -505,20 +799,58 @@ static int callback_metrics(struct lws *wsi, enum lws_callback_reasons reason,
                 break;
             }
         }
-        int n = stats->current < metrics_length ? LWS_WRITE_HTTP : LWS_WRITE_HTTP_FINAL;
+        while (stats->current >= metrics_length && stats->current < metrics_length + LATENCY_METRIC_LINES) {
+            if (write_latency_line(&position, end, stats->current - metrics_length, &stats->stats)) {
+                stats->current++;
+            } else {
+                qd_log(hs->log, QD_LOG_DEBUG, "insufficient space in buffer");
+                break;
+            }
+        }
+        size_t threads_start = metrics_length + LATENCY_METRIC_LINES;
+        size_t threads_end   = threads_start + thread_metric_lines(stats);
+        while (stats->current >= threads_start && stats->current < threads_end) {
+            if (write_thread_line(&position, end, stats->current - threads_start, stats)) {
+                stats->current++;
+            } else {
+                qd_log(hs->log, QD_LOG_DEBUG, "insufficient space in buffer");
+                break;
+            }
+        }
+        bool done = false;
+        if (stats->current >= threads_end)
+            done = write_entity_metrics(&position, end, stats);
+        int n = done ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP;
 
         //write buffer
         size_t available = position - start;
-	if (lws_write(wsi, (unsigned char*) start, available, n) != available)
+        if ((available || done) && lws_write(wsi, (unsigned char*) start, available, n) != available)
             return 1;
-        if (n == LWS_WRITE_HTTP_FINAL) {
+        if (done) {
+            free(stats->batch);
+            stats->batch = 0;
+            free(stats->threads);
+            stats->threads = 0;
             if (lws_http_transaction_completed(wsi)) return -1;
-        } else {
+        } else if (!stats->pending) {
+            //otherwise the core thread's reply asks for the next callback
             lws_callback_on_writable(wsi);
         }
         return 0;
     }
 
+    case LWS_CALLBACK_CLOSED_HTTP: {
+        //a batch still being filled by the core thread is left to it
+        if (stats->batch && !stats->pending) {
+            qdr_query_free(stats->batch->cursor);
+            free(stats->batch);
+            stats->batch = 0;
+        }
+        free(stats->threads);
+        stats->threads = 0;
+        return 0;
+    }
+
     default:
         return 0;
     }
@@ -537,12 +869,18 @@ static int callback_amqpws(struct lws *wsi, enum lws_callback_reasons reason,
         /* Upgrade accepted HTTP connection to AMQPWS */
         memset(c, 0, sizeof(*c));
         c->wsi = wsi;
+        c->thread = current_thread;
+        DEQ_ITEM_INIT(c);
+        if (c->thread) {
+            DEQ_INSERT_TAIL(c->thread->connections, c);
+        }
         qd_http_listener_t *hl = wsi_listener(wsi);
         if (hl == NULL) {
             return unexpected_close(c->wsi, "cannot-upgrade");
         }
         c->qd_conn = qd_server_connection(hs->server, &hl->listener->config);
-        if (c->qd_conn == NULL) {
+        buffer_set_size(&c->wbuf, LWS_PRE + WS_FRAME_MAX);
+        if (c->qd_conn == NULL || c->wbuf.start == NULL) {
             return unexpected_close(c->wsi, "out-of-memory");
         }
         c->qd_conn->context = c;
@@ -562,18 +900,25 @@ static int callback_amqpws(struct lws *wsi, enum lws_callback_reasons reason,
 
     case LWS_CALLBACK_SERVER_WRITEABLE: {
         if (handle_events(c)) return -1;
+        if (lws_partial_buffered(wsi)) {
+            /* LWS still holds the tail of the last write, adding more would
+             * only copy it again into LWS's buffer.
+             */
+            lws_callback_on_writable(wsi);
+            return 0;
+        }
         pn_bytes_t dbuf = pn_connection_driver_write_buffer(&c->driver);
         if (dbuf.size) {
-            /* lws_write() demands LWS_PRE bytes of free space before the data,
-             * so we must copy from the driver's buffer to larger temporary wbuf
+            /* lws_write() demands LWS_PRE bytes of free space before the data
+             * and proton's buffer has none, so the bytes are copied once into
+             * wbuf.  Writing at most WS_FRAME_MAX per callback keeps each write
+             * small enough for the socket to take whole; handle_events() asks
+             * for another callback if more is pending.
              */
-            buffer_set_size(&c->wbuf, LWS_PRE + dbuf.size);
-            if (c->wbuf.start == NULL) {
-                return unexpected_close(c->wsi, "out-of-memory");
-            }
+            size_t size = dbuf.size < WS_FRAME_MAX ? dbuf.size : WS_FRAME_MAX;
             unsigned char* buf = (unsigned char*)c->wbuf.start + LWS_PRE;
-            memcpy(buf, dbuf.start, dbuf.size);
-            ssize_t wrote = lws_write(wsi, buf, dbuf.size, LWS_WRITE_BINARY);
+            memcpy(buf, dbuf.start, size);
+            ssize_t wrote = lws_write(wsi, buf, size, LWS_WRITE_BINARY);
             if (wrote < 0) {
                 pn_connection_driver_write_close(&c->driver);
                 return unexpected_close(c->wsi, "write-error");
@@ -600,20 +945,16 @@ static int callback_amqpws(struct lws *wsi, enum lws_callback_reasons reason,
         return handle_events(c);
     }
 
-    case LWS_CALLBACK_USER: {
-        pn_timestamp_t next_tick = pn_transport_tick(c->driver.transport, hs->now);
-        if (next_tick && next_tick > hs->now && next_tick < hs->next_tick) {
-            hs->next_tick = next_tick;
-        }
-        return handle_events(c);
-    }
-
     case LWS_CALLBACK_WS_PEER_INITIATED_CLOSE: {
         pn_connection_driver_read_close(&c->driver);
         return handle_events(c);
     }
 
     case LWS_CALLBACK_CLOSED: {
+        if (c->thread) {
+            DEQ_REMOVE(c->thread->connections, c);
+            c->thread = 0;
+        }
         if (c->driver.transport) {
             pn_connection_driver_close(&c->driver);
             handle_events(c);
@@ -630,21 +971,47 @@ static int callback_amqpws(struct lws *wsi, enum lws_callback_reasons reason,
 
 #define DEFAULT_TICK 1000
 
+/* Run transport ticks for the connections of this thread, may decrease
+ * st->next_tick.
+ */
+static void connections_tick(service_thread_t *st) {
+    connection_t *c = DEQ_HEAD(st->connections);
+    while (c) {
+        connection_t *next = DEQ_NEXT(c);
+        if (c->driver.transport) {
+            pn_timestamp_t next_tick = pn_transport_tick(c->driver.transport, st->now);
+            if (next_tick && next_tick > st->now && next_tick < st->next_tick) {
+                st->next_tick = next_tick;
+            }
+            if (handle_events(c)) {
+                /* Not in a callback for this wsi, let LWS close it */
+                lws_set_timeout(c->wsi, PENDING_TIMEOUT_CLOSE_SEND, LWS_TO_KILL_ASYNC);
+            }
+        }
+        c = next;
+    }
+}
+
 static void* http_thread_run(void* v) {
-    qd_http_server_t *hs = v;
-    qd_log(hs->log, QD_LOG_INFO, "HTTP server thread running");
+    service_thread_t *st = v;
+    qd_http_server_t *hs = st->server;
+    current_thread = st;
+    qd_log(hs->log, QD_LOG_INFO, "HTTP server thread %d running", st->tsi);
     int result = 0;
     while(result >= 0) {
-        /* Send a USER event to run transport ticks, may decrease hs->next_tick. */
-        hs->now = qd_timer_now();
-        hs->next_tick = hs->now + DEFAULT_TICK;
-        lws_callback_all_protocol(hs->context, &protocols[1], LWS_CALLBACK_USER);
-        lws_callback_all_protocol(hs->context, &protocols[2], LWS_CALLBACK_USER);
-        pn_millis_t timeout = (hs->next_tick > hs->now) ? hs->next_tick - hs->now : 1;
-        result = lws_service(hs->context, timeout);
-
-        /* Process any work items on the queue */
-        for (work_t w = work_pop(hs); w.type != W_NONE; w = work_pop(hs)) {
+        st->now = qd_timer_now();
+        st->next_tick = st->now + DEFAULT_TICK;
+        connections_tick(st);
+        pn_millis_t timeout = (st->next_tick > st->now) ? st->next_tick - st->now : 1;
+        result = lws_service_tsi(hs->context, timeout, st->tsi);
+
+        /* Process the work pushed since the last pass */
+        qd_http_work_t *item = work_take(st);
+        while (item) {
+            qd_http_work_t *next = item->next;
+            work_t w = item->work;
+            free_qd_http_work_t(item);
+            item = next;
             switch (w.type) {
             case W_NONE:
                 break;
@@ -664,33 +1031,52 @@ static void* http_thread_run(void* v) {
                 connection_t *c = w.value;
                 pn_collector_put(c->driver.collector, PN_OBJECT, c->driver.connection,
                                  PN_CONNECTION_WAKE);
-                handle_events(c);
+                if (handle_events(c)) {
+                    lws_set_timeout(c->wsi, PENDING_TIMEOUT_CLOSE_SEND, LWS_TO_KILL_ASYNC);
+                }
                 break;
             }
             }
         }
     }
-    qd_log(hs->log, QD_LOG_INFO, "HTTP server thread exit");
+    current_thread = 0;
+    qd_log(hs->log, QD_LOG_INFO, "HTTP server thread %d exit", st->tsi);
     return NULL;
 }
 
 void qd_http_server_stop(qd_http_server_t *hs) {
     if (!hs) return;
-    if (hs->thread) {
-        /* Thread safe, stop via work queue then clean up */
-        work_t work = { W_STOP, NULL };
-        work_push(hs, work);
-        sys_thread_join(hs->thread);
-        sys_thread_free(hs->thread);
-        hs->thread = NULL;
+    /* Thread safe, stop via work queues then clean up */
+    for (int i = 0; i < hs->thread_count; ++i) {
+        if (hs->threads[i].thread) {
+            work_t work = { W_STOP, NULL };
+            work_push(&hs->threads[i], work, NULL);
+        }
+    }
+    for (int i = 0; i < hs->thread_count; ++i) {
+        service_thread_t *st = &hs->threads[i];
+        if (st->thread) {
+            sys_thread_join(st->thread);
+            sys_thread_free(st->thread);
+            st->thread = NULL;
+        }
     }
 }
 
 void qd_http_server_free(qd_http_server_t *hs) {
     if (!hs) return;
     qd_http_server_stop(hs);
-    work_queue_destroy(&hs->work);
+    for (int i = 0; i < hs->thread_count; ++i) {
+        qd_http_work_t *item = work_take(&hs->threads[i]);
+        while (item) {
+            qd_http_work_t *next = item->next;
+            free_qd_http_work_t(item);
+            item = next;
+        }
+        sys_atomic_ptr_destroy(&hs->threads[i].work);
+    }
     if (hs->context) lws_context_destroy(hs->context);
+    if (hs->lock) sys_mutex_free(hs->lock);
     free(hs);
 }
 
@@ -698,7 +1084,11 @@ qd_http_server_t *qd_http_server(qd_server_t *s, qd_log_source_t *log) {
     log_init();
     qd_http_server_t *hs = calloc(1, sizeof(*hs));
     if (hs) {
-        work_queue_init(&hs->work);
+        hs->lock = sys_mutex();
+        int threads = qd_server_dispatch(s)->http_threads;
+        if (threads < 1) threads = 1;
+        if (threads > HTTP_MAX_THREADS) threads = HTTP_MAX_THREADS;
+
         struct lws_context_creation_info info = {0};
         info.gid = info.uid = -1;
         info.user = hs;
@@ -708,6 +1098,7 @@ qd_http_server_t *qd_http_server(qd_server_t *s, qd_log_source_t *log) {
             LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
         info.max_http_header_pool = 32;
         info.timeout_secs = 1;
+        info.count_threads = threads;
 
         hs->context = lws_create_context(&info);
         hs->server = s;
@@ -716,7 +1107,17 @@ qd_http_server_t *qd_http_server(qd_server_t *s, qd_log_source_t *log) {
         if (!hs->context) {
             qd_log(hs->log, QD_LOG_CRITICAL, "No memory starting HTTP server");
             qd_http_server_free(hs);
-            hs = NULL;
+            return NULL;
+        }
+        /* LWS may allow fewer threads than asked for */
+        hs->thread_count = lws_get_count_threads(hs->context);
+        if (hs->thread_count > HTTP_MAX_THREADS) hs->thread_count = HTTP_MAX_THREADS;
+        for (int i = 0; i < hs->thread_count; ++i) {
+            service_thread_t *st = &hs->threads[i];
+            st->server = hs;
+            st->tsi = i;
+            sys_atomic_ptr_init(&st->work, 0);
+            DEQ_INIT(st->connections);
         }
     }
     return hs;
@@ -727,18 +1128,22 @@ qd_http_server_t *qd_http_server(qd_server_t *s, qd_log_source_t *log) {
 qd_http_listener_t *qd_http_server_listen(qd_http_server_t *hs, qd_listener_t *li)
 {
     hs->core = qd_dispatch_router_core(qd_server_dispatch(hs->server));
-    sys_mutex_lock(hs->work.lock);
-    if (!hs->thread) {
-        hs->thread = sys_thread(http_thread_run, hs);
+    sys_mutex_lock(hs->lock);
+    if (!hs->started) {
+        hs->started = true;
+        for (int i = 0; i < hs->thread_count; ++i) {
+            hs->threads[i].thread = sys_thread(http_thread_run, &hs->threads[i]);
+        }
     }
-    bool ok = hs->thread;
-    sys_mutex_unlock(hs->work.lock);
+    bool ok = hs->thread_count > 0 && hs->threads[0].thread;
+    sys_mutex_unlock(hs->lock);
     if (!ok) return NULL;
 
+    /* Vhosts are created and destroyed on thread 0 */
     qd_http_listener_t *hl = qd_http_listener(hs, li);
     if (hl) {
         work_t w = { W_LISTEN, hl };
-        work_push(hs, w);
+        work_push(&hs->threads[0], w, NULL);
     }
     return hl;
 }
@@ -746,7 +1151,7 @@ qd_http_listener_t *qd_http_server_listen(qd_http_server_t *hs, qd_listener_t *l
 void qd_http_listener_close(qd_http_listener_t *hl)
 {
     work_t w = { W_CLOSE, hl };
-    work_push(hl->server, w);
+    work_push(&hl->server->threads[0], w, NULL);
 }
 
 static qd_http_server_t *wsi_server(struct lws *wsi) {
@@ -20,23 +20,43 @@
 #include "immediate_private.h"
 #include "server_private.h"
 
+#include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/threading.h>
 #include <assert.h>
 
+/* Most handlers run by one visit, so that a burst does not hold up the thread's other events */
+#define QD_IMMEDIATE_BUDGET 64
+
 struct qd_immediate_t {
+    DEQ_LINKS(qd_immediate_t);   /* In run_queue while armed */
     qd_server_t *server;
     void (*handler)(void* context);
     void *context;
     bool armed;
 };
 
+DEQ_DECLARE(qd_immediate_t, qd_immediate_list_t);
+
 /* Array rather than list for fast access and cache-coherence */
 static qd_immediate_t immediates[256] = {{0}};
 static size_t count = 0;
 static sys_mutex_t *lock = NULL;
 
+/*
+ * Armed immediates wait on run_queue in the order they were armed.  One server
+ * interrupt is enough for the whole queue: interrupt_pending is set from the
+ * interrupt until a visit leaves the queue empty, and arms in between add to the
+ * queue without interrupting again.
+ */
+static qd_immediate_list_t run_queue;
+static qd_server_t *interrupt_server = NULL;
+static bool interrupt_pending = false;
+
 void qd_immediate_initialize(void) {
     lock = sys_mutex();
+    DEQ_INIT(run_queue);
+    interrupt_server = NULL;
+    interrupt_pending = false;
 }
 
 void qd_immediate_finalize(void) {
@@ -47,14 +67,18 @@ void qd_immediate_finalize(void) {
 qd_immediate_t *qd_immediate(qd_dispatch_t *qd, void (*handler)(void*), void* context) {
     sys_mutex_lock(lock);
     if (count >= sizeof(immediates)/sizeof(immediates[0])) {
+        sys_mutex_unlock(lock);
         assert("exceeded max number of qd_immediate_t objects" == 0);
         return 0;
     }
     qd_immediate_t *i = &immediates[count++];
+    DEQ_ITEM_INIT(i);
     i->server = qd ? qd->server : NULL;
     i->handler = handler;
     i->context = context;
     i->armed = false;
+    if (i->server)
+        interrupt_server = i->server;
     sys_mutex_unlock(lock);
     return i;
 }
@@ -63,17 +87,24 @@ void qd_immediate_arm(qd_immediate_t *i) {
     bool interrupt = false;
     sys_mutex_lock(lock);
     if (!i->armed) {
-        interrupt = i->armed = true;
+        i->armed = true;
+        DEQ_INSERT_TAIL(run_queue, i);
+        if (i->server && !interrupt_pending) {
+            interrupt = interrupt_pending = true;
+        }
     }
     sys_mutex_unlock(lock);
-    if (interrupt && i->server) {
+    if (interrupt) {
         qd_server_interrupt(i->server);
     }
 }
 
 void qd_immediate_disarm(qd_immediate_t *i) {
     sys_mutex_lock(lock);
-    i->armed = false;
+    if (i->armed) {
+        DEQ_REMOVE(run_queue, i);
+        i->armed = false;
+    }
     sys_mutex_unlock(lock);
 }
 
@@ -84,13 +115,28 @@ void qd_immediate_free(qd_immediate_t *i) {
 
 void qd_immediate_visit() {
     sys_mutex_lock(lock);
-    for (qd_immediate_t *i = immediates; i < immediates + count; ++i) {
-        if (i->armed) {
-            i->armed = false;
-            sys_mutex_unlock(lock);
-            i->handler(i->context);
-            sys_mutex_lock(lock);
-        }
+    /* Those armed by the handlers wait for the next visit */
+    size_t budget = DEQ_SIZE(run_queue);
+    if (budget > QD_IMMEDIATE_BUDGET)
+        budget = QD_IMMEDIATE_BUDGET;
+    qd_immediate_t *i = DEQ_HEAD(run_queue);
+    while (i && budget-- > 0) {
+        DEQ_REMOVE_HEAD(run_queue);
+        i->armed = false;
+        sys_mutex_unlock(lock);
+        i->handler(i->context);
+        sys_mutex_lock(lock);
+        i = DEQ_HEAD(run_queue);
     }
+
+    /* What the budget left over needs another wakeup */
+    bool interrupt = false;
+    if (DEQ_IS_EMPTY(run_queue))
+        interrupt_pending = false;
+    else if (interrupt_server)
+        interrupt = interrupt_pending = true;
     sys_mutex_unlock(lock);
+    if (interrupt) {
+        qd_server_interrupt(interrupt_server);
+    }
 }
@@ -21,51 +21,14 @@
 #include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/alloc.h>
 #include "message_private.h"
+#include "iterator_private.h"
 #include <stdio.h>
 #include <string.h>
 
 
-typedef enum {
-    MODE_TO_END,
-    MODE_TO_SLASH
-} parse_mode_t;
-
-typedef enum {
-    STATE_AT_PREFIX,
-    STATE_AT_PHASE,
-    STATE_IN_SPACE,
-    STATE_IN_BODY
-} view_state_t;
-
-typedef struct qd_hash_segment_t {
-    DEQ_LINKS(struct qd_hash_segment_t);
-    uint32_t hash;           //The hash of the segment
-    uint32_t segment_length; //The length of the segment
-} qd_hash_segment_t;
-
-DEQ_DECLARE(qd_hash_segment_t, qd_hash_segment_list_t);
 ALLOC_DECLARE(qd_hash_segment_t);
 ALLOC_DEFINE(qd_hash_segment_t);
 
-struct qd_iterator_t {
-    qd_iterator_pointer_t   start_pointer;      // Pointer to the raw data
-    qd_iterator_pointer_t   view_start_pointer; // Pointer to the start of the view
-    qd_iterator_pointer_t   view_pointer;       // Pointer to the remaining view
-    qd_iterator_view_t      view;
-    int                     annotation_length;
-    int                     annotation_remaining;
-    qd_hash_segment_list_t  hash_segments;
-    parse_mode_t            mode;
-    view_state_t            state;
-    unsigned char           prefix;
-    unsigned char           prefix_override;
-    unsigned char           phase;
-    const char             *space;
-    int                     space_length;
-    int                     space_cursor;
-    bool                    view_space;
-};
-
 ALLOC_DECLARE(qd_iterator_t);
 ALLOC_DEFINE(qd_iterator_t);
 
@@ -85,7 +48,117 @@ static char *my_area   = "";
 static char *my_router = "";
 
 static const char    *SEPARATORS = "./";
-static const uint32_t HASH_INIT  = 5381;
+
+//
+// View hashing consumes the octets as little-endian 64-bit stripes using the
+// xxHash64 round and avalanche functions.  The state can be sampled after any
+// octet, which is what allows qd_iterator_hash_view_segments to produce the
+// hash of every segment prefix in a single pass.
+//
+static const uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+static const uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+typedef struct {
+    uint64_t state;    // Accumulated full stripes
+    uint64_t stripe;   // Octets of the partial stripe
+    uint32_t pending;  // Number of octets in the partial stripe
+    uint32_t length;   // Total octets hashed
+} view_hash_t;
+
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t stripe)
+{
+    acc += stripe * HASH_PRIME_2;
+    acc  = (acc << 31) | (acc >> 33);
+    return acc * HASH_PRIME_1;
+}
+
+
+static inline void hash_init(view_hash_t *vh)
+{
+    vh->state   = HASH_PRIME_5;
+    vh->stripe  = 0;
+    vh->pending = 0;
+    vh->length  = 0;
+}
+
+
+static inline void hash_octet(view_hash_t *vh, unsigned char octet)
+{
+    vh->stripe |= ((uint64_t) octet) << (vh->pending * 8);
+    vh->length++;
+    if (++vh->pending == 8) {
+        vh->state   = hash_round(vh->state, vh->stripe);
+        vh->stripe  = 0;
+        vh->pending = 0;
+    }
+}
+
+
+static inline void hash_run(view_hash_t *vh, const unsigned char *run, uint32_t length)
+{
+    while (length && vh->pending) {
+        hash_octet(vh, *run++);
+        length--;
+    }
+
+    while (length >= 8) {
+        uint64_t stripe = (uint64_t) run[0]         | ((uint64_t) run[1] << 8)
+                       | ((uint64_t) run[2] << 16) | ((uint64_t) run[3] << 24)
+                       | ((uint64_t) run[4] << 32) | ((uint64_t) run[5] << 40)
+                       | ((uint64_t) run[6] << 48) | ((uint64_t) run[7] << 56);
+        vh->state   = hash_round(vh->state, stripe);
+        vh->length += 8;
+        run        += 8;
+        length     -= 8;
+    }
+
+    while (length--)
+        hash_octet(vh, *run++);
+}
+
+
+static inline uint32_t hash_value(const view_hash_t *vh)
+{
+    uint64_t h = vh->state;
+    if (vh->pending)
+        h = hash_round(h, vh->stripe);
+    h ^= vh->length;
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return (uint32_t) h;
+}
+
+
+//
+// The hash state after the annotations that come before the address in a view
+// annotated with a tenant space: the space alone for ITER_VIEW_ADDRESS_WITH_SPACE,
+// and the mobile prefix, the phase and the space for ITER_VIEW_ADDRESS_HASH.
+//
+#define QD_ITER_SPACE_PHASES 10
+
+struct qd_iterator_space_t {
+    const char  *space;
+    int          length;
+    view_hash_t  with_space;
+    view_hash_t  mobile[QD_ITER_SPACE_PHASES];  // By phase, '0' to '9'
+};
+
+
+//
+// Forget the memoized view hash and, unless only the view's annotations
+// changed, note that qd_iterator_reset_view must re-parse the view.
+//
+static inline void view_modified(qd_iterator_t *iter)
+{
+    iter->view_pristine = false;
+    iter->hash_valid    = false;
+}
 
 
 static void set_to_edge_connection(qd_iterator_t *iter)
@@ -100,6 +173,131 @@ static void set_to_edge_connection(qd_iterator_t *iter)
 }
 
 
+//
+// The classes of router-scoped address, each named by the prefix that follows
+// the leading '_'.  qd_iterator_set_address builds the table once with this
+// router's area and ID spelled out, grouped by the first octet of the prefix
+// and ordered so that the first entry of a group that matches is the right one.
+// An address that starts with '_' but matches none of them is mobile.
+//
+typedef struct {
+    char     *text;      ///< The prefix, after the leading '_'
+    uint32_t  length;
+    char      prefix;    ///< Hash prefix of the view, or 0 to view the edge connection
+    bool      to_slash;  ///< The view ends at the following slash
+} address_class_t;
+
+#define ADDRESS_CLASSES 10
+
+static address_class_t address_classes[ADDRESS_CLASSES];
+static int             address_class_count = 0;
+static char           *address_class_text  = 0;
+
+static struct {
+    uint8_t first;
+    uint8_t count;
+} address_class_dispatch[256];
+
+
+static void add_address_class(char **text, const char *s1, const char *s2, const char *s3, char prefix, bool to_slash)
+{
+    address_class_t *cls = &address_classes[address_class_count];
+    cls->text     = *text;
+    cls->length   = (uint32_t) sprintf(*text, "%s%s%s", s1, s2, s3);
+    cls->prefix   = prefix;
+    cls->to_slash = to_slash;
+    *text += cls->length + 1;
+
+    unsigned char octet = (unsigned char) cls->text[0];
+    if (address_class_dispatch[octet].count++ == 0)
+        address_class_dispatch[octet].first = (uint8_t) address_class_count;
+    address_class_count++;
+}
+
+
+static void build_address_classes(void)
+{
+    // An edge router sends anything not addressed to itself to its interior router
+    char beyond_area   = edge_mode ? 0 : QD_ITER_HASH_PREFIX_AREA;
+    char beyond_router = edge_mode ? 0 : QD_ITER_HASH_PREFIX_ROUTER;
+    char beyond_edge   = edge_mode ? 0 : QD_ITER_HASH_PREFIX_EDGE_SUMMARY;
+
+    free(address_class_text);
+    address_class_text  = (char*) malloc(128 + 3 * (strlen(my_area) + strlen(my_router)));
+    address_class_count = 0;
+    ZERO(&address_class_dispatch);
+
+    char *text = address_class_text;
+    add_address_class(&text, "local/",    "",      "",        QD_ITER_HASH_PREFIX_LOCAL,       false);
+    add_address_class(&text, "topo/all/", "all/",  "",        QD_ITER_HASH_PREFIX_TOPOLOGICAL, false);
+    add_address_class(&text, "topo/all/", my_router, "",      QD_ITER_HASH_PREFIX_LOCAL,       false);
+    add_address_class(&text, "topo/all/", "",      "",        beyond_router,                   true);
+    add_address_class(&text, "topo/",     my_area, "all/",    QD_ITER_HASH_PREFIX_TOPOLOGICAL, false);
+    add_address_class(&text, "topo/",     my_area, my_router, QD_ITER_HASH_PREFIX_LOCAL,       false);
+    add_address_class(&text, "topo/",     my_area, "",        beyond_router,                   true);
+    add_address_class(&text, "topo/",     "",      "",        beyond_area,                     true);
+    add_address_class(&text, "edge/",     my_router, "",      QD_ITER_HASH_PREFIX_LOCAL,       false);
+    add_address_class(&text, "edge/",     "",      "",        beyond_edge,                     true);
+    assert(address_class_count == ADDRESS_CLASSES);
+}
+
+
+//
+// Return the octet at the pointer, or -1 if there are no more.
+//
+static int pointer_octet(const qd_iterator_pointer_t *ptr)
+{
+    if (ptr->remaining == 0)
+        return -1;
+    if (ptr->buffer && ptr->cursor == qd_buffer_cursor(ptr->buffer))
+        return ptr->buffer->next ? *qd_buffer_base(ptr->buffer->next) : -1;
+    return *ptr->cursor;
+}
+
+
+//
+// If the octets at the pointer start with text, advance the pointer past them.
+// The comparison takes a run of contiguous octets at a time.
+//
+static bool pointer_skip(qd_iterator_pointer_t *ptr, const char *text, uint32_t length)
+{
+    if (ptr->remaining < length)
+        return false;
+
+    qd_iterator_pointer_t lptr = *ptr;
+    while (length) {
+        if (lptr.buffer && lptr.cursor == qd_buffer_cursor(lptr.buffer)) {
+            if (!lptr.buffer->next)
+                return false;
+            lptr.buffer = lptr.buffer->next;
+            lptr.cursor = qd_buffer_base(lptr.buffer);
+        }
+
+        uint32_t run = lptr.buffer ? qd_buffer_cursor(lptr.buffer) - lptr.cursor : lptr.remaining;
+        if (run > length)
+            run = length;
+        if (memcmp(lptr.cursor, text, run) != 0)
+            return false;
+        lptr.cursor    += run;
+        lptr.remaining -= run;
+        text           += run;
+        length         -= run;
+
+    }
+
+    // Like field_iterator_move_cursor, leave the cursor at the start of the next buffer
+    if (lptr.buffer && lptr.cursor == qd_buffer_cursor(lptr.buffer)) {
+        lptr.buffer = lptr.buffer->next;
+        lptr.cursor = lptr.buffer ? qd_buffer_base(lptr.buffer) : 0;
+        if (!lptr.buffer)
+            lptr.remaining = 0;
+    }
+
+    *ptr = lptr;
+    return true;
+}
+
+
 static void parse_address_view(qd_iterator_t *iter)
 {
     //
@@ -108,72 +306,43 @@ static void parse_address_view(qd_iterator_t *iter)
     // in order to aid the router in looking up addresses.
     //
 
-    qd_iterator_pointer_t save_pointer = iter->view_pointer;
+    qd_iterator_pointer_t ptr = iter->view_pointer;
     iter->annotation_length = 1;
 
-    if (iter->prefix_override == '\0' && qd_iterator_prefix(iter, "_")) {
+    if (iter->prefix_override == '\0' && pointer_skip(&ptr, "_", 1)) {
         if (iter->view == ITER_VIEW_ADDRESS_WITH_SPACE) {
-            iter->view_pointer      = save_pointer;
             iter->view_space        = false;
             iter->annotation_length = 0;
             return;
         }
 
-        if (qd_iterator_prefix(iter, "local/")) {
-            iter->prefix = QD_ITER_HASH_PREFIX_LOCAL;
-            iter->state  = STATE_AT_PREFIX;
-            return;
-        }
-
-        if (qd_iterator_prefix(iter, "topo/")) {
-            if (qd_iterator_prefix(iter, "all/") || qd_iterator_prefix(iter, my_area)) {
-                if (qd_iterator_prefix(iter, "all/")) {
-                    iter->prefix = QD_ITER_HASH_PREFIX_TOPOLOGICAL;
-                    iter->state  = STATE_AT_PREFIX;
+        if (address_class_count == 0)
+            build_address_classes();
+
+        int octet = pointer_octet(&ptr);
+        if (octet >= 0) {
+            int first = address_class_dispatch[octet].first;
+            int last  = first + address_class_dispatch[octet].count;
+            for (int i = first; i < last; i++) {
+                const address_class_t *cls  = &address_classes[i];
+                qd_iterator_pointer_t  rest = ptr;
+                if (pointer_skip(&rest, cls->text, cls->length)) {
+                    iter->view_pointer = rest;
+                    if (cls->prefix == 0)
+                        set_to_edge_connection(iter);
+                    else {
+                        iter->prefix = cls->prefix;
+                        iter->state  = STATE_AT_PREFIX;
+                        if (cls->to_slash)
+                            iter->mode = MODE_TO_SLASH;
+                    }
                     return;
-                } else if (qd_iterator_prefix(iter, my_router)) {
-                    iter->prefix = QD_ITER_HASH_PREFIX_LOCAL;
-                    iter->state  = STATE_AT_PREFIX;
-                    return;
-                }
-
-                if (edge_mode)
-                    set_to_edge_connection(iter);
-                else {
-                    iter->prefix = QD_ITER_HASH_PREFIX_ROUTER;
-                    iter->state  = STATE_AT_PREFIX;
-                    iter->mode   = MODE_TO_SLASH;
                 }
-                return;
             }
-
-            if (edge_mode)
-                set_to_edge_connection(iter);
-            else {
-                iter->prefix = QD_ITER_HASH_PREFIX_AREA;
-                iter->state  = STATE_AT_PREFIX;
-                iter->mode   = MODE_TO_SLASH;
-            }
-            return;
         }
 
-        if (qd_iterator_prefix(iter, "edge/")) {
-            if (qd_iterator_prefix(iter, my_router)) {
-                iter->prefix = QD_ITER_HASH_PREFIX_LOCAL;
-                iter->state  = STATE_AT_PREFIX;
-                return;
-            }
-
-            if (edge_mode) {
-                set_to_edge_connection(iter);
-                return;
-            } else {
-                iter->prefix = QD_ITER_HASH_PREFIX_EDGE_SUMMARY;
-                iter->state  = STATE_AT_PREFIX;
-                iter->mode   = MODE_TO_SLASH;
-                return;
-            }
-        }
+        // A mobile address that starts with '_' is hashed without it
+        iter->view_pointer = ptr;
     }
 
     iter->prefix            = iter->prefix_override ? iter->prefix_override : QD_ITER_HASH_PREFIX_MOBILE;
@@ -223,6 +392,8 @@ static void parse_node_view(qd_iterator_t *iter)
 
 void qd_iterator_remove_trailing_separator(qd_iterator_t *iter)
 {
+    view_modified(iter);
+
     // Save the iterator's pointer so we can apply it back before returning from this function.
     qd_iterator_pointer_t save_pointer = iter->view_pointer;
 
@@ -376,8 +547,42 @@ static inline void field_iterator_move_cursor(qd_iterator_t *iter, uint32_t leng
 }
 
 
+//
+// The contiguous octets at the cursor.  Unlike qd_iterator_contiguous this
+// includes the rest of the tenant space while the cursor is in it.
+//
+static inline uint32_t view_run(const qd_iterator_t *iter, const unsigned char **run)
+{
+    if (iter->state == STATE_IN_SPACE) {
+        uint32_t length = iter->space_length - iter->space_cursor;
+        if (length > (uint32_t) iter->annotation_remaining)
+            length = iter->annotation_remaining;
+        *run = (const unsigned char*) iter->space + iter->space_cursor;
+        return length;
+    }
+    return qd_iterator_contiguous(iter, run);
+}
+
+
+//
+// Move the cursor over octets that view_run returned.
+//
+static inline void view_advance(qd_iterator_t *iter, uint32_t length)
+{
+    if (iter->state == STATE_IN_SPACE) {
+        iter->space_cursor         += length;
+        iter->annotation_remaining -= length;
+        if (iter->space_cursor == iter->space_length)
+            iter->state = STATE_IN_BODY;
+        return;
+    }
+    field_iterator_move_cursor(iter, length);
+}
+
+
 static void qd_iterator_free_hash_segments(qd_iterator_t *iter)
 {
+    iter->inline_segment_count = 0;
     qd_hash_segment_t *seg = DEQ_HEAD(iter->hash_segments);
     while (seg) {
         DEQ_REMOVE_HEAD(iter->hash_segments);
@@ -402,57 +607,85 @@ void qd_iterator_set_address(bool _edge_mode, const char *area, const char *rout
     edge_mode = _edge_mode;
     my_area   = ptr;
     my_router = ptr + area_size + 2;
+    build_address_classes();
 }
 
 
-qd_iterator_t* qd_iterator_string(const char *text, qd_iterator_view_t view)
+void qd_iterator_init_string(qd_iterator_t *iter, const char *text, qd_iterator_view_t view)
 {
-    qd_iterator_t *iter = new_qd_iterator_t();
-    if (!iter)
-        return 0;
+    qd_iterator_init_binary(iter, text, strlen(text), view);
+}
+
 
+void qd_iterator_init_binary(qd_iterator_t *iter, const char *text, int length, qd_iterator_view_t view)
+{
     ZERO(iter);
     iter->start_pointer.cursor    = (unsigned char*) text;
-    iter->start_pointer.remaining = strlen(text);
+    iter->start_pointer.remaining = length;
     iter->phase                   = '0';
 
     qd_iterator_reset_view(iter, view);
-
-    return iter;
 }
 
 
-qd_iterator_t* qd_iterator_binary(const char *text, int length, qd_iterator_view_t view)
+void qd_iterator_init_buffer(qd_iterator_t *iter, qd_buffer_t *buffer, int offset, int length, qd_iterator_view_t view)
 {
-    qd_iterator_t *iter = new_qd_iterator_t();
-    if (!iter)
-        return 0;
-
     ZERO(iter);
-    iter->start_pointer.cursor    = (unsigned char*) text;
+    iter->start_pointer.buffer    = buffer;
+    iter->start_pointer.cursor    = qd_buffer_base(buffer) + offset;
     iter->start_pointer.remaining = length;
     iter->phase                   = '0';
 
     qd_iterator_reset_view(iter, view);
+}
+
+
+void qd_iterator_init_pointer(qd_iterator_t *iter, const qd_iterator_pointer_t *ptr, qd_iterator_view_t view)
+{
+    ZERO(iter);
+    iter->start_pointer = *ptr;
+    iter->phase         = '0';
+
+    qd_iterator_reset_view(iter, view);
+}
 
+
+void qd_iterator_fini(qd_iterator_t *iter)
+{
+    if (iter)
+        qd_iterator_free_hash_segments(iter);
+}
+
+
+qd_iterator_t* qd_iterator_string(const char *text, qd_iterator_view_t view)
+{
+    qd_iterator_t *iter = new_qd_iterator_t();
+    if (!iter)
+        return 0;
+
+    qd_iterator_init_string(iter, text, view);
     return iter;
 }
 
 
-qd_iterator_t *qd_iterator_buffer(qd_buffer_t *buffer, int offset, int length, qd_iterator_view_t view)
+qd_iterator_t* qd_iterator_binary(const char *text, int length, qd_iterator_view_t view)
 {
     qd_iterator_t *iter = new_qd_iterator_t();
     if (!iter)
         return 0;
 
-    ZERO(iter);
-    iter->start_pointer.buffer    = buffer;
-    iter->start_pointer.cursor    = qd_buffer_base(buffer) + offset;
-    iter->start_pointer.remaining = length;
-    iter->phase                   = '0';
+    qd_iterator_init_binary(iter, text, length, view);
+    return iter;
+}
 
-    qd_iterator_reset_view(iter, view);
 
+qd_iterator_t *qd_iterator_buffer(qd_buffer_t *buffer, int offset, int length, qd_iterator_view_t view)
+{
+    qd_iterator_t *iter = new_qd_iterator_t();
+    if (!iter)
+        return 0;
+
+    qd_iterator_init_buffer(iter, buffer, offset, length, view);
     return iter;
 }
 
@@ -462,7 +695,7 @@ void qd_iterator_free(qd_iterator_t *iter)
     if (!iter)
         return;
 
-    qd_iterator_free_hash_segments(iter);
+    qd_iterator_fini(iter);
     free_qd_iterator_t(iter);
 }
 
@@ -487,11 +720,22 @@ void qd_iterator_reset(qd_iterator_t *iter)
 void qd_iterator_reset_view(qd_iterator_t *iter, qd_iterator_view_t view)
 {
     if (iter) {
+        //
+        // Re-selecting the view already in place only needs to rewind it; the
+        // parse and any memoized hash remain valid.
+        //
+        if (iter->view_pristine && iter->view == view) {
+            qd_iterator_reset(iter);
+            return;
+        }
+
         iter->view_pointer = iter->start_pointer;
         iter->view         = view;
         view_initialize(iter);
         iter->view_start_pointer   = iter->view_pointer;
         iter->annotation_remaining = iter->annotation_length;
+        iter->view_pristine        = true;
+        iter->hash_valid           = false;
     }
 }
 
@@ -504,8 +748,10 @@ qd_iterator_view_t qd_iterator_get_view(const qd_iterator_t *iter)
 
 void qd_iterator_annotate_phase(qd_iterator_t *iter, char phase)
 {
-    if (iter)
-        iter->phase = phase;
+    if (iter && iter->phase != phase) {
+        iter->phase      = phase;
+        iter->hash_valid = false;
+    }
 }
 
 
@@ -514,6 +760,7 @@ void qd_iterator_trim_view(qd_iterator_t *iter, int length)
     if (!iter)
         return;
 
+    view_modified(iter);
     iter->view_start_pointer = iter->view_pointer;
     int view_length = qd_iterator_length(iter);
     if (view_length > length) {
@@ -532,6 +779,7 @@ void qd_iterator_annotate_prefix(qd_iterator_t *iter, char prefix)
 {
     if (iter) {
         iter->prefix_override = prefix;
+        view_modified(iter);
         qd_iterator_reset_view(iter, iter->view);
     }
 }
@@ -540,8 +788,10 @@ void qd_iterator_annotate_prefix(qd_iterator_t *iter, char prefix)
 void qd_iterator_annotate_space(qd_iterator_t *iter, const char* space, int space_length)
 {
     if (iter) {
+        view_modified(iter);
         iter->space        = space;
         iter->space_length = space_length;
+        iter->space_hash   = 0;
         if      (iter->view == ITER_VIEW_ADDRESS_HASH)
             iter->annotation_length = (iter->view_space ? space_length : 0) + (iter->prefix == QD_ITER_HASH_PREFIX_MOBILE ? 2 : 1);
         else if (iter->view == ITER_VIEW_ADDRESS_WITH_SPACE) {
@@ -552,6 +802,42 @@ void qd_iterator_annotate_space(qd_iterator_t *iter, const char* space, int spac
 }
 
 
+qd_iterator_space_t *qd_iterator_space(const char *space, int space_length)
+{
+    qd_iterator_space_t *sh = NEW(qd_iterator_space_t);
+    sh->space  = space;
+    sh->length = space_length;
+
+    hash_init(&sh->with_space);
+    hash_run(&sh->with_space, (const unsigned char*) space, space_length);
+
+    for (int phase = 0; phase < QD_ITER_SPACE_PHASES; phase++) {
+        view_hash_t *vh = &sh->mobile[phase];
+        hash_init(vh);
+        hash_octet(vh, QD_ITER_HASH_PREFIX_MOBILE);
+        hash_octet(vh, '0' + phase);
+        hash_run(vh, (const unsigned char*) space, space_length);
+    }
+
+    return sh;
+}
+
+
+void qd_iterator_space_free(qd_iterator_space_t *space)
+{
+    free(space);
+}
+
+
+void qd_iterator_annotate_space_hash(qd_iterator_t *iter, const qd_iterator_space_t *space)
+{
+    if (iter && space) {
+        qd_iterator_annotate_space(iter, space->space, space->length);
+        iter->space_hash = space;
+    }
+}
+
+
 unsigned char qd_iterator_octet(qd_iterator_t *iter)
 {
     if (!iter)
@@ -585,6 +871,17 @@ unsigned char qd_iterator_octet(qd_iterator_t *iter)
 
     unsigned char result = *(iter->view_pointer.cursor);
 
+    //
+    // Fast path: the next octet is not the last one in its buffer and the view
+    // does not stop at a slash, so no buffer or mode bookkeeping is needed.
+    //
+    if (iter->mode == MODE_TO_END &&
+        (!iter->view_pointer.buffer || iter->view_pointer.cursor + 1 < qd_buffer_cursor(iter->view_pointer.buffer))) {
+        iter->view_pointer.cursor++;
+        iter->view_pointer.remaining--;
+        return result;
+    }
+
     field_iterator_move_cursor(iter, 1);
     if (iter->view_pointer.remaining && iter->mode == MODE_TO_SLASH && *(iter->view_pointer.cursor) == '/')
         iter->view_pointer.remaining = 0;
@@ -599,15 +896,8 @@ bool qd_iterator_end(const qd_iterator_t *iter)
 }
 
 
-qd_iterator_t *qd_iterator_sub(const qd_iterator_t *iter, uint32_t length)
+void qd_iterator_init_sub(qd_iterator_t *sub, const qd_iterator_t *iter, uint32_t length)
 {
-    if (!iter)
-        return 0;
-
-    qd_iterator_t *sub = new_qd_iterator_t();
-    if (!sub)
-        return 0;
-
     ZERO(sub);
     sub->start_pointer           = iter->view_pointer;
     sub->start_pointer.remaining = length;
@@ -617,7 +907,19 @@ qd_iterator_t *qd_iterator_sub(const qd_iterator_t *iter, uint32_t length)
     sub->mode                    = iter->mode;
     sub->state                   = STATE_IN_BODY;
     sub->phase                   = '0';
+}
+
+
+qd_iterator_t *qd_iterator_sub(const qd_iterator_t *iter, uint32_t length)
+{
+    if (!iter)
+        return 0;
+
+    qd_iterator_t *sub = new_qd_iterator_t();
+    if (!sub)
+        return 0;
 
+    qd_iterator_init_sub(sub, iter, length);
     return sub;
 }
 
@@ -653,6 +955,17 @@ bool qd_iterator_equal(qd_iterator_t *iter, const unsigned char *string)
     qd_iterator_reset(iter);
 
     while (!qd_iterator_end(iter) && *string) {
+        const unsigned char *run;
+        uint32_t             run_length = view_run(iter, &run);
+        if (run_length) {
+            size_t length = strnlen((const char*) string, run_length);
+            if (memcmp(run, string, length) != 0)
+                break;
+            view_advance(iter, length);
+            string += length;
+            continue;
+        }
+
         unsigned char octet = qd_iterator_octet(iter);
         if (*string != octet)
             break;
@@ -674,6 +987,17 @@ bool qd_iterator_prefix(qd_iterator_t *iter, const char *prefix)
     unsigned char *c                   = (unsigned char*) prefix;
 
     while(*c) {
+        const unsigned char *run;
+        uint32_t             run_length = qd_iterator_contiguous(iter, &run);
+        if (run_length) {
+            size_t length = strnlen((const char*) c, run_length);
+            if (memcmp(run, c, length) != 0)
+                break;
+            field_iterator_move_cursor(iter, length);
+            c += length;
+            continue;
+        }
+
         if (*c != qd_iterator_octet(iter))
             break;
         c++;
@@ -693,6 +1017,12 @@ void iterator_pointer_move_cursor(qd_iterator_pointer_t *ptr, uint32_t length)
 {
     uint32_t count = length > ptr->remaining ? ptr->remaining : length;
 
+    if (!ptr->buffer) {     // string/binary data
+        ptr->cursor    += count;
+        ptr->remaining -= count;
+        return;
+    }
+
     while (count) {
         uint32_t remaining = qd_buffer_cursor(ptr->buffer) - ptr->cursor;
         remaining = remaining > count ? count : remaining;
@@ -734,7 +1064,6 @@ bool qd_iterator_prefix_ptr(const qd_iterator_pointer_t *ptr, uint32_t skip, con
         c++;
 
         iterator_pointer_move_cursor(&lptr, 1);
-        lptr.remaining -= 1;
     }
 
     return *c == 0;
@@ -754,8 +1083,18 @@ int qd_iterator_ncopy(qd_iterator_t *iter, unsigned char* buffer, int n)
 
     qd_iterator_reset(iter);
     int i = 0;
-    while (!qd_iterator_end(iter) && i < n)
-        buffer[i++] = qd_iterator_octet(iter);
+    while (!qd_iterator_end(iter) && i < n) {
+        const unsigned char *run;
+        uint32_t             run_length = view_run(iter, &run);
+        if (run_length) {
+            if (run_length > (uint32_t) (n - i))
+                run_length = n - i;
+            memcpy(buffer + i, run, run_length);
+            view_advance(iter, run_length);
+            i += run_length;
+        } else
+            buffer[i++] = qd_iterator_octet(iter);
+    }
     return i;
 }
 
@@ -789,59 +1128,108 @@ unsigned char *qd_iterator_copy(qd_iterator_t *iter)
 }
 
 
+void qd_iterator_init_dup(qd_iterator_t *dup, const qd_iterator_t *iter)
+{
+    if (!iter) {
+        ZERO(dup);
+        dup->phase = '0';
+        return;
+    }
+
+    *dup = *iter;
+    // drop any references to the hash segments to avoid potential double
+    // free
+    dup->inline_segment_count = 0;
+    DEQ_INIT(dup->hash_segments);
+}
+
+
 qd_iterator_t *qd_iterator_dup(const qd_iterator_t *iter)
 {
     if (!iter)
         return 0;
 
     qd_iterator_t *dup = new_qd_iterator_t();
-    if (dup) {
-        *dup = *iter;
-        // drop any references to the hash segments to avoid potential double
-        // free
-        DEQ_INIT(dup->hash_segments);
-    }
+    if (dup)
+        qd_iterator_init_dup(dup, iter);
     return dup;
 }
 
 
 /**
- * Creates and returns a new qd_hash_segment_t and initializes it.
+ * Record the hash of the next longer segment: in the iterator while there is
+ * room, otherwise in an overflow segment at the end of the linked list
  */
-static qd_hash_segment_t *qd_iterator_hash_segment(void)
+static void qd_insert_hash_segment(qd_iterator_t *iter, uint32_t *hash, int segment_length)
 {
+    // While storing the segment, don't include the hash of the separator in the segment but do include it in the overall hash.
+    if (iter->inline_segment_count < QD_ITERATOR_INLINE_SEGMENTS) {
+        qd_inline_segment_t *inline_segment = &iter->inline_segments[iter->inline_segment_count++];
+        inline_segment->hash           = *hash;
+        inline_segment->segment_length = segment_length;
+        return;
+    }
+
     qd_hash_segment_t *hash_segment = new_qd_hash_segment_t();
     DEQ_ITEM_INIT(hash_segment);
-    hash_segment->hash           = 0;
-    hash_segment->segment_length = 0;
-    return hash_segment;
+    hash_segment->hash           = *hash;
+    hash_segment->segment_length = segment_length;
+    DEQ_INSERT_TAIL(iter->hash_segments, hash_segment);
 }
 
 
-/**
- * Create a new hash segment and insert it at the end of the linked list
- */
-static void qd_insert_hash_segment(qd_iterator_t *iter, uint32_t *hash, int segment_length)
+//
+// Start hashing a rewound view from the precomputed state of its tenant-space
+// annotations, moving the cursor to the first octet of the address.  Returns
+// false, leaving the view as it was, unless the view's annotations are ones
+// that were precomputed.
+//
+static bool hash_resume_space(qd_iterator_t *iter, view_hash_t *vh)
 {
-    qd_hash_segment_t *hash_segment = qd_iterator_hash_segment();
+    const qd_iterator_space_t *sh = iter->space_hash;
+    if (!sh || !iter->view_space)
+        return false;
 
-    // While storing the segment, don't include the hash of the separator in the segment but do include it in the overall hash.
-    hash_segment->hash = *hash;
+    if (iter->view == ITER_VIEW_ADDRESS_WITH_SPACE && iter->annotation_length == sh->length)
+        *vh = sh->with_space;
+    else if (iter->view == ITER_VIEW_ADDRESS_HASH && iter->prefix == QD_ITER_HASH_PREFIX_MOBILE &&
+             iter->phase >= '0' && iter->phase < '0' + QD_ITER_SPACE_PHASES &&
+             iter->annotation_length == sh->length + 2)
+        *vh = sh->mobile[iter->phase - '0'];
+    else
+        return false;
 
-    hash_segment->segment_length = segment_length;
-    DEQ_INSERT_TAIL(iter->hash_segments, hash_segment);
+    iter->state                = STATE_IN_BODY;
+    iter->space_cursor         = sh->length;
+    iter->annotation_remaining = 0;
+    return true;
 }
 
 
 uint32_t qd_iterator_hash_view(qd_iterator_t *iter)
 {
-    uint32_t hash = HASH_INIT;
+    if (iter->hash_valid)
+        return iter->view_hash;
+
+    view_hash_t vh;
 
     qd_iterator_reset(iter);
-    while (!qd_iterator_end(iter))
-        hash = ((hash << 5) + hash) + (uint32_t) qd_iterator_octet(iter); /* hash * 33 + c */
+    if (!hash_resume_space(iter, &vh))
+        hash_init(&vh);
 
-    return hash;
+    while (!qd_iterator_end(iter)) {
+        const unsigned char *run;
+        uint32_t             run_length = view_run(iter, &run);
+        if (run_length) {
+            hash_run(&vh, run, run_length);
+            view_advance(iter, run_length);
+        } else
+            hash_octet(&vh, qd_iterator_octet(iter));
+    }
+
+    iter->view_hash  = hash_value(&vh);
+    iter->hash_valid = true;
+    return iter->view_hash;
 }
 
 
@@ -852,29 +1240,52 @@ void qd_iterator_hash_view_segments(qd_iterator_t *iter)
     
     // Reset the pointers in the iterator
     qd_iterator_reset(iter);
-    uint32_t hash = HASH_INIT;
-    char octet;
-    int segment_length=0;
+    view_hash_t vh;
+    uint32_t    hash;
+    char        octet;
+    int         segment_length=0;
+
+    hash_init(&vh);
 
     qd_iterator_free_hash_segments(iter);
 
     while (!qd_iterator_end(iter)) {
-        // Get the octet at which the iterator is currently pointing to.
-        octet = qd_iterator_octet(iter);
-        segment_length += 1;
-
-        if (strrchr(SEPARATORS, (int) octet)) {
-            qd_insert_hash_segment(iter, &hash, segment_length-1);
+        // Take the contiguous run of octets at the cursor, or a single octet
+        // if the view is annotated or the run ends at a buffer boundary.
+        const unsigned char *run;
+        unsigned char        single;
+        uint32_t             run_length = view_run(iter, &run);
+        if (run_length)
+            view_advance(iter, run_length);
+        else {
+            single     = qd_iterator_octet(iter);
+            run        = &single;
+            run_length = 1;
         }
 
-        hash = ((hash << 5) + hash) + octet; /* hash * 33 + c */
+        for (uint32_t idx = 0; idx < run_length; idx++) {
+            octet = run[idx];
+            segment_length += 1;
+
+            if (strrchr(SEPARATORS, (int) octet)) {
+                hash = hash_value(&vh);
+                qd_insert_hash_segment(iter, &hash, segment_length-1);
+            }
+
+            hash_octet(&vh, (unsigned char) octet);
+        }
     }
 
     // Segments should never end with a separator. see view_initialize which in turn calls
     // qd_iterator_remove_trailing_separator
     // Insert the last segment which was not inserted in the previous while loop
+    hash = hash_value(&vh);
     qd_insert_hash_segment(iter, &hash, segment_length);
 
+    // The last segment is the whole view
+    iter->view_hash  = hash;
+    iter->hash_valid = true;
+
     // Return the pointers in the iterator back to the original state before returning from this function.
     qd_iterator_reset(iter);
 }
@@ -882,16 +1293,27 @@ void qd_iterator_hash_view_segments(qd_iterator_t *iter)
 
 bool qd_iterator_next_segment(qd_iterator_t *iter, uint32_t *hash)
 {
+    uint32_t segment_length;
+
+    //
+    // The overflow segments are longer than the inline ones, so take them first
+    //
     qd_hash_segment_t *hash_segment = DEQ_TAIL(iter->hash_segments);
-    if (!hash_segment)
+    if (hash_segment) {
+        *hash          = hash_segment->hash;
+        segment_length = hash_segment->segment_length;
+        DEQ_REMOVE_TAIL(iter->hash_segments);
+        free_qd_hash_segment_t(hash_segment);
+    } else if (iter->inline_segment_count > 0) {
+        qd_inline_segment_t *inline_segment = &iter->inline_segments[--iter->inline_segment_count];
+        *hash          = inline_segment->hash;
+        segment_length = inline_segment->segment_length;
+    } else
         return false;
 
-    *hash = hash_segment->hash;
-    qd_iterator_trim_view(iter, hash_segment->segment_length);
-
-    DEQ_REMOVE_TAIL(iter->hash_segments);
-
-    free_qd_hash_segment_t(hash_segment);
+    qd_iterator_trim_view(iter, segment_length);
+    iter->view_hash  = *hash;
+    iter->hash_valid = true;
 
     return true;
 }
@@ -905,3 +1327,20 @@ void qd_iterator_get_view_cursor(
     ptr->cursor    = iter->view_pointer.cursor;
     ptr->remaining = iter->view_pointer.remaining;
 }
+
+
+uint32_t qd_iterator_contiguous(const qd_iterator_t *iter, const unsigned char **cursor)
+{
+    if (!iter || iter->state != STATE_IN_BODY || iter->mode != MODE_TO_END)
+        return 0;
+
+    uint32_t avail = iter->view_pointer.remaining;
+    if (iter->view_pointer.buffer) {
+        uint32_t in_buffer = qd_buffer_cursor(iter->view_pointer.buffer) - iter->view_pointer.cursor;
+        if (in_buffer < avail)
+            avail = in_buffer;
+    }
+
+    *cursor = iter->view_pointer.cursor;
+    return avail;
+}
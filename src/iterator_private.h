@@ -0,0 +1,108 @@
+#ifndef __iterator_private_h__
+#define __iterator_private_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/iterator.h>
+#include <qpid/dispatch/ctools.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The iterator's layout is private to the router so that short-lived
+ * iterators can live on the stack.  An iterator set up with one of the
+ * qd_iterator_init_* functions below is not pool allocated: release it with
+ * qd_iterator_fini, never with qd_iterator_free.  It must not outlive the
+ * data it was set up over, nor be handed to code that keeps the iterator.
+ */
+
+typedef enum {
+    MODE_TO_END,
+    MODE_TO_SLASH
+} parse_mode_t;
+
+typedef enum {
+    STATE_AT_PREFIX,
+    STATE_AT_PHASE,
+    STATE_IN_SPACE,
+    STATE_IN_BODY
+} view_state_t;
+
+typedef struct qd_hash_segment_t {
+    DEQ_LINKS(struct qd_hash_segment_t);
+    uint32_t hash;           //The hash of the segment
+    uint32_t segment_length; //The length of the segment
+} qd_hash_segment_t;
+
+DEQ_DECLARE(qd_hash_segment_t, qd_hash_segment_list_t);
+
+// Segment hashes kept in the iterator itself; an address with more segments
+// than this holds the longer ones in pool-allocated overflow segments
+#define QD_ITERATOR_INLINE_SEGMENTS 8
+
+typedef struct qd_inline_segment_t {
+    uint32_t hash;
+    uint32_t segment_length;
+} qd_inline_segment_t;
+
+struct qd_iterator_t {
+    qd_iterator_pointer_t   start_pointer;      // Pointer to the raw data
+    qd_iterator_pointer_t   view_start_pointer; // Pointer to the start of the view
+    qd_iterator_pointer_t   view_pointer;       // Pointer to the remaining view
+    qd_iterator_view_t      view;
+    int                     annotation_length;
+    int                     annotation_remaining;
+    qd_inline_segment_t     inline_segments[QD_ITERATOR_INLINE_SEGMENTS];
+    int                     inline_segment_count;
+    qd_hash_segment_list_t  hash_segments;      // Overflow segments, longer than the inline ones
+    parse_mode_t            mode;
+    view_state_t            state;
+    unsigned char           prefix;
+    unsigned char           prefix_override;
+    unsigned char           phase;
+    const char             *space;
+    int                     space_length;
+    const qd_iterator_space_t *space_hash;      // Precomputed annotation hashes for the space, or 0
+    int                     space_cursor;
+    bool                    view_space;
+    bool                    view_pristine;      // View is exactly as view_initialize left it
+    bool                    hash_valid;         // view_hash holds the hash of the current view
+    uint32_t                view_hash;
+};
+
+/**
+ * Set up iterators in caller storage; these match qd_iterator_string,
+ * qd_iterator_binary, qd_iterator_buffer, qd_iterator_dup and qd_iterator_sub.
+ */
+void qd_iterator_init_string(qd_iterator_t *iter, const char *text, qd_iterator_view_t view);
+void qd_iterator_init_binary(qd_iterator_t *iter, const char *text, int length, qd_iterator_view_t view);
+void qd_iterator_init_buffer(qd_iterator_t *iter, qd_buffer_t *buffer, int offset, int length, qd_iterator_view_t view);
+void qd_iterator_init_dup(qd_iterator_t *iter, const qd_iterator_t *from);
+void qd_iterator_init_sub(qd_iterator_t *iter, const qd_iterator_t *from, uint32_t length);
+
+/**
+ * Set up an iterator in caller storage over the octets a pointer describes.
+ */
+void qd_iterator_init_pointer(qd_iterator_t *iter, const qd_iterator_pointer_t *ptr, qd_iterator_view_t view);
+
+/**
+ * Release what an iterator in caller storage holds, leaving the storage.
+ */
+void qd_iterator_fini(qd_iterator_t *iter);
+
+#endif
@@ -0,0 +1,621 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "local_transport.h"
+#include "server_private.h"
+
+#include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/log.h>
+#include <qpid/dispatch/threading.h>
+#include <qpid/dispatch/timer.h>
+
+#include <proton/connection_driver.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Listeners with socketAddressFamily local accept co-located clients on a Unix
+ * domain socket.  The proactor only listens on network addresses, so these
+ * connections are run by a thread of their own, like the HTTP connections: each
+ * has a pn_connection_driver_t and the thread polls the sockets, reading straight
+ * into the driver's input buffer and writing straight from its output buffer.
+ * A pipe wakes the thread when work is queued for it by another thread.
+ */
+
+#define LOCAL_BACKLOG      50
+#define LOCAL_DEFAULT_TICK 1000   /* msec */
+
+typedef struct qd_local_connection_t qd_local_connection_t;
+struct qd_local_connection_t {
+    DEQ_LINKS(qd_local_connection_t);
+    qd_local_server_t      *server;
+    pn_connection_driver_t  driver;
+    qd_connection_t        *qd_conn;    /* Zero once freed on PN_TRANSPORT_CLOSED */
+    uint64_t                conn_id;
+    int                     fd;
+    short                   revents;
+};
+ALLOC_DECLARE(qd_local_connection_t);
+ALLOC_DEFINE(qd_local_connection_t);
+DEQ_DECLARE(qd_local_connection_t, qd_local_connection_list_t);
+
+struct qd_local_listener_t {
+    DEQ_LINKS(qd_local_listener_t);
+    qd_local_server_t *server;
+    qd_listener_t     *listener;
+    int                fd;          /* -1 until listening, or if listening failed */
+    short              revents;
+};
+DEQ_DECLARE(qd_local_listener_t, qd_local_listener_list_t);
+
+typedef struct qd_local_work_t qd_local_work_t;
+struct qd_local_work_t {
+    DEQ_LINKS(qd_local_work_t);
+    enum { W_LISTEN, W_CLOSE, W_WAKE, W_STOP } type;
+    qd_local_listener_t *listener;  /* W_LISTEN, W_CLOSE */
+    uint64_t             conn_id;   /* W_WAKE */
+};
+ALLOC_DECLARE(qd_local_work_t);
+ALLOC_DEFINE(qd_local_work_t);
+DEQ_DECLARE(qd_local_work_t, qd_local_work_list_t);
+
+struct qd_local_server_t {
+    qd_server_t          *server;
+    qd_log_source_t      *log;
+    sys_mutex_t          *lock;         /* Protects work and started */
+    qd_local_work_list_t  work;
+    bool                  started;
+    sys_thread_t         *thread;
+    int                   wake_fd[2];   /* Pipe, read end polled by the thread */
+
+    /* Owned by the thread */
+    qd_local_listener_list_t    listeners;
+    qd_local_connection_list_t  connections;
+    struct pollfd              *pollfds;
+    size_t                      pollfds_size;
+    pn_timestamp_t              next_tick;
+};
+
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0
+        && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0
+        && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+
+/* Never blocks, the pipe is only a doorbell so a full pipe already rings it */
+static void work_push(qd_local_server_t *ls, qd_local_work_t *item)
+{
+    sys_mutex_lock(ls->lock);
+    DEQ_INSERT_TAIL(ls->work, item);
+    sys_mutex_unlock(ls->lock);
+    char b = 0;
+    ssize_t ignore = write(ls->wake_fd[1], &b, 1);
+    (void) ignore;
+}
+
+
+static qd_local_work_t *work_item(int type)
+{
+    qd_local_work_t *item = new_qd_local_work_t();
+    ZERO(item);
+    DEQ_ITEM_INIT(item);
+    item->type = type;
+    return item;
+}
+
+
+static void listener_free(qd_local_listener_t *ll)
+{
+    if (ll->fd >= 0) {
+        close(ll->fd);
+        unlink(ll->listener->config.host);
+    }
+    ll->listener->local = NULL;
+    qd_listener_decref(ll->listener);
+    free(ll);
+}
+
+
+static void listener_open(qd_local_server_t *ls, qd_local_listener_t *ll)
+{
+    DEQ_INSERT_TAIL(ls->listeners, ll);
+
+    const char *path = ll->listener->config.host;
+    struct sockaddr_un addr;
+    ZERO(&addr);
+    addr.sun_family = AF_UNIX;
+    if (!path || !*path || strlen(path) >= sizeof(addr.sun_path)) {
+        qd_log(ls->log, QD_LOG_ERROR, "Local listener has invalid socket path '%s'", path ? path : "");
+        goto error;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* A socket left behind by a router that did not exit cleanly would fail the bind */
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || !set_nonblocking(fd)
+        || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(fd, LOCAL_BACKLOG) != 0) {
+        qd_log(ls->log, QD_LOG_ERROR, "Error listening for local connections on %s: %s",
+               path, strerror(errno));
+        if (fd >= 0) close(fd);
+        goto error;
+    }
+    ll->fd = fd;
+    qd_log(ls->log, QD_LOG_NOTICE, "Listening for local connections on %s", path);
+    return;
+
+  error:
+    if (ll->listener->exit_on_error) {
+        qd_log(ls->log, QD_LOG_CRITICAL, "Shutting down, required listener failed %s",
+               path ? path : "");
+        exit(1);
+    }
+}
+
+
+static void listener_close(qd_local_server_t *ls, qd_local_listener_t *ll)
+{
+    if (ll->fd >= 0)
+        qd_log(ls->log, QD_LOG_INFO, "Stopped listening for local connections on %s",
+               ll->listener->config.host);
+    DEQ_REMOVE(ls->listeners, ll);
+    listener_free(ll);
+}
+
+
+/* Wake up a connection managed by the local server thread */
+static void connection_wake(qd_connection_t *qd_conn)
+{
+    qd_local_connection_t *lc = (qd_local_connection_t*) qd_conn->context;
+    if (lc) {
+        qd_local_work_t *item = work_item(W_WAKE);
+        item->conn_id = qd_conn->connection_id;
+        work_push(lc->server, item);
+    }
+}
+
+
+/* Returns false once the connection is finished and should be freed */
+static bool connection_handle(qd_local_connection_t *lc)
+{
+    if (lc->qd_conn && !qd_connection_driver_handle(lc->qd_conn, &lc->driver))
+        lc->qd_conn = 0;
+    if (!lc->qd_conn) {
+        while (pn_connection_driver_next_event(&lc->driver))
+            ;
+    }
+    return !pn_connection_driver_finished(&lc->driver);
+}
+
+
+static void connection_read(qd_local_connection_t *lc)
+{
+    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&lc->driver);
+    if (rbuf.size == 0)
+        return;
+    ssize_t n = read(lc->fd, rbuf.start, rbuf.size);
+    if (n > 0) {
+        pn_connection_driver_read_done(&lc->driver, n);
+    } else if (n == 0) {
+        pn_connection_driver_read_close(&lc->driver);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        pn_connection_driver_errorf(&lc->driver, "local-read-error", "%s", strerror(errno));
+        pn_connection_driver_close(&lc->driver);
+    }
+}
+
+
+/* Returns true if anything was written */
+static bool connection_write(qd_local_connection_t *lc)
+{
+    bool wrote = false;
+    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&lc->driver);
+    while (wbuf.size) {
+        ssize_t n = send(lc->fd, wbuf.start, wbuf.size, MSG_NOSIGNAL);
+        if (n > 0) {
+            pn_connection_driver_write_done(&lc->driver, n);
+            wrote = true;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                pn_connection_driver_errorf(&lc->driver, "local-write-error", "%s", strerror(errno));
+                pn_connection_driver_close(&lc->driver);
+                wrote = true;
+            }
+            break;
+        }
+        wbuf = pn_connection_driver_write_buffer(&lc->driver);
+    }
+    return wrote;
+}
+
+
+/* Returns false once the connection is finished and should be freed */
+static bool connection_run(qd_local_connection_t *lc)
+{
+    bool ok = connection_handle(lc);
+    if (connection_write(lc))
+        ok = connection_handle(lc);
+    return ok;
+}
+
+
+static void connection_free(qd_local_server_t *ls, qd_local_connection_t *lc)
+{
+    DEQ_REMOVE(ls->connections, lc);
+    close(lc->fd);
+    /* Only at shutdown is qd_conn still there, qd_server_free() frees it */
+    if (lc->qd_conn)
+        lc->qd_conn->context = 0;
+    pn_connection_driver_destroy(&lc->driver);
+    free_qd_local_connection_t(lc);
+}
+
+
+static void connection_open(qd_local_server_t *ls, qd_local_listener_t *ll, int fd)
+{
+    qd_server_config_t *config = &ll->listener->config;
+    qd_connection_t *qd_conn = qd_server_connection(ls->server, config);
+    if (!qd_conn) {
+        qd_log(ls->log, QD_LOG_CRITICAL, "No memory for local connection on %s", config->host);
+        close(fd);
+        return;
+    }
+
+    qd_local_connection_t *lc = new_qd_local_connection_t();
+    ZERO(lc);
+    DEQ_ITEM_INIT(lc);
+    lc->server  = ls;
+    lc->qd_conn = qd_conn;
+    lc->conn_id = qd_conn->connection_id;
+    lc->fd      = fd;
+
+    qd_conn->context  = lc;
+    qd_conn->wake     = connection_wake;
+    qd_conn->listener = ll->listener;
+    /* The peer is on this host: policy treats it like a loopback client */
+    strncpy(qd_conn->rhost, "127.0.0.1", sizeof(qd_conn->rhost));
+    snprintf(qd_conn->rhost_port, sizeof(qd_conn->rhost_port), "local:%s", config->host);
+
+    int err = pn_connection_driver_init(&lc->driver, qd_conn->pn_conn, NULL);
+    if (err) {
+        /* The unopened qd_conn stays on the server's list until qd_server_free() */
+        qd_log(ls->log, QD_LOG_CRITICAL, "No memory for local connection on %s", config->host);
+        qd_conn->context = 0;
+        pn_connection_driver_destroy(&lc->driver);
+        free_qd_local_connection_t(lc);
+        close(fd);
+        return;
+    }
+    DEQ_INSERT_TAIL(ls->connections, lc);
+    qd_log(ls->log, QD_LOG_DEBUG, "[C%"PRIu64"] Accepted local connection on %s",
+           lc->conn_id, config->host);
+}
+
+
+static void listener_accept(qd_local_server_t *ls, qd_local_listener_t *ll)
+{
+    while (true) {
+        int fd = accept(ll->fd, 0, 0);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qd_log(ls->log, QD_LOG_WARNING, "Accept failed on local listener %s: %s",
+                       ll->listener->config.host, strerror(errno));
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        connection_open(ls, ll, fd);
+    }
+}
+
+
+/* Run transport ticks when one is due and return the poll timeout in msec */
+static int connections_tick(qd_local_server_t *ls)
+{
+    pn_timestamp_t now = qd_timer_now();
+    if (now >= ls->next_tick) {
+        ls->next_tick = now + LOCAL_DEFAULT_TICK;
+        qd_local_connection_t *lc = DEQ_HEAD(ls->connections);
+        while (lc) {
+            qd_local_connection_t *next = DEQ_NEXT(lc);
+            pn_timestamp_t tick = pn_transport_tick(lc->driver.transport, now);
+            if (tick && tick > now && tick < ls->next_tick)
+                ls->next_tick = tick;
+            if (!connection_run(lc))
+                connection_free(ls, lc);
+            lc = next;
+        }
+    }
+    return ls->next_tick > now ? (int) (ls->next_tick - now) : 1;
+}
+
+
+/* Build the poll set: the wake pipe, then listeners, then connections */
+static nfds_t poll_prepare(qd_local_server_t *ls)
+{
+    size_t size = 1 + DEQ_SIZE(ls->listeners) + DEQ_SIZE(ls->connections);
+    if (size > ls->pollfds_size) {
+        struct pollfd *pollfds = realloc(ls->pollfds, size * sizeof(struct pollfd));
+        if (!pollfds)
+            size = ls->pollfds_size;  /* Serve who fits until memory is found */
+        else {
+            ls->pollfds      = pollfds;
+            ls->pollfds_size = size;
+        }
+    }
+
+    nfds_t n = 0;
+    ls->pollfds[n].fd       = ls->wake_fd[0];
+    ls->pollfds[n++].events = POLLIN;
+
+    qd_local_listener_t *ll = DEQ_HEAD(ls->listeners);
+    for (; ll; ll = DEQ_NEXT(ll)) {
+        ll->revents = 0;
+        if (ll->fd >= 0 && n < size) {
+            ls->pollfds[n].fd       = ll->fd;
+            ls->pollfds[n++].events = POLLIN;
+        }
+    }
+
+    qd_local_connection_t *lc = DEQ_HEAD(ls->connections);
+    for (; lc; lc = DEQ_NEXT(lc)) {
+        lc->revents = 0;
+        if (n < size) {
+            short events = 0;
+            if (pn_connection_driver_read_buffer(&lc->driver).size)  events |= POLLIN;
+            if (pn_connection_driver_write_buffer(&lc->driver).size) events |= POLLOUT;
+            ls->pollfds[n].fd       = lc->fd;
+            ls->pollfds[n++].events = events;
+        }
+    }
+    return n;
+}
+
+
+/* Hand the results back in the order poll_prepare() used */
+static void poll_results(qd_local_server_t *ls, nfds_t n)
+{
+    nfds_t i = 1;
+    qd_local_listener_t *ll = DEQ_HEAD(ls->listeners);
+    for (; ll && i < n; ll = DEQ_NEXT(ll))
+        if (ll->fd >= 0)
+            ll->revents = ls->pollfds[i++].revents;
+
+    qd_local_connection_t *lc = DEQ_HEAD(ls->connections);
+    for (; lc && i < n; lc = DEQ_NEXT(lc))
+        lc->revents = ls->pollfds[i++].revents;
+}
+
+
+/* Process the work queued since the last pass, returns false on W_STOP */
+static bool work_run(qd_local_server_t *ls)
+{
+    char drain[64];
+    while (read(ls->wake_fd[0], drain, sizeof(drain)) > 0)
+        ;
+
+    qd_local_work_list_t work;
+    sys_mutex_lock(ls->lock);
+    work = ls->work;
+    DEQ_INIT(ls->work);
+    sys_mutex_unlock(ls->lock);
+
+    bool running = true;
+    qd_local_work_t *item = DEQ_HEAD(work);
+    while (item) {
+        DEQ_REMOVE_HEAD(work);
+        switch (item->type) {
+        case W_LISTEN:
+            listener_open(ls, item->listener);
+            break;
+        case W_CLOSE:
+            listener_close(ls, item->listener);
+            break;
+        case W_WAKE: {
+            /* The connection may have closed since the wake was queued */
+            qd_local_connection_t *lc = DEQ_HEAD(ls->connections);
+            DEQ_FIND(lc, lc->conn_id == item->conn_id);
+            if (lc && lc->qd_conn)
+                pn_collector_put(lc->driver.collector, PN_OBJECT, lc->driver.connection,
+                                 PN_CONNECTION_WAKE);
+            break;
+        }
+        case W_STOP:
+            running = false;
+            break;
+        }
+        free_qd_local_work_t(item);
+        item = DEQ_HEAD(work);
+    }
+    return running;
+}
+
+
+static void *local_thread_run(void *arg)
+{
+    qd_local_server_t *ls = (qd_local_server_t*) arg;
+    qd_log(ls->log, QD_LOG_INFO, "Local transport thread running");
+
+    bool running = true;
+    while (running) {
+        int timeout = connections_tick(ls);
+        nfds_t n = poll_prepare(ls);
+        if (poll(ls->pollfds, n, timeout) < 0) {
+            if (errno != EINTR)
+                qd_log(ls->log, QD_LOG_ERROR, "Local transport poll failed: %s", strerror(errno));
+            n = 0;
+        }
+        poll_results(ls, n);
+
+        running = work_run(ls);
+
+        qd_local_listener_t *ll = DEQ_HEAD(ls->listeners);
+        for (; ll; ll = DEQ_NEXT(ll))
+            if (ll->revents & POLLIN)
+                listener_accept(ls, ll);
+
+        qd_local_connection_t *lc = DEQ_HEAD(ls->connections);
+        while (lc) {
+            qd_local_connection_t *next = DEQ_NEXT(lc);
+            if (lc->revents & (POLLIN | POLLHUP | POLLERR))
+                connection_read(lc);
+            if (!connection_run(lc))
+                connection_free(ls, lc);
+            lc = next;
+        }
+    }
+
+    qd_log(ls->log, QD_LOG_INFO, "Local transport thread exit");
+    return NULL;
+}
+
+
+qd_local_server_t *qd_local_server(qd_server_t *server, qd_log_source_t *log)
+{
+    qd_local_server_t *ls = NEW(qd_local_server_t);
+    if (!ls)
+        return NULL;
+    ZERO(ls);
+    ls->server = server;
+    ls->log    = log;
+    ls->lock   = sys_mutex();
+    DEQ_INIT(ls->work);
+    DEQ_INIT(ls->listeners);
+    DEQ_INIT(ls->connections);
+    if (pipe(ls->wake_fd) != 0) {
+        qd_log(log, QD_LOG_CRITICAL, "Cannot create the local transport wake pipe: %s", strerror(errno));
+        sys_mutex_free(ls->lock);
+        free(ls);
+        return NULL;
+    }
+    set_nonblocking(ls->wake_fd[0]);
+    set_nonblocking(ls->wake_fd[1]);
+    return ls;
+}
+
+
+void qd_local_server_stop(qd_local_server_t *ls)
+{
+    if (!ls) return;
+    sys_mutex_lock(ls->lock);
+    sys_thread_t *thread = ls->thread;
+    ls->thread = NULL;
+    sys_mutex_unlock(ls->lock);
+    if (thread) {
+        work_push(ls, work_item(W_STOP));
+        sys_thread_join(thread);
+        sys_thread_free(thread);
+    }
+}
+
+
+void qd_local_server_free(qd_local_server_t *ls)
+{
+    if (!ls) return;
+    qd_local_server_stop(ls);
+
+    /* A listener is freed from the list once the thread has seen its W_LISTEN,
+     * from the queue otherwise.
+     */
+    qd_local_work_t *item = DEQ_HEAD(ls->work);
+    while (item) {
+        DEQ_REMOVE_HEAD(ls->work);
+        if (item->type == W_LISTEN)
+            listener_free(item->listener);
+        free_qd_local_work_t(item);
+        item = DEQ_HEAD(ls->work);
+    }
+    while (DEQ_HEAD(ls->listeners)) {
+        qd_local_listener_t *ll = DEQ_HEAD(ls->listeners);
+        DEQ_REMOVE_HEAD(ls->listeners);
+        listener_free(ll);
+    }
+    while (DEQ_HEAD(ls->connections))
+        connection_free(ls, DEQ_HEAD(ls->connections));
+
+    close(ls->wake_fd[0]);
+    close(ls->wake_fd[1]);
+    free(ls->pollfds);
+    sys_mutex_free(ls->lock);
+    free(ls);
+}
+
+
+qd_local_listener_t *qd_local_server_listen(qd_local_server_t *ls, qd_listener_t *li)
+{
+    sys_mutex_lock(ls->lock);
+    if (!ls->started) {
+        ls->started = true;
+        ls->thread  = sys_thread(local_thread_run, ls);
+    }
+    bool ok = !!ls->thread;
+    sys_mutex_unlock(ls->lock);
+    if (!ok) return NULL;
+
+    qd_local_listener_t *ll = NEW(qd_local_listener_t);
+    if (!ll) {
+        qd_log(ls->log, QD_LOG_CRITICAL, "No memory for local listen on %s", li->config.host);
+        return NULL;
+    }
+    ZERO(ll);
+    DEQ_ITEM_INIT(ll);
+    ll->server   = ls;
+    ll->listener = li;
+    ll->fd       = -1;
+    li->local    = ll;
+    sys_atomic_inc(&li->ref_count); /* Released when the listener is closed or the server freed */
+
+    qd_local_work_t *item = work_item(W_LISTEN);
+    item->listener = ll;
+    work_push(ls, item);
+    return ll;
+}
+
+
+void qd_local_listener_close(qd_local_listener_t *ll)
+{
+    qd_local_work_t *item = work_item(W_CLOSE);
+    item->listener = ll;
+    work_push(ll->server, item);
+}
@@ -0,0 +1,45 @@
+#ifndef QD_LOCAL_TRANSPORT_H
+#define QD_LOCAL_TRANSPORT_H
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+typedef struct qd_local_listener_t qd_local_listener_t;
+typedef struct qd_local_server_t qd_local_server_t;
+
+struct qd_server_t;
+struct qd_listener_t;
+struct qd_log_source_t;
+
+/* Create the server for listeners with socketAddressFamily local */
+qd_local_server_t *qd_local_server(struct qd_server_t *server, struct qd_log_source_t *log);
+
+/* Stop the local server thread */
+void qd_local_server_stop(qd_local_server_t*);
+
+/* Free the local server (stops the thread if still running) */
+void qd_local_server_free(qd_local_server_t*);
+
+/* Listen on the Unix domain socket at the listener's host, thread safe. */
+qd_local_listener_t *qd_local_server_listen(qd_local_server_t *s, struct qd_listener_t *li);
+
+/* Stop listening, connections already accepted stay open.  Thread safe. */
+void qd_local_listener_close(qd_local_listener_t *ll);
+
+#endif // QD_LOCAL_TRANSPORT_H
@@ -85,9 +85,42 @@ static log_sink_list_t sink_list = {0};
 const char *format = "%Y-%m-%d %H:%M:%S.%%06lu %z";
 bool utc = false;
 
-void qd_log_global_options(const char* _format, bool _utc) {
+// A formatted log line waiting for the writer thread.  The record holds a
+// reference to its sink so the sink cannot be closed while the line is queued.
+typedef struct qd_log_record_t qd_log_record_t;
+
+struct qd_log_record_t {
+    DEQ_LINKS(qd_log_record_t);
+    log_sink_t *sink;
+    int         syslog_level;
+    char        text[LOG_MAX];
+};
+
+ALLOC_DECLARE(qd_log_record_t);
+ALLOC_DEFINE(qd_log_record_t);
+
+DEQ_DECLARE(qd_log_record_t, qd_log_record_list_t);
+
+#define LOG_QUEUE_DEFAULT 4096
+
+static sys_mutex_t          *writer_lock = 0;
+static sys_cond_t           *writer_cond = 0;     // signals the writer that records are queued
+static sys_cond_t           *space_cond = 0;      // signals blocked producers that space is free
+static sys_thread_t         *writer_thread = 0;
+static qd_log_record_list_t  pending = {0};       // protected by writer_lock
+static int                   queue_max = LOG_QUEUE_DEFAULT;  // 0 means write synchronously
+static bool                  overflow_block = false;
+static bool                  writer_stopping = false;
+static bool                  writer_busy = false;  // the writer is writing a batch taken from pending
+
+void qd_log_global_options(const char* _format, bool _utc, int _queue_size, bool _overflow_block) {
     if (_format) format = _format;
     utc = _utc;
+    sys_mutex_lock(writer_lock);
+    queue_max = _queue_size < 0 ? 0 : _queue_size;
+    overflow_block = _overflow_block;
+    sys_cond_signal_all(space_cond);
+    sys_mutex_unlock(writer_lock);
 }
 
 static const char* SINK_STDOUT = "stdout";
@@ -95,17 +128,24 @@ static const char* SINK_STDERR = "stderr";
 static const char* SINK_SYSLOG = "syslog";
 static const char* SOURCE_DEFAULT = "DEFAULT";
 
+// Leaf lock protecting sink_list, sinks reaching a zero reference count and
+// the sink pointer of a log source.  Nothing may log while holding it.
+static sys_mutex_t *sink_lock = 0;
+
+/// Caller must hold the sink_lock
 static log_sink_t* find_log_sink_lh(const char* name) {
     log_sink_t* sink = DEQ_HEAD(sink_list);
     DEQ_FIND(sink, strcmp(sink->name, name) == 0);
     return sink;
 }
 
-// Must hold the log_source_lock
+// Drop a reference to a sink, closing it when the last one goes.  Queued log
+// records hold references, so this may run on the writer thread.
 static void log_sink_free_lh(log_sink_t* sink) {
     if (!sink) return;
     assert(sink->ref_count);
 
+    sys_mutex_lock(sink_lock);
     if (sys_atomic_dec(&sink->ref_count) == 1) {
         DEQ_REMOVE(sink_list, sink);
         free(sink->name);
@@ -115,13 +155,16 @@ static void log_sink_free_lh(log_sink_t* sink) {
             closelog();
         free(sink);
     }
+    sys_mutex_unlock(sink_lock);
 }
 
 static log_sink_t* log_sink_lh(const char* name) {
+    sys_mutex_lock(sink_lock);
     log_sink_t* sink = find_log_sink_lh(name);
     if (sink)
         sys_atomic_inc(&sink->ref_count);
-    else {
+    sys_mutex_unlock(sink_lock);
+    if (!sink) {
 
         bool syslog = false;
         FILE *file = 0;
@@ -154,7 +197,9 @@ static log_sink_t* log_sink_lh(const char* name) {
         sink->name = strdup(name);
         sink->syslog = syslog;
         sink->file = file;
+        sys_mutex_lock(sink_lock);
         DEQ_INSERT_TAIL(sink_list, sink);
+        sys_mutex_unlock(sink_lock);
 
     }
     return sink;
@@ -168,6 +213,7 @@ typedef enum {DEFAULT, NONE, TRACE, DEBUG, INFO, NOTICE, WARNING, ERROR, CRITICA
 #define LEVEL_INDEX(LEVEL) ((LEVEL) - TRACE)
 
 struct qd_log_source_t {
+    qd_log_source_head_t head;  /* Must be first, read inline by qd_log_enabled */
     DEQ_LINKS(qd_log_source_t);
     char *module;
     int mask;
@@ -176,6 +222,7 @@ struct qd_log_source_t {
     bool syslog;
     log_sink_t *sink;
     uint64_t severity_histogram[N_LEVEL_INDICES];
+    sys_atomic_t dropped;       /* Entries discarded because the writer queue was full */
 };
 
 DEQ_DECLARE(qd_log_source_t, qd_log_source_list_t);
@@ -289,27 +336,152 @@ static bool default_bool(int value, int default_value) {
     return value == -1 ? default_value : value;
 }
 
+/// Output one formatted line.  Called by the writer thread, or by the logging
+/// thread itself when the queue is disabled.
+static void write_record(qd_log_record_t *record)
+{
+    log_sink_t *sink = record->sink;
+    if (sink->file) {
+        if (fputs(record->text, sink->file) == EOF) {
+            char msg[TEXT_MAX];
+            snprintf(msg, sizeof(msg), "Cannot write log output to '%s'", sink->name);
+            perror(msg);
+            exit(1);
+        };
+    }
+    if (sink->syslog) {
+        if (record->syslog_level != -1)
+            syslog(record->syslog_level, "%s", record->text);
+    }
+}
+
+static void release_record(qd_log_record_t *record)
+{
+    log_sink_free_lh(record->sink);
+    free_qd_log_record_t(record);
+}
+
+/// Write out and release a list of records, with a single flush per run of
+/// records for the same sink.
+static void write_batch(qd_log_record_list_t *batch)
+{
+    qd_log_record_t *record = DEQ_HEAD(*batch);
+    while (record) {
+        DEQ_REMOVE_HEAD(*batch);
+        write_record(record);
+        qd_log_record_t *next = DEQ_HEAD(*batch);
+        if (record->sink->file && (!next || next->sink != record->sink))
+            fflush(record->sink->file);
+        release_record(record);
+        record = next;
+    }
+}
+
+/**
+ * Take everything queued in one go and write it out.
+ */
+static void *log_writer_run(void *unused)
+{
+    sys_mutex_lock(writer_lock);
+    while (true) {
+        while (DEQ_IS_EMPTY(pending) && !writer_stopping)
+            sys_cond_wait(writer_cond, writer_lock);
+        if (DEQ_IS_EMPTY(pending) && writer_stopping)
+            break;
+
+        qd_log_record_list_t batch = pending;
+        DEQ_INIT(pending);
+        writer_busy = true;
+        sys_mutex_unlock(writer_lock);
+
+        write_batch(&batch);
+
+        sys_mutex_lock(writer_lock);
+        writer_busy = false;
+        sys_cond_signal_all(space_cond);
+    }
+    sys_mutex_unlock(writer_lock);
+    return 0;
+}
+
+/**
+ * Hand a formatted record to the writer thread.  If the queue is full the
+ * record is dropped unless the overflow policy is to block.  Critical entries
+ * are written before returning, after everything queued ahead of them, as the
+ * process often exits right after logging one.  Returns false if the record
+ * was dropped.
+ */
+static bool queue_record(qd_log_record_t *record, bool critical)
+{
+    sys_mutex_lock(writer_lock);
+    if (critical) {
+        while (writer_busy)
+            sys_cond_wait(space_cond, writer_lock);
+        write_batch(&pending);
+        sys_cond_signal_all(space_cond);
+    }
+
+    while (queue_max > 0 && writer_thread && !writer_stopping &&
+           DEQ_SIZE(pending) >= queue_max && overflow_block)
+        sys_cond_wait(space_cond, writer_lock);
+
+    if (critical || queue_max == 0 || !writer_thread || writer_stopping) {
+        // Synchronous mode: the writer lock keeps lines from interleaving
+        write_record(record);
+        if (record->sink->file)
+            fflush(record->sink->file);
+        sys_mutex_unlock(writer_lock);
+        release_record(record);
+        return true;
+    }
+
+    if (DEQ_SIZE(pending) >= queue_max) {
+        sys_mutex_unlock(writer_lock);
+        release_record(record);
+        return false;
+    }
+
+    bool was_empty = DEQ_IS_EMPTY(pending);
+    DEQ_INSERT_TAIL(pending, record);
+    if (was_empty)
+        sys_cond_signal(writer_cond);
+    sys_mutex_unlock(writer_lock);
+    return true;
+}
+
+/// Format an entry for the source's sink and queue it for output.
 static void write_log(qd_log_source_t *log_source, qd_log_entry_t *entry)
 {
+    // Take a reference to the sink so a concurrent reconfiguration cannot
+    // close it while the record is queued.
+    sys_mutex_lock(sink_lock);
     log_sink_t* sink = log_source->sink ? log_source->sink : default_log_source->sink;
+    if (sink)
+        sys_atomic_inc(&sink->ref_count);
+    sys_mutex_unlock(sink_lock);
     if (!sink) return;
 
-    char log_str[LOG_MAX];
-    char *begin = log_str;
-    char *end = log_str + LOG_MAX;
+    qd_log_record_t *record = new_qd_log_record_t();
+    DEQ_ITEM_INIT(record);
+    record->sink = sink;
+
+    char *begin = record->text;
+    char *end = record->text + LOG_MAX;
 
     const level_t *level = level_for_bit(entry->level);
     if (!level) {
         level = &levels[INFO];
         qd_error_clear();
     }
+    record->syslog_level = level->syslog;
 
     if (default_bool(log_source->includeTimestamp, default_log_source->includeTimestamp)) {
         char buf[100];
         buf[0] = '\0';
 
         time_t sec = entry->time.tv_sec;
-        struct tm *time = utc ? gmtime(&sec) : localtime(&sec);
+        struct tm tm_buf;
+        struct tm *time = utc ? gmtime_r(&sec, &tm_buf) : localtime_r(&sec, &tm_buf);
         char fmt[100];
         strftime(fmt, sizeof fmt, format, time);
         snprintf(buf, 100, fmt, entry->time.tv_usec);
@@ -323,20 +495,22 @@ static void write_log(qd_log_source_t *log_source, qd_log_entry_t *entry)
         aprintf(&begin, end, " (%s:%d)", entry->file, entry->line);
     aprintf(&begin, end, "\n");
 
-    if (sink->file) {
-        if (fputs(log_str, sink->file) == EOF) {
-            char msg[TEXT_MAX];
-            snprintf(msg, sizeof(msg), "Cannot write log output to '%s'", sink->name);
-            perror(msg);
-            exit(1);
-        };
-        fflush(sink->file);
-    }
-    if (sink->syslog) {
-        int syslog_level = level->syslog;
-        if (syslog_level != -1)
-            syslog(syslog_level, "%s", log_str);
-    }
+    if (!queue_record(record, entry->level == QD_LOG_CRITICAL))
+        sys_atomic_inc(&log_source->dropped);
+}
+
+/// Recompute the cached enable mask of a source. Caller must hold log_source_lock
+static void update_enabled_mask_lh(qd_log_source_t *log_source) {
+    int mask = log_source->mask;
+    if (mask == -1 && default_log_source)
+        mask = default_log_source->mask;
+    sys_atomic_set(&log_source->head.enabled_mask, (uint32_t) (mask == -1 ? 0 : mask));
+}
+
+/// Recompute every source's cached mask, e.g. after DEFAULT changed. Caller must hold log_source_lock
+static void update_enabled_masks_lh(void) {
+    for (qd_log_source_t *src = DEQ_HEAD(source_list); src; src = DEQ_NEXT(src))
+        update_enabled_mask_lh(src);
 }
 
 /// Reset the log source to the default state
@@ -359,6 +533,9 @@ static qd_log_source_t *qd_log_source_lh(const char *module)
         log_source->module = (char*) malloc(strlen(module) + 1);
         strcpy(log_source->module, module);
         qd_log_source_defaults(log_source);
+        sys_atomic_init(&log_source->dropped, 0);
+        sys_atomic_init(&log_source->head.enabled_mask, 0);
+        update_enabled_mask_lh(log_source);
         DEQ_INSERT_TAIL(source_list, log_source);
         qd_entity_cache_add(QD_LOG_STATS_TYPE, log_source);
     }
@@ -378,6 +555,7 @@ qd_log_source_t *qd_log_source_reset(const char *module)
     sys_mutex_lock(log_source_lock);
     qd_log_source_t* src = qd_log_source_lh(module);
     qd_log_source_defaults(src);
+    update_enabled_masks_lh();
     sys_mutex_unlock(log_source_lock);
     return src;
 }
@@ -385,15 +563,12 @@ qd_log_source_t *qd_log_source_reset(const char *module)
 static void qd_log_source_free_lh(qd_log_source_t* src) {
     DEQ_REMOVE(source_list, src);
     log_sink_free_lh(src->sink);
+    sys_atomic_destroy(&src->dropped);
+    sys_atomic_destroy(&src->head.enabled_mask);
     free(src->module);
     free(src);
 }
 
-bool qd_log_enabled(qd_log_source_t *source, qd_log_level_t level) {
-    if (!source) return false;
-    int mask = source->mask == -1 ? default_log_source->mask : source->mask;
-    return level & mask;
-}
 
 void qd_vlog_impl(qd_log_source_t *source, qd_log_level_t level, const char *file, int line, const char *fmt, va_list ap)
 {
@@ -411,8 +586,8 @@ void qd_vlog_impl(qd_log_source_t *source, qd_log_level_t level, const char *fil
 
     if (!qd_log_enabled(source, level)) return;
 
-    // Bounded buffer of log entries, keep most recent.
-    sys_mutex_lock(log_lock);
+    // Format and queue the output before taking the log lock; the
+    // writer thread does the actual I/O.
     qd_log_entry_t *entry = new_qd_log_entry_t();
     DEQ_ITEM_INIT(entry);
     entry->module = source->module;
@@ -422,6 +597,9 @@ void qd_vlog_impl(qd_log_source_t *source, qd_log_level_t level, const char *fil
     gettimeofday(&entry->time, NULL);
     vsnprintf(entry->text, TEXT_MAX, fmt, ap);
     write_log(source, entry);
+
+    // Bounded buffer of log entries, keep most recent.
+    sys_mutex_lock(log_lock);
     DEQ_INSERT_TAIL(entries, entry);
     if (DEQ_SIZE(entries) > LIST_MAX)
         qd_log_entry_free_lh(DEQ_HEAD(entries));
@@ -487,8 +665,19 @@ void qd_log_initialize(void)
     log_lock = sys_mutex();
     log_source_lock = sys_mutex();
 
+    DEQ_INIT(pending);
+    sink_lock   = sys_mutex();
+    writer_lock = sys_mutex();
+    writer_cond = sys_cond();
+    space_cond  = sys_cond();
+    writer_stopping = false;
+    writer_thread = sys_thread(log_writer_run, 0);
+
     default_log_source = qd_log_source(SOURCE_DEFAULT);
+    sys_mutex_lock(log_source_lock);
     default_log_source->mask = levels[INFO].mask;
+    update_enabled_masks_lh();
+    sys_mutex_unlock(log_source_lock);
     default_log_source->includeTimestamp = true;
     default_log_source->includeSource = 0;
     default_log_source->sink = log_sink_lh(SINK_STDERR);
@@ -496,6 +685,17 @@ void qd_log_initialize(void)
 
 
 void qd_log_finalize(void) {
+    // Let the writer drain whatever is still queued before the sinks go away
+    if (writer_thread) {
+        sys_mutex_lock(writer_lock);
+        writer_stopping = true;
+        sys_cond_signal(writer_cond);
+        sys_cond_signal_all(space_cond);
+        sys_mutex_unlock(writer_lock);
+        sys_thread_join(writer_thread);
+        sys_thread_free(writer_thread);
+        writer_thread = 0;
+    }
     while (DEQ_HEAD(source_list))
         qd_log_source_free_lh(DEQ_HEAD(source_list));
     while (DEQ_HEAD(entries))
@@ -529,10 +729,11 @@ qd_error_t qd_log_entity(qd_entity_t *entity) {
             QD_ERROR_BREAK();
 
             /* DEFAULT source may already have a sink, so free the old sink first */
-            if (src->sink) {
-                log_sink_free_lh(src->sink);
-            }
+            sys_mutex_lock(sink_lock);
+            log_sink_t *old_sink = src->sink;
             src->sink = sink;           /* Assign the new sink   */
+            sys_mutex_unlock(sink_lock);
+            log_sink_free_lh(old_sink);
 
             if (src->sink->syslog) /* Timestamp off for syslog. */
                 src->includeTimestamp = 0;
@@ -542,6 +743,7 @@ qd_error_t qd_log_entity(qd_entity_t *entity) {
             enable = qd_entity_get_string(entity, "enable");
             QD_ERROR_BREAK();
             src->mask = enable_mask(enable);
+            update_enabled_masks_lh();
         }
         QD_ERROR_BREAK();
 
@@ -580,6 +782,7 @@ qd_error_t qd_entity_refresh_logStats(qd_entity_t* entity, void *impl)
     qd_entity_set_long(entity,   "warningCount",  log->severity_histogram[LEVEL_INDEX(WARNING)]);
     qd_entity_set_long(entity,   "errorCount",    log->severity_histogram[LEVEL_INDEX(ERROR)]);
     qd_entity_set_long(entity,   "criticalCount", log->severity_histogram[LEVEL_INDEX(CRITICAL)]);
+    qd_entity_set_long(entity,   "droppedCount",  sys_atomic_get(&log->dropped));
     qd_entity_set_string(entity, "name",          log->module);
     qd_entity_set_string(entity, "identity",      identity_str);
 
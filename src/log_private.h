@@ -22,7 +22,13 @@
 #include <qpid/dispatch/log.h>
 
 void qd_log_initialize(void);
-void qd_log_global_options(const char* format, bool utc);
+/**
+ * Set the router-wide log options.  queue_size bounds the number of formatted
+ * lines waiting for the writer thread (0 writes synchronously on the logging
+ * thread); when the queue is full entries are dropped unless overflow_block
+ * is set.  Critical entries are never dropped.
+ */
+void qd_log_global_options(const char* format, bool utc, int queue_size, bool overflow_block);
 void qd_log_finalize(void);
 
 #define QD_LOG_TEXT_MAX 2048
@@ -24,10 +24,14 @@
 #include <qpid/dispatch/iterator.h>
 #include <qpid/dispatch/log.h>
 #include <qpid/dispatch/buffer.h>
+#include <qpid/dispatch/timer.h>
 #include <proton/object.h>
 #include "message_private.h"
+#include "iterator_private.h"
 #include "compose_private.h"
 #include "connection_manager_private.h"
+#include "compression.h"
+#include "probes.h"
 #include "aprintf.h"
 #include <string.h>
 #include <ctype.h>
@@ -73,9 +77,25 @@ PN_HANDLE(PN_DELIVERY_CTX)
 
 ALLOC_DEFINE_CONFIG(qd_message_t, sizeof(qd_message_pvt_t), 0, 0);
 ALLOC_DEFINE(qd_message_content_t);
+ALLOC_DEFINE(qd_message_annotations_t);
+
+// The annotations of every message that has none, never written or freed
+static qd_message_annotations_t no_annotations;
 
 typedef void (*buffer_process_t) (void *context, const unsigned char *base, int length);
 
+//
+// Spill mode: once the buffers held by a message being received exceed the
+// threshold, further buffers are allocated from a spill file rather than memory.
+//
+static size_t      spill_threshold = 0;
+static const char *spill_directory = 0;
+
+// Pre-encoded start of router-originated messages (see qd_message_start_properties)
+static qd_compose_template_t *properties_prefix = 0;
+
+static void qd_message_index_received_LH(qd_message_content_t *content);
+
 qd_log_source_t* log_source = 0;
 
 qd_log_source_t* qd_message_log_source()
@@ -88,8 +108,97 @@ qd_log_source_t* qd_message_log_source()
     }
 }
 
+void qd_message_set_spill(size_t threshold, const char *directory)
+{
+    spill_threshold = threshold;
+    spill_directory = directory;
+}
+
+
+// Buffer memory charged to the receiving connection.  Spilled buffers are held on disk.
+static inline size_t buffer_charge(qd_buffer_t *buf)
+{
+    return qd_buffer_is_spilled(buf) ? 0 : qd_buffer_units(buf) * BUFFER_SIZE;
+}
+
+
+// Account for a buffer added to or taken from the content's chain
+static inline void content_add_buffer(qd_message_content_t *content, qd_buffer_t *buf)
+{
+    content->buffer_units  += qd_buffer_units(buf);
+    content->buffer_octets += qd_buffer_size(buf);
+}
+
+
+static inline void content_remove_buffer(qd_message_content_t *content, qd_buffer_t *buf)
+{
+    content->buffer_units  -= qd_buffer_units(buf);
+    content->buffer_octets -= qd_buffer_size(buf);
+}
+
+
+// Account for a chain set up whole, by compose or snapshot
+static void content_count_buffers(qd_message_content_t *content)
+{
+    for (qd_buffer_t *buf = DEQ_HEAD(content->buffers); buf; buf = DEQ_NEXT(buf))
+        content_add_buffer(content, buf);
+}
+
+
+// Allocate the buffer that qd_message_receive fills next
+static qd_buffer_t *receive_buffer(qd_message_content_t *content, size_t hint)
+{
+    if (spill_threshold && content->buffer_units * BUFFER_SIZE >= spill_threshold) {
+        if (!content->spill && !content->spill_failed) {
+            content->spill        = qd_buffer_spill(spill_directory);
+            content->spill_failed = !content->spill;
+        }
+        if (content->spill) {
+            qd_buffer_t *buf = qd_buffer_spill_alloc(content->spill);
+            if (buf)
+                return buf;
+        }
+    }
+    return qd_buffer_sized(hint);
+}
+
+
+static qd_composed_field_t *compose_properties_prefix(void)
+{
+    qd_composed_field_t *field = qd_compose(QD_PERFORMATIVE_HEADER, 0);
+    qd_compose_start_list(field);
+    qd_compose_insert_bool(field, 0);     // durable
+    qd_compose_end_list(field);
+
+    field = qd_compose(QD_PERFORMATIVE_PROPERTIES, field);
+    qd_compose_start_list(field);
+    qd_compose_insert_null(field);        // message-id
+    qd_compose_insert_null(field);        // user-id
+    return field;
+}
+
+
 void qd_message_initialize() {
     log_source = qd_log_source("MESSAGE");
+    if (!properties_prefix) {
+        qd_composed_field_t *field = compose_properties_prefix();
+        properties_prefix = qd_compose_template(field);
+        qd_compose_free(field);
+    }
+}
+
+
+void qd_message_finalize() {
+    qd_compose_template_free(properties_prefix);
+    properties_prefix = 0;
+}
+
+
+qd_composed_field_t *qd_message_start_properties(void)
+{
+    if (properties_prefix)
+        return qd_compose_from_template(properties_prefix, 0);
+    return compose_properties_prefix();
 }
 
 int qd_message_repr_len() { return qd_log_max_len(); }
@@ -354,6 +463,62 @@ char* qd_message_repr(qd_message_t *msg, char* buffer, size_t len, qd_log_bits f
     return buffer;
 }
 
+/**
+ * Append a copy of the encoded section at location, if it is present, to list.
+ */
+static void snapshot_section(qd_buffer_list_t *list, const qd_field_location_t *location)
+{
+    if (!location->parsed)
+        return;
+
+    qd_buffer_t   *src       = location->buffer;
+    unsigned char *cursor    = qd_buffer_base(src) + location->offset;
+    size_t         remaining = location->hdr_length + location->length;
+    qd_buffer_t   *dst       = DEQ_TAIL(*list);
+
+    while (remaining > 0 && src) {
+        size_t available = qd_buffer_cursor(src) - cursor;
+        if (available == 0) {
+            src = DEQ_NEXT(src);
+            cursor = src ? qd_buffer_base(src) : 0;
+            continue;
+        }
+        if (!dst || qd_buffer_capacity(dst) == 0) {
+            dst = qd_buffer();
+            DEQ_INSERT_TAIL(*list, dst);
+        }
+        size_t n = available < remaining ? available : remaining;
+        if (n > qd_buffer_capacity(dst))
+            n = qd_buffer_capacity(dst);
+        memcpy(qd_buffer_cursor(dst), cursor, n);
+        qd_buffer_insert(dst, n);
+        cursor    += n;
+        remaining -= n;
+    }
+}
+
+
+qd_message_t *qd_message_repr_snapshot(qd_message_t *in_msg)
+{
+    if (!qd_message_check(in_msg, QD_DEPTH_APPLICATION_PROPERTIES))
+        return 0;
+
+    qd_message_content_t *content = MSG_CONTENT(in_msg);
+    qd_message_pvt_t     *copy    = (qd_message_pvt_t*) qd_message();
+    if (!copy)
+        return 0;
+
+    LOCK(content->lock);
+    snapshot_section(&copy->content->buffers, &content->section_message_properties);
+    snapshot_section(&copy->content->buffers, &content->section_application_properties);
+    UNLOCK(content->lock);
+
+    content_count_buffers(copy->content);
+    copy->content->receive_complete = true;
+    return (qd_message_t*) copy;
+}
+
+
 /**
  * Advance cursor through buffer chain by 'consume' bytes.
  * Cursor and buffer args are advanced to point to new position in buffer chain.
@@ -556,82 +721,144 @@ static int start_list(unsigned char **cursor, qd_buffer_t **buffer)
 }
 
 
+//
+// Outcome of checking the buffer chain for one message section.
+//
+typedef enum {
+    QD_SECTION_INVALID,    // The section is malformed, unexpected or a duplicate
+    QD_SECTION_OK,         // The section was consumed, or is absent and nothing was consumed
+    QD_SECTION_NEED_MORE   // Not enough of the message has arrived to tell; nothing was consumed
+} qd_section_status_t;
+
+
+//
+// Move the cursor over exhausted buffers to the next readable octet.  Unlike advance(),
+// this never loses the position at the end of the received data, so a section walk
+// can resume from there when more buffers are appended.
+//
+// Return false if there is no readable octet.
+//
+static bool section_ready(unsigned char **cursor, qd_buffer_t **buffer)
+{
+    while (*cursor == qd_buffer_base(*buffer) + qd_buffer_size(*buffer)) {
+        if (!(*buffer)->next)
+            return false;
+        *buffer = (*buffer)->next;
+        *cursor = qd_buffer_base(*buffer);
+    }
+    return true;
+}
+
+
+static bool section_octet(unsigned char **cursor, qd_buffer_t **buffer, unsigned char *octet)
+{
+    if (!section_ready(cursor, buffer))
+        return false;
+    *octet = *(*cursor)++;
+    return true;
+}
+
+
+// Advance by consume octets if they have all arrived.  Return false, without moving, if not.
+static bool section_skip(unsigned char **cursor, qd_buffer_t **buffer, size_t consume)
+{
+    unsigned char *local_cursor = *cursor;
+    qd_buffer_t   *local_buffer = *buffer;
+
+    while (consume > 0) {
+        size_t remaining = qd_buffer_base(local_buffer) + qd_buffer_size(local_buffer) - local_cursor;
+        if (consume <= remaining) {
+            local_cursor += consume;
+            break;
+        }
+        if (!local_buffer->next)
+            return false;
+        consume      -= remaining;
+        local_buffer  = local_buffer->next;
+        local_cursor  = qd_buffer_base(local_buffer);
+    }
+
+    *cursor = local_cursor;
+    *buffer = local_buffer;
+    return true;
+}
+
+
 //
 // Check the buffer chain, starting at cursor to see if it matches the pattern.
 // If the pattern matches, check the next tag to see if it's in the set of expected
-// tags.  If not, return zero.  If so, set the location descriptor to the good
+// tags.  If not, return INVALID.  If so, set the location descriptor to the good
 // tag and advance the cursor (and buffer, if needed) to the end of the matched section.
 //
 // If there is no match, don't advance the cursor.
 //
-// Return 0 if the pattern matches but the following tag is unexpected
-// Return 0 if the pattern matches and the location already has a pointer (duplicate section)
-// Return 1 if the pattern matches and we've advanced the cursor/buffer
-// Return 1 if the pattern does not match
+// If more_expected is set the chain is still being received.  A pattern, section header
+// or section body that runs off the end of the chain then returns NEED_MORE and leaves
+// the cursor and location untouched so the check can be repeated once more has arrived.
+// Otherwise a chain that ends early is treated as the end of the message.
 //
-static int qd_check_and_advance(qd_buffer_t         **buffer,
-                                unsigned char       **cursor,
-                                const unsigned char  *pattern,
-                                int                   pattern_length,
-                                const unsigned char  *expected_tags,
-                                qd_field_location_t  *location)
-{
+// Return INVALID if the pattern matches but the following tag is unexpected
+// Return INVALID if the pattern matches and the location already has a pointer (duplicate section)
+// Return OK if the pattern matches and we've advanced the cursor/buffer
+// Return OK if the pattern does not match
+//
+static qd_section_status_t qd_check_and_advance(qd_buffer_t         **buffer,
+                                                unsigned char       **cursor,
+                                                const unsigned char  *pattern,
+                                                int                   pattern_length,
+                                                const unsigned char  *expected_tags,
+                                                qd_field_location_t  *location,
+                                                bool                  more_expected)
+{
+    qd_section_status_t short_data = more_expected ? QD_SECTION_NEED_MORE : QD_SECTION_OK;
     qd_buffer_t   *test_buffer = *buffer;
     unsigned char *test_cursor = *cursor;
 
     if (!test_cursor)
-        return 1; // no match
+        return QD_SECTION_OK; // no match
 
-    unsigned char *end_of_buffer = qd_buffer_base(test_buffer) + qd_buffer_size(test_buffer);
+    //
+    // A previous walk may have stopped at the very end of a buffer.  Start the
+    // section at the first octet that follows.
+    //
+    if (!section_ready(&test_cursor, &test_buffer))
+        return short_data;
+    qd_buffer_t   *start_buffer = test_buffer;
+    unsigned char *start_cursor = test_cursor;
+
+    unsigned char octet;
     int idx = 0;
 
-    while (idx < pattern_length && *test_cursor == pattern[idx]) {
+    while (idx < pattern_length) {
+        if (!section_octet(&test_cursor, &test_buffer, &octet))
+            return short_data;
+        if (octet != pattern[idx])
+            return QD_SECTION_OK; // Pattern didn't match
         idx++;
-        test_cursor++;
-        if (test_cursor == end_of_buffer) {
-            test_buffer = test_buffer->next;
-            if (test_buffer == 0)
-                return 1; // Pattern didn't match
-            test_cursor = qd_buffer_base(test_buffer);
-            end_of_buffer = test_cursor + qd_buffer_size(test_buffer);
-        }
     }
 
-    if (idx < pattern_length)
-        return 1; // Pattern didn't match
-
     //
     // Pattern matched, check the tag
     //
+    if (!section_ready(&test_cursor, &test_buffer))
+        return short_data;
     while (*expected_tags && *test_cursor != *expected_tags)
         expected_tags++;
     if (*expected_tags == 0)
-        return 0;  // Unexpected tag
+        return QD_SECTION_INVALID;  // Unexpected tag
 
     if (location->parsed)
-        return 0;  // Duplicate section
+        return QD_SECTION_INVALID;  // Duplicate section
 
     //
-    // Pattern matched and tag is expected.  Mark the beginning of the section.
-    //
-    location->parsed     = 1;
-    location->buffer     = *buffer;
-    location->offset     = *cursor - qd_buffer_base(*buffer);
-    location->length     = 0;
-    location->hdr_length = pattern_length;
-
-    //
-    // Advance the pointers to consume the whole section.
+    // Read the section's length to find out how much to consume.
     //
     int pre_consume = 1;  // Count the already extracted tag
     int consume     = 0;
-    unsigned char tag = next_octet(&test_cursor, &test_buffer);
-
-    unsigned char tag_subcat = tag & 0xF0;
-    if (!test_cursor && tag_subcat != 0x40)
-        return 0;
+    unsigned char tag;
+    section_octet(&test_cursor, &test_buffer, &tag);
 
-    switch (tag_subcat) {
+    switch (tag & 0xF0) {
     case 0x40:               break;
     case 0x50: consume = 1;  break;
     case 0x60: consume = 2;  break;
@@ -643,30 +870,41 @@ static int qd_check_and_advance(qd_buffer_t         **buffer,
     case 0xD0:
     case 0xF0:
         pre_consume += 3;
-        consume |= ((int) next_octet(&test_cursor, &test_buffer)) << 24;
-        if (!test_cursor) return 0;
-        consume |= ((int) next_octet(&test_cursor, &test_buffer)) << 16;
-        if (!test_cursor) return 0;
-        consume |= ((int) next_octet(&test_cursor, &test_buffer)) << 8;
-        if (!test_cursor) return 0;
+        for (int i = 0; i < 3; i++) {
+            if (!section_octet(&test_cursor, &test_buffer, &octet))
+                return more_expected ? QD_SECTION_NEED_MORE : QD_SECTION_INVALID;
+            consume = (consume << 8) | octet;
+        }
         // Fall through to the next case...
 
     case 0xA0:
     case 0xC0:
     case 0xE0:
         pre_consume += 1;
-        consume |= (int) next_octet(&test_cursor, &test_buffer);
-        if (!test_cursor) return 0;
+        if (!section_octet(&test_cursor, &test_buffer, &octet))
+            return more_expected ? QD_SECTION_NEED_MORE : QD_SECTION_INVALID;
+        consume = (consume << 8) | octet;
         break;
     }
 
-    location->length = pre_consume + consume;
-    if (consume)
-        advance(&test_cursor, &test_buffer, consume);
+    if (!section_skip(&test_cursor, &test_buffer, consume)) {
+        if (more_expected)
+            return QD_SECTION_NEED_MORE;
+        advance_guarded(&test_cursor, &test_buffer, consume, 0, 0);
+    }
+
+    //
+    // Pattern matched and tag is expected.  Mark the beginning of the section.
+    //
+    location->parsed     = 1;
+    location->buffer     = start_buffer;
+    location->offset     = start_cursor - qd_buffer_base(start_buffer);
+    location->length     = pre_consume + consume;
+    location->hdr_length = pattern_length;
 
     *cursor = test_cursor;
     *buffer = test_buffer;
-    return 1;
+    return QD_SECTION_OK;
 }
 
 
@@ -713,28 +951,61 @@ static qd_message_field_t qd_field_section(qd_message_field_t field)
 }
 
 
+// position of each properties field's qd_field_location_t in the message
+// content object, in the order the fields appear in the properties list
+static const intptr_t properties_field_offsets[] = {
+    (intptr_t) &((qd_message_content_t *)0)->field_message_id,
+    (intptr_t) &((qd_message_content_t *)0)->field_user_id,
+    (intptr_t) &((qd_message_content_t *)0)->field_to,
+    (intptr_t) &((qd_message_content_t *)0)->field_subject,
+    (intptr_t) &((qd_message_content_t *)0)->field_reply_to,
+    (intptr_t) &((qd_message_content_t *)0)->field_correlation_id,
+    (intptr_t) &((qd_message_content_t *)0)->field_content_type,
+    (intptr_t) &((qd_message_content_t *)0)->field_content_encoding,
+    (intptr_t) &((qd_message_content_t *)0)->field_absolute_expiry_time,
+    (intptr_t) &((qd_message_content_t *)0)->field_creation_time,
+    (intptr_t) &((qd_message_content_t *)0)->field_group_id,
+    (intptr_t) &((qd_message_content_t *)0)->field_group_sequence,
+    (intptr_t) &((qd_message_content_t *)0)->field_reply_to_group_id
+};
+
+#define QD_PROPERTIES_FIELD_COUNT (sizeof(properties_field_offsets) / sizeof(properties_field_offsets[0]))
+
+
+//
+// Record the location of every field in the properties list in one pass so that
+// later field lookups need no further parsing.  Called once the whole properties
+// section has been located.
+//
+static void qd_message_index_properties_LH(qd_message_content_t *content)
+{
+    content->properties_indexed = true;
+
+    qd_buffer_t   *buffer = content->section_message_properties.buffer;
+    unsigned char *cursor = qd_buffer_base(buffer) + content->section_message_properties.offset;
+    advance(&cursor, &buffer, content->section_message_properties.hdr_length);
+    if (!cursor)
+        return;
+
+    int count = start_list(&cursor, &buffer);
+    if (count > (int) QD_PROPERTIES_FIELD_COUNT)
+        count = QD_PROPERTIES_FIELD_COUNT;
+
+    for (int position = 0; position < count && cursor; position++) {
+        qd_field_location_t *f = (qd_field_location_t *)((char *)content + properties_field_offsets[position]);
+        if (f->parsed)
+            advance(&cursor, &buffer, f->hdr_length + f->length);
+        else if (!traverse_field(&cursor, &buffer, f))
+            return;
+    }
+}
+
+
 // get the field location of a field in the message properties (if it exists,
 // else 0).
 static qd_field_location_t *qd_message_properties_field(qd_message_t *msg, qd_message_field_t field)
 {
-    static const intptr_t offsets[] = {
-        // position of the field's qd_field_location_t in the message content
-        // object
-        (intptr_t) &((qd_message_content_t *)0)->field_message_id,
-        (intptr_t) &((qd_message_content_t *)0)->field_user_id,
-        (intptr_t) &((qd_message_content_t *)0)->field_to,
-        (intptr_t) &((qd_message_content_t *)0)->field_subject,
-        (intptr_t) &((qd_message_content_t *)0)->field_reply_to,
-        (intptr_t) &((qd_message_content_t *)0)->field_correlation_id,
-        (intptr_t) &((qd_message_content_t *)0)->field_content_type,
-        (intptr_t) &((qd_message_content_t *)0)->field_content_encoding,
-        (intptr_t) &((qd_message_content_t *)0)->field_absolute_expiry_time,
-        (intptr_t) &((qd_message_content_t *)0)->field_creation_time,
-        (intptr_t) &((qd_message_content_t *)0)->field_group_id,
-        (intptr_t) &((qd_message_content_t *)0)->field_group_sequence,
-        (intptr_t) &((qd_message_content_t *)0)->field_reply_to_group_id
-    };
-    // update table above if new fields need to be accessed:
+    // update the offsets table if new fields need to be accessed:
     assert(QD_FIELD_MESSAGE_ID <= field && field <= QD_FIELD_REPLY_TO_GROUP_ID);
 
     qd_message_content_t *content = MSG_CONTENT(msg);
@@ -744,32 +1015,16 @@ static qd_field_location_t *qd_message_properties_field(qd_message_t *msg, qd_me
     }
 
     const int index = field - QD_FIELD_MESSAGE_ID;
-    qd_field_location_t *const location = (qd_field_location_t *)((char *)content + offsets[index]);
+    qd_field_location_t *const location = (qd_field_location_t *)((char *)content + properties_field_offsets[index]);
     if (location->parsed)
         return location;
 
-    // requested field not parsed out.  Need to parse out up to the requested field:
-    qd_buffer_t   *buffer = content->section_message_properties.buffer;
-    unsigned char *cursor = qd_buffer_base(buffer) + content->section_message_properties.offset;
-    advance(&cursor, &buffer, content->section_message_properties.hdr_length);
-    if (index >= start_list(&cursor, &buffer)) return 0;  // properties list too short
-
-    int position = 0;
-    while (position < index) {
-        qd_field_location_t *f = (qd_field_location_t *)((char *)content + offsets[position]);
-        if (f->parsed)
-            advance(&cursor, &buffer, f->hdr_length + f->length);
-        else // parse it out
-            if (!traverse_field(&cursor, &buffer, f)) return 0;
-        position++;
-    }
-
-    // all fields previous to the target have now been parsed and cursor/buffer
-    // are in the correct position, parse out the field:
-    if (traverse_field(&cursor, &buffer, location))
-        return location;
+    LOCK(content->lock);
+    if (!content->properties_indexed)
+        qd_message_index_properties_LH(content);
+    UNLOCK(content->lock);
 
-    return 0;
+    return location->parsed ? location : 0;
 }
 
 
@@ -857,6 +1112,49 @@ static qd_field_location_t *qd_message_field_location(qd_message_t *msg, qd_mess
 }
 
 
+static void annotations_decref(qd_message_annotations_t *ma)
+{
+    if (ma == &no_annotations || sys_atomic_dec(&ma->ref_count) != 1)
+        return;
+    qd_buffer_list_free_buffers(&ma->ma_to_override);
+    qd_buffer_list_free_buffers(&ma->ma_trace);
+    qd_buffer_list_free_buffers(&ma->ma_ingress);
+    qd_buffer_list_free_buffers(&ma->ma_trace_compact);
+    qd_buffer_list_free_buffers(&ma->ma_ingress_compact);
+    qd_buffer_list_free_buffers(&ma->ma_sequence);
+    sys_atomic_destroy(&ma->ref_count);
+    free_qd_message_annotations_t(ma);
+}
+
+
+/**
+ * Return the message's annotations for it to change, first giving the message a
+ * block of its own if it has none or shares one with other copies.  The lists
+ * of a shared block are cloned, which shares their buffers rather than copying.
+ */
+static qd_message_annotations_t *annotations_writable(qd_message_pvt_t *msg)
+{
+    qd_message_annotations_t *ma = msg->annotations;
+    if (ma != &no_annotations && sys_atomic_get(&ma->ref_count) == 1)
+        return ma;
+
+    qd_message_annotations_t *own = new_qd_message_annotations_t();
+    ZERO(own);
+    sys_atomic_init(&own->ref_count, 1);
+    qd_buffer_list_clone(&own->ma_to_override, &ma->ma_to_override);
+    qd_buffer_list_clone(&own->ma_trace, &ma->ma_trace);
+    qd_buffer_list_clone(&own->ma_ingress, &ma->ma_ingress);
+    qd_buffer_list_clone(&own->ma_trace_compact, &ma->ma_trace_compact);
+    qd_buffer_list_clone(&own->ma_ingress_compact, &ma->ma_ingress_compact);
+    qd_buffer_list_clone(&own->ma_sequence, &ma->ma_sequence);
+    own->ma_phase = ma->ma_phase;
+
+    annotations_decref(ma);
+    msg->annotations = own;
+    return own;
+}
+
+
 qd_message_t *qd_message()
 {
     qd_message_pvt_t *msg = (qd_message_pvt_t*) new_qd_message_t();
@@ -864,16 +1162,13 @@ qd_message_t *qd_message()
         return 0;
 
     DEQ_ITEM_INIT(msg);
-    DEQ_INIT(msg->ma_to_override);
-    DEQ_INIT(msg->ma_trace);
-    DEQ_INIT(msg->ma_ingress);
-    msg->ma_phase = 0;
-    msg->ma_phase      = 0;
+    msg->annotations   = &no_annotations;
     msg->sent_depth    = QD_DEPTH_NONE;
     msg->cursor.buffer = 0;
     msg->cursor.cursor = 0;
     msg->send_complete = false;
     msg->tag_sent      = false;
+    msg->octets_sent   = 0;
 
     msg->content = new_qd_message_content_t();
 
@@ -886,6 +1181,8 @@ qd_message_t *qd_message()
     msg->content->lock = sys_mutex();
     sys_atomic_init(&msg->content->ref_count, 1);
     msg->content->parse_depth = QD_DEPTH_NONE;
+    msg->content->q2_upper    = QD_QLIMIT_Q2_UPPER;
+    msg->content->q2_lower    = QD_QLIMIT_Q2_LOWER;
 
     return (qd_message_t*) msg;
 }
@@ -897,9 +1194,7 @@ void qd_message_free(qd_message_t *in_msg)
     uint32_t rc;
     qd_message_pvt_t     *msg     = (qd_message_pvt_t*) in_msg;
 
-    qd_buffer_list_free_buffers(&msg->ma_to_override);
-    qd_buffer_list_free_buffers(&msg->ma_trace);
-    qd_buffer_list_free_buffers(&msg->ma_ingress);
+    annotations_decref(msg->annotations);
 
     qd_message_content_t *content = msg->content;
 
@@ -916,10 +1211,14 @@ void qd_message_free(qd_message_t *in_msg)
             qd_parse_free(content->ma_pf_to_override);
         if (content->ma_pf_trace)
             qd_parse_free(content->ma_pf_trace);
+        if (content->ma_pf_sequence)
+            qd_parse_free(content->ma_pf_sequence);
 
+        size_t charged = 0;
         qd_buffer_t *buf = DEQ_HEAD(content->buffers);
         while (buf) {
             DEQ_REMOVE_HEAD(content->buffers);
+            charged += buffer_charge(buf);
             qd_buffer_free(buf);
             buf = DEQ_HEAD(content->buffers);
         }
@@ -927,6 +1226,13 @@ void qd_message_free(qd_message_t *in_msg)
         if (content->pending)
             qd_buffer_free(content->pending);
 
+        qd_buffer_spill_free(content->spill);
+
+        if (content->memory_account) {
+            qd_memory_account_release(content->memory_account, charged);
+            qd_memory_account_decref(content->memory_account);
+        }
+
         sys_mutex_free(content->lock);
         free_qd_message_content_t(content);
     }
@@ -945,10 +1251,9 @@ qd_message_t *qd_message_copy(qd_message_t *in_msg)
         return 0;
 
     DEQ_ITEM_INIT(copy);
-    qd_buffer_list_clone(&copy->ma_to_override, &msg->ma_to_override);
-    qd_buffer_list_clone(&copy->ma_trace, &msg->ma_trace);
-    qd_buffer_list_clone(&copy->ma_ingress, &msg->ma_ingress);
-    copy->ma_phase = msg->ma_phase;
+    copy->annotations = msg->annotations;
+    if (copy->annotations != &no_annotations)
+        sys_atomic_inc(&copy->annotations->ref_count);
     copy->strip_annotations_in  = msg->strip_annotations_in;
 
     copy->content = content;
@@ -958,6 +1263,7 @@ qd_message_t *qd_message_copy(qd_message_t *in_msg)
     copy->cursor.cursor = 0;
     copy->send_complete = false;
     copy->tag_sent      = false;
+    copy->octets_sent   = 0;
 
     qd_message_message_annotations((qd_message_t*) copy);
 
@@ -979,13 +1285,19 @@ void qd_message_message_annotations(qd_message_t *in_msg)
     if (content->ma_field_iter_in == 0)
         return;
 
-    qd_parse_annotations(
+    //
+    // Only locate the router annotations here.  Their values are parsed when
+    // something asks for them, so a message whose annotations are all the
+    // user's costs no more than the scan of the map.
+    //
+    qd_parse_annotations_locate(
         msg->strip_annotations_in,
         content->ma_field_iter_in,
-        &content->ma_pf_ingress,
-        &content->ma_pf_phase,
-        &content->ma_pf_to_override,
-        &content->ma_pf_trace,
+        &content->ma_ingress,
+        &content->ma_phase,
+        &content->ma_to_override,
+        &content->ma_trace,
+        &content->ma_sequence,
         &content->ma_user_annotation_blob,
         &content->ma_count);
 
@@ -1000,51 +1312,82 @@ void qd_message_message_annotations(qd_message_t *in_msg)
         cf->parsed = true;
     }
 
-    // extract phase
-    if (content->ma_pf_phase) {
-        content->ma_int_phase = qd_parse_as_int(content->ma_pf_phase);
-    }
-
     return;
 }
 
 
 void qd_message_set_trace_annotation(qd_message_t *in_msg, qd_composed_field_t *trace_field)
 {
-    qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
-    qd_buffer_list_free_buffers(&msg->ma_trace);
-    qd_compose_take_buffers(trace_field, &msg->ma_trace);
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_trace);
+    qd_compose_take_buffers(trace_field, &ma->ma_trace);
     qd_compose_free(trace_field);
 }
 
 void qd_message_set_to_override_annotation(qd_message_t *in_msg, qd_composed_field_t *to_field)
 {
-    qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
-    qd_buffer_list_free_buffers(&msg->ma_to_override);
-    qd_compose_take_buffers(to_field, &msg->ma_to_override);
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_to_override);
+    qd_compose_take_buffers(to_field, &ma->ma_to_override);
     qd_compose_free(to_field);
 }
 
+void qd_message_set_to_override_buffers(qd_message_t *in_msg, const qd_buffer_list_t *to_buffers)
+{
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_to_override);
+    qd_buffer_list_clone(&ma->ma_to_override, to_buffers);
+}
+
 void qd_message_set_phase_annotation(qd_message_t *in_msg, int phase)
 {
     qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
-    msg->ma_phase = phase;
+    if (msg->annotations->ma_phase != phase)
+        annotations_writable(msg)->ma_phase = phase;
 }
 
 int qd_message_get_phase_annotation(const qd_message_t *in_msg)
 {
     qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
-    return msg->ma_phase;
+    return msg->annotations->ma_phase;
 }
 
 void qd_message_set_ingress_annotation(qd_message_t *in_msg, qd_composed_field_t *ingress_field)
 {
-    qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
-    qd_buffer_list_free_buffers(&msg->ma_ingress);
-    qd_compose_take_buffers(ingress_field, &msg->ma_ingress);
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_ingress);
+    qd_compose_take_buffers(ingress_field, &ma->ma_ingress);
     qd_compose_free(ingress_field);
 }
 
+void qd_message_set_compact_annotations(qd_message_t *in_msg, qd_composed_field_t *trace_field, qd_composed_field_t *ingress_field)
+{
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_trace_compact);
+    qd_buffer_list_free_buffers(&ma->ma_ingress_compact);
+    if (trace_field) {
+        qd_compose_take_buffers(trace_field, &ma->ma_trace_compact);
+        qd_compose_free(trace_field);
+    }
+    if (ingress_field) {
+        qd_compose_take_buffers(ingress_field, &ma->ma_ingress_compact);
+        qd_compose_free(ingress_field);
+    }
+}
+
+void qd_message_set_sequence_annotation(qd_message_t *in_msg, qd_composed_field_t *sequence_field)
+{
+    qd_message_annotations_t *ma = annotations_writable((qd_message_pvt_t*) in_msg);
+    qd_buffer_list_free_buffers(&ma->ma_sequence);
+    qd_compose_take_buffers(sequence_field, &ma->ma_sequence);
+    qd_compose_free(sequence_field);
+}
+
+bool qd_message_has_sequence_annotation(const qd_message_t *in_msg)
+{
+    return !DEQ_IS_EMPTY(((qd_message_pvt_t*) in_msg)->annotations->ma_sequence);
+}
+
 bool qd_message_is_discard(qd_message_t *msg)
 {
     if (!msg)
@@ -1062,6 +1405,20 @@ void qd_message_set_discard(qd_message_t *msg, bool discard)
     pvt_msg->content->discard = discard;
 }
 
+size_t qd_message_octets_sent(qd_message_t *in_msg)
+{
+    return in_msg ? ((qd_message_pvt_t*) in_msg)->octets_sent : 0;
+}
+
+size_t qd_message_buffered_size(qd_message_t *in_msg)
+{
+    if (!in_msg)
+        return 0;
+    qd_message_pvt_t *msg = (qd_message_pvt_t*) in_msg;
+    return msg->content->buffer_octets;
+}
+
+
 size_t qd_message_fanout(qd_message_t *in_msg)
 {
     if (!in_msg)
@@ -1092,6 +1449,21 @@ void qd_message_add_num_closed_receivers(qd_message_t *in_msg)
 * This also means that messages must always have a priority,
 * using default value if sender leaves it unspecified.
 */
+bool qd_message_group_hash(qd_message_t *msg, uint32_t *hash)
+{
+    qd_field_location_t *location = qd_message_properties_field(msg, QD_FIELD_GROUP_ID);
+    if (!location || location->tag == QD_AMQP_NULL || location->length == 0)
+        return false;
+
+    qd_iterator_t iter;
+    qd_iterator_init_buffer(&iter, location->buffer, location->offset + location->hdr_length,
+                            location->length, ITER_VIEW_ALL);
+    *hash = qd_iterator_hash_view(&iter);
+    qd_iterator_fini(&iter);
+    return true;
+}
+
+
 uint8_t qd_message_get_priority(qd_message_t *msg)
 {
     qd_message_content_t *content = MSG_CONTENT(msg);
@@ -1102,6 +1474,61 @@ uint8_t qd_message_get_priority(qd_message_t *msg)
     return content->priority_present ? content->priority : QDR_DEFAULT_PRIORITY;
 }
 
+
+static void qd_message_parse_expiry(qd_message_t *in_msg)
+{
+    qd_message_content_t *content = MSG_CONTENT(in_msg);
+    int64_t               expiry  = 0;
+
+    //
+    // A zero ttl is taken as no ttl, as clients that always send the field do.
+    //
+    qd_iterator_t *iter = qd_message_field_iterator(in_msg, QD_FIELD_HEADER);
+    if (iter) {
+        qd_parsed_field_t *field = qd_parse(iter);
+        if (qd_parse_ok(field) && qd_parse_is_list(field) && qd_parse_sub_count(field) >= 3) {
+            qd_parsed_field_t *ttl_field = qd_parse_sub_value(field, 2);
+            uint32_t           ttl       = qd_parse_tag(ttl_field) != QD_AMQP_NULL ? qd_parse_as_uint(ttl_field) : 0;
+            if (ttl > 0)
+                expiry = qd_timer_now() + ttl;
+        }
+        qd_parse_free(field);
+        qd_iterator_free(iter);
+    }
+
+    iter = qd_message_field_iterator_typed(in_msg, QD_FIELD_ABSOLUTE_EXPIRY_TIME);
+    if (iter) {
+        qd_parsed_field_t *field = qd_parse(iter);
+        if (qd_parse_ok(field) && qd_parse_tag(field) == QD_AMQP_TIMESTAMP) {
+            int64_t absolute = (int64_t) qd_parse_as_ulong(field);
+            if (absolute > 0 && (expiry == 0 || absolute < expiry))
+                expiry = absolute;
+        }
+        qd_parse_free(field);
+        qd_iterator_free(iter);
+    }
+
+    content->expiry        = expiry;
+    content->expiry_parsed = true;
+}
+
+
+int64_t qd_message_expiry(qd_message_t *msg)
+{
+    qd_message_content_t *content = MSG_CONTENT(msg);
+
+    if (!content->expiry_parsed)
+        qd_message_parse_expiry(msg);
+
+    return content->expiry;
+}
+
+
+uint64_t qd_message_trace_id(const qd_message_t *msg)
+{
+    return msg ? (uint64_t) (uintptr_t) MSG_CONTENT(msg) : 0;
+}
+
 bool qd_message_receive_complete(qd_message_t *in_msg)
 {
     if (!in_msg)
@@ -1191,6 +1618,64 @@ qd_message_t * qd_get_message_context(pn_delivery_t *delivery)
 }
 
 
+//
+// On a link whose connection compresses, every delivery starts with one octet
+// saying how the rest of it is encoded.
+//
+#define QD_WIRE_UNKNOWN 0  // The first octet has not arrived
+#define QD_WIRE_RAW     1
+#define QD_WIRE_DEFLATE 2
+#define QD_WIRE_ERROR   3  // The compressed bytes were corrupt
+
+
+//
+// Read message bytes from the link, through the link's inflater when the delivery
+// was sent compressed.  Returns as pn_link_recv does.
+//
+static ssize_t link_recv(qd_message_content_t *content, pn_link_t *pnl, qd_link_t *qdl, char *data, size_t capacity)
+{
+    qd_inflater_t *inflater = qd_link_inflater(qdl);
+    if (!inflater || content->wire_encoding == QD_WIRE_RAW)
+        return pn_link_recv(pnl, data, capacity);
+
+    if (content->wire_encoding == QD_WIRE_UNKNOWN) {
+        char    encoding;
+        ssize_t rc = pn_link_recv(pnl, &encoding, 1);
+        if (rc <= 0)
+            return rc;
+        content->wire_encoding = encoding == QD_WIRE_DEFLATE ? QD_WIRE_DEFLATE : QD_WIRE_RAW;
+        if (content->wire_encoding == QD_WIRE_RAW)
+            return pn_link_recv(pnl, data, capacity);
+        qd_inflater_reset(inflater);
+    }
+
+    if (content->wire_encoding == QD_WIRE_ERROR)
+        return PN_ERR;
+
+    while (true) {
+        ssize_t produced = qd_inflater_read(inflater, data, capacity);
+        if (produced < 0) {
+            content->wire_encoding = QD_WIRE_ERROR;
+            return PN_ERR;
+        }
+        if (produced > 0) {
+            qd_connection_count_compressed(qd_link_connection(qdl), false, produced, 0);
+            return produced;
+        }
+
+        size_t room;
+        char  *input = qd_inflater_input(inflater, &room);
+        if (!input)
+            return 0;
+        ssize_t rc = pn_link_recv(pnl, input, room);
+        if (rc <= 0)
+            return rc;
+        qd_inflater_input_added(inflater, rc);
+        qd_connection_count_compressed(qd_link_connection(qdl), false, 0, rc);
+    }
+}
+
+
 qd_message_t *qd_message_receive(pn_delivery_t *delivery)
 {
     pn_link_t        *link = pn_delivery_link(delivery);
@@ -1210,6 +1695,9 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
         qd_link_t       *qdl = (qd_link_t *)pn_link_get_context(link);
         qd_connection_t *qdc = qd_link_connection(qdl);
         msg->content->input_link = pn_link_get_context(link);
+        msg->content->memory_account = qd_connection_memory_account(qdc);
+        msg->content->q2_upper = qd_link_q2_upper(qdl);
+        msg->content->q2_lower = qd_link_q2_lower(qdl);
         msg->strip_annotations_in  = qd_connection_strip_annotations_in(qdc);
         pn_record_def(record, PN_DELIVERY_CTX, PN_WEAKREF);
         pn_record_set(record, PN_DELIVERY_CTX, (void*) msg);
@@ -1236,14 +1724,17 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
     }
 
     // Loop until msg is complete, error seen, or incoming bytes are consumed
-    bool recv_error = false;
+    bool   recv_error = false;
+    size_t received   = 0;
     while (1) {
         //
         // handle EOS and clean up after pn receive errors
         //
         bool at_eos = (pn_delivery_partial(delivery) == false) &&
                       (pn_delivery_aborted(delivery) == false) &&
-                      (pn_delivery_pending(delivery) == 0);
+                      (pn_delivery_pending(delivery) == 0) &&
+                      !(msg->content->wire_encoding == QD_WIRE_DEFLATE &&
+                        qd_inflater_pending(qd_link_inflater(qdl)));
 
         if (at_eos || recv_error) {
             // Message is complete
@@ -1255,6 +1746,11 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
                         // pending buffer has bytes that are port of message
                         DEQ_INSERT_TAIL(msg->content->buffers,
                                         msg->content->pending);
+                        sys_atomic_ptr_swap(&msg->content->published_tail, msg->content->pending);
+                        content_add_buffer(msg->content, msg->content->pending);
+                        qd_memory_account_charge(msg->content->memory_account,
+                                                 buffer_charge(msg->content->pending));
+                        qd_buffer_spill_evict(msg->content->pending);
                     } else {
                         // pending buffer is empty
                         qd_buffer_free(msg->content->pending);
@@ -1265,13 +1761,18 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
                 }
 
                 msg->content->receive_complete = true;
-                msg->content->aborted = pn_delivery_aborted(delivery);
+                msg->content->aborted = pn_delivery_aborted(delivery) ||
+                                        msg->content->wire_encoding == QD_WIRE_ERROR;
                 msg->content->input_link = 0;
+                qd_message_index_received_LH(msg->content);
+                QD_PROBE2(message_received, qd_message_trace_id((qd_message_t*) msg), qdl);
 
                 // unlink message and delivery
                 pn_record_set(record, PN_DELIVERY_CTX, 0);
             }
             UNLOCK(msg->content->lock);
+            if (!msg->content->aborted)
+                qd_connection_frame_sample(qd_link_connection(qdl), msg->content->octets_received + received);
             break;
         }
 
@@ -1279,24 +1780,31 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
         // Handle a missing or full pending buffer
         //
         if (!msg->content->pending) {
-            // Pending buffer is absent: get a new one
-            msg->content->pending = qd_buffer();
+            // Pending buffer is absent: get a new one sized for what has arrived
+            msg->content->pending = receive_buffer(msg->content, pn_delivery_pending(delivery));
         } else {
             // Pending buffer exists
             if (qd_buffer_capacity(msg->content->pending) == 0) {
                 // Pending buffer is full
                 LOCK(msg->content->lock);
                 DEQ_INSERT_TAIL(msg->content->buffers, msg->content->pending);
+                sys_atomic_ptr_swap(&msg->content->published_tail, msg->content->pending);
+                content_add_buffer(msg->content, msg->content->pending);
+                qd_memory_account_charge(msg->content->memory_account,
+                                         buffer_charge(msg->content->pending));
+                qd_buffer_spill_evict(msg->content->pending);
                 msg->content->pending = 0;
+                qd_message_index_received_LH(msg->content);
                 if (qd_message_Q2_holdoff_should_block((qd_message_t *)msg)) {
                     if (!qd_link_is_q2_limit_unbounded(qdl)) {
                         msg->content->q2_input_holdoff = true;
+                        qd_link_q2_stalled(qdl);
                         UNLOCK(msg->content->lock);
                         break;
                     }
                 }
                 UNLOCK(msg->content->lock);
-                msg->content->pending = qd_buffer();
+                msg->content->pending = receive_buffer(msg->content, pn_delivery_pending(delivery));
             } else {
                 // Pending buffer still has capacity
             }
@@ -1305,9 +1813,9 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
         //
         // Try to fill the remaining space in the pending buffer.
         //
-        rc = pn_link_recv(link,
-                          (char*) qd_buffer_cursor(msg->content->pending),
-                          qd_buffer_capacity(msg->content->pending));
+        rc = link_recv(msg->content, link, qdl,
+                       (char*) qd_buffer_cursor(msg->content->pending),
+                       qd_buffer_capacity(msg->content->pending));
 
         if (rc < 0) {
             // error or eos seen. next pass breaks out of loop
@@ -1318,6 +1826,7 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
             // the cursor in the buffer.
             //
             qd_buffer_insert(msg->content->pending, rc);
+            received += rc;
         } else {
             //
             // We received zero bytes, and no PN_EOS.  This means that we've received
@@ -1329,14 +1838,79 @@ qd_message_t *qd_message_receive(pn_delivery_t *delivery)
         }
     }
 
+    if (received) {
+        msg->content->octets_received += received;
+        qd_connection_count_frame_octets(qd_link_connection(qdl), false, received);
+        qd_connection_window_received(qd_link_connection(qdl), received);
+    }
+
     return (qd_message_t*) msg;
 }
 
 
+//
+// The sections ahead of the body are sent as a run of small fragments, each from its
+// own buffer.  They are gathered into one block so that proton sees a single send
+// for all of them rather than one per fragment.
+//
+#define SEND_GATHER_SIZE 1024
+
+typedef struct {
+    pn_link_t *pnl;
+    qd_link_t *link;
+    bool       compressed;
+    int        length;
+    size_t     sent;
+    char       data[SEND_GATHER_SIZE];
+} send_gather_t;
+
+
+static void deflate_output(void *context, const char *data, size_t length)
+{
+    pn_link_send((pn_link_t*) context, data, length);
+}
+
+
+//
+// Write message bytes to the link, through the link's deflater when the delivery
+// is sent compressed.
+//
+static void link_send(pn_link_t *pnl, qd_link_t *link, bool compressed, const char *data, size_t length)
+{
+    if (!compressed) {
+        pn_link_send(pnl, data, length);
+        return;
+    }
+
+    ssize_t wire = qd_deflater_write(qd_link_deflater(link), data, length, deflate_output, pnl);
+    qd_connection_count_compressed(qd_link_connection(link), true, length, wire > 0 ? wire : 0);
+}
+
+
+static void send_gather_flush(send_gather_t *gather)
+{
+    if (gather->length > 0) {
+        link_send(gather->pnl, gather->link, gather->compressed, gather->data, gather->length);
+        gather->sent  += gather->length;
+        gather->length = 0;
+    }
+}
+
+
 static void send_handler(void *context, const unsigned char *start, int length)
 {
-    pn_link_t *pnl = (pn_link_t*) context;
-    pn_link_send(pnl, (const char*) start, length);
+    send_gather_t *gather = (send_gather_t*) context;
+
+    if (gather->length + length > SEND_GATHER_SIZE) {
+        send_gather_flush(gather);
+        if (length > SEND_GATHER_SIZE) {
+            link_send(gather->pnl, gather->link, gather->compressed, (const char*) start, length);
+            gather->sent += length;
+            return;
+        }
+    }
+    memcpy(gather->data + gather->length, start, length);
+    gather->length += length;
 }
 
 
@@ -1373,38 +1947,53 @@ static void compose_message_annotations_v1(qd_message_pvt_t *msg, qd_buffer_list
     if (!field)
         return;
 
-    // add dispatch router specific annotations if any are defined
-    if (!DEQ_IS_EMPTY(msg->ma_to_override) ||
-        !DEQ_IS_EMPTY(msg->ma_trace) ||
-        !DEQ_IS_EMPTY(msg->ma_ingress) ||
-        msg->ma_phase != 0) {
+    // add dispatch router specific annotations if any are defined.  The
+    // annotations may be shared with other copies, so they are cloned into the
+    // composed field rather than moved.
+    qd_message_annotations_t *ma = msg->annotations;
+    qd_buffer_list_t          copy;
+    if (!DEQ_IS_EMPTY(ma->ma_to_override) ||
+        !DEQ_IS_EMPTY(ma->ma_trace) ||
+        !DEQ_IS_EMPTY(ma->ma_ingress) ||
+        !DEQ_IS_EMPTY(ma->ma_sequence) ||
+        ma->ma_phase != 0) {
 
         if (!map_started) {
             qd_compose_start_map(out_ma);
             map_started = true;
         }
 
-        if (!DEQ_IS_EMPTY(msg->ma_to_override)) {
+        if (!DEQ_IS_EMPTY(ma->ma_to_override)) {
             qd_compose_insert_symbol(field, QD_MA_TO);
-            qd_compose_insert_buffers(field, &msg->ma_to_override);
+            qd_buffer_list_clone(&copy, &ma->ma_to_override);
+            qd_compose_insert_buffers(field, &copy);
             field_count++;
         }
 
-        if (!DEQ_IS_EMPTY(msg->ma_trace)) {
+        if (!DEQ_IS_EMPTY(ma->ma_trace)) {
             qd_compose_insert_symbol(field, QD_MA_TRACE);
-            qd_compose_insert_buffers(field, &msg->ma_trace);
+            qd_buffer_list_clone(&copy, &ma->ma_trace);
+            qd_compose_insert_buffers(field, &copy);
             field_count++;
         }
 
-        if (!DEQ_IS_EMPTY(msg->ma_ingress)) {
+        if (!DEQ_IS_EMPTY(ma->ma_ingress)) {
             qd_compose_insert_symbol(field, QD_MA_INGRESS);
-            qd_compose_insert_buffers(field, &msg->ma_ingress);
+            qd_buffer_list_clone(&copy, &ma->ma_ingress);
+            qd_compose_insert_buffers(field, &copy);
             field_count++;
         }
 
-        if (msg->ma_phase != 0) {
+        if (ma->ma_phase != 0) {
             qd_compose_insert_symbol(field, QD_MA_PHASE);
-            qd_compose_insert_int(field, msg->ma_phase);
+            qd_compose_insert_int(field, ma->ma_phase);
+            field_count++;
+        }
+
+        if (!DEQ_IS_EMPTY(ma->ma_sequence)) {
+            qd_compose_insert_symbol(field, QD_MA_SEQUENCE);
+            qd_buffer_list_clone(&copy, &ma->ma_sequence);
+            qd_compose_insert_buffers(field, &copy);
             field_count++;
         }
         // pad out to N fields
@@ -1463,6 +2052,149 @@ static void compose_message_annotations(qd_message_pvt_t *msg, qd_buffer_list_t
 }
 
 
+static void send_uint32(send_gather_t *gather, uint32_t value)
+{
+    unsigned char octets[4] = {(unsigned char) (value >> 24), (unsigned char) (value >> 16),
+                               (unsigned char) (value >> 8),  (unsigned char) value};
+    send_handler(gather, octets, 4);
+}
+
+
+//
+// The encoded length of a symbol or string as qd_compose_insert_symbol and
+// qd_compose_insert_string write it
+//
+static inline uint32_t variable_length(uint32_t length)
+{
+    return (length < 256 ? 2 : 5) + length;
+}
+
+
+static void send_variable(send_gather_t *gather, uint8_t tag8, uint8_t tag32, const char *value)
+{
+    uint32_t length = strlen(value);
+    if (length < 256) {
+        unsigned char header[2] = {tag8, (unsigned char) length};
+        send_handler(gather, header, 2);
+    } else {
+        unsigned char tag = tag32;
+        send_handler(gather, &tag, 1);
+        send_uint32(gather, length);
+    }
+    send_handler(gather, (const unsigned char*) value, length);
+}
+
+
+// Send a router annotation value, consuming its buffers as composing it would
+// The value stays with the message, whose annotations other copies may share
+static void send_annotation_value(send_gather_t *gather, const char *key, const qd_buffer_list_t *value)
+{
+    send_variable(gather, QD_AMQP_SYM8, QD_AMQP_SYM32, key);
+    qd_buffer_t *buf = DEQ_HEAD(*value);
+    while (buf) {
+        send_handler(gather, qd_buffer_base(buf), qd_buffer_size(buf));
+        buf = DEQ_NEXT(buf);
+    }
+}
+
+
+//
+// Write the outgoing message annotations section straight into the send
+// gather, in the encoding compose_message_annotations would produce, with the
+// user annotations blob copied in from the incoming message.  Every length is
+// known up front, so no intermediate buffers are composed.
+//
+static void send_message_annotations(qd_message_pvt_t *msg, send_gather_t *gather, bool strip_annotations, bool compact)
+{
+    qd_message_content_t     *content     = msg->content;
+    qd_message_annotations_t *ma          = msg->annotations;
+    const qd_buffer_list_t   *trace       = compact && !DEQ_IS_EMPTY(ma->ma_trace_compact) ? &ma->ma_trace_compact : &ma->ma_trace;
+    const qd_buffer_list_t   *ingress     = compact && !DEQ_IS_EMPTY(ma->ma_ingress_compact) ? &ma->ma_ingress_compact : &ma->ma_ingress;
+    uint32_t                  field_count = 0;
+    uint32_t                  router_size = 0;
+    int                       padding     = 0;
+    bool                      router      = !strip_annotations &&
+        (!DEQ_IS_EMPTY(ma->ma_to_override) || !DEQ_IS_EMPTY(*trace) ||
+         !DEQ_IS_EMPTY(*ingress) || !DEQ_IS_EMPTY(ma->ma_sequence) || ma->ma_phase != 0);
+
+    if (router) {
+        if (!DEQ_IS_EMPTY(ma->ma_to_override)) {
+            router_size += variable_length(strlen(QD_MA_TO)) + qd_buffer_list_length(&ma->ma_to_override);
+            field_count++;
+        }
+        if (!DEQ_IS_EMPTY(*trace)) {
+            router_size += variable_length(strlen(QD_MA_TRACE)) + qd_buffer_list_length(trace);
+            field_count++;
+        }
+        if (!DEQ_IS_EMPTY(*ingress)) {
+            router_size += variable_length(strlen(QD_MA_INGRESS)) + qd_buffer_list_length(ingress);
+            field_count++;
+        }
+        if (ma->ma_phase != 0) {
+            router_size += variable_length(strlen(QD_MA_PHASE)) + (ma->ma_phase >= -128 && ma->ma_phase <= 127 ? 2 : 5);
+            field_count++;
+        }
+        if (!DEQ_IS_EMPTY(ma->ma_sequence)) {
+            router_size += variable_length(strlen(QD_MA_SEQUENCE)) + qd_buffer_list_length(&ma->ma_sequence);
+            field_count++;
+        }
+        // pad out to N fields
+        padding      = QD_MA_N_KEYS - field_count;
+        router_size += padding * (variable_length(strlen(QD_MA_PREFIX)) + variable_length(1));
+        field_count  = QD_MA_N_KEYS;
+    }
+
+    if (!router && content->ma_count == 0)
+        return;
+
+    //
+    // Section descriptor and map header
+    //
+    static const unsigned char descriptor[] = {0x00, QD_AMQP_SMALLULONG, (unsigned char) QD_PERFORMATIVE_MESSAGE_ANNOTATIONS, QD_AMQP_MAP32};
+    send_handler(gather, descriptor, sizeof(descriptor));
+    send_uint32(gather, 4 + content->field_user_annotations.length + router_size);
+    send_uint32(gather, content->ma_count + field_count * 2);
+
+    //
+    // The incoming message's user annotations, then the router annotations
+    //
+    if (content->field_user_annotations.length > 0) {
+        qd_buffer_t   *buf    = content->field_user_annotations.buffer;
+        unsigned char *cursor = content->field_user_annotations.offset + qd_buffer_base(buf);
+        advance_guarded(&cursor, &buf, content->field_user_annotations.length, send_handler, (void*) gather);
+    }
+
+    if (!router)
+        return;
+
+    if (!DEQ_IS_EMPTY(ma->ma_to_override))
+        send_annotation_value(gather, QD_MA_TO, &ma->ma_to_override);
+    if (!DEQ_IS_EMPTY(*trace))
+        send_annotation_value(gather, QD_MA_TRACE, trace);
+    if (!DEQ_IS_EMPTY(*ingress))
+        send_annotation_value(gather, QD_MA_INGRESS, ingress);
+    if (ma->ma_phase != 0) {
+        send_variable(gather, QD_AMQP_SYM8, QD_AMQP_SYM32, QD_MA_PHASE);
+        if (ma->ma_phase >= -128 && ma->ma_phase <= 127) {
+            unsigned char phase[2] = {QD_AMQP_SMALLINT, (unsigned char) ma->ma_phase};
+            send_handler(gather, phase, 2);
+        } else {
+            unsigned char tag = QD_AMQP_INT;
+            send_handler(gather, &tag, 1);
+            send_uint32(gather, (uint32_t) ma->ma_phase);
+        }
+    }
+    if (!DEQ_IS_EMPTY(ma->ma_sequence))
+        send_annotation_value(gather, QD_MA_SEQUENCE, &ma->ma_sequence);
+
+    static const unsigned char pad_value[] = {QD_AMQP_STR8_UTF8, 1, 'X'};
+    for (int pad = padding; pad > 0; pad--) {
+        send_variable(gather, QD_AMQP_SYM8, QD_AMQP_SYM32, QD_MA_PREFIX);
+        send_handler(gather, pad_value, sizeof(pad_value));
+    }
+}
+
+
 void qd_message_send(qd_message_t *in_msg,
                      qd_link_t    *link,
                      bool          strip_annotations,
@@ -1490,13 +2222,27 @@ void qd_message_send(qd_message_t *in_msg,
             return;
         }
 
-        qd_buffer_list_t new_ma;
-        qd_buffer_list_t new_ma_trailer;
-        DEQ_INIT(new_ma);
-        DEQ_INIT(new_ma_trailer);
+        //
+        // On a compressing connection, open the delivery with its encoding.  A
+        // message already known to be small is not worth compressing.
+        //
+        qd_deflater_t *deflater = qd_link_deflater(link);
+        if (deflater) {
+            const qd_server_config_t *cf = qd_connection_config(qd_link_connection(link));
+            msg->send_compressed = !content->receive_complete || !cf ||
+                qd_message_buffered_size(in_msg) >= cf->compression_min_bytes;
+            char encoding = msg->send_compressed ? QD_WIRE_DEFLATE : QD_WIRE_RAW;
+            pn_link_send(pnl, &encoding, 1);
+            if (msg->send_compressed)
+                qd_deflater_reset(deflater);
+        }
 
-        // Process  the message annotations if any
-        compose_message_annotations(msg, &new_ma, &new_ma_trailer, strip_annotations);
+        send_gather_t gather;
+        gather.pnl        = pnl;
+        gather.link       = link;
+        gather.compressed = msg->send_compressed;
+        gather.length     = 0;
+        gather.sent       = 0;
 
         //
         // Start with the very first buffer;
@@ -1512,7 +2258,7 @@ void qd_message_send(qd_message_t *in_msg,
         if (content->section_message_header.length > 0) {
             buf    = content->section_message_header.buffer;
             cursor = content->section_message_header.offset + qd_buffer_base(buf);
-            advance_guarded(&cursor, &buf, header_consume, send_handler, (void*) pnl);
+            advance_guarded(&cursor, &buf, header_consume, send_handler, (void*) &gather);
         }
 
         //
@@ -1522,41 +2268,16 @@ void qd_message_send(qd_message_t *in_msg,
         if (content->section_delivery_annotation.length > 0) {
             buf    = content->section_delivery_annotation.buffer;
             cursor = content->section_delivery_annotation.offset + qd_buffer_base(buf);
-            advance_guarded(&cursor, &buf, da_consume, send_handler, (void*) pnl);
+            advance_guarded(&cursor, &buf, da_consume, send_handler, (void*) &gather);
         }
 
         //
-        // Send new message annotations map start if any
+        // Send the new message annotations, including any user annotations
         //
-        qd_buffer_t *da_buf = DEQ_HEAD(new_ma);
-        while (da_buf) {
-            char *to_send = (char*) qd_buffer_base(da_buf);
-            pn_link_send(pnl, to_send, qd_buffer_size(da_buf));
-            da_buf = DEQ_NEXT(da_buf);
-        }
-        qd_buffer_list_free_buffers(&new_ma);
-
-        //
-        // Annotations possibly include an opaque blob of user annotations
-        //
-        if (content->field_user_annotations.length > 0) {
-            qd_buffer_t *buf2      = content->field_user_annotations.buffer;
-            unsigned char *cursor2 = content->field_user_annotations.offset + qd_buffer_base(buf);
-            advance_guarded(&cursor2, &buf2,
-                            content->field_user_annotations.length,
-                            send_handler, (void*) pnl);
-        }
-
-        //
-        // Annotations may include the v1 new_ma_trailer
-        //
-        qd_buffer_t *ta_buf = DEQ_HEAD(new_ma_trailer);
-        while (ta_buf) {
-            char *to_send = (char*) qd_buffer_base(ta_buf);
-            pn_link_send(pnl, to_send, qd_buffer_size(ta_buf));
-            ta_buf = DEQ_NEXT(ta_buf);
-        }
-        qd_buffer_list_free_buffers(&new_ma_trailer);
+        send_message_annotations(msg, &gather, strip_annotations,
+                                 qd_connection_compact_annotations(qd_link_connection(link)));
+        send_gather_flush(&gather);
+        msg->octets_sent += gather.sent;
 
 
         //
@@ -1583,12 +2304,14 @@ void qd_message_send(qd_message_t *in_msg,
     buf = msg->cursor.buffer;
     assert (buf);
 
-    pn_session_t     *pns  = pn_link_session(pnl);
+    pn_session_t     *pns      = pn_link_session(pnl);
+    size_t            q3_upper = qd_link_q3_upper(link);
+    size_t            sent     = 0;
 
     while (msg->content->aborted ||
            (buf &&
             (msg->cursor.cursor < qd_buffer_cursor(buf) || buf->next != 0) &&
-            pn_session_outgoing_bytes(pns) <= QD_QLIMIT_Q3_UPPER)) {
+            pn_session_outgoing_bytes(pns) <= q3_upper)) {
 
         if (msg->content->aborted) {
             if (pn_link_current(pnl)) {
@@ -1606,22 +2329,53 @@ void qd_message_send(qd_message_t *in_msg,
         int num_bytes_to_send = buf_size - (msg->cursor.cursor - qd_buffer_base(buf));
         if (num_bytes_to_send > 0) {
             // We are deliberately avoiding the return value of pn_link_send because we can't do anything nice with it.
-            (void) pn_link_send(pnl, (const char*)msg->cursor.cursor, num_bytes_to_send);
+            link_send(pnl, link, msg->send_compressed, (const char*)msg->cursor.cursor, num_bytes_to_send);
+            sent += num_bytes_to_send;
+            msg->octets_sent += num_bytes_to_send;
         }
 
-        // If the entire message has already been received,  taking out this lock is not that expensive
-        // because there is no contention for this lock.
-        LOCK(msg->content->lock);
+        //
+        // Cut-through: the receiver publishes each buffer it appends, after linking it
+        // in, so any buffer short of the published tail already has its successor
+        // linked and can be followed without the content lock.  The lock is only taken
+        // to free buffers every receiver has passed and to settle the end of the chain.
+        // Messages not built by qd_message_receive have no published tail and their
+        // chain is complete.
+        //
+        qd_buffer_t *tail     = (qd_buffer_t*) sys_atomic_ptr_get(&content->published_tail);
+        qd_buffer_t *next_buf = (tail && buf == tail) ? 0 : DEQ_NEXT(buf);
+        bool         locked   = false;
+
+        if (!next_buf) {
+            LOCK(msg->content->lock);
+            locked   = true;
+            next_buf = DEQ_NEXT(buf);
+        }
 
-        qd_buffer_t *next_buf = DEQ_NEXT(buf);
         if (next_buf) {
             // There is a next buffer, the previous buffer has been fully sent by now.
-            qd_buffer_add_fanout(buf);
-
-            if (qd_message_fanout(in_msg) - msg->content->num_closed_receivers == qd_buffer_fanout(buf)) {
+            //
+            // A sole live receiver (anycast and link-routed deliveries) needs no
+            // per-buffer count: everything behind its cursor is done with and can be
+            // released as it goes.  Multicast copies count their passes in bfanout and
+            // the last one through frees.  A fanout of zero means the message was not
+            // forwarded and some other holder may still read it, so nothing is freed.
+            //
+            bool sole_receiver = qd_message_fanout(in_msg) - msg->content->num_closed_receivers == 1;
+            if (!sole_receiver)
+                qd_buffer_add_fanout(buf);
+
+            if (sole_receiver ||
+                qd_message_fanout(in_msg) - msg->content->num_closed_receivers == qd_buffer_fanout(buf)) {
+                if (!locked) {
+                    LOCK(msg->content->lock);
+                    locked = true;
+                }
                 qd_buffer_t *local_buf = DEQ_HEAD(content->buffers);
                 while (local_buf && local_buf != next_buf) {
                     DEQ_REMOVE_HEAD(content->buffers);
+                    content_remove_buffer(content, local_buf);
+                    qd_memory_account_release(content->memory_account, buffer_charge(local_buf));
                     qd_buffer_free(local_buf);
                     if (!msg->content->buffers_freed)
                         msg->content->buffers_freed = true;
@@ -1674,56 +2428,80 @@ void qd_message_send(qd_message_t *in_msg,
             }
         }
 
-        UNLOCK(msg->content->lock);
+        if (locked)
+            UNLOCK(msg->content->lock);
 
         buf = next_buf;
     }
 
-    *q3_stalled = (pn_session_outgoing_bytes(pns) > QD_QLIMIT_Q3_UPPER);
+    *q3_stalled = (pn_session_outgoing_bytes(pns) > q3_upper);
+
+    if (sent)
+        qd_connection_count_frame_octets(qd_link_connection(link), true, sent);
+    if (sent || msg->send_complete)
+        qd_connection_window_sent(qd_link_connection(link), pnl, sent, msg->send_complete);
+
+    if (msg->send_complete)
+        QD_PROBE2(message_sent, qd_message_trace_id(in_msg), link);
 }
 
 
-static int qd_check_field_LH(qd_message_content_t *content,
-                             qd_message_depth_t    depth,
-                             const unsigned char  *long_pattern,
-                             const unsigned char  *short_pattern,
-                             const unsigned char  *expected_tags,
-                             qd_field_location_t  *location,
-                             int                   more)
+static qd_section_status_t qd_check_field_LH(qd_message_content_t *content,
+                                             qd_message_depth_t    depth,
+                                             const unsigned char  *long_pattern,
+                                             const unsigned char  *short_pattern,
+                                             const unsigned char  *expected_tags,
+                                             qd_field_location_t  *location,
+                                             int                   more)
 {
 #define LONG  10
 #define SHORT 3
     if (depth > content->parse_depth) {
-        if (0 == qd_check_and_advance(&content->parse_buffer, &content->parse_cursor, long_pattern,  LONG,  expected_tags, location))
-            return 0;
-        if (0 == qd_check_and_advance(&content->parse_buffer, &content->parse_cursor, short_pattern, SHORT, expected_tags, location))
-            return 0;
+        //
+        // While the message is still arriving, a section that is not yet complete must
+        // be checked again later rather than treated as absent.  A message held off by
+        // Q2 cannot deliver more until it is drained, so it is checked as it stands.
+        //
+        bool more_expected = !content->receive_complete && !!content->input_link && !content->q2_input_holdoff;
+        qd_section_status_t status;
+
+        status = qd_check_and_advance(&content->parse_buffer, &content->parse_cursor, long_pattern,  LONG,  expected_tags, location, more_expected);
+        if (status != QD_SECTION_OK)
+            return status;
+        status = qd_check_and_advance(&content->parse_buffer, &content->parse_cursor, short_pattern, SHORT, expected_tags, location, more_expected);
+        if (status != QD_SECTION_OK)
+            return status;
         if (!more)
             content->parse_depth = depth;
     }
-    return 1;
+    return QD_SECTION_OK;
 }
 
 
-static bool qd_message_check_LH(qd_message_content_t *content, qd_message_depth_t depth)
+//
+// Walk the sections of the message down to the requested depth, resuming from
+// wherever the previous walk stopped.  On INVALID, *reason says which section
+// is at fault.
+//
+static qd_section_status_t qd_message_index_LH(qd_message_content_t *content, qd_message_depth_t depth, const char **reason)
 {
-    qd_error_clear();
+    qd_section_status_t status;
 
     //
     // In the case of a streaming or multi buffer message, there is a change that some buffers might be freed before the entire
     // message has arrived in which case we cannot reliably check the message using the depth.
     //
     if (content->buffers_freed)
-        return true;
+        return QD_SECTION_OK;
 
     qd_buffer_t *buffer  = DEQ_HEAD(content->buffers);
 
     if (!buffer) {
-        return false;
+        return QD_SECTION_NEED_MORE;
     }
 
     if (depth <= content->parse_depth)
-        return true; // We've already parsed at least this deep
+        return QD_SECTION_OK; // We've already parsed at least this deep
 
     if (content->parse_buffer == 0) {
         content->parse_buffer = buffer;
@@ -1731,62 +2509,56 @@ static bool qd_message_check_LH(qd_message_content_t *content, qd_message_depth_
     }
 
     if (depth == QD_DEPTH_NONE)
-        return true;
+        return QD_SECTION_OK;
 
     //
     // MESSAGE HEADER
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_HEADER,
-                               MSG_HDR_LONG, MSG_HDR_SHORT, TAGS_LIST, &content->section_message_header, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid header");
-        return false;
-    }
-    if (depth == QD_DEPTH_HEADER)
-        return true;
+    *reason = "Invalid header";
+    status = qd_check_field_LH(content, QD_DEPTH_HEADER,
+                               MSG_HDR_LONG, MSG_HDR_SHORT, TAGS_LIST, &content->section_message_header, 0);
+    if (status != QD_SECTION_OK || depth == QD_DEPTH_HEADER)
+        return status;
 
     //
     // DELIVERY ANNOTATION
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_DELIVERY_ANNOTATIONS,
-                               DELIVERY_ANNOTATION_LONG, DELIVERY_ANNOTATION_SHORT, TAGS_MAP, &content->section_delivery_annotation, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid delivery-annotations");
-        return false;
-    }
-    if (depth == QD_DEPTH_DELIVERY_ANNOTATIONS)
-        return true;
+    *reason = "Invalid delivery-annotations";
+    status = qd_check_field_LH(content, QD_DEPTH_DELIVERY_ANNOTATIONS,
+                               DELIVERY_ANNOTATION_LONG, DELIVERY_ANNOTATION_SHORT, TAGS_MAP, &content->section_delivery_annotation, 0);
+    if (status != QD_SECTION_OK || depth == QD_DEPTH_DELIVERY_ANNOTATIONS)
+        return status;
 
     //
     // MESSAGE ANNOTATION
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_MESSAGE_ANNOTATIONS,
-                               MESSAGE_ANNOTATION_LONG, MESSAGE_ANNOTATION_SHORT, TAGS_MAP, &content->section_message_annotation, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid annotations");
-        return false;
-    }
-    if (depth == QD_DEPTH_MESSAGE_ANNOTATIONS)
-        return true;
+    *reason = "Invalid annotations";
+    status = qd_check_field_LH(content, QD_DEPTH_MESSAGE_ANNOTATIONS,
+                               MESSAGE_ANNOTATION_LONG, MESSAGE_ANNOTATION_SHORT, TAGS_MAP, &content->section_message_annotation, 0);
+    if (status != QD_SECTION_OK || depth == QD_DEPTH_MESSAGE_ANNOTATIONS)
+        return status;
 
     //
     // PROPERTIES
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_PROPERTIES,
-                               PROPERTIES_LONG, PROPERTIES_SHORT, TAGS_LIST, &content->section_message_properties, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid message properties");
-        return false;
-    }
+    *reason = "Invalid message properties";
+    status = qd_check_field_LH(content, QD_DEPTH_PROPERTIES,
+                               PROPERTIES_LONG, PROPERTIES_SHORT, TAGS_LIST, &content->section_message_properties, 0);
+    if (status != QD_SECTION_OK)
+        return status;
+    if (content->section_message_properties.parsed && !content->properties_indexed)
+        qd_message_index_properties_LH(content);
     if (depth == QD_DEPTH_PROPERTIES)
-        return true;
+        return status;
 
     //
     // APPLICATION PROPERTIES
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_APPLICATION_PROPERTIES,
-                               APPLICATION_PROPERTIES_LONG, APPLICATION_PROPERTIES_SHORT, TAGS_MAP, &content->section_application_properties, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid application-properties");
-        return false;
-    }
-    if (depth == QD_DEPTH_APPLICATION_PROPERTIES)
-        return true;
+    *reason = "Invalid application-properties";
+    status = qd_check_field_LH(content, QD_DEPTH_APPLICATION_PROPERTIES,
+                               APPLICATION_PROPERTIES_LONG, APPLICATION_PROPERTIES_SHORT, TAGS_MAP, &content->section_application_properties, 0);
+    if (status != QD_SECTION_OK || depth == QD_DEPTH_APPLICATION_PROPERTIES)
+        return status;
 
     //
     // BODY
@@ -1794,35 +2566,61 @@ static bool qd_message_check_LH(qd_message_content_t *content, qd_message_depth_
     // not a problem for messages passing through Dispatch because through-only messages won't
     // be parsed to BODY-depth.
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_BODY,
-                               BODY_DATA_LONG, BODY_DATA_SHORT, TAGS_BINARY, &content->section_body, 1)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid body data");
-        return false;
-    }
-    if (0 == qd_check_field_LH(content, QD_DEPTH_BODY,
-                               BODY_SEQUENCE_LONG, BODY_SEQUENCE_SHORT, TAGS_LIST, &content->section_body, 1)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid body sequence");
-        return false;
-    }
-    if (0 == qd_check_field_LH(content, QD_DEPTH_BODY,
-                               BODY_VALUE_LONG, BODY_VALUE_SHORT, TAGS_ANY, &content->section_body, 0)) {
-        qd_error(QD_ERROR_MESSAGE, "Invalid body value");
-        return false;
-    }
-    if (depth == QD_DEPTH_BODY)
-        return true;
+    *reason = "Invalid body data";
+    status = qd_check_field_LH(content, QD_DEPTH_BODY,
+                               BODY_DATA_LONG, BODY_DATA_SHORT, TAGS_BINARY, &content->section_body, 1);
+    if (status != QD_SECTION_OK)
+        return status;
+    *reason = "Invalid body sequence";
+    status = qd_check_field_LH(content, QD_DEPTH_BODY,
+                               BODY_SEQUENCE_LONG, BODY_SEQUENCE_SHORT, TAGS_LIST, &content->section_body, 1);
+    if (status != QD_SECTION_OK)
+        return status;
+    *reason = "Invalid body value";
+    status = qd_check_field_LH(content, QD_DEPTH_BODY,
+                               BODY_VALUE_LONG, BODY_VALUE_SHORT, TAGS_ANY, &content->section_body, 0);
+    if (status != QD_SECTION_OK || depth == QD_DEPTH_BODY)
+        return status;
 
     //
     // FOOTER
     //
-    if (0 == qd_check_field_LH(content, QD_DEPTH_ALL,
-                               FOOTER_LONG, FOOTER_SHORT, TAGS_MAP, &content->section_footer, 0)) {
+    *reason = "Invalid footer";
+    return qd_check_field_LH(content, QD_DEPTH_ALL,
+                             FOOTER_LONG, FOOTER_SHORT, TAGS_MAP, &content->section_footer, 0);
+}
 
-        qd_error(QD_ERROR_MESSAGE, "Invalid footer");
+
+//
+// Extend the section index over buffers that have just been appended to the
+// message.  The sections up to the application properties, which are what
+// routing, policy and logging look at, are located as the message streams in
+// so that later checks and field lookups find them already recorded.  Errors
+// are left for qd_message_check to report.
+//
+static void qd_message_index_received_LH(qd_message_content_t *content)
+{
+    const char *reason;
+    (void) qd_message_index_LH(content, QD_DEPTH_APPLICATION_PROPERTIES, &reason);
+}
+
+
+static bool qd_message_check_LH(qd_message_content_t *content, qd_message_depth_t depth)
+{
+    const char *reason = 0;
+
+    qd_error_clear();
+
+    switch (qd_message_index_LH(content, depth, &reason)) {
+    case QD_SECTION_OK:
+        return true;
+    case QD_SECTION_INVALID:
+        qd_error(QD_ERROR_MESSAGE, "%s", reason);
+        return false;
+    case QD_SECTION_NEED_MORE:
+    default:
         return false;
     }
-
-    return true;
 }
 
 
@@ -1853,21 +2651,32 @@ qd_iterator_t *qd_message_field_iterator_typed(qd_message_t *msg, qd_message_fie
 }
 
 
-qd_iterator_t *qd_message_field_iterator(qd_message_t *msg, qd_message_field_t field)
+bool qd_message_field_iterator_init(qd_message_t *msg, qd_message_field_t field, qd_iterator_t *iter)
 {
     qd_field_location_t *loc = qd_message_field_location(msg, field);
 
     if (!loc)
-        return 0;
+        return false;
 
     if (loc->tag == QD_AMQP_NULL)
-        return 0;
+        return false;
 
     qd_buffer_t   *buffer = loc->buffer;
     unsigned char *cursor = qd_buffer_base(loc->buffer) + loc->offset;
     advance(&cursor, &buffer, loc->hdr_length);
 
-    return qd_iterator_buffer(buffer, cursor - qd_buffer_base(buffer), loc->length, ITER_VIEW_ALL);
+    qd_iterator_init_buffer(iter, buffer, cursor - qd_buffer_base(buffer), loc->length, ITER_VIEW_ALL);
+    return true;
+}
+
+
+qd_iterator_t *qd_message_field_iterator(qd_message_t *msg, qd_message_field_t field)
+{
+    qd_iterator_t local;
+    if (!qd_message_field_iterator_init(msg, field, &local))
+        return 0;
+
+    return qd_iterator_dup(&local);
 }
 
 
@@ -1957,6 +2766,7 @@ void qd_message_compose_1(qd_message_t *msg, const char *to, qd_buffer_list_t *b
 
     qd_compose_take_buffers(field, &content->buffers);
     qd_compose_free(field);
+    content_count_buffers(content);
 }
 
 
@@ -1969,6 +2779,7 @@ void qd_message_compose_2(qd_message_t *msg, qd_composed_field_t *field)
 
     content->buffers = *field_buffers;
     DEQ_INIT(*field_buffers); // Zero out the linkage to the now moved buffers.
+    content_count_buffers(content);
 }
 
 
@@ -1982,6 +2793,7 @@ void qd_message_compose_3(qd_message_t *msg, qd_composed_field_t *field1, qd_com
     content->buffers = *field1_buffers;
     DEQ_INIT(*field1_buffers);
     DEQ_APPEND(content->buffers, (*field2_buffers));
+    content_count_buffers(content);
 }
 
 
@@ -1997,36 +2809,75 @@ void qd_message_compose_4(qd_message_t *msg, qd_composed_field_t *field1, qd_com
     DEQ_INIT(*field1_buffers);
     DEQ_APPEND(content->buffers, (*field2_buffers));
     DEQ_APPEND(content->buffers, (*field3_buffers));
+    content_count_buffers(content);
+}
+
+
+// Parse a router annotation value on first use
+static qd_parsed_field_t *qd_message_router_annotation(qd_message_t *msg,
+                                                       qd_parsed_field_t **parsed,
+                                                       const qd_iterator_pointer_t *value)
+{
+    qd_message_content_t *content = MSG_CONTENT(msg);
+
+    qd_message_message_annotations(msg);
+    if (!value->buffer)
+        return 0;
+
+    LOCK(content->lock);
+    if (!*parsed)
+        *parsed = qd_parse_annotation_value(value);
+    UNLOCK(content->lock);
+    return *parsed;
 }
 
 
 qd_parsed_field_t *qd_message_get_ingress    (qd_message_t *msg)
 {
-    return ((qd_message_pvt_t*)msg)->content->ma_pf_ingress;
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    return qd_message_router_annotation(msg, &content->ma_pf_ingress, &content->ma_ingress);
 }
 
 
 qd_parsed_field_t *qd_message_get_phase      (qd_message_t *msg)
 {
-    return ((qd_message_pvt_t*)msg)->content->ma_pf_phase;
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    return qd_message_router_annotation(msg, &content->ma_pf_phase, &content->ma_phase);
 }
 
 
 qd_parsed_field_t *qd_message_get_to_override(qd_message_t *msg)
 {
-    return ((qd_message_pvt_t*)msg)->content->ma_pf_to_override;
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    return qd_message_router_annotation(msg, &content->ma_pf_to_override, &content->ma_to_override);
 }
 
 
 qd_parsed_field_t *qd_message_get_trace      (qd_message_t *msg)
 {
-    return ((qd_message_pvt_t*)msg)->content->ma_pf_trace;
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    return qd_message_router_annotation(msg, &content->ma_pf_trace, &content->ma_trace);
+}
+
+
+qd_parsed_field_t *qd_message_get_sequence   (qd_message_t *msg)
+{
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    return qd_message_router_annotation(msg, &content->ma_pf_sequence, &content->ma_sequence);
 }
 
 
 int qd_message_get_phase_val(qd_message_t *msg)
 {
-    return ((qd_message_pvt_t*)msg)->content->ma_int_phase;
+    qd_message_content_t *content = MSG_CONTENT(msg);
+
+    if (!content->ma_phase_parsed) {
+        qd_parsed_field_t *phase = qd_message_get_phase(msg);
+        if (phase)
+            content->ma_int_phase = qd_parse_as_int(phase);
+        content->ma_phase_parsed = true;
+    }
+    return content->ma_int_phase;
 }
 
 
@@ -2044,13 +2895,13 @@ bool qd_message_Q2_holdoff_should_block(qd_message_t *msg)
     if (!msg)
         return false;
     qd_message_pvt_t *msg_pvt = (qd_message_pvt_t*) msg;
-    return !msg_pvt->content->disable_q2_holdoff && DEQ_SIZE(msg_pvt->content->buffers) >= QD_QLIMIT_Q2_UPPER;
+    return !msg_pvt->content->disable_q2_holdoff && msg_pvt->content->buffer_units >= msg_pvt->content->q2_upper;
 }
 
 
 bool qd_message_Q2_holdoff_should_unblock(qd_message_t *msg)
 {
-    return DEQ_SIZE(((qd_message_pvt_t*)msg)->content->buffers) < QD_QLIMIT_Q2_LOWER;
+    return ((qd_message_pvt_t*)msg)->content->buffer_units < ((qd_message_pvt_t*)msg)->content->q2_lower;
 }
 
 
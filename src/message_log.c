@@ -0,0 +1,239 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "message_log.h"
+#include "parse_tree.h"
+#include "server_private.h"
+#include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/iterator.h>
+#include <qpid/dispatch/log.h>
+#include <qpid/dispatch/threading.h>
+#include <qpid/dispatch/timer.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Messages waiting for the message-log thread, beyond which they go unlogged
+#define QD_MESSAGE_LOG_QUEUE_MAX 4096
+
+// Longest address compared against messageLoggingAddress
+#define QD_MESSAGE_LOG_ADDRESS_MAX 256
+
+typedef struct qd_message_log_entry_t qd_message_log_entry_t;
+
+struct qd_message_log_entry_t {
+    DEQ_LINKS(qd_message_log_entry_t);
+    qd_message_t *snapshot;    ///< From qd_message_repr_snapshot, 0 for an aborted message
+    qd_log_bits   bits;
+    uint64_t      conn_id;
+    bool          sent;
+    char         *link_name;
+    char         *source;
+    char         *target;
+};
+
+DEQ_DECLARE(qd_message_log_entry_t, qd_message_log_entry_list_t);
+
+ALLOC_DECLARE(qd_message_log_entry_t);
+ALLOC_DEFINE(qd_message_log_entry_t);
+
+static sys_mutex_t                 *queue_lock = 0;
+static sys_cond_t                  *queue_cond = 0;
+static qd_message_log_entry_list_t  queue;
+static uint64_t                     dropped;      // Sampled but not queued, reported by the thread
+static bool                         stopping;
+static sys_thread_t                *thread = 0;
+
+
+static void entry_free(qd_message_log_entry_t *entry)
+{
+    qd_message_free(entry->snapshot);
+    free(entry->link_name);
+    free(entry->source);
+    free(entry->target);
+    free_qd_message_log_entry_t(entry);
+}
+
+
+static void entry_log(qd_message_log_entry_t *entry, char *buf, size_t len)
+{
+    const char *msg_str = entry->snapshot ? qd_message_repr(entry->snapshot, buf, len, entry->bits)
+                                          : "aborted message";
+    if (msg_str)
+        qd_log(qd_message_log_source(), QD_LOG_TRACE,
+               "[C%"PRIu64"]: %s %s on link '%s' (%s -> %s)",
+               entry->conn_id,
+               entry->sent ? "Sent" : "Received",
+               msg_str,
+               entry->link_name,
+               entry->source ? entry->source : "",
+               entry->target ? entry->target : "");
+}
+
+
+static void *message_log_run(void *unused)
+{
+    char *buf = (char*) malloc(qd_message_repr_len());
+
+    sys_mutex_lock(queue_lock);
+    while (true) {
+        while (!stopping && DEQ_IS_EMPTY(queue))
+            sys_cond_wait(queue_cond, queue_lock);
+
+        qd_message_log_entry_t *entry = DEQ_HEAD(queue);
+        if (!entry)
+            break;
+        DEQ_REMOVE_HEAD(queue);
+        uint64_t missed = dropped;
+        dropped = 0;
+        sys_mutex_unlock(queue_lock);
+
+        if (missed)
+            qd_log(qd_message_log_source(), QD_LOG_TRACE,
+                   "%"PRIu64" sampled messages were not logged, the message log fell behind", missed);
+        entry_log(entry, buf, qd_message_repr_len());
+        entry_free(entry);
+
+        sys_mutex_lock(queue_lock);
+    }
+    sys_mutex_unlock(queue_lock);
+
+    free(buf);
+    return 0;
+}
+
+
+void qd_message_log_initialize(void)
+{
+    DEQ_INIT(queue);
+    dropped    = 0;
+    stopping   = false;
+    queue_lock = sys_mutex();
+    queue_cond = sys_cond();
+    thread     = sys_thread(message_log_run, 0);
+}
+
+
+void qd_message_log_finalize(void)
+{
+    // The thread logs whatever is still queued before it exits
+    if (thread) {
+        sys_mutex_lock(queue_lock);
+        stopping = true;
+        sys_cond_signal(queue_cond);
+        sys_mutex_unlock(queue_lock);
+        sys_thread_join(thread);
+        sys_thread_free(thread);
+        thread = 0;
+    }
+    if (queue_lock) {
+        sys_cond_free(queue_cond);
+        sys_mutex_free(queue_lock);
+        queue_cond = 0;
+        queue_lock = 0;
+    }
+}
+
+
+/**
+ * True if the message's address matches the pattern: the link's address, or on an
+ * anonymous link the message's to field.
+ */
+static bool message_log_address_match(const qd_server_config_t *cf, const char *link_address, qd_message_t *msg)
+{
+    void *payload;
+
+    if (link_address)
+        return qd_parse_tree_retrieve_match_str(cf->log_address_tree, link_address, &payload);
+
+    qd_iterator_t *to = qd_message_field_iterator(msg, QD_FIELD_TO);
+    if (!to)
+        return false;
+    char address[QD_MESSAGE_LOG_ADDRESS_MAX];
+    qd_iterator_strncpy(to, address, sizeof(address));
+    qd_iterator_free(to);
+    return qd_parse_tree_retrieve_match_str(cf->log_address_tree, address, &payload);
+}
+
+
+void qd_message_log(qd_connection_t *conn, pn_link_t *pn_link, qd_message_t *msg)
+{
+    if (!conn || !pn_link || !msg)
+        return;
+    const qd_server_config_t *cf = qd_connection_config(conn);
+    if (!cf || cf->log_bits == 0 || !qd_log_enabled(qd_message_log_source(), QD_LOG_TRACE))
+        return;
+
+    //
+    // The cheapest tests go first: the one-in-N count, then the rate limit, which
+    // only counts messages that pass, then the address.
+    //
+    qd_message_log_sampler_t *sampler = &conn->log_sampler;
+    if (++sampler->skipped < (uint32_t) cf->log_sample)
+        return;
+    sampler->skipped = 0;
+
+    if (cf->log_rate_limit > 0) {
+        int64_t now = qd_timer_now_usec();
+        if (now - sampler->rate_start >= 1000000) {
+            sampler->rate_start = now;
+            sampler->rate_count = 0;
+        }
+        if (sampler->rate_count >= (uint32_t) cf->log_rate_limit)
+            return;
+    }
+
+    bool        sent = pn_link_is_sender(pn_link);
+    const char *src  = pn_terminus_get_address(pn_link_source(pn_link));
+    const char *tgt  = pn_terminus_get_address(pn_link_target(pn_link));
+    if (cf->log_address_tree && !message_log_address_match(cf, sent ? src : tgt, msg))
+        return;
+
+    qd_message_t *snapshot = 0;
+    if (!qd_message_aborted(msg)) {
+        snapshot = qd_message_repr_snapshot(msg);
+        if (!snapshot)
+            return;
+    }
+    sampler->rate_count++;
+
+    qd_message_log_entry_t *entry = new_qd_message_log_entry_t();
+    ZERO(entry);
+    DEQ_ITEM_INIT(entry);
+    entry->snapshot  = snapshot;
+    entry->bits      = cf->log_bits;
+    entry->conn_id   = qd_connection_connection_id(conn);
+    entry->sent      = sent;
+    entry->link_name = strdup(pn_link_name(pn_link));
+    entry->source    = src ? strdup(src) : 0;
+    entry->target    = tgt ? strdup(tgt) : 0;
+
+    sys_mutex_lock(queue_lock);
+    if (DEQ_SIZE(queue) < QD_MESSAGE_LOG_QUEUE_MAX) {
+        DEQ_INSERT_TAIL(queue, entry);
+        entry = 0;
+        sys_cond_signal(queue_cond);
+    } else
+        dropped++;
+    sys_mutex_unlock(queue_lock);
+
+    if (entry)
+        entry_free(entry);
+}
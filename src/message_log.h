@@ -0,0 +1,56 @@
+#ifndef __message_log_h__
+#define __message_log_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/message.h>
+#include <qpid/dispatch/server.h>
+#include <stdint.h>
+
+/* Sampled message logging.
+ *
+ * A listener or connector with messageLoggingComponents logs those components
+ * of the messages crossing its connections.  Formatting them costs more than
+ * forwarding the message, so the messages logged can be thinned to one in every
+ * messageLoggingSample, to at most messageLoggingRateLimit a second on each
+ * connection, and to those whose address matches messageLoggingAddress.  The I/O
+ * thread only copies a chosen message's property sections; the message-log
+ * thread formats and logs them.  When that thread falls behind, messages go
+ * unlogged and it reports how many.
+ */
+
+/**
+ * Per-connection sampling state, used only on the connection's I/O thread.
+ */
+typedef struct qd_message_log_sampler_t {
+    uint32_t skipped;       ///< Messages passed over since the last one sampled
+    uint32_t rate_count;    ///< Messages logged in the current second
+    int64_t  rate_start;    ///< Start of the current second, microseconds
+} qd_message_log_sampler_t;
+
+void qd_message_log_initialize(void);
+void qd_message_log_finalize(void);
+
+/**
+ * Log a message sent or received on a link of the connection if the connection's
+ * sampling chooses it.
+ */
+void qd_message_log(qd_connection_t *conn, pn_link_t *pn_link, qd_message_t *msg);
+
+#endif
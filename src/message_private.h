@@ -68,6 +68,12 @@ typedef struct {
     sys_mutex_t         *lock;
     sys_atomic_t         ref_count;                       // The number of messages referencing this
     qd_buffer_list_t     buffers;                         // The buffer chain containing the message
+    sys_atomic_ptr_t     published_tail;                  // Last buffer readable without the lock while receiving
+    size_t               buffer_units;                    // Size of the chain in base-size buffers (for Q2)
+    size_t               buffer_octets;                   // Octets of content held in the chain
+    size_t               octets_received;                 // Message octets read from the link so far
+    qd_memory_account_t *memory_account;                  // Account of the receiving connection, charged for the chain
+    qd_buffer_spill_t   *spill;                           // Spill file for buffers beyond the spill threshold
     qd_buffer_t         *pending;                         // Buffer owned by and filled by qd_message_receive
     qd_field_location_t  section_message_header;          // The message header list
     qd_field_location_t  section_delivery_annotation;     // The delivery annotation map
@@ -96,58 +102,96 @@ typedef struct {
     qd_buffer_t         *parse_buffer;
     unsigned char       *parse_cursor;
     qd_message_depth_t   parse_depth;
+    bool                 properties_indexed;             // every field_* of the properties list has been located
     qd_iterator_t       *ma_field_iter_in;                // 'message field iterator' for msg.FIELD_MESSAGE_ANNOTATION
 
     qd_iterator_pointer_t ma_user_annotation_blob;        // Original user annotations
                                                           // with router annotations stripped
     uint32_t             ma_count;                        // Number of map elements in blob
                                                           // after the router fields stripped
-    qd_parsed_field_t   *ma_pf_ingress;
+    qd_iterator_pointer_t ma_ingress;                     // Encoded router annotation values, located
+    qd_iterator_pointer_t ma_phase;                       // but not parsed (buffer is null if absent)
+    qd_iterator_pointer_t ma_to_override;
+    qd_iterator_pointer_t ma_trace;
+    qd_iterator_pointer_t ma_sequence;
+    qd_parsed_field_t   *ma_pf_ingress;                   // Parsed on first use
     qd_parsed_field_t   *ma_pf_phase;
     qd_parsed_field_t   *ma_pf_to_override;
     qd_parsed_field_t   *ma_pf_trace;
+    qd_parsed_field_t   *ma_pf_sequence;
     int                  ma_int_phase;
+    bool                 ma_phase_parsed;                 // ma_int_phase has been extracted
     sys_atomic_t         fanout;                         // The number of receivers for this message. This number does not include in-process subscribers.
     int                  num_closed_receivers;
     qd_link_t           *input_link;                     // message received on this link
+    size_t               q2_upper;                       // Q2 holdoff watermarks, in buffer units,
+    size_t               q2_lower;                       // taken from input_link
 
     bool                 ma_parsed;                      // have parsed annotations in incoming message
     bool                 discard;                        // Should this message be discarded?
     bool                 receive_complete;               // true if the message has been completely received, false otherwise
+    uint8_t              wire_encoding;                  // QD_WIRE_* of the delivery on a compressing link, from its first octet
     bool                 q2_input_holdoff;               // hold off calling pn_link_recv
     bool                 aborted;                        // receive completed with abort flag set
+    bool                 spill_failed;                   // the spill file could not be created
     bool                 disable_q2_holdoff;             // Disable the Q2 flow control
     bool                 buffers_freed;                  // Has at least one buffer been freed ?
     bool                 priority_parsed;
     bool                 priority_present;
     uint8_t              priority;                       // The priority of this message
+    bool                 expiry_parsed;
+    int64_t              expiry;                         // When the message expires in qd_timer_now() time, 0 if never
 } qd_message_content_t;
 
+/**
+ * The router annotations of an outgoing message.  A copy of a message shares
+ * the block of the message it was copied from; the first copy to set an
+ * annotation to a new value gets a block of its own.
+ */
+typedef struct {
+    sys_atomic_t          ref_count;
+    qd_buffer_list_t      ma_to_override;  // to field in outgoing message annotations.
+    qd_buffer_list_t      ma_trace;        // trace list in outgoing message annotations
+    qd_buffer_list_t      ma_ingress;      // ingress field in outgoing message annotations
+    qd_buffer_list_t      ma_trace_compact;    // trace list for links to peers with compact annotations
+    qd_buffer_list_t      ma_ingress_compact;  // ingress field for links to peers with compact annotations
+    qd_buffer_list_t      ma_sequence;     // multicast sequence in outgoing message annotations
+    int                   ma_phase;        // phase for the override address
+} qd_message_annotations_t;
+
 typedef struct {
     DEQ_LINKS(qd_message_t);   // Deque linkage that overlays the qd_message_t
     qd_iterator_pointer_t cursor;          // A pointer to the current location of the outgoing byte stream.
     qd_message_depth_t    message_depth;   // What is the depth of the message that has been received so far
     qd_message_depth_t    sent_depth;      // How much of the message has been sent?  QD_DEPTH_NONE means nothing has been sent so far, QD_DEPTH_HEADER means the header has already been sent, dont send it again and so on.
     qd_message_content_t *content;         // The actual content of the message. The content is never copied
-    qd_buffer_list_t      ma_to_override;  // to field in outgoing message annotations.
-    qd_buffer_list_t      ma_trace;        // trace list in outgoing message annotations
-    qd_buffer_list_t      ma_ingress;      // ingress field in outgoing message annotations
-    int                   ma_phase;        // phase for the override address
+    qd_message_annotations_t *annotations;  // Router annotations, never null and possibly shared
     bool                  strip_annotations_in;
     bool                  send_complete;   // Has the message been completely received and completely sent?
     bool                  tag_sent;        // Tags are sent
+    bool                  send_compressed; // Sent through the link's deflater
+    size_t                octets_sent;     // Message octets written to the link so far, before compression
 } qd_message_pvt_t;
 
 ALLOC_DECLARE(qd_message_t);
 ALLOC_DECLARE(qd_message_content_t);
+ALLOC_DECLARE(qd_message_annotations_t);
 
 #define MSG_CONTENT(m) (((qd_message_pvt_t*) m)->content)
 
 /** Initialize logging */
 void qd_message_initialize();
+void qd_message_finalize();
 
 qd_iterator_pointer_t qd_message_cursor(qd_message_pvt_t *msg);
 
+/**
+ * As qd_message_field_iterator, but set up the iterator in caller storage (see
+ * iterator_private.h).  Returns false, leaving iter untouched, if the field is
+ * absent or null.
+ */
+bool qd_message_field_iterator_init(qd_message_t *msg, qd_message_field_t field, qd_iterator_t *iter);
+
 #define QDR_N_PRIORITIES     10
 #define QDR_MAX_PRIORITY     (QDR_N_PRIORITIES - 1)
 #define QDR_DEFAULT_PRIORITY  4
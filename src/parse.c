@@ -21,6 +21,7 @@
 #include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/parse.h>
 #include <qpid/dispatch/amqp.h>
+#include "iterator_private.h"
 
 #include <stdio.h>
 #include <limits.h>
@@ -45,6 +46,82 @@ ALLOC_DEFINE(qd_parsed_field_t);
 ALLOC_DECLARE(qd_parsed_turbo_t);
 ALLOC_DEFINE(qd_parsed_turbo_t);
 
+/**
+ * Encoding layout per tag category (tag >> 4): the number of octets in the
+ * tag, size and count fields, and the payload size of fixed-width types.
+ * A zero header length marks a category that carries no length information.
+ */
+static const struct {
+    uint8_t header_length;
+    uint8_t fixed_size;
+} type_layout[16] = {
+    [0x4] = {1, 0},  [0x5] = {1, 1},  [0x6] = {1, 2},  [0x7] = {1, 4},
+    [0x8] = {1, 8},  [0x9] = {1, 16}, [0xA] = {2, 0},  [0xB] = {5, 0},
+    [0xC] = {3, 0},  [0xD] = {9, 0},  [0xE] = {3, 0},  [0xF] = {9, 0},
+};
+
+
+static inline uint32_t load_uint32(const unsigned char *octets)
+{
+    return ((uint32_t) octets[0] << 24) | ((uint32_t) octets[1] << 16)
+        |  ((uint32_t) octets[2] << 8)  |  (uint32_t) octets[3];
+}
+
+
+/**
+ * Decode the tag, size and count of a field whose header lies entirely in one
+ * contiguous run of the iterator.  Returns false (with the iterator untouched)
+ * when the header straddles a buffer boundary or the tag is invalid, in which
+ * case the caller falls back to octet-at-a-time decoding.
+ */
+static inline bool get_type_info_contiguous(qd_iterator_t *iter, uint8_t *tag, uint32_t *size, uint32_t *count, uint32_t *length_of_size, uint32_t *length_of_count)
+{
+    const unsigned char *cursor;
+    uint32_t avail = qd_iterator_contiguous(iter, &cursor);
+    if (avail == 0)
+        return false;
+
+    uint8_t  category      = cursor[0] >> 4;
+    uint32_t header_length = type_layout[category].header_length;
+    if (header_length == 0 || header_length > avail)
+        return false;
+
+    *tag             = cursor[0];
+    *size            = type_layout[category].fixed_size;
+    *count           = 0;
+    *length_of_size  = 0;
+    *length_of_count = 0;
+
+    switch (category) {
+    case 0xA:
+        *size           = cursor[1];
+        *length_of_size = 1;
+        break;
+    case 0xB:
+        *size           = load_uint32(cursor + 1);
+        *length_of_size = 4;
+        break;
+    case 0xC:
+    case 0xE:
+        *size            = cursor[1];
+        *count           = cursor[2];
+        *length_of_size  = 1;
+        *length_of_count = 1;
+        break;
+    case 0xD:
+    case 0xF:
+        *size            = load_uint32(cursor + 1);
+        *count           = load_uint32(cursor + 5);
+        *length_of_size  = 4;
+        *length_of_count = 4;
+        break;
+    }
+
+    qd_iterator_advance(iter, header_length);
+    return true;
+}
+
+
 /**
  * size = the number of bytes following tag:size (payload, including the count)
  * count = the number of elements. Applies only to compound structures
@@ -54,6 +131,9 @@ static char *get_type_info(qd_iterator_t *iter, uint8_t *tag, uint32_t *size, ui
     if (qd_iterator_end(iter))
         return "Insufficient Data to Determine Tag";
 
+    if (get_type_info_contiguous(iter, tag, size, count, length_of_size, length_of_count))
+        goto validate;
+
     *tag             = qd_iterator_octet(iter);
     *count           = 0;
     *size            = 0;
@@ -120,6 +200,7 @@ static char *get_type_info(qd_iterator_t *iter, uint8_t *tag, uint32_t *size, ui
         break;
     }
 
+validate:
     if ((*tag == QD_AMQP_MAP8 || *tag == QD_AMQP_MAP32) && (*count & 1))
         return "Odd Number of Elements in a Map";
 
@@ -695,17 +776,125 @@ qd_parsed_field_t *qd_parse_value_by_key(qd_parsed_field_t *field, const char *k
 }
 
 
-const char *qd_parse_annotations_v1(
+static bool is_tag_a_string(uint8_t tag)
+{
+    return tag == QD_AMQP_STR8_UTF8 || tag == QD_AMQP_STR32_UTF8 || tag == QD_AMQP_SYM8 || tag == QD_AMQP_SYM32;
+}
+
+
+const char *qd_parse_map_locate(qd_iterator_t      *iter,
+                                const char * const *keys,
+                                int                 key_count,
+                                qd_parsed_turbo_t  *values)
+{
+    if (!iter || !keys || !values)
+        return "missing argument";
+
+    for (int idx = 0; idx < key_count; idx++)
+        ZERO(&values[idx]);
+
+    uint8_t  tag             = 0;
+    uint32_t size            = 0;
+    uint32_t count           = 0;
+    uint32_t length_of_count = 0;
+    uint32_t length_of_size  = 0;
+    const char *parse_error = get_type_info(iter, &tag, &size, &count, &length_of_size, &length_of_count);
+    if (parse_error)
+        return parse_error;
+
+    if (!is_tag_a_map(tag))
+        return "Not a map";
+
+    int unresolved = key_count;
+    for (uint32_t idx = 0; idx < count && unresolved > 0; idx += 2) {
+        qd_parsed_turbo_t key;
+        qd_parsed_turbo_t value;
+
+        // Describe the key and the value, skipping each one's payload
+        qd_iterator_get_view_cursor(iter, &key.bufptr);
+        parse_error = get_type_info(iter, &key.tag, &key.size, &key.count, &key.length_of_size, &key.length_of_count);
+        if (parse_error)
+            return parse_error;
+        qd_iterator_advance(iter, key.size - key.length_of_count);
+
+        qd_iterator_get_view_cursor(iter, &value.bufptr);
+        parse_error = get_type_info(iter, &value.tag, &value.size, &value.count, &value.length_of_size, &value.length_of_count);
+        if (parse_error)
+            return parse_error;
+        qd_iterator_advance(iter, value.size - value.length_of_count);
+        value.bufptr.remaining = 1 + value.length_of_size + value.size;
+
+        if (!is_tag_a_string(key.tag))
+            continue;
+
+        for (int k = 0; k < key_count; k++) {
+            if (values[k].tag == 0 && key.size == strlen(keys[k]) &&
+                qd_iterator_prefix_ptr(&key.bufptr, key.length_of_size + 1, keys[k])) {
+                values[k] = value;
+                DEQ_ITEM_INIT(&values[k]);
+                unresolved--;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+bool qd_parse_turbo_equal(const qd_parsed_turbo_t *value, const unsigned char *text)
+{
+    return value && is_tag_a_string(value->tag) && value->size == strlen((const char*) text) &&
+        qd_iterator_prefix_ptr(&value->bufptr, value->length_of_size + 1, (const char*) text);
+}
+
+
+void qd_parse_turbo_raw(const qd_parsed_turbo_t *value, qd_iterator_pointer_t *raw)
+{
+    qd_iterator_t iter;
+    qd_iterator_init_pointer(&iter, &value->bufptr, ITER_VIEW_ALL);
+    qd_iterator_advance(&iter, 1 + value->length_of_size + value->length_of_count);
+    qd_iterator_get_view_cursor(&iter, raw);
+    raw->remaining = value->size - value->length_of_count;
+    qd_iterator_fini(&iter);
+}
+
+
+qd_parsed_field_t *qd_parse_turbo_value(const qd_parsed_turbo_t *value)
+{
+    if (!value || value->tag == 0)
+        return 0;
+
+    qd_iterator_t iter;
+    qd_iterator_init_pointer(&iter, &value->bufptr, ITER_VIEW_ALL);
+    qd_parsed_field_t *field = qd_parse(&iter);
+    qd_iterator_fini(&iter);
+    return field;
+}
+
+
+static bool annotation_key_is(const qd_parsed_turbo_t *key, const char *name)
+{
+    return key->size == strlen(name) &&
+        qd_iterator_prefix_ptr(&key->bufptr, key->length_of_size + 1, name);
+}
+
+
+//
+// Skeletal scan of the annotations map: find the user blob and record where
+// each router annotation value lies.  No parse trees are built.
+//
+static const char *qd_parse_annotations_locate_v1(
     bool                   strip_anno_in,
     qd_iterator_t         *ma_iter_in,
-    qd_parsed_field_t    **ma_ingress,
-    qd_parsed_field_t    **ma_phase,
-    qd_parsed_field_t    **ma_to_override,
-    qd_parsed_field_t    **ma_trace,
+    qd_iterator_pointer_t *ma_ingress,
+    qd_iterator_pointer_t *ma_phase,
+    qd_iterator_pointer_t *ma_to_override,
+    qd_iterator_pointer_t *ma_trace,
+    qd_iterator_pointer_t *ma_sequence,
     qd_iterator_pointer_t *blob_pointer,
     uint32_t              *blob_item_count)
 {
-    // Do full parse
     qd_iterator_reset(ma_iter_in);
 
     qd_parsed_turbo_list_t annos;
@@ -720,55 +909,29 @@ const char *qd_parse_annotations_v1(
     if (!strip_anno_in) {
         anno = DEQ_HEAD(annos);
         while (anno) {
-            qd_iterator_t *key_iter =
-                qd_iterator_buffer(anno->bufptr.buffer,
-                                anno->bufptr.cursor - qd_buffer_base(anno->bufptr.buffer),
-                                anno->size + anno->length_of_size,
-                                ITER_VIEW_ALL);
-            assert(key_iter);
-
-            qd_parsed_field_t *key_field = qd_parse(key_iter);
-            assert(key_field);
-
-            qd_iterator_t *iter = qd_parse_raw(key_field);
-            assert(iter);
-
             qd_parsed_turbo_t *anno_val = DEQ_NEXT(anno);
             assert(anno_val);
 
-            qd_iterator_t *val_iter =
-                qd_iterator_buffer(anno_val->bufptr.buffer,
-                                anno_val->bufptr.cursor - qd_buffer_base(anno_val->bufptr.buffer),
-                                anno_val->size + anno_val->length_of_size,
-                                ITER_VIEW_ALL);
-            assert(val_iter);
-
-            qd_parsed_field_t *val_field = qd_parse(val_iter);
-            assert(val_field);
-
-            // Hoist the key name out of the buffers into a normal char array
-            char key_name[QD_MA_MAX_KEY_LEN + 1];
-            (void)qd_iterator_strncpy(iter, key_name, QD_MA_MAX_KEY_LEN + 1);
-
-            // transfer ownership of the extracted value to the message
-            if        (!strcmp(key_name, QD_MA_TRACE)) {
-                *ma_trace = val_field;
-            } else if (!strcmp(key_name, QD_MA_INGRESS)) {
-                *ma_ingress = val_field;
-            } else if (!strcmp(key_name, QD_MA_TO)) {
-                *ma_to_override = val_field;
-            } else if (!strcmp(key_name, QD_MA_PHASE)) {
-                *ma_phase = val_field;
+            qd_iterator_pointer_t *value = 0;
+            if        (annotation_key_is(anno, QD_MA_TRACE)) {
+                value = ma_trace;
+            } else if (annotation_key_is(anno, QD_MA_INGRESS)) {
+                value = ma_ingress;
+            } else if (annotation_key_is(anno, QD_MA_TO)) {
+                value = ma_to_override;
+            } else if (annotation_key_is(anno, QD_MA_PHASE)) {
+                value = ma_phase;
+            } else if (annotation_key_is(anno, QD_MA_SEQUENCE)) {
+                value = ma_sequence;
             } else {
                 // TODO: this key had the QD_MA_PREFIX but it does not match
-                //       one of the actual fields. 
-                qd_parse_free(val_field);
+                //       one of the actual fields.
             }
 
-            qd_iterator_free(key_iter);
-            qd_parse_free(key_field);
-            qd_iterator_free(val_iter);
-            // val_field is usually handed over to message_private and is freed 
+            if (value) {
+                *value           = anno_val->bufptr;
+                value->remaining = anno_val->size + anno_val->length_of_size;
+            }
 
             anno = DEQ_NEXT(anno_val);
         }
@@ -791,8 +954,28 @@ const char *qd_parse_annotations_v1(
 }
 
 
-void qd_parse_annotations(
-    bool                   strip_annotations_in,
+qd_parsed_field_t *qd_parse_annotation_value(const qd_iterator_pointer_t *value)
+{
+    if (!value || !value->buffer)
+        return 0;
+
+    qd_iterator_t *val_iter =
+        qd_iterator_buffer(value->buffer,
+                           value->cursor - qd_buffer_base(value->buffer),
+                           value->remaining,
+                           ITER_VIEW_ALL);
+    assert(val_iter);
+
+    qd_parsed_field_t *val_field = qd_parse(val_iter);
+    assert(val_field);
+
+    qd_iterator_free(val_iter);
+    return val_field;
+}
+
+
+const char *qd_parse_annotations_v1(
+    bool                   strip_anno_in,
     qd_iterator_t         *ma_iter_in,
     qd_parsed_field_t    **ma_ingress,
     qd_parsed_field_t    **ma_phase,
@@ -801,15 +984,41 @@ void qd_parse_annotations(
     qd_iterator_pointer_t *blob_pointer,
     uint32_t              *blob_item_count)
 {
-    *ma_ingress             = 0;
-    *ma_phase               = 0;
-    *ma_to_override         = 0;
-    *ma_trace               = 0;
+    qd_iterator_pointer_t ingress;
+    qd_iterator_pointer_t phase;
+    qd_iterator_pointer_t to_override;
+    qd_iterator_pointer_t trace;
+    qd_iterator_pointer_t sequence;
+    ZERO(&ingress);
+    ZERO(&phase);
+    ZERO(&to_override);
+    ZERO(&trace);
+    ZERO(&sequence);
+
+    const char *parse_error = qd_parse_annotations_locate_v1(strip_anno_in, ma_iter_in,
+                                                             &ingress, &phase, &to_override, &trace,
+                                                             &sequence, blob_pointer, blob_item_count);
+    if (parse_error)
+        return parse_error;
+
+    // transfer ownership of the extracted values to the caller
+    *ma_ingress     = qd_parse_annotation_value(&ingress);
+    *ma_phase       = qd_parse_annotation_value(&phase);
+    *ma_to_override = qd_parse_annotation_value(&to_override);
+    *ma_trace       = qd_parse_annotation_value(&trace);
+    return 0;
+}
+
+
+static bool qd_parse_annotations_blob(qd_iterator_t         *ma_iter_in,
+                                      qd_iterator_pointer_t *blob_pointer,
+                                      uint32_t              *blob_item_count)
+{
     ZERO(blob_pointer);
     *blob_item_count        = 0;
 
     if (!ma_iter_in)
-        return;
+        return false;
 
     uint8_t  tag             = 0;
     uint32_t size            = 0;
@@ -820,20 +1029,68 @@ void qd_parse_annotations(
                                             &size, blob_item_count, &length_of_size,
                                             &length_of_count);
     if (parse_error)
-        return;
+        return false;
 
     if (!is_tag_a_map(tag)) {
-        return;
+        return false;
     }
 
     // Initial snapshot on size/content of annotation payload
-    qd_iterator_t *raw_iter = qd_iterator_sub(ma_iter_in, (size - length_of_count));
+    qd_iterator_t raw_iter;
+    qd_iterator_init_sub(&raw_iter, ma_iter_in, (size - length_of_count));
 
     // If there are no router annotations then all annotations
     // are the user's opaque blob.
-    qd_iterator_get_view_cursor(raw_iter, blob_pointer);
+    qd_iterator_get_view_cursor(&raw_iter, blob_pointer);
+
+    qd_iterator_fini(&raw_iter);
+    return true;
+}
+
+
+void qd_parse_annotations_locate(
+    bool                   strip_annotations_in,
+    qd_iterator_t         *ma_iter_in,
+    qd_iterator_pointer_t *ma_ingress,
+    qd_iterator_pointer_t *ma_phase,
+    qd_iterator_pointer_t *ma_to_override,
+    qd_iterator_pointer_t *ma_trace,
+    qd_iterator_pointer_t *ma_sequence,
+    qd_iterator_pointer_t *blob_pointer,
+    uint32_t              *blob_item_count)
+{
+    ZERO(ma_ingress);
+    ZERO(ma_phase);
+    ZERO(ma_to_override);
+    ZERO(ma_trace);
+    ZERO(ma_sequence);
+
+    if (!qd_parse_annotations_blob(ma_iter_in, blob_pointer, blob_item_count))
+        return;
+
+    (void) qd_parse_annotations_locate_v1(strip_annotations_in, ma_iter_in, ma_ingress, ma_phase,
+                                          ma_to_override, ma_trace, ma_sequence,
+                                          blob_pointer, blob_item_count);
+}
 
-    qd_iterator_free(raw_iter);
+
+void qd_parse_annotations(
+    bool                   strip_annotations_in,
+    qd_iterator_t         *ma_iter_in,
+    qd_parsed_field_t    **ma_ingress,
+    qd_parsed_field_t    **ma_phase,
+    qd_parsed_field_t    **ma_to_override,
+    qd_parsed_field_t    **ma_trace,
+    qd_iterator_pointer_t *blob_pointer,
+    uint32_t              *blob_item_count)
+{
+    *ma_ingress             = 0;
+    *ma_phase               = 0;
+    *ma_to_override         = 0;
+    *ma_trace               = 0;
+
+    if (!qd_parse_annotations_blob(ma_iter_in, blob_pointer, blob_item_count))
+        return;
 
     (void) qd_parse_annotations_v1(strip_annotations_in, ma_iter_in, ma_ingress, ma_phase,
                                     ma_to_override, ma_trace,
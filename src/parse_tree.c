@@ -19,6 +19,8 @@
 
 
 #include "parse_tree.h"
+#include "iterator_private.h"
+#include <qpid/dispatch/hash.h>
 #include <qpid/dispatch/log.h>
 
 
@@ -210,18 +212,77 @@ struct qd_parse_node {
     bool is_match_glob;         // this node is match zero or more wildcard
     char *token;          // portion of pattern represented by this node
     char *pattern;        // entire normalized pattern matching this node
+    uint32_t token_len;
+    uint32_t token_hash;
     // sub-trees of this node:
     qd_parse_node_list_t  children; // all that start with a non-wildcard token
+    qd_parse_node_t     **child_index;  // children hashed by token, once there are many
+    uint32_t              child_index_mask;
     struct qd_parse_node  *match_1_child;   // starts with a match 1 wildcard
     struct qd_parse_node  *match_glob_child;  // starts with 0 or more wildcard
     // data returned on match against this node:
     void *payload;
     qd_log_source_t *log_source;
+    // root node only: bumped on every pattern add or remove, and the optional
+    // cache of qd_parse_tree_retrieve_match results
+    uint64_t generation;
+    struct parse_tree_cache *cache;
 };
 ALLOC_DECLARE(qd_parse_node_t);
 ALLOC_DEFINE(qd_parse_node_t);
 
 
+// Match cache
+//
+// Maps a value to the payload of its best match (NULL included, so values
+// matching nothing are cached as well).  Entries record the tree generation
+// they were computed in and are ignored once the tree has changed.  The least
+// recently used entry is recycled when the cache is full.
+//
+typedef struct parse_cache_entry parse_cache_entry_t;
+DEQ_DECLARE(parse_cache_entry_t, parse_cache_entry_list_t);
+struct parse_cache_entry {
+    DEQ_LINKS(parse_cache_entry_t);
+    qd_hash_handle_t *hash_handle;
+    void             *payload;
+    uint64_t          generation;
+};
+ALLOC_DECLARE(parse_cache_entry_t);
+ALLOC_DEFINE(parse_cache_entry_t);
+
+typedef struct parse_tree_cache {
+    qd_hash_t                *entries;
+    parse_cache_entry_list_t  lru;       // most recently used at the head
+    int                       capacity;
+} parse_tree_cache_t;
+
+
+static void parse_tree_cache_free(parse_tree_cache_t *cache)
+{
+    parse_cache_entry_t *entry = DEQ_HEAD(cache->lru);
+    while (entry) {
+        DEQ_REMOVE_HEAD(cache->lru);
+        qd_hash_handle_free(entry->hash_handle);
+        free_parse_cache_entry_t(entry);
+        entry = DEQ_HEAD(cache->lru);
+    }
+    qd_hash_free(cache->entries);
+    free(cache);
+}
+
+
+// FNV-1a hash of a token, used to index a node's children
+static uint32_t token_hash(const char *begin, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    while (len--) {
+        hash ^= (unsigned char) *begin++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
 static qd_parse_node_t *new_parse_node(const token_t *t, qd_parse_tree_type_t type)
 {
     qd_parse_node_t *n = new_qd_parse_node_t();
@@ -237,6 +298,8 @@ static qd_parse_node_t *new_parse_node(const token_t *t, qd_parse_tree_type_t ty
             n->token = malloc(tlen + 1);
             strncpy(n->token, t->begin, tlen);
             n->token[tlen] = 0;
+            n->token_len  = tlen;
+            n->token_hash = token_hash(n->token, tlen);
             token_iterator_t tmp;
             token_iterator_init(&tmp, type, n->token);
             n->is_match_1 = token_iterator_is_match_1(&tmp);
@@ -259,17 +322,112 @@ static int parse_node_child_count(const qd_parse_node_t *n)
 static void free_parse_node(qd_parse_node_t *n)
 {
     assert(parse_node_child_count(n) == 0);
+    free(n->child_index);
     free(n->token);
     free(n->pattern);
     free_qd_parse_node_t(n);
 }
 
 
+// Child index
+//
+// Nodes with many non-wildcard children (e.g. a level of the tree holding
+// thousands of distinct tokens) keep an open-addressed index of them keyed by
+// token hash, so finding a child costs one probe rather than a list scan.
+// The index is built once the child count passes CHILD_INDEX_MIN, is kept at
+// most half full, and is maintained as patterns are added and removed.
+//
+#define CHILD_INDEX_MIN 8
+
+static void child_index_place(qd_parse_node_t **index, uint32_t mask, qd_parse_node_t *child)
+{
+    uint32_t idx = child->token_hash & mask;
+    while (index[idx])
+        idx = (idx + 1) & mask;
+    index[idx] = child;
+}
+
+
+static void child_index_rebuild(qd_parse_node_t *node, uint32_t slots)
+{
+    free(node->child_index);
+    node->child_index      = NEW_ARRAY(qd_parse_node_t*, slots);
+    node->child_index_mask = slots - 1;
+    memset(node->child_index, 0, sizeof(qd_parse_node_t*) * slots);
+
+    qd_parse_node_t *child = DEQ_HEAD(node->children);
+    while (child) {
+        child_index_place(node->child_index, node->child_index_mask, child);
+        child = DEQ_NEXT(child);
+    }
+}
+
+
+static void parse_node_insert_child(qd_parse_node_t *node, qd_parse_node_t *child)
+{
+    DEQ_INSERT_TAIL(node->children, child);
+    size_t count = DEQ_SIZE(node->children);
+
+    if (node->child_index) {
+        if (count * 2 > node->child_index_mask + 1)
+            child_index_rebuild(node, (node->child_index_mask + 1) * 2);
+        else
+            child_index_place(node->child_index, node->child_index_mask, child);
+    } else if (count > CHILD_INDEX_MIN) {
+        child_index_rebuild(node, CHILD_INDEX_MIN * 4);
+    }
+}
+
+
+static void parse_node_remove_child(qd_parse_node_t *node, qd_parse_node_t *child)
+{
+    DEQ_REMOVE(node->children, child);
+    if (!node->child_index)
+        return;
+
+    uint32_t mask = node->child_index_mask;
+    uint32_t idx  = child->token_hash & mask;
+    while (node->child_index[idx] != child)
+        idx = (idx + 1) & mask;
+
+    // backward-shift the rest of the probe run over the vacated slot
+    uint32_t next = idx;
+    while (true) {
+        node->child_index[idx] = 0;
+        while (true) {
+            next = (next + 1) & mask;
+            if (!node->child_index[next])
+                return;
+            uint32_t home = node->child_index[next]->token_hash & mask;
+            if (((next - home) & mask) >= ((next - idx) & mask))
+                break;
+        }
+        node->child_index[idx] = node->child_index[next];
+        idx = next;
+    }
+}
+
+
 // find immediate child node matching token
 static qd_parse_node_t *parse_node_find_child(const qd_parse_node_t *node, const token_t *token)
 {
+    const size_t len = TOKEN_LEN(*token);
+
+    if (node->child_index) {
+        uint32_t hash = token_hash(token->begin, len);
+        uint32_t idx  = hash & node->child_index_mask;
+        qd_parse_node_t *child;
+        while ((child = node->child_index[idx]) != 0) {
+            if (child->token_hash == hash && child->token_len == len
+                && memcmp(child->token, token->begin, len) == 0)
+                return child;
+            idx = (idx + 1) & node->child_index_mask;
+        }
+        return 0;
+    }
+
     qd_parse_node_t *child = DEQ_HEAD(node->children);
-    while (child && !token_match_str(token, child->token))
+    while (child && !(child->token_len == len && memcmp(child->token, token->begin, len) == 0))
         child = DEQ_NEXT(child);
     return child;
 }
@@ -328,7 +486,7 @@ static void *parse_node_add_pattern(qd_parse_node_t *node,
                                           payload);
         } else {
             child = new_parse_node(&current, node->type);
-            DEQ_INSERT_TAIL(node->children, child);
+            parse_node_insert_child(node, child);
             return parse_node_add_pattern(child,
                                           key,
                                           pattern,
@@ -379,7 +537,7 @@ static void *parse_node_remove_pattern(qd_parse_node_t *node,
             old = parse_node_remove_pattern(child, key, pattern);
             if (child->pattern == NULL
                 && parse_node_child_count(child) == 0) {
-                DEQ_REMOVE(node->children, child);
+                parse_node_remove_child(node, child);
                 free_parse_node(child);
             }
         }
@@ -427,14 +585,108 @@ static qd_parse_node_t *parse_node_get_pattern(qd_parse_node_t *node,
 }
 
 
-static bool parse_node_find(qd_parse_node_t *, token_iterator_t *,
-                            qd_parse_tree_visit_t *, void *);
+// Search state
+//
+// A "match zero or more" node below another one can be entered many times at
+// the same position in the value, once for each way the outer glob can split
+// the preceding tokens.  The first exploration of each such (node, position)
+// state is memoized as the range of matches it reported; re-entering the state
+// replays those matches instead of walking the sub-tree again.  Replaying
+// keeps the callback sequence identical to a full walk.
+//
+typedef struct glob_state {
+    const qd_parse_node_t *node;
+    const char            *position;
+    size_t                 first;  // index of its first match in the match log
+    size_t                 count;  // number of matches reported
+} glob_state_t;
+
+#define SEARCH_ON_STACK 16
+
+typedef struct parse_search {
+    qd_parse_tree_visit_t   *callback;
+    void                    *handle;
+    int                      glob_depth;  // number of glob nodes being matched
+    int                      recording;   // number of memoized states being explored
+    glob_state_t            *states;
+    size_t                   state_count;
+    size_t                   state_capacity;
+    const qd_parse_node_t  **log;         // matches reported while recording
+    size_t                   log_count;
+    size_t                   log_capacity;
+    glob_state_t             states_on_stack[SEARCH_ON_STACK];
+    const qd_parse_node_t   *log_on_stack[SEARCH_ON_STACK];
+} parse_search_t;
+
+
+static void parse_search_init(parse_search_t *s, qd_parse_tree_visit_t *callback, void *handle)
+{
+    s->callback       = callback;
+    s->handle         = handle;
+    s->glob_depth     = 0;
+    s->recording      = 0;
+    s->states         = s->states_on_stack;
+    s->state_count    = 0;
+    s->state_capacity = SEARCH_ON_STACK;
+    s->log            = s->log_on_stack;
+    s->log_count      = 0;
+    s->log_capacity   = SEARCH_ON_STACK;
+}
+
+
+static void parse_search_final(parse_search_t *s)
+{
+    if (s->states != s->states_on_stack)
+        free(s->states);
+    if (s->log != s->log_on_stack)
+        free(s->log);
+}
+
+
+// double the capacity of a search array, moving it off the stack if needed
+static void *parse_search_grow(void *array, const void *on_stack, size_t *capacity, size_t size)
+{
+    void *bigger;
+    if (array == on_stack) {
+        bigger = malloc(*capacity * 2 * size);
+        memcpy(bigger, array, *capacity * size);
+    } else
+        bigger = realloc(array, *capacity * 2 * size);
+    *capacity *= 2;
+    return bigger;
+}
+
+
+// report a match to the caller
+// returns false to stop the search
+static bool parse_search_emit(parse_search_t *s, const qd_parse_node_t *node)
+{
+    if (s->recording) {
+        if (s->log_count == s->log_capacity)
+            s->log = parse_search_grow(s->log, s->log_on_stack, &s->log_capacity, sizeof(*s->log));
+        s->log[s->log_count++] = node;
+    }
+    return s->callback(s->handle, node->pattern, node->payload);
+}
+
+
+static glob_state_t *parse_search_find_state(parse_search_t *s, const qd_parse_node_t *node, const char *position)
+{
+    for (size_t idx = 0; idx < s->state_count; idx++) {
+        if (s->states[idx].node == node && s->states[idx].position == position)
+            return &s->states[idx];
+    }
+    return 0;
+}
+
+
+static bool parse_node_find(qd_parse_node_t *, token_iterator_t *, parse_search_t *);
 
 
 // search the sub-trees of this node.
 // This function returns false to stop the search
 static bool parse_node_find_children(qd_parse_node_t *node, token_iterator_t *value,
-                                     qd_parse_tree_visit_t *callback, void *handle)
+                                     parse_search_t *s)
 {
     if (!token_iterator_done(value)) {
 
@@ -446,14 +698,14 @@ static bool parse_node_find_children(qd_parse_node_t *node, token_iterator_t *va
 
             qd_parse_node_t *child = parse_node_find_child(node, &child_token);
             if (child) {
-                if (!parse_node_find(child, &tmp, callback, handle))
+                if (!parse_node_find(child, &tmp, s))
                     return false;
             }
         }
 
         if (node->match_1_child) {
             token_iterator_t tmp = *value;
-            if (!parse_node_find(node->match_1_child, &tmp, callback, handle))
+            if (!parse_node_find(node->match_1_child, &tmp, s))
                 return false;
         }
     }
@@ -461,7 +713,7 @@ static bool parse_node_find_children(qd_parse_node_t *node, token_iterator_t *va
     // always try glob - even if empty (it can match empty keys)
     if (node->match_glob_child) {
         token_iterator_t tmp = *value;
-        if (!parse_node_find(node->match_glob_child, &tmp, callback, handle))
+        if (!parse_node_find(node->match_glob_child, &tmp, s))
             return false;
     }
 
@@ -472,24 +724,24 @@ static bool parse_node_find_children(qd_parse_node_t *node, token_iterator_t *va
 // This node matched the last token.
 // This function returns false to stop the search
 static bool parse_node_find_token(qd_parse_node_t *node, token_iterator_t *value,
-                                  qd_parse_tree_visit_t *callback, void *handle)
+                                  parse_search_t *s)
 {
     if (token_iterator_done(value) && node->pattern) {
         // exact match current node
-        if (!callback(handle, node->pattern, node->payload))
+        if (!parse_search_emit(s, node))
             return false;
     }
 
     // no payload or more tokens.  Continue to lower sub-trees. Even if no more
     // tokens (may have a # match)
-    return parse_node_find_children(node, value, callback, handle);
+    return parse_node_find_children(node, value, s);
 }
 
 
 // this node matches any one token
 // returns false to stop the search
 static bool parse_node_match_1(qd_parse_node_t *node, token_iterator_t *value,
-                               qd_parse_tree_visit_t *callback, void *handle)
+                               parse_search_t *s)
 {
     // must match exactly one token:
     if (token_iterator_done(value))
@@ -500,46 +752,81 @@ static bool parse_node_match_1(qd_parse_node_t *node, token_iterator_t *value,
 
     if (token_iterator_done(value) && node->pattern) {
         // exact match current node
-        if (!callback(handle, node->pattern, node->payload))
+        if (!parse_search_emit(s, node))
             return false;
     }
 
     // no payload or more tokens: continue to lower sub-trees
-    return parse_node_find_children(node, value, callback, handle);
+    return parse_node_find_children(node, value, s);
 }
 
 
 // current node is hash, match the remainder of the string
 // return false to stop search
 static bool parse_node_match_glob(qd_parse_node_t *node, token_iterator_t *value,
-                                  qd_parse_tree_visit_t *callback, void *handle)
+                                  parse_search_t *s)
 {
+    //
+    // Only a glob nested in another glob can be re-entered at the same
+    // position, so only those states are memoized.
+    //
+    size_t state_idx = SIZE_MAX;
+    if (s->glob_depth > 0) {
+        glob_state_t *state = parse_search_find_state(s, node, value->token.begin);
+        if (state) {
+            size_t first = state->first;
+            size_t count = state->count;
+            for (size_t idx = 0; idx < count; idx++) {
+                if (!parse_search_emit(s, s->log[first + idx]))
+                    return false;
+            }
+            return true;
+        }
+
+        if (s->state_count == s->state_capacity)
+            s->states = parse_search_grow(s->states, s->states_on_stack, &s->state_capacity, sizeof(*s->states));
+        state_idx = s->state_count++;
+        s->states[state_idx].node     = node;
+        s->states[state_idx].position = value->token.begin;
+        s->states[state_idx].first    = s->log_count;
+        s->states[state_idx].count    = 0;
+        s->recording++;
+    }
+
+    bool more = true;
+    s->glob_depth++;
+
     // consume each token and look for a match on the
     // remaining key.
-    while (!token_iterator_done(value)) {
-        if (!parse_node_find_children(node, value, callback, handle))
-            return false;
+    while (more && !token_iterator_done(value)) {
+        more = parse_node_find_children(node, value, s);
         token_iterator_next(value);
     }
 
     // this node matches
-    if (node->pattern)
-        return callback(handle, node->pattern, node->payload);
+    if (more && node->pattern)
+        more = parse_search_emit(s, node);
 
-    return true;
+    s->glob_depth--;
+    if (state_idx != SIZE_MAX) {
+        s->states[state_idx].count = s->log_count - s->states[state_idx].first;
+        s->recording--;
+    }
+
+    return more;
 }
 
 
 // find the payload associated with the input string 'value'
 static bool parse_node_find(qd_parse_node_t *node, token_iterator_t *value,
-                            qd_parse_tree_visit_t *callback, void *handle)
+                            parse_search_t *s)
 {
     if (node->is_match_1)
-        return parse_node_match_1(node, value, callback, handle);
+        return parse_node_match_1(node, value, s);
     else if (node->is_match_glob)
-        return parse_node_match_glob(node, value, callback, handle);
+        return parse_node_match_glob(node, value, s);
     else
-        return parse_node_find_token(node, value, callback, handle);
+        return parse_node_find_token(node, value, s);
 }
 
 
@@ -554,6 +841,12 @@ static void parse_node_free(qd_parse_node_t *node)
             DEQ_REMOVE_HEAD(node->children);
             parse_node_free(child);
         }
+        free(node->child_index);
+        node->child_index = NULL;
+        if (node->cache) {
+            parse_tree_cache_free(node->cache);
+            node->cache = NULL;
+        }
 
         free_parse_node(node);
     }
@@ -578,30 +871,103 @@ bool qd_parse_tree_retrieve_match(qd_parse_tree_t *node,
                                   const qd_iterator_t *value,
                                   void **payload)
 {
+    parse_tree_cache_t  *cache = node->cache;
+    parse_cache_entry_t *entry = NULL;
+    qd_iterator_t        key;
+
     *payload = NULL;
+
+    // Nothing can match an empty tree.  Routers without link routes search
+    // theirs on every attach, so skip the cache lookup as well.
+    if (DEQ_IS_EMPTY(node->children) && !node->match_1_child && !node->match_glob_child && !node->payload)
+        return false;
+
+    if (cache) {
+        qd_iterator_init_dup(&key, value);
+        qd_hash_retrieve(cache->entries, &key, (void **) &entry);
+        if (entry && entry->generation == node->generation) {
+            if (entry != DEQ_HEAD(cache->lru)) {
+                DEQ_REMOVE(cache->lru, entry);
+                DEQ_INSERT_HEAD(cache->lru, entry);
+            }
+            qd_iterator_fini(&key);
+            *payload = entry->payload;
+            if (*payload == NULL)
+                qd_log(node->log_source, QD_LOG_TRACE, "Parse tree match not found (cached)");
+            return *payload != NULL;
+        }
+    }
+
     qd_parse_tree_search(node, value, get_first, payload);
     if (*payload == NULL)
         qd_log(node->log_source, QD_LOG_TRACE, "Parse tree match not found");
+
+    if (cache) {
+        if (!entry) {
+            if (DEQ_SIZE(cache->lru) < cache->capacity) {
+                entry = new_parse_cache_entry_t();
+                ZERO(entry);
+                DEQ_ITEM_INIT(entry);
+            } else {
+                // recycle the least recently used entry
+                entry = DEQ_TAIL(cache->lru);
+                DEQ_REMOVE_TAIL(cache->lru);
+                qd_hash_remove_by_handle(cache->entries, entry->hash_handle);
+                qd_hash_handle_free(entry->hash_handle);
+                entry->hash_handle = NULL;
+            }
+            qd_hash_insert(cache->entries, &key, entry, &entry->hash_handle);
+        } else
+            DEQ_REMOVE(cache->lru, entry);
+
+        DEQ_INSERT_HEAD(cache->lru, entry);
+        entry->payload    = *payload;
+        entry->generation = node->generation;
+        qd_iterator_fini(&key);
+    }
+
     return *payload != NULL;
 }
 
 
+void qd_parse_tree_set_cache_size(qd_parse_tree_t *tree, int entries)
+{
+    if (tree->cache) {
+        parse_tree_cache_free(tree->cache);
+        tree->cache = NULL;
+    }
+
+    if (entries > 0) {
+        int exponent = 4;
+        while ((1 << exponent) < entries && exponent < 16)
+            exponent++;
+        tree->cache = NEW(parse_tree_cache_t);
+        tree->cache->entries  = qd_hash(exponent, 0, 0);
+        tree->cache->capacity = entries;
+        DEQ_INIT(tree->cache->lru);
+    }
+}
+
+
 // Invoke callback for each pattern that matches 'value'
 void qd_parse_tree_search(qd_parse_tree_t *node,
                           const qd_iterator_t *value,
                           qd_parse_tree_visit_t *callback, void *handle)
 {
     token_iterator_t t_iter;
-    // @TODO(kgiusti) for now:
-    qd_iterator_t *dup = qd_iterator_dup(value);
-    char *str = (char *)qd_iterator_copy(dup);
+    qd_iterator_t dup;
+    qd_iterator_init_dup(&dup, value);
+    char *str = (char *)qd_iterator_copy(&dup);
     qd_log(node->log_source, QD_LOG_TRACE, "Parse tree search for '%s'", str);
 
+    parse_search_t search;
+    parse_search_init(&search, callback, handle);
     token_iterator_init(&t_iter, node->type, str);
-    parse_node_find(node, &t_iter, callback, handle);
+    parse_node_find(node, &t_iter, &search);
+    parse_search_final(&search);
 
     free(str);
-    qd_iterator_free(dup);
+    qd_iterator_fini(&dup);
 }
 
 
@@ -612,9 +978,9 @@ void *qd_parse_tree_add_pattern(qd_parse_tree_t *node,
 {
     token_iterator_t key;
     void *rc = NULL;
-    // @TODO(kgiusti) for now:
-    qd_iterator_t *dup = qd_iterator_dup(pattern);
-    char *str = (char *)qd_iterator_copy(dup);
+    qd_iterator_t dup;
+    qd_iterator_init_dup(&dup, pattern);
+    char *str = (char *)qd_iterator_copy(&dup);
 
     normalize_pattern(node->type, str);
     qd_log(node->log_source, QD_LOG_TRACE,
@@ -622,8 +988,9 @@ void *qd_parse_tree_add_pattern(qd_parse_tree_t *node,
 
     token_iterator_init(&key, node->type, str);
     rc = parse_node_add_pattern(node, &key, str, payload);
+    node->generation++;
     free(str);
-    qd_iterator_free(dup);
+    qd_iterator_fini(&dup);
     return rc;
 }
 
@@ -635,9 +1002,9 @@ bool qd_parse_tree_get_pattern(qd_parse_tree_t *node,
 {
     token_iterator_t key;
     qd_parse_node_t *found = NULL;
-    // @TODO(kgiusti) for now:
-    qd_iterator_t *dup = qd_iterator_dup(pattern);
-    char *str = (char *)qd_iterator_copy(dup);
+    qd_iterator_t dup;
+    qd_iterator_init_dup(&dup, pattern);
+    char *str = (char *)qd_iterator_copy(&dup);
 
     normalize_pattern(node->type, (char *)str);
     qd_log(node->log_source, QD_LOG_TRACE,
@@ -646,7 +1013,7 @@ bool qd_parse_tree_get_pattern(qd_parse_tree_t *node,
     token_iterator_init(&key, node->type, str);
     found = parse_node_get_pattern(node, &key, str);
     free(str);
-    qd_iterator_free(dup);
+    qd_iterator_fini(&dup);
     *payload = found ? found->payload : NULL;
     return *payload != NULL;
 }
@@ -658,9 +1025,9 @@ void *qd_parse_tree_remove_pattern(qd_parse_tree_t *node,
 {
     token_iterator_t key;
     void *rc = NULL;
-    // @TODO(kgiusti) for now:
-    qd_iterator_t *dup = qd_iterator_dup(pattern);
-    char *str = (char *)qd_iterator_copy(dup);
+    qd_iterator_t dup;
+    qd_iterator_init_dup(&dup, pattern);
+    char *str = (char *)qd_iterator_copy(&dup);
 
     normalize_pattern(node->type, str);
     qd_log(node->log_source, QD_LOG_TRACE,
@@ -668,8 +1035,9 @@ void *qd_parse_tree_remove_pattern(qd_parse_tree_t *node,
 
     token_iterator_init(&key, node->type, str);
     rc = parse_node_remove_pattern(node, &key, str);
+    node->generation++;
     free(str);
-    qd_iterator_free(dup);
+    qd_iterator_fini(&dup);
     return rc;
 }
 
@@ -709,9 +1077,10 @@ bool qd_parse_tree_validate_pattern(const qd_parse_tree_t *tree,
         // pattern
         token_iterator_t ti;
         bool valid = true;
-        qd_iterator_t *dup = qd_iterator_dup(pattern);
-        char *str = (char *)qd_iterator_copy(dup);
-        qd_iterator_free(dup);
+        qd_iterator_t dup;
+        qd_iterator_init_dup(&dup, pattern);
+        char *str = (char *)qd_iterator_copy(&dup);
+        qd_iterator_fini(&dup);
         token_iterator_init(&ti, QD_PARSE_TREE_MQTT, str);
         while (!token_iterator_done(&ti)) {
             token_t head;
@@ -795,6 +1164,7 @@ void *qd_parse_tree_add_pattern_str(qd_parse_tree_t *node,
 
     token_iterator_init(&key, node->type, str);
     rc = parse_node_add_pattern(node, &key, str, payload);
+    node->generation++;
     free(str);
     return rc;
 }
@@ -811,8 +1181,11 @@ void qd_parse_tree_search_str(qd_parse_tree_t *node,
     char *str = strdup(value);
     qd_log(node->log_source, QD_LOG_TRACE, "Parse tree(str) search for '%s'", str);
 
+    parse_search_t search;
+    parse_search_init(&search, callback, handle);
     token_iterator_init(&t_iter, node->type, str);
-    parse_node_find(node, &t_iter, callback, handle);
+    parse_node_find(node, &t_iter, &search);
+    parse_search_final(&search);
 
     free(str);
 }
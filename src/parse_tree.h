@@ -95,6 +95,12 @@ bool qd_parse_tree_retrieve_match(qd_parse_tree_t *tree,
                                   const qd_iterator_t *value,
                                   void **payload);
 
+// Keep the results of up to 'entries' recent qd_parse_tree_retrieve_match
+// calls (0 disables the cache, the default).  Cached results are discarded
+// whenever a pattern is added or removed.  Lookups then update the cache, so
+// a cached tree must only be used from one thread.
+void qd_parse_tree_set_cache_size(qd_parse_tree_t *tree, int entries);
+
 // parse tree traversal
 
 // return false to stop tree transversal
@@ -26,6 +26,8 @@
 #include "dispatch_private.h"
 #include "qpid/dispatch/container.h"
 #include "qpid/dispatch/server.h"
+#include "qpid/dispatch/atomic.h"
+#include "qpid/dispatch/timer.h"
 #include <proton/message.h>
 #include <proton/condition.h>
 #include <proton/connection.h>
@@ -67,6 +69,53 @@ static const char * const user_subst_i_suffix   = "s";
 static const char * const user_subst_i_wildcard = "*";
 
 static void hostname_tree_free(qd_parse_tree_t *hostname_tree);
+qd_parse_tree_t *qd_policy_parse_tree(const char *config_spec);
+
+//
+// Settings of a vhost user group, as last returned by the Python policy manager.
+// Entries are keyed by "<vhost>\0<group>" and the whole cache is flushed when the
+// policy rulesets change.
+//
+#define QD_POLICY_SETTINGS_CACHE_MAX 1024
+#define QD_POLICY_SETTINGS_KEY_MAX   512
+
+typedef struct qd_policy_settings_entry_t qd_policy_settings_entry_t;
+struct qd_policy_settings_entry_t {
+    DEQ_LINKS(qd_policy_settings_entry_t);
+    qd_hash_handle_t     *hash_handle;
+    qd_policy_settings_t  settings;   // parse trees are not compiled here
+};
+DEQ_DECLARE(qd_policy_settings_entry_t, qd_policy_settings_entry_list_t);
+
+//
+// Outcome of message target approvals on anonymous links, per connection.
+// Entries are keyed by the 'to' address and dropped when the policy
+// settings generation changes or the cache fills up.
+//
+#define QD_POLICY_TARGET_CACHE_MAX 256
+
+static const char target_approval_allow = 'a';
+static const char target_approval_deny  = 'd';
+
+//
+// Message and byte rate limit of a vhost, or of a user on a vhost.  Connections
+// share a rate by key ("<vhost>" or "<vhost>\0<user>") and hold a reference to it
+// in their settings.  Tokens are kept in millionths so that a refill after any
+// number of microseconds is exact; a rate may run up to one second of burst.
+//
+struct qd_policy_rate_t {
+    DEQ_LINKS(qd_policy_rate_t);
+    qd_hash_handle_t *hash_handle;
+    qd_policy_t      *policy;
+    int               ref_count;      // protected by policy->rate_lock
+    sys_mutex_t      *lock;           // protects the fields below
+    int64_t           max_messages;   // per second, zero for no limit
+    int64_t           max_bytes;      // per second, zero for no limit
+    int64_t           message_tokens;
+    int64_t           byte_tokens;
+    int64_t           last_usec;
+};
+DEQ_DECLARE(qd_policy_rate_t, qd_policy_rate_list_t);
 
 //
 // Policy configuration/statistics management interface
@@ -77,6 +126,13 @@ struct qd_policy_t {
     void                 *py_policy_manager;
     sys_mutex_t          *tree_lock;
     qd_parse_tree_t      *hostname_tree;
+    sys_mutex_t          *settings_lock;
+    qd_hash_t            *settings_hash;
+    qd_policy_settings_entry_list_t settings_cache;
+    sys_atomic_t          settings_generation;
+    sys_mutex_t          *rate_lock;
+    qd_hash_t            *rate_hash;
+    qd_policy_rate_list_t rates;
                           // configured settings
     int                   max_connection_limit;
     char                 *policyDir;
@@ -100,6 +156,13 @@ qd_policy_t *qd_policy(qd_dispatch_t *qd)
     policy->max_connection_limit = 65535;
     policy->tree_lock            = sys_mutex();
     policy->hostname_tree        = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+    policy->settings_lock        = sys_mutex();
+    policy->settings_hash        = qd_hash(10, 32, 0);
+    DEQ_INIT(policy->settings_cache);
+    sys_atomic_init(&policy->settings_generation, 0);
+    policy->rate_lock            = sys_mutex();
+    policy->rate_hash            = qd_hash(8, 16, 0);
+    DEQ_INIT(policy->rates);
 
     qd_log(policy->log_source, QD_LOG_TRACE, "Policy Initialized");
     return policy;
@@ -116,9 +179,334 @@ void qd_policy_free(qd_policy_t *policy)
     if (policy->tree_lock)
         sys_mutex_free(policy->tree_lock);
     hostname_tree_free(policy->hostname_tree);
+    qd_policy_settings_cache_flush(policy);
+    qd_hash_free(policy->settings_hash);
+    sys_mutex_free(policy->settings_lock);
+    sys_atomic_destroy(&policy->settings_generation);
+    qd_policy_rate_t *rate = DEQ_HEAD(policy->rates);
+    while (rate) {
+        DEQ_REMOVE_HEAD(policy->rates);
+        qd_hash_handle_free(rate->hash_handle);
+        sys_mutex_free(rate->lock);
+        free(rate);
+        rate = DEQ_HEAD(policy->rates);
+    }
+    qd_hash_free(policy->rate_hash);
+    sys_mutex_free(policy->rate_lock);
     free(policy);
 }
 
+
+static void settings_strings_free(qd_policy_settings_t *settings)
+{
+    free(settings->sources);
+    free(settings->targets);
+    free(settings->sourcePattern);
+    free(settings->targetPattern);
+}
+
+
+static char *settings_strdup(const char *s)
+{
+    return s ? strdup(s) : 0;
+}
+
+
+// settings_lock must be held
+static void settings_cache_flush_LH(qd_policy_t *policy)
+{
+    sys_atomic_inc(&policy->settings_generation);
+    qd_policy_settings_entry_t *entry = DEQ_HEAD(policy->settings_cache);
+    while (entry) {
+        DEQ_REMOVE_HEAD(policy->settings_cache);
+        qd_hash_remove_by_handle(policy->settings_hash, entry->hash_handle);
+        qd_hash_handle_free(entry->hash_handle);
+        settings_strings_free(&entry->settings);
+        free(entry);
+        entry = DEQ_HEAD(policy->settings_cache);
+    }
+}
+
+
+void qd_policy_settings_cache_flush(qd_policy_t *policy)
+{
+    sys_mutex_lock(policy->settings_lock);
+    settings_cache_flush_LH(policy);
+    sys_mutex_unlock(policy->settings_lock);
+}
+
+
+static qd_iterator_t *settings_key(char *buf, size_t size, const char *vhost, const char *group)
+{
+    size_t vlen = strlen(vhost);
+    size_t glen = strlen(group);
+    if (vlen + glen + 1 > size)
+        return 0;
+    memcpy(buf, vhost, vlen);
+    buf[vlen] = 0;
+    memcpy(buf + vlen + 1, group, glen);
+    return qd_iterator_binary(buf, (int) (vlen + 1 + glen), ITER_VIEW_ALL);
+}
+
+
+/**
+ * Apply the settings of a user group to a connection.  Values already enabled or
+ * configured by an authz plugin are kept.
+ */
+static void settings_apply(qd_policy_settings_t *settings, const qd_policy_settings_t *group)
+{
+    settings->maxFrameSize     = group->maxFrameSize;
+    settings->maxSessionWindow = group->maxSessionWindow;
+    settings->maxSessions      = group->maxSessions;
+    settings->maxSenders       = group->maxSenders;
+    settings->maxReceivers     = group->maxReceivers;
+    settings->maxMemory        = group->maxMemory;
+    settings->maxMessageRate      = group->maxMessageRate;
+    settings->maxByteRate         = group->maxByteRate;
+    settings->vhostMaxMessageRate = group->vhostMaxMessageRate;
+    settings->vhostMaxByteRate    = group->vhostMaxByteRate;
+    if (!settings->allowAnonymousSender)
+        settings->allowAnonymousSender = group->allowAnonymousSender;
+    if (!settings->allowDynamicSource)
+        settings->allowDynamicSource = group->allowDynamicSource;
+    settings->allowUserIdProxy       = group->allowUserIdProxy;
+    settings->allowWaypointLinks     = group->allowWaypointLinks;
+    settings->allowDynamicLinkRoutes = group->allowDynamicLinkRoutes;
+    if (settings->sources == 0)
+        settings->sources = settings_strdup(group->sources);
+    if (settings->targets == 0)
+        settings->targets = settings_strdup(group->targets);
+    settings->sourcePattern   = settings_strdup(group->sourcePattern);
+    settings->targetPattern   = settings_strdup(group->targetPattern);
+    settings->sourceParseTree = qd_policy_parse_tree(settings->sourcePattern);
+    settings->targetParseTree = qd_policy_parse_tree(settings->targetPattern);
+    settings->denialCounts    = group->denialCounts;
+}
+
+
+/**
+ * Copy the cached settings of a vhost user group to a connection.
+ * @return true if the group's settings were cached
+ */
+static bool settings_cache_lookup(qd_policy_t *policy, const char *vhost, const char *group,
+                                  qd_policy_settings_t *settings)
+{
+    char key_buf[QD_POLICY_SETTINGS_KEY_MAX];
+    qd_iterator_t *key = settings_key(key_buf, sizeof(key_buf), vhost, group);
+    if (!key)
+        return false;
+
+    qd_policy_settings_entry_t *entry = 0;
+    sys_mutex_lock(policy->settings_lock);
+    qd_hash_retrieve(policy->settings_hash, key, (void **) &entry);
+    if (entry)
+        settings_apply(settings, &entry->settings);
+    sys_mutex_unlock(policy->settings_lock);
+    qd_iterator_free(key);
+    return !!entry;
+}
+
+
+/**
+ * Save the settings of a vhost user group.  Ownership of the strings in group
+ * passes to the cache, or they are freed if the group can't be cached.
+ */
+static void settings_cache_insert(qd_policy_t *policy, const char *vhost, const char *group,
+                                  qd_policy_settings_t *settings)
+{
+    char key_buf[QD_POLICY_SETTINGS_KEY_MAX];
+    qd_iterator_t *key = settings_key(key_buf, sizeof(key_buf), vhost, group);
+    if (!key) {
+        settings_strings_free(settings);
+        return;
+    }
+
+    qd_policy_settings_entry_t *entry = NEW(qd_policy_settings_entry_t);
+    ZERO(entry);
+    DEQ_ITEM_INIT(entry);
+    entry->settings = *settings;
+
+    sys_mutex_lock(policy->settings_lock);
+    if (DEQ_SIZE(policy->settings_cache) >= QD_POLICY_SETTINGS_CACHE_MAX)
+        settings_cache_flush_LH(policy);
+    if (qd_hash_insert(policy->settings_hash, key, entry, &entry->hash_handle) == QD_ERROR_NONE) {
+        DEQ_INSERT_TAIL(policy->settings_cache, entry);
+        entry = 0;
+    }
+    sys_mutex_unlock(policy->settings_lock);
+
+    if (entry) {
+        // another connection cached the group first
+        settings_strings_free(&entry->settings);
+        free(entry);
+    }
+    qd_iterator_free(key);
+}
+
+/**
+ * Find or create the rate for key and take a reference to it.  The limits of
+ * the latest settings replace those of the connections already sharing it.
+ */
+static qd_policy_rate_t *rate_acquire(qd_policy_t *policy, qd_iterator_t *key, int max_messages, int max_bytes)
+{
+    qd_policy_rate_t *rate = 0;
+    sys_mutex_lock(policy->rate_lock);
+    qd_hash_retrieve(policy->rate_hash, key, (void **) &rate);
+    if (!rate) {
+        rate = NEW(qd_policy_rate_t);
+        ZERO(rate);
+        DEQ_ITEM_INIT(rate);
+        rate->policy         = policy;
+        rate->lock           = sys_mutex();
+        rate->message_tokens = (int64_t) max_messages * 1000000;
+        rate->byte_tokens    = (int64_t) max_bytes * 1000000;
+        rate->last_usec      = qd_timer_now_usec();
+        qd_hash_insert(policy->rate_hash, key, rate, &rate->hash_handle);
+        DEQ_INSERT_TAIL(policy->rates, rate);
+    }
+    rate->ref_count++;
+    sys_mutex_lock(rate->lock);
+    rate->max_messages = max_messages;
+    rate->max_bytes    = max_bytes;
+    sys_mutex_unlock(rate->lock);
+    sys_mutex_unlock(policy->rate_lock);
+    return rate;
+}
+
+
+static void rate_release(qd_policy_rate_t *rate)
+{
+    if (!rate)
+        return;
+
+    qd_policy_t *policy = rate->policy;
+    sys_mutex_lock(policy->rate_lock);
+    if (--rate->ref_count > 0)
+        rate = 0;
+    else {
+        DEQ_REMOVE(policy->rates, rate);
+        qd_hash_remove_by_handle(policy->rate_hash, rate->hash_handle);
+        qd_hash_handle_free(rate->hash_handle);
+    }
+    sys_mutex_unlock(policy->rate_lock);
+
+    if (rate) {
+        sys_mutex_free(rate->lock);
+        free(rate);
+    }
+}
+
+
+static void settings_rates_acquire(qd_policy_t *policy, qd_policy_settings_t *settings,
+                                   const char *vhost, const char *username)
+{
+    rate_release(settings->userRate);
+    rate_release(settings->vhostRate);
+    settings->userRate  = 0;
+    settings->vhostRate = 0;
+
+    char key_buf[QD_POLICY_SETTINGS_KEY_MAX];
+    if (settings->maxMessageRate > 0 || settings->maxByteRate > 0) {
+        qd_iterator_t *key = settings_key(key_buf, sizeof(key_buf), vhost, username ? username : "");
+        if (key) {
+            settings->userRate = rate_acquire(policy, key, settings->maxMessageRate, settings->maxByteRate);
+            qd_iterator_free(key);
+        }
+    }
+    if (settings->vhostMaxMessageRate > 0 || settings->vhostMaxByteRate > 0) {
+        qd_iterator_t *key = qd_iterator_string(vhost, ITER_VIEW_ALL);
+        settings->vhostRate = rate_acquire(policy, key, settings->vhostMaxMessageRate, settings->vhostMaxByteRate);
+        qd_iterator_free(key);
+    }
+}
+
+
+// rate->lock must be held
+static void rate_refill_LH(qd_policy_rate_t *rate, int64_t now)
+{
+    int64_t elapsed = now - rate->last_usec;
+    if (elapsed <= 0)
+        return;
+    rate->last_usec = now;
+    if (elapsed > 1000000)
+        elapsed = 1000000;
+
+    rate->message_tokens += elapsed * rate->max_messages;
+    if (rate->message_tokens > rate->max_messages * 1000000)
+        rate->message_tokens = rate->max_messages * 1000000;
+    rate->byte_tokens += elapsed * rate->max_bytes;
+    if (rate->byte_tokens > rate->max_bytes * 1000000)
+        rate->byte_tokens = rate->max_bytes * 1000000;
+}
+
+
+/**
+ * The milliseconds until tokens at limit per second climb back above zero.
+ */
+static int rate_wait_msec(int64_t tokens, int64_t limit)
+{
+    if (limit == 0 || tokens > 0)
+        return 0;
+    int64_t usec = (1 - tokens + limit - 1) / limit;
+    return (int) (usec / 1000) + 1;
+}
+
+
+static void rate_charge(qd_policy_rate_t *rate, size_t bytes)
+{
+    if (!rate)
+        return;
+    if (bytes > INT32_MAX)
+        bytes = INT32_MAX;
+    sys_mutex_lock(rate->lock);
+    rate_refill_LH(rate, qd_timer_now_usec());
+    if (rate->max_messages)
+        rate->message_tokens -= 1000000;
+    if (rate->max_bytes)
+        rate->byte_tokens -= (int64_t) bytes * 1000000;
+    sys_mutex_unlock(rate->lock);
+}
+
+
+static int rate_wait(qd_policy_rate_t *rate)
+{
+    if (!rate)
+        return 0;
+    sys_mutex_lock(rate->lock);
+    rate_refill_LH(rate, qd_timer_now_usec());
+    int msg_wait  = rate_wait_msec(rate->message_tokens, rate->max_messages);
+    int byte_wait = rate_wait_msec(rate->byte_tokens, rate->max_bytes);
+    sys_mutex_unlock(rate->lock);
+    return msg_wait > byte_wait ? msg_wait : byte_wait;
+}
+
+
+void qd_policy_rate_charge(qd_connection_t *qd_conn, size_t bytes)
+{
+    qd_policy_settings_t *settings = qd_conn->policy_settings;
+    rate_charge(settings->userRate, bytes);
+    rate_charge(settings->vhostRate, bytes);
+}
+
+
+bool qd_policy_rate_limited(qd_connection_t *qd_conn)
+{
+    qd_policy_settings_t *settings = qd_conn->policy_settings;
+    if (!settings || (!settings->userRate && !settings->vhostRate))
+        return false;
+
+    int user_wait  = rate_wait(settings->userRate);
+    int vhost_wait = rate_wait(settings->vhostRate);
+    int wait       = user_wait > vhost_wait ? user_wait : vhost_wait;
+    if (wait == 0)
+        return false;
+
+    if (settings->denialCounts)
+        settings->denialCounts->rateLimited++;
+    qd_connection_hold_credit(qd_conn, wait);
+    return true;
+}
+
 //
 //
 #define CHECK() if (qd_error_code()) goto error
@@ -182,7 +570,8 @@ qd_error_t qd_policy_c_counts_refresh(long ccounts, qd_entity_t *entity)
     qd_policy_denial_counts_t *dc = (qd_policy_denial_counts_t*)ccounts;
     if (!qd_entity_set_long(entity, "sessionDenied", dc->sessionDenied) &&
         !qd_entity_set_long(entity, "senderDenied", dc->senderDenied) &&
-        !qd_entity_set_long(entity, "receiverDenied", dc->receiverDenied)
+        !qd_entity_set_long(entity, "receiverDenied", dc->receiverDenied) &&
+        !qd_entity_set_long(entity, "rateLimited", dc->rateLimited)
     )
         return QD_ERROR_NONE;
     return qd_error_code();
@@ -237,7 +626,7 @@ void qd_policy_socket_close(qd_policy_t *policy, const qd_connection_t *conn)
     assert (n_connections >= 0);
     if (policy->enableVhostPolicy) {
         // HACK ALERT: TODO: This should be deferred to a Python thread
-        qd_python_lock_state_t lock_state = qd_python_lock();
+        qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_POLICY);
         PyObject *module = PyImport_ImportModule("qpid_dispatch_internal.policy.policy_manager");
         if (module) {
             PyObject *close_connection = PyObject_GetAttrString(module, "policy_close_connection");
@@ -377,7 +766,7 @@ bool qd_policy_open_lookup_user(
     // Lookup the user/host/vhost for allow/deny and to get settings name
     bool res = false;
     name_buf[0] = 0;
-    qd_python_lock_state_t lock_state = qd_python_lock();
+    qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_POLICY);
     PyObject *module = PyImport_ImportModule("qpid_dispatch_internal.policy.policy_manager");
     if (module) {
         PyObject *lookup_user = PyObject_GetAttrString(module, "policy_lookup_user");
@@ -413,8 +802,14 @@ bool qd_policy_open_lookup_user(
         return false;
     }
 
-    // 
-    if (name_buf[0]) {
+    //
+    // The settings of the user group are fetched from Python only the first time
+    // the group is used on the vhost.
+    //
+    bool cached = settings_cache_lookup(policy, vhost, name_buf, settings);
+    qd_policy_settings_t group;
+    ZERO(&group);
+    if (!cached) {
         // Go get the named settings
         res = false;
         PyObject *upolicy = PyDict_New();
@@ -425,32 +820,27 @@ bool qd_policy_open_lookup_user(
                                                         (PyObject *)policy->py_policy_manager,
                                                         vhost, name_buf, upolicy);
                 if (result2) {
-                    settings->maxFrameSize         = qd_entity_opt_long((qd_entity_t*)upolicy, "maxFrameSize", 0);
-                    settings->maxSessionWindow     = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSessionWindow", 0);
-                    settings->maxSessions          = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSessions", 0);
-                    settings->maxSenders           = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSenders", 0);
-                    settings->maxReceivers         = qd_entity_opt_long((qd_entity_t*)upolicy, "maxReceivers", 0);
-                    if (!settings->allowAnonymousSender) { //don't override if enabled by authz plugin
-                        settings->allowAnonymousSender = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowAnonymousSender", false);
-                    }
-                    if (!settings->allowDynamicSource) { //don't override if enabled by authz plugin
-                        settings->allowDynamicSource   = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowDynamicSource", false);
-                    }
-                    settings->allowUserIdProxy       = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowUserIdProxy", false);
-                    settings->allowWaypointLinks     = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowWaypointLinks", true);
-                    settings->allowDynamicLinkRoutes = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowDynamicLinkRoutes", true);
-                    if (settings->sources == 0) { //don't override if configured by authz plugin
-                        settings->sources              = qd_entity_get_string((qd_entity_t*)upolicy, "sources");
-                    }
-                    if (settings->targets == 0) { //don't override if configured by authz plugin
-                        settings->targets              = qd_entity_get_string((qd_entity_t*)upolicy, "targets");
-                    }
-                    settings->sourcePattern        = qd_entity_get_string((qd_entity_t*)upolicy, "sourcePattern");
-                    settings->targetPattern        = qd_entity_get_string((qd_entity_t*)upolicy, "targetPattern");
-                    settings->sourceParseTree      = qd_policy_parse_tree(settings->sourcePattern);
-                    settings->targetParseTree      = qd_policy_parse_tree(settings->targetPattern);
-                    settings->denialCounts         = (qd_policy_denial_counts_t*)
-                                                    qd_entity_get_long((qd_entity_t*)upolicy, "denialCounts");
+                    group.maxFrameSize           = qd_entity_opt_long((qd_entity_t*)upolicy, "maxFrameSize", 0);
+                    group.maxSessionWindow       = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSessionWindow", 0);
+                    group.maxSessions            = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSessions", 0);
+                    group.maxSenders             = qd_entity_opt_long((qd_entity_t*)upolicy, "maxSenders", 0);
+                    group.maxReceivers           = qd_entity_opt_long((qd_entity_t*)upolicy, "maxReceivers", 0);
+                    group.maxMemory              = qd_entity_opt_long((qd_entity_t*)upolicy, "maxMemory", 0);
+                    group.maxMessageRate         = qd_entity_opt_long((qd_entity_t*)upolicy, "maxMessageRate", 0);
+                    group.maxByteRate            = qd_entity_opt_long((qd_entity_t*)upolicy, "maxByteRate", 0);
+                    group.vhostMaxMessageRate    = qd_entity_opt_long((qd_entity_t*)upolicy, "vhostMaxMessageRate", 0);
+                    group.vhostMaxByteRate       = qd_entity_opt_long((qd_entity_t*)upolicy, "vhostMaxByteRate", 0);
+                    group.allowAnonymousSender   = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowAnonymousSender", false);
+                    group.allowDynamicSource     = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowDynamicSource", false);
+                    group.allowUserIdProxy       = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowUserIdProxy", false);
+                    group.allowWaypointLinks     = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowWaypointLinks", true);
+                    group.allowDynamicLinkRoutes = qd_entity_opt_bool((qd_entity_t*)upolicy, "allowDynamicLinkRoutes", true);
+                    group.sources                = qd_entity_get_string((qd_entity_t*)upolicy, "sources");
+                    group.targets                = qd_entity_get_string((qd_entity_t*)upolicy, "targets");
+                    group.sourcePattern          = qd_entity_get_string((qd_entity_t*)upolicy, "sourcePattern");
+                    group.targetPattern          = qd_entity_get_string((qd_entity_t*)upolicy, "targetPattern");
+                    group.denialCounts           = (qd_policy_denial_counts_t*)
+                                                   qd_entity_get_long((qd_entity_t*)upolicy, "denialCounts");
                     Py_XDECREF(result2);
                     res = true; // named settings content returned
                 } else {
@@ -468,6 +858,11 @@ bool qd_policy_open_lookup_user(
     Py_XDECREF(module);
     qd_python_unlock(lock_state);
 
+    if (res && !cached) {
+        settings_apply(settings, &group);
+        settings_cache_insert(policy, vhost, name_buf, &group);
+    }
+
     if (name_buf[0]) {
         qd_log(policy->log_source,
            QD_LOG_TRACE,
@@ -551,7 +946,7 @@ void qd_policy_apply_session_settings(pn_session_t *ssn, qd_connection_t *qd_con
         const qd_server_config_t * cf = qd_connection_config(qd_conn);
         capacity = cf->incoming_capacity;
     }
-    pn_session_set_incoming_capacity(ssn, capacity);
+    pn_session_set_incoming_capacity(ssn, qd_connection_window_incoming(qd_conn, capacity));
 }
 
 //
@@ -607,54 +1002,74 @@ bool is_token_sep(char testc)
 // Wildcard character at end of source/target name strings
 #define QPALN_WILDCARD '*'
 
-#define MIN(a,b) (((a)<(b))?(a):(b))
-
 /**
- * Given a username and a list of allowed link names 
- * decide if the proposed link name is approved.
- * @param[in] username the user name
- * @param[in] allowed csv of (key, prefix, suffix) tuples
- * @param[in] proposed the link source/target name to be approved
- * @return true if the user is allowed to open this link source/target name
- * 
- * Concrete example
- * user: 'bob', allowed (from spec): 'A,B,tmp-${user},C', proposed: 'tmp-bob'
- * note that allowed above is now a tuple and not simple string fron the spec.
+ * A link name matcher is the packed CSV of allowed source/target names
+ * compiled once for the user of a connection. Non-pattern rules are
+ * resolved to exact names held in a hash and to prefixes for names that
+ * end with a wildcard. Pattern rules keep only which substitution kinds
+ * are present; the names themselves live in the parse tree.
  */
-bool _qd_policy_approve_link_name(const char *username, const char *allowed, const char *proposed)
+struct qd_policy_link_matcher_t {
+    char            *username;
+    qd_parse_tree_t *tree;          // borrowed from the settings, may be 0
+    bool             any;           // a '*' rule allows every name
+    qd_hash_t       *exact;         // names allowed verbatim
+    char           **prefixes;      // names allowed by leading text, '*' removed
+    int              prefix_count;
+    bool             tree_absent;
+    bool             tree_prefix;
+    bool             tree_suffix;
+};
+
+
+static void link_matcher_add_name(qd_policy_link_matcher_t *matcher, char *name)
 {
-    // Verify string sizes are usable
-    size_t p_len = strlen(proposed);
-    if (p_len == 0) {
-        // degenerate case of blank proposed name being opened. will never match anything.
-        return false;
-    }
-    size_t a_len = strlen(allowed);
-    if (a_len == 0) {
-        // no names in 'allowed'.
-        return false;
+    size_t len = strlen(name);
+    if (len > 0 && name[len - 1] == QPALN_WILDCARD) {
+        // Rule clauses that end with wildcard
+        // must match only as many characters as the clause without the '*'.
+        // name=tmp*, will match proposed 'tmp', 'tmp-xxx', 'tmp-bob', ...
+        name[len - 1] = '\0';
+        char **grown = (char **) realloc(matcher->prefixes, (matcher->prefix_count + 1) * sizeof(char *));
+        if (!grown) {
+            free(name);
+            return;
+        }
+        matcher->prefixes = grown;
+        matcher->prefixes[matcher->prefix_count++] = name;
+    } else {
+        // Rule clauses that do not end with wildcard
+        // must match entire proposed name string.
+        // name=tmp-bob-5, proposed can be only 'tmp-bob-5'
+        if (!matcher->exact)
+            matcher->exact = qd_hash(6, 4, 1);
+        qd_iterator_t *key = qd_iterator_string(name, ITER_VIEW_ALL);
+        qd_hash_insert_const(matcher->exact, key, matcher, 0);
+        qd_iterator_free(key);
+        free(name);
     }
+}
+
+
+qd_policy_link_matcher_t *qd_policy_link_matcher(const char *username, const char *allowed, qd_parse_tree_t *tree)
+{
+    qd_policy_link_matcher_t *matcher = NEW(qd_policy_link_matcher_t);
+    ZERO(matcher);
+    matcher->username = strdup(username ? username : "");
+    matcher->tree     = tree;
+
+    if (!allowed || !*allowed)
+        return matcher;
 
-    size_t username_len = strlen(username);
+    size_t username_len = strlen(matcher->username);
 
     // make a writable, disposable copy of the csv string
     char * dup = strdup(allowed);
-    if (!dup) {
-        return false;
-    }
+    if (!dup)
+        return matcher;
     char * dupend = dup + strlen(dup);
     char * pch = dup;
 
-    // get a scratch buffer for writing temporary match strings
-    char * pName = (char *)malloc(QPALN_SIZE);
-    if (!pName) {
-        free(dup);
-        return false;
-    }
-    size_t pName_sz = QPALN_SIZE;
-
-    bool result = false;
-
     while (pch < dupend) {
         // the tuple strings
         char  *pChar, *pS1, *pS2;
@@ -681,196 +1096,193 @@ bool _qd_policy_approve_link_name(const char *username, const char *allowed, con
         pch += sS2 + 1;
         pS2[sS2] = '\0';
 
-        // compute size of generated string and make sure
-        // temporary buffer is big enough to hold it.
-        size_t sName = sS1 + username_len + sS2 + 1;
-        if (sName > pName_sz) {
-            size_t newSize = sName + QPALN_SIZE;
-            char * newPtr = (char *)realloc(pName, newSize);
-            if (!newPtr) {
+        if (tree) {
+            // The parse tree holds the names; remember which user
+            // substitutions have to be tried against it.
+            if (*pChar == *user_subst_i_absent)
+                matcher->tree_absent = true;
+            else if (*pChar == *user_subst_i_prefix)
+                matcher->tree_prefix = true;
+            else if (*pChar == *user_subst_i_suffix)
+                matcher->tree_suffix = true;
+            else if (*pChar == *user_subst_i_embed)
+                assert(false); // not supported
+            else {
+                assert(false);
                 break;
             }
-            pName = newPtr;
-            pName_sz = newSize;
+            continue;
         }
 
-        // if wildcard then check no more
         if (*pChar == *user_subst_i_wildcard) {
-            result = true;
-            break;
+            matcher->any = true;
+            continue;
         }
+
         // From the rule clause construct what the rule is allowing
-        // given the user name associated with this request.
-        int snpN;
+        // given the user name associated with this connection.
+        size_t sName = sS1 + username_len + sS2 + 1;
+        char *pName = (char *) malloc(sName);
+        if (!pName)
+            break;
         if (*pChar == *user_subst_i_absent)
-            snpN = snprintf(pName, sName, "%s", pS1);
+            snprintf(pName, sName, "%s", pS1);
         else if (*pChar == *user_subst_i_prefix)
-            snpN = snprintf(pName, sName, "%s%s", username, pS2);
+            snprintf(pName, sName, "%s%s", matcher->username, pS2);
         else if (*pChar == *user_subst_i_embed)
-            snpN = snprintf(pName, sName, "%s%s%s", pS1, username, pS2);
+            snprintf(pName, sName, "%s%s%s", pS1, matcher->username, pS2);
         else if (*pChar == *user_subst_i_suffix)
-            snpN = snprintf(pName, sName, "%s%s", pS1, username);
+            snprintf(pName, sName, "%s%s", pS1, matcher->username);
         else {
             assert(false);
+            free(pName);
             break;
         }
-
-        size_t rule_len = MIN(snpN, sName); 
-        if (pName[rule_len-1] != QPALN_WILDCARD) {
-            // Rule clauses that do not end with wildcard 
-            // must match entire proposed name string.
-            // pName=tmp-bob-5, proposed can be only 'tmp-bob-5'
-            result = strcmp(proposed, pName) == 0;
-        } else {
-            // Rule clauses that end with wildcard
-            // must match only as many characters as the cluase without the '*'.
-            // pName=tmp*, will match proposed 'tmp', 'tmp-xxx', 'tmp-bob', ...
-            result = strncmp(proposed, pName, rule_len - 1) == 0;
-        }
-        if (result)
-            break;
+        link_matcher_add_name(matcher, pName);
     }
-    free(pName);
     free(dup);
 
-    return result;
+    return matcher;
 }
 
 
-bool _qd_policy_approve_link_name_tree(const char *username, const char *allowed, const char *proposed,
-                                       qd_parse_tree_t *tree)
+void qd_policy_link_matcher_free(qd_policy_link_matcher_t *matcher)
 {
-    // Verify string sizes are usable
-    size_t proposed_len = strlen(proposed);
-    if (proposed_len == 0) {
-        // degenerate case of blank proposed name being opened. will never match anything.
-        return false;
+    if (!matcher) return;
+    for (int i = 0; i < matcher->prefix_count; i++)
+        free(matcher->prefixes[i]);
+    free(matcher->prefixes);
+    qd_hash_free(matcher->exact);
+    free(matcher->username);
+    free(matcher);
+}
+
+
+static bool link_matcher_tree_lookup(qd_parse_tree_t *tree, const char *name)
+{
+    void * unused_payload = 0;
+    return qd_parse_tree_retrieve_match_str(tree, name, &unused_payload);
+}
+
+
+static bool link_matcher_approve_tree(const qd_policy_link_matcher_t *matcher, const char *proposed, size_t proposed_len)
+{
+    if (matcher->tree_absent) {
+        // Substitution spec is absent. The search string is the
+        // proposed name itself.
+        if (link_matcher_tree_lookup(matcher->tree, proposed))
+            return true;
     }
-    size_t a_len = strlen(allowed);
-    if (a_len == 0) {
-        // no names in 'allowed'.
+
+    if (!matcher->tree_prefix && !matcher->tree_suffix)
         return false;
-    }
 
-    size_t username_len = strlen(username);
-    size_t usersubst_len = strlen(user_subst_key);
+    const char *username     = matcher->username;
+    size_t      username_len = strlen(username);
+    size_t      usersubst_len = strlen(user_subst_key);
 
-    // make a writable, disposable copy of the csv string
-    char * dup = strdup(allowed);
-    if (!dup) {
+    // scratch buffer for writing temporary match strings
+    char   on_stack[QPALN_SIZE];
+    size_t sName = proposed_len + usersubst_len + 1;
+    char  *pName = sName <= QPALN_SIZE ? on_stack : (char *) malloc(sName);
+    if (!pName)
         return false;
+
+    bool result = false;
+
+    if (matcher->tree_prefix &&
+        strncmp(proposed, username, username_len) == 0 &&
+        // Check that username is not part of a larger token.
+        (username_len == proposed_len || is_token_sep(proposed[username_len]))) {
+        snprintf(pName, sName, "%s%s", user_subst_key, proposed + username_len);
+        result = link_matcher_tree_lookup(matcher->tree, pName);
     }
-    char * dupend = dup + strlen(dup);
-    char * pch = dup;
 
-    // get a scratch buffer for writing temporary match strings
-    char * pName = (char *)malloc(QPALN_SIZE);
-    if (!pName) {
-        free(dup);
-        return false;
+    // Check that link name has a delimited username suffix.
+    // A substitution-only rule clause is handled by prefix.
+    if (!result && matcher->tree_suffix &&
+        username_len < proposed_len &&
+        is_token_sep(proposed[proposed_len - username_len - 1]) &&
+        strncmp(&proposed[proposed_len - username_len], username, username_len) == 0) {
+        pName[0] = '\0';
+        strncat(pName, proposed, proposed_len - username_len);
+        strcat(pName, user_subst_key);
+        result = link_matcher_tree_lookup(matcher->tree, pName);
     }
-    size_t pName_sz = QPALN_SIZE;
 
-    bool result = false;
+    if (pName != on_stack)
+        free(pName);
+    return result;
+}
 
-    while (pch < dupend) {
-        // the tuple strings
-        char  *pChar, *pS1, *pS2;
-        size_t sChar,  sS1,  sS2;
 
-        // extract control field
-        sChar = strcspn(pch, QPALN_COMMA_SEP);
-        if (sChar != 1) { assert(false); break;}
-        pChar = pch;
-        pChar[sChar] = '\0';
-        pch += sChar + 1;
-        if (pch >= dupend) { assert(false); break; }
+bool qd_policy_link_matcher_approve(const qd_policy_link_matcher_t *matcher, const char *proposed)
+{
+    size_t proposed_len = strlen(proposed);
+    if (proposed_len == 0) {
+        // degenerate case of blank proposed name being opened. will never match anything.
+        return false;
+    }
 
-        // extract prefix field S1
-        sS1 = strcspn(pch, QPALN_COMMA_SEP);
-        pS1 = pch;
-        pS1[sS1] = '\0';
-        pch += sS1 + 1;
-        if (pch > dupend) { assert(false); break; }
+    if (matcher->tree)
+        return link_matcher_approve_tree(matcher, proposed, proposed_len);
 
-        // extract suffix field S2
-        sS2 = strcspn(pch, QPALN_COMMA_SEP);
-        pS2 = pch;
-        pch += sS2 + 1;
-        pS2[sS2] = '\0';
+    if (matcher->any)
+        return true;
 
-        // compute size of generated string and make sure
-        // temporary buffer is big enough to hold it.
-        size_t sName = proposed_len + usersubst_len + 1;
-        if (sName > pName_sz) {
-            size_t newSize = sName + QPALN_SIZE;
-            char * newPtr = (char *)realloc(pName, newSize);
-            if (!newPtr) {
-                break;
-            }
-            pName = newPtr;
-            pName_sz = newSize;
-        }
+    if (matcher->exact) {
+        const void    *unused = 0;
+        qd_iterator_t *key    = qd_iterator_string(proposed, ITER_VIEW_ALL);
+        qd_hash_retrieve_const(matcher->exact, key, &unused);
+        qd_iterator_free(key);
+        if (unused)
+            return true;
+    }
 
-        // From the rule clause construct what the rule is allowing
-        // given the user name associated with this request.
-        if (*pChar == *user_subst_i_absent) {
-            // Substitution spec is absent. The search string is the literal
-            // S1 in the rule.
-            snprintf(pName, sName, "%s", proposed);
-        }
-        else if (*pChar == *user_subst_i_prefix) {
-            // Substitution spec is prefix.
-            if (strncmp(proposed, username, username_len) != 0)
-                continue; // Denied. Proposed does not have username prefix.
-            // Check that username is not part of a larger token.
-            if (username_len == proposed_len) {
-                // If username is the whole link name then allow if lookup is ok
-            } else {
-                // Proposed is longer than username. Make sure that proposed
-                // is delimited after user name.
-                if (!is_token_sep(proposed[username_len])) {
-                    continue; // denied. proposed has username prefix it it not a delimited user name
-                }
-            }
-            snprintf(pName, sName, "%s%s", user_subst_key, proposed + username_len);
-        }
-        else if (*pChar == *user_subst_i_embed) {
-            assert(false); // not supported
-        }
-        else if (*pChar == *user_subst_i_suffix) {
-            // Check that link name has username suffix
-            if (username_len > proposed_len) {
-                continue; // denied. proposed name is too short to hold username
-            } else {
-                //---
-                // if (username_len == proposed_len) { ... }
-                // unreachable code. substitution-only rule clause is handled by prefix
-                //---
-                if (!is_token_sep(proposed[proposed_len - username_len - 1])) {
-                    continue; // denied. proposed suffix it it not a delimited user name
-                }
-                if (strncmp(&proposed[proposed_len - username_len], username, username_len) != 0) {
-                    continue; // denied. username is not the suffix
-                }
-            }
-            pName[0] = '\0';
-            strncat(pName, proposed, proposed_len - username_len);
-            strcat(pName, user_subst_key);
-        }
-        else {
-            assert(false);
-            break;
-        }
+    for (int i = 0; i < matcher->prefix_count; i++) {
+        const char *prefix = matcher->prefixes[i];
+        if (strncmp(proposed, prefix, strlen(prefix)) == 0)
+            return true;
+    }
+    return false;
+}
 
-        void * unused_payload = 0;
-        result = qd_parse_tree_retrieve_match_str(tree, pName, &unused_payload);
-        if (result)
-            break;
+
+/**
+ * Given a username and a list of allowed link names 
+ * decide if the proposed link name is approved.
+ * @param[in] username the user name
+ * @param[in] allowed csv of (key, prefix, suffix) tuples
+ * @param[in] proposed the link source/target name to be approved
+ * @return true if the user is allowed to open this link source/target name
+ * 
+ * Concrete example
+ * user: 'bob', allowed (from spec): 'A,B,tmp-${user},C', proposed: 'tmp-bob'
+ * note that allowed above is now a tuple and not simple string fron the spec.
+ */
+bool _qd_policy_approve_link_name(const char *username, const char *allowed, const char *proposed)
+{
+    if (!*proposed || !*allowed) {
+        // blank proposed name never matches; no names in 'allowed'.
+        return false;
     }
-    free(pName);
-    free(dup);
+    qd_policy_link_matcher_t *matcher = qd_policy_link_matcher(username, allowed, 0);
+    bool result = qd_policy_link_matcher_approve(matcher, proposed);
+    qd_policy_link_matcher_free(matcher);
+    return result;
+}
+
 
+bool _qd_policy_approve_link_name_tree(const char *username, const char *allowed, const char *proposed,
+                                       qd_parse_tree_t *tree)
+{
+    if (!*proposed || !*allowed) {
+        // blank proposed name never matches; no names in 'allowed'.
+        return false;
+    }
+    qd_policy_link_matcher_t *matcher = qd_policy_link_matcher(username, allowed, tree);
+    bool result = qd_policy_link_matcher_approve(matcher, proposed);
+    qd_policy_link_matcher_free(matcher);
     return result;
 }
 
@@ -892,8 +1304,54 @@ static bool qd_policy_terminus_is_waypoint(pn_terminus_t *term)
     return false;
 }
 
+/**
+ * Look up a previous approval of a message target on this connection.
+ * The cache is emptied when the policy settings generation moved on.
+ * @return &target_approval_allow, &target_approval_deny or 0 if not cached
+ */
+static const void *target_approval_lookup(qd_policy_settings_t *settings, qd_iterator_t *address, uint32_t generation)
+{
+    if (!settings->targetApprovals)
+        return 0;
+    if (settings->targetApprovalGeneration != generation ||
+        settings->targetApprovalCount >= QD_POLICY_TARGET_CACHE_MAX) {
+        qd_hash_free(settings->targetApprovals);
+        settings->targetApprovals     = 0;
+        settings->targetApprovalCount = 0;
+        return 0;
+    }
+    const void *approval = 0;
+    qd_hash_retrieve_const(settings->targetApprovals, address, &approval);
+    return approval;
+}
+
+
+static void target_approval_insert(qd_policy_settings_t *settings, qd_iterator_t *address, uint32_t generation, bool allowed)
+{
+    if (!settings->targetApprovals) {
+        settings->targetApprovals          = qd_hash(6, 4, 1);
+        settings->targetApprovalGeneration = generation;
+    }
+    const void *approval = allowed ? &target_approval_allow : &target_approval_deny;
+    if (qd_hash_insert_const(settings->targetApprovals, address, approval, 0) == QD_ERROR_NONE)
+        settings->targetApprovalCount++;
+}
+
+
 bool qd_policy_approve_message_target(qd_iterator_t *address, qd_connection_t *qd_conn)
 {
+    qd_policy_t          *policy     = qd_server_dispatch(qd_conn->server)->policy;
+    qd_policy_settings_t *settings   = qd_conn->policy_settings;
+    uint32_t              generation = sys_atomic_get(&policy->settings_generation);
+
+    bool lookup = false;
+    const void *approval = target_approval_lookup(settings, address, generation);
+    if (approval) {
+        lookup = approval == &target_approval_allow;
+        if (!qd_log_enabled(policy->log_source, lookup ? QD_LOG_TRACE : QD_LOG_INFO))
+            return lookup;
+    }
+
 #define ON_STACK_SIZE 2048
     char  on_stack[ON_STACK_SIZE + 1];
     char *buffer    = on_stack;
@@ -907,27 +1365,21 @@ bool qd_policy_approve_message_target(qd_iterator_t *address, qd_connection_t *q
 
     const char* target = qd_iterator_strncpy(address, buffer, length + 1);
 
-    bool lookup = false;
-    if (qd_conn->policy_settings->targetParseTree) {
-        lookup = _qd_policy_approve_link_name_tree(qd_conn->user_id, qd_conn->policy_settings->targetPattern, target, qd_conn->policy_settings->targetParseTree);
-    } else if (qd_conn->policy_settings->targets) {
-        lookup = _qd_policy_approve_link_name(qd_conn->user_id, qd_conn->policy_settings->targets, target);
+    if (!approval) {
+        lookup = qd_policy_approve_link_name(qd_conn->user_id, settings, target, false);
+        target_approval_insert(settings, address, generation, lookup);
     }
 
     const char *hostip = qd_connection_remote_ip(qd_conn);
     const char *vhost = pn_connection_remote_hostname(qd_connection_pn(qd_conn));
-    qd_log(qd_server_dispatch(qd_conn->server)->policy->log_source, (lookup ? QD_LOG_TRACE : QD_LOG_INFO),
+    qd_log(policy->log_source, (lookup ? QD_LOG_TRACE : QD_LOG_INFO),
            "[%"PRIu64"]: %s AMQP message to '%s' for user '%s', rhost '%s', vhost '%s' based on target address",
            qd_conn->connection_id, (lookup ? "ALLOW" : "DENY"), target, qd_conn->user_id, hostip, vhost);
 
     if (on_heap)
         free(buffer);
 
-    if (!lookup) {
-        return false;
-    } else {
-        return true;
-    }
+    return lookup;
 }
 
 bool qd_policy_approve_amqp_sender_link(pn_link_t *pn_link, qd_connection_t *qd_conn)
@@ -1067,7 +1519,8 @@ void qd_policy_amqp_open(qd_connection_t *qd_conn) {
     qd_policy_t *policy = qd->policy;
     bool connection_allowed = true;
 
-    if (policy->enableVhostPolicy && (!qd_conn->role || strcmp(qd_conn->role, "inter-router"))) {
+    if (policy->enableVhostPolicy && (!qd_conn->role || (strcmp(qd_conn->role, "inter-router") &&
+                                                                  strcmp(qd_conn->role, "inter-router-data")))) {
         // Open connection or not based on policy.
         pn_transport_t *pn_trans = pn_connection_transport(conn);
         const char *hostip = qd_connection_remote_ip(qd_conn);
@@ -1087,11 +1540,17 @@ void qd_policy_amqp_open(qd_connection_t *qd_conn) {
                                        qd_conn->policy_settings) &&
             settings_name[0]) {
             // This connection is allowed by policy.
+            // Compile the allowed link names for this user
+            qd_policy_settings_compile_link_names(qd_conn->policy_settings, qd_conn->user_id);
+            // Join the message and byte rates of the user and the vhost
+            settings_rates_acquire(policy, qd_conn->policy_settings, vhost, qd_conn->user_id);
             // Apply transport policy settings
             if (qd_conn->policy_settings->maxFrameSize > 0)
                 pn_transport_set_max_frame(pn_trans, qd_conn->policy_settings->maxFrameSize);
             if (qd_conn->policy_settings->maxSessions > 0)
                 pn_transport_set_channel_max(pn_trans, qd_conn->policy_settings->maxSessions - 1);
+            if (qd_conn->policy_settings->maxMemory > 0)
+                qd_connection_set_memory_limit(qd_conn, qd_conn->policy_settings->maxMemory);
         } else {
             // This connection is denied by policy.
             connection_allowed = false;
@@ -1119,15 +1578,43 @@ void qd_policy_settings_free(qd_policy_settings_t *settings)
     if (settings->targetPattern)   free(settings->targetPattern);
     if (settings->sourceParseTree) qd_parse_tree_free(settings->sourceParseTree);
     if (settings->targetParseTree) qd_parse_tree_free(settings->targetParseTree);
+    qd_policy_link_matcher_free(settings->sourceMatcher);
+    qd_policy_link_matcher_free(settings->targetMatcher);
+    qd_hash_free(settings->targetApprovals);
+    rate_release(settings->userRate);
+    rate_release(settings->vhostRate);
     free (settings);
 }
 
 
+void qd_policy_settings_compile_link_names(qd_policy_settings_t *settings, const char *username)
+{
+    qd_policy_link_matcher_free(settings->sourceMatcher);
+    qd_policy_link_matcher_free(settings->targetMatcher);
+    settings->sourceMatcher = 0;
+    settings->targetMatcher = 0;
+
+    if (settings->sourceParseTree)
+        settings->sourceMatcher = qd_policy_link_matcher(username, settings->sourcePattern, settings->sourceParseTree);
+    else if (settings->sources)
+        settings->sourceMatcher = qd_policy_link_matcher(username, settings->sources, 0);
+
+    if (settings->targetParseTree)
+        settings->targetMatcher = qd_policy_link_matcher(username, settings->targetPattern, settings->targetParseTree);
+    else if (settings->targets)
+        settings->targetMatcher = qd_policy_link_matcher(username, settings->targets, 0);
+}
+
+
 bool qd_policy_approve_link_name(const char *username,
                                  const qd_policy_settings_t *settings,
                                  const char *proposed,
                                  bool isReceiver)
 {
+    const qd_policy_link_matcher_t *matcher = isReceiver ? settings->sourceMatcher : settings->targetMatcher;
+    if (matcher)
+        return qd_policy_link_matcher_approve(matcher, proposed);
+
     if (isReceiver) {
         if (settings->sourceParseTree) {
             return _qd_policy_approve_link_name_tree(username, settings->sourcePattern, proposed, settings->sourceParseTree);
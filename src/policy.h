@@ -38,16 +38,25 @@ struct qd_policy_denial_counts_s {
     int sessionDenied;
     int senderDenied;
     int receiverDenied;
+    int rateLimited;
 };
 
 typedef struct qd_policy_t qd_policy_t;
 
+typedef struct qd_policy_link_matcher_t qd_policy_link_matcher_t;
+typedef struct qd_policy_rate_t qd_policy_rate_t;
+
 struct qd_policy__settings_s {
     int  maxFrameSize;
     int  maxSessionWindow;
     int  maxSessions;
     int  maxSenders;
     int  maxReceivers;
+    int  maxMemory;
+    int  maxMessageRate;
+    int  maxByteRate;
+    int  vhostMaxMessageRate;
+    int  vhostMaxByteRate;
     bool allowDynamicSource;
     bool allowAnonymousSender;
     bool allowUserIdProxy;
@@ -59,6 +68,13 @@ struct qd_policy__settings_s {
     char *targetPattern;
     qd_parse_tree_t *sourceParseTree;
     qd_parse_tree_t *targetParseTree;
+    qd_policy_link_matcher_t *sourceMatcher;
+    qd_policy_link_matcher_t *targetMatcher;
+    qd_hash_t *targetApprovals;
+    int        targetApprovalCount;
+    uint32_t   targetApprovalGeneration;
+    qd_policy_rate_t *userRate;
+    qd_policy_rate_t *vhostRate;
     qd_policy_denial_counts_t *denialCounts;
 };
 
@@ -168,6 +184,14 @@ void qd_policy_amqp_open(qd_connection_t *conn);
  */
 void qd_policy_settings_free(qd_policy_settings_t *settings);
 
+/** Compile the allowed sources and targets of the settings for one user
+ * so that link attaches are approved without parsing the CSV again.
+ * 
+ * @param settings the settings of an allowed connection
+ * @param username authenticated user name of the connection
+ */
+void qd_policy_settings_compile_link_names(qd_policy_settings_t *settings, const char *username);
+
 /** Approve link by source/target name.
  * @param[in] username authenticated user name
  * @param[in] settings policy settings
@@ -198,6 +222,12 @@ bool qd_policy_host_pattern_add(qd_policy_t *policy, const char *hostPattern);
  */
 void qd_policy_host_pattern_remove(qd_policy_t *policy, const char *hostPattern);
 
+/** Discard the user group settings cached from the Python policy manager.
+ * Called when the policy rulesets change.
+ * @param[in] policy qd_policy_t
+ */
+void qd_policy_settings_cache_flush(qd_policy_t *policy);
+
 /** Look up a hostname in the lookup parse_tree
  * @param[in] policy qd_policy_t
  * @param[in] hostname a concrete vhost name
@@ -222,4 +252,20 @@ char * qd_policy_compile_allowed_csv(char * csv);
  * @param[in] qd_conn dispatch connection with policy settings
  */
 bool qd_policy_approve_message_target(qd_iterator_t *address, qd_connection_t *qd_conn);
+
+/** Account a message received on a connection against the message and byte
+ * rate limits of its user and vhost.
+ * @param[in] qd_conn the connection, which must have policy settings
+ * @param[in] bytes the size of the message
+ */
+void qd_policy_rate_charge(qd_connection_t *qd_conn, size_t bytes);
+
+/** Check the message and byte rate limits of a connection's user and vhost
+ * before credit is issued to its receiving links.  When a limit is exceeded
+ * the connection is asked to issue the withheld credit once the rate allows
+ * another message; see qd_connection_hold_credit.
+ * @param[in] qd_conn the connection
+ * @return true if credit must be withheld
+ */
+bool qd_policy_rate_limited(qd_connection_t *qd_conn);
 #endif
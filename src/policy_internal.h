@@ -94,4 +94,27 @@ bool _qd_policy_approve_link_name(const char *username, const char *allowed, con
  * @param[in] tree the parse tree for this source/target names
  */
 bool _qd_policy_approve_link_name_tree(const char *username, const char *allowed, const char *proposed, qd_parse_tree_t *tree);
+
+
+/** Compile a link name matcher.
+ * The packed CSV is parsed once and ${user} is resolved for username.
+ * @param[in] username authenticated user name
+ * @param[in] allowed policy settings source/target string in packed CSV form.
+ * @param[in] tree the parse tree for pattern source/target names, or 0
+ * @return the matcher, to be released with qd_policy_link_matcher_free
+ */
+qd_policy_link_matcher_t *qd_policy_link_matcher(const char *username, const char *allowed, qd_parse_tree_t *tree);
+
+
+/** Approve link by source/target name using a compiled matcher.
+ * @param[in] matcher the matcher for the connection
+ * @param[in] proposed the link source/target name to be approved
+ */
+bool qd_policy_link_matcher_approve(const qd_policy_link_matcher_t *matcher, const char *proposed);
+
+
+/** Dispose of a link name matcher
+ * @param[in] matcher the matcher to be destroyed, may be 0
+ */
+void qd_policy_link_matcher_free(qd_policy_link_matcher_t *matcher);
 #endif
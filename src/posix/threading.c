@@ -23,11 +23,20 @@
 //
 #undef NDEBUG
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <qpid/dispatch/threading.h>
 #include <qpid/dispatch/ctools.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <assert.h>
+#include <time.h>
 
 struct sys_mutex_t {
     pthread_mutex_t mutex;
@@ -93,6 +102,22 @@ void sys_cond_wait(sys_cond_t *cond, sys_mutex_t *held_mutex)
 }
 
 
+void sys_cond_timedwait(sys_cond_t *cond, sys_mutex_t *held_mutex, int64_t usec)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += usec / 1000000;
+    deadline.tv_nsec += (usec % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec  += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int result = pthread_cond_timedwait(&(cond->cond), &(held_mutex->mutex), &deadline);
+    assert(result == 0 || result == ETIMEDOUT);
+}
+
+
 void sys_cond_signal(sys_cond_t *cond)
 {
     int result = pthread_cond_signal(&(cond->cond));
@@ -177,3 +202,47 @@ void sys_thread_join(sys_thread_t *thread)
 {
     pthread_join(thread->thread, 0);
 }
+
+
+int sys_thread_set_affinity(const char *cpus)
+{
+#ifdef __linux__
+    cpu_set_t   set;
+    const char *cursor = cpus;
+
+    CPU_ZERO(&set);
+    while (*cursor) {
+        char *end;
+        long  first = strtol(cursor, &end, 10);
+        long  last  = first;
+
+        if (end == cursor || first < 0)
+            return EINVAL;
+        cursor = end;
+        if (*cursor == '-') {
+            cursor++;
+            last = strtol(cursor, &end, 10);
+            if (end == cursor || last < first)
+                return EINVAL;
+            cursor = end;
+        }
+        if (last >= CPU_SETSIZE)
+            return EINVAL;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &set);
+
+        while (isspace((unsigned char) *cursor))
+            cursor++;
+        if (*cursor == ',')
+            cursor++;
+        else if (*cursor)
+            return EINVAL;
+    }
+
+    if (CPU_COUNT(&set) == 0)
+        return EINVAL;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return ENOTSUP;
+#endif
+}
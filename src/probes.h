@@ -0,0 +1,51 @@
+#ifndef __dispatch_probes_h__
+#define __dispatch_probes_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+/* Static tracepoints (USDT) on the delivery lifecycle.
+ *
+ * The probes belong to the provider "qdrouterd" and can be attached to with
+ * bpftrace or SystemTap.  Each one is a single nop until a tracer attaches to
+ * it, and is compiled out entirely unless USE_SDT_PROBES is set.  The first
+ * argument is always the qd_message_trace_id of the message, shared by the
+ * incoming delivery and every outgoing copy, so a tracer can pair up events:
+ *
+ *     bpftrace -e 'usdt:libqpid-dispatch.so:qdrouterd:message_received { @t[arg0] = nsecs; }
+ *                  usdt:libqpid-dispatch.so:qdrouterd:message_sent /@t[arg0]/ { @usec = hist((nsecs - @t[arg0]) / 1000); }'
+ *
+ *   message_received  (message, link)                 the whole message has arrived (I/O thread)
+ *   link_deliver      (message, delivery, link id)    the core takes an incoming delivery
+ *   forward           (message, treatment, fanout)    the core has chosen the message's destinations
+ *   core_link_deliver (message, delivery, settled)    an I/O thread writes an outgoing delivery
+ *   message_sent      (message, link)                 the whole message has been written (I/O thread)
+ *   delivery_update   (message, disposition, settled) the core applies a disposition
+ */
+#if USE_SDT_PROBES
+#include <sys/sdt.h>
+#define QD_PROBE2(name, a1, a2)     DTRACE_PROBE2(qdrouterd, name, a1, a2)
+#define QD_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(qdrouterd, name, a1, a2, a3)
+#else
+#define QD_PROBE2(name, a1, a2)     do {} while (0)
+#define QD_PROBE3(name, a1, a2, a3) do {} while (0)
+#endif
+
+#endif
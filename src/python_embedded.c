@@ -27,13 +27,21 @@
 #include <qpid/dispatch/amqp.h>
 #include <qpid/dispatch/alloc.h>
 #include <qpid/dispatch/router.h>
+#include <qpid/dispatch/timer.h>
 #include <qpid/dispatch/error.h>
 
 #include <ctype.h>
+#include <inttypes.h>
 
 
 #define DISPATCH_MODULE "qpid_dispatch_internal.dispatch"
 
+// A single hold of the python lock this long is logged as a warning
+#define QD_PYTHON_HOLD_WARN_USEC   100000
+
+// Interval of the per-caller report of python lock hold times
+#define QD_PYTHON_HOLD_REPORT_USEC 60000000
+
 //===============================================================================
 // Control Functions
 //===============================================================================
@@ -46,7 +54,33 @@ static PyObject        *dispatch_module = 0;
 static PyObject        *message_type = 0;
 static PyObject        *dispatch_python_pkgdir = 0;
 
+typedef struct {
+    uint64_t count;
+    uint64_t total_usec;
+    uint64_t max_usec;
+} qd_python_hold_stats_t;
+
+static const char *caller_names[QD_PYTHON_CALLER_COUNT] = {"startup", "router", "agent", "policy"};
+
+// Guarded by ilock
+static qd_python_hold_stats_t  hold_stats[QD_PYTHON_CALLER_COUNT];
+static qd_python_caller_t      holder;
+static int64_t                 hold_start;
+static int64_t                 report_start;
+static PyThreadState          *saved_state = 0;
+
+//
+// Every thread but the worker runs python in the thread state created by
+// Py_Initialize, so none of them may release the lock in the middle of a python
+// call.  The worker has a state of its own that it swaps in with the lock, which
+// lets it release the lock around C calls made from python.
+//
+static __thread PyThreadState *thread_state = 0;
+
 static void qd_python_setup(void);
+static void qd_python_worker_initialize(void);
+static void qd_python_worker_finalize(void);
+static void *qd_python_worker_run(void *unused);
 
 
 void qd_python_initialize(qd_dispatch_t *qd, const char *python_pkgdir)
@@ -54,10 +88,12 @@ void qd_python_initialize(qd_dispatch_t *qd, const char *python_pkgdir)
     log_source = qd_log_source("PYTHON");
     dispatch = qd;
     ilock = sys_mutex();
+    report_start = qd_timer_now_usec();
+    qd_python_worker_initialize();
     if (python_pkgdir)
         dispatch_python_pkgdir = PyUnicode_FromString(python_pkgdir);
 
-    qd_python_lock_state_t ls = qd_python_lock();
+    qd_python_lock_state_t ls = qd_python_lock(QD_PYTHON_CALLER_STARTUP);
     Py_Initialize();
     qd_python_setup();
     qd_python_unlock(ls);
@@ -71,6 +107,7 @@ void qd_python_finalize(void)
     dispatch_module = 0;
     PyGC_Collect();
     Py_Finalize();
+    qd_python_worker_finalize();
 }
 
 
@@ -460,8 +497,39 @@ typedef struct {
     qd_dispatch_t      *qd;
     qdr_core_t         *core;
     qdr_subscription_t *sub;
+    int                 threaded;  ///< The handler runs on the python worker thread
 } IoAdapter;
 
+
+//
+// Messages for threaded IoAdapters, waiting for the python worker thread
+//
+typedef struct qd_python_work_t qd_python_work_t;
+
+struct qd_python_work_t {
+    DEQ_LINKS(qd_python_work_t);
+    IoAdapter    *adapter;
+    qd_message_t *msg;
+    int           link_id;
+    int           inter_router_cost;
+};
+
+ALLOC_DECLARE(qd_python_work_t);
+ALLOC_DEFINE(qd_python_work_t);
+DEQ_DECLARE(qd_python_work_t, qd_python_work_list_t);
+
+static sys_mutex_t           *work_lock = 0;   // Taken after ilock when both are held
+static sys_cond_t            *work_cond = 0;
+static qd_python_work_list_t  work_queue;
+static bool                   work_stopping;
+static sys_thread_t          *work_thread = 0;
+
+static void qd_python_work_free(qd_python_work_t *work)
+{
+    qd_message_free(work->msg);
+    free_qd_python_work_t(work);
+}
+
 // Parse an iterator to a python object.
 static PyObject *py_iter_parse(qd_iterator_t *iter)
 {
@@ -512,23 +580,15 @@ static qd_error_t iter_to_py_attr(qd_iterator_t *iter,
     return qd_error_code();
 }
 
-static void qd_io_rx_handler(void *context, qd_message_t *msg, int link_id, int inter_router_cost,
-                             uint64_t ignore)
+/**
+ * Pass a message to an IoAdapter's handler.
+ * Called with qd_python_lock held
+ */
+static void qd_io_deliver(IoAdapter *self, qd_message_t *msg, int link_id, int inter_router_cost)
 {
-    IoAdapter *self = (IoAdapter*) context;
-
-    //
-    // Parse the message through the body and exit if the message is not well formed.
-    //
-    if (!qd_message_check(msg, QD_DEPTH_BODY))
-        return;
-
-    // This is called from non-python threads so we need to acquire the GIL to use python APIS.
-    qd_python_lock_state_t lock_state = qd_python_lock();
     PyObject *py_msg = PyObject_CallFunction(message_type, NULL);
     if (!py_msg) {
         qd_error_py();
-        qd_python_unlock(lock_state);
         return;
     }
     iter_to_py_attr(qd_message_field_iterator(msg, QD_FIELD_TO), py_iter_copy, py_msg, "address");
@@ -543,6 +603,45 @@ static void qd_io_rx_handler(void *context, qd_message_t *msg, int link_id, int
     Py_DECREF(py_msg);
     Py_XDECREF(value);
     qd_error_py();
+}
+
+
+static void qd_io_rx_handler(void *context, qd_message_t *msg, int link_id, int inter_router_cost,
+                             uint64_t ignore)
+{
+    IoAdapter *self = (IoAdapter*) context;
+
+    //
+    // Parse the message through the body and exit if the message is not well formed.
+    //
+    if (!qd_message_check(msg, QD_DEPTH_BODY))
+        return;
+
+    if (self->threaded) {
+        qd_python_work_t *work = new_qd_python_work_t();
+        ZERO(work);
+        DEQ_ITEM_INIT(work);
+        work->adapter           = self;
+        work->msg               = qd_message_copy(msg);
+        work->link_id           = link_id;
+        work->inter_router_cost = inter_router_cost;
+
+        sys_mutex_lock(work_lock);
+        if (!work_stopping) {
+            DEQ_INSERT_TAIL(work_queue, work);
+            work = 0;
+            sys_cond_signal(work_cond);
+        }
+        sys_mutex_unlock(work_lock);
+
+        if (work)
+            qd_python_work_free(work);
+        return;
+    }
+
+    // This is called from non-python threads so we need to acquire the GIL to use python APIS.
+    qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_ROUTER);
+    qd_io_deliver(self, msg, link_id, inter_router_cost);
     qd_python_unlock(lock_state);
 }
 
@@ -556,7 +655,9 @@ static int IoAdapter_init(IoAdapter *self, PyObject *args, PyObject *kwds)
 
     const char *aclass_str = NULL;
     const char *phase_str = NULL;
-    if (!PyArg_ParseTuple(args, "OO|ssi", &self->handler, &addr, &aclass_str, &phase_str, &treatment))
+    self->threaded = 0;
+    if (!PyArg_ParseTuple(args, "OO|ssip", &self->handler, &addr, &aclass_str, &phase_str, &treatment,
+                          &self->threaded))
         return -1;
     if (aclass_str) {
         if (strlen(aclass_str) != 1 || !isalpha(*aclass_str)) {
@@ -580,6 +681,12 @@ static int IoAdapter_init(IoAdapter *self, PyObject *args, PyObject *kwds)
         PyErr_SetString(PyExc_TypeError, "IoAdapter: ANYCAST_BALANCED is not supported for in-process subscriptions");
         return -1;
     }
+    if (self->threaded) {
+        sys_mutex_lock(work_lock);
+        if (!work_thread && !work_stopping)
+            work_thread = sys_thread(qd_python_worker_run, 0);
+        sys_mutex_unlock(work_lock);
+    }
     Py_INCREF(self->handler);
     self->qd   = dispatch;
     self->core = qd_router_core(self->qd);
@@ -597,6 +704,25 @@ static int IoAdapter_init(IoAdapter *self, PyObject *args, PyObject *kwds)
 
 static void IoAdapter_dealloc(IoAdapter* self)
 {
+    if (self->threaded) {
+        qd_python_work_list_t dropped;
+        DEQ_INIT(dropped);
+        sys_mutex_lock(work_lock);
+        qd_python_work_t *work = DEQ_HEAD(work_queue);
+        while (work) {
+            qd_python_work_t *next = DEQ_NEXT(work);
+            if (work->adapter == self) {
+                DEQ_REMOVE(work_queue, work);
+                DEQ_INSERT_TAIL(dropped, work);
+            }
+            work = next;
+        }
+        sys_mutex_unlock(work_lock);
+        while ((work = DEQ_HEAD(dropped))) {
+            DEQ_REMOVE_HEAD(dropped);
+            qd_python_work_free(work);
+        }
+    }
     qdr_core_unsubscribe(self->sub);
     Py_DECREF(self->handler);
     Py_TYPE(self)->tp_free((PyObject*)self);
@@ -605,18 +731,9 @@ static void IoAdapter_dealloc(IoAdapter* self)
 static qd_error_t compose_python_message(qd_composed_field_t **field, PyObject *message,
                                          qd_dispatch_t* qd) {
 
-    // Add header first
-    *field   = qd_compose(QD_PERFORMATIVE_HEADER, *field);
-
-    qd_compose_start_list(*field);
-    qd_compose_insert_bool(*field, 0);     // durable
-    qd_compose_end_list(*field);
-
+    // Header and the properties up to the "to" field
+    *field = qd_message_start_properties();
 
-    *field = qd_compose(QD_PERFORMATIVE_PROPERTIES, *field);
-    qd_compose_start_list(*field);
-    qd_compose_insert_null(*field);                                 // message-id
-    qd_compose_insert_null(*field);                                 // user-id
     qd_py_attr_to_composed(message, "address", *field); QD_ERROR_RET(); // to
     qd_compose_insert_null(*field);                                 // subject
     qd_compose_insert_null(*field);                                 // reply-to
@@ -644,6 +761,18 @@ static PyObject *qd_python_send(PyObject *self, PyObject *args)
         return 0;
 
     if (compose_python_message(&field, message, ioa->qd) == QD_ERROR_NONE) {
+        char     *a_str   = 0;
+        PyObject *address = PyObject_GetAttrString(message, "address");
+        if (address) {
+            a_str = py_obj_2_c_string(address);
+            Py_DECREF(address);
+        }
+
+        // Nothing below uses python, so the worker lets other threads run it meanwhile
+        bool release = thread_state != 0;
+        if (release)
+            qd_python_unlock(0);
+
         qd_message_t *msg = qd_message();
         qd_message_compose_2(msg, field);
 
@@ -658,20 +787,18 @@ static PyObject *qd_python_send(PyObject *self, PyObject *args)
         qd_message_set_ingress_annotation(msg, ingress);
         qd_message_set_trace_annotation(msg, trace);
 
-        PyObject *address = PyObject_GetAttrString(message, "address");
-        if (address) {
-            char *a_str = py_obj_2_c_string(address);
-            if (a_str) {
-                qdr_send_to2(ioa->core, msg, a_str, (bool) no_echo, (bool) control);
-                free(a_str);
-            } else {
-                qd_log(log_source, QD_LOG_ERROR,
-                       "Unable to convert message address to C string");
-            }
-            Py_DECREF(address);
+        if (a_str) {
+            qdr_send_to2(ioa->core, msg, a_str, (bool) no_echo, (bool) control);
+            free(a_str);
+        } else if (address) {
+            qd_log(log_source, QD_LOG_ERROR,
+                   "Unable to convert message address to C string");
         }
         qd_compose_free(field);
         qd_message_free(msg);
+
+        if (release)
+            qd_python_lock(QD_PYTHON_CALLER_AGENT);
         Py_RETURN_NONE;
     }
     if (!PyErr_Occurred())
@@ -776,15 +903,142 @@ static void qd_python_setup(void)
     }
 }
 
-qd_python_lock_state_t qd_python_lock(void)
+qd_python_lock_state_t qd_python_lock(qd_python_caller_t caller)
 {
     sys_mutex_lock(ilock);
-    lock_held = true;
+    lock_held  = true;
+    holder     = caller;
+    hold_start = qd_timer_now_usec();
+    if (thread_state)
+        saved_state = PyThreadState_Swap(thread_state);
     return 0;
 }
 
 void qd_python_unlock(qd_python_lock_state_t lock_state)
 {
+    if (thread_state)
+        PyThreadState_Swap(saved_state);
+
+    int64_t                 now       = qd_timer_now_usec();
+    uint64_t                held      = now - hold_start;
+    qd_python_caller_t      caller    = holder;
+    qd_python_hold_stats_t *stats     = &hold_stats[caller];
+    bool                    report    = false;
+    qd_python_hold_stats_t  snapshot[QD_PYTHON_CALLER_COUNT];
+
+    stats->count++;
+    stats->total_usec += held;
+    if (held > stats->max_usec)
+        stats->max_usec = held;
+    if (now - report_start >= QD_PYTHON_HOLD_REPORT_USEC) {
+        report_start = now;
+        report       = true;
+        memcpy(snapshot, hold_stats, sizeof(snapshot));
+    }
+
     lock_held = false;
     sys_mutex_unlock(ilock);
+
+    if (held >= QD_PYTHON_HOLD_WARN_USEC)
+        qd_log(log_source, QD_LOG_WARNING, "The %s held the python lock for %"PRIu64" ms",
+               caller_names[caller], held / 1000);
+
+    if (report && qd_log_enabled(log_source, QD_LOG_DEBUG)) {
+        for (int i = 0; i < QD_PYTHON_CALLER_COUNT; i++) {
+            if (snapshot[i].count)
+                qd_log(log_source, QD_LOG_DEBUG,
+                       "Python lock held by the %s: %"PRIu64" times, %"PRIu64" us mean, %"PRIu64" us max",
+                       caller_names[i], snapshot[i].count, snapshot[i].total_usec / snapshot[i].count,
+                       snapshot[i].max_usec);
+        }
+    }
+}
+
+
+//===============================================================================
+// Python Worker Thread
+//===============================================================================
+
+static void *qd_python_worker_run(void *unused)
+{
+    qd_python_lock(QD_PYTHON_CALLER_AGENT);
+    PyThreadState *state = PyThreadState_New(PyThreadState_Get()->interp);
+    qd_python_unlock(0);
+    thread_state = state;
+
+    while (true) {
+        sys_mutex_lock(work_lock);
+        while (!work_stopping && DEQ_IS_EMPTY(work_queue))
+            sys_cond_wait(work_cond, work_lock);
+        bool stop = work_stopping;
+        sys_mutex_unlock(work_lock);
+        if (stop)
+            break;
+
+        // Taken before the work is dequeued so that its adapter cannot be freed in between
+        qd_python_lock(QD_PYTHON_CALLER_AGENT);
+        sys_mutex_lock(work_lock);
+        qd_python_work_t *work = DEQ_HEAD(work_queue);
+        if (work)
+            DEQ_REMOVE_HEAD(work_queue);
+        sys_mutex_unlock(work_lock);
+        if (work)
+            qd_io_deliver(work->adapter, work->msg, work->link_id, work->inter_router_cost);
+        qd_python_unlock(0);
+
+        if (work)
+            qd_python_work_free(work);
+    }
+
+    thread_state = 0;
+    qd_python_lock(QD_PYTHON_CALLER_AGENT);
+    PyThreadState_Clear(state);
+    PyThreadState_Delete(state);
+    qd_python_unlock(0);
+    return 0;
+}
+
+
+static void qd_python_worker_initialize(void)
+{
+    DEQ_INIT(work_queue);
+    work_stopping = false;
+    work_lock     = sys_mutex();
+    work_cond     = sys_cond();
+}
+
+
+void qd_python_worker_stop(void)
+{
+    if (!work_lock)
+        return;
+
+    sys_mutex_lock(work_lock);
+    work_stopping = true;
+    sys_cond_signal(work_cond);
+    sys_mutex_unlock(work_lock);
+
+    if (work_thread) {
+        sys_thread_join(work_thread);
+        sys_thread_free(work_thread);
+        work_thread = 0;
+    }
+
+    sys_mutex_lock(work_lock);
+    qd_python_work_t *work;
+    while ((work = DEQ_HEAD(work_queue))) {
+        DEQ_REMOVE_HEAD(work_queue);
+        qd_python_work_free(work);
+    }
+    sys_mutex_unlock(work_lock);
+}
+
+
+static void qd_python_worker_finalize(void)
+{
+    // Freed after the interpreter, whose IoAdapters use the lock as they go
+    sys_cond_free(work_cond);
+    sys_mutex_free(work_lock);
+    work_cond = 0;
+    work_lock = 0;
 }
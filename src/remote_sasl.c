@@ -20,6 +20,7 @@
  */
 
 #include "remote_sasl.h"
+#include "digest.h"
 #include "server_private.h"
 
 #include <stdio.h>
@@ -31,6 +32,11 @@
 #include <proton/sasl-plugin.h>
 #include <qpid/dispatch/log.h>
 #include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/hash.h>
+#include <qpid/dispatch/iterator.h>
+#include <qpid/dispatch/threading.h>
+#include <qpid/dispatch/timer.h>
+#include <time.h>
 
 static qd_log_source_t* auth_service_log;
 
@@ -110,8 +116,38 @@ typedef struct
     char* username;
     permissions_t permissions;
     pn_sasl_outcome_t outcome;
+
+    int cache_seconds;
+    bool connect_deferred;  // mechanisms came from the cache; not yet connected downstream
+    bool init_pending;      // the upstream init is to be sent once downstream offers mechanisms
+    bool multi_step;        // the exchange went beyond sasl-init, so its outcome is not cached
 } qdr_sasl_relay_t;
 
+//
+// Results of the authentication service, shared by all relays.  Entries are either
+// the mechanisms offered at an address, keyed by "M\0<address>", or the identity
+// and permissions granted for a single-step exchange, keyed by
+// "R\0<address>\0<hostname>\0<mechanism>\0<response>".  Keys compare in full, so a
+// hit requires the exact credentials seen before.  Entries live for the
+// cache_seconds of the relay that stored them.
+//
+#define QDR_SASL_CACHE_MAX 1024
+
+typedef struct qdr_sasl_cache_entry_t qdr_sasl_cache_entry_t;
+struct qdr_sasl_cache_entry_t {
+    DEQ_LINKS(qdr_sasl_cache_entry_t);
+    qd_hash_handle_t *hash_handle;
+    time_t            expires;
+    char             *value;      // mechanisms or authenticated identity
+    char             *sources;    // permissions, raw comma separated lists
+    char             *targets;
+};
+DEQ_DECLARE(qdr_sasl_cache_entry_t, qdr_sasl_cache_entry_list_t);
+
+static sys_mutex_t                 *cache_lock;
+static qd_hash_t                   *cache_hash;
+static qdr_sasl_cache_entry_list_t  cache_entries;
+
 static void copy_bytes(const pn_bytes_t* from, qdr_owned_bytes_t* to)
 {
     if (to->start) {
@@ -150,6 +186,203 @@ static void delete_qdr_sasl_relay_t(qdr_sasl_relay_t* instance)
     free(instance);
 }
 
+static void cache_entry_free(qdr_sasl_cache_entry_t* entry)
+{
+    free(entry->value);
+    free(entry->sources);
+    free(entry->targets);
+    free(entry);
+}
+
+// cache_lock must be held
+static void cache_remove_LH(qdr_sasl_cache_entry_t* entry)
+{
+    DEQ_REMOVE(cache_entries, entry);
+    qd_hash_remove_by_handle(cache_hash, entry->hash_handle);
+    qd_hash_handle_free(entry->hash_handle);
+    cache_entry_free(entry);
+}
+
+void qdr_remote_sasl_initialize(void)
+{
+    cache_lock = sys_mutex();
+    cache_hash = qd_hash(8, 16, 0);
+    DEQ_INIT(cache_entries);
+}
+
+void qdr_remote_sasl_finalize(void)
+{
+    if (!cache_lock) return;
+    while (DEQ_HEAD(cache_entries)) {
+        cache_remove_LH(DEQ_HEAD(cache_entries));
+    }
+    qd_hash_free(cache_hash);
+    sys_mutex_free(cache_lock);
+    cache_hash = 0;
+    cache_lock = 0;
+}
+
+/**
+ * Build a cache key from a kind and a number of fields separated by nulls.  A
+ * response, which may hold a password, is keyed by its SHA-256 digest so that
+ * the cache never keeps the credentials themselves.  The returned key is freed
+ * by the caller; it is null if the response cannot be digested.
+ */
+static char* cache_key(size_t* length, char kind, const char* address, const char* hostname,
+                       const char* mechanism, const qdr_owned_bytes_t* response)
+{
+    unsigned char digest[QD_SHA256_LENGTH];
+    if (response && !qd_sha256(response->start, response->size, digest))
+        return 0;
+
+    size_t alen = strlen(address);
+    size_t hlen = hostname ? strlen(hostname) : 0;
+    size_t mlen = mechanism ? strlen(mechanism) : 0;
+    size_t rlen = response ? QD_SHA256_LENGTH : 0;
+    size_t size = 2 + alen + (response ? 1 + hlen + 1 + mlen + 1 + rlen : 0);
+    char* key = (char*) malloc(size);
+    char* cursor = key;
+    *cursor++ = kind;
+    *cursor++ = '\0';
+    memcpy(cursor, address, alen);
+    cursor += alen;
+    if (response) {
+        *cursor++ = '\0';
+        if (hlen) memcpy(cursor, hostname, hlen);
+        cursor += hlen;
+        *cursor++ = '\0';
+        if (mlen) memcpy(cursor, mechanism, mlen);
+        cursor += mlen;
+        *cursor++ = '\0';
+        memcpy(cursor, digest, rlen);
+    }
+    *length = size;
+    return key;
+}
+
+// cache_lock must be held
+static qdr_sasl_cache_entry_t* cache_find_LH(const char* key, size_t length)
+{
+    qdr_sasl_cache_entry_t* entry = 0;
+    qd_iterator_t* iter = qd_iterator_binary(key, (int) length, ITER_VIEW_ALL);
+    qd_hash_retrieve(cache_hash, iter, (void**) &entry);
+    qd_iterator_free(iter);
+    if (entry && entry->expires <= qd_timer_now_usec() / 1000000) {
+        cache_remove_LH(entry);
+        entry = 0;
+    }
+    return entry;
+}
+
+/**
+ * Store an entry, taking ownership of the strings.
+ */
+static void cache_insert(const char* key, size_t length, int seconds, char* value, char* sources, char* targets)
+{
+    qdr_sasl_cache_entry_t* entry = NEW(qdr_sasl_cache_entry_t);
+    ZERO(entry);
+    DEQ_ITEM_INIT(entry);
+    entry->expires = qd_timer_now_usec() / 1000000 + seconds;
+    entry->value   = value;
+    entry->sources = sources;
+    entry->targets = targets;
+
+    sys_mutex_lock(cache_lock);
+    qdr_sasl_cache_entry_t* existing = cache_find_LH(key, length);
+    if (existing) {
+        cache_remove_LH(existing);
+    }
+    while (DEQ_HEAD(cache_entries) &&
+           (DEQ_SIZE(cache_entries) >= QDR_SASL_CACHE_MAX || DEQ_HEAD(cache_entries)->expires <= qd_timer_now_usec() / 1000000)) {
+        cache_remove_LH(DEQ_HEAD(cache_entries));
+    }
+    qd_iterator_t* iter = qd_iterator_binary(key, (int) length, ITER_VIEW_ALL);
+    if (qd_hash_insert(cache_hash, iter, entry, &entry->hash_handle) == QD_ERROR_NONE) {
+        DEQ_INSERT_TAIL(cache_entries, entry);
+        entry = 0;
+    }
+    qd_iterator_free(iter);
+    sys_mutex_unlock(cache_lock);
+
+    if (entry) {
+        cache_entry_free(entry);
+    }
+}
+
+static char* cache_strdup(const char* s)
+{
+    return s ? strdup(s) : 0;
+}
+
+static char* cache_lookup_mechanisms(const char* address)
+{
+    size_t length;
+    char* key = cache_key(&length, 'M', address, 0, 0, 0);
+    char* mechs = 0;
+    sys_mutex_lock(cache_lock);
+    qdr_sasl_cache_entry_t* entry = cache_find_LH(key, length);
+    if (entry) {
+        mechs = strdup(entry->value);
+    }
+    sys_mutex_unlock(cache_lock);
+    free(key);
+    return mechs;
+}
+
+static void cache_store_mechanisms(const char* address, const char* mechs, int seconds)
+{
+    size_t length;
+    char* key = cache_key(&length, 'M', address, 0, 0, 0);
+    cache_insert(key, length, seconds, strdup(mechs), 0, 0);
+    free(key);
+}
+
+static void set_permission_buffer(buffer_t* buffer, const char* list)
+{
+    if (list) {
+        buffer->start = strdup(list);
+        buffer->used = strlen(list);
+        buffer->capacity = buffer->used + 1;
+    }
+}
+
+/**
+ * Complete the relay from an earlier identical single-step exchange.
+ * @return true if the exchange was found
+ */
+static bool cache_lookup_result(qdr_sasl_relay_t* impl)
+{
+    size_t length;
+    char* key = cache_key(&length, 'R', impl->authentication_service_address, impl->sasl_init_hostname,
+                          impl->selected_mechanism, &impl->response);
+    bool found = false;
+    if (!key)
+        return false;
+    sys_mutex_lock(cache_lock);
+    qdr_sasl_cache_entry_t* entry = cache_find_LH(key, length);
+    if (entry) {
+        impl->username = strdup(entry->value);
+        set_permission_buffer(&impl->permissions.sources, entry->sources);
+        set_permission_buffer(&impl->permissions.targets, entry->targets);
+        found = true;
+    }
+    sys_mutex_unlock(cache_lock);
+    free(key);
+    return found;
+}
+
+static void cache_store_result(qdr_sasl_relay_t* impl)
+{
+    size_t length;
+    char* key = cache_key(&length, 'R', impl->authentication_service_address, impl->sasl_init_hostname,
+                          impl->selected_mechanism, &impl->response);
+    if (!key)
+        return;
+    cache_insert(key, length, impl->cache_seconds, strdup(impl->username),
+                 cache_strdup(impl->permissions.sources.start), cache_strdup(impl->permissions.targets.start));
+    free(key);
+}
+
 PN_HANDLE(REMOTE_SASL_CTXT)
 
 bool qdr_is_authentication_service_connection(pn_connection_t* conn)
@@ -183,6 +416,32 @@ static void set_sasl_relay_context(pn_connection_t* conn, qdr_sasl_relay_t* cont
     pn_record_set(r, REMOTE_SASL_CTXT, context);
 }
 
+static bool notify_upstream(qdr_sasl_relay_t* impl, uint8_t state);
+
+static void connect_downstream(qdr_sasl_relay_t* impl)
+{
+    impl->downstream = pn_connection();
+    pn_connection_set_hostname(impl->downstream, impl->authentication_service_address);
+    set_sasl_relay_context(impl->downstream, impl);
+    //request permissions in response if supported by peer:
+    pn_data_t* data = pn_connection_desired_capabilities(impl->downstream);
+    pn_data_put_array(data, false, PN_SYMBOL);
+    pn_data_enter(data);
+    pn_data_put_symbol(data, pn_bytes(13, "ADDRESS-AUTHZ"));
+    pn_data_exit(data);
+
+    data = pn_connection_properties(impl->downstream);
+    pn_data_put_map(data);
+    pn_data_enter(data);
+    pn_data_put_symbol(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_PRODUCT_KEY), QD_CONNECTION_PROPERTY_PRODUCT_KEY));
+    pn_data_put_string(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_PRODUCT_VALUE), QD_CONNECTION_PROPERTY_PRODUCT_VALUE));
+    pn_data_put_symbol(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_VERSION_KEY), QD_CONNECTION_PROPERTY_VERSION_KEY));
+    pn_data_put_string(data, pn_bytes(strlen(QPID_DISPATCH_VERSION), QPID_DISPATCH_VERSION));
+    pn_data_exit(data);
+
+    pn_proactor_connect(impl->proactor, impl->downstream, impl->authentication_service_address);
+}
+
 static bool remote_sasl_init_server(pn_transport_t* transport)
 {
     pn_connection_t* upstream = pn_transport_connection(transport);
@@ -192,26 +451,18 @@ static bool remote_sasl_init_server(pn_transport_t* transport)
         impl->upstream = upstream;
         pn_proactor_t* proactor = impl->proactor;
         if (!proactor) return false;
-        impl->downstream = pn_connection();
-        pn_connection_set_hostname(impl->downstream, impl->authentication_service_address);
-        set_sasl_relay_context(impl->downstream, impl);
-        //request permissions in response if supported by peer:
-        pn_data_t* data = pn_connection_desired_capabilities(impl->downstream);
-        pn_data_put_array(data, false, PN_SYMBOL);
-        pn_data_enter(data);
-        pn_data_put_symbol(data, pn_bytes(13, "ADDRESS-AUTHZ"));
-        pn_data_exit(data);
-
-        data = pn_connection_properties(impl->downstream);
-        pn_data_put_map(data);
-        pn_data_enter(data);
-        pn_data_put_symbol(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_PRODUCT_KEY), QD_CONNECTION_PROPERTY_PRODUCT_KEY));
-        pn_data_put_string(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_PRODUCT_VALUE), QD_CONNECTION_PROPERTY_PRODUCT_VALUE));
-        pn_data_put_symbol(data, pn_bytes(strlen(QD_CONNECTION_PROPERTY_VERSION_KEY), QD_CONNECTION_PROPERTY_VERSION_KEY));
-        pn_data_put_string(data, pn_bytes(strlen(QPID_DISPATCH_VERSION), QPID_DISPATCH_VERSION));
-        pn_data_exit(data);
-
-        pn_proactor_connect(proactor, impl->downstream, impl->authentication_service_address);
+        if (impl->cache_seconds > 0) {
+            //offer the mechanisms seen recently; the service is only
+            //contacted if the client's credentials are not cached
+            char* mechs = cache_lookup_mechanisms(impl->authentication_service_address);
+            if (mechs) {
+                impl->mechlist = mechs;
+                impl->connect_deferred = true;
+                notify_upstream(impl, DOWNSTREAM_MECHANISMS_RECEIVED);
+                return true;
+            }
+        }
+        connect_downstream(impl);
         return true;
     } else {
         return false;
@@ -352,7 +603,17 @@ static bool remote_sasl_process_mechanisms(pn_transport_t *transport, const char
 {
     qdr_sasl_relay_t* impl = (qdr_sasl_relay_t*) pnx_sasl_get_context(transport);
     if (impl) {
+        if (impl->mechlist) free(impl->mechlist);
         impl->mechlist = strdup(mechs);
+        if (impl->cache_seconds > 0) {
+            cache_store_mechanisms(impl->authentication_service_address, mechs, impl->cache_seconds);
+        }
+        if (impl->init_pending) {
+            //upstream already chose from the cached mechanisms
+            impl->init_pending = false;
+            notify_downstream(impl, UPSTREAM_INIT_RECEIVED);
+            return true;
+        }
         if (notify_upstream(impl, DOWNSTREAM_MECHANISMS_RECEIVED)) {
             return true;
         } else {
@@ -369,6 +630,7 @@ static void remote_sasl_process_challenge(pn_transport_t *transport, const pn_by
 {
     qdr_sasl_relay_t* impl = (qdr_sasl_relay_t*) pnx_sasl_get_context(transport);
     if (impl) {
+        impl->multi_step = true;
         copy_bytes(recv, &(impl->challenge));
         if (!notify_upstream(impl, DOWNSTREAM_CHALLENGE_RECEIVED)) {
             pnx_sasl_set_desired_state(transport, SASL_ERROR);
@@ -413,6 +675,19 @@ static void remote_sasl_process_init(pn_transport_t *transport, const char *mech
     if (impl) {
         impl->selected_mechanism = strdup(mechanism);
         copy_bytes(recv, &(impl->response));
+        if (impl->connect_deferred) {
+            impl->connect_deferred = false;
+            if (cache_lookup_result(impl)) {
+                qd_log(auth_service_log, QD_LOG_DEBUG, "authentication of %s found in cache", impl->username);
+                impl->outcome = PN_SASL_OK;
+                impl->complete = true;
+                notify_upstream(impl, DOWNSTREAM_OUTCOME_RECEIVED);
+            } else {
+                impl->init_pending = true;
+                connect_downstream(impl);
+            }
+            return;
+        }
         if (!notify_downstream(impl, UPSTREAM_INIT_RECEIVED)) {
             pnx_sasl_set_desired_state(transport, SASL_ERROR);
         }
@@ -424,6 +699,7 @@ static void remote_sasl_process_response(pn_transport_t *transport, const pn_byt
 {
     qdr_sasl_relay_t* impl = (qdr_sasl_relay_t*) pnx_sasl_get_context(transport);
     if (impl) {
+        impl->multi_step = true;
         copy_bytes(recv, &(impl->response));
         if (!notify_downstream(impl, UPSTREAM_RESPONSE_RECEIVED)) {
             pnx_sasl_set_desired_state(transport, SASL_ERROR);
@@ -472,11 +748,12 @@ static void set_remote_impl(pn_transport_t *transport, qdr_sasl_relay_t* context
     pnx_sasl_set_implementation(transport, &remote_sasl_impl, context);
 }
 
-void qdr_use_remote_authentication_service(pn_transport_t *transport, const char* address, const char* sasl_init_hostname, pn_ssl_domain_t* ssl_domain, pn_proactor_t* proactor)
+void qdr_use_remote_authentication_service(pn_transport_t *transport, const char* address, const char* sasl_init_hostname, pn_ssl_domain_t* ssl_domain, pn_proactor_t* proactor, int cache_seconds)
 {
     auth_service_log = qd_log_source("AUTHSERVICE");
     qdr_sasl_relay_t* context = new_qdr_sasl_relay_t(address, sasl_init_hostname, proactor);
     context->ssl_domain = ssl_domain;
+    context->cache_seconds = cache_lock ? cache_seconds : 0;
     set_remote_impl(transport, context);
 }
 
@@ -664,6 +941,9 @@ void qdr_handle_authentication_service_connection_event(pn_event_t *e)
         } else {
             context->username = strdup("");
         }
+        if (context->cache_seconds > 0 && !context->multi_step && context->selected_mechanism) {
+            cache_store_result(context);
+        }
         //notify upstream connection of successful authentication
         notify_upstream(context, DOWNSTREAM_OUTCOME_RECEIVED);
 
@@ -24,8 +24,15 @@
 #include <proton/ssl.h>
 #include <proton/types.h>
 
-void qdr_use_remote_authentication_service(pn_transport_t* transport, const char* address, const char* sasl_init_hostname, pn_ssl_domain_t* ssl_domain, pn_proactor_t* proactor);
+void qdr_use_remote_authentication_service(pn_transport_t* transport, const char* address, const char* sasl_init_hostname, pn_ssl_domain_t* ssl_domain, pn_proactor_t* proactor, int cache_seconds);
 bool qdr_is_authentication_service_connection(pn_connection_t* conn);
 void qdr_handle_authentication_service_connection_event(pn_event_t *e);
 
+/**
+ * Set up and tear down the cache of authentication service results shared by
+ * all listeners.
+ */
+void qdr_remote_sasl_initialize(void);
+void qdr_remote_sasl_finalize(void);
+
 #endif /* remote_sasl.h */
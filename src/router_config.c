@@ -54,6 +54,8 @@ qd_error_t qd_router_configure_address(qd_router_t *router, qd_entity_t *entity)
     char *pattern = 0;
     char *distrib = 0;
     char *prefix  = 0;
+    char *drop_policy = 0;
+    char *mcast_settle = 0;
 
     do {
         name = qd_entity_opt_string(entity, "name", 0);             QD_ERROR_BREAK();
@@ -76,9 +78,16 @@ qd_error_t qd_router_configure_address(qd_router_t *router, qd_entity_t *entity)
         }
 
         bool  waypoint  = qd_entity_opt_bool(entity, "waypoint", false);
+        bool  ordered   = qd_entity_opt_bool(entity, "priorityOrdered", false);
+        bool  affinity  = qd_entity_opt_bool(entity, "groupAffinity", false);
         long  in_phase  = qd_entity_opt_long(entity, "ingressPhase", -1);
         long  out_phase = qd_entity_opt_long(entity, "egressPhase", -1);
         long  priority  = qd_entity_opt_long(entity, "priority",    -1);
+        long  sample    = qd_entity_opt_long(entity, "presettledSampleRate", 10);
+        long  q_depth   = qd_entity_opt_long(entity, "queueMaxDepth", 0);
+        long  q_bytes   = qd_entity_opt_long(entity, "queueMaxBytes", 0);
+        drop_policy     = qd_entity_opt_string(entity, "presettledDropPolicy", 0);  QD_ERROR_BREAK();
+        mcast_settle    = qd_entity_opt_string(entity, "multicastSettlement", 0);   QD_ERROR_BREAK();
 
         //
         // Formulate this configuration create it through the core management API.
@@ -109,9 +118,33 @@ qd_error_t qd_router_configure_address(qd_router_t *router, qd_entity_t *entity)
         qd_compose_insert_string(body, "waypoint");
         qd_compose_insert_bool(body, waypoint);
 
+        qd_compose_insert_string(body, "priorityOrdered");
+        qd_compose_insert_bool(body, ordered);
+
+        qd_compose_insert_string(body, "groupAffinity");
+        qd_compose_insert_bool(body, affinity);
+
         qd_compose_insert_string(body, "priority");
         qd_compose_insert_long(body, priority);
 
+        if (drop_policy) {
+            qd_compose_insert_string(body, "presettledDropPolicy");
+            qd_compose_insert_string(body, drop_policy);
+        }
+
+        if (mcast_settle) {
+            qd_compose_insert_string(body, "multicastSettlement");
+            qd_compose_insert_string(body, mcast_settle);
+        }
+
+        qd_compose_insert_string(body, "presettledSampleRate");
+        qd_compose_insert_long(body, sample);
+
+        qd_compose_insert_string(body, "queueMaxDepth");
+        qd_compose_insert_long(body, q_depth);
+
+        qd_compose_insert_string(body, "queueMaxBytes");
+        qd_compose_insert_long(body, q_bytes);
 
         if (in_phase >= 0) {
             qd_compose_insert_string(body, "ingressPhase");
@@ -133,6 +166,8 @@ qd_error_t qd_router_configure_address(qd_router_t *router, qd_entity_t *entity)
     free(prefix);
     free(distrib);
     free(pattern);
+    free(drop_policy);
+    free(mcast_settle);
 
     return qd_error_code();
 }
@@ -0,0 +1,298 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "action_trace.h"
+#include "router_core_private.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_STRINGS_MAX 1024
+
+struct qdr_action_trace_t {
+    qdr_core_t *core;
+    FILE       *file;
+    char       *path;
+    int64_t     start_usec;
+    uint64_t    records;
+    bool        failed;
+};
+
+//
+// The actions recorded with their arguments, by label.  Labels are unique per handler.
+//
+static const struct {
+    const char              *label;
+    qdr_action_trace_type_t  type;
+} traced_actions[] = {
+    {"link_deliver",       QDR_TRACE_LINK_DELIVER},
+    {"update_delivery",    QDR_TRACE_UPDATE_DELIVERY},
+    {"update_deliveries",  QDR_TRACE_UPDATE_DELIVERY},
+    {"link_flow",          QDR_TRACE_LINK_FLOW},
+    {"deliver_continue",   QDR_TRACE_DELIVER_CONTINUE},
+    {"link_first_attach",  QDR_TRACE_LINK_FIRST_ATTACH},
+    {"link_second_attach", QDR_TRACE_LINK_SECOND_ATTACH},
+    {"link_detach",        QDR_TRACE_LINK_DETACH},
+    {"connection_opened",  QDR_TRACE_CONNECTION_OPENED},
+    {"connection_closed",  QDR_TRACE_CONNECTION_CLOSED},
+};
+
+
+typedef struct {
+    qdr_action_trace_record_t record;
+    char                      strings[TRACE_STRINGS_MAX];
+} trace_entry_t;
+
+
+static void trace_string(trace_entry_t *entry, const char *value)
+{
+    size_t used = entry->record.string_length;
+    size_t len  = value ? strlen(value) : 0;
+    if (used + len + 1 > TRACE_STRINGS_MAX)
+        len = used < TRACE_STRINGS_MAX ? TRACE_STRINGS_MAX - used - 1 : 0;
+    if (used >= TRACE_STRINGS_MAX)
+        return;
+    if (len)
+        memcpy(entry->strings + used, value, len);
+    entry->strings[used + len] = '\0';
+    entry->record.string_length = used + len + 1;
+}
+
+
+static void trace_iterator(trace_entry_t *entry, qd_iterator_t *iter)
+{
+    char buffer[TRACE_STRINGS_MAX / 2];
+    buffer[0] = '\0';
+    if (iter) {
+        qd_iterator_strncpy(iter, buffer, sizeof(buffer));
+        qd_iterator_reset(iter);
+    }
+    trace_string(entry, buffer);
+}
+
+
+static void trace_field(trace_entry_t *entry, qdr_field_t *field)
+{
+    trace_iterator(entry, field ? field->iterator : 0);
+}
+
+
+static void trace_terminus(trace_entry_t *entry, qdr_terminus_t *terminus)
+{
+    trace_iterator(entry, terminus ? qdr_terminus_get_address(terminus) : 0);
+}
+
+
+static void trace_write(qdr_action_trace_t *trace, trace_entry_t *entry)
+{
+    if (trace->failed)
+        return;
+
+    entry->record.usec = qd_timer_now_usec() - trace->start_usec;
+    if (fwrite(&entry->record, sizeof(entry->record), 1, trace->file) != 1 ||
+        (entry->record.string_length &&
+         fwrite(entry->strings, entry->record.string_length, 1, trace->file) != 1)) {
+        qd_log(trace->core->log, QD_LOG_ERROR, "Core action trace %s stopped, write failed: %s",
+               trace->path, strerror(errno));
+        trace->failed = true;
+        return;
+    }
+    trace->records++;
+}
+
+
+static void trace_entry_init(trace_entry_t *entry, qdr_action_trace_type_t type)
+{
+    memset(&entry->record, 0, sizeof(entry->record));
+    entry->record.type = (uint8_t) type;
+}
+
+
+static void trace_update(qdr_action_trace_t *trace, qdr_delivery_t *dlv, uint64_t disposition, bool settled)
+{
+    trace_entry_t entry;
+    trace_entry_init(&entry, QDR_TRACE_UPDATE_DELIVERY);
+    entry.record.object = (uintptr_t) dlv;
+    entry.record.peer   = (uintptr_t) dlv->link;
+    entry.record.value  = disposition;
+    entry.record.flags  = settled ? QDR_TRACE_FLAG_SETTLED : 0;
+    trace_write(trace, &entry);
+}
+
+
+qdr_action_trace_t *qdr_action_trace(qdr_core_t *core, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        qd_log(core->log, QD_LOG_ERROR, "Unable to create core action trace %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    qdr_action_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, QDR_ACTION_TRACE_MAGIC, sizeof(header.magic));
+    header.version     = QDR_ACTION_TRACE_VERSION;
+    header.record_size = sizeof(qdr_action_trace_record_t);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        qd_log(core->log, QD_LOG_ERROR, "Unable to write core action trace %s: %s", path, strerror(errno));
+        fclose(file);
+        return 0;
+    }
+
+    qdr_action_trace_t *trace = NEW(qdr_action_trace_t);
+    ZERO(trace);
+    trace->core       = core;
+    trace->file       = file;
+    trace->path       = strdup(path);
+    trace->start_usec = qd_timer_now_usec();
+    qd_log(core->log, QD_LOG_INFO, "Recording core actions to %s", path);
+    return trace;
+}
+
+
+void qdr_action_trace_CT(qdr_action_trace_t *trace, qdr_action_t *action)
+{
+    if (!action->label)
+        return;
+
+    qdr_action_trace_type_t type = QDR_TRACE_OTHER;
+    for (int i = 0; i < sizeof(traced_actions) / sizeof(traced_actions[0]); i++) {
+        if (strcmp(action->label, traced_actions[i].label) == 0) {
+            type = traced_actions[i].type;
+            break;
+        }
+    }
+
+    trace_entry_t entry;
+    trace_entry_init(&entry, type);
+
+    switch (type) {
+    case QDR_TRACE_CONNECTION_OPENED: {
+        qdr_connection_t *conn = action->args.connection.conn;
+        entry.record.object = (uintptr_t) conn;
+        entry.record.arg    = conn->role;
+        entry.record.peer   = conn->inter_router_cost;
+        entry.record.value  = conn->link_capacity;
+        entry.record.flags  = conn->incoming ? QDR_TRACE_FLAG_INCOMING : 0;
+        trace_field(&entry, action->args.connection.connection_label);
+        trace_field(&entry, action->args.connection.container_id);
+        if (conn->tenant_space) {
+            // The tenant space is the vhost followed by a '/'
+            char vhost[TRACE_STRINGS_MAX / 2];
+            snprintf(vhost, sizeof(vhost), "%.*s", conn->tenant_space_len - 1, conn->tenant_space);
+            trace_string(&entry, vhost);
+        } else
+            trace_string(&entry, "");
+        break;
+    }
+
+    case QDR_TRACE_CONNECTION_CLOSED:
+        entry.record.object = (uintptr_t) action->args.connection.conn;
+        break;
+
+    case QDR_TRACE_LINK_FIRST_ATTACH: {
+        qdr_link_t     *link  = action->args.connection.link;
+        qdr_terminus_t *local = action->args.connection.dir == QD_OUTGOING
+            ? action->args.connection.source : action->args.connection.target;
+        entry.record.object = (uintptr_t) link;
+        entry.record.peer   = (uintptr_t) action->args.connection.conn;
+        entry.record.arg    = action->args.connection.dir;
+        entry.record.flags  = local && qdr_terminus_is_dynamic(local) ? QDR_TRACE_FLAG_DYNAMIC : 0;
+        trace_string(&entry, link->name);
+        trace_terminus(&entry, action->args.connection.source);
+        trace_terminus(&entry, action->args.connection.target);
+        break;
+    }
+
+    case QDR_TRACE_LINK_SECOND_ATTACH: {
+        qdr_link_t *link = action->args.connection.link;
+        entry.record.object = (uintptr_t) link;
+        entry.record.peer   = (uintptr_t) link->conn;
+        trace_terminus(&entry, action->args.connection.source);
+        trace_terminus(&entry, action->args.connection.target);
+        break;
+    }
+
+    case QDR_TRACE_LINK_DETACH:
+        entry.record.object = (uintptr_t) action->args.connection.link;
+        entry.record.peer   = (uintptr_t) action->args.connection.conn;
+        entry.record.arg    = action->args.connection.dt;
+        entry.record.flags  = action->args.connection.error ? QDR_TRACE_FLAG_ERROR : 0;
+        break;
+
+    case QDR_TRACE_LINK_FLOW:
+        entry.record.object = (uintptr_t) action->args.connection.link;
+        entry.record.arg    = action->args.connection.credit;
+        entry.record.flags  = action->args.connection.drain ? QDR_TRACE_FLAG_DRAIN : 0;
+        break;
+
+    case QDR_TRACE_LINK_DELIVER: {
+        qdr_delivery_t *dlv = action->args.connection.delivery;
+        entry.record.object = (uintptr_t) dlv;
+        entry.record.peer   = (uintptr_t) dlv->link;
+        entry.record.value  = qd_message_buffered_size(dlv->msg);
+        entry.record.flags  = (dlv->settled ? QDR_TRACE_FLAG_SETTLED : 0)
+            | (action->args.connection.more ? QDR_TRACE_FLAG_MORE : 0);
+        if (dlv->to_addr)
+            trace_iterator(&entry, dlv->to_addr);
+        break;
+    }
+
+    case QDR_TRACE_DELIVER_CONTINUE:
+        entry.record.object = (uintptr_t) action->args.connection.delivery;
+        entry.record.flags  = action->args.connection.more ? QDR_TRACE_FLAG_MORE : 0;
+        break;
+
+    case QDR_TRACE_UPDATE_DELIVERY:
+        if (strcmp(action->label, "update_deliveries") == 0) {
+            // One record per delivery of the vector
+            for (int r = 0; r < action->args.dispositions.range_count; r++) {
+                qdr_disposition_range_t *range = &action->args.dispositions.ranges[r];
+                for (int i = range->first; i < range->first + range->count; i++)
+                    trace_update(trace, action->args.dispositions.deliveries[i], range->disposition, range->settled);
+            }
+            return;
+        }
+        trace_update(trace, action->args.delivery.delivery, action->args.delivery.disposition,
+                     action->args.delivery.settled);
+        return;
+
+    default:
+        trace_string(&entry, action->label);
+        break;
+    }
+
+    trace_write(trace, &entry);
+}
+
+
+void qdr_action_trace_free(qdr_action_trace_t *trace)
+{
+    if (!trace)
+        return;
+
+    if (fclose(trace->file) != 0 && !trace->failed)
+        qd_log(trace->core->log, QD_LOG_ERROR, "Unable to complete core action trace %s: %s",
+               trace->path, strerror(errno));
+    else
+        qd_log(trace->core->log, QD_LOG_INFO, "Recorded %"PRIu64" core actions to %s", trace->records, trace->path);
+    free(trace->path);
+    free(trace);
+}
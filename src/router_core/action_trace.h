@@ -0,0 +1,97 @@
+#ifndef qd_router_core_action_trace
+#define qd_router_core_action_trace 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/router_core.h>
+#include <stdint.h>
+
+//
+// A binary trace of the actions run by the core thread, written when the router's
+// coreActionTrace attribute is set and read by tests/benchmarks/core_replay.
+//
+// The file is a qdr_action_trace_header_t followed by records in the order the core
+// ran the actions.  Each record is a qdr_action_trace_record_t followed by
+// string_length bytes of NUL-terminated strings.  Connections, links and deliveries
+// are identified by their addresses in the recording router; an identifier may be
+// reused once its object is gone.  Integers are in the recording host's byte order.
+//
+// The data-plane actions from the I/O threads are recorded with their arguments.
+// Every other action is recorded only by its label.
+//
+#define QDR_ACTION_TRACE_MAGIC   "QDRTRACE"
+#define QDR_ACTION_TRACE_VERSION 1
+
+typedef enum {
+    QDR_TRACE_OTHER = 0,          ///< strings: label
+    QDR_TRACE_CONNECTION_OPENED,  ///< object: conn, arg: role, peer: cost, value: link capacity  strings: label, container, vhost
+    QDR_TRACE_CONNECTION_CLOSED,  ///< object: conn
+    QDR_TRACE_LINK_FIRST_ATTACH,  ///< object: link, peer: conn, arg: direction  strings: name, source, target
+    QDR_TRACE_LINK_SECOND_ATTACH, ///< object: link, peer: conn  strings: source, target
+    QDR_TRACE_LINK_DETACH,        ///< object: link, peer: conn, arg: detach type
+    QDR_TRACE_LINK_FLOW,          ///< object: link, arg: credit
+    QDR_TRACE_LINK_DELIVER,       ///< object: delivery, peer: link, value: buffered octets  strings: address, if any
+    QDR_TRACE_DELIVER_CONTINUE,   ///< object: delivery
+    QDR_TRACE_UPDATE_DELIVERY,    ///< object: delivery, peer: link, value: disposition
+    QDR_TRACE_RECORD_TYPES
+} qdr_action_trace_type_t;
+
+#define QDR_TRACE_FLAG_INCOMING  0x01  ///< Connection opened by the peer
+#define QDR_TRACE_FLAG_SETTLED   0x02  ///< Delivery or update is settled
+#define QDR_TRACE_FLAG_DRAIN     0x04  ///< Flow in drain mode
+#define QDR_TRACE_FLAG_MORE      0x08  ///< More of the message is still to arrive
+#define QDR_TRACE_FLAG_DYNAMIC   0x10  ///< The peer's terminus is dynamic
+#define QDR_TRACE_FLAG_ERROR     0x20  ///< Detach carries an error
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;  ///< sizeof(qdr_action_trace_record_t) of the writer
+} qdr_action_trace_header_t;
+
+typedef struct {
+    uint8_t  type;           ///< qdr_action_trace_type_t
+    uint8_t  flags;
+    uint16_t string_length;
+    int32_t  arg;
+    uint64_t usec;           ///< Since the trace was opened
+    uint64_t object;
+    uint64_t peer;
+    uint64_t value;
+} qdr_action_trace_record_t;
+
+typedef struct qdr_action_trace_t qdr_action_trace_t;
+struct qdr_action_t;
+
+/**
+ * Create the trace file.  Returns 0 and logs the error if it cannot be created.
+ */
+qdr_action_trace_t *qdr_action_trace(qdr_core_t *core, const char *path);
+
+/**
+ * Record an action the core thread is about to run.
+ */
+void qdr_action_trace_CT(qdr_action_trace_t *trace, struct qdr_action_t *action);
+
+/**
+ * Flush and close the trace file.
+ */
+void qdr_action_trace_free(qdr_action_trace_t *trace);
+
+#endif
@@ -27,6 +27,8 @@
 #include "router_core_private.h"
 #include "exchange_bindings.h"
 #include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
 #include "agent_router.h"
 #include "agent_conn_link_route.h"
 
@@ -35,6 +37,10 @@ static void qdr_manage_read_CT(qdr_core_t *core, qdr_action_t *action, bool disc
 static void qdr_manage_create_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_manage_delete_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_manage_update_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_manage_bulk_create_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_manage_bulk_delete_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_agent_bulk_result_CT(qdr_query_t *query);
+static void qdr_manage_summary_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 
 ALLOC_DECLARE(qdr_query_t);
 ALLOC_DEFINE(qdr_query_t);
@@ -69,6 +75,11 @@ static void qdr_agent_response_handler(void *context)
 
 void qdr_agent_enqueue_response_CT(qdr_core_t *core, qdr_query_t *query)
 {
+    if (query->bulk) {
+        qdr_agent_bulk_result_CT(query);
+        return;
+    }
+
     sys_mutex_lock(core->query_lock);
     DEQ_INSERT_TAIL(core->outgoing_query_list, query);
     bool notify = DEQ_SIZE(core->outgoing_query_list) == 1;
@@ -117,6 +128,7 @@ void qdr_manage_create(qdr_core_t              *core,
                        uint64_t                 in_conn_id)
 {
     qdr_action_t *action = qdr_action(qdr_manage_create_CT, "manage_create");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
 
     // Create a query object here
     action->args.agent.query        = qdr_query(core, context, type, out_body, in_conn_id);
@@ -136,6 +148,7 @@ void qdr_manage_delete(qdr_core_t *core,
                        uint64_t                 in_conn_id)
 {
     qdr_action_t *action = qdr_action(qdr_manage_delete_CT, "manage_delete");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
 
     // Create a query object here
     action->args.agent.query = qdr_query(core, context, type, 0, in_conn_id);
@@ -146,6 +159,64 @@ void qdr_manage_delete(qdr_core_t *core,
 }
 
 
+static void qdr_manage_bulk(qdr_core_t              *core,
+                            qdr_action_handler_t     action_handler,
+                            const char              *label,
+                            void                    *context,
+                            qd_router_entity_type_t  type,
+                            qd_parsed_field_t       *in_body,
+                            qd_composed_field_t     *out_body,
+                            uint64_t                 in_conn_id)
+{
+    qdr_action_t *action = qdr_action(action_handler, label);
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
+
+    action->args.agent.query   = qdr_query(core, context, type, out_body, in_conn_id);
+    action->args.agent.in_body = in_body;
+
+    qdr_action_enqueue(core, action);
+}
+
+
+void qdr_manage_bulk_create(qdr_core_t              *core,
+                            void                    *context,
+                            qd_router_entity_type_t  type,
+                            qd_parsed_field_t       *in_body,
+                            qd_composed_field_t     *out_body,
+                            uint64_t                 in_conn_id)
+{
+    qdr_manage_bulk(core, qdr_manage_bulk_create_CT, "manage_bulk_create", context, type, in_body, out_body, in_conn_id);
+}
+
+
+void qdr_manage_bulk_delete(qdr_core_t              *core,
+                            void                    *context,
+                            qd_router_entity_type_t  type,
+                            qd_parsed_field_t       *in_body,
+                            qd_composed_field_t     *out_body,
+                            uint64_t                 in_conn_id)
+{
+    qdr_manage_bulk(core, qdr_manage_bulk_delete_CT, "manage_bulk_delete", context, type, in_body, out_body, in_conn_id);
+}
+
+
+void qdr_manage_summary(qdr_core_t              *core,
+                        void                    *context,
+                        qd_router_entity_type_t  type,
+                        bool                     edges,
+                        qd_composed_field_t     *out_body,
+                        uint64_t                 in_conn_id)
+{
+    qdr_action_t *action = qdr_action(qdr_manage_summary_CT, "manage_summary");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
+
+    action->args.agent.query  = qdr_query(core, context, type, out_body, in_conn_id);
+    action->args.agent.edges = edges;
+
+    qdr_action_enqueue(core, action);
+}
+
+
 void qdr_manage_read(qdr_core_t              *core,
                      void                    *context,
                      qd_router_entity_type_t  entity_type,
@@ -155,6 +226,7 @@ void qdr_manage_read(qdr_core_t              *core,
                      uint64_t                 in_conn_id)
 {
     qdr_action_t *action = qdr_action(qdr_manage_read_CT, "manage_read");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
 
     // Create a query object here
     action->args.agent.query = qdr_query(core, context, entity_type, body, in_conn_id);
@@ -175,6 +247,7 @@ void qdr_manage_update(qdr_core_t              *core,
                        uint64_t                 in_conn_id)
 {
     qdr_action_t *action = qdr_action(qdr_manage_update_CT, "manage_update");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
     action->args.agent.query = qdr_query(core, context, type, out_body, in_conn_id);
     action->args.agent.name = qdr_field_from_iter(name);
     action->args.agent.identity = qdr_field_from_iter(identity);
@@ -207,6 +280,7 @@ qdr_query_t *qdr_manage_query(qdr_core_t              *core,
     case QD_ROUTER_BINDING:           qdr_agent_set_columns(query, attribute_names, qdr_config_binding_columns, QDR_CONFIG_BINDING_COLUMN_COUNT); break;
     case QD_ROUTER_CONN_LINK_ROUTE:   qdr_agent_set_columns(query, attribute_names, qdr_conn_link_route_columns,
                                                             QDR_CONN_LINK_ROUTE_COLUMN_COUNT); break;
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_set_columns(query, attribute_names, qdr_core_action_columns, QDR_CORE_ACTION_COLUMN_COUNT); break;
     }
 
     return query;
@@ -227,12 +301,14 @@ void qdr_query_add_attribute_names(qdr_query_t *query)
     case QD_ROUTER_EXCHANGE:          qdr_agent_emit_columns(query, qdr_config_exchange_columns, QDR_CONFIG_EXCHANGE_COLUMN_COUNT); break;
     case QD_ROUTER_BINDING:           qdr_agent_emit_columns(query, qdr_config_binding_columns, QDR_CONFIG_BINDING_COLUMN_COUNT); break;
     case QD_ROUTER_CONN_LINK_ROUTE:   qdr_agent_emit_columns(query, qdr_conn_link_route_columns, QDR_CONN_LINK_ROUTE_COLUMN_COUNT); break;
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_emit_columns(query, qdr_core_action_columns, QDR_CORE_ACTION_COLUMN_COUNT); break;
     }
 }
 
 void qdr_query_get_first(qdr_query_t *query, int offset)
 {
     qdr_action_t *action = qdr_action(qdrh_query_get_first_CT, "query_get_first");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
     action->args.agent.query  = query;
     action->args.agent.offset = offset;
     qdr_action_enqueue(query->core, action);
@@ -242,6 +318,7 @@ void qdr_query_get_first(qdr_query_t *query, int offset)
 void qdr_query_get_next(qdr_query_t *query)
 {
     qdr_action_t *action = qdr_action(qdrh_query_get_next_CT, "query_get_next");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
     action->args.agent.query = query;
     qdr_action_enqueue(query->core, action);
 }
@@ -255,9 +332,88 @@ void qdr_query_free(qdr_query_t *query)
     if (query->next_key)
         qdr_field_free(query->next_key);
 
+    for (int i = 0; i < query->filter_count; i++)
+        free(query->filters[i].value);
+
     free_qdr_query_t(query);
 }
 
+
+/**
+ * The text form of a scalar value used to compare filters, or 0 if the value is
+ * not a string, number, boolean or null.  Free with free().
+ */
+static char *qdr_agent_field_text(qd_parsed_field_t *field)
+{
+    char text[32];
+
+    switch (qd_parse_tag(field)) {
+    case QD_AMQP_STR8_UTF8:
+    case QD_AMQP_STR32_UTF8:
+    case QD_AMQP_SYM8:
+    case QD_AMQP_SYM32:
+        return (char*) qd_iterator_copy(qd_parse_raw(field));
+
+    case QD_AMQP_UBYTE:
+    case QD_AMQP_USHORT:
+    case QD_AMQP_UINT:
+    case QD_AMQP_SMALLUINT:
+    case QD_AMQP_UINT0:
+    case QD_AMQP_ULONG:
+    case QD_AMQP_SMALLULONG:
+    case QD_AMQP_ULONG0:
+        snprintf(text, sizeof(text), "%"PRIu64, qd_parse_as_ulong(field));
+        break;
+
+    case QD_AMQP_BYTE:
+    case QD_AMQP_SHORT:
+    case QD_AMQP_INT:
+    case QD_AMQP_SMALLINT:
+    case QD_AMQP_LONG:
+    case QD_AMQP_SMALLLONG:
+        snprintf(text, sizeof(text), "%"PRId64, qd_parse_as_long(field));
+        break;
+
+    case QD_AMQP_BOOLEAN:
+    case QD_AMQP_TRUE:
+    case QD_AMQP_FALSE:
+        snprintf(text, sizeof(text), "%s", qd_parse_as_bool(field) ? "true" : "false");
+        break;
+
+    case QD_AMQP_NULL:
+        snprintf(text, sizeof(text), "null");
+        break;
+
+    default:
+        return 0;
+    }
+
+    return strdup(text);
+}
+
+
+static void qdr_agent_add_filters(qdr_query_t *query, qd_parsed_field_t *filter, const char *qdr_columns[])
+{
+    uint32_t count = qd_parse_sub_count(filter);
+
+    for (uint32_t idx = 0; idx < count && query->filter_count < QDR_AGENT_MAX_FILTERS; idx++) {
+        qd_parsed_field_t *key   = qd_parse_sub_key(filter, idx);
+        qd_parsed_field_t *value = qd_parse_sub_value(filter, idx);
+        qdr_query_filter_t *f    = &query->filters[query->filter_count++];
+
+        f->column = -1;
+        f->value  = value ? qdr_agent_field_text(value) : 0;
+        if (key && qd_parse_is_scalar(key)) {
+            for (int j = 0; qdr_columns[j]; j++) {
+                if (qd_iterator_equal(qd_parse_raw(key), (const unsigned char*) qdr_columns[j])) {
+                    f->column = j;
+                    break;
+                }
+            }
+        }
+    }
+}
+
 static void qdr_agent_emit_columns(qdr_query_t *query, const char *qdr_columns[], int column_count)
 {
     qd_compose_start_list(query->body);
@@ -324,6 +480,20 @@ static void qdr_agent_set_columns(qdr_query_t *query,
 
 
 
+void qdr_query_set_filter(qdr_query_t *query, qd_parsed_field_t *filter)
+{
+    if (!filter || !qd_parse_is_map(filter))
+        return;
+
+    switch (query->entity_type) {
+    case QD_ROUTER_CONNECTION: qdr_agent_add_filters(query, filter, qdr_connection_columns); break;
+    case QD_ROUTER_LINK:       qdr_agent_add_filters(query, filter, qdr_link_columns); break;
+    case QD_ROUTER_ADDRESS:    qdr_agent_add_filters(query, filter, qdr_address_columns); break;
+    default: break;
+    }
+}
+
+
 void qdr_manage_handler(qdr_core_t *core, qdr_manage_response_t response_handler)
 {
     core->agent_response_handler = response_handler;
@@ -338,10 +508,136 @@ void qdr_agent_setup_CT(qdr_core_t *core)
 {
     DEQ_INIT(core->outgoing_query_list);
     core->query_lock  = sys_mutex();
+    core->snapshot_lock = sys_mutex();
+    DEQ_INIT(core->agent_snapshots);
     core->agent_timer = qd_timer(core->qd, qdr_agent_response_handler, core);
 }
 
 
+bool qdr_agent_filter_match_CT(qdr_core_t *core, qdr_query_t *query, qdr_agent_column_writer_t writer, void *object)
+{
+    for (int i = 0; i < query->filter_count; i++) {
+        qdr_query_filter_t *f = &query->filters[i];
+        if (f->column < 0 || !f->value)
+            return false;
+
+        //
+        // Encode the column as it would be written into the response and
+        // compare the text of the value.
+        //
+        qd_composed_field_t *field = qd_compose_subfield(0);
+        qd_buffer_list_t     buffers;
+        writer(core, field, f->column, object);
+        qd_compose_take_buffers(field, &buffers);
+        qd_compose_free(field);
+
+        bool match = false;
+        if (!DEQ_IS_EMPTY(buffers)) {
+            qd_iterator_t     *iter   = qd_iterator_buffer(DEQ_HEAD(buffers), 0, qd_buffer_list_length(&buffers), ITER_VIEW_ALL);
+            qd_parsed_field_t *parsed = qd_parse(iter);
+            if (parsed && qd_parse_ok(parsed)) {
+                char *text = qdr_agent_field_text(parsed);
+                match = text && strcmp(text, f->value) == 0;
+                free(text);
+            }
+            qd_parse_free(parsed);
+            qd_iterator_free(iter);
+        }
+        qd_buffer_list_free_buffers(&buffers);
+
+        if (!match)
+            return false;
+    }
+    return true;
+}
+
+
+static qdr_agent_cursor_t *qdr_agent_find_cursor_CT(qdr_core_t *core, qdr_query_t *query)
+{
+    for (int i = 0; i < QDR_AGENT_CURSORS; i++) {
+        qdr_agent_cursor_t *cursor = &core->agent_cursors[i];
+        if (cursor->object && cursor->query == query)
+            return cursor;
+    }
+    return 0;
+}
+
+
+void qdr_agent_set_cursor_CT(qdr_core_t *core, qdr_query_t *query, void *object)
+{
+    qdr_agent_cursor_t *cursor = qdr_agent_find_cursor_CT(core, query);
+
+    if (!object) {
+        if (cursor)
+            cursor->object = 0;
+        return;
+    }
+
+    if (!cursor) {
+        //
+        // Take a free slot, or the least recently used one.  A query that
+        // loses its slot falls back to seeking its offset.
+        //
+        cursor = &core->agent_cursors[0];
+        for (int i = 0; i < QDR_AGENT_CURSORS; i++) {
+            qdr_agent_cursor_t *slot = &core->agent_cursors[i];
+            if (!slot->object) {
+                cursor = slot;
+                break;
+            }
+            if (slot->stamp < cursor->stamp)
+                cursor = slot;
+        }
+    }
+
+    cursor->query       = query;
+    cursor->entity_type = query->entity_type;
+    cursor->offset      = query->next_offset;
+    cursor->object      = object;
+    cursor->filtered    = query->filter_count > 0;
+    cursor->stamp       = ++core->agent_cursor_stamp;
+}
+
+
+void *qdr_agent_cursor_CT(qdr_core_t *core, qdr_query_t *query)
+{
+    qdr_agent_cursor_t *cursor = qdr_agent_find_cursor_CT(core, query);
+    return cursor ? cursor->object : 0;
+}
+
+
+void *qdr_agent_cursor_resume_CT(qdr_core_t *core, qdr_query_t *query, int offset)
+{
+    //
+    // A slot still naming this query was left by a freed query at the same address.
+    //
+    qdr_agent_set_cursor_CT(core, query, 0);
+
+    if (offset == 0 || query->filter_count > 0)
+        return 0;
+
+    for (int i = 0; i < QDR_AGENT_CURSORS; i++) {
+        qdr_agent_cursor_t *cursor = &core->agent_cursors[i];
+        if (cursor->object && !cursor->filtered && cursor->entity_type == query->entity_type && cursor->offset == offset) {
+            cursor->query = query;
+            cursor->stamp = ++core->agent_cursor_stamp;
+            return cursor->object;
+        }
+    }
+    return 0;
+}
+
+
+void qdr_agent_object_removed_CT(qdr_core_t *core, void *object, void *next)
+{
+    for (int i = 0; i < QDR_AGENT_CURSORS; i++) {
+        qdr_agent_cursor_t *cursor = &core->agent_cursors[i];
+        if (cursor->object == object)
+            cursor->object = next;
+    }
+}
+
+
 static void qdr_agent_forbidden(qdr_core_t *core, qdr_query_t *query, bool op_query)
 {
     query->status = QD_AMQP_FORBIDDEN;
@@ -369,6 +665,7 @@ static void qdr_manage_read_CT(qdr_core_t *core, qdr_action_t *action, bool disc
     case QD_ROUTER_EXCHANGE:          qdra_config_exchange_get_CT(core, name, identity, query, qdr_config_exchange_columns); break;
     case QD_ROUTER_BINDING:           qdra_config_binding_get_CT(core, name, identity, query, qdr_config_binding_columns); break;
     case QD_ROUTER_CONN_LINK_ROUTE:   qdra_conn_link_route_get_CT(core, name, identity, query, qdr_conn_link_route_columns); break;
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_forbidden(core, query, false); break;
    }
 
     qdr_field_free(action->args.agent.name);
@@ -376,13 +673,8 @@ static void qdr_manage_read_CT(qdr_core_t *core, qdr_action_t *action, bool disc
 }
 
 
-static void qdr_manage_create_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+static void qdr_manage_create_entity_CT(qdr_core_t *core, qdr_query_t *query, qd_iterator_t *name, qd_parsed_field_t *in_body)
 {
-    qd_iterator_t     *name         = qdr_field_iterator(action->args.agent.name);
-    qdr_query_t       *query        = action->args.agent.query;
-    qd_parsed_field_t *in_body      = action->args.agent.in_body;
-    qd_buffer_list_t   body_buffers = action->args.agent.body_buffers;
-
     switch (query->entity_type) {
     case QD_ROUTER_CONFIG_ADDRESS:    qdra_config_address_create_CT(core, name, query, in_body); break;
     case QD_ROUTER_CONFIG_LINK_ROUTE: qdra_config_link_route_create_CT(core, name, query, in_body); break;
@@ -395,21 +687,13 @@ static void qdr_manage_create_CT(qdr_core_t *core, qdr_action_t *action, bool di
     case QD_ROUTER_EXCHANGE:          qdra_config_exchange_create_CT(core, name, query, in_body); break;
     case QD_ROUTER_BINDING:           qdra_config_binding_create_CT(core, name, query, in_body); break;
     case QD_ROUTER_CONN_LINK_ROUTE:   qdra_conn_link_route_create_CT(core, name, query, in_body); break;
-
-   }
-
-   qdr_field_free(action->args.agent.name);
-   qd_parse_free(in_body);
-   qd_buffer_list_free_buffers(&body_buffers);
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_forbidden(core, query, false); break;
+    }
 }
 
 
-static void qdr_manage_delete_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+static void qdr_manage_delete_entity_CT(qdr_core_t *core, qdr_query_t *query, qd_iterator_t *name, qd_iterator_t *identity)
 {
-    qd_iterator_t *name     = qdr_field_iterator(action->args.agent.name);
-    qd_iterator_t *identity = qdr_field_iterator(action->args.agent.identity);
-    qdr_query_t   *query    = action->args.agent.query;
-
     switch (query->entity_type) {
     case QD_ROUTER_CONFIG_ADDRESS:    qdra_config_address_delete_CT(core, query, name, identity); break;
     case QD_ROUTER_CONFIG_LINK_ROUTE: qdra_config_link_route_delete_CT(core, query, name, identity); break;
@@ -422,10 +706,188 @@ static void qdr_manage_delete_CT(qdr_core_t *core, qdr_action_t *action, bool di
     case QD_ROUTER_EXCHANGE:          qdra_config_exchange_delete_CT(core, query, name, identity); break;
     case QD_ROUTER_BINDING:           qdra_config_binding_delete_CT(core, query, name, identity); break;
     case QD_ROUTER_CONN_LINK_ROUTE:   qdra_conn_link_route_delete_CT(core, query, name, identity); break;
-   }
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_forbidden(core, query, false); break;
+    }
+}
 
-   qdr_field_free(action->args.agent.name);
-   qdr_field_free(action->args.agent.identity);
+
+static void qdr_manage_create_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qd_iterator_t     *name         = qdr_field_iterator(action->args.agent.name);
+    qdr_query_t       *query        = action->args.agent.query;
+    qd_parsed_field_t *in_body      = action->args.agent.in_body;
+    qd_buffer_list_t   body_buffers = action->args.agent.body_buffers;
+
+    qdr_manage_create_entity_CT(core, query, name, in_body);
+
+    qdr_field_free(action->args.agent.name);
+    qd_parse_free(in_body);
+    qd_buffer_list_free_buffers(&body_buffers);
+}
+
+
+static void qdr_manage_delete_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qd_iterator_t *name     = qdr_field_iterator(action->args.agent.name);
+    qd_iterator_t *identity = qdr_field_iterator(action->args.agent.identity);
+    qdr_query_t   *query    = action->args.agent.query;
+
+    qdr_manage_delete_entity_CT(core, query, name, identity);
+
+    qdr_field_free(action->args.agent.name);
+    qdr_field_free(action->args.agent.identity);
+}
+
+
+//
+// A bulk request creates or deletes each entity of its list through a query of
+// its own, as for a single request.  Those queries are marked with the bulk
+// query, and rather than being answered each writes its outcome into the next
+// element of the bulk response's list.
+//
+
+/**
+ * True if the entity type's creates and deletes are all answered within the
+ * action, so that every entity of a bulk request reports an outcome.
+ */
+static bool qdr_agent_bulk_supported(qd_router_entity_type_t type)
+{
+    switch (type) {
+    case QD_ROUTER_CONFIG_ADDRESS:
+    case QD_ROUTER_CONFIG_LINK_ROUTE:
+    case QD_ROUTER_CONFIG_AUTO_LINK:
+    case QD_ROUTER_EXCHANGE:
+    case QD_ROUTER_BINDING:
+    case QD_ROUTER_CONN_LINK_ROUTE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+static void qdr_agent_bulk_result_CT(qdr_query_t *query)
+{
+    qd_composed_field_t *body = query->bulk->body;
+    qd_buffer_list_t     attributes;
+
+    DEQ_INIT(attributes);
+    if (query->body) {
+        qd_compose_take_buffers(query->body, &attributes);
+        qd_compose_free(query->body);
+    }
+
+    qd_compose_start_map(body);
+    qd_compose_insert_string(body, "statusCode");
+    qd_compose_insert_int(body, query->status.status);
+    qd_compose_insert_string(body, "statusDescription");
+    if (query->status.description)
+        qd_compose_insert_string(body, query->status.description);
+    else
+        qd_compose_insert_null(body);
+    if (query->status.status / 100 == 2 && !DEQ_IS_EMPTY(attributes)) {
+        qd_compose_insert_string(body, "attributes");
+        qd_compose_insert_buffers(body, &attributes);
+    }
+    qd_compose_end_map(body);
+
+    qd_buffer_list_free_buffers(&attributes);
+    qdr_query_free(query);
+}
+
+
+static void qdr_manage_bulk_CT(qdr_core_t *core, qdr_action_t *action, bool create)
+{
+    qdr_query_t       *query   = action->args.agent.query;
+    qd_parsed_field_t *in_body = action->args.agent.in_body;
+
+    query->status = QD_AMQP_OK;
+    qd_compose_start_list(query->body);
+
+    if (!qdr_agent_bulk_supported(query->entity_type)) {
+        query->status = QD_AMQP_NOT_IMPLEMENTED;
+        query->status.description = "Bulk operations are not supported for this entity type";
+    } else if (!in_body || !qd_parse_is_list(in_body)) {
+        query->status = QD_AMQP_BAD_REQUEST;
+        query->status.description = "Body of a bulk request must be a list";
+    } else {
+        uint32_t count = qd_parse_sub_count(in_body);
+        for (uint32_t i = 0; i < count; i++) {
+            qd_parsed_field_t *entity = qd_parse_sub_value(in_body, i);
+            qdr_query_t       *one    = qdr_query(core, 0, query->entity_type, 0, query->in_conn);
+            one->bulk = query;
+
+            if (!qd_parse_is_map(entity)) {
+                one->status = QD_AMQP_BAD_REQUEST;
+                one->status.description = "Each entity of a bulk request must be a map";
+                qdr_agent_bulk_result_CT(one);
+                continue;
+            }
+
+            qd_parsed_field_t *name_field = qd_parse_value_by_key(entity, "name");
+            qd_iterator_t     *name       = name_field ? qd_parse_raw(name_field) : 0;
+
+            if (create) {
+                // The created entity's attributes are written into the result
+                one->body = qd_compose_subfield(0);
+                qdr_manage_create_entity_CT(core, one, name, entity);
+            } else {
+                qd_parsed_field_t *identity_field = qd_parse_value_by_key(entity, "identity");
+                qd_iterator_t     *identity       = identity_field ? qd_parse_raw(identity_field) : 0;
+                qdr_manage_delete_entity_CT(core, one, name, identity);
+            }
+        }
+    }
+
+    qd_compose_end_list(query->body);
+    qdr_agent_enqueue_response_CT(core, query);
+    qd_parse_free(in_body);
+}
+
+
+static void qdr_manage_bulk_create_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qdr_manage_bulk_CT(core, action, true);
+}
+
+
+static void qdr_manage_bulk_delete_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qdr_manage_bulk_CT(core, action, false);
+}
+
+
+static void qdr_manage_summary_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qdr_query_t *query = action->args.agent.query;
+    bool         edges = action->args.agent.edges;
+
+    if (query->entity_type != QD_ROUTER_ROUTER) {
+        query->status = QD_AMQP_NOT_IMPLEMENTED;
+        query->status.description = "Summaries are only available for the router entity";
+    } else if (edges && core->edge_summary_handler) {
+        // Answered by the handler once the edges have replied
+        core->edge_summary_handler(core->edge_summary_context, query);
+        return;
+    } else if (edges) {
+        query->status = QD_AMQP_NOT_IMPLEMENTED;
+        query->status.description = "Only interior routers merge edge summaries";
+    } else {
+        qdr_router_summary_t summary;
+        qdra_router_summary_CT(core, &summary);
+        qd_compose_start_map(query->body);
+        qd_compose_insert_string(query->body, "id");
+        qd_compose_insert_string(query->body, core->router_id);
+        qdra_router_summary_write(query->body, &summary);
+        qd_compose_end_map(query->body);
+        query->status = QD_AMQP_OK;
+        qdr_agent_enqueue_response_CT(core, query);
+        return;
+    }
+
+    qd_compose_start_map(query->body);
+    qd_compose_end_map(query->body);
+    qdr_agent_enqueue_response_CT(core, query);
 }
 
 static void qdr_manage_update_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
@@ -447,6 +909,7 @@ static void qdr_manage_update_CT(qdr_core_t *core, qdr_action_t *action, bool di
     case QD_ROUTER_EXCHANGE:          break;
     case QD_ROUTER_BINDING:           break;
     case QD_ROUTER_CONN_LINK_ROUTE:   break;
+    case QD_ROUTER_CORE_ACTION:       qdr_agent_forbidden(core, query, false); break;
    }
 
    qdr_field_free(action->args.agent.name);
@@ -475,6 +938,7 @@ static void qdrh_query_get_first_CT(qdr_core_t *core, qdr_action_t *action, bool
         case QD_ROUTER_EXCHANGE:          qdra_config_exchange_get_first_CT(core, query, offset); break;
         case QD_ROUTER_BINDING:           qdra_config_binding_get_first_CT(core, query, offset); break;
         case QD_ROUTER_CONN_LINK_ROUTE:   qdra_conn_link_route_get_first_CT(core, query, offset); break;
+        case QD_ROUTER_CORE_ACTION:       qdra_core_action_get_first_CT(core, query, offset); break;
         }
     }
 }
@@ -497,6 +961,7 @@ static void qdrh_query_get_next_CT(qdr_core_t *core, qdr_action_t *action, bool
         case QD_ROUTER_EXCHANGE:          qdra_config_exchange_get_next_CT(core, query); break;
         case QD_ROUTER_BINDING:           qdra_config_binding_get_next_CT(core, query); break;
         case QD_ROUTER_CONN_LINK_ROUTE:   qdra_conn_link_route_get_next_CT(core, query); break;
+        case QD_ROUTER_CORE_ACTION:       qdra_core_action_get_next_CT(core, query); break;
         }
     }
 }
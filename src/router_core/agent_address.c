@@ -18,6 +18,7 @@
  */
 
 #include "agent_address.h"
+#include "agent_router.h"
 #include "router_core_private.h"
 
 #define QDR_ADDRESS_NAME                                0
@@ -40,6 +41,17 @@
 #define QDR_ADDRESS_TRANSIT_OUTSTANDING                17
 #define QDR_ADDRESS_TRACKED_DELIVERIES                 18
 #define QDR_ADDRESS_PRIORITY                           19
+#define QDR_ADDRESS_QUEUE_DEPTH                        20
+#define QDR_ADDRESS_QUEUE_BYTES                        21
+#define QDR_ADDRESS_QUEUED_DELIVERIES                  22
+#define QDR_ADDRESS_QUEUE_FULL_COUNT                   23
+#define QDR_ADDRESS_QUEUE_WAIT_AVG                     24
+#define QDR_ADDRESS_QUEUE_WAIT_MAX                     25
+#define QDR_ADDRESS_SEND_LATENCY_HISTOGRAM             26
+#define QDR_ADDRESS_SETTLE_LATENCY_HISTOGRAM           27
+#define QDR_ADDRESS_SETTLE_LATENCY_AVG                 28
+#define QDR_ADDRESS_SETTLE_LATENCY_MAX                 29
+#define QDR_ADDRESS_STAGE_LATENCY                      30
 
 const char *qdr_address_columns[] =
     {"name",
@@ -62,6 +74,17 @@ const char *qdr_address_columns[] =
      "transitOutstanding",
      "trackedDeliveries",
      "priority",
+     "queueDepth",
+     "queueBytes",
+     "queuedDeliveries",
+     "queueFullCount",
+     "queueWaitMicrosAvg",
+     "queueWaitMicrosMax",
+     "sendLatencyHistogram",
+     "settleLatencyHistogram",
+     "settleLatencyMicrosAvg",
+     "settleLatencyMicrosMax",
+     "stageLatencyMicros",
      0};
 
 
@@ -70,6 +93,9 @@ static void qdr_insert_address_columns_CT(qdr_core_t          *core,
                                           qd_composed_field_t *body,
                                           int                  column_index)
 {
+    static const qdr_address_stats_t no_stats;  // for addresses that have never seen a delivery
+    const qdr_address_stats_t *stats = addr->stats ? addr->stats : &no_stats;
+
     switch(column_index) {
     case QDR_ADDRESS_NAME:
     case QDR_ADDRESS_IDENTITY:
@@ -128,31 +154,31 @@ static void qdr_insert_address_columns_CT(qdr_core_t          *core,
     }
 
     case QDR_ADDRESS_DELIVERIES_INGRESS:
-        qd_compose_insert_ulong(body, addr->deliveries_ingress);
+        qd_compose_insert_ulong(body, stats->deliveries_ingress);
         break;
 
     case QDR_ADDRESS_DELIVERIES_EGRESS:
-        qd_compose_insert_ulong(body, addr->deliveries_egress);
+        qd_compose_insert_ulong(body, stats->deliveries_egress);
         break;
 
     case QDR_ADDRESS_DELIVERIES_TRANSIT:
-        qd_compose_insert_ulong(body, addr->deliveries_transit);
+        qd_compose_insert_ulong(body, stats->deliveries_transit);
         break;
 
     case QDR_ADDRESS_DELIVERIES_TO_CONTAINER:
-        qd_compose_insert_ulong(body, addr->deliveries_to_container);
+        qd_compose_insert_ulong(body, stats->deliveries_to_container);
         break;
 
     case QDR_ADDRESS_DELIVERIES_FROM_CONTAINER:
-        qd_compose_insert_ulong(body, addr->deliveries_from_container);
+        qd_compose_insert_ulong(body, stats->deliveries_from_container);
         break;
 
     case QDR_ADDRESS_DELIVERIES_EGRESS_ROUTE_CONTAINER:
-        qd_compose_insert_ulong(body, addr->deliveries_egress_route_container);
+        qd_compose_insert_ulong(body, stats->deliveries_egress_route_container);
         break;
 
     case QDR_ADDRESS_DELIVERIES_INGRESS_ROUTE_CONTAINER:
-        qd_compose_insert_ulong(body, addr->deliveries_ingress_route_container);
+        qd_compose_insert_ulong(body, stats->deliveries_ingress_route_container);
         break;
 
     case QDR_ADDRESS_TRANSIT_OUTSTANDING:
@@ -173,6 +199,50 @@ static void qdr_insert_address_columns_CT(qdr_core_t          *core,
         qd_compose_insert_int(body, addr->priority);
         break;
 
+    case QDR_ADDRESS_QUEUE_DEPTH:
+        qd_compose_insert_ulong(body, DEQ_SIZE(addr->queue));
+        break;
+
+    case QDR_ADDRESS_QUEUE_BYTES:
+        qd_compose_insert_ulong(body, addr->queue_bytes);
+        break;
+
+    case QDR_ADDRESS_QUEUED_DELIVERIES:
+        qd_compose_insert_ulong(body, stats->queued_deliveries);
+        break;
+
+    case QDR_ADDRESS_QUEUE_FULL_COUNT:
+        qd_compose_insert_ulong(body, stats->queue_full_count);
+        break;
+
+    case QDR_ADDRESS_QUEUE_WAIT_AVG:
+        qd_compose_insert_ulong(body, stats->dequeued_deliveries ? stats->queue_wait_usec_total / stats->dequeued_deliveries : 0);
+        break;
+
+    case QDR_ADDRESS_QUEUE_WAIT_MAX:
+        qd_compose_insert_ulong(body, stats->queue_wait_usec_max);
+        break;
+
+    case QDR_ADDRESS_SEND_LATENCY_HISTOGRAM:
+        qdr_agent_write_latency_CT(body, stats->latency, QDR_LATENCY_SEND_HISTOGRAM);
+        break;
+
+    case QDR_ADDRESS_SETTLE_LATENCY_HISTOGRAM:
+        qdr_agent_write_latency_CT(body, stats->latency, QDR_LATENCY_SETTLE_HISTOGRAM);
+        break;
+
+    case QDR_ADDRESS_SETTLE_LATENCY_AVG:
+        qdr_agent_write_latency_CT(body, stats->latency, QDR_LATENCY_SETTLE_AVG);
+        break;
+
+    case QDR_ADDRESS_SETTLE_LATENCY_MAX:
+        qdr_agent_write_latency_CT(body, stats->latency, QDR_LATENCY_SETTLE_MAX);
+        break;
+
+    case QDR_ADDRESS_STAGE_LATENCY:
+        qdr_agent_write_latency_CT(body, stats->latency, QDR_LATENCY_STAGES_SUMMARY);
+        break;
+
     default:
         qd_compose_insert_null(body);
         break;
@@ -215,15 +285,36 @@ static void qdr_manage_write_address_list_CT(qdr_core_t *core, qdr_query_t *quer
 }
 
 
-static void qdr_manage_advance_address_CT(qdr_query_t *query, qdr_address_t *addr)
+static void qdr_agent_address_column_CT(qdr_core_t *core, qd_composed_field_t *body, int col, void *addr)
+{
+    qdr_insert_address_columns_CT(core, (qdr_address_t*) addr, body, col);
+}
+
+
+// The first address from addr on that matches the query's filter
+static qdr_address_t *qdr_manage_match_address_CT(qdr_core_t *core, qdr_query_t *query, qdr_address_t *addr)
+{
+    while (addr && !qdr_agent_filter_match_CT(core, query, qdr_agent_address_column_CT, addr))
+        addr = DEQ_NEXT(addr);
+    return addr;
+}
+
+
+static qdr_address_t *qdr_manage_seek_address_CT(qdr_core_t *core, qdr_query_t *query, int offset)
+{
+    qdr_address_t *addr = qdr_manage_match_address_CT(core, query, DEQ_HEAD(core->addrs));
+    for (int i = 0; i < offset && addr; i++)
+        addr = qdr_manage_match_address_CT(core, query, DEQ_NEXT(addr));
+    return addr;
+}
+
+
+static void qdr_manage_advance_address_CT(qdr_core_t *core, qdr_query_t *query, qdr_address_t *addr)
 {
     query->next_offset++;
-    addr = DEQ_NEXT(addr);
-    if (addr) {
-        query->more     = true;
-        query->next_key = qdr_field((const char*) qd_hash_key_by_handle(addr->hash_handle));
-    } else
-        query->more = false;
+    addr = qdr_manage_match_address_CT(core, query, DEQ_NEXT(addr));
+    query->more = !!addr;
+    qdr_agent_set_cursor_CT(core, query, addr);
 }
 
 void qdra_address_get_CT(qdr_core_t    *core,
@@ -266,23 +357,22 @@ void qdra_address_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
     //
     query->status = QD_AMQP_OK;
 
+    //
+    // Pick up where the previous page left off, or run to the address at the offset.
+    //
+    qdr_address_t *addr = (qdr_address_t*) qdr_agent_cursor_resume_CT(core, query, offset);
+    if (!addr && offset < DEQ_SIZE(core->addrs))
+        addr = qdr_manage_seek_address_CT(core, query, offset);
+
     //
     // If the offset goes beyond the set of addresses, end the query now.
     //
-    if (offset >= DEQ_SIZE(core->addrs)) {
+    if (!addr) {
         query->more = false;
         qdr_agent_enqueue_response_CT(core, query);
         return;
     }
 
-    //
-    // Run to the address at the offset.
-    //
-    qdr_address_t *addr = DEQ_HEAD(core->addrs);
-    for (int i = 0; i < offset && addr; i++)
-        addr = DEQ_NEXT(addr);
-    assert(addr != 0);
-
     //
     // Write the columns of the address entity into the response body.
     //
@@ -292,7 +382,7 @@ void qdra_address_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
     // Advance to the next address
     //
     query->next_offset = offset;
-    qdr_manage_advance_address_CT(query, addr);
+    qdr_manage_advance_address_CT(core, query, addr);
 
     //
     // Enqueue the response.
@@ -303,27 +393,15 @@ void qdra_address_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
 
 void qdra_address_get_next_CT(qdr_core_t *core, qdr_query_t *query)
 {
-    qdr_address_t *addr = 0;
-
     //
-    // Use the stored key to try to find the next entry in the table.
+    // The cursor is the next address.  If it was lost, use the saved offset,
+    // which is less efficient.
     //
-    if (query->next_key) {
-        qd_hash_retrieve(core->addr_hash, query->next_key->iterator, (void**) &addr);
-        qdr_field_free(query->next_key);
-        query->next_key = 0;
-    }
-    if (!addr) {
-        //
-        // If the address was removed in the time between this get and the previous one,
-        // we need to use the saved offset, which is less efficient.
-        //
-        if (query->next_offset < DEQ_SIZE(core->addrs)) {
-            addr = DEQ_HEAD(core->addrs);
-            for (int i = 0; i < query->next_offset && addr; i++)
-                addr = DEQ_NEXT(addr);
-        }
-    }
+    qdr_address_t *addr = (qdr_address_t*) qdr_agent_cursor_CT(core, query);
+    if (addr)
+        addr = qdr_manage_match_address_CT(core, query, addr);
+    else if (query->next_offset < DEQ_SIZE(core->addrs))
+        addr = qdr_manage_seek_address_CT(core, query, query->next_offset);
 
     if (addr) {
         //
@@ -334,7 +412,7 @@ void qdra_address_get_next_CT(qdr_core_t *core, qdr_query_t *query)
         //
         // Advance to the next address
         //
-        qdr_manage_advance_address_CT(query, addr);
+        qdr_manage_advance_address_CT(core, query, addr);
     } else
         query->more = false;
 
@@ -32,6 +32,13 @@
 #define QDR_CONFIG_ADDRESS_OUT_PHASE     7
 #define QDR_CONFIG_ADDRESS_PATTERN       8
 #define QDR_CONFIG_ADDRESS_PRIORITY      9
+#define QDR_CONFIG_ADDRESS_DROP_POLICY    10
+#define QDR_CONFIG_ADDRESS_SAMPLE_RATE    11
+#define QDR_CONFIG_ADDRESS_QUEUE_DEPTH    12
+#define QDR_CONFIG_ADDRESS_QUEUE_BYTES    13
+#define QDR_CONFIG_ADDRESS_MCAST_SETTLE   14
+#define QDR_CONFIG_ADDRESS_PRIORITY_ORDER 15
+#define QDR_CONFIG_ADDRESS_GROUP_AFFINITY 16
 
 const char *qdr_config_address_columns[] =
     {"name",
@@ -44,8 +51,21 @@ const char *qdr_config_address_columns[] =
      "egressPhase",
      "pattern",
      "priority",
+     "presettledDropPolicy",
+     "presettledSampleRate",
+     "queueMaxDepth",
+     "queueMaxBytes",
+     "multicastSettlement",
+     "priorityOrdered",
+     "groupAffinity",
      0};
 
+static const char *qdr_presettled_drop_names[QDR_PRESETTLED_DROP_POLICIES] =
+    {"all", "oldest", "newest", "sample", "conflate"};
+
+static const char *qdr_mcast_settlement_names[QDR_MCAST_SETTLE_MODES] =
+    {"presettle", "firstAccept", "allAccept", "majority"};
+
 const char *CONFIG_ADDRESS_TYPE = "org.apache.qpid.dispatch.router.config.address";
 
 static void qdr_config_address_insert_column_CT(qdr_address_config_t *addr, int col, qd_composed_field_t *body, bool as_map)
@@ -125,6 +145,34 @@ static void qdr_config_address_insert_column_CT(qdr_address_config_t *addr, int
     case QDR_CONFIG_ADDRESS_PRIORITY:
         qd_compose_insert_int(body, addr->priority);
         break;
+
+    case QDR_CONFIG_ADDRESS_DROP_POLICY:
+        qd_compose_insert_string(body, qdr_presettled_drop_names[addr->presettled_drop]);
+        break;
+
+    case QDR_CONFIG_ADDRESS_SAMPLE_RATE:
+        qd_compose_insert_int(body, addr->presettled_sample_rate);
+        break;
+
+    case QDR_CONFIG_ADDRESS_QUEUE_DEPTH:
+        qd_compose_insert_int(body, addr->queue_max_depth);
+        break;
+
+    case QDR_CONFIG_ADDRESS_QUEUE_BYTES:
+        qd_compose_insert_long(body, (int64_t) addr->queue_max_bytes);
+        break;
+
+    case QDR_CONFIG_ADDRESS_MCAST_SETTLE:
+        qd_compose_insert_string(body, qdr_mcast_settlement_names[addr->mcast_settlement]);
+        break;
+
+    case QDR_CONFIG_ADDRESS_PRIORITY_ORDER:
+        qd_compose_insert_bool(body, addr->priority_ordered);
+        break;
+
+    case QDR_CONFIG_ADDRESS_GROUP_AFFINITY:
+        qd_compose_insert_bool(body, addr->group_affinity);
+        break;
     }
 }
 
@@ -236,6 +284,40 @@ static qd_address_treatment_t qdra_address_treatment_CT(qd_parsed_field_t *field
 }
 
 
+static bool qdra_presettled_drop_CT(qd_parsed_field_t *field, qdr_presettled_drop_t *policy)
+{
+    *policy = QDR_PRESETTLED_DROP_ALL;
+    if (!field)
+        return true;
+
+    qd_iterator_t *iter = qd_parse_raw(field);
+    for (int i = 0; i < QDR_PRESETTLED_DROP_POLICIES; i++) {
+        if (qd_iterator_equal(iter, (const unsigned char*) qdr_presettled_drop_names[i])) {
+            *policy = (qdr_presettled_drop_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static bool qdra_mcast_settlement_CT(qd_parsed_field_t *field, qdr_mcast_settlement_t *mode)
+{
+    *mode = QDR_MCAST_SETTLE_PRESETTLE;
+    if (!field)
+        return true;
+
+    qd_iterator_t *iter = qd_parse_raw(field);
+    for (int i = 0; i < QDR_MCAST_SETTLE_MODES; i++) {
+        if (qd_iterator_equal(iter, (const unsigned char*) qdr_mcast_settlement_names[i])) {
+            *mode = (qdr_mcast_settlement_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 static qdr_address_config_t *qdr_address_config_find_by_identity_CT(qdr_core_t *core, qd_iterator_t *identity)
 {
     if (!identity)
@@ -261,14 +343,7 @@ static qdr_address_config_t *qdr_address_config_find_by_name_CT(qdr_core_t *core
     if (!name)
         return 0;
 
-    qdr_address_config_t *rc = DEQ_HEAD(core->addr_config);
-    while (rc) { // Sometimes the name can be null
-        if (rc->name && qd_iterator_equal(name, (const unsigned char*) rc->name))
-            break;
-        rc = DEQ_NEXT(rc);
-    }
-
-    return rc;
+    return (qdr_address_config_t*) qdr_config_name_find_CT(core->addr_config_names, name);
 }
 
 
@@ -316,12 +391,7 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
         //
         // Ensure there isn't a duplicate name and that the body is a map
         //
-        qdr_address_config_t *addr = DEQ_HEAD(core->addr_config);
-        while (addr) {
-            if (name && addr->name && qd_iterator_equal(name, (const unsigned char*) addr->name))
-                break;
-            addr = DEQ_NEXT(addr);
-        }
+        qdr_address_config_t *addr = (qdr_address_config_t*) qdr_config_name_find_CT(core->addr_config_names, name);
 
         if (!!addr) {
             query->status = QD_AMQP_BAD_REQUEST;
@@ -347,6 +417,13 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
         qd_parsed_field_t *in_phase_field  = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_IN_PHASE]);
         qd_parsed_field_t *out_phase_field = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_OUT_PHASE]);
         qd_parsed_field_t *priority_field  = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_PRIORITY]);
+        qd_parsed_field_t *drop_field      = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_DROP_POLICY]);
+        qd_parsed_field_t *sample_field    = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_SAMPLE_RATE]);
+        qd_parsed_field_t *q_depth_field   = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_QUEUE_DEPTH]);
+        qd_parsed_field_t *q_bytes_field   = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_QUEUE_BYTES]);
+        qd_parsed_field_t *settle_field    = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_MCAST_SETTLE]);
+        qd_parsed_field_t *ordered_field   = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_PRIORITY_ORDER]);
+        qd_parsed_field_t *affinity_field  = qd_parse_value_by_key(in_body, qdr_config_address_columns[QDR_CONFIG_ADDRESS_GROUP_AFFINITY]);
 
         //
         // Either a prefix or a pattern field is mandatory.  Prefix and pattern
@@ -391,9 +468,16 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
 
 
         bool waypoint  = waypoint_field  ? qd_parse_as_bool(waypoint_field) : false;
+        bool ordered   = ordered_field   ? qd_parse_as_bool(ordered_field)  : false;
+        bool affinity  = affinity_field  ? qd_parse_as_bool(affinity_field) : false;
         long in_phase  = in_phase_field  ? qd_parse_as_long(in_phase_field)  : -1;
         long out_phase = out_phase_field ? qd_parse_as_long(out_phase_field) : -1;
         long priority  = priority_field  ? qd_parse_as_long(priority_field)  : -1;
+        long sample    = sample_field    ? qd_parse_as_long(sample_field)    : 10;
+        long q_depth   = q_depth_field   ? qd_parse_as_long(q_depth_field)   : 0;
+        long q_bytes   = q_bytes_field   ? qd_parse_as_long(q_bytes_field)   : 0;
+        qdr_presettled_drop_t presettled_drop;
+        qdr_mcast_settlement_t mcast_settlement;
 
         //
         // Handle the address-phasing logic.  If the phases are provided, use them.  Otherwise
@@ -424,6 +508,43 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
             break;
         }
 
+        //
+        // Validate the pre-settled drop policy.
+        //
+        if (!qdra_presettled_drop_CT(drop_field, &presettled_drop)) {
+            query->status = QD_AMQP_BAD_REQUEST;
+            query->status.description = "presettledDropPolicy must be one of all, oldest, newest, sample or conflate";
+            qd_log(core->agent_log, QD_LOG_ERROR, "Error performing CREATE of %s: %s", CONFIG_ADDRESS_TYPE, query->status.description);
+            break;
+        }
+
+        if (sample < 1) {
+            query->status = QD_AMQP_BAD_REQUEST;
+            query->status.description = "presettledSampleRate must be at least 1";
+            qd_log(core->agent_log, QD_LOG_ERROR, "Error performing CREATE of %s: %s", CONFIG_ADDRESS_TYPE, query->status.description);
+            break;
+        }
+
+        //
+        // Validate the multicast settlement mode.
+        //
+        if (!qdra_mcast_settlement_CT(settle_field, &mcast_settlement)) {
+            query->status = QD_AMQP_BAD_REQUEST;
+            query->status.description = "multicastSettlement must be one of presettle, firstAccept, allAccept or majority";
+            qd_log(core->agent_log, QD_LOG_ERROR, "Error performing CREATE of %s: %s", CONFIG_ADDRESS_TYPE, query->status.description);
+            break;
+        }
+
+        //
+        // Validate the in-router queue bounds.
+        //
+        if (q_depth < 0 || q_bytes < 0) {
+            query->status = QD_AMQP_BAD_REQUEST;
+            query->status.description = "queueMaxDepth and queueMaxBytes must not be negative";
+            qd_log(core->agent_log, QD_LOG_ERROR, "Error performing CREATE of %s: %s", CONFIG_ADDRESS_TYPE, query->status.description);
+            break;
+        }
+
         //
         // The request is good.  Create the entity and insert it into the hash index and list.
         //
@@ -432,6 +553,7 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
         DEQ_ITEM_INIT(addr);
         addr->ref_count = 1; // Represents the reference from the addr_config list
         addr->name      = name ? (char*) qd_iterator_copy(name) : 0;
+        addr->name_handle = 0;
         addr->identity  = qdr_identifier(core);
         addr->treatment = qdra_address_treatment_CT(distrib_field);
         addr->in_phase  = in_phase;
@@ -439,11 +561,20 @@ void qdra_config_address_create_CT(qdr_core_t         *core,
         addr->is_prefix = !!prefix_field;
         addr->pattern   = pattern;
         addr->priority  = priority;
+        addr->presettled_drop        = presettled_drop;
+        addr->presettled_sample_rate = sample;
+        addr->queue_max_depth        = q_depth;
+        addr->queue_max_bytes        = q_bytes;
+        addr->mcast_settlement       = mcast_settlement;
+        addr->priority_ordered       = ordered;
+        addr->group_affinity         = affinity;
         pattern = 0;
 
         qd_iterator_reset_view(iter, ITER_VIEW_ALL);
         qd_parse_tree_add_pattern(core->addr_parse_tree, iter, addr);
+        qdr_config_snapshot_changed_CT(core);
         DEQ_INSERT_TAIL(core->addr_config, addr);
+        qdr_config_name_insert_CT(core->addr_config_names, addr->name, addr, &addr->name_handle);
 
         //
         // Compose the result map for the response.
@@ -295,14 +295,7 @@ static qdr_auto_link_t *qdr_auto_link_config_find_by_name_CT(qdr_core_t *core, q
     if (!name)
         return 0;
 
-    qdr_auto_link_t *rc = DEQ_HEAD(core->auto_links);
-    while (rc) { // Sometimes the name can be null
-        if (rc->name && qd_iterator_equal(name, (const unsigned char*) rc->name))
-            break;
-        rc = DEQ_NEXT(rc);
-    }
-
-    return rc;
+    return (qdr_auto_link_t*) qdr_config_name_find_CT(core->auto_link_names, name);
 }
 
 
@@ -346,12 +339,7 @@ void qdra_config_auto_link_create_CT(qdr_core_t        *core,
         //
         // Ensure there isn't a duplicate name and that the body is a map
         //
-        qdr_auto_link_t *al = DEQ_HEAD(core->auto_links);
-        while (al) {
-            if (name && al->name && qd_iterator_equal(name, (const unsigned char*) al->name))
-                break;
-            al = DEQ_NEXT(al);
-        }
+        qdr_auto_link_t *al = (qdr_auto_link_t*) qdr_config_name_find_CT(core->auto_link_names, name);
 
         if (!!al) {
             query->status = QD_AMQP_BAD_REQUEST;
@@ -333,14 +333,7 @@ static qdr_link_route_t *qdr_link_route_config_find_by_name_CT(qdr_core_t *core,
     if (!name)
         return 0;
 
-    qdr_link_route_t *rc = DEQ_HEAD(core->link_routes);
-    while (rc) { // Sometimes the name can be null
-        if (rc->name && qd_iterator_equal(name, (const unsigned char*) rc->name))
-            break;
-        rc = DEQ_NEXT(rc);
-    }
-
-    return rc;
+    return (qdr_link_route_t*) qdr_config_name_find_CT(core->link_route_names, name);
 }
 
 
@@ -386,12 +379,7 @@ void qdra_config_link_route_create_CT(qdr_core_t        *core,
         //
         // Ensure there isn't a duplicate name and that the body is a map
         //
-        qdr_link_route_t *lr = DEQ_HEAD(core->link_routes);
-        while (lr) {
-            if (name && lr->name && qd_iterator_equal(name, (const unsigned char*) lr->name))
-                break;
-            lr = DEQ_NEXT(lr);
-        }
+        qdr_link_route_t *lr = (qdr_link_route_t*) qdr_config_name_find_CT(core->link_route_names, name);
 
         if (!!lr) {
             query->status = QD_AMQP_BAD_REQUEST;
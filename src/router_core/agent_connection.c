@@ -41,6 +41,15 @@
 #define QDR_CONNECTION_SSL              16
 #define QDR_CONNECTION_OPENED           17
 #define QDR_CONNECTION_ACTIVE           18
+#define QDR_CONNECTION_PRIORITY_DELIVERIES 19
+#define QDR_CONNECTION_PRIORITY_BYTES   20
+#define QDR_CONNECTION_COMPRESSION_IN   21
+#define QDR_CONNECTION_COMPRESSION_OUT  22
+#define QDR_CONNECTION_MAX_FRAME_SIZE   23
+#define QDR_CONNECTION_FRAMES_IN        24
+#define QDR_CONNECTION_FRAMES_OUT       25
+#define QDR_CONNECTION_BYTES_PER_FRAME_IN  26
+#define QDR_CONNECTION_BYTES_PER_FRAME_OUT 27
 
 const char * const QDR_CONNECTION_DIR_IN  = "in";
 const char * const QDR_CONNECTION_DIR_OUT = "out";
@@ -50,6 +59,7 @@ const char *qdr_connection_roles[] =
      "inter-router",
      "route-container",
      "edge",
+     "inter-router-data",
      0};
 
 const char *qdr_connection_columns[] =
@@ -72,6 +82,15 @@ const char *qdr_connection_columns[] =
      "ssl",
      "opened",
      "active",
+     "priorityDeliveries",
+     "priorityBytes",
+     "compressionIn",
+     "compressionOut",
+     "maxFrameSize",
+     "framesIn",
+     "framesOut",
+     "bytesPerFrameIn",
+     "bytesPerFrameOut",
      0};
 
 const char *CONNECTION_TYPE = "org.apache.qpid.dispatch.connection";
@@ -215,6 +234,49 @@ static void qdr_connection_insert_column_CT(qdr_core_t *core, qdr_connection_t *
         }
         break;
 
+    case QDR_CONNECTION_PRIORITY_DELIVERIES:
+        qd_compose_start_list(body);
+        for (int priority = 0; priority < QDR_N_PRIORITIES; priority++)
+            qd_compose_insert_ulong(body, conn->priority_deliveries[priority]);
+        qd_compose_end_list(body);
+        break;
+
+    case QDR_CONNECTION_PRIORITY_BYTES:
+        qd_compose_start_list(body);
+        for (int priority = 0; priority < QDR_N_PRIORITIES; priority++)
+            qd_compose_insert_ulong(body, conn->priority_bytes[priority]);
+        qd_compose_end_list(body);
+        break;
+
+    case QDR_CONNECTION_COMPRESSION_IN:
+    case QDR_CONNECTION_COMPRESSION_OUT: {
+        const uint64_t *counts = col == QDR_CONNECTION_COMPRESSION_IN ? conn->compressed_in : conn->compressed_out;
+        qd_compose_start_list(body);
+        qd_compose_insert_ulong(body, counts[0]);
+        qd_compose_insert_ulong(body, counts[1]);
+        qd_compose_end_list(body);
+        break;
+    }
+
+    case QDR_CONNECTION_MAX_FRAME_SIZE:
+        qd_compose_insert_uint(body, conn->max_frame_size);
+        break;
+
+    case QDR_CONNECTION_FRAMES_IN:
+        qd_compose_insert_ulong(body, conn->frames[0]);
+        break;
+
+    case QDR_CONNECTION_FRAMES_OUT:
+        qd_compose_insert_ulong(body, conn->frames[1]);
+        break;
+
+    case QDR_CONNECTION_BYTES_PER_FRAME_IN:
+    case QDR_CONNECTION_BYTES_PER_FRAME_OUT: {
+        int dir = col == QDR_CONNECTION_BYTES_PER_FRAME_IN ? 0 : 1;
+        qd_compose_insert_ulong(body, conn->frames[dir] ? conn->frame_octets[dir] / conn->frames[dir] : 0);
+        break;
+    }
+
     case QDR_CONNECTION_PROPERTIES: {
         pn_data_t *data = conn->connection_info->connection_properties;
         qd_compose_start_map(body);
@@ -271,11 +333,36 @@ static void qdr_agent_write_connection_CT(qdr_core_t *core, qdr_query_t *query,
 }
 
 
-static void qdr_manage_advance_connection_CT(qdr_query_t *query, qdr_connection_t *conn)
+static void qdr_agent_connection_column_CT(qdr_core_t *core, qd_composed_field_t *body, int col, void *conn)
+{
+    qdr_connection_insert_column_CT(core, (qdr_connection_t*) conn, col, body, false);
+}
+
+
+// The first connection from conn on that matches the query's filter
+static qdr_connection_t *qdr_manage_match_connection_CT(qdr_core_t *core, qdr_query_t *query, qdr_connection_t *conn)
+{
+    while (conn && !qdr_agent_filter_match_CT(core, query, qdr_agent_connection_column_CT, conn))
+        conn = DEQ_NEXT(conn);
+    return conn;
+}
+
+
+static qdr_connection_t *qdr_manage_seek_connection_CT(qdr_core_t *core, qdr_query_t *query, int offset)
+{
+    qdr_connection_t *conn = qdr_manage_match_connection_CT(core, query, DEQ_HEAD(core->open_connections));
+    for (int i = 0; i < offset && conn; i++)
+        conn = qdr_manage_match_connection_CT(core, query, DEQ_NEXT(conn));
+    return conn;
+}
+
+
+static void qdr_manage_advance_connection_CT(qdr_core_t *core, qdr_query_t *query, qdr_connection_t *conn)
 {
     query->next_offset++;
-    conn = DEQ_NEXT(conn);
+    conn = qdr_manage_match_connection_CT(core, query, DEQ_NEXT(conn));
     query->more = !!conn;
+    qdr_agent_set_cursor_CT(core, query, conn);
 }
 
 
@@ -286,23 +373,22 @@ void qdra_connection_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offs
     //
     query->status = QD_AMQP_OK;
 
+    //
+    // Pick up where the previous page left off, or run to the object at the offset.
+    //
+    qdr_connection_t *conn = (qdr_connection_t*) qdr_agent_cursor_resume_CT(core, query, offset);
+    if (!conn && offset < DEQ_SIZE(core->open_connections))
+        conn = qdr_manage_seek_connection_CT(core, query, offset);
+
     //
     // If the offset goes beyond the set of objects, end the query now.
     //
-    if (offset >= DEQ_SIZE(core->open_connections)) {
+    if (!conn) {
         query->more = false;
         qdr_agent_enqueue_response_CT(core, query);
         return;
     }
 
-    //
-    // Run to the object at the offset.
-    //
-    qdr_connection_t *conn = DEQ_HEAD(core->open_connections);
-    for (int i = 0; i < offset && conn; i++)
-        conn = DEQ_NEXT(conn);
-    assert(conn);
-
     //
     // Write the columns of the object into the response body.
     //
@@ -312,7 +398,7 @@ void qdra_connection_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offs
     // Advance to the next connection
     //
     query->next_offset = offset;
-    qdr_manage_advance_connection_CT(query, conn);
+    qdr_manage_advance_connection_CT(core, query, conn);
 
     //
     // Enqueue the response.
@@ -322,13 +408,14 @@ void qdra_connection_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offs
 
 void qdra_connection_get_next_CT(qdr_core_t *core, qdr_query_t *query)
 {
-    qdr_connection_t *conn = 0;
-
-    if (query->next_offset < DEQ_SIZE(core->open_connections)) {
-        conn = DEQ_HEAD(core->open_connections);
-        for (int i = 0; i < query->next_offset && conn; i++)
-            conn = DEQ_NEXT(conn);
-    }
+    //
+    // The cursor is the next object unless it was lost, then seek the saved offset.
+    //
+    qdr_connection_t *conn = (qdr_connection_t*) qdr_agent_cursor_CT(core, query);
+    if (conn)
+        conn = qdr_manage_match_connection_CT(core, query, conn);
+    else if (query->next_offset < DEQ_SIZE(core->open_connections))
+        conn = qdr_manage_seek_connection_CT(core, query, query->next_offset);
 
     if (conn) {
         //
@@ -339,7 +426,7 @@ void qdra_connection_get_next_CT(qdr_core_t *core, qdr_query_t *query)
         //
         // Advance to the next object
         //
-        qdr_manage_advance_connection_CT(query, conn);
+        qdr_manage_advance_connection_CT(core, query, conn);
     } else
         query->more = false;
 
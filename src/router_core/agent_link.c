@@ -18,6 +18,7 @@
  */
 
 #include "agent_link.h"
+#include "agent_router.h"
 #include <inttypes.h>
 #include <stdio.h>
 
@@ -47,6 +48,13 @@
 #define QDR_LINK_INGRESS_HISTOGRAM        23
 #define QDR_LINK_PRIORITY                 24
 #define QDR_LINK_SETTLE_RATE              25
+#define QDR_LINK_Q2_STALL_COUNT           26
+#define QDR_LINK_Q3_STALL_COUNT           27
+#define QDR_LINK_SEND_LATENCY_HISTOGRAM   28
+#define QDR_LINK_SETTLE_LATENCY_HISTOGRAM 29
+#define QDR_LINK_SETTLE_LATENCY_AVG       30
+#define QDR_LINK_SETTLE_LATENCY_MAX       31
+#define QDR_LINK_STAGE_LATENCY            32
 
 const char *qdr_link_columns[] =
     {"name",
@@ -75,6 +83,13 @@ const char *qdr_link_columns[] =
      "ingressHistogram",
      "priority",
      "settleRate",
+     "q2StallCount",
+     "q3StallCount",
+     "sendLatencyHistogram",
+     "settleLatencyHistogram",
+     "settleLatencyMicrosAvg",
+     "settleLatencyMicrosMax",
+     "stageLatencyMicros",
      0};
 
 static const char *qd_link_type_name(qd_link_type_t lt)
@@ -143,7 +158,7 @@ static void qdr_agent_write_column_CT(qdr_core_t *core, qd_composed_field_t *bod
         break;
 
     case QDR_LINK_CAPACITY:
-        qd_compose_insert_uint(body, link->capacity);
+        qd_compose_insert_uint(body, link->credit_window > 0 ? link->credit_window : link->capacity);
         break;
 
     case QDR_LINK_PEER:
@@ -164,7 +179,7 @@ static void qdr_agent_write_column_CT(qdr_core_t *core, qd_composed_field_t *bod
         break;
 
     case QDR_LINK_DELIVERY_COUNT:
-        qd_compose_insert_ulong(body, link->total_deliveries);
+        qd_compose_insert_ulong(body, link->total_deliveries + __atomic_load_n(&link->direct_deliveries, __ATOMIC_RELAXED));
         break;
 
     case QDR_LINK_CONNECTION_ID: {
@@ -260,6 +275,34 @@ static void qdr_agent_write_column_CT(qdr_core_t *core, qd_composed_field_t *bod
     }
         break;
 
+    case QDR_LINK_Q2_STALL_COUNT:
+        qd_compose_insert_ulong(body, link->q2_stall_count);
+        break;
+
+    case QDR_LINK_Q3_STALL_COUNT:
+        qd_compose_insert_ulong(body, link->q3_stall_count);
+        break;
+
+    case QDR_LINK_SEND_LATENCY_HISTOGRAM:
+        qdr_agent_write_latency_CT(body, link->latency, QDR_LATENCY_SEND_HISTOGRAM);
+        break;
+
+    case QDR_LINK_SETTLE_LATENCY_HISTOGRAM:
+        qdr_agent_write_latency_CT(body, link->latency, QDR_LATENCY_SETTLE_HISTOGRAM);
+        break;
+
+    case QDR_LINK_SETTLE_LATENCY_AVG:
+        qdr_agent_write_latency_CT(body, link->latency, QDR_LATENCY_SETTLE_AVG);
+        break;
+
+    case QDR_LINK_SETTLE_LATENCY_MAX:
+        qdr_agent_write_latency_CT(body, link->latency, QDR_LATENCY_SETTLE_MAX);
+        break;
+
+    case QDR_LINK_STAGE_LATENCY:
+        qdr_agent_write_latency_CT(body, link->latency, QDR_LATENCY_STAGES_SUMMARY);
+        break;
+
     default:
         qd_compose_insert_null(body);
         break;
@@ -279,15 +322,36 @@ static void qdr_agent_write_link_CT(qdr_core_t *core, qdr_query_t *query,  qdr_l
     qd_compose_end_list(body);
 }
 
-static void qdr_manage_advance_link_CT(qdr_query_t *query, qdr_link_t *link)
+static void qdr_agent_link_column_CT(qdr_core_t *core, qd_composed_field_t *body, int col, void *link)
+{
+    qdr_agent_write_column_CT(core, body, col, (qdr_link_t*) link);
+}
+
+
+// The first link from link on that matches the query's filter
+static qdr_link_t *qdr_manage_match_link_CT(qdr_core_t *core, qdr_query_t *query, qdr_link_t *link)
+{
+    while (link && !qdr_agent_filter_match_CT(core, query, qdr_agent_link_column_CT, link))
+        link = DEQ_NEXT(link);
+    return link;
+}
+
+
+static qdr_link_t *qdr_manage_seek_link_CT(qdr_core_t *core, qdr_query_t *query, int offset)
+{
+    qdr_link_t *link = qdr_manage_match_link_CT(core, query, DEQ_HEAD(core->open_links));
+    for (int i = 0; i < offset && link; i++)
+        link = qdr_manage_match_link_CT(core, query, DEQ_NEXT(link));
+    return link;
+}
+
+
+static void qdr_manage_advance_link_CT(qdr_core_t *core, qdr_query_t *query, qdr_link_t *link)
 {
     query->next_offset++;
-    link = DEQ_NEXT(link);
-    if (link) {
-        query->more     = true;
-        //query->next_key = qdr_field((const char*) qd_hash_key_by_handle(link->owning_addr->hash_handle));
-    } else
-        query->more = false;
+    link = qdr_manage_match_link_CT(core, query, DEQ_NEXT(link));
+    query->more = !!link;
+    qdr_agent_set_cursor_CT(core, query, link);
 }
 
 
@@ -298,33 +362,32 @@ void qdra_link_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
     //
     query->status = QD_AMQP_OK;
 
+    //
+    // Pick up where the previous page left off, or run to the link at the offset.
+    //
+    qdr_link_t *link = (qdr_link_t*) qdr_agent_cursor_resume_CT(core, query, offset);
+    if (!link && offset < DEQ_SIZE(core->open_links))
+        link = qdr_manage_seek_link_CT(core, query, offset);
+
     //
     // If the offset goes beyond the set of links, end the query now.
     //
-    if (offset >= DEQ_SIZE(core->open_links)) {
+    if (!link) {
         query->more = false;
         qdr_agent_enqueue_response_CT(core, query);
         return;
     }
 
-    //
-    // Run to the address at the offset.
-    //
-    qdr_link_t *link = DEQ_HEAD(core->open_links);
-    for (int i = 0; i < offset && link; i++)
-        link = DEQ_NEXT(link);
-    assert(link);
-
     //
     // Write the columns of the link into the response body.
     //
     qdr_agent_write_link_CT(core, query, link);
 
     //
-    // Advance to the next address
+    // Advance to the next link
     //
     query->next_offset = offset;
-    qdr_manage_advance_link_CT(query, link);
+    qdr_manage_advance_link_CT(core, query, link);
 
     //
     // Enqueue the response.
@@ -335,13 +398,14 @@ void qdra_link_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
 
 void qdra_link_get_next_CT(qdr_core_t *core, qdr_query_t *query)
 {
-    qdr_link_t *link = 0;
-
-        if (query->next_offset < DEQ_SIZE(core->open_links)) {
-            link = DEQ_HEAD(core->open_links);
-            for (int i = 0; i < query->next_offset && link; i++)
-                link = DEQ_NEXT(link);
-        }
+    //
+    // The cursor is the next link unless it was lost, then seek the saved offset.
+    //
+    qdr_link_t *link = (qdr_link_t*) qdr_agent_cursor_CT(core, query);
+    if (link)
+        link = qdr_manage_match_link_CT(core, query, link);
+    else if (query->next_offset < DEQ_SIZE(core->open_links))
+        link = qdr_manage_seek_link_CT(core, query, query->next_offset);
 
     if (link) {
         //
@@ -352,7 +416,7 @@ void qdra_link_get_next_CT(qdr_core_t *core, qdr_query_t *query)
         //
         // Advance to the next link
         //
-        qdr_manage_advance_link_CT(query, link);
+        qdr_manage_advance_link_CT(core, query, link);
     } else
         query->more = false;
 
@@ -50,6 +50,18 @@
 #define QDR_ROUTER_DELIVERIES_TRANSIT                  23
 #define QDR_ROUTER_DELIVERIES_INGRESS_ROUTE_CONTAINER  24
 #define QDR_ROUTER_DELIVERIES_EGRESS_ROUTE_CONTAINER   25
+#define QDR_ROUTER_CORE_PARK_COUNT                     26
+#define QDR_ROUTER_DROPPED_DUPLICATE_MULTICASTS        27
+#define QDR_ROUTER_DROPPED_PRESETTLED_ALL              28
+#define QDR_ROUTER_DROPPED_PRESETTLED_OLDEST           29
+#define QDR_ROUTER_DROPPED_PRESETTLED_NEWEST           30
+#define QDR_ROUTER_DROPPED_PRESETTLED_SAMPLED          31
+#define QDR_ROUTER_DROPPED_PRESETTLED_CONFLATED        32
+#define QDR_ROUTER_AUTO_LINKS_PENDING                  33
+#define QDR_ROUTER_DROPPED_EXPIRED_DELIVERIES          34
+#define QDR_ROUTER_OVERLOAD_LEVEL                      35
+#define QDR_ROUTER_CREDIT_WITHHELD                     36
+#define QDR_ROUTER_STAGE_LATENCY                       37
 
 
 const char *qdr_router_columns[] =
@@ -79,8 +91,26 @@ const char *qdr_router_columns[] =
      "deliveriesTransit",
      "deliveriesIngressRouteContainer",
      "deliveriesEgressRouteContainer",
+     "coreParkCount",
+     "droppedDuplicateMulticasts",
+     "droppedPresettledAll",
+     "droppedPresettledOldest",
+     "droppedPresettledNewest",
+     "droppedPresettledSampled",
+     "droppedPresettledConflated",
+     "autoLinksPending",
+     "droppedExpiredDeliveries",
+     "overloadLevel",
+     "creditWithheld",
+     "stageLatencyMicros",
      0};
 
+const char *qdr_latency_stage_names[QDR_LATENCY_STAGES] =
+    {"ingress",
+     "core",
+     "egress",
+     "downstream"};
+
 
 static const char *qd_router_mode_names[] = {
     "standalone",
@@ -95,7 +125,7 @@ static const char *router_mode(qd_router_mode_t router_mode)
 
 }
 
-static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_core_t *core)
+static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_core_t *core, const qdr_delivery_counters_t *settled)
 {
 
     switch(col) {
@@ -146,6 +176,10 @@ static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_co
         qd_compose_insert_ulong(body, DEQ_SIZE(core->auto_links));
         break;
 
+    case QDR_ROUTER_AUTO_LINKS_PENDING:
+        qd_compose_insert_ulong(body, core->auto_links_pending);
+        break;
+
     case QDR_ROUTER_ID:
     case QDR_ROUTER_NAME:
         if (core->router_id)
@@ -155,7 +189,7 @@ static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_co
         break;
 
     case QDR_ROUTER_PRESETTLED_DELIVERIES:
-        qd_compose_insert_ulong(body, core->presettled_deliveries);
+        qd_compose_insert_ulong(body, settled->presettled);
         break;
 
     case QDR_ROUTER_DROPPED_PRESETTLED_DELIVERIES:
@@ -163,39 +197,39 @@ static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_co
         break;
 
     case QDR_ROUTER_ACCEPTED_DELIVERIES:
-        qd_compose_insert_ulong(body, core->accepted_deliveries);
+        qd_compose_insert_ulong(body, settled->accepted);
         break;
 
     case QDR_ROUTER_REJECTED_DELIVERIES:
-        qd_compose_insert_ulong(body, core->rejected_deliveries);
+        qd_compose_insert_ulong(body, settled->rejected);
         break;
 
     case QDR_ROUTER_RELEASED_DELIVERIES:
-        qd_compose_insert_ulong(body, core->released_deliveries);
+        qd_compose_insert_ulong(body, settled->released);
         break;
 
     case QDR_ROUTER_MODIFIED_DELIVERIES:
-        qd_compose_insert_ulong(body, core->modified_deliveries);
+        qd_compose_insert_ulong(body, settled->modified);
         break;
 
     case QDR_ROUTER_DELAYED_1SEC:
-        qd_compose_insert_ulong(body, core->deliveries_delayed_1sec);
+        qd_compose_insert_ulong(body, settled->delayed_1sec);
         break;
 
     case QDR_ROUTER_DELAYED_10SEC:
-        qd_compose_insert_ulong(body, core->deliveries_delayed_10sec);
+        qd_compose_insert_ulong(body, settled->delayed_10sec);
         break;
 
     case QDR_ROUTER_DELIVERIES_INGRESS:
-        qd_compose_insert_ulong(body, core->deliveries_ingress);
+        qd_compose_insert_ulong(body, core->deliveries_ingress + __atomic_load_n(&core->deliveries_direct_ingress, __ATOMIC_RELAXED));
         break;
 
     case QDR_ROUTER_DELIVERIES_EGRESS:
-        qd_compose_insert_ulong(body, core->deliveries_egress);
+        qd_compose_insert_ulong(body, core->deliveries_egress + __atomic_load_n(&core->deliveries_direct_egress, __ATOMIC_RELAXED));
         break;
 
     case QDR_ROUTER_DELIVERIES_TRANSIT:
-        qd_compose_insert_ulong(body, core->deliveries_transit);
+        qd_compose_insert_ulong(body, core->deliveries_transit + __atomic_load_n(&core->deliveries_direct_transit, __ATOMIC_RELAXED));
         break;
 
     case QDR_ROUTER_DELIVERIES_INGRESS_ROUTE_CONTAINER:
@@ -206,6 +240,39 @@ static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_co
         qd_compose_insert_ulong(body, core->deliveries_egress_route_container);
         break;
 
+    case QDR_ROUTER_CORE_PARK_COUNT:
+        qd_compose_insert_ulong(body, core->action_park_count);
+        break;
+
+    case QDR_ROUTER_DROPPED_DUPLICATE_MULTICASTS:
+        qd_compose_insert_ulong(body, core->dropped_duplicate_multicasts);
+        break;
+
+    case QDR_ROUTER_DROPPED_EXPIRED_DELIVERIES:
+        qd_compose_insert_ulong(body, settled->dropped_expired);
+        break;
+
+    case QDR_ROUTER_OVERLOAD_LEVEL:
+        qd_compose_insert_uint(body, core->overload_level);
+        break;
+
+    case QDR_ROUTER_CREDIT_WITHHELD:
+        qd_compose_insert_ulong(body, core->credit_withheld);
+        break;
+
+    case QDR_ROUTER_STAGE_LATENCY:
+        qdr_agent_write_latency_CT(body, core->delivery_latency.count ? &core->delivery_latency : 0,
+                                   QDR_LATENCY_STAGES_SUMMARY);
+        break;
+
+    case QDR_ROUTER_DROPPED_PRESETTLED_ALL:
+    case QDR_ROUTER_DROPPED_PRESETTLED_OLDEST:
+    case QDR_ROUTER_DROPPED_PRESETTLED_NEWEST:
+    case QDR_ROUTER_DROPPED_PRESETTLED_SAMPLED:
+    case QDR_ROUTER_DROPPED_PRESETTLED_CONFLATED:
+        qd_compose_insert_ulong(body, core->presettled_dropped[col - QDR_ROUTER_DROPPED_PRESETTLED_ALL]);
+        break;
+
     default:
         qd_compose_insert_null(body);
         break;
@@ -216,12 +283,14 @@ static void qdr_agent_write_column_CT(qd_composed_field_t *body, int col, qdr_co
 
 static void qdr_agent_write_router_CT(qdr_query_t *query,  qdr_core_t *core)
 {
-    qd_composed_field_t *body = query->body;
+    qd_composed_field_t     *body = query->body;
+    qdr_delivery_counters_t  settled;
 
+    qdr_delivery_counters_total_CT(core, &settled);
     qd_compose_start_list(body);
     int i = 0;
     while (query->columns[i] >= 0) {
-        qdr_agent_write_column_CT(body, query->columns[i], core);
+        qdr_agent_write_column_CT(body, query->columns[i], core, &settled);
         i++;
     }
     qd_compose_end_list(body);
@@ -256,3 +325,326 @@ void qdra_router_get_next_CT(qdr_core_t *core, qdr_query_t *query)
 {
 
 }
+
+
+#define QDR_CORE_ACTION_NAME                    0
+#define QDR_CORE_ACTION_IDENTITY                1
+#define QDR_CORE_ACTION_TYPE                    2
+#define QDR_CORE_ACTION_COUNT                   3
+#define QDR_CORE_ACTION_QUEUE_DELAY_TOTAL       4
+#define QDR_CORE_ACTION_QUEUE_DELAY_MAX         5
+#define QDR_CORE_ACTION_QUEUE_DELAY_HISTOGRAM   6
+#define QDR_CORE_ACTION_SERVICE_TIME_TOTAL      7
+#define QDR_CORE_ACTION_SERVICE_TIME_MAX        8
+#define QDR_CORE_ACTION_SERVICE_TIME_HISTOGRAM  9
+
+
+const char *qdr_core_action_columns[] =
+    {"name",
+     "identity",
+     "type",
+     "actionCount",
+     "queueDelayTotal",
+     "queueDelayMax",
+     "queueDelayHistogram",
+     "serviceTimeTotal",
+     "serviceTimeMax",
+     "serviceTimeHistogram",
+     0};
+
+
+// Upper bound in microseconds of the bucket holding the given percentile of the histogram
+static uint64_t qdr_summary_percentile(const uint64_t *histogram, uint64_t percent)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < QDR_ACTION_HIST_BUCKETS; i++)
+        total += histogram[i];
+    if (total == 0)
+        return 0;
+
+    uint64_t cumulative = 0;
+    for (int i = 0; i < QDR_ACTION_HIST_BUCKETS; i++) {
+        cumulative += histogram[i];
+        if (cumulative * 100 >= total * percent)
+            return qdr_action_hist_upper(i);
+    }
+    return qdr_action_hist_upper(QDR_ACTION_HIST_BUCKETS - 1);
+}
+
+
+static void qdr_agent_write_histogram_CT(qd_composed_field_t *body, const uint64_t *histogram)
+{
+    qd_compose_start_list(body);
+    for (int i = 0; i < QDR_ACTION_HIST_BUCKETS; i++)
+        qd_compose_insert_ulong(body, histogram[i]);
+    qd_compose_end_list(body);
+}
+
+
+void qdr_agent_write_latency_CT(qd_composed_field_t *body, const qdr_latency_stats_t *stats, qdr_latency_column_t col)
+{
+    switch (col) {
+    case QDR_LATENCY_SEND_HISTOGRAM:
+    case QDR_LATENCY_SETTLE_HISTOGRAM:
+        if (stats)
+            qdr_agent_write_histogram_CT(body, col == QDR_LATENCY_SEND_HISTOGRAM ? stats->send_histogram : stats->settle_histogram);
+        else
+            qd_compose_insert_null(body);
+        break;
+
+    case QDR_LATENCY_SETTLE_AVG:
+        qd_compose_insert_ulong(body, stats && stats->count ? stats->settle_usec_total / stats->count : 0);
+        break;
+
+    case QDR_LATENCY_SETTLE_MAX:
+        qd_compose_insert_ulong(body, stats ? stats->settle_usec_max : 0);
+        break;
+
+    case QDR_LATENCY_STAGES_SUMMARY:
+        if (!stats) {
+            qd_compose_insert_null(body);
+            break;
+        }
+        qd_compose_start_map(body);
+        qd_compose_insert_string(body, "count");
+        qd_compose_insert_ulong(body, stats->count);
+        for (int i = 0; i < QDR_LATENCY_STAGES; i++) {
+            qd_compose_insert_string(body, qdr_latency_stage_names[i]);
+            qd_compose_start_list(body);
+            qd_compose_insert_ulong(body, stats->count ? stats->stage_usec_total[i] / stats->count : 0);
+            qd_compose_insert_ulong(body, qdr_summary_percentile(stats->stage_histogram[i], 50));
+            qd_compose_insert_ulong(body, qdr_summary_percentile(stats->stage_histogram[i], 99));
+            qd_compose_insert_ulong(body, stats->stage_usec_max[i]);
+            qd_compose_end_list(body);
+        }
+        qd_compose_end_map(body);
+        break;
+    }
+}
+
+
+static void qdr_agent_write_core_action_column_CT(qd_composed_field_t *body, int col, qdr_action_stats_t *stats)
+{
+    switch(col) {
+    case QDR_CORE_ACTION_NAME:
+    case QDR_CORE_ACTION_IDENTITY:
+        qd_compose_insert_string(body, stats->label);
+        break;
+
+    case QDR_CORE_ACTION_TYPE:
+        qd_compose_insert_string(body, "org.apache.qpid.dispatch.router.coreAction");
+        break;
+
+    case QDR_CORE_ACTION_COUNT:
+        qd_compose_insert_ulong(body, stats->count);
+        break;
+
+    case QDR_CORE_ACTION_QUEUE_DELAY_TOTAL:
+        qd_compose_insert_ulong(body, stats->queue_usec_total);
+        break;
+
+    case QDR_CORE_ACTION_QUEUE_DELAY_MAX:
+        qd_compose_insert_ulong(body, stats->queue_usec_max);
+        break;
+
+    case QDR_CORE_ACTION_QUEUE_DELAY_HISTOGRAM:
+        qdr_agent_write_histogram_CT(body, stats->queue_histogram);
+        break;
+
+    case QDR_CORE_ACTION_SERVICE_TIME_TOTAL:
+        qd_compose_insert_ulong(body, stats->service_usec_total);
+        break;
+
+    case QDR_CORE_ACTION_SERVICE_TIME_MAX:
+        qd_compose_insert_ulong(body, stats->service_usec_max);
+        break;
+
+    case QDR_CORE_ACTION_SERVICE_TIME_HISTOGRAM:
+        qdr_agent_write_histogram_CT(body, stats->service_histogram);
+        break;
+
+    default:
+        qd_compose_insert_null(body);
+        break;
+    }
+}
+
+
+static void qdr_agent_write_core_action_CT(qdr_query_t *query, qdr_action_stats_t *stats)
+{
+    qd_composed_field_t *body = query->body;
+
+    qd_compose_start_list(body);
+    int i = 0;
+    while (query->columns[i] >= 0) {
+        qdr_agent_write_core_action_column_CT(body, query->columns[i], stats);
+        i++;
+    }
+    qd_compose_end_list(body);
+}
+
+
+static void qdr_manage_advance_core_action_CT(qdr_query_t *query, qdr_action_stats_t *stats)
+{
+    query->next_offset++;
+    query->more = DEQ_NEXT(stats) != 0;
+}
+
+
+void qdra_core_action_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset)
+{
+    //
+    // Queries that get this far will always succeed.
+    //
+    query->status = QD_AMQP_OK;
+
+    //
+    // If the offset goes beyond the set of action statistics, end the query now.
+    //
+    if (offset >= DEQ_SIZE(core->action_stats)) {
+        query->more = false;
+        qdr_agent_enqueue_response_CT(core, query);
+        return;
+    }
+
+    qdr_action_stats_t *stats = DEQ_HEAD(core->action_stats);
+    for (int i = 0; i < offset && stats; i++)
+        stats = DEQ_NEXT(stats);
+    assert(stats);
+
+    qdr_agent_write_core_action_CT(query, stats);
+
+    query->next_offset = offset;
+    qdr_manage_advance_core_action_CT(query, stats);
+
+    qdr_agent_enqueue_response_CT(core, query);
+}
+
+
+void qdra_core_action_get_next_CT(qdr_core_t *core, qdr_query_t *query)
+{
+    qdr_action_stats_t *stats = 0;
+
+    if (query->next_offset < DEQ_SIZE(core->action_stats)) {
+        stats = DEQ_HEAD(core->action_stats);
+        for (int i = 0; i < query->next_offset && stats; i++)
+            stats = DEQ_NEXT(stats);
+    }
+
+    if (stats) {
+        qdr_agent_write_core_action_CT(query, stats);
+        qdr_manage_advance_core_action_CT(query, stats);
+    } else
+        query->more = false;
+
+    qdr_agent_enqueue_response_CT(core, query);
+}
+
+
+const char *qdr_summary_counters[QDR_SUMMARY_COUNTER_COUNT] =
+    {"connectionCount",
+     "linkCount",
+     "addrCount",
+     "deliveriesIngress",
+     "deliveriesEgress",
+     "presettledDeliveries",
+     "acceptedDeliveries",
+     "rejectedDeliveries",
+     "releasedDeliveries",
+     "modifiedDeliveries"};
+
+
+void qdra_router_summary_CT(qdr_core_t *core, qdr_router_summary_t *summary)
+{
+    qdr_delivery_counters_t settled;
+    qdr_delivery_counters_total_CT(core, &settled);
+
+    ZERO(summary);
+    uint64_t ingress = core->deliveries_ingress + __atomic_load_n(&core->deliveries_direct_ingress, __ATOMIC_RELAXED);
+    uint64_t egress  = core->deliveries_egress + __atomic_load_n(&core->deliveries_direct_egress, __ATOMIC_RELAXED);
+
+    summary->counters[0] = DEQ_SIZE(core->open_connections);
+    summary->counters[1] = DEQ_SIZE(core->open_links);
+    summary->counters[2] = DEQ_SIZE(core->addrs);
+    summary->counters[3] = ingress;
+    summary->counters[4] = egress;
+    summary->counters[5] = settled.presettled;
+    summary->counters[6] = settled.accepted;
+    summary->counters[7] = settled.rejected;
+    summary->counters[8] = settled.released;
+    summary->counters[9] = settled.modified;
+    memcpy(summary->settle_histogram, core->delivery_latency.settle_histogram, sizeof(summary->settle_histogram));
+
+    //
+    // The first summary's rates cover the uptime
+    //
+    int64_t now     = qd_timer_now_usec();
+    int64_t elapsed = core->summary_usec ? now - core->summary_usec : (int64_t) core->uptime_ticks * 1000000;
+    if (elapsed > 0) {
+        summary->ingress_rate = (ingress - core->summary_ingress) * 1000000 / (uint64_t) elapsed;
+        summary->egress_rate  = (egress - core->summary_egress) * 1000000 / (uint64_t) elapsed;
+    }
+    core->summary_usec    = now;
+    core->summary_ingress = ingress;
+    core->summary_egress  = egress;
+}
+
+
+void qdra_router_summary_write(qd_composed_field_t *body, const qdr_router_summary_t *summary)
+{
+    for (int i = 0; i < QDR_SUMMARY_COUNTER_COUNT; i++) {
+        qd_compose_insert_string(body, qdr_summary_counters[i]);
+        qd_compose_insert_ulong(body, summary->counters[i]);
+    }
+    qd_compose_insert_string(body, "ingressRate");
+    qd_compose_insert_ulong(body, summary->ingress_rate);
+    qd_compose_insert_string(body, "egressRate");
+    qd_compose_insert_ulong(body, summary->egress_rate);
+    qd_compose_insert_string(body, "settleLatencyP50");
+    qd_compose_insert_ulong(body, qdr_summary_percentile(summary->settle_histogram, 50));
+    qd_compose_insert_string(body, "settleLatencyP90");
+    qd_compose_insert_ulong(body, qdr_summary_percentile(summary->settle_histogram, 90));
+    qd_compose_insert_string(body, "settleLatencyP99");
+    qd_compose_insert_ulong(body, qdr_summary_percentile(summary->settle_histogram, 99));
+    qd_compose_insert_string(body, "settleHistogram");
+    qd_compose_start_list(body);
+    for (int i = 0; i < QDR_ACTION_HIST_BUCKETS; i++) {
+        if (summary->settle_histogram[i]) {
+            qd_compose_insert_uint(body, i);
+            qd_compose_insert_ulong(body, summary->settle_histogram[i]);
+        }
+    }
+    qd_compose_end_list(body);
+}
+
+
+bool qdra_router_summary_merge(qdr_router_summary_t *summary, qd_parsed_field_t *map)
+{
+    if (!map || !qd_parse_is_map(map))
+        return false;
+
+    qd_parsed_field_t *histogram = qd_parse_value_by_key(map, "settleHistogram");
+    if (histogram && !qd_parse_is_list(histogram))
+        return false;
+
+    for (int i = 0; i < QDR_SUMMARY_COUNTER_COUNT; i++) {
+        qd_parsed_field_t *value = qd_parse_value_by_key(map, qdr_summary_counters[i]);
+        if (value)
+            summary->counters[i] += qd_parse_as_ulong(value);
+    }
+
+    qd_parsed_field_t *value = qd_parse_value_by_key(map, "ingressRate");
+    if (value)
+        summary->ingress_rate += qd_parse_as_ulong(value);
+    value = qd_parse_value_by_key(map, "egressRate");
+    if (value)
+        summary->egress_rate += qd_parse_as_ulong(value);
+
+    uint32_t count = histogram ? qd_parse_sub_count(histogram) : 0;
+    for (uint32_t i = 0; i + 1 < count; i += 2) {
+        uint32_t bucket = qd_parse_as_uint(qd_parse_sub_value(histogram, i));
+        if (bucket < QDR_ACTION_HIST_BUCKETS)
+            summary->settle_histogram[bucket] += qd_parse_as_ulong(qd_parse_sub_value(histogram, i + 1));
+    }
+    return true;
+}
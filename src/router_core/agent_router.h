@@ -21,12 +21,75 @@
 
 #include "router_core_private.h"
 
-#define QDR_ROUTER_COLUMN_COUNT  26
+#define QDR_ROUTER_COLUMN_COUNT  38
 
 const char *qdr_router_columns[QDR_ROUTER_COLUMN_COUNT + 1];
 
+#define QDR_CORE_ACTION_COLUMN_COUNT  10
+
+const char *qdr_core_action_columns[QDR_CORE_ACTION_COLUMN_COUNT + 1];
+
 void qdra_router_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset);
 void qdra_router_get_next_CT(qdr_core_t *core, qdr_query_t *query);
 void qdra_router_get_next_CT(qdr_core_t *core, qdr_query_t *query);
 
+/**
+ * The delivery latency columns shared by router.link and router.address.
+ */
+typedef enum {
+    QDR_LATENCY_SEND_HISTOGRAM,
+    QDR_LATENCY_SETTLE_HISTOGRAM,
+    QDR_LATENCY_SETTLE_AVG,
+    QDR_LATENCY_SETTLE_MAX,
+    QDR_LATENCY_STAGES_SUMMARY  ///< Map of the count and, per stage, [avg, p50, p99, max]
+} qdr_latency_column_t;
+
+/// Keys of the stages in the stage latency summary, in qdr_latency_stage_t order
+extern const char *qdr_latency_stage_names[QDR_LATENCY_STAGES];
+
+/**
+ * Write a delivery latency column.  Stats may be null when no delivery has
+ * been measured yet.
+ */
+void qdr_agent_write_latency_CT(qd_composed_field_t *body, const qdr_latency_stats_t *stats, qdr_latency_column_t col);
+
+void qdra_core_action_get_first_CT(qdr_core_t *core, qdr_query_t *query, int offset);
+void qdra_core_action_get_next_CT(qdr_core_t *core, qdr_query_t *query);
+
+//
+// A compact summary of the router's traffic, the body of a GET-SUMMARY
+// response.  An interior merges the summaries of its edges into one for
+// GET-EDGE-SUMMARY: the counters and rates add up, and the latency
+// percentiles are taken from the sum of the settlement histograms.
+//
+#define QDR_SUMMARY_COUNTER_COUNT  10
+
+extern const char *qdr_summary_counters[QDR_SUMMARY_COUNTER_COUNT];
+
+typedef struct qdr_router_summary_t {
+    uint64_t counters[QDR_SUMMARY_COUNTER_COUNT];     ///< In the order of qdr_summary_counters
+    uint64_t ingress_rate;                            ///< Deliveries per second since the previous summary
+    uint64_t egress_rate;
+    uint64_t settle_histogram[QDR_ACTION_HIST_BUCKETS];
+} qdr_router_summary_t;
+
+/**
+ * Take the summary of this router.  The rates cover the time since the
+ * previous summary was taken, or since startup.
+ */
+void qdra_router_summary_CT(qdr_core_t *core, qdr_router_summary_t *summary);
+
+/**
+ * Write the keys and values of a summary into an open map.  The histogram is
+ * written as a flat list of bucket and count pairs for the non-empty buckets
+ * only.
+ */
+void qdra_router_summary_write(qd_composed_field_t *body, const qdr_router_summary_t *summary);
+
+/**
+ * Add a summary map, as written by qdra_router_summary_write, into summary.
+ * Returns false, leaving summary unchanged, if the map is not a summary.
+ */
+bool qdra_router_summary_merge(qdr_router_summary_t *summary, qd_parsed_field_t *map);
+
 #endif
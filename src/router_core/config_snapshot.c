@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "router_core_private.h"
+#include "iterator_private.h"
+#include <qpid/dispatch/atomic.h>
+
+//
+// The core's address and link-route pattern trees change on the core thread
+// and their lookups update the trees' match caches, so only the core thread
+// may use them.  A snapshot is an immutable copy of the patterns, built by the
+// core after a pass that changed them, that any thread may search.  Each
+// snapshot is reference counted: a reader holds the one it took for as long as
+// it likes while the core publishes newer ones, and the last reference frees it.
+//
+struct qdr_config_snapshot_t {
+    sys_atomic_t               ref_count;
+    qd_parse_tree_t           *addr_tree;           ///< pattern --> qdr_address_config_info_t
+    qd_parse_tree_t           *link_route_tree[2];  ///< pattern --> &link_routed, QD_INCOMING and QD_OUTGOING
+    qdr_address_config_info_t *infos;
+    int                        info_count;
+};
+
+// The payload of every link-route pattern, which only needs to be non-null
+static char link_routed;
+
+
+static bool count_pattern(void *handle, const char *pattern, void *payload)
+{
+    (*(int*) handle)++;
+    return true;
+}
+
+
+static bool copy_address_config(void *handle, const char *pattern, void *payload)
+{
+    qdr_config_snapshot_t     *snap = (qdr_config_snapshot_t*) handle;
+    qdr_address_config_t      *addr = (qdr_address_config_t*) payload;
+    qdr_address_config_info_t *info = &snap->infos[snap->info_count++];
+
+    info->treatment = addr->treatment;
+    info->in_phase  = addr->in_phase;
+    info->out_phase = addr->out_phase;
+    info->priority  = addr->priority;
+    qd_parse_tree_add_pattern_str(snap->addr_tree, pattern, info);
+    return true;
+}
+
+
+static bool copy_link_route(void *handle, const char *pattern, void *payload)
+{
+    qd_parse_tree_add_pattern_str((qd_parse_tree_t*) handle, pattern, &link_routed);
+    return true;
+}
+
+
+static qdr_config_snapshot_t *qdr_config_snapshot_build(qdr_core_t *core)
+{
+    qdr_config_snapshot_t *snap = NEW(qdr_config_snapshot_t);
+    ZERO(snap);
+    sys_atomic_init(&snap->ref_count, 1);
+
+    // Without a match cache a tree is only read by its lookups
+    snap->addr_tree                    = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+    snap->link_route_tree[QD_INCOMING] = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+    snap->link_route_tree[QD_OUTGOING] = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+
+    if (core->addr_parse_tree) {
+        int count = 0;
+        qd_parse_tree_walk(core->addr_parse_tree, count_pattern, &count);
+        snap->infos = NEW_ARRAY(qdr_address_config_info_t, count);
+        qd_parse_tree_walk(core->addr_parse_tree, copy_address_config, snap);
+    }
+
+    for (int dir = QD_INCOMING; dir <= QD_OUTGOING; dir++)
+        if (core->link_route_tree[dir])
+            qd_parse_tree_walk(core->link_route_tree[dir], copy_link_route, snap->link_route_tree[dir]);
+
+    return snap;
+}
+
+
+void qdr_config_snapshot_setup(qdr_core_t *core)
+{
+    core->config_snapshot_lock = sys_mutex();
+    core->config_snapshot      = qdr_config_snapshot_build(core);
+}
+
+
+void qdr_config_snapshot_cleanup(qdr_core_t *core)
+{
+    qdr_config_snapshot_decref(core->config_snapshot);
+    core->config_snapshot = 0;
+    sys_mutex_free(core->config_snapshot_lock);
+}
+
+
+void qdr_config_snapshot_changed_CT(qdr_core_t *core)
+{
+    core->config_snapshot_stale = true;
+}
+
+
+void qdr_config_snapshot_publish_CT(qdr_core_t *core)
+{
+    if (!core->config_snapshot_stale)
+        return;
+    core->config_snapshot_stale = false;
+
+    //
+    // Build the new snapshot before taking the lock, which is held only to
+    // swap the pointer, so that lookups never wait for a rebuild.
+    //
+    qdr_config_snapshot_t *snap = qdr_config_snapshot_build(core);
+
+    sys_mutex_lock(core->config_snapshot_lock);
+    qdr_config_snapshot_t *old = core->config_snapshot;
+    core->config_snapshot = snap;
+    sys_mutex_unlock(core->config_snapshot_lock);
+
+    qdr_config_snapshot_decref(old);
+}
+
+
+qdr_config_snapshot_t *qdr_config_snapshot(qdr_core_t *core)
+{
+    sys_mutex_lock(core->config_snapshot_lock);
+    qdr_config_snapshot_t *snap = core->config_snapshot;
+    sys_atomic_inc(&snap->ref_count);
+    sys_mutex_unlock(core->config_snapshot_lock);
+    return snap;
+}
+
+
+void qdr_config_snapshot_decref(qdr_config_snapshot_t *snap)
+{
+    if (!snap || sys_atomic_dec(&snap->ref_count) != 1)
+        return;
+
+    qd_parse_tree_free(snap->addr_tree);
+    qd_parse_tree_free(snap->link_route_tree[QD_INCOMING]);
+    qd_parse_tree_free(snap->link_route_tree[QD_OUTGOING]);
+    free(snap->infos);
+    sys_atomic_destroy(&snap->ref_count);
+    free(snap);
+}
+
+
+/**
+ * Search a tree for an address in the view the core's trees are keyed with,
+ * leaving the caller's iterator as it was.
+ */
+static void *qdr_config_snapshot_match(qd_parse_tree_t *tree, qd_iterator_t *address, const char *space, int space_len)
+{
+    qd_iterator_t iter;
+    void         *payload = 0;
+
+    qd_iterator_init_dup(&iter, address);
+    qd_iterator_reset_view(&iter, ITER_VIEW_ADDRESS_WITH_SPACE);
+    if (space)
+        qd_iterator_annotate_space(&iter, space, space_len);
+    qd_parse_tree_retrieve_match(tree, &iter, &payload);
+    qd_iterator_fini(&iter);
+    return payload;
+}
+
+
+bool qdr_config_snapshot_address(qdr_config_snapshot_t     *snap,
+                                 qd_iterator_t             *address,
+                                 const char                *space,
+                                 int                        space_len,
+                                 qdr_address_config_info_t *info)
+{
+    qdr_address_config_info_t *found = (qdr_address_config_info_t*)
+        qdr_config_snapshot_match(snap->addr_tree, address, space, space_len);
+    if (found && info)
+        *info = *found;
+    return !!found;
+}
+
+
+bool qdr_config_snapshot_link_routed(qdr_config_snapshot_t *snap,
+                                     qd_iterator_t         *address,
+                                     const char            *space,
+                                     int                    space_len,
+                                     qd_direction_t         dir)
+{
+    return !!qdr_config_snapshot_match(snap->link_route_tree[dir], address, space, space_len);
+}
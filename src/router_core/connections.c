@@ -30,6 +30,7 @@
 
 static void qdr_connection_opened_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_connection_closed_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_connection_teardown_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_link_inbound_first_attach_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_link_inbound_second_attach_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_link_inbound_detach_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
@@ -38,6 +39,7 @@ static void qdr_link_detach_sent(qdr_link_t *link);
 
 ALLOC_DEFINE(qdr_connection_t);
 ALLOC_DEFINE(qdr_connection_work_t);
+ALLOC_DEFINE(qdr_link_work_lists_t);
 
 //==================================================================================
 // Internal Functions
@@ -95,16 +97,21 @@ qdr_connection_t *qdr_connection_opened(qdr_core_t            *core,
     conn->policy_allow_dynamic_link_routes = policy_allow_dynamic_link_routes;
     conn->link_capacity         = link_capacity;
     conn->mask_bit              = -1;
+    conn->data_stripe           = -1;
     DEQ_INIT(conn->links);
-    DEQ_INIT(conn->work_list);
+    sys_atomic_ptr_init(&conn->work_stack, 0);
     conn->connection_info->role = conn->role;
     conn->work_lock = sys_mutex();
+    sys_atomic_init(&conn->wake_pending, 0);
 
     if (vhost) {
         conn->tenant_space_len = strlen(vhost) + 1;
-        conn->tenant_space = (char*) malloc(conn->tenant_space_len + 1);
-        strcpy(conn->tenant_space, vhost);
-        strcat(conn->tenant_space, "/");
+        char *tenant_space = (char*) malloc(conn->tenant_space_len + 1);
+        strcpy(tenant_space, vhost);
+        strcat(tenant_space, "/");
+        conn->tenant_space = qdr_intern(tenant_space);
+        conn->tenant_hash  = qd_iterator_space(conn->tenant_space, conn->tenant_space_len);
+        free(tenant_space);
     }
 
     if (context_binder) {
@@ -136,7 +143,13 @@ bool qdr_connection_route_container(qdr_connection_t *conn)
 void qdr_connection_set_context(qdr_connection_t *conn, void *context)
 {
     if (conn) {
+        //
+        // Receiving I/O threads wake this connection for streaming deliveries under the
+        // work lock, so the context must not change beneath them.
+        //
+        sys_mutex_lock(conn->work_lock);
         conn->user_context = context;
+        sys_mutex_unlock(conn->work_lock);
     }
 }
 
@@ -160,24 +173,24 @@ qdr_connection_info_t *qdr_connection_info(bool             is_encrypted,
     connection_info->is_authenticated      = is_authenticated;
     connection_info->opened                = opened;
 
-    if (container)
-        connection_info->container = strdup(container);
-    if (sasl_mechanisms)
-        connection_info->sasl_mechanisms = strdup(sasl_mechanisms);
+    //
+    // Connections from the same fleet of clients share their values of most of these,
+    // so only the host, which carries the peer's port, gets a copy of its own.
+    //
+    connection_info->container       = qdr_intern(container);
+    connection_info->sasl_mechanisms = qdr_intern(sasl_mechanisms);
     connection_info->dir = dir;
     if (host)
         connection_info->host = strdup(host);
-    if (ssl_proto)
-        connection_info->ssl_proto = strdup(ssl_proto);
-    if (ssl_cipher)
-        connection_info->ssl_cipher = strdup(ssl_cipher);
-    if (user)
-        connection_info->user = strdup(user);
-
-    pn_data_t *qdr_conn_properties = pn_data(0);
-    pn_data_copy(qdr_conn_properties, connection_properties);
-
-    connection_info->connection_properties = qdr_conn_properties;
+    connection_info->ssl_proto  = qdr_intern(ssl_proto);
+    connection_info->ssl_cipher = qdr_intern(ssl_cipher);
+    connection_info->user       = qdr_intern(user);
+
+    if (connection_properties && pn_data_size(connection_properties) > 0) {
+        pn_data_t *qdr_conn_properties = pn_data(0);
+        pn_data_copy(qdr_conn_properties, connection_properties);
+        connection_info->connection_properties = qdr_conn_properties;
+    }
     connection_info->ssl_ssf = ssl_ssf;
     connection_info->ssl     = ssl;
 
@@ -187,13 +200,14 @@ qdr_connection_info_t *qdr_connection_info(bool             is_encrypted,
 
 static void qdr_connection_info_free(qdr_connection_info_t *ci)
 {
-    free(ci->container);
-    free(ci->sasl_mechanisms);
+    qdr_intern_release(ci->container);
+    qdr_intern_release(ci->sasl_mechanisms);
     free(ci->host);
-    free(ci->ssl_proto);
-    free(ci->ssl_cipher);
-    free(ci->user);
-    pn_data_free(ci->connection_properties);
+    qdr_intern_release(ci->ssl_proto);
+    qdr_intern_release(ci->ssl_cipher);
+    qdr_intern_release(ci->user);
+    if (ci->connection_properties)
+        pn_data_free(ci->connection_properties);
     free_qdr_connection_info_t(ci);
 }
 
@@ -211,6 +225,196 @@ const char *qdr_connection_get_tenant_space(const qdr_connection_t *conn, int *l
 }
 
 
+/**
+ * Process the work collected for one link.  If budget is given, at most that many
+ * deliveries are pushed and the budget is reduced by the number sent.  *more is set
+ * if the budget ran out before the link's deliveries did.
+ */
+static int qdr_connection_process_link(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link, int *budget, bool *more)
+{
+    qdr_link_work_t *link_work;
+    bool             detach_sent = false;
+    int              event_count = 0;
+
+    //
+    // The work lock must be used to protect accesses to the link's work_list and
+    // link_work->processing.
+    //
+    sys_mutex_lock(conn->work_lock);
+    link_work = DEQ_HEAD(link->work_list);
+    if (link_work) {
+        DEQ_REMOVE_HEAD(link->work_list);
+        link_work->processing = true;
+    }
+    sys_mutex_unlock(conn->work_lock);
+
+    //
+    // Handle disposition/settlement updates
+    //
+    qdr_delivery_ref_list_t updated_deliveries;
+    sys_mutex_lock(conn->work_lock);
+    DEQ_MOVE(link->updated_deliveries, updated_deliveries);
+    sys_mutex_unlock(conn->work_lock);
+
+    qdr_delivery_ref_t *dref = DEQ_HEAD(updated_deliveries);
+    while (dref) {
+        core->delivery_update_handler(core->user_context, dref->dlv, dref->dlv->disposition, dref->dlv->settled);
+        qdr_delivery_decref(core, dref->dlv, "qdr_connection_process - remove from updated list");
+        qdr_del_delivery_ref(&updated_deliveries, dref);
+        dref = DEQ_HEAD(updated_deliveries);
+        event_count++;
+    }
+
+    while (link_work) {
+        switch (link_work->work_type) {
+        case QDR_LINK_WORK_DELIVERY :
+            {
+                int limit = link_work->value;
+                if (budget && *budget < limit)
+                    limit = *budget > 0 ? *budget : 0;
+                int count = limit > 0 ? core->push_handler(core->user_context, link, limit) : 0;
+                assert(count <= limit);
+                link_work->value -= count;
+                if (budget) {
+                    *budget -= count;
+                    if (count == limit && link_work->value > 0)
+                        *more = true;
+                }
+                conn->priority_deliveries[link->priority] += count;
+                break;
+            }
+
+        case QDR_LINK_WORK_FLOW :
+            if (link_work->value > 0)
+                core->flow_handler(core->user_context, link, link_work->value);
+            if      (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_SET)
+                core->drain_handler(core->user_context, link, true);
+            else if (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_CLEAR)
+                core->drain_handler(core->user_context, link, false);
+            else if (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_DRAINED)
+                core->drained_handler(core->user_context, link);
+            break;
+
+        case QDR_LINK_WORK_FIRST_DETACH :
+        case QDR_LINK_WORK_SECOND_DETACH :
+            core->detach_handler(core->user_context, link, link_work->error,
+                                 link_work->work_type == QDR_LINK_WORK_FIRST_DETACH,
+                                 link_work->close_link);
+            detach_sent = true;
+            break;
+        }
+
+        sys_mutex_lock(conn->work_lock);
+        if (link_work->work_type == QDR_LINK_WORK_DELIVERY && link_work->value > 0 && !link->detach_received) {
+            DEQ_INSERT_HEAD(link->work_list, link_work);
+            link_work->processing = false;
+            link_work = 0; // Halt work processing
+        } else {
+            qdr_error_free(link_work->error);
+            free_qdr_link_work_t(link_work);
+            link_work = DEQ_HEAD(link->work_list);
+            if (link_work) {
+                DEQ_REMOVE_HEAD(link->work_list);
+                link_work->processing = true;
+            }
+        }
+        sys_mutex_unlock(conn->work_lock);
+        event_count++;
+    }
+
+    if (detach_sent) {
+        // let the core thread know so it can clean up
+        qdr_link_detach_sent(link);
+    }
+
+    return event_count;
+}
+
+
+/**
+ * Put links whose work was cut short by the connection budget back on the connection's
+ * work lists, ahead of links the core queued in the meantime, and wake the connection
+ * so the remainder is handled after other connections have had their turn.
+ */
+static void qdr_connection_requeue_links(qdr_connection_t *conn, qdr_link_ref_list_t *links_with_work)
+{
+    bool requeued = false;
+
+    sys_mutex_lock(conn->work_lock);
+    for (int priority = 0; priority <= QDR_MAX_PRIORITY; ++ priority) {
+        if (DEQ_SIZE(links_with_work[priority]) == 0)
+            continue;
+
+        qdr_link_ref_list_t *conn_links = qdr_connection_work_links(conn, priority);
+        qdr_link_ref_list_t  queued;
+        DEQ_MOVE(*conn_links, queued);
+
+        qdr_link_ref_t *ref = DEQ_HEAD(links_with_work[priority]);
+        while (ref) {
+            qdr_link_t *link = ref->link;
+            DEQ_REMOVE_HEAD(links_with_work[priority]);
+            if (link->ref[QDR_LINK_LIST_CLASS_WORK]) {
+                // The core has already queued this link again
+                link->ref[QDR_LINK_LIST_CLASS_LOCAL] = 0;
+                free_qdr_link_ref_t(ref);
+            } else {
+                move_link_ref(link, QDR_LINK_LIST_CLASS_LOCAL, QDR_LINK_LIST_CLASS_WORK);
+                DEQ_INSERT_TAIL(*conn_links, ref);
+            }
+            requeued = true;
+            ref = DEQ_HEAD(links_with_work[priority]);
+        }
+
+        DEQ_APPEND(*conn_links, queued);
+    }
+    sys_mutex_unlock(conn->work_lock);
+
+    if (requeued) {
+        if (conn->user_context && sys_atomic_set(&conn->wake_pending, 1) == 0)
+            conn->core->activate_handler(conn->core->user_context, conn);
+    }
+}
+
+
+qdr_link_ref_list_t *qdr_connection_work_links(qdr_connection_t *conn, int priority)
+{
+    if (!conn->links_with_work) {
+        conn->links_with_work = new_qdr_link_work_lists_t();
+        ZERO(conn->links_with_work);
+    }
+    return &conn->links_with_work->lists[priority];
+}
+
+
+void qdr_connection_unqueue_link(qdr_connection_t *conn, qdr_link_t *link)
+{
+    //
+    // A link on a work list implies the lists exist
+    //
+    if (link->ref[QDR_LINK_LIST_CLASS_WORK])
+        qdr_del_link_ref(&conn->links_with_work->lists[link->priority], link, QDR_LINK_LIST_CLASS_WORK);
+}
+
+
+void qdr_connection_set_compression_stats(qdr_connection_t *conn, const uint64_t in[2], const uint64_t out[2])
+{
+    conn->compressed_in[0]  = in[0];
+    conn->compressed_in[1]  = in[1];
+    conn->compressed_out[0] = out[0];
+    conn->compressed_out[1] = out[1];
+}
+
+
+void qdr_connection_set_frame_stats(qdr_connection_t *conn, uint32_t max_frame_size, const uint64_t frames[2], const uint64_t octets[2])
+{
+    conn->max_frame_size  = max_frame_size;
+    conn->frames[0]       = frames[0];
+    conn->frames[1]       = frames[1];
+    conn->frame_octets[0] = octets[0];
+    conn->frame_octets[1] = octets[1];
+}
+
+
 int qdr_connection_process(qdr_connection_t *conn)
 {
     qdr_connection_work_list_t  work_list;
@@ -219,14 +423,41 @@ int qdr_connection_process(qdr_connection_t *conn)
 
     qdr_link_ref_t *ref;
     qdr_link_t     *link;
-    bool            detach_sent;
 
     int event_count = 0;
 
+    //
+    // Allow the core to wake this connection again.  This must happen before the
+    // work is collected so that work added from here on causes a new wakeup.
+    //
+    sys_atomic_set(&conn->wake_pending, 0);
+
     sys_mutex_lock(conn->work_lock);
-    DEQ_MOVE(conn->work_list, work_list);
+
+    //
+    // The connection work stack is pushed without the lock but is taken here, under
+    // the lock, so the snapshot is consistent with the link work collected below.
+    // Reverse it to restore the order in which the work was enqueued.
+    //
+    DEQ_INIT(work_list);
+    qdr_connection_work_t *item = (qdr_connection_work_t*) sys_atomic_ptr_swap(&conn->work_stack, 0);
+    while (item) {
+        qdr_connection_work_t *next = item->next;
+        DEQ_ITEM_INIT(item);
+        DEQ_INSERT_HEAD(work_list, item);
+        item = next;
+    }
+
+    //
+    // Take the lists of links with work, and free them so an idle connection holds none.
+    //
+    qdr_link_work_lists_t *conn_links = conn->links_with_work;
+    conn->links_with_work = 0;
     for (int priority = 0; priority <= QDR_MAX_PRIORITY; ++ priority) {
-        DEQ_MOVE(conn->links_with_work[priority], links_with_work[priority]);
+        if (conn_links)
+            DEQ_MOVE(conn_links->lists[priority], links_with_work[priority]);
+        else
+            DEQ_INIT(links_with_work[priority]);
 
         //
         // Move the references from CLASS_WORK to CLASS_LOCAL so concurrent action in the core
@@ -239,6 +470,8 @@ int qdr_connection_process(qdr_connection_t *conn)
         }
     }
     sys_mutex_unlock(conn->work_lock);
+    if (conn_links)
+        free_qdr_link_work_lists_t(conn_links);
 
     event_count += DEQ_SIZE(work_list);
     qdr_connection_work_t *work = DEQ_HEAD(work_list);
@@ -259,105 +492,73 @@ int qdr_connection_process(qdr_connection_t *conn)
         work = DEQ_HEAD(work_list);
     }
 
-    // Process the links_with_work array from highest to lowest priority.
-    for (int priority = QDR_MAX_PRIORITY; priority >= 0; -- priority) {
-        do {
-            qdr_link_work_t *link_work;
-            detach_sent = false;
-
-            ref = DEQ_HEAD(links_with_work[priority]);
-            if (ref) {
-                link = ref->link;
-                qdr_del_link_ref(links_with_work + priority, ref->link, QDR_LINK_LIST_CLASS_LOCAL);
+    //
+    // With a connection budget, stop handing deliveries to the connection once it is
+    // spent.  Whatever is left goes back on the connection's work lists below.
+    //
+    int  budget   = core->connection_budget;
+    int *budget_p = budget > 0 ? &budget : 0;
 
-                //
-                // The work lock must be used to protect accesses to the link's work_list and
-                // link_work->processing.
-                //
-                sys_mutex_lock(conn->work_lock);
-                link_work = DEQ_HEAD(link->work_list);
-                if (link_work) {
-                    DEQ_REMOVE_HEAD(link->work_list);
-                    link_work->processing = true;
-                }
-                sys_mutex_unlock(conn->work_lock);
-            } else
-                link = 0;
+    int active_priorities = 0;
+    for (int priority = 0; priority <= QDR_MAX_PRIORITY; ++ priority)
+        if (DEQ_SIZE(links_with_work[priority]) > 0)
+            active_priorities++;
 
-            if (link) {
-                //
-                // Handle disposition/settlement updates
-                //
-                qdr_delivery_ref_list_t updated_deliveries;
-                sys_mutex_lock(conn->work_lock);
-                DEQ_MOVE(link->updated_deliveries, updated_deliveries);
-                sys_mutex_unlock(conn->work_lock);
-
-                qdr_delivery_ref_t *dref = DEQ_HEAD(updated_deliveries);
-                while (dref) {
-                    core->delivery_update_handler(core->user_context, dref->dlv, dref->dlv->disposition, dref->dlv->settled);
-                    qdr_delivery_decref(core, dref->dlv, "qdr_connection_process - remove from updated list");
-                    qdr_del_delivery_ref(&updated_deliveries, dref);
-                    dref = DEQ_HEAD(updated_deliveries);
-                    event_count++;
+    if (core->outbound_weighted && active_priorities > 1) {
+        //
+        // Weighted deficit round-robin: each pass gives every priority with work a
+        // quantum of deliveries in proportion to its level, plus whatever it did not
+        // use in the last pass.  Links that run out of quantum go to the back of their
+        // priority's list for the next pass.
+        //
+        int  deficit[QDR_N_PRIORITIES];
+        bool pending = true;
+        ZERO(deficit);
+
+        while (pending && !(budget_p && budget == 0)) {
+            pending = false;
+            for (int priority = QDR_MAX_PRIORITY; priority >= 0; -- priority) {
+                if (DEQ_SIZE(links_with_work[priority]) == 0) {
+                    deficit[priority] = 0;
+                    continue;
                 }
 
-                while (link_work) {
-                    switch (link_work->work_type) {
-                    case QDR_LINK_WORK_DELIVERY :
-                        {
-                            int count = core->push_handler(core->user_context, link, link_work->value);
-                            assert(count <= link_work->value);
-                            link_work->value -= count;
-                            break;
-                        }
-
-                    case QDR_LINK_WORK_FLOW :
-                        if (link_work->value > 0)
-                            core->flow_handler(core->user_context, link, link_work->value);
-                        if      (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_SET)
-                            core->drain_handler(core->user_context, link, true);
-                        else if (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_CLEAR)
-                            core->drain_handler(core->user_context, link, false);
-                        else if (link_work->drain_action == QDR_LINK_WORK_DRAIN_ACTION_DRAINED)
-                            core->drained_handler(core->user_context, link);
-                        break;
-
-                    case QDR_LINK_WORK_FIRST_DETACH :
-                    case QDR_LINK_WORK_SECOND_DETACH :
-                        core->detach_handler(core->user_context, link, link_work->error,
-                                             link_work->work_type == QDR_LINK_WORK_FIRST_DETACH,
-                                             link_work->close_link);
-                        detach_sent = true;
-                        break;
-                    }
-
-                    sys_mutex_lock(conn->work_lock);
-                    if (link_work->work_type == QDR_LINK_WORK_DELIVERY && link_work->value > 0 && !link->detach_received) {
-                        DEQ_INSERT_HEAD(link->work_list, link_work);
-                        link_work->processing = false;
-                        link_work = 0; // Halt work processing
-                    } else {
-                        qdr_error_free(link_work->error);
-                        free_qdr_link_work_t(link_work);
-                        link_work = DEQ_HEAD(link->work_list);
-                        if (link_work) {
-                            DEQ_REMOVE_HEAD(link->work_list);
-                            link_work->processing = true;
-                        }
-                    }
-                    sys_mutex_unlock(conn->work_lock);
-                    event_count++;
+                deficit[priority] += core->outbound_quantum * (priority + 1);
+                while (deficit[priority] > 0 && !(budget_p && budget == 0) && (ref = DEQ_HEAD(links_with_work[priority]))) {
+                    bool more    = false;
+                    int  quantum = budget_p && budget < deficit[priority] ? budget : deficit[priority];
+                    int  left    = quantum;
+                    link = ref->link;
+                    qdr_del_link_ref(links_with_work + priority, link, QDR_LINK_LIST_CLASS_LOCAL);
+                    event_count += qdr_connection_process_link(core, conn, link, &left, &more);
+                    deficit[priority] -= quantum - left;
+                    if (budget_p)
+                        budget -= quantum - left;
+                    if (more)
+                        qdr_add_link_ref(links_with_work + priority, link, QDR_LINK_LIST_CLASS_LOCAL);
                 }
 
-                if (detach_sent) {
-                    // let the core thread know so it can clean up
-                    qdr_link_detach_sent(link);
-                }
+                if (DEQ_SIZE(links_with_work[priority]) > 0)
+                    pending = true;
+            }
+        }
+    } else {
+        // Process the links_with_work array from highest to lowest priority.
+        for (int priority = QDR_MAX_PRIORITY; priority >= 0 && !(budget_p && budget == 0); -- priority) {
+            while (!(budget_p && budget == 0) && (ref = DEQ_HEAD(links_with_work[priority]))) {
+                bool more = false;
+                link = ref->link;
+                qdr_del_link_ref(links_with_work + priority, link, QDR_LINK_LIST_CLASS_LOCAL);
+                event_count += qdr_connection_process_link(core, conn, link, budget_p, &more);
+                if (more)
+                    qdr_add_link_ref(links_with_work + priority, link, QDR_LINK_LIST_CLASS_LOCAL);
             }
-        } while (detach_sent || link);
+        }
     }
 
+    if (budget_p)
+        qdr_connection_requeue_links(conn, links_with_work);
+
     return event_count;
 }
 
@@ -425,10 +626,18 @@ bool qdr_link_strip_annotations_out(const qdr_link_t *link)
 
 void qdr_link_stalled_outbound(qdr_link_t *link)
 {
+    if (!link->stalled_outbound)
+        link->q3_stall_count++;
     link->stalled_outbound = true;
 }
 
 
+void qdr_link_stalled_inbound(qdr_link_t *link, uint32_t count)
+{
+    link->q2_stall_count += count;
+}
+
+
 const char *qdr_link_name(const qdr_link_t *link)
 {
     return link->name;
@@ -437,7 +646,7 @@ const char *qdr_link_name(const qdr_link_t *link)
 
 static void qdr_link_setup_histogram(qdr_connection_t *conn, qd_direction_t dir, qdr_link_t *link)
 {
-    if (dir == QD_OUTGOING && conn->role != QDR_ROLE_INTER_ROUTER) {
+    if (dir == QD_OUTGOING && conn->role != QDR_ROLE_INTER_ROUTER && conn->role != QDR_ROLE_INTER_ROUTER_DATA) {
         link->ingress_histogram = NEW_ARRAY(uint64_t, qd_bitmask_width());
         for (int i = 0; i < qd_bitmask_width(); i++)
             link->ingress_histogram[i] = 0;
@@ -482,8 +691,10 @@ qdr_link_t *qdr_link_first_attach(qdr_connection_t *conn,
     link->strip_annotations_in  = conn->strip_annotations_in;
     link->strip_annotations_out = conn->strip_annotations_out;
 
-    if      (qdr_terminus_has_capability(local_terminus, QD_CAPABILITY_ROUTER_CONTROL))
+    if      (qdr_terminus_has_capability(local_terminus, QD_CAPABILITY_ROUTER_CONTROL)) {
         link->link_type = QD_LINK_CONTROL;
+        link->priority  = QDR_MAX_PRIORITY;
+    }
     else if (qdr_terminus_has_capability(local_terminus, QD_CAPABILITY_ROUTER_DATA))
         link->link_type = QD_LINK_ROUTER;
     else if (qdr_terminus_has_capability(local_terminus, QD_CAPABILITY_EDGE_DOWNLINK)) {
@@ -555,6 +766,7 @@ void qdr_connection_handlers(qdr_core_t                *core,
                              qdr_delivery_update_t      delivery_update)
 {
     core->user_context            = context;
+    core->activate_handler        = activate;
     core->first_attach_handler    = first_attach;
     core->second_attach_handler   = second_attach;
     core->detach_handler          = detach;
@@ -574,6 +786,9 @@ void qdr_connection_handlers(qdr_core_t                *core,
 
 void qdr_connection_activate_CT(qdr_core_t *core, qdr_connection_t *conn)
 {
+    if (conn->closing)
+        return;
+
     if (!conn->in_activate_list) {
         DEQ_INSERT_TAIL_N(ACTIVATE, core->connections_to_activate, conn);
         conn->in_activate_list = true;
@@ -581,16 +796,34 @@ void qdr_connection_activate_CT(qdr_core_t *core, qdr_connection_t *conn)
 }
 
 
+//
+// Wake the connection for a settlement on one of its inter-router links once the
+// settlement window has passed, so that further settlements pushed meanwhile are
+// written in the same pass and leave as ranged dispositions.
+//
+void qdr_connection_hold_settlement_CT(qdr_core_t *core, qdr_connection_t *conn)
+{
+    if (conn->in_activate_list || conn->in_settle_list || conn->closing)
+        return;
+
+    conn->settle_held_usec = qd_timer_now_usec();
+    DEQ_INSERT_TAIL_N(SETTLE, core->connections_settle_held, conn);
+    conn->in_settle_list = true;
+}
+
+
 void qdr_connection_enqueue_work_CT(qdr_core_t            *core,
                                     qdr_connection_t      *conn,
                                     qdr_connection_work_t *work)
 {
-    sys_mutex_lock(conn->work_lock);
-    DEQ_INSERT_TAIL(conn->work_list, work);
-    bool notify = DEQ_SIZE(conn->work_list) == 1;
-    sys_mutex_unlock(conn->work_lock);
+    void *head;
 
-    if (notify)
+    do {
+        head = sys_atomic_ptr_get(&conn->work_stack);
+        work->next = (qdr_connection_work_t*) head;
+    } while (!sys_atomic_ptr_cas(&conn->work_stack, head, work));
+
+    if (!head)
         qdr_connection_activate_CT(core, conn);
 }
 
@@ -604,7 +837,7 @@ void qdr_link_enqueue_work_CT(qdr_core_t      *core,
     sys_mutex_lock(conn->work_lock);
     DEQ_INSERT_TAIL(link->work_list, work);
     // Enqueue work at priority 0.
-    qdr_add_link_ref(conn->links_with_work, link, QDR_LINK_LIST_CLASS_WORK);
+    qdr_add_link_ref(qdr_connection_work_links(conn, 0), link, QDR_LINK_LIST_CLASS_WORK);
     sys_mutex_unlock(conn->work_lock);
 
     qdr_connection_activate_CT(core, conn);
@@ -691,13 +924,19 @@ static void qdr_link_cleanup_deliveries_CT(qdr_core_t *core, qdr_connection_t *c
         DEQ_REMOVE_HEAD(undelivered);
         peer = qdr_delivery_first_peer_CT(dlv);
         while (peer) {
-            if (peer->multicast) {
+            if (peer->mcast_settlement != QDR_MCAST_SETTLE_PRESETTLE) {
+                //
+                // The consumer is gone; it counts against the multicast delivery.
+                //
+                qdr_delivery_mcast_outcome_CT(core, peer, 0, 1);
+            }
+            else if (peer->multicast) {
                 //
                 // If the address of the delivery is a multicast address and if there are no receivers for this address, the peer delivery must be released.
                 //
                 // If the address of the delivery is a multicast address and there is at least one other receiver for the address, dont do anything
                 //
-                if (DEQ_SIZE(peer->peers) == 1 || peer->peer)  {
+                if (peer->peer_count == 1 || peer->peer)  {
                     qdr_delivery_release_CT(core, peer);
                 }
             }
@@ -750,8 +989,12 @@ static void qdr_link_cleanup_deliveries_CT(qdr_core_t *core, qdr_connection_t *c
 
         peer = qdr_delivery_first_peer_CT(dlv);
         while (peer) {
-            if (link->link_direction == QD_OUTGOING)
-                qdr_delivery_failed_CT(core, peer);
+            if (link->link_direction == QD_OUTGOING) {
+                if (peer->mcast_settlement != QDR_MCAST_SETTLE_PRESETTLE)
+                    qdr_delivery_mcast_outcome_CT(core, peer, 0, 1);
+                else
+                    qdr_delivery_failed_CT(core, peer);
+            }
             qdr_delivery_unlink_peers_CT(core, dlv, peer);
             peer = qdr_delivery_next_peer_CT(dlv);
         }
@@ -818,39 +1061,74 @@ static void qdr_link_abort_undelivered_CT(qdr_core_t *core, qdr_link_t *link)
 }
 
 
-static void qdr_link_cleanup_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link, const char *log_text)
+//
+// Detach the link from everything that could forward to it: its link-routed peer,
+// the core mask-bit tables and its owning address.
+//
+static void qdr_link_unbind_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link)
 {
-    //
-    // Remove the link from the master list of links
-    //
-    DEQ_REMOVE(core->open_links, link);
-
-    //
-    // If the link has a core_endpoint, allow the core_endpoint module to
-    // clean up its state
-    //
-    if (link->core_endpoint)
-        qdrc_endpoint_do_cleanup_CT(core, link->core_endpoint);
-
     //
     // If the link has a connected peer, unlink the peer
     //
     if (link->connected_link) {
+        sys_mutex_lock(core->link_route_lock);
         link->connected_link->connected_link = 0;
         link->connected_link = 0;
+        sys_mutex_unlock(core->link_route_lock);
     }
 
     //
     // If this link is involved in inter-router communication, remove its reference
     // from the core mask-bit tables
     //
-    if (qd_bitmask_valid_bit_value(conn->mask_bit)) {
+    if (conn->role == QDR_ROLE_INTER_ROUTER_DATA) {
+        if (link->link_type == QD_LINK_ROUTER && link->link_direction == QD_OUTGOING &&
+            link->priority < QDR_N_PRIORITIES && conn->data_links[link->priority] == link) {
+            conn->data_links[link->priority] = 0;
+            if (conn->data_stripe >= 0)
+                core->data_links_by_mask_bit[conn->mask_bit].stripes[conn->data_stripe][link->priority] = 0;
+            core->mcast_epoch++;
+        }
+    } else if (qd_bitmask_valid_bit_value(conn->mask_bit)) {
         if (link->link_type == QD_LINK_CONTROL)
             core->control_links_by_mask_bit[conn->mask_bit] = 0;
         if (link->link_type == QD_LINK_ROUTER)
             core->data_links_by_mask_bit[conn->mask_bit].links[link->priority] = 0;
+        core->mcast_epoch++;
     }
 
+    if (link->ref[QDR_LINK_LIST_CLASS_ADDRESS]) {
+        assert(link->owning_addr);
+        qdr_del_link_ref((link->link_direction == QD_OUTGOING)
+                         ? &link->owning_addr->rlinks
+                         : &link->owning_addr->inlinks,
+                         link,  QDR_LINK_LIST_CLASS_ADDRESS);
+    }
+}
+
+
+static void qdr_link_cleanup_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link, const char *log_text)
+{
+    //
+    // Remove the link from the master list of links
+    //
+    qdr_agent_object_removed_CT(core, link, DEQ_NEXT(link));
+    DEQ_REMOVE(core->open_links, link);
+
+    //
+    // If the link has a core_endpoint, allow the core_endpoint module to
+    // clean up its state
+    //
+    if (link->core_endpoint)
+        qdrc_endpoint_do_cleanup_CT(core, link->core_endpoint);
+
+    //
+    // The links of a closing connection were unbound when it closed, and its
+    // mask-bit may since have gone to a new connection.
+    //
+    if (!conn->closing)
+        qdr_link_unbind_CT(core, conn, link);
+
     //
     // Clean up the work list
     //
@@ -882,17 +1160,9 @@ static void qdr_link_cleanup_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_li
     //
     sys_mutex_lock(conn->work_lock);
     qdr_del_link_ref(&conn->links, link, QDR_LINK_LIST_CLASS_CONNECTION);
-    qdr_del_link_ref(conn->links_with_work + link->priority, link, QDR_LINK_LIST_CLASS_WORK);
+    qdr_connection_unqueue_link(conn, link);
     sys_mutex_unlock(conn->work_lock);
 
-    if (link->ref[QDR_LINK_LIST_CLASS_ADDRESS]) {
-        assert(link->owning_addr);
-        qdr_del_link_ref((link->link_direction == QD_OUTGOING)
-                         ? &link->owning_addr->rlinks
-                         : &link->owning_addr->inlinks,
-                         link,  QDR_LINK_LIST_CLASS_ADDRESS);
-    }
-
     //
     // Free the link's name and terminus_addr
     //
@@ -900,6 +1170,7 @@ static void qdr_link_cleanup_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_li
     free(link->disambiguated_name);
     free(link->terminus_addr);
     free(link->ingress_histogram);
+    free(link->latency);
     free(link->insert_prefix);
     free(link->strip_prefix);
 
@@ -908,7 +1179,7 @@ static void qdr_link_cleanup_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_li
     //
     qd_log(core->log, QD_LOG_INFO, "[C%"PRIu64"][L%"PRIu64"] %s: del=%"PRIu64" presett=%"PRIu64" psdrop=%"PRIu64
            " acc=%"PRIu64" rej=%"PRIu64" rel=%"PRIu64" mod=%"PRIu64" delay1=%"PRIu64" delay10=%"PRIu64,
-           conn->identity, link->identity, log_text, link->total_deliveries, link->presettled_deliveries,
+           conn->identity, link->identity, log_text, link->total_deliveries + __atomic_load_n(&link->direct_deliveries, __ATOMIC_RELAXED), link->presettled_deliveries,
            link->dropped_presettled_deliveries, link->accepted_deliveries, link->rejected_deliveries,
            link->released_deliveries, link->modified_deliveries, link->deliveries_delayed_1sec,
            link->deliveries_delayed_10sec);
@@ -942,6 +1213,10 @@ qdr_link_t *qdr_create_link_CT(qdr_core_t       *core,
     link->disambiguated_name = 0;
     link->terminus_addr  = 0;
     qdr_generate_link_name("qdlink", link->name, QD_DISCRIMINATOR_SIZE + 8);
+
+    // The connection's I/O thread serves router-control links ahead of data links
+    if (link_type == QD_LINK_CONTROL)
+        link->priority = QDR_MAX_PRIORITY;
     link->admin_enabled  = true;
     link->oper_status    = QDR_LINK_OPER_DOWN;
     link->insert_prefix  = 0;
@@ -1037,7 +1312,7 @@ qdr_address_config_t *qdr_config_for_address_CT(qdr_core_t *core, qdr_connection
 
     qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_WITH_SPACE);
     if (conn && conn->tenant_space)
-        qd_iterator_annotate_space(iter, conn->tenant_space, conn->tenant_space_len);
+        qd_iterator_annotate_space_hash(iter, conn->tenant_hash);
     qd_parse_tree_retrieve_match(core->addr_parse_tree, iter, (void **) &addr);
     qd_iterator_annotate_prefix(iter, '\0');
     qd_iterator_reset_view(iter, old_view);
@@ -1097,10 +1372,32 @@ qd_address_treatment_t qdr_treatment_for_address_hash_with_default_CT(qdr_core_t
 }
 
 
+// Most idle addresses freed in one pass of the grace-period timer
+#define QDR_ADDRESS_GC_BATCH 256
+
+
+/**
+ * True if the address has no in-process consumer, destination or other use.
+ */
+static bool qdr_address_is_idle(const qdr_address_t *addr)
+{
+    return DEQ_SIZE(addr->subscriptions) == 0
+        && DEQ_SIZE(addr->rlinks) == 0
+        && DEQ_SIZE(addr->inlinks) == 0
+        && qd_bitmask_cardinality(addr->rnodes) == 0
+        && addr->ref_count == 0
+        && !addr->block_deletion
+        && addr->tracked_deliveries == 0
+        && DEQ_SIZE(addr->queue) == 0
+        && addr->core_endpoint == 0;
+}
+
+
 /**
  * Check an address to see if it no longer has any associated destinations.
  * Depending on its policy, the address may be eligible for being closed out
- * (i.e. Logging its terminal statistics and freeing its resources).
+ * (i.e. Logging its terminal statistics and freeing its resources).  With a
+ * grace period the address is kept for reuse until the period ends.
  */
 void qdr_check_addr_CT(qdr_core_t *core, qdr_address_t *addr)
 {
@@ -1111,19 +1408,125 @@ void qdr_check_addr_CT(qdr_core_t *core, qdr_address_t *addr)
     // If the address has no in-process consumer or destinations, it should be
     // deleted.
     //
-    if (DEQ_SIZE(addr->subscriptions) == 0
-        && DEQ_SIZE(addr->rlinks) == 0
-        && DEQ_SIZE(addr->inlinks) == 0
-        && qd_bitmask_cardinality(addr->rnodes) == 0
-        && addr->ref_count == 0
-        && !addr->block_deletion
-        && addr->tracked_deliveries == 0
-        && addr->core_endpoint == 0) {
-        qdr_core_remove_address(core, addr);
+    if (qdr_address_is_idle(addr)) {
+        if (core->addr_grace_period > 0)
+            qdr_address_gc_defer_CT(core, addr);
+        else
+            qdr_core_remove_address(core, addr);
     }
 }
 
 
+static void qdr_address_gc_CT(qdr_core_t *core, void *context)
+{
+    int            freed = 0;
+    int            batch = QDR_ADDRESS_GC_BATCH;
+    qdr_address_t *addr  = DEQ_HEAD(core->addrs_gc);
+
+    while (addr && (int32_t) (core->uptime_ticks - addr->gc_tick) >= 0 && batch-- > 0) {
+        DEQ_REMOVE_HEAD_N(GC, core->addrs_gc);
+        addr->in_gc_list = false;
+
+        if (addr->withdraw_pending) {
+            addr->withdraw_pending = false;
+            qdr_post_mobile_removed_CT(core, (const char*) qd_hash_key_by_handle(addr->hash_handle));
+        }
+
+        //
+        // An address used again during its grace period is no longer idle and is
+        // simply dropped from the list.
+        //
+        if (qdr_address_is_idle(addr)) {
+            qdr_core_remove_address(core, addr);
+            freed++;
+        }
+        addr = DEQ_HEAD(core->addrs_gc);
+    }
+
+    if (freed > 0)
+        qd_log(core->log, QD_LOG_DEBUG, "Freed %d idle addresses after their grace period", freed);
+
+    //
+    // Come back in a second if the batch ran out, else when the next one is due
+    //
+    if (addr) {
+        int32_t delay = batch < 0 ? 1 : (int32_t) (addr->gc_tick - core->uptime_ticks);
+        qdr_core_timer_schedule_CT(core, core->addr_gc_timer, delay > 0 ? delay : 1);
+    }
+}
+
+
+void qdr_address_gc_defer_CT(qdr_core_t *core, qdr_address_t *addr)
+{
+    //
+    // The list stays in order of deadline by always taking the address to the tail
+    //
+    if (addr->in_gc_list)
+        DEQ_REMOVE_N(GC, core->addrs_gc, addr);
+    addr->gc_tick    = core->uptime_ticks + core->addr_grace_period;
+    addr->in_gc_list = true;
+    DEQ_INSERT_TAIL_N(GC, core->addrs_gc, addr);
+
+    if (!core->addr_gc_timer)
+        core->addr_gc_timer = qdr_core_timer_CT(core, qdr_address_gc_CT, 0);
+    if (!qdr_core_timer_scheduled_CT(core->addr_gc_timer))
+        qdr_core_timer_schedule_CT(core, core->addr_gc_timer, core->addr_grace_period);
+}
+
+
+//
+// True if both connections are to the same peer router (same remote container)
+//
+static bool qdr_same_peer(const qdr_connection_t *a, const qdr_connection_t *b)
+{
+    const char *ca = a->connection_info ? a->connection_info->container : 0;
+    const char *cb = b->connection_info ? b->connection_info->container : 0;
+    return ca && cb && strcmp(ca, cb) == 0;
+}
+
+
+//
+// Give an inter-router-data connection a stripe in the sheaf of the peer on mask_bit
+// and publish the data links it already has.
+//
+static void qdr_bind_data_connection_CT(qdr_core_t *core, qdr_connection_t *conn, int mask_bit)
+{
+    qdr_priority_sheaf_t *sheaf = core->data_links_by_mask_bit + mask_bit;
+    int stripe = 0;
+    while (stripe < QDR_MAX_DATA_STRIPES && sheaf->stripe_conns[stripe])
+        stripe++;
+    if (stripe == QDR_MAX_DATA_STRIPES) {
+        qd_log(core->log, QD_LOG_WARNING,
+               "[C%"PRIu64"] More than %d inter-router-data connections to one peer, connection not used",
+               conn->identity, QDR_MAX_DATA_STRIPES);
+        return;
+    }
+
+    conn->mask_bit    = mask_bit;
+    conn->data_stripe = stripe;
+    sheaf->stripe_conns[stripe] = conn;
+    sheaf->stripe_count++;
+    for (int priority = 0; priority < QDR_N_PRIORITIES; ++priority)
+        sheaf->stripes[stripe][priority] = conn->data_links[priority];
+    core->mcast_epoch++;
+}
+
+
+static void qdr_unbind_data_connection_CT(qdr_core_t *core, qdr_connection_t *conn)
+{
+    if (conn->data_stripe < 0)
+        return;
+
+    qdr_priority_sheaf_t *sheaf = core->data_links_by_mask_bit + conn->mask_bit;
+    sheaf->stripe_conns[conn->data_stripe] = 0;
+    sheaf->stripe_count--;
+    memset(sheaf->stripes[conn->data_stripe], 0, sizeof(sheaf->stripes[conn->data_stripe]));
+    conn->data_stripe = -1;
+    conn->mask_bit    = -1;
+    core->mcast_epoch++;
+}
+
+
 static void qdr_connection_opened_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
 {
 
@@ -1154,6 +1557,17 @@ static void qdr_connection_opened_CT(qdr_core_t *core, qdr_action_t *action, boo
                     break;
                 }
 
+                //
+                // Data connections to this peer that opened first share its mask-bit
+                //
+                qdr_connection_t *data_conn = DEQ_HEAD(core->open_connections);
+                while (data_conn) {
+                    if (data_conn->role == QDR_ROLE_INTER_ROUTER_DATA && data_conn->data_stripe < 0 &&
+                        qdr_same_peer(data_conn, conn))
+                        qdr_bind_data_connection_CT(core, data_conn, conn->mask_bit);
+                    data_conn = DEQ_NEXT(data_conn);
+                }
+
                 if (!conn->incoming) {
                     //
                     // The connector-side of inter-router connections is responsible for setting up the
@@ -1170,6 +1584,30 @@ static void qdr_connection_opened_CT(qdr_core_t *core, qdr_action_t *action, boo
                 }
             }
 
+            if (conn->role == QDR_ROLE_INTER_ROUTER_DATA) {
+                //
+                // A data connection carries only the routed-message links and shares the
+                // mask-bit of the inter-router connection to the same peer.  If that is not
+                // open yet the data connection is bound when it opens.
+                //
+                qdr_connection_t *peer = DEQ_HEAD(core->open_connections);
+                while (peer) {
+                    if (peer->role == QDR_ROLE_INTER_ROUTER && qd_bitmask_valid_bit_value(peer->mask_bit) &&
+                        qdr_same_peer(conn, peer))
+                        break;
+                    peer = DEQ_NEXT(peer);
+                }
+                if (peer)
+                    qdr_bind_data_connection_CT(core, conn, peer->mask_bit);
+
+                if (!conn->incoming) {
+                    for (int priority = 0; priority < QDR_N_PRIORITIES; ++ priority) {
+                        (void) qdr_create_link_CT(core, conn, QD_LINK_ROUTER,  QD_INCOMING, qdr_terminus_router_data(), qdr_terminus_router_data());
+                        (void) qdr_create_link_CT(core, conn, QD_LINK_ROUTER,  QD_OUTGOING, qdr_terminus_router_data(), qdr_terminus_router_data());
+                    }
+                }
+            }
+
             if (conn->role == QDR_ROLE_ROUTE_CONTAINER) {
                 //
                 // Notify the route-control module that a route-container connection has opened.
@@ -1197,12 +1635,25 @@ static void qdr_connection_opened_CT(qdr_core_t *core, qdr_action_t *action, boo
 void qdr_connection_free(qdr_connection_t *conn)
 {
     sys_mutex_free(conn->work_lock);
-    free(conn->tenant_space);
+    sys_atomic_destroy(&conn->wake_pending);
+    sys_atomic_ptr_destroy(&conn->work_stack);
+    qd_iterator_space_free(conn->tenant_hash);
+    qdr_intern_release(conn->tenant_space);
     qdr_connection_info_free(conn->connection_info);
+    if (conn->links_with_work)
+        free_qdr_link_work_lists_t(conn->links_with_work);
     free_qdr_connection_t(conn);
 }
 
 
+//
+// The links of a closed connection, and the deliveries on them, are torn down in
+// slices of about this many objects, one slice per core pass, so that a connection
+// with very many links does not hold up the core thread.
+//
+#define QDR_CONNECTION_TEARDOWN_BUDGET 1024
+
+
 static void qdr_connection_closed_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
 {
     if (discard)
@@ -1219,32 +1670,73 @@ static void qdr_connection_closed_CT(qdr_core_t *core, qdr_action_t *action, boo
     // Give back the router mask-bit.
     //
     if (conn->role == QDR_ROLE_INTER_ROUTER) {
+        qdr_connection_t *data_conn = DEQ_HEAD(core->open_connections);
+        while (data_conn) {
+            if (data_conn->role == QDR_ROLE_INTER_ROUTER_DATA && data_conn->mask_bit == conn->mask_bit)
+                qdr_unbind_data_connection_CT(core, data_conn);
+            data_conn = DEQ_NEXT(data_conn);
+        }
         qdr_reset_sheaf(core, conn->mask_bit);
         qd_bitmask_set_bit(core->neighbor_free_mask, conn->mask_bit);
     }
 
+    if (conn->role == QDR_ROLE_INTER_ROUTER_DATA)
+        qdr_unbind_data_connection_CT(core, conn);
+
     //
-    // Remove the references in the links_with_work list
+    // Unbind every link now, which is cheap, so that nothing is forwarded to the
+    // connection while its links are torn down.  From here on the connection is
+    // not activated and is no longer listed with the open connections.  The
+    // links let go of their owning addresses, which may now be freed first.
     //
-    qdr_link_ref_t *link_ref;
-    for (int priority = 0; priority < QDR_N_PRIORITIES; ++ priority) {
-        link_ref = DEQ_HEAD(conn->links_with_work[priority]);
-        while (link_ref) {
-            qdr_del_link_ref(conn->links_with_work + priority, link_ref->link, QDR_LINK_LIST_CLASS_WORK);
-            link_ref = DEQ_HEAD(conn->links_with_work[priority]);
-        }
+    qdr_link_ref_t *link_ref = DEQ_HEAD(conn->links);
+    while (link_ref) {
+        qdr_route_auto_link_closed_CT(core, link_ref->link);
+        qdr_link_unbind_CT(core, conn, link_ref->link);
+        link_ref->link->owning_addr = 0;
+        link_ref = DEQ_NEXT(link_ref);
     }
 
+    conn->closing = true;
+
     //
-    // TODO - Clean up links associated with this connection
-    //        This involves the links and the dispositions of deliveries stored
-    //        with the links.
+    // If this connection is on the activation list, remove it from the list
     //
-    link_ref = DEQ_HEAD(conn->links);
-    while (link_ref) {
-        qdr_link_t *link = link_ref->link;
+    if (conn->in_activate_list) {
+        conn->in_activate_list = false;
+        DEQ_REMOVE_N(ACTIVATE, core->connections_to_activate, conn);
+    }
+
+    if (conn->in_settle_list) {
+        conn->in_settle_list = false;
+        DEQ_REMOVE_N(SETTLE, core->connections_settle_held, conn);
+    }
+
+    qdr_agent_object_removed_CT(core, conn, DEQ_NEXT(conn));
+    qdr_delivery_counters_retire_CT(core, conn);
+    DEQ_REMOVE(core->open_connections, conn);
+    DEQ_INSERT_TAIL(core->closing_connections, conn);
+
+    qdr_connection_teardown_CT(core, action, false);
+}
+
+
+static void qdr_connection_teardown_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    //
+    // A discarded teardown leaves the connection on the closing list for the
+    // core to free as it shuts down.
+    //
+    if (discard)
+        return;
 
-        qdr_route_auto_link_closed_CT(core, link);
+    qdr_connection_t *conn   = action->args.connection.conn;
+    int               budget = QDR_CONNECTION_TEARDOWN_BUDGET;
+
+    qdr_link_ref_t *link_ref = DEQ_HEAD(conn->links);
+    while (link_ref && budget > 0) {
+        qdr_link_t *link = link_ref->link;
+        budget -= 1 + DEQ_SIZE(link->undelivered) + DEQ_SIZE(link->unsettled);
 
         //
         // Clean up the link and all its associated state.
@@ -1253,29 +1745,41 @@ static void qdr_connection_closed_CT(qdr_core_t *core, qdr_action_t *action, boo
         link_ref = DEQ_HEAD(conn->links);
     }
 
+    if (link_ref) {
+        qdr_action_t *next = qdr_action(qdr_connection_teardown_CT, "connection_teardown");
+        next->args.connection.conn = conn;
+        qdr_action_enqueue(core, next);
+        return;
+    }
+
     //
-    // Discard items on the work list
+    // Remove the references in the links_with_work list
     //
-    qdr_connection_work_t *work = DEQ_HEAD(conn->work_list);
-    while (work) {
-        DEQ_REMOVE_HEAD(conn->work_list);
-        qdr_connection_work_free_CT(work);
-        work = DEQ_HEAD(conn->work_list);
+    for (int priority = 0; conn->links_with_work && priority < QDR_N_PRIORITIES; ++ priority) {
+        qdr_link_ref_list_t *work_links = &conn->links_with_work->lists[priority];
+        link_ref = DEQ_HEAD(*work_links);
+        while (link_ref) {
+            qdr_del_link_ref(work_links, link_ref->link, QDR_LINK_LIST_CLASS_WORK);
+            link_ref = DEQ_HEAD(*work_links);
+        }
     }
 
     //
-    // If this connection is on the activation list, remove it from the list
+    // Discard items on the work list
     //
-    if (conn->in_activate_list) {
-        conn->in_activate_list = false;
-        DEQ_REMOVE_N(ACTIVATE, core->connections_to_activate, conn);
+    qdr_connection_work_t *work = (qdr_connection_work_t*) sys_atomic_ptr_swap(&conn->work_stack, 0);
+    while (work) {
+        qdr_connection_work_t *next = work->next;
+        qdr_connection_work_free_CT(work);
+        work = next;
     }
 
     qdrc_event_conn_raise(core, QDRC_EVENT_CONN_CLOSED, conn);
 
     qd_log(core->log, QD_LOG_INFO, "[C%"PRIu64"] Connection Closed", conn->identity);
 
-    DEQ_REMOVE(core->open_connections, conn);
+    qdr_delivery_counters_retire_CT(core, conn);
+    DEQ_REMOVE(core->closing_connections, conn);
     qdr_connection_free(conn);
 }
 
@@ -1289,6 +1793,7 @@ static void qdr_attach_link_control_CT(qdr_core_t *core, qdr_connection_t *conn,
         link->owning_addr = core->hello_addr;
         qdr_add_link_ref(&core->hello_addr->rlinks, link, QDR_LINK_LIST_CLASS_ADDRESS);
         core->control_links_by_mask_bit[conn->mask_bit] = link;
+        core->mcast_epoch++;
     }
 }
 
@@ -1299,6 +1804,7 @@ static void qdr_detach_link_control_CT(qdr_core_t *core, qdr_connection_t *conn,
         qdr_del_link_ref(&core->hello_addr->rlinks, link, QDR_LINK_LIST_CLASS_ADDRESS);
         link->owning_addr = 0;
         core->control_links_by_mask_bit[conn->mask_bit] = 0;
+        core->mcast_epoch++;
         qdr_post_link_lost_CT(core, conn->mask_bit);
     }
 }
@@ -1309,6 +1815,22 @@ static void qdr_detach_link_control_CT(qdr_core_t *core, qdr_connection_t *conn,
 //
 static void qdr_attach_link_data_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link)
 {
+    if (conn->role == QDR_ROLE_INTER_ROUTER_DATA) {
+        // Priorities are assigned in attach order, as on the inter-router connection
+        int next_slot = conn->data_link_count++;
+        if (next_slot > QDR_MAX_PRIORITY) {
+            qd_log(core->log, QD_LOG_ERROR, "Attempt to attach too many links on inter-router-data connection.");
+            return;
+        }
+        link->priority = next_slot;
+        conn->data_links[next_slot] = link;
+        if (conn->data_stripe >= 0) {
+            core->data_links_by_mask_bit[conn->mask_bit].stripes[conn->data_stripe][next_slot] = link;
+            core->mcast_epoch++;
+        }
+        return;
+    }
+
     if (conn->role == QDR_ROLE_INTER_ROUTER) {
         // As inter-router links are attached to this connection, they
         // are assigned priorities in the order in which they are attached.
@@ -1323,34 +1845,49 @@ static void qdr_attach_link_data_CT(qdr_core_t *core, qdr_connection_t *conn, qd
         }
         link->priority = next_slot;
         core->data_links_by_mask_bit[conn->mask_bit].links[next_slot] = link;
+        core->mcast_epoch++;
     }
 }
 
 
 static void qdr_detach_link_data_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link)
 {
-    if (conn->role == QDR_ROLE_INTER_ROUTER)
+    if (conn->role == QDR_ROLE_INTER_ROUTER_DATA) {
+        if (link->priority < QDR_N_PRIORITIES && conn->data_links[link->priority] == link) {
+            conn->data_links[link->priority] = 0;
+            if (conn->data_stripe >= 0) {
+                core->data_links_by_mask_bit[conn->mask_bit].stripes[conn->data_stripe][link->priority] = 0;
+                core->mcast_epoch++;
+            }
+        }
+        return;
+    }
+
+    if (conn->role == QDR_ROLE_INTER_ROUTER) {
         core->data_links_by_mask_bit[conn->mask_bit].links[link->priority] = 0;
+        core->mcast_epoch++;
+    }
 }
 
 
 static void qdr_attach_link_downlink_CT(qdr_core_t *core, qdr_connection_t *conn, qdr_link_t *link, qdr_terminus_t *source)
 {
     qdr_address_t *addr;
-    qd_iterator_t *iter = qd_iterator_dup(qdr_terminus_get_address(source));
-    qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_HASH);
-    qd_iterator_annotate_prefix(iter, QD_ITER_HASH_PREFIX_EDGE_SUMMARY);
+    qd_iterator_t  iter;
+    qd_iterator_init_dup(&iter, qdr_terminus_get_address(source));
+    qd_iterator_reset_view(&iter, ITER_VIEW_ADDRESS_HASH);
+    qd_iterator_annotate_prefix(&iter, QD_ITER_HASH_PREFIX_EDGE_SUMMARY);
 
-    qd_hash_retrieve(core->addr_hash, iter, (void**) &addr);
+    qd_hash_retrieve(core->addr_hash, &iter, (void**) &addr);
     if (!addr) {
        addr = qdr_address_CT(core, QD_TREATMENT_ANYCAST_BALANCED, 0);
-        qd_hash_insert(core->addr_hash, iter, addr, &addr->hash_handle);
+        qd_hash_insert(core->addr_hash, &iter, addr, &addr->hash_handle);
         DEQ_INSERT_TAIL(core->addrs, addr);
     }
 
     qdr_core_bind_address_link_CT(core, addr, link);
 
-    qd_iterator_free(iter);
+    qd_iterator_fini(&iter);
 }
 
 
@@ -1384,8 +1921,9 @@ static void qdr_link_inbound_first_attach_CT(qdr_core_t *core, qdr_action_t *act
     //
     // Reject any attaches of inter-router links that arrive on connections that are not inter-router.
     //
-    if (((link->link_type == QD_LINK_CONTROL || link->link_type == QD_LINK_ROUTER) &&
-         conn->role != QDR_ROLE_INTER_ROUTER)) {
+    if ((link->link_type == QD_LINK_CONTROL && conn->role != QDR_ROLE_INTER_ROUTER) ||
+        (link->link_type == QD_LINK_ROUTER && conn->role != QDR_ROLE_INTER_ROUTER &&
+         conn->role != QDR_ROLE_INTER_ROUTER_DATA)) {
         link->link_type = QD_LINK_ENDPOINT; // Demote the link type to endpoint if this is not an inter-router connection
         qdr_link_outbound_detach_CT(core, link, 0, QDR_CONDITION_FORBIDDEN, true);
         qdr_terminus_free(source);
@@ -1399,8 +1937,9 @@ static void qdr_link_inbound_first_attach_CT(qdr_core_t *core, qdr_action_t *act
     // CONTROL link on the connection.  This will prevent endpoints from using inter-router
     // listeners for normal traffic but will not prevent routed-links from being established.
     //
-    if (conn->role == QDR_ROLE_INTER_ROUTER && link->link_type == QD_LINK_ENDPOINT &&
-        core->control_links_by_mask_bit[conn->mask_bit] == 0) {
+    if (link->link_type == QD_LINK_ENDPOINT &&
+        (conn->role == QDR_ROLE_INTER_ROUTER_DATA ||
+         (conn->role == QDR_ROLE_INTER_ROUTER && core->control_links_by_mask_bit[conn->mask_bit] == 0))) {
         qdr_link_outbound_detach_CT(core, link, 0, QDR_CONDITION_WRONG_ROLE, true);
         qdr_terminus_free(source);
         qdr_terminus_free(target);
@@ -1515,6 +2054,16 @@ static void qdr_link_inbound_second_attach_CT(qdr_core_t *core, qdr_action_t *ac
     link->oper_status = QDR_LINK_OPER_UP;
     link->attach_count++;
 
+    //
+    // Feed the answer time of a link-routed attach into the connection's attach latency.
+    //
+    if (link->attach_sent_usec) {
+        int64_t sample = qd_timer_now_usec() - link->attach_sent_usec;
+        if (sample > 0)
+            conn->attach_usec_ewma = conn->attach_usec_ewma ? conn->attach_usec_ewma + (sample - conn->attach_usec_ewma) / 8 : sample;
+        link->attach_sent_usec = 0;
+    }
+
     //
     // Mark the link as an edge link if it's inside an edge connection.
     //
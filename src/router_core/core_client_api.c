@@ -41,6 +41,8 @@ struct qdrc_client_request_t {
     qd_iterator_t       *correlation_key;
     qd_hash_handle_t    *hash_handle;
     qdr_delivery_t      *delivery;
+    qdr_delivery_t      *delivery_key;        // key of unsettled_handle, kept after delivery is released
+    qd_hash_handle_t    *unsettled_handle;
     qdr_core_timer_t    *timer;
 
     qd_composed_field_t *app_properties;
@@ -49,6 +51,7 @@ struct qdrc_client_request_t {
     bool                 on_send_queue;      // to be sent
     bool                 on_unsettled_list;  // awaiting disposition
     bool                 on_reply_list;      // awaiting reply message
+    bool                 in_flight;          // sent and counted against max_in_flight
 
     qdrc_client_on_reply_CT_t        on_reply_cb;
     qdrc_client_on_ack_CT_t          on_ack_cb;
@@ -61,6 +64,7 @@ ALLOC_DEFINE(qdrc_client_request_t);
 struct qdrc_client_t {
     qdr_core_t                 *core;
     qd_hash_t                  *correlations;
+    qd_hash_t                  *unsettled;  // unsettled requests by delivery
 
     qdrc_endpoint_t            *sender;  // for outgoing management request messages
     qdrc_endpoint_t            *receiver;  // for incoming management reply messages
@@ -77,6 +81,8 @@ struct qdrc_client_t {
     int                         rx_credit_max;
     int                         rx_credit;
     int                         tx_credit;
+    int                         in_flight;      // requests sent and not yet done
+    int                         max_in_flight;  // 0 => limited by link credit only
 
     void                       *user_context;
     qdrc_client_on_state_CT_t   on_state_cb;
@@ -154,9 +160,11 @@ qdrc_client_t *qdrc_client_CT(qdr_core_t *core,
 
     ZERO(client);
     client->core = core;
-    client->correlations = qd_hash(6, 4, 0);
+    client->correlations = qd_hash(10, 32, 0);
+    client->unsettled = qd_hash(10, 32, 0);
     client->next_cid = rand();
     client->rx_credit_max = credit_window;
+    client->max_in_flight = core->client_max_in_flight;
     client->user_context = user_context;
     client->on_state_cb = on_state_cb;
     client->on_flow_cb = on_flow_cb;
@@ -217,6 +225,7 @@ void qdrc_client_free_CT(qdrc_client_t *client)
     }
 
     qd_hash_free(client->correlations);
+    qd_hash_free(client->unsettled);
     free(client->reply_to);
 
     qd_log(client->core->log, QD_LOG_TRACE,
@@ -259,6 +268,13 @@ int qdrc_client_request_CT(qdrc_client_t                 *client,
 }
 
 
+void qdrc_client_set_max_in_flight_CT(qdrc_client_t *client, int max_in_flight)
+{
+    client->max_in_flight = max_in_flight > 0 ? max_in_flight : 0;
+    _flush_send_queue_CT(client);
+}
+
+
 // attempt to send a new request message
 static void _send_request_CT(qdrc_client_t *client,
                              qdrc_client_request_t *req)
@@ -277,6 +293,11 @@ static void _flush_send_queue_CT(qdrc_client_t *client)
     while (req && client->tx_credit > 0) {
         bool presettled = (req->on_ack_cb == NULL);
 
+        if (client->max_in_flight && client->in_flight >= client->max_in_flight) {
+            // resumes as outstanding requests complete
+            break;
+        }
+
         if (req->on_reply_cb && !client->reply_to) {
             // cannot send until receiver comes up
             break;
@@ -302,6 +323,11 @@ static void _flush_send_queue_CT(qdrc_client_t *client)
         if (!presettled && req->on_ack_cb) {
             DEQ_INSERT_TAIL_N(UNSETTLED, client->unsettled_list, req);
             req->on_unsettled_list = true;
+            req->delivery_key = req->delivery;
+            qd_iterator_t *key = qd_iterator_binary((const char *) &req->delivery_key,
+                                                    sizeof(req->delivery_key), ITER_VIEW_ALL);
+            qd_hash_insert(client->unsettled, key, req, &req->unsettled_handle);
+            qd_iterator_free(key);
         }
         if (req->on_reply_cb) {
             DEQ_INSERT_TAIL_N(REPLY, client->reply_list, req);
@@ -310,6 +336,9 @@ static void _flush_send_queue_CT(qdrc_client_t *client)
         if (!req->on_reply_list && !req->on_unsettled_list) {
             // "Fire and forget" no need to keep the request any longer
             _free_request_CT(client, req, NULL);
+        } else {
+            req->in_flight = true;
+            client->in_flight++;
         }
         client->tx_credit -= 1;
         req = DEQ_HEAD(client->send_queue);
@@ -336,6 +365,14 @@ static void _free_request_CT(qdrc_client_t *client,
         qd_hash_handle_free(req->hash_handle);
     }
 
+    if (req->unsettled_handle) {
+        qd_hash_remove_by_handle(client->unsettled, req->unsettled_handle);
+        qd_hash_handle_free(req->unsettled_handle);
+    }
+
+    if (req->in_flight)
+        client->in_flight--;
+
     if (req->correlation_key) {
         qd_iterator_free(req->correlation_key);
     }
@@ -470,8 +507,10 @@ static void _sender_update_CT(void *context,
 
     if (disposition) {
         // should be on unsettled list
-        qdrc_client_request_t *req = DEQ_HEAD(client->unsettled_list);
-        DEQ_FIND_N(UNSETTLED, req, (req->delivery == delivery));
+        qdrc_client_request_t *req = NULL;
+        qd_iterator_t *key = qd_iterator_binary((const char *) &delivery, sizeof(delivery), ITER_VIEW_ALL);
+        qd_hash_retrieve(client->unsettled, key, (void **)&req);
+        qd_iterator_free(key);
         if (req) {
             assert(req->on_ack_cb);
             req->on_ack_cb(client->core,
@@ -482,6 +521,9 @@ static void _sender_update_CT(void *context,
             // remove from unsettled list
             DEQ_REMOVE_N(UNSETTLED, client->unsettled_list, req);
             req->on_unsettled_list = false;
+            qd_hash_remove_by_handle(client->unsettled, req->unsettled_handle);
+            qd_hash_handle_free(req->unsettled_handle);
+            req->unsettled_handle = 0;
 
             // delivery no longer needed
             qdr_delivery_decref_CT(client->core, req->delivery, "core client send request");
@@ -498,6 +540,7 @@ static void _sender_update_CT(void *context,
                    " client=%p delivery=%p",
                    client, delivery);
         }
+        _flush_send_queue_CT(client);
     }
 }
 
@@ -564,6 +607,7 @@ static void _receiver_transfer_CT(void *client_context,
         }
 
         qdrc_endpoint_settle_CT(core, delivery, disposition);
+        _flush_send_queue_CT(client);
 
         if (--client->rx_credit < (client->rx_credit_max / 2)) {
             int prev = client->rx_credit;
@@ -659,10 +703,7 @@ static qd_message_t *_create_message_CT(qdrc_client_t *client,
                                         qdrc_client_request_t *req)
 {
     // build necessary message headers, etc:
-    qd_composed_field_t *fld = qd_compose(QD_PERFORMATIVE_HEADER, 0);
-    qd_compose_start_list(fld);
-    qd_compose_insert_bool(fld, 0);     // durable
-    qd_compose_end_list(fld);
+    qd_composed_field_t *fld;
 
     if (req->on_reply_cb) {
         // generate unique correlation-id
@@ -676,16 +717,18 @@ static qd_message_t *_create_message_CT(qdrc_client_t *client,
                        req,
                        &req->hash_handle);
 
-        fld = qd_compose(QD_PERFORMATIVE_PROPERTIES, fld);
-        qd_compose_start_list(fld);
-        qd_compose_insert_null(fld);                    // message-id
-        qd_compose_insert_null(fld);                    // user-id
+        fld = qd_message_start_properties();            // header, message-id, user-id
         qd_compose_insert_null(fld);                    // to
         qd_compose_insert_null(fld);                    // subject
         assert(client->reply_to);
         qd_compose_insert_string(fld, client->reply_to);
         qd_compose_insert_string(fld, req->correlation_id);
         qd_compose_end_list(fld);
+    } else {
+        fld = qd_compose(QD_PERFORMATIVE_HEADER, 0);
+        qd_compose_start_list(fld);
+        qd_compose_insert_bool(fld, 0);     // durable
+        qd_compose_end_list(fld);
     }
 
     qd_message_t *message = qd_message();
@@ -714,4 +757,5 @@ static void _timer_expired(qdr_core_t *core, void *context)
     qdrc_client_request_t *req = (qdrc_client_request_t *)context;
     qdrc_client_t *client = req->client;
     _free_request_CT(client, req, "Timed out");
+    _flush_send_queue_CT(client);
 }
@@ -163,4 +163,14 @@ int qdrc_client_request_CT(qdrc_client_t                 *client,
                            qdrc_client_on_ack_CT_t        on_ack_cb,
                            qdrc_client_request_done_CT_t  done_cb);
 
+
+/**
+ * Limit the requests awaiting a disposition or reply at once.  Further
+ * requests stay queued until outstanding ones complete.  The limit starts at
+ * the router's coreClientMaxInFlight setting.
+ * @param client - as returned by qdrc_client_CT()
+ * @param max_in_flight - the limit, zero for none beyond link credit
+ */
+void qdrc_client_set_max_in_flight_CT(qdrc_client_t *client, int max_in_flight);
+
 #endif // #define qd_router_core_client_api_h 1
@@ -40,6 +40,8 @@ typedef uint32_t qdrc_event_t;
  * QDRC_EVENT_CONN_EDGE_LOST             An edge connection has been lost
  * QDRC_EVENT_CONN_IR_ESTABLISHED        (not implemented)
  * QDRC_EVENT_CONN_IR_LOST               (not implemented)
+ * QDRC_EVENT_CONN_EDGE_UPLINK_ADDED     An additional edge connection now carries traffic (edgeUplinks > 1)
+ * QDRC_EVENT_CONN_EDGE_UPLINK_LOST      An additional edge connection has been lost
  *
  * QDRC_EVENT_LINK_IN_ATTACHED           (not implemented)
  * QDRC_EVENT_LINK_IN_DETACHED           (not implemented)
@@ -68,7 +70,9 @@ typedef uint32_t qdrc_event_t;
 #define QDRC_EVENT_CONN_EDGE_LOST            0x00000008
 #define QDRC_EVENT_CONN_IR_ESTABLISHED       0x00000010
 #define QDRC_EVENT_CONN_IR_LOST              0x00000020
-#define _QDRC_EVENT_CONN_RANGE               0x0000003F
+#define QDRC_EVENT_CONN_EDGE_UPLINK_ADDED    0x00000040
+#define QDRC_EVENT_CONN_EDGE_UPLINK_LOST     0x00000080
+#define _QDRC_EVENT_CONN_RANGE               0x000000FF
 
 #define QDRC_EVENT_LINK_IN_ATTACHED          0x00000100
 #define QDRC_EVENT_LINK_IN_DETACHED          0x00000200
@@ -138,6 +138,7 @@ qdr_delivery_t *qdrc_endpoint_delivery_CT(qdr_core_t *core, qdrc_endpoint_t *end
     *tag                = core->next_tag++;
     dlv->tag_length = 8;
     dlv->ingress_index = -1;
+    dlv->owner_thread  = -1;
     return dlv;
 }
 
@@ -28,6 +28,13 @@ typedef struct qdrc_endpoint_t qdrc_endpoint_t;
 #ifndef qd_router_core_endpoint
 #define qd_router_core_endpoint 1
 
+//
+// Every core-endpoint link is attached on a connection: links bound by mobile address
+// are attached by a remote peer, and links created with qdrc_endpoint_create_link_CT
+// run over the connection passed in.  Two core-endpoints in the same router never
+// exchange messages directly, so deliveries to and from them are always encoded AMQP.
+//
+
 
 /**
  * Event - An attach for a new core-endpoint link has arrived
@@ -30,6 +30,7 @@ void qdr_process_tick_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 void qdr_process_tick(qdr_core_t *core)
 {
     qdr_action_t *action = qdr_action(qdr_process_tick_CT, "process_tick");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     qdr_action_enqueue(core, action);
 }
 
@@ -42,55 +43,41 @@ qdr_core_timer_t *qdr_core_timer_CT(qdr_core_t *core, qdr_timer_cb_t callback, v
         return 0;
 
     ZERO(timer);
-    timer->handler = callback;
-    timer->context = timer_context;
-    DEQ_ITEM_INIT(timer);
+    timer->entry.owner = timer;
+    timer->handler     = callback;
+    timer->context     = timer_context;
 
     return timer;
 }
 
 
-void qdr_core_timer_schedule_CT(qdr_core_t *core, qdr_core_timer_t *timer, uint32_t delay)
+//
+// Deadlines are taken from the time of the core thread's current pass, not
+// from a fresh clock reading.
+//
+static void qdr_core_timer_insert_CT(qdr_core_t *core, qdr_core_timer_t *timer, int64_t msec)
 {
-    if (timer->scheduled)
-        qdr_core_timer_cancel_CT(core, timer);
+    if (msec > QD_WHEEL_SPAN)
+        msec = QD_WHEEL_SPAN;
+    qd_timer_wheel_insert(&core->timer_wheel, &timer->entry, core->timer_wheel.now + msec);
+}
 
-    qdr_core_timer_t *ptr         = DEQ_HEAD(core->scheduled_timers);
-    uint32_t          time_before = 0;
 
-    while (ptr && time_before + ptr->delta_time_seconds <= delay) {
-        time_before += ptr->delta_time_seconds;
-        ptr = DEQ_NEXT(ptr);
-    }
+void qdr_core_timer_schedule_CT(qdr_core_t *core, qdr_core_timer_t *timer, uint32_t delay)
+{
+    qdr_core_timer_insert_CT(core, timer, (int64_t) delay * 1000);
+}
 
-    //
-    // ptr is the first timer to exceed duration or NULL if we ran out
-    //
-    timer->delta_time_seconds = delay - time_before;
-    timer->scheduled          = true;
-
-    if (!ptr)
-        DEQ_INSERT_TAIL(core->scheduled_timers, timer);
-    else {
-        ptr->delta_time_seconds -= timer->delta_time_seconds;
-        ptr = DEQ_PREV(ptr);
-        if (ptr)
-            DEQ_INSERT_AFTER(core->scheduled_timers, timer, ptr);
-        else
-            DEQ_INSERT_HEAD(core->scheduled_timers, timer);
-    }
+
+void qdr_core_timer_schedule_msec_CT(qdr_core_t *core, qdr_core_timer_t *timer, uint32_t msec)
+{
+    qdr_core_timer_insert_CT(core, timer, msec);
 }
 
 
 void qdr_core_timer_cancel_CT(qdr_core_t *core, qdr_core_timer_t *timer)
 {
-    if (timer->scheduled) {
-        timer->scheduled = false;
-        if (DEQ_NEXT(timer)) {
-            DEQ_NEXT(timer)->delta_time_seconds += timer->delta_time_seconds;
-        }
-        DEQ_REMOVE(core->scheduled_timers, timer);
-    }
+    qd_timer_wheel_remove(&core->timer_wheel, &timer->entry);
 }
 
 
@@ -104,29 +91,34 @@ void qdr_core_timer_free_CT(qdr_core_t *core, qdr_core_timer_t *timer)
 }
 
 
-void qdr_process_tick_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+int64_t qdr_core_timer_process_CT(qdr_core_t *core, int64_t now_msec)
 {
-    if (discard)
-        return;
-
-    core->uptime_ticks++;
-
-    qdr_core_timer_t *timer = DEQ_HEAD(core->scheduled_timers);
-    qdr_core_timer_t *timer_next = 0;
-
-    while (timer && timer->delta_time_seconds == 0) {
-        assert(timer->scheduled);
-        timer->scheduled = false;
-        timer_next = DEQ_NEXT(timer);
-        DEQ_REMOVE(core->scheduled_timers, timer);
+    qd_timer_wheel_t *wheel = &core->timer_wheel;
+    qd_timer_wheel_advance(wheel, now_msec);
 
+    //
+    // Only fire the timers that were due on entry, a handler re-scheduling
+    // itself with no delay runs on the next pass.
+    //
+    size_t            due   = DEQ_SIZE(wheel->expired);
+    qd_wheel_entry_t *entry = qd_timer_wheel_expired(wheel);
+    while (due-- > 0 && entry) {
+        qdr_core_timer_t *timer = (qdr_core_timer_t*) entry->owner;
+        qd_timer_wheel_remove(wheel, entry);
         if (timer->handler)
             timer->handler(core, timer->context);
-
-        timer = timer_next;
+        entry = qd_timer_wheel_expired(wheel);
     }
 
-    if (timer)
-        timer->delta_time_seconds--;
+    qd_wheel_entry_t *next = qd_timer_wheel_next(wheel);
+    return next ? next->deadline : -1;
 }
 
+
+void qdr_process_tick_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    if (discard)
+        return;
+
+    core->uptime_ticks++;
+}
@@ -16,7 +16,9 @@
  * specific language governing permissions and limitations
  * under the License.
  */
+#include <qpid/dispatch/amqp.h>
 #include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/hash.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include "router_core_private.h"
@@ -33,15 +35,14 @@ struct next_hop_t
 {
     // per-exchange list of all next hops
     DEQ_LINKS_N(exchange_list, next_hop_t);
-    // when hooked to the transmit list
-    DEQ_LINKS_N(transmit_list, next_hop_t);
 
     int                  ref_count;  // binding references
     int                  phase;
-    bool                 on_xmit_list;
+    bool                 in_route;   // set while a subject route is built
     qdr_exchange_t      *exchange;
     unsigned char       *next_hop;
     qdr_address_t       *qdr_addr;
+    qd_buffer_list_t     to_override;  // next_hop encoded once for every message's annotation
 };
 
 ALLOC_DECLARE(next_hop_t);
@@ -61,12 +62,20 @@ DEQ_DECLARE(next_hop_t, next_hop_list_t);
 // value of "a.b" will match two distict binding keys "+.b" and "a.+".  If
 // both these patterns share the same next_hop_t only 1 copy of the message
 // will be forwarded.
+//
+// Bindings on a headers exchange do not use the parse tree.  Their key is a
+// comma separated list of clauses over the message's application properties:
+// "name=value" matches a property with that value, "name" matches if the
+// property is present, and an optional "x-match=all" (the default) or
+// "x-match=any" selects whether every clause or at least one must match.
 typedef struct qdr_binding qdr_binding_t;
+typedef struct headers_clause_t headers_clause_t;
 struct qdr_binding
 {
     // per-exchange list of all bindings
     DEQ_LINKS_N(exchange_list, qdr_binding_t);
-    // parse tree node's list of bindings sharing the same pattern
+    // parse tree node's list of bindings sharing the same pattern (or the
+    // headers exchange list of bindings without clauses)
     DEQ_LINKS_N(tree_list, qdr_binding_t);
 
     unsigned char       *name;
@@ -76,6 +85,13 @@ struct qdr_binding
     unsigned char       *key;
     next_hop_t          *next_hop;
 
+    // headers exchange only
+    headers_clause_t    *clauses;
+    int                  clause_count;
+    bool                 match_any;
+    int                  hits;         // clauses matched by message 'epoch'
+    uint64_t             epoch;
+
     uint64_t             msgs_matched;
 };
 
@@ -84,6 +100,53 @@ ALLOC_DEFINE(qdr_binding_t);
 DEQ_DECLARE(qdr_binding_t, qdr_binding_list_t);
 
 
+// headers_key_t
+// Entry in a headers exchange's clause index.  Clauses are indexed by the
+// application property name ("P<name>") for presence clauses, or by the
+// name and value ("V<name length>:<name><value>") for value clauses, so a
+// message only visits the clauses of the properties it carries.
+typedef struct headers_key_t headers_key_t;
+DEQ_DECLARE(headers_clause_t, headers_clause_list_t);
+struct headers_key_t
+{
+    qd_hash_handle_t       *hash_handle;
+    headers_clause_list_t   clauses;
+};
+
+struct headers_clause_t
+{
+    DEQ_LINKS(headers_clause_t);
+    qdr_binding_t          *binding;
+    headers_key_t          *key;
+    uint64_t                epoch;     // last message that matched the clause
+};
+
+
+// subject_route_t
+// The result of matching one distinct subject against the bindings: every
+// matched binding (for the matchedCount statistics) and the de-duplicated set
+// of next hops the message is forwarded to.  Routes are cached per exchange
+// and the whole cache is discarded whenever a binding is added or removed.
+// The least recently used route is dropped once the cache is full.
+#define QDR_EXCHANGE_ROUTE_CACHE_MAX 1024
+
+typedef struct subject_route_t subject_route_t;
+struct subject_route_t
+{
+    DEQ_LINKS(subject_route_t);
+    qd_hash_handle_t    *hash_handle;
+    qdr_binding_t      **bindings;
+    int                  binding_count;
+    next_hop_t         **next_hops;
+    int                  next_hop_count;
+    int                  capacity;
+};
+
+ALLOC_DECLARE(subject_route_t);
+ALLOC_DEFINE(subject_route_t);
+DEQ_DECLARE(subject_route_t, subject_route_list_t);
+
+
 struct qdr_exchange {
     DEQ_LINKS(qdr_exchange_t);          // for core->exchanges
     qdr_core_t         *core;
@@ -97,11 +160,23 @@ struct qdr_exchange {
     qdr_binding_list_t  bindings;
     next_hop_list_t     next_hops;
     qdr_forwarder_t    *old_forwarder;
+    qd_hash_t          *route_hash;     // subject --> subject_route_t
+    subject_route_list_t routes;        // most recently used at the head
+
+    // matchMethod "headers" (parse_tree is NULL)
+    bool                headers;
+    qd_hash_t          *headers_index;  // clause key --> headers_key_t
+    qdr_binding_list_t  headers_all;    // x-match=all bindings without clauses
+    uint64_t            headers_epoch;  // bumped for each message matched
+    subject_route_t     headers_route;  // reused for every message
 
     uint64_t msgs_received;
     uint64_t msgs_dropped;
     uint64_t msgs_routed;
     uint64_t msgs_alternate;
+    uint64_t route_hits;        // subjects found in the route cache
+    uint64_t route_misses;      // subjects matched against the bindings
+    uint64_t match_usec;        // time spent matching those
 };
 
 ALLOC_DECLARE(qdr_exchange_t);
@@ -114,7 +189,8 @@ static qdr_exchange_t *qdr_exchange(qdr_core_t    *core,
                                     int            phase,
                                     qd_iterator_t *alternate,
                                     int            alt_phase,
-                                    qd_parse_tree_type_t method);
+                                    qd_parse_tree_type_t method,
+                                    bool           headers);
 static void write_config_exchange_map(qdr_exchange_t      *ex,
                                       qd_composed_field_t *body);
 static qdr_exchange_t *find_exchange(qdr_core_t    *core,
@@ -150,6 +226,14 @@ static next_hop_t *find_next_hop(qdr_exchange_t *ex,
 static bool gather_next_hops(void *handle,
                              const char *pattern,
                              void *payload);
+static subject_route_t *subject_route(qdr_exchange_t *ex,
+                                      qd_iterator_t  *subject);
+static void flush_subject_routes(qdr_exchange_t *ex);
+static subject_route_t *headers_route(qdr_exchange_t *ex,
+                                      qd_message_t   *msg);
+static int parse_headers_key(const char *key,
+                             bool       *match_any,
+                             char     ***index_keys);
 static int send_message(qdr_core_t     *core,
                         next_hop_t     *next_hop,
                         qd_message_t   *msg,
@@ -191,17 +275,26 @@ int qdr_forward_exchange_CT(qdr_core_t     *core,
     if (!presettled)
         in_delivery->settled = true;
 
-    qd_iterator_t *subject = qd_message_check(msg, QD_DEPTH_PROPERTIES)
-        ? qd_message_field_iterator(msg, QD_FIELD_SUBJECT)
-        : NULL;
-    next_hop_list_t transmit_list;
-    DEQ_INIT(transmit_list);
+    subject_route_t *route = NULL;
+
+    if (ex->headers) {
+        route = headers_route(ex, msg);
+    } else {
+        qd_iterator_t *subject = qd_message_check(msg, QD_DEPTH_PROPERTIES)
+            ? qd_message_field_iterator(msg, QD_FIELD_SUBJECT)
+            : NULL;
+        if (subject) {
+            // find the next hops for all bindings matching the subject
+            route = subject_route(ex, subject);
+            qd_iterator_free(subject);
+        }
+    }
 
-    if (subject) {
-        // find all matching bindings and build a list of their next hops
-        qd_parse_tree_search(ex->parse_tree, subject, gather_next_hops, &transmit_list);
-        qd_iterator_free(subject);
+    if (route) {
+        for (int i = 0; i < route->binding_count; i++)
+            route->bindings[i]->msgs_matched += 1;
     }
+    const int next_hop_count = route ? route->next_hop_count : 0;
 
     // if there are valid next hops then we're routing this message based on an
     // entirely new destination address.  We need to reset the origin and the
@@ -210,7 +303,7 @@ int qdr_forward_exchange_CT(qdr_core_t     *core,
     // possible that the next hop is reached via the same link/router this
     // message arrived from.
     // @TODO(kgiusti) - loop detection
-    if (DEQ_SIZE(transmit_list) > 0 || ex->alternate) {
+    if (next_hop_count > 0 || ex->alternate) {
         if (in_delivery) {
             in_delivery->origin = 0;
             qd_bitmask_free(in_delivery->link_exclusion);
@@ -229,14 +322,11 @@ int qdr_forward_exchange_CT(qdr_core_t     *core,
         qd_message_set_ingress_annotation(msg, ingress_field);
     }
 
-    next_hop_t *next_hop = DEQ_HEAD(transmit_list);
-    while (next_hop) {
-        DEQ_REMOVE_N(transmit_list, transmit_list, next_hop);
-        next_hop->on_xmit_list = false;
+    for (int i = 0; i < next_hop_count; i++) {
+        next_hop_t *next_hop = route->next_hops[i];
         assert(next_hop->qdr_addr);
         // @TODO(kgiusti) - non-recursive handling of next hop if it is an exchange
         forwarded += send_message(ex->core, next_hop, msg, in_delivery, exclude_inprocess, control);
-        next_hop = DEQ_HEAD(transmit_list);
     }
 
     if (forwarded == 0 && ex->alternate) {
@@ -278,32 +368,319 @@ int qdr_forward_exchange_CT(qdr_core_t     *core,
 }
 
 
+// Add a matched binding to the route under construction
+static void route_add_binding(subject_route_t *route, qdr_binding_t *binding)
+{
+    if (route->binding_count == route->capacity) {
+        // there can never be more next hops than bindings
+        route->capacity = route->capacity ? route->capacity * 2 : 8;
+        route->bindings = realloc(route->bindings, route->capacity * sizeof(qdr_binding_t *));
+        route->next_hops = realloc(route->next_hops, route->capacity * sizeof(next_hop_t *));
+    }
+    route->bindings[route->binding_count++] = binding;
+
+    // note - since multiple bindings may reference the next hop, it is
+    // possible a next hop has already been added to the route.  do not
+    // re-add.  This is not thread safe but that is fine since all
+    // forwarding is done on the core thread.
+    if (!binding->next_hop->in_route) {
+        route->next_hops[route->next_hop_count++] = binding->next_hop;
+        binding->next_hop->in_route = true;
+    }
+}
+
+
 // callback from parse tree search:
-// handle = transmit_list containing all matching next_hops
+// handle = subject route under construction
 // pattern = pattern that matches the search (ignored)
 // payload = list of bindings configured for the pattern
 static bool gather_next_hops(void *handle, const char *pattern, void *payload)
 {
-    next_hop_list_t *transmit_list = (next_hop_list_t *)handle;
+    subject_route_t *route = (subject_route_t *)handle;
     qdr_binding_list_t *bindings = (qdr_binding_list_t *)payload;
 
     qdr_binding_t *binding = DEQ_HEAD(*bindings);
     while (binding) {
-        binding->msgs_matched += 1;
-        // note - since multiple bindings may reference the next hop, it is
-        // possible a next hop has already been added to the transmit list.
-        // do not re-add.  This is not thread safe but that is fine since all
-        // forwarding is done on the core thread.
-        if (!binding->next_hop->on_xmit_list) {
-            DEQ_INSERT_TAIL_N(transmit_list, *transmit_list, binding->next_hop);
-            binding->next_hop->on_xmit_list = true;
-        }
+        route_add_binding(route, binding);
         binding = DEQ_NEXT_N(tree_list, binding);
     }
     return true;  // keep searching
 }
 
 
+// Return the route for the subject, matching it against the bindings only if
+// it is not already cached
+static subject_route_t *subject_route(qdr_exchange_t *ex, qd_iterator_t *subject)
+{
+    subject_route_t *route = NULL;
+
+    qd_hash_retrieve(ex->route_hash, subject, (void **)&route);
+    if (route) {
+        ex->route_hits += 1;
+        if (route != DEQ_HEAD(ex->routes)) {
+            DEQ_REMOVE(ex->routes, route);
+            DEQ_INSERT_HEAD(ex->routes, route);
+        }
+        return route;
+    }
+
+    int64_t start = qd_timer_now_usec();
+    ex->route_misses += 1;
+
+    if (DEQ_SIZE(ex->routes) >= QDR_EXCHANGE_ROUTE_CACHE_MAX) {
+        route = DEQ_TAIL(ex->routes);
+        DEQ_REMOVE_TAIL(ex->routes);
+        qd_hash_remove_by_handle(ex->route_hash, route->hash_handle);
+        qd_hash_handle_free(route->hash_handle);
+        free(route->bindings);
+        free(route->next_hops);
+    } else {
+        route = new_subject_route_t();
+    }
+    ZERO(route);
+    DEQ_ITEM_INIT(route);
+
+    qd_parse_tree_search(ex->parse_tree, subject, gather_next_hops, route);
+    for (int i = 0; i < route->next_hop_count; i++)
+        route->next_hops[i]->in_route = false;
+
+    qd_hash_insert(ex->route_hash, subject, route, &route->hash_handle);
+    DEQ_INSERT_HEAD(ex->routes, route);
+    ex->match_usec += qd_timer_now_usec() - start;
+    return route;
+}
+
+
+// Count one matching clause key of the current message against the bindings
+// on a headers exchange
+static void headers_match_key(qdr_exchange_t  *ex,
+                              subject_route_t *route,
+                              const char      *index_key)
+{
+    headers_key_t *hkey = NULL;
+    qd_iterator_t *iter = qd_iterator_string(index_key, ITER_VIEW_ALL);
+    qd_hash_retrieve(ex->headers_index, iter, (void **)&hkey);
+    qd_iterator_free(iter);
+    if (!hkey)
+        return;
+
+    const uint64_t epoch = ex->headers_epoch;
+    headers_clause_t *clause = DEQ_HEAD(hkey->clauses);
+    while (clause) {
+        // a repeated property must not match the same clause twice
+        if (clause->epoch != epoch) {
+            qdr_binding_t *b = clause->binding;
+            clause->epoch = epoch;
+            if (b->epoch != epoch) {
+                b->epoch = epoch;
+                b->hits  = 0;
+            }
+            if (++b->hits == (b->match_any ? 1 : b->clause_count))
+                route_add_binding(route, b);
+        }
+        clause = DEQ_NEXT(clause);
+    }
+}
+
+
+// Render an application property value the way it is written in a binding
+// key.  Returns the length, or -1 if the type cannot be matched by value.
+static int headers_value_text(qd_parsed_field_t *value, char *text, size_t size)
+{
+    switch (qd_parse_tag(value)) {
+    case QD_AMQP_STR8_UTF8:
+    case QD_AMQP_STR32_UTF8:
+    case QD_AMQP_SYM8:
+    case QD_AMQP_SYM32: {
+        qd_iterator_t *raw = qd_parse_raw(value);
+        int len = qd_iterator_length(raw);
+        if (len >= size)
+            return -1;
+        qd_iterator_reset(raw);
+        qd_iterator_ncopy(raw, (unsigned char *) text, len);
+        text[len] = 0;
+        return strlen(text) == len ? len : -1;   // no embedded NULs
+    }
+
+    case QD_AMQP_BOOLEAN:
+    case QD_AMQP_TRUE:
+    case QD_AMQP_FALSE:
+        return snprintf(text, size, "%s", qd_parse_as_bool(value) ? "true" : "false");
+
+    case QD_AMQP_UBYTE:
+    case QD_AMQP_USHORT:
+    case QD_AMQP_UINT:
+    case QD_AMQP_SMALLUINT:
+    case QD_AMQP_UINT0:
+    case QD_AMQP_ULONG:
+    case QD_AMQP_SMALLULONG:
+    case QD_AMQP_ULONG0:
+        return snprintf(text, size, "%"PRIu64, qd_parse_as_ulong(value));
+
+    case QD_AMQP_BYTE:
+    case QD_AMQP_SHORT:
+    case QD_AMQP_INT:
+    case QD_AMQP_SMALLINT:
+    case QD_AMQP_LONG:
+    case QD_AMQP_SMALLLONG:
+        return snprintf(text, size, "%"PRId64, qd_parse_as_long(value));
+
+    default:
+        return -1;
+    }
+}
+
+
+// Match the application properties of the message against the bindings of a
+// headers exchange.  The work done is proportional to the number of
+// properties in the message and the clauses they hit, not to the number of
+// bindings.
+static subject_route_t *headers_route(qdr_exchange_t *ex, qd_message_t *msg)
+{
+    subject_route_t *route = &ex->headers_route;
+    route->binding_count  = 0;
+    route->next_hop_count = 0;
+    ex->headers_epoch    += 1;
+
+    for (qdr_binding_t *b = DEQ_HEAD(ex->headers_all); b; b = DEQ_NEXT_N(tree_list, b))
+        route_add_binding(route, b);
+
+    qd_iterator_t *props_iter = qd_message_check(msg, QD_DEPTH_APPLICATION_PROPERTIES)
+        ? qd_message_field_iterator(msg, QD_FIELD_APPLICATION_PROPERTIES)
+        : NULL;
+    qd_parsed_field_t *props = props_iter ? qd_parse(props_iter) : NULL;
+
+    if (props && qd_parse_ok(props) && qd_parse_is_map(props)) {
+        char   value[64];
+        char  *index_key = NULL;
+        size_t index_size = 0;
+        uint32_t count = qd_parse_sub_count(props);
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            qd_iterator_t *name = qd_parse_raw(qd_parse_sub_key(props, idx));
+            size_t name_len = qd_iterator_length(name);
+            int value_len = headers_value_text(qd_parse_sub_value(props, idx), value, sizeof(value));
+            size_t needed = name_len + sizeof(value) + 24;
+
+            if (needed > index_size) {
+                index_size = needed;
+                index_key = realloc(index_key, index_size);
+            }
+
+            // presence clause key
+            index_key[0] = 'P';
+            qd_iterator_reset(name);
+            qd_iterator_ncopy(name, (unsigned char *) index_key + 1, name_len);
+            index_key[name_len + 1] = 0;
+            if (strlen(index_key) != name_len + 1)
+                continue;   // embedded NUL: cannot be bound
+            headers_match_key(ex, route, index_key);
+
+            // value clause key: rewrite the prefix in place around the name
+            if (value_len >= 0) {
+                char prefix[24];
+                int  prefix_len = snprintf(prefix, sizeof(prefix), "V%zu:", name_len);
+                memmove(index_key + prefix_len, index_key + 1, name_len);
+                memcpy(index_key, prefix, prefix_len);
+                strcpy(index_key + prefix_len + name_len, value);
+                headers_match_key(ex, route, index_key);
+            }
+        }
+        free(index_key);
+    }
+
+    qd_parse_free(props);
+    qd_iterator_free(props_iter);
+
+    for (int i = 0; i < route->next_hop_count; i++)
+        route->next_hops[i]->in_route = false;
+
+    return route;
+}
+
+
+// Parse a headers exchange binding key.  Returns the number of clauses or -1
+// if the key is malformed.  If index_keys is not NULL it is set to a newly
+// allocated array holding the index key of each clause.
+static int parse_headers_key(const char *key, bool *match_any, char ***index_keys)
+{
+    int   count   = 0;
+    bool  x_match = false;
+    char *copy    = strdup(key);
+    char *cursor  = *copy ? copy : NULL;
+    char **keys   = NULL;
+
+    *match_any = false;
+    while (cursor) {
+        char *entry = cursor;
+        char *comma = strchr(cursor, ',');
+        if (comma) {
+            *comma = 0;
+            cursor = comma + 1;
+        } else {
+            cursor = NULL;
+        }
+
+        char *value = strchr(entry, '=');
+        if (value)
+            *value++ = 0;
+
+        if (*entry == 0)
+            goto error;   // empty entry or name
+
+        if (strcmp(entry, "x-match") == 0) {
+            if (x_match || !value)
+                goto error;
+            if (strcmp(value, "any") == 0)
+                *match_any = true;
+            else if (strcmp(value, "all") != 0)
+                goto error;
+            x_match = true;
+        } else {
+            if (index_keys) {
+                size_t len = strlen(entry);
+                char  *ikey = malloc(len + (value ? strlen(value) : 0) + 24);
+                if (value)
+                    sprintf(ikey, "V%zu:%s%s", len, entry, value);
+                else
+                    sprintf(ikey, "P%s", entry);
+                keys = realloc(keys, (count + 1) * sizeof(char *));
+                keys[count] = ikey;
+            }
+            count++;
+        }
+    }
+
+    free(copy);
+    if (index_keys)
+        *index_keys = keys;
+    return count;
+
+error:
+    for (int i = 0; keys && i < count; i++)
+        free(keys[i]);
+    free(keys);
+    free(copy);
+    return -1;
+}
+
+
+// Discard all cached routes.  Called whenever the bindings change.
+static void flush_subject_routes(qdr_exchange_t *ex)
+{
+    subject_route_t *route = DEQ_HEAD(ex->routes);
+    while (route) {
+        DEQ_REMOVE_HEAD(ex->routes);
+        qd_hash_remove_by_handle(ex->route_hash, route->hash_handle);
+        qd_hash_handle_free(route->hash_handle);
+        free(route->bindings);
+        free(route->next_hops);
+        free_subject_route_t(route);
+        route = DEQ_HEAD(ex->routes);
+    }
+}
+
+
 // Forward a copy of the message to the to_addr address
 static int send_message(qdr_core_t     *core,
                         next_hop_t     *next_hop,
@@ -319,9 +696,7 @@ static int send_message(qdr_core_t     *core,
            next_hop->exchange->name, next_hop->next_hop);
 
     // set "to override" and "phase" message annotations based on the next hop
-    qd_composed_field_t *to_field = qd_compose_subfield(0);
-    qd_compose_insert_string(to_field, (char *)next_hop->next_hop);
-    qd_message_set_to_override_annotation(copy, to_field);  // frees to_field
+    qd_message_set_to_override_buffers(copy, &next_hop->to_override);
     qd_message_set_phase_annotation(copy, next_hop->phase);
 
     count = qdr_forward_message_CT(core, next_hop->qdr_addr, copy, in_delivery, exclude_inprocess, control);
@@ -359,6 +734,9 @@ qdr_address_t *qdr_exchange_alternate_addr(const qdr_exchange_t *ex)
 #define QDR_CONFIG_EXCHANGE_DROPPED       9
 #define QDR_CONFIG_EXCHANGE_FORWARDED     10
 #define QDR_CONFIG_EXCHANGE_DIVERTED      11
+#define QDR_CONFIG_EXCHANGE_ROUTE_HITS    12
+#define QDR_CONFIG_EXCHANGE_ROUTE_MISSES  13
+#define QDR_CONFIG_EXCHANGE_MATCH_MICROS  14
 
 const char *qdr_config_exchange_columns[QDR_CONFIG_EXCHANGE_COLUMN_COUNT + 1] =
     {"name",
@@ -373,6 +751,9 @@ const char *qdr_config_exchange_columns[QDR_CONFIG_EXCHANGE_COLUMN_COUNT + 1] =
      "droppedCount",
      "forwardedCount",
      "divertedCount",
+     "routeCacheHits",
+     "routeCacheMisses",
+     "matchMicros",
      0};
 
 // from management_agent.c
@@ -460,11 +841,14 @@ void qdra_config_exchange_create_CT(qdr_core_t         *core,
     qd_parsed_field_t *method_field = qd_parse_value_by_key(in_body,
                                                             qdr_config_exchange_columns[QDR_CONFIG_EXCHANGE_MATCH_METHOD]);
     qd_parse_tree_type_t method = QD_PARSE_TREE_AMQP_0_10;
+    bool headers = false;
     if (method_field) {
         if (qd_iterator_equal(qd_parse_raw(method_field), (const unsigned char *)"mqtt")) {
             method = QD_PARSE_TREE_MQTT;
+        } else if (qd_iterator_equal(qd_parse_raw(method_field), (const unsigned char *)"headers")) {
+            headers = true;
         } else if (!qd_iterator_equal(qd_parse_raw(method_field), (const unsigned char *)"amqp")) {
-            query->status.description = "Exchange matchMethod must be either 'amqp' or 'mqtt'";
+            query->status.description = "Exchange matchMethod must be one of 'amqp', 'mqtt' or 'headers'";
             goto exit;
         }
     }
@@ -497,7 +881,7 @@ void qdra_config_exchange_create_CT(qdr_core_t         *core,
         }
     }
 
-    ex = qdr_exchange(core, name, address, phase, alternate, alt_phase, method);
+    ex = qdr_exchange(core, name, address, phase, alternate, alt_phase, method, headers);
     if (ex) {
         // @TODO(kgiusti) - for now, until the behavior is nailed down:
         static int warn_user;
@@ -715,10 +1099,20 @@ void qdra_config_binding_create_CT(qdr_core_t         *core,
 
     qd_parsed_field_t *key_field = qd_parse_value_by_key(in_body,
                                                          qdr_config_binding_columns[QDR_CONFIG_BINDING_KEY]);
-    // if no pattern given, assume match all "#":
-    key = key_field ? qd_iterator_dup(qd_parse_raw(key_field)) : qd_iterator_string("#", ITER_VIEW_ALL);
-
-    if (!qd_parse_tree_validate_pattern(ex->parse_tree, key)) {
+    // if no pattern given, assume match all ("#", or no clauses for headers):
+    key = key_field ? qd_iterator_dup(qd_parse_raw(key_field))
+        : qd_iterator_string(ex->headers ? "" : "#", ITER_VIEW_ALL);
+
+    if (ex->headers) {
+        bool match_any;
+        char *key_str = (char *) qd_iterator_copy(key);
+        int clauses = parse_headers_key(key_str, &match_any, NULL);
+        free(key_str);
+        if (clauses < 0) {
+            query->status.description = "The binding key is not a valid list of header clauses";
+            goto exit;
+        }
+    } else if (!qd_parse_tree_validate_pattern(ex->parse_tree, key)) {
         query->status.description = "The binding key pattern is invalid";
         goto exit;
     }
@@ -885,7 +1279,8 @@ static qdr_exchange_t *qdr_exchange(qdr_core_t *core,
                                     int            phase,
                                     qd_iterator_t *alternate,
                                     int            alt_phase,
-                                    qd_parse_tree_type_t method)
+                                    qd_parse_tree_type_t method,
+                                    bool           headers)
 {
     assert(address);
     qdr_exchange_t *ex = new_qdr_exchange_t();
@@ -897,9 +1292,17 @@ static qdr_exchange_t *qdr_exchange(qdr_core_t *core,
         ex->name = qd_iterator_copy(name);
         ex->address = qd_iterator_copy(address);
         ex->phase = phase;
-        ex->parse_tree = qd_parse_tree_new(method);
+        if (headers) {
+            ex->headers = true;
+            ex->headers_index = qd_hash(8, 32, 0);
+            DEQ_INIT(ex->headers_all);
+        } else {
+            ex->parse_tree = qd_parse_tree_new(method);
+        }
+        ex->route_hash = qd_hash(6, 32, 0);
         DEQ_INIT(ex->bindings);
         DEQ_INIT(ex->next_hops);
+        DEQ_INIT(ex->routes);
 
         qd_iterator_reset_view(address, ITER_VIEW_ADDRESS_HASH);
         qd_iterator_annotate_phase(address, (char) phase + '0');
@@ -919,6 +1322,7 @@ static qdr_exchange_t *qdr_exchange(qdr_core_t *core,
                                                  old ? old->bypass_valid_origins: false);
         ex->old_forwarder = old;
         ex->qdr_addr->forwarder = new;
+        qdr_forward_select_CT(core, ex->qdr_addr);
         ex->qdr_addr->ref_count += 1;
         ex->qdr_addr->exchange = ex;
         DEQ_INSERT_TAIL(core->exchanges, ex);
@@ -955,18 +1359,87 @@ static void qdr_exchange_free(qdr_exchange_t *ex)
 
     free(ex->qdr_addr->forwarder);
     ex->qdr_addr->forwarder = ex->old_forwarder;
+    qdr_forward_select_CT(ex->core, ex->qdr_addr);
     assert(ex->qdr_addr->ref_count > 0);
     ex->qdr_addr->ref_count -= 1;
     qdr_check_addr_CT(ex->core, ex->qdr_addr);
     free(ex->name);
     free(ex->address);
 
-    qd_parse_tree_free(ex->parse_tree);
+    flush_subject_routes(ex);
+    qd_hash_free(ex->route_hash);
+    if (ex->headers) {
+        qd_hash_free(ex->headers_index);
+        free(ex->headers_route.bindings);
+        free(ex->headers_route.next_hops);
+    } else {
+        qd_parse_tree_free(ex->parse_tree);
+    }
     free_qdr_exchange_t(ex);
 }
 
 // Binding constructor/destructor
 
+// Add the clauses of a (valid) binding key to a headers exchange's index
+static void headers_binding_index(qdr_exchange_t *ex, qdr_binding_t *b)
+{
+    char **index_keys = NULL;
+    b->clause_count = parse_headers_key((const char *) b->key, &b->match_any, &index_keys);
+    assert(b->clause_count >= 0);
+
+    if (b->clause_count == 0) {
+        // x-match=all with no clauses matches every message, x-match=any none
+        if (!b->match_any)
+            DEQ_INSERT_TAIL_N(tree_list, ex->headers_all, b);
+        return;
+    }
+
+    b->clauses = calloc(b->clause_count, sizeof(headers_clause_t));
+    for (int i = 0; i < b->clause_count; i++) {
+        headers_clause_t *clause = &b->clauses[i];
+        headers_key_t    *hkey   = NULL;
+        qd_iterator_t    *iter   = qd_iterator_string(index_keys[i], ITER_VIEW_ALL);
+
+        qd_hash_retrieve(ex->headers_index, iter, (void **)&hkey);
+        if (!hkey) {
+            hkey = NEW(headers_key_t);
+            ZERO(hkey);
+            DEQ_INIT(hkey->clauses);
+            qd_hash_insert(ex->headers_index, iter, hkey, &hkey->hash_handle);
+        }
+        qd_iterator_free(iter);
+        free(index_keys[i]);
+
+        DEQ_ITEM_INIT(clause);
+        clause->binding = b;
+        clause->key     = hkey;
+        DEQ_INSERT_TAIL(hkey->clauses, clause);
+    }
+    free(index_keys);
+}
+
+
+static void headers_binding_unindex(qdr_exchange_t *ex, qdr_binding_t *b)
+{
+    if (b->clause_count == 0 && !b->match_any)
+        DEQ_REMOVE_N(tree_list, ex->headers_all, b);
+
+    for (int i = 0; i < b->clause_count; i++) {
+        headers_clause_t *clause = &b->clauses[i];
+        headers_key_t    *hkey   = clause->key;
+        DEQ_REMOVE(hkey->clauses, clause);
+        if (DEQ_IS_EMPTY(hkey->clauses)) {
+            qd_hash_remove_by_handle(ex->headers_index, hkey->hash_handle);
+            qd_hash_handle_free(hkey->hash_handle);
+            free(hkey);
+        }
+    }
+    free(b->clauses);
+    b->clauses = NULL;
+    b->clause_count = 0;
+}
+
+
 static qdr_binding_t *qdr_binding(qdr_exchange_t *ex,
                                   qd_iterator_t *name,
                                   qd_iterator_t *key,
@@ -985,16 +1458,21 @@ static qdr_binding_t *qdr_binding(qdr_exchange_t *ex,
         b->key = qd_iterator_copy(key);
         b->next_hop = next_hop(ex, nhop, phase);
 
-        qdr_binding_list_t  *bindings = NULL;
-        if (!qd_parse_tree_get_pattern(ex->parse_tree, key, (void **)&bindings)) {
-            // new pattern
-            bindings = malloc(sizeof(*bindings));
-            DEQ_INIT(*bindings);
-            qd_parse_tree_add_pattern(ex->parse_tree, key, bindings);
+        if (ex->headers) {
+            headers_binding_index(ex, b);
+        } else {
+            qdr_binding_list_t  *bindings = NULL;
+            if (!qd_parse_tree_get_pattern(ex->parse_tree, key, (void **)&bindings)) {
+                // new pattern
+                bindings = malloc(sizeof(*bindings));
+                DEQ_INIT(*bindings);
+                qd_parse_tree_add_pattern(ex->parse_tree, key, bindings);
+            }
+            assert(bindings);
+            DEQ_INSERT_TAIL_N(tree_list, *bindings, b);
         }
-        assert(bindings);
-        DEQ_INSERT_TAIL_N(tree_list, *bindings, b);
         DEQ_INSERT_TAIL_N(exchange_list, ex->bindings, b);
+        flush_subject_routes(ex);
     }
     return b;
 }
@@ -1005,17 +1483,24 @@ static void qdr_binding_free(qdr_binding_t *b)
     qdr_binding_list_t *bindings = NULL;
     qdr_exchange_t *ex = b->exchange;
 
-    qd_iterator_t *k_iter = qd_iterator_string((char *)b->key,
-                                               ITER_VIEW_ALL);
-    if (qd_parse_tree_get_pattern(ex->parse_tree, k_iter, (void **)&bindings)) {
-        assert(bindings && !DEQ_IS_EMPTY(*bindings));
-        DEQ_REMOVE_N(tree_list, *bindings, b);
-        if (DEQ_IS_EMPTY(*bindings)) {
-            qd_parse_tree_remove_pattern(ex->parse_tree, k_iter);
-            free(bindings);
+    // cached routes may reference the binding or its next hop
+    flush_subject_routes(ex);
+
+    if (ex->headers) {
+        headers_binding_unindex(ex, b);
+    } else {
+        qd_iterator_t *k_iter = qd_iterator_string((char *)b->key,
+                                                   ITER_VIEW_ALL);
+        if (qd_parse_tree_get_pattern(ex->parse_tree, k_iter, (void **)&bindings)) {
+            assert(bindings && !DEQ_IS_EMPTY(*bindings));
+            DEQ_REMOVE_N(tree_list, *bindings, b);
+            if (DEQ_IS_EMPTY(*bindings)) {
+                qd_parse_tree_remove_pattern(ex->parse_tree, k_iter);
+                free(bindings);
+            }
         }
+        qd_iterator_free(k_iter);
     }
-    qd_iterator_free(k_iter);
 
     DEQ_REMOVE_N(exchange_list, b->exchange->bindings, b);
     free(b->name);
@@ -1037,11 +1522,16 @@ static next_hop_t *next_hop(qdr_exchange_t *ex,
         if (!nh) return NULL;
         ZERO(nh);
         DEQ_ITEM_INIT_N(exchange_list, nh);
-        DEQ_ITEM_INIT_N(transmit_list, nh);
         nh->exchange = ex;
         nh->next_hop = qd_iterator_copy(address);
         nh->phase = phase;
 
+        qd_composed_field_t *to_field = qd_compose_subfield(0);
+        qd_compose_insert_string(to_field, (char *)nh->next_hop);
+        DEQ_INIT(nh->to_override);
+        qd_compose_take_buffers(to_field, &nh->to_override);
+        qd_compose_free(to_field);
+
         qd_iterator_reset_view(address, ITER_VIEW_ADDRESS_HASH);
         qd_iterator_annotate_phase(address, (char) phase + '0');
         qd_hash_retrieve(ex->core->addr_hash, address, (void **)&nh->qdr_addr);
@@ -1070,7 +1560,8 @@ static void next_hop_release(next_hop_t *nh)
             qdr_check_addr_CT(nh->exchange->core, nh->qdr_addr);
         }
         DEQ_REMOVE_N(exchange_list, nh->exchange->next_hops, nh);
-        assert(!nh->on_xmit_list);
+        assert(!nh->in_route);
+        qd_buffer_list_free_buffers(&nh->to_override);
         free(nh->next_hop);
         free_next_hop_t(nh);
     }
@@ -1164,6 +1655,10 @@ static void exchange_insert_column(qdr_exchange_t *ex, int col, qd_composed_fiel
         break;
 
     case QDR_CONFIG_EXCHANGE_MATCH_METHOD:
+        if (ex->headers) {
+            qd_compose_insert_string(body, "headers");
+            break;
+        }
         switch (qd_parse_tree_type(ex->parse_tree)) {
         case QD_PARSE_TREE_AMQP_0_10:
             qd_compose_insert_string(body, "amqp");
@@ -1195,6 +1690,18 @@ static void exchange_insert_column(qdr_exchange_t *ex, int col, qd_composed_fiel
     case QDR_CONFIG_EXCHANGE_DIVERTED:
         qd_compose_insert_ulong(body, ex->msgs_alternate);
         break;
+
+    case QDR_CONFIG_EXCHANGE_ROUTE_HITS:
+        qd_compose_insert_ulong(body, ex->route_hits);
+        break;
+
+    case QDR_CONFIG_EXCHANGE_ROUTE_MISSES:
+        qd_compose_insert_ulong(body, ex->route_misses);
+        break;
+
+    case QDR_CONFIG_EXCHANGE_MATCH_MICROS:
+        qd_compose_insert_ulong(body, ex->match_usec);
+        break;
     }
 }
 
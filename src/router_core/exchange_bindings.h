@@ -20,7 +20,7 @@
  */
 
 
-#define QDR_CONFIG_EXCHANGE_COLUMN_COUNT 12
+#define QDR_CONFIG_EXCHANGE_COLUMN_COUNT 15
 #define QDR_CONFIG_BINDING_COLUMN_COUNT  7
 
 extern const char *qdr_config_exchange_columns[];
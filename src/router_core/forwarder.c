@@ -19,9 +19,22 @@
 
 #include "router_core_private.h"
 #include <qpid/dispatch/amqp.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <strings.h>
+#include <time.h>
 #include "forwarder.h"
+#include "probes.h"
+
+//
+// A multicast message identity is remembered this long (in core ticks, i.e. seconds)
+// or until this many newer ones have been seen, whichever comes first.
+//
+#define QDR_MULTICAST_SEEN_TICKS 5
+#define QDR_MULTICAST_SEEN_MAX   65536
+
+ALLOC_DEFINE(qdr_multicast_seen_t);
+ALLOC_DEFINE(qdr_queued_message_t);
 
 typedef struct qdr_forward_deliver_info_t {
     DEQ_LINKS(struct qdr_forward_deliver_info_t);
@@ -29,15 +42,84 @@ typedef struct qdr_forward_deliver_info_t {
     qdr_delivery_t *out_dlv;
 } qdr_forward_deliver_info_t;
 
-ALLOC_DECLARE(qdr_forward_deliver_info_t);
 DEQ_DECLARE(qdr_forward_deliver_info_t, qdr_forward_deliver_info_list_t);
 
-ALLOC_DEFINE(qdr_forward_deliver_info_t);
 
+static uint32_t qdr_address_stripe_hash(qdr_address_t *addr)
+{
+    if (addr->stripe_hash == 0) {
+        // djb2 over the address key, never left at zero so it is computed once
+        uint32_t hash = 5381;
+        const unsigned char *key = addr->hash_handle ? qd_hash_key_by_handle(addr->hash_handle) : 0;
+        if (key)
+            while (*key)
+                hash = ((hash << 5) + hash) + *key++;
+        addr->stripe_hash = hash | 1;
+    }
+    return addr->stripe_hash;
+}
+
+
+qdr_link_t *qdr_peer_stripe_link_CT(qdr_core_t *core, int mask_bit, int priority, qdr_address_t *addr)
+{
+    qdr_priority_sheaf_t *sheaf = core->data_links_by_mask_bit + mask_bit;
+    qdr_link_t           *link  = sheaf->links[priority];
+
+    if (!link || !addr || sheaf->stripe_count == 0)
+        return link;
+
+    qdr_link_t *candidates[QDR_MAX_DATA_STRIPES + 1];
+    int         count = 0;
+    candidates[count++] = link;
+    for (int stripe = 0; stripe < QDR_MAX_DATA_STRIPES; stripe++)
+        if (sheaf->stripes[stripe][priority])
+            candidates[count++] = sheaf->stripes[stripe][priority];
 
-static qdr_link_t * peer_data_link(qdr_core_t *core,
-                                   qdr_node_t *node,
-                                   int         priority)
+    return candidates[qdr_address_stripe_hash(addr) % count];
+}
+
+
+//
+// The neighbors through which rnode can be reached, at most max of them.  Without
+// equal-cost multipath this is just the one next hop.
+//
+static int qdr_forward_next_nodes_CT(qdr_core_t *core, qdr_node_t *rnode, qdr_node_t **nodes, int max)
+{
+    int count = 0;
+
+    if (rnode->equal_cost_hops) {
+        int bit, c;
+        for (QD_BITMASK_EACH(rnode->equal_cost_hops, bit, c)) {
+            qdr_node_t *hop = core->routers_by_mask_bit[bit];
+            if (hop && hop->link_mask_bit >= 0 && count < max)
+                nodes[count++] = hop;
+        }
+    }
+
+    if (count == 0)
+        nodes[count++] = rnode->next_hop ? rnode->next_hop : rnode;
+    return count;
+}
+
+
+//
+// The neighbor to forward an address's traffic to rnode through.  Among equal-cost
+// next hops the address hash picks one, so each address keeps to a single path
+// while the addresses as a whole spread over all of them.  The upper bits of the
+// hash are used so the choice is independent of the data stripe.
+//
+static qdr_node_t *qdr_forward_next_node_CT(qdr_core_t *core, qdr_node_t *rnode, qdr_address_t *addr)
+{
+    qdr_node_t *nodes[QDR_MAX_EQUAL_COST_HOPS];
+    int         count = qdr_forward_next_nodes_CT(core, rnode, nodes, QDR_MAX_EQUAL_COST_HOPS);
+    return nodes[count > 1 ? (qdr_address_stripe_hash(addr) >> 16) % count : 0];
+}
+
+
+static qdr_link_t * peer_data_link(qdr_core_t    *core,
+                                   qdr_node_t    *node,
+                                   int            priority,
+                                   qdr_address_t *addr)
 {
     int nlmb = node->link_mask_bit;
 
@@ -46,14 +128,12 @@ static qdr_link_t * peer_data_link(qdr_core_t *core,
 
     // Try to return the requested priority link, but if it does
     // not exist, return the closest one that is lower.
-    qdr_link_t * link = 0;
     while (1) {
-        if ((link = core->data_links_by_mask_bit[nlmb].links[priority]))
-            return link;
+        if (core->data_links_by_mask_bit[nlmb].links[priority])
+            return qdr_peer_stripe_link_CT(core, nlmb, priority, addr);
         if (-- priority < 0)
             return 0;
     }
-    return link;
 }
 
 
@@ -127,6 +207,10 @@ qdr_delivery_t *qdr_forward_new_delivery_CT(qdr_core_t *core, qdr_delivery_t *in
 
     out_dlv->ingress_time  = in_dlv ? in_dlv->ingress_time  : core->uptime_ticks;
     out_dlv->ingress_index = in_dlv ? in_dlv->ingress_index : -1;
+    out_dlv->owner_thread  = in_dlv ? in_dlv->owner_thread  : -1;
+    out_dlv->ingress_usec  = in_dlv ? in_dlv->ingress_usec  : 0;
+    out_dlv->core_usec     = in_dlv ? in_dlv->core_usec     : 0;
+    out_dlv->queued_usec   = out_dlv->ingress_usec ? qd_timer_now_usec() : 0;
 
     //
     // Add one to the message fanout. This will later be used in the qd_message_send function that sends out messages.
@@ -137,81 +221,229 @@ qdr_delivery_t *qdr_forward_new_delivery_CT(qdr_core_t *core, qdr_delivery_t *in
     // Create peer linkage if the outgoing delivery is unsettled. This peer linkage is necessary to deal with dispositions that show up in the future.
     // Also create peer linkage if the message is not yet been completely received. This linkage will help us stream large pre-settled multicast messages.
     //
-    if (!out_dlv->settled || !qd_message_receive_complete(msg))
+    if (!out_dlv->settled || !qd_message_receive_complete(msg)) {
         qdr_delivery_link_peers_CT(in_dlv, out_dlv);
+        if (in_dlv && !qd_message_receive_complete(msg))
+            qdr_delivery_add_stream_peer_CT(core, in_dlv, out_dlv);
+    }
 
     return out_dlv;
 }
 
 
 //
-// Drop all pre-settled deliveries pending on the link's
-// undelivered list.
+// A queued pre-settled delivery may be dropped unless it is in a link_work
+// record that is being processed.  If it's being processed, it is too late
+// to drop the delivery.
 //
-static void qdr_forward_drop_presettled_CT_LH(qdr_core_t *core, qdr_link_t *link)
+static inline bool qdr_forward_droppable_CT_LH(qdr_delivery_t *dlv)
 {
-    qdr_delivery_t *dlv = DEQ_HEAD(link->undelivered);
+    return dlv->settled && dlv->link_work && !dlv->link_work->processing;
+}
+
+
+//
+// Take a droppable pre-settled delivery off the link's undelivered list and
+// return its credit.
+//
+static void qdr_forward_unqueue_presettled_CT_LH(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv)
+{
+    DEQ_REMOVE(link->undelivered, dlv);
+    dlv->where = QDR_DELIVERY_NOWHERE;
 
-    if (!dlv)
-        return;
     //
-    // Remove leading delivery from consideration.
-    // Parts of this message may have been transmitted already and dropping
-    // it may corrupt outbound data.
+    // The link-work item representing this pending delivery must be
+    // updated to reflect the removal of the delivery.  If the item
+    // has no other deliveries associated with it, it can be removed
+    // from the work list.
     //
+    assert(dlv->link_work);
+    if (dlv->link_work && (--dlv->link_work->value == 0)) {
+        DEQ_REMOVE(link->work_list, dlv->link_work);
+        free_qdr_link_work_t(dlv->link_work);
+        dlv->link_work = 0;
+    }
+    dlv->disposition = PN_RELEASED;
+    qdr_delivery_decref_CT(core, dlv, "qdr_forward_unqueue_presettled_CT_LH - remove from link-work list");
+    link->credit_available++;
+}
+
+
+//
+// Remove one pre-settled delivery from the link's undelivered list.
+//
+static void qdr_forward_drop_one_presettled_CT_LH(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv,
+                                                  qdr_presettled_drop_t policy)
+{
+    qdr_forward_unqueue_presettled_CT_LH(core, link, dlv);
+
+    // Increment the presettled_dropped_deliveries on the out_link
+    link->dropped_presettled_deliveries++;
+    core->dropped_presettled_deliveries++;
+    core->presettled_dropped[policy]++;
+}
+
+
+//
+// Make room on a backed-up link for an arriving pre-settled delivery according
+// to the drop policy.  The leading delivery is never considered: parts of it
+// may have been transmitted already and dropping it may corrupt outbound data.
+// Returns false if the arriving delivery should be dropped instead.
+//
+static bool qdr_forward_drop_presettled_CT_LH(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *arriving,
+                                              qdr_presettled_drop_t policy, int sample_rate)
+{
+    qdr_delivery_t *dlv = DEQ_HEAD(link->undelivered);
+
+    if (!dlv)
+        return true;
     dlv = DEQ_NEXT(dlv);
 
     qdr_delivery_t *next;
 
-    while (dlv) {
-        next = DEQ_NEXT(dlv);
-        //
-        // Remove pre-settled deliveries unless they are in a link_work
-        // record that is being processed.  If it's being processed, it is
-        // too late to drop the delivery.
-        //
-        if (dlv->settled && dlv->link_work && !dlv->link_work->processing) {
-            DEQ_REMOVE(link->undelivered, dlv);
-            dlv->where = QDR_DELIVERY_NOWHERE;
+    switch (policy) {
+    case QDR_PRESETTLED_DROP_ALL:
+        while (dlv) {
+            next = DEQ_NEXT(dlv);
+            if (qdr_forward_droppable_CT_LH(dlv))
+                qdr_forward_drop_one_presettled_CT_LH(core, link, dlv, policy);
+            dlv = next;
+        }
+        return true;
 
-            //
-            // The link-work item representing this pending delivery must be
-            // updated to reflect the removal of the delivery.  If the item
-            // has no other deliveries associated with it, it can be removed
-            // from the work list.
-            //
-            assert(dlv->link_work);
-            if (dlv->link_work && (--dlv->link_work->value == 0)) {
-                DEQ_REMOVE(link->work_list, dlv->link_work);
-                free_qdr_link_work_t(dlv->link_work);
-                dlv->link_work = 0;
+    //
+    // An arriving delivery that is still streaming in is linked to its peer and
+    // must be queued.
+    //
+    case QDR_PRESETTLED_DROP_NEWEST:
+        if (qd_message_receive_complete(arriving->msg))
+            return false;
+        break;
+
+    case QDR_PRESETTLED_DROP_SAMPLE:
+        if (link->presettled_sampled++ % sample_rate != 0 && qd_message_receive_complete(arriving->msg))
+            return false;
+        break;
+
+    case QDR_PRESETTLED_DROP_CONFLATE:
+        if (arriving->conflation_key) {
+            for (; dlv; dlv = DEQ_NEXT(dlv)) {
+                if (qdr_forward_droppable_CT_LH(dlv) && dlv->conflation_key
+                    && strcmp(dlv->conflation_key, arriving->conflation_key) == 0) {
+                    qdr_forward_drop_one_presettled_CT_LH(core, link, dlv, policy);
+                    return true;
+                }
             }
-            dlv->disposition = PN_RELEASED;
-            qdr_delivery_decref_CT(core, dlv, "qdr_forward_drop_presettled_CT_LH - remove from link-work list");
-
-            // Increment the presettled_dropped_deliveries on the out_link
-            link->dropped_presettled_deliveries++;
-            core->dropped_presettled_deliveries++;
+            dlv = DEQ_NEXT(DEQ_HEAD(link->undelivered));
         }
-        dlv = next;
+        break;
+
+    default:
+        break;
     }
+
+    //
+    // Drop the oldest delivery that can be dropped.
+    //
+    while (dlv && !qdr_forward_droppable_CT_LH(dlv))
+        dlv = DEQ_NEXT(dlv);
+    if (dlv)
+        qdr_forward_drop_one_presettled_CT_LH(core, link, dlv, policy);
+    return true;
+}
+
+
+//
+// Queue a delivery on a priority-ordered link behind the deliveries of its own
+// priority or higher.  It never goes ahead of the first QDR_LINK_DELIVERY_BATCH
+// deliveries: the link's I/O thread may be sending those, and expects them to
+// stay at the head of the list in order.
+//
+static void qdr_forward_insert_by_priority_CT_LH(qdr_link_t *link, qdr_delivery_t *dlv)
+{
+    qdr_delivery_t *after    = DEQ_TAIL(link->undelivered);
+    int             position = (int) DEQ_SIZE(link->undelivered);
+
+    while (after && position > QDR_LINK_DELIVERY_BATCH && after->priority < dlv->priority) {
+        after = DEQ_PREV(after);
+        position--;
+    }
+
+    if (after)
+        DEQ_INSERT_AFTER(link->undelivered, dlv, after);
+    else
+        DEQ_INSERT_TAIL(link->undelivered, dlv);
 }
 
 
 void qdr_forward_deliver_CT(qdr_core_t *core, qdr_link_t *out_link, qdr_delivery_t *out_dlv)
 {
+    //
+    // Drop policies other than the default apply only to client links whose
+    // address configures one.
+    //
+    qdr_presettled_drop_t  policy      = QDR_PRESETTLED_DROP_ALL;
+    int                    sample_rate = 1;
+    qdr_address_config_t  *config      = out_link->owning_addr ? out_link->owning_addr->config : 0;
+    if (config && out_dlv->settled && out_link->link_type == QD_LINK_ENDPOINT && !out_link->core_endpoint) {
+        policy      = config->presettled_drop;
+        sample_rate = config->presettled_sample_rate;
+    }
+
+    //
+    // Ordering the undelivered list by priority applies to the same links.  The
+    // priority is taken from the message before the work lock, like the group-id below.
+    //
+    bool ordered = false;
+    if (config && config->priority_ordered && out_link->link_type == QD_LINK_ENDPOINT && !out_link->core_endpoint) {
+        ordered = true;
+        out_dlv->priority = out_link->owning_addr->priority >= 0 ?
+            out_link->owning_addr->priority : qd_message_get_priority(out_dlv->msg);
+    }
+
+    //
+    // Conflation compares group-ids while the work lock is held, so take
+    // the arriving message's group-id first.
+    //
+    if (policy == QDR_PRESETTLED_DROP_CONFLATE && !out_dlv->conflation_key) {
+        qd_iterator_t *group_id = qd_message_field_iterator(out_dlv->msg, QD_FIELD_GROUP_ID);
+        if (group_id) {
+            out_dlv->conflation_key = (char*) qd_iterator_copy(group_id);
+            qd_iterator_free(group_id);
+        }
+    }
+
     sys_mutex_lock(out_link->conn->work_lock);
 
     //
     // If the delivery is pre-settled and the outbound link is at or above capacity,
-    // discard all pre-settled deliveries on the undelivered list prior to enqueuing
-    // the new delivery.
+    // make room according to the drop policy before enqueuing the new delivery, or
+    // drop the new delivery itself.
     //
-    if (out_dlv->settled && out_link->capacity > 0 && DEQ_SIZE(out_link->undelivered) >= out_link->capacity)
-        qdr_forward_drop_presettled_CT_LH(core, out_link);
+    if (out_dlv->settled && out_link->capacity > 0 && DEQ_SIZE(out_link->undelivered) >= out_link->capacity) {
+        if (!qdr_forward_drop_presettled_CT_LH(core, out_link, out_dlv, policy, sample_rate)) {
+            sys_mutex_unlock(out_link->conn->work_lock);
+
+            out_dlv->disposition = PN_RELEASED;
+            out_link->dropped_presettled_deliveries++;
+            core->dropped_presettled_deliveries++;
+            core->presettled_dropped[policy]++;
+
+            //
+            // Nothing else holds a reference to the new delivery; this frees it.
+            //
+            qdr_delivery_incref(out_dlv, "qdr_forward_deliver_CT - dropped on arrival");
+            qdr_delivery_decref_CT(core, out_dlv, "qdr_forward_deliver_CT - dropped on arrival");
+            return;
+        }
+    }
 
-    DEQ_INSERT_TAIL(out_link->undelivered, out_dlv);
+    if (ordered)
+        qdr_forward_insert_by_priority_CT_LH(out_link, out_dlv);
+    else
+        DEQ_INSERT_TAIL(out_link->undelivered, out_dlv);
     out_dlv->where = QDR_DELIVERY_IN_UNDELIVERED;
+    out_link->credit_available--;
 
     // This incref is for putting the delivery in the undelivered list
     qdr_delivery_incref(out_dlv, "qdr_forward_deliver_CT - add to undelivered list");
@@ -231,18 +463,26 @@ void qdr_forward_deliver_CT(qdr_core_t *core, qdr_link_t *out_link, qdr_delivery
         work->value     = 1;
         DEQ_INSERT_TAIL(out_link->work_list, work);
     }
-    qdr_add_link_ref(out_link->conn->links_with_work + out_link->priority, out_link, QDR_LINK_LIST_CLASS_WORK);
+    qdr_add_link_ref(qdr_connection_work_links(out_link->conn, out_link->priority), out_link, QDR_LINK_LIST_CLASS_WORK);
 
     out_dlv->link_work = work;
     sys_mutex_unlock(out_link->conn->work_lock);
 
+    //
+    // A queued pre-settled message that can expire arms the sweep that drops
+    // it should it expire before the link gets to it.
+    //
+    if (out_dlv->settled && !qdr_core_timer_scheduled_CT(core->expiry_timer)
+        && qd_message_receive_complete(out_dlv->msg) && qd_message_expiry(out_dlv->msg))
+        qdr_core_timer_schedule_CT(core, core->expiry_timer, 1);
+
     //
     // We are dealing here only with link routed deliveries
     // If the out_link has a connected link and if the out_link is an inter-router link, increment the global deliveries_transit
     // If the out_link is a route container link, add to the global deliveries_egress
     //
     if (out_link->connected_link) {
-        if (out_link->conn->role == QDR_ROLE_INTER_ROUTER) {
+        if (out_link->conn->role == QDR_ROLE_INTER_ROUTER || out_link->conn->role == QDR_ROLE_INTER_ROUTER_DATA) {
             core->deliveries_transit++;
         }
         else {
@@ -294,20 +534,264 @@ static uint8_t qdr_forward_effective_priority(qd_message_t *msg, qdr_address_t *
 
 
 /**
- * Determine if forwarding a delivery onto a link will result in edge-echo.
+ * Determine if forwarding a delivery onto a link will result in edge-echo.  On an edge
+ * router with several uplinks this includes passing a delivery from one interior router
+ * to another.
  */
-static inline bool qdr_forward_edge_echo_CT(qdr_delivery_t *in_dlv, qdr_link_t *out_link)
+static inline bool qdr_forward_edge_echo_CT(qdr_core_t *core, qdr_delivery_t *in_dlv, qdr_link_t *out_link)
 {
-    return (in_dlv && in_dlv->via_edge && in_dlv->link->conn == out_link->conn);
+    if (!in_dlv || !in_dlv->via_edge)
+        return false;
+    if (in_dlv->link->conn == out_link->conn)
+        return true;
+    return core->router_mode == QD_ROUTER_MODE_EDGE && out_link->edge;
 }
 
 
-int qdr_forward_multicast_CT(qdr_core_t      *core,
-                             qdr_address_t   *addr,
-                             qd_message_t    *msg,
-                             qdr_delivery_t  *in_delivery,
-                             bool             exclude_inprocess,
-                             bool             control)
+//
+// Group-id affinity: an address configured with groupAffinity sends each group
+// to one consumer, picked by rendezvous hashing.  Every candidate destination is
+// scored by mixing its key with the hash of the group-id and the highest score
+// wins, so a consumer leaving moves only its own groups and one joining takes
+// only the groups it now scores highest for.
+//
+static inline uint64_t qdr_forward_affinity_score(uint64_t destination, uint32_t group)
+{
+    uint64_t x = destination ^ ((uint64_t) group << 32 | group);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+//
+// True if the message should go to its group's consumer, with the hash of its
+// group-id.  Messages without a group-id are forwarded by the usual treatment.
+//
+static inline bool qdr_forward_group_CT(qdr_address_t *addr, qd_message_t *msg, uint32_t *group)
+{
+    return addr->config && addr->config->group_affinity && qd_message_group_hash(msg, group);
+}
+
+
+//
+// The local consumer link with the highest score for the group, skipping links
+// that would edge-echo.  Links are keyed by identity, which is stable for the
+// life of the link.
+//
+static qdr_link_ref_t *qdr_forward_affinity_link_CT(qdr_core_t     *core,
+                                                    qdr_address_t  *addr,
+                                                    qdr_delivery_t *in_delivery,
+                                                    uint32_t        group,
+                                                    uint64_t       *score)
+{
+    qdr_link_ref_t *best = 0;
+
+    for (qdr_link_ref_t *link_ref = DEQ_HEAD(addr->rlinks); link_ref; link_ref = DEQ_NEXT(link_ref)) {
+        if (qdr_forward_edge_echo_CT(core, in_delivery, link_ref->link))
+            continue;
+        uint64_t value = qdr_forward_affinity_score(link_ref->link->identity, group);
+        if (!best || value > *score) {
+            best   = link_ref;
+            *score = value;
+        }
+    }
+    return best;
+}
+
+
+//
+// The remote router in mask with the highest score for the group, or -1.  Routers
+// are keyed by mask bit, kept apart from link identities by the top bit.  With an
+// origin (>= 0) only routers that are valid destinations for it are considered.
+//
+static int qdr_forward_affinity_router_CT(qdr_core_t   *core,
+                                          qd_bitmask_t *mask,
+                                          int           origin,
+                                          uint32_t      group,
+                                          uint64_t     *score)
+{
+    int best = -1;
+    int node_bit;
+    int c;
+
+    for (QD_BITMASK_EACH(mask, node_bit, c)) {
+        qdr_node_t *rnode = core->routers_by_mask_bit[node_bit];
+        if (!rnode || (origin >= 0 && !qd_bitmask_value(rnode->valid_origins, origin)))
+            continue;
+        uint64_t value = qdr_forward_affinity_score((1ULL << 63) | (uint64_t) node_bit, group);
+        if (best < 0 || value > *score) {
+            best   = node_bit;
+            *score = value;
+        }
+    }
+    return best;
+}
+
+
+static void qdr_multicast_seen_free_CT(qdr_core_t *core, qdr_multicast_seen_t *seen)
+{
+    DEQ_REMOVE(core->multicast_seen_list, seen);
+    qd_hash_remove_by_handle(core->multicast_seen, seen->hash_handle);
+    qd_hash_handle_free(seen->hash_handle);
+    free_qdr_multicast_seen_t(seen);
+}
+
+
+/**
+ * Determine if a multicast message has already been forwarded to this address by this
+ * router, having reached it more than once over redundant paths (for instance back to
+ * the edge router it came from by way of the interior).
+ *
+ * Multicast messages are identified by their QD_MA_SEQUENCE annotation, assigned by the
+ * first router to forward them: the assigning router's id and a per-router sequence.
+ * A message without one is given one here.  The identity is remembered together with
+ * the address for a few seconds.
+ */
+static bool qdr_forward_multicast_duplicate_CT(qdr_core_t *core, qdr_address_t *addr, qd_message_t *msg)
+{
+    const char *address = addr->hash_handle ? (const char*) qd_hash_key_by_handle(addr->hash_handle) : 0;
+    if (!address)
+        return false;
+
+    qdr_multicast_seen_t *seen = DEQ_HEAD(core->multicast_seen_list);
+    while (seen && (core->uptime_ticks - seen->tick > QDR_MULTICAST_SEEN_TICKS ||
+                    DEQ_SIZE(core->multicast_seen_list) >= QDR_MULTICAST_SEEN_MAX)) {
+        qdr_multicast_seen_free_CT(core, seen);
+        seen = DEQ_HEAD(core->multicast_seen_list);
+    }
+
+    char              *sequence = 0;
+    qd_parsed_field_t *incoming = qd_message_get_sequence(msg);
+    if (incoming && qd_parse_is_scalar(incoming)) {
+        qd_iterator_t *iter = qd_parse_raw(incoming);
+        qd_iterator_reset_view(iter, ITER_VIEW_ALL);
+        sequence = (char*) qd_iterator_copy(iter);
+    } else if (!qd_message_has_sequence_annotation(msg)) {
+        const char *node_id = qd_router_id(core->qd);
+        size_t      len     = strlen(node_id) + 22;
+        sequence = (char*) malloc(len);
+        snprintf(sequence, len, "%s/%"PRIu64, node_id, core->next_multicast_sequence++);
+
+        qd_composed_field_t *sequence_field = qd_compose_subfield(0);
+        qd_compose_insert_string(sequence_field, sequence);
+        qd_message_set_sequence_annotation(msg, sequence_field);
+    } else {
+        // Already assigned here while forwarding the message to another address
+        return false;
+    }
+
+    size_t len = strlen(address) + strlen(sequence) + 2;
+    char  *key = (char*) malloc(len);
+    snprintf(key, len, "%s|%s", address, sequence);
+    free(sequence);
+
+    qd_iterator_t  key_iter;
+    void          *found    = 0;
+    qd_iterator_init_string(&key_iter, key, ITER_VIEW_ALL);
+    qd_hash_retrieve(core->multicast_seen, &key_iter, &found);
+    if (!found) {
+        seen = new_qdr_multicast_seen_t();
+        ZERO(seen);
+        seen->tick = core->uptime_ticks;
+        qd_hash_insert(core->multicast_seen, &key_iter, seen, &seen->hash_handle);
+        DEQ_INSERT_TAIL(core->multicast_seen_list, seen);
+    }
+    qd_iterator_fini(&key_iter);
+    free(key);
+
+    return !!found;
+}
+
+
+//
+// Return the inter-router links a multicast message for the address that
+// entered the network at 'origin' is sent over, rebuilding the cached plan if
+// the topology has changed since it was computed.
+//
+static qdr_mcast_plan_t *qdr_forward_mcast_plan_CT(qdr_core_t    *core,
+                                                   qdr_address_t *addr,
+                                                   int            origin,
+                                                   bool           control,
+                                                   uint8_t        priority)
+{
+    int key_priority = control ? -1 : (int) priority;
+
+    if (!addr->mcast_plans) {
+        addr->mcast_plans = NEW_ARRAY(qdr_mcast_plan_t, QDR_MCAST_PLAN_SLOTS);
+        memset(addr->mcast_plans, 0, QDR_MCAST_PLAN_SLOTS * sizeof(qdr_mcast_plan_t));
+    }
+
+    qdr_mcast_plan_t *plan = &addr->mcast_plans[(origin * 7 + key_priority + 1) % QDR_MCAST_PLAN_SLOTS];
+    if (plan->epoch == core->mcast_epoch && plan->origin == origin && plan->priority == key_priority)
+        return plan;
+
+    plan->epoch    = core->mcast_epoch;
+    plan->origin   = origin;
+    plan->priority = key_priority;
+    plan->count    = 0;
+
+    int           dest_bit;
+    qdr_link_t   *dest_link;
+    qdr_node_t   *next_node;
+    qd_bitmask_t *link_set = qd_bitmask(0);
+
+    //
+    // Loop over the target nodes for this address.  Build a set of outgoing links
+    // for which there are valid targets.  We do this to avoid sending more than one
+    // message down a given link.  It's possible that there are multiple destinations
+    // for this address that are all reachable over the same link.  In this case, we
+    // will send only one copy of the message over the link and allow a downstream
+    // router to fan the message out.
+    //
+    int c;
+    for (QD_BITMASK_EACH(addr->rnodes, dest_bit, c)) {
+        qdr_node_t *rnode = core->routers_by_mask_bit[dest_bit];
+        if (!rnode)
+            continue;
+
+        if (rnode->next_hop)
+            next_node = rnode->next_hop;
+        else
+            next_node = rnode;
+
+        dest_link = control ? PEER_CONTROL_LINK(core, next_node) : peer_data_link(core, next_node, priority, 0);
+        if (dest_link && qd_bitmask_value(rnode->valid_origins, origin))
+            qd_bitmask_set_bit(link_set, dest_link->conn->mask_bit);
+    }
+
+    int link_bit;
+    while (qd_bitmask_first_set(link_set, &link_bit)) {
+        qd_bitmask_clear_bit(link_set, link_bit);
+        if (plan->count == plan->capacity) {
+            plan->capacity  = plan->capacity ? plan->capacity * 2 : 4;
+            plan->link_bits = realloc(plan->link_bits, plan->capacity * sizeof(int));
+        }
+        plan->link_bits[plan->count++] = link_bit;
+    }
+
+    qd_bitmask_free(link_set);
+    return plan;
+}
+
+
+//
+// The body of the multicast forwarders.  The remote and inprocess arguments are
+// constants at each caller, so the variant for an address whose only
+// destinations are local links leaves out the ingress lookup, the remote plan
+// and the in-process subscribers.
+//
+static inline int qdr_forward_multicast_body_CT(qdr_core_t      *core,
+                                                qdr_address_t   *addr,
+                                                qd_message_t    *msg,
+                                                qdr_delivery_t  *in_delivery,
+                                                bool             exclude_inprocess,
+                                                bool             control,
+                                                const bool       remote,
+                                                const bool       inprocess)
 {
     bool          bypass_valid_origins = addr->forwarder->bypass_valid_origins;
     int           fanout               = 0;
@@ -320,14 +804,31 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
     DEQ_INIT(deliver_info_list);
 
     //
-    // If the delivery is not presettled, set the settled flag for forwarding so all
-    // outgoing deliveries will be presettled.
+    // Drop a copy of a data message that has already been forwarded here.  It is
+    // settled as a forwarded multicast would be.
     //
-    // NOTE:  This is the only multicast mode currently supported.  Others will likely be
-    //        implemented in the future.
+    if (!control && qdr_forward_multicast_duplicate_CT(core, addr, msg)) {
+        if (in_delivery)
+            in_delivery->settled = true;
+        core->dropped_duplicate_multicasts++;
+        qd_log(core->log, QD_LOG_TRACE, "Dropped duplicate multicast message for address %s",
+               (const char*) qd_hash_key_by_handle(addr->hash_handle));
+        return 0;
+    }
+
+    //
+    // If the delivery is not presettled, the address's settlement mode decides how it
+    // is settled.  By default set the settled flag for forwarding so all outgoing
+    // deliveries will be presettled.  The other modes forward unsettled copies and
+    // settle the delivery from their outcomes; a message still arriving is always
+    // forwarded pre-settled.
     //
-    if (!presettled)
+    qdr_mcast_settlement_t mode = QDR_MCAST_SETTLE_PRESETTLE;
+    if (!presettled && receive_complete && addr->config)
+        mode = addr->config->mcast_settlement;
+    if (!presettled && mode == QDR_MCAST_SETTLE_PRESETTLE)
         in_delivery->settled = true;
+    int subscribers = 0;
 
     //
     // Forward to local subscribers
@@ -340,11 +841,12 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
             //
             // Only forward via links that don't result in edge-echo.
             //
-            if (!qdr_forward_edge_echo_CT(in_delivery, out_link)) {
+            if (!qdr_forward_edge_echo_CT(core, in_delivery, out_link)) {
                 qdr_delivery_t *out_delivery = qdr_forward_new_delivery_CT(core, in_delivery, out_link, msg);
 
-                // Store the out_link and out_delivery so we can forward the delivery later on
-                qdr_forward_deliver_info_t *deliver_info = new_qdr_forward_deliver_info_t();
+                // Store the out_link and out_delivery so we can forward the delivery later on.
+                // The record is only needed for this pass, so it comes from the core arena.
+                qdr_forward_deliver_info_t *deliver_info = QDR_ARENA_NEW(core, qdr_forward_deliver_info_t);
                 ZERO(deliver_info);
                 deliver_info->out_dlv = out_delivery;
                 deliver_info->out_link = out_link;
@@ -352,7 +854,7 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
 
                 fanout++;
                 if (out_link->link_type != QD_LINK_CONTROL && out_link->link_type != QD_LINK_ROUTER) {
-                    addr->deliveries_egress++;
+                    qdr_address_stats_CT(addr)->deliveries_egress++;
                     core->deliveries_egress++;
                 }
             }
@@ -373,78 +875,54 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
     int origin = -1;
     qd_iterator_t *ingress_iter = in_delivery ? in_delivery->origin : 0;
 
-    if (ingress_iter && !bypass_valid_origins) {
+    if (!remote || qd_bitmask_cardinality(addr->rnodes) == 0)
+        origin = -1;  // No remote destination to check the origin against
+    else if (ingress_iter && !bypass_valid_origins) {
         qd_iterator_reset_view(ingress_iter, ITER_VIEW_NODE_HASH);
         qdr_address_t *origin_addr;
         qd_hash_retrieve(core->addr_hash, ingress_iter, (void*) &origin_addr);
         if (origin_addr && qd_bitmask_cardinality(origin_addr->rnodes) == 1)
             qd_bitmask_first_set(origin_addr->rnodes, &origin);
-    } else
+    } else if (!bypass_valid_origins && in_delivery && qd_bitmask_valid_bit_value(in_delivery->ingress_index))
+        origin = in_delivery->ingress_index;  // A compact ingress arrives as a mask bit
+    else
         origin = 0;
 
     //
     // Forward to the next-hops for remote destinations.
     //
     if (origin >= 0) {
-        int           dest_bit;
-        qdr_link_t   *dest_link;
-        qdr_node_t   *next_node;
-        qd_bitmask_t *link_set = qd_bitmask(0);
-
-        //
-        // Loop over the target nodes for this address.  Build a set of outgoing links
-        // for which there are valid targets.  We do this to avoid sending more than one
-        // message down a given link.  It's possible that there are multiple destinations
-        // for this address that are all reachable over the same link.  In this case, we
-        // will send only one copy of the message over the link and allow a downstream
-        // router to fan the message out.
-        //
-        int c;
-        for (QD_BITMASK_EACH(addr->rnodes, dest_bit, c)) {
-            qdr_node_t *rnode = core->routers_by_mask_bit[dest_bit];
-            if (!rnode)
-                continue;
-
-            if (rnode->next_hop)
-                next_node = rnode->next_hop;
-            else
-                next_node = rnode;
-
-            dest_link = control ? PEER_CONTROL_LINK(core, next_node) : peer_data_link(core, next_node, priority);
-            if (dest_link && qd_bitmask_value(rnode->valid_origins, origin))
-                qd_bitmask_set_bit(link_set, dest_link->conn->mask_bit);
-        }
+        qdr_mcast_plan_t *plan = qdr_forward_mcast_plan_CT(core, addr, origin, control, priority);
+        qdr_link_t       *dest_link;
 
         //
         // Send a copy of the message outbound on each identified link.
         //
-        int link_bit;
-        while (qd_bitmask_first_set(link_set, &link_bit)) {
-            qd_bitmask_clear_bit(link_set, link_bit);
+        for (int i = 0; i < plan->count; i++) {
+            int link_bit = plan->link_bits[i];
             dest_link = control ?
                 core->control_links_by_mask_bit[link_bit] :
-                core->data_links_by_mask_bit[link_bit].links[priority];
+                qdr_peer_stripe_link_CT(core, link_bit, priority, addr);
             if (dest_link && (!link_exclusion || qd_bitmask_value(link_exclusion, link_bit) == 0)) {
                 qdr_delivery_t *out_delivery = qdr_forward_new_delivery_CT(core, in_delivery, dest_link, msg);
 
-                // Store the out_link and out_delivery so we can forward the delivery later on
-                qdr_forward_deliver_info_t *deliver_info = new_qdr_forward_deliver_info_t();
+                // Store the out_link and out_delivery so we can forward the delivery later on.
+                // The record is only needed for this pass, so it comes from the core arena.
+                qdr_forward_deliver_info_t *deliver_info = QDR_ARENA_NEW(core, qdr_forward_deliver_info_t);
                 ZERO(deliver_info);
                 deliver_info->out_dlv = out_delivery;
                 deliver_info->out_link = dest_link;
                 DEQ_INSERT_TAIL(deliver_info_list, deliver_info);
 
                 fanout++;
-                addr->deliveries_transit++;
+                qdr_address_stats_CT(addr)->deliveries_transit++;
                 if (dest_link->link_type == QD_LINK_ROUTER)
                     core->deliveries_transit++;
             }
         }
-
-        qd_bitmask_free(link_set);
     }
 
-    if (!exclude_inprocess) {
+    if (inprocess && !exclude_inprocess) {
         //
         // Forward to in-process subscribers
         //
@@ -466,7 +944,8 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
             }
 
             fanout++;
-            addr->deliveries_to_container++;
+            subscribers++;
+            qdr_address_stats_CT(addr)->deliveries_to_container++;
             sub = DEQ_NEXT(sub);
         }
     }
@@ -475,7 +954,6 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
     while (deliver_info) {
         qdr_forward_deliver_CT(core, deliver_info->out_link, deliver_info->out_dlv);
         DEQ_REMOVE_HEAD(deliver_info_list);
-        free_qdr_forward_deliver_info_t(deliver_info);
         deliver_info = DEQ_HEAD(deliver_info_list);
     }
 
@@ -486,7 +964,15 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
             // destinations, return it to its original unsettled state.
             //
             in_delivery->settled = false;
-        else {
+        else if (mode != QDR_MCAST_SETTLE_PRESETTLE) {
+            //
+            // In-process subscribers cannot refuse the message, so they count as
+            // accepting it now.
+            //
+            in_delivery->mcast_settlement = mode;
+            in_delivery->mcast_fanout     = fanout;
+            qdr_delivery_mcast_outcome_CT(core, in_delivery, subscribers, 0);
+        } else {
             //
             // The delivery was not presettled and it was forwarded to at least
             // one destination.  Accept and settle the delivery only if the entire delivery
@@ -503,12 +989,44 @@ int qdr_forward_multicast_CT(qdr_core_t      *core,
 }
 
 
-int qdr_forward_closest_CT(qdr_core_t      *core,
-                           qdr_address_t   *addr,
-                           qd_message_t    *msg,
-                           qdr_delivery_t  *in_delivery,
-                           bool             exclude_inprocess,
-                           bool             control)
+int qdr_forward_multicast_CT(qdr_core_t      *core,
+                             qdr_address_t   *addr,
+                             qd_message_t    *msg,
+                             qdr_delivery_t  *in_delivery,
+                             bool             exclude_inprocess,
+                             bool             control)
+{
+    return qdr_forward_multicast_body_CT(core, addr, msg, in_delivery, exclude_inprocess, control, true, true);
+}
+
+
+//
+// Multicast forwarding for an address with no remote router and no in-process subscriber.
+//
+static int qdr_forward_multicast_local_CT(qdr_core_t      *core,
+                                          qdr_address_t   *addr,
+                                          qd_message_t    *msg,
+                                          qdr_delivery_t  *in_delivery,
+                                          bool             exclude_inprocess,
+                                          bool             control)
+{
+    return qdr_forward_multicast_body_CT(core, addr, msg, in_delivery, exclude_inprocess, control, false, false);
+}
+
+
+//
+// The body of the closest forwarders.  The inprocess and affinity arguments are
+// constants at each caller, so the compiler leaves out the in-process subscriber
+// and group-id checks from the variant for addresses that have neither.
+//
+static inline int qdr_forward_closest_body_CT(qdr_core_t      *core,
+                                              qdr_address_t   *addr,
+                                              qd_message_t    *msg,
+                                              qdr_delivery_t  *in_delivery,
+                                              bool             exclude_inprocess,
+                                              bool             control,
+                                              const bool       inprocess,
+                                              const bool       affinity)
 {
     qdr_link_t     *out_link;
     qdr_delivery_t *out_delivery;
@@ -516,7 +1034,7 @@ int qdr_forward_closest_CT(qdr_core_t      *core,
     //
     // Forward to an in-process subscriber if there is one.
     //
-    if (!exclude_inprocess) {
+    if (inprocess && !exclude_inprocess) {
         bool receive_complete = qd_message_receive_complete(msg);
         qdr_subscription_t *sub = DEQ_HEAD(addr->subscriptions);
         if (sub) {
@@ -553,21 +1071,37 @@ int qdr_forward_closest_CT(qdr_core_t      *core,
                 DEQ_INSERT_TAIL(addr->subscriptions, sub);
             }
 
-            addr->deliveries_to_container++;
+            qdr_address_stats_CT(addr)->deliveries_to_container++;
             return 1;
         }
     }
 
     //
-    // Forward to a local subscriber.
+    // Forward to a local subscriber.  Take the first one in round-robin order that
+    // has credit for the delivery; if none has, take the first one.  A message of
+    // a group goes to the group's subscriber, credit or not.
     //
-    qdr_link_ref_t *link_ref = DEQ_HEAD(addr->rlinks);
+    uint32_t        group;
+    uint64_t        score;
+    bool            sticky   = affinity && !control && qdr_forward_group_CT(addr, msg, &group);
+    qdr_link_ref_t *link_ref = sticky ? 0 : DEQ_HEAD(addr->rlinks);
+    qdr_link_ref_t *fallback = 0;
 
     //
-    // If this link results in edge-echo, skip to the next link in the list.
+    // Links that result in edge-echo are skipped.
     //
-    while (link_ref && qdr_forward_edge_echo_CT(in_delivery, link_ref->link))
-        link_ref = DEQ_NEXT(link_ref);
+    for (; link_ref; link_ref = DEQ_NEXT(link_ref)) {
+        if (qdr_forward_edge_echo_CT(core, in_delivery, link_ref->link))
+            continue;
+        if (link_ref->link->credit_available > 0)
+            break;
+        if (!fallback)
+            fallback = link_ref;
+    }
+    if (sticky)
+        link_ref = qdr_forward_affinity_link_CT(core, addr, in_delivery, group, &score);
+    else if (!link_ref)
+        link_ref = fallback;
 
     if (link_ref) {
         out_link     = link_ref->link;
@@ -575,21 +1109,21 @@ int qdr_forward_closest_CT(qdr_core_t      *core,
         qdr_forward_deliver_CT(core, out_link, out_delivery);
 
         //
-        // If there are multiple local subscribers, rotate the list of link references
-        // so deliveries will be distributed among the subscribers in a round-robin pattern.
+        // If there are multiple local subscribers, move the chosen link reference to
+        // the end of the list so deliveries will be distributed among the subscribers
+        // in a round-robin pattern.
         //
-        if (DEQ_SIZE(addr->rlinks) > 1) {
-            link_ref = DEQ_HEAD(addr->rlinks);
-            DEQ_REMOVE_HEAD(addr->rlinks);
+        if (!sticky && DEQ_SIZE(addr->rlinks) > 1) {
+            DEQ_REMOVE(addr->rlinks, link_ref);
             DEQ_INSERT_TAIL(addr->rlinks, link_ref);
         }
 
-        addr->deliveries_egress++;
+        qdr_address_stats_CT(addr)->deliveries_egress++;
         core->deliveries_egress++;
 
         if (qdr_connection_route_container(out_link->conn)) {
             core->deliveries_egress_route_container++;
-            addr->deliveries_egress_route_container++;
+            qdr_address_stats_CT(addr)->deliveries_egress_route_container++;
         }
 
         return 1;
@@ -607,25 +1141,28 @@ int qdr_forward_closest_CT(qdr_core_t      *core,
     // link for the traffic class: control or data
     //
     qdr_node_t *next_node;
+    int         remote = addr->next_remote;
+
+    if (sticky && remote >= 0)
+        remote = qdr_forward_affinity_router_CT(core, addr->closest_remotes, -1, group, &score);
 
-    if (addr->next_remote >= 0) {
-        qdr_node_t *rnode = core->routers_by_mask_bit[addr->next_remote];
+    if (remote >= 0) {
+        qdr_node_t *rnode = core->routers_by_mask_bit[remote];
         if (rnode) {
-            _qdbm_next(addr->closest_remotes, &addr->next_remote);
-            if (addr->next_remote == -1)
-                qd_bitmask_first_set(addr->closest_remotes, &addr->next_remote);
+            if (!sticky) {
+                _qdbm_next(addr->closest_remotes, &addr->next_remote);
+                if (addr->next_remote == -1)
+                    qd_bitmask_first_set(addr->closest_remotes, &addr->next_remote);
+            }
 
-            if (rnode->next_hop)
-                next_node = rnode->next_hop;
-            else
-                next_node = rnode;
+            next_node = qdr_forward_next_node_CT(core, rnode, addr);
 
             uint8_t priority = qdr_forward_effective_priority(msg, addr);
-            out_link = control ? PEER_CONTROL_LINK(core, next_node) : peer_data_link(core, next_node, priority);
+            out_link = control ? PEER_CONTROL_LINK(core, next_node) : peer_data_link(core, next_node, priority, addr);
             if (out_link) {
                 out_delivery = qdr_forward_new_delivery_CT(core, in_delivery, out_link, msg);
                 qdr_forward_deliver_CT(core, out_link, out_delivery);
-                addr->deliveries_transit++;
+                qdr_address_stats_CT(addr)->deliveries_transit++;
                 if (out_link->link_type == QD_LINK_ROUTER)
                     core->deliveries_transit++;
                 return 1;
@@ -637,6 +1174,67 @@ int qdr_forward_closest_CT(qdr_core_t      *core,
 }
 
 
+int qdr_forward_closest_CT(qdr_core_t      *core,
+                           qdr_address_t   *addr,
+                           qd_message_t    *msg,
+                           qdr_delivery_t  *in_delivery,
+                           bool             exclude_inprocess,
+                           bool             control)
+{
+    return qdr_forward_closest_body_CT(core, addr, msg, in_delivery, exclude_inprocess, control, true, true);
+}
+
+
+//
+// Closest forwarding for an address with no in-process subscriber and no group affinity.
+//
+static int qdr_forward_closest_plain_CT(qdr_core_t      *core,
+                                        qdr_address_t   *addr,
+                                        qd_message_t    *msg,
+                                        qdr_delivery_t  *in_delivery,
+                                        bool             exclude_inprocess,
+                                        bool             control)
+{
+    return qdr_forward_closest_body_CT(core, addr, msg, in_delivery, exclude_inprocess, control, false, false);
+}
+
+
+//
+// The cost of giving one more delivery to a balanced destination: the number of
+// deliveries it already has outstanding or, with latency-aware balancing, the
+// time those are expected to take to settle given its recent settlement latency.
+// Destinations without a latency sample yet look fast, so they get tried.
+//
+static inline uint64_t qdr_forward_balanced_value(qdr_core_t *core, uint32_t outstanding, int64_t settle_usec)
+{
+    if (!core->balanced_latency_aware)
+        return outstanding;
+    return (uint64_t) (outstanding + 1) * (uint64_t) (settle_usec > 0 ? settle_usec : 1);
+}
+
+
+//
+// The mask bit of the router a delivery entered the network at, compared against
+// the valid_origins mask of each candidate destination router.
+//
+static int qdr_forward_origin_CT(qdr_core_t *core, qdr_delivery_t *in_delivery)
+{
+    int origin = 0;
+    qd_iterator_t *ingress_iter = in_delivery ? in_delivery->origin : 0;
+
+    if (ingress_iter) {
+        qd_iterator_reset_view(ingress_iter, ITER_VIEW_NODE_HASH);
+        qdr_address_t *origin_addr;
+        qd_hash_retrieve(core->addr_hash, ingress_iter, (void*) &origin_addr);
+        if (origin_addr && qd_bitmask_cardinality(origin_addr->rnodes) == 1)
+            qd_bitmask_first_set(origin_addr->rnodes, &origin);
+    } else if (in_delivery && qd_bitmask_valid_bit_value(in_delivery->ingress_index))
+        origin = in_delivery->ingress_index;
+
+    return origin;
+}
+
+
 int qdr_forward_balanced_CT(qdr_core_t      *core,
                             qdr_address_t   *addr,
                             qd_message_t    *msg,
@@ -656,38 +1254,75 @@ int qdr_forward_balanced_CT(qdr_core_t      *core,
         addr->outstanding_deliveries = NEW_ARRAY(int, qd_bitmask_width());
         for (int i = 0; i < qd_bitmask_width(); i++)
             addr->outstanding_deliveries[i] = 0;
+        if (core->balanced_latency_aware) {
+            addr->settle_usec_ewma = NEW_ARRAY(int64_t, qd_bitmask_width());
+            for (int i = 0; i < qd_bitmask_width(); i++)
+                addr->settle_usec_ewma[i] = 0;
+        }
     }
 
     qdr_link_t *best_eligible_link       = 0;
     int         best_eligible_link_bit   = -1;
-    uint32_t    eligible_link_value      = UINT32_MAX;
+    uint64_t    eligible_link_value      = UINT64_MAX;
     qdr_link_t *best_ineligible_link     = 0;
     int         best_ineligible_link_bit = -1;
-    uint32_t    ineligible_link_value    = UINT32_MAX;
+    uint64_t    ineligible_link_value    = UINT64_MAX;
 
     //
     // Find all the possible outbound links for this delivery, searching for the one with the
-    // smallest eligible value.  Value = outstanding_deliveries + minimum_downrange_cost.
-    // A link is ineligible if the outstanding_deliveries is equal to or greater than the
-    // link's capacity.
+    // smallest eligible value.  Value = outstanding_deliveries + minimum_downrange_cost,
+    // where outstanding_deliveries is scaled by settlement latency if balancing is
+    // latency-aware (see qdr_forward_balanced_value).  A link is ineligible if the
+    // outstanding_deliveries is equal to or greater than the link's capacity, or if
+    // it is a local link whose consumer has no credit left for another delivery.
     //
     // If there are no eligible links, use the best ineligible link.  Zero fanout should be returned
     // only if there are no available destinations.
     //
+    // A message of a group skips the search: its destination, a local link or a remote
+    // router, is the one that scores highest for the group, whatever its load.
+    //
+    uint32_t group;
+    if (qdr_forward_group_CT(addr, msg, &group)) {
+        uint64_t        link_score   = 0;
+        uint64_t        router_score = 0;
+        qdr_link_ref_t *affinity_ref = qdr_forward_affinity_link_CT(core, addr, in_delivery, group, &link_score);
+        int             router_bit   = qdr_forward_affinity_router_CT(core, addr->rnodes,
+                                                                      qdr_forward_origin_CT(core, in_delivery),
+                                                                      group, &router_score);
+        qdr_link_t     *router_link  = 0;
+
+        if (router_bit >= 0 && (!affinity_ref || router_score > link_score)) {
+            qdr_node_t *next_nodes[QDR_MAX_EQUAL_COST_HOPS];
+            qdr_forward_next_nodes_CT(core, core->routers_by_mask_bit[router_bit], next_nodes, QDR_MAX_EQUAL_COST_HOPS);
+            router_link = peer_data_link(core, next_nodes[0], qdr_forward_effective_priority(msg, addr), addr);
+        }
+
+        if (router_link) {
+            best_eligible_link     = router_link;
+            best_eligible_link_bit = router_link->conn->mask_bit;
+            eligible_link_value    = 0;
+        } else if (affinity_ref) {
+            best_eligible_link  = affinity_ref->link;
+            eligible_link_value = 0;
+        }
+    }
+
 
     //
     // Start with the local links
     //
-    qdr_link_ref_t *link_ref = DEQ_HEAD(addr->rlinks);
+    qdr_link_ref_t *link_ref = best_eligible_link ? 0 : DEQ_HEAD(addr->rlinks);
     while (link_ref && eligible_link_value != 0) {
-        qdr_link_t *link     = link_ref->link;
-        uint32_t    value    = DEQ_SIZE(link->undelivered) + DEQ_SIZE(link->unsettled);
-        bool        eligible = link->capacity > value;
+        qdr_link_t *link        = link_ref->link;
+        uint32_t    outstanding = DEQ_SIZE(link->undelivered) + DEQ_SIZE(link->unsettled);
+        uint64_t    value       = qdr_forward_balanced_value(core, outstanding, link->settle_usec_ewma);
+        bool        eligible    = link->capacity > outstanding && link->credit_available > 0;
 
         //
         // Only consider links that do not result in edge-echo.
         //
-        if (!qdr_forward_edge_echo_CT(in_delivery, link)) {
+        if (!qdr_forward_edge_echo_CT(core, in_delivery, link)) {
             //
             // If this is the best eligible link so far, record the fact.
             // Otherwise, if this is the best ineligible link, make note of that.
@@ -709,38 +1344,34 @@ int qdr_forward_balanced_CT(qdr_core_t      *core,
     // inter-router links as well.
     //
     if (!best_eligible_link || eligible_link_value > 0) {
-        //
-        // Get the mask bit associated with the ingress router for the message.
-        // This will be compared against the "valid_origin" masks for each
-        // candidate destination router.
-        //
-        int origin = 0;
-        qd_iterator_t *ingress_iter = in_delivery ? in_delivery->origin : 0;
-
-        if (ingress_iter) {
-            qd_iterator_reset_view(ingress_iter, ITER_VIEW_NODE_HASH);
-            qdr_address_t *origin_addr;
-            qd_hash_retrieve(core->addr_hash, ingress_iter, (void*) &origin_addr);
-            if (origin_addr && qd_bitmask_cardinality(origin_addr->rnodes) == 1)
-                qd_bitmask_first_set(origin_addr->rnodes, &origin);
-        }
-
+        int origin = qdr_forward_origin_CT(core, in_delivery);
         int c;
         int node_bit;
         for (QD_BITMASK_EACH(addr->rnodes, node_bit, c)) {
-            qdr_node_t *rnode     = core->routers_by_mask_bit[node_bit];
-            qdr_node_t *next_node = rnode->next_hop ? rnode->next_hop : rnode;
-            uint8_t     priority  = qdr_forward_effective_priority(msg, addr);
-            qdr_link_t *link      = peer_data_link(core, next_node, priority);
-            if (!link) continue;
-            int         link_bit  = link->conn->mask_bit;
-            int         value     = addr->outstanding_deliveries[link_bit];
-            bool        eligible  = link->capacity > value;
-
-            if (qd_bitmask_value(rnode->valid_origins, origin)) {
+            qdr_node_t *rnode = core->routers_by_mask_bit[node_bit];
+            if (!qd_bitmask_value(rnode->valid_origins, origin))
+                continue;
+
+            //
+            // Every neighbor on an equal-cost path to the router is a candidate,
+            // so with multipath the path is chosen per delivery by load.
+            //
+            qdr_node_t *next_nodes[QDR_MAX_EQUAL_COST_HOPS];
+            int         next_count = qdr_forward_next_nodes_CT(core, rnode, next_nodes, QDR_MAX_EQUAL_COST_HOPS);
+            uint8_t     priority   = qdr_forward_effective_priority(msg, addr);
+
+            for (int n = 0; n < next_count; n++) {
+                qdr_link_t *link = peer_data_link(core, next_nodes[n], priority, addr);
+                if (!link) continue;
+                int         link_bit    = link->conn->mask_bit;
+                int         outstanding = addr->outstanding_deliveries[link_bit];
+                bool        eligible    = link->capacity > outstanding;
+
                 //
                 // Link is a candidate, adjust the value by the bias (node cost).
                 //
+                uint64_t value = qdr_forward_balanced_value(core, outstanding,
+                                                            addr->settle_usec_ewma ? addr->settle_usec_ewma[link_bit] : 0);
                 value += rnode->cost;
                 if (eligible && eligible_link_value > value) {
                     best_eligible_link     = link;
@@ -778,6 +1409,8 @@ int qdr_forward_balanced_CT(qdr_core_t      *core,
 
     if (chosen_link) {
         qdr_delivery_t *out_delivery = qdr_forward_new_delivery_CT(core, in_delivery, chosen_link, msg);
+        if (core->balanced_latency_aware && in_delivery && !in_delivery->settled)
+            out_delivery->forward_usec = qd_timer_now_usec();
         qdr_forward_deliver_CT(core, chosen_link, out_delivery);
 
         //
@@ -794,17 +1427,17 @@ int qdr_forward_balanced_CT(qdr_core_t      *core,
         // Bump the appropriate counter based on where we sent the delivery.
         //
         if (chosen_link_bit >= 0) {
-            addr->deliveries_transit++;
+            qdr_address_stats_CT(addr)->deliveries_transit++;
             if (chosen_link->link_type == QD_LINK_ROUTER)
                 core->deliveries_transit++;
         }
         else {
-            addr->deliveries_egress++;
+            qdr_address_stats_CT(addr)->deliveries_egress++;
             core->deliveries_egress++;
 
             if (qdr_connection_route_container(chosen_link->conn)) {
                 core->deliveries_egress_route_container++;
-                addr->deliveries_egress_route_container++;
+                qdr_address_stats_CT(addr)->deliveries_egress_route_container++;
             }
         }
         return 1;
@@ -813,6 +1446,28 @@ int qdr_forward_balanced_CT(qdr_core_t      *core,
     return 0;
 }
 
+//
+// The live load on a connection that can take a link-routed attach: its links, the
+// unsettled deliveries on them, its attaches still waiting for an answer, and one
+// more for every millisecond its recent attaches have taken to be answered.  This
+// is computed in-line when an attach is routed, so balancing needs no extra actions.
+//
+static uint64_t qdr_forward_link_conn_load(qdr_connection_t *conn)
+{
+    uint64_t load = DEQ_SIZE(conn->links) + conn->attach_usec_ewma / 1000;
+
+    sys_mutex_lock(conn->work_lock);
+    qdr_link_ref_t *ref = DEQ_HEAD(conn->links);
+    while (ref) {
+        load += DEQ_SIZE(ref->link->unsettled) + (ref->link->attach_sent_usec ? 1 : 0);
+        ref = DEQ_NEXT(ref);
+    }
+    sys_mutex_unlock(conn->work_lock);
+
+    return load;
+}
+
+
 bool qdr_forward_link_balanced_CT(qdr_core_t     *core,
                                   qdr_address_t  *addr,
                                   qdr_link_t     *in_link,
@@ -841,10 +1496,22 @@ bool qdr_forward_link_balanced_CT(qdr_core_t     *core,
 
         //
         // If there are more than one local connections available for handling this link,
-        // rotate the list so the attaches are balanced across the containers.
+        // use the least loaded one and move it to the tail of the list, so attaches to
+        // equally loaded containers rotate among them.
         //
         if (DEQ_SIZE(addr->conns) > 1) {
-            DEQ_REMOVE_HEAD(addr->conns);
+            uint64_t              best_load = qdr_forward_link_conn_load(conn);
+            qdr_connection_ref_t *ref       = DEQ_NEXT(conn_ref);
+            while (ref && best_load > 0) {
+                uint64_t load = qdr_forward_link_conn_load(ref->conn);
+                if (load < best_load) {
+                    best_load = load;
+                    conn_ref  = ref;
+                }
+                ref = DEQ_NEXT(ref);
+            }
+            conn = conn_ref->conn;
+            DEQ_REMOVE(addr->conns, conn_ref);
             DEQ_INSERT_TAIL(addr->conns, conn_ref);
         }
     } else {
@@ -879,7 +1546,7 @@ bool qdr_forward_link_balanced_CT(qdr_core_t     *core,
                 else
                     next_node = rnode;
 
-                qdr_link_t * pdl = peer_data_link(core, next_node, 0);
+                qdr_link_t * pdl = peer_data_link(core, next_node, 0, 0);
                 if (next_node && pdl)
                     conn = pdl->conn;
             }
@@ -914,6 +1581,7 @@ void qdr_forward_link_direct_CT(qdr_core_t       *core,
     out_link->link_direction = qdr_link_direction(in_link) == QD_OUTGOING ? QD_INCOMING : QD_OUTGOING;
     out_link->admin_enabled  = true;
     out_link->attach_count   = 1;
+    out_link->attach_sent_usec = qd_timer_now_usec();
 
     if (strip) {
         out_link->strip_prefix = strip;
@@ -926,8 +1594,10 @@ void qdr_forward_link_direct_CT(qdr_core_t       *core,
 
     out_link->name = strdup(in_link->disambiguated_name ? in_link->disambiguated_name : in_link->name);
 
+    sys_mutex_lock(core->link_route_lock);
     out_link->connected_link = in_link;
     in_link->connected_link  = out_link;
+    sys_mutex_unlock(core->link_route_lock);
 
     DEQ_INSERT_TAIL(core->open_links, out_link);
     qdr_add_link_ref(&conn->links, out_link, QDR_LINK_LIST_CLASS_CONNECTION);
@@ -964,6 +1634,45 @@ qdr_forwarder_t *qdr_new_forwarder(qdr_forward_message_t fm, qdr_forward_attach_
 }
 
 
+//
+// Drop the expired pre-settled deliveries queued on backed-up links, which
+// would otherwise hold their buffers until the consumers catch up to them.
+// Unsettled ones stay until they are reached and released, as their senders
+// are owed an outcome.  The sweep runs again while deliveries that can
+// expire remain queued.
+//
+static void qdr_forward_expiry_sweep_CT(qdr_core_t *core, void *context)
+{
+    bool pending = false;
+
+    qdr_link_t *link = DEQ_HEAD(core->open_links);
+    while (link) {
+        if (link->link_direction == QD_OUTGOING && link->link_type != QD_LINK_CONTROL && link->conn) {
+            sys_mutex_lock(link->conn->work_lock);
+            qdr_delivery_t *dlv = DEQ_HEAD(link->undelivered);
+            dlv = dlv ? DEQ_NEXT(dlv) : 0;  // The leading delivery is left to the sending thread
+            while (dlv) {
+                qdr_delivery_t *next = DEQ_NEXT(dlv);
+                if (qdr_forward_droppable_CT_LH(dlv) && qd_message_receive_complete(dlv->msg)
+                    && qd_message_expiry(dlv->msg)) {
+                    if (qdr_delivery_expired(dlv)) {
+                        dlv->expired = true;
+                        qdr_forward_unqueue_presettled_CT_LH(core, link, dlv);
+                    } else
+                        pending = true;
+                }
+                dlv = next;
+            }
+            sys_mutex_unlock(link->conn->work_lock);
+        }
+        link = DEQ_NEXT(link);
+    }
+
+    if (pending)
+        qdr_core_timer_schedule_CT(core, core->expiry_timer, 1);
+}
+
+
 void qdr_forwarder_setup_CT(qdr_core_t *core)
 {
     //
@@ -978,6 +1687,31 @@ void qdr_forwarder_setup_CT(qdr_core_t *core)
     // Create link forwarders
     //
     core->forwarders[QD_TREATMENT_LINK_BALANCED] = qdr_new_forwarder(0, qdr_forward_link_balanced_CT, false);
+
+    //
+    // Start the multicast sequence from the clock so identities assigned before a
+    // restart are not reused while they may still be remembered elsewhere.
+    //
+    core->multicast_seen          = qd_hash(10, 32, 0);
+    core->next_multicast_sequence = ((uint64_t) time(0)) << 20;
+    DEQ_INIT(core->multicast_seen_list);
+
+    core->expiry_timer = qdr_core_timer_CT(core, qdr_forward_expiry_sweep_CT, 0);
+}
+
+
+void qdr_forwarder_cleanup_CT(qdr_core_t *core)
+{
+    qdr_multicast_seen_t *seen = DEQ_HEAD(core->multicast_seen_list);
+    while (seen) {
+        qdr_multicast_seen_free_CT(core, seen);
+        seen = DEQ_HEAD(core->multicast_seen_list);
+    }
+    qd_hash_free(core->multicast_seen);
+    core->multicast_seen = 0;
+
+    qdr_core_timer_free_CT(core, core->expiry_timer);
+    core->expiry_timer = 0;
 }
 
 
@@ -989,18 +1723,152 @@ qdr_forwarder_t *qdr_forwarder_CT(qdr_core_t *core, qd_address_treatment_t treat
 }
 
 
+void qdr_forward_select_CT(qdr_core_t *core, qdr_address_t *addr)
+{
+    qdr_forwarder_t *forw = addr->forwarder;
+
+    addr->forward_message = forw ? forw->forward_message : 0;
+    if (!forw || !DEQ_IS_EMPTY(addr->subscriptions))
+        return;
+
+    if (forw->forward_message == qdr_forward_closest_CT && !(addr->config && addr->config->group_affinity))
+        addr->forward_message = qdr_forward_closest_plain_CT;
+    else if (forw->forward_message == qdr_forward_multicast_CT && qd_bitmask_cardinality(addr->rnodes) == 0)
+        addr->forward_message = qdr_forward_multicast_local_CT;
+}
+
+
 int qdr_forward_message_CT(qdr_core_t *core, qdr_address_t *addr, qd_message_t *msg, qdr_delivery_t *in_delivery,
                            bool exclude_inprocess, bool control)
 {
     int fanout = 0;
-    if (addr->forwarder)
-        fanout = addr->forwarder->forward_message(core, addr, msg, in_delivery, exclude_inprocess, control);
+    if (addr->forward_message)
+        fanout = addr->forward_message(core, addr, msg, in_delivery, exclude_inprocess, control);
+    QD_PROBE3(forward, qd_message_trace_id(msg), addr->treatment, fanout);
 
     // TODO - Deal with this delivery's disposition
     return fanout;
 }
 
 
+//
+// An anycast address can take a message now if an in-process subscriber or a remote
+// router can consume it, or if one of its local consumers has credit to spare.
+//
+static bool qdr_addr_can_forward_CT(qdr_address_t *addr)
+{
+    if (DEQ_SIZE(addr->subscriptions) > 0 || qd_bitmask_cardinality(addr->rnodes) > 0)
+        return true;
+
+    qdr_link_ref_t *ref = DEQ_HEAD(addr->rlinks);
+    while (ref) {
+        if (ref->link->credit_available > 0)
+            return true;
+        ref = DEQ_NEXT(ref);
+    }
+    return false;
+}
+
+
+static bool qdr_addr_queue_full_CT(qdr_address_t *addr, size_t bytes)
+{
+    qdr_address_config_t *config = addr->config;
+    if (DEQ_SIZE(addr->queue) >= config->queue_max_depth)
+        return true;
+    return config->queue_max_bytes > 0 && addr->queue_bytes + bytes > config->queue_max_bytes;
+}
+
+
+bool qdr_addr_queue_CT(qdr_core_t *core, qdr_address_t *addr, qdr_delivery_t *dlv)
+{
+    if (!addr->config || addr->config->queue_max_depth <= 0 || qdr_is_addr_treatment_multicast(addr))
+        return false;
+
+    if (!qd_message_receive_complete(dlv->msg))
+        return false;
+
+    //
+    // Messages queued earlier go first.  If there was nothing ahead of this one and a
+    // consumer can take it, forward it the usual way.
+    //
+    if (DEQ_SIZE(addr->queue) > 0)
+        qdr_addr_drain_queue_CT(core, addr);
+    if (DEQ_SIZE(addr->queue) == 0 && qdr_addr_can_forward_CT(addr))
+        return false;
+
+    size_t bytes = qd_message_buffered_size(dlv->msg);
+    if (qdr_addr_queue_full_CT(addr, bytes)) {
+        //
+        // Leave the delivery to the normal path, which withholds credit from the
+        // producer until the consumers catch up.
+        //
+        qdr_address_stats_CT(addr)->queue_full_count++;
+        return false;
+    }
+
+    qdr_queued_message_t *queued = new_qdr_queued_message_t();
+    ZERO(queued);
+    queued->msg          = qd_message_copy(dlv->msg);
+    queued->bytes        = bytes;
+    queued->enqueue_usec = qd_timer_now_usec();
+    DEQ_INSERT_TAIL(addr->queue, queued);
+    addr->queue_bytes += bytes;
+    qdr_address_stats_CT(addr)->queued_deliveries++;
+
+    //
+    // The router now owns the message.  Accept and settle it on the producer's
+    // link so its credit is replenished right away.
+    //
+    if (!dlv->settled) {
+        dlv->disposition = PN_ACCEPTED;
+        dlv->settled     = true;
+        qdr_delivery_push_CT(core, dlv);
+    }
+
+    qd_log(core->log, QD_LOG_TRACE, "Queued message on address %s (depth %zu)",
+           (const char*) qd_hash_key_by_handle(addr->hash_handle), DEQ_SIZE(addr->queue));
+    return true;
+}
+
+
+static void qdr_addr_dequeue_CT(qdr_address_t *addr, qdr_queued_message_t *queued)
+{
+    DEQ_REMOVE_HEAD(addr->queue);
+    addr->queue_bytes -= queued->bytes;
+    qd_message_free(queued->msg);
+    free_qdr_queued_message_t(queued);
+}
+
+
+void qdr_addr_drain_queue_CT(qdr_core_t *core, qdr_address_t *addr)
+{
+    qdr_queued_message_t *queued = DEQ_HEAD(addr->queue);
+    while (queued && qdr_addr_can_forward_CT(addr)) {
+        (void) qdr_forward_message_CT(core, addr, queued->msg, 0, false, false);
+
+        qdr_address_stats_t *stats = qdr_address_stats_CT(addr);
+        uint64_t wait = (uint64_t) (qd_timer_now_usec() - queued->enqueue_usec);
+        stats->queue_wait_usec_total += wait;
+        if (wait > stats->queue_wait_usec_max)
+            stats->queue_wait_usec_max = wait;
+        stats->dequeued_deliveries++;
+
+        qdr_addr_dequeue_CT(addr, queued);
+        queued = DEQ_HEAD(addr->queue);
+    }
+}
+
+
+void qdr_addr_flush_queue_CT(qdr_core_t *core, qdr_address_t *addr)
+{
+    qdr_queued_message_t *queued = DEQ_HEAD(addr->queue);
+    while (queued) {
+        qdr_addr_dequeue_CT(addr, queued);
+        queued = DEQ_HEAD(addr->queue);
+    }
+}
+
+
 bool qdr_forward_attach_CT(qdr_core_t *core, qdr_address_t *addr, qdr_link_t *in_link,
                            qdr_terminus_t *source, qdr_terminus_t *target)
 {
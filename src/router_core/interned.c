@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "interned.h"
+#include "iterator_private.h"
+#include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/hash.h>
+#include <qpid/dispatch/iterator.h>
+#include <qpid/dispatch/threading.h>
+#include <assert.h>
+
+typedef struct qdr_interned_t {
+    qd_hash_handle_t *handle;
+    uint32_t          refs;
+} qdr_interned_t;
+
+ALLOC_DECLARE(qdr_interned_t);
+ALLOC_DEFINE(qdr_interned_t);
+
+static sys_mutex_t *intern_lock;
+static qd_hash_t   *interned;
+
+
+void qdr_intern_initialize(void)
+{
+    intern_lock = sys_mutex();
+    interned    = qd_hash(10, 32, 0);
+}
+
+
+void qdr_intern_finalize(void)
+{
+    //
+    // The connections holding references have all been freed by now
+    //
+    qd_hash_free(interned);
+    sys_mutex_free(intern_lock);
+    interned    = 0;
+    intern_lock = 0;
+}
+
+
+static qdr_interned_t *qdr_interned_LH(qd_iterator_t *key)
+{
+    qdr_interned_t *entry = 0;
+    qd_hash_retrieve(interned, key, (void**) &entry);
+    return entry;
+}
+
+
+const char *qdr_intern(const char *value)
+{
+    if (!value)
+        return 0;
+
+    qd_iterator_t key;
+    qd_iterator_init_string(&key, value, ITER_VIEW_ALL);
+    sys_mutex_lock(intern_lock);
+    qdr_interned_t *entry = qdr_interned_LH(&key);
+    if (!entry) {
+        entry = new_qdr_interned_t();
+        ZERO(entry);
+        if (qd_hash_insert(interned, &key, entry, &entry->handle) != QD_ERROR_NONE) {
+            sys_mutex_unlock(intern_lock);
+            qd_iterator_fini(&key);
+            free_qdr_interned_t(entry);
+            return 0;
+        }
+    }
+    entry->refs++;
+    const char *shared = (const char*) qd_hash_key_by_handle(entry->handle);
+    sys_mutex_unlock(intern_lock);
+    qd_iterator_fini(&key);
+    return shared;
+}
+
+
+void qdr_intern_release(const char *shared)
+{
+    if (!shared)
+        return;
+
+    qd_iterator_t key;
+    qd_iterator_init_string(&key, shared, ITER_VIEW_ALL);
+    sys_mutex_lock(intern_lock);
+    qdr_interned_t *entry = qdr_interned_LH(&key);
+    assert(entry && (const char*) qd_hash_key_by_handle(entry->handle) == shared);
+    if (entry && --entry->refs == 0) {
+        qd_hash_remove_by_handle(interned, entry->handle);
+        qd_hash_handle_free(entry->handle);
+        free_qdr_interned_t(entry);
+    }
+    sys_mutex_unlock(intern_lock);
+    qd_iterator_fini(&key);
+}
@@ -0,0 +1,42 @@
+#ifndef qd_router_core_interned
+#define qd_router_core_interned 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Shared, reference-counted copies of the strings that many connections hold the
+// same value of: container ids, vhosts, users, SASL mechanisms and TLS parameters.
+// The functions are thread safe; connection info is created on the I/O threads and
+// freed on the core thread.
+//
+
+void qdr_intern_initialize(void);
+void qdr_intern_finalize(void);
+
+/**
+ * Return the shared copy of value, adding a reference.  Returns 0 for a null value.
+ */
+const char *qdr_intern(const char *value);
+
+/**
+ * Drop a reference taken by qdr_intern.  Null is ignored.
+ */
+void qdr_intern_release(const char *interned);
+
+#endif
@@ -33,12 +33,14 @@ const char *ENTITY = "entityType";
 const char *TYPE = "type";
 const char *COUNT = "count";
 const char *OFFSET = "offset";
+const char *PAGE_SIZE = "pageSize";
 const char *NAME = "name";
 const char *IDENTITY = "identity";
 
 
 const char *OPERATION = "operation";
 const char *ATTRIBUTE_NAMES = "attributeNames";
+const char *FILTER = "filter";
 
 
 const unsigned char *config_address_entity_type  = (unsigned char*) "org.apache.qpid.dispatch.router.config.address";
@@ -52,11 +54,13 @@ const unsigned char *connection_entity_type      = (unsigned char*) "org.apache.
 const unsigned char *config_exchange_entity_type = (unsigned char*) "org.apache.qpid.dispatch.router.config.exchange";
 const unsigned char *config_binding_entity_type  = (unsigned char*) "org.apache.qpid.dispatch.router.config.binding";
 const unsigned char *conn_link_route_entity_type = (unsigned char*) "org.apache.qpid.dispatch.router.connection.linkRoute";
+const unsigned char *core_action_entity_type     = (unsigned char*) "org.apache.qpid.dispatch.router.coreAction";
 
 const char * const status_description = "statusDescription";
 const char * const correlation_id = "correlation-id";
 const char * const results = "results";
 const char * const status_code = "statusCode";
+const char * const partial = "partial";
 
 const char * MANAGEMENT_INTERNAL = "_local/$_management_internal";
 
@@ -66,6 +70,10 @@ const unsigned char *MANAGEMENT_CREATE = (unsigned char*) "CREATE";
 const unsigned char *MANAGEMENT_READ   = (unsigned char*) "READ";
 const unsigned char *MANAGEMENT_UPDATE = (unsigned char*) "UPDATE";
 const unsigned char *MANAGEMENT_DELETE = (unsigned char*) "DELETE";
+const unsigned char *MANAGEMENT_BULK_CREATE = (unsigned char*) "BULK-CREATE";
+const unsigned char *MANAGEMENT_BULK_DELETE = (unsigned char*) "BULK-DELETE";
+const unsigned char *MANAGEMENT_GET_SUMMARY = (unsigned char*) "GET-SUMMARY";
+const unsigned char *MANAGEMENT_GET_EDGE_SUMMARY = (unsigned char*) "GET-EDGE-SUMMARY";
 
 
 typedef enum {
@@ -73,11 +81,18 @@ typedef enum {
     QD_ROUTER_OPERATION_CREATE,
     QD_ROUTER_OPERATION_READ,
     QD_ROUTER_OPERATION_UPDATE,
-    QD_ROUTER_OPERATION_DELETE
+    QD_ROUTER_OPERATION_DELETE,
+    QD_ROUTER_OPERATION_BULK_CREATE,
+    QD_ROUTER_OPERATION_BULK_DELETE,
+    QD_ROUTER_OPERATION_GET_SUMMARY,
+    QD_ROUTER_OPERATION_GET_EDGE_SUMMARY
 } qd_router_operation_type_t;
 
 
-typedef struct qd_management_context_t {
+typedef struct qd_management_context_t qd_management_context_t;
+
+struct qd_management_context_t {
+    DEQ_LINKS(qd_management_context_t);
     qd_message_t               *msg;
     qd_message_t               *source;
     qd_composed_field_t        *field;
@@ -85,11 +100,38 @@ typedef struct qd_management_context_t {
     qdr_core_t                 *core;
     int                         count;
     int                         current_count;
+    int                         offset;
     qd_router_operation_type_t  operation_type;
-} qd_management_context_t ;
+    qdr_agent_snapshot_t       *snapshot;   ///< Snapshot this context is building
+    int                         page_size;  ///< Rows per response message of a paged query, 0 for one response
+    int                         page_rows;  ///< Rows in the page being composed
+    qd_buffer_list_t            names;      ///< The attributeNames list repeated in each page
+};
 
 ALLOC_DECLARE(qd_management_context_t);
 ALLOC_DEFINE(qd_management_context_t);
+DEQ_DECLARE(qd_management_context_t, qd_management_context_list_t);
+
+//
+// The encoded rows of an address, link or connection query, taken by running
+// the query once on the core and shared by the QUERY requests with the same
+// attributeNames and filter that arrive within managementSnapshotMillis.
+// Those requests are answered on the thread handling them, for any offset and
+// count, without going through the core thread.
+//
+struct qdr_agent_snapshot_t {
+    DEQ_LINKS(qdr_agent_snapshot_t);
+    unsigned char                *key;         ///< Entity type, attributeNames and filter as encoded
+    int                           key_length;
+    qd_buffer_list_t              names;       ///< The attributeNames list of the response
+    qd_buffer_list_t             *rows;
+    int                           row_count;
+    int                           row_capacity;
+    int64_t                       taken_msec;
+    bool                          complete;
+    int                           refs;        ///< The cache and each response being written
+    qd_management_context_list_t  waiting;     ///< Requests for the snapshot being built
+};
 
 /**
  * Convenience function to create and initialize context (qd_management_context_t)
@@ -103,6 +145,7 @@ static qd_management_context_t* qd_management_context(qd_message_t
                                                       int                        count)
 {
     qd_management_context_t *ctx = new_qd_management_context_t();
+    ZERO(ctx);
     ctx->count  = count;
     ctx->field  = field;
     ctx->msg    = msg;
@@ -117,9 +160,10 @@ static qd_management_context_t* qd_management_context(qd_message_t
 
 
 /**
- * Sets the error status on a new composed field.
+ * Sets the error status on a new composed field.  A response that is not the
+ * last page of a paged query is marked partial.
  */
-static void qd_set_response_status(const qd_amqp_error_t *error, qd_composed_field_t **field)
+static void qd_set_response_status(const qd_amqp_error_t *error, bool is_partial, qd_composed_field_t **field)
 {
     //
     // Insert appropriate success or error
@@ -130,6 +174,10 @@ static void qd_set_response_status(const qd_amqp_error_t *error, qd_composed_fie
     qd_compose_insert_string(*field, error->description);
     qd_compose_insert_string(*field, status_code);
     qd_compose_insert_int(*field, error->status);
+    if (is_partial) {
+        qd_compose_insert_string(*field, partial);
+        qd_compose_insert_bool(*field, true);
+    }
     qd_compose_end_map(*field);
 }
 
@@ -139,21 +187,9 @@ static void qd_set_properties(qd_message_t         *msg,
                               qd_composed_field_t **fld)
 {
     //
-    // Start header
-    //
-    *fld   = qd_compose(QD_PERFORMATIVE_HEADER, 0);
-
-    qd_compose_start_list(*fld);
-    qd_compose_insert_bool(*fld, 0);     // durable
-    qd_compose_end_list(*fld);
-
-    //
-    // End header, start properties
+    // Header, and properties up to the "to" field
     //
-    *fld = qd_compose(QD_PERFORMATIVE_PROPERTIES, *fld);
-    qd_compose_start_list(*fld);
-    qd_compose_insert_null(*fld);                           // message-id
-    qd_compose_insert_null(*fld);                           // user-id
+    *fld = qd_message_start_properties();
     qd_iterator_t *correlation_id = qd_message_field_iterator_typed(msg, QD_FIELD_CORRELATION_ID);
     // Grab the reply_to field from the incoming message. This is the address we will send the response to.
     *reply_to = qd_message_field_iterator(msg, QD_FIELD_REPLY_TO);
@@ -169,15 +205,27 @@ static void qd_set_properties(qd_message_t         *msg,
 }
 
 
+static void qd_manage_send_response(qd_management_context_t *ctx, const qd_amqp_error_t *status);
+static void qd_manage_send_page(qd_management_context_t *ctx);
+static void qd_manage_snapshot_row(qd_management_context_t *ctx, bool more);
+
+
 static void qd_manage_response_handler(void *context, const qd_amqp_error_t *status, bool more)
 {
     qd_management_context_t *ctx = (qd_management_context_t*) context;
     bool need_free = false;
+
+    if (ctx->snapshot) {
+        qd_manage_snapshot_row(ctx, more);
+        return;
+    }
     if (ctx->operation_type == QD_ROUTER_OPERATION_QUERY) {
         if (status->status / 100 == 2) { // There is no error, proceed to conditionally call get_next
             if (more) {
                 ctx->current_count++; // Increment how many you have at hand
                 if (ctx->count != ctx->current_count) {
+                    if (ctx->page_size > 0 && ++ctx->page_rows == ctx->page_size)
+                        qd_manage_send_page(ctx);
                     qdr_query_get_next(ctx->query);
                     return;
                 } else {
@@ -205,6 +253,22 @@ static void qd_manage_response_handler(void *context, const qd_amqp_error_t *sta
         }
     }
 
+    qd_manage_send_response(ctx, status);
+
+    if (need_free) {
+        qdr_query_free(ctx->query);
+    }
+    qd_buffer_list_free_buffers(&ctx->names);
+    free_qd_management_context_t(ctx);
+}
+
+
+/**
+ * Compose the response message from the body in ctx->field and send it.  The
+ * body's buffers move into the message, leaving the field empty.
+ */
+static void qd_manage_send_message(qd_management_context_t *ctx, const qd_amqp_error_t *status, bool is_partial)
+{
     qd_iterator_t       *reply_to = 0;
     qd_composed_field_t *fld = 0;
 
@@ -213,65 +277,341 @@ static void qd_manage_response_handler(void *context, const qd_amqp_error_t *sta
     qd_set_properties(ctx->source, &reply_to, &fld);
 
     // Second, set the status on the message, QD_AMQP_OK or QD_AMQP_BAD_REQUEST and so on.
-    qd_set_response_status(status, &fld);
+    qd_set_response_status(status, is_partial, &fld);
 
     // Finally, compose and send the message.
     qd_message_compose_3(ctx->msg, fld, ctx->field);
 
     qdr_send_to1(ctx->core, ctx->msg, reply_to, true, false);
 
-    // We have come to the very end. Free the appropriate memory.
-    // Just go over this with Ted to see if I freed everything.
-
     qd_iterator_free(reply_to);
     qd_compose_free(fld);
-
     qd_message_free(ctx->msg);
+    ctx->msg = 0;
+}
+
+
+static void qd_manage_send_response(qd_management_context_t *ctx, const qd_amqp_error_t *status)
+{
+    qd_manage_send_message(ctx, status, false);
+
+    // We have come to the very end. Free the appropriate memory.
     qd_message_free(ctx->source);
     qd_compose_free(ctx->field);
+}
 
-    if (need_free) {
-        qdr_query_free(ctx->query);
+
+/**
+ * Start the body of a page of a paged query: the attribute names and an open
+ * results list, which the query's rows are written into.
+ */
+static void qd_manage_start_page(qd_management_context_t *ctx)
+{
+    qd_buffer_list_t copy;
+
+    qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, ctx->field);
+    qd_compose_start_map(ctx->field);
+    qd_compose_insert_string(ctx->field, ATTRIBUTE_NAMES);
+    qd_buffer_list_clone(&copy, &ctx->names);
+    qd_compose_insert_buffers(ctx->field, &copy);
+    qd_compose_insert_string(ctx->field, results);
+    qd_compose_start_list(ctx->field);
+    ctx->page_rows = 0;
+}
+
+
+/**
+ * Send the full page of a paged query as a partial response and start the
+ * next, so that no more than a page of rows is ever held.  The final response,
+ * which may hold no rows, is sent as for any query.
+ */
+static void qd_manage_send_page(qd_management_context_t *ctx)
+{
+    qd_compose_end_list(ctx->field);
+    qd_compose_end_map(ctx->field);
+    qd_manage_send_message(ctx, &QD_AMQP_OK, true);
+    ctx->msg = qd_message();
+    qd_manage_start_page(ctx);
+}
+
+
+static void qd_snapshot_decref(qdr_agent_snapshot_t *snap)
+{
+    // called with the snapshot lock held
+    if (--snap->refs > 0)
+        return;
+    for (int i = 0; i < snap->row_count; i++)
+        qd_buffer_list_free_buffers(&snap->rows[i]);
+    qd_buffer_list_free_buffers(&snap->names);
+    free(snap->rows);
+    free(snap->key);
+    free(snap);
+}
+
+
+static void qd_snapshot_key_append(unsigned char *key, int *length, qd_parsed_field_t *field)
+{
+    if (!field) {
+        key[(*length)++] = QD_AMQP_NULL;
+        return;
     }
+    qd_iterator_t *iter = qd_parse_typed(field);
+    *length += qd_iterator_ncopy(iter, key + *length, qd_iterator_length(iter));
+}
+
+
+static unsigned char *qd_snapshot_key(qd_router_entity_type_t entity_type, qd_parsed_field_t *attribute_names,
+                                      qd_parsed_field_t *filter, int *length)
+{
+    int size = 3;
+    if (attribute_names) size += qd_iterator_length(qd_parse_typed(attribute_names));
+    if (filter)          size += qd_iterator_length(qd_parse_typed(filter));
+
+    unsigned char *key = (unsigned char*) malloc(size);
+    *length = 0;
+    key[(*length)++] = (unsigned char) entity_type;
+    qd_snapshot_key_append(key, length, attribute_names);
+    qd_snapshot_key_append(key, length, filter);
+    return key;
+}
+
+
+/**
+ * Write the attribute names and the requested rows of a complete snapshot into
+ * the response and send it.
+ */
+static void qd_snapshot_respond(qd_management_context_t *ctx, qdr_agent_snapshot_t *snap)
+{
+    qd_buffer_list_t copy;
+
+    qd_buffer_list_clone(&copy, &snap->names);
+    qd_compose_insert_buffers(ctx->field, &copy);
+    qd_compose_insert_string(ctx->field, results);
+    qd_compose_start_list(ctx->field);
+    int first = ctx->offset < 0 ? 0 : ctx->offset;
+    int last  = snap->row_count;
+    if (ctx->count >= 0 && first + ctx->count < last)
+        last = first + ctx->count;
+    for (int i = first; i < last; i++) {
+        qd_buffer_list_clone(&copy, &snap->rows[i]);
+        qd_compose_insert_buffers(ctx->field, &copy);
+    }
+    qd_compose_end_list(ctx->field);
+    qd_compose_end_map(ctx->field);
+
+    qd_manage_send_response(ctx, &QD_AMQP_OK);
     free_qd_management_context_t(ctx);
 }
 
 
+/**
+ * Called for each row of a query building a snapshot.
+ */
+static void qd_manage_snapshot_row(qd_management_context_t *ctx, bool more)
+{
+    qdr_agent_snapshot_t *snap = ctx->snapshot;
+    qd_buffer_list_t      row;
+
+    qd_compose_take_buffers(ctx->field, &row);
+    if (!DEQ_IS_EMPTY(row)) {
+        if (snap->row_count == snap->row_capacity) {
+            snap->row_capacity = snap->row_capacity ? snap->row_capacity * 2 : 64;
+            snap->rows = (qd_buffer_list_t*) realloc(snap->rows, snap->row_capacity * sizeof(qd_buffer_list_t));
+        }
+        snap->rows[snap->row_count++] = row;
+    }
+
+    if (more) {
+        qdr_query_get_next(ctx->query);
+        return;
+    }
+
+    //
+    // The listing is complete; the core frees the query on return.  Answer
+    // the requests that waited for it.
+    //
+    qdr_core_t *core = ctx->core;
+    qd_compose_free(ctx->field);
+    free_qd_management_context_t(ctx);
+
+    qd_management_context_list_t waiting;
+    sys_mutex_lock(core->snapshot_lock);
+    snap->complete   = true;
+    snap->taken_msec = qd_timer_now_usec() / 1000;
+    DEQ_MOVE(snap->waiting, waiting);
+    snap->refs++;
+    sys_mutex_unlock(core->snapshot_lock);
+
+    qd_management_context_t *waiter = DEQ_HEAD(waiting);
+    while (waiter) {
+        DEQ_REMOVE_HEAD(waiting);
+        qd_snapshot_respond(waiter, snap);
+        waiter = DEQ_HEAD(waiting);
+    }
+
+    sys_mutex_lock(core->snapshot_lock);
+    qd_snapshot_decref(snap);
+    sys_mutex_unlock(core->snapshot_lock);
+}
+
+
+/**
+ * Answer a query from a snapshot, or start building one.  Returns false if
+ * snapshots are off or do not cover the entity type.
+ */
+static bool qd_snapshot_query(qdr_core_t                *core,
+                              qd_management_context_t   *ctx,
+                              qd_router_entity_type_t    entity_type,
+                              qd_parsed_field_t         *attribute_names,
+                              qd_parsed_field_t         *filter,
+                              uint64_t                   in_conn)
+{
+    if (core->agent_snapshot_msec <= 0)
+        return false;
+    if (entity_type != QD_ROUTER_ADDRESS && entity_type != QD_ROUTER_LINK && entity_type != QD_ROUTER_CONNECTION)
+        return false;
+
+    int            key_length;
+    unsigned char *key = qd_snapshot_key(entity_type, attribute_names, filter, &key_length);
+    int64_t        now = qd_timer_now_usec() / 1000;
+
+    sys_mutex_lock(core->snapshot_lock);
+    qdr_agent_snapshot_t *snap = DEQ_HEAD(core->agent_snapshots);
+    while (snap) {
+        qdr_agent_snapshot_t *next = DEQ_NEXT(snap);
+        if (snap->complete && now - snap->taken_msec >= core->agent_snapshot_msec) {
+            DEQ_REMOVE(core->agent_snapshots, snap);
+            qd_snapshot_decref(snap);
+        } else if (snap->key_length == key_length && memcmp(snap->key, key, key_length) == 0)
+            break;
+        snap = next;
+    }
+
+    if (snap) {
+        free(key);
+        if (!snap->complete) {
+            DEQ_INSERT_TAIL(snap->waiting, ctx);
+            sys_mutex_unlock(core->snapshot_lock);
+            return true;
+        }
+        snap->refs++;
+        sys_mutex_unlock(core->snapshot_lock);
+        qd_snapshot_respond(ctx, snap);
+        sys_mutex_lock(core->snapshot_lock);
+        qd_snapshot_decref(snap);
+        sys_mutex_unlock(core->snapshot_lock);
+        return true;
+    }
+
+    snap = NEW(qdr_agent_snapshot_t);
+    ZERO(snap);
+    snap->key        = key;
+    snap->key_length = key_length;
+    snap->refs       = 1;
+    DEQ_INIT(snap->names);
+    DEQ_INIT(snap->waiting);
+    DEQ_INSERT_TAIL(snap->waiting, ctx);
+    DEQ_INSERT_TAIL(core->agent_snapshots, snap);
+    sys_mutex_unlock(core->snapshot_lock);
+
+    //
+    // Run the whole listing through the core, one row at a time as usual.
+    //
+    qd_management_context_t *builder = new_qd_management_context_t();
+    ZERO(builder);
+    builder->core           = core;
+    builder->count          = -1;
+    builder->operation_type = QD_ROUTER_OPERATION_QUERY;
+    builder->snapshot       = snap;
+    builder->field          = qd_compose_subfield(0);
+    builder->query          = qdr_manage_query(core, builder, entity_type, attribute_names, builder->field, in_conn);
+    qdr_query_set_filter(builder->query, filter);
+    qdr_query_add_attribute_names(builder->query);
+    qd_compose_take_buffers(builder->field, &snap->names);
+    qdr_query_get_first(builder->query, 0);
+    return true;
+}
+
+
+void qdr_management_agent_free_snapshots(qdr_core_t *core)
+{
+    qdr_agent_snapshot_t *snap = DEQ_HEAD(core->agent_snapshots);
+    while (snap) {
+        DEQ_REMOVE_HEAD(core->agent_snapshots);
+        qd_snapshot_decref(snap);
+        snap = DEQ_HEAD(core->agent_snapshots);
+    }
+}
+
+
 static void qd_core_agent_query_handler(qdr_core_t                 *core,
                                         qd_router_entity_type_t     entity_type,
                                         qd_router_operation_type_t  operation_type,
                                         qd_message_t               *msg,
                                         int                        *count,
                                         int                        *offset,
+                                        int                         page_size,
                                         uint64_t                    in_conn)
 {
-    //
-    // Add the Body.
-    //
-    qd_composed_field_t *field = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
-
-    // Start a map in the body. Look for the end map in the callback function, qd_manage_response_handler.
-    qd_compose_start_map(field);
-
-    //add a "attributeNames" key
-    qd_compose_insert_string(field, ATTRIBUTE_NAMES);
+    qd_composed_field_t *field = qd_compose_subfield(0);
 
     // Call local function that creates and returns a local qd_management_context_t object containing the values passed in.
     qd_management_context_t *ctx = qd_management_context(qd_message(), msg, field, 0, core, operation_type, (*count));
 
     // Grab the attribute names from the incoming message body. The attribute names will be used later on in the response.
     qd_parsed_field_t *attribute_names_parsed_field = 0;
+    qd_parsed_field_t *filter_parsed_field = 0;
 
     qd_iterator_t *body_iter = qd_message_field_iterator(msg, QD_FIELD_BODY);
 
     qd_parsed_field_t *body = qd_parse(body_iter);
     if (body != 0 && qd_parse_is_map(body)) {
         attribute_names_parsed_field = qd_parse_value_by_key(body, ATTRIBUTE_NAMES);
+        filter_parsed_field          = qd_parse_value_by_key(body, FILTER);
     }
 
     // Set the callback function.
     qdr_manage_handler(core, qd_manage_response_handler);
+
+    ctx->offset    = *offset;
+    ctx->page_size = page_size;
+
+    if (page_size > 0) {
+        //
+        // A paged query sends each page of rows as it fills, so it is always
+        // run live: capture the attribute names to repeat in every page.
+        //
+        ctx->query = qdr_manage_query(core, ctx, entity_type, attribute_names_parsed_field, field, in_conn);
+        qdr_query_set_filter(ctx->query, filter_parsed_field);
+        qdr_query_add_attribute_names(ctx->query);
+        qd_compose_take_buffers(field, &ctx->names);
+        qd_manage_start_page(ctx);
+        qdr_query_get_first(ctx->query, (*offset));
+
+        qd_iterator_free(body_iter);
+        qd_parse_free(body);
+        return;
+    }
+
+    //
+    // Add the Body.
+    //
+    qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, field);
+
+    // Start a map in the body. Look for the end map in the callback function, qd_manage_response_handler.
+    qd_compose_start_map(field);
+
+    //add a "attributeNames" key
+    qd_compose_insert_string(field, ATTRIBUTE_NAMES);
+
+    if (qd_snapshot_query(core, ctx, entity_type, attribute_names_parsed_field, filter_parsed_field, in_conn)) {
+        qd_iterator_free(body_iter);
+        qd_parse_free(body);
+        return;
+    }
+
     ctx->query = qdr_manage_query(core, ctx, entity_type, attribute_names_parsed_field, field, in_conn);
+    qdr_query_set_filter(ctx->query, filter_parsed_field);
 
     //Add the attribute names
     qdr_query_add_attribute_names(ctx->query); //this adds a list of attribute names like ["attribute1", "attribute2", "attribute3", "attribute4",]
@@ -385,21 +725,76 @@ static void qd_core_agent_delete_handler(qdr_core_t                 *core,
 }
 
 
+/**
+ * Handles BULK-CREATE and BULK-DELETE: the body is a list with a map for each
+ * entity and the response body a list with each entity's outcome.
+ */
+static void qd_core_agent_bulk_handler(qdr_core_t                 *core,
+                                       qd_message_t               *msg,
+                                       qd_router_entity_type_t     entity_type,
+                                       qd_router_operation_type_t  operation_type,
+                                       uint64_t                    in_conn)
+{
+    qd_composed_field_t *out_body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+
+    // Set the callback function.
+    qdr_manage_handler(core, qd_manage_response_handler);
+
+    qd_management_context_t *ctx = qd_management_context(qd_message(), msg, out_body, 0, core, operation_type, 0);
+
+    qd_iterator_t     *body_iter = qd_message_field_iterator(msg, QD_FIELD_BODY);
+    qd_parsed_field_t *in_body   = qd_parse(body_iter);
+    qd_iterator_free(body_iter);
+
+    if (operation_type == QD_ROUTER_OPERATION_BULK_CREATE)
+        qdr_manage_bulk_create(core, ctx, entity_type, in_body, out_body, in_conn);
+    else
+        qdr_manage_bulk_delete(core, ctx, entity_type, in_body, out_body, in_conn);
+}
+
+
+/**
+ * Handles GET-SUMMARY and GET-EDGE-SUMMARY on the router: the response body is
+ * a map summarizing this router's traffic, or that of its edges.
+ */
+static void qd_core_agent_summary_handler(qdr_core_t                 *core,
+                                          qd_message_t               *msg,
+                                          qd_router_entity_type_t     entity_type,
+                                          qd_router_operation_type_t  operation_type,
+                                          uint64_t                    in_conn)
+{
+    qd_composed_field_t *out_body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+
+    // Set the callback function.
+    qdr_manage_handler(core, qd_manage_response_handler);
+
+    qd_management_context_t *ctx = qd_management_context(qd_message(), msg, out_body, 0, core, operation_type, 0);
+
+    qdr_manage_summary(core, ctx, entity_type, operation_type == QD_ROUTER_OPERATION_GET_EDGE_SUMMARY,
+                       out_body, in_conn);
+}
+
+
 /**
  * Checks the content of the message to see if this can be handled by the C-management agent. If this agent cannot handle it, it will be
  * forwarded to the Python agent.
  */
-static bool qd_can_handle_request(qd_parsed_field_t           *properties_fld,
+static bool qd_can_handle_request(qd_iterator_t               *properties_iter,
                                   qd_router_entity_type_t     *entity_type,
                                   qd_router_operation_type_t  *operation_type,
-                                  qd_iterator_t              **identity_iter,
-                                  qd_iterator_t              **name_iter,
+                                  qd_iterator_pointer_t       *identity,
+                                  qd_iterator_pointer_t       *name,
                                   int                         *count,
-                                  int                         *offset)
+                                  int                         *offset,
+                                  int                         *page_size)
 {
+    enum { P_IDENTITY, P_NAME, P_ENTITY, P_TYPE, P_OPERATION, P_COUNT, P_OFFSET, P_PAGE_SIZE, P_N };
+    const char *keys[P_N] = { IDENTITY, NAME, ENTITY, TYPE, OPERATION, COUNT, OFFSET, PAGE_SIZE };
+    qd_parsed_turbo_t values[P_N];
+
     // The must be a property field and that property field should be a AMQP map. This is true for QUERY but I need
     // to check if it true for CREATE, UPDATE and DELETE
-    if (properties_fld == 0 || !qd_parse_is_map(properties_fld))
+    if (properties_iter == 0 || qd_parse_map_locate(properties_iter, keys, P_N, values) != 0)
         return false;
 
     //
@@ -408,80 +803,95 @@ static bool qd_can_handle_request(qd_parsed_field_t           *properties_fld,
     // 'entityType': 'org.apache.qpid.dispatch.router.link'
     // TODO - Add more entity types here. The above is not a complete list.
 
-    qd_parsed_field_t *parsed_field = qd_parse_value_by_key(properties_fld, IDENTITY);
-    if (parsed_field!=0) {
-        *identity_iter = qd_parse_raw(parsed_field);
-    }
-    parsed_field = qd_parse_value_by_key(properties_fld, NAME);
-    if (parsed_field!=0) {
-        *name_iter = qd_parse_raw(parsed_field);
-    }
+    if (values[P_IDENTITY].tag)
+        qd_parse_turbo_raw(&values[P_IDENTITY], identity);
+    if (values[P_NAME].tag)
+        qd_parse_turbo_raw(&values[P_NAME], name);
 
-    parsed_field = qd_parse_value_by_key(properties_fld, ENTITY);
+    const qd_parsed_turbo_t *value = &values[P_ENTITY];
 
-    if (parsed_field == 0) { // Sometimes there is no 'entityType' but 'type' might be available.
-        parsed_field = qd_parse_value_by_key(properties_fld, TYPE);
-        if (parsed_field == 0)
+    if (value->tag == 0) { // Sometimes there is no 'entityType' but 'type' might be available.
+        value = &values[P_TYPE];
+        if (value->tag == 0)
             return false;
     }
 
-    if (qd_iterator_equal(qd_parse_raw(parsed_field), address_entity_type))
+    if (qd_parse_turbo_equal(value, address_entity_type))
         *entity_type = QD_ROUTER_ADDRESS;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), link_entity_type))
+    else if (qd_parse_turbo_equal(value, link_entity_type))
         *entity_type = QD_ROUTER_LINK;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), config_address_entity_type))
+    else if (qd_parse_turbo_equal(value, config_address_entity_type))
         *entity_type = QD_ROUTER_CONFIG_ADDRESS;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), link_route_entity_type))
+    else if (qd_parse_turbo_equal(value, link_route_entity_type))
         *entity_type = QD_ROUTER_CONFIG_LINK_ROUTE;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), auto_link_entity_type))
+    else if (qd_parse_turbo_equal(value, auto_link_entity_type))
         *entity_type = QD_ROUTER_CONFIG_AUTO_LINK;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), router_entity_type))
+    else if (qd_parse_turbo_equal(value, router_entity_type))
         *entity_type = QD_ROUTER_ROUTER;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), console_entity_type))
+    else if (qd_parse_turbo_equal(value, console_entity_type))
         *entity_type = QD_ROUTER_FORBIDDEN;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), connection_entity_type))
+    else if (qd_parse_turbo_equal(value, connection_entity_type))
         *entity_type = QD_ROUTER_CONNECTION;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), config_exchange_entity_type))
+    else if (qd_parse_turbo_equal(value, config_exchange_entity_type))
         *entity_type = QD_ROUTER_EXCHANGE;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), config_binding_entity_type))
+    else if (qd_parse_turbo_equal(value, config_binding_entity_type))
         *entity_type = QD_ROUTER_BINDING;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), conn_link_route_entity_type))
+    else if (qd_parse_turbo_equal(value, conn_link_route_entity_type))
         *entity_type = QD_ROUTER_CONN_LINK_ROUTE;
+    else if (qd_parse_turbo_equal(value, core_action_entity_type))
+        *entity_type = QD_ROUTER_CORE_ACTION;
     else
         return false;
 
 
-    parsed_field = qd_parse_value_by_key(properties_fld, OPERATION);
+    value = &values[P_OPERATION];
 
-    if (parsed_field == 0)
+    if (value->tag == 0)
         return false;
 
-    if (qd_iterator_equal(qd_parse_raw(parsed_field), MANAGEMENT_QUERY))
+    if (qd_parse_turbo_equal(value, MANAGEMENT_QUERY))
         (*operation_type) = QD_ROUTER_OPERATION_QUERY;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), MANAGEMENT_CREATE))
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_CREATE))
         (*operation_type) = QD_ROUTER_OPERATION_CREATE;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), MANAGEMENT_READ))
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_READ))
         (*operation_type) = QD_ROUTER_OPERATION_READ;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), MANAGEMENT_UPDATE))
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_UPDATE))
         (*operation_type) = QD_ROUTER_OPERATION_UPDATE;
-    else if (qd_iterator_equal(qd_parse_raw(parsed_field), MANAGEMENT_DELETE))
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_DELETE))
         (*operation_type) = QD_ROUTER_OPERATION_DELETE;
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_BULK_CREATE))
+        (*operation_type) = QD_ROUTER_OPERATION_BULK_CREATE;
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_BULK_DELETE))
+        (*operation_type) = QD_ROUTER_OPERATION_BULK_DELETE;
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_GET_SUMMARY))
+        (*operation_type) = QD_ROUTER_OPERATION_GET_SUMMARY;
+    else if (qd_parse_turbo_equal(value, MANAGEMENT_GET_EDGE_SUMMARY))
+        (*operation_type) = QD_ROUTER_OPERATION_GET_EDGE_SUMMARY;
     else
         // This is an unknown operation type. cannot be handled, return false.
         return false;
 
     // Obtain the count and offset.
-    parsed_field = qd_parse_value_by_key(properties_fld, COUNT);
+    qd_parsed_field_t *parsed_field = qd_parse_turbo_value(&values[P_COUNT]);
     if (parsed_field)
         (*count) = (int)qd_parse_as_long(parsed_field);
     else
         (*count) = -1;
+    qd_parse_free(parsed_field);
 
-    parsed_field = qd_parse_value_by_key(properties_fld, OFFSET);
+    parsed_field = qd_parse_turbo_value(&values[P_OFFSET]);
     if (parsed_field)
         (*offset) = (int)qd_parse_as_long(parsed_field);
     else
         (*offset) = 0;
+    qd_parse_free(parsed_field);
+
+    parsed_field = qd_parse_turbo_value(&values[P_PAGE_SIZE]);
+    if (parsed_field)
+        (*page_size) = (int)qd_parse_as_long(parsed_field);
+    else
+        (*page_size) = 0;
+    qd_parse_free(parsed_field);
 
     return true;
 }
@@ -496,23 +906,42 @@ void qdr_management_agent_on_message(void *context, qd_message_t *msg, int unuse
                                      uint64_t in_conn_id)
 {
     qdr_core_t *core = (qdr_core_t*) context;
-    qd_iterator_t *app_properties_iter = qd_message_field_iterator(msg, QD_FIELD_APPLICATION_PROPERTIES);
+    qd_iterator_t app_properties_iter;
+    bool          has_properties = qd_message_field_iterator_init(msg, QD_FIELD_APPLICATION_PROPERTIES, &app_properties_iter);
 
     qd_router_entity_type_t    entity_type = 0;
     qd_router_operation_type_t operation_type = 0;
 
-    qd_iterator_t *identity_iter = 0;
-    qd_iterator_t *name_iter = 0;
+    //
+    // The identity and name are only read for the duration of this call, so
+    // iterate them in place
+    //
+    qd_iterator_pointer_t identity;
+    qd_iterator_pointer_t name;
+    qd_iterator_t         identity_local;
+    qd_iterator_t         name_local;
+    qd_iterator_t        *identity_iter = 0;
+    qd_iterator_t        *name_iter = 0;
+    ZERO(&identity);
+    ZERO(&name);
 
     int32_t count = 0;
     int32_t offset = 0;
+    int32_t page_size = 0;
 
-    qd_parsed_field_t *properties_fld = qd_parse(app_properties_iter);
-
-    if (qd_can_handle_request(properties_fld, &entity_type, &operation_type, &identity_iter, &name_iter, &count, &offset)) {
+    if (qd_can_handle_request(has_properties ? &app_properties_iter : 0, &entity_type, &operation_type,
+                              &identity, &name, &count, &offset, &page_size)) {
+        if (identity.cursor) {
+            qd_iterator_init_pointer(&identity_local, &identity, ITER_VIEW_ALL);
+            identity_iter = &identity_local;
+        }
+        if (name.cursor) {
+            qd_iterator_init_pointer(&name_local, &name, ITER_VIEW_ALL);
+            name_iter = &name_local;
+        }
         switch (operation_type) {
         case QD_ROUTER_OPERATION_QUERY:
-            qd_core_agent_query_handler(core, entity_type, operation_type, msg, &count, &offset, in_conn_id);
+            qd_core_agent_query_handler(core, entity_type, operation_type, msg, &count, &offset, page_size, in_conn_id);
             break;
         case QD_ROUTER_OPERATION_CREATE:
             qd_core_agent_create_handler(core, msg, entity_type, operation_type, name_iter, in_conn_id);
@@ -526,6 +955,14 @@ void qdr_management_agent_on_message(void *context, qd_message_t *msg, int unuse
         case QD_ROUTER_OPERATION_DELETE:
             qd_core_agent_delete_handler(core, msg, entity_type, operation_type, identity_iter, name_iter, in_conn_id);
             break;
+        case QD_ROUTER_OPERATION_BULK_CREATE:
+        case QD_ROUTER_OPERATION_BULK_DELETE:
+            qd_core_agent_bulk_handler(core, msg, entity_type, operation_type, in_conn_id);
+            break;
+        case QD_ROUTER_OPERATION_GET_SUMMARY:
+        case QD_ROUTER_OPERATION_GET_EDGE_SUMMARY:
+            qd_core_agent_summary_handler(core, msg, entity_type, operation_type, in_conn_id);
+            break;
         }
     } else {
         //
@@ -534,8 +971,9 @@ void qdr_management_agent_on_message(void *context, qd_message_t *msg, int unuse
         qdr_send_to2(core, msg, MANAGEMENT_INTERNAL, false, false);
     }
 
-    qd_iterator_free(app_properties_iter);
-    qd_parse_free(properties_fld);
-
+    qd_iterator_fini(identity_iter);
+    qd_iterator_fini(name_iter);
+    if (has_properties)
+        qd_iterator_fini(&app_properties_iter);
 }
 
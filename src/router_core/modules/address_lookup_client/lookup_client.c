@@ -57,6 +57,28 @@ ALLOC_DECLARE(qcm_addr_lookup_request_t);
 ALLOC_DEFINE(qcm_addr_lookup_request_t);
 
 
+//
+// With addressLookupCacheSeconds set, the results of lookups are kept for that long so that
+// later attaches to the same address, in the same direction, are resolved without asking
+// the interior.  Only results that let the attach proceed are cached: "not a link route"
+// and "link route with destinations".  A link route without destinations fails the attach
+// and is always asked again.  The cache is emptied whenever the edge connection changes.
+//
+#define QCM_ADDR_LOOKUP_CACHE_MAX 4096
+
+typedef struct qcm_addr_lookup_cache_entry_t {
+    DEQ_LINKS(struct qcm_addr_lookup_cache_entry_t);
+    qd_hash_handle_t *hash_handle;
+    qd_direction_t    dir;
+    uint32_t          expire_tick;
+    bool              is_link_route;
+} qcm_addr_lookup_cache_entry_t;
+
+DEQ_DECLARE(qcm_addr_lookup_cache_entry_t, qcm_addr_lookup_cache_list_t);
+ALLOC_DECLARE(qcm_addr_lookup_cache_entry_t);
+ALLOC_DEFINE(qcm_addr_lookup_cache_entry_t);
+
+
 typedef struct qcm_lookup_client_t {
     qdr_core_t                     *core;
     qdrc_event_subscription_t      *event_sub;
@@ -66,9 +88,84 @@ typedef struct qcm_lookup_client_t {
     qdrc_client_t                  *client_api;
     qcm_addr_lookup_request_list_t  pending_requests;
     qcm_addr_lookup_request_list_t  sent_requests;
+    qd_hash_t                      *cache_hash[2];  // Indexed by direction
+    qcm_addr_lookup_cache_list_t    cache_list;     // Oldest first
 } qcm_lookup_client_t;
 
 
+static void qcm_addr_lookup_cache_remove(qcm_lookup_client_t *client, qcm_addr_lookup_cache_entry_t *entry)
+{
+    DEQ_REMOVE(client->cache_list, entry);
+    qd_hash_remove_by_handle(client->cache_hash[entry->dir], entry->hash_handle);
+    qd_hash_handle_free(entry->hash_handle);
+    free_qcm_addr_lookup_cache_entry_t(entry);
+}
+
+
+static void qcm_addr_lookup_cache_flush(qcm_lookup_client_t *client)
+{
+    while (DEQ_HEAD(client->cache_list))
+        qcm_addr_lookup_cache_remove(client, DEQ_HEAD(client->cache_list));
+}
+
+
+static qcm_addr_lookup_cache_entry_t *qcm_addr_lookup_cache_find(qcm_lookup_client_t *client, qd_direction_t dir,
+                                                                 qdr_terminus_t *term)
+{
+    if (client->core->addr_lookup_cache_ttl == 0 || !client->cache_hash[dir])
+        return 0;
+
+    //
+    // Entries expire in the order they were made.  Drop the expired ones first.
+    //
+    qcm_addr_lookup_cache_entry_t *entry = DEQ_HEAD(client->cache_list);
+    while (entry && (int32_t) (client->core->uptime_ticks - entry->expire_tick) >= 0) {
+        qcm_addr_lookup_cache_remove(client, entry);
+        entry = DEQ_HEAD(client->cache_list);
+    }
+
+    char          *key  = (char*) qd_iterator_copy(qdr_terminus_get_address(term));
+    qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+    entry = 0;
+    qd_hash_retrieve(client->cache_hash[dir], iter, (void**) &entry);
+    qd_iterator_free(iter);
+    free(key);
+    return entry;
+}
+
+
+static void qcm_addr_lookup_cache_put(qcm_lookup_client_t *client, qd_direction_t dir, qdr_terminus_t *term,
+                                      bool is_link_route)
+{
+    qdr_core_t *core = client->core;
+    if (core->addr_lookup_cache_ttl == 0 || !qdr_terminus_get_address(term))
+        return;
+
+    qcm_addr_lookup_cache_entry_t *entry = qcm_addr_lookup_cache_find(client, dir, term);
+    if (entry)
+        qcm_addr_lookup_cache_remove(client, entry);
+    if (DEQ_SIZE(client->cache_list) >= QCM_ADDR_LOOKUP_CACHE_MAX)
+        qcm_addr_lookup_cache_remove(client, DEQ_HEAD(client->cache_list));
+
+    if (!client->cache_hash[dir])
+        client->cache_hash[dir] = qd_hash(10, 32, 0);
+
+    entry = new_qcm_addr_lookup_cache_entry_t();
+    ZERO(entry);
+    entry->dir           = dir;
+    entry->expire_tick   = core->uptime_ticks + core->addr_lookup_cache_ttl;
+    entry->is_link_route = is_link_route;
+
+    char          *key  = (char*) qd_iterator_copy(qdr_terminus_get_address(term));
+    qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+    qd_hash_insert(client->cache_hash[dir], iter, entry, &entry->hash_handle);
+    qd_iterator_free(iter);
+    free(key);
+
+    DEQ_INSERT_TAIL(client->cache_list, entry);
+}
+
+
 static char* disambiguated_link_name(qdr_connection_info_t *conn, char *original)
 {
     size_t olen = strlen(original);
@@ -82,18 +179,44 @@ static char* disambiguated_link_name(qdr_connection_info_t *conn, char *original
 }
 
 
+//
+// The router-specific part of generated addresses never changes once the core is
+// running, so it is formatted once and each address is the prefix plus a fresh
+// discriminator.
+//
+#define QDR_GENERATED_ADDR_MAX 200
+
+static qdr_core_t *temp_prefix_core = 0;
+static char        temp_prefix[QDR_GENERATED_ADDR_MAX - QD_DISCRIMINATOR_SIZE];
+static size_t      temp_prefix_length;
+
+static const char   mobile_prefix[]      = "amqp:/_$temp.";
+static const size_t mobile_prefix_length = sizeof(mobile_prefix) - 1;
+
+
+static void qdr_generate_addr(char *buffer, const char *prefix, size_t prefix_length)
+{
+    memcpy(buffer, prefix, prefix_length);
+    qd_generate_discriminator(buffer + prefix_length);
+}
+
+
 /**
  * Generate a temporary routable address for a destination connected to this
  * router node.
  */
-static void qdr_generate_temp_addr(qdr_core_t *core, char *buffer, size_t length)
+static void qdr_generate_temp_addr(qdr_core_t *core, char *buffer)
 {
-    char discriminator[QD_DISCRIMINATOR_SIZE];
-    qd_generate_discriminator(discriminator);
-    if (core->router_mode == QD_ROUTER_MODE_EDGE)
-        snprintf(buffer, length, "amqp:/_edge/%s/temp.%s", core->router_id, discriminator);
-    else
-        snprintf(buffer, length, "amqp:/_topo/%s/%s/temp.%s", core->router_area, core->router_id, discriminator);
+    if (temp_prefix_core != core) {
+        int length;
+        if (core->router_mode == QD_ROUTER_MODE_EDGE)
+            length = snprintf(temp_prefix, sizeof(temp_prefix), "amqp:/_edge/%s/temp.", core->router_id);
+        else
+            length = snprintf(temp_prefix, sizeof(temp_prefix), "amqp:/_topo/%s/%s/temp.", core->router_area, core->router_id);
+        temp_prefix_length = length < (int) sizeof(temp_prefix) ? (size_t) length : sizeof(temp_prefix) - 1;
+        temp_prefix_core   = core;
+    }
+    qdr_generate_addr(buffer, temp_prefix, temp_prefix_length);
 }
 
 
@@ -101,11 +224,9 @@ static void qdr_generate_temp_addr(qdr_core_t *core, char *buffer, size_t length
  * Generate a temporary mobile address for a producer connected to this
  * router node.
  */
-static void qdr_generate_mobile_addr(qdr_core_t *core, char *buffer, size_t length)
+static void qdr_generate_mobile_addr(char *buffer)
 {
-    char discriminator[QD_DISCRIMINATOR_SIZE];
-    qd_generate_discriminator(discriminator);
-    snprintf(buffer, length, "amqp:/_$temp.%s", discriminator);
+    qdr_generate_addr(buffer, mobile_prefix, mobile_prefix_length);
 }
 
 
@@ -155,7 +276,7 @@ static qdr_address_t *qdr_lookup_terminus_address_CT(qdr_core_t       *core,
         if (dnp_address) {
             qd_iterator_reset_view(dnp_address, ITER_VIEW_ADDRESS_WITH_SPACE);
             if (conn->tenant_space)
-                qd_iterator_annotate_space(dnp_address, conn->tenant_space, conn->tenant_space_len);
+                qd_iterator_annotate_space_hash(dnp_address, conn->tenant_hash);
             qd_parse_tree_retrieve_match(core->link_route_tree[dir], dnp_address, (void**) &addr);
 
             if (addr && conn->tenant_space) {
@@ -179,7 +300,7 @@ static qdr_address_t *qdr_lookup_terminus_address_CT(qdr_core_t       *core,
         if (!accept_dynamic)
             return 0;
 
-        char temp_addr[200];
+        char temp_addr[QDR_GENERATED_ADDR_MAX];
         bool generating = true;
         while (generating) {
             //
@@ -188,15 +309,16 @@ static qdr_address_t *qdr_lookup_terminus_address_CT(qdr_core_t       *core,
             // unlikely).
             //
             if (dir == QD_OUTGOING)
-                qdr_generate_temp_addr(core, temp_addr, 200);
+                qdr_generate_temp_addr(core, temp_addr);
             else
-                qdr_generate_mobile_addr(core, temp_addr, 200);
+                qdr_generate_mobile_addr(temp_addr);
 
             qd_iterator_t *temp_iter = qd_iterator_string(temp_addr, ITER_VIEW_ADDRESS_HASH);
-            qd_hash_retrieve(core->addr_hash, temp_iter, (void**) &addr);
+            uint32_t       temp_hash = qd_iterator_hash_view(temp_iter);
+            qd_hash_retrieve_with_hash(core->addr_hash, temp_hash, temp_iter, (void**) &addr);
             if (!addr) {
                 addr = qdr_address_CT(core, QD_TREATMENT_ANYCAST_BALANCED, 0);
-                qd_hash_insert(core->addr_hash, temp_iter, addr, &addr->hash_handle);
+                qd_hash_insert_with_hash(core->addr_hash, temp_hash, temp_iter, addr, &addr->hash_handle);
                 DEQ_INSERT_TAIL(core->addrs, addr);
                 qdr_terminus_set_address(terminus, temp_addr);
                 generating = false;
@@ -219,7 +341,7 @@ static qdr_address_t *qdr_lookup_terminus_address_CT(qdr_core_t       *core,
     qd_iterator_t *iter = qdr_terminus_get_address(terminus);
     qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_WITH_SPACE);
     if (conn->tenant_space)
-        qd_iterator_annotate_space(iter, conn->tenant_space, conn->tenant_space_len);
+        qd_iterator_annotate_space_hash(iter, conn->tenant_hash);
     qd_parse_tree_retrieve_match(core->link_route_tree[dir], iter, (void**) &addr);
     if (addr) {
         *link_route = true;
@@ -477,12 +599,13 @@ static void qcm_addr_lookup_process_pending_requests_CT(qcm_lookup_client_t *cli
 static bool qcm_terminus_has_local_link_route(qdr_core_t *core, qdr_connection_t *conn, qdr_terminus_t *terminus, qd_direction_t dir)
 {
     qdr_address_t *addr;
-    qd_iterator_t *iter = qd_iterator_dup(qdr_terminus_get_address(terminus));
-    qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_WITH_SPACE);
+    qd_iterator_t  iter;
+    qd_iterator_init_dup(&iter, qdr_terminus_get_address(terminus));
+    qd_iterator_reset_view(&iter, ITER_VIEW_ADDRESS_WITH_SPACE);
     if (conn->tenant_space)
-        qd_iterator_annotate_space(iter, conn->tenant_space, conn->tenant_space_len);
-    qd_parse_tree_retrieve_match(core->link_route_tree[dir], iter, (void**) &addr);
-    qd_iterator_free(iter);
+        qd_iterator_annotate_space_hash(&iter, conn->tenant_hash);
+    qd_parse_tree_retrieve_match(core->link_route_tree[dir], &iter, (void**) &addr);
+    qd_iterator_fini(&iter);
     return addr && (DEQ_SIZE(addr->conns) > 0);
 }
 
@@ -512,22 +635,41 @@ static void qcm_addr_lookup_CT(void             *context,
         && !qcm_terminus_has_local_link_route(client->core, conn, term, dir)) {
         //
         // We are in edge mode, there is an active edge connection, the terminus has an address,
-        // and there is no local link route for this address.  Set up the asynchronous lookup.
+        // and there is no local link route for this address.  If there is a recent answer for
+        // the address, use it.
         //
-        qcm_addr_lookup_request_t *request = new_qcm_addr_lookup_request_t();
-        DEQ_ITEM_INIT(request);
-        request->conn   = conn;
-        request->link   = link;
-        request->dir    = dir;
-        request->source = source;
-        request->target = target;
+        qcm_addr_lookup_cache_entry_t *entry = qcm_addr_lookup_cache_find(client, dir, term);
+        if (entry && entry->is_link_route) {
+            //
+            // The address is for a link route with destinations upstream.  Directly forward the attach.
+            //
+            qdr_forward_link_direct_CT(client->core, client->edge_conn, link, source, target, 0, 0);
+            return;
+        }
 
-        request->conn_sequence = qd_alloc_sequence(conn);
-        request->link_sequence = qd_alloc_sequence(link);
+        if (!entry) {
+            //
+            // No recent answer.  Set up the asynchronous lookup.
+            //
+            qcm_addr_lookup_request_t *request = new_qcm_addr_lookup_request_t();
+            DEQ_ITEM_INIT(request);
+            request->conn   = conn;
+            request->link   = link;
+            request->dir    = dir;
+            request->source = source;
+            request->target = target;
+
+            request->conn_sequence = qd_alloc_sequence(conn);
+            request->link_sequence = qd_alloc_sequence(link);
+
+            DEQ_INSERT_TAIL(client->pending_requests, request);
+            qcm_addr_lookup_process_pending_requests_CT(client);
+            return;
+        }
 
-        DEQ_INSERT_TAIL(client->pending_requests, request);
-        qcm_addr_lookup_process_pending_requests_CT(client);
-        return;
+        //
+        // The address is recently known not to be a link route.  Use the local search.
+        //
     }
 
     //
@@ -623,6 +765,11 @@ static uint64_t on_reply(qdr_core_t    *core,
         //
         // The lookup decode is of a valid service response.
         //
+        if (!is_link_route || has_destinations)
+            qcm_addr_lookup_cache_put(client, request->dir,
+                                      request->dir == QD_INCOMING ? request->target : request->source,
+                                      is_link_route);
+
         if (!is_link_route)
             //
             // The address is not for a link route.  Use the local search.
@@ -687,6 +834,7 @@ static void on_conn_event(void             *context,
     case QDRC_EVENT_CONN_EDGE_ESTABLISHED:
         client->edge_conn      = conn;
         client->request_credit = 0;
+        qcm_addr_lookup_cache_flush(client);
 
         //
         // Set up a Client API session on the edge connection.
@@ -705,6 +853,7 @@ static void on_conn_event(void             *context,
     case QDRC_EVENT_CONN_EDGE_LOST:
         client->edge_conn      = 0;
         client->request_credit = 0;
+        qcm_addr_lookup_cache_flush(client);
 
         //
         // Remove the Client API session.
@@ -753,6 +902,10 @@ static void qcm_addr_lookup_client_final_CT(void *module_context)
     qdrc_event_unsubscribe_CT(client->core, client->event_sub);
     client->core->addr_lookup_handler = 0;
     qdrc_client_free_CT(client->client_api);
+    qcm_addr_lookup_cache_flush(client);
+    for (int dir = 0; dir < 2; dir++)
+        if (client->cache_hash[dir])
+            qd_hash_free(client->cache_hash[dir]);
     free(client);
 }
 
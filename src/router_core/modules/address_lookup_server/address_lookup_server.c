@@ -42,15 +42,15 @@ static struct {
 
 /* parse out the opcode from the request
  */
-static address_lookup_opcode_t _decode_opcode(qd_parsed_field_t *properties)
+static address_lookup_opcode_t _decode_opcode(const qd_parsed_turbo_t *value)
 {
-    if (!properties)
-        return OPCODE_INVALID;
-    qd_parsed_field_t *oc = qd_parse_value_by_key(properties, "opcode");
+    qd_parsed_field_t *oc = qd_parse_turbo_value(value);
     if (!oc)
         return OPCODE_INVALID;
     uint32_t opcode = qd_parse_as_uint(oc);
-    if (!qd_parse_ok(oc))
+    bool     ok     = qd_parse_ok(oc);
+    qd_parse_free(oc);
+    if (!ok)
         return OPCODE_INVALID;
     return (address_lookup_opcode_t)opcode;
 }
@@ -191,10 +191,13 @@ void _on_transfer(void           *link_context,
            "Address lookup request received (container=%s, endpoint=%p)",
            epr->container_id, (void *)epr->endpoint);
 
-    uint64_t disposition = PN_ACCEPTED;
-    qd_iterator_t *p_iter = qd_message_field_iterator(message, QD_FIELD_APPLICATION_PROPERTIES);
-    qd_parsed_field_t *props = qd_parse(p_iter);
-    if (!props || !qd_parse_ok(props) || !qd_parse_is_map(props)) {
+    uint64_t           disposition = PN_ACCEPTED;
+    const char * const keys[]      = { "version", "opcode" };
+    qd_parsed_turbo_t  props[2];
+    qd_parsed_field_t *v           = 0;
+    qd_iterator_t      p_iter;
+    bool               has_props   = qd_message_field_iterator_init(message, QD_FIELD_APPLICATION_PROPERTIES, &p_iter);
+    if (!has_props || qd_parse_map_locate(&p_iter, keys, 2, props) != 0) {
         qd_log(_server_state.core->log, QD_LOG_ERROR,
                "Invalid address lookup request - no properties (container=%s, endpoint=%p)",
                epr->container_id, (void *)epr->endpoint);
@@ -202,7 +205,7 @@ void _on_transfer(void           *link_context,
         goto exit;
     }
 
-    qd_parsed_field_t *v = qd_parse_value_by_key(props, "version");
+    v = qd_parse_turbo_value(&props[0]);
     if (!v) {
         qd_log(_server_state.core->log, QD_LOG_ERROR,
                "Invalid address lookup request - no version (container=%s, endpoint=%p)",
@@ -230,7 +233,7 @@ void _on_transfer(void           *link_context,
         // @TODO(kgiusti) send reply with status QCM_ADDR_LOOKUP_BAD_VERSION
     }
 
-    address_lookup_opcode_t opcode = _decode_opcode(props);
+    address_lookup_opcode_t opcode = _decode_opcode(&props[1]);
     switch (opcode) {
     case OPCODE_LINK_ROUTE_LOOKUP: {
         qd_iterator_t *b_iter = qd_message_field_iterator(message, QD_FIELD_BODY);
@@ -254,8 +257,9 @@ void _on_transfer(void           *link_context,
     }
 
 exit:
-    qd_parse_free(props);
-    qd_iterator_free(p_iter);
+    qd_parse_free(v);
+    if (has_props)
+        qd_iterator_fini(&p_iter);
     qdrc_endpoint_settle_CT(_server_state.core, delivery, disposition);
     qdrc_endpoint_flow_CT(_server_state.core, epr->endpoint, 1, false);
     return;
@@ -23,8 +23,27 @@
 #include "core_link_endpoint.h"
 #include <stdio.h>
 
+//
+// With edgeAddressUpdateWindowSeconds set, updates to an edge are not sent as the address
+// changes.  The address is recorded as pending for that edge, once however often it changes,
+// and when the window closes the edge is sent the address's state at that moment.  The
+// updates go out as messages of up to QDRC_ADDR_UPDATE_BATCH_MAX (address, destination)
+// pairs, so a flapping address costs each edge one update per window.
+//
+#define QDRC_ADDR_UPDATE_BATCH_MAX 128
+
 typedef struct qdr_addr_tracking_module_context_t     qdr_addr_tracking_module_context_t;
 typedef struct qdr_addr_endpoint_state_t              qdr_addr_endpoint_state_t;
+typedef struct qdr_addr_pending_update_t              qdr_addr_pending_update_t;
+
+struct qdr_addr_pending_update_t {
+    DEQ_LINKS(qdr_addr_pending_update_t);
+    qd_hash_handle_t *hash_handle;  // The key is the address's hash key
+};
+
+DEQ_DECLARE(qdr_addr_pending_update_t, qdr_addr_pending_update_list_t);
+ALLOC_DECLARE(qdr_addr_pending_update_t);
+ALLOC_DEFINE(qdr_addr_pending_update_t);
 
 struct qdr_addr_endpoint_state_t {
     DEQ_LINKS(qdr_addr_endpoint_state_t);
@@ -33,6 +52,8 @@ struct qdr_addr_endpoint_state_t {
     qdr_addr_tracking_module_context_t *mc;
     int                                ref_count;
     bool                               closed; // Is the endpoint that this state belong to closed?
+    qd_hash_t                          *pending_hash;  // Addresses with an update pending, created on first use
+    qdr_addr_pending_update_list_t      pending;
 };
 
 DEQ_DECLARE(qdr_addr_endpoint_state_t, qdr_addr_endpoint_state_list_t);
@@ -44,6 +65,7 @@ struct  qdr_addr_tracking_module_context_t {
     qdr_addr_endpoint_state_list_t  endpoint_state_list;
     qdrc_event_subscription_t      *event_sub;
     qdrc_endpoint_desc_t           addr_tracking_endpoint;
+    qdr_core_timer_t               *window_timer;
 };
 
 
@@ -78,6 +100,78 @@ static qd_message_t *qdcm_edge_create_address_dlv(qdr_core_t *core, qdr_address_
     return msg;
 }
 
+static bool qdrc_can_send_address(qdr_address_t *addr, qdr_connection_t *conn);
+
+
+//
+// Compose one update carrying up to QDRC_ADDR_UPDATE_BATCH_MAX of the edge's pending addresses,
+// removing them from the pending list.  The body is a flat list of (address, destination) pairs.
+//
+static qd_message_t *qdcm_edge_create_batch_dlv(qdr_core_t *core, qdr_addr_endpoint_state_t *endpoint_state)
+{
+    qd_message_t *msg = qd_message();
+
+    qd_composed_field_t *fld   = qd_compose(QD_PERFORMATIVE_HEADER, 0);
+    qd_compose_start_list(fld);
+    qd_compose_insert_bool(fld, 0);     // durable
+    qd_compose_end_list(fld);
+
+    qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+    qd_compose_start_list(body);
+
+    int count = 0;
+    qdr_addr_pending_update_t *update = DEQ_HEAD(endpoint_state->pending);
+    while (update && count < QDRC_ADDR_UPDATE_BATCH_MAX) {
+        const char    *key  = (const char*) qd_hash_key_by_handle(update->hash_handle);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+        qdr_address_t *addr = 0;
+
+        qd_hash_retrieve(core->addr_hash, iter, (void**) &addr);
+        qd_iterator_free(iter);
+
+        qd_compose_insert_string(body, key);
+        qd_compose_insert_bool(body, qdrc_can_send_address(addr, endpoint_state->conn));
+
+        DEQ_REMOVE_HEAD(endpoint_state->pending);
+        qd_hash_remove_by_handle(endpoint_state->pending_hash, update->hash_handle);
+        qd_hash_handle_free(update->hash_handle);
+        free_qdr_addr_pending_update_t(update);
+        update = DEQ_HEAD(endpoint_state->pending);
+        count++;
+    }
+
+    qd_compose_end_list(body);
+    qd_message_compose_3(msg, fld, body);
+
+    qd_compose_free(body);
+    qd_compose_free(fld);
+
+    return msg;
+}
+
+
+static void qdrc_discard_pending_updates(qdr_addr_endpoint_state_t *endpoint_state)
+{
+    qdr_addr_pending_update_t *update = DEQ_HEAD(endpoint_state->pending);
+    while (update) {
+        DEQ_REMOVE_HEAD(endpoint_state->pending);
+        qd_hash_remove_by_handle(endpoint_state->pending_hash, update->hash_handle);
+        qd_hash_handle_free(update->hash_handle);
+        free_qdr_addr_pending_update_t(update);
+        update = DEQ_HEAD(endpoint_state->pending);
+    }
+}
+
+
+static void qdrc_free_endpoint_state(qdr_addr_endpoint_state_t *endpoint_state)
+{
+    qdrc_discard_pending_updates(endpoint_state);
+    if (endpoint_state->pending_hash)
+        qd_hash_free(endpoint_state->pending_hash);
+    free_qdr_addr_endpoint_state_t(endpoint_state);
+}
+
+
 static qdr_addr_endpoint_state_t *qdrc_get_endpoint_state_for_connection(qdr_addr_endpoint_state_list_t  endpoint_state_list, qdr_connection_t *conn)
 {
     qdr_addr_endpoint_state_t *endpoint_state = DEQ_HEAD(endpoint_state_list);
@@ -156,7 +250,7 @@ static void qdrc_address_endpoint_cleanup(void *link_context)
 
             endpoint_state->conn = 0;
             endpoint_state->endpoint = 0;
-            free_qdr_addr_endpoint_state_t(endpoint_state);
+            qdrc_free_endpoint_state(endpoint_state);
         }
     }
 }
@@ -197,6 +291,63 @@ static void qdrc_send_message(qdr_core_t *core, qdr_address_t *addr, qdrc_endpoi
     qdrc_endpoint_send_CT(core, endpoint, dlv, true);
 }
 
+
+//
+// Send the update for an address to one edge, or with an update window, note that the
+// address has changed; the state sent when the window closes is the one it has then.
+//
+static void qdrc_update_edge(qdr_addr_tracking_module_context_t *mc, qdr_addr_endpoint_state_t *endpoint_state,
+                             qdr_address_t *addr, bool insert_addr)
+{
+    qdr_core_t *core = mc->core;
+
+    if (core->edge_update_window == 0) {
+        qdrc_send_message(core, addr, endpoint_state->endpoint, insert_addr);
+        return;
+    }
+
+    if (!endpoint_state->pending_hash)
+        endpoint_state->pending_hash = qd_hash(6, 4, 0);
+
+    const char    *key  = (const char*) qd_hash_key_by_handle(addr->hash_handle);
+    qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+    void          *found = 0;
+
+    qd_hash_retrieve(endpoint_state->pending_hash, iter, &found);
+    if (!found) {
+        qdr_addr_pending_update_t *update = new_qdr_addr_pending_update_t();
+        ZERO(update);
+        qd_hash_insert(endpoint_state->pending_hash, iter, update, &update->hash_handle);
+        DEQ_INSERT_TAIL(endpoint_state->pending, update);
+    }
+    qd_iterator_free(iter);
+
+    if (!qdr_core_timer_scheduled_CT(mc->window_timer))
+        qdr_core_timer_schedule_CT(core, mc->window_timer, core->edge_update_window);
+}
+
+
+//
+// The update window has closed.  Send each edge the current state of its pending addresses.
+//
+static void qdrc_on_window_timer(qdr_core_t *core, void *context)
+{
+    qdr_addr_tracking_module_context_t *mc = (qdr_addr_tracking_module_context_t*) context;
+
+    qdr_addr_endpoint_state_t *endpoint_state = DEQ_HEAD(mc->endpoint_state_list);
+    while (endpoint_state) {
+        if (endpoint_state->closed || !endpoint_state->endpoint)
+            qdrc_discard_pending_updates(endpoint_state);
+
+        while (DEQ_SIZE(endpoint_state->pending) > 0) {
+            qd_message_t   *msg = qdcm_edge_create_batch_dlv(core, endpoint_state);
+            qdr_delivery_t *dlv = qdrc_endpoint_delivery_CT(core, endpoint_state->endpoint, msg);
+            qdrc_endpoint_send_CT(core, endpoint_state->endpoint, dlv, true);
+        }
+        endpoint_state = DEQ_NEXT(endpoint_state);
+    }
+}
+
 static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr)
 {
     // We only care about mobile addresses.
@@ -218,8 +369,7 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
                     if(inlink->link->edge_context != 0) {
                         qdr_addr_endpoint_state_t *endpoint_state = (qdr_addr_endpoint_state_t *)inlink->link->edge_context;
                         if (!endpoint_state->closed && qdrc_can_send_address(addr, endpoint_state->conn) ) {
-                            qdrc_endpoint_t *endpoint = endpoint_state->endpoint;
-                            qdrc_send_message(addr_tracking->core, addr, endpoint, true);
+                            qdrc_update_edge(addr_tracking, endpoint_state, addr, true);
                         }
                     }
                     inlink = DEQ_NEXT(inlink);
@@ -241,7 +391,7 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
                     if (!endpoint_state->closed && qdrc_can_send_address(addr, endpoint_state->conn) ) {
                         qdrc_endpoint_t *endpoint = endpoint_state->endpoint;
                         if (endpoint)
-                            qdrc_send_message(addr_tracking->core, addr, endpoint, true);
+                            qdrc_update_edge(addr_tracking, endpoint_state, addr, true);
                     }
                 }
                 inlink = DEQ_NEXT(inlink);
@@ -263,7 +413,7 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
                         if(!endpoint_state->closed) {
                             qdrc_endpoint_t *endpoint = endpoint_state->endpoint;
                             if (endpoint)
-                                qdrc_send_message(addr_tracking->core, addr, endpoint, false);
+                                qdrc_update_edge(addr_tracking, endpoint_state, addr, false);
                         }
                     }
                     inlink = DEQ_NEXT(inlink);
@@ -288,9 +438,8 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
             while (inlink) {
                 if (inlink->link->edge_context != 0) {
                     qdr_addr_endpoint_state_t *endpoint_state = (qdr_addr_endpoint_state_t *)inlink->link->edge_context;
-                    qdrc_endpoint_t *endpoint = endpoint_state->endpoint;
                     if (endpoint_state->conn == link->conn && !endpoint_state->closed) {
-                        qdrc_send_message(addr_tracking->core, addr, endpoint, false);
+                        qdrc_update_edge(addr_tracking, endpoint_state, addr, false);
                         break;
                     }
                 }
@@ -309,9 +458,8 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
             while (inlink) {
                 if(inlink->link->edge_context != 0) {
                     qdr_addr_endpoint_state_t *endpoint_state = (qdr_addr_endpoint_state_t *)inlink->link->edge_context;
-                    qdrc_endpoint_t *endpoint = endpoint_state->endpoint;
                     if (link->conn == endpoint_state->conn && !endpoint_state->closed) {
-                        qdrc_send_message(addr_tracking->core, addr, endpoint, true);
+                        qdrc_update_edge(addr_tracking, endpoint_state, addr, true);
                         break;
                     }
                 }
@@ -339,7 +487,7 @@ static void on_link_event(void *context, qdrc_event_t event, qdr_link_t *link)
                 link->edge_context = endpoint_state;
                 endpoint_state->ref_count++;
                 if (qdrc_can_send_address(addr, link->conn) && endpoint_state) {
-                    qdrc_send_message(mc->core, addr, endpoint_state->endpoint, true);
+                    qdrc_update_edge(mc, endpoint_state, addr, true);
                 }
             }
             break;
@@ -360,7 +508,7 @@ static void on_link_event(void *context, qdrc_event_t event, qdr_link_t *link)
                     }
                     endpoint_state->conn = 0;
                     endpoint_state->endpoint = 0;
-                    free_qdr_addr_endpoint_state_t(endpoint_state);
+                    qdrc_free_endpoint_state(endpoint_state);
                 }
             }
             break;
@@ -383,6 +531,7 @@ static void qdrc_edge_address_tracking_init_CT(qdr_core_t *core, void **module_c
     qdr_addr_tracking_module_context_t *context = NEW(qdr_addr_tracking_module_context_t);
     ZERO(context);
     context->core = core;
+    context->window_timer = qdr_core_timer_CT(core, qdrc_on_window_timer, context);
     *module_context = context;
 
     //
@@ -416,10 +565,11 @@ static void qdrc_edge_address_tracking_final_CT(void *module_context)
     qdr_addr_endpoint_state_t *endpoint_state = DEQ_HEAD(mc->endpoint_state_list);
     while (endpoint_state) {
         DEQ_REMOVE_HEAD(mc->endpoint_state_list);
-        free_qdr_addr_endpoint_state_t(endpoint_state);
+        qdrc_free_endpoint_state(endpoint_state);
         endpoint_state = DEQ_HEAD(mc->endpoint_state_list);
     }
     qdrc_event_unsubscribe_CT(mc->core, mc->event_sub);
+    qdr_core_timer_free_CT(mc->core, mc->window_timer);
     free(mc);
 }
 
@@ -56,16 +56,44 @@
 //    6) Handle address tracking updates indicating which producer-addresses have destinations
 //       reachable via the edge connection.
 //
+//  All of the above is done for each uplink: the active edge connection and, with
+//  edgeUplinks > 1, the additional uplinks announced by the Connection Manager.  Traffic
+//  leaving the edge is spread over the uplinks by the anycast forwarders, since each
+//  uplink contributes an anonymous sender to "_edge" and its own proxy links to mobile
+//  addresses.  Multicast addresses are proxied over the active edge connection only; a
+//  copy entering through every interior would otherwise reach local consumers once per
+//  uplink.
+//
+//  When an uplink comes up, proxy links are normally created for every eligible address at
+//  once.  With edgeProxyAttachRate set, at most that many are created per second, so that
+//  an edge with many local addresses does not flood the interior with attaches when it
+//  reconnects.  Each pass starts again from the head of the address list; addresses that
+//  already have their proxy links cost only the check.  Changes to individual addresses are
+//  proxied as they happen, paced or not.
+//
 
 #define INITIAL_CREDIT 32
 
+//
+// The state kept for one uplink.  Slot 0 is the active edge connection, whose proxy links
+// are addr->edge_inlink and addr->edge_outlink.  The proxy links of the additional uplinks
+// in slots 1..QDR_MAX_EDGE_UPLINKS-1 are kept in addr->edge_uplinks.
+//
+typedef struct qcm_edge_uplink_t {
+    qcm_edge_addr_proxy_t *ap;
+    qdr_connection_t      *conn;
+    qdrc_endpoint_t       *tracking_endpoint;
+    qdr_core_timer_t      *sweep_timer;    ///< Drives paced proxying, with edgeProxyAttachRate
+    int                    created;        ///< Proxy links created on this uplink
+    int                    slot;
+} qcm_edge_uplink_t;
+
 struct qcm_edge_addr_proxy_t {
     qdr_core_t                *core;
     qdrc_event_subscription_t *event_sub;
     bool                       edge_conn_established;
     qdr_address_t             *edge_conn_addr;
-    qdr_connection_t          *edge_conn;
-    qdrc_endpoint_t           *tracking_endpoint;
+    qcm_edge_uplink_t         *uplinks[QDR_MAX_EDGE_UPLINKS];
     qdrc_endpoint_desc_t       endpoint_descriptor;
 };
 
@@ -124,9 +152,36 @@ static void set_waypoint_capability(qdr_terminus_t *term, char phase_char, qd_di
 }
 
 
-static void add_inlink(qcm_edge_addr_proxy_t *ap, const char *key, qdr_address_t *addr)
+//
+// Return the location of the address's proxy link on an uplink in the given direction, or
+// 0 if the address has none there and create is false.
+//
+static qdr_link_t **proxy_link(qcm_edge_uplink_t *uplink, qdr_address_t *addr, qd_direction_t dir, bool create)
 {
-    if (addr->edge_inlink == 0) {
+    if (uplink->slot == 0)
+        return dir == QD_INCOMING ? &addr->edge_inlink : &addr->edge_outlink;
+
+    if (!addr->edge_uplinks) {
+        if (!create)
+            return 0;
+        addr->edge_uplinks = NEW(qdr_edge_uplink_links_t);
+        ZERO(addr->edge_uplinks);
+    }
+    return dir == QD_INCOMING ? &addr->edge_uplinks->inlink[uplink->slot - 1] : &addr->edge_uplinks->outlink[uplink->slot - 1];
+}
+
+
+static bool is_proxied_on(qcm_edge_uplink_t *uplink, qdr_address_t *addr)
+{
+    return uplink->slot == 0 || (addr->treatment != QD_TREATMENT_MULTICAST_FLOOD &&
+                                 addr->treatment != QD_TREATMENT_MULTICAST_ONCE);
+}
+
+
+static void add_inlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, const char *key, qdr_address_t *addr)
+{
+    qdr_link_t **ref = proxy_link(uplink, addr, QD_INCOMING, true);
+    if (*ref == 0) {
         qdr_terminus_t *term = qdr_terminus_normal(key + 2);
 
         if (addr->config && addr->config->out_phase > 0) {
@@ -139,28 +194,34 @@ static void add_inlink(qcm_edge_addr_proxy_t *ap, const char *key, qdr_address_t
                 set_waypoint_capability(term, key[1], QD_INCOMING, addr->config->in_phase, addr->config->out_phase);
         }
 
-        qdr_link_t *link = qdr_create_link_CT(ap->core, ap->edge_conn, QD_LINK_ENDPOINT, QD_INCOMING,
+        qdr_link_t *link = qdr_create_link_CT(ap->core, uplink->conn, QD_LINK_ENDPOINT, QD_INCOMING,
                                               term, qdr_terminus_normal(0));
+        *ref = link;
+        uplink->created++;
         qdr_core_bind_address_link_CT(ap->core, addr, link);
-        addr->edge_inlink = link;
     }
 }
 
 
-static void del_inlink(qcm_edge_addr_proxy_t *ap, qdr_address_t *addr)
+static void del_inlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, qdr_address_t *addr)
 {
-    qdr_link_t *link = addr->edge_inlink;
+    qdr_link_t **ref  = proxy_link(uplink, addr, QD_INCOMING, false);
+    qdr_link_t  *link = ref ? *ref : 0;
     if (link) {
-        addr->edge_inlink = 0;
+        *ref = 0;
         qdr_core_unbind_address_link_CT(ap->core, addr, link);
         qdr_link_outbound_detach_CT(ap->core, link, 0, QDR_CONDITION_NONE, true);
     }
 }
 
 
-static void add_outlink(qcm_edge_addr_proxy_t *ap, const char *key, qdr_address_t *addr)
+static void add_outlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, const char *key, qdr_address_t *addr)
 {
-    if (addr->edge_outlink == 0 && DEQ_SIZE(addr->subscriptions) == 0) {
+    if (DEQ_SIZE(addr->subscriptions) > 0)
+        return;
+
+    qdr_link_t **ref = proxy_link(uplink, addr, QD_OUTGOING, true);
+    if (*ref == 0) {
         //
         // Note that this link must not be bound to the address at this time.  That will
         // happen later when the interior tells us that there are upstream destinations
@@ -178,114 +239,300 @@ static void add_outlink(qcm_edge_addr_proxy_t *ap, const char *key, qdr_address_
                 set_waypoint_capability(term, key[1], QD_OUTGOING, addr->config->in_phase, addr->config->out_phase);
         }
 
-        qdr_link_t *link = qdr_create_link_CT(ap->core, ap->edge_conn, QD_LINK_ENDPOINT, QD_OUTGOING,
-                                              qdr_terminus_normal(0), term);
-        addr->edge_outlink = link;
+        *ref = qdr_create_link_CT(ap->core, uplink->conn, QD_LINK_ENDPOINT, QD_OUTGOING,
+                                  qdr_terminus_normal(0), term);
+        uplink->created++;
     }
 }
 
 
-static void del_outlink(qcm_edge_addr_proxy_t *ap, qdr_address_t *addr)
+static void del_outlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, qdr_address_t *addr)
 {
-    qdr_link_t *link = addr->edge_outlink;
+    qdr_link_t **ref  = proxy_link(uplink, addr, QD_OUTGOING, false);
+    qdr_link_t  *link = ref ? *ref : 0;
     if (link) {
-        addr->edge_outlink = 0;
+        *ref = 0;
         qdr_core_unbind_address_link_CT(ap->core, addr, link);
         qdr_link_outbound_detach_CT(ap->core, link, 0, QDR_CONDITION_NONE, true);
     }
 }
 
 
+//
+// Local destinations and sources are those not on an uplink.  Links on the uplinks are the
+// proxies themselves or lead to other interior routers, and must not cause the address to be
+// proxied (that would route deliveries from one interior to another through the edge).
+//
+static bool has_local_dest(qdr_address_t *addr)
+{
+    qdr_link_ref_t *ref = DEQ_HEAD(addr->rlinks);
+    while (ref) {
+        if (ref->link->conn->role != QDR_ROLE_EDGE_CONNECTION)
+            return true;
+        ref = DEQ_NEXT(ref);
+    }
+    return false;
+}
+
+
+static bool has_local_source(qdr_address_t *addr)
+{
+    qdr_link_ref_t *ref = DEQ_HEAD(addr->inlinks);
+    while (ref) {
+        if (ref->link->conn->role != QDR_ROLE_EDGE_CONNECTION)
+            return true;
+        ref = DEQ_NEXT(ref);
+    }
+    return false;
+}
+
+
+//
+// Make the address's incoming proxy links on the uplink match its local destinations.
+//
+static void sync_inlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, const char *key, qdr_address_t *addr)
+{
+    if (has_local_dest(addr) && is_proxied_on(uplink, addr))
+        add_inlink(ap, uplink, key, addr);
+    else
+        del_inlink(ap, uplink, addr);
+}
+
+
+//
+// Make the address's outgoing proxy links on the uplink match its local sources.
+//
+static void sync_outlink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink, const char *key, qdr_address_t *addr)
+{
+    if (has_local_source(addr) && is_proxied_on(uplink, addr))
+        add_outlink(ap, uplink, key, addr);
+    else
+        del_outlink(ap, uplink, addr);
+}
+
+
+//
+// Forget the proxy links in a slot without touching them.  Used when the uplink's connection
+// has closed, which has already freed its links.
+//
+static void clear_slot(qcm_edge_addr_proxy_t *ap, int slot)
+{
+    qdr_address_t *addr = DEQ_HEAD(ap->core->addrs);
+    while (addr) {
+        if (slot == 0) {
+            addr->edge_inlink  = 0;
+            addr->edge_outlink = 0;
+        } else if (addr->edge_uplinks) {
+            addr->edge_uplinks->inlink[slot - 1]  = 0;
+            addr->edge_uplinks->outlink[slot - 1] = 0;
+        }
+        addr = DEQ_NEXT(addr);
+    }
+}
+
+
+static qcm_edge_uplink_t *find_uplink(qcm_edge_addr_proxy_t *ap, qdr_connection_t *conn)
+{
+    for (int slot = 0; slot < QDR_MAX_EDGE_UPLINKS; slot++)
+        if (ap->uplinks[slot] && ap->uplinks[slot]->conn == conn)
+            return ap->uplinks[slot];
+    return 0;
+}
+
+
+//
+// Attach the links that every uplink carries, independent of the mobile addresses.
+//
+static void attach_uplink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink)
+{
+    qdr_connection_t *conn = uplink->conn;
+
+    //
+    // Attach an anonymous sending link to the interior router.
+    //
+    qdr_link_t *out_link = qdr_create_link_CT(ap->core, conn,
+                                              QD_LINK_ENDPOINT, QD_OUTGOING,
+                                              qdr_terminus(0), qdr_terminus(0));
+
+    //
+    // Associate the anonymous sender with the edge connection address.  This will cause
+    // all deliveries destined off-edge to be sent to the interior via the edge connection.
+    //
+    qdr_core_bind_address_link_CT(ap->core, ap->edge_conn_addr, out_link);
+
+    //
+    // Attach a receiving link for edge summary.  This will cause all deliveries
+    // destined for this router to be delivered via the edge connection.
+    //
+    (void) qdr_create_link_CT(ap->core, conn,
+                              QD_LINK_ENDPOINT, QD_INCOMING,
+                              qdr_terminus_edge_downlink(ap->core->router_id),
+                              qdr_terminus_edge_downlink(0));
+
+    //
+    // Attach a receiving link for edge address tracking updates.
+    //
+    uplink->tracking_endpoint =
+        qdrc_endpoint_create_link_CT(ap->core, conn, QD_INCOMING,
+                                     qdr_terminus_normal(QD_TERMINUS_EDGE_ADDRESS_TRACKING),
+                                     qdr_terminus(0), &ap->endpoint_descriptor, uplink);
+}
+
+
+//
+// Create the proxy links on an uplink for every eligible local destination and source, or
+// as many as edgeProxyAttachRate allows for this second.
+//
+static void proxy_addresses(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink)
+{
+    int            limit = ap->core->edge_proxy_attach_rate;
+    int            start = uplink->created;
+    qdr_address_t *addr  = DEQ_HEAD(ap->core->addrs);
+
+    while (addr) {
+        if (limit > 0 && uplink->created - start >= limit) {
+            //
+            // The budget is spent with addresses left to look at.  Resume in a second.
+            //
+            qdr_core_timer_schedule_CT(ap->core, uplink->sweep_timer, 1);
+            return;
+        }
+
+        const char *key = (const char*) qd_hash_key_by_handle(addr->hash_handle);
+        if (*key == QD_ITER_HASH_PREFIX_MOBILE) {
+            //
+            // If the address has local destinations, create an incoming link from the
+            // interior to signal the presence of local consumers.
+            //
+            sync_inlink(ap, uplink, key, addr);
+
+            //
+            // If the address has local sources, create an outgoing link to the interior
+            // to signal the presence of local producers.
+            //
+            sync_outlink(ap, uplink, key, addr);
+        }
+        addr = DEQ_NEXT(addr);
+    }
+}
+
+
+//
+// Make an additional uplink the active edge connection.  Its links stay attached; the proxy
+// links move from its slot to slot 0, and multicast addresses are proxied on it from now on.
+//
+static void promote_uplink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink)
+{
+    int slot = uplink->slot;
+
+    qdr_address_t *addr = DEQ_HEAD(ap->core->addrs);
+    while (addr) {
+        if (addr->edge_uplinks) {
+            addr->edge_inlink  = addr->edge_uplinks->inlink[slot - 1];
+            addr->edge_outlink = addr->edge_uplinks->outlink[slot - 1];
+            addr->edge_uplinks->inlink[slot - 1]  = 0;
+            addr->edge_uplinks->outlink[slot - 1] = 0;
+        } else {
+            addr->edge_inlink  = 0;
+            addr->edge_outlink = 0;
+        }
+        addr = DEQ_NEXT(addr);
+    }
+
+    ap->uplinks[slot] = 0;
+    ap->uplinks[0]    = uplink;
+    uplink->slot      = 0;
+}
+
+
+static void on_sweep_timer(qdr_core_t *core, void *context)
+{
+    qcm_edge_uplink_t *uplink = (qcm_edge_uplink_t*) context;
+
+    proxy_addresses(uplink->ap, uplink);
+}
+
+
+static qcm_edge_uplink_t *new_uplink(qcm_edge_addr_proxy_t *ap, qdr_connection_t *conn, int slot)
+{
+    qcm_edge_uplink_t *uplink = NEW(qcm_edge_uplink_t);
+    ZERO(uplink);
+    uplink->ap          = ap;
+    uplink->conn        = conn;
+    uplink->slot        = slot;
+    uplink->sweep_timer = qdr_core_timer_CT(ap->core, on_sweep_timer, uplink);
+    ap->uplinks[slot] = uplink;
+    return uplink;
+}
+
+
+static void free_uplink(qcm_edge_addr_proxy_t *ap, qcm_edge_uplink_t *uplink)
+{
+    if (uplink) {
+        qdr_core_timer_free_CT(ap->core, uplink->sweep_timer);
+        free(uplink);
+    }
+}
+
+
 static void on_conn_event(void *context, qdrc_event_t event, qdr_connection_t *conn)
 {
     qcm_edge_addr_proxy_t *ap = (qcm_edge_addr_proxy_t*) context;
+    qcm_edge_uplink_t     *uplink;
 
     switch (event) {
-    case QDRC_EVENT_CONN_EDGE_ESTABLISHED : {
+    case QDRC_EVENT_CONN_EDGE_ESTABLISHED :
         //
         // Flag the edge connection as being established.
         //
         ap->edge_conn_established = true;
-        ap->edge_conn             = conn;
-
-        //
-        // Attach an anonymous sending link to the interior router.
-        //
-        qdr_link_t *out_link = qdr_create_link_CT(ap->core, conn,
-                                                  QD_LINK_ENDPOINT, QD_OUTGOING,
-                                                  qdr_terminus(0), qdr_terminus(0));
-
-        //
-        // Associate the anonymous sender with the edge connection address.  This will cause
-        // all deliveries destined off-edge to be sent to the interior via the edge connection.
-        //
-        qdr_core_bind_address_link_CT(ap->core, ap->edge_conn_addr, out_link);
 
-        //
-        // Attach a receiving link for edge summary.  This will cause all deliveries
-        // destined for this router to be delivered via the edge connection.
-        //
-        (void) qdr_create_link_CT(ap->core, conn,
-                                  QD_LINK_ENDPOINT, QD_INCOMING,
-                                  qdr_terminus_edge_downlink(ap->core->router_id),
-                                  qdr_terminus_edge_downlink(0));
-
-        //
-        // Attach a receiving link for edge address tracking updates.
-        //
-        ap->tracking_endpoint =
-            qdrc_endpoint_create_link_CT(ap->core, conn, QD_INCOMING,
-                                         qdr_terminus_normal(QD_TERMINUS_EDGE_ADDRESS_TRACKING),
-                                         qdr_terminus(0), &ap->endpoint_descriptor, ap);
+        uplink = find_uplink(ap, conn);
+        if (uplink)
+            promote_uplink(ap, uplink);
+        else {
+            //
+            // Nullify the edge link references in case there are any left over from an earlier
+            // instance of an edge connection.
+            //
+            clear_slot(ap, 0);
+            uplink = new_uplink(ap, conn, 0);
+            attach_uplink(ap, uplink);
+        }
 
         //
         // Process eligible local destinations
         //
-        qdr_address_t *addr = DEQ_HEAD(ap->core->addrs);
-        while (addr) {
-            const char *key = (const char*) qd_hash_key_by_handle(addr->hash_handle);
-            if (*key == QD_ITER_HASH_PREFIX_MOBILE) {
-                //
-                // Nullify the edge link references in case there are any left over from an earlier
-                // instance of an edge connection.
-                //
-                addr->edge_inlink  = 0;
-                addr->edge_outlink = 0;
-
-                //
-                // If the address has more than zero attached destinations, create an
-                // incoming link from the interior to signal the presence of local consumers.
-                //
-                if (DEQ_SIZE(addr->rlinks) > 0) {
-                    if (DEQ_SIZE(addr->rlinks) == 1) {
-                        qdr_link_ref_t *ref = DEQ_HEAD(addr->rlinks);
-                        if (ref->link->conn != ap->edge_conn)
-                            add_inlink(ap, key, addr);
-                    } else
-                        add_inlink(ap, key, addr);
-                }
-
-                //
-                // If the address has more than zero attached sources, create an outgoing link
-                // to the interior to signal the presence of local producers.
-                //
-                if (DEQ_SIZE(addr->inlinks) > 0) {
-                    if (DEQ_SIZE(addr->inlinks) == 1) {
-                        qdr_link_ref_t *ref = DEQ_HEAD(addr->inlinks);
-                        if (ref->link->conn != ap->edge_conn)
-                            add_outlink(ap, key, addr);
-                    } else
-                        add_outlink(ap, key, addr);
-                }
-            }
-            addr = DEQ_NEXT(addr);
-        }
+        proxy_addresses(ap, uplink);
         break;
-    }
 
     case QDRC_EVENT_CONN_EDGE_LOST :
         ap->edge_conn_established = false;
-        ap->edge_conn             = 0;
+        free_uplink(ap, ap->uplinks[0]);
+        ap->uplinks[0] = 0;
+        break;
+
+    case QDRC_EVENT_CONN_EDGE_UPLINK_ADDED : {
+        int slot = 1;
+        while (slot < QDR_MAX_EDGE_UPLINKS && ap->uplinks[slot])
+            slot++;
+        if (slot == QDR_MAX_EDGE_UPLINKS)
+            break;
+
+        clear_slot(ap, slot);
+        uplink = new_uplink(ap, conn, slot);
+        attach_uplink(ap, uplink);
+        proxy_addresses(ap, uplink);
+        break;
+    }
+
+    case QDRC_EVENT_CONN_EDGE_UPLINK_LOST :
+        uplink = find_uplink(ap, conn);
+        if (uplink) {
+            clear_slot(ap, uplink->slot);
+            ap->uplinks[uplink->slot] = 0;
+            free_uplink(ap, uplink);
+        }
         break;
 
     default:
@@ -298,7 +545,6 @@ static void on_conn_event(void *context, qdrc_event_t event, qdr_connection_t *c
 static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr)
 {
     qcm_edge_addr_proxy_t *ap = (qcm_edge_addr_proxy_t*) context;
-    qdr_link_ref_t        *link_ref;
 
     //
     // If we don't have an established edge connection, there is no further work to be done.
@@ -313,58 +559,34 @@ static void on_addr_event(void *context, qdrc_event_t event, qdr_address_t *addr
     if (*key != QD_ITER_HASH_PREFIX_MOBILE)
         return;
 
-    switch (event) {
-    case QDRC_EVENT_ADDR_BECAME_LOCAL_DEST :
-        //
-        // Add an edge connection for this address only if the local destination is
-        // not the link to the interior.
-        //
-        link_ref = DEQ_HEAD(addr->rlinks);
-        if (link_ref->link->conn != ap->edge_conn)
-            add_inlink(ap, key, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_NO_LONGER_LOCAL_DEST :
-        del_inlink(ap, addr);
-        break;
+    for (int slot = 0; slot < QDR_MAX_EDGE_UPLINKS; slot++) {
+        qcm_edge_uplink_t *uplink = ap->uplinks[slot];
+        if (!uplink)
+            continue;
 
-    case QDRC_EVENT_ADDR_ONE_LOCAL_DEST :
-        //
-        // If the remaining local destination is the link to the interior,
-        // remove the inlink for this address.
-        //
-        link_ref = DEQ_HEAD(addr->rlinks);
-        if (link_ref->link->conn == ap->edge_conn)
-            del_inlink(ap, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_TWO_DEST :
-        add_inlink(ap, key, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_BECAME_SOURCE :
-        link_ref = DEQ_HEAD(addr->inlinks);
-        if (link_ref->link->conn != ap->edge_conn)
-            add_outlink(ap, key, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_NO_LONGER_SOURCE :
-        del_outlink(ap, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_TWO_SOURCE :
-        add_outlink(ap, key, addr);
-        break;
-
-    case QDRC_EVENT_ADDR_ONE_SOURCE :
-        link_ref = DEQ_HEAD(addr->inlinks);
-        if (link_ref->link->conn == ap->edge_conn)
-            del_outlink(ap, addr);
-        break;
-
-    default:
-        assert(false);
-        break;
+        switch (event) {
+        case QDRC_EVENT_ADDR_BECAME_LOCAL_DEST :
+        case QDRC_EVENT_ADDR_NO_LONGER_LOCAL_DEST :
+        case QDRC_EVENT_ADDR_ONE_LOCAL_DEST :
+        case QDRC_EVENT_ADDR_TWO_DEST :
+            //
+            // Keep an incoming proxy link only while a destination other than the links to
+            // the interior routers remains.
+            //
+            sync_inlink(ap, uplink, key, addr);
+            break;
+
+        case QDRC_EVENT_ADDR_BECAME_SOURCE :
+        case QDRC_EVENT_ADDR_NO_LONGER_SOURCE :
+        case QDRC_EVENT_ADDR_TWO_SOURCE :
+        case QDRC_EVENT_ADDR_ONE_SOURCE :
+            sync_outlink(ap, uplink, key, addr);
+            break;
+
+        default:
+            assert(false);
+            break;
+        }
     }
 }
 
@@ -373,9 +595,9 @@ static void on_second_attach(void           *link_context,
                              qdr_terminus_t *remote_source,
                              qdr_terminus_t *remote_target)
 {
-    qcm_edge_addr_proxy_t *ap = (qcm_edge_addr_proxy_t*) link_context;
+    qcm_edge_uplink_t *uplink = (qcm_edge_uplink_t*) link_context;
 
-    qdrc_endpoint_flow_CT(ap->core, ap->tracking_endpoint, INITIAL_CREDIT, false);
+    qdrc_endpoint_flow_CT(uplink->ap->core, uplink->tracking_endpoint, INITIAL_CREDIT, false);
 
     qdr_terminus_free(remote_source);
     qdr_terminus_free(remote_target);
@@ -386,21 +608,24 @@ static void on_transfer(void           *link_context,
                         qdr_delivery_t *dlv,
                         qd_message_t   *msg)
 {
-    qcm_edge_addr_proxy_t *ap = (qcm_edge_addr_proxy_t*) link_context;
+    qcm_edge_uplink_t     *uplink = (qcm_edge_uplink_t*) link_context;
+    qcm_edge_addr_proxy_t *ap     = uplink->ap;
 
     //
     // Validate the message
     //
     if (qd_message_check(msg, QD_DEPTH_BODY)) {
         //
-        // Get the message body.  It must be a list with two elements.  The first is an address
-        // and the second is a boolean indicating whether that address has upstream destinations.
+        // Get the message body.  It must be a list of (address, destination) pairs: an address
+        // followed by a boolean indicating whether that address has upstream destinations.
+        // An interior with an update window batches several pairs into one message.
         //
-        qd_iterator_t     *iter = qd_message_field_iterator(msg, QD_FIELD_BODY);
-        qd_parsed_field_t *body = qd_parse(iter);
-        if (!!body && qd_parse_is_list(body) && qd_parse_sub_count(body) == 2) {
-            qd_parsed_field_t *addr_field = qd_parse_sub_value(body, 0);
-            qd_parsed_field_t *dest_field = qd_parse_sub_value(body, 1);
+        qd_iterator_t     *iter  = qd_message_field_iterator(msg, QD_FIELD_BODY);
+        qd_parsed_field_t *body  = qd_parse(iter);
+        uint32_t           count = !!body && qd_parse_is_list(body) ? qd_parse_sub_count(body) : 0;
+        for (uint32_t idx = 0; count % 2 == 0 && idx < count; idx += 2) {
+            qd_parsed_field_t *addr_field = qd_parse_sub_value(body, idx);
+            qd_parsed_field_t *dest_field = qd_parse_sub_value(body, idx + 1);
 
             if (qd_parse_is_scalar(addr_field) && qd_parse_is_scalar(dest_field)) {
                 qd_iterator_t *addr_iter = qd_parse_raw(addr_field);
@@ -410,11 +635,17 @@ static void on_transfer(void           *link_context,
                 qd_iterator_reset_view(addr_iter, ITER_VIEW_ALL);
                 qd_hash_retrieve(ap->core->addr_hash, addr_iter, (void**) &addr);
                 if (addr) {
-                    qdr_link_t *link = addr->edge_outlink;
+                    qdr_link_t **ref  = proxy_link(uplink, addr, QD_OUTGOING, false);
+                    qdr_link_t  *link = ref ? *ref : 0;
                     if (link) {
-                        if (dest)
+                        //
+                        // The state is sent rather than the change, so it may repeat what
+                        // the link already reflects.
+                        //
+                        bool bound = link->ref[QDR_LINK_LIST_CLASS_ADDRESS] != 0;
+                        if (dest && !bound)
                             qdr_core_bind_address_link_CT(ap->core, addr, link);
-                        else
+                        else if (!dest && bound)
                             qdr_core_unbind_address_link_CT(ap->core, addr, link);
                     }
                 }
@@ -428,15 +659,15 @@ static void on_transfer(void           *link_context,
     //
     // Replenish the credit for this delivery
     //
-    qdrc_endpoint_flow_CT(ap->core, ap->tracking_endpoint, 1, false);
+    qdrc_endpoint_flow_CT(ap->core, uplink->tracking_endpoint, 1, false);
 }
 
 
 static void on_cleanup(void *link_context)
 {
-    qcm_edge_addr_proxy_t *ap = (qcm_edge_addr_proxy_t*) link_context;
+    qcm_edge_uplink_t *uplink = (qcm_edge_uplink_t*) link_context;
 
-    ap->tracking_endpoint = 0;
+    uplink->tracking_endpoint = 0;
 }
 
 
@@ -463,6 +694,8 @@ qcm_edge_addr_proxy_t *qcm_edge_addr_proxy(qdr_core_t *core)
     ap->event_sub = qdrc_event_subscribe_CT(core,
                                             QDRC_EVENT_CONN_EDGE_ESTABLISHED
                                             | QDRC_EVENT_CONN_EDGE_LOST
+                                            | QDRC_EVENT_CONN_EDGE_UPLINK_ADDED
+                                            | QDRC_EVENT_CONN_EDGE_UPLINK_LOST
                                             | QDRC_EVENT_ADDR_BECAME_LOCAL_DEST
                                             | QDRC_EVENT_ADDR_NO_LONGER_LOCAL_DEST
                                             | QDRC_EVENT_ADDR_ONE_LOCAL_DEST
@@ -483,6 +716,8 @@ qcm_edge_addr_proxy_t *qcm_edge_addr_proxy(qdr_core_t *core)
 void qcm_edge_addr_proxy_final(qcm_edge_addr_proxy_t *ap)
 {
     qdrc_event_unsubscribe_CT(ap->core, ap->event_sub);
+    for (int slot = 0; slot < QDR_MAX_EDGE_UPLINKS; slot++)
+        free_uplink(ap, ap->uplinks[slot]);
     free(ap);
 }
 
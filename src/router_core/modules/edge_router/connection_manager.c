@@ -29,42 +29,105 @@
 // The Connection Manager is responsible for keeping track of all of the
 // edge connections to Interior routers and choosing one to be the active
 // edge connection.  An edge router may maintain multiple "edge-connection"
-// connections to different Interior routers.  Only one of those connections
-// will be designated as active and carry edge traffic.  This component
-// identifies the active edge connection and generates outbound core events
+// connections to different Interior routers.  One of those connections
+// is designated as active and carries edge traffic and the edge management,
+// link-route and address-lookup exchanges.  If the router is configured with
+// edgeUplinks > 1, up to edgeUplinks - 1 further connections are designated
+// as additional uplinks that carry edge traffic alongside the active one; the
+// rest are standby connections.  This component identifies the active edge
+// connection and the additional uplinks and generates outbound core events
 // to notify other interested parties:
 //
 //     QDRC_EVENT_CONN_EDGE_ESTABLISHED
 //     QDRC_EVENT_CONN_EDGE_LOST
+//     QDRC_EVENT_CONN_EDGE_UPLINK_ADDED
+//     QDRC_EVENT_CONN_EDGE_UPLINK_LOST
+//
+// When the active edge connection is lost and an additional uplink is open,
+// that uplink is promoted: it is removed from the additional set and raised
+// in QDRC_EVENT_CONN_EDGE_ESTABLISHED without a preceding UPLINK_LOST.
 //
 
 struct qcm_edge_conn_mgr_t {
     qdr_core_t                *core;
     qdrc_event_subscription_t *event_sub;
     qdr_connection_t          *active_edge_connection;
+    qdr_connection_t          *uplinks[QDR_MAX_EDGE_UPLINKS - 1];
+    int                        uplink_count;
 };
 
 
+static bool is_uplink(qcm_edge_conn_mgr_t *cm, qdr_connection_t *conn)
+{
+    for (int i = 0; i < cm->uplink_count; i++)
+        if (cm->uplinks[i] == conn)
+            return true;
+    return false;
+}
+
+
+static void remove_uplink(qcm_edge_conn_mgr_t *cm, qdr_connection_t *conn)
+{
+    for (int i = 0; i < cm->uplink_count; i++)
+        if (cm->uplinks[i] == conn) {
+            cm->uplinks[i] = cm->uplinks[--cm->uplink_count];
+            return;
+        }
+}
+
+
+static void add_uplink(qcm_edge_conn_mgr_t *cm, qdr_connection_t *conn)
+{
+    qd_log(cm->core->log, QD_LOG_INFO, "Edge connection (id=%"PRIu64") to interior added as an uplink", conn->identity);
+    cm->uplinks[cm->uplink_count++] = conn;
+    qdrc_event_conn_raise(cm->core, QDRC_EVENT_CONN_EDGE_UPLINK_ADDED, conn);
+}
+
+
+//
+// Bring standby edge connections into use as additional uplinks until the
+// configured number is reached.  The closing connection is skipped.
+//
+static void fill_uplinks(qcm_edge_conn_mgr_t *cm, qdr_connection_t *closing)
+{
+    qdr_connection_t *conn = DEQ_HEAD(cm->core->open_connections);
+    while (conn && cm->uplink_count < cm->core->edge_uplinks - 1) {
+        if (conn != closing && conn->role == QDR_ROLE_EDGE_CONNECTION
+            && conn != cm->active_edge_connection && !is_uplink(cm, conn))
+            add_uplink(cm, conn);
+        conn = DEQ_NEXT(conn);
+    }
+}
+
+
 static void on_conn_event(void *context, qdrc_event_t event, qdr_connection_t *conn)
 {
     qcm_edge_conn_mgr_t *cm = (qcm_edge_conn_mgr_t*) context;
 
     switch (event) {
     case QDRC_EVENT_CONN_OPENED :
-        if (cm->active_edge_connection == 0 && conn->role == QDR_ROLE_EDGE_CONNECTION) {
+        if (conn->role != QDR_ROLE_EDGE_CONNECTION)
+            break;
+        if (cm->active_edge_connection == 0) {
             qd_log(cm->core->log, QD_LOG_INFO, "Edge connection (id=%"PRIu64") to interior established", conn->identity);
             cm->active_edge_connection = conn;
             cm->core->active_edge_connection = conn;
             qdrc_event_conn_raise(cm->core, QDRC_EVENT_CONN_EDGE_ESTABLISHED, conn);
-        }
+        } else if (cm->uplink_count < cm->core->edge_uplinks - 1)
+            add_uplink(cm, conn);
         break;
 
     case QDRC_EVENT_CONN_CLOSED :
         if (cm->active_edge_connection == conn) {
             qdrc_event_conn_raise(cm->core, QDRC_EVENT_CONN_EDGE_LOST, conn);
-            qdr_connection_t *alternate = DEQ_HEAD(cm->core->open_connections);
-            while (alternate && (alternate == conn || alternate->role != QDR_ROLE_EDGE_CONNECTION))
-                alternate = DEQ_NEXT(alternate);
+            qdr_connection_t *alternate = cm->uplink_count > 0 ? cm->uplinks[0] : 0;
+            if (alternate)
+                remove_uplink(cm, alternate);
+            else {
+                alternate = DEQ_HEAD(cm->core->open_connections);
+                while (alternate && (alternate == conn || alternate->role != QDR_ROLE_EDGE_CONNECTION))
+                    alternate = DEQ_NEXT(alternate);
+            }
             if (alternate) {
                 qd_log(cm->core->log, QD_LOG_INFO,
                        "Edge connection (id=%"PRIu64") to interior lost, activating alternate id=%"PRIu64"",
@@ -72,12 +135,18 @@ static void on_conn_event(void *context, qdrc_event_t event, qdr_connection_t *c
                 cm->active_edge_connection = alternate;
                 cm->core->active_edge_connection = alternate;
                 qdrc_event_conn_raise(cm->core, QDRC_EVENT_CONN_EDGE_ESTABLISHED, alternate);
+                fill_uplinks(cm, conn);
             } else {
                 qd_log(cm->core->log, QD_LOG_INFO,
                        "Edge connection (id=%"PRIu64") to interior lost, no alternate connection available",
                        conn->identity);
                 cm->active_edge_connection = 0;
             }
+        } else if (is_uplink(cm, conn)) {
+            qd_log(cm->core->log, QD_LOG_INFO, "Edge uplink (id=%"PRIu64") to interior lost", conn->identity);
+            remove_uplink(cm, conn);
+            qdrc_event_conn_raise(cm->core, QDRC_EVENT_CONN_EDGE_UPLINK_LOST, conn);
+            fill_uplinks(cm, conn);
         }
         break;
 
@@ -100,6 +169,7 @@ qcm_edge_conn_mgr_t *qcm_edge_conn_mgr(qdr_core_t *core)
                                             0,
                                             cm);
     cm->active_edge_connection = 0;
+    cm->uplink_count           = 0;
 
     return cm;
 }
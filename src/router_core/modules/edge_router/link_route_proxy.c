@@ -24,6 +24,12 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+// Proxies created or deleted by one bulk request
+#define QDR_LINK_ROUTE_PROXY_BATCH_MAX 64
+
+// Requests outstanding on the interior at once, regardless of credit
+#define QDR_LINK_ROUTE_PROXY_MAX_IN_FLIGHT 8
+
 // Track the state of the link route configuration proxy on
 // the uplinked interior router
 //
@@ -37,7 +43,9 @@ typedef enum {
     QDR_LINK_ROUTE_PROXY_DELETING,  // delete request sent
 } link_route_proxy_state_t;
 
-typedef struct link_route_proxy_t link_route_proxy_t;
+typedef struct link_route_proxy_t       link_route_proxy_t;
+typedef struct link_route_proxy_batch_t link_route_proxy_batch_t;
+
 struct link_route_proxy_t {
     DEQ_LINKS(link_route_proxy_t);
     char                     *proxy_name;
@@ -45,26 +53,48 @@ struct link_route_proxy_t {
     char                     *address;
     link_route_proxy_state_t  proxy_state;
     qd_direction_t            direction;
+    link_route_proxy_batch_t *batch;        // bulk request awaiting a reply, if any
+    int                       batch_index;  // position in that request's list
 };
 ALLOC_DEFINE(link_route_proxy_t);
 DEQ_DECLARE(link_route_proxy_t, link_route_proxy_list_t);
 
+// The proxies of one BULK-CREATE or BULK-DELETE request, in the order of the
+// request's list and so of the reply's.  A proxy freed while the request is
+// outstanding leaves its slot empty.
+//
+struct link_route_proxy_batch_t {
+    DEQ_LINKS(link_route_proxy_batch_t);
+    bool                create;
+    int                 count;
+    link_route_proxy_t *proxies[QDR_LINK_ROUTE_PROXY_BATCH_MAX];
+};
+ALLOC_DEFINE(link_route_proxy_batch_t);
+DEQ_DECLARE(link_route_proxy_batch_t, link_route_proxy_batch_list_t);
+
 
-static link_route_proxy_list_t    _link_route_proxies;
-static qdrc_event_subscription_t *_event_handle;
+static link_route_proxy_list_t       _link_route_proxies;
+static link_route_proxy_batch_list_t _batches;
+static qdrc_event_subscription_t    *_event_handle;
 static int   _available_credit;
+static int   _in_flight;
+static bool  _bulk_unsupported;  // the interior rejected a bulk request
 
 
 static uint64_t _on_create_reply_CT(qdr_core_t *, void *, int32_t, const char *, qd_iterator_t *);
 static uint64_t _on_delete_reply_CT(qdr_core_t *, void *, int32_t, const char *, qd_iterator_t *);
 static void     _on_create_error_CT(qdr_core_t *, void *, const char *);
 static void     _on_delete_error_CT(qdr_core_t *, void *, const char *);
+static uint64_t _on_bulk_reply_CT(qdr_core_t *, void *, int32_t, const char *, qd_iterator_t *);
+static void     _on_bulk_error_CT(qdr_core_t *, void *, const char *);
 
 
 static void _free_link_route_proxy(link_route_proxy_t *lrp)
 {
     if (!lrp)
         return;
+    if (lrp->batch)
+        lrp->batch->proxies[lrp->batch_index] = 0;
     free(lrp->proxy_name);
     free(lrp->proxy_id);
     free(lrp->address);
@@ -72,9 +102,23 @@ static void _free_link_route_proxy(link_route_proxy_t *lrp)
 }
 
 
+static void _free_batch(link_route_proxy_batch_t *batch)
+{
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->proxies[i])
+            batch->proxies[i]->batch = 0;
+    }
+    DEQ_REMOVE(_batches, batch);
+    free_link_route_proxy_batch_t(batch);
+}
+
+
 // clean up the entire proxy list
 static void _free_all_link_route_proxies(void)
 {
+    while (DEQ_HEAD(_batches))
+        _free_batch(DEQ_HEAD(_batches));
+
     link_route_proxy_t *lrp = DEQ_HEAD(_link_route_proxies);
     while (lrp) {
         DEQ_REMOVE_HEAD(_link_route_proxies);
@@ -84,11 +128,10 @@ static void _free_all_link_route_proxies(void)
 }
 
 
-// generate the body for a management CREATE message for a Connection Scoped
-// Link Route
-static qd_composed_field_t  *_create_body(link_route_proxy_t *lrp)
+// compose the attributes of a Connection Scoped Link Route as the map of a
+// CREATE body or an element of a BULK-CREATE body
+static void _compose_create_map(qd_composed_field_t *body, link_route_proxy_t *lrp)
 {
-    qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
     qd_compose_start_map(body);
 
     qd_compose_insert_string(body, qdr_conn_link_route_columns[QDR_CONN_LINK_ROUTE_TYPE]);
@@ -104,81 +147,188 @@ static qd_composed_field_t  *_create_body(link_route_proxy_t *lrp)
     qd_compose_insert_string(body, lrp->proxy_name);
 
     qd_compose_end_map(body);
+}
+
+
+// generate the body for a management CREATE message for a Connection Scoped
+// Link Route
+static qd_composed_field_t  *_create_body(link_route_proxy_t *lrp)
+{
+    qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+    _compose_create_map(body, lrp);
     return body;
 }
 
 
-// check for any link route configuration entities that need to be
-// synchronized with the peer interior router
-//
-static void _sync_interior_proxies(qdr_core_t *core)
+// take credit for one more request to the interior, if the request pipeline
+// has room for it
+static bool _reserve_request(void)
 {
-    link_route_proxy_t *lrp = DEQ_HEAD(_link_route_proxies);
-    while (lrp && _available_credit > 0) {
+    if (_available_credit <= 0 || _in_flight >= QDR_LINK_ROUTE_PROXY_MAX_IN_FLIGHT)
+        return false;
+    _available_credit -= 1;
+    _in_flight += 1;
+    return true;
+}
 
-        if (lrp->proxy_state == QDR_LINK_ROUTE_PROXY_NEW) {
 
-            qd_log(core->log, QD_LOG_TRACE,
-                   "Creating proxy link route for address=%s named=%s",
-                   lrp->address, lrp->proxy_name);
+// a request reserved by _reserve_request has been answered or has failed
+static void _request_done(void)
+{
+    if (_in_flight > 0)
+        _in_flight -= 1;
+}
 
-            lrp->proxy_state = QDR_LINK_ROUTE_PROXY_CREATING;
-            qcm_edge_mgmt_request_CT(core,
-                                     lrp, // context
-                                     "CREATE",
-                                     CONN_LINK_ROUTE_TYPE,
-                                     0,  // id
-                                     lrp->proxy_name,
-                                     _create_body(lrp),
-                                     10,  // timeout
-                                     _on_create_reply_CT,
-                                     _on_create_error_CT);
-            _available_credit -= 1;
-
-        } else if (lrp->proxy_state == QDR_LINK_ROUTE_PROXY_DELETED) {
 
-            qd_log(core->log, QD_LOG_TRACE,
-                   "Deleting proxy link route address=%s proxy-id=%s name=%s",
-                   lrp->address, lrp->proxy_id, lrp->proxy_name);
+static void _send_create_CT(qdr_core_t *core, link_route_proxy_t *lrp)
+{
+    qd_log(core->log, QD_LOG_TRACE,
+           "Creating proxy link route for address=%s named=%s",
+           lrp->address, lrp->proxy_name);
 
-            lrp->proxy_state = QDR_LINK_ROUTE_PROXY_DELETING;
+    qcm_edge_mgmt_request_CT(core,
+                             lrp, // context
+                             "CREATE",
+                             CONN_LINK_ROUTE_TYPE,
+                             0,  // id
+                             lrp->proxy_name,
+                             _create_body(lrp),
+                             10,  // timeout
+                             _on_create_reply_CT,
+                             _on_create_error_CT);
+}
 
-            // empty body for delete
-            qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+
+static void _send_delete_CT(qdr_core_t *core, link_route_proxy_t *lrp)
+{
+    qd_log(core->log, QD_LOG_TRACE,
+           "Deleting proxy link route address=%s proxy-id=%s name=%s",
+           lrp->address, lrp->proxy_id, lrp->proxy_name);
+
+    // empty body for delete
+    qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+    qd_compose_start_map(body);
+    qd_compose_end_map(body);
+
+    qcm_edge_mgmt_request_CT(core,
+                             lrp, // context
+                             "DELETE",
+                             CONN_LINK_ROUTE_TYPE,
+                             lrp->proxy_id,
+                             lrp->proxy_name,
+                             body,
+                             10,  // timeout
+                             _on_delete_reply_CT,
+                             _on_delete_error_CT);
+}
+
+
+// send the batch as a BULK-CREATE or BULK-DELETE request, or as a plain
+// request if it holds a single proxy
+static void _send_batch_CT(qdr_core_t *core, link_route_proxy_batch_t *batch)
+{
+    if (batch->count == 1) {
+        link_route_proxy_t *lrp = batch->proxies[0];
+        _free_batch(batch);
+        if (lrp->proxy_state == QDR_LINK_ROUTE_PROXY_CREATING)
+            _send_create_CT(core, lrp);
+        else
+            _send_delete_CT(core, lrp);
+        return;
+    }
+
+    qd_log(core->log, QD_LOG_TRACE,
+           "%s %d proxy link routes in one request",
+           batch->create ? "Creating" : "Deleting", batch->count);
+
+    qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+    qd_compose_start_list(body);
+    for (int i = 0; i < batch->count; i++) {
+        link_route_proxy_t *lrp = batch->proxies[i];
+        if (batch->create)
+            _compose_create_map(body, lrp);
+        else {
             qd_compose_start_map(body);
+            qd_compose_insert_string(body, "identity");
+            qd_compose_insert_string(body, lrp->proxy_id);
+            qd_compose_insert_string(body, "name");
+            qd_compose_insert_string(body, lrp->proxy_name);
             qd_compose_end_map(body);
+        }
+    }
+    qd_compose_end_list(body);
+
+    qcm_edge_mgmt_request_CT(core,
+                             batch, // context
+                             batch->create ? "BULK-CREATE" : "BULK-DELETE",
+                             CONN_LINK_ROUTE_TYPE,
+                             0,  // id
+                             0,  // name
+                             body,
+                             10,  // timeout
+                             _on_bulk_reply_CT,
+                             _on_bulk_error_CT);
+}
+
+
+// send a request for every proxy in the given state, up to the batch size per
+// request and as many requests as the pipeline allows
+static void _sync_proxies_in_state(qdr_core_t *core, link_route_proxy_state_t state)
+{
+    const int                 batch_max = _bulk_unsupported ? 1 : QDR_LINK_ROUTE_PROXY_BATCH_MAX;
+    link_route_proxy_batch_t *batch     = 0;
+    link_route_proxy_t       *lrp       = DEQ_HEAD(_link_route_proxies);
+
+    while (lrp) {
+        if (lrp->proxy_state == state) {
+            if (!batch) {
+                if (!_reserve_request())
+                    break;
+                batch = new_link_route_proxy_batch_t();
+                ZERO(batch);
+                DEQ_ITEM_INIT(batch);
+                batch->create = state == QDR_LINK_ROUTE_PROXY_NEW;
+                DEQ_INSERT_TAIL(_batches, batch);
+            }
 
-            qcm_edge_mgmt_request_CT(core,
-                                     lrp, // context
-                                     "DELETE",
-                                     CONN_LINK_ROUTE_TYPE,
-                                     lrp->proxy_id,
-                                     lrp->proxy_name,
-                                     body,
-                                     10,  // timeout
-                                     _on_delete_reply_CT,
-                                     _on_delete_error_CT);
-            _available_credit -= 1;
+            lrp->proxy_state = batch->create ? QDR_LINK_ROUTE_PROXY_CREATING : QDR_LINK_ROUTE_PROXY_DELETING;
+            lrp->batch       = batch;
+            lrp->batch_index = batch->count;
+            batch->proxies[batch->count++] = lrp;
+
+            if (batch->count == batch_max) {
+                _send_batch_CT(core, batch);
+                batch = 0;
+            }
         }
         lrp = DEQ_NEXT(lrp);
     }
+
+    if (batch)
+        _send_batch_CT(core, batch);
 }
 
 
-// handle the response to our create request message
-static uint64_t _on_create_reply_CT(qdr_core_t    *core,
-                                    void          *request_context,
-                                    int32_t        statusCode,
-                                    const char    *statusDescription,
-                                    qd_iterator_t *body)
+// check for any link route configuration entities that need to be
+// synchronized with the peer interior router
+//
+static void _sync_interior_proxies(qdr_core_t *core)
+{
+    _sync_proxies_in_state(core, QDR_LINK_ROUTE_PROXY_NEW);
+    _sync_proxies_in_state(core, QDR_LINK_ROUTE_PROXY_DELETED);
+}
+
+
+// apply the outcome of creating one proxy on the interior
+static uint64_t _create_result_CT(qdr_core_t        *core,
+                                  link_route_proxy_t *lrp,
+                                  int32_t            statusCode,
+                                  const char        *statusDescription,
+                                  qd_parsed_field_t *proxy_id)
 {
-    link_route_proxy_t *lrp = (link_route_proxy_t *)request_context;
     uint64_t disposition = PN_ACCEPTED;
 
     if (statusCode == 201) {  // Created
-        qd_parsed_field_t *parsed_body = qd_parse(body);
-        qd_parsed_field_t *proxy_id = qd_parse_value_by_key(parsed_body,
-                                                            "identity");
         if (!proxy_id) {
             // really should not happen (a bug)
             qd_log(core->log, QD_LOG_ERROR,
@@ -201,13 +351,11 @@ static uint64_t _on_create_reply_CT(qdr_core_t    *core,
                 // the address was removed while waiting for the create
                 // to complete.  Now forward the delete along to interior
                 lrp->proxy_state = QDR_LINK_ROUTE_PROXY_DELETED;
-                _sync_interior_proxies(core);
                 break;
             default:
                 assert(false);
             }
         }
-        qd_parse_free(parsed_body);
     } else {
         // crap.  This is unexpected.  Perhaps a duplication?
         // only way to be sure is to now query using the proxy
@@ -223,7 +371,57 @@ static uint64_t _on_create_reply_CT(qdr_core_t    *core,
         _free_link_route_proxy(lrp);
     }
 
+    return disposition;
+}
+
+
+// apply the outcome of deleting one proxy on the interior
+static void _delete_result_CT(qdr_core_t         *core,
+                              link_route_proxy_t *lrp,
+                              int32_t             statusCode,
+                              const char         *statusDescription)
+{
+    switch (statusCode) {
+    case 204:
+    case 404:
+        // consider No Content or Not Found as success
+        qd_log(core->log, QD_LOG_TRACE,
+               "link route proxy DELETE successful,"
+               " address=%s proxy_id=%s proxy_name=%s (code=%d)",
+               lrp->address, lrp->proxy_id, lrp->proxy_name,
+               statusCode);
+        break;
+    default:
+        // oh crap, this is unexpected and is probably a bug
+        qd_log(core->log, QD_LOG_ERROR,
+               "link route proxy DELETE failed with error: (%"PRId32") %s,"
+               " address=%s proxy id=%s proxy name=%s)",
+               statusCode,
+               statusDescription ? statusDescription : "unknown",
+               lrp->address, lrp->proxy_id, lrp->proxy_name);
+    }
+    DEQ_REMOVE(_link_route_proxies, lrp);
+    _free_link_route_proxy(lrp);
+}
+
+
+// handle the response to our create request message
+static uint64_t _on_create_reply_CT(qdr_core_t    *core,
+                                    void          *request_context,
+                                    int32_t        statusCode,
+                                    const char    *statusDescription,
+                                    qd_iterator_t *body)
+{
+    link_route_proxy_t *lrp = (link_route_proxy_t *)request_context;
+    qd_parsed_field_t  *parsed_body = statusCode == 201 ? qd_parse(body) : 0;
+    qd_parsed_field_t  *proxy_id = parsed_body ? qd_parse_value_by_key(parsed_body, "identity") : 0;
+
+    _request_done();
+    uint64_t disposition = _create_result_CT(core, lrp, statusCode, statusDescription, proxy_id);
+
+    qd_parse_free(parsed_body);
     qd_iterator_free(body);
+    _sync_interior_proxies(core);
     return disposition;
 }
 
@@ -237,6 +435,7 @@ static void _on_create_error_CT(qdr_core_t *core,
 
     // likely the link detached or conn coming down - preserve
     // the proxy and try again later
+    _request_done();
     qd_log(core->log, QD_LOG_DEBUG,
            "link route proxy CREATE failed: %s, address=%s name=%s",
            error ? error : "unknown",
@@ -256,27 +455,9 @@ static uint64_t _on_delete_reply_CT(qdr_core_t    *core,
 
     qd_iterator_free(body);  // body is ignored
 
-    switch (statusCode) {
-    case 204:
-    case 404:
-        // consider No Content or Not Found as success
-        qd_log(core->log, QD_LOG_TRACE,
-               "link route proxy DELETE successful,"
-               " address=%s proxy_id=%s proxy_name=%s (code=%d)",
-               lrp->address, lrp->proxy_id, lrp->proxy_name,
-               statusCode);
-        break;
-    default:
-        // oh crap, this is unexpected and is probably a bug
-        qd_log(core->log, QD_LOG_ERROR,
-               "link route proxy DELETE failed with error: (%"PRId32") %s,"
-               " address=%s proxy id=%s proxy name=%s)",
-               statusCode,
-               statusDescription ? statusDescription : "unknown",
-               lrp->address, lrp->proxy_id, lrp->proxy_name);
-    }
-    DEQ_REMOVE(_link_route_proxies, lrp);
-    _free_link_route_proxy(lrp);
+    _request_done();
+    _delete_result_CT(core, lrp, statusCode, statusDescription);
+    _sync_interior_proxies(core);
     return PN_ACCEPTED;
 }
 
@@ -290,6 +471,7 @@ static void _on_delete_error_CT(qdr_core_t *core,
 
     // likely the link detached or conn coming down - preserve
     // the proxy and try again later
+    _request_done();
     qd_log(core->log, QD_LOG_DEBUG,
            "link route proxy DELETE failed: %s, address=%s name=%s",
            error ? error : "unknown",
@@ -298,6 +480,101 @@ static void _on_delete_error_CT(qdr_core_t *core,
 }
 
 
+// the bulk request was not carried out: return its proxies to the state
+// they were in before it was sent
+static void _bulk_not_done(link_route_proxy_batch_t *batch)
+{
+    for (int i = 0; i < batch->count; i++) {
+        link_route_proxy_t *lrp = batch->proxies[i];
+        if (!lrp)
+            continue;
+        if (!batch->create)
+            lrp->proxy_state = QDR_LINK_ROUTE_PROXY_DELETED;
+        else if (lrp->proxy_state == QDR_LINK_ROUTE_PROXY_CANCELLED) {
+            // deleted while waiting and never created
+            DEQ_REMOVE(_link_route_proxies, lrp);
+            _free_link_route_proxy(lrp);
+        } else
+            lrp->proxy_state = QDR_LINK_ROUTE_PROXY_NEW;
+    }
+}
+
+
+// handle the response to a bulk request: a list holding the outcome of each
+// proxy, in request order
+static uint64_t _on_bulk_reply_CT(qdr_core_t    *core,
+                                  void          *request_context,
+                                  int32_t        statusCode,
+                                  const char    *statusDescription,
+                                  qd_iterator_t *body)
+{
+    link_route_proxy_batch_t *batch = (link_route_proxy_batch_t *)request_context;
+    qd_parsed_field_t        *list  = statusCode == 200 ? qd_parse(body) : 0;
+
+    _request_done();
+
+    if (!list || !qd_parse_ok(list) || !qd_parse_is_list(list)) {
+        // an interior that predates the bulk operations rejects them, so
+        // fall back to a request per proxy
+        qd_log(core->log, QD_LOG_DEBUG,
+               "link route proxy %s failed: (%"PRId32") %s, using single requests",
+               batch->create ? "BULK-CREATE" : "BULK-DELETE",
+               statusCode,
+               statusDescription ? statusDescription : "invalid response");
+        _bulk_unsupported = true;
+        _bulk_not_done(batch);
+    } else {
+        for (int i = 0; i < batch->count; i++) {
+            link_route_proxy_t *lrp = batch->proxies[i];
+            if (!lrp)
+                continue;
+            lrp->batch = 0;
+            batch->proxies[i] = 0;
+
+            qd_parsed_field_t *result = qd_parse_sub_value(list, i);
+            qd_parsed_field_t *code   = result ? qd_parse_value_by_key(result, "statusCode") : 0;
+            qd_parsed_field_t *desc   = result ? qd_parse_value_by_key(result, "statusDescription") : 0;
+            int32_t            status = code ? qd_parse_as_int(code) : 500;
+            char              *desc_str = desc && qd_parse_is_scalar(desc) && qd_parse_tag(desc) != QD_AMQP_NULL
+                ? (char *)qd_iterator_copy(qd_parse_raw(desc)) : 0;
+
+            if (batch->create) {
+                qd_parsed_field_t *attributes = result ? qd_parse_value_by_key(result, "attributes") : 0;
+                qd_parsed_field_t *proxy_id   = attributes ? qd_parse_value_by_key(attributes, "identity") : 0;
+                _create_result_CT(core, lrp, status, desc_str, proxy_id);
+            } else
+                _delete_result_CT(core, lrp, status, desc_str);
+            free(desc_str);
+        }
+    }
+
+    qd_parse_free(list);
+    qd_iterator_free(body);
+    _free_batch(batch);
+    _sync_interior_proxies(core);
+    return PN_ACCEPTED;
+}
+
+
+// bulk request failed to reach interior (or was rejected, released, etc)
+static void _on_bulk_error_CT(qdr_core_t *core,
+                              void       *request_context,
+                              const char *error)
+{
+    link_route_proxy_batch_t *batch = (link_route_proxy_batch_t *)request_context;
+
+    // likely the link detached or conn coming down - preserve
+    // the proxies and try again later
+    _request_done();
+    qd_log(core->log, QD_LOG_DEBUG,
+           "link route proxy %s failed: %s, %d proxies",
+           batch->create ? "BULK-CREATE" : "BULK-DELETE",
+           error ? error : "unknown", batch->count);
+    _bulk_not_done(batch);
+    _free_batch(batch);
+}
+
+
 // called when a new link route is configured.  Create a proxy
 // for the link route on the interior router
 //
@@ -381,6 +658,12 @@ static void _on_conn_event(void             *context,
     // we only receive edge loss events
     assert(event_type == QDRC_EVENT_CONN_EDGE_LOST);
 
+    // outstanding requests are dropped with the uplink without a callback
+    while (DEQ_HEAD(_batches))
+        _free_batch(DEQ_HEAD(_batches));
+    _in_flight        = 0;
+    _bulk_unsupported = false;  // the next interior may differ
+
     // the interior should purge all of the proxies since they are connection
     // scoped. Reset the proxy state to NEW or remove the proxy if deleted
     link_route_proxy_t *lrp = DEQ_HEAD(_link_route_proxies);
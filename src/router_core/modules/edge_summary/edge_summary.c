@@ -0,0 +1,318 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/ctools.h>
+#include "module.h"
+#include "agent_router.h"
+#include "core_client_api.h"
+#include "core_events.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+//
+// Answers GET-EDGE-SUMMARY on an interior router: sends GET-SUMMARY to the
+// $management of every connected edge at once and merges the replies into one
+// response.  Each edge has a core client created on its first summary and kept
+// until its connection closes.  An edge that has not answered within the
+// timeout is listed in the response rather than holding it up.
+//
+
+#define QCM_EDGE_SUMMARY_TIMEOUT  5   // seconds
+
+typedef struct qcm_edge_summary_edge_t    qcm_edge_summary_edge_t;
+typedef struct qcm_edge_summary_request_t qcm_edge_summary_request_t;
+typedef struct qcm_edge_summary_ask_t     qcm_edge_summary_ask_t;
+
+struct qcm_edge_summary_edge_t {
+    DEQ_LINKS(qcm_edge_summary_edge_t);
+    qdr_connection_t *conn;
+    qdrc_client_t    *client;
+};
+ALLOC_DECLARE(qcm_edge_summary_edge_t);
+ALLOC_DEFINE(qcm_edge_summary_edge_t);
+DEQ_DECLARE(qcm_edge_summary_edge_t, qcm_edge_summary_edge_list_t);
+
+// A GET-EDGE-SUMMARY waiting for its edges
+struct qcm_edge_summary_request_t {
+    DEQ_LINKS(qcm_edge_summary_request_t);
+    qdr_query_t          *query;
+    int                   asked;
+    int                   answered;
+    int                   pending;
+    qdr_router_summary_t  merged;
+    qd_composed_field_t  *unanswered;  // list of the ids of the edges that did not answer
+};
+ALLOC_DECLARE(qcm_edge_summary_request_t);
+ALLOC_DEFINE(qcm_edge_summary_request_t);
+DEQ_DECLARE(qcm_edge_summary_request_t, qcm_edge_summary_request_list_t);
+
+// One edge's part of a request, the context of its GET-SUMMARY
+struct qcm_edge_summary_ask_t {
+    qcm_edge_summary_request_t *request;
+    char                       *edge_id;
+    bool                        answered;
+};
+ALLOC_DECLARE(qcm_edge_summary_ask_t);
+ALLOC_DEFINE(qcm_edge_summary_ask_t);
+
+typedef struct {
+    qdr_core_t                      *core;
+    qdrc_event_subscription_t       *event_sub;
+    qcm_edge_summary_edge_list_t     edges;
+    qcm_edge_summary_request_list_t  requests;
+    bool                             stopping;
+} qcm_edge_summary_t;
+
+
+static void qcm_edge_summary_complete_CT(qcm_edge_summary_t *module, qcm_edge_summary_request_t *request)
+{
+    qdr_query_t         *query = request->query;
+    qd_composed_field_t *body  = query->body;
+    qd_buffer_list_t     ids;
+
+    DEQ_REMOVE(module->requests, request);
+
+    qd_compose_end_list(request->unanswered);
+    DEQ_INIT(ids);
+    qd_compose_take_buffers(request->unanswered, &ids);
+    qd_compose_free(request->unanswered);
+
+    if (module->stopping) {
+        // No response can be sent once the core is going away
+        qd_buffer_list_free_buffers(&ids);
+        qdr_query_free(query);
+        free_qcm_edge_summary_request_t(request);
+        return;
+    }
+
+    qd_compose_start_map(body);
+    qd_compose_insert_string(body, "edgeCount");
+    qd_compose_insert_uint(body, request->asked);
+    qd_compose_insert_string(body, "edgesAnswered");
+    qd_compose_insert_uint(body, request->answered);
+    qdra_router_summary_write(body, &request->merged);
+    qd_compose_insert_string(body, "unansweredEdges");
+    qd_compose_insert_buffers(body, &ids);
+    qd_compose_end_map(body);
+
+    qd_buffer_list_free_buffers(&ids);
+    free_qcm_edge_summary_request_t(request);
+
+    query->status = QD_AMQP_OK;
+    qdr_agent_enqueue_response_CT(module->core, query);
+}
+
+
+static uint64_t qcm_edge_summary_on_reply_CT(qdr_core_t    *core,
+                                             qdrc_client_t *client,
+                                             void          *user_context,
+                                             void          *request_context,
+                                             qd_iterator_t *app_properties,
+                                             qd_iterator_t *body)
+{
+    qcm_edge_summary_ask_t *ask = (qcm_edge_summary_ask_t *) request_context;
+
+    qd_parsed_field_t *properties = qd_parse(app_properties);
+    qd_parsed_field_t *status     = properties && qd_parse_is_map(properties)
+        ? qd_parse_value_by_key(properties, "statusCode") : 0;
+
+    if (status && qd_parse_as_int(status) == 200) {
+        qd_parsed_field_t *summary = qd_parse(body);
+        if (summary && qd_parse_ok(summary) && qdra_router_summary_merge(&ask->request->merged, summary))
+            ask->answered = true;
+        qd_parse_free(summary);
+    }
+
+    if (!ask->answered)
+        qd_log(core->log, QD_LOG_DEBUG, "Edge %s sent an invalid summary", ask->edge_id);
+
+    qd_parse_free(properties);
+    qd_iterator_free(app_properties);
+    qd_iterator_free(body);
+    return PN_ACCEPTED;
+}
+
+
+static void qcm_edge_summary_on_done_CT(qdr_core_t    *core,
+                                        qdrc_client_t *client,
+                                        void          *user_context,
+                                        void          *request_context,
+                                        const char    *error)
+{
+    qcm_edge_summary_t         *module  = (qcm_edge_summary_t *) user_context;
+    qcm_edge_summary_ask_t     *ask     = (qcm_edge_summary_ask_t *) request_context;
+    qcm_edge_summary_request_t *request = ask->request;
+
+    if (ask->answered)
+        request->answered++;
+    else {
+        qd_log(core->log, QD_LOG_DEBUG, "Edge %s did not answer the summary request: %s",
+               ask->edge_id, error ? error : "connection closed");
+        qd_compose_insert_string(request->unanswered, ask->edge_id);
+    }
+
+    free(ask->edge_id);
+    free_qcm_edge_summary_ask_t(ask);
+
+    if (--request->pending == 0)
+        qcm_edge_summary_complete_CT(module, request);
+}
+
+
+static qcm_edge_summary_edge_t *qcm_edge_summary_edge_CT(qcm_edge_summary_t *module, qdr_connection_t *conn)
+{
+    qcm_edge_summary_edge_t *edge = DEQ_HEAD(module->edges);
+    DEQ_FIND(edge, edge->conn == conn);
+    if (edge)
+        return edge;
+
+    qdr_terminus_t *target = qdr_terminus(0);
+    qdr_terminus_set_address(target, "$management");
+
+    edge = new_qcm_edge_summary_edge_t();
+    ZERO(edge);
+    DEQ_ITEM_INIT(edge);
+    edge->conn   = conn;
+    edge->client = qdrc_client_CT(module->core, conn, target, 10, module, 0, 0);
+    if (!edge->client) {
+        free_qcm_edge_summary_edge_t(edge);
+        return 0;
+    }
+    DEQ_INSERT_TAIL(module->edges, edge);
+    return edge;
+}
+
+
+static void qcm_edge_summary_free_edge_CT(qcm_edge_summary_t *module, qcm_edge_summary_edge_t *edge)
+{
+    DEQ_REMOVE(module->edges, edge);
+    qdrc_client_free_CT(edge->client);  // Completes its outstanding requests as unanswered
+    free_qcm_edge_summary_edge_t(edge);
+}
+
+
+static void qcm_edge_summary_handler_CT(void *context, qdr_query_t *query)
+{
+    qcm_edge_summary_t         *module  = (qcm_edge_summary_t *) context;
+    qcm_edge_summary_request_t *request = new_qcm_edge_summary_request_t();
+
+    ZERO(request);
+    DEQ_ITEM_INIT(request);
+    request->query      = query;
+    request->unanswered = qd_compose_subfield(0);
+    qd_compose_start_list(request->unanswered);
+    DEQ_INSERT_TAIL(module->requests, request);
+
+    // Held while the requests are sent so that none completes it early
+    request->pending = 1;
+
+    qdr_connection_t *conn = DEQ_HEAD(module->core->open_connections);
+    while (conn) {
+        if (conn->role == QDR_ROLE_EDGE_CONNECTION) {
+            const char *edge_id = conn->connection_info && conn->connection_info->container
+                ? conn->connection_info->container : "";
+            qcm_edge_summary_edge_t *edge = qcm_edge_summary_edge_CT(module, conn);
+
+            request->asked++;
+            if (!edge) {
+                qd_compose_insert_string(request->unanswered, edge_id);
+            } else {
+                qcm_edge_summary_ask_t *ask = new_qcm_edge_summary_ask_t();
+                ZERO(ask);
+                ask->request = request;
+                ask->edge_id = strdup(edge_id);
+                request->pending++;
+
+                qd_composed_field_t *ap = qd_compose(QD_PERFORMATIVE_APPLICATION_PROPERTIES, 0);
+                qd_compose_start_map(ap);
+                qd_compose_insert_string(ap, "operation");
+                qd_compose_insert_string(ap, "GET-SUMMARY");
+                qd_compose_insert_string(ap, "type");
+                qd_compose_insert_string(ap, "org.apache.qpid.dispatch.router");
+                qd_compose_end_map(ap);
+
+                qd_composed_field_t *body = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+                qd_compose_start_map(body);
+                qd_compose_end_map(body);
+
+                qdrc_client_request_CT(edge->client, ask, ap, body, QCM_EDGE_SUMMARY_TIMEOUT,
+                                       qcm_edge_summary_on_reply_CT, 0, qcm_edge_summary_on_done_CT);
+            }
+        }
+        conn = DEQ_NEXT(conn);
+    }
+
+    if (--request->pending == 0)
+        qcm_edge_summary_complete_CT(module, request);
+}
+
+
+static void qcm_edge_summary_on_conn_event_CT(void             *context,
+                                              qdrc_event_t      event_type,
+                                              qdr_connection_t *conn)
+{
+    qcm_edge_summary_t      *module = (qcm_edge_summary_t *) context;
+    qcm_edge_summary_edge_t *edge   = DEQ_HEAD(module->edges);
+
+    DEQ_FIND(edge, edge->conn == conn);
+    if (edge)
+        qcm_edge_summary_free_edge_CT(module, edge);
+}
+
+
+static bool qcm_edge_summary_enable_CT(qdr_core_t *core)
+{
+    return core->router_mode == QD_ROUTER_MODE_INTERIOR;
+}
+
+
+static void qcm_edge_summary_init_CT(qdr_core_t *core, void **module_context)
+{
+    qcm_edge_summary_t *module = NEW(qcm_edge_summary_t);
+    ZERO(module);
+    module->core      = core;
+    module->event_sub = qdrc_event_subscribe_CT(core,
+                                                QDRC_EVENT_CONN_CLOSED,
+                                                qcm_edge_summary_on_conn_event_CT,
+                                                0,
+                                                0,
+                                                module);
+    core->edge_summary_handler = qcm_edge_summary_handler_CT;
+    core->edge_summary_context = module;
+    *module_context = module;
+}
+
+
+static void qcm_edge_summary_final_CT(void *module_context)
+{
+    qcm_edge_summary_t *module = (qcm_edge_summary_t *) module_context;
+
+    module->core->edge_summary_handler = 0;
+    module->core->edge_summary_context = 0;
+    qdrc_event_unsubscribe_CT(module->core, module->event_sub);
+
+    module->stopping = true;
+    while (DEQ_HEAD(module->edges))
+        qcm_edge_summary_free_edge_CT(module, DEQ_HEAD(module->edges));
+    free(module);
+}
+
+
+QDR_CORE_MODULE_DECLARE("edge_summary", qcm_edge_summary_enable_CT, qcm_edge_summary_init_CT, qcm_edge_summary_final_CT)
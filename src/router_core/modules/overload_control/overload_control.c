@@ -0,0 +1,118 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/buffer.h>
+#include "module.h"
+
+//
+// Watches how far the router is falling behind and sets the core's overload
+// level, which cuts the credit issued to producers on incoming client links.
+// Three measures are sampled: the most actions queued for the core thread
+// since the last sample, the bytes of message buffers in use, and how late the
+// core thread runs this timer.  Each is taken as a percentage of its configured
+// threshold and the highest sets the pressure.  The level rises one step per
+// sample while the pressure is above the entry point of the next level and
+// falls one step once it is a quarter of a threshold below the entry point of
+// the current one, so a router hovering at a threshold does not flap.
+//
+
+#define QCM_OVERLOAD_SAMPLE_MSEC 100
+
+typedef struct {
+    qdr_core_t       *core;
+    qdr_core_timer_t *timer;
+    int64_t           due_msec;
+} qcm_overload_t;
+
+
+static int qcm_overload_percent(uint64_t measured, uint64_t threshold)
+{
+    if (threshold == 0)
+        return 0;
+    uint64_t percent = measured * 100 / threshold;
+    return percent > 1000 ? 1000 : (int) percent;
+}
+
+
+// Pressure at which a level is entered: 100% for the first, then 50% more per level
+static inline int qcm_overload_entry(int level)
+{
+    return 100 + 50 * (level - 1);
+}
+
+
+static void qcm_overload_sample_CT(qdr_core_t *core, void *context)
+{
+    qcm_overload_t *module = (qcm_overload_t*) context;
+    int64_t         now    = qd_timer_now_usec() / 1000;
+    int64_t         lag    = module->due_msec ? now - module->due_msec : 0;
+
+    int pressure = qcm_overload_percent(core->action_depth_peak, core->overload_action_depth);
+    core->action_depth_peak = 0;
+
+    if (core->overload_buffer_bytes) {
+        int buffers = qcm_overload_percent(qd_buffer_in_use_bytes(), core->overload_buffer_bytes);
+        if (buffers > pressure)
+            pressure = buffers;
+    }
+
+    int lateness = qcm_overload_percent(lag > 0 ? lag : 0, core->overload_core_lag_msec);
+    if (lateness > pressure)
+        pressure = lateness;
+
+    int level = core->overload_level;
+    if (level < QDR_OVERLOAD_LEVELS && pressure >= qcm_overload_entry(level + 1))
+        level++;
+    else if (level > 0 && pressure < qcm_overload_entry(level) - 25)
+        level--;
+    qdr_overload_set_level_CT(core, level);
+
+    module->due_msec = now + QCM_OVERLOAD_SAMPLE_MSEC;
+    qdr_core_timer_schedule_msec_CT(core, module->timer, QCM_OVERLOAD_SAMPLE_MSEC);
+}
+
+
+static bool qcm_overload_enable_CT(qdr_core_t *core)
+{
+    return core->overload_action_depth > 0 || core->overload_buffer_bytes > 0 || core->overload_core_lag_msec > 0;
+}
+
+
+static void qcm_overload_init_CT(qdr_core_t *core, void **module_context)
+{
+    qcm_overload_t *module = NEW(qcm_overload_t);
+    ZERO(module);
+    module->core  = core;
+    module->timer = qdr_core_timer_CT(core, qcm_overload_sample_CT, module);
+    module->due_msec = qd_timer_now_usec() / 1000 + QCM_OVERLOAD_SAMPLE_MSEC;
+    qdr_core_timer_schedule_msec_CT(core, module->timer, QCM_OVERLOAD_SAMPLE_MSEC);
+    *module_context = module;
+}
+
+
+static void qcm_overload_final_CT(void *module_context)
+{
+    qcm_overload_t *module = (qcm_overload_t*) module_context;
+    qdr_core_timer_free_CT(module->core, module->timer);
+    free(module);
+}
+
+
+QDR_CORE_MODULE_DECLARE("overload_control", qcm_overload_enable_CT, qcm_overload_init_CT, qcm_overload_final_CT)
@@ -0,0 +1,131 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/ctools.h>
+#include "module.h"
+#include "stats_page.h"
+
+//
+// Copies the core's counters into the shared statistics page every
+// statsPageMillis.  Only the core thread can read its lists and counters
+// safely, so the copy is a timer on the core thread, bounded by the page's
+// link slots.
+//
+
+typedef struct {
+    qdr_core_t             *core;
+    qd_stats_page_header_t *page;
+    qdr_core_timer_t       *timer;
+} qcm_stats_page_t;
+
+
+static void qcm_stats_page_write_router_CT(qdr_core_t *core, qd_stats_page_router_t *router)
+{
+    uint64_t depth = 0;
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++)
+        depth += DEQ_SIZE(core->action_queue[cls]);
+
+    qdr_delivery_counters_t settled;
+    qdr_delivery_counters_total_CT(core, &settled);
+
+    router->connections                        = DEQ_SIZE(core->open_connections);
+    router->links                              = DEQ_SIZE(core->open_links);
+    router->addresses                          = DEQ_SIZE(core->addrs);
+    router->deliveries_ingress                 = core->deliveries_ingress;
+    router->deliveries_egress                  = core->deliveries_egress;
+    router->deliveries_transit                 = core->deliveries_transit;
+    router->deliveries_ingress_route_container = core->deliveries_ingress_route_container;
+    router->deliveries_egress_route_container  = core->deliveries_egress_route_container;
+    router->presettled_deliveries              = settled.presettled;
+    router->dropped_presettled_deliveries      = core->dropped_presettled_deliveries;
+    router->accepted_deliveries                = settled.accepted;
+    router->rejected_deliveries                = settled.rejected;
+    router->released_deliveries                = settled.released;
+    router->modified_deliveries                = settled.modified;
+    router->action_queue_depth                 = depth;
+    router->action_park_count                  = core->action_park_count;
+}
+
+
+static uint32_t qcm_stats_page_write_links_CT(qdr_core_t *core, qd_stats_page_link_t *records, uint32_t capacity)
+{
+    uint32_t    count = 0;
+    qdr_link_t *link  = DEQ_HEAD(core->open_links);
+    while (link && count < capacity) {
+        qd_stats_page_link_t *record = &records[count++];
+        record->identity    = link->identity;
+        record->connection  = link->conn ? link->conn->identity : 0;
+        record->direction   = link->link_direction == QD_OUTGOING ? 1 : 0;
+        record->undelivered = (uint32_t) DEQ_SIZE(link->undelivered);
+        record->unsettled   = (uint32_t) DEQ_SIZE(link->unsettled);
+        record->deliveries  = link->total_deliveries + __atomic_load_n(&link->direct_deliveries, __ATOMIC_RELAXED);
+        record->presettled  = link->presettled_deliveries;
+        record->accepted    = link->accepted_deliveries;
+        record->rejected    = link->rejected_deliveries;
+        record->released    = link->released_deliveries;
+        record->modified    = link->modified_deliveries;
+        link = DEQ_NEXT(link);
+    }
+    return count;
+}
+
+
+static void qcm_stats_page_update_CT(qdr_core_t *core, void *context)
+{
+    qcm_stats_page_t       *module = (qcm_stats_page_t*) context;
+    qd_stats_page_header_t *page   = module->page;
+
+    qd_stats_page_begin_update(page);
+    qcm_stats_page_write_router_CT(core, qd_stats_page_router(page));
+    page->alloc_count = (uint32_t) qd_alloc_write_stats_page(qd_stats_page_allocs(page), page->alloc_slots);
+    page->link_count  = qcm_stats_page_write_links_CT(core, qd_stats_page_links(page), page->link_slots);
+    page->update_msec = (uint64_t) (qd_timer_now_usec() / 1000);
+    qd_stats_page_end_update(page);
+
+    qdr_core_timer_schedule_msec_CT(core, module->timer, core->stats_page_msec);
+}
+
+
+static bool qcm_stats_page_enable_CT(qdr_core_t *core)
+{
+    return qd_stats_page() != 0 && core->stats_page_msec > 0;
+}
+
+
+static void qcm_stats_page_init_CT(qdr_core_t *core, void **module_context)
+{
+    qcm_stats_page_t *module = NEW(qcm_stats_page_t);
+    ZERO(module);
+    module->core  = core;
+    module->page  = qd_stats_page();
+    module->timer = qdr_core_timer_CT(core, qcm_stats_page_update_CT, module);
+    qcm_stats_page_update_CT(core, module);
+    *module_context = module;
+}
+
+
+static void qcm_stats_page_final_CT(void *module_context)
+{
+    qcm_stats_page_t *module = (qcm_stats_page_t*) module_context;
+    qdr_core_timer_free_CT(module->core, module->timer);
+    free(module);
+}
+
+
+QDR_CORE_MODULE_DECLARE("stats_page", qcm_stats_page_enable_CT, qcm_stats_page_init_CT, qcm_stats_page_final_CT)
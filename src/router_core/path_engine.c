@@ -0,0 +1,311 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <qpid/dispatch/ctools.h>
+#include "path_engine.h"
+
+#define PATH_NO_LINK -1
+
+typedef enum {
+    PATH_NODE_UNKNOWN,     ///< Not yet referenced
+    PATH_NODE_PEER,        ///< Known only as the peer of another node
+    PATH_NODE_LINK_STATE   ///< Has a link state of its own
+} path_node_state_t;
+
+struct qdr_path_graph_t {
+    int                width;
+    int                node_count;
+    char             **ids;
+    path_node_state_t *state;
+    int               *link_cost;   ///< width x width, PATH_NO_LINK where there is no link
+    int               *prior_cost;  ///< The links as of the last calculation
+    bool               calculated;  ///< prior_cost and the cached trees are meaningful
+
+    //
+    // The shortest-path tree from each node, one row of width entries per root
+    //
+    int               *tree_prev;
+    int               *tree_cost;
+    int               *tree_hops;
+    bool              *tree_valid;
+    long               trees_computed;
+};
+
+
+qdr_path_graph_t *qdr_path_graph(void)
+{
+    qdr_path_graph_t *graph = NEW(qdr_path_graph_t);
+    ZERO(graph);
+    graph->width     = qd_bitmask_width();
+    graph->ids       = NEW_ARRAY(char*, graph->width);
+    graph->state     = NEW_ARRAY(path_node_state_t, graph->width);
+    graph->link_cost  = NEW_ARRAY(int, graph->width * graph->width);
+    graph->prior_cost = NEW_ARRAY(int, graph->width * graph->width);
+    graph->tree_prev  = NEW_ARRAY(int, graph->width * graph->width);
+    graph->tree_cost  = NEW_ARRAY(int, graph->width * graph->width);
+    graph->tree_hops  = NEW_ARRAY(int, graph->width * graph->width);
+    graph->tree_valid = NEW_ARRAY(bool, graph->width);
+    for (int i = 0; i < graph->width * graph->width; i++) {
+        graph->link_cost[i]  = PATH_NO_LINK;
+        graph->prior_cost[i] = PATH_NO_LINK;
+    }
+    for (int i = 0; i < graph->width; i++)
+        graph->tree_valid[i] = false;
+    return graph;
+}
+
+
+void qdr_path_graph_free(qdr_path_graph_t *graph)
+{
+    if (!graph)
+        return;
+    for (int i = 0; i < graph->node_count; i++)
+        free(graph->ids[i]);
+    free(graph->ids);
+    free(graph->state);
+    free(graph->link_cost);
+    free(graph->prior_cost);
+    free(graph->tree_prev);
+    free(graph->tree_cost);
+    free(graph->tree_hops);
+    free(graph->tree_valid);
+    free(graph);
+}
+
+
+int qdr_path_graph_node(qdr_path_graph_t *graph, const char *id)
+{
+    for (int i = 0; i < graph->node_count; i++)
+        if (strcmp(graph->ids[i], id) == 0)
+            return i;
+
+    if (graph->node_count == graph->width)
+        return -1;
+
+    int node = graph->node_count++;
+    graph->ids[node]   = strdup(id);
+    graph->state[node] = PATH_NODE_UNKNOWN;
+    return node;
+}
+
+
+const char *qdr_path_graph_node_id(const qdr_path_graph_t *graph, int node)
+{
+    return graph->ids[node];
+}
+
+
+int qdr_path_graph_node_count(const qdr_path_graph_t *graph)
+{
+    return graph->node_count;
+}
+
+
+long qdr_path_graph_trees_computed(const qdr_path_graph_t *graph)
+{
+    return graph->trees_computed;
+}
+
+
+void qdr_path_graph_reload(qdr_path_graph_t *graph)
+{
+    for (int i = 0; i < graph->width * graph->width; i++)
+        graph->link_cost[i] = PATH_NO_LINK;
+    for (int i = 0; i < graph->node_count; i++)
+        graph->state[i] = PATH_NODE_UNKNOWN;
+}
+
+
+void qdr_path_graph_link_state(qdr_path_graph_t *graph, int node)
+{
+    if (graph->state[node] == PATH_NODE_PEER)
+        for (int i = 0; i < graph->width; i++)
+            graph->link_cost[node * graph->width + i] = PATH_NO_LINK;
+    graph->state[node] = PATH_NODE_LINK_STATE;
+}
+
+
+void qdr_path_graph_link(qdr_path_graph_t *graph, int node, int peer, int cost)
+{
+    graph->link_cost[node * graph->width + peer] = cost;
+    if (graph->state[peer] == PATH_NODE_UNKNOWN) {
+        graph->state[peer] = PATH_NODE_PEER;
+        graph->link_cost[peer * graph->width + node] = 1;
+    }
+}
+
+
+/**
+ * Dijkstra's algorithm from root into the root's cached tree.  prev holds each
+ * reachable node's predecessor (-1 for the root and unreachable nodes), cost its
+ * cost (-1 if unreachable) and hops its distance in hops.  Equal-cost nodes are
+ * resolved in id order so the result is repeatable and matches the Python engine.
+ */
+static void path_tree_from_root(qdr_path_graph_t *graph, int root)
+{
+    int           count      = graph->node_count;
+    int          *prev       = graph->tree_prev + root * graph->width;
+    int          *cost       = graph->tree_cost + root * graph->width;
+    int          *hops       = graph->tree_hops + root * graph->width;
+    qd_bitmask_t *unresolved = qd_bitmask(0);
+
+    for (int i = 0; i < graph->width; i++) {
+        prev[i] = -1;
+        cost[i] = -1;  // infinite
+        hops[i] = 0;
+        if (i < count)
+            qd_bitmask_set_bit(unresolved, i);
+    }
+    cost[root] = 0;
+
+    while (qd_bitmask_cardinality(unresolved) > 0) {
+        int u = -1;
+        int i, c;
+        for (QD_BITMASK_EACH(unresolved, i, c)) {
+            if (cost[i] < 0)
+                continue;
+            if (u < 0 || cost[i] < cost[u] || (cost[i] == cost[u] && strcmp(graph->ids[i], graph->ids[u]) < 0))
+                u = i;
+        }
+
+        if (u < 0)
+            break;  // The remaining nodes are unreachable
+
+        qd_bitmask_clear_bit(unresolved, u);
+        const int *links = graph->link_cost + u * graph->width;
+        for (int v = 0; v < count; v++) {
+            if (links[v] == PATH_NO_LINK || !qd_bitmask_value(unresolved, v))
+                continue;
+            int alt = cost[u] + links[v];
+            if (cost[v] < 0 || alt < cost[v]) {
+                cost[v] = alt;
+                hops[v] = hops[u] + 1;
+                prev[v] = u;
+            }
+        }
+    }
+
+    qd_bitmask_free(unresolved);
+    graph->tree_valid[root] = true;
+    graph->trees_computed++;
+}
+
+
+/**
+ * Drop the cached trees that a change in the link from u to v could alter.  A
+ * link that got worse matters only to trees that use it.  A link that got better
+ * matters only where it reaches v at least as cheaply as the tree does; an equal
+ * cost can change the tie-break, so that counts too.
+ */
+static void path_invalidate_trees(qdr_path_graph_t *graph, int u, int v, int old_cost, int new_cost)
+{
+    bool worse = new_cost == PATH_NO_LINK || (old_cost != PATH_NO_LINK && new_cost > old_cost);
+
+    for (int root = 0; root < graph->node_count; root++) {
+        if (!graph->tree_valid[root])
+            continue;
+
+        const int *prev = graph->tree_prev + root * graph->width;
+        const int *cost = graph->tree_cost + root * graph->width;
+        if (worse) {
+            if (prev[v] == u)
+                graph->tree_valid[root] = false;
+        } else if (cost[u] >= 0 && (cost[v] < 0 || cost[u] + new_cost <= cost[v]))
+            graph->tree_valid[root] = false;
+    }
+}
+
+
+static void path_tree(qdr_path_graph_t *graph, int root)
+{
+    if (!graph->tree_valid[root])
+        path_tree_from_root(graph, root);
+}
+
+
+int qdr_path_calculate_routes(qdr_path_graph_t *graph, int root, qdr_path_route_t *routes)
+{
+    int count  = graph->node_count;
+    int radius = 0;
+
+    if (graph->calculated) {
+        for (int u = 0; u < count; u++) {
+            const int *links = graph->link_cost  + u * graph->width;
+            const int *prior = graph->prior_cost + u * graph->width;
+            for (int v = 0; v < count; v++)
+                if (links[v] != prior[v])
+                    path_invalidate_trees(graph, u, v, prior[v], links[v]);
+        }
+    } else {
+        for (int i = 0; i < graph->width; i++)
+            graph->tree_valid[i] = false;
+        graph->calculated = true;
+    }
+
+    path_tree(graph, root);
+    const int *prev = graph->tree_prev + root * graph->width;
+    const int *cost = graph->tree_cost + root * graph->width;
+    const int *hops = graph->tree_hops + root * graph->width;
+
+    for (int node = 0; node < count; node++) {
+        routes[node].next_hop      = -1;
+        routes[node].cost          = 0;
+        routes[node].valid_origins = qd_bitmask(0);
+        if (prev[node] < 0)
+            continue;
+
+        int hop = node;
+        while (prev[hop] != root)
+            hop = prev[hop];
+        routes[node].next_hop = hop;
+        routes[node].cost     = cost[node];
+        if (hops[node] > radius)
+            radius = hops[node];
+    }
+
+    //
+    // A remote origin is valid for a destination if the origin's shortest path to
+    // that destination passes through the root.
+    //
+    for (int origin = 0; origin < count; origin++) {
+        if (routes[origin].next_hop < 0)
+            continue;
+
+        path_tree(graph, origin);
+        const int *origin_prev = graph->tree_prev + origin * graph->width;
+        for (int dest = 0; dest < count; dest++) {
+            if (dest == root || routes[dest].next_hop < 0 || origin_prev[dest] < 0)
+                continue;
+            for (int hop = origin_prev[dest]; hop != origin; hop = origin_prev[hop]) {
+                if (hop == root) {
+                    qd_bitmask_set_bit(routes[dest].valid_origins, origin);
+                    break;
+                }
+            }
+        }
+    }
+
+    //
+    // The links just used become the baseline for the next calculation.
+    //
+    memcpy(graph->prior_cost, graph->link_cost, sizeof(int) * graph->width * graph->width);
+    return radius;
+}
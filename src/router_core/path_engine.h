@@ -0,0 +1,85 @@
+#ifndef qd_router_core_path_engine
+#define qd_router_core_path_engine 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/bitmask.h>
+
+//
+// Shortest-path computation over the collected link states.  This is the C
+// counterpart of PathEngine in python/qpid_dispatch_internal/router/path.py and
+// produces the same next hops, costs, valid origins and radius.
+//
+// Nodes are indexed in the order they are added and node sets are bitmasks of
+// those indices, so a graph holds at most qd_bitmask_width() nodes.
+//
+// A graph is meant to be kept across calculations.  The shortest-path tree from
+// each node is cached and, when the link states are loaded again, only the trees
+// that a changed link can affect are recomputed.
+//
+typedef struct qdr_path_graph_t qdr_path_graph_t;
+
+typedef struct qdr_path_route_t {
+    int           next_hop;       ///< Index of the neighbor the node is reached through, -1 if unreachable
+    int           cost;           ///< Cost of the path from the root
+    qd_bitmask_t *valid_origins;  ///< Origins whose path to the node passes through the root
+} qdr_path_route_t;
+
+qdr_path_graph_t *qdr_path_graph(void);
+void qdr_path_graph_free(qdr_path_graph_t *graph);
+
+/**
+ * Return the index of the node with this id, adding it if it is new.  Returns -1
+ * if the graph is full.
+ */
+int qdr_path_graph_node(qdr_path_graph_t *graph, const char *id);
+const char *qdr_path_graph_node_id(const qdr_path_graph_t *graph, int node);
+int qdr_path_graph_node_count(const qdr_path_graph_t *graph);
+
+/**
+ * Begin loading a new set of link states.  The links from the previous set are
+ * kept for comparison by the next qdr_path_calculate_routes.
+ */
+void qdr_path_graph_reload(qdr_path_graph_t *graph);
+
+/**
+ * Record that the node has a link state of its own; any links assumed for it
+ * while it was only known as a peer are dropped.
+ */
+void qdr_path_graph_link_state(qdr_path_graph_t *graph, int node);
+
+/**
+ * Add a link from a node's link state.  A peer with no link state of its own is
+ * given a unit-cost link back so that routes to it can be established.
+ */
+void qdr_path_graph_link(qdr_path_graph_t *graph, int node, int peer, int cost);
+
+/**
+ * Compute the routes from root to every node.  routes must have room for
+ * qdr_path_graph_node_count() entries; the caller frees their valid_origins.
+ * Returns the radius of the topology in hops.
+ */
+int qdr_path_calculate_routes(qdr_path_graph_t *graph, int root, qdr_path_route_t *routes);
+
+/**
+ * The number of shortest-path trees computed over the life of the graph.
+ */
+long qdr_path_graph_trees_computed(const qdr_path_graph_t *graph);
+
+#endif
@@ -102,6 +102,7 @@ void qdr_route_check_id_for_deletion_CT(qdr_core_t *core, qdr_conn_identifier_t
         qd_hash_remove_by_handle(core->conn_id_hash, cid->container_hash_handle);
         qd_hash_handle_free(cid->connection_hash_handle);
         qd_hash_handle_free(cid->container_hash_handle);
+        qdr_core_timer_free_CT(core, cid->activate_timer);
         free_qdr_conn_identifier_t(cid);
     }
 }
@@ -282,6 +283,52 @@ static void qdr_route_attempt_auto_link_CT(qdr_core_t      *core,
 }
 
 
+/**
+ * Activates the next batch of a container's auto-links on the connection they are
+ * being paced onto, and schedules the batch after it a second later.
+ */
+static void qdr_auto_link_activate_batch_CT(qdr_core_t *core, void *context)
+{
+    qdr_conn_identifier_t *cid    = (qdr_conn_identifier_t*) context;
+    int                    budget = core->auto_link_activate_rate;
+
+    while (cid->activate_next && budget > 0) {
+        qdr_auto_link_t *al = cid->activate_next;
+        cid->activate_next = DEQ_NEXT_N(REF, al);
+        if (al->activate_pending) {
+            al->activate_pending = false;
+            core->auto_links_pending--;
+            qdr_auto_link_activate_CT(core, al, cid->activate_conn);
+            budget--;
+        }
+    }
+
+    if (cid->activate_next)
+        qdr_core_timer_schedule_CT(core, cid->activate_timer, 1);
+    else
+        cid->activate_conn = 0;
+}
+
+
+/**
+ * Drops the auto-links still waiting for a paced activation on a container.
+ */
+static void qdr_auto_link_cancel_batches_CT(qdr_core_t *core, qdr_conn_identifier_t *cid)
+{
+    while (cid->activate_next) {
+        qdr_auto_link_t *al = cid->activate_next;
+        if (al->activate_pending) {
+            al->activate_pending = false;
+            core->auto_links_pending--;
+        }
+        cid->activate_next = DEQ_NEXT_N(REF, al);
+    }
+    cid->activate_conn = 0;
+    if (cid->activate_timer)
+        qdr_core_timer_cancel_CT(core, cid->activate_timer);
+}
+
+
 static void qdr_auto_link_deactivate_CT(qdr_core_t *core, qdr_auto_link_t *al, qdr_connection_t *conn)
 {
     qdr_route_log_CT(core, "Auto Link Deactivated", al->name, al->identity, conn);
@@ -379,6 +426,7 @@ qdr_link_route_t *qdr_route_add_link_route_CT(qdr_core_t             *core,
     // Add the link route to the core list
     //
     DEQ_INSERT_TAIL(core->link_routes, lr);
+    qdr_config_name_insert_CT(core->link_route_names, lr->name, lr, &lr->name_handle);
     qd_log(core->log, QD_LOG_TRACE, "Link route %spattern added: pattern=%s name=%s",
            is_prefix ? "prefix " : "", lr->pattern, lr->name);
 
@@ -512,6 +560,7 @@ qdr_auto_link_t *qdr_route_add_auto_link_CT(qdr_core_t          *core,
     // Add the auto_link to the core list
     //
     DEQ_INSERT_TAIL(core->auto_links, al);
+    qdr_config_name_insert_CT(core->auto_link_names, al->name, al, &al->name_handle);
 
     return al;
 }
@@ -565,13 +614,30 @@ void qdr_route_connection_opened_CT(qdr_core_t       *core,
     }
 
     //
-    // Activate all auto-links associated with this remote container.
+    // Activate all auto-links associated with this remote container.  With an activation
+    // rate set, they are queued and their attaches go out in batches, one each second.
     //
+    if (core->auto_link_activate_rate == 0 || DEQ_SIZE(cid->auto_link_refs) <= core->auto_link_activate_rate) {
+        qdr_auto_link_t *al = DEQ_HEAD(cid->auto_link_refs);
+        while (al) {
+            qdr_auto_link_activate_CT(core, al, conn);
+            al = DEQ_NEXT_N(REF, al);
+        }
+        return;
+    }
+
+    qdr_auto_link_cancel_batches_CT(core, cid);
     qdr_auto_link_t *al = DEQ_HEAD(cid->auto_link_refs);
     while (al) {
-        qdr_auto_link_activate_CT(core, al, conn);
+        al->activate_pending = true;
+        core->auto_links_pending++;
         al = DEQ_NEXT_N(REF, al);
     }
+    if (!cid->activate_timer)
+        cid->activate_timer = qdr_core_timer_CT(core, qdr_auto_link_activate_batch_CT, cid);
+    cid->activate_conn = conn;
+    cid->activate_next = DEQ_HEAD(cid->auto_link_refs);
+    qdr_auto_link_activate_batch_CT(core, cid);
 }
 
 
@@ -592,6 +658,9 @@ void qdr_route_connection_closed_CT(qdr_core_t *core, qdr_connection_t *conn)
 
     qdr_conn_identifier_t *cid = conn->conn_id;
     if (cid) {
+        if (cid->activate_conn == conn)
+            qdr_auto_link_cancel_batches_CT(core, cid);
+
         //
         // Deactivate all link-routes associated with this remote container.
         //
@@ -635,6 +704,7 @@ void qdr_link_route_map_pattern_CT(qdr_core_t *core, qd_iterator_t *address, qdr
     bool found = qd_parse_tree_get_pattern(core->link_route_tree[dir], iter, (void **)&other_addr);
     if (!found) {
         qd_parse_tree_add_pattern(core->link_route_tree[dir], iter, addr);
+        qdr_config_snapshot_changed_CT(core);
     } else {
         // the pattern is mapped once when the address is added to the hash
         // table.  It should not be mapped twice
@@ -659,6 +729,7 @@ void qdr_link_route_unmap_pattern_CT(qdr_core_t *core, qd_iterator_t *address)
     bool found = qd_parse_tree_get_pattern(core->link_route_tree[dir], iter, (void **)&addr);
     if (found) {
         qd_parse_tree_remove_pattern(core->link_route_tree[dir], iter);
+        qdr_config_snapshot_changed_CT(core);
     } else {
         // expected that the pattern is removed when the address is deleted.
         // Attempting to remove it twice is unexpected
@@ -29,10 +29,24 @@ static void qdr_set_next_hop_CT      (qdr_core_t *core, qdr_action_t *action, bo
 static void qdr_remove_next_hop_CT   (qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_set_cost_CT          (qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_set_valid_origins_CT (qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_set_equal_cost_hops_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_map_destination_CT   (qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_unmap_destination_CT (qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_subscribe_CT         (qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_unsubscribe_CT       (qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_route_table_batch_CT (qdr_core_t *core, qdr_action_t *action, bool discard);
+
+
+//
+// Hold the update if a route table transaction is open, else pass it to the core now.
+//
+static void qdr_route_table_enqueue(qdr_core_t *core, qdr_action_t *action)
+{
+    if (core->rt_batch_depth > 0)
+        DEQ_INSERT_TAIL(core->rt_batch, action);
+    else
+        qdr_action_enqueue(core, action);
+}
 
 
 //==================================================================================
@@ -42,87 +56,127 @@ static void qdr_unsubscribe_CT       (qdr_core_t *core, qdr_action_t *action, bo
 void qdr_core_add_router(qdr_core_t *core, const char *address, int router_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_add_router_CT, "add_router");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.address        = qdr_field(address);
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_del_router(qdr_core_t *core, int router_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_del_router_CT, "del_router");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_set_link(qdr_core_t *core, int router_maskbit, int link_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_set_link_CT, "set_link");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.link_maskbit   = link_maskbit;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_remove_link(qdr_core_t *core, int router_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_remove_link_CT, "remove_link");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_set_next_hop(qdr_core_t *core, int router_maskbit, int nh_router_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_set_next_hop_CT, "set_next_hop");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit    = router_maskbit;
     action->args.route_table.nh_router_maskbit = nh_router_maskbit;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_remove_next_hop(qdr_core_t *core, int router_maskbit)
 {
     qdr_action_t *action = qdr_action(qdr_remove_next_hop_CT, "remove_next_hop");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_set_cost(qdr_core_t *core, int router_maskbit, int cost)
 {
     qdr_action_t *action = qdr_action(qdr_set_cost_CT, "set_cost");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.cost           = cost;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_set_valid_origins(qdr_core_t *core, int router_maskbit, qd_bitmask_t *routers)
 {
     qdr_action_t *action = qdr_action(qdr_set_valid_origins_CT, "set_valid_origins");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.router_set     = routers;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
+}
+
+
+void qdr_core_set_equal_cost_hops(qdr_core_t *core, int router_maskbit, qd_bitmask_t *next_hops)
+{
+    qdr_action_t *action = qdr_action(qdr_set_equal_cost_hops_CT, "set_equal_cost_hops");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
+    action->args.route_table.router_maskbit = router_maskbit;
+    action->args.route_table.router_set     = next_hops;
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_map_destination(qdr_core_t *core, int router_maskbit, const char *address_hash, int treatment_hint)
 {
     qdr_action_t *action = qdr_action(qdr_map_destination_CT, "map_destination");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.address        = qdr_field(address_hash);
     action->args.route_table.treatment_hint = treatment_hint;
-    qdr_action_enqueue(core, action);
+    qdr_route_table_enqueue(core, action);
 }
 
 
 void qdr_core_unmap_destination(qdr_core_t *core, int router_maskbit, const char *address_hash)
 {
     qdr_action_t *action = qdr_action(qdr_unmap_destination_CT, "unmap_destination");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.route_table.router_maskbit = router_maskbit;
     action->args.route_table.address        = qdr_field(address_hash);
+    qdr_route_table_enqueue(core, action);
+}
+
+
+void qdr_core_route_table_begin(qdr_core_t *core)
+{
+    if (core->rt_batch_depth++ == 0)
+        DEQ_INIT(core->rt_batch);
+}
+
+
+void qdr_core_route_table_commit(qdr_core_t *core)
+{
+    assert(core->rt_batch_depth > 0);
+    if (--core->rt_batch_depth > 0 || DEQ_SIZE(core->rt_batch) == 0)
+        return;
+
+    qdr_action_t *action = qdr_action(qdr_route_table_batch_CT, "route_table_batch");
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
+    DEQ_MOVE(core->rt_batch, action->args.route_table.batch);
     qdr_action_enqueue(core, action);
 }
 
@@ -154,6 +208,8 @@ qdr_subscription_t *qdr_core_subscribe(qdr_core_t             *core,
     sub->on_message_context = context;
 
     qdr_action_t *action = qdr_action(qdr_subscribe_CT, "subscribe");
+
+    action->action_class = QDR_ACTION_CLASS_CONTROL;
     action->args.io.address       = qdr_field(address);
     action->args.io.address_class = aclass;
     action->args.io.address_phase = phase;
@@ -169,6 +225,7 @@ void qdr_core_unsubscribe(qdr_subscription_t *sub)
 {
     if (sub) {
         qdr_action_t *action = qdr_action(qdr_unsubscribe_CT, "unsubscribe");
+        action->action_class = QDR_ACTION_CLASS_CONTROL;
         action->args.io.subscription = sub;
         qdr_action_enqueue(sub->core, action);
     }
@@ -221,11 +278,23 @@ void qdr_route_table_setup_CT(qdr_core_t *core)
     DEQ_INIT(core->routers);
     core->addr_hash    = qd_hash(12, 32, 0);
     core->conn_id_hash = qd_hash(6, 4, 0);
+    core->addr_config_names = qd_hash(6, 4, 0);
+    core->auto_link_names   = qd_hash(6, 4, 0);
+    core->link_route_names  = qd_hash(6, 4, 0);
     core->cost_epoch   = 1;
+    core->mcast_epoch  = 1;
     core->addr_parse_tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
     core->link_route_tree[QD_INCOMING] = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
     core->link_route_tree[QD_OUTGOING] = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
 
+    //
+    // These trees are only searched on the core thread, so they can keep a
+    // cache of recent lookups.  Attach storms hit the same few addresses.
+    //
+    qd_parse_tree_set_cache_size(core->addr_parse_tree, 256);
+    qd_parse_tree_set_cache_size(core->link_route_tree[QD_INCOMING], core->link_route_cache_size);
+    qd_parse_tree_set_cache_size(core->link_route_tree[QD_OUTGOING], core->link_route_cache_size);
+
     if (core->router_mode == QD_ROUTER_MODE_INTERIOR) {
         core->hello_addr      = qdr_add_local_address_CT(core, 'L', "qdhello",     QD_TREATMENT_MULTICAST_FLOOD);
         core->router_addr_L   = qdr_add_local_address_CT(core, 'L', "qdrouter",    QD_TREATMENT_MULTICAST_FLOOD);
@@ -247,9 +316,7 @@ void qdr_route_table_setup_CT(qdr_core_t *core)
         for (int idx = 0; idx < qd_bitmask_width(); idx++) {
             core->routers_by_mask_bit[idx]   = 0;
             core->control_links_by_mask_bit[idx] = 0;
-            core->data_links_by_mask_bit[idx].count = 0;
-            for (int priority = 0; priority < QDR_N_PRIORITIES; ++ priority)
-              core->data_links_by_mask_bit[idx].links[priority] = 0;
+            ZERO(&core->data_links_by_mask_bit[idx]);
 
         }
     }
@@ -313,7 +380,8 @@ static void qdr_add_router_CT(qdr_core_t *core, qdr_action_t *action, bool disca
         rnode->next_hop          = 0;
         rnode->link_mask_bit     = -1;
         rnode->ref_count         = 0;
-        rnode->valid_origins     = qd_bitmask(0);
+        rnode->valid_origins     = qdr_shared_mask_CT(core, qd_bitmask(0));
+        rnode->equal_cost_hops   = 0;
         rnode->cost              = 0;
 
         //
@@ -327,14 +395,14 @@ static void qdr_add_router_CT(qdr_core_t *core, qdr_action_t *action, bool disca
         //
         // Link the router record to the address record.
         //
-        qd_bitmask_set_bit(addr->rnodes, router_maskbit);
+        qdr_address_rnodes_set_CT(core, addr, router_maskbit);
 
         //
         // Link the router record to the router address records.
         // Use the T-class addresses only.
         //
-        qd_bitmask_set_bit(core->router_addr_T->rnodes, router_maskbit);
-        qd_bitmask_set_bit(core->routerma_addr_T->rnodes, router_maskbit);
+        qdr_address_rnodes_set_CT(core, core->router_addr_T, router_maskbit);
+        qdr_address_rnodes_set_CT(core, core->routerma_addr_T, router_maskbit);
 
         //
         // Bump the ref-count by three for each of the above links.
@@ -345,6 +413,7 @@ static void qdr_add_router_CT(qdr_core_t *core, qdr_action_t *action, bool disca
         // Add the router record to the mask-bit index.
         //
         core->routers_by_mask_bit[router_maskbit] = rnode;
+        core->mcast_epoch++;
     } while (false);
 
     qdr_field_free(address);
@@ -372,10 +441,11 @@ static void qdr_del_router_CT(qdr_core_t *core, qdr_action_t *action, bool disca
     //
     // Unlink the router node from the address record
     //
-    qd_bitmask_clear_bit(oaddr->rnodes, router_maskbit);
-    qd_bitmask_clear_bit(core->router_addr_T->rnodes, router_maskbit);
-    qd_bitmask_clear_bit(core->routerma_addr_T->rnodes, router_maskbit);
+    qdr_address_rnodes_clear_CT(core, oaddr, router_maskbit);
+    qdr_address_rnodes_clear_CT(core, core->router_addr_T, router_maskbit);
+    qdr_address_rnodes_clear_CT(core, core->routerma_addr_T, router_maskbit);
     rnode->ref_count -= 3;
+    core->mcast_epoch++;
 
     //
     // While the router node has a non-zero reference count, look for addresses
@@ -383,7 +453,7 @@ static void qdr_del_router_CT(qdr_core_t *core, qdr_action_t *action, bool disca
     //
     qdr_address_t *addr = DEQ_HEAD(core->addrs);
     while (addr && rnode->ref_count > 0) {
-        if (qd_bitmask_clear_bit(addr->rnodes, router_maskbit))
+        if (qdr_address_rnodes_clear_CT(core, addr, router_maskbit))
             //
             // If the cleared bit was originally set, decrement the ref count
             //
@@ -435,6 +505,7 @@ static void qdr_set_link_CT(qdr_core_t *core, qdr_action_t *action, bool discard
     //
     qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
     rnode->link_mask_bit = link_maskbit;
+    core->mcast_epoch++;
     qdr_addr_start_inlinks_CT(core, rnode->owning_addr);
 }
 
@@ -455,6 +526,7 @@ static void qdr_remove_link_CT(qdr_core_t *core, qdr_action_t *action, bool disc
 
     qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
     rnode->link_mask_bit = -1;
+    core->mcast_epoch++;
 }
 
 
@@ -486,6 +558,7 @@ static void qdr_set_next_hop_CT(qdr_core_t *core, qdr_action_t *action, bool dis
     if (router_maskbit != nh_router_maskbit) {
         qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
         rnode->next_hop   = core->routers_by_mask_bit[nh_router_maskbit];
+        core->mcast_epoch++;
         qdr_addr_start_inlinks_CT(core, rnode->owning_addr);
     }
 }
@@ -502,6 +575,7 @@ static void qdr_remove_next_hop_CT(qdr_core_t *core, qdr_action_t *action, bool
 
     qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
     rnode->next_hop = 0;
+    core->mcast_epoch++;
 }
 
 
@@ -547,17 +621,60 @@ static void qdr_set_valid_origins_CT(qdr_core_t *core, qdr_action_t *action, boo
             break;
         }
 
-        qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
-        if (rnode->valid_origins)
-            qd_bitmask_free(rnode->valid_origins);
-        rnode->valid_origins = valid_origins;
+        //
+        // Routers with the same origin set share one interned mask.  An
+        // unchanged set comes back as the same pointer and leaves the cached
+        // multicast plans valid.
+        //
+        qdr_node_t   *rnode  = core->routers_by_mask_bit[router_maskbit];
+        qd_bitmask_t *shared = qdr_shared_mask_CT(core, valid_origins);
         valid_origins = 0;
+        if (shared == rnode->valid_origins) {
+            qdr_shared_mask_release_CT(core, shared);
+            break;
+        }
+        qdr_shared_mask_release_CT(core, rnode->valid_origins);
+        rnode->valid_origins = shared;
+        core->mcast_epoch++;
     } while (false);
 
     if (valid_origins)
         qd_bitmask_free(valid_origins);
 }
 
+static void qdr_set_equal_cost_hops_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    int           router_maskbit = action->args.route_table.router_maskbit;
+    qd_bitmask_t *next_hops      = action->args.route_table.router_set;
+
+    if (discard) {
+        qd_bitmask_free(next_hops);
+        return;
+    }
+
+    if (router_maskbit >= qd_bitmask_width() || router_maskbit < 0) {
+        qd_log(core->log, QD_LOG_CRITICAL, "set_equal_cost_hops: Router maskbit out of range: %d", router_maskbit);
+        qd_bitmask_free(next_hops);
+        return;
+    }
+
+    qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
+    if (rnode == 0) {
+        qd_log(core->log, QD_LOG_CRITICAL, "set_equal_cost_hops: Router not found");
+        qd_bitmask_free(next_hops);
+        return;
+    }
+
+    if (rnode->equal_cost_hops)
+        qdr_shared_mask_release_CT(core, rnode->equal_cost_hops);
+    rnode->equal_cost_hops = 0;
+
+    if (qd_bitmask_cardinality(next_hops) > 1)
+        rnode->equal_cost_hops = qdr_shared_mask_CT(core, next_hops);
+    else
+        qd_bitmask_free(next_hops);
+}
+
 static qd_address_treatment_t default_treatment(qdr_core_t *core, int hint) {
     switch (hint) {
     case QD_TREATMENT_MULTICAST_FLOOD:
@@ -628,9 +745,10 @@ static void qdr_map_destination_CT(qdr_core_t *core, qdr_action_t *action, bool
         }
 
         qdr_node_t *rnode = core->routers_by_mask_bit[router_maskbit];
-        qd_bitmask_set_bit(addr->rnodes, router_maskbit);
+        qdr_address_rnodes_set_CT(core, addr, router_maskbit);
         rnode->ref_count++;
         addr->cost_epoch--;
+        core->mcast_epoch++;
         qdr_addr_start_inlinks_CT(core, addr);
 
         //
@@ -677,9 +795,10 @@ static void qdr_unmap_destination_CT(qdr_core_t *core, qdr_action_t *action, boo
             break;
         }
         
-        qd_bitmask_clear_bit(addr->rnodes, router_maskbit);
+        qdr_address_rnodes_clear_CT(core, addr, router_maskbit);
         rnode->ref_count--;
         addr->cost_epoch--;
+        core->mcast_epoch++;
 
         //
         // Raise an address event if this was the last destination for the address
@@ -696,6 +815,22 @@ static void qdr_unmap_destination_CT(qdr_core_t *core, qdr_action_t *action, boo
 }
 
 
+static void qdr_route_table_batch_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    //
+    // Apply the updates of one route table transaction back to back.  Each handler
+    // releases its own arguments, discarding included.
+    //
+    qdr_action_t *update = DEQ_HEAD(action->args.route_table.batch);
+    while (update) {
+        DEQ_REMOVE_HEAD(action->args.route_table.batch);
+        update->action_handler(core, update, discard);
+        free_qdr_action_t(update);
+        update = DEQ_HEAD(action->args.route_table.batch);
+    }
+}
+
+
 static void qdr_subscribe_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
 {
     qdr_field_t        *address = action->args.io.address;
@@ -728,6 +863,7 @@ static void qdr_subscribe_CT(qdr_core_t *core, qdr_action_t *action, bool discar
             sub->addr = addr;
             DEQ_ITEM_INIT(sub);
             DEQ_INSERT_TAIL(addr->subscriptions, sub);
+            qdr_forward_select_CT(core, addr);
             qdr_addr_start_inlinks_CT(core, addr);
         }
     } else
@@ -743,6 +879,7 @@ static void qdr_unsubscribe_CT(qdr_core_t *core, qdr_action_t *action, bool disc
 
     if (!discard) {
         DEQ_REMOVE(sub->addr->subscriptions, sub);
+        qdr_forward_select_CT(core, sub->addr);
         sub->addr = 0;
         qdr_check_addr_CT(sub->core, sub->addr);
     }
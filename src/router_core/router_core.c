@@ -26,6 +26,8 @@
 
 ALLOC_DEFINE(qdr_address_t);
 ALLOC_DEFINE(qdr_address_config_t);
+ALLOC_DEFINE(qdr_address_stats_t);
+ALLOC_DEFINE(qdr_shared_mask_t);
 ALLOC_DEFINE(qdr_node_t);
 ALLOC_DEFINE(qdr_delivery_t);
 ALLOC_DEFINE(qdr_delivery_ref_t);
@@ -40,6 +42,20 @@ ALLOC_DEFINE(qdr_connection_info_t);
 
 static void qdr_general_handler(void *context);
 
+static void qdr_free_cleanup_chain(qdr_delivery_cleanup_t *cleanup)
+{
+    while (cleanup) {
+        qdr_delivery_cleanup_t *next = cleanup->next;
+        if (cleanup->msg)
+            qd_message_free(cleanup->msg);
+        if (cleanup->iter)
+            qd_iterator_free(cleanup->iter);
+        free_qdr_delivery_cleanup_t(cleanup);
+        cleanup = next;
+    }
+}
+
+
 qdr_core_t *qdr_core(qd_dispatch_t *qd, qd_router_mode_t mode, const char *area, const char *id)
 {
     qdr_core_t *core = NEW(qdr_core_t);
@@ -50,7 +66,10 @@ qdr_core_t *qdr_core(qd_dispatch_t *qd, qd_router_mode_t mode, const char *area,
     core->router_area = area;
     core->router_id   = id;
 
+    qdr_intern_initialize();
+
     DEQ_INIT(core->exchanges);
+    qd_timer_wheel_init(&core->timer_wheel, qd_timer_now_usec() / 1000);
 
     //
     // Set up the logging sources for the router core
@@ -64,12 +83,75 @@ qdr_core_t *qdr_core(qd_dispatch_t *qd, qd_router_mode_t mode, const char *area,
     core->action_cond = sys_cond();
     core->action_lock = sys_mutex();
     core->running     = true;
-    DEQ_INIT(core->action_list);
+    sys_atomic_ptr_init(&core->action_stack, 0);
+    sys_atomic_init(&core->action_sleeping, 0);
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++)
+        DEQ_INIT(core->action_queue[cls]);
+
+    //
+    // Set up the scheduling of action classes.  A class must always get at least one
+    // action per round or it could be starved.
+    //
+    core->action_budget = qd->core_action_budget > 0 ? qd->core_action_budget : 0;
+    core->action_weight[QDR_ACTION_CLASS_DATA]       = qd->core_data_plane_weight;
+    core->action_weight[QDR_ACTION_CLASS_CONTROL]    = qd->core_control_plane_weight;
+    core->action_weight[QDR_ACTION_CLASS_MANAGEMENT] = qd->core_management_weight;
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++)
+        if (core->action_weight[cls] < 1)
+            core->action_weight[cls] = 1;
+    core->action_spin_usec = qd->core_spin_micros > 0 ? qd->core_spin_micros : 0;
+    core->action_spin_window   = core->action_spin_usec;
+    core->action_spin_hit_rate = QDR_SPIN_RATE_ONE;
+    core->action_stats_enabled = qd->core_action_stats;
+    if (qd->core_action_trace && *qd->core_action_trace)
+        core->action_trace = qdr_action_trace(core, qd->core_action_trace);
+    core->balanced_latency_aware = qd->balanced_latency_aware;
+    core->delivery_latency_stats = qd->delivery_latency_stats;
+    core->stats_page_msec        = qd->stats_page_msec > 0 ? qd->stats_page_msec : 0;
+    core->agent_snapshot_msec    = qd->management_snapshot_msec > 0 ? qd->management_snapshot_msec : 0;
+    core->metrics_series_limit   = qd->metrics_series_limit > 0 ? qd->metrics_series_limit : 0;
+    core->edge_proxy_attach_rate = qd->edge_proxy_attach_rate > 0 ? qd->edge_proxy_attach_rate : 0;
+    core->edge_update_window     = qd->edge_update_window > 0 ? qd->edge_update_window : 0;
+    core->addr_lookup_cache_ttl  = qd->addr_lookup_cache_ttl > 0 ? qd->addr_lookup_cache_ttl : 0;
+    core->addr_grace_period      = qd->addr_grace_period > 0 ? qd->addr_grace_period : 0;
+    core->producer_credit_release = qd->producer_credit_release > 0 ? qd->producer_credit_release : 0;
+    core->link_route_cache_size  = qd->link_route_cache_size > 0 ? qd->link_route_cache_size : 0;
+    core->auto_link_activate_rate = qd->auto_link_activate_rate > 0 ? qd->auto_link_activate_rate : 0;
+    core->client_max_in_flight    = qd->core_client_max_in_flight > 0 ? qd->core_client_max_in_flight : 0;
+    core->edge_uplinks = qd->edge_uplinks < 1 ? 1 : qd->edge_uplinks > QDR_MAX_EDGE_UPLINKS ? QDR_MAX_EDGE_UPLINKS : qd->edge_uplinks;
+    core->activation_batch_usec = qd->core_activation_batch_micros > 0 ? qd->core_activation_batch_micros : 0;
+    core->settle_window_usec = qd->inter_router_settle_micros > 0 ? qd->inter_router_settle_micros : 0;
+    core->outbound_weighted  = qd->outbound_scheduler && strcmp(qd->outbound_scheduler, "weighted") == 0;
+    core->outbound_quantum   = qd->outbound_quantum > 0 ? qd->outbound_quantum : 1;
+    core->connection_budget  = qd->connection_delivery_budget > 0 ? qd->connection_delivery_budget : 0;
+    core->credit_window_max  = qd->adaptive_credit_max > 0 ? qd->adaptive_credit_max : 0;
+    core->credit_window_min  = qd->adaptive_credit_min > 0 ? qd->adaptive_credit_min : 1;
+    if (core->credit_window_min > core->credit_window_max && core->credit_window_max > 0)
+        core->credit_window_min = core->credit_window_max;
+    core->overload_action_depth  = qd->overload_action_depth > 0 ? qd->overload_action_depth : 0;
+    core->overload_buffer_bytes  = qd->overload_buffer_mb > 0 ? (size_t) qd->overload_buffer_mb << 20 : 0;
+    core->overload_core_lag_msec = qd->overload_core_lag_msec > 0 ? qd->overload_core_lag_msec : 0;
+    DEQ_INIT(core->action_stats);
 
     core->work_lock = sys_mutex();
+    qdr_config_snapshot_setup(core);
+    core->stream_lock = sys_mutex();
+    core->link_route_lock = sys_mutex();
     DEQ_INIT(core->work_list);
     core->work_timer = qd_timer(core->qd, qdr_general_handler, core);
 
+    //
+    // Set up the per-server-thread delivery cleanup inboxes
+    //
+    core->cleanup_inbox_count = qd->thread_count > 0 ? qd->thread_count : 0;
+    if (core->cleanup_inbox_count > 0) {
+        core->cleanup_inbox = NEW_ARRAY(qdr_cleanup_inbox_t, core->cleanup_inbox_count);
+        for (int i = 0; i < core->cleanup_inbox_count; i++) {
+            ZERO(&core->cleanup_inbox[i]);
+            sys_atomic_ptr_init(&core->cleanup_inbox[i].head, 0);
+        }
+    }
+
     //
     // Set up the unique identifier generator
     //
@@ -100,20 +182,42 @@ void qdr_core_free(qdr_core_t *core)
     //
     // Stop and join the thread
     //
+    sys_mutex_lock(core->action_lock);
     core->running = false;
     sys_cond_signal(core->action_cond);
+    sys_mutex_unlock(core->action_lock);
     sys_thread_join(core->thread);
+    qdr_action_trace_free(core->action_trace);
+    core->action_trace = 0;
 
     // Drain the general work lists
     qdr_general_handler(core);
 
+    for (int i = 0; i < core->cleanup_inbox_count; i++) {
+        qdr_free_cleanup_chain((qdr_delivery_cleanup_t*) sys_atomic_ptr_swap(&core->cleanup_inbox[i].head, 0));
+        sys_atomic_ptr_destroy(&core->cleanup_inbox[i].head);
+    }
+    free(core->cleanup_inbox);
+    qdr_arena_free(&core->arena);
+
     //
     // Free the core resources
     //
     sys_thread_free(core->thread);
     sys_cond_free(core->action_cond);
     sys_mutex_free(core->action_lock);
+    sys_atomic_ptr_destroy(&core->action_stack);
+    sys_atomic_destroy(&core->action_sleeping);
+
+    qdr_action_stats_t *stats = DEQ_HEAD(core->action_stats);
+    while (stats) {
+        DEQ_REMOVE_HEAD(core->action_stats);
+        free(stats);
+        stats = DEQ_HEAD(core->action_stats);
+    }
     sys_mutex_free(core->work_lock);
+    sys_mutex_free(core->stream_lock);
+    sys_mutex_free(core->link_route_lock);
     sys_mutex_free(core->id_lock);
     qd_timer_free(core->work_timer);
 
@@ -128,6 +232,7 @@ void qdr_core_free(qdr_core_t *core)
             free(core->forwarders[i]);
         }
     }
+    qdr_forwarder_cleanup_CT(core);
 
     qdr_link_route_t *link_route = 0;
     while ( (link_route = DEQ_HEAD(core->link_routes))) {
@@ -147,10 +252,15 @@ void qdr_core_free(qdr_core_t *core)
     while ( (addr = DEQ_HEAD(core->addrs)) ) {
         qdr_core_remove_address(core, addr);
     }
+    qdr_core_timer_free_CT(core, core->addr_gc_timer);
+    qdr_core_timer_free_CT(core, core->credit_release_timer);
     qdr_address_config_t *addr_config = 0;
     while ( (addr_config = DEQ_HEAD(core->addr_config))) {
         qdr_core_remove_address_config(core, addr_config);
     }
+    qd_hash_free(core->addr_config_names);
+    qd_hash_free(core->auto_link_names);
+    qd_hash_free(core->link_route_names);
     qd_hash_free(core->addr_hash);
     qd_parse_tree_free(core->addr_parse_tree);
     qd_parse_tree_free(core->link_route_tree[QD_INCOMING]);
@@ -160,6 +270,7 @@ void qdr_core_free(qdr_core_t *core)
     while ( (rnode = DEQ_HEAD(core->routers)) ) {
         qdr_router_node_free(core, rnode);
     }
+    qdr_shared_mask_free_all_CT(core);
 
     qdr_link_t *link = DEQ_HEAD(core->open_links);
     while (link) {
@@ -167,11 +278,12 @@ void qdr_core_free(qdr_core_t *core)
         if (link->core_endpoint)
             qdrc_endpoint_do_cleanup_CT(core, link->core_endpoint);
         qdr_del_link_ref(&link->conn->links, link, QDR_LINK_LIST_CLASS_CONNECTION);
-        qdr_del_link_ref(&link->conn->links_with_work[link->priority], link, QDR_LINK_LIST_CLASS_WORK);
+        qdr_connection_unqueue_link(link->conn, link);
         free(link->name);
         free(link->disambiguated_name);
         free(link->terminus_addr);
         free(link->ingress_histogram);
+        free(link->latency);
         free(link->insert_prefix);
         free(link->strip_prefix);
         link->name = 0;
@@ -179,6 +291,11 @@ void qdr_core_free(qdr_core_t *core)
         link = DEQ_HEAD(core->open_links);
     }
 
+    //
+    // Connections whose teardown was cut short are freed with the open ones
+    //
+    DEQ_APPEND(core->open_connections, core->closing_connections);
+
     qdr_connection_t *conn = DEQ_HEAD(core->open_connections);
     while (conn) {
         DEQ_REMOVE_HEAD(core->open_connections);
@@ -188,11 +305,11 @@ void qdr_core_free(qdr_core_t *core)
             qdr_route_check_id_for_deletion_CT(core, conn->conn_id);
         }
 
-        qdr_connection_work_t *work = DEQ_HEAD(conn->work_list);
+        qdr_connection_work_t *work = (qdr_connection_work_t*) sys_atomic_ptr_swap(&conn->work_stack, 0);
         while (work) {
-            DEQ_REMOVE_HEAD(conn->work_list);
+            qdr_connection_work_t *next = work->next;
             qdr_connection_work_free_CT(work);
-            work = DEQ_HEAD(conn->work_list);
+            work = next;
         }
 
         qdr_connection_free(conn);
@@ -204,18 +321,24 @@ void qdr_core_free(qdr_core_t *core)
 
     qdr_modules_finalize(core);
 
+    qdr_management_agent_free_snapshots(core);
+    if (core->snapshot_lock)             sys_mutex_free(core->snapshot_lock);
     if (core->query_lock)                sys_mutex_free(core->query_lock);
+    qdr_config_snapshot_cleanup(core);
     if (core->routers_by_mask_bit)       free(core->routers_by_mask_bit);
     if (core->control_links_by_mask_bit) free(core->control_links_by_mask_bit);
     if (core->data_links_by_mask_bit)    free(core->data_links_by_mask_bit);
     if (core->neighbor_free_mask)        qd_bitmask_free(core->neighbor_free_mask);
 
+    qdr_intern_finalize();
     free(core);
 }
 
 void qdr_router_node_free(qdr_core_t *core, qdr_node_t *rnode)
 {
-    qd_bitmask_free(rnode->valid_origins);
+    qdr_shared_mask_release_CT(core, rnode->valid_origins);
+    if (rnode->equal_cost_hops)
+        qdr_shared_mask_release_CT(core, rnode->equal_cost_hops);
     DEQ_REMOVE(core->routers, rnode);
     core->routers_by_mask_bit[rnode->mask_bit] = 0;
     core->cost_epoch++;
@@ -320,12 +443,209 @@ qdr_action_t *qdr_action(qdr_action_handler_t action_handler, const char *label)
 }
 
 
+#define QDR_ACTION_BATCH_MAX 64
+
+//
+// Actions held by an I/O thread between qdr_action_batch_begin and qdr_action_batch_end.
+// The chain is linked through 'next' with the newest action at the top, the same
+// order used by the core's action stack.
+//
+static __thread struct {
+    qdr_core_t   *core;
+    qdr_action_t *top;
+    qdr_action_t *bottom;
+    int           count;
+} action_batch;
+
+
+static void qdr_action_push_chain(qdr_core_t *core, qdr_action_t *top, qdr_action_t *bottom)
+{
+    //
+    // Push the chain onto the lock-free stack.  The core thread takes the
+    // whole stack at once and restores FIFO order, so there is no ABA hazard.
+    //
+    qdr_action_t *head;
+    do {
+        head = (qdr_action_t*) sys_atomic_ptr_get(&core->action_stack);
+        bottom->next = head;
+    } while (!sys_atomic_ptr_cas(&core->action_stack, head, top));
+
+    //
+    // Only touch the lock and condition variable if the core thread is parked.
+    //
+    if (sys_atomic_get(&core->action_sleeping)) {
+        sys_mutex_lock(core->action_lock);
+        sys_cond_signal(core->action_cond);
+        sys_mutex_unlock(core->action_lock);
+    }
+}
+
+
+static void qdr_action_batch_flush(void)
+{
+    if (action_batch.top) {
+        qdr_action_push_chain(action_batch.core, action_batch.top, action_batch.bottom);
+        action_batch.top    = 0;
+        action_batch.bottom = 0;
+        action_batch.count  = 0;
+    }
+}
+
+
 void qdr_action_enqueue(qdr_core_t *core, qdr_action_t *action)
 {
-    sys_mutex_lock(core->action_lock);
-    DEQ_INSERT_TAIL(core->action_list, action);
-    sys_cond_signal(core->action_cond);
-    sys_mutex_unlock(core->action_lock);
+    if (core->action_stats_enabled)
+        action->enqueue_usec = qd_timer_now_usec();
+
+    if (action_batch.core == core) {
+        action->next = action_batch.top;
+        action_batch.top = action;
+        if (!action_batch.bottom)
+            action_batch.bottom = action;
+        if (++action_batch.count >= QDR_ACTION_BATCH_MAX)
+            qdr_action_batch_flush();
+        return;
+    }
+
+    qdr_action_push_chain(core, action, action);
+}
+
+
+bool qdr_action_batch_active(qdr_core_t *core)
+{
+    return action_batch.core == core;
+}
+
+
+//
+// Return the most recent action held in the calling thread's batch for this core, or
+// zero if there is none.  The caller may add work to it; nothing has been issued after
+// it and the core thread will not see it until the batch is flushed.
+//
+qdr_action_t *qdr_action_batch_top(qdr_core_t *core)
+{
+    return action_batch.core == core ? action_batch.top : 0;
+}
+
+
+void qdr_action_batch_begin(qdr_core_t *core)
+{
+    if (action_batch.core == core)
+        return;
+
+    qdr_action_batch_flush();
+    action_batch.core = core;
+}
+
+
+void qdr_action_batch_end(void)
+{
+    qdr_action_batch_flush();
+    action_batch.core = 0;
+}
+
+
+void qdr_delivery_cleanup_drain(qdr_core_t *core)
+{
+    int index = qd_server_thread_index();
+    if (index < 0 || index >= core->cleanup_inbox_count)
+        return;
+
+    qdr_cleanup_inbox_t *inbox = &core->cleanup_inbox[index];
+    if (sys_atomic_ptr_get(&inbox->head) == 0)
+        return;
+
+    qdr_free_cleanup_chain((qdr_delivery_cleanup_t*) sys_atomic_ptr_swap(&inbox->head, 0));
+}
+
+
+qd_bitmask_t *qdr_shared_mask_CT(qdr_core_t *core, qd_bitmask_t *mask)
+{
+    uint32_t           hash   = qd_bitmask_hash(mask);
+    qdr_shared_mask_list_t *bucket = &core->shared_masks[hash % QDR_SHARED_MASK_BUCKETS];
+
+    qdr_shared_mask_t *entry = DEQ_HEAD(*bucket);
+    while (entry) {
+        if (entry->hash == hash && qd_bitmask_equal(entry->mask, mask)) {
+            entry->ref_count++;
+            qd_bitmask_free(mask);
+            return entry->mask;
+        }
+        entry = DEQ_NEXT(entry);
+    }
+
+    entry = new_qdr_shared_mask_t();
+    DEQ_ITEM_INIT(entry);
+    entry->mask      = mask;
+    entry->hash      = hash;
+    entry->ref_count = 1;
+    DEQ_INSERT_HEAD(*bucket, entry);
+    return mask;
+}
+
+
+void qdr_shared_mask_release_CT(qdr_core_t *core, qd_bitmask_t *mask)
+{
+    uint32_t           hash   = qd_bitmask_hash(mask);
+    qdr_shared_mask_list_t *bucket = &core->shared_masks[hash % QDR_SHARED_MASK_BUCKETS];
+
+    qdr_shared_mask_t *entry = DEQ_HEAD(*bucket);
+    while (entry && entry->mask != mask)
+        entry = DEQ_NEXT(entry);
+
+    assert(entry);
+    if (entry && --entry->ref_count == 0) {
+        DEQ_REMOVE(*bucket, entry);
+        qd_bitmask_free(entry->mask);
+        free_qdr_shared_mask_t(entry);
+    }
+}
+
+
+static int qdr_address_rnodes_update_CT(qdr_core_t *core, qdr_address_t *addr, int router_maskbit, bool set)
+{
+    int old_value = qd_bitmask_value(addr->rnodes, router_maskbit);
+    if (old_value == (set ? 1 : 0))
+        return old_value;
+
+    qd_bitmask_t *mask = qd_bitmask(0);
+    qd_bitmask_copy(mask, addr->rnodes);
+    if (set)
+        qd_bitmask_set_bit(mask, router_maskbit);
+    else
+        qd_bitmask_clear_bit(mask, router_maskbit);
+
+    mask = qdr_shared_mask_CT(core, mask);
+    qdr_shared_mask_release_CT(core, addr->rnodes);
+    addr->rnodes = mask;
+    qdr_forward_select_CT(core, addr);
+    return old_value;
+}
+
+
+int qdr_address_rnodes_set_CT(qdr_core_t *core, qdr_address_t *addr, int router_maskbit)
+{
+    return qdr_address_rnodes_update_CT(core, addr, router_maskbit, true);
+}
+
+
+int qdr_address_rnodes_clear_CT(qdr_core_t *core, qdr_address_t *addr, int router_maskbit)
+{
+    return qdr_address_rnodes_update_CT(core, addr, router_maskbit, false);
+}
+
+
+void qdr_shared_mask_free_all_CT(qdr_core_t *core)
+{
+    for (int i = 0; i < QDR_SHARED_MASK_BUCKETS; i++) {
+        qdr_shared_mask_t *entry = DEQ_HEAD(core->shared_masks[i]);
+        while (entry) {
+            DEQ_REMOVE_HEAD(core->shared_masks[i]);
+            qd_bitmask_free(entry->mask);
+            free_qdr_shared_mask_t(entry);
+            entry = DEQ_HEAD(core->shared_masks[i]);
+        }
+    }
 }
 
 
@@ -338,7 +658,7 @@ qdr_address_t *qdr_address_CT(qdr_core_t *core, qd_address_treatment_t treatment
     addr->config    = config;
     addr->treatment = treatment;
     addr->forwarder = qdr_forwarder_CT(core, treatment);
-    addr->rnodes    = qd_bitmask(0);
+    addr->rnodes    = qdr_shared_mask_CT(core, qd_bitmask(0));
     addr->add_prefix = 0;
     addr->del_prefix = 0;
     addr->priority   = -1;
@@ -346,6 +666,7 @@ qdr_address_t *qdr_address_CT(qdr_core_t *core, qd_address_treatment_t treatment
     if (config)
         config->ref_count++;
 
+    qdr_forward_select_CT(core, addr);
     return addr;
 }
 
@@ -431,6 +752,8 @@ bool qdr_is_addr_treatment_multicast(qdr_address_t *addr)
 
 void qdr_core_delete_link_route(qdr_core_t *core, qdr_link_route_t *lr)
 {
+    qdr_config_name_remove_CT(core->link_route_names, &lr->name_handle);
+
     if (lr->conn_id) {
         DEQ_REMOVE_N(REF, lr->conn_id->link_route_refs, lr);
         qdr_route_check_id_for_deletion_CT(core, lr->conn_id);
@@ -451,7 +774,14 @@ void qdr_core_delete_link_route(qdr_core_t *core, qdr_link_route_t *lr)
 
 void qdr_core_delete_auto_link(qdr_core_t *core, qdr_auto_link_t *al)
 {
+    qdr_config_name_remove_CT(core->auto_link_names, &al->name_handle);
+
     if (al->conn_id) {
+        if (al->activate_pending) {
+            if (al->conn_id->activate_next == al)
+                al->conn_id->activate_next = DEQ_NEXT_N(REF, al);
+            core->auto_links_pending--;
+        }
         DEQ_REMOVE_N(REF, al->conn_id->auto_link_refs, al);
         qdr_route_check_id_for_deletion_CT(core, al->conn_id);
     }
@@ -480,7 +810,12 @@ void qdr_core_remove_address(qdr_core_t *core, qdr_address_t *addr)
         free_address_config(config);
 
     // Remove the address from the list, hash index, and parse tree
+    qdr_agent_object_removed_CT(core, addr, DEQ_NEXT(addr));
     DEQ_REMOVE(core->addrs, addr);
+    if (addr->in_gc_list)
+        DEQ_REMOVE_N(GC, core->addrs_gc, addr);
+    if (addr->in_credit_list)
+        DEQ_REMOVE_N(CREDIT, core->addrs_credit, addr);
     if (addr->hash_handle) {
         const char *a_str = (const char *)qd_hash_key_by_handle(addr->hash_handle);
         if (QDR_IS_LINK_ROUTE(a_str[0])) {
@@ -504,12 +839,17 @@ void qdr_core_remove_address(qdr_core_t *core, qdr_address_t *addr)
         lref = DEQ_HEAD(addr->rlinks);
     }
 
-    qd_bitmask_free(addr->rnodes);
+    qdr_shared_mask_release_CT(core, addr->rnodes);
+    if (addr->stats)
+        free(addr->stats->latency);
+    free_qdr_address_stats_t(addr->stats);
+    free(addr->edge_uplinks);
     if (addr->treatment == QD_TREATMENT_ANYCAST_CLOSEST) {
         qd_bitmask_free(addr->closest_remotes);
     }
     else if (addr->treatment == QD_TREATMENT_ANYCAST_BALANCED) {
         free(addr->outstanding_deliveries);
+        free(addr->settle_usec_ewma);
     }
 
     qdr_connection_ref_t *cr = DEQ_HEAD(addr->conns);
@@ -518,6 +858,14 @@ void qdr_core_remove_address(qdr_core_t *core, qdr_address_t *addr)
         cr = DEQ_HEAD(addr->conns);
     }
 
+    qdr_addr_flush_queue_CT(core, addr);
+
+    if (addr->mcast_plans) {
+        for (int i = 0; i < QDR_MCAST_PLAN_SLOTS; i++)
+            free(addr->mcast_plans[i].link_bits);
+        free(addr->mcast_plans);
+    }
+
     free(addr->add_prefix);
     free(addr->del_prefix);
     free_qdr_address_t(addr);
@@ -534,7 +882,12 @@ void qdr_core_bind_address_link_CT(qdr_core_t *core, qdr_address_t *addr, qdr_li
     if (link->link_direction == QD_OUTGOING) {
         qdr_add_link_ref(&addr->rlinks, link, QDR_LINK_LIST_CLASS_ADDRESS);
         if (DEQ_SIZE(addr->rlinks) == 1) {
-            if (key && (*key == QD_ITER_HASH_PREFIX_EDGE_SUMMARY || *key == QD_ITER_HASH_PREFIX_MOBILE))
+            //
+            // A destination back within the grace period was never withdrawn
+            //
+            if (addr->withdraw_pending)
+                addr->withdraw_pending = false;
+            else if (key && (*key == QD_ITER_HASH_PREFIX_EDGE_SUMMARY || *key == QD_ITER_HASH_PREFIX_MOBILE))
                 qdr_post_mobile_added_CT(core, key, addr->treatment);
             qdr_addr_start_inlinks_CT(core, addr);
             qdrc_event_addr_raise(core, QDRC_EVENT_ADDR_BECAME_LOCAL_DEST, addr);
@@ -558,8 +911,13 @@ void qdr_core_unbind_address_link_CT(qdr_core_t *core, qdr_address_t *addr, qdr_
         qdr_del_link_ref(&addr->rlinks, link, QDR_LINK_LIST_CLASS_ADDRESS);
         if (DEQ_SIZE(addr->rlinks) == 0) {
             const char *key = (const char*) qd_hash_key_by_handle(addr->hash_handle);
-            if (key && (*key == QD_ITER_HASH_PREFIX_MOBILE || *key == QD_ITER_HASH_PREFIX_EDGE_SUMMARY))
-                qdr_post_mobile_removed_CT(core, key);
+            if (key && (*key == QD_ITER_HASH_PREFIX_MOBILE || *key == QD_ITER_HASH_PREFIX_EDGE_SUMMARY)) {
+                if (core->addr_grace_period > 0) {
+                    addr->withdraw_pending = true;
+                    qdr_address_gc_defer_CT(core, addr);
+                } else
+                    qdr_post_mobile_removed_CT(core, key);
+            }
             qdrc_event_addr_raise(core, QDRC_EVENT_ADDR_NO_LONGER_LOCAL_DEST, addr);
         } else if (DEQ_SIZE(addr->rlinks) == 1 && qd_bitmask_cardinality(addr->rnodes) == 0)
             qdrc_event_addr_raise(core, QDRC_EVENT_ADDR_ONE_LOCAL_DEST, addr);
@@ -597,13 +955,46 @@ void qdr_core_unbind_address_conn_CT(qdr_core_t *core, qdr_address_t *addr, qdr_
 }
 
 
+void qdr_config_name_insert_CT(qd_hash_t *names, const char *name, void *entity, qd_hash_handle_t **handle)
+{
+    if (!name)
+        return;
+    qd_iterator_t key;
+    qd_iterator_init_string(&key, name, ITER_VIEW_ALL);
+    if (qd_hash_insert(names, &key, entity, handle) != QD_ERROR_NONE)
+        *handle = 0;  // A duplicate name stays findable by the first holder only
+    qd_iterator_fini(&key);
+}
+
+
+void qdr_config_name_remove_CT(qd_hash_t *names, qd_hash_handle_t **handle)
+{
+    if (*handle) {
+        qd_hash_remove_by_handle(names, *handle);
+        qd_hash_handle_free(*handle);
+        *handle = 0;
+    }
+}
+
+
+void *qdr_config_name_find_CT(qd_hash_t *names, qd_iterator_t *name)
+{
+    void *entity = 0;
+    if (name)
+        qd_hash_retrieve(names, name, &entity);
+    return entity;
+}
+
+
 void qdr_core_remove_address_config(qdr_core_t *core, qdr_address_config_t *addr)
 {
     qd_iterator_t *pattern = qd_iterator_string(addr->pattern, ITER_VIEW_ALL);
 
-    // Remove the address from the list and the parse tree
+    // Remove the address from the list, the name index and the parse tree
     DEQ_REMOVE(core->addr_config, addr);
+    qdr_config_name_remove_CT(core->addr_config_names, &addr->name_handle);
     qd_parse_tree_remove_pattern(core->addr_parse_tree, pattern);
+    qdr_config_snapshot_changed_CT(core);
     addr->ref_count--;
 
     if (addr->ref_count == 0)
@@ -755,6 +1146,18 @@ static void qdr_post_global_stats_response(qdr_core_t *core, qdr_general_work_t
     work->stats_handler(work->context);
 }
 
+// Convert the settle histogram to the cumulative power-of-two buckets of the metrics
+static void qdr_latency_metric_buckets(const qdr_latency_stats_t *latency, uint64_t *buckets)
+{
+    uint64_t cumulative = 0;
+    int      bucket     = 0;
+    for (int i = 0; i < QDR_LATENCY_METRIC_BUCKETS; i++) {
+        while (bucket < QDR_ACTION_HIST_BUCKETS - 1 && qdr_action_hist_upper(bucket) <= ((uint64_t) 1 << i))
+            cumulative += latency->settle_histogram[bucket++];
+        buckets[i] = cumulative;
+    }
+}
+
 static void qdr_global_stats_request_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
 {
     qdr_global_stats_t *stats = action->args.stats_request.stats;
@@ -764,17 +1167,26 @@ static void qdr_global_stats_request_CT(qdr_core_t *core, qdr_action_t *action,
     stats->connections = DEQ_SIZE(core->open_connections);
     stats->link_routes = DEQ_SIZE(core->link_routes);
     stats->auto_links = DEQ_SIZE(core->auto_links);
-    stats->presettled_deliveries = core->presettled_deliveries;
+    qdr_delivery_counters_t settled;
+    qdr_delivery_counters_total_CT(core, &settled);
+    stats->presettled_deliveries = settled.presettled;
     stats->dropped_presettled_deliveries = core->dropped_presettled_deliveries;
-    stats->accepted_deliveries = core->accepted_deliveries;
-    stats->rejected_deliveries = core->rejected_deliveries;
-    stats->released_deliveries = core->released_deliveries;
-    stats->modified_deliveries = core->modified_deliveries;
+    stats->accepted_deliveries = settled.accepted;
+    stats->rejected_deliveries = settled.rejected;
+    stats->released_deliveries = settled.released;
+    stats->modified_deliveries = settled.modified;
     stats->deliveries_ingress = core->deliveries_ingress;
     stats->deliveries_egress = core->deliveries_egress;
     stats->deliveries_transit = core->deliveries_transit;
     stats->deliveries_ingress_route_container = core->deliveries_ingress_route_container;
     stats->deliveries_egress_route_container = core->deliveries_egress_route_container;
+    stats->overload_level = core->overload_level;
+    stats->credit_withheld = core->credit_withheld;
+
+    const qdr_latency_stats_t *latency = &core->delivery_latency;
+    stats->delivery_latency_count    = latency->count;
+    stats->delivery_latency_usec_sum = latency->settle_usec_total;
+    qdr_latency_metric_buckets(latency, stats->delivery_latency_buckets);
 
     qdr_general_work_t *work = qdr_general_work(qdr_post_global_stats_response);
     work->stats_handler = action->args.stats_request.handler;
@@ -785,9 +1197,159 @@ static void qdr_global_stats_request_CT(qdr_core_t *core, qdr_action_t *action,
 void qdr_request_global_stats(qdr_core_t *core, qdr_global_stats_t *stats, qdr_global_stats_handler_t callback, void *context)
 {
     qdr_action_t *action = qdr_action(qdr_global_stats_request_CT, "global_stats_request");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
     action->args.stats_request.stats = stats;
     action->args.stats_request.handler = callback;
     action->args.stats_request.context = context;
     qdr_action_enqueue(core, action);
 }
 
+
+extern const char *qdr_connection_roles[];
+
+static void qdr_entity_metrics_latency(qdr_entity_metrics_t *row, const qdr_latency_stats_t *latency)
+{
+    row->has_latency = !!latency;
+    if (latency) {
+        row->latency_count    = latency->count;
+        row->latency_usec_sum = latency->settle_usec_total;
+        qdr_latency_metric_buckets(latency, row->latency_buckets);
+    }
+}
+
+
+static void qdr_entity_metrics_row_CT(qdr_entity_metrics_type_t type, void *object, qdr_entity_metrics_t *row)
+{
+    ZERO(row);
+
+    switch (type) {
+    case QDR_ENTITY_METRICS_ADDRESS: {
+        qdr_address_t *addr = (qdr_address_t*) object;
+        if (addr->hash_handle)
+            snprintf(row->name, sizeof(row->name), "%s", (const char*) qd_hash_key_by_handle(addr->hash_handle));
+        if (addr->stats) {
+            row->counters[0] = addr->stats->deliveries_ingress;
+            row->counters[1] = addr->stats->deliveries_egress;
+            row->counters[2] = addr->stats->deliveries_transit;
+            row->counters[3] = addr->stats->deliveries_to_container;
+            row->counters[4] = addr->stats->deliveries_from_container;
+            qdr_entity_metrics_latency(row, addr->stats->latency);
+        }
+        break;
+    }
+
+    case QDR_ENTITY_METRICS_LINK: {
+        qdr_link_t *link = (qdr_link_t*) object;
+        row->identity = link->identity;
+        row->kind     = link->link_direction == QD_INCOMING ? "in" : "out";
+        if (link->owning_addr && link->owning_addr->hash_handle)
+            snprintf(row->name, sizeof(row->name), "%s", (const char*) qd_hash_key_by_handle(link->owning_addr->hash_handle));
+        else if (link->terminus_addr)
+            snprintf(row->name, sizeof(row->name), "%s", link->terminus_addr);
+        row->counters[0] = link->total_deliveries + __atomic_load_n(&link->direct_deliveries, __ATOMIC_RELAXED);
+        row->counters[1] = DEQ_SIZE(link->undelivered);
+        row->counters[2] = DEQ_SIZE(link->unsettled);
+        row->counters[3] = link->presettled_deliveries;
+        row->counters[4] = link->dropped_presettled_deliveries;
+        row->counters[5] = link->accepted_deliveries;
+        row->counters[6] = link->rejected_deliveries;
+        row->counters[7] = link->released_deliveries;
+        row->counters[8] = link->modified_deliveries;
+        qdr_entity_metrics_latency(row, link->latency);
+        break;
+    }
+
+    case QDR_ENTITY_METRICS_CONNECTION: {
+        qdr_connection_t *conn = (qdr_connection_t*) object;
+        row->identity = conn->identity;
+        if (conn->connection_info) {
+            row->kind = qdr_connection_roles[conn->connection_info->role];
+            if (conn->connection_info->host)
+                snprintf(row->name, sizeof(row->name), "%s", conn->connection_info->host);
+        }
+        row->counters[0] = DEQ_SIZE(conn->links);
+        for (int priority = 0; priority < QDR_N_PRIORITIES; priority++) {
+            row->counters[1] += conn->priority_deliveries[priority];
+            row->counters[2] += conn->priority_bytes[priority];
+        }
+        break;
+    }
+    }
+}
+
+
+static void *qdr_entity_metrics_next(qdr_entity_metrics_type_t type, void *object)
+{
+    switch (type) {
+    case QDR_ENTITY_METRICS_ADDRESS:    return DEQ_NEXT((qdr_address_t*) object);
+    case QDR_ENTITY_METRICS_LINK:       return DEQ_NEXT((qdr_link_t*) object);
+    case QDR_ENTITY_METRICS_CONNECTION: return DEQ_NEXT((qdr_connection_t*) object);
+    }
+    return 0;
+}
+
+
+static void *qdr_entity_metrics_seek_CT(qdr_core_t *core, qdr_entity_metrics_type_t type, int offset)
+{
+    void *object = 0;
+    switch (type) {
+    case QDR_ENTITY_METRICS_ADDRESS:    object = DEQ_HEAD(core->addrs);            break;
+    case QDR_ENTITY_METRICS_LINK:       object = DEQ_HEAD(core->open_links);       break;
+    case QDR_ENTITY_METRICS_CONNECTION: object = DEQ_HEAD(core->open_connections); break;
+    }
+    for (int i = 0; i < offset && object; i++)
+        object = qdr_entity_metrics_next(type, object);
+    return object;
+}
+
+
+static void qdr_entity_metrics_request_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    static const qd_router_entity_type_t entity_types[] = {QD_ROUTER_ADDRESS, QD_ROUTER_LINK, QD_ROUTER_CONNECTION};
+    qdr_entity_metrics_batch_t *batch = action->args.stats_request.batch;
+    void                       *object;
+
+    //
+    // The cursor follows the listing between batches, as it does for agent queries.
+    //
+    if (!batch->cursor) {
+        batch->cursor = qdr_query(core, 0, entity_types[batch->type], 0, 0);
+        object = qdr_entity_metrics_seek_CT(core, batch->type, 0);
+    } else {
+        object = qdr_agent_cursor_CT(core, batch->cursor);
+        if (!object)
+            object = qdr_entity_metrics_seek_CT(core, batch->type, batch->cursor->next_offset);
+    }
+
+    batch->count = 0;
+    while (object && batch->count < QDR_ENTITY_METRICS_BATCH && batch->total < core->metrics_series_limit) {
+        qdr_entity_metrics_row_CT(batch->type, object, &batch->rows[batch->count++]);
+        batch->total++;
+        batch->cursor->next_offset++;
+        object = qdr_entity_metrics_next(batch->type, object);
+    }
+
+    batch->more = object && batch->total < core->metrics_series_limit;
+    qdr_agent_set_cursor_CT(core, batch->cursor, batch->more ? object : 0);
+    if (!batch->more) {
+        qdr_query_free(batch->cursor);
+        batch->cursor = 0;
+    }
+
+    qdr_general_work_t *work = qdr_general_work(qdr_post_global_stats_response);
+    work->stats_handler = action->args.stats_request.handler;
+    work->context = action->args.stats_request.context;
+    qdr_post_general_work_CT(core, work);
+}
+
+
+void qdr_request_entity_metrics(qdr_core_t *core, qdr_entity_metrics_batch_t *batch, qdr_global_stats_handler_t callback, void *context)
+{
+    qdr_action_t *action = qdr_action(qdr_entity_metrics_request_CT, "entity_metrics_request");
+    action->action_class = QDR_ACTION_CLASS_MANAGEMENT;
+    action->args.stats_request.batch = batch;
+    action->args.stats_request.handler = callback;
+    action->args.stats_request.context = context;
+    qdr_action_enqueue(core, action);
+}
+
@@ -21,10 +21,13 @@
 
 #include "dispatch_private.h"
 #include "message_private.h"
+#include "iterator_private.h"
+#include "timer_wheel_private.h"
 #include <qpid/dispatch/router_core.h>
 #include <qpid/dispatch/threading.h>
 #include <qpid/dispatch/atomic.h>
 #include <qpid/dispatch/log.h>
+#include <qpid/dispatch/timer.h>
 #include <memory.h>
 
 typedef struct qdr_address_t         qdr_address_t;
@@ -44,8 +47,16 @@ typedef struct qdr_edge_t            qdr_edge_t;
 #include "core_link_endpoint.h"
 #include "core_events.h"
 #include "core_attach_address_lookup.h"
+#include "action_trace.h"
+#include "interned.h"
 
 qdr_forwarder_t *qdr_forwarder_CT(qdr_core_t *core, qd_address_treatment_t treatment);
+/**
+ * Choose how messages to the address are forwarded, a variant of its forwarder's
+ * without the checks for destinations it lacks.  Called when the address's
+ * forwarder, remote routers or in-process subscribers change.
+ */
+void qdr_forward_select_CT(qdr_core_t *core, qdr_address_t *addr);
 int qdr_forward_message_CT(qdr_core_t *core, qdr_address_t *addr, qd_message_t *msg, qdr_delivery_t *in_delivery,
                            bool exclude_inprocess, bool control);
 bool qdr_forward_attach_CT(qdr_core_t *core, qdr_address_t *addr, qdr_link_t *in_link, qdr_terminus_t *source,
@@ -89,10 +100,42 @@ char *qdr_field_copy(qdr_field_t *field);
 typedef struct qdr_action_t qdr_action_t;
 typedef void (*qdr_action_handler_t) (qdr_core_t *core, qdr_action_t *action, bool discard);
 
+/**
+ * qdr_action_class_t - Scheduling class of an action.  The core thread keeps a queue per
+ *                      class and serves them in weighted round-robin order, except for the
+ *                      router-control link class which is drained before each round so that
+ *                      hellos are not held up behind a data backlog.  Actions within a class
+ *                      are always run in the order they were enqueued.
+ */
+typedef enum {
+    QDR_ACTION_CLASS_DATA = 0,    ///< Connections, links, deliveries, dispositions (default)
+    QDR_ACTION_CLASS_CONTROL,     ///< Topology, route tables, subscriptions, router protocol
+    QDR_ACTION_CLASS_MANAGEMENT,  ///< Management agent requests
+    QDR_ACTION_CLASS_CONTROL_LINK,///< Deliveries and flow on router-control links, run ahead of every round
+    QDR_ACTION_CLASSES
+} qdr_action_class_t;
+
+//
+// A run of consecutive disposition updates from one link that share an outcome.
+// The deliveries are first .. first + count - 1 of the owning action's array.
+//
+typedef struct {
+    qdr_link_t  *link;
+    uint64_t     disposition;
+    qdr_error_t *error;
+    bool         settled;
+    int          first;
+    int          count;
+} qdr_disposition_range_t;
+
+DEQ_DECLARE(qdr_action_t, qdr_action_list_t);
+
 struct qdr_action_t {
     DEQ_LINKS(qdr_action_t);
     qdr_action_handler_t  action_handler;
     const char           *label;
+    qdr_action_class_t    action_class;
+    int64_t               enqueue_usec;   ///< Set only when action statistics are enabled
     union {
         //
         // Arguments for router control-plane actions
@@ -105,6 +148,7 @@ struct qdr_action_t {
             int           treatment_hint;
             qd_bitmask_t *router_set;
             qdr_field_t  *address;
+            qdr_action_list_t batch;  ///< The updates of a route table transaction
         } route_table;
 
         //
@@ -139,6 +183,19 @@ struct qdr_action_t {
             qdr_error_t    *error;
         } delivery;
 
+        //
+        // Arguments for a vector of delivery state updates from one connection
+        //
+        struct {
+            qdr_connection_t        *conn;
+            qdr_disposition_range_t *ranges;
+            qdr_delivery_t         **deliveries;
+            int                      range_count;
+            int                      range_capacity;
+            int                      count;
+            int                      capacity;
+        } dispositions;
+
         //
         // Arguments for in-process messaging
         //
@@ -163,6 +220,7 @@ struct qdr_action_t {
             qdr_field_t             *name;
             qd_parsed_field_t       *in_body;
             qd_buffer_list_t         body_buffers;
+            bool                     edges;     ///< Summary merged across the edges
         } agent;
 
         //
@@ -170,6 +228,7 @@ struct qdr_action_t {
         //
         struct {
             qdr_global_stats_t             *stats;
+            qdr_entity_metrics_batch_t     *batch;
             qdr_global_stats_handler_t     handler;
             void                           *context;
         } stats_request;
@@ -188,7 +247,108 @@ struct qdr_action_t {
 };
 
 ALLOC_DECLARE(qdr_action_t);
-DEQ_DECLARE(qdr_action_t, qdr_action_list_t);
+
+//
+// Latency statistics kept by the core thread for each distinct action label.
+//
+// The histograms are log-linear in microseconds:  buckets 0-3 count values 0-3,
+// after which each power-of-two range is split into QDR_ACTION_HIST_SUB equal
+// buckets.  The last bucket also counts everything beyond it.
+//
+#define QDR_ACTION_HIST_SUB      4
+#define QDR_ACTION_HIST_BUCKETS  96
+#define QDR_ACTION_STATS_SLOTS   128
+
+typedef struct qdr_action_stats_t qdr_action_stats_t;
+
+struct qdr_action_stats_t {
+    DEQ_LINKS(qdr_action_stats_t);
+    const char *label;
+    uint64_t    count;
+    uint64_t    queue_usec_total;
+    uint64_t    queue_usec_max;
+    uint64_t    service_usec_total;
+    uint64_t    service_usec_max;
+    uint64_t    queue_histogram[QDR_ACTION_HIST_BUCKETS];
+    uint64_t    service_histogram[QDR_ACTION_HIST_BUCKETS];
+};
+
+DEQ_DECLARE(qdr_action_stats_t, qdr_action_stats_list_t);
+
+static inline int qdr_action_hist_bucket(uint64_t usec)
+{
+    if (usec < QDR_ACTION_HIST_SUB)
+        return (int) usec;
+
+    int msb    = 63 - __builtin_clzll(usec);
+    int bucket = (msb - 1) * QDR_ACTION_HIST_SUB + (int) ((usec >> (msb - 2)) & (QDR_ACTION_HIST_SUB - 1));
+    return bucket < QDR_ACTION_HIST_BUCKETS ? bucket : QDR_ACTION_HIST_BUCKETS - 1;
+}
+
+/// Exclusive upper bound, in microseconds, of the values counted in a histogram bucket
+static inline uint64_t qdr_action_hist_upper(int bucket)
+{
+    if (bucket < QDR_ACTION_HIST_SUB)
+        return (uint64_t) bucket + 1;
+    int msb = bucket / QDR_ACTION_HIST_SUB + 1;
+    return (uint64_t) (QDR_ACTION_HIST_SUB + bucket % QDR_ACTION_HIST_SUB + 1) << (msb - 2);
+}
+
+//
+// The stages of a delivery's time in the router, which add up to its settlement
+// latency.
+//
+typedef enum {
+    QDR_LATENCY_STAGE_INGRESS,     ///< Handed to the core by the I/O thread, to taken up by the core thread
+    QDR_LATENCY_STAGE_CORE,        ///< Taken up by the core, to queued on the outgoing link
+    QDR_LATENCY_STAGE_EGRESS,      ///< Queued on the outgoing link, to first transmission
+    QDR_LATENCY_STAGE_DOWNSTREAM,  ///< First transmission, to settlement by the receiver
+    QDR_LATENCY_STAGES
+} qdr_latency_stage_t;
+
+//
+// End-to-end latency of unsettled deliveries leaving the router, measured from
+// the arrival of the incoming delivery.  Kept by the core thread per outgoing
+// link, per address and for the whole router, using the action histogram
+// buckets.  Allocated on first use.
+//
+typedef struct qdr_latency_stats_t {
+    uint64_t count;
+    uint64_t settle_usec_total;
+    uint64_t settle_usec_max;
+    uint64_t send_histogram[QDR_ACTION_HIST_BUCKETS];    ///< Arrival to first transmission
+    uint64_t settle_histogram[QDR_ACTION_HIST_BUCKETS];  ///< Arrival to settlement
+    uint64_t stage_usec_total[QDR_LATENCY_STAGES];
+    uint64_t stage_usec_max[QDR_LATENCY_STAGES];
+    uint64_t stage_histogram[QDR_LATENCY_STAGES][QDR_ACTION_HIST_BUCKETS];
+} qdr_latency_stats_t;
+
+static inline void qdr_latency_record(qdr_latency_stats_t *stats, uint64_t send_usec, uint64_t settle_usec,
+                                      const uint64_t *stage_usec)
+{
+    stats->count++;
+    stats->settle_usec_total += settle_usec;
+    if (settle_usec > stats->settle_usec_max)
+        stats->settle_usec_max = settle_usec;
+    stats->send_histogram[qdr_action_hist_bucket(send_usec)]++;
+    stats->settle_histogram[qdr_action_hist_bucket(settle_usec)]++;
+    for (int i = 0; i < QDR_LATENCY_STAGES; i++) {
+        stats->stage_usec_total[i] += stage_usec[i];
+        if (stage_usec[i] > stats->stage_usec_max[i])
+            stats->stage_usec_max[i] = stage_usec[i];
+        stats->stage_histogram[i][qdr_action_hist_bucket(stage_usec[i])]++;
+    }
+}
+
+static inline void qdr_latency_record_ptr(qdr_latency_stats_t **stats, uint64_t send_usec, uint64_t settle_usec,
+                                          const uint64_t *stage_usec)
+{
+    if (!*stats) {
+        *stats = NEW(qdr_latency_stats_t);
+        ZERO(*stats);
+    }
+    qdr_latency_record(*stats, send_usec, settle_usec, stage_usec);
+}
 
 //
 //
@@ -199,11 +359,62 @@ struct qdr_delivery_cleanup_t {
     DEQ_LINKS(qdr_delivery_cleanup_t);
     qd_message_t  *msg;
     qd_iterator_t *iter;
+    int            owner_thread;  ///< Server thread that received the message, -1 if none
 };
 
 ALLOC_DECLARE(qdr_delivery_cleanup_t);
 DEQ_DECLARE(qdr_delivery_cleanup_t, qdr_delivery_cleanup_list_t);
 
+//
+// Per-server-thread inbox of delivery cleanups.  Message buffers are returned to the
+// allocation pool of the thread that received them so they stay in that thread's
+// local free list.  The core pushes chains (linked through 'next'), the owning thread
+// swaps the whole chain out after each event batch.
+//
+typedef struct qdr_cleanup_inbox_t {
+    sys_atomic_ptr_t        head;
+    qdr_delivery_cleanup_t *pending_top;     ///< Core thread only: chain not yet pushed
+    qdr_delivery_cleanup_t *pending_bottom;
+    int64_t                 first_push_usec; ///< Core thread only: when the inbox became non-empty
+} qdr_cleanup_inbox_t;
+
+//
+// Per-pass arena.  Objects that do not outlive the current pass of the core thread's
+// main loop may be bump-allocated from the arena instead of their allocation pools.
+// The arena is reset in one step at the end of each pass; its objects are never freed
+// individually and must not be referenced after the pass.  Blocks are kept across
+// passes, so a steady load allocates no memory.
+//
+typedef struct qdr_arena_block_t qdr_arena_block_t;
+
+struct qdr_arena_block_t {
+    qdr_arena_block_t *next;
+    size_t             size;  ///< Usable bytes following the header
+    size_t             used;
+};
+
+typedef struct {
+    qdr_arena_block_t *head;
+    qdr_arena_block_t *current;
+} qdr_arena_t;
+
+void *qdr_arena_alloc_CT(qdr_core_t *core, size_t size);
+void  qdr_arena_reset_CT(qdr_core_t *core);
+void  qdr_arena_free(qdr_arena_t *arena);
+
+#define QDR_ARENA_NEW(core,T) ((T*) qdr_arena_alloc_CT((core), sizeof(T)))
+
+//
+// An inbox that its thread has not drained for this long is handed to general
+// work instead, so an idle thread cannot hold on to freed messages.
+//
+#define QDR_CLEANUP_STEAL_USEC 10000
+
+//
+// Fixed-point one for the core's spin hit rate (see qdr_spin_for_actions_CT).
+//
+#define QDR_SPIN_RATE_ONE 1024
+
 //
 // General Work
 //
@@ -310,6 +521,13 @@ DEQ_DECLARE(qdr_link_work_t, qdr_link_work_list_t);
 
 #define QDR_AGENT_MAX_COLUMNS 64
 #define QDR_AGENT_COLUMN_NULL (QDR_AGENT_MAX_COLUMNS + 1)
+#define QDR_AGENT_MAX_FILTERS 8
+#define QDR_AGENT_CURSORS     16
+
+typedef struct qdr_query_filter_t {
+    int   column;   ///< Column of the attribute, -1 if unknown (matches nothing)
+    char *value;    ///< Canonical text of the value, see qdr_agent_field_text
+} qdr_query_filter_t;
 
 struct qdr_query_t {
     DEQ_LINKS(qdr_query_t);
@@ -323,10 +541,31 @@ struct qdr_query_t {
     bool                     more;
     qd_amqp_error_t          status;
     uint64_t                 in_conn;  // or perhaps a pointer???
+    qdr_query_filter_t       filters[QDR_AGENT_MAX_FILTERS];
+    int                      filter_count;
+    qdr_query_t             *bulk;     ///< The bulk request this query is one entity of, 0 if none
 };
 
+//
+// Position of a query in an entity list, kept by the core between get-next
+// calls and between successive pages of the same listing.  The query pointer
+// is only compared, the query may have been freed by the time a later page
+// picks the cursor up.
+//
+typedef struct qdr_agent_cursor_t {
+    qdr_query_t             *query;
+    qd_router_entity_type_t  entity_type;
+    int                      offset;    ///< Index of object in the listing
+    void                    *object;    ///< Next object of the listing, 0 if the slot is free
+    bool                     filtered;
+    uint64_t                 stamp;     ///< For least-recently-used replacement
+} qdr_agent_cursor_t;
+
 DEQ_DECLARE(qdr_query_t, qdr_query_list_t); 
 
+typedef struct qdr_agent_snapshot_t qdr_agent_snapshot_t;  ///< See management_agent.c
+DEQ_DECLARE(qdr_agent_snapshot_t, qdr_agent_snapshot_list_t);
+
 struct qdr_node_t {
     DEQ_LINKS(qdr_node_t);
     qdr_address_t    *owning_addr;
@@ -334,7 +573,8 @@ struct qdr_node_t {
     qdr_node_t       *next_hop;           ///< Next hop node _if_ this is not a neighbor node
     int               link_mask_bit;      ///< Mask bit of inter-router connection if this is a neighbor node
     uint32_t          ref_count;
-    qd_bitmask_t     *valid_origins;
+    qd_bitmask_t     *valid_origins;   ///< [shared] interned, read-only
+    qd_bitmask_t     *equal_cost_hops; ///< [shared] Neighbors on equal-cost paths, 0 unless more than one
     int               cost;
 };
 
@@ -344,6 +584,7 @@ void qdr_router_node_free(qdr_core_t *core, qdr_node_t *rnode);
 
 #define PEER_CONTROL_LINK(c,n) ((n->link_mask_bit >= 0) ? (c)->control_links_by_mask_bit[n->link_mask_bit] : 0)
 // PEER_DATA_LINK has gotten more complex with prioritized links, and is now a function, peer_data_link().
+// Striping across inter-router-data connections is done by qdr_peer_stripe_link_CT().
 
 
 
@@ -370,6 +611,35 @@ typedef struct qdr_delivery_ref_t {
 ALLOC_DECLARE(qdr_delivery_ref_t);
 DEQ_DECLARE(qdr_delivery_ref_t, qdr_delivery_ref_list_t);
 
+//
+// The most deliveries qdr_link_process_deliveries takes off an outgoing link's
+// undelivered list per visit to the connection's work_lock
+//
+#define QDR_LINK_DELIVERY_BATCH 32
+
+//
+// How an unsettled delivery to a multicast address is settled.  With presettle
+// the router accepts it and forwards pre-settled copies; the other modes
+// forward unsettled copies and settle the delivery once the consumers'
+// outcomes decide it.
+//
+typedef enum {
+    QDR_MCAST_SETTLE_PRESETTLE,    ///< Accepted by the router on forwarding
+    QDR_MCAST_SETTLE_FIRST_ACCEPT, ///< Accepted when one consumer accepts
+    QDR_MCAST_SETTLE_ALL_ACCEPT,   ///< Accepted when every consumer accepts
+    QDR_MCAST_SETTLE_MAJORITY,     ///< Accepted when more than half the consumers accept
+    QDR_MCAST_SETTLE_MODES
+} qdr_mcast_settlement_t;
+
+//
+// An outgoing peer of a delivery whose message is still arriving.  The receiving
+// I/O thread wakes these directly as more of the message comes in.
+//
+typedef struct qdr_stream_peer_t {
+    qdr_delivery_t *dlv;
+    qdr_link_t     *link;
+} qdr_stream_peer_t;
+
 struct qdr_subscription_t {
     DEQ_LINKS(qdr_subscription_t);
     qdr_core_t    *core;
@@ -382,33 +652,63 @@ DEQ_DECLARE(qdr_subscription_t, qdr_subscription_list_t);
 
 
 struct qdr_delivery_t {
+    //
+    // Fields written by I/O threads as well as by the core.  The reference count is
+    // changed from both sides, and the connection's I/O thread moves the delivery
+    // between its link's lists and sets the context, tag and disposition.  These are
+    // kept together, clear of the core-only fields below.
+    //
     DEQ_LINKS(qdr_delivery_t);
-    void                   *context;
     sys_atomic_t            ref_count;
     bool                    ref_counted;   /// Used to protect against ref count going 1 -> 0 -> 1
+    bool                    settled;
+    bool                    presettled;
+    qdr_delivery_where_t    where;
+    void                   *context;
+    uint64_t                disposition;
+    qdr_error_t            *error;
+    pn_data_t              *extension_state;
+    qdr_link_work_t        *link_work;         ///< Delivery work item for this delivery
     qdr_link_t             *link;
-    qdr_delivery_t         *peer;          /// Use this peer if the delivery has one and only one peer.
-    qdr_delivery_ref_t     *next_peer_ref;
     qd_message_t           *msg;
+    int                     owner_thread;      ///< Server thread that received the message, -1 if none
+    int                     tag_length;
+    uint8_t                 tag[32];
+    qdr_stream_peer_t      *stream_peers;      ///< Peers to wake while the message streams in, under core->stream_lock
+    int                     stream_peer_count;
+    int                     stream_peer_capacity;
+    int64_t                 ingress_usec;      ///< When the incoming delivery arrived, 0 if not timed
+    int64_t                 send_usec;         ///< When this outgoing delivery was first transmitted
+    bool                    expired;           ///< Dropped or released because its message expired
+
+    //
+    // Fields used only by the core thread, starting on their own cache line.
+    //
+    qdr_delivery_t         *peer __attribute__((aligned(64)));  /// Use this peer if the delivery has one and only one peer.
+    int                     next_peer_index;   /// Cursor of qdr_delivery_next_peer_CT in peers
     qd_iterator_t          *to_addr;
     qd_iterator_t          *origin;
-    uint64_t                disposition;
     uint32_t                ingress_time;
-    pn_data_t              *extension_state;
-    qdr_error_t            *error;
-    bool                    settled;
-    bool                    presettled;
-    qdr_delivery_where_t    where;
-    uint8_t                 tag[32];
-    int                     tag_length;
+    int64_t                 forward_usec;      /// When latency-aware balanced forwarding sent it, else 0
+    int64_t                 core_usec;         /// When the core took up the incoming delivery, 0 if not timed
+    int64_t                 queued_usec;       /// When the core queued this outgoing delivery, 0 if not timed
+    int64_t                 credit_usec;       /// When it arrived on an adaptive-credit link, else 0
+    char                   *conflation_key;    /// Group-id of a pre-settled delivery on a conflating link
     qd_bitmask_t           *link_exclusion;
     qdr_address_t          *tracking_addr;
     int                     tracking_addr_bit;
     int                     ingress_index;
-    qdr_link_work_t        *link_work;         ///< Delivery work item for this delivery
     qdr_subscription_list_t subscriptions;
-    qdr_delivery_ref_list_t peers;             /// Use this list if there if the delivery has more than one peer.
+    qdr_delivery_t        **peers;             /// Use this array if the delivery has more than one peer.
+    int                     peer_count;
+    int                     peer_capacity;
+    int                     peer_slot;         /// Index of this delivery in its peer's peers array
     bool                    multicast;         /// True if this delivery is targeted for a multicast address.
+    qdr_mcast_settlement_t  mcast_settlement;  /// How an unsettled multicast in-delivery is settled
+    uint8_t                 priority;          /// Its place on a priority-ordered undelivered list
+    uint32_t                mcast_fanout;      /// Consumers whose outcomes settle it
+    uint32_t                mcast_accepted;
+    uint32_t                mcast_failed;
     bool                    via_edge;          /// True if this delivery arrived via an edge-connection.
 };
 
@@ -416,6 +716,21 @@ ALLOC_DECLARE(qdr_delivery_t);
 DEQ_DECLARE(qdr_delivery_t, qdr_delivery_list_t);
 
 
+//
+// True if the delivery's message has fully arrived and its ttl or
+// absolute-expiry-time has passed.  The expiry is decoded once per message,
+// first by the core when it forwards the incoming delivery, so the check costs
+// a clock read only for messages that expire at all.
+//
+static inline bool qdr_delivery_expired(qdr_delivery_t *dlv)
+{
+    if (!dlv->msg || !qd_message_receive_complete(dlv->msg))
+        return false;
+    int64_t expiry = qd_message_expiry(dlv->msg);
+    return expiry && expiry <= qd_timer_now();
+}
+
+
 void qdr_add_delivery_ref_CT(qdr_delivery_ref_list_t *list, qdr_delivery_t *dlv);
 void qdr_del_delivery_ref(qdr_delivery_ref_list_t *list, qdr_delivery_ref_t *ref);
 
@@ -435,7 +750,9 @@ typedef enum {
 #define QDR_LINK_RATE_DEPTH 5
 
 struct qdr_link_t {
-    DEQ_LINKS(qdr_link_t);
+    //
+    // Set up when the link is created and read from every thread.
+    //
     qdr_core_t              *core;
     uint64_t                 identity;
     void                    *user_context;
@@ -443,58 +760,95 @@ struct qdr_link_t {
     qdr_connection_t        *conn;               ///< [ref] Connection that owns this link
     qd_link_type_t           link_type;
     qd_direction_t           link_direction;
-    qdr_link_work_list_t     work_list;
     char                    *name;
     char                    *disambiguated_name;
     char                    *terminus_addr;
+    char                    *strip_prefix;
+    char                    *insert_prefix;
+    bool                     strip_annotations_in;
+    bool                     strip_annotations_out;
+    bool                     edge;              ///< True if this link is in an edge-connection
+    bool                     terminus_survives_disconnect;
+    uint8_t                  priority;
+
+    //
+    // Shared with the connection's I/O thread, mostly under the connection's work_lock.
+    //
+    qdr_link_work_list_t     work_list __attribute__((aligned(64)));
+    qdr_delivery_list_t      undelivered;        ///< Deliveries to be forwarded or sent
+    qdr_delivery_list_t      unsettled;          ///< Unsettled deliveries
+    qdr_delivery_list_t      settled;            ///< Settled deliveries
+    qdr_delivery_ref_list_t  updated_deliveries; ///< References to deliveries (in the unsettled list) with updates.
+    int                      credit_to_core; ///< Number of the available credits incrementally given to the core
+    int                      credit_available;  ///< Outgoing: credit granted less deliveries queued by the core (core thread only)
+    bool                     stalled_outbound;  ///< Indicates that this link is stalled on outbound buffer backpressure
+    uint64_t                 q2_stall_count;    ///< Times inbound messages were held off at the Q2 watermark
+    uint64_t                 q3_stall_count;    ///< Times outbound sending stalled at the Q3 watermark
+    bool                     detach_received;   ///< True on core receipt of inbound attach
+    bool                     detach_send_done;  ///< True once the detach has been sent by the I/O thread
+    uint64_t                 total_deliveries;
+    uint64_t                 direct_deliveries;  ///< Passed to the connected link by the I/O thread; atomic, see qdr_link_deliver_direct
+    qdr_link_t              *connected_link;     ///< [ref] If this is a link-route, the connected link; I/O threads read it under core->link_route_lock
+    bool                     routed_via_core;    ///< A delivery went through the core to the connected link (I/O thread only)
+
+    //
+    // Used only by the core thread, starting on their own cache line.
+    //
+    qdr_address_t           *owning_addr __attribute__((aligned(64)));  ///< [ref] Address record that owns this link
+    DEQ_LINKS(qdr_link_t);
     int                      attach_count;       ///< 1 or 2 depending on the state of the lifecycle
+    int64_t                  attach_sent_usec;   ///< When a link-routed attach was forwarded on this link, 0 once answered
     int                      detach_count;       ///< 0, 1, or 2 depending on the state of the lifecycle
-    qdr_address_t           *owning_addr;        ///< [ref] Address record that owns this link
     int                      phase;
-    qdr_link_t              *connected_link;     ///< [ref] If this is a link-route, reference the connected link
     qdrc_endpoint_t         *core_endpoint;      ///< [ref] Set if this link terminates on an in-core endpoint
     qdr_link_ref_t          *ref[QDR_LINK_LIST_CLASSES];  ///< Pointers to containing reference objects
     qdr_auto_link_t         *auto_link;          ///< [ref] Auto_link that owns this link
-    qdr_delivery_list_t      undelivered;        ///< Deliveries to be forwarded or sent
-    qdr_delivery_list_t      unsettled;          ///< Unsettled deliveries
-    qdr_delivery_list_t      settled;            ///< Settled deliveries
-    qdr_delivery_ref_list_t  updated_deliveries; ///< References to deliveries (in the unsettled list) with updates.
     qdr_link_oper_status_t   oper_status;
     int                      capacity;
-    int                      credit_to_core; ///< Number of the available credits incrementally given to the core
     int                      credit_pending; ///< Number of credits to be issued once consumers are available
     int                      credit_stored;  ///< Number of credits given to the link before it was ready to process them.
+    int                      credit_window;  ///< Adaptive credit: the current window, 0 until the link adapts
+    int                      credit_debt;    ///< Replacement credits to withhold after the window shrank
+    int                      overload_withheld;  ///< Credit held back while the router is overloaded
+    int                      overload_owed;      ///< Credit asked for at the current level, not yet a whole grant
+    int                      credit_round_settles;  ///< Settlements so far in this adaptation round
+    int                      credit_round_peak;     ///< Most unsettled deliveries seen in this round
+    int                      credit_rounds;
+    int64_t                  credit_rtt_min;        ///< Base settlement latency, in microseconds
+    int64_t                  credit_round_rtt_min;
+    int64_t                  credit_rtt_ewma;
     bool                     admin_enabled;
-    bool                     strip_annotations_in;
-    bool                     strip_annotations_out;
     bool                     drain_mode;
-    bool                     stalled_outbound;  ///< Indicates that this link is stalled on outbound buffer backpressure
-    bool                     detach_received;   ///< True on core receipt of inbound attach
-    bool                     detach_send_done;  ///< True once the detach has been sent by the I/O thread
-    bool                     edge;              ///< True if this link is in an edge-connection
-    char                    *strip_prefix;
-    char                    *insert_prefix;
-    bool                     terminus_survives_disconnect;
 
-    uint64_t  total_deliveries;
     uint64_t  presettled_deliveries;
     uint64_t  dropped_presettled_deliveries;
     uint64_t  accepted_deliveries;
     uint64_t  rejected_deliveries;
     uint64_t  released_deliveries;
     uint64_t  modified_deliveries;
+    uint64_t  expired_deliveries;
     uint64_t  deliveries_delayed_1sec;
     uint64_t  deliveries_delayed_10sec;
     uint64_t  settled_deliveries[QDR_LINK_RATE_DEPTH];
     uint64_t *ingress_histogram;
-    uint8_t   priority;
+    qdr_latency_stats_t *latency;  ///< Outgoing links only, allocated on first settlement
     uint8_t   rate_cursor;
     uint32_t  core_ticks;
+    int64_t   settle_usec_ewma;   ///< Settlement latency of balanced deliveries, 0 if none yet
+    uint64_t  presettled_sampled; ///< Pre-settled deliveries considered by the sampling drop policy
 };
 
 ALLOC_DECLARE(qdr_link_t);
 DEQ_DECLARE(qdr_link_t, qdr_link_list_t);
 
+//
+// The class of the actions an I/O thread raises for a link's deliveries and flow.
+//
+static inline qdr_action_class_t qdr_link_action_class(const qdr_link_t *link)
+{
+    return link->link_type == QD_LINK_CONTROL ? QDR_ACTION_CLASS_CONTROL_LINK : QDR_ACTION_CLASS_DATA;
+}
+
 struct qdr_link_ref_t {
     DEQ_LINKS(qdr_link_ref_t);
     qdr_link_t *link;
@@ -519,27 +873,131 @@ DEQ_DECLARE(qdr_connection_ref_t, qdr_connection_ref_list_t);
 void qdr_add_connection_ref(qdr_connection_ref_list_t *ref_list, qdr_connection_t *conn);
 void qdr_del_connection_ref(qdr_connection_ref_list_t *ref_list, qdr_connection_t *conn);
 
+//
+// The set of inter-router link mask bits a multicast message from one origin
+// router is sent over.  Plans are cached per address and priority, and are
+// rebuilt whenever core->mcast_epoch moves on: any change to the routers, their
+// next hops, valid origins, inter-router links or an address's rnodes.
+//
+#define QDR_MCAST_PLAN_SLOTS 4
+
+typedef struct qdr_mcast_plan_t {
+    uint64_t  epoch;       ///< core->mcast_epoch the plan was built in, 0 if unused
+    int       origin;      ///< mask bit of the ingress router
+    int       priority;    ///< data link priority, -1 for control links
+    int       count;
+    int       capacity;
+    int      *link_bits;   ///< ascending inter-router link mask bits
+} qdr_mcast_plan_t;
+
+//
+// A message held in an address's in-router queue while its consumers have no credit
+//
+typedef struct qdr_queued_message_t {
+    DEQ_LINKS(struct qdr_queued_message_t);
+    qd_message_t *msg;
+    size_t        bytes;
+    int64_t       enqueue_usec;
+} qdr_queued_message_t;
+
+ALLOC_DECLARE(qdr_queued_message_t);
+DEQ_DECLARE(qdr_queued_message_t, qdr_queued_message_list_t);
+
+//
+// Per-address delivery statistics.  Most addresses on a large network are
+// remote-only and never see a delivery, so the block is allocated on first use.
+//
+typedef struct qdr_address_stats_t {
+    uint64_t deliveries_ingress;
+    uint64_t deliveries_egress;
+    uint64_t deliveries_transit;
+    uint64_t deliveries_to_container;
+    uint64_t deliveries_from_container;
+    uint64_t deliveries_egress_route_container;
+    uint64_t deliveries_ingress_route_container;
+    uint64_t queued_deliveries;     ///< Messages ever put on the in-router queue
+    uint64_t queue_full_count;      ///< Messages that found the in-router queue full
+    uint64_t queue_wait_usec_total; ///< Time spent queued by messages that have left the queue
+    uint64_t queue_wait_usec_max;
+    uint64_t dequeued_deliveries;
+    qdr_latency_stats_t *latency;   ///< Deliveries settled by local consumers of the address
+} qdr_address_stats_t;
+
+ALLOC_DECLARE(qdr_address_stats_t);
+
+//
+// An interned, reference-counted router set.  Addresses reached through the
+// same routers share one read-only rnodes mask, and routers with the same
+// valid origins share one valid_origins mask, so equal sets compare equal
+// by pointer.
+//
+typedef struct qdr_shared_mask_t qdr_shared_mask_t;
+struct qdr_shared_mask_t {
+    DEQ_LINKS(qdr_shared_mask_t);
+    qd_bitmask_t *mask;
+    uint32_t      hash;
+    uint32_t      ref_count;
+};
+
+ALLOC_DECLARE(qdr_shared_mask_t);
+DEQ_DECLARE(qdr_shared_mask_t, qdr_shared_mask_list_t);
+
+#define QDR_SHARED_MASK_BUCKETS 1024
+
+//
+// Most neighbors used as equal-cost next hops to one router
+//
+#define QDR_MAX_EQUAL_COST_HOPS 8
+
+//
+// Most edge connections an edge router carries traffic over at once
+//
+#define QDR_MAX_EDGE_UPLINKS 4
+
+//
+// Proxy links for an address on the edge uplinks other than the active edge
+// connection.  Allocated only on edge routers with more than one uplink.
+//
+typedef struct qdr_edge_uplink_links_t {
+    qdr_link_t *inlink[QDR_MAX_EDGE_UPLINKS - 1];   ///< [ref]
+    qdr_link_t *outlink[QDR_MAX_EDGE_UPLINKS - 1];  ///< [ref]
+} qdr_edge_uplink_links_t;
+
 struct qdr_address_t {
     DEQ_LINKS(qdr_address_t);
+    DEQ_LINKS_N(GC, qdr_address_t);       ///< In core->addrs_gc while awaiting its grace period
+    DEQ_LINKS_N(CREDIT, qdr_address_t);   ///< In core->addrs_credit while producer credit is released
     qdr_address_config_t      *config;
     qdr_subscription_list_t    subscriptions; ///< In-process message subscribers
     qdr_connection_ref_list_t  conns;         ///< Local Connections for route-destinations
     qdr_link_ref_list_t        rlinks;        ///< Locally-Connected Consumers
     qdr_link_ref_list_t        inlinks;       ///< Locally-Connected Producers
-    qd_bitmask_t              *rnodes;        ///< Bitmask of remote routers with connected consumers
+    qd_bitmask_t              *rnodes;        ///< [shared] Remote routers with connected consumers, read-only
     qd_hash_handle_t          *hash_handle;   ///< Linkage back to the hash table entry
     qdrc_endpoint_desc_t      *core_endpoint; ///< [ref] Set if this address is bound to an in-core endpoint
     void                      *core_endpoint_context;
     qdr_link_t                *edge_inlink;   ///< [ref] In-link from connected Interior router (on edge router)
     qdr_link_t                *edge_outlink;  ///< [ref] Out-link to connected Interior router (on edge router)
+    qdr_edge_uplink_links_t   *edge_uplinks;  ///< In/out-links on the additional edge uplinks, allocated on first use
+    uint32_t                   stripe_hash;   ///< Hash of the address key choosing its inter-router data stripe, 0 until used
     qd_address_treatment_t     treatment;
     qdr_forwarder_t           *forwarder;
+    int (*forward_message)(qdr_core_t*, qdr_address_t*, qd_message_t*, qdr_delivery_t*, bool, bool);  ///< The forwarder's variant for the address as it is, see qdr_forward_select_CT
     int                        ref_count;     ///< Number of link-routes + auto-links referencing this address
     bool                       block_deletion;
     bool                       local;
     bool                       router_control_only; ///< If set, address is only for deliveries arriving on a control link
     uint32_t                   tracked_deliveries;
     uint64_t                   cost_epoch;
+    uint32_t                   gc_tick;          ///< uptime_ticks at which the grace period ends
+    bool                       in_gc_list;
+    bool                       in_credit_list;
+    bool                       withdraw_pending; ///< The loss of the last local destination is not yet posted
+
+    //
+    // Cached inter-router fan-out for multicast treatment
+    //
+    qdr_mcast_plan_t *mcast_plans;  ///< QDR_MCAST_PLAN_SLOTS entries, allocated on first use
 
     //
     // State for "closest" treatment
@@ -551,6 +1009,13 @@ struct qdr_address_t {
     // State for "balanced" treatment
     //
     int *outstanding_deliveries;
+    int64_t *settle_usec_ewma;  ///< Per inter-router link bit, latency-aware balancing only
+
+    //
+    // In-router queue for anycast treatment, if configured
+    //
+    qdr_queued_message_list_t queue;
+    size_t                    queue_bytes;
 
     //
     // State for "exchange" treatment
@@ -563,17 +1028,7 @@ struct qdr_address_t {
     char *add_prefix;
     char *del_prefix;
 
-    /**@name Statistics */
-    ///@{
-    uint64_t deliveries_ingress;
-    uint64_t deliveries_egress;
-    uint64_t deliveries_transit;
-    uint64_t deliveries_to_container;
-    uint64_t deliveries_from_container;
-    uint64_t deliveries_egress_route_container;
-    uint64_t deliveries_ingress_route_container;
-
-    ///@}
+    qdr_address_stats_t *stats;  ///< Allocated on first use, see qdr_address_stats_CT
 
     int priority;
 };
@@ -581,15 +1036,67 @@ struct qdr_address_t {
 ALLOC_DECLARE(qdr_address_t);
 DEQ_DECLARE(qdr_address_t, qdr_address_list_t);
 
+/**
+ * Hold an idle address, or the withdrawal of its last local destination, for the
+ * grace period.  The address is freed, and the withdrawal posted, only if it is
+ * still idle when the period ends.
+ */
+void qdr_address_gc_defer_CT(qdr_core_t *core, qdr_address_t *addr);
+
 qdr_address_t *qdr_address_CT(qdr_core_t *core, qd_address_treatment_t treatment, qdr_address_config_t *config);
+bool qdr_addr_queue_CT(qdr_core_t *core, qdr_address_t *addr, qdr_delivery_t *dlv);
+void qdr_addr_drain_queue_CT(qdr_core_t *core, qdr_address_t *addr);
+void qdr_addr_flush_queue_CT(qdr_core_t *core, qdr_address_t *addr);
 qdr_address_t *qdr_add_local_address_CT(qdr_core_t *core, char aclass, const char *addr, qd_address_treatment_t treatment);
 qdr_address_t *qdr_add_mobile_address_CT(qdr_core_t *core, const char* prefix, const char *addr, qd_address_treatment_t treatment, bool edge);
 void qdr_core_remove_address(qdr_core_t *core, qdr_address_t *addr);
+
+/**
+ * The address's statistics block, allocated on first use.
+ */
+static inline qdr_address_stats_t *qdr_address_stats_CT(qdr_address_t *addr)
+{
+    if (!addr->stats) {
+        addr->stats = new_qdr_address_stats_t();
+        ZERO(addr->stats);
+    }
+    return addr->stats;
+}
+
+/**
+ * Set or clear a remote router in an address's rnodes.  The address is
+ * moved onto the interned mask for its new router set; the old value of the
+ * bit is returned, as with qd_bitmask_set_bit/clear_bit.
+ */
+int qdr_address_rnodes_set_CT(qdr_core_t *core, qdr_address_t *addr, int router_maskbit);
+int qdr_address_rnodes_clear_CT(qdr_core_t *core, qdr_address_t *addr, int router_maskbit);
+
+/**
+ * Return the interned copy of mask with a reference taken on it.  Ownership
+ * of mask passes to the core: it either becomes the interned copy or is
+ * freed.  Interned masks are read-only and are given back with
+ * qdr_shared_mask_release_CT.
+ */
+qd_bitmask_t *qdr_shared_mask_CT(qdr_core_t *core, qd_bitmask_t *mask);
+void qdr_shared_mask_release_CT(qdr_core_t *core, qd_bitmask_t *mask);
+void qdr_shared_mask_free_all_CT(qdr_core_t *core);
 void qdr_core_bind_address_link_CT(qdr_core_t *core, qdr_address_t *addr, qdr_link_t *link);
 void qdr_core_unbind_address_link_CT(qdr_core_t *core, qdr_address_t *addr, qdr_link_t *link);
 void qdr_core_bind_address_conn_CT(qdr_core_t *core, qdr_address_t *addr, qdr_connection_t *conn);
 void qdr_core_unbind_address_conn_CT(qdr_core_t *core, qdr_address_t *addr, qdr_connection_t *conn);
 
+//
+// What to drop when pre-settled deliveries back up on an outgoing link
+//
+typedef enum {
+    QDR_PRESETTLED_DROP_ALL,       ///< Every queued pre-settled delivery
+    QDR_PRESETTLED_DROP_OLDEST,    ///< The oldest queued pre-settled delivery
+    QDR_PRESETTLED_DROP_NEWEST,    ///< The arriving delivery
+    QDR_PRESETTLED_DROP_SAMPLE,    ///< All but one in every presettled_sample_rate arriving deliveries
+    QDR_PRESETTLED_DROP_CONFLATE,  ///< The queued delivery with the arriving one's group-id, else the oldest
+    QDR_PRESETTLED_DROP_POLICIES
+} qdr_presettled_drop_t;
+
 struct qdr_address_config_t {
     DEQ_LINKS(qdr_address_config_t);
     char                   *name;
@@ -601,11 +1108,39 @@ struct qdr_address_config_t {
     int                     in_phase;
     int                     out_phase;
     int                     priority;
+    qdr_presettled_drop_t   presettled_drop;
+    qdr_mcast_settlement_t  mcast_settlement;
+    bool                    priority_ordered; ///< Consumer links queue deliveries by message priority
+    bool                    group_affinity;   ///< Anycast messages with the same group-id go to the same consumer
+    int                     presettled_sample_rate;
+    int                     queue_max_depth;  ///< In-router queue size in messages, 0 => no queue
+    size_t                  queue_max_bytes;  ///< In-router queue size in buffered octets, 0 => unlimited
+    qd_hash_handle_t       *name_handle;      ///< In core->addr_config_names, if named
 };
 
 ALLOC_DECLARE(qdr_address_config_t);
 DEQ_DECLARE(qdr_address_config_t, qdr_address_config_list_t);
 void qdr_core_remove_address_config(qdr_core_t *core, qdr_address_config_t *addr);
+
+/**
+ * Configuration snapshots (see qdr_config_snapshot in router_core.h).  A pass
+ * of the core that changes the address or link-route pattern trees marks the
+ * snapshot stale, and at the end of the pass one new snapshot is published
+ * however many patterns changed.
+ */
+void qdr_config_snapshot_setup(qdr_core_t *core);
+void qdr_config_snapshot_cleanup(qdr_core_t *core);
+void qdr_config_snapshot_changed_CT(qdr_core_t *core);
+void qdr_config_snapshot_publish_CT(qdr_core_t *core);
+
+/**
+ * The configured addresses, link routes and auto links are indexed by name, so
+ * that creating one, or finding one by name, does not walk the whole list.
+ * Entities without a name are not indexed.
+ */
+void  qdr_config_name_insert_CT(qd_hash_t *names, const char *name, void *entity, qd_hash_handle_t **handle);
+void  qdr_config_name_remove_CT(qd_hash_t *names, qd_hash_handle_t **handle);
+void *qdr_config_name_find_CT(qd_hash_t *names, qd_iterator_t *name);
 bool qdr_is_addr_treatment_multicast(qdr_address_t *addr);
 
 //
@@ -616,18 +1151,18 @@ bool qdr_is_addr_treatment_multicast(qdr_address_t *addr);
 //
 
 struct qdr_connection_info_t {
-    char                       *container;
-    char                       *sasl_mechanisms;
+    const char                 *container;        ///< Interned, as are the other const strings
+    const char                 *sasl_mechanisms;
     char                       *host;
     bool                        is_encrypted;
-    char                       *ssl_proto;
-    char                       *ssl_cipher;
-    char                       *user;
+    const char                 *ssl_proto;
+    const char                 *ssl_cipher;
+    const char                 *user;
     bool                        is_authenticated;
     bool                        opened;
     qd_direction_t              dir;
     qdr_connection_role_t       role;
-    pn_data_t                  *connection_properties;
+    pn_data_t                  *connection_properties;  ///< 0 if the peer sent none
     bool                        ssl;
     int                         ssl_ssf; //ssl strength factor
 };
@@ -636,13 +1171,57 @@ ALLOC_DECLARE(qdr_connection_info_t);
 
 DEQ_DECLARE(qdr_link_route_t, qdr_link_route_list_t);
 
+//
+// The per-priority lists of links with work for a connection's IO thread.  Most
+// connections are idle most of the time, so the lists are only allocated while
+// there is work on them.
+//
+typedef struct qdr_link_work_lists_t {
+    qdr_link_ref_list_t lists[QDR_N_PRIORITIES];
+} qdr_link_work_lists_t;
+
+ALLOC_DECLARE(qdr_link_work_lists_t);
+
+/**
+ * The connection's list of links with work at a priority, allocating the lists if
+ * needed.  Call with the connection's work_lock held.
+ */
+qdr_link_ref_list_t *qdr_connection_work_links(qdr_connection_t *conn, int priority);
+
+/**
+ * Take a link off its connection's work list, if it is on one.  Call with the
+ * connection's work_lock held.
+ */
+void qdr_connection_unqueue_link(qdr_connection_t *conn, qdr_link_t *link);
+
+/**
+ * The core-wide settlement counters, kept as one shard per connection.  A
+ * shard is written only by the thread settling its connection's deliveries
+ * and the router's totals are summed from the shards when they are read.
+ */
+typedef struct qdr_delivery_counters_t {
+    uint64_t  presettled;
+    uint64_t  accepted;
+    uint64_t  rejected;
+    uint64_t  released;
+    uint64_t  modified;
+    uint64_t  dropped_expired;
+    uint64_t  delayed_1sec;
+    uint64_t  delayed_10sec;
+} qdr_delivery_counters_t;
+
 struct qdr_connection_t {
     DEQ_LINKS(qdr_connection_t);
     DEQ_LINKS_N(ACTIVATE, qdr_connection_t);
+    DEQ_LINKS_N(SETTLE, qdr_connection_t);
     uint64_t                    identity;
     qdr_core_t                 *core;
     bool                        incoming;
     bool                        in_activate_list;
+    bool                        in_settle_list;
+    bool                        closing;           ///< Closed and being torn down in slices, takes no new work
+    int64_t                     settle_held_usec;  ///< When the first held inter-router settlement was pushed
+    sys_atomic_t                wake_pending;  ///< Set by the core when it wakes the connection, cleared by the IO thread
     qdr_connection_role_t       role;
     int                         inter_router_cost;
     qdr_conn_identifier_t      *conn_id;
@@ -651,12 +1230,25 @@ struct qdr_connection_t {
     bool                        policy_allow_dynamic_link_routes;
     int                         link_capacity;
     int                         mask_bit;
-    qdr_connection_work_list_t  work_list;
+    int                         data_stripe;      ///< Slot in the peer's sheaf for inter-router-data connections, -1 if unbound
+    int                         data_link_count;  ///< Outgoing data links attached on an inter-router-data connection
+    qdr_link_t                 *data_links[QDR_N_PRIORITIES]; ///< Those links by priority, kept while unbound
+    sys_atomic_ptr_t            work_stack;  ///< Lock-free LIFO of qdr_connection_work_t linked through 'next'
     sys_mutex_t                *work_lock;
     qdr_link_ref_list_t         links;
-    qdr_link_ref_list_t         links_with_work[QDR_N_PRIORITIES];
-    char                       *tenant_space;
+    qdr_link_work_lists_t      *links_with_work;  ///< 0 until link work is queued, and again once the IO thread takes it (work_lock)
+    int64_t                     attach_usec_ewma;  ///< Latency of link-routed attaches answered here, 0 if none yet
+    uint64_t                    priority_deliveries[QDR_N_PRIORITIES]; ///< Sent per priority (IO thread)
+    uint64_t                    priority_bytes[QDR_N_PRIORITIES];
+    uint64_t                    compressed_in[2];   ///< {message, wire} bytes received compressed (IO thread)
+    uint64_t                    compressed_out[2];  ///< {message, wire} bytes sent compressed (IO thread)
+    uint32_t                    max_frame_size;     ///< The max-frame-size this router advertised (IO thread)
+    uint64_t                    frames[2];          ///< {in, out} frames (IO thread)
+    uint64_t                    frame_octets[2];    ///< {in, out} message octets (IO thread)
+    qdr_delivery_counters_t     delivery_counters;  ///< This connection's shard of the router's settlement counters
+    const char                 *tenant_space;  ///< Interned "vhost/", or 0
     int                         tenant_space_len;
+    qd_iterator_space_t        *tenant_hash;   ///< The tenant space with its annotation hashes precomputed
     qdr_connection_info_t      *connection_info;
     void                       *user_context; /* Updated from IO thread, use work_lock */
     qdr_link_route_list_t       conn_link_routes;  // connection scoped link routes
@@ -688,6 +1280,7 @@ struct qdr_link_route_t {
     char                   *add_prefix;
     char                   *del_prefix;
     qdr_connection_t       *parent_conn;
+    qd_hash_handle_t       *name_handle;    ///< In core->link_route_names, if a named configured route
 };
 
 ALLOC_DECLARE(qdr_link_route_t);
@@ -698,15 +1291,12 @@ void qdr_core_delete_auto_link (qdr_core_t *core,  qdr_auto_link_t *al);
 typedef void (*qdr_timer_cb_t)(qdr_core_t *core, void* context);
 
 typedef struct qdr_core_timer_t {
-    DEQ_LINKS(struct qdr_core_timer_t);
-    qdr_timer_cb_t  handler;
-    void           *context;
-    uint32_t        delta_time_seconds;
-    bool            scheduled;
+    qd_wheel_entry_t  entry;    ///< Position on the core's timer wheel
+    qdr_timer_cb_t    handler;
+    void             *context;
 } qdr_core_timer_t;
 
 ALLOC_DECLARE(qdr_core_timer_t);
-DEQ_DECLARE(qdr_core_timer_t, qdr_core_timer_list_t);
 
 
 typedef enum {
@@ -732,8 +1322,10 @@ struct qdr_auto_link_t {
     qdr_conn_identifier_t *conn_id;
     qdr_link_t            *link;
     qdr_auto_link_state_t  state;
+    bool                   activate_pending; // Waiting for a paced activation on its container's connection
     qdr_core_timer_t      *retry_timer; // If the auto link attach fails or gets disconnected, this timer retries the attach.
     char                  *last_error;
+    qd_hash_handle_t      *name_handle; // In core->auto_link_names, if named
 };
 
 ALLOC_DECLARE(qdr_auto_link_t);
@@ -746,40 +1338,120 @@ struct qdr_conn_identifier_t {
     qdr_connection_ref_list_t  connection_refs;
     qdr_link_route_list_t      link_route_refs;
     qdr_auto_link_list_t       auto_link_refs;
+    qdr_connection_t          *activate_conn;   ///< Connection auto-links are being activated on in paced batches
+    qdr_auto_link_t           *activate_next;   ///< Next auto-link in auto_link_refs to consider for that
+    qdr_core_timer_t          *activate_timer;  ///< Runs the next batch
 };
 
 ALLOC_DECLARE(qdr_conn_identifier_t);
 DEQ_DECLARE(qdr_exchange_t, qdr_exchange_list_t);
 
+//
+// Maximum number of inter-router-data connections striped alongside the
+// inter-router connection to one peer.
+//
+#define QDR_MAX_DATA_STRIPES 8
+
 typedef struct qdr_priority_sheaf_t {
     qdr_link_t *links[QDR_N_PRIORITIES];
     int count;
+    qdr_link_t       *stripes[QDR_MAX_DATA_STRIPES][QDR_N_PRIORITIES]; ///< Outgoing links on inter-router-data connections
+    qdr_connection_t *stripe_conns[QDR_MAX_DATA_STRIPES];
+    int               stripe_count;
 } qdr_priority_sheaf_t;
 
+//
+// A multicast message identity (QD_MA_SEQUENCE plus the address) forwarded recently
+//
+typedef struct qdr_multicast_seen_t {
+    DEQ_LINKS(struct qdr_multicast_seen_t);
+    qd_hash_handle_t *hash_handle;
+    uint32_t          tick;       ///< core uptime when first forwarded
+} qdr_multicast_seen_t;
+
+ALLOC_DECLARE(qdr_multicast_seen_t);
+DEQ_DECLARE(qdr_multicast_seen_t, qdr_multicast_seen_list_t);
+
+/**
+ * Handler - Answer a GET-EDGE-SUMMARY query, now or once the edges have replied,
+ * with qdr_agent_enqueue_response_CT.
+ */
+typedef void (*qdrc_edge_summary_t) (void *context, qdr_query_t *query);
+
 struct qdr_core_t {
     qd_dispatch_t     *qd;
     qd_log_source_t   *log;
     qd_log_source_t   *agent_log;
     sys_thread_t      *thread;
     bool               running;
-    qdr_action_list_t  action_list;
+    sys_atomic_ptr_t   action_stack;     ///< Lock-free LIFO of pending actions, linked through 'next'
+    sys_atomic_t       action_sleeping;  ///< Non-zero while the core thread is parked on action_cond
     sys_cond_t        *action_cond;
-    sys_mutex_t       *action_lock;
+    sys_mutex_t       *action_lock;      ///< Protects action_cond only
+    qdr_action_list_t  action_queue[QDR_ACTION_CLASSES];   ///< Per-class pending actions (core thread only)
+    int                action_weight[QDR_ACTION_CLASSES];  ///< Round-robin quantum per class
+    int                action_budget;    ///< Max actions per scheduling pass, 0 => no limit
+    int                action_spin_usec; ///< Busy-poll time before parking, 0 => park immediately
+    int                action_spin_window;   ///< Current busy-poll time, scaled by the spin hit rate
+    int                action_spin_hit_rate; ///< Smoothed share of spins that caught work, out of QDR_SPIN_RATE_ONE
+    uint64_t           action_park_count;
+    bool               action_stats_enabled;
+    qdr_action_trace_t *action_trace;           ///< Recording of the actions run, if enabled
+    bool               balanced_latency_aware;  ///< Weigh balanced destinations by settlement latency
+    bool               delivery_latency_stats;  ///< Time deliveries for the latency histograms
+    int                stats_page_msec;         ///< Interval the stats_page module copies counters, 0 = never
+    qdr_latency_stats_t delivery_latency;       ///< Router-wide delivery latency
+    int64_t            summary_usec;            ///< When the last GET-SUMMARY was taken, 0 = never
+    uint64_t           summary_ingress;         ///< Deliveries counted by that summary, for its rates
+    uint64_t           summary_egress;
+    int                edge_uplinks;            ///< Edge connections carrying traffic at once (edge router)
+    int                edge_proxy_attach_rate;  ///< Proxy links created per second on a new uplink, 0 = no limit
+    int                edge_update_window;      ///< Seconds address-tracking updates to an edge are coalesced, 0 = none
+    uint32_t           addr_lookup_cache_ttl;   ///< Seconds an edge keeps address lookup results, 0 = no cache
+    uint32_t           addr_grace_period;       ///< Seconds an idle address is kept before it is freed, 0 = none
+    int                producer_credit_release; ///< Credits released per address per interval to blocked producers, 0 = all at once
+    int                link_route_cache_size;   ///< Entries in each link-route pattern match cache
+    int                auto_link_activate_rate; ///< Auto-links activated per second on a new connection, 0 = no limit
+    uint64_t           auto_links_pending;      ///< Auto-links waiting for a paced activation
+    int                client_max_in_flight;    ///< Initial in-flight request limit of core clients, 0 = none
+    qdr_action_stats_list_t  action_stats;  ///< In order of first appearance, for management
+    qdr_action_stats_t      *action_stats_by_label[QDR_ACTION_STATS_SLOTS];
+    int                      activation_batch_usec; ///< Min interval between activation sweeps, 0 => every pass
+    int64_t                  last_activation_usec;
+    int                      settle_window_usec;  ///< Time inter-router settlements are held to share frames, 0 => none
+    bool                     outbound_weighted;   ///< Share connection output among priorities by weight, not strictly
+    int                      credit_window_min;   ///< Bounds for adaptive incoming link credit,
+    int                      credit_window_max;   ///< max 0 => fixed at the link capacity
+    int                      outbound_quantum;    ///< Deliveries per pass per priority level when weighted
+    int                      connection_budget;   ///< Max deliveries per qdr_connection_process, 0 => no limit
+    int                      overload_action_depth;  ///< Overload thresholds, 0 where the measure is disabled
+    size_t                   overload_buffer_bytes;
+    int                      overload_core_lag_msec;
+    int                      overload_level;      ///< 0 .. QDR_OVERLOAD_LEVELS, set by the overload_control module
+    size_t                   action_depth_peak;   ///< Most actions queued at once since the overload check
+    uint64_t                 credit_withheld;     ///< Credits ever withheld from producers while overloaded
 
     sys_mutex_t             *work_lock;
-    qdr_core_timer_list_t    scheduled_timers;
+    sys_mutex_t             *stream_lock;  ///< Protects the stream_peers of deliveries
+    sys_mutex_t             *link_route_lock;  ///< Protects connected_link, which I/O threads forward on
+    qd_timer_wheel_t         timer_wheel;  ///< Core timers, in milliseconds of qd_timer_now_usec
     qdr_general_work_list_t  work_list;
     qd_timer_t              *work_timer;
     uint32_t                 uptime_ticks;
 
     qdr_connection_list_t open_connections;
+    qdr_connection_list_t closing_connections;  ///< Closed, their links still being torn down
     qdr_connection_t     *active_edge_connection;
     qdr_connection_list_t connections_to_activate;
+    qdr_connection_list_t connections_settle_held;  ///< Oldest first, linked through SETTLE
     qdr_link_list_t       open_links;
 
     qdrc_attach_addr_lookup_t  addr_lookup_handler;
     void                      *addr_lookup_context;
 
+    qdrc_edge_summary_t        edge_summary_handler;  ///< Set by the edge_summary module on interiors
+    void                      *edge_summary_context;
+
     //
     // Agent section
     //
@@ -789,6 +1461,12 @@ struct qdr_core_t {
     qdr_manage_response_t  agent_response_handler;
     qdr_subscription_t    *agent_subscription_mobile;
     qdr_subscription_t    *agent_subscription_local;
+    qdr_agent_cursor_t     agent_cursors[QDR_AGENT_CURSORS];
+    uint64_t               agent_cursor_stamp;
+    sys_mutex_t           *snapshot_lock;
+    qdr_agent_snapshot_list_t agent_snapshots;
+    int                    agent_snapshot_msec;   ///< Lifetime of query snapshots, 0 for none
+    int                    metrics_series_limit;  ///< Entities of each type in the metrics endpoint
 
     //
     // Route table section
@@ -797,11 +1475,14 @@ struct qdr_core_t {
     qdr_mobile_added_t    rt_mobile_added;
     qdr_mobile_removed_t  rt_mobile_removed;
     qdr_link_lost_t       rt_link_lost;
+    qdr_action_list_t     rt_batch;        ///< Updates held until qdr_core_route_table_commit
+    int                   rt_batch_depth;  ///< Nesting of qdr_core_route_table_begin, engine thread only
 
     //
     // Connection section
     //
     void                      *user_context;
+    qdr_connection_activate_t  activate_handler;
     qdr_link_first_attach_t    first_attach_handler;
     qdr_link_second_attach_t   second_attach_handler;
     qdr_link_detach_t          detach_handler;
@@ -827,11 +1508,22 @@ struct qdr_core_t {
     qdr_address_config_list_t  addr_config;
     qdr_auto_link_list_t       auto_links;
     qdr_link_route_list_t      link_routes;
+    qd_hash_t                 *addr_config_names;
+    qd_hash_t                 *auto_link_names;
+    qd_hash_t                 *link_route_names;
     qd_hash_t                 *conn_id_hash;
     qdr_address_list_t         addrs;
+    qdr_address_list_t         addrs_gc;       ///< Idle addresses by the end of their grace period, linked through GC
+    qdr_core_timer_t          *addr_gc_timer;
+    qdr_address_list_t         addrs_credit;   ///< Addresses releasing pending producer credit, linked through CREDIT
+    qdr_core_timer_t          *credit_release_timer;
     qd_hash_t                 *addr_hash;
+    qdr_shared_mask_list_t     shared_masks[QDR_SHARED_MASK_BUCKETS];  ///< Interned router sets by mask hash
     qd_parse_tree_t           *addr_parse_tree;
     qd_parse_tree_t           *link_route_tree[2];   // QD_INCOMING, QD_OUTGOING
+    qdr_config_snapshot_t     *config_snapshot;      ///< Copy of the pattern trees for other threads
+    sys_mutex_t               *config_snapshot_lock; ///< Guards swapping config_snapshot
+    bool                       config_snapshot_stale;
     qdr_address_t             *hello_addr;
     qdr_address_t             *router_addr_L;
     qdr_address_t             *routerma_addr_L;
@@ -844,6 +1536,7 @@ struct qdr_core_t {
     qdr_link_t          **control_links_by_mask_bit;
     qdr_priority_sheaf_t *data_links_by_mask_bit;
     uint64_t              cost_epoch;
+    uint64_t              mcast_epoch;        ///< Bumped on any change that affects multicast plans
 
     uint64_t              next_tag;
 
@@ -854,21 +1547,30 @@ struct qdr_core_t {
     qdr_forwarder_t      *forwarders[QD_TREATMENT_LINK_BALANCED + 1];
 
     qdr_delivery_cleanup_list_t  delivery_cleanup_list;  ///< List of delivery cleanup items to be processed in an IO thread
+    qdr_cleanup_inbox_t         *cleanup_inbox;          ///< One per server thread
+    int                          cleanup_inbox_count;
+    int                          cleanup_inboxes_waiting; ///< Inboxes with a non-zero first_push_usec
+
+    qdr_arena_t                  arena;                  ///< Reset at the end of each core-thread pass
+
+    qd_hash_t                   *multicast_seen;          ///< Recent multicast identities, for dropping duplicates
+    qdr_multicast_seen_list_t    multicast_seen_list;     ///< The same, oldest first
+    uint64_t                     next_multicast_sequence; ///< Next QD_MA_SEQUENCE assigned by this router
+    uint64_t                     presettled_dropped[QDR_PRESETTLED_DROP_POLICIES];  ///< Drops made by each policy
+    qdr_core_timer_t            *expiry_timer;            ///< Sweeps expired pre-settled deliveries off backed-up links
 
     // Overall delivery counters
-    uint64_t  presettled_deliveries;
+    qdr_delivery_counters_t closed_delivery_counters;  ///< Shards folded in from connections that have closed
     uint64_t  dropped_presettled_deliveries;
-    uint64_t  accepted_deliveries;
-    uint64_t  rejected_deliveries;
-    uint64_t  released_deliveries;
-    uint64_t  modified_deliveries;
     uint64_t  deliveries_ingress;
     uint64_t  deliveries_egress;
     uint64_t  deliveries_transit;
     uint64_t  deliveries_egress_route_container;
     uint64_t  deliveries_ingress_route_container;
-    uint64_t  deliveries_delayed_1sec;
-    uint64_t  deliveries_delayed_10sec;
+    uint64_t  deliveries_direct_ingress;  ///< The I/O threads' link-routed deliveries; atomic, see qdr_link_deliver_direct
+    uint64_t  deliveries_direct_egress;
+    uint64_t  deliveries_direct_transit;
+    uint64_t  dropped_duplicate_multicasts;
 };
 
 struct qdr_terminus_t {
@@ -890,12 +1592,25 @@ ALLOC_DECLARE(qdr_terminus_t);
 void *router_core_thread(void *arg);
 uint64_t qdr_identifier(qdr_core_t* core);
 void qdr_management_agent_on_message(void *context, qd_message_t *msg, int link_id, int cost, uint64_t in_conn_id);
+void qdr_management_agent_free_snapshots(qdr_core_t *core);
 void  qdr_route_table_setup_CT(qdr_core_t *core);
 void  qdr_agent_setup_CT(qdr_core_t *core);
 void  qdr_forwarder_setup_CT(qdr_core_t *core);
+void  qdr_forwarder_cleanup_CT(qdr_core_t *core);
 qdr_action_t *qdr_action(qdr_action_handler_t action_handler, const char *label);
 void qdr_action_enqueue(qdr_core_t *core, qdr_action_t *action);
+bool qdr_action_batch_active(qdr_core_t *core);
+qdr_action_t *qdr_action_batch_top(qdr_core_t *core);
+void qdr_connection_hold_settlement_CT(qdr_core_t *core, qdr_connection_t *conn);
 void qdr_link_issue_credit_CT(qdr_core_t *core, qdr_link_t *link, int credit, bool drain);
+
+//
+// Overload control.  Level 0 is normal; at each level up to QDR_OVERLOAD_LEVELS the
+// producers on incoming client links get half the replacement credit of the level
+// below, and none at QDR_OVERLOAD_LEVELS.
+//
+#define QDR_OVERLOAD_LEVELS 3
+void qdr_overload_set_level_CT(qdr_core_t *core, int level);
 void qdr_drain_inbound_undelivered_CT(qdr_core_t *core, qdr_link_t *link, qdr_address_t *addr);
 void qdr_addr_start_inlinks_CT(qdr_core_t *core, qdr_address_t *addr);
 
@@ -922,6 +1637,19 @@ void qdr_delivery_link_peers_CT(qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv)
  */
 void qdr_delivery_unlink_peers_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_delivery_t *peer);
 
+/**
+ * Count consumer outcomes of an unsettled multicast delivery forwarded under a
+ * settlement mode other than presettle, settling the delivery once they
+ * decide it.  Outcomes that arrive after that are only counted.
+ */
+void qdr_delivery_mcast_outcome_CT(qdr_core_t *core, qdr_delivery_t *in_dlv, uint32_t accepted, uint32_t failed);
+
+/**
+ * Let the I/O thread receiving in_dlv's message wake out_dlv's connection directly as
+ * the rest of the message arrives.  The peers must already be linked.
+ */
+void qdr_delivery_add_stream_peer_CT(qdr_core_t *core, qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv);
+
 /**
  *
  */
@@ -944,8 +1672,53 @@ qdr_delivery_t *qdr_delivery_next_peer_CT(qdr_delivery_t *dlv);
 */
 void qdr_increment_delivery_counters_CT(qdr_core_t *core, qdr_delivery_t *delivery);
 
+/**
+ * Sum the settlement counters of every connection, open or closed.
+ */
+void qdr_delivery_counters_total_CT(qdr_core_t *core, qdr_delivery_counters_t *total);
+
+/**
+ * Fold a closing connection's shard of the settlement counters into the core.
+ */
+void qdr_delivery_counters_retire_CT(qdr_core_t *core, qdr_connection_t *conn);
+
 void qdr_agent_enqueue_response_CT(qdr_core_t *core, qdr_query_t *query);
 
+/**
+ * Writes one column of an entity object, as the query response writers do.
+ */
+typedef void (*qdr_agent_column_writer_t)(qdr_core_t *core, qd_composed_field_t *body, int col, void *object);
+
+/**
+ * Returns true if the object satisfies every filter of the query; always true
+ * for an unfiltered query.
+ */
+bool qdr_agent_filter_match_CT(qdr_core_t *core, qdr_query_t *query, qdr_agent_column_writer_t writer, void *object);
+
+/**
+ * Record the next object of a query's listing, at query->next_offset.  A null
+ * object releases the query's cursor.
+ */
+void qdr_agent_set_cursor_CT(qdr_core_t *core, qdr_query_t *query, void *object);
+
+/**
+ * The next object of the query's listing, 0 if the query has no cursor.
+ */
+void *qdr_agent_cursor_CT(qdr_core_t *core, qdr_query_t *query);
+
+/**
+ * Called by get-first.  Returns the object at offset if an earlier unfiltered
+ * query of the same entity type stopped there, and hands its cursor to this
+ * query, so that paging through a listing does not re-walk it for each page.
+ */
+void *qdr_agent_cursor_resume_CT(qdr_core_t *core, qdr_query_t *query, int offset);
+
+/**
+ * Must be called before an address, link or connection is removed from its
+ * core list; cursors resting on it move to next.
+ */
+void qdr_agent_object_removed_CT(qdr_core_t *core, void *object, void *next);
+
 void qdr_post_mobile_added_CT(qdr_core_t *core, const char *address_hash, qd_address_treatment_t treatment);
 void qdr_post_mobile_removed_CT(qdr_core_t *core, const char *address_hash);
 void qdr_post_link_lost_CT(qdr_core_t *core, int link_maskbit);
@@ -1007,6 +1780,30 @@ qdr_core_timer_t *qdr_core_timer_CT(qdr_core_t *core, qdr_timer_cb_t callback, v
  */
 void qdr_core_timer_schedule_CT(qdr_core_t *core, qdr_core_timer_t *timer, uint32_t delay);
 
+/**
+ * Schedules a core timer with a delay in milliseconds.
+ * @param core Pointer to the core object returned by qd_core()
+ * @param timer Timer object that needs to be scheduled.
+ * @param msec The number of milliseconds to wait before firing the timer
+ */
+void qdr_core_timer_schedule_msec_CT(qdr_core_t *core, qdr_core_timer_t *timer, uint32_t msec);
+
+/**
+ * Returns true if the timer is scheduled and has not fired yet.
+ */
+static inline bool qdr_core_timer_scheduled_CT(const qdr_core_timer_t *timer)
+{
+    return timer->entry.scheduled;
+}
+
+/**
+ * Fire the core timers that are due.  Called by the core thread on every pass.
+ * @param core Pointer to the core object returned by qd_core()
+ * @param now_msec The current time in milliseconds of qd_timer_now_usec
+ * @return The deadline of the next timer in milliseconds, -1 if none is scheduled.
+ */
+int64_t qdr_core_timer_process_CT(qdr_core_t *core, int64_t now_msec);
+
 /**
  * Cancels an already scheduled timeer. This does not free the timer. It is the responsibility of the person who
  * created the timer to free it.
@@ -1032,4 +1829,12 @@ void qdr_core_timer_free_CT(qdr_core_t *core, qdr_core_timer_t *timer);
  */
 void qdr_reset_sheaf(qdr_core_t *core, uint8_t n);
 
+/**
+ * Return the outgoing data link to the peer on mask_bit for the given priority.
+ * When inter-router-data connections to the peer exist, the link is chosen among
+ * them and the inter-router connection by a hash of the address, so each address
+ * stays on one connection.  A null addr always selects the inter-router connection.
+ */
+qdr_link_t *qdr_peer_stripe_link_CT(qdr_core_t *core, int mask_bit, int priority, qdr_address_t *addr);
+
 #endif
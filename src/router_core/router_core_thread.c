@@ -19,6 +19,7 @@
 
 #include "router_core_private.h"
 #include "module.h"
+#include <sched.h>
 
 /**
  * Creates a thread that is dedicated to managing and using the routing table.
@@ -62,12 +63,77 @@ static void qdr_activate_connections_CT(qdr_core_t *core)
     while (conn) {
         DEQ_REMOVE_HEAD_N(ACTIVATE, core->connections_to_activate);
         conn->in_activate_list = false;
-        qd_server_activate((qd_connection_t*) qdr_connection_get_context(conn));
+
+        //
+        // Held settlements go out with this wakeup.
+        //
+        if (conn->in_settle_list) {
+            DEQ_REMOVE_N(SETTLE, core->connections_settle_held, conn);
+            conn->in_settle_list = false;
+        }
+
+        //
+        // Don't wake a connection whose previous wakeup has not been serviced yet.
+        // The IO thread will pick up the new work when it processes that one.
+        //
+        if (qdr_connection_get_context(conn) && sys_atomic_set(&conn->wake_pending, 1) == 0)
+            core->activate_handler(core->user_context, conn);
         conn = DEQ_HEAD(core->connections_to_activate);
     }
 }
 
 
+/**
+ * Flag for activation the connections whose settlement window has passed.  Returns the
+ * number of microseconds until the next held window ends, or -1 if none are held.
+ */
+static int64_t qdr_release_held_settlements_CT(qdr_core_t *core)
+{
+    qdr_connection_t *conn = DEQ_HEAD(core->connections_settle_held);
+    if (!conn)
+        return -1;
+
+    int64_t now = qd_timer_now_usec();
+    while (conn && now - conn->settle_held_usec >= core->settle_window_usec) {
+        DEQ_REMOVE_HEAD_N(SETTLE, core->connections_settle_held);
+        conn->in_settle_list = false;
+        qdr_connection_activate_CT(core, conn);
+        conn = DEQ_HEAD(core->connections_settle_held);
+    }
+
+    return conn ? conn->settle_held_usec + core->settle_window_usec - now : -1;
+}
+
+
+/**
+ * Fire the core timers that are due.  Returns the number of microseconds until
+ * the next one, -1 if none is scheduled.
+ */
+static int64_t qdr_run_core_timers_CT(qdr_core_t *core)
+{
+    int64_t now  = qd_timer_now_usec();
+    int64_t next = qdr_core_timer_process_CT(core, now / 1000);
+    if (next < 0)
+        return -1;
+    int64_t wait = next * 1000 - now;
+    return wait > 0 ? wait : 0;
+}
+
+
+/**
+ * Returns true if there are actions waiting to be run by the core thread.
+ */
+static bool qdr_actions_pending_CT(qdr_core_t *core)
+{
+    if (sys_atomic_ptr_get(&core->action_stack) != 0)
+        return true;
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++)
+        if (DEQ_SIZE(core->action_queue[cls]) > 0)
+            return true;
+    return false;
+}
+
+
 static void qdr_do_message_to_addr_free(qdr_core_t *core, qdr_general_work_t *work)
 {
     qdr_delivery_cleanup_t *cleanup = DEQ_HEAD(work->delivery_cleanup_list);
@@ -84,6 +150,102 @@ static void qdr_do_message_to_addr_free(qdr_core_t *core, qdr_general_work_t *wo
 }
 
 
+/**
+ * Hand the cleanups gathered during a core pass to the threads that received the
+ * messages.  Cleanups with no owning thread, and the contents of any inbox its
+ * thread has left undrained for QDR_CLEANUP_STEAL_USEC, go to general work.
+ */
+static void qdr_post_delivery_cleanup_CT(qdr_core_t *core)
+{
+    qdr_delivery_cleanup_list_t unowned;
+    qdr_delivery_cleanup_t     *cleanup;
+    DEQ_INIT(unowned);
+
+    if (DEQ_SIZE(core->delivery_cleanup_list) == 0 && core->cleanup_inboxes_waiting == 0)
+        return;
+
+    cleanup = DEQ_HEAD(core->delivery_cleanup_list);
+    while (cleanup) {
+        DEQ_REMOVE_HEAD(core->delivery_cleanup_list);
+        int owner = cleanup->owner_thread;
+        if (owner >= 0 && owner < core->cleanup_inbox_count) {
+            qdr_cleanup_inbox_t *inbox = &core->cleanup_inbox[owner];
+            cleanup->next = inbox->pending_top;
+            inbox->pending_top = cleanup;
+            if (!inbox->pending_bottom)
+                inbox->pending_bottom = cleanup;
+        } else
+            DEQ_INSERT_TAIL(unowned, cleanup);
+        cleanup = DEQ_HEAD(core->delivery_cleanup_list);
+    }
+
+    int64_t now = core->cleanup_inboxes_waiting > 0 ? qd_timer_now_usec() : 0;
+
+    for (int i = 0; i < core->cleanup_inbox_count; i++) {
+        qdr_cleanup_inbox_t *inbox = &core->cleanup_inbox[i];
+
+        if (inbox->first_push_usec && now - inbox->first_push_usec >= QDR_CLEANUP_STEAL_USEC) {
+            cleanup = (qdr_delivery_cleanup_t*) sys_atomic_ptr_swap(&inbox->head, 0);
+            while (cleanup) {
+                qdr_delivery_cleanup_t *next = cleanup->next;
+                DEQ_ITEM_INIT(cleanup);
+                DEQ_INSERT_TAIL(unowned, cleanup);
+                cleanup = next;
+            }
+            inbox->first_push_usec = 0;
+            core->cleanup_inboxes_waiting--;
+        }
+
+        if (inbox->pending_top) {
+            void *head;
+            do {
+                head = sys_atomic_ptr_get(&inbox->head);
+                inbox->pending_bottom->next = (qdr_delivery_cleanup_t*) head;
+            } while (!sys_atomic_ptr_cas(&inbox->head, head, inbox->pending_top));
+
+            if (!head) {
+                if (!inbox->first_push_usec)
+                    core->cleanup_inboxes_waiting++;
+                inbox->first_push_usec = now ? now : qd_timer_now_usec();
+            }
+            inbox->pending_top    = 0;
+            inbox->pending_bottom = 0;
+        }
+    }
+
+    if (DEQ_SIZE(unowned) > 0) {
+        qdr_general_work_t *work = qdr_general_work(qdr_do_message_to_addr_free);
+        DEQ_MOVE(unowned, work->delivery_cleanup_list);
+        qdr_post_general_work_CT(core, work);
+    }
+}
+
+
+/**
+ * Microseconds until the oldest undrained cleanup inbox is due to be taken over, or
+ * -1 if no inbox is waiting.
+ */
+static int64_t qdr_cleanup_steal_due_CT(qdr_core_t *core)
+{
+    if (core->cleanup_inboxes_waiting == 0)
+        return -1;
+
+    int64_t now = qd_timer_now_usec();
+    int64_t due = -1;
+    for (int i = 0; i < core->cleanup_inbox_count; i++) {
+        int64_t first = core->cleanup_inbox[i].first_push_usec;
+        if (first) {
+            int64_t left = first + QDR_CLEANUP_STEAL_USEC - now;
+            if (left < 0)
+                left = 0;
+            if (due < 0 || left < due)
+                due = left;
+        }
+    }
+    return due;
+}
+
+
 void qdr_modules_init(qdr_core_t *core)
 {
     //
@@ -120,11 +282,289 @@ void qdr_modules_finalize(qdr_core_t *core)
 }
 
 
+/**
+ * Move everything on the lock-free action stack onto the per-class queues.
+ * Returns true if there is any pending work on the queues afterwards.
+ */
+static bool qdr_collect_actions_CT(qdr_core_t *core)
+{
+    qdr_action_t *action = (qdr_action_t*) sys_atomic_ptr_swap(&core->action_stack, 0);
+    qdr_action_t *fifo   = 0;
+
+    //
+    // The stack is in LIFO order.  Reverse it so the actions are queued in
+    // the order they were enqueued.
+    //
+    while (action) {
+        qdr_action_t *next = action->next;
+        action->next = fifo;
+        fifo   = action;
+        action = next;
+    }
+
+    while (fifo) {
+        qdr_action_t *next = fifo->next;
+        DEQ_ITEM_INIT(fifo);
+        DEQ_INSERT_TAIL(core->action_queue[fifo->action_class], fifo);
+        fifo = next;
+    }
+
+    size_t depth = 0;
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++)
+        depth += DEQ_SIZE(core->action_queue[cls]);
+    if (depth > core->action_depth_peak)
+        core->action_depth_peak = depth;
+    return depth > 0;
+}
+
+
+/**
+ * Find the statistics record for an action label, creating it on first use.
+ * Labels are string literals so they are keyed by address.
+ */
+static qdr_action_stats_t *qdr_action_stats_CT(qdr_core_t *core, const char *label)
+{
+    uintptr_t slot = ((uintptr_t) label >> 3) % QDR_ACTION_STATS_SLOTS;
+
+    for (int probe = 0; probe < QDR_ACTION_STATS_SLOTS; probe++) {
+        qdr_action_stats_t *stats = core->action_stats_by_label[slot];
+        if (!stats) {
+            stats = NEW(qdr_action_stats_t);
+            ZERO(stats);
+            stats->label = label;
+            DEQ_INSERT_TAIL(core->action_stats, stats);
+            core->action_stats_by_label[slot] = stats;
+            return stats;
+        }
+        if (stats->label == label)
+            return stats;
+        slot = (slot + 1) % QDR_ACTION_STATS_SLOTS;
+    }
+    return 0;
+}
+
+
+static void qdr_run_action_CT(qdr_core_t *core, qdr_action_t *action)
+{
+    if (action->label)
+        qd_log(core->log, QD_LOG_TRACE, "Core action '%s'%s", action->label, core->running ? "" : " (discard)");
+
+    if (core->action_trace && core->running)
+        qdr_action_trace_CT(core->action_trace, action);
+
+    if (core->action_stats_enabled && action->label) {
+        const char *label = action->label;
+        int64_t     start = qd_timer_now_usec();
+        uint64_t    queue = start > action->enqueue_usec ? start - action->enqueue_usec : 0;
+
+        action->action_handler(core, action, !core->running);
+
+        int64_t  end     = qd_timer_now_usec();
+        uint64_t service = end > start ? end - start : 0;
+
+        qdr_action_stats_t *stats = qdr_action_stats_CT(core, label);
+        if (stats) {
+            stats->count++;
+            stats->queue_usec_total   += queue;
+            stats->service_usec_total += service;
+            if (queue > stats->queue_usec_max)
+                stats->queue_usec_max = queue;
+            if (service > stats->service_usec_max)
+                stats->service_usec_max = service;
+            stats->queue_histogram[qdr_action_hist_bucket(queue)]++;
+            stats->service_histogram[qdr_action_hist_bucket(service)]++;
+        }
+    } else
+        action->action_handler(core, action, !core->running);
+
+    free_qdr_action_t(action);
+}
+
+
+/**
+ * Run queued actions in weighted round-robin order across the action classes.
+ * Each round first runs all of the router-control link actions, then gives
+ * every other class up to its weight in actions.  The pass ends when the
+ * queues are empty or the action budget has been spent, so that a flood of
+ * one kind of work can neither starve the other classes nor delay connection
+ * activation indefinitely.
+ */
+static void qdr_run_actions_CT(qdr_core_t *core)
+{
+    int  budget = core->action_budget;
+    bool more   = true;
+
+    while (more) {
+        more = false;
+
+        qdr_action_list_t *control = &core->action_queue[QDR_ACTION_CLASS_CONTROL_LINK];
+        qdr_action_t      *action;
+        while ((action = DEQ_HEAD(*control))) {
+            DEQ_REMOVE_HEAD(*control);
+            qdr_run_action_CT(core, action);
+            if (core->action_budget > 0 && --budget == 0)
+                return;
+        }
+
+        for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++) {
+            if (cls == QDR_ACTION_CLASS_CONTROL_LINK)
+                continue;
+
+            qdr_action_list_t *queue   = &core->action_queue[cls];
+            int                quantum = core->action_weight[cls];
+            action = DEQ_HEAD(*queue);
+
+            while (action && quantum > 0) {
+                DEQ_REMOVE_HEAD(*queue);
+                qdr_run_action_CT(core, action);
+                quantum--;
+                if (core->action_budget > 0 && --budget == 0)
+                    return;
+                action = DEQ_HEAD(*queue);
+            }
+
+            if (action)
+                more = true;
+        }
+    }
+}
+
+
+static inline void qdr_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+
+#define QDR_SPIN_PAUSE_MAX 64
+
+/**
+ * Busy-poll the action stack before parking.  The poll backs off exponentially
+ * with CPU pause hints and, once the back-off saturates, yields the processor
+ * between polls so a spinning core does not starve an I/O thread sharing its CPU.
+ *
+ * The spin lasts up to core->action_spin_usec microseconds while spins keep
+ * catching work, and shrinks towards a sixteenth of that as more of them end
+ * in a park anyway.  Returns true if work arrived.
+ */
+static bool qdr_spin_for_actions_CT(qdr_core_t *core)
+{
+    int64_t deadline = qd_timer_now_usec() + core->action_spin_window;
+    int     pauses   = 1;
+    bool    caught   = false;
+
+    while (core->running) {
+        if (sys_atomic_ptr_get(&core->action_stack) != 0) {
+            caught = true;
+            break;
+        }
+
+        if (pauses < QDR_SPIN_PAUSE_MAX) {
+            for (int i = 0; i < pauses; i++)
+                qdr_cpu_relax();
+            pauses <<= 1;
+        } else {
+            sched_yield();
+            if (qd_timer_now_usec() >= deadline)
+                break;
+        }
+    }
+
+    int rate = core->action_spin_hit_rate;
+    rate += ((caught ? QDR_SPIN_RATE_ONE : 0) - rate) / 8;
+    core->action_spin_hit_rate = rate;
+
+    int floor  = core->action_spin_usec / 16 > 0 ? core->action_spin_usec / 16 : 1;
+    int window = (int) (((int64_t) core->action_spin_usec * rate) / QDR_SPIN_RATE_ONE);
+    core->action_spin_window = window > floor ? window : floor;
+    return caught;
+}
+
+
+#define ARENA_BLOCK_SIZE  (64 * 1024)
+#define ARENA_ALIGN       16
+#define ARENA_ROUND(s)    (((s) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define ARENA_DATA(b)     ((char*) (b) + ARENA_ROUND(sizeof(qdr_arena_block_t)))
+
+void *qdr_arena_alloc_CT(qdr_core_t *core, size_t size)
+{
+    qdr_arena_t       *arena = &core->arena;
+    qdr_arena_block_t *block = arena->current;
+
+    size = ARENA_ROUND(size);
+
+    //
+    // Move on to the next retained block, or add one, when the current block is full.
+    // An oversized request gets a block of its own.
+    //
+    while (!block || block->used + size > block->size) {
+        qdr_arena_block_t *next = block ? block->next : arena->head;
+        if (next && next->size >= size) {
+            block = next;
+            block->used = 0;
+            continue;
+        }
+
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        qdr_arena_block_t *fresh = (qdr_arena_block_t*) malloc(ARENA_ROUND(sizeof(qdr_arena_block_t)) + capacity);
+        if (!fresh)
+            return 0;
+        fresh->size = capacity;
+        fresh->used = 0;
+        fresh->next = next;
+        if (block)
+            block->next = fresh;
+        else
+            arena->head = fresh;
+        block = fresh;
+    }
+
+    arena->current = block;
+    void *p = ARENA_DATA(block) + block->used;
+    block->used += size;
+    return p;
+}
+
+
+void qdr_arena_reset_CT(qdr_core_t *core)
+{
+    qdr_arena_t *arena = &core->arena;
+    if (arena->head) {
+        arena->head->used = 0;
+        arena->current    = arena->head;
+    }
+}
+
+
+void qdr_arena_free(qdr_arena_t *arena)
+{
+    qdr_arena_block_t *block = arena->head;
+    while (block) {
+        qdr_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head    = 0;
+    arena->current = 0;
+}
+
+
 void *router_core_thread(void *arg)
 {
-    qdr_core_t        *core = (qdr_core_t*) arg;
-    qdr_action_list_t  action_list;
-    qdr_action_t      *action;
+    qdr_core_t *core = (qdr_core_t*) arg;
+
+    const char *cpus = core->qd->core_thread_cpus;
+    if (cpus) {
+        int rc = sys_thread_set_affinity(cpus);
+        if (rc)
+            qd_log(core->log, QD_LOG_WARNING, "Unable to bind the router core thread to CPUs '%s': %s", cpus, strerror(rc));
+        else
+            qd_log(core->log, QD_LOG_INFO, "Router core thread bound to CPUs '%s'", cpus);
+    }
 
     qdr_forwarder_setup_CT(core);
     qdr_route_table_setup_CT(core);
@@ -135,50 +575,103 @@ void *router_core_thread(void *arg)
     qd_log(core->log, QD_LOG_INFO, "Router Core thread running. %s/%s", core->router_area, core->router_id);
     while (core->running) {
         //
-        // Use the lock only to protect the condition variable and the action list
+        // Take the entire stack of pending actions in one atomic operation
         //
-        sys_mutex_lock(core->action_lock);
+        if (!qdr_collect_actions_CT(core)) {
+            //
+            // In busy-poll mode, spin for a while before giving up the CPU.
+            //
+            if (core->action_spin_usec > 0 && qdr_spin_for_actions_CT(core))
+                continue;
+
+            //
+            // Nothing to do.  Announce that we are parking before re-checking the
+            // stack so a producer that pushes concurrently will see the flag and
+            // signal the condition variable.  If settlements are being held, wake
+            // up no later than the end of the oldest window, and if a cleanup inbox
+            // is undrained, no later than it is due to be taken over.
+            //
+            int64_t hold_usec  = qdr_release_held_settlements_CT(core);
+            int64_t timer_usec = qdr_run_core_timers_CT(core);
+            if (timer_usec >= 0 && (hold_usec < 0 || timer_usec < hold_usec))
+                hold_usec = timer_usec;
+            qdr_post_delivery_cleanup_CT(core);
+            int64_t steal_usec = qdr_cleanup_steal_due_CT(core);
+            if (steal_usec >= 0 && (hold_usec < 0 || steal_usec < hold_usec))
+                hold_usec = steal_usec;
+            if (DEQ_SIZE(core->connections_to_activate) > 0) {
+                qdr_activate_connections_CT(core);
+                continue;
+            }
+
+            core->action_park_count++;
+            sys_mutex_lock(core->action_lock);
+            sys_atomic_set(&core->action_sleeping, 1);
+            if (hold_usec >= 0) {
+                if (core->running && sys_atomic_ptr_get(&core->action_stack) == 0)
+                    sys_cond_timedwait(core->action_cond, core->action_lock, hold_usec);
+            } else {
+                while (core->running && sys_atomic_ptr_get(&core->action_stack) == 0)
+                    sys_cond_wait(core->action_cond, core->action_lock);
+            }
+            sys_atomic_set(&core->action_sleeping, 0);
+            sys_mutex_unlock(core->action_lock);
+
+            if (!qdr_collect_actions_CT(core))
+                continue;
+        }
 
         //
-        // Block on the condition variable when there is no action to do
+        // Process and free up to one budget's worth of queued actions
         //
-        while (core->running && DEQ_IS_EMPTY(core->action_list))
-            sys_cond_wait(core->action_cond, core->action_lock);
+        qdr_run_actions_CT(core);
+        qdr_run_core_timers_CT(core);
 
         //
-        // Move the entire action list to a private list so we can process it without
-        // holding the lock
+        // Hand other threads one new configuration snapshot for all the pattern changes above
         //
-        DEQ_MOVE(core->action_list, action_list);
-        sys_mutex_unlock(core->action_lock);
+        qdr_config_snapshot_publish_CT(core);
 
         //
-        // Process and free all of the action items in the list
+        // Activate all connections that were flagged for activation during the above processing.
+        // With activation batching, hold the activations while more work is pending until the
+        // batch interval has passed.  Activations are never held across a park.
         //
-        action = DEQ_HEAD(action_list);
-        while (action) {
-            DEQ_REMOVE_HEAD(action_list);
-            if (action->label)
-                qd_log(core->log, QD_LOG_TRACE, "Core action '%s'%s", action->label, core->running ? "" : " (discard)");
-            action->action_handler(core, action, !core->running);
-            free_qdr_action_t(action);
-            action = DEQ_HEAD(action_list);
+        qdr_release_held_settlements_CT(core);
+        if (core->activation_batch_usec == 0 || !qdr_actions_pending_CT(core)) {
+            qdr_activate_connections_CT(core);
+        } else if (DEQ_SIZE(core->connections_to_activate) > 0) {
+            int64_t now = qd_timer_now_usec();
+            if (now - core->last_activation_usec >= core->activation_batch_usec) {
+                qdr_activate_connections_CT(core);
+                core->last_activation_usec = now;
+            }
         }
 
         //
-        // Activate all connections that were flagged for activation during the above processing
+        // Schedule the cleanup of deliveries freed during this core-thread pass
         //
-        qdr_activate_connections_CT(core);
+        qdr_post_delivery_cleanup_CT(core);
 
         //
-        // Schedule the cleanup of deliveries freed during this core-thread pass
+        // Objects allocated from the arena during this pass are dead now
         //
-        if (DEQ_SIZE(core->delivery_cleanup_list) > 0) {
-            qdr_general_work_t *work = qdr_general_work(qdr_do_message_to_addr_free);
-            DEQ_MOVE(core->delivery_cleanup_list, work->delivery_cleanup_list);
-            qdr_post_general_work_CT(core, work);
+        qdr_arena_reset_CT(core);
+    }
+
+    //
+    // Discard whatever is still queued
+    //
+    qdr_collect_actions_CT(core);
+    for (int cls = 0; cls < QDR_ACTION_CLASSES; cls++) {
+        qdr_action_t *action = DEQ_HEAD(core->action_queue[cls]);
+        while (action) {
+            DEQ_REMOVE_HEAD(core->action_queue[cls]);
+            qdr_run_action_CT(core, action);
+            action = DEQ_HEAD(core->action_queue[cls]);
         }
     }
+    qdr_post_delivery_cleanup_CT(core);
 
     qd_log(core->log, QD_LOG_INFO, "Router Core thread exited");
     return 0;
@@ -19,14 +19,22 @@
 
 #include "router_core_private.h"
 #include "exchange_bindings.h"
+#include "trace_ring.h"
+#include "probes.h"
 #include <qpid/dispatch/amqp.h>
 #include <stdio.h>
 #include <inttypes.h>
 
+//
+// The most deliveries one vector of disposition updates carries to the core
+//
+#define QDR_DISPOSITION_VECTOR_MAX 256
+
 static void qdr_link_deliver_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_link_flow_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_send_to_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_update_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
+static void qdr_update_deliveries_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_delete_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 static void qdr_deliver_continue_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 
@@ -42,29 +50,50 @@ void qdr_delivery_copy_extension_state(qdr_delivery_t *src, qdr_delivery_t *dest
 // Interface Functions
 //==================================================================================
 
-qdr_delivery_t *qdr_link_deliver(qdr_link_t *link, qd_message_t *msg, qd_iterator_t *ingress,
-                                 bool settled, qd_bitmask_t *link_exclusion, int ingress_index)
+//
+// Build the link_deliver action for a newly arrived delivery.  The new delivery
+// holds one reference, which belongs to the action.
+//
+static qdr_action_t *qdr_link_deliver_action(qdr_link_t *link, qd_message_t *msg,
+                                             qd_iterator_t *ingress, qd_iterator_t *addr,
+                                             bool settled, qd_bitmask_t *link_exclusion, int ingress_index)
 {
     qdr_action_t   *action = qdr_action(qdr_link_deliver_CT, "link_deliver");
     qdr_delivery_t *dlv    = new_qdr_delivery_t();
 
+    action->action_class = qdr_link_action_class(link);
+
     ZERO(dlv);
     dlv->link           = link;
     dlv->msg            = msg;
-    dlv->to_addr        = 0;
+    dlv->to_addr        = addr;
     dlv->origin         = ingress;
     dlv->settled        = settled;
     dlv->presettled     = settled;
     dlv->link_exclusion = link_exclusion;
     dlv->ingress_index  = ingress_index;
+    dlv->owner_thread   = qd_server_thread_index();
     dlv->error          = 0;
     dlv->disposition    = 0;
+    dlv->ingress_usec   = link->core->delivery_latency_stats ? qd_timer_now_usec() : 0;
 
     qdr_delivery_incref(dlv, "qdr_link_deliver - newly created delivery, add to action list");
-    qdr_delivery_incref(dlv, "qdr_link_deliver - protect returned value");
+    QD_TRACE_EVENT(QD_TRACE_RECEIVE, qd_message_trace_id(msg), dlv, link->conn ? link->conn->identity : 0, link->identity);
+    qd_server_count_delivery(true);
 
     action->args.connection.delivery = dlv;
     action->args.connection.more = !qd_message_receive_complete(msg);
+    return action;
+}
+
+
+qdr_delivery_t *qdr_link_deliver(qdr_link_t *link, qd_message_t *msg, qd_iterator_t *ingress,
+                                 bool settled, qd_bitmask_t *link_exclusion, int ingress_index)
+{
+    qdr_action_t   *action = qdr_link_deliver_action(link, msg, ingress, 0, settled, link_exclusion, ingress_index);
+    qdr_delivery_t *dlv    = action->args.connection.delivery;
+
+    qdr_delivery_incref(dlv, "qdr_link_deliver - protect returned value");
     qdr_action_enqueue(link->core, action);
     return dlv;
 }
@@ -74,31 +103,104 @@ qdr_delivery_t *qdr_link_deliver_to(qdr_link_t *link, qd_message_t *msg,
                                     qd_iterator_t *ingress, qd_iterator_t *addr,
                                     bool settled, qd_bitmask_t *link_exclusion, int ingress_index)
 {
-    qdr_action_t   *action = qdr_action(qdr_link_deliver_CT, "link_deliver");
-    qdr_delivery_t *dlv    = new_qdr_delivery_t();
+    qdr_action_t   *action = qdr_link_deliver_action(link, msg, ingress, addr, settled, link_exclusion, ingress_index);
+    qdr_delivery_t *dlv    = action->args.connection.delivery;
 
-    ZERO(dlv);
-    dlv->link           = link;
-    dlv->msg            = msg;
-    dlv->to_addr        = addr;
-    dlv->origin         = ingress;
-    dlv->settled        = settled;
-    dlv->presettled     = settled;
-    dlv->link_exclusion = link_exclusion;
-    dlv->ingress_index  = ingress_index;
-    dlv->error          = 0;
-    dlv->disposition    = 0;
-
-    qdr_delivery_incref(dlv, "qdr_link_deliver_to - newly created delivery, add to action list");
     qdr_delivery_incref(dlv, "qdr_link_deliver_to - protect returned value");
-
-    action->args.connection.delivery = dlv;
-    action->args.connection.more = !qd_message_receive_complete(msg);
     qdr_action_enqueue(link->core, action);
     return dlv;
 }
 
 
+void qdr_link_deliver_presettled(qdr_link_t *link, qd_message_t *msg,
+                                 qd_iterator_t *ingress, qd_iterator_t *addr,
+                                 qd_bitmask_t *link_exclusion, int ingress_index)
+{
+    assert(qd_message_receive_complete(msg));
+
+    //
+    // Nothing will ever come back for this delivery, so the core's action reference
+    // is the only one it needs.
+    //
+    qdr_action_enqueue(link->core, qdr_link_deliver_action(link, msg, ingress, addr, true, link_exclusion, ingress_index));
+}
+
+
+//
+// Put a pre-settled, fully received delivery straight onto the peer of an
+// attach-routed link from the receiving I/O thread, much as qdr_link_deliver_CT
+// and qdr_forward_deliver_CT would, so that the core plays no part in it.
+// Returns false if the core has to forward the delivery: the link has lost its
+// peer, or the peer is at capacity and its drop policy applies.
+//
+// Holding core->link_route_lock keeps the core from unlinking and freeing the
+// peer.  The delivery needs no peer linkage, as no disposition will follow it.
+// The peer's credit_available is left alone; the core does not use it for
+// attach-routed links.  The direct delivery counters are updated atomically,
+// as the core thread reads them without the lock.
+//
+static bool qdr_link_deliver_direct(qdr_link_t *link, qdr_delivery_t *in_dlv, const uint8_t *tag, int tag_length)
+{
+    qdr_core_t *core   = link->core;
+    bool        direct = false;
+
+    sys_mutex_lock(core->link_route_lock);
+    qdr_link_t       *out_link = link->connected_link;
+    qdr_connection_t *conn     = out_link ? out_link->conn : 0;
+    if (conn && !out_link->core_endpoint) {
+        sys_mutex_lock(conn->work_lock);
+        if (out_link->capacity == 0 || DEQ_SIZE(out_link->undelivered) < out_link->capacity) {
+            qdr_delivery_t *out_dlv = new_qdr_delivery_t();
+            ZERO(out_dlv);
+            out_dlv->link          = out_link;
+            out_dlv->msg           = qd_message_copy(in_dlv->msg);
+            out_dlv->settled       = true;
+            out_dlv->presettled    = true;
+            out_dlv->ingress_time  = in_dlv->ingress_time;
+            out_dlv->owner_thread  = in_dlv->owner_thread;
+            out_dlv->tag_length    = tag_length;
+            memcpy(out_dlv->tag, tag, tag_length);
+            qd_message_add_fanout(in_dlv->msg);
+            qdr_delivery_copy_extension_state(in_dlv, out_dlv, true);
+
+            DEQ_INSERT_TAIL(out_link->undelivered, out_dlv);
+            out_dlv->where = QDR_DELIVERY_IN_UNDELIVERED;
+            qdr_delivery_incref(out_dlv, "qdr_link_deliver_direct - add to undelivered list");
+
+            qdr_link_work_t *work = DEQ_TAIL(out_link->work_list);
+            if (work && work->work_type == QDR_LINK_WORK_DELIVERY) {
+                work->value++;
+            } else {
+                work = new_qdr_link_work_t();
+                ZERO(work);
+                work->work_type = QDR_LINK_WORK_DELIVERY;
+                work->value     = 1;
+                DEQ_INSERT_TAIL(out_link->work_list, work);
+            }
+            qdr_add_link_ref(qdr_connection_work_links(conn, out_link->priority), out_link, QDR_LINK_LIST_CLASS_WORK);
+            out_dlv->link_work = work;
+
+            if (conn->user_context && sys_atomic_set(&conn->wake_pending, 1) == 0)
+                core->activate_handler(core->user_context, conn);
+            direct = true;
+        }
+        sys_mutex_unlock(conn->work_lock);
+
+        if (direct) {
+            __atomic_fetch_add(&link->direct_deliveries, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&core->deliveries_direct_ingress, 1, __ATOMIC_RELAXED);
+            if (conn->role == QDR_ROLE_INTER_ROUTER || conn->role == QDR_ROLE_INTER_ROUTER_DATA)
+                __atomic_fetch_add(&core->deliveries_direct_transit, 1, __ATOMIC_RELAXED);
+            else
+                __atomic_fetch_add(&core->deliveries_direct_egress, 1, __ATOMIC_RELAXED);
+        }
+    }
+    sys_mutex_unlock(core->link_route_lock);
+
+    return direct;
+}
+
+
 qdr_delivery_t *qdr_link_deliver_to_routed_link(qdr_link_t *link, qd_message_t *msg, bool settled,
                                                 const uint8_t *tag, int tag_length,
                                                 uint64_t disposition, pn_data_t* disposition_data)
@@ -106,23 +208,36 @@ qdr_delivery_t *qdr_link_deliver_to_routed_link(qdr_link_t *link, qd_message_t *
     if (tag_length > 32)
         return 0;
     
-    qdr_action_t   *action = qdr_action(qdr_link_deliver_CT, "link_deliver");
-    qdr_delivery_t *dlv    = new_qdr_delivery_t();
+    qdr_delivery_t *dlv = new_qdr_delivery_t();
 
     ZERO(dlv);
     dlv->link         = link;
     dlv->msg          = msg;
     dlv->settled      = settled;
     dlv->presettled   = settled;
+    dlv->owner_thread = qd_server_thread_index();
     dlv->error        = 0;
     dlv->disposition  = 0;
+    dlv->ingress_time = link->core->uptime_ticks;
 
     qdr_delivery_read_extension_state(dlv, disposition, disposition_data, true);
-    qdr_delivery_incref(dlv, "qdr_link_deliver_to_routed_link - newly created delivery, add to action list");
     qdr_delivery_incref(dlv, "qdr_link_deliver_to_routed_link - protect returned value");
 
+    //
+    // Pre-settled deliveries bypass the core until one has to go through it;
+    // from then on they all do, so that none overtakes one the core still holds.
+    //
+    bool more = !qd_message_receive_complete(msg);
+    if (settled && !more && !link->routed_via_core && qdr_link_deliver_direct(link, dlv, tag, tag_length))
+        return dlv;
+    link->routed_via_core = true;
+
+    qdr_action_t *action = qdr_action(qdr_link_deliver_CT, "link_deliver");
+    action->action_class = qdr_link_action_class(link);
+    qdr_delivery_incref(dlv, "qdr_link_deliver_to_routed_link - newly created delivery, add to action list");
+
     action->args.connection.delivery = dlv;
-    action->args.connection.more = !qd_message_receive_complete(msg);
+    action->args.connection.more = more;
     action->args.connection.tag_length = tag_length;
     memcpy(action->args.connection.tag, tag, tag_length);
     qdr_action_enqueue(link->core, action);
@@ -130,13 +245,57 @@ qdr_delivery_t *qdr_link_deliver_to_routed_link(qdr_link_t *link, qd_message_t *
 }
 
 
+//
+// Wake the connections of a streaming delivery's peers from the receiving I/O thread.
+// Returns false if the core has not yet given the delivery any peers, in which case
+// the core has to be told.
+//
+static bool qdr_deliver_continue_direct(qdr_core_t *core, qdr_delivery_t *in_dlv)
+{
+    bool direct = false;
+
+    sys_mutex_lock(core->stream_lock);
+    for (int i = 0; i < in_dlv->stream_peer_count; i++) {
+        qdr_delivery_t   *peer = in_dlv->stream_peers[i].dlv;
+        qdr_link_t       *link = in_dlv->stream_peers[i].link;
+        qdr_connection_t *conn = link->conn;
+
+        //
+        // As in qdr_deliver_continue_peers_CT, the peer's link work must be at the head
+        // of its link's work list for the connection to be worth waking.
+        //
+        sys_mutex_lock(conn->work_lock);
+        qdr_link_work_t *work = peer->link_work;
+        if (work && (work->processing || work == DEQ_HEAD(link->work_list))) {
+            qdr_add_link_ref(qdr_connection_work_links(conn, 0), link, QDR_LINK_LIST_CLASS_WORK);
+            if (conn->user_context && sys_atomic_set(&conn->wake_pending, 1) == 0)
+                core->activate_handler(core->user_context, conn);
+        }
+        sys_mutex_unlock(conn->work_lock);
+        direct = true;
+    }
+    sys_mutex_unlock(core->stream_lock);
+
+    return direct;
+}
+
+
 qdr_delivery_t *qdr_deliver_continue(qdr_delivery_t *in_dlv)
 {
+    qd_message_t *msg  = qdr_delivery_message(in_dlv);
+    bool          more = !qd_message_receive_complete(msg);
+
+    //
+    // Once the core has forwarded a streaming delivery, the rest of the message goes to
+    // the peers without it.  Only completion and abort go through the core.
+    //
+    if (more && qdr_deliver_continue_direct(in_dlv->link->core, in_dlv))
+        return in_dlv;
+
     qdr_action_t   *action = qdr_action(qdr_deliver_continue_CT, "deliver_continue");
+    action->action_class = qdr_link_action_class(in_dlv->link);
     action->args.connection.delivery = in_dlv;
-
-    qd_message_t *msg = qdr_delivery_message(in_dlv);
-    action->args.connection.more = !qd_message_receive_complete(msg);
+    action->args.connection.more = more;
 
     // This incref is for the action reference
     qdr_delivery_incref(in_dlv, "qdr_deliver_continue - add to action list");
@@ -150,8 +309,6 @@ int qdr_link_process_deliveries(qdr_core_t *core, qdr_link_t *link, int credit)
     qdr_connection_t *conn = link->conn;
     qdr_delivery_t   *dlv;
     int               offer   = -1;
-    bool              settled = false;
-    bool              send_complete = false;
     int               num_deliveries_completed = 0;
 
     if (link->link_direction == QD_OUTGOING) {
@@ -161,69 +318,127 @@ int qdr_link_process_deliveries(qdr_core_t *core, qdr_link_t *link, int credit)
             return 0;
 
         while (credit > 0) {
+            qdr_delivery_t *batch[QDR_LINK_DELIVERY_BATCH];
+            bool            settled[QDR_LINK_DELIVERY_BATCH];
+            bool            release[QDR_LINK_DELIVERY_BATCH];
+            bool            expired[QDR_LINK_DELIVERY_BATCH];
+            uint64_t        new_disp[QDR_LINK_DELIVERY_BATCH];
+            int             limit = credit < QDR_LINK_DELIVERY_BATCH ? credit : QDR_LINK_DELIVERY_BATCH;
+            int             count = 0;
+            int             sent  = 0;
+
+            //
+            // Note the deliveries at the head of the undelivered list that the credit
+            // allows, visiting the lock only once.  They stay on the list while they are
+            // sent, and are referenced here in case the core cleans up the link meanwhile.
+            //
             sys_mutex_lock(conn->work_lock);
-            dlv = DEQ_HEAD(link->undelivered);
+            for (dlv = DEQ_HEAD(link->undelivered); dlv && count < limit; dlv = DEQ_NEXT(dlv)) {
+                qdr_delivery_incref(dlv, "qdr_link_process_deliveries - batched for sending");
+                batch[count++] = dlv;
+            }
             sys_mutex_unlock(conn->work_lock);
-            if (dlv) {
-                settled = dlv->settled;
-                uint64_t new_disp = core->deliver_handler(core->user_context, link, dlv, settled);
-                sys_mutex_lock(conn->work_lock);
-                send_complete = qdr_delivery_send_complete(dlv);
-                if (send_complete) {
-                    //
-                    // The entire message has been sent. It is now the appropriate time to have the delivery removed
-                    // from the head of the undelivered list and move it to the unsettled list if it is not settled.
-                    //
-                    num_deliveries_completed++;
 
+            if (count == 0)
+                break;
+
+            //
+            // Send them in order.  A delivery whose message is still being received or
+            // sent must stay at the head of the undelivered list, and the deliveries
+            // behind it have to wait until it has been sent out entirely.
+            //
+            bool send_complete = true;
+            while (sent < count) {
+                dlv = batch[sent];
+                settled[sent]  = dlv->settled;
+
+                //
+                // A message that expired while it was queued is not sent, provided none
+                // of it has gone out yet.  It uses no credit, and the core releases it
+                // if it is unsettled.
+                //
+                expired[sent] = link->link_type != QD_LINK_CONTROL && !qd_message_tag_sent(dlv->msg) && qdr_delivery_expired(dlv);
+                if (expired[sent]) {
+                    new_disp[sent] = settled[sent] ? 0 : PN_RELEASED;
+                    sent++;
+                    continue;
+                }
+
+                if (dlv->ingress_usec && !dlv->send_usec)
+                    dlv->send_usec = qd_timer_now_usec();
+                new_disp[sent] = core->deliver_handler(core->user_context, link, dlv, settled[sent]);
+                send_complete  = qdr_delivery_send_complete(dlv);
+                if (!send_complete)
+                    break;
+                QD_TRACE_EVENT(QD_TRACE_SEND, qd_message_trace_id(dlv->msg), dlv, conn->identity, link->identity);
+                qd_server_count_delivery(false);
+                sent++;
+            }
+
+            //
+            // The entire messages have been sent.  Remove the deliveries from the head
+            // of the undelivered list and move them to the unsettled list if they are
+            // not settled, again under a single visit to the lock.
+            //
+            sys_mutex_lock(conn->work_lock);
+            for (int i = 0; i < sent; i++) {
+                dlv = batch[i];
+                num_deliveries_completed++;
+
+                if (!expired[i]) {
                     credit--;
                     link->credit_to_core--;
                     link->total_deliveries++;
-                    offer = DEQ_SIZE(link->undelivered);
-
-                    if (offer == 0) {
-                        sys_mutex_unlock(conn->work_lock);
-                        return num_deliveries_completed;
-                    }
-
-                    DEQ_REMOVE_HEAD(link->undelivered);
-                    dlv->link_work = 0;
-
-                    if (settled) {
-                        dlv->where = QDR_DELIVERY_NOWHERE;
-                        qdr_delivery_decref(core, dlv, "qdr_link_process_deliveries - remove from undelivered list");
-                    } else {
-                        DEQ_INSERT_TAIL(link->unsettled, dlv);
-                        dlv->where = QDR_DELIVERY_IN_UNSETTLED;
-                        qd_log(core->log, QD_LOG_DEBUG, "Delivery transfer:  dlv:%lx qdr_link_process_deliveries: undelivered-list -> unsettled-list", (long) dlv);
-                    }
                 }
-                else {
-                    //
-                    // The message is still being received/sent.
-                    // 1. We cannot remove the delivery from the undelivered list.
-                    //    This delivery needs to stay at the head of the undelivered list until the entire message
-                    //    has been sent out i.e other deliveries in the undelivered list have to wait before this
-                    //    entire large delivery is sent out
-                    // 2. We need to call deliver_handler so any newly arrived bytes can be pushed out
-                    // 3. We need to break out of this loop otherwise a thread will keep spinning in here until
-                    //    the entire message has been sent out.
-                    //
-                    sys_mutex_unlock(conn->work_lock);
-
-                    //
-                    // Note here that we are not incrementing num_deliveries_processed. Since this delivery is
-                    // still coming in or still being sent out, we cannot consider this delivery as fully processed.
-                    //
-                    return num_deliveries_completed;
+                offer = DEQ_SIZE(link->undelivered);
+
+                release[i] = false;
+                if (DEQ_HEAD(link->undelivered) != dlv) {
+                    // The core took the delivery off the link while it was being sent
+                    new_disp[i] = 0;
+                    continue;
                 }
-                sys_mutex_unlock(conn->work_lock);
+
+                DEQ_REMOVE_HEAD(link->undelivered);
+                dlv->link_work = 0;
+                if (expired[i])
+                    dlv->expired = true;
+
+                if (settled[i]) {
+                    dlv->where = QDR_DELIVERY_NOWHERE;
+                    release[i] = true;
+                } else {
+                    DEQ_INSERT_TAIL(link->unsettled, dlv);
+                    dlv->where = QDR_DELIVERY_IN_UNSETTLED;
+                    qd_log(core->log, QD_LOG_DEBUG, "Delivery transfer:  dlv:%lx qdr_link_process_deliveries: undelivered-list -> unsettled-list", (long) dlv);
+                }
+            }
+            sys_mutex_unlock(conn->work_lock);
+
+            for (int i = 0; i < sent; i++) {
+                if (!expired[i])
+                    conn->priority_bytes[link->priority] += qd_message_octets_sent(batch[i]->msg);
 
                 // the core will need to update the delivery's disposition
-                if (new_disp)
+                if (new_disp[i])
                     qdr_delivery_update_disposition(((qd_router_t *)core->user_context)->router_core,
-                                                    dlv, new_disp, true, 0, 0, false);
-            } else
+                                                    batch[i], new_disp[i], true, 0, 0, false);
+                if (release[i])
+                    qdr_delivery_decref(core, batch[i], "qdr_link_process_deliveries - remove from undelivered list");
+            }
+
+            for (int i = 0; i < count; i++)
+                qdr_delivery_decref(core, batch[i], "qdr_link_process_deliveries - batch sent");
+
+            if (!send_complete) {
+                //
+                // Note here that we are not counting the partially sent delivery.  Since it is
+                // still coming in or still being sent out, we cannot consider it fully processed.
+                //
+                return num_deliveries_completed;
+            }
+
+            if (count < limit)
                 break;
         }
 
@@ -252,6 +467,7 @@ void qdr_link_flow(qdr_core_t *core, qdr_link_t *link, int credit, bool drain_mo
         link->credit_to_core += credit;
     }
 
+    action->action_class           = qdr_link_action_class(link);
     action->args.connection.link   = link;
     action->args.connection.credit = credit;
     action->args.connection.drain  = drain_mode;
@@ -267,6 +483,7 @@ void qdr_send_to1(qdr_core_t *core, qd_message_t *msg, qd_iterator_t *addr, bool
     action->args.io.message           = qd_message_copy(msg);
     action->args.io.exclude_inprocess = exclude_inprocess;
     action->args.io.control           = control;
+    action->action_class              = control ? QDR_ACTION_CLASS_CONTROL : QDR_ACTION_CLASS_DATA;
 
     qdr_action_enqueue(core, action);
 }
@@ -279,6 +496,7 @@ void qdr_send_to2(qdr_core_t *core, qd_message_t *msg, const char *addr, bool ex
     action->args.io.message           = qd_message_copy(msg);
     action->args.io.exclude_inprocess = exclude_inprocess;
     action->args.io.control           = control;
+    action->action_class              = control ? QDR_ACTION_CLASS_CONTROL : QDR_ACTION_CLASS_DATA;
 
     qdr_action_enqueue(core, action);
 }
@@ -288,6 +506,8 @@ void qdr_delivery_update_disposition(qdr_core_t *core, qdr_delivery_t *delivery,
                                      bool settled, qdr_error_t *error, pn_data_t *ext_state, bool ref_given)
 {
     qdr_action_t *action = qdr_action(qdr_update_delivery_CT, "update_delivery");
+    if (delivery->link)
+        action->action_class = qdr_link_action_class(delivery->link);
     action->args.delivery.delivery    = delivery;
     action->args.delivery.disposition = disposition;
     action->args.delivery.settled     = settled;
@@ -308,6 +528,92 @@ void qdr_delivery_update_disposition(qdr_core_t *core, qdr_delivery_t *delivery,
 }
 
 
+//
+// Add one update to a vector of disposition updates, extending the last range if the
+// update comes from the same link with the same outcome.  Updates that carry an error
+// always get a range of their own so each error has a single owner.
+//
+static void qdr_disposition_vector_add(qdr_action_t *action, qdr_delivery_t *delivery, qdr_link_t *link,
+                                       uint64_t disposition, bool settled, qdr_error_t *error)
+{
+    if (action->args.dispositions.count == action->args.dispositions.capacity) {
+        action->args.dispositions.capacity *= 2;
+        action->args.dispositions.deliveries = (qdr_delivery_t**)
+            realloc(action->args.dispositions.deliveries,
+                    action->args.dispositions.capacity * sizeof(qdr_delivery_t*));
+    }
+
+    int index = action->args.dispositions.count++;
+    action->args.dispositions.deliveries[index] = delivery;
+
+    if (action->args.dispositions.range_count > 0) {
+        qdr_disposition_range_t *range = &action->args.dispositions.ranges[action->args.dispositions.range_count - 1];
+        if (!error && !range->error && range->link == link
+            && range->disposition == disposition && range->settled == settled) {
+            range->count++;
+            return;
+        }
+    }
+
+    if (action->args.dispositions.range_count == action->args.dispositions.range_capacity) {
+        action->args.dispositions.range_capacity *= 2;
+        action->args.dispositions.ranges = (qdr_disposition_range_t*)
+            realloc(action->args.dispositions.ranges,
+                    action->args.dispositions.range_capacity * sizeof(qdr_disposition_range_t));
+    }
+
+    qdr_disposition_range_t *range = &action->args.dispositions.ranges[action->args.dispositions.range_count++];
+    range->link        = link;
+    range->disposition = disposition;
+    range->error       = error;
+    range->settled     = settled;
+    range->first       = index;
+    range->count       = 1;
+}
+
+
+void qdr_delivery_update_dispositions(qdr_core_t *core, qdr_delivery_t *delivery, uint64_t disposition,
+                                      bool settled, qdr_error_t *error, pn_data_t *ext_state)
+{
+    qdr_link_t *link = delivery->link;
+
+    //
+    // Outside of an I/O thread's action batch there is nothing to aggregate with.
+    // Router-control links keep their own action class and are not aggregated.
+    //
+    if (!link || !qdr_action_batch_active(core) || link->link_type == QD_LINK_CONTROL) {
+        qdr_delivery_update_disposition(core, delivery, disposition, settled, error, ext_state, false);
+        return;
+    }
+
+    qdr_delivery_read_extension_state(delivery, disposition, ext_state, false);
+    qdr_delivery_incref(delivery, "qdr_delivery_update_dispositions - add to action vector");
+
+    //
+    // Join the vector at the top of this thread's batch if it belongs to the same
+    // connection.  Because nothing has been issued after it, the core still sees
+    // every action in the order the thread issued it.
+    //
+    qdr_action_t *action = qdr_action_batch_top(core);
+    if (action && action->action_handler == qdr_update_deliveries_CT
+        && action->args.dispositions.conn == link->conn
+        && action->args.dispositions.count < QDR_DISPOSITION_VECTOR_MAX) {
+        qdr_disposition_vector_add(action, delivery, link, disposition, settled, error);
+        return;
+    }
+
+    action = qdr_action(qdr_update_deliveries_CT, "update_deliveries");
+    action->args.dispositions.conn           = link->conn;
+    action->args.dispositions.capacity       = 16;
+    action->args.dispositions.deliveries     = NEW_PTR_ARRAY(qdr_delivery_t, 16);
+    action->args.dispositions.range_capacity = 4;
+    action->args.dispositions.ranges         = NEW_ARRAY(qdr_disposition_range_t, 4);
+    qdr_disposition_vector_add(action, delivery, link, disposition, settled, error);
+
+    qdr_action_enqueue(core, action);
+}
+
+
 void qdr_delivery_set_context(qdr_delivery_t *delivery, void *context)
 {
     delivery->context = context;
@@ -500,6 +806,155 @@ void qdr_delivery_failed_CT(qdr_core_t *core, qdr_delivery_t *dlv)
 }
 
 
+//
+// Adaptive credit for incoming endpoint links.  The window is reconsidered once per
+// round, a round being as many settlements as the window is large.  If settlement
+// latency has risen well above its base the downstream is backing up and the window
+// shrinks; if the producer kept the whole window in flight and latency held, it grows.
+// A producer that uses much less than its window has it trimmed to save memory.
+//
+#define QDR_CREDIT_BACKLOG_FACTOR   4   ///< Latency above this multiple of the base is backlog
+#define QDR_CREDIT_RTT_RESET_ROUNDS 16  ///< Re-learn the base latency this often
+
+static bool qdr_link_credit_adaptive_CT(qdr_core_t *core, qdr_link_t *link)
+{
+    return core->credit_window_max > 0
+        && link->link_direction == QD_INCOMING
+        && link->link_type == QD_LINK_ENDPOINT
+        && !link->connected_link
+        && !link->core_endpoint;
+}
+
+
+/**
+ * Note the arrival of an unsettled delivery on an adaptive-credit link.
+ */
+static void qdr_link_credit_arrival_CT(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv)
+{
+    if (link->credit_window == 0) {
+        //
+        // The link was granted its configured capacity when it attached.  Bring that
+        // within the bounds, taking back the excess as deliveries settle.
+        //
+        int window = link->capacity;
+        if (window > core->credit_window_max)
+            window = core->credit_window_max;
+        if (window < core->credit_window_min)
+            window = core->credit_window_min;
+        if (window > link->capacity)
+            qdr_link_issue_credit_CT(core, link, window - link->capacity, false);
+        else
+            link->credit_debt = link->capacity - window;
+        link->credit_window = window;
+    }
+
+    int outstanding = (int) DEQ_SIZE(link->unsettled) + 1;
+    if (outstanding > link->credit_round_peak)
+        link->credit_round_peak = outstanding;
+    dlv->credit_usec = qd_timer_now_usec();
+}
+
+
+/**
+ * Return the replacement credit for a settled delivery on an adaptive-credit link.
+ */
+static int qdr_link_credit_settled_CT(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv)
+{
+    if (dlv->credit_usec) {
+        int64_t sample = qd_timer_now_usec() - dlv->credit_usec;
+        if (sample < 1)
+            sample = 1;
+        link->credit_rtt_ewma = link->credit_rtt_ewma ? link->credit_rtt_ewma + (sample - link->credit_rtt_ewma) / 8 : sample;
+        if (!link->credit_round_rtt_min || sample < link->credit_round_rtt_min)
+            link->credit_round_rtt_min = sample;
+        dlv->credit_usec = 0;
+    }
+
+    int credit = 1;
+    if (link->credit_window > 0 && ++link->credit_round_settles >= link->credit_window) {
+        if (!link->credit_rtt_min || link->credit_round_rtt_min < link->credit_rtt_min
+            || ++link->credit_rounds % QDR_CREDIT_RTT_RESET_ROUNDS == 0)
+            link->credit_rtt_min = link->credit_round_rtt_min;
+
+        int window = link->credit_window;
+        int step   = window / 4 > 0 ? window / 4 : 1;
+        int target = window;
+
+        if (link->credit_rtt_min && link->credit_rtt_ewma > QDR_CREDIT_BACKLOG_FACTOR * link->credit_rtt_min)
+            target = window - step;
+        else if (link->credit_round_peak >= window)
+            target = window + step;
+        else if (link->credit_round_peak * 2 < window)
+            target = link->credit_round_peak * 2;
+
+        if (target > core->credit_window_max)
+            target = core->credit_window_max;
+        if (target < core->credit_window_min)
+            target = core->credit_window_min;
+
+        if (target > window) {
+            //
+            // Grow, paying off any outstanding debt first.
+            //
+            int grow = target - window;
+            int paid = grow < link->credit_debt ? grow : link->credit_debt;
+            link->credit_debt -= paid;
+            credit += grow - paid;
+        } else
+            link->credit_debt += window - target;
+
+        if (target != window)
+            qd_log(core->log, QD_LOG_DEBUG, "[C%"PRIu64"][L%"PRIu64"] Credit window %d -> %d (latency %"PRId64"us, base %"PRId64"us)",
+                   link->conn->identity, link->identity, window, target, link->credit_rtt_ewma, link->credit_rtt_min);
+
+        link->credit_window        = target;
+        link->credit_round_settles = 0;
+        link->credit_round_peak    = 0;
+        link->credit_round_rtt_min = 0;
+    }
+
+    if (credit == 1 && link->credit_debt > 0) {
+        link->credit_debt--;
+        credit = 0;
+    }
+    return credit;
+}
+
+
+static inline uint64_t qdr_latency_interval(int64_t from, int64_t to)
+{
+    return to > from ? (uint64_t) (to - from) : 0;
+}
+
+
+//
+// Account the time from the arrival of the incoming delivery to the first
+// transmission and to the settlement of this outgoing delivery, and its split
+// into stages.  A stage whose start was not stamped is counted in the one before.
+//
+static void qdr_delivery_record_latency_CT(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv)
+{
+    int64_t now       = qd_timer_now_usec();
+    int64_t send_at   = dlv->send_usec ? dlv->send_usec : now;
+    int64_t core_at   = dlv->core_usec ? dlv->core_usec : dlv->ingress_usec;
+    int64_t queued_at = dlv->queued_usec ? dlv->queued_usec : core_at;
+    uint64_t settle   = qdr_latency_interval(dlv->ingress_usec, now);
+    uint64_t send     = qdr_latency_interval(dlv->ingress_usec, send_at);
+    uint64_t stages[QDR_LATENCY_STAGES];
+
+    stages[QDR_LATENCY_STAGE_INGRESS]    = qdr_latency_interval(dlv->ingress_usec, core_at);
+    stages[QDR_LATENCY_STAGE_CORE]       = qdr_latency_interval(core_at, queued_at);
+    stages[QDR_LATENCY_STAGE_EGRESS]     = qdr_latency_interval(queued_at, send_at);
+    stages[QDR_LATENCY_STAGE_DOWNSTREAM] = qdr_latency_interval(send_at, now);
+
+    qdr_latency_record(&core->delivery_latency, send, settle, stages);
+    qdr_latency_record_ptr(&link->latency, send, settle, stages);
+    if (link->owning_addr)
+        qdr_latency_record_ptr(&qdr_address_stats_CT(link->owning_addr)->latency, send, settle, stages);
+    dlv->ingress_usec = 0;
+}
+
+
 bool qdr_delivery_settled_CT(qdr_core_t *core, qdr_delivery_t *dlv)
 {
     //
@@ -528,6 +983,28 @@ bool qdr_delivery_settled_CT(qdr_core_t *core, qdr_delivery_t *dlv)
     if (link->link_direction == QD_OUTGOING)
         sys_mutex_unlock(conn->work_lock);
 
+    if (moved)
+        QD_TRACE_EVENT(QD_TRACE_SETTLE, qd_message_trace_id(dlv->msg), dlv, conn->identity, link->identity);
+
+    if (moved && link->link_direction == QD_OUTGOING && dlv->ingress_usec)
+        qdr_delivery_record_latency_CT(core, link, dlv);
+
+    //
+    // Feed the settlement latency of a latency-aware balanced delivery into the
+    // average of the destination it was sent to: the inter-router link for the
+    // address, or the local consumer's link.
+    //
+    if (dlv->forward_usec) {
+        int64_t *ewma = (dlv->tracking_addr && dlv->tracking_addr->settle_usec_ewma)
+            ? &dlv->tracking_addr->settle_usec_ewma[dlv->tracking_addr_bit]
+            : &link->settle_usec_ewma;
+        int64_t sample = qd_timer_now_usec() - dlv->forward_usec;
+        if (sample < 1)
+            sample = 1;
+        *ewma = *ewma ? *ewma + (sample - *ewma) / 8 : sample;
+        dlv->forward_usec = 0;
+    }
+
     if (dlv->tracking_addr) {
         dlv->tracking_addr->outstanding_deliveries[dlv->tracking_addr_bit]--;
         dlv->tracking_addr->tracked_deliveries--;
@@ -545,7 +1022,7 @@ bool qdr_delivery_settled_CT(qdr_core_t *core, qdr_delivery_t *dlv)
     //
     if (moved && link->link_direction == QD_INCOMING &&
         link->link_type != QD_LINK_ROUTER && !link->connected_link)
-        qdr_link_issue_credit_CT(core, link, 1, false);
+        qdr_link_issue_credit_CT(core, link, link->credit_window > 0 ? qdr_link_credit_settled_CT(core, link, dlv) : 1, false);
 
     return moved;
 }
@@ -554,46 +1031,53 @@ void qdr_increment_delivery_counters_CT(qdr_core_t *core, qdr_delivery_t *delive
 {
     qdr_link_t *link = delivery->link;
     if (link) {
+        qdr_delivery_counters_t *shard = link->conn ? &link->conn->delivery_counters : &core->closed_delivery_counters;
         bool do_rate = false;
+        bool incoming = link->link_direction == QD_INCOMING;
 
         if (delivery->presettled) {
             do_rate = delivery->disposition != PN_RELEASED;
             link->presettled_deliveries++;
-            if (link->link_direction ==  QD_INCOMING && link->link_type == QD_LINK_ENDPOINT)
-                core->presettled_deliveries++;
+            if (incoming && link->link_type == QD_LINK_ENDPOINT)
+                shard->presettled++;
         }
         else if (delivery->disposition == PN_ACCEPTED) {
             do_rate = true;
             link->accepted_deliveries++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->accepted_deliveries++;
+            if (incoming)
+                shard->accepted++;
         }
         else if (delivery->disposition == PN_REJECTED) {
             do_rate = true;
             link->rejected_deliveries++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->rejected_deliveries++;
+            if (incoming)
+                shard->rejected++;
         }
         else if (delivery->disposition == PN_RELEASED && !delivery->presettled) {
             link->released_deliveries++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->released_deliveries++;
+            if (incoming)
+                shard->released++;
         }
         else if (delivery->disposition == PN_MODIFIED) {
             link->modified_deliveries++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->modified_deliveries++;
+            if (incoming)
+                shard->modified++;
+        }
+
+        if (delivery->expired) {
+            link->expired_deliveries++;
+            shard->dropped_expired++;
         }
 
         uint32_t delay = core->uptime_ticks - delivery->ingress_time;
         if (delay > 10) {
             link->deliveries_delayed_10sec++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->deliveries_delayed_10sec++;
+            if (incoming)
+                shard->delayed_10sec++;
         } else if (delay > 1) {
             link->deliveries_delayed_1sec++;
-            if (link->link_direction ==  QD_INCOMING)
-                core->deliveries_delayed_1sec++;
+            if (incoming)
+                shard->delayed_1sec++;
         }
 
         if (qd_bitmask_valid_bit_value(delivery->ingress_index) && link->ingress_histogram)
@@ -619,6 +1103,34 @@ void qdr_increment_delivery_counters_CT(qdr_core_t *core, qdr_delivery_t *delive
 }
 
 
+static void qdr_delivery_counters_add(qdr_delivery_counters_t *total, const qdr_delivery_counters_t *shard)
+{
+    total->presettled      += shard->presettled;
+    total->accepted        += shard->accepted;
+    total->rejected        += shard->rejected;
+    total->released        += shard->released;
+    total->modified        += shard->modified;
+    total->dropped_expired += shard->dropped_expired;
+    total->delayed_1sec    += shard->delayed_1sec;
+    total->delayed_10sec   += shard->delayed_10sec;
+}
+
+
+void qdr_delivery_counters_total_CT(qdr_core_t *core, qdr_delivery_counters_t *total)
+{
+    *total = core->closed_delivery_counters;
+    for (qdr_connection_t *conn = DEQ_HEAD(core->open_connections); conn; conn = DEQ_NEXT(conn))
+        qdr_delivery_counters_add(total, &conn->delivery_counters);
+}
+
+
+void qdr_delivery_counters_retire_CT(qdr_core_t *core, qdr_connection_t *conn)
+{
+    qdr_delivery_counters_add(&core->closed_delivery_counters, &conn->delivery_counters);
+    ZERO(&conn->delivery_counters);
+}
+
+
 static void qdr_delete_delivery_internal_CT(qdr_core_t *core, qdr_delivery_t *delivery)
 {
     assert(sys_atomic_get(&delivery->ref_count) == 0);
@@ -627,8 +1139,9 @@ static void qdr_delete_delivery_internal_CT(qdr_core_t *core, qdr_delivery_t *de
         qdr_delivery_cleanup_t *cleanup = new_qdr_delivery_cleanup_t();
 
         DEQ_ITEM_INIT(cleanup);
-        cleanup->msg  = delivery->msg;
-        cleanup->iter = delivery->to_addr;
+        cleanup->msg          = delivery->msg;
+        cleanup->iter         = delivery->to_addr;
+        cleanup->owner_thread = delivery->owner_thread;
 
         DEQ_INSERT_TAIL(core->delivery_cleanup_list, cleanup);
     }
@@ -645,17 +1158,11 @@ static void qdr_delete_delivery_internal_CT(qdr_core_t *core, qdr_delivery_t *de
 
     qdr_increment_delivery_counters_CT(core, delivery);
 
-    //
-    // Free all the peer qdr_delivery_ref_t references
-    //
-    qdr_delivery_ref_t *ref = DEQ_HEAD(delivery->peers);
-    while (ref) {
-        qdr_del_delivery_ref(&delivery->peers, ref);
-        ref = DEQ_HEAD(delivery->peers);
-    }
-
     qd_bitmask_free(delivery->link_exclusion);
     qdr_error_free(delivery->error);
+    free(delivery->conflation_key);
+    free(delivery->stream_peers);
+    free(delivery->peers);
 
     free_qdr_delivery_t(delivery);
 
@@ -663,7 +1170,34 @@ static void qdr_delete_delivery_internal_CT(qdr_core_t *core, qdr_delivery_t *de
 
 static bool qdr_delivery_has_peer_CT(qdr_delivery_t *dlv)
 {
-    return dlv->peer || DEQ_SIZE(dlv->peers) > 0;
+    return dlv->peer || dlv->peer_count > 0;
+}
+
+
+//
+// A delivery with more than one peer keeps them in an array, and each peer
+// records its slot so that it can be removed without a search.  Removal moves
+// the last peer into the vacated slot.
+//
+static void qdr_delivery_add_peer_CT(qdr_delivery_t *dlv, qdr_delivery_t *peer)
+{
+    if (dlv->peer_count == dlv->peer_capacity) {
+        dlv->peer_capacity = dlv->peer_capacity ? dlv->peer_capacity * 2 : 4;
+        dlv->peers = (qdr_delivery_t**) realloc(dlv->peers, dlv->peer_capacity * sizeof(qdr_delivery_t*));
+    }
+    peer->peer_slot = dlv->peer_count;
+    dlv->peers[dlv->peer_count++] = peer;
+}
+
+
+static void qdr_delivery_remove_peer_CT(qdr_delivery_t *dlv, qdr_delivery_t *peer)
+{
+    int slot = peer->peer_slot;
+    assert(slot < dlv->peer_count && dlv->peers[slot] == peer);
+
+    qdr_delivery_t *last = dlv->peers[--dlv->peer_count];
+    dlv->peers[slot] = last;
+    last->peer_slot  = slot;
 }
 
 void qdr_delivery_link_peers_CT(qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv)
@@ -680,15 +1214,15 @@ void qdr_delivery_link_peers_CT(qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv)
     else {
         if (in_dlv->peer) {
             // This is the first time we know that in_dlv is going to have more than one peer.
-            // There is already a peer in the in_dlv->peer pointer, move it into a list and zero it out.
-            qdr_add_delivery_ref_CT(&in_dlv->peers, in_dlv->peer);
+            // There is already a peer in the in_dlv->peer pointer, move it into the array and zero it out.
+            qdr_delivery_add_peer_CT(in_dlv, in_dlv->peer);
 
-            // Zero out the peer pointer. Since there is more than one peer, this peer has been moved to the "peers" linked list.
-            // All peers will now reside in the peers linked list. No need to decref/incref here because you are transferring ownership.
+            // Zero out the peer pointer. Since there is more than one peer, this peer has been moved to the "peers" array.
+            // All peers will now reside in the peers array. No need to decref/incref here because you are transferring ownership.
             in_dlv->peer = 0;
         }
 
-        qdr_add_delivery_ref_CT(&in_dlv->peers, out_dlv);
+        qdr_delivery_add_peer_CT(in_dlv, out_dlv);
     }
 
     out_dlv->peer = in_dlv;
@@ -698,6 +1232,17 @@ void qdr_delivery_link_peers_CT(qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv)
 }
 
 
+static void qdr_delivery_remove_stream_peer_LH(qdr_delivery_t *dlv, qdr_delivery_t *peer)
+{
+    for (int i = 0; i < dlv->stream_peer_count; i++) {
+        if (dlv->stream_peers[i].dlv == peer) {
+            dlv->stream_peers[i] = dlv->stream_peers[--dlv->stream_peer_count];
+            return;
+        }
+    }
+}
+
+
 void qdr_delivery_unlink_peers_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_delivery_t *peer)
 {
     // If there is no delivery or a peer, we cannot proceed.
@@ -715,17 +1260,9 @@ void qdr_delivery_unlink_peers_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_del
         dlv->peer  = 0;
     } else {
         //
-        // This is the not so easy case
+        // dlv has more than one peer; the target peer knows its slot in dlv's array
         //
-        // dlv has more than one peer, so we have to search for our target peer
-        // in the list of peers
-        //
-        qdr_delivery_ref_t *peer_ref = DEQ_HEAD(dlv->peers);
-        while (peer_ref && peer_ref->dlv != peer) {
-            peer_ref = DEQ_NEXT(peer_ref);
-        }
-        assert(peer_ref != 0);
-        qdr_del_delivery_ref(&dlv->peers, peer_ref);
+        qdr_delivery_remove_peer_CT(dlv, peer);
     }
 
     // now drop the peer's reference to dlv
@@ -734,12 +1271,14 @@ void qdr_delivery_unlink_peers_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_del
         assert(peer->peer == dlv);
         peer->peer = 0;
     }  else {
-        qdr_delivery_ref_t *peer_ref = DEQ_HEAD(peer->peers);
-        while (peer_ref && peer_ref->dlv != dlv) {
-            peer_ref = DEQ_NEXT(peer_ref);
-        }
-        assert(peer_ref != 0);
-        qdr_del_delivery_ref(&peer->peers, peer_ref);
+        qdr_delivery_remove_peer_CT(peer, dlv);
+    }
+
+    if (dlv->stream_peer_count > 0 || peer->stream_peer_count > 0) {
+        sys_mutex_lock(core->stream_lock);
+        qdr_delivery_remove_stream_peer_LH(dlv, peer);
+        qdr_delivery_remove_stream_peer_LH(peer, dlv);
+        sys_mutex_unlock(core->stream_lock);
     }
 
     qdr_delivery_decref_CT(core, dlv, "qdr_delivery_unlink_peers_CT - unlinked from peer (delivery)");
@@ -747,6 +1286,29 @@ void qdr_delivery_unlink_peers_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_del
 }
 
 
+void qdr_delivery_add_stream_peer_CT(qdr_core_t *core, qdr_delivery_t *in_dlv, qdr_delivery_t *out_dlv)
+{
+    if (!out_dlv->link)
+        return;
+
+    sys_mutex_lock(core->stream_lock);
+    if (in_dlv->stream_peer_count == in_dlv->stream_peer_capacity) {
+        in_dlv->stream_peer_capacity = in_dlv->stream_peer_capacity ? in_dlv->stream_peer_capacity * 2 : 4;
+        in_dlv->stream_peers = (qdr_stream_peer_t*) realloc(in_dlv->stream_peers,
+                                                            in_dlv->stream_peer_capacity * sizeof(qdr_stream_peer_t));
+    }
+    in_dlv->stream_peers[in_dlv->stream_peer_count].dlv  = out_dlv;
+    in_dlv->stream_peers[in_dlv->stream_peer_count].link = out_dlv->link;
+    in_dlv->stream_peer_count++;
+    sys_mutex_unlock(core->stream_lock);
+}
+
+
+//
+// The peers in the array are visited from the last to the first.  Unlinking a
+// visited peer only moves another visited peer into its slot, so a caller may
+// unlink each peer as it goes.
+//
 qdr_delivery_t *qdr_delivery_first_peer_CT(qdr_delivery_t *dlv)
 {
     // What if there are no peers for this delivery?
@@ -757,16 +1319,10 @@ qdr_delivery_t *qdr_delivery_first_peer_CT(qdr_delivery_t *dlv)
         // If there is a dlv->peer, it is the one and only peer.
         return dlv->peer;
     }
-    else {
-        // The delivery has more than one peer.
-        qdr_delivery_ref_t *peer_ref = DEQ_HEAD(dlv->peers);
 
-        // Save the next peer to dlv->next_peer_ref so we can use it when somebody calls qdr_delivery_next_peer_CT
-        dlv->next_peer_ref = DEQ_NEXT(peer_ref);
-
-        // Return the first peer.
-        return peer_ref->dlv;
-    }
+    // The delivery has more than one peer.
+    dlv->next_peer_index = dlv->peer_count - 1;
+    return qdr_delivery_next_peer_CT(dlv);
 }
 
 qdr_delivery_t *qdr_delivery_next_peer_CT(qdr_delivery_t *dlv)
@@ -775,16 +1331,11 @@ qdr_delivery_t *qdr_delivery_next_peer_CT(qdr_delivery_t *dlv)
         // There is no next_peer if there is only one peer. If there is a non-zero dlv->peer, it is the only peer
         return 0;
     }
-    else {
-        // There is more than one peer to this delivery.
-        qdr_delivery_ref_t *next_peer_ref = dlv->next_peer_ref;
-        if (next_peer_ref) {
-            // Save the next peer to dlv->next_peer_ref so we can use it when somebody calls qdr_delivery_next_peer_CT
-            dlv->next_peer_ref = DEQ_NEXT(dlv->next_peer_ref);
-            return next_peer_ref->dlv;
-        }
-        return 0;
-    }
+
+    // There is more than one peer to this delivery.
+    if (dlv->next_peer_index >= 0 && dlv->next_peer_index < dlv->peer_count)
+        return dlv->peers[dlv->next_peer_index--];
+    return 0;
 }
 
 
@@ -810,7 +1361,18 @@ static void qdr_link_flow_CT(qdr_core_t *core, qdr_action_t *action, bool discar
     bool activate         = false;
     bool drain_was_set    = !link->drain_mode && drain;
     qdr_link_work_t *work = 0;
-    
+
+    //
+    // Track the credit that deliveries queued by the core have not used yet.  Coming
+    // out of drain mode, the credit is absolute rather than incremental.
+    //
+    if (link->link_direction == QD_OUTGOING) {
+        if (link->drain_mode && !drain)
+            link->credit_available = credit - (int) DEQ_SIZE(link->undelivered);
+        else
+            link->credit_available += credit;
+    }
+
     link->drain_mode = drain;
 
     //
@@ -820,7 +1382,9 @@ static void qdr_link_flow_CT(qdr_core_t *core, qdr_action_t *action, bool discar
     if (link->stalled_outbound) {
         link->stalled_outbound = false;
         // Adding this work at priority 0.
-        qdr_add_link_ref(link->conn->links_with_work, link, QDR_LINK_LIST_CLASS_WORK);
+        sys_mutex_lock(link->conn->work_lock);
+        qdr_add_link_ref(qdr_connection_work_links(link->conn, 0), link, QDR_LINK_LIST_CLASS_WORK);
+        sys_mutex_unlock(link->conn->work_lock);
         activate = true;
     }
 
@@ -868,11 +1432,18 @@ static void qdr_link_flow_CT(qdr_core_t *core, qdr_action_t *action, bool discar
                 DEQ_INSERT_TAIL(link->work_list, work);
             if (DEQ_SIZE(link->undelivered) > 0 || drain_was_set) {
                 // Adding this work at priority 0.
-                qdr_add_link_ref(link->conn->links_with_work, link, QDR_LINK_LIST_CLASS_WORK);
+                qdr_add_link_ref(qdr_connection_work_links(link->conn, 0), link, QDR_LINK_LIST_CLASS_WORK);
                 activate = true;
             }
             sys_mutex_unlock(link->conn->work_lock);
         }
+
+        //
+        // New credit lets messages held in the address's in-router queue move on.
+        //
+        if (link->link_direction == QD_OUTGOING && credit > 0 && link->owning_addr
+            && DEQ_SIZE(link->owning_addr->queue) > 0)
+            qdr_addr_drain_queue_CT(core, link->owning_addr);
     }
 
     //
@@ -902,6 +1473,8 @@ static long qdr_addr_path_count_CT(qdr_address_t *addr)
 
 static void qdr_link_forward_CT(qdr_core_t *core, qdr_link_t *link, qdr_delivery_t *dlv, qdr_address_t *addr, bool more)
 {
+    QD_TRACE_EVENT(QD_TRACE_FORWARD, qd_message_trace_id(dlv->msg), dlv, link->conn ? link->conn->identity : 0, link->identity);
+
     if (dlv->link->link_type == QD_LINK_ENDPOINT)
         core->deliveries_ingress++;
 
@@ -944,17 +1517,33 @@ static void qdr_link_forward_CT(qdr_core_t *core, qdr_link_t *link, qdr_delivery
         return;
     }
 
+    if (!more && link->link_type != QD_LINK_CONTROL && qdr_delivery_expired(dlv)) {
+        //
+        // The message expired before it could be forwarded.  Drop it, releasing
+        // it back to the sender if it is unsettled, and replace the credit.
+        //
+        dlv->expired = true;
+        if (!dlv->settled)
+            qdr_delivery_release_CT(core, dlv);
+        qdr_delivery_decref_CT(core, dlv, "qdr_link_forward_CT - removed from action (expired)");
+        qdr_link_issue_credit_CT(core, link, 1, false);
+        return;
+    }
+
     int fanout = 0;
 
     dlv->multicast = qdr_is_addr_treatment_multicast(addr);
 
     if (addr) {
-        fanout = qdr_forward_message_CT(core, addr, dlv->msg, dlv, false, link->link_type == QD_LINK_CONTROL);
+        if (!more && link->link_type != QD_LINK_CONTROL && qdr_addr_queue_CT(core, addr, dlv))
+            fanout = 1;
+        else
+            fanout = qdr_forward_message_CT(core, addr, dlv->msg, dlv, false, link->link_type == QD_LINK_CONTROL);
         if (link->link_type != QD_LINK_CONTROL && link->link_type != QD_LINK_ROUTER) {
-            addr->deliveries_ingress++;
+            qdr_address_stats_CT(addr)->deliveries_ingress++;
 
             if (qdr_connection_route_container(link->conn)) {
-                addr->deliveries_ingress_route_container++;
+                qdr_address_stats_CT(addr)->deliveries_ingress_route_container++;
                 core->deliveries_ingress_route_container++;
             }
 
@@ -1055,12 +1644,18 @@ static void qdr_link_deliver_CT(qdr_core_t *core, qdr_action_t *action, bool dis
     // Record the ingress time so we can track the age of this delivery.
     //
     dlv->ingress_time = core->uptime_ticks;
+    if (dlv->ingress_usec)
+        dlv->core_usec = qd_timer_now_usec();
+    QD_PROBE3(link_deliver, qd_message_trace_id(dlv->msg), dlv, link->identity);
 
     //
     // If the link is an edge link, mark this delivery as via-edge
     //
     dlv->via_edge = link->edge;
 
+    if (!dlv->settled && qdr_link_credit_adaptive_CT(core, link))
+        qdr_link_credit_arrival_CT(core, link, dlv);
+
     //
     // If this link has a core_endpoint, direct deliveries to that endpoint.
     //
@@ -1111,11 +1706,17 @@ static void qdr_link_deliver_CT(qdr_core_t *core, qdr_action_t *action, bool dis
     //
 
     if (DEQ_IS_EMPTY(link->undelivered)) {
+        //
+        // A targeted link, including the auto-links and waypoint links of a
+        // multi-phase address, is bound at attach to the address of its own
+        // phase, so a phase transition costs no lookup here.  Only anonymous
+        // deliveries are resolved, once, by their phase-annotated address.
+        //
         qdr_address_t *addr = link->owning_addr;
         if (!addr && dlv->to_addr) {
             qdr_connection_t *conn = link->conn;
             if (conn && conn->tenant_space)
-                qd_iterator_annotate_space(dlv->to_addr, conn->tenant_space, conn->tenant_space_len);
+                qd_iterator_annotate_space_hash(dlv->to_addr, conn->tenant_hash);
             qd_hash_retrieve(core->addr_hash, dlv->to_addr, (void**) &addr);
         }
 
@@ -1172,22 +1773,96 @@ void qdr_in_process_send_to_CT(qdr_core_t *core, qd_iterator_t *address, qd_mess
         // Forward the message.  We don't care what the fanout count is.
         //
         (void) qdr_forward_message_CT(core, addr, msg, 0, exclude_inprocess, control);
-        addr->deliveries_from_container++;
+        qdr_address_stats_CT(addr)->deliveries_from_container++;
     } else
         qd_log(core->log, QD_LOG_DEBUG, "In-process send to an unknown address");
 }
 
 
-static void qdr_update_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+void qdr_delivery_mcast_outcome_CT(qdr_core_t *core, qdr_delivery_t *in_dlv, uint32_t accepted, uint32_t failed)
 {
-    qdr_delivery_t *dlv        = action->args.delivery.delivery;
+    in_dlv->mcast_accepted += accepted;
+    in_dlv->mcast_failed   += failed;
+    if (in_dlv->settled)
+        return;
+
+    uint32_t n       = in_dlv->mcast_fanout;
+    uint32_t a       = in_dlv->mcast_accepted;
+    uint32_t f       = in_dlv->mcast_failed;
+    bool     success = false;
+    bool     failure = false;
+
+    switch (in_dlv->mcast_settlement) {
+    case QDR_MCAST_SETTLE_FIRST_ACCEPT:
+        success = a > 0;
+        failure = f >= n;
+        break;
+
+    case QDR_MCAST_SETTLE_ALL_ACCEPT:
+        success = a >= n;
+        failure = f > 0;
+        break;
+
+    case QDR_MCAST_SETTLE_MAJORITY:
+        success = 2 * a > n;
+        failure = 2 * (n - f) <= n;  // the consumers yet to fail cannot make a majority
+        break;
+
+    default:
+        return;
+    }
+
+    if (!success && !failure)
+        return;
+
+    in_dlv->disposition = success ? PN_ACCEPTED : PN_MODIFIED;
+    in_dlv->settled     = true;
+    bool moved = qdr_delivery_settled_CT(core, in_dlv);
+    qdr_delivery_push_CT(core, in_dlv);
+    if (moved)
+        qdr_delivery_decref_CT(core, in_dlv, "qdr_delivery_mcast_outcome_CT - remove from unsettled list");
+}
+
+
+//
+// An update to an outgoing copy of a multicast delivery settled by its consumers'
+// outcomes is counted on the in-delivery instead of being passed to it.
+//
+static void qdr_update_mcast_delivery_CT(qdr_core_t *core, qdr_delivery_t *dlv, qdr_delivery_t *in_dlv,
+                                         uint64_t disp, bool settled, qdr_error_t *error)
+{
+    bool dlv_moved = false;
+
+    dlv->disposition = disp;
+    if (settled) {
+        qdr_delivery_mcast_outcome_CT(core, in_dlv, disp == PN_ACCEPTED, disp != PN_ACCEPTED);
+        qdr_delivery_unlink_peers_CT(core, dlv, in_dlv);
+        if (dlv->link)
+            dlv_moved = qdr_delivery_settled_CT(core, dlv);
+    }
+
+    qdr_delivery_decref_CT(core, dlv, "qdr_update_delivery_CT - remove from action");
+    if (dlv_moved)
+        qdr_delivery_decref_CT(core, dlv, "qdr_update_delivery_CT - removed from unsettled (1)");
+    qdr_error_free(error);
+}
+
+
+static void qdr_update_delivery_internal_CT(qdr_core_t *core, qdr_delivery_t *dlv, uint64_t disp,
+                                            bool settled, qdr_error_t *error)
+{
+    QD_PROBE3(delivery_update, qd_message_trace_id(dlv->msg), disp, settled);
+
     qdr_delivery_t *peer       = qdr_delivery_first_peer_CT(dlv);
+
+    if (peer && peer->mcast_settlement != QDR_MCAST_SETTLE_PRESETTLE) {
+        qdr_update_mcast_delivery_CT(core, dlv, peer, disp, settled, error);
+        return;
+    }
+
     bool            push       = false;
     bool            peer_moved = false;
     bool            dlv_moved  = false;
-    uint64_t        disp       = action->args.delivery.disposition;
-    bool            settled    = action->args.delivery.settled;
-    qdr_error_t    *error      = action->args.delivery.error;
     bool error_unassigned      = true;
 
     //
@@ -1253,6 +1928,30 @@ static void qdr_update_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool
 }
 
 
+static void qdr_update_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    qdr_update_delivery_internal_CT(core,
+                                    action->args.delivery.delivery,
+                                    action->args.delivery.disposition,
+                                    action->args.delivery.settled,
+                                    action->args.delivery.error);
+}
+
+
+static void qdr_update_deliveries_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    for (int r = 0; r < action->args.dispositions.range_count; r++) {
+        qdr_disposition_range_t *range = &action->args.dispositions.ranges[r];
+        for (int i = range->first; i < range->first + range->count; i++)
+            qdr_update_delivery_internal_CT(core, action->args.dispositions.deliveries[i],
+                                            range->disposition, range->settled, range->error);
+    }
+
+    free(action->args.dispositions.ranges);
+    free(action->args.dispositions.deliveries);
+}
+
+
 static void qdr_delete_delivery_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
 {
     if (!discard)
@@ -1274,7 +1973,7 @@ void qdr_deliver_continue_peers_CT(qdr_core_t *core, qdr_delivery_t *in_dlv)
             sys_mutex_lock(peer->link->conn->work_lock);
             if (work->processing || work == DEQ_HEAD(peer->link->work_list)) {
                 // Adding this work at priority 0.
-                qdr_add_link_ref(peer->link->conn->links_with_work, peer->link, QDR_LINK_LIST_CLASS_WORK);
+                qdr_add_link_ref(qdr_connection_work_links(peer->link->conn, 0), peer->link, QDR_LINK_LIST_CLASS_WORK);
                 sys_mutex_unlock(peer->link->conn->work_lock);
 
                 //
@@ -1365,6 +2064,86 @@ static void qdr_deliver_continue_CT(qdr_core_t *core, qdr_action_t *action, bool
 }
 
 
+/**
+ * Queue a flow work item for the link's IO thread to apply
+ */
+static void qdr_link_enqueue_flow_CT(qdr_core_t *core, qdr_link_t *link, int credit,
+                                     qdr_link_work_drain_action_t drain_action)
+{
+    qdr_link_work_t *work = new_qdr_link_work_t();
+    ZERO(work);
+
+    work->work_type    = QDR_LINK_WORK_FLOW;
+    work->value        = credit;
+    work->drain_action = drain_action;
+
+    qdr_link_enqueue_work_CT(core, link, work);
+}
+
+
+//
+// Overload control applies to the links that bring new messages in from clients.
+//
+static inline bool qdr_link_overload_controlled_CT(const qdr_link_t *link)
+{
+    return link->link_type == QD_LINK_ENDPOINT && !link->connected_link && !link->core_endpoint;
+}
+
+
+/**
+ * Cut the credit to be given to a link while the router is overloaded.  At
+ * level n one credit is given for every 2^n owed, and none at the deepest level;
+ * the rest is held on the link until the overload eases.
+ */
+static int qdr_link_overload_credit_CT(qdr_core_t *core, qdr_link_t *link, int credit)
+{
+    int grant = 0;
+
+    if (core->overload_level < QDR_OVERLOAD_LEVELS) {
+        int unit = 1 << core->overload_level;
+        link->overload_owed += credit;
+        grant = link->overload_owed / unit;
+        link->overload_owed %= unit;
+    }
+
+    link->overload_withheld += credit - grant;
+    core->credit_withheld   += credit - grant;
+    return grant;
+}
+
+
+void qdr_overload_set_level_CT(qdr_core_t *core, int level)
+{
+    int previous = core->overload_level;
+    if (level == previous)
+        return;
+
+    core->overload_level = level;
+    qd_log(core->log, level > previous ? QD_LOG_WARNING : QD_LOG_INFO,
+           "Overload level %d, producers get %s of their replacement credit", level,
+           level == 0 ? "all" : level == 1 ? "half" : level == 2 ? "a quarter" : "none");
+
+    if (level > previous)
+        return;
+
+    //
+    // Give back the credit held at the deeper level: all of it once the
+    // router has recovered, otherwise half.
+    //
+    qdr_link_t *link = DEQ_HEAD(core->open_links);
+    while (link) {
+        if (link->overload_withheld > 0) {
+            int release = level == 0 ? link->overload_withheld : link->overload_withheld / 2;
+            link->overload_withheld -= release;
+            link->overload_owed      = 0;
+            if (release > 0)
+                qdr_link_enqueue_flow_CT(core, link, release, QDR_LINK_WORK_DRAIN_ACTION_NONE);
+        }
+        link = DEQ_NEXT(link);
+    }
+}
+
+
 /**
  * Add link-work to provide credit to the link in an IO thread
  */
@@ -1378,19 +2157,17 @@ void qdr_link_issue_credit_CT(qdr_core_t *core, qdr_link_t *link, int credit, bo
     if (link->credit_pending > 0)
         link->credit_pending = link->credit_pending > credit ? link->credit_pending - credit : 0;
 
+    if (core->overload_level > 0 && credit > 0 && !drain && qdr_link_overload_controlled_CT(link))
+        credit = qdr_link_overload_credit_CT(core, link, credit);
+
     if (!drain_changed && credit == 0)
         return;
 
-    qdr_link_work_t *work = new_qdr_link_work_t();
-    ZERO(work);
-
-    work->work_type = QDR_LINK_WORK_FLOW;
-    work->value     = credit;
-
+    qdr_link_work_drain_action_t drain_action = QDR_LINK_WORK_DRAIN_ACTION_NONE;
     if (drain_changed)
-        work->drain_action = drain ? QDR_LINK_WORK_DRAIN_ACTION_SET : QDR_LINK_WORK_DRAIN_ACTION_CLEAR;
+        drain_action = drain ? QDR_LINK_WORK_DRAIN_ACTION_SET : QDR_LINK_WORK_DRAIN_ACTION_CLEAR;
 
-    qdr_link_enqueue_work_CT(core, link, work);
+    qdr_link_enqueue_flow_CT(core, link, credit, drain_action);
 }
 
 
@@ -1427,8 +2204,108 @@ void qdr_drain_inbound_undelivered_CT(qdr_core_t *core, qdr_link_t *link, qdr_ad
  * Also, check the inlinks to see if there are undelivered messages.  If so, drain them to
  * the forwarder.
  */
+//
+// Interval at which pending producer credit is released when it is paced
+//
+#define QDR_CREDIT_RELEASE_MSEC 100
+
+
+/**
+ * Issue up to budget of the credit owed to the address's producers, each link
+ * getting a share in proportion to what it is owed.  Links served go to the back
+ * of the list so that any left out of a slice are served first in the next.
+ * A budget of zero issues everything.  Returns true if credit is still owed.
+ */
+static bool qdr_addr_release_credit_CT(qdr_core_t *core, qdr_address_t *addr, int budget)
+{
+    int64_t         owed = 0;
+    qdr_link_ref_t *ref  = DEQ_HEAD(addr->inlinks);
+    for (; ref; ref = DEQ_NEXT(ref))
+        if (ref->link->credit_pending > 0)
+            owed += ref->link->credit_pending;
+
+    if (owed == 0)
+        return false;
+
+    if (budget == 0 || owed <= budget) {
+        for (ref = DEQ_HEAD(addr->inlinks); ref; ref = DEQ_NEXT(ref))
+            if (ref->link->credit_pending > 0)
+                qdr_link_issue_credit_CT(core, ref->link, ref->link->credit_pending, false);
+        return false;
+    }
+
+    int    left  = budget;
+    size_t count = DEQ_SIZE(addr->inlinks);
+    ref = DEQ_HEAD(addr->inlinks);
+    while (ref && count-- > 0 && left > 0) {
+        qdr_link_ref_t *next = DEQ_NEXT(ref);
+        qdr_link_t     *link = ref->link;
+        if (link->credit_pending > 0) {
+            int share = (int) ((int64_t) budget * link->credit_pending / owed);
+            if (share < 1)
+                share = 1;
+            if (share > left)
+                share = left;
+            if (share > link->credit_pending)
+                share = link->credit_pending;
+            left -= share;
+            qdr_link_issue_credit_CT(core, link, share, false);
+            DEQ_REMOVE(addr->inlinks, ref);
+            DEQ_INSERT_TAIL(addr->inlinks, ref);
+        }
+        ref = next;
+    }
+    return true;
+}
+
+
+static void qdr_addr_credit_release_CT(qdr_core_t *core, void *context)
+{
+    //
+    // Only the addresses queued before this pass are served, one slice each
+    //
+    size_t count = DEQ_SIZE(core->addrs_credit);
+    while (count-- > 0) {
+        qdr_address_t *addr = DEQ_HEAD(core->addrs_credit);
+        DEQ_REMOVE_HEAD_N(CREDIT, core->addrs_credit);
+        addr->in_credit_list = false;
+
+        //
+        // An address that lost its path again keeps the rest for its next start
+        //
+        if (qdr_addr_path_count_CT(addr) == 1 &&
+            qdr_addr_release_credit_CT(core, addr, core->producer_credit_release)) {
+            DEQ_INSERT_TAIL_N(CREDIT, core->addrs_credit, addr);
+            addr->in_credit_list = true;
+        }
+    }
+
+    if (DEQ_SIZE(core->addrs_credit) > 0)
+        qdr_core_timer_schedule_msec_CT(core, core->credit_release_timer, QDR_CREDIT_RELEASE_MSEC);
+}
+
+
+static void qdr_addr_credit_defer_CT(qdr_core_t *core, qdr_address_t *addr)
+{
+    if (!addr->in_credit_list) {
+        DEQ_INSERT_TAIL_N(CREDIT, core->addrs_credit, addr);
+        addr->in_credit_list = true;
+    }
+    if (!core->credit_release_timer)
+        core->credit_release_timer = qdr_core_timer_CT(core, qdr_addr_credit_release_CT, 0);
+    if (!qdr_core_timer_scheduled_CT(core->credit_release_timer))
+        qdr_core_timer_schedule_msec_CT(core, core->credit_release_timer, QDR_CREDIT_RELEASE_MSEC);
+}
+
+
 void qdr_addr_start_inlinks_CT(qdr_core_t *core, qdr_address_t *addr)
 {
+    //
+    // A new destination may take messages held in the in-router queue.
+    //
+    if (DEQ_SIZE(addr->queue) > 0)
+        qdr_addr_drain_queue_CT(core, addr);
+
     //
     // If there aren't any inlinks, there's no point in proceeding.
     //
@@ -1436,21 +2313,18 @@ void qdr_addr_start_inlinks_CT(qdr_core_t *core, qdr_address_t *addr)
         return;
 
     if (qdr_addr_path_count_CT(addr) == 1) {
+        //
+        // Issue credit to stalled links, paced if producerCreditRelease is set
+        //
+        if (qdr_addr_release_credit_CT(core, addr, core->producer_credit_release))
+            qdr_addr_credit_defer_CT(core, addr);
+
+        //
+        // Drain undelivered deliveries via the forwarder
+        //
         qdr_link_ref_t *ref = DEQ_HEAD(addr->inlinks);
         while (ref) {
-            qdr_link_t *link = ref->link;
-
-            //
-            // Issue credit to stalled links
-            //
-            if (link->credit_pending > 0)
-                qdr_link_issue_credit_CT(core, link, link->credit_pending, false);
-
-            //
-            // Drain undelivered deliveries via the forwarder
-            //
-            qdr_drain_inbound_undelivered_CT(core, link, addr);
-
+            qdr_drain_inbound_undelivered_CT(core, ref->link, addr);
             ref = DEQ_NEXT(ref);
         }
     }
@@ -1470,16 +2344,21 @@ void qdr_delivery_push_CT(qdr_core_t *core, qdr_delivery_t *dlv)
         qdr_delivery_incref(dlv, "qdr_delivery_push_CT - add to updated list");
         qdr_add_delivery_ref_CT(&link->updated_deliveries, dlv);
         // Adding this work at priority 0.
-        qdr_add_link_ref(link->conn->links_with_work, link, QDR_LINK_LIST_CLASS_WORK);
+        qdr_add_link_ref(qdr_connection_work_links(link->conn, 0), link, QDR_LINK_LIST_CLASS_WORK);
         activate = true;
     }
     sys_mutex_unlock(link->conn->work_lock);
 
     //
-    // Activate the connection
+    // Activate the connection.  Settlements on inter-router links may wait a little
+    // so that those that follow share the same disposition frames.
     //
-    if (activate)
-        qdr_connection_activate_CT(core, link->conn);
+    if (activate) {
+        if (dlv->settled && link->link_type == QD_LINK_ROUTER && core->settle_window_usec > 0)
+            qdr_connection_hold_settlement_CT(core, link->conn);
+        else
+            qdr_connection_activate_CT(core, link->conn);
+    }
 }
 
 pn_data_t* qdr_delivery_extension_state(qdr_delivery_t *delivery)
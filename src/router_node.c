@@ -26,6 +26,11 @@
 #include "dispatch_private.h"
 #include "entity_cache.h"
 #include "router_private.h"
+#include "message_private.h"
+#include "iterator_private.h"
+#include "compression.h"
+#include "message_log.h"
+#include "probes.h"
 #include <qpid/dispatch/router_core.h>
 #include <qpid/dispatch/proton_utils.h>
 #include <proton/sasl.h>
@@ -36,10 +41,12 @@ const char *QD_ROUTER_ADDRESS_TYPE = "router.address";
 const char *QD_ROUTER_LINK_TYPE = "router.link";
 
 static char *router_role    = "inter-router";
+static char *router_data_role = "inter-router-data";
 static char *container_role = "route-container";
 static char *edge_role      = "edge";
 static char *direct_prefix;
 static char *node_id;
+static uint64_t node_id_hash;  // This router's compact trace identifier
 
 static void deferred_AMQP_rx_handler(void *context, bool discard);
 
@@ -144,6 +151,11 @@ static void qd_router_connection_get_config(const qd_connection_t  *conn,
             *strip_annotations_out = false;
             *role = QDR_ROLE_INTER_ROUTER;
             *cost = cf->inter_router_cost;
+        } else if (cf && (strcmp(cf->role, router_data_role) == 0)) {
+            *strip_annotations_in  = false;
+            *strip_annotations_out = false;
+            *role = QDR_ROLE_INTER_ROUTER_DATA;
+            *cost = cf->inter_router_cost;
         } else if (cf && (strcmp(cf->role, edge_role) == 0)) {
             *strip_annotations_in  = false;
             *strip_annotations_out = false;
@@ -170,20 +182,53 @@ static int AMQP_writable_conn_handler(void *type_context, qd_connection_t *conn,
 {
     qdr_connection_t *qconn = (qdr_connection_t*) qd_connection_get_context(conn);
 
-    if (qconn)
+    if (qconn) {
+        if (qd_connection_compression(conn)) {
+            uint64_t in[2], out[2];
+            qd_connection_compression_stats(conn, in, out);
+            qdr_connection_set_compression_stats(qconn, in, out);
+        }
+        uint32_t max_frame_size;
+        uint64_t frames[2], octets[2];
+        qd_connection_frame_stats(conn, &max_frame_size, frames, octets);
+        qdr_connection_set_frame_stats(qconn, max_frame_size, frames, octets);
         return qdr_connection_process(qconn);
+    }
     return 0;
 }
 
 
+static bool is_compact_id(qd_parsed_field_t *item)
+{
+    uint8_t tag = qd_parse_tag(item);
+    return tag == QD_AMQP_ULONG || tag == QD_AMQP_SMALLULONG || tag == QD_AMQP_ULONG0;
+}
+
+
+/**
+ * The compact trace identifier of a trace entry or ingress in either encoding.
+ */
+static uint64_t trace_item_id(qd_parsed_field_t *item)
+{
+    if (is_compact_id(item))
+        return qd_parse_as_ulong(item);
+
+    qd_iterator_t *iter = qd_parse_raw(item);
+    qd_iterator_reset_view(iter, ITER_VIEW_NODE_HASH);
+    return qd_tracemask_id_hash(iter);
+}
+
+
 static qd_iterator_t *router_annotate_message(qd_router_t   *router,
                                               qd_message_t  *msg,
                                               qd_bitmask_t **link_exclusions,
                                               uint32_t      *distance,
                                               int           *ingress_index)
 {
-    qd_iterator_t *ingress_iter = 0;
-    bool           edge_mode    = router->router_mode == QD_ROUTER_MODE_EDGE;
+    qd_iterator_t       *ingress_iter  = 0;
+    bool                 edge_mode     = router->router_mode == QD_ROUTER_MODE_EDGE;
+    bool                 compact       = router->qd->compact_annotations;
+    qd_composed_field_t *trace_compact = 0;
 
     *link_exclusions = 0;
     *distance        = 0;
@@ -192,6 +237,7 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
     qd_parsed_field_t *ingress = qd_message_get_ingress(msg);
     qd_parsed_field_t *to      = qd_message_get_to_override(msg);
     qd_parsed_field_t *phase   = qd_message_get_phase(msg);
+    qd_parsed_field_t *sequence = qd_message_get_sequence(msg);
 
     //
     // QD_MA_TRACE:
@@ -201,9 +247,18 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
     //
     // Edge routers do not add their IDs to the trace list.
     //
+    // With compact annotations enabled the trace is also composed as a list of
+    // compact router identifiers, which is sent instead of the strings on links
+    // to peers that negotiated it.  Compact entries received from such a peer
+    // are turned back into IDs for the string list.
+    //
     if (!edge_mode) {
         qd_composed_field_t *trace_field = qd_compose_subfield(0);
+        if (compact)
+            trace_compact = qd_compose_subfield(0);
         qd_compose_start_list(trace_field);
+        if (trace_compact)
+            qd_compose_start_list(trace_compact);
         if (trace) {
             if (qd_parse_is_list(trace)) {
                 //
@@ -224,9 +279,9 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
                 uint32_t idx = 0;
                 qd_parsed_field_t *trace_item = qd_parse_sub_value(trace, idx);
                 while (trace_item) {
-                    qd_iterator_t *iter = qd_parse_raw(trace_item);
-                    qd_iterator_reset_view(iter, ITER_VIEW_ALL);
-                    qd_compose_insert_string_iterator(trace_field, iter);
+                    qd_tracemask_resolve_id(router->tracemask, trace_item, trace_field);
+                    if (trace_compact)
+                        qd_compose_insert_ulong(trace_compact, trace_item_id(trace_item));
                     idx++;
                     trace_item = qd_parse_sub_value(trace, idx);
                 }
@@ -236,6 +291,10 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
         qd_compose_insert_string(trace_field, node_id);
         qd_compose_end_list(trace_field);
         qd_message_set_trace_annotation(msg, trace_field);
+        if (trace_compact) {
+            qd_compose_insert_ulong(trace_compact, node_id_hash);
+            qd_compose_end_list(trace_compact);
+        }
     }
 
     //
@@ -256,6 +315,16 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
         qd_message_set_phase_annotation(msg, qd_message_get_phase_val(msg));
     }
 
+    //
+    // QD_MA_SEQUENCE:
+    // Preserve the existing value.
+    //
+    if (sequence && qd_parse_is_scalar(sequence)) {
+        qd_composed_field_t *sequence_field = qd_compose_subfield(0);
+        qd_compose_insert_string_iterator(sequence_field, qd_parse_raw(sequence));
+        qd_message_set_sequence_annotation(msg, sequence_field);
+    }
+
     //
     // QD_MA_INGRESS:
     // If there is no ingress field, annotate the ingress as
@@ -263,14 +332,32 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
     //
     // Edge routers do not annotate the ingress field.
     //
+    // A compact ingress has no address for the core to look up, so its mask bit
+    // is returned in ingress_index instead of an iterator.
+    //
     if (!edge_mode) {
         qd_composed_field_t *ingress_field = qd_compose_subfield(0);
+        uint64_t             ingress_id    = node_id_hash;
         if (ingress && qd_parse_is_scalar(ingress)) {
-            ingress_iter = qd_parse_raw(ingress);
-            qd_compose_insert_string_iterator(ingress_field, ingress_iter);
+            if (is_compact_id(ingress)) {
+                int maskbit = qd_tracemask_resolve_id(router->tracemask, ingress, ingress_field);
+                if (maskbit >= 0)
+                    *ingress_index = maskbit;
+            } else {
+                ingress_iter = qd_parse_raw(ingress);
+                qd_compose_insert_string_iterator(ingress_field, ingress_iter);
+            }
+            if (compact)
+                ingress_id = trace_item_id(ingress);
         } else
             qd_compose_insert_string(ingress_field, node_id);
         qd_message_set_ingress_annotation(msg, ingress_field);
+
+        if (trace_compact) {
+            qd_composed_field_t *ingress_compact = qd_compose_subfield(0);
+            qd_compose_insert_ulong(ingress_compact, ingress_id);
+            qd_message_set_compact_annotations(msg, trace_compact, ingress_compact);
+        }
     }
 
     //
@@ -280,28 +367,6 @@ static qd_iterator_t *router_annotate_message(qd_router_t   *router,
     return ingress_iter;
 }
 
-static void log_link_message(qd_connection_t *conn, pn_link_t *pn_link, qd_message_t *msg)
-{
-    if (!conn || !pn_link || !msg) return;
-    const qd_server_config_t *cf = qd_connection_config(conn);
-    if (!cf) return;
-    char buf[qd_message_repr_len()];
-    const char *msg_str = qd_message_aborted(msg) ?
-        "aborted message" : qd_message_repr(msg, buf, sizeof(buf), cf->log_bits);
-    if (msg_str) {
-        const char *src = pn_terminus_get_address(pn_link_source(pn_link));
-        const char *tgt = pn_terminus_get_address(pn_link_target(pn_link));
-        qd_log(qd_message_log_source(), QD_LOG_TRACE,
-               "[C%"PRIu64"]: %s %s on link '%s' (%s -> %s)",
-               qd_connection_connection_id(conn),
-               pn_link_is_sender(pn_link) ? "Sent" : "Received",
-               msg_str,
-               pn_link_name(pn_link),
-               src ? src : "",
-               tgt ? tgt : "");
-    }
-}
-
 /**
  * Inbound Delivery Handler
  */
@@ -318,6 +383,13 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
     pn_delivery_t  *pnd          = pn_link_current(pn_link);
     if (!pnd)
         return next_delivery;
+
+    //
+    // Hold the core actions generated while processing this event batch so they
+    // are handed to the core together when the batch completes.
+    //
+    qdr_action_batch_begin(router->router_core);
+
     qdr_link_t     *rlink        = (qdr_link_t*) qd_link_get_context(link);
     qd_connection_t  *conn       = qd_link_connection(link);
     qdr_delivery_t *delivery     = qdr_node_delivery_qdr_from_pn(pnd);
@@ -328,8 +400,15 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
     qd_message_t   *msg   = qd_message_receive(pnd);
     bool receive_complete = qd_message_receive_complete(msg);
 
+    uint32_t q2_stalls = qd_link_take_q2_stalls(link);
+    if (q2_stalls && rlink)
+        qdr_link_stalled_inbound(rlink, q2_stalls);
+
     if (receive_complete) {
-        log_link_message(conn, pn_link, msg);
+        qd_message_log(conn, pn_link, msg);
+
+        if (conn && conn->policy_settings)
+            qd_policy_rate_charge(conn, qd_message_buffered_size(msg));
 
         //
         // The entire message has been received and we are ready to consume the delivery by calling pn_link_advance().
@@ -474,23 +553,23 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
 
     if (check_user) {
         // This connection must not allow proxied user_id
-        qd_iterator_t *userid_iter  = qd_message_field_iterator(msg, QD_FIELD_USER_ID);
-        if (userid_iter) {
+        qd_iterator_t userid_iter;
+        if (qd_message_field_iterator_init(msg, QD_FIELD_USER_ID, &userid_iter)) {
             // The user_id property has been specified
-            if (qd_iterator_remaining(userid_iter) > 0) {
+            if (qd_iterator_remaining(&userid_iter) > 0) {
                 // user_id property in message is not blank
-                if (!qd_iterator_equal(userid_iter, (const unsigned char *)conn->user_id)) {
+                if (!qd_iterator_equal(&userid_iter, (const unsigned char *)conn->user_id)) {
                     // This message is rejected: attempted user proxy is disallowed
                     qd_log(router->log_source, QD_LOG_DEBUG, "Message rejected due to user_id proxy violation. User:%s", conn->user_id);
                     pn_link_flow(pn_link, 1);
                     pn_delivery_update(pnd, PN_REJECTED);
                     pn_delivery_settle(pnd);
                     qd_message_free(msg);
-                    qd_iterator_free(userid_iter);
+                    qd_iterator_fini(&userid_iter);
                     return next_delivery;
                 }
             }
-            qd_iterator_free(userid_iter);
+            qd_iterator_fini(&userid_iter);
         }
     }
 
@@ -517,6 +596,12 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
         return next_delivery;
     }
 
+    //
+    // A pre-settled delivery that has fully arrived needs no tracking on this side:
+    // hand it to the core without keeping a qdr_delivery and settle it now.
+    //
+    bool presettled = pn_delivery_settled(pnd) && receive_complete;
+
     if (anonymous_link) {
         qd_iterator_t *addr_iter = 0;
         int phase = 0;
@@ -554,6 +639,11 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
                 qd_iterator_reset_view(addr_iter, ITER_VIEW_ADDRESS_HASH);
                 if (phase > 0)
                     qd_iterator_annotate_phase(addr_iter, '0' + (char) phase);
+                if (presettled) {
+                    qdr_link_deliver_presettled(rlink, msg, ingress_iter, addr_iter, link_exclusions, ingress_index);
+                    pn_delivery_settle(pnd);
+                    return next_delivery;
+                }
                 delivery = qdr_link_deliver_to(rlink, msg, ingress_iter, addr_iter, pn_delivery_settled(pnd),
                                                link_exclusions, ingress_index);
             } else {
@@ -587,10 +677,11 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
         if (term_addr) {
             qd_composed_field_t *to_override = qd_compose_subfield(0);
             if (tenant_space) {
-                qd_iterator_t *aiter = qd_iterator_string(term_addr, ITER_VIEW_ADDRESS_WITH_SPACE);
-                qd_iterator_annotate_space(aiter, tenant_space, tenant_space_len);
-                qd_compose_insert_string_iterator(to_override, aiter);
-                qd_iterator_free(aiter);
+                qd_iterator_t aiter;
+                qd_iterator_init_string(&aiter, term_addr, ITER_VIEW_ADDRESS_WITH_SPACE);
+                qd_iterator_annotate_space(&aiter, tenant_space, tenant_space_len);
+                qd_compose_insert_string_iterator(to_override, &aiter);
+                qd_iterator_fini(&aiter);
             } else
                 qd_compose_insert_string(to_override, term_addr);
             qd_message_set_to_override_annotation(msg, to_override);
@@ -598,6 +689,11 @@ static bool AMQP_rx_handler(void* context, qd_link_t *link)
             if (phase != 0)
                 qd_message_set_phase_annotation(msg, phase);
         }
+        if (presettled) {
+            qdr_link_deliver_presettled(rlink, msg, ingress_iter, 0, link_exclusions, ingress_index);
+            pn_delivery_settle(pnd);
+            return next_delivery;
+        }
         delivery = qdr_link_deliver(rlink, msg, ingress_iter, pn_delivery_settled(pnd), link_exclusions, ingress_index);
     }
 
@@ -668,14 +764,15 @@ static void AMQP_disposition_handler(void* context, qd_link_t *link, pn_delivery
     qdr_error_t      *error = qdr_error_from_pn(cond);
 
     //
-    // Update the disposition of the delivery
+    // Update the disposition of the delivery.  Within the event batch, consecutive
+    // updates on this connection are carried to the core in one action.
     //
-    qdr_delivery_update_disposition(router->router_core, delivery,
-                                    pn_delivery_remote_state(pnd),
-                                    pn_delivery_settled(pnd),
-                                    error,
-                                    pn_disposition_data(disp),
-                                    false);
+    qdr_action_batch_begin(router->router_core);
+    qdr_delivery_update_dispositions(router->router_core, delivery,
+                                     pn_delivery_remote_state(pnd),
+                                     pn_delivery_settled(pnd),
+                                     error,
+                                     pn_disposition_data(disp));
 
     //
     // If settled, close out the delivery
@@ -773,6 +870,26 @@ static int AMQP_link_flow_handler(void* context, qd_link_t *link)
 }
 
 
+/**
+ * Event Batch Complete Handler
+ */
+static void AMQP_batch_complete_handler(void *context)
+{
+    qd_router_t *router = (qd_router_t*) context;
+
+    //
+    // Hand any core actions held during this event batch to the core thread.
+    //
+    qdr_action_batch_end();
+
+    //
+    // Free the messages received on this thread that the core has finished with.
+    //
+    if (router->router_core)
+        qdr_delivery_cleanup_drain(router->router_core);
+}
+
+
 /**
  * Link Detached Handler
  */
@@ -910,6 +1027,7 @@ static void AMQP_opened_handler(qd_router_t *router, qd_connection_t *conn, bool
     const char *container = conn->pn_conn ? pn_connection_remote_container(conn->pn_conn) : 0;
     conn->strip_annotations_in  = false;
     conn->strip_annotations_out = false;
+    conn->compact_annotations   = false;
     if (conn->pn_conn) {
         tport = pn_connection_transport(conn->pn_conn);
         ssl   = conn->ssl;
@@ -942,9 +1060,14 @@ static void AMQP_opened_handler(qd_router_t *router, qd_connection_t *conn, bool
 
     pn_data_t *props = pn_conn ? pn_connection_remote_properties(pn_conn) : 0;
 
-    if (role == QDR_ROLE_INTER_ROUTER || role == QDR_ROLE_EDGE_CONNECTION) {
+    conn->compression = false;
+
+    if (role == QDR_ROLE_INTER_ROUTER || role == QDR_ROLE_INTER_ROUTER_DATA || role == QDR_ROLE_EDGE_CONNECTION) {
         //
-        // Check the remote properties for an inter-router cost value.
+        // Check the remote properties for an inter-router cost value, for
+        // the marker a peer puts on its inter-router-data connections, and for
+        // a peer router's offers of compact trace and ingress annotations and
+        // of message compression.
         //
         if (props) {
             pn_data_rewind(props);
@@ -959,8 +1082,30 @@ static void AMQP_opened_handler(qd_router_t *router, qd_connection_t *conn, bool
                             pn_data_next(props);
                             if (pn_data_type(props) == PN_INT)
                                 remote_cost = pn_data_get_int(props);
-                            break;
-                        }
+                        } else if (sym.size == strlen(QD_CONNECTION_PROPERTY_DATA_KEY) &&
+                                   strncmp(sym.start, QD_CONNECTION_PROPERTY_DATA_KEY, sym.size) == 0) {
+                            pn_data_next(props);
+                            if (role == QDR_ROLE_INTER_ROUTER && pn_data_type(props) == PN_BOOL &&
+                                pn_data_get_bool(props))
+                                role = QDR_ROLE_INTER_ROUTER_DATA;
+                        } else if (sym.size == strlen(QD_CONNECTION_PROPERTY_COMPACT_ANNOTATIONS_KEY) &&
+                                   strncmp(sym.start, QD_CONNECTION_PROPERTY_COMPACT_ANNOTATIONS_KEY, sym.size) == 0) {
+                            pn_data_next(props);
+                            if (role != QDR_ROLE_EDGE_CONNECTION && router->qd->compact_annotations &&
+                                pn_data_type(props) == PN_BOOL && pn_data_get_bool(props))
+                                conn->compact_annotations = true;
+                        } else if (sym.size == strlen(QD_CONNECTION_PROPERTY_COMPRESSION_KEY) &&
+                                   strncmp(sym.start, QD_CONNECTION_PROPERTY_COMPRESSION_KEY, sym.size) == 0) {
+                            pn_data_next(props);
+                            const qd_server_config_t *cf = qd_connection_config(conn);
+                            if (cf && cf->compression && qd_compression_supported() &&
+                                pn_data_type(props) == PN_SYMBOL) {
+                                pn_bytes_t method = pn_data_get_symbol(props);
+                                conn->compression = method.size == strlen(qd_compression_method()) &&
+                                    strncmp(method.start, qd_compression_method(), method.size) == 0;
+                            }
+                        } else
+                            pn_data_next(props);  // Skip the value of any other key
                     }
                 }
             }
@@ -1224,6 +1369,16 @@ static void qd_router_timer_handler(void *context)
 
     // This sends a tick into the core and this happens every second.
     qdr_process_tick(router->router_core);
+
+    //
+    // Return surplus cached allocator memory to the heap.
+    //
+    int trim_interval = router->qd->allocator_trim_interval;
+    if (trim_interval > 0 && ++router->alloc_trim_ticks >= trim_interval) {
+        router->alloc_trim_ticks = 0;
+        qd_alloc_trim();
+    }
+
     qd_timer_schedule(router->timer, 1000);
 }
 
@@ -1237,6 +1392,7 @@ static qd_node_type_t router_node = {"router", 0, 0,
                                      AMQP_link_detach_handler,
                                      AMQP_link_attach_handler,
                                      AMQP_link_flow_handler,
+                                     AMQP_batch_complete_handler,
                                      0,   // node_created_handler
                                      0,   // node_destroyed_handler
                                      AMQP_inbound_opened_handler,
@@ -1280,6 +1436,10 @@ qd_router_t *qd_router(qd_dispatch_t *qd, qd_router_mode_t mode, const char *are
     //
     qd_iterator_set_address(mode == QD_ROUTER_MODE_EDGE, area, id);
 
+    qd_iterator_t *node_iter = qd_iterator_string(node_id, ITER_VIEW_NODE_HASH);
+    node_id_hash = qd_tracemask_id_hash(node_iter);
+    qd_iterator_free(node_iter);
+
     switch (router->router_mode) {
     case QD_ROUTER_MODE_STANDALONE: qd_log(router->log_source, QD_LOG_INFO, "Router started in Standalone mode");  break;
     case QD_ROUTER_MODE_INTERIOR:   qd_log(router->log_source, QD_LOG_INFO, "Router started in Interior mode, area=%s id=%s", area, id);  break;
@@ -1296,8 +1456,9 @@ qd_router_t *qd_router(qd_dispatch_t *qd, qd_router_mode_t mode, const char *are
 static void CORE_connection_activate(void *context, qdr_connection_t *conn)
 {
     //
-    // IMPORTANT:  This is the only core callback that is invoked on the core
-    //             thread itself. It must not take locks that could deadlock the core.
+    // IMPORTANT:  Unlike the other core callbacks, this one is invoked on the core
+    //             thread itself as well as on I/O threads. It must not take locks
+    //             that could deadlock the core.
     //
     qd_server_activate((qd_connection_t*) qdr_connection_get_context(conn));
 }
@@ -1412,9 +1573,21 @@ static void CORE_link_flow(void *context, qdr_link_t *link, int credit)
         return;
 
     pn_link_t *plink = qd_link_pn(qlink);
+    if (!plink)
+        return;
 
-    if (plink)
-        pn_link_flow(plink, credit);
+    //
+    // A connection holding more buffer memory than its policy allows gets no more
+    // credit until the memory is released.  One over its policy message or byte
+    // rate gets none until the rate allows another message.
+    //
+    qd_connection_t *conn = qd_link_connection(qlink);
+    if (conn && (qd_connection_memory_blocked(conn) || qd_policy_rate_limited(conn))) {
+        qd_link_withhold_credit(qlink, credit);
+        return;
+    }
+
+    pn_link_flow(plink, credit);
 }
 
 
@@ -1535,6 +1708,7 @@ static uint64_t CORE_link_deliver(void *context, qdr_link_t *link, qdr_delivery_
 
     qd_message_t *msg_out = qdr_delivery_message(dlv);
 
+    QD_PROBE3(core_link_deliver, qd_message_trace_id(msg_out), dlv, settled);
     qd_message_send(msg_out, qlink, qdr_link_strip_annotations_out(link), &restart_rx, &q3_stalled);
 
     if (q3_stalled)
@@ -1577,7 +1751,7 @@ static uint64_t CORE_link_deliver(void *context, qdr_link_t *link, qdr_delivery_
                     pn_delivery_settle(pdlv);
             }
         }
-        log_link_message(qconn, plink, msg_out);
+        qd_message_log(qconn, plink, msg_out);
     }
     return update;
 }
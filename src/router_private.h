@@ -64,6 +64,7 @@ struct qd_router_t {
 
     sys_mutex_t              *lock;
     qd_timer_t               *timer;
+    int                       alloc_trim_ticks;
 
     //
     // Store the "radius" of the current network topology.  This is defined as the
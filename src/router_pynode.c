@@ -27,13 +27,33 @@
 #include "router_private.h"
 #include "entity_cache.h"
 #include "python_private.h"
+#include "router_core/path_engine.h"
 
 static qd_log_source_t *log_source = 0;
 static PyObject        *pyRouter   = 0;
 static PyObject        *pyTick     = 0;
-static PyObject        *pyAdded    = 0;
-static PyObject        *pyRemoved  = 0;
 static PyObject        *pyLinkLost = 0;
+static PyObject        *pyChanged  = 0;
+
+static qdr_path_graph_t *path_graph = 0;  // Kept between route calculations
+
+//
+// Local mobile address changes reported by the core.  These are queued here,
+// under a lock of their own, and handed to the Python engine in one call at
+// the next timer tick.  The engine only advertises local address changes from
+// its tick, so this costs no latency and keeps the threads running core
+// general work from contending for the Python lock once per address.
+//
+typedef struct mobile_change_t mobile_change_t;
+struct mobile_change_t {
+    DEQ_LINKS(mobile_change_t);
+    char *address_hash;
+    int   treatment;   // -1 for a removed address
+};
+DEQ_DECLARE(mobile_change_t, mobile_change_list_t);
+
+static sys_mutex_t          *mobile_lock = 0;
+static mobile_change_list_t  mobile_changes;
 
 typedef struct {
     PyObject_HEAD
@@ -224,6 +244,221 @@ static PyObject* qd_set_valid_origins(PyObject *self, PyObject *args)
 }
 
 
+static PyObject* qd_set_equal_cost_hops(PyObject *self, PyObject *args)
+{
+    RouterAdapter *adapter = (RouterAdapter*) self;
+    qd_router_t   *router  = adapter->router;
+    int            router_maskbit;
+    PyObject      *hop_list;
+
+    if (!PyArg_ParseTuple(args, "iO", &router_maskbit, &hop_list))
+        return 0;
+
+    if (router_maskbit >= qd_bitmask_width() || router_maskbit < 0) {
+        PyErr_SetString(PyExc_Exception, "Router bit mask out of range");
+        return 0;
+    }
+
+    if (!PyList_Check(hop_list)) {
+        PyErr_SetString(PyExc_Exception, "Expected List as argument 2");
+        return 0;
+    }
+
+    qd_bitmask_t *next_hops = qd_bitmask(0);
+    Py_ssize_t    hop_count = PyList_Size(hop_list);
+    for (Py_ssize_t idx = 0; idx < hop_count; idx++) {
+        PyObject *pi      = PyList_GetItem(hop_list, idx);
+        int       maskbit = QD_PY_INT_CHECK(pi) ? (int) QD_PY_INT_2_INT64(pi) : -1;
+        if (maskbit >= qd_bitmask_width() || maskbit < 0) {
+            qd_bitmask_free(next_hops);
+            PyErr_SetString(PyExc_Exception, "Next hop bit mask out of range");
+            return 0;
+        }
+        qd_bitmask_set_bit(next_hops, maskbit);
+    }
+
+    qdr_core_set_equal_cost_hops(router->router_core, router_maskbit, next_hops);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/**
+ * Load the link states (a dict of router id to its dict of peer id to cost) into
+ * the path graph.  Returns false with *full set if the graph ran out of node slots.
+ */
+static bool load_link_states(qdr_path_graph_t *graph, PyObject *link_states, bool *full, char **error)
+{
+    PyObject   *key;
+    PyObject   *peers;
+    Py_ssize_t  iter = 0;
+
+    qdr_path_graph_reload(graph);
+    while (PyDict_Next(link_states, &iter, &key, &peers)) {
+        char *id   = py_string_2_c(key);
+        int   node = id ? qdr_path_graph_node(graph, id) : -1;
+        free(id);
+        if (node < 0) {
+            *full = true;
+            return false;
+        }
+
+        if (!PyDict_Check(peers)) {
+            *error = "Expected Dict of peer costs";
+            return false;
+        }
+
+        qdr_path_graph_link_state(graph, node);
+
+        PyObject   *peer_key;
+        PyObject   *peer_cost;
+        Py_ssize_t  peer_iter = 0;
+        while (PyDict_Next(peers, &peer_iter, &peer_key, &peer_cost)) {
+            char *peer_id = py_string_2_c(peer_key);
+            int   peer    = peer_id ? qdr_path_graph_node(graph, peer_id) : -1;
+            free(peer_id);
+            if (peer < 0) {
+                *full = true;
+                return false;
+            }
+            if (!QD_PY_INT_CHECK(peer_cost)) {
+                *error = "Expected integer link cost";
+                return false;
+            }
+            qdr_path_graph_link(graph, node, peer, (int) QD_PY_INT_2_INT64(peer_cost));
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Compute next hops, costs, valid origins and the radius from the link states in
+ * C.  Returns the same tuple as PathEngine.calculate_routes or None if there are
+ * more routers than the engine has node slots, in which case the caller computes
+ * them in Python.
+ *
+ * The graph is kept between calls so that only the shortest-path trees affected
+ * by what changed since the last call are recomputed.
+ */
+static PyObject* qd_calculate_routes(PyObject *self, PyObject *args)
+{
+    const char *root_id;
+    PyObject   *link_states;
+    char       *error = 0;
+    bool        full  = false;
+
+    if (!PyArg_ParseTuple(args, "sO", &root_id, &link_states))
+        return 0;
+
+    if (!PyDict_Check(link_states)) {
+        PyErr_SetString(PyExc_Exception, "Expected Dict as argument 2");
+        return 0;
+    }
+
+    if (!path_graph)
+        path_graph = qdr_path_graph();
+
+    if (!load_link_states(path_graph, link_states, &full, &error) && full) {
+        //
+        // Routers that have left the network still hold node slots.  Start over
+        // with a fresh graph before giving up.
+        //
+        qdr_path_graph_free(path_graph);
+        path_graph = qdr_path_graph();
+        full       = false;
+        load_link_states(path_graph, link_states, &full, &error);
+    }
+
+    if (error || full) {
+        //
+        // The graph is partly loaded; start from scratch next time.
+        //
+        qdr_path_graph_free(path_graph);
+        path_graph = 0;
+        if (error) {
+            PyErr_SetString(PyExc_Exception, error);
+            return 0;
+        }
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    qdr_path_graph_t *graph = path_graph;
+    int               root  = qdr_path_graph_node(graph, root_id);
+    if (root < 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    int               count  = qdr_path_graph_node_count(graph);
+    qdr_path_route_t *routes = NEW_ARRAY(qdr_path_route_t, count);
+    int               radius = qdr_path_calculate_routes(graph, root, routes);
+
+    PyObject *next_hops     = PyDict_New();
+    PyObject *costs         = PyDict_New();
+    PyObject *valid_origins = PyDict_New();
+
+    for (int node = 0; node < count; node++) {
+        if (routes[node].next_hop >= 0) {
+            const char *id  = qdr_path_graph_node_id(graph, node);
+            PyObject   *hop = PyUnicode_FromString(qdr_path_graph_node_id(graph, routes[node].next_hop));
+            PyObject   *cst = PyLong_FromLong((long) routes[node].cost);
+            PyObject   *vo  = PyList_New(0);
+            int         origin, c;
+
+            for (QD_BITMASK_EACH(routes[node].valid_origins, origin, c)) {
+                PyObject *oid = PyUnicode_FromString(qdr_path_graph_node_id(graph, origin));
+                PyList_Append(vo, oid);
+                Py_DECREF(oid);
+            }
+
+            PyDict_SetItemString(next_hops, id, hop);
+            PyDict_SetItemString(costs, id, cst);
+            PyDict_SetItemString(valid_origins, id, vo);
+            Py_DECREF(hop);
+            Py_DECREF(cst);
+            Py_DECREF(vo);
+        }
+        qd_bitmask_free(routes[node].valid_origins);
+    }
+
+    free(routes);
+
+    PyObject *result = PyTuple_New(4);
+    PyTuple_SetItem(result, 0, next_hops);
+    PyTuple_SetItem(result, 1, costs);
+    PyTuple_SetItem(result, 2, valid_origins);
+    PyTuple_SetItem(result, 3, PyLong_FromLong((long) radius));
+    return result;
+}
+
+
+static PyObject* qd_begin_route_update(PyObject *self, PyObject *args)
+{
+    RouterAdapter *adapter = (RouterAdapter*) self;
+    qd_router_t   *router  = adapter->router;
+
+    qdr_core_route_table_begin(router->router_core);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+static PyObject* qd_commit_route_update(PyObject *self, PyObject *args)
+{
+    RouterAdapter *adapter = (RouterAdapter*) self;
+    qd_router_t   *router  = adapter->router;
+
+    qdr_core_route_table_commit(router->router_core);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
 static PyObject* qd_set_radius(PyObject *self, PyObject *args)
 {
     RouterAdapter *adapter = (RouterAdapter*) self;
@@ -281,6 +516,149 @@ static PyObject* qd_unmap_destination(PyObject *self, PyObject *args)
     return Py_None;
 }
 
+
+/**
+ * Map (treatments is a list) or unmap (treatments is None) a list of destinations
+ * for one router in a single call and a single route table transaction.
+ */
+static PyObject* qd_map_destinations_common(PyObject *self, PyObject *args, bool map)
+{
+    RouterAdapter *adapter = (RouterAdapter*) self;
+    qd_router_t   *router  = adapter->router;
+    PyObject      *addr_list;
+    PyObject      *treatments = Py_None;
+    int            maskbit;
+
+    if (map ? !PyArg_ParseTuple(args, "OOi", &addr_list, &treatments, &maskbit)
+            : !PyArg_ParseTuple(args, "Oi", &addr_list, &maskbit))
+        return 0;
+
+    if (maskbit >= qd_bitmask_width() || maskbit < 0) {
+        PyErr_SetString(PyExc_Exception, "Router bit mask out of range");
+        return 0;
+    }
+
+    if (!PyList_Check(addr_list) || (treatments != Py_None && !PyList_Check(treatments))) {
+        PyErr_SetString(PyExc_Exception, "Expected List of addresses");
+        return 0;
+    }
+
+    Py_ssize_t count  = PyList_Size(addr_list);
+    Py_ssize_t hinted = treatments != Py_None ? PyList_Size(treatments) : 0;
+
+    qdr_core_route_table_begin(router->router_core);
+    for (Py_ssize_t idx = 0; idx < count; idx++) {
+        char *addr = py_string_2_c(PyList_GetItem(addr_list, idx));
+        if (!addr)
+            continue;
+        if (map) {
+            int treatment = -1;
+            if (idx < hinted) {
+                PyObject *hint = PyList_GetItem(treatments, idx);
+                if (QD_PY_INT_CHECK(hint))
+                    treatment = (int) QD_PY_INT_2_INT64(hint);
+            }
+            qdr_core_map_destination(router->router_core, maskbit, addr, treatment);
+        } else
+            qdr_core_unmap_destination(router->router_core, maskbit, addr);
+        free(addr);
+    }
+    qdr_core_route_table_commit(router->router_core);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+static PyObject* qd_map_destinations(PyObject *self, PyObject *args)
+{
+    return qd_map_destinations_common(self, args, true);
+}
+
+
+static PyObject* qd_unmap_destinations(PyObject *self, PyObject *args)
+{
+    return qd_map_destinations_common(self, args, false);
+}
+
+
+/**
+ * Decode a prefix-compressed address list (see compress_addresses in
+ * qpid_dispatch_internal/router/data.py) into a list of strings.
+ */
+static PyObject* qd_decode_addresses(PyObject *self, PyObject *args)
+{
+    PyObject   *blob;
+    char       *data;
+    Py_ssize_t  size;
+
+    if (!PyArg_ParseTuple(args, "O", &blob))
+        return 0;
+
+    if (!PyBytes_Check(blob) || PyBytes_AsStringAndSize(blob, &data, &size) < 0) {
+        PyErr_SetString(PyExc_Exception, "Expected binary address list");
+        return 0;
+    }
+
+    PyObject *result   = PyList_New(0);
+    char     *prev     = 0;
+    size_t    prev_len = 0;
+    size_t    pos      = 0;
+    bool      ok       = true;
+
+    while (ok && pos < (size_t) size) {
+        uint64_t lengths[2] = {0, 0};
+        for (int i = 0; i < 2 && ok; i++) {
+            int shift = 0;
+            while (true) {
+                if (pos >= (size_t) size || shift > 56) {
+                    ok = false;
+                    break;
+                }
+                uint8_t octet = (uint8_t) data[pos++];
+                lengths[i] |= (uint64_t) (octet & 0x7F) << shift;
+                shift += 7;
+                if (!(octet & 0x80))
+                    break;
+            }
+        }
+
+        if (!ok || lengths[0] > prev_len || lengths[1] > (size_t) size - pos) {
+            ok = false;
+            break;
+        }
+
+        size_t  len = (size_t) (lengths[0] + lengths[1]);
+        char   *cur = (char*) malloc(len + 1);
+        if (lengths[0])
+            memcpy(cur, prev, (size_t) lengths[0]);
+        memcpy(cur + lengths[0], data + pos, (size_t) lengths[1]);
+        cur[len] = '\0';
+        pos += (size_t) lengths[1];
+
+        PyObject *addr = PyUnicode_DecodeUTF8(cur, (Py_ssize_t) len, 0);
+        if (!addr) {
+            free(cur);
+            Py_DECREF(result);
+            return 0;
+        }
+        PyList_Append(result, addr);
+        Py_DECREF(addr);
+
+        free(prev);
+        prev     = cur;
+        prev_len = len;
+    }
+
+    free(prev);
+    if (!ok) {
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_Exception, "Malformed compressed address list");
+        return 0;
+    }
+    return result;
+}
+
 static PyObject* qd_get_agent(PyObject *self, PyObject *args) {
     RouterAdapter *adapter = (RouterAdapter*) self;
     PyObject *agent = adapter->router->qd->agent;
@@ -300,9 +678,16 @@ static PyMethodDef RouterAdapter_methods[] = {
     {"remove_next_hop",     qd_remove_next_hop,   METH_VARARGS, "Remove the next hop for a remote router"},
     {"set_cost",            qd_set_cost,          METH_VARARGS, "Set the cost to reach a remote router"},
     {"set_valid_origins",   qd_set_valid_origins, METH_VARARGS, "Set the valid origins for a remote router"},
+    {"set_equal_cost_hops", qd_set_equal_cost_hops, METH_VARARGS, "Set the equal-cost next hops for a remote router"},
     {"set_radius",          qd_set_radius,        METH_VARARGS, "Set the current topology radius"},
+    {"calculate_routes",    qd_calculate_routes,  METH_VARARGS, "Compute the routes from the collected link states"},
+    {"begin_route_update",  qd_begin_route_update,  METH_NOARGS, "Hold route table updates until commit_route_update"},
+    {"commit_route_update", qd_commit_route_update, METH_NOARGS, "Pass the held route table updates to the core at once"},
     {"map_destination",     qd_map_destination,   METH_VARARGS, "Add a newly discovered destination mapping"},
     {"unmap_destination",   qd_unmap_destination, METH_VARARGS, "Delete a destination mapping"},
+    {"map_destinations",    qd_map_destinations,  METH_VARARGS, "Add the destination mappings for a list of addresses"},
+    {"unmap_destinations",  qd_unmap_destinations, METH_VARARGS, "Delete the destination mappings for a list of addresses"},
+    {"decode_addresses",    qd_decode_addresses,  METH_VARARGS, "Decode a prefix-compressed address list"},
     {"get_agent",           qd_get_agent,         METH_VARARGS, "Get the management agent"},
     {0, 0, 0, 0}
 };
@@ -317,42 +702,76 @@ static PyTypeObject RouterAdapterType = {
 };
 
 
+static void qd_router_mobile_changed(const char *address_hash, int treatment)
+{
+    mobile_change_t *change = NEW(mobile_change_t);
+    DEQ_ITEM_INIT(change);
+    change->address_hash = strdup(address_hash);
+    change->treatment    = treatment;
+
+    sys_mutex_lock(mobile_lock);
+    DEQ_INSERT_TAIL(mobile_changes, change);
+    sys_mutex_unlock(mobile_lock);
+}
+
+
 static void qd_router_mobile_added(void *context, const char *address_hash, qd_address_treatment_t treatment)
 {
     qd_router_t *router = (qd_router_t*) context;
-    PyObject    *pArgs;
-    PyObject    *pValue;
 
-    if (pyAdded && router->router_mode == QD_ROUTER_MODE_INTERIOR) {
-        qd_python_lock_state_t lock_state = qd_python_lock();
-        pArgs = PyTuple_New(2);
-        PyTuple_SetItem(pArgs, 0, PyUnicode_FromString(address_hash));
-        PyTuple_SetItem(pArgs, 1, PyLong_FromLong((long) treatment));
-        pValue = PyObject_CallObject(pyAdded, pArgs);
-        qd_error_py();
-        Py_DECREF(pArgs);
-        Py_XDECREF(pValue);
-        qd_python_unlock(lock_state);
-    }
+    if (pyChanged && router->router_mode == QD_ROUTER_MODE_INTERIOR)
+        qd_router_mobile_changed(address_hash, (int) treatment);
 }
 
 
 static void qd_router_mobile_removed(void *context, const char *address_hash)
 {
     qd_router_t *router = (qd_router_t*) context;
-    PyObject    *pArgs;
-    PyObject    *pValue;
 
-    if (pyRemoved && router->router_mode == QD_ROUTER_MODE_INTERIOR) {
-        qd_python_lock_state_t lock_state = qd_python_lock();
-        pArgs = PyTuple_New(1);
-        PyTuple_SetItem(pArgs, 0, PyUnicode_FromString(address_hash));
-        pValue = PyObject_CallObject(pyRemoved, pArgs);
-        qd_error_py();
-        Py_DECREF(pArgs);
-        Py_XDECREF(pValue);
-        qd_python_unlock(lock_state);
+    if (pyChanged && router->router_mode == QD_ROUTER_MODE_INTERIOR)
+        qd_router_mobile_changed(address_hash, -1);
+}
+
+
+/**
+ * Hand the queued mobile address changes to the Python engine, in the order
+ * the core reported them.  Must be called with the Python lock held.
+ */
+static void qd_router_mobile_flush(void)
+{
+    mobile_change_list_t changes;
+
+    sys_mutex_lock(mobile_lock);
+    DEQ_MOVE(mobile_changes, changes);
+    sys_mutex_unlock(mobile_lock);
+
+    if (DEQ_IS_EMPTY(changes))
+        return;
+
+    PyObject *pList = PyList_New(DEQ_SIZE(changes));
+    Py_ssize_t idx  = 0;
+
+    mobile_change_t *change = DEQ_HEAD(changes);
+    while (change) {
+        DEQ_REMOVE_HEAD(changes);
+        PyObject *pTreatment;
+        if (change->treatment < 0) {
+            Py_INCREF(Py_None);
+            pTreatment = Py_None;
+        } else
+            pTreatment = PyLong_FromLong((long) change->treatment);
+        PyList_SetItem(pList, idx++, Py_BuildValue("(sN)", change->address_hash, pTreatment));
+        free(change->address_hash);
+        free(change);
+        change = DEQ_HEAD(changes);
     }
+
+    PyObject *pArgs  = PyTuple_New(1);
+    PyTuple_SetItem(pArgs, 0, pList);
+    PyObject *pValue = PyObject_CallObject(pyChanged, pArgs);
+    qd_error_py();
+    Py_DECREF(pArgs);
+    Py_XDECREF(pValue);
 }
 
 
@@ -362,8 +781,8 @@ static void qd_router_link_lost(void *context, int link_mask_bit)
     PyObject    *pArgs;
     PyObject    *pValue;
 
-    if (pyRemoved && router->router_mode == QD_ROUTER_MODE_INTERIOR) {
-        qd_python_lock_state_t lock_state = qd_python_lock();
+    if (pyLinkLost && router->router_mode == QD_ROUTER_MODE_INTERIOR) {
+        qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_ROUTER);
         pArgs = PyTuple_New(1);
         PyTuple_SetItem(pArgs, 0, PyLong_FromLong((long) link_mask_bit));
         pValue = PyObject_CallObject(pyLinkLost, pArgs);
@@ -379,6 +798,8 @@ qd_error_t qd_router_python_setup(qd_router_t *router)
 {
     qd_error_clear();
     log_source = qd_log_source("ROUTER");
+    mobile_lock = sys_mutex();
+    DEQ_INIT(mobile_changes);
 
     qdr_core_route_table_handlers(router->router_core,
                                   router,
@@ -412,7 +833,7 @@ qd_error_t qd_router_python_setup(qd_router_t *router)
     PyObject* pClass;
     PyObject* pArgs;
 
-    pModule = PyImport_ImportModule("qpid_dispatch_internal.router"); QD_ERROR_PY_RET();
+    pModule = PyImport_ImportModule("qpid_dispatch_internal.router.engine"); QD_ERROR_PY_RET();
     pClass = PyObject_GetAttrString(pModule, "RouterEngine");
     Py_DECREF(pModule);
     QD_ERROR_PY_RET();
@@ -451,14 +872,26 @@ qd_error_t qd_router_python_setup(qd_router_t *router)
     QD_ERROR_PY_RET();
 
     pyTick = PyObject_GetAttrString(pyRouter, "handleTimerTick"); QD_ERROR_PY_RET();
-    pyAdded = PyObject_GetAttrString(pyRouter, "addressAdded"); QD_ERROR_PY_RET();
-    pyRemoved = PyObject_GetAttrString(pyRouter, "addressRemoved"); QD_ERROR_PY_RET();
+    pyChanged = PyObject_GetAttrString(pyRouter, "addressesChanged"); QD_ERROR_PY_RET();
     pyLinkLost = PyObject_GetAttrString(pyRouter, "linkLost"); QD_ERROR_PY_RET();
     return qd_error_code();
 }
 
 void qd_router_python_free(qd_router_t *router) {
-    // empty
+    qdr_path_graph_free(path_graph);
+    path_graph = 0;
+
+    if (mobile_lock) {
+        mobile_change_t *change = DEQ_HEAD(mobile_changes);
+        while (change) {
+            DEQ_REMOVE_HEAD(mobile_changes);
+            free(change->address_hash);
+            free(change);
+            change = DEQ_HEAD(mobile_changes);
+        }
+        sys_mutex_free(mobile_lock);
+        mobile_lock = 0;
+    }
 }
 
 
@@ -471,7 +904,8 @@ qd_error_t qd_pyrouter_tick(qd_router_t *router)
     PyObject *pValue;
 
     if (pyTick && router->router_mode == QD_ROUTER_MODE_INTERIOR) {
-        qd_python_lock_state_t lock_state = qd_python_lock();
+        qd_python_lock_state_t lock_state = qd_python_lock(QD_PYTHON_CALLER_ROUTER);
+        qd_router_mobile_flush();
         pArgs  = PyTuple_New(0);
         pValue = PyObject_CallObject(pyTick, pArgs);
         Py_DECREF(pArgs);
@@ -27,6 +27,9 @@
 #include <qpid/dispatch/server.h>
 #include <qpid/dispatch/failoverlist.h>
 #include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/container.h>
+#include <qpid/dispatch/hash.h>
+#include <qpid/dispatch/iterator.h>
 
 #include <proton/event.h>
 #include <proton/listener.h>
@@ -41,14 +44,56 @@
 #include "immediate_private.h"
 #include "policy.h"
 #include "server_private.h"
+#include "stats_page.h"
 #include "timer_private.h"
 #include "config.h"
 #include "remote_sasl.h"
+#include "compression.h"
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
 
+/* With connection affinity, the event batches of each connection are handed to
+ * the worker the connection is pinned to.
+ */
+typedef struct qd_server_worker_t {
+    sys_mutex_t       *lock;
+    sys_cond_t        *cond;
+    pn_event_batch_t **batches;  /* Ring of batches waiting for this worker */
+    int                head;
+    int                count;
+    int                capacity;
+    bool               stopping;
+} qd_server_worker_t;
+
+/**
+ * Native copy of one sslProfile's uidNameMappingFile.  The DisplayNameService
+ * pushes the mapping down whenever a profile is added or reloaded so that
+ * transport_get_user can translate ids without taking the Python lock.
+ */
+typedef struct qd_display_name_table_t qd_display_name_table_t;
+struct qd_display_name_table_t {
+    DEQ_LINKS(qd_display_name_table_t);
+    char       *profile;
+    qd_hash_t  *names;      // user_id -> display name (owned by 'values')
+    char      **values;
+    size_t      value_count;
+};
+
+DEQ_DECLARE(qd_display_name_table_t, qd_display_name_table_list_t);
+
+/**
+ * Counters of one server thread.  Only the thread itself writes them, with
+ * relaxed atomic stores so that management and metrics readers see whole
+ * values.
+ */
+typedef struct qd_server_thread_t {
+    qd_server_thread_stats_t stats;
+    int64_t                  last_usec;   /* End of the previous batch, 0 before the first */
+    bool                     started;
+} qd_server_thread_t;
+
 struct qd_server_t {
     qd_dispatch_t            *qd;
     const int                 thread_count; /* Immutable */
@@ -68,8 +113,17 @@ struct qd_server_t {
     int                       pause_now_serving;
     uint64_t                  next_connection_id;
     void                     *py_displayname_obj;
+    sys_rwlock_t             *display_name_lock;
+    qd_display_name_table_list_t display_names;   // protected by display_name_lock
     qd_http_server_t         *http;
+    qd_local_server_t        *local;
     bool                      stopping;
+    int                       next_thread_index;
+    qd_server_worker_t       *workers;      /* One per thread with connection affinity, else 0 */
+    int                       next_worker;
+    int                       tls_workers;  /* Leading workers reserved for tlsOffload listeners */
+    int                       next_tls_worker;
+    qd_server_thread_t       *threads;      /* thread_count + 1, the last for the affinity dispatcher */
 };
 
 #define HEARTBEAT_INTERVAL 1000
@@ -80,6 +134,7 @@ ALLOC_DEFINE(qd_deferred_call_t);
 ALLOC_DEFINE(qd_connection_t);
 
 const char *MECH_EXTERNAL = "EXTERNAL";
+const char *QD_WORKER_THREAD_TYPE = "workerThread";
 
 //Allowed uidFormat fields.
 const char CERT_COUNTRY_CODE = 'c';
@@ -97,6 +152,10 @@ static const int BACKLOG = 50;  /* Listening backlog */
 
 static void setup_ssl_sasl_and_open(qd_connection_t *ctx);
 static qd_failover_item_t *qd_connector_get_conn_info(qd_connector_t *ct);
+static bool connector_race_failed_lh(qd_connector_t *ct, qd_connection_t *ctx);
+static bool connector_race_won(qd_connection_t *ctx);
+static void connector_frame_fold_lh(qd_connector_t *ct, const qd_connection_t *c);
+static uint32_t connector_frame_size_lh(const qd_connector_t *ct);
 
 /**
  * This function is set as the pn_transport->tracer and is invoked when proton tries to write the log message to pn_transport->tracer
@@ -126,6 +185,106 @@ qd_error_t qd_register_display_name_service(qd_dispatch_t *qd, void *displayname
 }
 
 
+static void display_name_table_free(qd_display_name_table_t *table)
+{
+    if (!table) return;
+    qd_hash_free(table->names);
+    for (size_t i = 0; i < table->value_count; i++)
+        free(table->values[i]);
+    free(table->values);
+    free(table->profile);
+    free(table);
+}
+
+
+static qd_display_name_table_t *display_name_table_find_LH(qd_server_t *server, const char *profile)
+{
+    qd_display_name_table_t *table = DEQ_HEAD(server->display_names);
+    while (table && strcmp(table->profile, profile) != 0)
+        table = DEQ_NEXT(table);
+    return table;
+}
+
+
+/**
+ * Replace the native mapping for an sslProfile with the contents of a Python
+ * dict of user_id -> display name.  If py_names is None the profile mapping is
+ * removed.  The table is built before the write lock is taken so lookups are
+ * only blocked for the pointer swap.
+ * Called with qd_python_lock held
+ */
+qd_error_t qd_display_name_load(qd_dispatch_t *qd, const char *profile, void *py_names)
+{
+    PyObject *names = (PyObject *) py_names;
+    qd_display_name_table_t *table = 0;
+
+    if (names && names != Py_None) {
+        if (!PyDict_Check(names))
+            return qd_error(QD_ERROR_VALUE, "display name mapping for profile '%s' is not a dict", profile);
+
+        table = NEW(qd_display_name_table_t);
+        ZERO(table);
+        DEQ_ITEM_INIT(table);
+        table->profile = strdup(profile);
+        table->names   = qd_hash(10, 32, 0);
+        table->values  = (char **) calloc(PyDict_Size(names) + 1, sizeof(char *));
+
+        PyObject   *key;
+        PyObject   *value;
+        Py_ssize_t  pos = 0;
+        while (PyDict_Next(names, &pos, &key, &value)) {
+            char *user_id = py_string_2_c(key);
+            char *display = py_string_2_c(value);
+            if (user_id && display) {
+                qd_iterator_t *iter = qd_iterator_string(user_id, ITER_VIEW_ALL);
+                if (qd_hash_insert(table->names, iter, display, 0) == QD_ERROR_NONE) {
+                    table->values[table->value_count++] = display;
+                    display = 0;
+                }
+                qd_iterator_free(iter);
+            }
+            free(user_id);
+            free(display);
+        }
+        qd_error_clear();
+    }
+
+    qd_server_t *server = qd->server;
+    sys_rwlock_wrlock(server->display_name_lock);
+    qd_display_name_table_t *old = display_name_table_find_LH(server, profile);
+    if (old)
+        DEQ_REMOVE(server->display_names, old);
+    if (table)
+        DEQ_INSERT_TAIL(server->display_names, table);
+    sys_rwlock_unlock(server->display_name_lock);
+
+    display_name_table_free(old);
+    return QD_ERROR_NONE;
+}
+
+
+/**
+ * Translate user_id into its display name for the given sslProfile.
+ * Returns a newly allocated string or 0 if there is no mapping.
+ */
+static char *display_name_lookup(qd_server_t *server, const char *profile, const char *user_id)
+{
+    char *result = 0;
+    sys_rwlock_rdlock(server->display_name_lock);
+    qd_display_name_table_t *table = display_name_table_find_LH(server, profile);
+    if (table) {
+        qd_iterator_t *iter = qd_iterator_string(user_id, ITER_VIEW_ALL);
+        void *display = 0;
+        qd_hash_retrieve(table->names, iter, &display);
+        qd_iterator_free(iter);
+        if (display)
+            result = strdup((char *) display);
+    }
+    sys_rwlock_unlock(server->display_name_lock);
+    return result;
+}
+
+
 /**
  * Returns a char pointer to a user id which is constructed from components specified in the config->ssl_uid_format.
  * Parses through each component and builds a semi-colon delimited string which is returned as the user id.
@@ -304,16 +463,11 @@ static const char *transport_get_user(qd_connection_t *conn, pn_transport_t *tpo
             }
             if (config->ssl_uid_name_mapping_file) {
                 // Translate extracted id into display name
-                qd_python_lock_state_t lock_state = qd_python_lock();
-                PyObject *result = PyObject_CallMethod((PyObject *)conn->server->py_displayname_obj, "query", "(ss)", config->ssl_profile, user_id );
-                if (result) {
+                char *display = display_name_lookup(conn->server, config->ssl_profile, user_id);
+                if (display) {
                     free(user_id);
-                    user_id = py_string_2_c(result);
-                    Py_XDECREF(result);
-                } else {
-                    qd_log(conn->server->log_source, QD_LOG_DEBUG, "Internal: failed to read displaynameservice query result");
+                    user_id = display;
                 }
-                qd_python_unlock(lock_state);
             }
             qd_log(conn->server->log_source, QD_LOG_DEBUG, "User id is '%s' ", user_id);
             return user_id;
@@ -343,19 +497,58 @@ void qd_connection_set_user(qd_connection_t *conn)
 }
 
 
-qd_error_t qd_entity_refresh_sslProfile(qd_entity_t* entity, void *impl)
+qd_error_t qd_entity_refresh_authServicePlugin(qd_entity_t* entity, void *impl)
 {
     return QD_ERROR_NONE;
 }
 
-qd_error_t qd_entity_refresh_authServicePlugin(qd_entity_t* entity, void *impl)
+
+qd_tls_session_stats_t *qd_tls_session_stats(void)
 {
-    return QD_ERROR_NONE;
+    qd_tls_session_stats_t *stats = NEW(qd_tls_session_stats_t);
+    if (!stats)
+        return 0;
+    sys_atomic_init(&stats->ref_count, 1);
+    sys_atomic_init(&stats->resumed, 0);
+    sys_atomic_init(&stats->full, 0);
+    return stats;
 }
 
 
-static qd_error_t listener_setup_ssl(qd_connection_t *ctx, const qd_server_config_t *config, pn_transport_t *tport)
+void qd_tls_session_stats_incref(qd_tls_session_stats_t *stats)
+{
+    if (stats)
+        sys_atomic_inc(&stats->ref_count);
+}
+
+
+void qd_tls_session_stats_decref(qd_tls_session_stats_t *stats)
+{
+    if (stats && sys_atomic_dec(&stats->ref_count) == 1) {
+        sys_atomic_destroy(&stats->ref_count);
+        sys_atomic_destroy(&stats->resumed);
+        sys_atomic_destroy(&stats->full);
+        free(stats);
+    }
+}
+
+
+/* Count whether the completed TLS handshake on ctx resumed an earlier session */
+static void count_tls_session(qd_connection_t *ctx, const qd_server_config_t *config)
+{
+    if (!ctx->ssl || !config || !config->ssl_session_stats)
+        return;
+    if (pn_ssl_resume_status(ctx->ssl) == PN_SSL_RESUME_REUSED)
+        sys_atomic_inc(&config->ssl_session_stats->resumed);
+    else
+        sys_atomic_inc(&config->ssl_session_stats->full);
+}
+
+
+/* TLS is done by Proton's SSL layer inside the transport, not by kernel TLS. */
+static qd_error_t listener_ssl_domain(const qd_server_config_t *config, pn_ssl_domain_t **result)
 {
+    *result = 0;
     pn_ssl_domain_t *domain = pn_ssl_domain(PN_SSL_MODE_SERVER);
     if (!domain) return qd_error(QD_ERROR_RUNTIME, "No SSL support");
 
@@ -408,13 +601,34 @@ static qd_error_t listener_setup_ssl(qd_connection_t *ctx, const qd_server_confi
         }
     }
 
+    *result = domain;
+    return QD_ERROR_NONE;
+}
+
+
+static qd_error_t listener_setup_ssl(qd_connection_t *ctx, const qd_server_config_t *config, pn_transport_t *tport)
+{
+    //
+    // Normally all of the listener's connections share one domain, which lets a
+    // returning peer resume its TLS session instead of paying for a full
+    // handshake.  The domain is only built here if that failed at listen time,
+    // so the error is reported against the connection.
+    //
+    pn_ssl_domain_t *domain = ctx->listener->ssl_domain;
+    pn_ssl_domain_t *own_domain = 0;
+    if (!domain) {
+        if (listener_ssl_domain(config, &own_domain) != QD_ERROR_NONE)
+            return qd_error_code();
+        domain = own_domain;
+    }
+
     ctx->ssl = pn_ssl(tport);
     if (!ctx->ssl || pn_ssl_init(ctx->ssl, domain, 0)) {
-        pn_ssl_domain_free(domain);
+        if (own_domain) pn_ssl_domain_free(own_domain);
         return qd_error(QD_ERROR_RUNTIME, "Cannot initialize SSL");
     }
 
-    pn_ssl_domain_free(domain);
+    if (own_domain) pn_ssl_domain_free(own_domain);
     return QD_ERROR_NONE;
 }
 
@@ -460,6 +674,35 @@ static void decorate_connection(qd_server_t *qd_server, pn_connection_t *conn, c
         pn_data_put_int(pn_connection_properties(conn), config->inter_router_cost);
     }
 
+    //
+    // Tell the peer's inter-router listener that this connection carries data only
+    //
+    if (config && config->role && strcmp(config->role, "inter-router-data") == 0) {
+        pn_data_put_symbol(pn_connection_properties(conn),
+                           pn_bytes(strlen(QD_CONNECTION_PROPERTY_DATA_KEY), QD_CONNECTION_PROPERTY_DATA_KEY));
+        pn_data_put_bool(pn_connection_properties(conn), true);
+    }
+
+    //
+    // Offer the compact encoding of the trace and ingress annotations to a peer router
+    //
+    if (config && config->role && strncmp(config->role, "inter-router", strlen("inter-router")) == 0 &&
+        qd_server->qd->compact_annotations) {
+        pn_data_put_symbol(pn_connection_properties(conn),
+                           pn_bytes(strlen(QD_CONNECTION_PROPERTY_COMPACT_ANNOTATIONS_KEY), QD_CONNECTION_PROPERTY_COMPACT_ANNOTATIONS_KEY));
+        pn_data_put_bool(pn_connection_properties(conn), true);
+    }
+
+    //
+    // Offer compression of message bytes to a peer router
+    //
+    if (config && config->compression && qd_compression_supported()) {
+        pn_data_put_symbol(pn_connection_properties(conn),
+                           pn_bytes(strlen(QD_CONNECTION_PROPERTY_COMPRESSION_KEY), QD_CONNECTION_PROPERTY_COMPRESSION_KEY));
+        pn_data_put_symbol(pn_connection_properties(conn),
+                           pn_bytes(strlen(qd_compression_method()), qd_compression_method()));
+    }
+
     if (config) {
         qd_failover_list_t *fol = config->failover_list;
         if (fol) {
@@ -508,19 +751,63 @@ static void connection_wake(qd_connection_t *ctx) {
     if (ctx->pn_conn) pn_connection_wake(ctx->pn_conn);
 }
 
-/* Construct a new qd_connection. Thread safe. */
-qd_connection_t *qd_server_connection(qd_server_t *server, qd_server_config_t *config)
+struct qd_memory_account_t {
+    sys_atomic_t     ref_count;
+    sys_atomic_t     bytes;
+    uint32_t         limit;    ///< Zero for no limit
+    bool             blocked;  ///< Over the limit; receive credit is withheld
+    sys_mutex_t     *lock;     ///< Protects blocked and conn
+    qd_connection_t *conn;     ///< Zero once the connection has been freed
+};
+
+ALLOC_DEFINE(qd_memory_account_t);
+
+
+static qd_memory_account_t *qd_memory_account(qd_connection_t *conn)
+{
+    qd_memory_account_t *account = new_qd_memory_account_t();
+    if (!account)
+        return 0;
+    ZERO(account);
+    account->lock = sys_mutex();
+    account->conn = conn;
+    sys_atomic_init(&account->ref_count, 1);
+    sys_atomic_init(&account->bytes, 0);
+    return account;
+}
+
+
+/**
+ * Detach an account from its connection when the connection is freed.
+ */
+static void qd_memory_account_detach(qd_memory_account_t *account)
+{
+    if (!account)
+        return;
+    sys_mutex_lock(account->lock);
+    account->conn = 0;
+    sys_mutex_unlock(account->lock);
+    qd_memory_account_decref(account);
+}
+
+
+/*
+ * Construct a new qd_connection. Thread safe.  If decorate is false the caller
+ * is responsible for calling decorate_connection() before the connection is opened.
+ */
+static qd_connection_t *server_connection(qd_server_t *server, qd_server_config_t *config, bool decorate)
 {
     qd_connection_t *ctx = new_qd_connection_t();
     if (!ctx) return NULL;
     ZERO(ctx);
+    ctx->worker        = -1;
     ctx->pn_conn       = pn_connection();
-    ctx->deferred_call_lock = sys_mutex();
     ctx->role = strdup(config->role);
-    if (!ctx->pn_conn || !ctx->deferred_call_lock || !ctx->role) {
+    ctx->memory_account = qd_memory_account(ctx);
+    if (!ctx->pn_conn || !ctx->role || !ctx->memory_account) {
         if (ctx->pn_conn) pn_connection_free(ctx->pn_conn);
-        if (ctx->deferred_call_lock) sys_mutex_free(ctx->deferred_call_lock);
         free(ctx->role);
+        qd_memory_account_decref(ctx->memory_account);
         free(ctx);
         return NULL;
     }
@@ -528,35 +815,187 @@ qd_connection_t *qd_server_connection(qd_server_t *server, qd_server_config_t *c
     ctx->wake = connection_wake; /* Default, over-ridden for HTTP connections */
     pn_connection_set_context(ctx->pn_conn, ctx);
     DEQ_ITEM_INIT(ctx);
-    DEQ_INIT(ctx->deferred_calls);
+    sys_atomic_ptr_init(&ctx->deferred_calls, 0);
     DEQ_INIT(ctx->free_link_session_list);
     sys_mutex_lock(server->lock);
     ctx->connection_id = server->next_connection_id++;
     DEQ_INSERT_TAIL(server->conn_list, ctx);
     sys_mutex_unlock(server->lock);
-    decorate_connection(ctx->server, ctx->pn_conn, config);
+    if (decorate)
+        decorate_connection(ctx->server, ctx->pn_conn, config);
     return ctx;
 }
 
 
-static void on_accept(pn_event_t *e)
+qd_connection_t *qd_server_connection(qd_server_t *server, qd_server_config_t *config)
 {
-    assert(pn_event_type(e) == PN_LISTENER_ACCEPT);
-    pn_listener_t *pn_listener = pn_event_listener(e);
-    qd_listener_t *listener = pn_listener_get_context(pn_listener);
-    qd_connection_t *ctx = qd_server_connection(listener->server, &listener->config);
+    return server_connection(server, config, true);
+}
+
+
+static void token_bucket_init(qd_token_bucket_t *bucket, int rate, uint64_t now)
+{
+    bucket->rate         = rate > 0 ? rate : 0;
+    bucket->micro_tokens = bucket->rate * 1000000;
+    bucket->last_usec    = now;
+}
+
+
+static void token_bucket_refill(qd_token_bucket_t *bucket, uint64_t now)
+{
+    if (bucket->rate == 0)
+        return;
+    int64_t capacity = bucket->rate * 1000000;
+    bucket->micro_tokens += (int64_t) (now - bucket->last_usec) * bucket->rate;
+    if (bucket->micro_tokens > capacity)
+        bucket->micro_tokens = capacity;
+    bucket->last_usec = now;
+}
+
+
+static bool token_bucket_ready(const qd_token_bucket_t *bucket)
+{
+    return bucket->rate == 0 || bucket->micro_tokens >= 1000000;
+}
+
+
+/* Microseconds until the bucket next holds a whole token */
+static int64_t token_bucket_wait(const qd_token_bucket_t *bucket)
+{
+    if (token_bucket_ready(bucket))
+        return 0;
+    return (1000000 - bucket->micro_tokens + bucket->rate - 1) / bucket->rate;
+}
+
+
+static void token_bucket_take(qd_token_bucket_t *bucket)
+{
+    if (bucket->rate)
+        bucket->micro_tokens -= 1000000;
+}
+
+
+static bool listener_admission_enabled(const qd_listener_t *li)
+{
+    return li->accept_bucket.rate || li->tls_bucket.rate;
+}
+
+
+/* Take a token from each bucket if both have one. Call with admission_lock held. */
+static bool listener_admit_LH(qd_listener_t *li, uint64_t now)
+{
+    token_bucket_refill(&li->accept_bucket, now);
+    token_bucket_refill(&li->tls_bucket, now);
+    if (!token_bucket_ready(&li->accept_bucket) || !token_bucket_ready(&li->tls_bucket))
+        return false;
+    token_bucket_take(&li->accept_bucket);
+    token_bucket_take(&li->tls_bucket);
+    li->connections_admitted++;
+    return true;
+}
+
+
+/* Schedule the admission timer for the next token. Call with admission_lock held. */
+static void listener_schedule_admission_LH(qd_listener_t *li)
+{
+    int64_t wait = token_bucket_wait(&li->accept_bucket);
+    int64_t tls_wait = token_bucket_wait(&li->tls_bucket);
+    if (tls_wait > wait)
+        wait = tls_wait;
+    qd_duration_t msec = (wait + 999) / 1000;
+    qd_timer_schedule(li->admission_timer, msec > 0 ? msec : 1);
+}
+
+
+static void listener_accept(qd_listener_t *listener, bool refused)
+{
+    //
+    // Accept events for a listener are serialized on one thread, and proton
+    // gives us no way to open several SO_REUSEPORT sockets on the same port
+    // to spread them out.  Keep the work done here to the minimum; building
+    // the connection properties is left to PN_CONNECTION_BOUND, which runs in
+    // the new connection's own context.
+    //
+    qd_connection_t *ctx = server_connection(listener->server, &listener->config, false);
     if (!ctx) {
         qd_log(listener->server->log_source, QD_LOG_CRITICAL,
                "Allocation failure during accept to %s", listener->config.host_port);
         return;
     }
     ctx->listener = listener;
+    ctx->admission_refused = refused;
     qd_log(listener->server->log_source, QD_LOG_TRACE,
            "[%"PRIu64"]: Accepting incoming connection to '%s'",
            ctx->connection_id, ctx->listener->config.host_port);
     /* Asynchronous accept, configure the transport on PN_CONNECTION_BOUND */
-    pn_listener_accept(pn_listener, ctx->pn_conn);
- }
+    pn_listener_accept(listener->pn_listener, ctx->pn_conn);
+}
+
+
+/*
+ * Admission timer: accept as many of the waiting connections as the token
+ * buckets allow.  The waiting connections are still held by proton (and,
+ * beyond its own queue, by the kernel's listen backlog), so nothing has been
+ * spent on them yet.
+ */
+static void listener_admission_cb(void *context)
+{
+    qd_listener_t *li = (qd_listener_t*) context;
+    int admitted = 0;
+
+    sys_mutex_lock(li->admission_lock);
+    if (li->closed) {
+        sys_mutex_unlock(li->admission_lock);
+        return;
+    }
+    uint64_t now = qd_timer_now_usec();
+    while (li->pending_accepts > 0 && listener_admit_LH(li, now)) {
+        li->pending_accepts--;
+        admitted++;
+    }
+    if (li->pending_accepts > 0)
+        listener_schedule_admission_LH(li);
+    sys_mutex_unlock(li->admission_lock);
+
+    while (admitted-- > 0)
+        listener_accept(li, false);
+}
+
+
+static void on_accept(pn_event_t *e)
+{
+    assert(pn_event_type(e) == PN_LISTENER_ACCEPT);
+    pn_listener_t *pn_listener = pn_event_listener(e);
+    qd_listener_t *listener = pn_listener_get_context(pn_listener);
+
+    if (listener_admission_enabled(listener)) {
+        bool refused = false;
+        sys_mutex_lock(listener->admission_lock);
+        if (listener->pending_accepts == 0 && listener_admit_LH(listener, qd_timer_now_usec())) {
+            // Admitted immediately
+        } else if (listener->pending_accepts < listener->config.max_pending_accepts) {
+            //
+            // Leave the connection with proton until the rate allows it.  Mark
+            // first so a newcomer cannot overtake the connections already waiting.
+            //
+            if (listener->pending_accepts++ == 0)
+                listener_schedule_admission_LH(listener);
+            if (listener->pending_accepts > listener->pending_accepts_max)
+                listener->pending_accepts_max = listener->pending_accepts;
+            listener->connections_deferred++;
+            sys_mutex_unlock(listener->admission_lock);
+            return;
+        } else {
+            listener->connections_refused++;
+            refused = true;
+        }
+        sys_mutex_unlock(listener->admission_lock);
+        listener_accept(listener, refused);
+        return;
+    }
+
+    listener_accept(listener, false);
+}
 
 
 /* Log the description, set the transport condition (name, description) close the transport tail. */
@@ -624,6 +1063,15 @@ static void on_connection_bound(qd_server_t *server, pn_event_t *e) {
         pn_transport_set_server(tport);
         set_rhost_port(ctx);
 
+        if (ctx->admission_refused) {
+            qd_log(ctx->server->log_source, QD_LOG_INFO,
+                   "[%"PRIu64"]: Refusing connection from %s to %s, too many connections waiting for admission",
+                   ctx->connection_id, ctx->rhost_port, name);
+            connect_fail(ctx, QD_AMQP_COND_RESOURCE_LIMIT_EXCEEDED,
+                         "Too many connections waiting for admission on %s", name);
+            return;
+        }
+
         sys_mutex_lock(server->lock); /* Policy check is not thread safe */
         ctx->policy_counted = qd_policy_socket_accept(server->qd->policy, ctx->rhost);
         sys_mutex_unlock(server->lock);
@@ -632,6 +1080,7 @@ static void on_connection_bound(qd_server_t *server, pn_event_t *e) {
             pn_transport_close_head(tport);
             return;
         }
+        decorate_connection(ctx->server, pn_conn, config);
 
         // Set up SSL
         if (config->ssl_profile)  {
@@ -685,7 +1134,7 @@ static void on_connection_bound(qd_server_t *server, pn_event_t *e) {
                     }
                 }
             }
-            qdr_use_remote_authentication_service(tport, config->sasl_plugin_config.auth_service, config->sasl_plugin_config.sasl_init_hostname, plugin_ssl_domain, server->proactor);
+            qdr_use_remote_authentication_service(tport, config->sasl_plugin_config.auth_service, config->sasl_plugin_config.sasl_init_hostname, plugin_ssl_domain, server->proactor, config->sasl_plugin_config.cache_seconds);
         }
         pn_transport_require_auth(tport, config->requireAuthentication);
         pn_transport_require_encryption(tport, config->requireEncryption);
@@ -706,9 +1155,21 @@ static void on_connection_bound(qd_server_t *server, pn_event_t *e) {
     //
     // Common transport configuration.
     //
-    pn_transport_set_max_frame(tport, config->max_frame_size);
+    ctx->max_frame_size = config->max_frame_size;
+    if (ctx->connector && config->max_frame_size_min) {
+        sys_mutex_lock(ctx->connector->lock);
+        ctx->max_frame_size = connector_frame_size_lh(ctx->connector);
+        sys_mutex_unlock(ctx->connector->lock);
+        if (ctx->max_frame_size != config->max_frame_size)
+            qd_log(ctx->server->log_source, QD_LOG_DEBUG,
+                   "[C%"PRIu64"] Max frame size %"PRIu32" tuned from the sizes of messages received",
+                   ctx->connection_id, ctx->max_frame_size);
+    }
+    pn_transport_set_max_frame(tport, ctx->max_frame_size);
     pn_transport_set_channel_max(tport, config->max_sessions - 1);
-    pn_transport_set_idle_timeout(tport, config->idle_timeout_seconds * 1000);
+    pn_transport_set_idle_timeout(tport, config->liveness_timeout_ms > 0
+                                  ? config->liveness_timeout_ms
+                                  : config->idle_timeout_seconds * 1000);
 }
 
 
@@ -717,23 +1178,32 @@ static void invoke_deferred_calls(qd_connection_t *conn, bool discard)
     if (!conn)
         return;
 
-    // Lock access to deferred_calls, other threads may concurrently add to it.  Invoke
-    // the calls outside of the critical section.
     //
-    sys_mutex_lock(conn->deferred_call_lock);
+    // Other threads push onto the stack without a lock.  Take all of it at once,
+    // reverse it to restore the order the calls were made in, and invoke them.
+    // Calls made meanwhile start a new stack, so repeat until it stays empty.
+    //
     qd_deferred_call_t *dc;
-    while ((dc = DEQ_HEAD(conn->deferred_calls))) {
-        DEQ_REMOVE_HEAD(conn->deferred_calls);
-        sys_mutex_unlock(conn->deferred_call_lock);
-        dc->call(dc->context, discard);
-        free_qd_deferred_call_t(dc);
-        sys_mutex_lock(conn->deferred_call_lock);
+    while ((dc = (qd_deferred_call_t*) sys_atomic_ptr_swap(&conn->deferred_calls, 0))) {
+        qd_deferred_call_t *fifo = 0;
+        while (dc) {
+            qd_deferred_call_t *next = dc->next;
+            dc->next = fifo;
+            fifo     = dc;
+            dc       = next;
+        }
+        while (fifo) {
+            dc   = fifo;
+            fifo = dc->next;
+            dc->call(dc->context, discard);
+            free_qd_deferred_call_t(dc);
+        }
     }
-    sys_mutex_unlock(conn->deferred_call_lock);
 }
 
 void qd_container_handle_event(qd_container_t *container, pn_event_t *event, pn_connection_t *pn_conn, qd_connection_t *qd_conn);
 void qd_conn_event_batch_complete(qd_container_t *container, qd_connection_t *qd_conn, bool conn_closed);
+void qd_container_batch_complete(qd_container_t *container);
 
 static void handle_listener(pn_event_t *e, qd_server_t *qd_server) {
     qd_log_source_t *log = qd_server->log_source;
@@ -784,6 +1254,10 @@ static void handle_listener(pn_event_t *e, qd_server_t *qd_server) {
         } else {
             qd_log(log, QD_LOG_TRACE, "Listener closed on %s", host_port);
         }
+        sys_mutex_lock(li->admission_lock);
+        li->closed = true;
+        li->pending_accepts = 0;
+        sys_mutex_unlock(li->admission_lock);
         qd_listener_decref(li);
         break;
     }
@@ -809,25 +1283,31 @@ static void qd_connection_free(qd_connection_t *ctx)
     if (ctx->connector) {
         long delay = ctx->connector->delay;
         sys_mutex_lock(ctx->connector->lock);
-        ctx->connector->ctx = 0;
-        // Increment the connection index by so that we can try connecting to the failover url (if any).
-        bool has_failover = qd_connector_has_failover_info(ctx->connector);
-
-        if (has_failover) {
-            // Go thru the failover list round robin.
-            // IMPORTANT: Note here that we set the re-try timer to 1 second.
-            // We want to quickly keep cycling thru the failover urls every second.
-            delay = 1000;
-        }
+        if (ctx->racing && connector_race_failed_lh(ctx->connector, ctx)) {
+            // Other attempts of the connector's race are still pending
+            sys_mutex_unlock(ctx->connector->lock);
+        } else {
+            connector_frame_fold_lh(ctx->connector, ctx);
+            ctx->connector->ctx = 0;
+            // Increment the connection index by so that we can try connecting to the failover url (if any).
+            bool has_failover = qd_connector_has_failover_info(ctx->connector);
+
+            if (has_failover) {
+                // Go thru the failover list round robin.
+                // IMPORTANT: Note here that we set the re-try timer to 1 second.
+                // We want to quickly keep cycling thru the failover urls every second.
+                delay = 1000;
+            }
 
-        ctx->connector->state = CXTR_STATE_CONNECTING;
-        sys_mutex_unlock(ctx->connector->lock);
+            ctx->connector->state = CXTR_STATE_CONNECTING;
+            sys_mutex_unlock(ctx->connector->lock);
 
-        //
-        // Increment the ref-count to account for the timer's reference to the connector.
-        //
-        sys_atomic_inc(&ctx->connector->ref_count);
-        qd_timer_schedule(ctx->connector->timer, delay);
+            //
+            // Increment the ref-count to account for the timer's reference to the connector.
+            //
+            sys_atomic_inc(&ctx->connector->ref_count);
+            qd_timer_schedule(ctx->connector->timer, delay);
+        }
     }
 
     sys_mutex_lock(qd_server->lock);
@@ -839,11 +1319,13 @@ static void qd_connection_free(qd_connection_t *ctx)
     }
     sys_mutex_unlock(qd_server->lock);
 
+    qd_memory_account_detach(ctx->memory_account);  // No more credit restarts
     invoke_deferred_calls(ctx, true);  // Discard any pending deferred calls
-    sys_mutex_free(ctx->deferred_call_lock);
+    sys_atomic_ptr_destroy(&ctx->deferred_calls);
     qd_policy_settings_free(ctx->policy_settings);
     if (ctx->free_user_id) free((char*)ctx->user_id);
     if (ctx->timer) qd_timer_free(ctx->timer);
+    qd_timer_free(ctx->rate_timer);
     free(ctx->name);
     free(ctx->role);
     free_qd_connection_t(ctx);
@@ -879,7 +1361,8 @@ static void startup_timer_handler(void *context)
 
 static void qd_increment_conn_index(qd_connection_t *ctx)
 {
-    if (ctx->connector) {
+    // A raced attempt does not advance the index, the race covers the whole list
+    if (ctx->connector && !ctx->racing) {
         qd_failover_item_t *item = qd_connector_get_conn_info(ctx->connector);
 
         if (item->retries == 1) {
@@ -941,6 +1424,11 @@ static bool handle(qd_server_t *qd_server, pn_event_t *e, pn_connection_t *pn_co
         break;
 
     case PN_CONNECTION_REMOTE_OPEN:
+        if (ctx && ctx->racing && !connector_race_won(ctx)) {
+            // Another attempt of the connector opened first, this one is never reported
+            pn_connection_close(pn_conn);
+            return true;
+        }
         // If we are transitioning to the open state, notify the client via callback.
         if (ctx && ctx->timer) {
             qd_timer_free(ctx->timer);
@@ -948,6 +1436,8 @@ static bool handle(qd_server_t *qd_server, pn_event_t *e, pn_connection_t *pn_co
         }
         if (ctx && !ctx->opened) {
             ctx->opened = true;
+            count_tls_session(ctx, ctx->listener ? &ctx->listener->config
+                              : ctx->connector ? &ctx->connector->config : 0);
             if (ctx->connector) {
                 ctx->connector->delay = 2000;  // Delay re-connect in case there is a recurring error
                 qd_failover_item_t *item = qd_connector_get_conn_info(ctx->connector);
@@ -994,94 +1484,339 @@ static bool handle(qd_server_t *qd_server, pn_event_t *e, pn_connection_t *pn_co
     return true;
 }
 
-static void *thread_run(void *arg)
+static __thread int server_thread_index = -1;
+static __thread qd_server_thread_t *server_thread = 0;
+
+int qd_server_thread_index(void)
 {
-    qd_server_t      *qd_server = (qd_server_t*)arg;
-    bool running = true;
-    while (running) {
-        pn_event_batch_t *events = pn_proactor_wait(qd_server->proactor);
-        pn_event_t * e;
-        qd_connection_t *qd_conn = 0;
-        pn_connection_t *pn_conn = 0;
+    return server_thread_index;
+}
 
-        while (running && (e = pn_event_batch_next(events))) {
-            pn_connection_t *conn = pn_event_connection(e);
 
-            if (!pn_conn)
-                pn_conn = conn;
-            assert(pn_conn == conn);
+/* Socket I/O belongs to the Proton proactor; workers only handle event batches. */
+static void thread_start(qd_server_t *qd_server, int index)
+{
+    server_thread_index = index;
+    server_thread = &qd_server->threads[index];
+    server_thread->stats.index      = index;
+    server_thread->stats.dispatcher = qd_server->workers && index == qd_server->thread_count;
+    __atomic_store_n(&server_thread->started, true, __ATOMIC_RELEASE);
+    qd_entity_cache_add(QD_WORKER_THREAD_TYPE, server_thread);
+
+    const char *cpus = qd_server->qd->worker_thread_cpus;
+    if (cpus) {
+        int rc = sys_thread_set_affinity(cpus);
+        if (rc)
+            qd_log(qd_server->log_source, QD_LOG_WARNING,
+                   "Unable to bind worker thread %d to CPUs '%s': %s", server_thread_index, cpus, strerror(rc));
+    }
+}
 
-            if (!qd_conn)
-                qd_conn = !!pn_conn ? (qd_connection_t*) pn_connection_get_context(pn_conn) : 0;
 
-            running = handle(qd_server, e, conn, qd_conn);
+static int thread_next_index(qd_server_t *qd_server)
+{
+    sys_mutex_lock(qd_server->lock);
+    int index = qd_server->next_thread_index++;
+    sys_mutex_unlock(qd_server->lock);
+    return index;
+}
 
-            /* Free the connection after all other processing is complete */
-            if (qd_conn && pn_event_type(e) == PN_TRANSPORT_CLOSED) {
-                pn_connection_set_context(pn_conn, NULL);
-                qd_connection_free(qd_conn);
-                qd_conn = 0;
-            }
-        }
 
-        //
-        // Notify the container that the batch is complete so it can do after-batch
-        // processing.
-        //
-        if (qd_conn)
-            qd_conn_event_batch_complete(qd_server->container, qd_conn, false);
+#define THREAD_STAT_ADD(t, field, n) __atomic_store_n(&(t)->stats.field, (t)->stats.field + (n), __ATOMIC_RELAXED)
+
 
-        pn_proactor_done(qd_server->proactor, events);
+/* Handle a batch of events and hand it back to the proactor.  Returns false if
+ * the server is stopping.
+ *
+ * With connectionBatchEvents set, stop a connection batch after that many events.
+ * Proton keeps the rest on the connection's collector and schedules the
+ * connection again once the batch is done, behind whatever else is ready.
+ */
+static bool thread_process_batch(qd_server_t *qd_server, pn_event_batch_t *events)
+{
+    qd_server_thread_t *thread = server_thread;
+    int64_t start = qd_timer_now_usec();
+    bool running = true;
+    pn_event_t * e;
+    qd_connection_t *qd_conn = 0;
+    pn_connection_t *pn_conn = 0;
+    int limit = pn_event_batch_connection(events) ? qd_server->qd->connection_batch_events : 0;
+    int count = 0;
+    uint64_t handled = 0;
+
+    while (running && !(limit > 0 && count++ == limit) && (e = pn_event_batch_next(events))) {
+        pn_connection_t *conn = pn_event_connection(e);
+
+        if (!pn_conn)
+            pn_conn = conn;
+        assert(pn_conn == conn);
+
+        if (!qd_conn)
+            qd_conn = !!pn_conn ? (qd_connection_t*) pn_connection_get_context(pn_conn) : 0;
+
+        running = handle(qd_server, e, conn, qd_conn);
+        handled++;
+        int type = (int) pn_event_type(e);
+        if (type < 0 || type >= QD_SERVER_EVENT_TYPES)
+            type = QD_SERVER_EVENT_TYPES - 1;
+        THREAD_STAT_ADD(thread, event_types[type], 1);
+
+        /* Free the connection after all other processing is complete */
+        if (qd_conn && pn_event_type(e) == PN_TRANSPORT_CLOSED) {
+            pn_connection_set_context(pn_conn, NULL);
+            qd_connection_free(qd_conn);
+            qd_conn = 0;
+        }
     }
-    return NULL;
+
+    //
+    // Notify the container that the batch is complete so it can do after-batch
+    // processing.
+    //
+    if (qd_conn)
+        qd_conn_event_batch_complete(qd_server->container, qd_conn, false);
+    qd_container_batch_complete(qd_server->container);
+    qd_stats_page_thread_batch(server_thread_index, handled);
+
+    int64_t end = qd_timer_now_usec();
+    if (thread->last_usec)
+        THREAD_STAT_ADD(thread, idle_usec, (uint64_t) (start - thread->last_usec));
+    THREAD_STAT_ADD(thread, busy_usec, (uint64_t) (end - start));
+    THREAD_STAT_ADD(thread, batches, 1);
+    THREAD_STAT_ADD(thread, events, handled);
+    if ((uint64_t) (end - start) > thread->stats.batch_usec_max)
+        __atomic_store_n(&thread->stats.batch_usec_max, (uint64_t) (end - start), __ATOMIC_RELAXED);
+    thread->last_usec = end;
+
+    pn_proactor_done(qd_server->proactor, events);
+    return running;
 }
 
 
-static qd_failover_item_t *qd_connector_get_conn_info(qd_connector_t *ct) {
+void qd_server_count_delivery(bool incoming)
+{
+    qd_server_thread_t *thread = server_thread;
+    if (!thread)
+        return;
+    if (incoming)
+        THREAD_STAT_ADD(thread, deliveries_in, 1);
+    else
+        THREAD_STAT_ADD(thread, deliveries_out, 1);
+}
 
-    qd_failover_item_t *item = DEQ_HEAD(ct->conn_info_list);
 
-    if (DEQ_SIZE(ct->conn_info_list) > 1) {
-        for (int i=1; i < ct->conn_index; i++) {
-            item = DEQ_NEXT(item);
-        }
-    }
-    return item;
+static void thread_stats_copy(const qd_server_thread_t *thread, qd_server_thread_stats_t *copy)
+{
+    copy->index          = thread->stats.index;
+    copy->dispatcher     = thread->stats.dispatcher;
+    copy->busy_usec      = __atomic_load_n(&thread->stats.busy_usec, __ATOMIC_RELAXED);
+    copy->idle_usec      = __atomic_load_n(&thread->stats.idle_usec, __ATOMIC_RELAXED);
+    copy->batch_usec_max = __atomic_load_n(&thread->stats.batch_usec_max, __ATOMIC_RELAXED);
+    copy->batches        = __atomic_load_n(&thread->stats.batches, __ATOMIC_RELAXED);
+    copy->events         = __atomic_load_n(&thread->stats.events, __ATOMIC_RELAXED);
+    copy->deliveries_in  = __atomic_load_n(&thread->stats.deliveries_in, __ATOMIC_RELAXED);
+    copy->deliveries_out = __atomic_load_n(&thread->stats.deliveries_out, __ATOMIC_RELAXED);
+    for (int t = 0; t < QD_SERVER_EVENT_TYPES; t++)
+        copy->event_types[t] = __atomic_load_n(&thread->stats.event_types[t], __ATOMIC_RELAXED);
 }
 
 
-/* Timer callback to try/retry connection open */
-static void try_open_lh(qd_connector_t *ct)
+int qd_server_thread_stats(qd_server_t *qd_server, qd_server_thread_stats_t *stats, int max)
 {
-    if (ct->state != CXTR_STATE_CONNECTING && ct->state != CXTR_STATE_INIT) {
-        /* No longer referenced by pn_connection or timer */
-        qd_connector_decref(ct);
-        return;
+    int count = 0;
+    for (int i = 0; i <= qd_server->thread_count && count < max; i++) {
+        qd_server_thread_t *thread = &qd_server->threads[i];
+        if (__atomic_load_n(&thread->started, __ATOMIC_ACQUIRE))
+            thread_stats_copy(thread, &stats[count++]);
     }
+    return count;
+}
 
-    qd_connection_t *ctx = qd_server_connection(ct->server, &ct->config);
-    if (!ctx) {                 /* Try again later */
-        qd_log(ct->server->log_source, QD_LOG_CRITICAL, "Allocation failure connecting to %s",
-               ct->config.host_port);
-        ct->delay = 10000;
-        sys_atomic_inc(&ct->ref_count);
-        qd_timer_schedule(ct->timer, ct->delay);
-        return;
-    }
-    ctx->connector    = ct;
-    const qd_server_config_t *config = &ct->config;
+
+qd_error_t qd_entity_refresh_workerThread(qd_entity_t* entity, void *impl)
+{
+    qd_server_thread_stats_t stats;
+    thread_stats_copy((qd_server_thread_t*) impl, &stats);
+
+    uint64_t total = stats.busy_usec + stats.idle_usec;
+    if (qd_entity_set_long(entity, "threadIndex", stats.index) == 0 &&
+        qd_entity_set_string(entity, "role", stats.dispatcher ? "dispatcher" : "worker") == 0 &&
+        qd_entity_set_long(entity, "busyMicros", stats.busy_usec) == 0 &&
+        qd_entity_set_long(entity, "idleMicros", stats.idle_usec) == 0 &&
+        qd_entity_set_long(entity, "utilization", total ? (long) (stats.busy_usec * 100 / total) : 0) == 0 &&
+        qd_entity_set_long(entity, "batches", stats.batches) == 0 &&
+        qd_entity_set_long(entity, "events", stats.events) == 0 &&
+        qd_entity_set_long(entity, "batchMicrosMax", stats.batch_usec_max) == 0 &&
+        qd_entity_set_long(entity, "deliveriesIn", stats.deliveries_in) == 0 &&
+        qd_entity_set_long(entity, "deliveriesOut", stats.deliveries_out) == 0 &&
+        qd_entity_set_map(entity, "eventCounts") == 0) {
+        for (int t = 0; t < QD_SERVER_EVENT_TYPES; t++) {
+            const char *name = t < QD_SERVER_EVENT_TYPES - 1 ? pn_event_type_name((pn_event_type_t) t) : "OTHER";
+            if (!stats.event_types[t] || !name)
+                continue;
+            if (qd_entity_set_map_key_value_int(entity, "eventCounts", name, (int) stats.event_types[t]) != 0)
+                return qd_error_code();
+        }
+        return QD_ERROR_NONE;
+    }
+    return qd_error_code();
+}
+
+
+static void *thread_run(void *arg)
+{
+    qd_server_t      *qd_server = (qd_server_t*)arg;
+    bool running = true;
+
+    thread_start(qd_server, thread_next_index(qd_server));
+
+    while (running)
+        running = thread_process_batch(qd_server, pn_proactor_wait(qd_server->proactor));
+    return NULL;
+}
+
+
+/* Worker thread with connection affinity: handle the batches the dispatcher
+ * hands over until told to stop.
+ */
+static void *worker_run(void *arg)
+{
+    qd_server_t *qd_server = (qd_server_t*) arg;
+    int          index     = thread_next_index(qd_server);
+    qd_server_worker_t *worker = &qd_server->workers[index];
+
+    thread_start(qd_server, index);
+
+    sys_mutex_lock(worker->lock);
+    while (true) {
+        while (worker->count == 0 && !worker->stopping)
+            sys_cond_wait(worker->cond, worker->lock);
+        if (worker->count == 0)
+            break;
+
+        pn_event_batch_t *events = worker->batches[worker->head];
+        worker->head = (worker->head + 1) % worker->capacity;
+        worker->count--;
+        sys_mutex_unlock(worker->lock);
+
+        (void) thread_process_batch(qd_server, events);
+
+        sys_mutex_lock(worker->lock);
+    }
+    sys_mutex_unlock(worker->lock);
+    return NULL;
+}
+
+
+static void worker_push(qd_server_worker_t *worker, pn_event_batch_t *events)
+{
+    sys_mutex_lock(worker->lock);
+    if (worker->count == worker->capacity) {
+        int capacity = worker->capacity ? worker->capacity * 2 : 16;
+        pn_event_batch_t **batches = (pn_event_batch_t**) malloc(capacity * sizeof(pn_event_batch_t*));
+        for (int i = 0; i < worker->count; i++)
+            batches[i] = worker->batches[(worker->head + i) % worker->capacity];
+        free(worker->batches);
+        worker->batches  = batches;
+        worker->head     = 0;
+        worker->capacity = capacity;
+    }
+    worker->batches[(worker->head + worker->count) % worker->capacity] = events;
+    worker->count++;
+    sys_cond_signal(worker->cond);
+    sys_mutex_unlock(worker->lock);
+}
+
+
+/*
+ * Choose the worker a new connection is pinned to.  Connections from
+ * tlsOffload listeners go to the reserved TLS workers, all others to the rest.
+ */
+static int dispatcher_pick_worker(qd_server_t *qd_server, const qd_connection_t *ctx)
+{
+    int tls_workers = qd_server->tls_workers;
+    if (tls_workers == 0)
+        return qd_server->next_worker++ % qd_server->thread_count;
+
+    const qd_server_config_t *config = ctx->listener ? &ctx->listener->config : 0;
+    if (config && config->tls_offload && config->ssl_profile)
+        return qd_server->next_tls_worker++ % tls_workers;
+    return tls_workers + qd_server->next_worker++ % (qd_server->thread_count - tls_workers);
+}
+
+
+/* With connection affinity, a single thread waits on the proactor.  Each
+ * connection is pinned to a worker when its first batch arrives, so its state
+ * and the thread-local pools it draws on stay with one thread.  Batches that are
+ * not for a connection - timers, listeners, interrupts - are handled here.
+ */
+static void dispatcher_run(qd_server_t *qd_server)
+{
+    bool running = true;
+
+    /* The dispatcher owns no worker slot */
+    thread_start(qd_server, qd_server->thread_count);
+
+    while (running) {
+        pn_event_batch_t *events  = pn_proactor_wait(qd_server->proactor);
+        pn_connection_t  *pn_conn = pn_event_batch_connection(events);
+        qd_connection_t  *ctx     = 0;
+
+        if (pn_conn && !qdr_is_authentication_service_connection(pn_conn))
+            ctx = (qd_connection_t*) pn_connection_get_context(pn_conn);
+
+        if (ctx) {
+            if (ctx->worker < 0)
+                ctx->worker = dispatcher_pick_worker(qd_server, ctx);
+            worker_push(&qd_server->workers[ctx->worker], events);
+        } else
+            running = thread_process_batch(qd_server, events);
+    }
+
+    for (int i = 0; i < qd_server->thread_count; i++) {
+        qd_server_worker_t *worker = &qd_server->workers[i];
+        sys_mutex_lock(worker->lock);
+        worker->stopping = true;
+        sys_cond_signal(worker->cond);
+        sys_mutex_unlock(worker->lock);
+    }
+}
+
+
+static qd_failover_item_t *qd_connector_get_conn_info(qd_connector_t *ct) {
+
+    qd_failover_item_t *item = DEQ_HEAD(ct->conn_info_list);
+
+    if (DEQ_SIZE(ct->conn_info_list) > 1) {
+        for (int i=1; i < ct->conn_index; i++) {
+            item = DEQ_NEXT(item);
+        }
+    }
+    return item;
+}
+
+
+/*
+ * Start one connection attempt of a connector, to host_port with the open frame naming
+ * hostname.  A race_target of -1 makes it the connector's only attempt, otherwise it is raced
+ * against the connector's other attempts.  Returns 0 if the connection could not be allocated.
+ */
+static qd_connection_t *connector_attempt_lh(qd_connector_t *ct, const char *hostname, const char *host_port,
+                                             int race_target)
+{
+    qd_connection_t *ctx = qd_server_connection(ct->server, &ct->config);
+    if (!ctx) {
+        qd_log(ct->server->log_source, QD_LOG_CRITICAL, "Allocation failure connecting to %s", host_port);
+        return 0;
+    }
+    ctx->connector    = ct;
+    const qd_server_config_t *config = &ct->config;
 
     //
     // Set the hostname on the pn_connection. This hostname will be used by proton as the
     // hostname in the open frame.
     //
-
-    qd_failover_item_t *item = qd_connector_get_conn_info(ct);
-
-    char *current_host = item->host;
-    char *host_port = item->host_port;
-
-    pn_connection_set_hostname(ctx->pn_conn, current_host);
+    pn_connection_set_hostname(ctx->pn_conn, hostname);
 
     // Set the sasl user name and password on the proton connection object. This has to be
     // done before pn_proactor_connect which will bind a transport to the connection
@@ -1090,96 +1825,321 @@ static void try_open_lh(qd_connector_t *ct)
     if (config->sasl_password)
         pn_connection_set_password(ctx->pn_conn, config->sasl_password);
 
-    ctx->connector->state = CXTR_STATE_OPEN;
-    ct->ctx   = ctx;
+    if (race_target < 0) {
+        ct->ctx = ctx;
+    } else {
+        ctx->racing      = true;
+        ctx->race_target = race_target;
+        ct->racers[ct->racer_count++] = ctx;
+    }
+    ct->state = CXTR_STATE_OPEN;
     ct->delay = 5000;
 
     qd_log(ct->server->log_source, QD_LOG_TRACE,
            "[%"PRIu64"] Connecting to %s", ctx->connection_id, host_port);
     /* Note: the transport is configured in the PN_CONNECTION_BOUND event */
     pn_proactor_connect(ct->server->proactor, ctx->pn_conn, host_port);
+    return ctx;
 }
 
-static void setup_ssl_sasl_and_open(qd_connection_t *ctx)
+
+static void connector_race_clear_lh(qd_connector_t *ct)
+{
+    for (int i = 0; i < ct->race_target_count; i++)
+        free(ct->race_targets[i].host_port);
+    ct->race_target_count = 0;
+    ct->race_next         = 0;
+}
+
+
+/* Take the next address of a family from a getaddrinfo result */
+static struct addrinfo *next_addrinfo(struct addrinfo **cursor, bool ipv6)
+{
+    while (*cursor) {
+        struct addrinfo *ai = *cursor;
+        *cursor = ai->ai_next;
+        if ((ai->ai_family == AF_INET6) == ipv6)
+            return ai;
+    }
+    return 0;
+}
+
+
+/*
+ * Resolve the connector's failover entries, starting with the current one, into the addresses
+ * to race.  The addresses of an entry alternate between IPv6 and IPv4 so that a family that
+ * is unreachable cannot hold up the other.  An entry that does not resolve is raced by name so
+ * its failure is reported as it would be without racing.
+ */
+static void connector_race_targets_lh(qd_connector_t *ct)
+{
+    connector_race_clear_lh(ct);
+
+    int entries = DEQ_SIZE(ct->conn_info_list);
+    int index   = entries > 1 ? ct->conn_index : 1;
+    qd_failover_item_t *item = qd_connector_get_conn_info(ct);
+
+    for (int i = 0; i < entries && ct->race_target_count < QD_CONNECTOR_RACE_MAX; i++) {
+        struct addrinfo  hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_ADDRCONFIG };
+        struct addrinfo *res   = 0;
+
+        if (getaddrinfo(item->host, item->port, &hints, &res) == 0 && res) {
+            struct addrinfo *cursor[2] = { res, res };  // Indexed by "is IPv6"
+            bool             ipv6      = res->ai_family == AF_INET6;
+
+            while (ct->race_target_count < QD_CONNECTOR_RACE_MAX) {
+                struct addrinfo *ai = next_addrinfo(&cursor[ipv6], ipv6);
+                if (ai)
+                    ipv6 = !ipv6;
+                else if (!(ai = next_addrinfo(&cursor[!ipv6], !ipv6)))
+                    break;
+
+                char host[NI_MAXHOST];
+                char port[NI_MAXSERV];
+                if (getnameinfo(ai->ai_addr, ai->ai_addrlen, host, sizeof(host), port, sizeof(port),
+                                NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+                    continue;
+
+                qd_connector_race_target_t *target = &ct->race_targets[ct->race_target_count++];
+                target->host_port  = (char*) malloc(strlen(host) + strlen(port) + 2);
+                sprintf(target->host_port, "%s:%s", host, port);
+                target->conn_index = index;
+            }
+            freeaddrinfo(res);
+        } else {
+            qd_connector_race_target_t *target = &ct->race_targets[ct->race_target_count++];
+            target->host_port  = strdup(item->host_port);
+            target->conn_index = index;
+        }
+
+        item = DEQ_NEXT(item);
+        index++;
+        if (!item) {
+            item  = DEQ_HEAD(ct->conn_info_list);
+            index = 1;
+        }
+    }
+}
+
+
+/*
+ * Start the next target of the race and arm the stagger for the one after it, unless the
+ * stagger is already armed.
+ */
+static void connector_race_next_lh(qd_connector_t *ct)
+{
+    qd_connector_race_target_t *target = &ct->race_targets[ct->race_next];
+    qd_failover_item_t *item = DEQ_HEAD(ct->conn_info_list);
+    for (int i = 1; i < target->conn_index; i++)
+        item = DEQ_NEXT(item);
+
+    connector_attempt_lh(ct, item->host, target->host_port, ct->race_next);
+    ct->race_next++;
+
+    if (ct->race_next < ct->race_target_count && !ct->race_timer_armed) {
+        ct->race_timer_armed = true;
+        sys_atomic_inc(&ct->ref_count);
+        qd_timer_schedule(ct->race_timer, ct->config.connect_race_ms);
+    }
+}
+
+
+/*
+ * A raced attempt failed before any attempt opened.  Start the next target right away if no
+ * other attempt is pending.  Returns false once the race has been lost by every target.
+ */
+static bool connector_race_failed_lh(qd_connector_t *ct, qd_connection_t *ctx)
+{
+    for (int i = 0; i < ct->racer_count; i++) {
+        if (ct->racers[i] == ctx) {
+            ct->racers[i] = ct->racers[--ct->racer_count];
+            break;
+        }
+    }
+
+    while (ct->racer_count == 0 && ct->race_next < ct->race_target_count)
+        connector_race_next_lh(ct);
+    return ct->racer_count > 0;
+}
+
+
+static void race_lost_close(void *context, bool discard)
+{
+    if (!discard)
+        pn_connection_close((pn_connection_t*) context);
+}
+
+
+/*
+ * A raced attempt has opened.  The first one to do so becomes the connector's connection and
+ * the other attempts are detached from the connector and closed.
+ */
+static bool connector_race_won(qd_connection_t *ctx)
 {
     qd_connector_t *ct = ctx->connector;
-    const qd_server_config_t *config = &ct->config;
-    pn_transport_t *tport  = pn_connection_transport(ctx->pn_conn);
+    if (!ct)
+        return false;
+
+    sys_mutex_lock(ct->lock);
+    bool won = ctx->connector == ct && !ct->ctx;
+    if (won) {
+        ct->ctx        = ctx;
+        ct->conn_index = ct->race_targets[ctx->race_target].conn_index;
+        ctx->racing    = false;
+        for (int i = 0; i < ct->racer_count; i++) {
+            qd_connection_t *loser = ct->racers[i];
+            if (loser != ctx) {
+                loser->connector = 0;
+                if (loser->pn_conn)
+                    qd_connection_invoke_deferred(loser, race_lost_close, loser->pn_conn);
+            }
+        }
+        qd_log(ct->server->log_source, QD_LOG_DEBUG,
+               "[C%"PRIu64"] Connection to %s won the race of %d attempt(s)",
+               ctx->connection_id, ct->race_targets[ctx->race_target].host_port, ct->race_next);
+        ct->racer_count = 0;
+        ct->race_next   = ct->race_target_count;
+    }
+    sys_mutex_unlock(ct->lock);
+    return won;
+}
+
+
+/* Timer callback to try/retry connection open */
+static void try_open_lh(qd_connector_t *ct)
+{
+    if (ct->state != CXTR_STATE_CONNECTING && ct->state != CXTR_STATE_INIT) {
+        /* No longer referenced by pn_connection or timer */
+        qd_connector_decref(ct);
+        return;
+    }
 
     //
-    // Set up SSL if appropriate
+    // With racing configured, every address of every failover entry is a target.  A single
+    // target is connected to as if racing were off.
     //
-    if (config->ssl_profile) {
-        pn_ssl_domain_t *domain = pn_ssl_domain(PN_SSL_MODE_CLIENT);
-
-        if (!domain) {
-            qd_error(QD_ERROR_RUNTIME, "SSL domain failed for connection to %s:%s",
-                     ct->config.host, ct->config.port);
-            return;
+    if (ct->config.connect_race_ms > 0) {
+        connector_race_targets_lh(ct);
+        if (ct->race_target_count > 1) {
+            ct->ctx = 0;
+            while (ct->racer_count == 0 && ct->race_next < ct->race_target_count)
+                connector_race_next_lh(ct);
+            if (ct->racer_count > 0)
+                return;
         }
+    }
 
-        // set our trusted database for checking the peer's cert:
-        if (config->ssl_trusted_certificate_db) {
-            if (pn_ssl_domain_set_trusted_ca_db(domain, config->ssl_trusted_certificate_db)) {
-                qd_log(ct->server->log_source, QD_LOG_ERROR,
-                       "SSL CA configuration failed for %s:%s",
-                       ct->config.host, ct->config.port);
-            }
+    qd_failover_item_t *item = qd_connector_get_conn_info(ct);
+    if (!connector_attempt_lh(ct, item->host, item->host_port, -1)) {  /* Try again later */
+        ct->delay = 10000;
+        sys_atomic_inc(&ct->ref_count);
+        qd_timer_schedule(ct->timer, ct->delay);
+    }
+}
+
+
+/*
+ * Build the client SSL domain for a connector.  Configuration problems are
+ * logged and otherwise ignored, as they always have been.
+ */
+static pn_ssl_domain_t *connector_ssl_domain(qd_connector_t *ct)
+{
+    const qd_server_config_t *config = &ct->config;
+    pn_ssl_domain_t *domain = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+
+    if (!domain) {
+        qd_error(QD_ERROR_RUNTIME, "SSL domain failed for connection to %s:%s",
+                 ct->config.host, ct->config.port);
+        return 0;
+    }
+
+    // set our trusted database for checking the peer's cert:
+    if (config->ssl_trusted_certificate_db) {
+        if (pn_ssl_domain_set_trusted_ca_db(domain, config->ssl_trusted_certificate_db)) {
+            qd_log(ct->server->log_source, QD_LOG_ERROR,
+                   "SSL CA configuration failed for %s:%s",
+                   ct->config.host, ct->config.port);
         }
-        // should we force the peer to provide a cert?
-        if (config->ssl_require_peer_authentication) {
-            const char *trusted = (config->ssl_trusted_certificates)
-                ? config->ssl_trusted_certificates
-                : config->ssl_trusted_certificate_db;
-            if (pn_ssl_domain_set_peer_authentication(domain,
-                                                      PN_SSL_VERIFY_PEER,
-                                                      trusted)) {
-                qd_log(ct->server->log_source, QD_LOG_ERROR,
-                       "SSL peer auth configuration failed for %s:%s",
-                       config->host, config->port);
-            }
+    }
+    // should we force the peer to provide a cert?
+    if (config->ssl_require_peer_authentication) {
+        const char *trusted = (config->ssl_trusted_certificates)
+            ? config->ssl_trusted_certificates
+            : config->ssl_trusted_certificate_db;
+        if (pn_ssl_domain_set_peer_authentication(domain,
+                                                  PN_SSL_VERIFY_PEER,
+                                                  trusted)) {
+            qd_log(ct->server->log_source, QD_LOG_ERROR,
+                   "SSL peer auth configuration failed for %s:%s",
+                   config->host, config->port);
         }
+    }
 
-        // configure our certificate if the peer requests one:
-        if (config->ssl_certificate_file) {
-            if (pn_ssl_domain_set_credentials(domain,
-                                              config->ssl_certificate_file,
-                                              config->ssl_private_key_file,
-                                              config->ssl_password)) {
-                qd_log(ct->server->log_source, QD_LOG_ERROR,
-                       "SSL local configuration failed for %s:%s",
-                       config->host, config->port);
-            }
+    // configure our certificate if the peer requests one:
+    if (config->ssl_certificate_file) {
+        if (pn_ssl_domain_set_credentials(domain,
+                                          config->ssl_certificate_file,
+                                          config->ssl_private_key_file,
+                                          config->ssl_password)) {
+            qd_log(ct->server->log_source, QD_LOG_ERROR,
+                   "SSL local configuration failed for %s:%s",
+                   config->host, config->port);
         }
+    }
 
-        if (config->ssl_ciphers) {
-            if (pn_ssl_domain_set_ciphers(domain, config->ssl_ciphers)) {
-                qd_log(ct->server->log_source, QD_LOG_ERROR,
-                       "SSL cipher configuration failed for %s:%s",
-                       config->host, config->port);
-            }
+    if (config->ssl_ciphers) {
+        if (pn_ssl_domain_set_ciphers(domain, config->ssl_ciphers)) {
+            qd_log(ct->server->log_source, QD_LOG_ERROR,
+                   "SSL cipher configuration failed for %s:%s",
+                   config->host, config->port);
+        }
+    }
+
+    if (config->ssl_protocols) {
+        if (pn_ssl_domain_set_protocols(domain, config->ssl_protocols)) {
+            qd_log(ct->server->log_source, QD_LOG_ERROR,
+                   "Permitted TLS protocols configuration failed %s:%s",
+                   config->host, config->port);
         }
+    }
 
-        if (config->ssl_protocols) {
-            if (pn_ssl_domain_set_protocols(domain, config->ssl_protocols)) {
+    //If ssl is enabled and verify_host_name is true, instruct proton to verify peer name
+    if (config->verify_host_name) {
+        if (pn_ssl_domain_set_peer_authentication(domain, PN_SSL_VERIFY_PEER_NAME, NULL)) {
                 qd_log(ct->server->log_source, QD_LOG_ERROR,
-                       "Permitted TLS protocols configuration failed %s:%s",
+                       "SSL peer host name verification failed for %s:%s",
                        config->host, config->port);
-            }
         }
+    }
+    return domain;
+}
 
-        //If ssl is enabled and verify_host_name is true, instruct proton to verify peer name
-        if (config->verify_host_name) {
-            if (pn_ssl_domain_set_peer_authentication(domain, PN_SSL_VERIFY_PEER_NAME, NULL)) {
-                    qd_log(ct->server->log_source, QD_LOG_ERROR,
-                           "SSL peer host name verification failed for %s:%s",
-                           config->host, config->port);
-            }
-        }
+
+static void setup_ssl_sasl_and_open(qd_connection_t *ctx)
+{
+    qd_connector_t *ct = ctx->connector;
+    const qd_server_config_t *config = &ct->config;
+    pn_transport_t *tport  = pn_connection_transport(ctx->pn_conn);
+
+    //
+    // Set up SSL if appropriate
+    //
+    if (config->ssl_profile) {
+        //
+        // The domain is kept for the life of the connector and the session is
+        // named after the peer, so a reconnect can resume the previous TLS
+        // session rather than negotiate a new one.
+        //
+        sys_mutex_lock(ct->lock);
+        if (!ct->ssl_domain)
+            ct->ssl_domain = connector_ssl_domain(ct);
+        pn_ssl_domain_t *domain = ct->ssl_domain;
+        sys_mutex_unlock(ct->lock);
+        if (!domain)
+            return;
 
         ctx->ssl = pn_ssl(tport);
-        pn_ssl_init(ctx->ssl, domain, 0);
-        pn_ssl_domain_free(domain);
+        pn_ssl_init(ctx->ssl, domain, config->host_port);
     }
 
     //
@@ -1204,6 +2164,18 @@ static void try_open_cb(void *context) {
     }
 }
 
+/* Timer callback to start the next attempt of a race.  The timer's reference is kept until
+ * the lock is released so that the armed flag cannot go stale. */
+static void try_race_cb(void *context) {
+    qd_connector_t *ct = (qd_connector_t*) context;
+    sys_mutex_lock(ct->lock);
+    ct->race_timer_armed = false;
+    if (ct->state == CXTR_STATE_OPEN && !ct->ctx && ct->race_next < ct->race_target_count)
+        connector_race_next_lh(ct);
+    sys_mutex_unlock(ct->lock);
+    qd_connector_decref(ct);
+}
+
 
 qd_server_t *qd_server(qd_dispatch_t *qd, int thread_count, const char *container_name,
                        const char *sasl_config_path, const char *sasl_config_name)
@@ -1228,6 +2200,7 @@ qd_server_t *qd_server(qd_dispatch_t *qd, int thread_count, const char *containe
     DEQ_INIT(qd_server->conn_list);
 
     qd_timer_initialize();
+    qdr_remote_sasl_initialize();
 
     qd_server->pause_requests         = 0;
     qd_server->threads_paused         = 0;
@@ -1235,8 +2208,13 @@ qd_server_t *qd_server(qd_dispatch_t *qd, int thread_count, const char *containe
     qd_server->pause_now_serving      = 0;
     qd_server->next_connection_id     = 1;
     qd_server->py_displayname_obj     = 0;
+    qd_server->display_name_lock      = sys_rwlock();
+    DEQ_INIT(qd_server->display_names);
+    qd_server->next_thread_index      = 0;
+    qd_server->threads                = (qd_server_thread_t*) calloc(thread_count + 1, sizeof(qd_server_thread_t));
 
     qd_server->http = qd_http_server(qd_server, qd_server->log_source);
+    qd_server->local = qd_local_server(qd_server, qd_server->log_source);
 
     qd_log(qd_server->log_source, QD_LOG_INFO, "Container Name: %s", qd_server->container_name);
 
@@ -1248,20 +2226,35 @@ void qd_server_free(qd_server_t *qd_server)
 {
     if (!qd_server) return;
     pn_proactor_free(qd_server->proactor);
+    qd_local_server_free(qd_server->local);
     qd_connection_t *ctx = DEQ_HEAD(qd_server->conn_list);
     while (ctx) {
         DEQ_REMOVE_HEAD(qd_server->conn_list);
         if (ctx->free_user_id) free((char*)ctx->user_id);
-        sys_mutex_free(ctx->deferred_call_lock);
+        sys_atomic_ptr_destroy(&ctx->deferred_calls);
+        qd_memory_account_detach(ctx->memory_account);
         free(ctx->name);
         free(ctx->role);
         free_qd_connection_t(ctx);
         ctx = DEQ_HEAD(qd_server->conn_list);
     }
     qd_timer_finalize();
+    qdr_remote_sasl_finalize();
     sys_mutex_free(qd_server->lock);
     sys_cond_free(qd_server->cond);
     Py_XDECREF((PyObject *)qd_server->py_displayname_obj);
+    qd_display_name_table_t *table = DEQ_HEAD(qd_server->display_names);
+    while (table) {
+        DEQ_REMOVE_HEAD(qd_server->display_names);
+        display_name_table_free(table);
+        table = DEQ_HEAD(qd_server->display_names);
+    }
+    sys_rwlock_free(qd_server->display_name_lock);
+    for (int i = 0; i <= qd_server->thread_count; i++) {
+        if (qd_server->threads[i].started)
+            qd_entity_cache_remove(QD_WORKER_THREAD_TYPE, &qd_server->threads[i]);
+    }
+    free(qd_server->threads);
     free(qd_server);
 }
 
@@ -1283,19 +2276,53 @@ void qd_server_run(qd_dispatch_t *qd)
 #ifndef NDEBUG
     qd_log(qd_server->log_source, QD_LOG_INFO, "Running in DEBUG Mode");
 #endif
-    int n = qd_server->thread_count - 1; /* Start count-1 threads + use current thread */
-    sys_thread_t **threads = (sys_thread_t **)calloc(n, sizeof(sys_thread_t*));
-    for (i = 0; i < n; i++) {
-        threads[i] = sys_thread(thread_run, qd_server);
-    }
-    thread_run(qd_server);      /* Use the current thread */
-    for (i = 0; i < n; i++) {
-        sys_thread_join(threads[i]);
-        sys_thread_free(threads[i]);
+    if (qd->worker_connection_affinity) {
+        int n = qd_server->thread_count; /* Start count workers + dispatch on the current thread */
+        qd_log(qd_server->log_source, QD_LOG_INFO, "Connections are pinned to worker threads");
+        if (qd->tls_offload_threads > 0) {
+            qd_server->tls_workers = qd->tls_offload_threads < n ? qd->tls_offload_threads : n - 1;
+            qd_log(qd_server->log_source, QD_LOG_INFO,
+                   "%d worker threads reserved for tlsOffload listeners", qd_server->tls_workers);
+        }
+        qd_server->workers = (qd_server_worker_t*) calloc(n, sizeof(qd_server_worker_t));
+        for (i = 0; i < n; i++) {
+            qd_server->workers[i].lock = sys_mutex();
+            qd_server->workers[i].cond = sys_cond();
+        }
+        sys_thread_t **threads = (sys_thread_t **)calloc(n, sizeof(sys_thread_t*));
+        for (i = 0; i < n; i++) {
+            threads[i] = sys_thread(worker_run, qd_server);
+        }
+        dispatcher_run(qd_server);
+        for (i = 0; i < n; i++) {
+            sys_thread_join(threads[i]);
+            sys_thread_free(threads[i]);
+            sys_mutex_free(qd_server->workers[i].lock);
+            sys_cond_free(qd_server->workers[i].cond);
+            free(qd_server->workers[i].batches);
+        }
+        free(threads);
+        free(qd_server->workers);
+        qd_server->workers = 0;
+    } else {
+        if (qd->tls_offload_threads > 0)
+            qd_log(qd_server->log_source, QD_LOG_WARNING,
+                   "tlsOffloadThreads has no effect without workerConnectionAffinity");
+        int n = qd_server->thread_count - 1; /* Start count-1 threads + use current thread */
+        sys_thread_t **threads = (sys_thread_t **)calloc(n, sizeof(sys_thread_t*));
+        for (i = 0; i < n; i++) {
+            threads[i] = sys_thread(thread_run, qd_server);
+        }
+        thread_run(qd_server);      /* Use the current thread */
+        for (i = 0; i < n; i++) {
+            sys_thread_join(threads[i]);
+            sys_thread_free(threads[i]);
+        }
+        free(threads);
     }
-    free(threads);
     qd_http_server_stop(qd_server->http); /* Stop HTTP threads immediately */
     qd_http_server_free(qd_server->http);
+    qd_local_server_stop(qd_server->local); /* Its connections go in qd_server_free() */
 
     qd_log(qd_server->log_source, QD_LOG_NOTICE, "Shut Down");
 }
@@ -1378,15 +2405,20 @@ void qd_connection_invoke_deferred(qd_connection_t *conn, qd_deferred_t call, vo
         return;
 
     qd_deferred_call_t *dc = new_qd_deferred_call_t();
-    DEQ_ITEM_INIT(dc);
     dc->call    = call;
     dc->context = context;
 
-    sys_mutex_lock(conn->deferred_call_lock);
-    DEQ_INSERT_TAIL(conn->deferred_calls, dc);
-    sys_mutex_unlock(conn->deferred_call_lock);
+    void *head;
+    do {
+        head     = sys_atomic_ptr_get(&conn->deferred_calls);
+        dc->next = (qd_deferred_call_t*) head;
+    } while (!sys_atomic_ptr_cas(&conn->deferred_calls, head, dc));
 
-    qd_server_activate(conn);
+    //
+    // A non-empty stack already has a wake on its way to drain it.
+    //
+    if (!head)
+        qd_server_activate(conn);
 }
 
 
@@ -1398,11 +2430,35 @@ qd_listener_t *qd_server_listener(qd_server_t *server)
     sys_atomic_init(&li->ref_count, 1);
     li->server      = server;
     li->http = NULL;
+    li->local = NULL;
+    li->admission_lock = sys_mutex();
+    if (!li->admission_lock) {
+        free_qd_listener_t(li);
+        return 0;
+    }
     return li;
 }
 
 static bool qd_listener_listen_pn(qd_listener_t *li) {
-   li->pn_listener = pn_listener();
+    uint64_t now = qd_timer_now_usec();
+    token_bucket_init(&li->accept_bucket, li->config.accept_rate, now);
+    token_bucket_init(&li->tls_bucket, li->config.ssl_profile ? li->config.tls_accept_rate : 0, now);
+    if (listener_admission_enabled(li) && !li->admission_timer) {
+        li->admission_timer = qd_timer(li->server->qd, listener_admission_cb, li);
+        if (!li->admission_timer) {
+            qd_log(li->server->log_source, QD_LOG_CRITICAL, "No memory listening on %s",
+                   li->config.host_port);
+            return false;
+        }
+    }
+
+    if (li->config.ssl_profile && !li->ssl_domain) {
+        if (listener_ssl_domain(&li->config, &li->ssl_domain) != QD_ERROR_NONE)
+            qd_log(li->server->log_source, QD_LOG_ERROR, "SSL configuration failed on %s: %s",
+                   li->config.host_port, qd_error_message());
+    }
+
+    li->pn_listener = pn_listener();
     if (li->pn_listener) {
         pn_listener_set_context(li->pn_listener, li);
         pn_proactor_listen(li->server->proactor, li->pn_listener, li->config.host_port,
@@ -1429,9 +2485,24 @@ static bool qd_listener_listen_http(qd_listener_t *li) {
 }
 
 
+static bool qd_listener_listen_local(qd_listener_t *li) {
+    if (li->server->local) {
+        /* qd_local_listener holds a reference to li, will decref when closed */
+        qd_local_server_listen(li->server->local, li);
+        return li->local;
+    } else {
+        qd_log(li->server->log_source, QD_LOG_ERROR, "No local transport to listen on %s",
+               li->config.host);
+        return false;
+    }
+}
+
+
 bool qd_listener_listen(qd_listener_t *li) {
-    if (li->pn_listener || li->http) /* Already listening */
+    if (li->pn_listener || li->http || li->local) /* Already listening */
         return true;
+    if (li->config.local)
+        return qd_listener_listen_local(li);
     return li->config.http ? qd_listener_listen_http(li) : qd_listener_listen_pn(li);
 }
 
@@ -1439,6 +2510,11 @@ bool qd_listener_listen(qd_listener_t *li) {
 void qd_listener_decref(qd_listener_t* li)
 {
     if (li && sys_atomic_dec(&li->ref_count) == 1) {
+        if (li->admission_timer)
+            qd_timer_free(li->admission_timer);
+        sys_mutex_free(li->admission_lock);
+        if (li->ssl_domain)
+            pn_ssl_domain_free(li->ssl_domain);
         qd_server_config_free(&li->config);
         free_qd_listener_t(li);
     }
@@ -1459,7 +2535,8 @@ qd_connector_t *qd_server_connector(qd_server_t *server)
     ct->state   = CXTR_STATE_INIT;
     ct->lock = sys_mutex();
     ct->timer = qd_timer(ct->server->qd, try_open_cb, ct);
-    if (!ct->lock || !ct->timer) {
+    ct->race_timer = qd_timer(ct->server->qd, try_race_cb, ct);
+    if (!ct->lock || !ct->timer || !ct->race_timer) {
         qd_connector_decref(ct);
         return 0;
     }
@@ -1487,9 +2564,16 @@ bool qd_connector_decref(qd_connector_t* ct)
         if (ct->ctx) {
             ct->ctx->connector = 0;
         }
+        for (int i = 0; i < ct->racer_count; i++)
+            ct->racers[i]->connector = 0;
+        ct->racer_count = 0;
+        connector_race_clear_lh(ct);
         sys_mutex_unlock(ct->lock);
+        if (ct->ssl_domain)
+            pn_ssl_domain_free(ct->ssl_domain);
         qd_server_config_free(&ct->config);
         qd_timer_free(ct->timer);
+        qd_timer_free(ct->race_timer);
 
         qd_failover_item_t *item = DEQ_HEAD(ct->conn_info_list);
         while (item) {
@@ -1550,6 +2634,432 @@ void qd_connection_handle(qd_connection_t *c, pn_event_t *e) {
     handle(c->server, e, pn_conn, qd_conn);
 }
 
+/* Expose event handling for connections run by a pn_connection_driver_t */
+bool qd_connection_driver_handle(qd_connection_t *c, pn_connection_driver_t *driver) {
+    pn_event_t *e;
+    while ((e = pn_connection_driver_next_event(driver))) {
+        handle(c->server, e, driver->connection, c);
+        /* Free the connection after all other processing is complete */
+        if (pn_event_type(e) == PN_TRANSPORT_CLOSED) {
+            pn_connection_set_context(driver->connection, NULL);
+            qd_connection_free(c);
+            return false;
+        }
+    }
+    qd_conn_event_batch_complete(c->server->container, c, false);
+    return true;
+}
+
 bool qd_connection_strip_annotations_in(const qd_connection_t *c) {
     return c->strip_annotations_in;
 }
+
+
+bool qd_connection_compact_annotations(const qd_connection_t *c) {
+    return c && c->compact_annotations;
+}
+
+
+bool qd_connection_compression(const qd_connection_t *c) {
+    return c && c->compression;
+}
+
+
+void qd_connection_count_compressed(qd_connection_t *c, bool outbound, size_t message_bytes, size_t wire_bytes)
+{
+    uint64_t *counts = outbound ? c->compressed_out : c->compressed_in;
+    counts[0] += message_bytes;
+    counts[1] += wire_bytes;
+}
+
+
+void qd_connection_compression_stats(const qd_connection_t *c, uint64_t in[2], uint64_t out[2])
+{
+    in[0]  = c->compressed_in[0];
+    in[1]  = c->compressed_in[1];
+    out[0] = c->compressed_out[0];
+    out[1] = c->compressed_out[1];
+}
+
+
+//
+// Frame size autotuning.  A frame size is fixed when the connection opens, so a
+// connector with max_frame_size_min set adapts across its connections: each
+// closing connection folds the sizes of the messages it received into the
+// connector's decayed counts, and the next one advertises the smallest power of
+// two that holds QD_FRAME_TUNE_PERCENT of them in one transfer frame.  Until
+// QD_FRAME_TUNE_MIN_SAMPLES messages have been seen max_frame_size is used.
+//
+#define QD_FRAME_TUNE_OVERHEAD     64   // Allowance for the transfer performative
+#define QD_FRAME_TUNE_PERCENT      90
+#define QD_FRAME_TUNE_MIN_SAMPLES  100
+
+
+static int frame_size_bucket(size_t octets)
+{
+    uint64_t frame  = QD_AMQP_MIN_MAX_FRAME_SIZE;
+    int      bucket = 0;
+    while (frame < octets && bucket < QD_FRAME_SIZE_BUCKETS - 1) {
+        frame <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+static void connector_frame_fold_lh(qd_connector_t *ct, const qd_connection_t *c)
+{
+    if (!ct->config.max_frame_size_min)
+        return;
+    for (int i = 0; i < QD_FRAME_SIZE_BUCKETS; i++)
+        ct->frame_sizes[i] = ct->frame_sizes[i] / 2 + c->frame_sizes[i];
+}
+
+
+static uint32_t connector_frame_size_lh(const qd_connector_t *ct)
+{
+    const qd_server_config_t *config = &ct->config;
+    uint64_t total = 0;
+    for (int i = 0; i < QD_FRAME_SIZE_BUCKETS; i++)
+        total += ct->frame_sizes[i];
+    if (total < QD_FRAME_TUNE_MIN_SAMPLES)
+        return config->max_frame_size;
+
+    uint64_t frame   = QD_AMQP_MIN_MAX_FRAME_SIZE;
+    uint64_t covered = 0;
+    for (int i = 0; i < QD_FRAME_SIZE_BUCKETS - 1; i++, frame <<= 1) {
+        covered += ct->frame_sizes[i];
+        if (covered * 100 >= total * QD_FRAME_TUNE_PERCENT)
+            break;
+    }
+
+    if (frame < config->max_frame_size_min)
+        frame = config->max_frame_size_min;
+    if (frame > config->max_frame_size)
+        frame = config->max_frame_size;
+    return (uint32_t) frame;
+}
+
+
+void qd_connection_count_frame_octets(qd_connection_t *c, bool outbound, size_t octets)
+{
+    c->frame_octets[outbound ? 1 : 0] += octets;
+}
+
+
+void qd_connection_frame_sample(qd_connection_t *c, size_t message_octets)
+{
+    if (c->connector && c->connector->config.max_frame_size_min)
+        c->frame_sizes[frame_size_bucket(message_octets + QD_FRAME_TUNE_OVERHEAD)]++;
+}
+
+
+void qd_connection_frame_stats(const qd_connection_t *c, uint32_t *max_frame_size, uint64_t frames[2], uint64_t octets[2])
+{
+    pn_transport_t *tport = c->pn_conn ? pn_connection_transport(c->pn_conn) : 0;
+
+    *max_frame_size = c->max_frame_size;
+    frames[0] = tport ? pn_transport_get_frames_input(tport) : 0;
+    frames[1] = tport ? pn_transport_get_frames_output(tport) : 0;
+    octets[0] = c->frame_octets[0];
+    octets[1] = c->frame_octets[1];
+}
+
+
+//
+// Session window autotuning (see qd_connection_window_outgoing).  A drain-rate
+// sample spans at least QD_SESSION_WINDOW_SAMPLE_USEC; one that spans more than
+// QD_SESSION_WINDOW_IDLE_USEC covered an idle spell and is discarded rather than
+// read as a slow peer.  A round-trip probe the peer has not answered in
+// QD_SESSION_WINDOW_PROBE_USEC (it may have been settled locally) is abandoned.
+//
+#define QD_SESSION_WINDOW_SAMPLE_USEC 100000
+#define QD_SESSION_WINDOW_IDLE_USEC   1000000
+#define QD_SESSION_WINDOW_PROBE_USEC  1000000
+
+
+static bool window_bounds(const qd_connection_t *c, size_t *min, size_t *max)
+{
+    const qd_server_config_t *cf = c ? qd_connection_config(c) : 0;
+    if (!cf || cf->session_window_max == 0)
+        return false;
+
+    *min = cf->session_window_min;
+    *max = cf->session_window_max;
+    if (c->policy_settings && c->policy_settings->maxSessionWindow > 0 &&
+        (size_t) c->policy_settings->maxSessionWindow < *max)
+        *max = (size_t) c->policy_settings->maxSessionWindow > *min ? (size_t) c->policy_settings->maxSessionWindow : *min;
+    return true;
+}
+
+
+static inline size_t window_clamp(uint64_t window, size_t min, size_t max)
+{
+    return window < min ? min : window > max ? max : (size_t) window;
+}
+
+
+static size_t window_outgoing_buffered(qd_connection_t *c)
+{
+    size_t buffered = 0;
+    for (pn_session_t *ssn = pn_session_head(c->pn_conn, 0); ssn; ssn = pn_session_next(ssn, 0))
+        buffered += pn_session_outgoing_bytes(ssn);
+    return buffered;
+}
+
+
+/**
+ * Close the direction's sample if it has run long enough and resize the window from
+ * the new rate.  Returns true if the window changed.
+ */
+static bool window_sample(qd_connection_t *c, qd_session_window_t *w, uint64_t drained, int64_t now,
+                          size_t min, size_t max)
+{
+    int64_t elapsed = now - w->sample_start;
+    if (elapsed < QD_SESSION_WINDOW_SAMPLE_USEC)
+        return false;
+
+    w->sample_start = now;
+    w->moved        = 0;
+    if (elapsed > QD_SESSION_WINDOW_IDLE_USEC)
+        return false;
+
+    int64_t rate = (int64_t) (drained * 1000000 / (uint64_t) elapsed);
+    w->rate = w->rate ? w->rate + (rate - w->rate) / 4 : rate;
+    if (c->window_rtt == 0)
+        return false;
+
+    size_t window = window_clamp(2 * (uint64_t) w->rate * (uint64_t) c->window_rtt / 1000000, min, max);
+    if (window == w->window)
+        return false;
+    w->window = window;
+    return true;
+}
+
+
+size_t qd_connection_window_outgoing(qd_connection_t *c, size_t q3_upper)
+{
+    size_t min, max;
+    if (!window_bounds(c, &min, &max))
+        return q3_upper;
+    if (c->window_out.window == 0)
+        c->window_out.window = window_clamp(q3_upper, min, max);
+    return c->window_out.window;
+}
+
+
+size_t qd_connection_window_incoming(qd_connection_t *c, size_t incoming_capacity)
+{
+    size_t min, max;
+    if (!window_bounds(c, &min, &max))
+        return incoming_capacity;
+    if (c->window_in.window == 0)
+        c->window_in.window = window_clamp(incoming_capacity, min, max);
+    return c->window_in.window;
+}
+
+
+void qd_connection_window_sent(qd_connection_t *c, pn_link_t *pnl, size_t octets, bool send_complete)
+{
+    size_t min, max;
+    if (!window_bounds(c, &min, &max))
+        return;
+
+    int64_t              now = qd_timer_now_usec();
+    qd_session_window_t *w   = &c->window_out;
+
+    if (send_complete && pn_link_snd_settle_mode(pnl) != PN_SND_SETTLED &&
+        (!c->rtt_probe_link || now - c->rtt_probe_sent > QD_SESSION_WINDOW_PROBE_USEC)) {
+        pn_delivery_t *pnd = pn_link_current(pnl);
+        pn_delivery_tag_t tag = pnd ? pn_delivery_tag(pnd) : (pn_delivery_tag_t) {0, 0};
+        if (pnd && !pn_delivery_settled(pnd) && tag.size <= sizeof(c->rtt_probe_tag)) {
+            memcpy(c->rtt_probe_tag, tag.start, tag.size);
+            c->rtt_probe_tag_length = tag.size;
+            c->rtt_probe_link       = pnl;
+            c->rtt_probe_sent       = now;
+        }
+    }
+
+    if (w->sample_start == 0) {
+        w->sample_start = now;
+        w->buffered     = window_outgoing_buffered(c);
+    }
+    w->moved += octets;
+
+    if (now - w->sample_start < QD_SESSION_WINDOW_SAMPLE_USEC)
+        return;
+
+    //
+    // What left the sessions is what they were given less what they hold beyond
+    // what they held when the sample began.
+    //
+    size_t   buffered = window_outgoing_buffered(c);
+    uint64_t offered  = w->moved + w->buffered;
+    uint64_t drained  = offered > buffered ? offered - buffered : 0;
+    w->buffered = buffered;
+    if (window_sample(c, w, drained, now, min, max))
+        qd_log(c->server->log_source, QD_LOG_TRACE,
+               "[C%"PRIu64"] Outgoing session window %zu (drain %"PRId64" octets/s, rtt %"PRId64"us)",
+               c->connection_id, w->window, w->rate, c->window_rtt);
+}
+
+
+void qd_connection_window_received(qd_connection_t *c, size_t octets)
+{
+    size_t min, max;
+    if (!window_bounds(c, &min, &max))
+        return;
+
+    int64_t              now = qd_timer_now_usec();
+    qd_session_window_t *w   = &c->window_in;
+
+    if (w->sample_start == 0)
+        w->sample_start = now;
+    w->moved += octets;
+
+    if (!window_sample(c, w, w->moved, now, min, max))
+        return;
+
+    // Proton advertises the new capacity with the session's next flow
+    for (pn_session_t *ssn = pn_session_head(c->pn_conn, 0); ssn; ssn = pn_session_next(ssn, 0))
+        pn_session_set_incoming_capacity(ssn, w->window);
+    qd_log(c->server->log_source, QD_LOG_TRACE,
+           "[C%"PRIu64"] Incoming session window %zu (drain %"PRId64" octets/s, rtt %"PRId64"us)",
+           c->connection_id, w->window, w->rate, c->window_rtt);
+}
+
+
+void qd_connection_window_updated(qd_connection_t *c, pn_delivery_t *pnd)
+{
+    if (!c || !c->rtt_probe_link || pn_delivery_link(pnd) != c->rtt_probe_link)
+        return;
+
+    //
+    // The link and tag are compared rather than the delivery, which proton may have
+    // freed and reused since the probe began.
+    //
+    pn_delivery_tag_t tag = pn_delivery_tag(pnd);
+    if (tag.size != c->rtt_probe_tag_length || memcmp(tag.start, c->rtt_probe_tag, tag.size) != 0)
+        return;
+
+    int64_t sample = qd_timer_now_usec() - c->rtt_probe_sent;
+    if (sample <= 0)
+        sample = 1;
+    c->window_rtt     = c->window_rtt ? c->window_rtt + (sample - c->window_rtt) / 8 : sample;
+    c->rtt_probe_link = 0;
+}
+
+
+qd_memory_account_t *qd_connection_memory_account(qd_connection_t *conn)
+{
+    if (!conn || !conn->memory_account)
+        return 0;
+    sys_atomic_inc(&conn->memory_account->ref_count);
+    return conn->memory_account;
+}
+
+
+void qd_memory_account_decref(qd_memory_account_t *account)
+{
+    if (account && sys_atomic_dec(&account->ref_count) == 1) {
+        sys_mutex_free(account->lock);
+        sys_atomic_destroy(&account->ref_count);
+        sys_atomic_destroy(&account->bytes);
+        free_qd_memory_account_t(account);
+    }
+}
+
+
+void qd_memory_account_charge(qd_memory_account_t *account, size_t bytes)
+{
+    if (!account)
+        return;
+
+    uint32_t total = sys_atomic_add(&account->bytes, bytes) + bytes;
+    if (account->limit == 0 || total < account->limit || account->blocked)
+        return;
+
+    sys_mutex_lock(account->lock);
+    if (!account->blocked && account->conn) {
+        account->blocked = true;
+        qd_log(account->conn->server->log_source, QD_LOG_INFO,
+               "[C%"PRIu64"] Memory limit of %"PRIu32" bytes reached, withholding credit",
+               account->conn->connection_id, account->limit);
+    }
+    sys_mutex_unlock(account->lock);
+}
+
+
+/**
+ * Issue the credit withheld from a connection's receiving links.
+ */
+static void restore_credit(void *context, bool discard)
+{
+    if (discard)
+        return;
+
+    qd_connection_t *conn = (qd_connection_t*) context;
+
+    //
+    // Whichever limit is still in force issues the credit when it lifts.
+    //
+    if (qd_connection_memory_blocked(conn) || qd_policy_rate_limited(conn))
+        return;
+
+    for (pn_link_t *pn_link = pn_link_head(conn->pn_conn, 0); pn_link; pn_link = pn_link_next(pn_link, 0)) {
+        qd_link_t *link = (qd_link_t*) pn_link_get_context(pn_link);
+        if (link && pn_link_is_receiver(pn_link)) {
+            int credit = qd_link_take_withheld_credit(link);
+            if (credit > 0)
+                pn_link_flow(pn_link, credit);
+        }
+    }
+}
+
+
+static void rate_timer_handler(void *context)
+{
+    qd_connection_t *conn = (qd_connection_t*) context;
+    qd_connection_invoke_deferred(conn, restore_credit, conn);
+}
+
+
+void qd_connection_hold_credit(qd_connection_t *conn, int msec)
+{
+    if (!conn->rate_timer)
+        conn->rate_timer = qd_timer(conn->server->qd, rate_timer_handler, conn);
+    if (conn->rate_timer)
+        qd_timer_schedule(conn->rate_timer, msec > 0 ? msec : 1);
+}
+
+
+void qd_memory_account_release(qd_memory_account_t *account, size_t bytes)
+{
+    if (!account)
+        return;
+
+    uint32_t total = sys_atomic_sub(&account->bytes, bytes) - bytes;
+    if (!account->blocked || total > account->limit - account->limit / 4)
+        return;
+
+    sys_mutex_lock(account->lock);
+    if (account->blocked) {
+        account->blocked = false;
+        if (account->conn)
+            qd_connection_invoke_deferred(account->conn, restore_credit, account->conn);
+    }
+    sys_mutex_unlock(account->lock);
+}
+
+
+void qd_connection_set_memory_limit(qd_connection_t *conn, size_t limit)
+{
+    if (conn->memory_account)
+        conn->memory_account->limit = limit > UINT32_MAX ? UINT32_MAX : (uint32_t) limit;
+}
+
+
+bool qd_connection_memory_blocked(const qd_connection_t *conn)
+{
+    return conn->memory_account && conn->memory_account->blocked;
+}
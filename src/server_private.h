@@ -26,26 +26,50 @@
 #include <qpid/dispatch/alloc.h>
 #include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/log.h>
+#include <proton/connection_driver.h>
 #include <proton/engine.h>
 #include <proton/event.h>
 #include <proton/ssl.h>
 
 #include "dispatch_private.h"
+#include "message_log.h"
 #include "timer_private.h"
 #include "http.h"
+#include "local_transport.h"
 
-#include <netdb.h>              /* For NI_MAXHOST/NI_MAXSERV */
+#include <netdb.h>              /* For NI_MAXSERV */
+#include <net/if.h>             /* For IF_NAMESIZE */
+#include <netinet/in.h>         /* For INET6_ADDRSTRLEN */
+
+/* Remote hosts are only ever numeric: an IPv6 address with an optional %scope */
+#define QD_RHOST_MAX (INET6_ADDRSTRLEN + IF_NAMESIZE)
 
 qd_dispatch_t* qd_server_dispatch(qd_server_t *server);
 void qd_server_timeout(qd_server_t *server, qd_duration_t delay);
 void qd_server_interrupt(qd_server_t *server);
 
+/**
+ * Copy the counters of the server threads that have started.
+ *
+ * @param server The server.
+ * @param stats Receives the counters, in thread index order.
+ * @param max Size of stats.
+ * @return The number of threads copied.
+ */
+int qd_server_thread_stats(qd_server_t *server, qd_server_thread_stats_t *stats, int max);
+
 qd_connection_t *qd_server_connection(qd_server_t *server, qd_server_config_t* config);
 
 qd_connector_t* qd_connection_connector(const qd_connection_t *c);
 
 void qd_connection_handle(qd_connection_t *c, pn_event_t *e);
 
+/**
+ * Handle the pending events of a connection run by a pn_connection_driver_t
+ * rather than the proactor.  Returns false once PN_TRANSPORT_CLOSED has freed c.
+ */
+bool qd_connection_driver_handle(qd_connection_t *c, pn_connection_driver_t *driver);
+
 
 const qd_server_config_t *qd_connector_config(const qd_connector_t *c);
 
@@ -65,13 +89,11 @@ typedef enum {
 
 
 typedef struct qd_deferred_call_t {
-    DEQ_LINKS(struct qd_deferred_call_t);
-    qd_deferred_t  call;
-    void          *context;
+    struct qd_deferred_call_t *next;
+    qd_deferred_t              call;
+    void                      *context;
 } qd_deferred_call_t;
 
-DEQ_DECLARE(qd_deferred_call_t, qd_deferred_call_list_t);
-
 typedef struct qd_pn_free_link_session_t {
     DEQ_LINKS(struct qd_pn_free_link_session_t);
     pn_session_t *pn_session;
@@ -91,6 +113,31 @@ DEQ_DECLARE(qd_pn_free_link_session_t, qd_pn_free_link_session_list_t);
 /**
  * Listener objects represent the desire to accept incoming transport connections.
  */
+/**
+ * TLS session resumption counters.  Shared by an sslProfile and every listener
+ * and connector configured from it, freed when the last of them goes.
+ */
+typedef struct qd_tls_session_stats_t {
+    sys_atomic_t ref_count;
+    sys_atomic_t resumed;   ///< Handshakes that resumed an earlier session
+    sys_atomic_t full;      ///< Handshakes that negotiated a new session
+} qd_tls_session_stats_t;
+
+qd_tls_session_stats_t *qd_tls_session_stats(void);
+void qd_tls_session_stats_incref(qd_tls_session_stats_t *stats);
+void qd_tls_session_stats_decref(qd_tls_session_stats_t *stats);
+
+/**
+ * Token bucket used to pace listener admission.  Tokens are kept in millionths
+ * so a refill can be computed directly from elapsed microseconds; the bucket
+ * holds at most one second's worth of tokens.
+ */
+typedef struct qd_token_bucket_t {
+    int64_t  rate;          ///< Tokens per second, zero for no limit
+    int64_t  micro_tokens;
+    uint64_t last_usec;
+} qd_token_bucket_t;
+
 struct qd_listener_t {
     /* May be referenced by connection_manager and pn_listener_t */
     sys_atomic_t              ref_count;
@@ -98,8 +145,22 @@ struct qd_listener_t {
     qd_server_config_t        config;
     pn_listener_t            *pn_listener;
     qd_http_listener_t       *http;
+    qd_local_listener_t      *local;
     DEQ_LINKS(qd_listener_t);
     bool                      exit_on_error;
+    pn_ssl_domain_t          *ssl_domain;   ///< Shared by all connections so sessions can be resumed
+
+    /* Admission pacing, protected by admission_lock */
+    sys_mutex_t              *admission_lock;
+    qd_timer_t               *admission_timer;
+    qd_token_bucket_t         accept_bucket;
+    qd_token_bucket_t         tls_bucket;
+    int                       pending_accepts;
+    int                       pending_accepts_max;
+    bool                      closed;
+    uint64_t                  connections_admitted;
+    uint64_t                  connections_deferred;
+    uint64_t                  connections_refused;
 };
 
 DEQ_DECLARE(qd_listener_t, qd_listener_list_t);
@@ -108,6 +169,18 @@ DEQ_DECLARE(qd_listener_t, qd_listener_list_t);
 /**
  * Connector objects represent the desire to create and maintain an outgoing transport connection.
  */
+/* The most connection attempts a connector races at once */
+#define QD_CONNECTOR_RACE_MAX 8
+
+/* Frame size autotuning buckets: the first holds messages that fit a 512 octet frame,
+ * each next one those that fit twice the frame of the one before */
+#define QD_FRAME_SIZE_BUCKETS 24
+
+typedef struct qd_connector_race_target_t {
+    char *host_port;    // Numeric address:port to connect to
+    int   conn_index;   // Position of the failover entry it was resolved from, 1-based
+} qd_connector_race_target_t;
+
 struct qd_connector_t {
     /* May be referenced by connection_manager, timer and pn_connection_t */
     sys_atomic_t              ref_count;
@@ -117,6 +190,7 @@ struct qd_connector_t {
     long                      delay;
 
     /* Connector state and ctx can be modified in proactor or management threads. */
+    pn_ssl_domain_t          *ssl_domain;   ///< Created on first connect, protected by lock
     sys_mutex_t              *lock;
     cxtr_state_t              state;
     qd_connection_t          *ctx;
@@ -124,12 +198,40 @@ struct qd_connector_t {
     /* This conn_list contains all the connection information needed to make a connection. It also includes failover connection information */
     qd_failover_item_list_t   conn_info_list;
     int                       conn_index; // Which connection in the connection list to connect to next.
+
+    /* Connect racing (config.connect_race_ms), protected by lock.  Each target is one address of
+     * one failover entry; attempts are started a stagger apart until one of them opens. */
+    qd_timer_t               *race_timer;
+    bool                      race_timer_armed;
+    qd_connector_race_target_t race_targets[QD_CONNECTOR_RACE_MAX];
+    int                       race_target_count;
+    int                       race_next;    // Index of the next target to start
+    qd_connection_t          *racers[QD_CONNECTOR_RACE_MAX];  // Attempts started and not yet decided
+    int                       racer_count;
+
+    /* Frame size autotuning (config.max_frame_size_min), protected by lock.  Decayed counts
+     * of the messages received by earlier connections, by the frame size bucket they fit. */
+    uint64_t                  frame_sizes[QD_FRAME_SIZE_BUCKETS];
     DEQ_LINKS(qd_connector_t);
 };
 
 DEQ_DECLARE(qd_connector_t, qd_connector_list_t);
 
 
+/**
+ * One direction of a connection's autotuned session window (see
+ * qd_connection_window_outgoing).  A sample counts the octets moved over at
+ * least QD_SESSION_WINDOW_SAMPLE_USEC and becomes a drain-rate measurement.
+ */
+typedef struct qd_session_window_t {
+    size_t   window;        ///< Current window in octets, zero until first used
+    int64_t  rate;          ///< Smoothed drain rate, octets per second
+    uint64_t moved;         ///< Octets sent or received in the current sample
+    size_t   buffered;      ///< Outgoing octets held by the sessions when the sample began
+    int64_t  sample_start;  ///< Microseconds, zero when no sample is running
+} qd_session_window_t;
+
+
 /**
  * Connection objects wrap Proton connection objects.
  */
@@ -139,7 +241,10 @@ struct qd_connection_t {
     qd_server_t                     *server;
     bool                            opened; // An open callback was invoked for this connection
     bool                            closed;
+    bool                            racing;   // A connector's attempt that has not yet won or lost
+    int                             race_target;  // Index of the connector race target, if racing
     int                             enqueued;
+    int                             worker;   // Worker the connection is pinned to, -1 if none
     qd_timer_t                      *timer;   // Timer for initial-setup
     pn_connection_t                 *pn_conn;
     pn_session_t                    *pn_sess;
@@ -157,16 +262,33 @@ struct qd_connection_t {
     int                             n_senders;
     int                             n_receivers;
     void                            *open_container;
-    qd_deferred_call_list_t         deferred_calls;
-    sys_mutex_t                     *deferred_call_lock;
+    sys_atomic_ptr_t                deferred_calls;  ///< Lock-free LIFO of qd_deferred_call_t linked through 'next'
     bool                            policy_counted;
+    bool                            admission_refused; // Over the listener's pending accept limit
     char                            *role;  //The specified role of the connection, e.g. "normal", "inter-router", "route-container" etc.
     qd_pn_free_link_session_list_t  free_link_session_list;
     bool                            strip_annotations_in;
     bool                            strip_annotations_out;
+    bool                            compact_annotations;  ///< Both routers offered compact trace and ingress annotations
+    bool                            compression;          ///< Both routers offered the same message compression
+    uint64_t                        compressed_in[2];     ///< {message, wire} bytes received compressed
+    uint64_t                        compressed_out[2];    ///< {message, wire} bytes sent compressed
+    qd_memory_account_t             *memory_account;
+    qd_message_log_sampler_t        log_sampler;
+    qd_session_window_t             window_out;     ///< Feeds the Q3 watermark of the connection's links
+    qd_session_window_t             window_in;      ///< Sets the incoming capacity of its sessions
+    int64_t                         window_rtt;     ///< Smoothed round trip in microseconds, zero until measured
+    pn_link_t                       *rtt_probe_link; ///< Link of the delivery timed for a round trip, or 0
+    int64_t                         rtt_probe_sent;
+    uint8_t                         rtt_probe_tag[32];
+    size_t                          rtt_probe_tag_length;
+    qd_timer_t                      *rate_timer;  // Issues credit withheld by policy rate limits
+    uint32_t                        max_frame_size;        ///< The max-frame-size this end advertised
+    uint64_t                        frame_octets[2];       ///< {in, out} message octets
+    uint64_t                        frame_sizes[QD_FRAME_SIZE_BUCKETS];  ///< Messages received, by frame size bucket
     void (*wake)(qd_connection_t*); /* Wake method, different for HTTP vs. proactor */
-    char rhost[NI_MAXHOST];     /* Remote host numeric IP for incoming connections */
-    char rhost_port[NI_MAXHOST+NI_MAXSERV]; /* Remote host:port for incoming connections */
+    char rhost[QD_RHOST_MAX];   /* Remote host numeric IP for incoming connections */
+    char rhost_port[QD_RHOST_MAX+NI_MAXSERV]; /* Remote host:port for incoming connections */
 };
 
 DEQ_DECLARE(qd_connection_t, qd_connection_list_t);
@@ -176,5 +298,6 @@ ALLOC_DECLARE(qd_deferred_call_t);
 ALLOC_DECLARE(qd_connector_t);
 ALLOC_DECLARE(qd_connection_t);
 ALLOC_DECLARE(qd_pn_free_link_session_t);
+ALLOC_DECLARE(qd_memory_account_t);
 
 #endif
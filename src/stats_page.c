@@ -0,0 +1,140 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "stats_page.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+qd_stats_page_thread_t *qd_stats_page_threads = 0;
+
+static qd_stats_page_header_t *page = 0;
+static char                   *page_path = 0;
+
+// Sections start on cache lines so thread records don't share them
+#define SECTION_ALIGN 64
+
+static uint64_t section_end(uint64_t offset, uint64_t size)
+{
+    uint64_t end = offset + size;
+    return (end + SECTION_ALIGN - 1) & ~((uint64_t) SECTION_ALIGN - 1);
+}
+
+
+qd_error_t qd_stats_page_open(const char *path, int link_slots)
+{
+    qd_stats_page_close();
+    if (link_slots < 0)
+        link_slots = 0;
+
+    uint64_t router_offset = section_end(0, sizeof(qd_stats_page_header_t));
+    uint64_t thread_offset = section_end(router_offset, sizeof(qd_stats_page_router_t));
+    uint64_t alloc_offset  = section_end(thread_offset, QD_STATS_PAGE_THREADS * sizeof(qd_stats_page_thread_t));
+    uint64_t link_offset   = section_end(alloc_offset, QD_STATS_PAGE_ALLOC_TYPES * sizeof(qd_stats_page_alloc_t));
+    uint64_t size          = section_end(link_offset, (uint64_t) link_slots * sizeof(qd_stats_page_link_t));
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return qd_error_errno(errno, "Cannot create stats page %s", path);
+    if (ftruncate(fd, (off_t) size) < 0) {
+        qd_error_errno(errno, "Cannot size stats page %s", path);
+        close(fd);
+        unlink(path);
+        return qd_error_code();
+    }
+    void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        qd_error_errno(errno, "Cannot map stats page %s", path);
+        unlink(path);
+        return qd_error_code();
+    }
+
+    // The file is zero-filled by ftruncate; magic is written last
+    page = (qd_stats_page_header_t*) map;
+    page->version       = QD_STATS_PAGE_VERSION;
+    page->size          = size;
+    page->thread_slots  = QD_STATS_PAGE_THREADS;
+    page->alloc_slots   = QD_STATS_PAGE_ALLOC_TYPES;
+    page->link_slots    = (uint32_t) link_slots;
+    page->router_offset = router_offset;
+    page->thread_offset = thread_offset;
+    page->alloc_offset  = alloc_offset;
+    page->link_offset   = link_offset;
+    page->pid           = (int64_t) getpid();
+    __atomic_store_n(&page->magic, QD_STATS_PAGE_MAGIC, __ATOMIC_RELEASE);
+
+    page_path = strdup(path);
+    qd_stats_page_threads = (qd_stats_page_thread_t*) ((char*) page + thread_offset);
+    return QD_ERROR_NONE;
+}
+
+
+void qd_stats_page_close(void)
+{
+    if (!page)
+        return;
+    qd_stats_page_threads = 0;
+    munmap(page, page->size);
+    page = 0;
+    unlink(page_path);
+    free(page_path);
+    page_path = 0;
+}
+
+
+qd_stats_page_header_t *qd_stats_page(void)
+{
+    return page;
+}
+
+
+qd_stats_page_router_t *qd_stats_page_router(qd_stats_page_header_t *page)
+{
+    return (qd_stats_page_router_t*) ((char*) page + page->router_offset);
+}
+
+
+qd_stats_page_alloc_t *qd_stats_page_allocs(qd_stats_page_header_t *page)
+{
+    return (qd_stats_page_alloc_t*) ((char*) page + page->alloc_offset);
+}
+
+
+qd_stats_page_link_t *qd_stats_page_links(qd_stats_page_header_t *page)
+{
+    return (qd_stats_page_link_t*) ((char*) page + page->link_offset);
+}
+
+
+void qd_stats_page_begin_update(qd_stats_page_header_t *page)
+{
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+void qd_stats_page_end_update(qd_stats_page_header_t *page)
+{
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,162 @@
+#ifndef __stats_page_h__
+#define __stats_page_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Shared-memory statistics page.
+ *
+ * When the router's statsPagePath is set, the router maps a file of fixed
+ * layout at that path so that external tools can sample counters by reading
+ * memory instead of sending management requests.  All fields are native-endian
+ * and every section is an array of fixed-size records at the offset given in
+ * the header; a reader must check magic and version and use the header's sizes
+ * rather than compile-time ones.
+ *
+ * Worker threads add their own counts to their thread record with relaxed
+ * atomic stores.  The router, allocator and link sections are rewritten every
+ * statsPageMillis by the core thread; sequence is odd while it writes, so a
+ * reader that sees the same even sequence before and after copying them has a
+ * consistent snapshot.
+ */
+
+#define QD_STATS_PAGE_MAGIC       0x47505351    ///< "QSPG"
+#define QD_STATS_PAGE_VERSION     1
+#define QD_STATS_PAGE_THREADS     64
+#define QD_STATS_PAGE_ALLOC_TYPES 128
+#define QD_STATS_PAGE_NAME        48
+
+typedef struct qd_stats_page_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;              ///< Bytes in the page
+    uint32_t thread_slots;      ///< Records in each section
+    uint32_t alloc_slots;
+    uint32_t link_slots;
+    uint32_t reserved;
+    uint64_t router_offset;     ///< Byte offsets of the sections from the start of the page
+    uint64_t thread_offset;
+    uint64_t alloc_offset;
+    uint64_t link_offset;
+    uint64_t sequence;          ///< Odd while the core thread rewrites its sections
+    uint64_t update_msec;       ///< qd_timer_now_usec milliseconds of the last rewrite
+    uint32_t alloc_count;       ///< Records in use in the allocator section
+    uint32_t link_count;        ///< Records in use in the link section, open_links order
+    int64_t  pid;
+} qd_stats_page_header_t;
+
+/** Router-wide counters, written by the core thread */
+typedef struct qd_stats_page_router_t {
+    uint64_t connections;
+    uint64_t links;
+    uint64_t addresses;
+    uint64_t deliveries_ingress;
+    uint64_t deliveries_egress;
+    uint64_t deliveries_transit;
+    uint64_t deliveries_ingress_route_container;
+    uint64_t deliveries_egress_route_container;
+    uint64_t presettled_deliveries;
+    uint64_t dropped_presettled_deliveries;
+    uint64_t accepted_deliveries;
+    uint64_t rejected_deliveries;
+    uint64_t released_deliveries;
+    uint64_t modified_deliveries;
+    uint64_t action_queue_depth;    ///< Actions taken off the action stack, not yet run
+    uint64_t action_park_count;     ///< Times the core thread has waited for work
+} qd_stats_page_router_t;
+
+/** Per worker thread, written only by that thread */
+typedef struct qd_stats_page_thread_t {
+    uint64_t batches;           ///< Proactor event batches handled
+    uint64_t events;            ///< Proactor events handled
+} qd_stats_page_thread_t;
+
+/** Per allocator type, written by the core thread */
+typedef struct qd_stats_page_alloc_t {
+    char     type_name[QD_STATS_PAGE_NAME];   ///< Null-terminated, truncated
+    uint64_t type_size;
+    uint64_t in_use_bytes;
+    uint64_t cached_bytes;
+    uint64_t local_hits;
+    uint64_t local_misses;
+} qd_stats_page_alloc_t;
+
+/** Per open link, written by the core thread */
+typedef struct qd_stats_page_link_t {
+    uint64_t identity;          ///< router.link identity
+    uint64_t connection;        ///< router.connection identity
+    uint32_t direction;         ///< 0 incoming, 1 outgoing
+    uint32_t undelivered;
+    uint32_t unsettled;
+    uint32_t pad;
+    uint64_t deliveries;
+    uint64_t presettled;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t released;
+    uint64_t modified;
+} qd_stats_page_link_t;
+
+/**
+ * Create and map the page at path, replacing any file there.  Sets qd_error
+ * on failure.
+ */
+qd_error_t qd_stats_page_open(const char *path, int link_slots);
+
+/** Unmap the page and remove its file. */
+void qd_stats_page_close(void);
+
+/** The mapped page, 0 if there is none. */
+qd_stats_page_header_t *qd_stats_page(void);
+
+qd_stats_page_router_t *qd_stats_page_router(qd_stats_page_header_t *page);
+qd_stats_page_alloc_t  *qd_stats_page_allocs(qd_stats_page_header_t *page);
+qd_stats_page_link_t   *qd_stats_page_links(qd_stats_page_header_t *page);
+
+/** Start and end a rewrite of the core thread's sections. */
+void qd_stats_page_begin_update(qd_stats_page_header_t *page);
+void qd_stats_page_end_update(qd_stats_page_header_t *page);
+
+/**
+ * Fill the allocator section, returns the number of records written.
+ * Implemented in alloc_pool.c.
+ */
+int qd_alloc_write_stats_page(qd_stats_page_alloc_t *records, int capacity);
+
+/**@internal*/
+extern qd_stats_page_thread_t *qd_stats_page_threads;
+
+/**
+ * Count a batch of events handled by worker thread index.  Only that thread
+ * calls it for the index; nothing is done when there is no page.
+ */
+static inline void qd_stats_page_thread_batch(int index, uint64_t events)
+{
+    qd_stats_page_thread_t *threads = qd_stats_page_threads;
+    if (threads && index >= 0 && index < QD_STATS_PAGE_THREADS) {
+        qd_stats_page_thread_t *t = &threads[index];
+        __atomic_store_n(&t->batches, t->batches + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&t->events, t->events + events, __ATOMIC_RELAXED);
+    }
+}
+
+#endif
@@ -28,13 +28,10 @@
 #include <stdio.h>
 #include <time.h>
 
-static sys_mutex_t     *lock = NULL;
-static qd_timer_list_t  idle_timers = {0};
-static qd_timer_list_t  scheduled_timers = {0};
-/* Timers have relative delta_time measured from the previous timer.
- * The delta_time of the first timer on the queue is measured from timer_base.
- */
-static qd_timestamp_t   time_base = 0;
+static sys_mutex_t      *lock = NULL;
+static qd_timer_wheel_t  wheel;
+/* The deadline the server timeout was last set for, 0 if none */
+static qd_timestamp_t    armed_deadline = 0;
 
 ALLOC_DECLARE(qd_timer_t);
 ALLOC_DEFINE(qd_timer_t);
@@ -48,34 +45,21 @@ sys_mutex_t* qd_timer_lock() { return lock; }
 
 static void timer_cancel_LH(qd_timer_t *timer)
 {
-    if (timer->scheduled) {
-        if (timer->next)
-            timer->next->delta_time += timer->delta_time;
-        DEQ_REMOVE(scheduled_timers, timer);
-        DEQ_INSERT_TAIL(idle_timers, timer);
-        timer->scheduled = false;
-    }
+    qd_timer_wheel_remove(&wheel, &timer->entry);
     qd_immediate_disarm(timer->immediate);
 }
 
-/* Adjust timer's time_base and delays for the current time. */
-static void timer_adjust_now_LH()
+/* Point the server timeout at the earliest scheduled timer. */
+static void timer_arm_next_LH(void)
 {
-    qd_timestamp_t now = qd_timer_now();
-    if (time_base != 0 && now > time_base) {
-        qd_duration_t delta = now - time_base;
-        /* Adjust timer delays by removing duration delta, starting from timer. */
-        for (qd_timer_t *timer = DEQ_HEAD(scheduled_timers); delta > 0 && timer; timer = DEQ_NEXT(timer)) {
-            if (timer->delta_time >= delta) {
-                timer->delta_time -= delta;
-                delta = 0;
-            } else {
-                delta -= timer->delta_time;
-                timer->delta_time = 0; /* Ready to fire */
-            }
-        }
+    qd_wheel_entry_t *first = qd_timer_wheel_next(&wheel);
+    if (first) {
+        qd_timer_t *timer = (qd_timer_t*) first->owner;
+        armed_deadline = first->deadline > wheel.now ? first->deadline : wheel.now;
+        qd_server_timeout(timer->server, armed_deadline - wheel.now);
+    } else {
+        armed_deadline = 0;
     }
-    time_base = now;
 }
 
 
@@ -90,17 +74,13 @@ qd_timer_t *qd_timer(qd_dispatch_t *qd, qd_timer_cb_t cb, void* context)
     if (!timer)
         return 0;
 
-    DEQ_ITEM_INIT(timer);
-
-    timer->server     = qd ? qd->server : 0;
-    timer->handler    = cb;
-    timer->context    = context;
-    timer->delta_time = 0;
-    timer->scheduled  = false;
-    timer->immediate  = qd_immediate(qd, cb, context);
-    sys_mutex_lock(lock);
-    DEQ_INSERT_TAIL(idle_timers, timer);
-    sys_mutex_unlock(lock);
+    ZERO(timer);
+    DEQ_ITEM_INIT(&timer->entry);
+    timer->entry.owner = timer;
+    timer->server      = qd ? qd->server : 0;
+    timer->handler     = cb;
+    timer->context     = context;
+    timer->immediate   = qd_immediate(qd, cb, context);
 
     return timer;
 }
@@ -111,7 +91,6 @@ void qd_timer_free(qd_timer_t *timer)
     if (!timer) return;
     sys_mutex_lock(lock);
     timer_cancel_LH(timer);
-    DEQ_REMOVE(idle_timers, timer);
     qd_immediate_free(timer->immediate);
     sys_mutex_unlock(lock);
     free_qd_timer_t(timer);
@@ -125,6 +104,14 @@ qd_timestamp_t qd_timer_now() {
 }
 
 
+int64_t qd_timer_now_usec(void)
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+
 void qd_timer_schedule(qd_timer_t *timer, qd_duration_t duration)
 {
     sys_mutex_lock(lock);
@@ -133,38 +120,26 @@ void qd_timer_schedule(qd_timer_t *timer, qd_duration_t duration)
         sys_mutex_unlock(lock);
         return;
     }
-    timer_cancel_LH(timer);  // Timer is now on the idle list
-    DEQ_REMOVE(idle_timers, timer);
+    qd_immediate_disarm(timer->immediate);
+
+    /* The wheel never moves back, so a clock stepping back delays timers
+     * rather than reordering them. */
+    qd_timestamp_t now = qd_timer_now();
+    if (wheel.count == 0)
+        qd_timer_wheel_advance(&wheel, now);   // Nothing to expire, just catch up
+    if (now < wheel.now)
+        now = wheel.now;
+    if (duration > QD_WHEEL_SPAN)
+        duration = QD_WHEEL_SPAN;
+    qd_timer_wheel_insert(&wheel, &timer->entry, now + duration);
 
     //
-    // Find the insert point in the schedule.
+    // Only a new earliest expiry needs the server timeout moved.
     //
-    timer_adjust_now_LH();   /* Adjust the timers for current time */
-
-    /* Invariant: time_before == total time up to but not including ptr */
-    qd_timer_t *ptr = DEQ_HEAD(scheduled_timers);
-    qd_duration_t time_before = 0;
-    while (ptr && time_before + ptr->delta_time < duration) {
-        time_before += ptr->delta_time;
-        ptr = ptr->next;
+    if (armed_deadline == 0 || timer->entry.deadline < armed_deadline) {
+        armed_deadline = timer->entry.deadline;
+        qd_server_timeout(timer->server, timer->entry.deadline - now);
     }
-    /* ptr is the first timer to exceed duration or NULL if we ran out */
-    if (!ptr) {
-        timer->delta_time = duration - time_before;
-        DEQ_INSERT_TAIL(scheduled_timers, timer);
-    } else {
-        timer->delta_time = duration - time_before;
-        ptr->delta_time -= timer->delta_time;
-        ptr = ptr->prev;
-        if (ptr)
-            DEQ_INSERT_AFTER(scheduled_timers, timer, ptr);
-        else
-            DEQ_INSERT_HEAD(scheduled_timers, timer);
-    }
-    timer->scheduled = true;
-
-    qd_timer_t *first = DEQ_HEAD(scheduled_timers);
-    qd_server_timeout(first->server, first->delta_time);
     sys_mutex_unlock(lock);
 }
 
@@ -186,9 +161,8 @@ void qd_timer_initialize()
 {
     qd_immediate_initialize();
     lock = sys_mutex();
-    DEQ_INIT(idle_timers);
-    DEQ_INIT(scheduled_timers);
-    time_base = 0;
+    qd_timer_wheel_init(&wheel, 0);
+    armed_deadline = 0;
 }
 
 
@@ -204,20 +178,17 @@ void qd_timer_finalize(void)
 void qd_timer_visit()
 {
     sys_mutex_lock(lock);
-    timer_adjust_now_LH();
-    qd_timer_t *timer = DEQ_HEAD(scheduled_timers);
-    while (timer && timer->delta_time == 0) {
-        timer_cancel_LH(timer); /* Removes timer from scheduled_timers */
-        qd_immediate_disarm(timer->immediate);
+    qd_timer_wheel_advance(&wheel, qd_timer_now());
+    qd_wheel_entry_t *entry = qd_timer_wheel_expired(&wheel);
+    while (entry) {
+        qd_timer_t *timer = (qd_timer_t*) entry->owner;
+        timer_cancel_LH(timer); /* Removes timer from the expired list */
         sys_mutex_unlock(lock);
         timer->handler(timer->context); /* Call the handler outside the lock, may re-schedule */
         sys_mutex_lock(lock);
-        timer = DEQ_HEAD(scheduled_timers);
-    }
-    qd_timer_t *first = DEQ_HEAD(scheduled_timers);
-    if (first) {
-        qd_server_timeout(first->server, first->delta_time);
+        entry = qd_timer_wheel_expired(&wheel);
     }
+    timer_arm_next_LH();
     sys_mutex_unlock(lock);
     qd_immediate_visit();
 }
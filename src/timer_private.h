@@ -20,22 +20,19 @@
  */
 
 #include "immediate_private.h"
+#include "timer_wheel_private.h"
 #include <qpid/dispatch/ctools.h>
 #include <qpid/dispatch/timer.h>
 #include <qpid/dispatch/threading.h>
 
 struct qd_timer_t {
-    DEQ_LINKS(qd_timer_t);
+    qd_wheel_entry_t  entry;     /* Position on the timer wheel */
     qd_server_t      *server;
     qd_timer_cb_t     handler;
     void             *context;
-    qd_timestamp_t    delta_time;
     qd_immediate_t   *immediate; /* Optimized path for schedule(0) */
-    bool              scheduled; /* true means on scheduled list, false on idle list */
 };
 
-DEQ_DECLARE(qd_timer_t, qd_timer_list_t);
-
 void qd_timer_initialize(void);
 void qd_timer_finalize(void);
 void qd_timer_visit();
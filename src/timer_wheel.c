@@ -0,0 +1,179 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "timer_wheel_private.h"
+
+static inline int wheel_level(int64_t deadline, int64_t now)
+{
+    return (63 - __builtin_clzll((uint64_t) (deadline ^ now))) / QD_WHEEL_BITS;
+}
+
+
+static void wheel_expire(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry)
+{
+    entry->level = -1;
+    DEQ_INSERT_TAIL(wheel->expired, entry);
+}
+
+
+static void wheel_place(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry)
+{
+    if (entry->deadline <= wheel->now) {
+        wheel_expire(wheel, entry);
+        return;
+    }
+
+    int level = wheel_level(entry->deadline, wheel->now);
+    if (level >= QD_WHEEL_LEVELS) {
+        // Beyond the span of the wheel, clamp to its last tick
+        entry->deadline = wheel->now | QD_WHEEL_SPAN;
+        if (entry->deadline == wheel->now) {
+            wheel_expire(wheel, entry);
+            return;
+        }
+        level = wheel_level(entry->deadline, wheel->now);
+    }
+
+    int slot = (int) (entry->deadline >> (level * QD_WHEEL_BITS)) & (QD_WHEEL_SLOTS - 1);
+    entry->level = (int8_t) level;
+    entry->slot  = (uint8_t) slot;
+    DEQ_INSERT_TAIL(wheel->slots[level][slot], entry);
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+
+static void wheel_expire_slot(qd_timer_wheel_t *wheel, int level, int slot)
+{
+    qd_wheel_entry_list_t *list  = &wheel->slots[level][slot];
+    qd_wheel_entry_t      *entry = DEQ_HEAD(*list);
+    while (entry) {
+        DEQ_REMOVE_HEAD(*list);
+        wheel_expire(wheel, entry);
+        entry = DEQ_HEAD(*list);
+    }
+    wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+}
+
+
+void qd_timer_wheel_init(qd_timer_wheel_t *wheel, int64_t now)
+{
+    for (int level = 0; level < QD_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < QD_WHEEL_SLOTS; slot++)
+            DEQ_INIT(wheel->slots[level][slot]);
+        wheel->occupied[level] = 0;
+    }
+    DEQ_INIT(wheel->expired);
+    wheel->count = 0;
+    wheel->now   = now;
+}
+
+
+void qd_timer_wheel_insert(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry, int64_t deadline)
+{
+    qd_timer_wheel_remove(wheel, entry);
+    entry->deadline  = deadline;
+    entry->scheduled = true;
+    wheel->count++;
+    wheel_place(wheel, entry);
+}
+
+
+void qd_timer_wheel_remove(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry)
+{
+    if (!entry->scheduled)
+        return;
+
+    if (entry->level < 0) {
+        DEQ_REMOVE(wheel->expired, entry);
+    } else {
+        qd_wheel_entry_list_t *list = &wheel->slots[entry->level][entry->slot];
+        DEQ_REMOVE(*list, entry);
+        if (DEQ_IS_EMPTY(*list))
+            wheel->occupied[entry->level] &= ~((uint64_t) 1 << entry->slot);
+    }
+    wheel->count--;
+    entry->scheduled = false;
+}
+
+
+void qd_timer_wheel_advance(qd_timer_wheel_t *wheel, int64_t now)
+{
+    if (now <= wheel->now)
+        return;
+
+    int64_t old = wheel->now;
+    wheel->now = now;
+    if (wheel->count == DEQ_SIZE(wheel->expired))
+        return;  // Nothing on the wheel
+
+    int top = wheel_level(now, old);
+
+    //
+    // Lower levels hold deadlines before the block now has moved into
+    //
+    for (int level = 0; level < top && level < QD_WHEEL_LEVELS; level++) {
+        while (wheel->occupied[level])
+            wheel_expire_slot(wheel, level, __builtin_ctzll(wheel->occupied[level]));
+    }
+    if (top >= QD_WHEEL_LEVELS)
+        return;
+
+    //
+    // At the top changed level, the slots passed over are due and the slot now
+    // falls in is redistributed below.
+    //
+    int old_slot = (int) (old >> (top * QD_WHEEL_BITS)) & (QD_WHEEL_SLOTS - 1);
+    int new_slot = (int) (now >> (top * QD_WHEEL_BITS)) & (QD_WHEEL_SLOTS - 1);
+    for (int slot = old_slot + 1; slot < new_slot; slot++) {
+        if (wheel->occupied[top] & ((uint64_t) 1 << slot))
+            wheel_expire_slot(wheel, top, slot);
+    }
+
+    qd_wheel_entry_list_t cascade;
+    DEQ_MOVE(wheel->slots[top][new_slot], cascade);
+    wheel->occupied[top] &= ~((uint64_t) 1 << new_slot);
+    qd_wheel_entry_t *entry = DEQ_HEAD(cascade);
+    while (entry) {
+        DEQ_REMOVE_HEAD(cascade);
+        wheel_place(wheel, entry);
+        entry = DEQ_HEAD(cascade);
+    }
+}
+
+
+qd_wheel_entry_t *qd_timer_wheel_next(qd_timer_wheel_t *wheel)
+{
+    if (!DEQ_IS_EMPTY(wheel->expired))
+        return DEQ_HEAD(wheel->expired);
+
+    for (int level = 0; level < QD_WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level]) {
+            qd_wheel_entry_t *entry = DEQ_HEAD(wheel->slots[level][__builtin_ctzll(wheel->occupied[level])]);
+            qd_wheel_entry_t *first = entry;
+            if (level > 0) {
+                // The slot spans several ticks
+                for (entry = DEQ_NEXT(entry); entry; entry = DEQ_NEXT(entry))
+                    if (entry->deadline < first->deadline)
+                        first = entry;
+            }
+            return first;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef __timer_wheel_private_h__
+#define __timer_wheel_private_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <qpid/dispatch/ctools.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hierarchical timing wheel of millisecond ticks, shared by the server timers
+ * and the core thread timers.  It does no locking; the owner serializes access.
+ *
+ * An entry is placed by the most significant QD_WHEEL_BITS-bit digit in which
+ * its deadline differs from the wheel's time; the slot is that digit of the
+ * deadline.  Every entry of a level therefore expires before every entry of
+ * the levels above it, and within a level the slots are in expiry order, so
+ * insert and remove are O(1) and the next expiry is found from the occupancy
+ * bitmaps.  When time advances, the slots that have passed are moved to the
+ * expired list and the slot time has moved into is redistributed to the lower
+ * levels.
+ */
+
+#define QD_WHEEL_BITS   6
+#define QD_WHEEL_SLOTS  (1 << QD_WHEEL_BITS)
+#define QD_WHEEL_LEVELS 8
+#define QD_WHEEL_SPAN   (((int64_t) 1 << (QD_WHEEL_BITS * QD_WHEEL_LEVELS)) - 1)  ///< Longest delay, in ticks
+
+typedef struct qd_wheel_entry_t qd_wheel_entry_t;
+
+/** Embedded in the timer object.  Only owner is set by the user. */
+struct qd_wheel_entry_t {
+    DEQ_LINKS(qd_wheel_entry_t);
+    void     *owner;      ///< The timer object containing the entry
+    int64_t   deadline;   ///< Absolute expiry tick while scheduled
+    int8_t    level;      ///< Level holding the entry, -1 for the expired list
+    uint8_t   slot;
+    bool      scheduled;
+};
+
+DEQ_DECLARE(qd_wheel_entry_t, qd_wheel_entry_list_t);
+
+typedef struct qd_timer_wheel_t {
+    qd_wheel_entry_list_t slots[QD_WHEEL_LEVELS][QD_WHEEL_SLOTS];
+    uint64_t              occupied[QD_WHEEL_LEVELS];  ///< Bit per non-empty slot
+    qd_wheel_entry_list_t expired;                    ///< Due, waiting to be fired
+    size_t                count;                      ///< Entries on the wheel and the expired list
+    int64_t               now;                        ///< Every deadline on the wheel is later
+} qd_timer_wheel_t;
+
+/**
+ * Initialize an empty wheel.  A zero-filled wheel is also valid and starts at
+ * tick zero.
+ */
+void qd_timer_wheel_init(qd_timer_wheel_t *wheel, int64_t now);
+
+/**
+ * Schedule an entry to expire at deadline, removing it first if it is
+ * scheduled.  Deadlines not after the wheel's time go straight to the expired
+ * list; deadlines beyond the span of the wheel are clamped to it.
+ */
+void qd_timer_wheel_insert(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry, int64_t deadline);
+
+/** Unschedule an entry; no effect if it is not scheduled. */
+void qd_timer_wheel_remove(qd_timer_wheel_t *wheel, qd_wheel_entry_t *entry);
+
+/**
+ * Move the wheel's time forward to now, moving the entries that are due to the
+ * expired list.  Time never moves back.
+ */
+void qd_timer_wheel_advance(qd_timer_wheel_t *wheel, int64_t now);
+
+/** The first expired entry, 0 if none.  It stays scheduled until removed. */
+static inline qd_wheel_entry_t *qd_timer_wheel_expired(qd_timer_wheel_t *wheel)
+{
+    return DEQ_HEAD(wheel->expired);
+}
+
+/** The entry with the earliest deadline, 0 if nothing is scheduled. */
+qd_wheel_entry_t *qd_timer_wheel_next(qd_timer_wheel_t *wheel);
+
+#endif
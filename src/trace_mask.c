@@ -22,11 +22,15 @@
 #include <qpid/dispatch/threading.h>
 #include <qpid/dispatch/hash.h>
 #include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/amqp.h>
+#include <string.h>
 
 typedef struct {
     qd_hash_handle_t *hash_handle;
     int               maskbit;
     int               link_maskbit;
+    uint64_t          id_hash;  ///< Compact trace identifier (see qd_tracemask_id_hash)
+    char             *id;       ///< The router's ID as it appears in a string trace list
 } qdtm_router_t;
 
 ALLOC_DECLARE(qdtm_router_t);
@@ -66,15 +70,54 @@ void qd_tracemask_free(qd_tracemask_t *tm)
 }
 
 
+uint64_t qd_tracemask_id_hash(qd_iterator_t *iter)
+{
+    //
+    // FNV-1a over the octets of the iterator's view.  A router's address in the
+    // hash view and its ID in the node-hash view yield the same octets, so every
+    // router computes the same value for a given router.
+    //
+    uint64_t hash = 14695981039346656037ULL;
+
+    qd_iterator_reset(iter);
+    while (!qd_iterator_end(iter)) {
+        hash ^= qd_iterator_octet(iter);
+        hash *= 1099511628211ULL;
+    }
+    qd_iterator_reset(iter);
+    return hash;
+}
+
+
+//
+// Extract the router's ID ("area/router") from its topology address
+// ("amqp:/_topo/area/router/qdrouter").
+//
+static char *router_id_from_address(const char *address)
+{
+    const char *topo = strstr(address, "_topo/");
+    const char *id   = topo ? topo + strlen("_topo/") : address;
+    size_t      len  = strlen(id);
+    const char *tail = "/qdrouter";
+
+    if (len > strlen(tail) && strcmp(id + len - strlen(tail), tail) == 0)
+        len -= strlen(tail);
+    return strndup(id, len);
+}
+
+
 void qd_tracemask_add_router(qd_tracemask_t *tm, const char *address, int maskbit)
 {
-    qd_iterator_t *iter = qd_iterator_string(address, ITER_VIEW_ADDRESS_HASH);
+    qd_iterator_t *iter    = qd_iterator_string(address, ITER_VIEW_ADDRESS_HASH);
+    uint64_t       id_hash = qd_tracemask_id_hash(iter);
     sys_rwlock_wrlock(tm->lock);
     assert(maskbit < qd_bitmask_width() && tm->router_by_mask_bit[maskbit] == 0);
     if (maskbit < qd_bitmask_width() && tm->router_by_mask_bit[maskbit] == 0) {
         qdtm_router_t *router = new_qdtm_router_t();
         router->maskbit = maskbit;
         router->link_maskbit = -1;
+        router->id_hash = id_hash;
+        router->id = router_id_from_address(address);
         qd_hash_insert(tm->hash, iter, router, &router->hash_handle);
         tm->router_by_mask_bit[maskbit] = router;
     }
@@ -92,6 +135,7 @@ void qd_tracemask_del_router(qd_tracemask_t *tm, int maskbit)
         qd_hash_remove_by_handle(tm->hash, router->hash_handle);
         qd_hash_handle_free(router->hash_handle);
         tm->router_by_mask_bit[maskbit] = 0;
+        free(router->id);
         free_qdtm_router_t(router);
     }
     sys_rwlock_unlock(tm->lock);
@@ -124,6 +168,53 @@ void qd_tracemask_remove_link(qd_tracemask_t *tm, int router_maskbit)
 }
 
 
+//
+// Find a router by its compact trace identifier.  The table holds at most one
+// router per mask bit, so it is scanned directly.  Call with the lock held.
+//
+static qdtm_router_t *router_by_id_hash_LH(qd_tracemask_t *tm, uint64_t id_hash)
+{
+    for (int i = 0; i < qd_bitmask_width(); i++) {
+        qdtm_router_t *router = tm->router_by_mask_bit[i];
+        if (router && router->id_hash == id_hash)
+            return router;
+    }
+    return 0;
+}
+
+
+static bool is_compact_item(qd_parsed_field_t *item)
+{
+    uint8_t tag = qd_parse_tag(item);
+    return tag == QD_AMQP_ULONG || tag == QD_AMQP_SMALLULONG || tag == QD_AMQP_ULONG0;
+}
+
+
+int qd_tracemask_resolve_id(qd_tracemask_t *tm, qd_parsed_field_t *item, qd_composed_field_t *field)
+{
+    int maskbit = -1;
+
+    if (!is_compact_item(item)) {
+        if (field) {
+            qd_iterator_t *iter = qd_parse_raw(item);
+            qd_iterator_reset_view(iter, ITER_VIEW_ALL);
+            qd_compose_insert_string_iterator(field, iter);
+        }
+        return maskbit;
+    }
+
+    sys_rwlock_rdlock(tm->lock);
+    qdtm_router_t *router = router_by_id_hash_LH(tm, qd_parse_as_ulong(item));
+    if (router) {
+        maskbit = router->maskbit;
+        if (field)
+            qd_compose_insert_string(field, router->id);
+    }
+    sys_rwlock_unlock(tm->lock);
+    return maskbit;
+}
+
+
 qd_bitmask_t *qd_tracemask_create(qd_tracemask_t *tm, qd_parsed_field_t *tracelist, int *ingress_index)
 {
     qd_bitmask_t *bm    = qd_bitmask(0);
@@ -136,9 +227,14 @@ qd_bitmask_t *qd_tracemask_create(qd_tracemask_t *tm, qd_parsed_field_t *traceli
     qd_parsed_field_t *item   = qd_parse_sub_value(tracelist, idx);
     qdtm_router_t     *router = 0;
     while (item) {
-        qd_iterator_t *iter = qd_parse_raw(item);
-        qd_iterator_reset_view(iter, ITER_VIEW_NODE_HASH);
-        qd_hash_retrieve(tm->hash, iter, (void*) &router);
+        router = 0;
+        if (is_compact_item(item))
+            router = router_by_id_hash_LH(tm, qd_parse_as_ulong(item));
+        else {
+            qd_iterator_t *iter = qd_parse_raw(item);
+            qd_iterator_reset_view(iter, ITER_VIEW_NODE_HASH);
+            qd_hash_retrieve(tm->hash, iter, (void*) &router);
+        }
         if (router) {
             if (router->link_maskbit >= 0)
                 qd_bitmask_set_bit(bm, router->link_maskbit);
@@ -0,0 +1,219 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "python_private.h"   // must be first!
+
+#include "trace_ring.h"
+#include <qpid/dispatch/atomic.h>
+#include <qpid/dispatch/ctools.h>
+#include <qpid/dispatch/threading.h>
+#include <qpid/dispatch/timer.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One recorded event, 40 bytes
+typedef struct qd_trace_event_t {
+    uint64_t timestamp;     // qd_timer_now_usec microseconds
+    uint64_t message;
+    uint64_t delivery;
+    uint64_t conn_id;
+    uint32_t link_id;
+    uint8_t  type;
+    uint8_t  pad[3];
+} qd_trace_event_t;
+
+typedef struct qd_trace_ring_t qd_trace_ring_t;
+
+struct qd_trace_ring_t {
+    DEQ_LINKS(qd_trace_ring_t);
+    long              thread_id;
+    uint32_t          mask;         // size - 1, size is a power of two
+    sys_atomic_t      head;         // count of events written, wraps
+    qd_trace_event_t  events[];
+};
+
+DEQ_DECLARE(qd_trace_ring_t, qd_trace_ring_list_t);
+
+bool qd_trace_ring_active = false;
+
+static sys_mutex_t           *ring_lock = 0;     // protects rings, not their contents
+static qd_trace_ring_list_t   rings = {0};
+static uint32_t               ring_size = 0;
+static __thread qd_trace_ring_t *thread_ring = 0;
+
+static const char *event_names[] = {"", "receive", "forward", "send", "settle"};
+
+
+void qd_trace_ring_initialize(void)
+{
+    DEQ_INIT(rings);
+    ring_lock = sys_mutex();
+}
+
+
+void qd_trace_ring_finalize(void)
+{
+    qd_trace_ring_active = false;
+    qd_trace_ring_t *ring = DEQ_HEAD(rings);
+    while (ring) {
+        DEQ_REMOVE_HEAD(rings);
+        sys_atomic_destroy(&ring->head);
+        free(ring);
+        ring = DEQ_HEAD(rings);
+    }
+    sys_mutex_free(ring_lock);
+    ring_lock = 0;
+}
+
+
+void qd_trace_ring_configure(int events_per_thread)
+{
+    uint32_t size = 0;
+    if (events_per_thread > 0) {
+        size = 1;
+        while (size < (uint32_t) events_per_thread && size < 0x40000000)
+            size <<= 1;
+    }
+    sys_mutex_lock(ring_lock);
+    ring_size = size;
+    qd_trace_ring_active = size > 0;
+    sys_mutex_unlock(ring_lock);
+}
+
+
+static qd_trace_ring_t *thread_ring_lh(void)
+{
+    qd_trace_ring_t *ring = (qd_trace_ring_t*) calloc(1, sizeof(qd_trace_ring_t) + ring_size * sizeof(qd_trace_event_t));
+    if (!ring)
+        return 0;
+    DEQ_ITEM_INIT(ring);
+    ring->thread_id = sys_thread_self();
+    ring->mask      = ring_size - 1;
+    sys_atomic_init(&ring->head, 0);
+    DEQ_INSERT_TAIL(rings, ring);
+    return ring;
+}
+
+
+void qd_trace_ring_record(qd_trace_event_type_t type, uint64_t message, const void *delivery,
+                          uint64_t conn_id, uint64_t link_id)
+{
+    qd_trace_ring_t *ring = thread_ring;
+    if (!ring) {
+        sys_mutex_lock(ring_lock);
+        if (ring_size)
+            ring = thread_ring = thread_ring_lh();
+        sys_mutex_unlock(ring_lock);
+        if (!ring)
+            return;
+    }
+
+    // Only this thread writes the ring; publishing head after the slot is
+    // filled lets a reader skip the slot currently being written.
+    uint32_t          head  = sys_atomic_get(&ring->head);
+    qd_trace_event_t *event = &ring->events[head & ring->mask];
+    event->timestamp = (uint64_t) qd_timer_now_usec();
+    event->message   = message;
+    event->delivery  = (uint64_t) (uintptr_t) delivery;
+    event->conn_id   = conn_id;
+    event->link_id   = (uint32_t) link_id;
+    event->type      = (uint8_t) type;
+    sys_atomic_set(&ring->head, head + 1);
+}
+
+
+// A copied event, the thread whose ring it came from and its place in that ring
+typedef struct qd_trace_copy_t {
+    qd_trace_event_t event;
+    long             thread_id;
+    uint32_t         seq;
+} qd_trace_copy_t;
+
+
+// Events of one thread in the same microsecond keep the order they were written
+static int compare_events(const void *a, const void *b)
+{
+    const qd_trace_copy_t *ca = (const qd_trace_copy_t*) a;
+    const qd_trace_copy_t *cb = (const qd_trace_copy_t*) b;
+    if (ca->event.timestamp != cb->event.timestamp)
+        return ca->event.timestamp < cb->event.timestamp ? -1 : 1;
+    if (ca->thread_id != cb->thread_id)
+        return ca->thread_id < cb->thread_id ? -1 : 1;
+    int32_t order = (int32_t) (ca->seq - cb->seq);   // seq wraps with the ring's head
+    return order < 0 ? -1 : order > 0;
+}
+
+
+/// Return the most recent events of all threads, up to limit, oldest first, as
+/// a python list.  Each event is a list of: thread id, event name, monotonic
+/// timestamp (us), message id, delivery id, connection id, link id.
+/// Called by management agent.
+PyObject *qd_trace_ring_recent_py(long limit)
+{
+    if (PyErr_Occurred()) return NULL;
+
+    // Copy the rings out first so python objects are built without the lock
+    sys_mutex_lock(ring_lock);
+    size_t total = 0;
+    for (qd_trace_ring_t *ring = DEQ_HEAD(rings); ring; ring = DEQ_NEXT(ring))
+        total += (size_t) ring->mask + 1;
+    qd_trace_copy_t *copies = (qd_trace_copy_t*) malloc((total ? total : 1) * sizeof(qd_trace_copy_t));
+    size_t           count  = 0;
+    for (qd_trace_ring_t *ring = DEQ_HEAD(rings); ring; ring = DEQ_NEXT(ring)) {
+        uint32_t head = sys_atomic_get(&ring->head);
+        uint32_t size = ring->mask + 1;
+        // The oldest slot may be overwritten while it is copied, leave it out
+        uint32_t n    = head < size ? head : size - 1;
+        for (uint32_t i = head - n; i != head; i++) {
+            copies[count].event     = ring->events[i & ring->mask];
+            copies[count].thread_id = ring->thread_id;
+            copies[count].seq       = i;
+            count++;
+        }
+    }
+    sys_mutex_unlock(ring_lock);
+
+    qsort(copies, count, sizeof(qd_trace_copy_t), compare_events);
+
+    size_t    first = (limit >= 0 && (size_t) limit < count) ? count - (size_t) limit : 0;
+    PyObject *list  = PyList_New(0);
+    if (!list) goto error;
+    for (size_t i = first; i < count; i++) {
+        qd_trace_event_t *e = &copies[i].event;
+        if (e->type < QD_TRACE_RECEIVE || e->type > QD_TRACE_SETTLE)
+            continue;
+        PyObject *py_event = Py_BuildValue("[lsKKKKk]", copies[i].thread_id, event_names[e->type],
+                                           (unsigned PY_LONG_LONG) e->timestamp,
+                                           (unsigned PY_LONG_LONG) e->message,
+                                           (unsigned PY_LONG_LONG) e->delivery,
+                                           (unsigned PY_LONG_LONG) e->conn_id,
+                                           (unsigned long) e->link_id);
+        if (!py_event) goto error;
+        PyList_Append(list, py_event);
+        Py_DECREF(py_event);
+        if (PyErr_Occurred()) goto error;
+    }
+    free(copies);
+    return list;
+
+ error:
+    free(copies);
+    Py_XDECREF(list);
+    return NULL;
+}
@@ -0,0 +1,74 @@
+#ifndef __trace_ring_h__
+#define __trace_ring_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Binary delivery trace ring.
+ *
+ * Each thread that records an event owns a fixed-size ring of compact binary
+ * records.  Only the owning thread writes its ring, so recording takes no lock;
+ * a reader copies the rings on demand (management GET-TRACE) and may miss the
+ * few records being overwritten while it reads.  Recording is off unless the
+ * router's traceRingSize is non-zero.
+ */
+
+typedef enum {
+    QD_TRACE_RECEIVE = 1,   ///< Delivery arrived on an incoming link and was handed to the core
+    QD_TRACE_FORWARD,       ///< Core forwarded the delivery
+    QD_TRACE_SEND,          ///< Delivery was written to an outgoing link
+    QD_TRACE_SETTLE         ///< Delivery was settled
+} qd_trace_event_type_t;
+
+void qd_trace_ring_initialize(void);
+void qd_trace_ring_finalize(void);
+
+/**
+ * Set the number of events kept per thread, rounded up to a power of two.
+ * Zero turns recording off.  Rings already allocated keep their size.
+ */
+void qd_trace_ring_configure(int events_per_thread);
+
+/**@internal*/
+extern bool qd_trace_ring_active;
+
+/**@internal*/
+void qd_trace_ring_record(qd_trace_event_type_t type, uint64_t message, const void *delivery,
+                          uint64_t conn_id, uint64_t link_id);
+
+/**
+ * Record a delivery event when tracing is on.  The arguments are not
+ * evaluated when it is off.
+ *
+ * @param type qd_trace_event_type_t
+ * @param message Identity of the message content (see qd_message_trace_id), shared
+ *                by the incoming delivery and every outgoing copy.
+ * @param delivery The qdr_delivery_t, identifying this leg of the transfer.
+ * @param conn_id Identity of the connection.
+ * @param link_id Identity of the link.
+ */
+#define QD_TRACE_EVENT(type, message, delivery, conn_id, link_id)               \
+    do {                                                                        \
+        if (qd_trace_ring_active)                                               \
+            qd_trace_ring_record(type, message, delivery, conn_id, link_id);    \
+    } while (0)
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "test_case.h"
 #include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/threading.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -32,6 +33,32 @@ qd_alloc_config_t config = {3, 7, 10};
 ALLOC_DECLARE(object_t);
 ALLOC_DEFINE_CONFIG(object_t, sizeof(object_t), 0, &config);
 
+typedef struct {
+    int A;
+} adaptive_t;
+
+qd_alloc_config_t adaptive_config = {2, 4, 0, 16};
+
+ALLOC_DECLARE(adaptive_t);
+ALLOC_DEFINE_CONFIG(adaptive_t, sizeof(adaptive_t), 0, &adaptive_config);
+
+typedef struct {
+    long owner;
+    int  serial;
+} exchange_t;
+
+qd_alloc_config_t exchange_config = {4, 8, 0, 0};
+
+ALLOC_DECLARE(exchange_t);
+ALLOC_DEFINE_CONFIG(exchange_t, sizeof(exchange_t), 0, &exchange_config);
+
+typedef struct {
+    char data[100];
+} huge_t;
+
+ALLOC_DECLARE(huge_t);
+ALLOC_DEFINE(huge_t);
+
 
 static char* check_stats(qd_alloc_stats_t *stats, uint64_t ah, uint64_t fh, uint64_t ht, uint64_t rt, uint64_t rg)
 {
@@ -72,12 +99,240 @@ static char* test_alloc_basic(void *context)
     return 0;
 }
 
+static void *adaptive_idle_thread(void *unused)
+{
+    adaptive_t *obj[100];
+    for (int idx = 0; idx < 100; idx++) {
+        obj[idx] = new_adaptive_t();
+        for (int op = 0; op < 1000; op++)
+            free_adaptive_t(new_adaptive_t());
+    }
+    for (int idx = 0; idx < 100; idx++)
+        free_adaptive_t(obj[idx]);
+    return 0;
+}
+
+
+static char* test_alloc_adaptive(void *context)
+{
+    adaptive_t *obj[100];
+    int         idx;
+    int         pass;
+    int         op;
+
+    //
+    // Repeated bursts larger than the local free list keep the thread going to the
+    // global pool, so the batch size must grow up to its configured maximum.
+    //
+    for (pass = 0; pass < 10; pass++) {
+        for (idx = 0; idx < 100; idx++)
+            obj[idx] = new_adaptive_t();
+        for (idx = 0; idx < 100; idx++)
+            free_adaptive_t(obj[idx]);
+    }
+
+    int batch;
+    int limit;
+    qd_alloc_pool_limits(&__desc_adaptive_t, __local_pool_adaptive_t, &batch, &limit);
+    if (batch != 16) return "Batch size did not grow under load";
+    if (limit != 32) return "Local limit did not scale with the batch size";
+
+    //
+    // Another thread that goes to the global pool only occasionally must not shrink
+    // the batch of this one.
+    //
+    sys_thread_t *idle = sys_thread(adaptive_idle_thread, 0);
+    sys_thread_join(idle);
+    sys_thread_free(idle);
+    qd_alloc_pool_limits(&__desc_adaptive_t, __local_pool_adaptive_t, &batch, &limit);
+    if (batch != 16) return "An idle thread changed the batch size of a busy one";
+
+    //
+    // A thread that goes to the global pool only occasionally, with long stretches
+    // served from its local list in between, must shrink the batch back to the
+    // configured size.
+    //
+    for (idx = 0; idx < 100; idx++) {
+        obj[idx] = new_adaptive_t();
+        for (op = 0; op < 1000; op++)
+            free_adaptive_t(new_adaptive_t());
+    }
+
+    qd_alloc_pool_limits(&__desc_adaptive_t, __local_pool_adaptive_t, &batch, &limit);
+    if (batch != 2) return "Batch size did not shrink with infrequent trips";
+    if (limit != 4) return "Local limit did not shrink with the batch size";
+
+    for (idx = 0; idx < 100; idx++)
+        free_adaptive_t(obj[idx]);
+
+    return 0;
+}
+
+
+static char* test_alloc_exchange(void *context)
+{
+    exchange_t       *obj[200];
+    int               idx;
+    qd_alloc_stats_t *stats;
+    char             *error = 0;
+
+    //
+    // Batches given back beyond the local limit fill the exchange and then spill
+    // onto the global free list; none of them go back to the heap.
+    //
+    for (idx = 0; idx < 200; idx++)
+        obj[idx] = new_exchange_t();
+    stats = alloc_stats_exchange_t();
+    error = check_stats(stats, 200, 0, 200, 0, 0);
+    for (idx = 0; idx < 200 && !error; idx++)
+        if ((uintptr_t) obj[idx] % 64)
+            error = "Object is not cache-line aligned";
+    for (idx = 0; idx < 200; idx++)
+        free_exchange_t(obj[idx]);
+    if (error) return error;
+
+    error = check_stats(stats, 200, 0, 8, 0, 48);
+    if (error) return error;
+
+    //
+    // Everything comes back from the exchange and the global list without carving.
+    //
+    for (idx = 0; idx < 200; idx++)
+        obj[idx] = new_exchange_t();
+    error = check_stats(stats, 200, 0, 200, 48, 48);
+    for (idx = 0; idx < 200; idx++)
+        free_exchange_t(obj[idx]);
+    return error;
+}
+
+
+#define EXCHANGE_THREADS 4
+#define EXCHANGE_ROUNDS  2000
+
+static char *exchange_error = 0;
+
+static void *exchange_thread(void *context)
+{
+    exchange_t *obj[50];
+    long        self = (long) context;
+    int         round;
+    int         idx;
+
+    for (round = 0; round < EXCHANGE_ROUNDS; round++) {
+        for (idx = 0; idx < 50; idx++) {
+            obj[idx] = new_exchange_t();
+            obj[idx]->owner  = self;
+            obj[idx]->serial = idx;
+        }
+        for (idx = 0; idx < 50; idx++) {
+            if (obj[idx]->owner != self || obj[idx]->serial != idx)
+                exchange_error = "Item handed out to two threads";
+            free_exchange_t(obj[idx]);
+        }
+    }
+    return 0;
+}
+
+
+static char* test_alloc_exchange_threads(void *context)
+{
+    sys_thread_t *thread[EXCHANGE_THREADS];
+    long          idx;
+
+    for (idx = 0; idx < EXCHANGE_THREADS; idx++)
+        thread[idx] = sys_thread(exchange_thread, (void*) (idx + 1));
+
+    for (idx = 0; idx < EXCHANGE_THREADS; idx++) {
+        sys_thread_join(thread[idx]);
+        sys_thread_free(thread[idx]);
+    }
+
+    return exchange_error;
+}
+
+
+static char* test_alloc_trim(void *context)
+{
+    exchange_t       *obj[200];
+    int               idx;
+    qd_alloc_stats_t *stats = alloc_stats_exchange_t();
+    uint64_t          freed = stats->total_free_to_heap;
+    uint64_t          held;
+    char             *error = 0;
+
+    for (idx = 0; idx < 200; idx++)
+        obj[idx] = new_exchange_t();
+    for (idx = 0; idx < 200; idx++)
+        free_exchange_t(obj[idx]);
+    held = stats->held_by_threads;
+
+    //
+    // With trimming disabled nothing is released.
+    //
+    qd_alloc_trim();
+    if (stats->total_free_to_heap != freed) return "Trim released items while disabled";
+
+    //
+    // A high-water mark of zero bytes is not a limit; a single byte releases every
+    // item cached in the global pool but leaves the thread's own items alone.
+    //
+    qd_alloc_set_trim_high_water(1);
+    qd_alloc_trim();
+    qd_alloc_set_trim_high_water(0);
+    if (stats->total_alloc_from_heap - stats->total_free_to_heap != held) error = "Trim did not release the global pool";
+    if (stats->held_by_threads != held) error = "Trim touched thread-held items";
+
+    //
+    // Allocation carries on from freshly carved items.
+    //
+    for (idx = 0; idx < 200; idx++)
+        obj[idx] = new_exchange_t();
+    for (idx = 0; idx < 200; idx++)
+        free_exchange_t(obj[idx]);
+    return error;
+}
+
+
+static char* test_alloc_huge_pages(void *context)
+{
+    huge_t *obj[100];
+    int     idx;
+    char   *error = 0;
+
+    if (!qd_alloc_use_huge_pages(&__desc_huge_t)) return "Huge pages not applied before the first allocation";
+
+    //
+    // Whether or not the system provides huge pages, the items come from a single
+    // huge-page sized (and aligned) chunk.
+    //
+    for (idx = 0; idx < 100; idx++)
+        obj[idx] = new_huge_t();
+    uintptr_t chunk = (uintptr_t) obj[0] & ~((uintptr_t) (2 * 1024 * 1024) - 1);
+    for (idx = 0; idx < 100; idx++) {
+        memset(obj[idx]->data, idx, sizeof(obj[idx]->data));
+        if (((uintptr_t) obj[idx] & ~((uintptr_t) (2 * 1024 * 1024) - 1)) != chunk)
+            error = "Items not carved from a huge-page chunk";
+    }
+
+    if (qd_alloc_use_huge_pages(&__desc_huge_t)) error = "Huge pages applied after the first allocation";
+
+    for (idx = 0; idx < 100; idx++)
+        free_huge_t(obj[idx]);
+    return error;
+}
+
+
 int alloc_tests(void)
 {
     int result = 0;
     char *test_group = "alloc_tests";
 
     TEST_CASE(test_alloc_basic, 0);
+    TEST_CASE(test_alloc_adaptive, 0);
+    TEST_CASE(test_alloc_exchange, 0);
+    TEST_CASE(test_alloc_exchange_threads, 0);
+    TEST_CASE(test_alloc_trim, 0);
+    TEST_CASE(test_alloc_huge_pages, 0);
 
     return result;
 }
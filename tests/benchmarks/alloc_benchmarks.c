@@ -0,0 +1,120 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/threading.h>
+#include <stdlib.h>
+
+typedef struct {
+    char data[64];
+} bench_object_t;
+
+ALLOC_DECLARE(bench_object_t);
+ALLOC_DEFINE(bench_object_t);
+
+#define BURST 256
+
+
+// Allocate and free one object: the thread's free list always has one
+static uint64_t alloc_free_single(void *context, uint64_t count)
+{
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        bench_object_t *object = new_bench_object_t();
+        BENCH_KEEP(object);
+        free_bench_object_t(object);
+    }
+    return bench_now_ns() - start;
+}
+
+
+// Allocate a burst, then free it: exercises the transfers between the thread
+// and global free lists.  One operation is one allocation and its free.
+static void alloc_free_bursts(uint64_t count)
+{
+    bench_object_t *objects[BURST];
+    uint64_t        done = 0;
+    while (done < count) {
+        int n = count - done < BURST ? (int) (count - done) : BURST;
+        for (int i = 0; i < n; i++)
+            objects[i] = new_bench_object_t();
+        for (int i = 0; i < n; i++)
+            free_bench_object_t(objects[i]);
+        done += n;
+    }
+}
+
+
+static uint64_t alloc_free_burst(void *context, uint64_t count)
+{
+    uint64_t start = bench_now_ns();
+    alloc_free_bursts(count);
+    return bench_now_ns() - start;
+}
+
+
+typedef struct {
+    int      threads;
+    uint64_t count;
+} threaded_t;
+
+
+static void *alloc_thread(void *arg)
+{
+    alloc_free_bursts(((threaded_t*) arg)->count);
+    return 0;
+}
+
+
+// Every thread runs count operations; the time per operation is the wall time
+// over all threads' operations, so perfect scaling keeps it falling with more
+// threads.
+static uint64_t alloc_free_threads(void *context, uint64_t count)
+{
+    threaded_t   *threaded = (threaded_t*) context;
+    sys_thread_t *threads[64];
+
+    threaded->count = count / threaded->threads + 1;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < threaded->threads; i++)
+        threads[i] = sys_thread(alloc_thread, threaded);
+    for (int i = 0; i < threaded->threads; i++) {
+        sys_thread_join(threads[i]);
+        sys_thread_free(threads[i]);
+    }
+    return bench_now_ns() - start;
+}
+
+
+void alloc_benchmarks(bench_t *bench)
+{
+    static const int thread_counts[] = {1, 2, 4, 8};
+
+    bench_run(bench, "alloc_free", 0, 0, alloc_free_single, 0);
+    bench_run(bench, "alloc_free_burst", "burst", BURST, alloc_free_burst, 0);
+
+    int max_threads = bench->quick ? 2 : 8;
+    for (int i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        if (thread_counts[i] > max_threads)
+            break;
+        threaded_t threaded = { .threads = thread_counts[i] };
+        bench_run(bench, "alloc_free_threads", "threads", threaded.threads, alloc_free_threads, &threaded);
+    }
+}
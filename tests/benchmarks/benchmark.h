@@ -0,0 +1,88 @@
+#ifndef __benchmark_h__
+#define __benchmark_h__ 1
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Micro-benchmark harness.
+ *
+ * A benchmark body runs its operation a given number of times and returns the
+ * nanoseconds the operations took, so that it can leave its own setup and
+ * teardown out of the measurement.  The harness doubles the count until one
+ * run takes at least the minimum time, then takes several runs at that count
+ * and reports the fastest, median and slowest time per operation.  Inputs are
+ * generated from fixed seeds so runs are comparable between builds.
+ */
+
+typedef struct bench_t {
+    FILE       *out;
+    const char *filter;      ///< Only run benchmarks whose name contains this, 0 for all
+    bool        quick;       ///< Small inputs and single short runs, for smoke testing
+    int         runs;        ///< Measured runs per benchmark
+    uint64_t    min_ns;      ///< Minimum duration of one run
+    int         count;       ///< Results written so far
+} bench_t;
+
+/**
+ * Run count operations, return the nanoseconds they took.
+ */
+typedef uint64_t (*bench_body_t)(void *context, uint64_t count);
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Deterministic pseudo-random numbers (xorshift64*), never 0 for a nonzero seed. */
+static inline uint64_t bench_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/** True if the named benchmark is selected; use it to skip expensive setup. */
+bool bench_selected(bench_t *bench, const char *name);
+
+/**
+ * Measure body and write its result.  param names the benchmark's input size
+ * (0 if none) and param_value is its value.
+ */
+void bench_run(bench_t *bench, const char *name, const char *param, long param_value,
+               bench_body_t body, void *context);
+
+/** Keep the compiler from discarding a computed value. */
+#define BENCH_KEEP(v) __asm__ __volatile__("" : : "g"(v) : "memory")
+
+void alloc_benchmarks(bench_t *bench);
+void hash_benchmarks(bench_t *bench);
+void parse_tree_benchmarks(bench_t *bench);
+void message_benchmarks(bench_t *bench);
+void bitmask_benchmarks(bench_t *bench);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include <qpid/dispatch/bitmask.h>
+
+// One operation is a pass over every set bit, as when forwarding to the
+// routers of a multicast address.
+static uint64_t bitmask_each(void *context, uint64_t count)
+{
+    qd_bitmask_t *mask = (qd_bitmask_t*) context;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        int bit, c;
+        int sum = 0;
+        for (QD_BITMASK_EACH(mask, bit, c))
+            sum += bit;
+        BENCH_KEEP(sum);
+    }
+    return bench_now_ns() - start;
+}
+
+
+void bitmask_benchmarks(bench_t *bench)
+{
+    int      width  = qd_bitmask_width();
+    int      bits[] = {1, 8, 64, width};
+    uint64_t seed   = 0x853c49e6748fea9bULL;
+
+    for (int i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+        if (bits[i] > width || (i > 0 && bits[i] <= bits[i - 1]))
+            continue;
+        qd_bitmask_t *mask = qd_bitmask(0);
+        while (qd_bitmask_cardinality(mask) < bits[i])
+            qd_bitmask_set_bit(mask, (int) (bench_random(&seed) % width));
+        bench_run(bench, "bitmask_each", "bits", bits[i], bitmask_each, mask);
+        qd_bitmask_free(mask);
+    }
+}
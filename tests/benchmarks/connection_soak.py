@@ -0,0 +1,226 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+"""
+Connection-scale soak benchmark: the memory and idle CPU cost of a router
+holding a large number of idle connections.
+
+Starts one router and opens the connections with the native idle_client,
+each with a number of receiving links that never get credit.  Once they are
+all open it reports, per connection:
+
+  - the growth of the router's resident set;
+  - the growth of each allocator type's in-use and cached bytes, and how
+    much of the resident growth the allocators do not account for (Proton's
+    transports and buffers, and the heap's own overhead);
+
+and the router's CPU use while the connections sit idle, which is the cost of
+their timers and heartbeats.  Run it from a build tree:
+
+    run.py -s ../tests/benchmarks/connection_soak.py --client tests/benchmarks/idle_client \\
+        --connections 100000 --links 2
+
+The router and the client each need a file descriptor per connection: the open
+file limit is raised to its hard limit and the run stops if that is too low.
+The connections are spread over several listeners so that no one listener runs
+out of ephemeral client ports.  --output also writes the results as JSON.
+"""
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import resource
+import sys
+import time
+
+from system_test import Qdrouterd, Tester, TIMEOUT
+
+ALLOCATOR = 'org.apache.qpid.dispatch.allocator'
+CONNECTIONS_PER_LISTENER = 20000
+
+
+def rss_bytes(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1]) * 1024
+    return 0
+
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        # The command name may hold spaces, the fields after it do not
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf(str("SC_CLK_TCK"))
+
+
+def allocators(router):
+    attributes = ['typeName', 'typeSize', 'inUseBytes', 'cachedBytes']
+    result = {}
+    for a in router.management.query(type=ALLOCATOR, attribute_names=attributes).get_dicts():
+        result[a['typeName']] = a
+    return result
+
+
+def raise_file_limit(needed):
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if hard != resource.RLIM_INFINITY and hard < needed:
+        return hard
+    resource.setrlimit(resource.RLIMIT_NOFILE, (needed if hard == resource.RLIM_INFINITY else hard, hard))
+    return None
+
+
+def wait_report(name, process, timeout):
+    """The client's JSON line once every connection is open"""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        with open(name) as f:
+            lines = [l for l in f.read().splitlines() if l.startswith("{")]
+        if lines:
+            return json.loads(lines[-1])
+        if process.poll() is not None:
+            return None
+        time.sleep(0.5)
+    return None
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description="Router memory and idle CPU per connection")
+    parser.add_argument("--client", default="idle_client", help="path of the idle_client program")
+    parser.add_argument("--connections", type=int, default=100000)
+    parser.add_argument("--links", type=int, default=1, help="receiving links per connection")
+    parser.add_argument("--idle-timeout", type=int, default=16, help="AMQP idle timeout in seconds, 0 for none")
+    parser.add_argument("--idle-seconds", type=int, default=30, help="how long to measure idle CPU")
+    parser.add_argument("--worker-threads", type=int, default=4)
+    parser.add_argument("--open-timeout", type=int, default=600, help="seconds allowed to open the connections")
+    parser.add_argument("--quick", action="store_true", help="a few connections, to check the harness works")
+    parser.add_argument("--output", help="write the results to this JSON file")
+    args = parser.parse_args(argv[1:])
+    if args.quick:
+        args.connections, args.links, args.idle_seconds = 500, 2, 3
+        args.open_timeout = min(args.open_timeout, TIMEOUT)
+    # The Tester changes directory, so resolve paths first
+    args.client = os.path.abspath(args.client) if os.path.exists(args.client) else args.client
+    args.output = args.output and os.path.abspath(args.output)
+    return args
+
+
+def main(argv):
+    args = parse_args(argv)
+    limit = raise_file_limit(args.connections + 1000)
+    if limit is not None:
+        print("The open file limit of %d is too low for %d connections" % (limit, args.connections))
+        return 1
+
+    tester = Tester("connection_soak")
+    tester.rmtree()
+    tester.setup()
+    try:
+        listeners = (args.connections + CONNECTIONS_PER_LISTENER - 1) // CONNECTIONS_PER_LISTENER
+        ports = [tester.get_port() for _ in range(listeners)]
+        config = [
+            ('router', {'mode': 'standalone', 'id': 'SOAK', 'workerThreads': args.worker_threads}),
+            ('listener', {'port': tester.get_port()}),   # Management
+        ]
+        for port in ports:
+            config.append(('listener', {'port': port, 'idleTimeoutSeconds': args.idle_timeout,
+                                        'maxPendingAccepts': 4096}))
+        router = tester.qdrouterd("SOAK", Qdrouterd.Config(config), wait=True)
+
+        time.sleep(1)
+        rss_before = rss_bytes(router.pid)
+        alloc_before = allocators(router)
+
+        cmd = [args.client, "--count", str(args.connections), "--links", str(args.links),
+               "--idle-timeout", str(args.idle_timeout)]
+        for port in ports:
+            cmd += ["--connect", "127.0.0.1:%d" % port]
+        with open("idle-client.out", "w") as out:
+            client = tester.popen(cmd, name="idle-client", expect=None, stdout=out)
+        opened = wait_report("idle-client.out", client, args.open_timeout)
+        if not opened or opened["open"] != args.connections:
+            print("Opened %s of %d connections, see idle-client.out" %
+                  (opened["open"] if opened else "none", args.connections))
+            return 1
+
+        # Let the router finish attaching before measuring
+        time.sleep(2)
+        rss_after = rss_bytes(router.pid)
+        alloc_after = allocators(router)
+        cpu_start, wall_start = cpu_seconds(router.pid), time.time()
+        time.sleep(args.idle_seconds)
+        cpu_idle = (cpu_seconds(router.pid) - cpu_start) / (time.time() - wall_start)
+        client.terminate()
+        client.wait()
+    finally:
+        tester.teardown()
+
+    n = args.connections
+    types = []
+    in_use_total = 0
+    for name, after in alloc_after.items():
+        before = alloc_before.get(name, {})
+        in_use = after['inUseBytes'] - before.get('inUseBytes', 0)
+        cached = after['cachedBytes'] - before.get('cachedBytes', 0)
+        in_use_total += in_use + cached
+        if in_use or cached:
+            types.append({"type": name, "typeSize": after['typeSize'],
+                          "in_use_per_connection": in_use / n, "cached_per_connection": cached / n})
+    types.sort(key=lambda t: -(t["in_use_per_connection"] + t["cached_per_connection"]))
+    rss_per_connection = (rss_after - rss_before) / n
+    result = {
+        "connections": n,
+        "links": args.links,
+        "idle_timeout": args.idle_timeout,
+        "worker_threads": args.worker_threads,
+        "open_seconds": opened["seconds"],
+        "rss_before": rss_before,
+        "rss_after": rss_after,
+        "rss_per_connection": rss_per_connection,
+        "allocator_per_connection": in_use_total / n,
+        "unaccounted_per_connection": rss_per_connection - in_use_total / n,
+        "idle_cpu": cpu_idle,
+        "allocators": types,
+    }
+
+    out = sys.stdout
+    out.write("%d connections with %d links each, opened in %.1f s (%.0f/s)\n" %
+              (n, args.links, opened["seconds"], opened["connections_per_sec"]))
+    out.write("RSS %.1f MB -> %.1f MB: %.0f bytes per connection, %.0f by the allocators, %.0f not\n" %
+              (rss_before / 1e6, rss_after / 1e6, rss_per_connection, result["allocator_per_connection"],
+               result["unaccounted_per_connection"]))
+    for t in types:
+        out.write("  %-32s %6d bytes each  %10.1f in use  %10.1f cached per connection\n" %
+                  (t["type"], t["typeSize"], t["in_use_per_connection"], t["cached_per_connection"]))
+    out.write("Idle CPU %.1f%% of a core over %d s\n" % (cpu_idle * 100, args.idle_seconds))
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(result, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
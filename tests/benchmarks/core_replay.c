@@ -0,0 +1,860 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//
+// Replay a core action trace, recorded with the router's coreActionTrace attribute,
+// against a router core with no network I/O:
+//
+//     core_replay [--output FILE] CONFIG TRACE
+//
+// CONFIG is a router configuration without listeners or connectors.  The core is
+// driven through the same calls the I/O threads make, from this program's main
+// thread, and the connection handlers are stubs that stand in for Proton.  The
+// records are issued as fast as the core takes them, so the timings measure the
+// core's own cost of the recorded traffic.
+//
+// Connections, links and deliveries that the recording router's peers created are
+// recreated from their records.  Links and deliveries the core creates itself, for
+// link routes and for forwarding, are matched to the records that refer to them in
+// the order the core hands them to this program.  When a record refers to one that
+// the core has not handed out yet, the replay waits for the core to catch up.
+// Inter-router and edge connections are replayed as normal connections, and the
+// control-plane actions in the trace are counted but not run.
+//
+// Prints one JSON object with the replay counts, the wall-clock time from the first
+// record until the core is idle, and the core's service time per kind of action.
+//
+
+#include "dispatch_private.h"
+#include "message_private.h"
+#include "router_core/router_core_private.h"
+#include "router_core/action_trace.h"
+#include <qpid/dispatch.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_STRINGS_MAX 1024
+#define TEMPLATES         64
+
+static const char *type_names[QDR_TRACE_RECORD_TYPES] = {
+    "other", "connection_opened", "connection_closed", "link_first_attach",
+    "link_second_attach", "link_detach", "link_flow", "link_deliver",
+    "deliver_continue", "update_delivery"
+};
+
+//
+// FIFO of pointers
+//
+typedef struct {
+    void   **items;
+    size_t   head;
+    size_t   count;
+    size_t   capacity;
+} fifo_t;
+
+static void fifo_push(fifo_t *fifo, void *item)
+{
+    if (fifo->count == fifo->capacity) {
+        size_t  capacity = fifo->capacity ? fifo->capacity * 2 : 16;
+        void  **items    = (void**) malloc(capacity * sizeof(void*));
+        for (size_t i = 0; i < fifo->count; i++)
+            items[i] = fifo->items[(fifo->head + i) % fifo->capacity];
+        free(fifo->items);
+        fifo->items    = items;
+        fifo->head     = 0;
+        fifo->capacity = capacity;
+    }
+    fifo->items[(fifo->head + fifo->count++) % fifo->capacity] = item;
+}
+
+static void *fifo_pop(fifo_t *fifo)
+{
+    if (fifo->count == 0)
+        return 0;
+    void *item = fifo->items[fifo->head];
+    fifo->head = (fifo->head + 1) % fifo->capacity;
+    fifo->count--;
+    return item;
+}
+
+//
+// Open-addressed map from the recording router's object identifiers
+//
+typedef struct {
+    uint64_t key;
+    void    *value;
+} id_slot_t;
+
+typedef struct {
+    id_slot_t *slots;
+    size_t     mask;
+    size_t     count;
+} id_map_t;
+
+static size_t id_hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t) key;
+}
+
+static void id_map_put(id_map_t *map, uint64_t key, void *value);
+
+static void id_map_grow(id_map_t *map)
+{
+    id_slot_t *old      = map->slots;
+    size_t     old_size = old ? map->mask + 1 : 0;
+    size_t     size     = old_size ? old_size * 2 : 1024;
+
+    map->slots = (id_slot_t*) calloc(size, sizeof(id_slot_t));
+    map->mask  = size - 1;
+    map->count = 0;
+    for (size_t i = 0; i < old_size; i++)
+        if (old[i].key)
+            id_map_put(map, old[i].key, old[i].value);
+    free(old);
+}
+
+static void *id_map_get(const id_map_t *map, uint64_t key)
+{
+    if (!key || !map->slots)
+        return 0;
+    for (size_t i = id_hash(key) & map->mask; map->slots[i].key; i = (i + 1) & map->mask)
+        if (map->slots[i].key == key)
+            return map->slots[i].value;
+    return 0;
+}
+
+static void id_map_put(id_map_t *map, uint64_t key, void *value)
+{
+    if (!key)
+        return;
+    if (!map->slots || (map->count + 1) * 2 > map->mask + 1)
+        id_map_grow(map);
+    size_t i = id_hash(key) & map->mask;
+    while (map->slots[i].key && map->slots[i].key != key)
+        i = (i + 1) & map->mask;
+    if (!map->slots[i].key)
+        map->count++;
+    map->slots[i].key   = key;
+    map->slots[i].value = value;
+}
+
+static void id_map_remove(id_map_t *map, uint64_t key)
+{
+    if (!key || !map->slots)
+        return;
+    size_t i = id_hash(key) & map->mask;
+    while (map->slots[i].key != key) {
+        if (!map->slots[i].key)
+            return;
+        i = (i + 1) & map->mask;
+    }
+
+    //
+    // Shift back the entries of the probe sequence that follow
+    //
+    size_t j = i;
+    for (;;) {
+        map->slots[i].key = 0;
+        for (;;) {
+            j = (j + 1) & map->mask;
+            if (!map->slots[j].key) {
+                map->count--;
+                return;
+            }
+            size_t home = id_hash(map->slots[j].key) & map->mask;
+            if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+                break;
+        }
+        map->slots[i] = map->slots[j];
+        i = j;
+    }
+}
+
+
+//
+// Replay state of the recorded objects
+//
+typedef struct replay_conn_t replay_conn_t;
+typedef struct replay_link_t replay_link_t;
+
+struct replay_conn_t {
+    DEQ_LINKS(replay_conn_t);
+    qdr_connection_t *conn;
+    uint64_t          id;
+    bool              closed;
+    fifo_t            core_attaches;  ///< Links the core attached, not yet matched to a record
+};
+
+struct replay_link_t {
+    DEQ_LINKS(replay_link_t);
+    qdr_link_t    *link;           ///< Zero once the core is done with the link
+    replay_conn_t *conn;
+    uint64_t       id;
+    bool           core_detached;  ///< The core sent the first detach
+    fifo_t         core_deliveries; ///< Unsettled deliveries sent on the link, not yet matched
+};
+
+typedef struct {
+    qdr_delivery_t *dlv;  ///< Holds a reference
+    replay_link_t  *link;
+} replay_delivery_t;
+
+DEQ_DECLARE(replay_conn_t, replay_conn_list_t);
+DEQ_DECLARE(replay_link_t, replay_link_list_t);
+
+typedef struct {
+    char         *address;
+    uint64_t      size;
+    qd_message_t *msg;
+} message_template_t;
+
+static struct {
+    qd_dispatch_t      *qd;
+    qdr_core_t         *core;
+    sys_mutex_t        *lock;
+    sys_cond_t         *cond;
+    fifo_t              activated;     ///< Under lock
+    sys_atomic_t        activations;   ///< Non-zero while activated is not empty
+    uint64_t            barrier_sent;
+    uint64_t            barrier_done;  ///< Under lock
+    id_map_t            conns;
+    id_map_t            links;
+    id_map_t            deliveries;
+    replay_conn_list_t  all_conns;
+    replay_link_list_t  all_links;
+    message_template_t  templates[TEMPLATES];
+    int                 next_template;
+    uint64_t            management_id;
+    uint64_t            records[QDR_TRACE_RECORD_TYPES];
+    uint64_t            replayed[QDR_TRACE_RECORD_TYPES];
+    uint64_t            waits;
+} replay;
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+//
+// Connection handler stubs.  Only the activation is called on the core thread; the others
+// run on the main thread in qdr_connection_process.
+//
+static void stub_activate(void *context, qdr_connection_t *conn)
+{
+    sys_mutex_lock(replay.lock);
+    fifo_push(&replay.activated, qdr_connection_get_context(conn));
+    sys_atomic_set(&replay.activations, 1);
+    sys_cond_signal(replay.cond);
+    sys_mutex_unlock(replay.lock);
+}
+
+static void stub_first_attach(void *context, qdr_connection_t *conn, qdr_link_t *link,
+                              qdr_terminus_t *source, qdr_terminus_t *target)
+{
+    replay_conn_t *rc = (replay_conn_t*) qdr_connection_get_context(conn);
+    replay_link_t *rl = NEW(replay_link_t);
+    ZERO(rl);
+    rl->link = link;
+    rl->conn = rc;
+    DEQ_INSERT_TAIL(replay.all_links, rl);
+    qdr_link_set_context(link, rl);
+    fifo_push(&rc->core_attaches, rl);
+}
+
+static void stub_second_attach(void *context, qdr_link_t *link, qdr_terminus_t *source, qdr_terminus_t *target)
+{
+}
+
+static void release_link_deliveries(replay_link_t *rl)
+{
+    qdr_delivery_t *dlv;
+    while ((dlv = (qdr_delivery_t*) fifo_pop(&rl->core_deliveries)))
+        qdr_delivery_decref(replay.core, dlv, "core_replay - link done");
+}
+
+static void stub_detach(void *context, qdr_link_t *link, qdr_error_t *error, bool first, bool close)
+{
+    replay_link_t *rl = (replay_link_t*) qdr_link_get_context(link);
+    if (!rl)
+        return;
+    if (first) {
+        rl->core_detached = true;
+    } else {
+        release_link_deliveries(rl);
+        qdr_link_set_context(link, 0);
+        rl->link = 0;
+    }
+}
+
+static void stub_flow(void *context, qdr_link_t *link, int credit) {}
+static void stub_offer(void *context, qdr_link_t *link, int delivery_count) {}
+static void stub_drained(void *context, qdr_link_t *link) {}
+static void stub_drain(void *context, qdr_link_t *link, bool mode) {}
+
+static int stub_push(void *context, qdr_link_t *link, int limit)
+{
+    if (!qdr_link_get_context(link))
+        return 0;
+    return qdr_link_process_deliveries(replay.core, link, limit);
+}
+
+static uint64_t stub_deliver(void *context, qdr_link_t *link, qdr_delivery_t *dlv, bool settled)
+{
+    replay_link_t *rl = (replay_link_t*) qdr_link_get_context(link);
+
+    // The whole message goes out at once
+    ((qd_message_pvt_t*) qdr_delivery_message(dlv))->send_complete = true;
+    qdr_delivery_set_tag_sent(dlv, true);
+
+    if (!settled && rl) {
+        qdr_delivery_incref(dlv, "core_replay - awaiting disposition");
+        fifo_push(&rl->core_deliveries, dlv);
+    }
+    return 0;
+}
+
+static void stub_delivery_update(void *context, qdr_delivery_t *dlv, uint64_t disp, bool settled) {}
+
+
+//
+// Run the connections the core has woken
+//
+static int service_activations(void)
+{
+    fifo_t batch;
+
+    sys_mutex_lock(replay.lock);
+    batch = replay.activated;
+    ZERO(&replay.activated);
+    sys_atomic_set(&replay.activations, 0);
+    sys_mutex_unlock(replay.lock);
+
+    int count = (int) batch.count;
+    replay_conn_t *rc;
+    while ((rc = (replay_conn_t*) fifo_pop(&batch)))
+        if (!rc->closed)
+            qdr_connection_process(rc->conn);
+    free(batch.items);
+    return count;
+}
+
+
+static void replay_barrier_CT(qdr_core_t *core, qdr_action_t *action, bool discard)
+{
+    //
+    // Activations are handed out at the end of the core's pass, so let this pass finish
+    // before reporting that the work ahead of the barrier is done.
+    //
+    if (!discard && DEQ_SIZE(core->connections_to_activate) > 0) {
+        qdr_action_t *again = qdr_action(replay_barrier_CT, "replay_barrier");
+        again->args.general.context_1 = action->args.general.context_1;
+        qdr_action_enqueue(core, again);
+        return;
+    }
+
+    sys_mutex_lock(replay.lock);
+    replay.barrier_done = (uint64_t) (uintptr_t) action->args.general.context_1;
+    sys_cond_signal(replay.cond);
+    sys_mutex_unlock(replay.lock);
+}
+
+
+//
+// Wait until the core has run everything issued so far and the connections it woke
+// have been processed.
+//
+static void quiesce(void)
+{
+    do {
+        uint64_t      seq    = ++replay.barrier_sent;
+        qdr_action_t *action = qdr_action(replay_barrier_CT, "replay_barrier");
+        action->args.general.context_1 = (void*) (uintptr_t) seq;
+        qdr_action_enqueue(replay.core, action);
+
+        sys_mutex_lock(replay.lock);
+        while (replay.barrier_done < seq) {
+            if (replay.activated.count > 0) {
+                sys_mutex_unlock(replay.lock);
+                service_activations();
+                sys_mutex_lock(replay.lock);
+                continue;
+            }
+            sys_cond_wait(replay.cond, replay.lock);
+        }
+        sys_mutex_unlock(replay.lock);
+    } while (service_activations() > 0);
+}
+
+
+static qd_message_t *message_for(const char *address, uint64_t size)
+{
+    for (int i = 0; i < TEMPLATES; i++) {
+        message_template_t *t = &replay.templates[i];
+        if (t->msg && t->size == size && strcmp(t->address, address) == 0)
+            return qd_message_copy(t->msg);
+    }
+
+    message_template_t *t = &replay.templates[replay.next_template];
+    replay.next_template = (replay.next_template + 1) % TEMPLATES;
+    if (t->msg) {
+        qd_message_free(t->msg);
+        free(t->address);
+    }
+
+    qd_buffer_list_t body;
+    DEQ_INIT(body);
+    uint64_t remaining = size;
+    while (remaining > 0) {
+        qd_buffer_t *buf = qd_buffer();
+        size_t       len = qd_buffer_capacity(buf) < remaining ? qd_buffer_capacity(buf) : (size_t) remaining;
+        memset(qd_buffer_cursor(buf), 'x', len);
+        qd_buffer_insert(buf, len);
+        DEQ_INSERT_TAIL(body, buf);
+        remaining -= len;
+    }
+
+    t->address = strdup(address);
+    t->size    = size;
+    t->msg     = qd_message();
+    qd_message_compose_1(t->msg, address, &body);
+    return qd_message_copy(t->msg);
+}
+
+
+static qdr_terminus_t *terminus(const char *address, bool dynamic)
+{
+    qdr_terminus_t *term = qdr_terminus(0);
+    if (*address)
+        qdr_terminus_set_address(term, address);
+    term->dynamic = dynamic;
+    return term;
+}
+
+
+static void bind_connection(qdr_connection_t *conn, void *token)
+{
+    replay_conn_t *rc = (replay_conn_t*) token;
+    rc->conn = conn;
+    qdr_connection_set_context(conn, rc);
+}
+
+
+static replay_link_t *link_for(uint64_t id)
+{
+    replay_link_t *rl = (replay_link_t*) id_map_get(&replay.links, id);
+    return rl && rl->link ? rl : 0;
+}
+
+
+static void forget_delivery(uint64_t id, replay_delivery_t *rd)
+{
+    qdr_delivery_decref(replay.core, rd->dlv, "core_replay - delivery done");
+    id_map_remove(&replay.deliveries, id);
+    free(rd);
+}
+
+
+static void close_connection(replay_conn_t *rc)
+{
+    //
+    // Release the deliveries held on the connection's links before the core tears them down
+    //
+    for (size_t i = 0; replay.deliveries.slots && i <= replay.deliveries.mask; ) {
+        id_slot_t         *slot = &replay.deliveries.slots[i];
+        replay_delivery_t *rd   = (replay_delivery_t*) slot->value;
+        if (slot->key && rd->link->conn == rc)
+            forget_delivery(slot->key, rd);  // Shifts a later entry into this slot
+        else
+            i++;
+    }
+    for (replay_link_t *rl = DEQ_HEAD(replay.all_links); rl; rl = DEQ_NEXT(rl)) {
+        if (rl->conn == rc) {
+            release_link_deliveries(rl);
+            if (rl->link)
+                qdr_link_set_context(rl->link, 0);
+            rl->link = 0;
+        }
+    }
+
+    rc->closed = true;
+    id_map_remove(&replay.conns, rc->id);
+    qdr_connection_closed(rc->conn);
+}
+
+
+static void replay_record(const qdr_action_trace_record_t *record, const char **strings, int string_count)
+{
+    static const char *empty = "";
+    for (int i = string_count; i < 3; i++)
+        strings[i] = empty;
+
+    switch (record->type) {
+    case QDR_TRACE_CONNECTION_OPENED: {
+        bool                   incoming = !!(record->flags & QDR_TRACE_FLAG_INCOMING);
+        qdr_connection_role_t  role     = (qdr_connection_role_t) record->arg;
+        if (role != QDR_ROLE_ROUTE_CONTAINER)
+            role = QDR_ROLE_NORMAL;
+
+        replay_conn_t *rc = NEW(replay_conn_t);
+        ZERO(rc);
+        rc->id = record->object;
+        DEQ_INSERT_TAIL(replay.all_conns, rc);
+
+        qdr_connection_info_t *info = qdr_connection_info(false, false, true, 0,
+                                                          incoming ? QD_INCOMING : QD_OUTGOING,
+                                                          "core_replay", 0, 0, "anonymous",
+                                                          strings[1], 0, 0, false);
+        qdr_connection_opened(replay.core, incoming, role, (int) record->peer, ++replay.management_id,
+                              strings[0], strings[1], false, false, false, (int) record->value,
+                              *strings[2] ? strings[2] : 0, info, bind_connection, rc);
+        id_map_put(&replay.conns, rc->id, rc);
+        break;
+    }
+
+    case QDR_TRACE_CONNECTION_CLOSED: {
+        replay_conn_t *rc = (replay_conn_t*) id_map_get(&replay.conns, record->object);
+        if (!rc)
+            return;
+        close_connection(rc);
+        break;
+    }
+
+    case QDR_TRACE_LINK_FIRST_ATTACH: {
+        replay_conn_t *rc = (replay_conn_t*) id_map_get(&replay.conns, record->peer);
+        if (!rc)
+            return;
+        qd_direction_t dir     = (qd_direction_t) record->arg;
+        bool           dynamic = !!(record->flags & QDR_TRACE_FLAG_DYNAMIC);
+        replay_link_t *rl      = NEW(replay_link_t);
+        ZERO(rl);
+        rl->conn = rc;
+        rl->id   = record->object;
+        DEQ_INSERT_TAIL(replay.all_links, rl);
+        rl->link = qdr_link_first_attach(rc->conn, dir,
+                                         terminus(strings[1], dynamic && dir == QD_OUTGOING),
+                                         terminus(strings[2], dynamic && dir == QD_INCOMING),
+                                         strings[0], 0);
+        qdr_link_set_context(rl->link, rl);
+        id_map_put(&replay.links, rl->id, rl);
+        break;
+    }
+
+    case QDR_TRACE_LINK_SECOND_ATTACH: {
+        replay_link_t *rl = link_for(record->object);
+        if (!rl) {
+            replay_conn_t *rc = (replay_conn_t*) id_map_get(&replay.conns, record->peer);
+            if (!rc)
+                return;
+            if (rc->core_attaches.count == 0) {
+                replay.waits++;
+                quiesce();
+            }
+            rl = (replay_link_t*) fifo_pop(&rc->core_attaches);
+            if (!rl || !rl->link)
+                return;
+            rl->id = record->object;
+            id_map_put(&replay.links, rl->id, rl);
+        }
+        qdr_link_second_attach(rl->link, terminus(strings[0], false), terminus(strings[1], false));
+        break;
+    }
+
+    case QDR_TRACE_LINK_DETACH: {
+        replay_link_t *rl = link_for(record->object);
+        if (!rl)
+            return;
+        qdr_error_t *error = record->flags & QDR_TRACE_FLAG_ERROR ? qdr_error("qd:replay", "recorded error") : 0;
+        qdr_link_detach(rl->link, (qd_detach_type_t) record->arg, error);
+        if (rl->core_detached) {
+            // This completes the detach; the core frees the link
+            release_link_deliveries(rl);
+            qdr_link_set_context(rl->link, 0);
+            rl->link = 0;
+        }
+        id_map_remove(&replay.links, rl->id);
+        break;
+    }
+
+    case QDR_TRACE_LINK_FLOW: {
+        replay_link_t *rl = link_for(record->object);
+        if (!rl)
+            return;
+        qdr_link_flow(replay.core, rl->link, record->arg, !!(record->flags & QDR_TRACE_FLAG_DRAIN));
+        break;
+    }
+
+    case QDR_TRACE_LINK_DELIVER: {
+        replay_link_t *rl = link_for(record->peer);
+        if (!rl)
+            return;
+        bool           settled = !!(record->flags & QDR_TRACE_FLAG_SETTLED);
+        const char    *address = strings[0];
+        qd_message_t  *msg     = message_for(address, record->value);
+        qd_iterator_t *to      = *address ? qd_iterator_string(address, ITER_VIEW_ALL) : 0;
+
+        if (settled && to) {
+            qdr_link_deliver_presettled(rl->link, msg, 0, to, 0, 0);
+        } else {
+            qdr_delivery_t *dlv = to ? qdr_link_deliver_to(rl->link, msg, 0, to, settled, 0, 0)
+                                     : qdr_link_deliver(rl->link, msg, 0, settled, 0, 0);
+            if (settled) {
+                qdr_delivery_decref(replay.core, dlv, "core_replay - presettled");
+            } else {
+                replay_delivery_t *old = (replay_delivery_t*) id_map_get(&replay.deliveries, record->object);
+                if (old)
+                    forget_delivery(record->object, old);
+                replay_delivery_t *rd = NEW(replay_delivery_t);
+                rd->dlv  = dlv;
+                rd->link = rl;
+                id_map_put(&replay.deliveries, record->object, rd);
+            }
+        }
+        break;
+    }
+
+    case QDR_TRACE_UPDATE_DELIVERY: {
+        replay_delivery_t *rd = (replay_delivery_t*) id_map_get(&replay.deliveries, record->object);
+        replay_link_t     *rl = link_for(record->peer);
+        if (rd && rd->link != rl) {
+            // The identifier has been reused since
+            forget_delivery(record->object, rd);
+            rd = 0;
+        }
+        if (!rd) {
+            if (!rl)
+                return;
+            if (rl->core_deliveries.count == 0) {
+                replay.waits++;
+                quiesce();
+                if (!rl->link)
+                    return;
+            }
+            qdr_delivery_t *dlv = (qdr_delivery_t*) fifo_pop(&rl->core_deliveries);
+            if (!dlv)
+                return;
+            rd = NEW(replay_delivery_t);
+            rd->dlv  = dlv;
+            rd->link = rl;
+            id_map_put(&replay.deliveries, record->object, rd);
+        }
+
+        bool settled = !!(record->flags & QDR_TRACE_FLAG_SETTLED);
+        qdr_delivery_update_disposition(replay.core, rd->dlv, record->value, settled, 0, 0, false);
+        if (settled)
+            forget_delivery(record->object, rd);
+        break;
+    }
+
+    default:
+        // Deliveries are replayed whole, and the control plane is not replayed
+        return;
+    }
+
+    replay.replayed[record->type]++;
+}
+
+
+static int replay_trace(FILE *file, const char *path)
+{
+    qdr_action_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, QDR_ACTION_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != QDR_ACTION_TRACE_VERSION ||
+        header.record_size != sizeof(qdr_action_trace_record_t)) {
+        fprintf(stderr, "core_replay: %s is not a core action trace of this version and host\n", path);
+        return 1;
+    }
+
+    qdr_action_trace_record_t record;
+    char                      strings[TRACE_STRINGS_MAX];
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.string_length > TRACE_STRINGS_MAX ||
+            (record.string_length && fread(strings, record.string_length, 1, file) != 1)) {
+            fprintf(stderr, "core_replay: %s is truncated\n", path);
+            return 1;
+        }
+
+        const char *fields[3];
+        int         count = 0;
+        if (record.string_length)
+            strings[record.string_length - 1] = '\0';
+        for (size_t at = 0; at < record.string_length && count < 3; at += strlen(strings + at) + 1)
+            fields[count++] = strings + at;
+
+        int type = record.type < QDR_TRACE_RECORD_TYPES ? record.type : QDR_TRACE_OTHER;
+        record.type = type;
+        replay.records[type]++;
+        replay_record(&record, fields, count);
+
+        //
+        // Keep up with the core's wakeups as an I/O thread would
+        //
+        if (sys_atomic_get(&replay.activations))
+            service_activations();
+    }
+    return 0;
+}
+
+
+static void print_report(FILE *out, const char *path, double seconds)
+{
+    uint64_t total = 0, replayed = 0;
+    for (int i = 0; i < QDR_TRACE_RECORD_TYPES; i++) {
+        total    += replay.records[i];
+        replayed += replay.replayed[i];
+    }
+
+    fprintf(out, "{\"trace\": \"%s\", \"records\": %"PRIu64", \"replayed\": %"PRIu64", \"waits\": %"PRIu64
+            ", \"seconds\": %.6f, \"records_per_sec\": %.1f,\n  \"types\": {",
+            path, total, replayed, replay.waits, seconds, seconds > 0 ? replayed / seconds : 0.0);
+    for (int i = 0; i < QDR_TRACE_RECORD_TYPES; i++)
+        fprintf(out, "%s\n    \"%s\": {\"records\": %"PRIu64", \"replayed\": %"PRIu64"}",
+                i ? "," : "", type_names[i], replay.records[i], replay.replayed[i]);
+    fprintf(out, "},\n  \"core_actions\": [");
+
+    bool first = true;
+    for (qdr_action_stats_t *stats = DEQ_HEAD(replay.core->action_stats); stats; stats = DEQ_NEXT(stats)) {
+        if (strcmp(stats->label, "replay_barrier") == 0)
+            continue;
+        fprintf(out, "%s\n    {\"label\": \"%s\", \"count\": %"PRIu64", \"service_usec\": %"PRIu64
+                ", \"service_usec_max\": %"PRIu64"}",
+                first ? "" : ",", stats->label, stats->count, stats->service_usec_total, stats->service_usec_max);
+        first = false;
+    }
+    fprintf(out, "]}\n");
+}
+
+
+static void *run_server(void *context)
+{
+    qd_server_run((qd_dispatch_t*) context);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *output = 0;
+    int         arg    = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--output") == 0) {
+        output = argv[arg + 1];
+        arg += 2;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [--output FILE] CONFIG TRACE\n", argv[0]);
+        return 1;
+    }
+    const char *config = argv[arg];
+    const char *path   = argv[arg + 1];
+
+    FILE *trace = fopen(path, "rb");
+    if (!trace) {
+        fprintf(stderr, "core_replay: cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    replay.qd = qd_dispatch(0, false);
+    qd_dispatch_load_config(replay.qd, config);
+    if (qd_error_code()) {
+        fprintf(stderr, "core_replay: config failed: %s\n", qd_error_message());
+        return 1;
+    }
+
+    replay.core = replay.qd->router->router_core;
+    replay.core->action_stats_enabled = true;
+    replay.lock = sys_mutex();
+    replay.cond = sys_cond();
+    sys_atomic_init(&replay.activations, 0);
+
+    //
+    // The handlers' context must stay the router; the core also uses it as one
+    //
+    qdr_connection_handlers(replay.core, (void*) replay.qd->router,
+                            stub_activate, stub_first_attach, stub_second_attach, stub_detach,
+                            stub_flow, stub_offer, stub_drained, stub_drain, stub_push,
+                            stub_deliver, stub_delivery_update);
+
+    sys_thread_t *server = sys_thread(run_server, replay.qd);
+
+    double start  = now_seconds();
+    int    result = replay_trace(trace, path);
+    quiesce();
+    double seconds = now_seconds() - start;
+    fclose(trace);
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "core_replay: cannot create %s: %s\n", output, strerror(errno));
+        result = 1;
+    } else {
+        print_report(out, path, seconds);
+        if (out != stdout)
+            fclose(out);
+    }
+
+    //
+    // Let the core clean up whatever the trace left open
+    //
+    for (replay_conn_t *rc = DEQ_HEAD(replay.all_conns); rc; rc = DEQ_NEXT(rc))
+        if (!rc->closed)
+            close_connection(rc);
+    quiesce();
+
+    qd_server_stop(replay.qd);
+    sys_thread_join(server);
+    sys_thread_free(server);
+
+    for (int i = 0; i < TEMPLATES; i++) {
+        qd_message_free(replay.templates[i].msg);
+        free(replay.templates[i].address);
+    }
+    replay_link_t *rl;
+    while ((rl = DEQ_HEAD(replay.all_links))) {
+        DEQ_REMOVE_HEAD(replay.all_links);
+        free(rl->core_deliveries.items);
+        free(rl);
+    }
+    replay_conn_t *rc;
+    while ((rc = DEQ_HEAD(replay.all_conns))) {
+        DEQ_REMOVE_HEAD(replay.all_conns);
+        free(rc->core_attaches.items);
+        free(rc);
+    }
+    free(replay.conns.slots);
+    free(replay.links.slots);
+    free(replay.deliveries.slots);
+    free(replay.activated.items);
+    sys_atomic_destroy(&replay.activations);
+    sys_cond_free(replay.cond);
+    sys_mutex_free(replay.lock);
+    qd_dispatch_free(replay.qd);
+    return result;
+}
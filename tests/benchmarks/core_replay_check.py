@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+"""
+Record a core action trace from a router passing load_client traffic, then
+replay it with core_replay and check every delivery was replayed.
+
+    run.py -s ../tests/benchmarks/core_replay_check.py --client tests/benchmarks/load_client \\
+        --replay tests/benchmarks/core_replay --config ../tests/benchmarks/core_replay.conf
+"""
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import sys
+import time
+
+from system_test import Qdrouterd, Tester, TIMEOUT
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Record and replay a core action trace")
+    parser.add_argument("--client", required=True, help="path of the load_client program")
+    parser.add_argument("--replay", required=True, help="path of the core_replay program")
+    parser.add_argument("--config", required=True, help="router configuration for core_replay")
+    parser.add_argument("--count", type=int, default=1000)
+    args = parser.parse_args(argv[1:])
+    # The Tester changes directory, so resolve paths first
+    client, replay, config = [os.path.abspath(p) for p in [args.client, args.replay, args.config]]
+
+    tester = Tester("core_replay_check")
+    tester.rmtree()
+    tester.setup()
+    try:
+        trace = os.path.abspath("core.trace")
+        port = tester.get_port()
+        router = tester.qdrouterd("TRACE", Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'TRACE', 'coreActionTrace': trace}),
+            ('listener', {'port': port}),
+            ('address', {'prefix': 'anycast', 'distribution': 'balanced'}),
+        ]), wait=True)
+
+        common = ["--connect", "127.0.0.1:%d" % port, "--address", "anycast/replay",
+                  "--count", str(args.count), "--size", "1024"]
+        receiver = tester.popen([client, "--receive", "--container", "replay-receiver"] + common,
+                                name="receiver", expect=None)
+        router.wait_address("anycast/replay", subscribers=1)
+        sender = tester.popen([client, "--send", "--container", "replay-sender"] + common,
+                              name="sender", expect=None)
+        deadline = time.time() + TIMEOUT
+        for p in [sender, receiver]:
+            while p.poll() is None and time.time() < deadline:
+                time.sleep(0.05)
+            if p.poll() is None:
+                p.terminate()
+                p.wait()
+
+        # The trace is complete once the router has shut down
+        router.teardown()
+
+        p = tester.popen([replay, "--output", "replay.json", config, trace], name="replay", expect=None)
+        if p.wait() != 0:
+            print("core_replay failed")
+            return 1
+        with open("replay.json") as f:
+            report = json.load(f)
+        print(json.dumps(report, indent=2))
+        delivered = report["types"]["link_deliver"]["replayed"]
+        if delivered < args.count:
+            print("expected at least %d link_deliver records, replayed %d" % (args.count, delivered))
+            return 1
+        return 0
+    finally:
+        tester.teardown()
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include <qpid/dispatch/hash.h>
+#include <qpid/dispatch/iterator.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_SIZE 32
+#define LOOKUPS  4096     /* Keys looked up, in random order, cycled through */
+
+typedef struct {
+    qd_hash_t *hash;
+    char      *keys;      /* key_count keys of KEY_SIZE chars */
+    int        key_count;
+    int        lookups[LOOKUPS];
+} hash_context_t;
+
+
+// Fresh iterators, as for the address of each message received: the hash of
+// an iterator is memoized, so reusing one would skip the hashing.
+static uint64_t hash_retrieve(void *context, uint64_t count)
+{
+    hash_context_t *hc = (hash_context_t*) context;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        qd_iterator_t *iter = qd_iterator_string(&hc->keys[hc->lookups[i % LOOKUPS] * KEY_SIZE], ITER_VIEW_ALL);
+        void *value;
+        qd_hash_retrieve(hc->hash, iter, &value);
+        BENCH_KEEP(value);
+        qd_iterator_free(iter);
+    }
+    return bench_now_ns() - start;
+}
+
+
+static void hash_retrieve_benchmark(bench_t *bench, int key_count)
+{
+    hash_context_t *hc = (hash_context_t*) calloc(1, sizeof(hash_context_t));
+    uint64_t        seed = 0x9e3779b97f4a7c15ULL;
+
+    hc->hash      = qd_hash(10, 32, 0);
+    hc->keys      = (char*) malloc((size_t) key_count * KEY_SIZE);
+    hc->key_count = key_count;
+    for (int i = 0; i < key_count; i++) {
+        char *key = &hc->keys[i * KEY_SIZE];
+        snprintf(key, KEY_SIZE, "M0bench/address/%08x", i);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+        qd_hash_insert(hc->hash, iter, key, 0);
+        qd_iterator_free(iter);
+    }
+    for (int i = 0; i < LOOKUPS; i++)
+        hc->lookups[i] = (int) (bench_random(&seed) % key_count);
+
+    bench_run(bench, "hash_retrieve", "keys", key_count, hash_retrieve, hc);
+
+    qd_hash_free(hc->hash);
+    free(hc->keys);
+    free(hc);
+}
+
+
+typedef struct {
+    char               text[512];
+    qd_iterator_view_t view;
+} iterator_context_t;
+
+
+static uint64_t iterator_create_free(void *context, uint64_t count)
+{
+    iterator_context_t *ic = (iterator_context_t*) context;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        qd_iterator_t *iter = qd_iterator_string(ic->text, ic->view);
+        BENCH_KEEP(iter);
+        qd_iterator_free(iter);
+    }
+    return bench_now_ns() - start;
+}
+
+
+// Includes creating and freeing the iterator; compare with iterator_create_free
+static uint64_t iterator_hash_view(void *context, uint64_t count)
+{
+    iterator_context_t *ic = (iterator_context_t*) context;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        qd_iterator_t *iter = qd_iterator_string(ic->text, ic->view);
+        uint32_t hash = qd_iterator_hash_view(iter);
+        BENCH_KEEP(hash);
+        qd_iterator_free(iter);
+    }
+    return bench_now_ns() - start;
+}
+
+
+static void iterator_benchmarks(bench_t *bench)
+{
+    static const int lengths[] = {16, 64, 256};
+    iterator_context_t ic;
+
+    qd_iterator_set_address(false, "bench-area", "bench-router");
+
+    for (int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        ic.view = ITER_VIEW_ALL;
+        memset(ic.text, 'a', lengths[i]);
+        ic.text[lengths[i]] = '\0';
+        if (i == 0)
+            bench_run(bench, "iterator_create_free", "length", lengths[i], iterator_create_free, &ic);
+        bench_run(bench, "iterator_hash_view", "length", lengths[i], iterator_hash_view, &ic);
+
+        // A mobile address as it arrives in a message's to field
+        ic.view = ITER_VIEW_ADDRESS_HASH;
+        int prefix = snprintf(ic.text, sizeof(ic.text), "amqp:/bench/queue/");
+        memset(ic.text + prefix, 'a', lengths[i]);
+        ic.text[prefix + lengths[i]] = '\0';
+        bench_run(bench, "iterator_hash_view_address", "length", lengths[i], iterator_hash_view, &ic);
+    }
+}
+
+
+void hash_benchmarks(bench_t *bench)
+{
+    int max_keys = bench->quick ? 1000 : 1000000;
+    if (bench_selected(bench, "hash_retrieve")) {
+        for (int keys = 1000; keys <= max_keys; keys *= 10)
+            hash_retrieve_benchmark(bench, keys);
+    }
+    iterator_benchmarks(bench);
+}
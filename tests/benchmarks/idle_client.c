@@ -0,0 +1,276 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* Idle connection holder for the connection soak benchmark (connection_soak.py).
+ *
+ * Opens --count connections, round-robin over the --connect addresses, each with
+ * --links receiving links that grant no credit, and then holds them open without
+ * traffic.  At most --pending connections are opening at once, so the router's
+ * accept backlog is not what is measured.  When every connection is open, or has
+ * failed, it writes one line of JSON on stdout and keeps the connections until
+ * --hold seconds have passed or it is terminated.
+ *
+ * Each connection's links receive from their own addresses, soak/<connection>/<link>,
+ * as an IoT device would.  Heartbeats follow the --idle-timeout both peers offer.
+ */
+
+#include <proton/condition.h>
+#include <proton/connection.h>
+#include <proton/event.h>
+#include <proton/link.h>
+#include <proton/proactor.h>
+#include <proton/session.h>
+#include <proton/transport.h>
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_ADDRESSES 64
+
+typedef struct {
+    int  index;
+    int  links_open;
+    bool ready;
+    bool failed;
+} idle_conn_t;
+
+typedef struct {
+    // Options
+    const char *host_ports[MAX_ADDRESSES];
+    int         host_port_count;
+    int         count;
+    int         links;
+    int         pending_max;
+    int         idle_timeout;   // Seconds, 0 for no heartbeats
+    int         hold;           // Seconds to hold the connections once open, 0 for ever
+
+    pn_proactor_t *proactor;
+    idle_conn_t   *conns;
+    int            started;
+    int            ready;
+    int            failed;
+    int            lost;        // Dropped after they were open
+    bool           reported;
+    uint64_t       start_ns;
+    uint64_t       ready_ns;
+} client_t;
+
+static volatile sig_atomic_t stopping;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void start_connections(client_t *client)
+{
+    while (client->started < client->count
+           && client->started - client->ready - client->failed < client->pending_max) {
+        idle_conn_t     *ic   = &client->conns[client->started];
+        pn_connection_t *conn = pn_connection();
+        ic->index = client->started++;
+        pn_connection_set_context(conn, ic);
+        pn_proactor_connect(client->proactor, conn, client->host_ports[ic->index % client->host_port_count]);
+    }
+}
+
+
+static void report(client_t *client)
+{
+    double seconds = (client->ready_ns - client->start_ns) / 1e9;
+    printf("{\"connections\": %d, \"links\": %d, \"open\": %d, \"failed\": %d, \"seconds\": %.3f, "
+           "\"connections_per_sec\": %.1f}\n",
+           client->count, client->links, client->ready, client->failed, seconds,
+           seconds > 0 ? client->ready / seconds : 0.0);
+    fflush(stdout);
+    client->reported = true;
+}
+
+
+static void connection_done(client_t *client)
+{
+    start_connections(client);
+    if (client->ready + client->failed == client->count) {
+        client->ready_ns = now_ns();
+        report(client);
+    }
+}
+
+
+static void connection_ready(client_t *client, idle_conn_t *ic)
+{
+    ic->ready = true;
+    client->ready++;
+    connection_done(client);
+}
+
+
+static void open_links(client_t *client, pn_connection_t *conn, idle_conn_t *ic)
+{
+    pn_session_t *session = pn_session(conn);
+    pn_session_open(session);
+    for (int i = 0; i < client->links; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "soak/%d/%d", ic->index, i);
+        pn_link_t *link = pn_receiver(session, name);
+        pn_terminus_set_address(pn_link_source(link), name);
+        pn_link_open(link);
+    }
+}
+
+
+static void handle(client_t *client, pn_event_t *event)
+{
+    pn_connection_t *conn = pn_event_connection(event);
+    idle_conn_t     *ic   = conn ? (idle_conn_t*) pn_connection_get_context(conn) : 0;
+
+    switch (pn_event_type(event)) {
+
+    case PN_CONNECTION_INIT: {
+        char container[64];
+        snprintf(container, sizeof(container), "soak-%d", ic->index);
+        pn_connection_set_container(conn, container);
+        pn_connection_open(conn);
+        open_links(client, conn, ic);
+        break;
+    }
+
+    case PN_CONNECTION_BOUND:
+        if (client->idle_timeout)
+            pn_transport_set_idle_timeout(pn_event_transport(event), client->idle_timeout * 1000);
+        break;
+
+    case PN_CONNECTION_REMOTE_OPEN:
+        if (client->links == 0 && !ic->ready)
+            connection_ready(client, ic);
+        break;
+
+    case PN_LINK_REMOTE_OPEN:
+        if (++ic->links_open == client->links && !ic->ready)
+            connection_ready(client, ic);
+        break;
+
+    case PN_TRANSPORT_CLOSED: {
+        pn_condition_t *condition = pn_transport_condition(pn_event_transport(event));
+        if (!ic)
+            break;
+        if (ic->ready)
+            client->lost++;
+        else if (!ic->failed) {
+            ic->failed = true;
+            if (client->failed++ == 0 && pn_condition_is_set(condition))
+                fprintf(stderr, "idle_client: %s: %s\n", pn_condition_get_name(condition),
+                        pn_condition_get_description(condition));
+            connection_done(client);
+        }
+        break;
+    }
+
+    case PN_PROACTOR_TIMEOUT:
+        // Wake every second to notice a signal, even when holding for longer
+        if (client->hold && client->reported
+            && now_ns() - client->ready_ns >= (uint64_t) client->hold * 1000000000)
+            stopping = 1;
+        pn_proactor_set_timeout(client->proactor, 1000);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static void on_signal(int sig)
+{
+    stopping = 1;
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s --connect HOST:PORT [--connect HOST:PORT ...] [options]\n"
+            "  --count N          connections to open (default 1000)\n"
+            "  --links N          receiving links on each connection (default 1)\n"
+            "  --pending N        most connections opening at once (default 200)\n"
+            "  --idle-timeout S   AMQP idle timeout to offer, 0 for none (default 16)\n"
+            "  --hold S           seconds to hold the connections open, 0 until terminated (default 0)\n",
+            program);
+}
+
+
+int main(int argc, char **argv)
+{
+    client_t client = { .count = 1000, .links = 1, .pending_max = 200, .idle_timeout = 16 };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg  = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : 0;
+        if (!next)                                   { usage(argv[0]); return 1; }
+        else if (strcmp(arg, "--connect") == 0 && client.host_port_count < MAX_ADDRESSES)
+            { client.host_ports[client.host_port_count++] = next; i++; }
+        else if (strcmp(arg, "--count") == 0)        { client.count = atoi(next); i++; }
+        else if (strcmp(arg, "--links") == 0)        { client.links = atoi(next); i++; }
+        else if (strcmp(arg, "--pending") == 0)      { client.pending_max = atoi(next); i++; }
+        else if (strcmp(arg, "--idle-timeout") == 0) { client.idle_timeout = atoi(next); i++; }
+        else if (strcmp(arg, "--hold") == 0)         { client.hold = atoi(next); i++; }
+        else                                         { usage(argv[0]); return 1; }
+    }
+    if (!client.host_port_count || client.count < 1 || client.links < 0 || client.pending_max < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGTERM, on_signal);
+    signal(SIGINT, on_signal);
+
+    client.conns    = (idle_conn_t*) calloc(client.count, sizeof(idle_conn_t));
+    client.proactor = pn_proactor();
+    client.start_ns = now_ns();
+    start_connections(&client);
+    pn_proactor_set_timeout(client.proactor, 1000);
+
+    while (!stopping) {
+        pn_event_batch_t *batch = pn_proactor_wait(client.proactor);
+        pn_event_t       *event;
+        while ((event = pn_event_batch_next(batch)))
+            handle(&client, event);
+        pn_proactor_done(client.proactor, batch);
+    }
+
+    if (!client.reported) {
+        client.ready_ns = now_ns();
+        report(&client);
+    }
+    if (client.lost)
+        fprintf(stderr, "idle_client: %d connections dropped while idle\n", client.lost);
+    pn_proactor_free(client.proactor);
+    free(client.conns);
+    return client.failed || client.lost ? 1 : 0;
+}
@@ -0,0 +1,461 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* Load generator and sink for the router benchmarks (router_benchmark.py).
+ *
+ * A sender sends count messages of a fixed size as fast as credit and its
+ * window of unsettled deliveries allow.  The last eight bytes of each body are
+ * the CLOCK_MONOTONIC time it was sent, so a receiver on the same host measures
+ * the latency of every message without decoding it.  Body bytes come from a
+ * fixed seed.  Each side writes its results as one line of JSON on stdout.
+ *
+ * With --link-route the receiver opens no link: it is the route container a
+ * link route leads to, and accepts the receiving links the router attaches.
+ */
+
+#include <proton/connection.h>
+#include <proton/delivery.h>
+#include <proton/error.h>
+#include <proton/event.h>
+#include <proton/link.h>
+#include <proton/message.h>
+#include <proton/proactor.h>
+#include <proton/session.h>
+#include <proton/transport.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TIMESTAMP_SIZE 8
+#define READ_CHUNK     65536
+
+typedef struct {
+    // Options
+    const char *host_port;
+    const char *address;
+    const char *container;
+    bool        sender;
+    bool        presettled;
+    bool        link_route;
+    uint64_t    count;
+    size_t      size;
+    int         window;
+    uint64_t    seed;
+    int         idle_timeout;   // Seconds without traffic before a receiver gives up
+
+    pn_proactor_t   *proactor;
+    pn_connection_t *connection;
+    bool             closing;
+
+    // Sender
+    char     *encoded;
+    size_t    encoded_size;
+    uint64_t  sent;
+    uint64_t  settled;
+    uint64_t  accepted;
+    uint64_t  released;
+    uint64_t  rejected;
+    uint64_t  modified;
+
+    // Receiver
+    uint64_t  received;
+    uint64_t  bytes;
+    uint8_t   tail[TIMESTAMP_SIZE];    // Last bytes of the delivery being read
+    size_t    tail_size;
+    uint64_t *latency_ns;
+    char     *chunk;
+
+    uint64_t  first_ns;
+    uint64_t  last_ns;
+    uint64_t  activity_ns;
+} client_t;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+// Encode the message once; only its timestamp changes between sends
+static bool encode_message(client_t *client)
+{
+    pn_message_t *msg  = pn_message();
+    char         *body = (char*) malloc(client->size);
+    uint64_t      seed = client->seed;
+
+    for (size_t i = 0; i < client->size; i++)
+        body[i] = (char) next_random(&seed);
+    pn_message_set_address(msg, client->address);
+    pn_data_put_binary(pn_message_body(msg), pn_bytes(client->size, body));
+    free(body);
+
+    size_t capacity = client->size + 512;
+    while (true) {
+        client->encoded = (char*) realloc(client->encoded, capacity);
+        client->encoded_size = capacity;
+        int rc = pn_message_encode(msg, client->encoded, &client->encoded_size);
+        if (rc == 0)
+            break;
+        if (rc != PN_OVERFLOW) {
+            pn_message_free(msg);
+            return false;
+        }
+        capacity *= 2;
+    }
+    pn_message_free(msg);
+    return true;
+}
+
+
+static void send_available(client_t *client, pn_link_t *link)
+{
+    while (pn_link_credit(link) > 0 && client->sent < client->count
+           && (client->presettled || client->sent - client->settled < (uint64_t) client->window)) {
+        uint64_t tag = client->sent;
+        pn_delivery_t *dlv = pn_delivery(link, pn_dtag((const char*) &tag, sizeof(tag)));
+
+        uint64_t now = now_ns();
+        if (!client->first_ns)
+            client->first_ns = now;
+        memcpy(client->encoded + client->encoded_size - TIMESTAMP_SIZE, &now, TIMESTAMP_SIZE);
+        pn_link_send(link, client->encoded, client->encoded_size);
+        pn_link_advance(link);
+        client->sent++;
+        if (client->presettled) {
+            pn_delivery_settle(dlv);
+            client->settled++;
+        }
+    }
+    if (client->settled == client->count && !client->closing) {
+        client->last_ns = now_ns();
+        client->closing = true;
+        pn_connection_close(client->connection);
+    }
+}
+
+
+static void sender_delivery(client_t *client, pn_delivery_t *dlv)
+{
+    if (!pn_delivery_updated(dlv) || !pn_delivery_remote_state(dlv))
+        return;
+    switch (pn_delivery_remote_state(dlv)) {
+    case PN_ACCEPTED: client->accepted++; break;
+    case PN_RELEASED: client->released++; break;
+    case PN_REJECTED: client->rejected++; break;
+    case PN_MODIFIED: client->modified++; break;
+    default: break;
+    }
+    pn_delivery_settle(dlv);
+    client->settled++;
+    send_available(client, pn_delivery_link(dlv));
+}
+
+
+static void finish_receiving(client_t *client)
+{
+    if (client->closing)
+        return;
+    client->closing = true;
+    pn_connection_close(client->connection);
+}
+
+
+static void receiver_delivery(client_t *client, pn_delivery_t *dlv)
+{
+    pn_link_t *link = pn_delivery_link(dlv);
+    if (!pn_delivery_readable(dlv))
+        return;
+
+    ssize_t n;
+    while ((n = pn_link_recv(link, client->chunk, READ_CHUNK)) > 0) {
+        client->bytes += n;
+        if ((size_t) n >= TIMESTAMP_SIZE) {
+            memcpy(client->tail, client->chunk + n - TIMESTAMP_SIZE, TIMESTAMP_SIZE);
+            client->tail_size = TIMESTAMP_SIZE;
+        } else {
+            size_t keep = client->tail_size + n > TIMESTAMP_SIZE ? TIMESTAMP_SIZE - n : client->tail_size;
+            memmove(client->tail, client->tail + client->tail_size - keep, keep);
+            memcpy(client->tail + keep, client->chunk, n);
+            client->tail_size = keep + n;
+        }
+    }
+    if (pn_delivery_partial(dlv))
+        return;
+
+    uint64_t now = now_ns();
+    uint64_t sent_ns;
+    memcpy(&sent_ns, client->tail, TIMESTAMP_SIZE);
+    if (client->received < client->count)
+        client->latency_ns[client->received] = client->tail_size == TIMESTAMP_SIZE && now > sent_ns ? now - sent_ns : 0;
+    client->tail_size = 0;
+    if (!client->first_ns)
+        client->first_ns = now;
+    client->last_ns = now;
+    client->received++;
+
+    if (!pn_delivery_remote_state(dlv) && !pn_delivery_settled(dlv))
+        pn_delivery_update(dlv, PN_ACCEPTED);
+    pn_delivery_settle(dlv);
+
+    int credit = pn_link_credit(link);
+    if (credit < client->window / 2)
+        pn_link_flow(link, client->window - credit);
+
+    if (client->received >= client->count)
+        finish_receiving(client);
+}
+
+
+static void open_link(client_t *client)
+{
+    pn_session_t *session = pn_session(client->connection);
+    pn_session_open(session);
+    if (client->sender) {
+        pn_link_t *link = pn_sender(session, "bench-sender");
+        pn_terminus_set_address(pn_link_target(link), client->address);
+        if (client->presettled)
+            pn_link_set_snd_settle_mode(link, PN_SND_SETTLED);
+        pn_link_open(link);
+    } else if (!client->link_route) {
+        pn_link_t *link = pn_receiver(session, "bench-receiver");
+        pn_terminus_set_address(pn_link_source(link), client->address);
+        pn_link_open(link);
+        pn_link_flow(link, client->window);
+    }
+}
+
+
+// Returns false when the connection is gone
+static bool handle(client_t *client, pn_event_t *event)
+{
+    switch (pn_event_type(event)) {
+
+    case PN_CONNECTION_INIT:
+        pn_connection_set_container(client->connection, client->container);
+        pn_connection_open(client->connection);
+        open_link(client);
+        break;
+
+    case PN_SESSION_REMOTE_OPEN: {
+        pn_session_t *session = pn_event_session(event);
+        if (pn_session_state(session) & PN_LOCAL_UNINIT)
+            pn_session_open(session);
+        break;
+    }
+
+    case PN_LINK_REMOTE_OPEN: {
+        // The router attaching a link-routed link to this container
+        pn_link_t *link = pn_event_link(event);
+        if (pn_link_state(link) & PN_LOCAL_UNINIT) {
+            pn_terminus_copy(pn_link_source(link), pn_link_remote_source(link));
+            pn_terminus_copy(pn_link_target(link), pn_link_remote_target(link));
+            pn_link_open(link);
+            if (pn_link_is_receiver(link))
+                pn_link_flow(link, client->window);
+        }
+        break;
+    }
+
+    case PN_LINK_FLOW:
+        if (client->sender)
+            send_available(client, pn_event_link(event));
+        break;
+
+    case PN_DELIVERY:
+        client->activity_ns = now_ns();
+        if (client->sender)
+            sender_delivery(client, pn_event_delivery(event));
+        else
+            receiver_delivery(client, pn_event_delivery(event));
+        break;
+
+    case PN_PROACTOR_TIMEOUT:
+        if (!client->sender && client->received
+            && now_ns() - client->activity_ns > (uint64_t) client->idle_timeout * 1000000000) {
+            fprintf(stderr, "load_client: no message for %d seconds, giving up\n", client->idle_timeout);
+            finish_receiving(client);
+        } else {
+            pn_proactor_set_timeout(client->proactor, 1000);
+        }
+        break;
+
+    case PN_TRANSPORT_CLOSED: {
+        pn_condition_t *condition = pn_transport_condition(pn_event_transport(event));
+        if (pn_condition_is_set(condition) && !client->closing)
+            fprintf(stderr, "load_client: %s: %s\n", pn_condition_get_name(condition),
+                    pn_condition_get_description(condition));
+        return false;
+    }
+
+    case PN_CONNECTION_REMOTE_CLOSE:
+        if (!client->closing) {
+            client->closing = true;
+            pn_connection_close(client->connection);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+
+static double percentile_usec(const uint64_t *sorted, uint64_t count, double fraction)
+{
+    if (!count)
+        return 0;
+    uint64_t index = (uint64_t) (fraction * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+
+static void report(client_t *client)
+{
+    uint64_t count   = client->sender ? client->settled : client->received;
+    double   seconds = client->last_ns > client->first_ns ? (client->last_ns - client->first_ns) / 1e9 : 0;
+    double   rate    = seconds > 0 ? count / seconds : 0;
+    double   mbytes  = seconds > 0 ? (double) count * client->size / seconds / 1e6 : 0;
+
+    printf("{\"role\": \"%s\", \"count\": %"PRIu64", \"size\": %zu, \"seconds\": %.6f, "
+           "\"msgs_per_sec\": %.1f, \"mb_per_sec\": %.3f",
+           client->sender ? "sender" : "receiver", count, client->size, seconds, rate, mbytes);
+    if (client->sender) {
+        printf(", \"accepted\": %"PRIu64", \"released\": %"PRIu64", \"rejected\": %"PRIu64", \"modified\": %"PRIu64,
+               client->accepted, client->released, client->rejected, client->modified);
+    } else {
+        uint64_t samples = client->received < client->count ? client->received : client->count;
+        qsort(client->latency_ns, samples, sizeof(uint64_t), compare_u64);
+        printf(", \"latency_usec\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+               percentile_usec(client->latency_ns, samples, 0.5),
+               percentile_usec(client->latency_ns, samples, 0.99),
+               percentile_usec(client->latency_ns, samples, 0.999),
+               samples ? client->latency_ns[samples - 1] / 1000.0 : 0);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s --send|--receive --connect HOST:PORT --address ADDRESS [options]\n"
+            "  --count N          messages to send or receive (default 10000)\n"
+            "  --size BYTES       body size, at least 8 (default 1024)\n"
+            "  --presettled       send presettled\n"
+            "  --window N         unsettled deliveries or receiver credit (default 1000)\n"
+            "  --seed N           seed of the body bytes (default 1)\n"
+            "  --container ID     container id of the connection\n"
+            "  --link-route       receive on links the router attaches\n"
+            "  --idle-timeout S   receiver gives up after S seconds without a message (default 10)\n",
+            program);
+}
+
+
+int main(int argc, char **argv)
+{
+    client_t client = { .count = 10000, .size = 1024, .window = 1000, .seed = 1, .idle_timeout = 10,
+                        .container = "bench-client" };
+    bool role_set = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg  = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : 0;
+        if (strcmp(arg, "--send") == 0)              { client.sender = true; role_set = true; }
+        else if (strcmp(arg, "--receive") == 0)      { client.sender = false; role_set = true; }
+        else if (strcmp(arg, "--presettled") == 0)   client.presettled = true;
+        else if (strcmp(arg, "--link-route") == 0)   client.link_route = true;
+        else if (!next)                              { usage(argv[0]); return 1; }
+        else if (strcmp(arg, "--connect") == 0)      { client.host_port = next; i++; }
+        else if (strcmp(arg, "--address") == 0)      { client.address = next; i++; }
+        else if (strcmp(arg, "--container") == 0)    { client.container = next; i++; }
+        else if (strcmp(arg, "--count") == 0)        { client.count = strtoull(next, 0, 10); i++; }
+        else if (strcmp(arg, "--size") == 0)         { client.size = strtoull(next, 0, 10); i++; }
+        else if (strcmp(arg, "--window") == 0)       { client.window = atoi(next); i++; }
+        else if (strcmp(arg, "--seed") == 0)         { client.seed = strtoull(next, 0, 10) | 1; i++; }
+        else if (strcmp(arg, "--idle-timeout") == 0) { client.idle_timeout = atoi(next); i++; }
+        else                                         { usage(argv[0]); return 1; }
+    }
+    if (!role_set || !client.host_port || !client.address || client.size < TIMESTAMP_SIZE
+        || client.window < 1 || client.count < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (client.sender) {
+        if (!encode_message(&client)) {
+            fprintf(stderr, "load_client: cannot encode a %zu byte message\n", client.size);
+            return 1;
+        }
+    } else {
+        client.latency_ns = (uint64_t*) calloc(client.count, sizeof(uint64_t));
+        client.chunk      = (char*) malloc(READ_CHUNK);
+    }
+
+    client.proactor   = pn_proactor();
+    client.connection = pn_connection();
+    pn_proactor_connect(client.proactor, client.connection, client.host_port);
+    if (!client.sender)
+        pn_proactor_set_timeout(client.proactor, 1000);
+
+    bool running = true;
+    while (running) {
+        pn_event_batch_t *batch = pn_proactor_wait(client.proactor);
+        pn_event_t       *event;
+        while (running && (event = pn_event_batch_next(batch)))
+            running = handle(&client, event);
+        pn_proactor_done(client.proactor, batch);
+    }
+
+    report(&client);
+    pn_proactor_free(client.proactor);
+    free(client.encoded);
+    free(client.latency_ns);
+    free(client.chunk);
+
+    uint64_t done = client.sender ? client.settled : client.received;
+    return done == client.count ? 0 : 1;
+}
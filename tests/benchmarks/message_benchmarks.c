@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include "message_private.h"
+#include <proton/message.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH     256
+#define BODY_SIZE 1024
+
+typedef struct {
+    char               encoded[8192];
+    size_t             size;
+    qd_message_depth_t depth;
+    qd_message_t      *messages[BATCH];
+} message_context_t;
+
+
+// A message as a client would send it: the address, a message id, message
+// annotations, eight application properties and a binary body.
+static size_t message_encode(char *buffer, size_t capacity)
+{
+    pn_message_t *pn_msg = pn_message();
+    char          body[BODY_SIZE];
+
+    memset(body, 'x', sizeof(body));
+    pn_message_set_address(pn_msg, "bench/queue");
+    pn_message_set_subject(pn_msg, "benchmark");
+    pn_data_put_ulong(pn_message_id(pn_msg), 12345);
+
+    pn_data_t *annotations = pn_message_annotations(pn_msg);
+    pn_data_put_map(annotations);
+    pn_data_enter(annotations);
+    pn_data_put_symbol(annotations, pn_bytes(strlen("x-opt-bench"), "x-opt-bench"));
+    pn_data_put_string(annotations, pn_bytes(strlen("value"), "value"));
+    pn_data_exit(annotations);
+
+    pn_data_t *properties = pn_message_properties(pn_msg);
+    pn_data_put_map(properties);
+    pn_data_enter(properties);
+    for (int i = 0; i < 8; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "property%d", i);
+        pn_data_put_string(properties, pn_bytes(strlen(key), key));
+        pn_data_put_int(properties, i);
+    }
+    pn_data_exit(properties);
+
+    pn_data_put_binary(pn_message_body(pn_msg), pn_bytes(sizeof(body), body));
+
+    size_t size = capacity;
+    int    rc   = pn_message_encode(pn_msg, buffer, &size);
+    pn_message_free(pn_msg);
+    return rc == 0 ? size : 0;
+}
+
+
+static qd_message_t *message_received(const message_context_t *mc)
+{
+    qd_message_t         *msg     = qd_message();
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    const char           *cursor  = mc->encoded;
+
+    while (cursor < mc->encoded + mc->size) {
+        qd_buffer_t *buf       = qd_buffer();
+        size_t       remaining = mc->encoded + mc->size - cursor;
+        size_t       segment   = qd_buffer_capacity(buf) < remaining ? qd_buffer_capacity(buf) : remaining;
+        memcpy(qd_buffer_base(buf), cursor, segment);
+        qd_buffer_insert(buf, segment);
+        DEQ_INSERT_TAIL(content->buffers, buf);
+        cursor += segment;
+    }
+    content->receive_complete = true;
+    return msg;
+}
+
+
+// Only the check is timed; the messages are built and freed around it
+static uint64_t message_check(void *context, uint64_t count)
+{
+    message_context_t *mc = (message_context_t*) context;
+    uint64_t elapsed = 0;
+    uint64_t done    = 0;
+
+    while (done < count) {
+        int n = count - done < BATCH ? (int) (count - done) : BATCH;
+        for (int i = 0; i < n; i++)
+            mc->messages[i] = message_received(mc);
+
+        uint64_t start = bench_now_ns();
+        for (int i = 0; i < n; i++) {
+            int valid = qd_message_check(mc->messages[i], mc->depth);
+            BENCH_KEEP(valid);
+        }
+        elapsed += bench_now_ns() - start;
+
+        for (int i = 0; i < n; i++)
+            qd_message_free(mc->messages[i]);
+        done += n;
+    }
+    return elapsed;
+}
+
+
+void message_benchmarks(bench_t *bench)
+{
+    static const struct {
+        const char        *name;
+        qd_message_depth_t depth;
+    } depths[] = {
+        {"message_check_header", QD_DEPTH_HEADER},
+        {"message_check_message_annotations", QD_DEPTH_MESSAGE_ANNOTATIONS},
+        {"message_check_properties", QD_DEPTH_PROPERTIES},
+        {"message_check_application_properties", QD_DEPTH_APPLICATION_PROPERTIES},
+        {"message_check_all", QD_DEPTH_ALL},
+    };
+
+    message_context_t *mc = (message_context_t*) calloc(1, sizeof(message_context_t));
+    mc->size = message_encode(mc->encoded, sizeof(mc->encoded));
+    if (mc->size == 0) {
+        fprintf(stderr, "message_benchmarks: pn_message_encode failed\n");
+        free(mc);
+        return;
+    }
+
+    for (int i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        mc->depth = depths[i].depth;
+        bench_run(bench, depths[i].name, "bytes", (long) mc->size, message_check, mc);
+    }
+    free(mc);
+}
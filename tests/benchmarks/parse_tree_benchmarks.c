@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include "parse_tree.h"
+#include <qpid/dispatch/iterator.h>
+#include <stdlib.h>
+
+#define ADDRESS_SIZE 64
+#define LOOKUPS      4096
+
+typedef struct {
+    qd_parse_tree_t *tree;
+    char             addresses[LOOKUPS][ADDRESS_SIZE];
+} parse_tree_context_t;
+
+
+// Fresh iterators, as for the address of each message received
+static uint64_t parse_tree_retrieve_match(void *context, uint64_t count)
+{
+    parse_tree_context_t *pc = (parse_tree_context_t*) context;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        qd_iterator_t *iter = qd_iterator_string(pc->addresses[i % LOOKUPS], ITER_VIEW_ALL);
+        void *payload;
+        bool found = qd_parse_tree_retrieve_match(pc->tree, iter, &payload);
+        BENCH_KEEP(found);
+        qd_iterator_free(iter);
+    }
+    return bench_now_ns() - start;
+}
+
+
+// A third each of exact, "match one" and "match many" patterns, like the
+// prefix and pattern addresses of a multi-tenant configuration:
+//
+//   tenant<t>.service<s>.queue    tenant<t>.*.topic<s>    tenant<t>.service<s>.#
+//
+// The lookups are addresses of the same shapes, so nearly all of them match.
+static void parse_tree_benchmark(bench_t *bench, int pattern_count, int cache_size)
+{
+    parse_tree_context_t *pc = (parse_tree_context_t*) calloc(1, sizeof(parse_tree_context_t));
+    uint64_t              seed = 0x2545f4914f6cdd1dULL;
+    char                  pattern[ADDRESS_SIZE];
+    int                   tenants = pattern_count / 300 + 1;
+
+    pc->tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+    for (int i = 0; i < pattern_count; i++) {
+        int tenant = i % tenants, service = i / tenants / 3;
+        switch (i / tenants % 3) {
+        case 0: snprintf(pattern, sizeof(pattern), "tenant%d.service%d.queue", tenant, service); break;
+        case 1: snprintf(pattern, sizeof(pattern), "tenant%d.*.topic%d", tenant, service); break;
+        default: snprintf(pattern, sizeof(pattern), "tenant%d.service%d.#", tenant, service); break;
+        }
+        qd_parse_tree_add_pattern_str(pc->tree, pattern, pc);
+    }
+    int services = pattern_count / tenants / 3 + 1;
+    for (int i = 0; i < LOOKUPS; i++) {
+        int tenant  = (int) (bench_random(&seed) % tenants);
+        int service = (int) (bench_random(&seed) % services);
+        switch (bench_random(&seed) % 3) {
+        case 0: snprintf(pc->addresses[i], ADDRESS_SIZE, "tenant%d.service%d.queue", tenant, service); break;
+        case 1: snprintf(pc->addresses[i], ADDRESS_SIZE, "tenant%d.region%d.topic%d", tenant, i % 7, service); break;
+        default: snprintf(pc->addresses[i], ADDRESS_SIZE, "tenant%d.service%d.a.b", tenant, service); break;
+        }
+    }
+    if (cache_size)
+        qd_parse_tree_set_cache_size(pc->tree, cache_size);
+
+    bench_run(bench, cache_size ? "parse_tree_retrieve_match_cached" : "parse_tree_retrieve_match",
+              "patterns", pattern_count, parse_tree_retrieve_match, pc);
+
+    qd_parse_tree_free(pc->tree);
+    free(pc);
+}
+
+
+void parse_tree_benchmarks(bench_t *bench)
+{
+    int max_patterns = bench->quick ? 1000 : 100000;
+    for (int patterns = 1000; patterns <= max_patterns; patterns *= 10) {
+        if (bench_selected(bench, "parse_tree_retrieve_match"))
+            parse_tree_benchmark(bench, patterns, 0);
+        if (bench_selected(bench, "parse_tree_retrieve_match_cached"))
+            parse_tree_benchmark(bench, patterns, LOOKUPS);  // Every address stays cached
+    }
+}
@@ -0,0 +1,269 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+"""
+End-to-end router throughput and latency benchmarks.
+
+Starts router networks with the system test fixtures and drives them with the
+native load_client: one sender on the first router and receivers on the last
+(anycast, link-routed) or on every other router (multicast).  For each case it
+reports messages/s and MB/s at the receivers and the p50/p99/p999 latency from
+send to receipt.  Message bodies and counts are fixed, so results from the same
+hardware can be compared between releases.  Run it from a build tree:
+
+    run.py -s ../tests/benchmarks/router_benchmark.py --client tests/benchmarks/load_client
+
+or "make router-benchmarks".  --output also writes the results as JSON.
+"""
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import sys
+import time
+
+from system_test import Qdrouterd, Tester, TIMEOUT
+
+TOPOLOGIES = ["one", "linear3", "mesh"]
+DISTRIBUTIONS = ["anycast", "multicast", "linkroute"]
+SETTLEMENTS = ["presettled", "unsettled"]
+SIZES = [64, 1024, 65536, 1048576, 10485760]
+
+LINK_ROUTE_CONTAINER = "bench-sink"
+
+
+class Network(object):
+    """A router network of one topology, started once for all its cases"""
+
+    def __init__(self, tester, topology, worker_threads):
+        self.tester = tester
+        self.topology = topology
+        count = {"one": 1, "linear3": 3, "mesh": 4}[topology]
+        names = ["BENCH.%s.%s" % (topology, chr(ord('A') + i)) for i in range(count)]
+        inter_router_ports = [tester.get_port() for _ in names]
+        self.client_ports = [tester.get_port() for _ in names]
+        self.route_ports = [tester.get_port() for _ in names]
+
+        if topology == "mesh":
+            links = [(i, j) for i in range(count) for j in range(i)]
+        else:
+            links = [(i, i - 1) for i in range(1, count)]
+
+        self.routers = []
+        for i, name in enumerate(names):
+            config = [
+                ('router', {'mode': 'standalone' if count == 1 else 'interior', 'id': name,
+                            'workerThreads': worker_threads}),
+                ('listener', {'port': self.client_ports[i], 'role': 'normal',
+                              'linkCapacity': 1000}),
+                ('listener', {'port': self.route_ports[i], 'role': 'route-container'}),
+                ('address', {'prefix': 'multicast', 'distribution': 'multicast'}),
+                ('address', {'prefix': 'anycast', 'distribution': 'balanced'}),
+            ]
+            # The link route leads to the last router's route container
+            container = {'containerId': LINK_ROUTE_CONTAINER} if i == count - 1 else {}
+            for direction in ['in', 'out']:
+                route = {'prefix': 'linkroute', 'direction': direction}
+                route.update(container)
+                config.append(('linkRoute', route))
+            if count > 1:
+                config.append(('listener', {'port': inter_router_ports[i], 'role': 'inter-router'}))
+                for a, b in links:
+                    if a == i:
+                        config.append(('connector', {'port': inter_router_ports[b], 'role': 'inter-router'}))
+            self.routers.append(tester.qdrouterd(name, Qdrouterd.Config(config), wait=True))
+
+        for a, b in links:
+            self.routers[a].wait_router_connected(names[b])
+            self.routers[b].wait_router_connected(names[a])
+
+    def host_port(self, index, route_container=False):
+        ports = self.route_ports if route_container else self.client_ports
+        return "127.0.0.1:%d" % ports[index]
+
+    def receiver_routers(self, distribution):
+        last = len(self.routers) - 1
+        if distribution != "multicast":
+            return [last]
+        if last == 0:
+            return [0, 0]
+        return list(range(1, last + 1))
+
+
+def message_count(args, size):
+    """Enough messages for a steady measurement, within the byte budget"""
+    return max(args.min_count, min(args.count, args.byte_budget // size))
+
+
+def run_case(args, network, distribution, settlement, size, case_id):
+    tester = network.tester
+    count = message_count(args, size)
+    window = max(1, min(args.window, (64 * 1048576) // size))
+    address = "%s/bench/%d" % (distribution, case_id)
+    presettled = ["--presettled"] if settlement == "presettled" else []
+    common = ["--address", address, "--count", str(count), "--size", str(size),
+              "--window", str(window), "--seed", str(args.seed)]
+
+    receivers = []
+    for i, router in enumerate(network.receiver_routers(distribution)):
+        cmd = [args.client, "--receive", "--idle-timeout", str(args.idle_timeout)] + common
+        if distribution == "linkroute":
+            cmd += ["--connect", network.host_port(router, route_container=True),
+                    "--link-route", "--container", LINK_ROUTE_CONTAINER]
+        else:
+            cmd += ["--connect", network.host_port(router), "--container", "bench-receiver-%d" % i]
+        with open("receiver-%d-%d.json" % (case_id, i), "w") as out:
+            receivers.append(tester.popen(cmd, name="receiver-%d" % case_id, expect=None, stdout=out))
+
+    sender_router = network.routers[0]
+    for router in set(network.receiver_routers(distribution)):
+        if distribution == "linkroute":
+            network.routers[router].wait_address("linkroute", containers=1)
+        else:
+            network.routers[router].wait_address(address, subscribers=1)
+        if router != 0:
+            sender_router.wait_address("linkroute" if distribution == "linkroute" else address, remotes=1)
+
+    with open("sender-%d.json" % case_id, "w") as out:
+        sender = tester.popen([args.client, "--send", "--connect", network.host_port(0),
+                               "--container", "bench-sender"] + presettled + common,
+                              name="sender-%d" % case_id, expect=None, stdout=out)
+
+    deadline = time.time() + args.case_timeout
+    for p in [sender] + receivers:
+        while p.poll() is None and time.time() < deadline:
+            time.sleep(0.05)
+        if p.poll() is None:
+            p.terminate()
+            p.wait()
+
+    def result(name):
+        with open(name) as f:
+            lines = [l for l in f.read().splitlines() if l.startswith("{")]
+        return json.loads(lines[-1]) if lines else None
+
+    return {
+        "topology": network.topology,
+        "distribution": distribution,
+        "settlement": settlement,
+        "size": size,
+        "count": count,
+        "sender": result("sender-%d.json" % case_id),
+        "receivers": [result("receiver-%d-%d.json" % (case_id, i)) for i in range(len(receivers))],
+    }
+
+
+def summarize(case):
+    """The receivers' slowest throughput and worst latencies"""
+    receivers = [r for r in case["receivers"] if r]
+    if not receivers or len(receivers) != len(case["receivers"]):
+        return None
+    return {
+        "received": min(r["count"] for r in receivers),
+        "msgs_per_sec": min(r["msgs_per_sec"] for r in receivers),
+        "mb_per_sec": min(r["mb_per_sec"] for r in receivers),
+        "p50_usec": max(r["latency_usec"]["p50"] for r in receivers),
+        "p99_usec": max(r["latency_usec"]["p99"] for r in receivers),
+        "p999_usec": max(r["latency_usec"]["p999"] for r in receivers),
+    }
+
+
+def print_case(case, out):
+    s = case.get("summary")
+    name = "%-8s %-10s %-10s %9d" % (case["topology"], case["distribution"], case["settlement"], case["size"])
+    if not s:
+        out.write("%s  FAILED, see the case's sender and receiver output\n" % name)
+    else:
+        out.write("%s %8d/%-8d %11.0f msg/s %9.2f MB/s  p50 %9.1f  p99 %9.1f  p999 %9.1f us\n" %
+                  (name, s["received"], case["count"], s["msgs_per_sec"], s["mb_per_sec"],
+                   s["p50_usec"], s["p99_usec"], s["p999_usec"]))
+    out.flush()
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description="Router throughput and latency benchmarks")
+    parser.add_argument("--client", default="load_client", help="path of the load_client program")
+    parser.add_argument("--topology", action="append", choices=TOPOLOGIES)
+    parser.add_argument("--distribution", action="append", choices=DISTRIBUTIONS)
+    parser.add_argument("--settlement", action="append", choices=SETTLEMENTS)
+    parser.add_argument("--size", action="append", type=int, help="body size in bytes")
+    parser.add_argument("--count", type=int, default=100000, help="most messages per case")
+    parser.add_argument("--min-count", type=int, default=100, help="fewest messages per case")
+    parser.add_argument("--byte-budget", type=int, default=1 << 30, help="most body bytes per case")
+    parser.add_argument("--window", type=int, default=1000, help="receiver credit and unsettled window")
+    parser.add_argument("--worker-threads", type=int, default=4)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--idle-timeout", type=int, default=10)
+    parser.add_argument("--case-timeout", type=int, default=300)
+    parser.add_argument("--quick", action="store_true",
+                        help="one small case per distribution on one router, to check the harness works")
+    parser.add_argument("--output", help="write the results to this JSON file")
+    args = parser.parse_args(argv[1:])
+    if args.quick:
+        args.topology = args.topology or ["one"]
+        args.settlement = args.settlement or ["unsettled"]
+        args.size = args.size or [1024]
+        args.count = args.min_count = 1000
+        args.case_timeout = min(args.case_timeout, TIMEOUT)
+    args.topology = args.topology or TOPOLOGIES
+    args.distribution = args.distribution or DISTRIBUTIONS
+    args.settlement = args.settlement or SETTLEMENTS
+    args.size = args.size or SIZES
+    # The Tester changes directory, so resolve paths first
+    args.client = os.path.abspath(args.client) if os.path.exists(args.client) else args.client
+    args.output = args.output and os.path.abspath(args.output)
+    return args
+
+
+def main(argv):
+    args = parse_args(argv)
+    tester = Tester("router_benchmark")
+    tester.rmtree()
+    tester.setup()
+    cases = []
+    case_id = 0
+    try:
+        for topology in args.topology:
+            network = Network(tester, topology, args.worker_threads)
+            for distribution in args.distribution:
+                for settlement in args.settlement:
+                    for size in args.size:
+                        case_id += 1
+                        case = run_case(args, network, distribution, settlement, size, case_id)
+                        case["summary"] = summarize(case)
+                        print_case(case, sys.stdout)
+                        cases.append(case)
+    finally:
+        tester.teardown()
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"seed": args.seed, "worker_threads": args.worker_threads, "cases": cases}, f, indent=2)
+    return 0 if all(c["summary"] and c["summary"]["received"] == c["count"] for c in cases) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
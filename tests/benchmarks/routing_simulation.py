@@ -0,0 +1,496 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+"""
+Routing engine simulation over large synthetic router networks.
+
+Runs one RouterEngine per simulated router in this process, on a simulated
+clock, and delivers their control messages to each other directly.  The
+router adapter each engine calls in place of the router core counts the
+qd_set_* and destination mapping calls it would have made.  For the cold
+start and for each link flap the simulation reports:
+
+  - the simulated seconds until every router's route table and mobile
+    address mappings agree with the topology, and the real time it took;
+  - the HELLO, RA, LSU, LSR, MAU and MAR messages and octets delivered;
+  - the router adapter calls, by method.
+
+Run it from a build tree:
+
+    run.py -s ../tests/benchmarks/routing_simulation.py --routers 128 --addresses 100000
+
+--output also writes the results as JSON.  The engines keep every remote
+address, so memory grows with routers times addresses.
+
+Flooded messages reach every router in the sender's partition in the tick
+they are sent, and the octets are the AMQP encoded size of each body as
+delivered, so one flood to N routers counts N bodies.  Real networks take
+longer to deliver and forward floods hop by hop; the results measure the
+engine's own convergence, not the network's.
+"""
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import argparse
+import copy
+import json
+import random
+import sys
+import time
+from collections import defaultdict, deque
+
+import mock                     # Mock definitions for tests.
+
+from qpid_dispatch_internal.dispatch import LOG_ERROR, TREATMENT_ANYCAST_BALANCED
+from qpid_dispatch_internal.router import engine as engine_module
+from qpid_dispatch_internal.router.engine import RouterEngine
+from qpid_dispatch_internal.compat import PY_BINARY_TYPE, PY_TEXT_TYPE, PY_LONG_TYPE
+
+TOPOLOGIES = ["ring", "grid", "random", "full"]
+
+CONFIG_DEFAULTS = {
+    'helloIntervalSeconds': 1,
+    'helloMaxAgeSeconds': 3,
+    'raIntervalSeconds': 30,
+    'raIntervalFluxSeconds': 4,
+    'remoteLsMaxAgeSeconds': 60,
+    'equalCostMultipath': False,
+    'routeSnapshotFile': None,
+    'routeSnapshotIntervalSeconds': 30,
+}
+
+
+class Clock(object):
+    """Stands in for the time module in the routing engine"""
+    def __init__(self):
+        self.now = 1000000.0
+
+    def time(self):
+        return self.now
+
+
+class NoLog(object):
+    """Keeps errors, drops everything else"""
+    errors = []
+
+    def __init__(self, module):
+        self.module = module
+
+    def log(self, level, text, *info):
+        if level >= LOG_ERROR:
+            NoLog.errors.append("%s: %s" % (self.module, text))
+
+
+class NoIo(object):
+    """The simulation delivers control messages itself, see SimRouter.send"""
+    def __init__(self, *args):
+        pass
+
+
+engine_module.time = CLOCK = Clock()
+engine_module.LogAdapter = NoLog
+engine_module.IoAdapter = NoIo
+
+
+class Config(object):
+    def __init__(self, attributes):
+        self.attributes = attributes
+
+    def __getattr__(self, name):
+        try:
+            return self.__dict__['attributes'][name]
+        except KeyError:
+            raise AttributeError(name)
+
+
+class Agent(object):
+    def __init__(self, config):
+        self.config = config
+
+    def find_entity_by_type(self, type):
+        return [self.config] if type == 'router' else []
+
+    def add_implementation(self, implementation, type):
+        pass
+
+    def remove_implementation(self, implementation):
+        pass
+
+
+class Adapter(object):
+    """
+    The router adapter of one simulated router.  Counts the calls into the
+    core and keeps enough of the route table to check convergence.
+    """
+    def __init__(self, config, calls):
+        self.agent = Agent(config)
+        self.calls = calls           # Shared by all routers: method => count
+        self.routers = {}            # maskbit => router id
+        self.links = set()           # maskbits of neighbors
+        self.next_hops = {}          # maskbit => next hop maskbit
+        self.mapped = defaultdict(int)  # maskbit => destinations mapped
+
+    def get_agent(self):
+        return self.agent
+
+    def add_router(self, address, maskbit):
+        self.calls['add_router'] += 1
+        self.routers[maskbit] = address.split('/')[-2]
+
+    def del_router(self, maskbit):
+        self.calls['del_router'] += 1
+        self.routers.pop(maskbit, None)
+        self.links.discard(maskbit)
+        self.next_hops.pop(maskbit, None)
+        self.mapped.pop(maskbit, None)
+
+    def set_link(self, maskbit, link_id):
+        self.calls['set_link'] += 1
+        self.links.add(maskbit)
+
+    def remove_link(self, maskbit):
+        self.calls['remove_link'] += 1
+        self.links.discard(maskbit)
+
+    def set_next_hop(self, maskbit, next_hop):
+        self.calls['set_next_hop'] += 1
+        self.next_hops[maskbit] = next_hop
+
+    def remove_next_hop(self, maskbit):
+        self.calls['remove_next_hop'] += 1
+        self.next_hops.pop(maskbit, None)
+
+    def set_cost(self, maskbit, cost):
+        self.calls['set_cost'] += 1
+
+    def set_valid_origins(self, maskbit, origins):
+        self.calls['set_valid_origins'] += 1
+
+    def set_equal_cost_hops(self, maskbit, hops):
+        self.calls['set_equal_cost_hops'] += 1
+
+    def set_radius(self, radius):
+        self.calls['set_radius'] += 1
+
+    def begin_route_update(self):
+        pass
+
+    def commit_route_update(self):
+        pass
+
+    def map_destination(self, addr, treatment, maskbit):
+        self.calls['map_destination'] += 1
+        self.calls['destinations_mapped'] += 1
+        self.mapped[maskbit] += 1
+
+    def unmap_destination(self, addr, maskbit):
+        self.calls['unmap_destination'] += 1
+        self.calls['destinations_unmapped'] += 1
+        self.mapped[maskbit] -= 1
+
+    def map_destinations(self, addrs, hints, maskbit):
+        self.calls['map_destinations'] += 1
+        self.calls['destinations_mapped'] += len(addrs)
+        self.mapped[maskbit] += len(addrs)
+
+    def unmap_destinations(self, addrs, maskbit):
+        self.calls['unmap_destinations'] += 1
+        self.calls['destinations_unmapped'] += len(addrs)
+        self.mapped[maskbit] -= len(addrs)
+
+    def reachable(self):
+        """The router ids the core can forward to"""
+        return set(self.routers[mb] for mb in self.routers if mb in self.links or mb in self.next_hops)
+
+
+class SimRouter(RouterEngine):
+    def __init__(self, network, router_id, max_routers, config):
+        self.network = network
+        self.link_ids = {}           # peer id => link id
+        self.addresses = 0
+        RouterEngine.__init__(self, Adapter(config, network.calls), router_id, '0', max_routers)
+
+    def send(self, dest, msg):
+        self.network.send(self, dest, msg)
+
+
+def encoded_size(value):
+    """The AMQP 1.0 encoded size of a message body, with the narrowest encodings"""
+    if value is None or isinstance(value, bool):
+        return 1
+    if isinstance(value, (int, PY_LONG_TYPE)):
+        return 2 if -128 <= value <= 127 else 9
+    if isinstance(value, float):
+        return 9
+    if isinstance(value, PY_TEXT_TYPE):
+        size = len(value.encode('utf-8'))
+        return size + (2 if size < 256 else 5)
+    if isinstance(value, PY_BINARY_TYPE):
+        return len(value) + (2 if len(value) < 256 else 5)
+    if isinstance(value, dict):
+        size = sum(encoded_size(k) + encoded_size(v) for k, v in value.items())
+    else:
+        size = sum(encoded_size(v) for v in value)
+    return size + (3 if size < 255 else 9)
+
+
+class Network(object):
+    def __init__(self, args):
+        self.calls = defaultdict(int)
+        self.traffic = defaultdict(lambda: [0, 0])   # opcode => [messages, octets]
+        self.queue = deque()
+        self.rng = random.Random(args.seed)
+        config = Config(dict(CONFIG_DEFAULTS))
+        ids = ["R%04d" % i for i in range(args.routers)]
+        self.routers = dict((i, SimRouter(self, i, max(args.routers, 128), config)) for i in ids)
+        self.order = ids
+        self.links = {}              # frozenset of ids => up
+        for a, b in self._topology(args.topology, ids, args.degree):
+            self.links[frozenset([a, b])] = True
+            for x, y in [(a, b), (b, a)]:
+                router = self.routers[x]
+                router.link_ids[y] = len(router.link_ids) + 1
+        self.hops = {}               # router id => distances(), until a link changes
+
+        changes = defaultdict(list)
+        for n in range(args.addresses):
+            at = ids[n % len(ids)]
+            changes[at].append(("M0sim/%d" % n, TREATMENT_ANYCAST_BALANCED))
+        for at, change in changes.items():
+            self.routers[at].addressesChanged(change)
+            self.routers[at].addresses = len(change)
+
+    def _topology(self, topology, ids, degree):
+        n = len(ids)
+        if topology == "full":
+            return [(ids[i], ids[j]) for i in range(n) for j in range(i)]
+        ring = [(ids[i], ids[(i + 1) % n]) for i in range(n)] if n > 1 else []
+        if n == 2:
+            ring = ring[:1]
+        if topology == "ring":
+            return ring
+        if topology == "grid":
+            width = max(1, int(n ** 0.5))
+            return [(ids[i], ids[i + 1]) for i in range(n - 1) if (i + 1) % width] + \
+                   [(ids[i], ids[i + width]) for i in range(n - width)]
+        # random: a ring for connectivity, then random chords to the mean degree
+        links = set(frozenset(l) for l in ring)
+        wanted = min(n * (n - 1) // 2, n * degree // 2)
+        while len(links) < wanted:
+            a, b = self.rng.sample(ids, 2)
+            links.add(frozenset([a, b]))
+        return [tuple(sorted(l)) for l in links]
+
+    def up_links(self):
+        return sorted(tuple(sorted(l)) for l, up in self.links.items() if up)
+
+    def neighbors(self, router_id):
+        return [peer for peer in self.routers[router_id].link_ids
+                if self.links[frozenset([router_id, peer])]]
+
+    def partition(self, router_id):
+        return set(self.distances(router_id))
+
+    def distances(self, router_id):
+        """Hops from the router to each router in its partition, itself included"""
+        if router_id not in self.hops:
+            hops = {router_id: 0}
+            todo = deque([router_id])
+            while todo:
+                at = todo.popleft()
+                for peer in self.neighbors(at):
+                    if peer not in hops:
+                        hops[peer] = hops[at] + 1
+                        todo.append(peer)
+            self.hops[router_id] = hops
+        return self.hops[router_id]
+
+    def send(self, sender, dest, msg):
+        body = msg.to_dict()
+        opcode = msg.get_opcode()
+        octets = encoded_size(body) + encoded_size({'opcode': opcode})
+        if dest == 'amqp:/_local/qdhello':
+            receivers = [(peer, self.routers[peer].link_ids[sender.id]) for peer in self.neighbors(sender.id)]
+        else:
+            target = dest.split('/')[-2]
+            group = self.distances(sender.id)
+            if target == 'all':
+                receivers = [(r, 0) for r in self.order if r in group and r != sender.id]
+            else:
+                receivers = [(target, 0)] if target in group else []
+        for receiver, link_id in receivers:
+            self.queue.append((self.routers[receiver], opcode, copy.deepcopy(body), link_id))
+            self.traffic[opcode][0] += 1
+            self.traffic[opcode][1] += octets
+
+    def deliver(self):
+        while self.queue:
+            router, opcode, body, link_id = self.queue.popleft()
+            router.handleControlMessage(opcode, body, link_id, 1)
+
+    def tick(self):
+        CLOCK.now += 1.0
+        for router_id in self.order:
+            self.routers[router_id].handleTimerTick()
+            self.deliver()
+
+    def set_link(self, a, b, up):
+        self.links[frozenset([a, b])] = up
+        self.hops = {}
+        if not up:
+            # Both ends see the connection fail
+            self.routers[a].linkLost(self.routers[a].link_ids[b])
+            self.routers[b].linkLost(self.routers[b].link_ids[a])
+            self.deliver()
+
+    def converged(self):
+        """
+        True when every router knows the link state of its partition, forwards
+        to each router in it on a shortest path, and maps all of their addresses.
+        """
+        for router_id in self.order:
+            router = self.routers[router_id]
+            hops = self.distances(router_id)
+            tracker = router.node_tracker
+            if set(tracker.link_state.peers) != set(self.neighbors(router_id)):
+                return False
+            for peer in hops:
+                if peer != router_id:
+                    node = tracker.nodes.get(peer)
+                    if not node or set(node.link_state.peers) != set(self.neighbors(peer)):
+                        return False
+
+            adapter = router.router_adapter
+            if adapter.reachable() != set(hops) - set([router_id]):
+                return False
+            for maskbit, peer in adapter.routers.items():
+                if peer not in hops:
+                    if adapter.mapped.get(maskbit, 0):
+                        return False
+                    continue
+                if adapter.mapped.get(maskbit, 0) != self.routers[peer].addresses:
+                    return False
+                if maskbit in adapter.next_hops:
+                    via = adapter.routers.get(adapter.next_hops[maskbit])
+                    if hops[peer] < 2 or via not in hops or hops[via] != 1 \
+                       or self.distances(via)[peer] != hops[peer] - 1:
+                        return False
+                elif maskbit not in adapter.links:
+                    return False
+        return True
+
+
+def run_phase(network, name, max_seconds, event=None):
+    """Run the event, then tick until the network converges"""
+    calls_before = dict(network.calls)
+    traffic_before = dict((k, list(v)) for k, v in network.traffic.items())
+    start_clock = CLOCK.now
+    start = time.time()
+    if event:
+        event()
+    converged = network.converged()
+    while not converged and CLOCK.now - start_clock < max_seconds:
+        network.tick()
+        converged = network.converged()
+    elapsed = time.time() - start
+
+    traffic = {}
+    for opcode, (messages, octets) in network.traffic.items():
+        before = traffic_before.get(opcode, [0, 0])
+        if messages - before[0]:
+            traffic[opcode] = {"messages": messages - before[0], "octets": octets - before[1]}
+    calls = dict((k, v - calls_before.get(k, 0)) for k, v in network.calls.items() if v - calls_before.get(k, 0))
+    return {
+        "phase": name,
+        "converged": converged,
+        "sim_seconds": CLOCK.now - start_clock,
+        "wall_seconds": elapsed,
+        "traffic": traffic,
+        "calls": calls,
+    }
+
+
+def print_phase(phase, out):
+    traffic = phase["traffic"]
+    messages = sum(t["messages"] for t in traffic.values())
+    octets = sum(t["octets"] for t in traffic.values())
+    lsu = traffic.get("LSU", {}).get("octets", 0)
+    mau = traffic.get("MAU", {}).get("octets", 0)
+    calls = phase["calls"]
+    set_calls = sum(v for k, v in calls.items() if k.startswith("set_"))
+    out.write("%-28s %-9s %5d s %9.2f s  %8d msgs %12d octets (LSU %d, MAU %d)  %8d qd_set_* %9d mapped %9d unmapped\n" %
+              (phase["phase"], "converged" if phase["converged"] else "TIMEOUT", phase["sim_seconds"],
+               phase["wall_seconds"], messages, octets, lsu, mau, set_calls,
+               calls.get("destinations_mapped", 0), calls.get("destinations_unmapped", 0)))
+    out.flush()
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description="Routing engine convergence on synthetic networks")
+    parser.add_argument("--routers", type=int, default=128)
+    parser.add_argument("--addresses", type=int, default=100000, help="mobile addresses, spread over the routers")
+    parser.add_argument("--topology", choices=TOPOLOGIES, default="random")
+    parser.add_argument("--degree", type=int, default=4, help="mean links per router of the random topology")
+    parser.add_argument("--flaps", type=int, default=3, help="links to take down and restore")
+    parser.add_argument("--max-seconds", type=int, default=600, help="simulated time allowed to converge")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--quick", action="store_true", help="a small network, to check the simulation works")
+    parser.add_argument("--output", help="write the results to this JSON file")
+    args = parser.parse_args(argv[1:])
+    if args.quick:
+        args.routers, args.addresses, args.flaps = 16, 2000, 1
+    return args
+
+
+def main(argv):
+    args = parse_args(argv)
+    start = time.time()
+    network = Network(args)
+    out = sys.stdout
+    out.write("%d routers, %d links (%s), %d mobile addresses, set up in %.2f s\n" %
+              (args.routers, len(network.up_links()), args.topology, args.addresses, time.time() - start))
+
+    phases = [run_phase(network, "cold start", args.max_seconds)]
+    print_phase(phases[-1], out)
+    for i in range(args.flaps):
+        a, b = network.rng.choice(network.up_links())
+        phases.append(run_phase(network, "link %s-%s down" % (a, b), args.max_seconds,
+                                lambda: network.set_link(a, b, False)))
+        print_phase(phases[-1], out)
+        phases.append(run_phase(network, "link %s-%s up" % (a, b), args.max_seconds,
+                                lambda: network.set_link(a, b, True)))
+        print_phase(phases[-1], out)
+
+    for error in NoLog.errors:
+        out.write("ERROR %s\n" % error)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"routers": args.routers, "addresses": args.addresses, "topology": args.topology,
+                       "links": len(network.up_links()), "seed": args.seed, "phases": phases,
+                       "errors": NoLog.errors}, f, indent=2)
+    return 0 if all(p["converged"] for p in phases) and not NoLog.errors else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include "config.h"
+#include <qpid/dispatch/alloc.h>
+#include <qpid/dispatch/buffer.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RUNS 16
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+
+bool bench_selected(bench_t *bench, const char *name)
+{
+    return !bench->filter || strstr(name, bench->filter);
+}
+
+
+void bench_run(bench_t *bench, const char *name, const char *param, long param_value,
+               bench_body_t body, void *context)
+{
+    if (!bench_selected(bench, name))
+        return;
+
+    //
+    // Warm up and find a count that runs for at least min_ns
+    //
+    uint64_t count = 1;
+    uint64_t elapsed = body(context, count);
+    while (elapsed < bench->min_ns && count < ((uint64_t) 1 << 40)) {
+        count *= 2;
+        elapsed = body(context, count);
+    }
+
+    uint64_t samples[MAX_RUNS];
+    int      runs = bench->runs < MAX_RUNS ? bench->runs : MAX_RUNS;
+    for (int i = 0; i < runs; i++)
+        samples[i] = body(context, count);
+    qsort(samples, runs, sizeof(uint64_t), compare_u64);
+
+    double min    = (double) samples[0] / count;
+    double median = (double) samples[runs / 2] / count;
+    double max    = (double) samples[runs - 1] / count;
+
+    fprintf(bench->out, "%s    {\"name\": \"%s\", ", bench->count ? ",\n" : "", name);
+    if (param)
+        fprintf(bench->out, "\"%s\": %ld, ", param, param_value);
+    fprintf(bench->out, "\"iterations\": %"PRIu64", \"runs\": %d, "
+            "\"ns_per_op\": {\"min\": %.2f, \"median\": %.2f, \"max\": %.2f}, \"ops_per_sec\": %.0f}",
+            count, runs, min, median, max, median > 0 ? 1e9 / median : 0.0);
+    fflush(bench->out);
+    bench->count++;
+
+    if (bench->out != stdout) {
+        if (param)
+            printf("%-40s %-8s %8ld %12.2f ns/op\n", name, param, param_value, median);
+        else
+            printf("%-40s %-8s %8s %12.2f ns/op\n", name, "", "", median);
+    }
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--quick] [--runs N] [--min-ms N] [--output FILE] [FILTER]\n", program);
+    fprintf(stderr, "Run the micro-benchmarks whose names contain FILTER and write the results as JSON.\n");
+}
+
+
+int main(int argc, char** argv)
+{
+    bench_t     bench  = { .out = stdout, .runs = 5, .min_ns = 50000000 };
+    const char *output = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            bench.quick = true;
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            bench.runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            bench.min_ns = (uint64_t) atoi(argv[++i]) * 1000000;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            bench.filter = argv[i];
+        }
+    }
+    if (bench.quick) {
+        bench.runs   = 1;
+        bench.min_ns = 1000000;
+    }
+    if (bench.runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (output) {
+        bench.out = fopen(output, "w");
+        if (!bench.out) {
+            perror(output);
+            return 1;
+        }
+    }
+
+    qd_alloc_initialize();
+    qd_buffer_set_size(512);
+
+    fprintf(bench.out, "{\"version\": \"%s\", \"memory_pool\": %s, \"buffer_size\": %d, \"quick\": %s,\n"
+            "  \"benchmarks\": [\n",
+            QPID_DISPATCH_VERSION, USE_MEMORY_POOL ? "true" : "false", 512, bench.quick ? "true" : "false");
+
+    alloc_benchmarks(&bench);
+    hash_benchmarks(&bench);
+    parse_tree_benchmarks(&bench);
+    message_benchmarks(&bench);
+    bitmask_benchmarks(&bench);
+
+    fprintf(bench.out, "\n  ]\n}\n");
+    if (bench.out != stdout)
+        fclose(bench.out);
+
+    qd_alloc_finalize();
+    return 0;
+}
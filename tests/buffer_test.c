@@ -73,26 +73,145 @@ static char *test_buffer_list_clone(void *context)
     unsigned int len = qd_buffer_list_clone(&copy, &list);
     if (len != pattern_len) return "Copy failed";
 
-    // 'corrupt' source buffer list:
-    *qd_buffer_base(DEQ_HEAD(list)) = (unsigned char)'X';
+    // the clone views the source's data, which must outlive the source buffers:
     qd_buffer_list_free_buffers(&list);
     if (!DEQ_IS_EMPTY(list)) return "List should be empty!";
 
     // ensure copy is un-molested:
     if (!compare_buffer(&copy, (unsigned char *)pattern, pattern_len)) return "Buffer list corrupted";
 
-    qd_buffer_list_free_buffers(&list);
     qd_buffer_list_free_buffers(&copy);
     return 0;
 }
 
 
+static char *test_buffer_view(void *context)
+{
+    char             *error = 0;
+    qd_buffer_list_t  list;
+    fill_buffer(&list, (unsigned char *)pattern, pattern_len);
+
+    //
+    // A view of a view shares the original data, which outlives the buffer it
+    // was written into.
+    //
+    qd_buffer_t *view = qd_buffer_view(DEQ_HEAD(list), 5, 20);
+    qd_buffer_t *sub  = qd_buffer_view(view, 6, 4);
+    qd_buffer_list_free_buffers(&list);
+    qd_buffer_free(view);
+
+    if (qd_buffer_size(sub) != 4)                        error = "View size mismatch";
+    else if (qd_buffer_capacity(sub) != 0)               error = "A view should be full";
+    else if (memcmp(qd_buffer_base(sub), pattern + 11, 4)) error = "View content mismatch";
+    else if (*qd_buffer_at(sub, 3) != pattern[14])       error = "View offset mismatch";
+
+    qd_buffer_free(sub);
+    return error;
+}
+
+
+static char *test_buffer_size_classes(void *context)
+{
+    char        *error = 0;
+    qd_buffer_t *small = qd_buffer_sized(0);
+    qd_buffer_t *skip  = qd_buffer_sized(BUFFER_SIZE * 2);
+    qd_buffer_t *large = qd_buffer_sized(BUFFER_SIZE * 1000);
+
+    //
+    // A hint below a class boundary stays in the smaller class.
+    //
+    if (qd_buffer_capacity(small) != BUFFER_SIZE)         error = "Small hint should give a base buffer";
+    else if (qd_buffer_capacity(skip) != BUFFER_SIZE)     error = "Hint below the next class should give a base buffer";
+    else if (qd_buffer_capacity(large) <= BUFFER_SIZE)    error = "Large hint should give a larger buffer";
+    else if (qd_buffer_units(small) != 1)                 error = "Base buffer should be one unit";
+    else if (qd_buffer_units(large) * BUFFER_SIZE != qd_buffer_capacity(large))
+        error = "Units should measure capacity in base buffers";
+
+    if (!error) {
+        //
+        // The whole capacity of a large buffer is usable, and cloning a chain of
+        // large buffers preserves the content.
+        //
+        size_t cap = qd_buffer_capacity(large);
+        memset(qd_buffer_cursor(large), 'x', cap);
+        qd_buffer_insert(large, cap);
+        if (qd_buffer_capacity(large) != 0) error = "Large buffer should be full";
+
+        qd_buffer_list_t list;
+        qd_buffer_list_t copy;
+        DEQ_INIT(list);
+        DEQ_INSERT_TAIL(list, large);
+        large = 0;
+        if (qd_buffer_list_clone(&copy, &list) != cap)           error = "Clone length mismatch";
+        else if (qd_buffer_list_length(&copy) != cap)            error = "Cloned list length mismatch";
+        else if (*qd_buffer_at(DEQ_TAIL(copy), qd_buffer_size(DEQ_TAIL(copy)) - 1) != 'x')
+            error = "Cloned content mismatch";
+        qd_buffer_list_free_buffers(&list);
+        qd_buffer_list_free_buffers(&copy);
+    }
+
+    qd_buffer_free(small);
+    qd_buffer_free(skip);
+    qd_buffer_free(large);
+    return error;
+}
+
+
+static char *test_buffer_spill(void *context)
+{
+    char              *error = 0;
+    qd_buffer_spill_t *spill = qd_buffer_spill(0);
+    if (!spill) return "Could not create a spill file";
+
+    qd_buffer_list_t list;
+    DEQ_INIT(list);
+    for (int i = 0; i < 3 && !error; i++) {
+        qd_buffer_t *buf = qd_buffer_spill_alloc(spill);
+        if (!buf) {
+            error = "Could not allocate a spilled buffer";
+            break;
+        }
+        if (!qd_buffer_is_spilled(buf))
+            error = "Buffer should be spilled";
+        size_t cap = qd_buffer_capacity(buf);
+        memset(qd_buffer_cursor(buf), 'a' + i, cap);
+        qd_buffer_insert(buf, cap);
+        DEQ_INSERT_TAIL(list, buf);
+
+        // the content must survive dropping the resident pages
+        qd_buffer_spill_evict(buf);
+    }
+
+    //
+    // The file stays open for the buffers after the owner lets go of it.
+    //
+    qd_buffer_spill_free(spill);
+
+    int i = 0;
+    for (qd_buffer_t *buf = DEQ_HEAD(list); buf && !error; buf = DEQ_NEXT(buf), i++) {
+        if (*qd_buffer_base(buf) != 'a' + i || *qd_buffer_at(buf, qd_buffer_size(buf) - 1) != 'a' + i)
+            error = "Spilled content mismatch";
+    }
+
+    qd_buffer_t *plain = qd_buffer();
+    if (!error && qd_buffer_is_spilled(plain))
+        error = "Pool buffer should not be spilled";
+    qd_buffer_free(plain);
+
+    qd_buffer_list_free_buffers(&list);
+    return error;
+}
+
+
 int buffer_tests()
 {
     int result = 0;
     char *test_group = "buffer_tests";
 
     TEST_CASE(test_buffer_list_clone, 0);
+    TEST_CASE(test_buffer_view, 0);
+    TEST_CASE(test_buffer_size_classes, 0);
+    TEST_CASE(test_buffer_spill, 0);
 
     return result;
 }
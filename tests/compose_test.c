@@ -393,6 +393,114 @@ static char *test_compose_subfields(void *context)
 }
 
 
+static void compose_template_prefix(qd_composed_field_t *field, const char *filler)
+{
+    qd_compose_start_list(field);
+    qd_compose_insert_string(field, filler);
+    qd_compose_start_map(field);
+    qd_compose_insert_symbol(field, "key");
+}
+
+
+static void compose_template_rest(qd_composed_field_t *field)
+{
+    qd_compose_insert_uint(field, 7);
+    qd_compose_end_map(field);
+    qd_compose_insert_string(field, "tail");
+    qd_compose_end_list(field);
+}
+
+
+static char *compose_template_compare(qd_composed_field_t *a, qd_composed_field_t *b)
+{
+    qd_buffer_list_t la, lb;
+    qd_compose_take_buffers(a, &la);
+    qd_compose_take_buffers(b, &lb);
+
+    size_t len = qd_buffer_list_length(&la);
+    char  *result = 0;
+    if (len != qd_buffer_list_length(&lb))
+        result = "Template encoding length differs";
+    else {
+        uint8_t *oa = malloc(len);
+        uint8_t *ob = malloc(len);
+        qd_buffer_t *buf = DEQ_HEAD(la);
+        for (uint8_t *c = oa; buf; buf = DEQ_NEXT(buf)) {
+            memcpy(c, qd_buffer_base(buf), qd_buffer_size(buf));
+            c += qd_buffer_size(buf);
+        }
+        buf = DEQ_HEAD(lb);
+        for (uint8_t *c = ob; buf; buf = DEQ_NEXT(buf)) {
+            memcpy(c, qd_buffer_base(buf), qd_buffer_size(buf));
+            c += qd_buffer_size(buf);
+        }
+        if (memcmp(oa, ob, len) != 0)
+            result = "Template encoding differs";
+        free(oa);
+        free(ob);
+    }
+
+    qd_buffer_list_free_buffers(&la);
+    qd_buffer_list_free_buffers(&lb);
+    return result;
+}
+
+
+static char *test_compose_template(void *context)
+{
+    // A short prefix, and one whose open composites straddle buffer boundaries
+    const size_t fill_lengths[] = {1, BUFFER_SIZE - 12, 3 * BUFFER_SIZE};
+
+    for (int i = 0; i < 3; i++) {
+        char *filler = malloc(fill_lengths[i] + 1);
+        memset(filler, 'x', fill_lengths[i]);
+        filler[fill_lengths[i]] = 0;
+
+        qd_composed_field_t *capture = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, 0);
+        compose_template_prefix(capture, filler);
+        qd_compose_template_t *tmpl = qd_compose_template(capture);
+        compose_template_prefix(capture, "");   // the template must not follow later changes
+        qd_compose_free(capture);
+
+        for (int extend = 0; extend < 2; extend++) {
+            qd_composed_field_t *expected = 0;
+            qd_composed_field_t *actual   = 0;
+            if (extend) {
+                expected = qd_compose(QD_PERFORMATIVE_HEADER, 0);
+                qd_compose_start_list(expected);
+                qd_compose_insert_string(expected, filler);
+                qd_compose_end_list(expected);
+                actual = qd_compose(QD_PERFORMATIVE_HEADER, 0);
+                qd_compose_start_list(actual);
+                qd_compose_insert_string(actual, filler);
+                qd_compose_end_list(actual);
+            }
+
+            expected = qd_compose(QD_PERFORMATIVE_BODY_AMQP_VALUE, expected);
+            compose_template_prefix(expected, filler);
+            compose_template_rest(expected);
+
+            actual = qd_compose_from_template(tmpl, actual);
+            compose_template_rest(actual);
+
+            char *result = compose_template_compare(expected, actual);
+            qd_compose_free(expected);
+            qd_compose_free(actual);
+            if (result) {
+                qd_compose_template_free(tmpl);
+                free(filler);
+                return result;
+            }
+        }
+
+        qd_compose_template_free(tmpl);
+        free(filler);
+    }
+
+    return 0;
+}
+
+
 int compose_tests()
 {
     int result = 0;
@@ -405,6 +513,7 @@ int compose_tests()
     TEST_CASE(test_compose_insert_empty_binary, 0);
     TEST_CASE(test_compose_scalars, 0);
     TEST_CASE(test_compose_subfields, 0);
+    TEST_CASE(test_compose_template, 0);
 
     return result;
 }
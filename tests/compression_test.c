@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "test_case.h"
+#include "compression.h"
+
+#define TEXT_SIZE 50000
+
+typedef struct {
+    char   data[TEXT_SIZE];
+    size_t length;
+} wire_t;
+
+
+static void wire_output(void *context, const char *data, size_t length)
+{
+    wire_t *wire = (wire_t*) context;
+    memcpy(wire->data + wire->length, data, length);
+    wire->length += length;
+}
+
+
+static void fill_text(char *text, size_t length, int seed)
+{
+    for (size_t i = 0; i < length; i++)
+        text[i] = "message body "[(i + seed) % 13];
+}
+
+
+//
+// Inflate the wire bytes, feeding them in small slices and reading into a small
+// buffer so that both input and output must be resumed.
+//
+static size_t inflate_wire(qd_inflater_t *inflater, const wire_t *wire, char *out, size_t capacity)
+{
+    size_t in_offset  = 0;
+    size_t out_length = 0;
+
+    while (out_length < capacity) {
+        ssize_t produced = qd_inflater_read(inflater, out + out_length, 100 < capacity - out_length ? 100 : capacity - out_length);
+        if (produced < 0)
+            return 0;
+        out_length += produced;
+        if (produced == 0) {
+            size_t room;
+            char  *input = qd_inflater_input(inflater, &room);
+            if (!input || in_offset == wire->length)
+                break;
+            size_t slice = wire->length - in_offset < 700 ? wire->length - in_offset : 700;
+            memcpy(input, wire->data + in_offset, slice);
+            qd_inflater_input_added(inflater, slice);
+            in_offset += slice;
+        }
+    }
+    return out_length;
+}
+
+
+static char *test_round_trip(void *context)
+{
+    static char    text[TEXT_SIZE];
+    static char    out[TEXT_SIZE];
+    static wire_t  wire;
+    char          *fail     = 0;
+    qd_deflater_t *deflater = qd_deflater();
+    qd_inflater_t *inflater = qd_inflater();
+
+    //
+    // Two deliveries, each written in pieces and reset before it starts
+    //
+    for (int delivery = 0; delivery < 2 && !fail; delivery++) {
+        fill_text(text, TEXT_SIZE, delivery);
+        wire.length = 0;
+        qd_deflater_reset(deflater);
+        qd_inflater_reset(inflater);
+
+        ssize_t total = 0;
+        for (size_t offset = 0; offset < TEXT_SIZE; offset += 10000)
+            total += qd_deflater_write(deflater, text + offset, 10000, wire_output, &wire);
+        if (total != (ssize_t) wire.length || wire.length >= TEXT_SIZE / 10) {
+            fail = "Repeated text did not compress";
+            break;
+        }
+
+        if (inflate_wire(inflater, &wire, out, TEXT_SIZE) != TEXT_SIZE || memcmp(text, out, TEXT_SIZE) != 0)
+            fail = "Inflated bytes differ from the original";
+        else if (qd_inflater_read(inflater, out, sizeof(out)) != 0 || qd_inflater_pending(inflater))
+            fail = "Inflater still pending after the whole delivery";
+    }
+
+    qd_deflater_free(deflater);
+    qd_inflater_free(inflater);
+    return fail;
+}
+
+
+static char *test_corrupt_input(void *context)
+{
+    static const char garbage[] = "\xff\xff\xff\xff not a deflate stream";
+    char             *fail      = 0;
+    qd_inflater_t    *inflater  = qd_inflater();
+    char              out[64];
+    size_t            room;
+
+    char *input = qd_inflater_input(inflater, &room);
+    memcpy(input, garbage, sizeof(garbage));
+    qd_inflater_input_added(inflater, sizeof(garbage));
+    if (qd_inflater_read(inflater, out, sizeof(out)) >= 0)
+        fail = "Expected an error for corrupt input";
+
+    qd_inflater_free(inflater);
+    return fail;
+}
+
+
+int compression_tests(void)
+{
+    int result = 0;
+    char *test_group = "compression_tests";
+
+    if (!qd_compression_supported())
+        return 0;
+
+    TEST_CASE(test_round_trip, 0);
+    TEST_CASE(test_corrupt_input, 0);
+
+    return result;
+}
@@ -25,17 +25,29 @@
 void qdr_process_tick_CT(qdr_core_t *core, qdr_action_t *action, bool discard);
 
 
-static int results[5];
+static int     results[5];
+static int64_t now_msec;
 
 static void callback(qdr_core_t *unused, void *context) {
     results[(long) context]++;
 }
 
 
+//
+// Advance the timer clock by a second
+//
+static void tick(qdr_core_t *core)
+{
+    now_msec += 1000;
+    qdr_core_timer_process_CT(core, now_msec);
+}
+
+
 static char* test_core_timer(void *context)
 {
     qdr_core_t *core = NEW(qdr_core_t);
     ZERO(core);
+    now_msec = 0;
 
     qdr_core_timer_t *timers[5];
 
@@ -66,7 +78,7 @@ static char* test_core_timer(void *context)
     //
     // Test zero-length timer
     //
-    qdr_process_tick_CT(core, 0, false);
+    qdr_core_timer_process_CT(core, now_msec);
     if (results[0] != 0 ||
         results[1] != 0 ||
         results[2] != 0 ||
@@ -77,7 +89,7 @@ static char* test_core_timer(void *context)
     //
     // Test 1-timer
     //
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
     if (results[0] != 0 ||
         results[1] != 0 ||
         results[2] != 1 ||
@@ -93,16 +105,16 @@ static char* test_core_timer(void *context)
     //
     // Test 5-timer
     //
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
+    tick(core);
+    tick(core);
     if (results[0] != 0 ||
         results[1] != 0 ||
         results[2] != 1 ||
         results[3] != 0 ||
         results[4] != 1)
         return "Expected timer(5) to not have fired yet";
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
     if (results[0] != 1 ||
         results[1] != 0 ||
         results[2] != 1 ||
@@ -114,14 +126,14 @@ static char* test_core_timer(void *context)
     // Test 15-timer
     //
     for (long i = 0; i < 9; i++)
-        qdr_process_tick_CT(core, 0, false);
+        tick(core);
     if (results[0] != 1 ||
         results[1] != 0 ||
         results[2] != 1 ||
         results[3] != 0 ||
         results[4] != 1)
         return "Expected timer(15) and timer(10) to not have fired";
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
     if (results[0] != 1 ||
         results[1] != 0 ||
         results[2] != 1 ||
@@ -133,7 +145,7 @@ static char* test_core_timer(void *context)
     // Run with no timers for awhile
     //
     for (long i = 0; i < 100; i++)
-        qdr_process_tick_CT(core, 0, false);
+        tick(core);
     if (results[0] != 1 ||
         results[1] != 0 ||
         results[2] != 1 ||
@@ -146,18 +158,17 @@ static char* test_core_timer(void *context)
     //
     qdr_core_timer_schedule_CT(core, timers[0], 5);
     qdr_core_timer_schedule_CT(core, timers[1], 5);
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
+    tick(core);
+    tick(core);
+    tick(core);
     if (results[0] != 1 ||
         results[1] != 0 ||
         results[2] != 1 ||
         results[3] != 1 ||
         results[4] != 1)
         return "Expected no timers to have fired while waiting for 5-timers";
-    qdr_process_tick_CT(core, 0, false);
+    tick(core);
     if (results[0] != 2 ||
         results[1] != 1 ||
         results[2] != 1 ||
@@ -171,6 +182,42 @@ static char* test_core_timer(void *context)
     for (long i = 0; i < 5; i++)
         qdr_core_timer_free_CT(core, timers[i]);
 
+    free(core);
+    return 0;
+}
+
+
+static char* test_core_timer_msec(void *context)
+{
+    qdr_core_t *core = NEW(qdr_core_t);
+    ZERO(core);
+
+    qdr_core_timer_t *timers[3];
+    for (long i = 0; i < 3; i++) {
+        timers[i]  = qdr_core_timer_CT(core, callback, (void*) i);
+        results[i] = 0;
+    }
+
+    qdr_core_timer_schedule_msec_CT(core, timers[0], 10);
+    qdr_core_timer_schedule_msec_CT(core, timers[1], 250);
+    qdr_core_timer_schedule_msec_CT(core, timers[2], 1);
+
+    if (qdr_core_timer_process_CT(core, 1) != 10 || results[2] != 1 || results[0] != 0)
+        return "Expected timer(1ms) to fire first";
+    if (qdr_core_timer_process_CT(core, 9) != 10 || results[0] != 0)
+        return "Expected timer(10ms) to not have fired yet";
+    if (qdr_core_timer_process_CT(core, 10) != 250 || results[0] != 1 || results[1] != 0)
+        return "Expected timer(10ms) to fire once";
+    if (!qdr_core_timer_scheduled_CT(timers[1]))
+        return "Expected timer(250ms) to be scheduled";
+    if (qdr_core_timer_process_CT(core, 100000) != -1 || results[1] != 1)
+        return "Expected timer(250ms) to fire once";
+    if (qdr_core_timer_scheduled_CT(timers[1]))
+        return "Expected no timer to be scheduled";
+
+    for (long i = 0; i < 3; i++)
+        qdr_core_timer_free_CT(core, timers[i]);
+    free(core);
     return 0;
 }
 
@@ -181,6 +228,7 @@ int core_timer_tests(void)
     char *test_group = "core_timer_tests";
 
     TEST_CASE(test_core_timer, 0);
+    TEST_CASE(test_core_timer_msec, 0);
 
     return result;
 }
@@ -23,6 +23,7 @@
 #include <qpid/dispatch/iterator.h>
 #include <qpid/dispatch/hash.h>
 #include <qpid/dispatch/router.h>
+#include "iterator_private.h"
 
 #define FAIL_TEXT_SIZE 10000
 static char fail_text[FAIL_TEXT_SIZE];
@@ -317,6 +318,10 @@ static char* test_view_address_hash(void *context)
     {"/mobile",                                 "M1mobile"},
     {"amqp:/_edge/router/sub",                  "Hrouter"},
     {"_edge/router/sub",                        "Hrouter"},
+    {"_topo/all/my-router/my-addr",             "Lmy-addr"},
+    {"_topo/all/router/my-addr",                "Rrouter"},
+    {"_topology/mobile",                        "M1topology/mobile"},
+    {"_my-area/mobile",                         "M1my-area/mobile"},
 
     // Re-run the above tests to make sure trailing dots are ignored.
     {"amqp:/_local/my-addr/sub.",                "Lmy-addr/sub"},
@@ -534,6 +539,51 @@ static char* test_view_address_hash_with_space(void *context)
 }
 
 
+static char* test_view_address_space_hash(void *context)
+{
+    struct {const char *addr; qd_iterator_view_t view; char phase; const char *octets;} cases[] = {
+    {"amqp:/link-target",            ITER_VIEW_ADDRESS_HASH,       '0', "M0test.vhost/link-target"},
+    {"domain/link-target",           ITER_VIEW_ADDRESS_HASH,       '1', "M1test.vhost/domain/link-target"},
+    {"amqp:/link-target",            ITER_VIEW_ADDRESS_WITH_SPACE, '0', "test.vhost/link-target"},
+    {"_topo/my-area/router/address", ITER_VIEW_ADDRESS_HASH,       '0', "Rrouter"},
+    {"_local/address",               ITER_VIEW_ADDRESS_WITH_SPACE, '0', "_local/address"},
+    {0, 0, 0, 0}
+    };
+    qd_iterator_space_t *space = qd_iterator_space("test.vhost/", 11);
+    char                *error = 0;
+
+    //
+    // A view annotated with a precomputed space must hash and compare exactly
+    // as if its octets were a plain string.
+    //
+    for (int idx = 0; cases[idx].addr && !error; idx++) {
+        qd_buffer_list_t chain;
+        DEQ_INIT(chain);
+        build_buffer_chain(&chain, cases[idx].addr, 3);
+
+        qd_iterator_t *plain   = qd_iterator_string(cases[idx].octets, ITER_VIEW_ALL);
+        qd_iterator_t *iters[] = {qd_iterator_string(cases[idx].addr, cases[idx].view),
+                                  qd_iterator_buffer(DEQ_HEAD(chain), 0, strlen(cases[idx].addr), cases[idx].view)};
+
+        for (int i = 0; i < 2; i++) {
+            qd_iterator_annotate_space_hash(iters[i], space);
+            qd_iterator_annotate_phase(iters[i], cases[idx].phase);
+            if (!error && qd_iterator_hash_view(iters[i]) != qd_iterator_hash_view(plain))
+                error = "hash of the annotated view does not match its octets";
+            if (!error && !qd_iterator_equal(iters[i], (const unsigned char*) cases[idx].octets))
+                error = "annotated view does not equal its octets";
+            qd_iterator_free(iters[i]);
+        }
+
+        qd_iterator_free(plain);
+        release_buffer_chain(&chain);
+    }
+
+    qd_iterator_space_free(space);
+    return error;
+}
+
+
 static char* test_view_node_hash(void *context)
 {
     struct {const char *addr; const char *view;} cases[] = {
@@ -616,6 +666,61 @@ static char* test_field_advance_buffer(void *context)
     return ret;
 }
 
+static char *test_buffer_chain_runs(void *context)
+{
+    //
+    // Compare, hash and copy a view that is split into buffers of every size
+    // against the same view over a flat string.
+    //
+    const char *text   = "amqp:/global.sub/node.a";
+    int         length = strlen(text);
+    static char error[200];
+
+    qd_iterator_t *flat      = qd_iterator_string(text, ITER_VIEW_ADDRESS_HASH);
+    uint32_t       flat_hash = qd_iterator_hash_view(flat);
+    unsigned char  flat_copy[64];
+    int            flat_len  = qd_iterator_ncopy(flat, flat_copy, sizeof(flat_copy));
+
+    for (int segment = 1; segment <= length; segment++) {
+        qd_buffer_list_t chain;
+        DEQ_INIT(chain);
+        build_buffer_chain(&chain, text, segment);
+
+        qd_iterator_t *iter = qd_iterator_buffer(DEQ_HEAD(chain), 0, length, ITER_VIEW_ALL);
+        unsigned char  copy[64];
+        int            copy_len;
+
+        error[0] = 0;
+        if (!qd_iterator_equal(iter, (const unsigned char*) text))
+            sprintf(error, "(%d) equal failed", segment);
+        else if (qd_iterator_equal(iter, (const unsigned char*) "amqp:/global.sub/node"))
+            sprintf(error, "(%d) equal matched a prefix", segment);
+        else if (!qd_iterator_prefix(iter, "amqp:/global.") || !qd_iterator_prefix(iter, "sub/"))
+            sprintf(error, "(%d) prefix failed", segment);
+        else if (qd_iterator_prefix(iter, "node.b") || !qd_iterator_prefix(iter, "node.a"))
+            sprintf(error, "(%d) prefix did not restore the cursor", segment);
+        else {
+            qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_HASH);
+            copy_len = qd_iterator_ncopy(iter, copy, sizeof(copy));
+            if (qd_iterator_hash_view(iter) != flat_hash)
+                sprintf(error, "(%d) hash mismatch", segment);
+            else if (copy_len != flat_len || memcmp(copy, flat_copy, copy_len) != 0)
+                sprintf(error, "(%d) copy mismatch", segment);
+        }
+
+        qd_iterator_free(iter);
+        release_buffer_chain(&chain);
+        if (error[0]) {
+            qd_iterator_free(flat);
+            return error;
+        }
+    }
+
+    qd_iterator_free(flat);
+    return 0;
+}
+
+
 static char *test_qd_hash_retrieve_prefix_separator(void *context)
 {
     qd_hash_t *hash = qd_hash(10, 32, 0);
@@ -1019,6 +1124,248 @@ static char *test_prefix_hash(void *context)
 }
 
 
+static char *test_memoized_view_hash(void *context)
+{
+    const char    *text  = "amqp:/my.address";
+    qd_iterator_t *iter  = qd_iterator_string(text, ITER_VIEW_ADDRESS_HASH);
+    char          *error = 0;
+
+    //
+    // The memoized hash must always match the hash of an equivalent,
+    // freshly-created iterator.
+    //
+    uint32_t first = qd_iterator_hash_view(iter);
+    qd_iterator_reset_view(iter, ITER_VIEW_ADDRESS_HASH);
+    if (qd_iterator_hash_view(iter) != first)
+        error = "hash changed after re-selecting the same view";
+
+    qd_iterator_annotate_phase(iter, '1');
+    qd_iterator_t *fresh = qd_iterator_string(text, ITER_VIEW_ADDRESS_HASH);
+    qd_iterator_annotate_phase(fresh, '1');
+    if (!error && (qd_iterator_hash_view(iter) == first || qd_iterator_hash_view(iter) != qd_iterator_hash_view(fresh)))
+        error = "hash not updated for the phase annotation";
+    qd_iterator_free(fresh);
+
+    qd_iterator_annotate_prefix(iter, 'C');
+    fresh = qd_iterator_string(text, ITER_VIEW_ADDRESS_HASH);
+    qd_iterator_annotate_prefix(fresh, 'C');
+    if (!error && qd_iterator_hash_view(iter) != qd_iterator_hash_view(fresh))
+        error = "hash not updated for the prefix annotation";
+    qd_iterator_free(fresh);
+
+    qd_iterator_reset_view(iter, ITER_VIEW_ALL);
+    fresh = qd_iterator_string(text, ITER_VIEW_ALL);
+    if (!error && qd_iterator_hash_view(iter) != qd_iterator_hash_view(fresh))
+        error = "hash not updated for the new view";
+    qd_iterator_free(fresh);
+
+    qd_iterator_reset(iter);
+    qd_iterator_trim_view(iter, 8);
+    fresh = qd_iterator_string("amqp:/my", ITER_VIEW_ALL);
+    if (!error && qd_iterator_hash_view(iter) != qd_iterator_hash_view(fresh))
+        error = "hash not updated for the trimmed view";
+    qd_iterator_free(fresh);
+
+    qd_iterator_free(iter);
+    return error;
+}
+
+
+static char *test_prefix_hash_many_segments(void *context)
+{
+    static char error[200];
+    char *entries[] = {"a.b.c.d.e.f.g.h.i.j.k",         //  0
+                       "a.b.c",                         //  1
+                       "a.b.c.d.e.f.g.h.i",             //  2
+                       0};
+    struct { char* pattern; int entry; } patterns[] = {{"a.b.c.d.e.f.g.h.i.j.k.l.m", 0},
+                                                       {"a.b.c.d.e.f.g.h.i.j.x.y.z", 2},
+                                                       {"a.b.c.d.e.f.g.h.x", 1},
+                                                       {"a.b.x", -1},
+                                                       {0, 0}};
+
+    qd_hash_t *hash = qd_hash(10, 32, 0);
+    long idx = 0;
+
+    while (entries[idx]) {
+        qd_iterator_t *iter = qd_iterator_string(entries[idx], ITER_VIEW_ADDRESS_HASH);
+        qd_hash_insert(hash, iter, (void*) (idx + 1), 0);
+        qd_iterator_free(iter);
+        idx++;
+    }
+
+    //
+    // The patterns have more segments than the iterator holds inline; look
+    // them up with both pooled and caller-storage iterators
+    //
+    idx = 0;
+    while (patterns[idx].pattern) {
+        qd_iterator_t *iter = qd_iterator_string(patterns[idx].pattern, ITER_VIEW_ADDRESS_HASH);
+        qd_iterator_t  local;
+        void          *ptr       = 0;
+        void          *local_ptr = 0;
+
+        qd_iterator_init_string(&local, patterns[idx].pattern, ITER_VIEW_ADDRESS_HASH);
+        qd_hash_retrieve_prefix(hash, iter, &ptr);
+        qd_hash_retrieve_prefix(hash, &local, &local_ptr);
+        qd_iterator_free(iter);
+        qd_iterator_fini(&local);
+
+        int position = (int) ((long) ptr) - 1;
+        if (position != patterns[idx].entry || local_ptr != ptr) {
+            snprintf(error, 200, "Pattern: '%s', expected %d, got %d (%d in caller storage)",
+                     patterns[idx].pattern, patterns[idx].entry, position, (int) ((long) local_ptr) - 1);
+            qd_hash_free(hash);
+            return error;
+        }
+        idx++;
+    }
+
+    qd_hash_free(hash);
+    return 0;
+}
+
+
+static char *test_hash_growth_and_removal(void *context)
+{
+    static char error[200];
+    const int   count = 5000;
+    char        key[100];
+
+    // Start with a small table so that it must grow many times
+    qd_hash_t         *hash    = qd_hash(3, 0, 0);
+    qd_hash_handle_t **handles = NEW_ARRAY(qd_hash_handle_t*, count);
+
+    //
+    // Alternate short keys (stored inline) with long ones (allocated)
+    //
+    for (int idx = 0; idx < count; idx++) {
+        snprintf(key, sizeof(key), (idx & 1) ? "address/with/a/much/longer/name/that/is/not/inline/%d" : "a%d", idx);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+        qd_error_t     err  = qd_hash_insert(hash, iter, (void*) (intptr_t) (idx + 1), &handles[idx]);
+        qd_iterator_free(iter);
+        if (err != QD_ERROR_NONE) {
+            snprintf(error, 200, "Insert of '%s' failed", key);
+            goto exit;
+        }
+    }
+
+    for (int idx = 0; idx < count; idx++) {
+        snprintf(key, sizeof(key), (idx & 1) ? "address/with/a/much/longer/name/that/is/not/inline/%d" : "a%d", idx);
+        if (strcmp(key, (const char*) qd_hash_key_by_handle(handles[idx])) != 0) {
+            snprintf(error, 200, "Key by handle mismatch for '%s'", key);
+            goto exit;
+        }
+
+        // Remove every third item, alternately by handle and by key
+        if (idx % 3 == 0) {
+            if (idx & 1)
+                qd_hash_remove_by_handle(hash, handles[idx]);
+            else {
+                qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+                qd_hash_remove(hash, iter);
+                qd_iterator_free(iter);
+            }
+            qd_hash_handle_free(handles[idx]);
+            handles[idx] = 0;
+        }
+    }
+
+    if (qd_hash_size(hash) != count - (count + 2) / 3) {
+        snprintf(error, 200, "Expected %d items, got %zu", count - (count + 2) / 3, qd_hash_size(hash));
+        goto exit;
+    }
+
+    for (int idx = 0; idx < count; idx++) {
+        snprintf(key, sizeof(key), (idx & 1) ? "address/with/a/much/longer/name/that/is/not/inline/%d" : "a%d", idx);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+        void          *val;
+        qd_hash_retrieve(hash, iter, &val);
+        qd_iterator_free(iter);
+        if ((intptr_t) val != (idx % 3 == 0 ? 0 : idx + 1)) {
+            snprintf(error, 200, "Wrong value retrieved for '%s'", key);
+            goto exit;
+        }
+    }
+
+    error[0] = 0;
+
+exit:
+    for (int idx = 0; idx < count; idx++)
+        qd_hash_handle_free(handles[idx]);
+    free(handles);
+    qd_hash_free(hash);
+    return error[0] ? error : 0;
+}
+
+
+static char *test_hash_incremental_growth(void *context)
+{
+    static char error[200];
+    const int   keys = 3000;
+    char        key[64];
+    uint32_t    seed = 1;
+
+    //
+    // Interleave inserts, removals and lookups so that many of them happen
+    // while the table is migrating into a larger one.
+    //
+    qd_hash_t         *hash    = qd_hash(3, 0, 0);
+    qd_hash_handle_t **handles = NEW_ARRAY(qd_hash_handle_t*, keys);
+    memset(handles, 0, sizeof(qd_hash_handle_t*) * keys);
+    error[0] = 0;
+
+    for (int op = 0; op < 40000 && !error[0]; op++) {
+        seed = seed * 1103515245 + 12345;
+        int k = (seed >> 8) % keys;
+
+        // Bias towards inserts early on so the table keeps growing
+        bool insert = !handles[k] || (op < 20000 && (seed & 0x3) != 0);
+        snprintf(key, sizeof(key), "key.%d", k);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+
+        if (!handles[k] && insert) {
+            if (qd_hash_insert(hash, iter, (void*) (intptr_t) (k + 1), &handles[k]) != QD_ERROR_NONE)
+                snprintf(error, 200, "Insert of '%s' failed", key);
+        } else if (handles[k] && !insert) {
+            if (k & 1)
+                qd_hash_remove_by_handle(hash, handles[k]);
+            else if (qd_hash_remove(hash, iter) != QD_ERROR_NONE)
+                snprintf(error, 200, "Remove of '%s' failed", key);
+            qd_hash_handle_free(handles[k]);
+            handles[k] = 0;
+        }
+
+        void *val;
+        qd_hash_retrieve(hash, iter, &val);
+        if ((intptr_t) val != (handles[k] ? k + 1 : 0))
+            snprintf(error, 200, "Wrong value for '%s' after op %d", key, op);
+        qd_iterator_free(iter);
+    }
+
+    size_t present = 0;
+    for (int k = 0; k < keys && !error[0]; k++) {
+        snprintf(key, sizeof(key), "key.%d", k);
+        qd_iterator_t *iter = qd_iterator_string(key, ITER_VIEW_ALL);
+        void          *val;
+        qd_hash_retrieve(hash, iter, &val);
+        qd_iterator_free(iter);
+        if ((intptr_t) val != (handles[k] ? k + 1 : 0))
+            snprintf(error, 200, "Wrong final value for '%s'", key);
+        present += handles[k] ? 1 : 0;
+    }
+
+    if (!error[0] && present != qd_hash_size(hash))
+        snprintf(error, 200, "Expected %zu items, got %zu", present, qd_hash_size(hash));
+
+    for (int k = 0; k < keys; k++)
+        qd_hash_handle_free(handles[k]);
+    free(handles);
+    qd_hash_free(hash);
+    return error[0] ? error : 0;
+}
+
+
 static char *test_prefix_hash_with_space(void *context)
 {
     static char error[200];
@@ -1111,9 +1458,11 @@ int field_tests(void)
     TEST_CASE(test_view_address_with_space, 0);
     TEST_CASE(test_view_address_hash_override, 0);
     TEST_CASE(test_view_address_hash_with_space, 0);
+    TEST_CASE(test_view_address_space_hash, 0);
     TEST_CASE(test_view_node_hash, 0);
     TEST_CASE(test_field_advance_string, 0);
     TEST_CASE(test_field_advance_buffer, 0);
+    TEST_CASE(test_buffer_chain_runs, 0);
     TEST_CASE(test_qd_hash_retrieve_prefix_separator, 0);
     TEST_CASE(test_qd_hash_retrieve_prefix, 0);
     TEST_CASE(test_qd_hash_retrieve_prefix_no_match, 0);
@@ -1125,6 +1474,10 @@ int field_tests(void)
     TEST_CASE(test_qd_hash_retrieve_prefix_separator_exact_match_dot_at_end_1, 0);
     TEST_CASE(test_prefix_hash, 0);
     TEST_CASE(test_prefix_hash_with_space, 0);
+    TEST_CASE(test_prefix_hash_many_segments, 0);
+    TEST_CASE(test_memoized_view_hash, 0);
+    TEST_CASE(test_hash_growth_and_removal, 0);
+    TEST_CASE(test_hash_incremental_growth, 0);
 
     qd_iterator_set_address(true, "my-area", "my-router");
     TEST_CASE(test_view_address_hash_edge, 0);
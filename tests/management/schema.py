@@ -26,7 +26,7 @@ from __future__ import absolute_import
 from __future__ import print_function
 
 import unittest, json
-from qpid_dispatch_internal.management.schema import Schema, BooleanType, EnumType, AttributeType, ValidationError, EnumValue, EntityType
+from qpid_dispatch_internal.management.schema import Schema, BooleanType, EnumType, AttributeType, ValidationError, EnumValue, EntityType, UniqueIndex
 from qpid_dispatch_internal.compat import OrderedDict
 import collections
 
@@ -146,6 +146,24 @@ class SchemaTest(unittest.TestCase):
              {'type': 'listener', 'name':'y'}]
         s.validate_all(m)
 
+    def test_unique_index(self):
+        s = Schema(**SCHEMA_1)
+        index = UniqueIndex(s)
+        x = {'type': 'listener', 'name':'x'}
+        s.validate_add(x, [], index)
+        index.add(x)
+        self.assertRaises(ValidationError, s.validate_add, {'type': 'connector', 'name':'x'}, [], index)
+        s.validate_add({'type': 'connector', 'name':'y'}, [], index)
+        c = {'type': 'container', 'name':'c'}
+        s.validate_add(c, [], index)
+        index.add(c)
+        self.assertRaises(ValidationError, s.validate_add, {'type': 'container', 'name':'d'}, [], index)
+        # Removed entities no longer clash
+        index.remove(x)
+        index.remove(c)
+        s.validate_add({'type': 'connector', 'name':'x'}, [], index)
+        s.validate_add({'type': 'container', 'name':'d'}, [], index)
+
     def test_schema_entity(self):
         s = Schema(**SCHEMA_1)
         self.assertRaises(ValidationError, s.entity, {'type': 'nosuch'})
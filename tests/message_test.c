@@ -57,6 +57,8 @@ static void set_content(qd_message_content_t *content, size_t len)
         cursor += segment;
         qd_buffer_insert(buf, segment);
         DEQ_INSERT_TAIL(content->buffers, buf);
+        content->buffer_units  += qd_buffer_units(buf);
+        content->buffer_octets += segment;
     }
 }
 
@@ -295,6 +297,69 @@ static char* test_check_multiple(void *context)
 }
 
 
+static char* test_check_streaming(void *context)
+{
+    pn_message_t *pn_msg = pn_message();
+    pn_message_set_address(pn_msg, "test_addr_3");
+    pn_message_set_subject(pn_msg, "streaming");
+
+    size_t size = 10000;
+    int result = pn_message_encode(pn_msg, buffer, &size);
+    pn_message_free(pn_msg);
+    if (result != 0) return "Error in pn_message_encode";
+
+    //
+    // Deliver the encoded message a few octets at a time.  While it is still
+    // arriving, the check must not pass until the properties have all arrived.
+    //
+    for (size_t chunk = 1; chunk <= 8; chunk++) {
+        qd_message_t         *msg     = qd_message();
+        qd_message_content_t *content = MSG_CONTENT(msg);
+        size_t                offset  = 0;
+        bool                  valid   = false;
+
+        content->input_link = (qd_link_t*) content;  // any link: still being received
+        while (offset < size) {
+            size_t       len = size - offset < chunk ? size - offset : chunk;
+            qd_buffer_t *buf = qd_buffer_sized(len);
+            memcpy(qd_buffer_cursor(buf), buffer + offset, len);
+            qd_buffer_insert(buf, len);
+            DEQ_INSERT_TAIL(content->buffers, buf);
+            offset += len;
+
+            bool now_valid = qd_message_check(msg, QD_DEPTH_PROPERTIES);
+            if (valid && !now_valid) {
+                qd_message_free(msg);
+                return "qd_message_check became 'invalid' as more of the message arrived";
+            }
+            valid = now_valid;
+        }
+        content->input_link       = 0;
+        content->receive_complete = true;
+
+        if (!qd_message_check(msg, QD_DEPTH_ALL)) {
+            qd_message_free(msg);
+            return "qd_message_check returns 'invalid' for a streamed message";
+        }
+
+        qd_iterator_t *iter = qd_message_field_iterator(msg, QD_FIELD_TO);
+        bool to_ok = iter && qd_iterator_equal(iter, (unsigned char*) "test_addr_3");
+        qd_iterator_free(iter);
+        iter = qd_message_field_iterator(msg, QD_FIELD_SUBJECT);
+        bool subject_ok = iter && qd_iterator_equal(iter, (unsigned char*) "streaming");
+        qd_iterator_free(iter);
+        qd_message_free(msg);
+
+        if (!to_ok)
+            return "Address mismatch in streamed message";
+        if (!subject_ok)
+            return "Subject mismatch in streamed message";
+    }
+
+    return 0;
+}
+
+
 static char* test_send_message_annotations(void *context)
 {
     qd_message_t         *msg     = qd_message();
@@ -371,6 +436,206 @@ static char* test_send_message_annotations(void *context)
 }
 
 
+static char* test_router_annotations_lazy(void *context)
+{
+    qd_message_t *src = qd_message();
+
+    qd_composed_field_t *trace = qd_compose_subfield(0);
+    qd_compose_start_list(trace);
+    qd_compose_insert_string(trace, "Node1");
+    qd_compose_insert_string(trace, "Node2");
+    qd_compose_end_list(trace);
+    qd_message_set_trace_annotation(src, trace);
+
+    qd_composed_field_t *to_override = qd_compose_subfield(0);
+    qd_compose_insert_string(to_override, "to/address");
+    qd_message_set_to_override_annotation(src, to_override);
+
+    qd_message_compose_1(src, "test_addr_0", 0);
+    size_t len = flatten_bufs(MSG_CONTENT(src));
+    qd_message_free(src);
+
+    qd_message_t         *msg     = qd_message();
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    set_content(content, len);
+
+    //
+    // Locating the annotations must not parse any of them.
+    //
+    qd_message_message_annotations(msg);
+    if (content->ma_pf_trace || content->ma_pf_to_override || content->ma_pf_ingress || content->ma_pf_phase) {
+        qd_message_free(msg);
+        return "Router annotations parsed before they were asked for";
+    }
+    if (content->ma_count != 0) {
+        qd_message_free(msg);
+        return "Unexpected user annotations";
+    }
+
+    char *error = 0;
+    qd_parsed_field_t *to = qd_message_get_to_override(msg);
+    if (!to || !qd_iterator_equal(qd_parse_raw(to), (unsigned char*) "to/address"))
+        error = "Bad to override";
+    qd_parsed_field_t *pf_trace = qd_message_get_trace(msg);
+    if (!error && (!pf_trace || !qd_parse_is_list(pf_trace) || qd_parse_sub_count(pf_trace) != 2))
+        error = "Bad trace";
+    if (!error && (qd_message_get_ingress(msg) || qd_message_get_phase(msg)))
+        error = "Unexpected ingress or phase annotation";
+    if (!error && qd_message_get_phase_val(msg) != 0)
+        error = "Unexpected phase value";
+
+    qd_message_free(msg);
+    return error;
+}
+
+
+static char* test_sequence_annotation(void *context)
+{
+    qd_message_t *src = qd_message();
+
+    qd_composed_field_t *sequence = qd_compose_subfield(0);
+    qd_compose_insert_string(sequence, "Router.A/42");
+    qd_message_set_sequence_annotation(src, sequence);
+    if (!qd_message_has_sequence_annotation(src)) {
+        qd_message_free(src);
+        return "Sequence annotation not set";
+    }
+
+    qd_message_compose_1(src, "test_addr_0", 0);
+    size_t len = flatten_bufs(MSG_CONTENT(src));
+    qd_message_free(src);
+
+    qd_message_t         *msg     = qd_message();
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    set_content(content, len);
+
+    char *error = 0;
+    qd_parsed_field_t *pf_sequence = qd_message_get_sequence(msg);
+    if (!pf_sequence || !qd_iterator_equal(qd_parse_raw(pf_sequence), (unsigned char*) "Router.A/42"))
+        error = "Bad sequence annotation";
+    if (!error && (qd_message_get_trace(msg) || qd_message_get_ingress(msg)))
+        error = "Unexpected trace or ingress annotation";
+    if (!error && qd_message_has_sequence_annotation(msg))
+        error = "Incoming sequence taken for an outgoing one";
+
+    qd_message_free(msg);
+    return error;
+}
+
+
+static char* test_copy_shares_annotations(void *context)
+{
+    qd_message_t *src = qd_message();
+
+    qd_composed_field_t *trace = qd_compose_subfield(0);
+    qd_compose_start_list(trace);
+    qd_compose_insert_string(trace, "Node1");
+    qd_compose_end_list(trace);
+    qd_message_set_trace_annotation(src, trace);
+    qd_message_compose_1(src, "test_addr_0", 0);
+
+    qd_message_t     *copy1 = qd_message_copy(src);
+    qd_message_t     *copy2 = qd_message_copy(src);
+    qd_message_pvt_t *pvt0  = (qd_message_pvt_t*) src;
+    qd_message_pvt_t *pvt1  = (qd_message_pvt_t*) copy1;
+    qd_message_pvt_t *pvt2  = (qd_message_pvt_t*) copy2;
+
+    //
+    // The copies share the annotations until one of them sets a different value.
+    //
+    char *error = 0;
+    if (pvt1->annotations != pvt0->annotations || pvt2->annotations != pvt0->annotations)
+        error = "Copies should share the annotations";
+
+    qd_message_set_phase_annotation(copy1, 0);
+    if (!error && pvt1->annotations != pvt0->annotations)
+        error = "Setting an unchanged phase should not unshare";
+
+    qd_message_set_phase_annotation(copy1, 3);
+    if (!error && pvt1->annotations == pvt0->annotations)
+        error = "Setting a new phase should unshare";
+    if (!error && (qd_message_get_phase_annotation(src) != 0 || qd_message_get_phase_annotation(copy2) != 0))
+        error = "Phase leaked to the other copies";
+    if (!error && qd_message_get_phase_annotation(copy1) != 3)
+        error = "Phase not set";
+    if (!error && qd_buffer_list_length(&pvt1->annotations->ma_trace) != qd_buffer_list_length(&pvt0->annotations->ma_trace))
+        error = "Unshared copy lost the trace";
+
+    qd_message_free(src);
+    qd_message_free(copy1);
+    qd_message_free(copy2);
+    return error;
+}
+
+
+static char* test_repr_snapshot(void *context)
+{
+    qd_message_t *msg = qd_message();
+    qd_message_compose_1(msg, "test_addr_snapshot", 0);
+
+    char expected[512];
+    char actual[512];
+    if (!qd_message_repr(msg, expected, sizeof(expected), INT32_MAX)) {
+        qd_message_free(msg);
+        return "Message has no representation";
+    }
+
+    //
+    // The snapshot must format the same after the message it was taken from is gone.
+    //
+    qd_message_t *snapshot = qd_message_repr_snapshot(msg);
+    qd_message_free(msg);
+    if (!snapshot)
+        return "No snapshot";
+
+    char *error = 0;
+    if (!qd_message_repr(snapshot, actual, sizeof(actual), INT32_MAX))
+        error = "Snapshot has no representation";
+    else if (strcmp(expected, actual) != 0)
+        error = "Snapshot formats differently";
+    else if (!strstr(actual, "test_addr_snapshot"))
+        error = "Representation lacks the to field";
+
+    qd_message_free(snapshot);
+    return error;
+}
+
+
+static char* test_composed_buffered_size(void *context)
+{
+    qd_buffer_list_t body;
+    DEQ_INIT(body);
+    for (int i = 0; i < 3; i++) {
+        qd_buffer_t *buf = qd_buffer();
+        memset(qd_buffer_cursor(buf), 'x', qd_buffer_capacity(buf));
+        qd_buffer_insert(buf, qd_buffer_capacity(buf));
+        DEQ_INSERT_TAIL(body, buf);
+    }
+
+    qd_message_t         *msg     = qd_message();
+    qd_message_content_t *content = MSG_CONTENT(msg);
+    qd_message_compose_1(msg, "test_addr_size", &body);
+
+    size_t octets = 0;
+    size_t units  = 0;
+    for (qd_buffer_t *buf = DEQ_HEAD(content->buffers); buf; buf = DEQ_NEXT(buf)) {
+        octets += qd_buffer_size(buf);
+        units  += qd_buffer_units(buf);
+    }
+
+    char *error = 0;
+    if (DEQ_SIZE(content->buffers) < 2)
+        error = "Expected the composed message to span several buffers";
+    else if (qd_message_buffered_size(msg) != octets)
+        error = "Buffered size is not the octets held";
+    else if (content->buffer_units != units)
+        error = "Composed buffers were not counted";
+
+    qd_message_free(msg);
+    return error;
+}
+
+
 static char* test_q2_input_holdoff_sensing(void *context)
 {
     if (QD_QLIMIT_Q2_LOWER >= QD_QLIMIT_Q2_UPPER)
@@ -405,7 +670,13 @@ int message_tests(void)
     TEST_CASE(test_receive_from_messenger, 0);
     TEST_CASE(test_message_properties, 0);
     TEST_CASE(test_check_multiple, 0);
+    TEST_CASE(test_check_streaming, 0);
     TEST_CASE(test_send_message_annotations, 0);
+    TEST_CASE(test_router_annotations_lazy, 0);
+    TEST_CASE(test_sequence_annotation, 0);
+    TEST_CASE(test_copy_shares_annotations, 0);
+    TEST_CASE(test_repr_snapshot, 0);
+    TEST_CASE(test_composed_buffered_size, 0);
     TEST_CASE(test_q2_input_holdoff_sensing, 0);
 
     return result;
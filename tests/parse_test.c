@@ -507,6 +507,221 @@ cleanup:
 }
 
 
+static uint64_t compact_id(const char *id)
+{
+    qd_iterator_t *iter = qd_iterator_string(id, ITER_VIEW_NODE_HASH);
+    uint64_t       hash = qd_tracemask_id_hash(iter);
+    qd_iterator_free(iter);
+    return hash;
+}
+
+
+static char *test_tracemask_compact(void *context)
+{
+    qd_bitmask_t    *bm = NULL;
+    qd_tracemask_t  *tm = qd_tracemask();
+    qd_buffer_list_t list;
+    static char      error[1024];
+
+    error[0] = 0;
+    DEQ_INIT(list);
+    qd_iterator_set_address(false, "0", "ROUTER");
+
+    qd_tracemask_add_router(tm, "amqp:/_topo/0/Router.A/qdrouter", 0);
+    qd_tracemask_add_router(tm, "amqp:/_topo/0/Router.D/qdrouter", 3);
+    qd_tracemask_add_router(tm, "amqp:/_topo/0/Router.E/qdrouter", 4);
+    qd_tracemask_set_link(tm, 0, 4);
+    qd_tracemask_set_link(tm, 3, 10);
+
+    //
+    // A compact trace, with a string entry and an unknown router mixed in
+    //
+    qd_composed_field_t *comp = qd_compose_subfield(0);
+    qd_compose_start_list(comp);
+    qd_compose_insert_ulong(comp, compact_id("0/Router.E"));
+    qd_compose_insert_ulong(comp, compact_id("0/Router.A"));
+    qd_compose_insert_ulong(comp, compact_id("0/Router.Z"));
+    qd_compose_insert_string(comp, "0/Router.D");
+    qd_compose_end_list(comp);
+    qd_compose_take_buffers(comp, &list);
+    qd_compose_free(comp);
+
+    qd_iterator_t     *iter = qd_iterator_buffer(DEQ_HEAD(list), 0, qd_buffer_list_length(&list), ITER_VIEW_ALL);
+    qd_parsed_field_t *pf   = qd_parse(iter);
+    qd_iterator_free(iter);
+
+    int ingress = -1;
+    bm = qd_tracemask_create(tm, pf, &ingress);
+    if (ingress != 4) {
+        sprintf(error, "Expected ingress index of 4, got %d", ingress);
+        goto cleanup;
+    }
+    if (qd_bitmask_cardinality(bm) != 2 || !qd_bitmask_value(bm, 4) || !qd_bitmask_value(bm, 10)) {
+        sprintf(error, "Expected link bits 4 and 10, got cardinality %d", qd_bitmask_cardinality(bm));
+        goto cleanup;
+    }
+
+    //
+    // Resolving back to strings drops the unknown router
+    //
+    comp = qd_compose_subfield(0);
+    qd_compose_start_list(comp);
+    int bits[4];
+    for (uint32_t idx = 0; idx < 4; idx++)
+        bits[idx] = qd_tracemask_resolve_id(tm, qd_parse_sub_value(pf, idx), comp);
+    qd_compose_end_list(comp);
+    if (bits[0] != 4 || bits[1] != 0 || bits[2] != -1 || bits[3] != -1) {
+        sprintf(error, "Unexpected mask bits %d %d %d %d", bits[0], bits[1], bits[2], bits[3]);
+        qd_compose_free(comp);
+        goto cleanup;
+    }
+
+    qd_buffer_list_t strings;
+    DEQ_INIT(strings);
+    qd_compose_take_buffers(comp, &strings);
+    qd_compose_free(comp);
+    iter = qd_iterator_buffer(DEQ_HEAD(strings), 0, qd_buffer_list_length(&strings), ITER_VIEW_ALL);
+    qd_parsed_field_t *resolved = qd_parse(iter);
+    qd_iterator_free(iter);
+    if (qd_parse_sub_count(resolved) != 3 ||
+        !qd_iterator_equal(qd_parse_raw(qd_parse_sub_value(resolved, 0)), (unsigned char*) "0/Router.E") ||
+        !qd_iterator_equal(qd_parse_raw(qd_parse_sub_value(resolved, 2)), (unsigned char*) "0/Router.D"))
+        sprintf(error, "Resolved trace does not hold the router IDs");
+    qd_parse_free(resolved);
+    qd_buffer_list_free_buffers(&strings);
+
+cleanup:
+    qd_parse_free(pf);
+    qd_tracemask_free(tm);
+    qd_bitmask_free(bm);
+    qd_buffer_list_free_buffers(&list);
+    return *error ? error : 0;
+}
+
+
+static char *test_parse_across_buffers(void *context)
+{
+    // list32 of [smalluint 7, str8 "abc", uint 256]
+    static const char   list[] = "\xd0\x00\x00\x00\x10\x00\x00\x00\x03"
+                                 "\x52\x07" "\xa1\x03" "abc" "\x70\x00\x00\x01\x00";
+    static const size_t length = sizeof(list) - 1;
+    static char error[1024];
+
+    //
+    // Split the encoding across two buffers at every offset so that each
+    // header is decoded both from contiguous memory and across a boundary.
+    //
+    for (size_t split = 1; split < length; split++) {
+        qd_buffer_list_t buffers;
+        DEQ_INIT(buffers);
+
+        qd_buffer_t *buf = qd_buffer();
+        memcpy(qd_buffer_cursor(buf), list, split);
+        qd_buffer_insert(buf, split);
+        DEQ_INSERT_TAIL(buffers, buf);
+
+        buf = qd_buffer();
+        memcpy(qd_buffer_cursor(buf), list + split, length - split);
+        qd_buffer_insert(buf, length - split);
+        DEQ_INSERT_TAIL(buffers, buf);
+
+        qd_iterator_t     *iter  = qd_iterator_buffer(DEQ_HEAD(buffers), 0, length, ITER_VIEW_ALL);
+        qd_parsed_field_t *field = qd_parse(iter);
+
+        error[0] = 0;
+        if (!qd_parse_ok(field))
+            sprintf(error, "(%zu) Parse failed: %s", split, qd_parse_error(field));
+        else if (qd_parse_tag(field) != QD_AMQP_LIST32 || qd_parse_sub_count(field) != 3)
+            sprintf(error, "(%zu) Wrong list tag or count", split);
+        else if (qd_parse_as_uint(qd_parse_sub_value(field, 0)) != 7)
+            sprintf(error, "(%zu) Wrong first element", split);
+        else if (!qd_iterator_equal(qd_parse_raw(qd_parse_sub_value(field, 1)), (const unsigned char*) "abc"))
+            sprintf(error, "(%zu) Wrong second element", split);
+        else if (qd_parse_as_uint(qd_parse_sub_value(field, 2)) != 256)
+            sprintf(error, "(%zu) Wrong third element", split);
+
+        qd_parse_free(field);
+        qd_iterator_free(iter);
+        qd_buffer_list_free_buffers(&buffers);
+        if (error[0])
+            return error;
+    }
+
+    return 0;
+}
+
+
+static char *test_map_locate(void *context)
+{
+    // map32 of "first":"value_of_first", "second":32, "third":true, 5:"five"
+    static const char   map[] = "\xd1\x00\x00\x00\x35\x00\x00\x00\x08"
+                                "\xa3\x05\x66irst\xa1\x0evalue_of_first"
+                                "\xa3\x06second\x52\x20"
+                                "\xa3\x05third\x41"
+                                "\x52\x05\xa1\x04\x66ive";
+    static const size_t length = sizeof(map) - 1;
+    static char error[1024];
+    const char * const  keys[] = {"third", "first", "fourth", "second", "five"};
+    qd_parsed_turbo_t   values[5];
+
+    //
+    // Split the encoding across two buffers at every offset so that the keys
+    // and values are found both in contiguous memory and across a boundary.
+    //
+    for (size_t split = 1; split < length; split++) {
+        qd_buffer_list_t buffers;
+        DEQ_INIT(buffers);
+
+        qd_buffer_t *buf = qd_buffer();
+        memcpy(qd_buffer_cursor(buf), map, split);
+        qd_buffer_insert(buf, split);
+        DEQ_INSERT_TAIL(buffers, buf);
+
+        buf = qd_buffer();
+        memcpy(qd_buffer_cursor(buf), map + split, length - split);
+        qd_buffer_insert(buf, length - split);
+        DEQ_INSERT_TAIL(buffers, buf);
+
+        qd_iterator_t *iter        = qd_iterator_buffer(DEQ_HEAD(buffers), 0, length, ITER_VIEW_ALL);
+        const char    *parse_error = qd_parse_map_locate(iter, keys, 5, values);
+
+        error[0] = 0;
+        if (parse_error)
+            sprintf(error, "(%zu) Locate failed: %s", split, parse_error);
+        else if (!qd_parse_turbo_equal(&values[1], (const unsigned char*) "value_of_first"))
+            sprintf(error, "(%zu) Wrong value for 'first'", split);
+        else if (values[2].tag != 0 || values[4].tag != 0)
+            sprintf(error, "(%zu) Found a key that is not in the map", split);
+        else if (values[0].tag != QD_AMQP_TRUE || values[3].tag != QD_AMQP_SMALLUINT)
+            sprintf(error, "(%zu) Wrong value tags", split);
+
+        if (!error[0]) {
+            qd_parsed_field_t *second = qd_parse_turbo_value(&values[3]);
+            if (!second || !qd_parse_ok(second) || qd_parse_as_uint(second) != 32)
+                sprintf(error, "(%zu) Wrong value for 'second'", split);
+            qd_parse_free(second);
+        }
+
+        if (!error[0]) {
+            qd_iterator_pointer_t raw;
+            qd_parse_turbo_raw(&values[1], &raw);
+            qd_iterator_t *raw_iter = qd_iterator_buffer(raw.buffer, raw.cursor - qd_buffer_base(raw.buffer),
+                                                         raw.remaining, ITER_VIEW_ALL);
+            if (!qd_iterator_equal(raw_iter, (const unsigned char*) "value_of_first"))
+                sprintf(error, "(%zu) Wrong raw value for 'first'", split);
+            qd_iterator_free(raw_iter);
+        }
+
+        qd_iterator_free(iter);
+        qd_buffer_list_free_buffers(&buffers);
+        if (error[0])
+            return error;
+    }
+
+    return 0;
+}
+
+
 int parse_tests()
 {
     int result = 0;
@@ -516,7 +731,10 @@ int parse_tests()
     TEST_CASE(test_map, 0);
     TEST_CASE(test_parser_errors, 0);
     TEST_CASE(test_tracemask, 0);
+    TEST_CASE(test_tracemask_compact, 0);
     TEST_CASE(test_integer_conversion, 0);
+    TEST_CASE(test_parse_across_buffers, 0);
+    TEST_CASE(test_map_locate, 0);
 
     return result;
 }
@@ -828,6 +828,176 @@ cleanup:
 }
 
 
+typedef struct {
+    int         count;
+    const char *patterns[32];
+} match_list_t;
+
+static bool gather_matches(void *handle, const char *pattern, void *payload)
+{
+    match_list_t *list = (match_list_t *)handle;
+    if (list->count < 32)
+        list->patterns[list->count] = pattern;
+    list->count++;
+    return true;
+}
+
+
+// nested globs are re-entered at the same position many times; every visit
+// must still be reported in precedence order
+static char *test_nested_globs(void *context)
+{
+    static const struct {
+        const char *value;
+        int         count;
+        const char *matches[12];
+    } tests[] = {
+        {"a.a.b.b", 6, {"#.a.#.b.#", "#.a.#.b", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b", "#.a.#.b.#"}},
+        {"a.x.a.b.y.b.c", 6, {"a.#.b.#.c", "a.#.b.#.c", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b.#"}},
+        {"a.a.a.b.b.b", 12, {"#.a.#.b.#", "#.a.#.b.#", "#.a.#.b", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b.#",
+                             "#.a.#.b", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b.#", "#.a.#.b", "#.a.#.b.#"}},
+        {"b.a.c", 0, {NULL}},
+        {NULL, 0, {NULL}}
+    };
+    static char error[200];
+    qd_parse_tree_t *tree = qd_parse_tree_new(QD_PARSE_TREE_AMQP_0_10);
+
+    qd_parse_tree_add_pattern_str(tree, "#.a.#.b.#", "1");
+    qd_parse_tree_add_pattern_str(tree, "#.a.#.b", "2");
+    qd_parse_tree_add_pattern_str(tree, "a.#.b.#.c", "3");
+
+    error[0] = 0;
+    for (int i = 0; tests[i].value && !error[0]; i++) {
+        match_list_t list = {0};
+        qd_parse_tree_search_str(tree, tests[i].value, gather_matches, &list);
+        if (list.count != tests[i].count) {
+            snprintf(error, sizeof(error), "'%s': expected %d matches, got %d",
+                     tests[i].value, tests[i].count, list.count);
+            break;
+        }
+        for (int j = 0; j < list.count; j++) {
+            if (strcmp(list.patterns[j], tests[i].matches[j]) != 0) {
+                snprintf(error, sizeof(error), "'%s': match %d expected '%s', got '%s'",
+                         tests[i].value, j, tests[i].matches[j], list.patterns[j]);
+                break;
+            }
+        }
+    }
+
+    qd_parse_tree_free(tree);
+    return error[0] ? error : 0;
+}
+
+
+// a node with many children uses an index to find them; verify it across
+// additions and removals
+static char *test_many_children(void *context)
+{
+    static char error[200];
+    static char payloads[1000];
+    char pattern[64];
+    void *payload;
+    qd_parse_tree_t *tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+
+    qd_parse_tree_add_pattern_str(tree, "node.*", "wildcard");
+    for (int i = 0; i < 1000; i++) {
+        snprintf(pattern, sizeof(pattern), "node.%d", i);
+        qd_parse_tree_add_pattern_str(tree, pattern, &payloads[i]);
+    }
+
+    for (int i = 1; i < 1000; i += 2) {
+        snprintf(pattern, sizeof(pattern), "node.%d", i);
+        if (qd_parse_tree_remove_pattern_str(tree, pattern) != &payloads[i]) {
+            snprintf(error, sizeof(error), "failed to remove '%s'", pattern);
+            qd_parse_tree_free(tree);
+            return error;
+        }
+    }
+
+    error[0] = 0;
+    for (int i = 0; i < 1000 && !error[0]; i++) {
+        snprintf(pattern, sizeof(pattern), "node.%d", i);
+        void *expected = (i & 1) ? (void *)"wildcard" : (void *)&payloads[i];
+        if (!qd_parse_tree_retrieve_match_str(tree, pattern, &payload) || payload != expected)
+            snprintf(error, sizeof(error), "wrong match for '%s'", pattern);
+    }
+
+    qd_parse_tree_free(tree);
+    return error[0] ? error : 0;
+}
+
+
+static char *test_match_cache(void *context)
+{
+    static char error[200];
+    const char *values[] = {"a.b.c", "a.x.c", "q.r", "a.b.c", "q.r", "a.y.c"};
+    void *payload;
+    qd_parse_tree_t *tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+
+    qd_parse_tree_set_cache_size(tree, 2);
+    qd_parse_tree_add_pattern_str(tree, "a.*.c", "glob");
+
+    // repeated values hit the cache, unmatched values are cached too
+    error[0] = 0;
+    for (int i = 0; i < 6 && !error[0]; i++) {
+        qd_iterator_t *iter = qd_iterator_string(values[i], ITER_VIEW_ALL);
+        bool found = qd_parse_tree_retrieve_match(tree, iter, &payload);
+        bool expect = values[i][0] == 'a';
+        if (found != expect || (found && strcmp((char *) payload, "glob") != 0))
+            snprintf(error, sizeof(error), "wrong match for '%s'", values[i]);
+        qd_iterator_free(iter);
+    }
+
+    // adding a better pattern must invalidate cached results
+    qd_iterator_t *iter = qd_iterator_string("a.b.c", ITER_VIEW_ALL);
+    qd_parse_tree_add_pattern_str(tree, "a.b.c", "exact");
+    if (!error[0] && (!qd_parse_tree_retrieve_match(tree, iter, &payload) ||
+                      strcmp((char *) payload, "exact") != 0))
+        snprintf(error, sizeof(error), "stale cached match after add");
+
+    qd_parse_tree_remove_pattern_str(tree, "a.b.c");
+    if (!error[0] && (!qd_parse_tree_retrieve_match(tree, iter, &payload) ||
+                      strcmp((char *) payload, "glob") != 0))
+        snprintf(error, sizeof(error), "stale cached match after remove");
+
+    qd_parse_tree_remove_pattern_str(tree, "a.*.c");
+    if (!error[0] && qd_parse_tree_retrieve_match(tree, iter, &payload))
+        snprintf(error, sizeof(error), "stale cached match after last remove");
+
+    qd_iterator_free(iter);
+    qd_parse_tree_free(tree);
+    return error[0] ? error : 0;
+}
+
+
+static char *test_empty_tree(void *context)
+{
+    static char error[200];
+    void *payload = (void *) "stale";
+    qd_parse_tree_t *tree = qd_parse_tree_new(QD_PARSE_TREE_ADDRESS);
+    qd_iterator_t *iter = qd_iterator_string("a.b", ITER_VIEW_ALL);
+
+    qd_parse_tree_set_cache_size(tree, 4);
+
+    // an empty tree matches nothing, before and after it has held patterns
+    error[0] = 0;
+    if (qd_parse_tree_retrieve_match(tree, iter, &payload) || payload != NULL)
+        snprintf(error, sizeof(error), "match in a new empty tree");
+
+    qd_parse_tree_add_pattern_str(tree, "#", "glob");
+    if (!error[0] && !qd_parse_tree_retrieve_match(tree, iter, &payload))
+        snprintf(error, sizeof(error), "no match for '#'");
+
+    qd_parse_tree_remove_pattern_str(tree, "#");
+    if (!error[0] && qd_parse_tree_retrieve_match(tree, iter, &payload))
+        snprintf(error, sizeof(error), "match in an emptied tree");
+
+    qd_iterator_free(iter);
+    qd_parse_tree_free(tree);
+    return error[0] ? error : 0;
+}
+
+
 int parse_tree_tests(void)
 {
     int result = 0;
@@ -840,5 +1010,9 @@ int parse_tree_tests(void)
     TEST_CASE(test_matches, 0);
     TEST_CASE(test_multiple_matches, 0);
     TEST_CASE(test_validation, 0);
+    TEST_CASE(test_nested_globs, 0);
+    TEST_CASE(test_many_children, 0);
+    TEST_CASE(test_match_cache, 0);
+    TEST_CASE(test_empty_tree, 0);
     return result;
 }
@@ -0,0 +1,230 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "test_case.h"
+#include <stdio.h>
+#include <string.h>
+#include "router_core/path_engine.h"
+
+typedef struct {
+    const char *id;
+    const char *peers[4];
+} path_link_state_t;
+
+//
+//  +----+      +----+      +----+
+//  | R2 |------| R3 |------| R4 |
+//  +----+      +----+      +----+
+//                 |           |
+//              +====+      +----+      +----+
+//              | R1 |------| R5 |------| R6 |------ R7 (no link state from R7)
+//              +====+      +----+      +----+
+//
+static const path_link_state_t topology[] = {
+    {"R2", {"R3"}},
+    {"R3", {"R1", "R2", "R4"}},
+    {"R4", {"R3", "R5"}},
+    {"R1", {"R3", "R5"}},
+    {"R5", {"R1", "R4", "R6"}},
+    {"R6", {"R5", "R7"}},
+    {0,    {0}}
+};
+
+
+static void load_graph(qdr_path_graph_t *graph, const path_link_state_t *link_states)
+{
+    qdr_path_graph_reload(graph);
+    for (const path_link_state_t *ls = link_states; ls->id; ls++) {
+        int node = qdr_path_graph_node(graph, ls->id);
+        qdr_path_graph_link_state(graph, node);
+        for (int i = 0; i < 4 && ls->peers[i]; i++)
+            qdr_path_graph_link(graph, node, qdr_path_graph_node(graph, ls->peers[i]), 1);
+    }
+}
+
+
+static qdr_path_graph_t *build_graph(const path_link_state_t *link_states)
+{
+    qdr_path_graph_t *graph = qdr_path_graph();
+    load_graph(graph, link_states);
+    return graph;
+}
+
+
+static int node_index(qdr_path_graph_t *graph, const char *id)
+{
+    for (int i = 0; i < qdr_path_graph_node_count(graph); i++)
+        if (strcmp(qdr_path_graph_node_id(graph, i), id) == 0)
+            return i;
+    return -1;
+}
+
+
+static const char *next_hop(qdr_path_graph_t *graph, qdr_path_route_t *routes, const char *id)
+{
+    int hop = routes[node_index(graph, id)].next_hop;
+    return hop >= 0 ? qdr_path_graph_node_id(graph, hop) : "";
+}
+
+
+static bool valid_origin(qdr_path_graph_t *graph, qdr_path_route_t *routes, const char *dest, const char *origin)
+{
+    return qd_bitmask_value(routes[node_index(graph, dest)].valid_origins, node_index(graph, origin));
+}
+
+
+static char *test_next_hops(void *context)
+{
+    qdr_path_graph_t *graph  = build_graph(topology);
+    int               count  = qdr_path_graph_node_count(graph);
+    qdr_path_route_t  routes[count];
+    int               radius = qdr_path_calculate_routes(graph, node_index(graph, "R1"), routes);
+    char             *result = 0;
+
+    if (count != 7)
+        result = "Expected the peer-only router to be added";
+    else if (radius != 3)
+        result = "Expected a radius of 3";
+    else if (routes[node_index(graph, "R1")].next_hop != -1)
+        result = "Expected no next hop for the root";
+    else if (strcmp(next_hop(graph, routes, "R2"), "R3") ||
+             strcmp(next_hop(graph, routes, "R3"), "R3") ||
+             strcmp(next_hop(graph, routes, "R4"), "R3") ||
+             strcmp(next_hop(graph, routes, "R5"), "R5") ||
+             strcmp(next_hop(graph, routes, "R6"), "R5") ||
+             strcmp(next_hop(graph, routes, "R7"), "R5"))
+        result = "Unexpected next hop";
+    else if (routes[node_index(graph, "R4")].cost != 2 || routes[node_index(graph, "R7")].cost != 3)
+        result = "Unexpected cost";
+
+    for (int i = 0; i < count; i++)
+        qd_bitmask_free(routes[i].valid_origins);
+    qdr_path_graph_free(graph);
+    return result;
+}
+
+
+static char *test_valid_origins(void *context)
+{
+    qdr_path_graph_t *graph = build_graph(topology);
+    int               count = qdr_path_graph_node_count(graph);
+    qdr_path_route_t  routes[count];
+    char             *result = 0;
+
+    qdr_path_calculate_routes(graph, node_index(graph, "R1"), routes);
+
+    if (!valid_origin(graph, routes, "R2", "R5") || !valid_origin(graph, routes, "R2", "R6") ||
+        !valid_origin(graph, routes, "R2", "R7") || valid_origin(graph, routes, "R2", "R4"))
+        result = "Unexpected valid origins for R2";
+    else if (qd_bitmask_cardinality(routes[node_index(graph, "R4")].valid_origins) != 0)
+        result = "Expected no valid origins for R4";
+    else if (!valid_origin(graph, routes, "R7", "R2") || !valid_origin(graph, routes, "R7", "R3") ||
+             valid_origin(graph, routes, "R7", "R4"))
+        result = "Unexpected valid origins for R7";
+
+    for (int i = 0; i < count; i++)
+        qd_bitmask_free(routes[i].valid_origins);
+    qdr_path_graph_free(graph);
+    return result;
+}
+
+
+//
+// The same topology with the R4-R5 link gone
+//
+static const path_link_state_t topology_no_r4_r5[] = {
+    {"R2", {"R3"}},
+    {"R3", {"R1", "R2", "R4"}},
+    {"R4", {"R3"}},
+    {"R1", {"R3", "R5"}},
+    {"R5", {"R1", "R6"}},
+    {"R6", {"R5", "R7"}},
+    {0,    {0}}
+};
+
+
+static char *test_incremental(void *context)
+{
+    qdr_path_graph_t *graph = build_graph(topology);
+    int               count = qdr_path_graph_node_count(graph);
+    int               root  = node_index(graph, "R1");
+    qdr_path_route_t  routes[count];
+    char             *result = 0;
+
+    qdr_path_calculate_routes(graph, root, routes);
+    for (int i = 0; i < count; i++)
+        qd_bitmask_free(routes[i].valid_origins);
+    long computed = qdr_path_graph_trees_computed(graph);
+
+    //
+    // Reloading the same link states needs no trees recomputed
+    //
+    load_graph(graph, topology);
+    qdr_path_calculate_routes(graph, root, routes);
+    for (int i = 0; i < count; i++)
+        qd_bitmask_free(routes[i].valid_origins);
+    if (qdr_path_graph_trees_computed(graph) != computed)
+        result = "Expected no trees to be recomputed for unchanged link states";
+
+    //
+    // Losing the R4-R5 link leaves the trees from R1, R2 and R3, which do not use
+    // it, untouched.  The result must match a calculation from scratch.
+    //
+    if (!result) {
+        qdr_path_graph_t *fresh = build_graph(topology_no_r4_r5);
+        qdr_path_route_t  fresh_routes[count];
+
+        load_graph(graph, topology_no_r4_r5);
+        qdr_path_calculate_routes(graph, root, routes);
+        qdr_path_calculate_routes(fresh, node_index(fresh, "R1"), fresh_routes);
+
+        long recomputed = qdr_path_graph_trees_computed(graph) - computed;
+        if (recomputed != 4)
+            result = "Expected only the trees using the lost link to be recomputed";
+
+        for (int i = 0; i < count; i++) {
+            if (!result && (routes[i].next_hop != fresh_routes[i].next_hop ||
+                            routes[i].cost != fresh_routes[i].cost))
+                result = "Incremental next hops differ from a full calculation";
+            for (int j = 0; j < count && !result; j++)
+                if (qd_bitmask_value(routes[i].valid_origins, j) != qd_bitmask_value(fresh_routes[i].valid_origins, j))
+                    result = "Incremental valid origins differ from a full calculation";
+            qd_bitmask_free(routes[i].valid_origins);
+            qd_bitmask_free(fresh_routes[i].valid_origins);
+        }
+        qdr_path_graph_free(fresh);
+    }
+
+    qdr_path_graph_free(graph);
+    return result;
+}
+
+
+int path_engine_tests(void)
+{
+    int result = 0;
+    char *test_group = "path_engine_tests";
+
+    TEST_CASE(test_next_hops, 0);
+    TEST_CASE(test_valid_origins, 0);
+    TEST_CASE(test_incremental, 0);
+
+    return result;
+}
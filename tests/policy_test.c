@@ -214,6 +214,38 @@ static char *test_link_name_csv_parser(void *context)
 }
 
 
+static char *test_link_name_matcher(void *context)
+{
+    char *result = 0;
+    qd_policy_link_matcher_t *matcher = qd_policy_link_matcher("joe", "a,ttt,,s,tmp-,,p,,-q*,a,abc*,", 0);
+
+    if (!qd_policy_link_matcher_approve(matcher, "ttt"))
+        result = "compiled matcher should allow exact name 'ttt' but does not";
+    else if (qd_policy_link_matcher_approve(matcher, "tttt"))
+        result = "compiled matcher should not allow 'tttt' but does";
+    else if (!qd_policy_link_matcher_approve(matcher, "tmp-joe"))
+        result = "compiled matcher should allow suffix subst 'tmp-joe' but does not";
+    else if (qd_policy_link_matcher_approve(matcher, "tmp-bob"))
+        result = "compiled matcher should not allow another user's 'tmp-bob' but does";
+    else if (!qd_policy_link_matcher_approve(matcher, "joe-q.1"))
+        result = "compiled matcher should allow prefix subst 'joe-q.1' but does not";
+    else if (!qd_policy_link_matcher_approve(matcher, "abcdef"))
+        result = "compiled matcher should allow wildcard 'abcdef' but does not";
+    else if (qd_policy_link_matcher_approve(matcher, ""))
+        result = "compiled matcher should not allow a blank name but does";
+    qd_policy_link_matcher_free(matcher);
+    if (result)
+        return result;
+
+    matcher = qd_policy_link_matcher("joe", "*,,", 0);
+    if (!qd_policy_link_matcher_approve(matcher, "anything"))
+        result = "compiled wildcard matcher should allow any name but does not";
+    qd_policy_link_matcher_free(matcher);
+
+    return result;
+}
+
+
 int policy_tests(void)
 {
     int result = 0;
@@ -222,6 +254,7 @@ int policy_tests(void)
     TEST_CASE(test_link_name_lookup, 0);
     TEST_CASE(test_link_name_tree_lookup, 0);
     TEST_CASE(test_link_name_csv_parser, 0);
+    TEST_CASE(test_link_name_matcher, 0);
 
     return result;
 }
@@ -24,13 +24,16 @@ from __future__ import print_function
 
 import os
 import sys
+import tempfile
 import unittest2 as unittest
 import mock                     # Mock definitions for tests.
 
 sys.path.append(os.path.join(os.environ["SOURCE_DIR"], "python"))
 
 from qpid_dispatch_internal.router.engine import HelloProtocol, PathEngine, NodeTracker
-from qpid_dispatch_internal.router.data import LinkState, MessageHELLO, ProtocolVersion
+from qpid_dispatch_internal.router.snapshot import RouteSnapshot
+from qpid_dispatch_internal.router.data import LinkState, MessageHELLO, MessageMAU, ProtocolVersion
+from qpid_dispatch_internal.router.data import compress_addresses, expand_addresses
 from qpid_dispatch.management.entity import EntityBase
 from system_test import main_module
 
@@ -101,6 +104,28 @@ class DataTest(unittest.TestCase):
         self.assertFalse(msg2.is_seen('R9'))
 
 
+    def test_compressed_addresses(self):
+        addrs = ['M0queue.b', 'M0queue.a', 'M0queue.abc', 'Dtopic', 'M0queue.\u00e9']
+        blob, order = compress_addresses(addrs)
+        self.assertEqual(expand_addresses(blob), sorted(addrs))
+        self.assertEqual([addrs[i] for i in order], sorted(addrs))
+        self.assertEqual(expand_addresses(compress_addresses([])[0]), [])
+
+
+    def test_compressed_mau_message(self):
+        msg1 = MessageMAU(None, 'R1', 3, ['M0b', 'M0a'], ['M0z'], _hints=[1, 2])
+        msg1.compressed = True
+        encoded = msg1.to_dict()
+        self.assertFalse('add' in encoded)
+        self.assertTrue('add_pc' in encoded)
+        msg2 = MessageMAU(encoded)
+        self.assertEqual(msg2.mobile_seq, 3)
+        self.assertEqual(msg2.add_list, ['M0a', 'M0b'])
+        self.assertEqual(msg2.hints, [2, 1])
+        self.assertEqual(msg2.del_list, ['M0z'])
+        self.assertEqual(msg2.exist_list, None)
+
+
 class NodeTrackerTest(unittest.TestCase):
     def log(self, level, text):
         pass
@@ -136,6 +161,96 @@ class NodeTrackerTest(unittest.TestCase):
         self.calls      = 0
 
 
+class SnapshotTest(unittest.TestCase):
+    """
+    Save a route snapshot from one node tracker and warm-start another from it.
+    """
+    class FakeAdapter(object):
+        def __init__(self):
+            self.mapped = {}
+        def get_agent(self):
+            return self
+        def add_implementation(self, impl, kind):
+            pass
+        def remove_implementation(self, impl):
+            pass
+        def add_router(self, address, maskbit):
+            pass
+        def del_router(self, maskbit):
+            pass
+        def map_destinations(self, addrs, hints, maskbit):
+            self.mapped.setdefault(maskbit, set()).update(addrs)
+        def unmap_destinations(self, addrs, maskbit):
+            self.mapped[maskbit].difference_update(addrs)
+
+    def log(self, level, text):
+        pass
+
+    def log_ls(self, level, text):
+        pass
+
+    def send_lsr(self, node_id):
+        self.lsr_sent.append(node_id)
+
+    def make_tracker(self):
+        self.router_adapter = self.FakeAdapter()
+        return NodeTracker(self, 128)
+
+    def setUp(self):
+        self.id = 'R1'
+        self.area = '0'
+        self.lsr_sent = []
+        self.link_state_engine = self
+        self.config = EntityBase({
+            'helloMaxAgeSeconds'      :  3.0,
+            'raIntervalFluxSeconds'   :  4.0,
+            'remoteLsMaxAgeSeconds'   : 60.0 })
+        self.fd, self.path = tempfile.mkstemp()
+        os.close(self.fd)
+        os.remove(self.path)
+
+    def tearDown(self):
+        if os.path.exists(self.path):
+            os.remove(self.path)
+
+    def test_warm_start(self):
+        tracker = self.make_tracker()
+        tracker.link_state_received('R2', ProtocolVersion, LinkState(None, 'R2', 3, {'R1': 1, 'R3': 1}), 100, 1.0)
+        tracker.link_state_received('R3', ProtocolVersion, LinkState(None, 'R3', 2, {'R2': 1}), 200, 1.0)
+        tracker.nodes['R2'].map_addresses(['M0a', 'M0b'])
+        tracker.nodes['R2'].mobile_address_sequence = 5
+        tracker.nodes['R3'].map_addresses(['M0c'])
+        tracker.nodes['R3'].mobile_address_sequence = 7
+        RouteSnapshot(self, tracker, self.path, 30).save()
+
+        tracker = self.make_tracker()
+        self.assertEqual(RouteSnapshot(self, tracker, self.path, 30).load(2.0), 2)
+        r2 = tracker.nodes['R2']
+        r3 = tracker.nodes['R3']
+        self.assertEqual(r2.link_state.ls_seq, 0)
+        self.assertEqual(r2.link_state.peers, {'R1': 1, 'R3': 1})
+        self.assertEqual(self.router_adapter.mapped[r2.maskbit], set(['M0a', 'M0b']))
+        self.assertTrue(tracker.recompute_topology)
+
+        # R2 is unchanged: its addresses are kept and its link state is refreshed
+        tracker.ra_received('R2', ProtocolVersion, 3, 5, 100, 3.0)
+        self.assertEqual(r2.mobile_address_sequence, 5)
+        self.assertFalse(r2.need_mobile_request)
+        self.assertEqual(self.lsr_sent, ['R2'])
+
+        # R3 has moved on: its stale addresses are dropped and requested again
+        tracker.ra_received('R3', ProtocolVersion, 2, 8, 200, 3.0)
+        self.assertEqual(self.router_adapter.mapped[r3.maskbit], set())
+        self.assertTrue(r3.need_mobile_request)
+
+    def test_foreign_snapshot(self):
+        tracker = self.make_tracker()
+        tracker.link_state_received('R2', ProtocolVersion, LinkState(None, 'R2', 1, {'R1': 1}), 100, 1.0)
+        RouteSnapshot(self, tracker, self.path, 30).save()
+        self.id = 'R9'
+        self.assertEqual(RouteSnapshot(self, self.make_tracker(), self.path, 30).load(2.0), 0)
+
+
 class NeighborTest(unittest.TestCase):
     def log(self, level, text):
         pass
@@ -221,6 +336,39 @@ class PathTest(unittest.TestCase):
     def log(self, level, text):
         pass
 
+    def test_equal_cost_next_hops(self):
+        """
+
+                    +----+
+                 +--| R2 |--+
+                 |  +----+  |
+        +====+   |          |   +----+      +----+
+        | R1 |---+          +---| R4 |------| R5 |
+        +====+   |          |   +----+      +----+
+                 |  +----+  |
+                 +--| R3 |--+
+                 |  +----+
+                 |     |10
+                 |  +----+
+                 +--| R6 |
+                 5  +----+
+
+        """
+        collection = { 'R1': LinkState(None, 'R1', 1, {'R2':1, 'R3':1, 'R6':5}),
+                       'R2': LinkState(None, 'R2', 1, {'R1':1, 'R4':1}),
+                       'R3': LinkState(None, 'R3', 1, {'R1':1, 'R4':1, 'R6':10}),
+                       'R4': LinkState(None, 'R4', 1, {'R2':1, 'R3':1, 'R5':1}),
+                       'R5': LinkState(None, 'R5', 1, {'R4':1}),
+                       'R6': LinkState(None, 'R6', 1, {'R1':5, 'R3':10}) }
+        next_hops, costs, valid_origins, radius = self.engine.calculate_routes(collection)
+        hops = self.engine.equal_cost_next_hops(collection, costs)
+        self.assertEqual(hops['R2'], ['R2'])
+        self.assertEqual(hops['R3'], ['R3'])
+        self.assertEqual(hops['R4'], ['R2', 'R3'])
+        self.assertEqual(hops['R5'], ['R2', 'R3'])
+        self.assertEqual(hops['R6'], ['R6'])
+        self.assertTrue(next_hops['R5'] in hops['R5'])
+
     def test_topology1(self):
         """
 
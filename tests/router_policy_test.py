@@ -163,6 +163,11 @@ class PolicyFile(TestCase):
         self.assertTrue(upolicy['maxSessions']              == 4)
         self.assertTrue(upolicy['maxSenders']               == 44)
         self.assertTrue(upolicy['maxReceivers']             == 44)
+        self.assertTrue(upolicy['maxMemory']                == 4444444)
+        self.assertTrue(upolicy['maxMessageRate']           == 4444)
+        self.assertTrue(upolicy['maxByteRate']              == 444444)
+        self.assertTrue(upolicy['vhostMaxMessageRate']      == 5000)
+        self.assertTrue(upolicy['vhostMaxByteRate']         == 0)
         self.assertTrue(upolicy['allowAnonymousSender'])
         self.assertTrue(upolicy['allowDynamicSource'])
         self.assertTrue(upolicy['targets'] == 'a,private,')
@@ -25,10 +25,12 @@
 int tool_tests(void);
 int timer_tests(qd_dispatch_t*);
 int core_timer_tests(void);
+int path_engine_tests(void);
 int alloc_tests(void);
 int compose_tests(void);
 int policy_tests(void);
 int failoverlist_tests(void);
+int compression_tests(void);
 int parse_tree_tests(void);
 int proton_utils_tests(void);
 
@@ -62,9 +64,11 @@ int main(int argc, char** argv)
 #endif
     result += policy_tests();
     result += failoverlist_tests();
+    result += compression_tests();
     result += parse_tree_tests();
     result += proton_utils_tests();
     result += core_timer_tests();
+    result += path_engine_tests();
 
     qd_dispatch_free(qd);       // dispatch_free last.
 
@@ -19,12 +19,70 @@
 
 #include <qpid/dispatch/buffer.h>
 #include <qpid/dispatch/alloc.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "test_case.h"
+#include "router_core/router_core_private.h"
 
 int message_tests();
 int field_tests();
 int parse_tests();
 int buffer_tests();
 
+//
+// Layout guards for the structures shared between the core and the I/O threads.
+// Fields written by the I/O threads must not share a cache line with fields only
+// the core touches.
+//
+#define CACHE_LINE 64
+#define FIRST_LINE(T,F) (offsetof(T,F) / CACHE_LINE)
+#define LAST_LINE(T,F)  ((offsetof(T,F) + sizeof(((T*) 0)->F) - 1) / CACHE_LINE)
+
+static char *test_delivery_layout(void *context)
+{
+    size_t core_line = FIRST_LINE(qdr_delivery_t, peer);
+
+    if (offsetof(qdr_delivery_t, peer) % CACHE_LINE)           return "Core-only delivery fields do not start a cache line";
+    if (LAST_LINE(qdr_delivery_t, ref_count)   >= core_line)   return "ref_count shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, context)     >= core_line)   return "context shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, disposition) >= core_line)   return "disposition shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, settled)     >= core_line)   return "settled shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, where)       >= core_line)   return "where shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, link_work)   >= core_line)   return "link_work shares a line with core-only fields";
+    if (LAST_LINE(qdr_delivery_t, tag)         >= core_line)   return "tag shares a line with core-only fields";
+    if (sizeof(qdr_delivery_t) > 5 * CACHE_LINE)               return "qdr_delivery_t is larger than five cache lines";
+    return 0;
+}
+
+
+static char *test_link_layout(void *context)
+{
+    size_t shared_line = FIRST_LINE(qdr_link_t, work_list);
+    size_t core_line   = FIRST_LINE(qdr_link_t, owning_addr);
+
+    if (offsetof(qdr_link_t, work_list) % CACHE_LINE)            return "Shared link fields do not start a cache line";
+    if (offsetof(qdr_link_t, owning_addr) % CACHE_LINE)          return "Core-only link fields do not start a cache line";
+    if (LAST_LINE(qdr_link_t, priority)         >= shared_line)  return "Read-mostly fields share a line with shared fields";
+    if (LAST_LINE(qdr_link_t, undelivered)      >= core_line)    return "undelivered shares a line with core-only fields";
+    if (LAST_LINE(qdr_link_t, credit_to_core)   >= core_line)    return "credit_to_core shares a line with core-only fields";
+    if (LAST_LINE(qdr_link_t, total_deliveries) >= core_line)    return "total_deliveries shares a line with core-only fields";
+    if (sizeof(qdr_link_t) > 9 * CACHE_LINE)                     return "qdr_link_t is larger than nine cache lines";
+    return 0;
+}
+
+
+static int layout_tests(void)
+{
+    int result = 0;
+    char *test_group = "layout_tests";
+
+    TEST_CASE(test_delivery_layout, 0);
+    TEST_CASE(test_link_layout, 0);
+
+    return result;
+}
+
+
 int main(int argc, char** argv)
 {
     size_t buffer_size = 512;
@@ -43,6 +101,7 @@ int main(int argc, char** argv)
     result += field_tests();
     result += parse_tests();
     result += buffer_tests();
+    result += layout_tests();
 
     qd_alloc_finalize();
     return result;
@@ -150,6 +150,66 @@ class AuthServicePluginDeprecatedTest(AuthServicePluginTest):
         ])).wait_ready()
 
 
+class AuthServicePluginCacheTest(TestCase):
+    @classmethod
+    def setUpClass(cls):
+        """
+        Tests that a router with cacheSeconds set authenticates a repeated
+        single-step exchange without the auth service.
+
+        """
+        super(AuthServicePluginCacheTest, cls).setUpClass()
+
+        if not SASL.extended():
+            return
+
+        AuthServicePluginTest.createSaslFiles()
+
+        print('launching auth service...')
+        auth_service_port = cls.tester.get_port()
+        cls.auth_service = cls.tester.qdrouterd('auth_service', Qdrouterd.Config([
+                     ('listener', {'host': '0.0.0.0', 'role': 'normal', 'port': auth_service_port,
+                                   'saslMechanisms':'PLAIN', 'authenticatePeer': 'yes'}),
+                     ('router', {'workerThreads': 1,
+                                 'id': 'auth_service',
+                                 'mode': 'standalone',
+                                 'saslConfigName': 'tests-mech-PLAIN',
+                                 'saslConfigPath': os.getcwd()})
+        ]))
+        cls.auth_service.wait_ready()
+
+        cls.router_port = cls.tester.get_port()
+        cls.tester.qdrouterd('router', Qdrouterd.Config([
+                     ('authServicePlugin', {'name':'myauth', 'host': '127.0.0.1', 'port': auth_service_port,
+                                            'cacheSeconds': 60}),
+                     ('listener', {'host': '0.0.0.0', 'port': cls.router_port, 'role': 'normal', 'saslPlugin':'myauth', 'saslMechanisms':'PLAIN'}),
+                     ('router', {'mode': 'standalone', 'id': 'router'})
+        ])).wait_ready()
+
+    @SkipIfNeeded(not SASL.extended(), "Cyrus library not available. skipping test")
+    def test_cached_credentials(self):
+        """
+        Check that cached credentials still authenticate once the auth service
+        is gone, and that other credentials do not.
+
+        """
+        test = SimpleConnect("127.0.0.1:%d" % self.router_port, 'test@domain.com', 'password')
+        test.run()
+        self.assertEqual(True, test.connected)
+        self.assertEqual(None, test.error)
+
+        self.auth_service.teardown()
+
+        test = SimpleConnect("127.0.0.1:%d" % self.router_port, 'test@domain.com', 'password')
+        test.run()
+        self.assertEqual(True, test.connected)
+        self.assertEqual(None, test.error)
+
+        test = SimpleConnect("127.0.0.1:%d" % self.router_port, 'test@domain.com', 'foo')
+        test.run()
+        self.assertEqual(False, test.connected)
+
+
 class SimpleConnect(MessagingHandler):
     def __init__(self, url, username, password):
         super(SimpleConnect, self).__init__()
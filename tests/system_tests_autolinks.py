@@ -25,6 +25,7 @@ from __future__ import print_function
 
 import unittest2 as unittest
 import json
+import time
 from threading import Timer
 from proton import Message
 from system_test import TestCase, Qdrouterd, main_module, TIMEOUT, Process
@@ -246,6 +247,49 @@ class AutoLinkRetryTest(TestCase):
         self.assertTrue(self.success)
 
 
+class AutoLinkActivationRateTest(TestCase):
+    """
+    Auto links beyond autoLinkActivationRate are attached in batches, one
+    each second, after their container's connection opens.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(AutoLinkActivationRateTest, cls).setUpClass()
+        container_port = cls.tester.get_port()
+
+        cls.container = cls.tester.qdrouterd('AutoLinkRateB', Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'AutoLinkRateB'}),
+            ('listener', {'role': 'normal', 'port': cls.tester.get_port()}),
+            ('listener', {'host': '127.0.0.1', 'role': 'normal', 'port': container_port}),
+        ]), wait=True)
+
+        config = [
+            ('router', {'mode': 'standalone', 'id': 'AutoLinkRateA', 'autoLinkActivationRate': 2}),
+            ('listener', {'host': '127.0.0.1', 'role': 'normal', 'port': cls.tester.get_port()}),
+            ('connector', {'host': '127.0.0.1', 'name': 'connectorToB',
+                           'role': 'route-container', 'port': container_port}),
+        ]
+        for i in range(6):
+            config.append(('autoLink', {'connection': 'connectorToB',
+                                        'addr': 'paced.%d' % i, 'direction': 'out'}))
+        cls.router = cls.tester.qdrouterd('AutoLinkRateA', Qdrouterd.Config(config), wait=True)
+
+    def test_auto_links_activated_in_batches(self):
+        node = Node.connect(self.router.addresses[0], timeout=TIMEOUT)
+        deadline = time.time() + TIMEOUT
+        while True:
+            links = node.query(type='org.apache.qpid.dispatch.router.config.autoLink',
+                               attribute_names=['operStatus']).get_dicts()
+            router = node.query(type='org.apache.qpid.dispatch.router',
+                                attribute_names=['autoLinksPending']).get_dicts()[0]
+            if all(l['operStatus'] == 'active' for l in links) and router['autoLinksPending'] == 0:
+                break
+            self.assertTrue(time.time() < deadline, "auto links not all activated: %r" % links)
+            time.sleep(0.2)
+        self.assertEqual(6, len(links))
+        node.close()
+
+
 class WaypointReceiverPhaseTest(TestCase):
     inter_router_port = None
 
@@ -30,7 +30,9 @@ from __future__ import print_function
 
 
 from threading import Timer
+import os
 import re
+import socket
 from subprocess import PIPE, STDOUT
 from system_test import TestCase, Qdrouterd, TIMEOUT, Process
 
@@ -155,3 +157,27 @@ class RouterTestBadConfiguration(TestCase):
         except Exception as e:
             raise Exception("%s\n%s" % (e, out))
         return out
+
+
+class RequiredListenerTest(TestCase):
+    """
+    The first listener of the configuration is required.  A router that
+    cannot listen on it exits, and the critical line saying why is in its
+    log even though log output is written by a separate thread.
+    """
+    def test_busy_port(self):
+        port = self.tester.get_port()
+        busy = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        busy.bind(('0.0.0.0', port))
+        busy.listen(1)
+        try:
+            router = self.qdrouterd('RequiredListener', Qdrouterd.Config([
+                ('router', {'mode': 'standalone', 'id': 'QDR.R'}),
+                ('listener', {'port': port})]), wait=False)
+            router.expect = Process.EXIT_FAIL
+            self.assertNotEqual(0, router.wait())
+        finally:
+            busy.close()
+
+        with open(os.path.join(router.outdir, 'RequiredListener.log'), 'r') as router_log:
+            self.assertIn("Shutting down, required listener failed", router_log.read())
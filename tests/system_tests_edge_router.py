@@ -22,7 +22,7 @@ from __future__ import division
 from __future__ import absolute_import
 from __future__ import print_function
 
-from time import sleep
+from time import sleep, time
 from threading import Event
 from threading import Timer
 
@@ -925,6 +925,47 @@ class LinkRouteProxyTest(TestCase):
         er.teardown()
         self._wait_address_gone(self.INT_B, "Edge1/*")
 
+    def test_04_many_link_routes_batched(self):
+        """
+        Activate more link routes than fit in one bulk proxy request before
+        the uplink exists, and verify all are proxied when it comes up
+        """
+        count = 70
+        routes = []
+        for i in range(count):
+            for direction in ('in', 'out'):
+                routes.append(('linkRoute', {'pattern': 'Edge2/%d/*' % i,
+                                             'containerId': 'FakeBroker',
+                                             'direction': direction}))
+        config = Qdrouterd.Config([('router', {'mode': 'edge',
+                                               'id': 'Edge2'}),
+                                   ('listener', {'role': 'normal',
+                                                 'port': self.tester.get_port()}),
+                                   ('listener', {'name': 'rc',
+                                                 'role': 'route-container',
+                                                 'port': self.tester.get_port()})]
+                                  + routes)
+        er = self.tester.qdrouterd('Edge2', config, wait=True)
+
+        fs = FakeService(er.addresses[1])
+        er.wait_address("Edge2/%d/*" % (count - 1))
+
+        er_mgmt = er.management
+        ctor = er_mgmt.create(type=self.CONNECTOR_TYPE,
+                              name='toA',
+                              attributes={'role': 'edge',
+                                          'port': self.INTA_edge_port})
+        for i in range(count):
+            self.INT_B.wait_address("Edge2/%d/*" % i)
+
+        # the proxies go away with the uplink
+        ctor.delete()
+        for i in range(count):
+            self._wait_address_gone(self.INT_B, "Edge2/%d/*" % i)
+
+        fs.join()
+        er.teardown()
+
     def test_50_link_topology(self):
         """
         Verify that the link topology that results from activating a link route
@@ -1062,6 +1103,155 @@ class LinkRouteProxyTest(TestCase):
         self._wait_address_gone(self.INT_A, "Conn/*/One")
 
 
+class EdgeUplinksTest(TestCase):
+    """
+    An edge router with edgeUplinks 2 carries traffic over its edge connections
+    to both interior routers at once.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(EdgeUplinksTest, cls).setUpClass()
+
+        inter_router_port = cls.tester.get_port()
+        edge_port_A       = cls.tester.get_port()
+        edge_port_B       = cls.tester.get_port()
+
+        def router(name, mode, extra):
+            config = [('router', {'mode': mode, 'id': name, 'edgeUplinks': 2}),
+                      ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+                      ('address', {'prefix': 'closest', 'distribution': 'closest'}),
+                      ('address', {'prefix': 'multicast', 'distribution': 'multicast'})] + extra
+            return cls.tester.qdrouterd(name, Qdrouterd.Config(config), wait=True)
+
+        cls.INT_A = router('INT.A', 'interior',
+                           [('listener', {'role': 'inter-router', 'port': inter_router_port}),
+                            ('listener', {'role': 'edge', 'port': edge_port_A})])
+        cls.INT_B = router('INT.B', 'interior',
+                           [('connector', {'role': 'inter-router', 'port': inter_router_port}),
+                            ('listener', {'role': 'edge', 'port': edge_port_B})])
+        cls.EA1   = router('EA1', 'edge',
+                           [('connector', {'name': 'uplinkA', 'role': 'edge', 'port': edge_port_A}),
+                            ('connector', {'name': 'uplinkB', 'role': 'edge', 'port': edge_port_B})])
+
+        cls.INT_A.wait_router_connected('INT.B')
+        cls.INT_B.wait_router_connected('INT.A')
+
+    def test_01_receiver_on_edge(self):
+        test = MobileAddressTest(self.EA1.addresses[0],
+                                 self.INT_B.addresses[0],
+                                 "closest.uplinks")
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_02_sender_on_edge(self):
+        test = MobileAddressTest(self.INT_A.addresses[0],
+                                 self.EA1.addresses[0],
+                                 "closest.uplinks.sender")
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_03_sender_on_edge_receiver_on_other_interior(self):
+        test = MobileAddressTest(self.INT_B.addresses[0],
+                                 self.EA1.addresses[0],
+                                 "closest.uplinks.remote")
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_04_multicast(self):
+        # a consumer on the edge must not get one copy per uplink
+        test = MobileAddressMulticastTest(self.EA1.addresses[0],
+                                          self.INT_B.addresses[0],
+                                          self.INT_A.addresses[0],
+                                          "multicast.uplinks")
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_05_edge_summary(self):
+        # each interior merges the summary of the one edge on it
+        summary = self.EA1.management.get_summary()
+        self.assertEqual('EA1', summary['id'])
+        self.assertGreaterEqual(summary['connectionCount'], 2)
+
+        deadline = time() + TIMEOUT
+        while True:
+            merged = self.INT_A.management.get_summary(edges=True)
+            if merged['edgesAnswered'] == 1 or time() > deadline:
+                break
+            sleep(0.1)
+        self.assertEqual(1, merged['edgeCount'])
+        self.assertEqual(1, merged['edgesAnswered'])
+        self.assertEqual([], merged['unansweredEdges'])
+        self.assertGreaterEqual(merged['connectionCount'], 2)
+        self.assertIn('settleLatencyP99', merged)
+
+        # an edge has no edges of its own
+        self.assertRaises(Exception, self.EA1.management.get_summary, True)
+
+
+class EdgeProxyAttachRateTest(TestCase):
+    """
+    An edge router with edgeProxyAttachRate set proxies its existing local
+    addresses over a few seconds when its uplink comes up.
+    """
+    def test_01_paced_proxying(self):
+        edge_port = self.tester.get_port()
+        edge = self.tester.qdrouterd('EA1.paced',
+                                     Qdrouterd.Config([('router', {'mode': 'edge', 'id': 'EA1.paced',
+                                                                   'edgeProxyAttachRate': 2}),
+                                                       ('listener', {'port': self.tester.get_port()}),
+                                                       ('connector', {'role': 'edge', 'port': edge_port})]),
+                                     wait=False)
+        edge.wait_ports()
+
+        addresses = ["paced.%d" % i for i in range(6)]
+        conn = BlockingConnection(edge.addresses[0])
+        receivers = [conn.create_receiver(a) for a in addresses]
+
+        interior = self.tester.qdrouterd('INT.A.paced',
+                                         Qdrouterd.Config([('router', {'mode': 'interior', 'id': 'INT.A.paced'}),
+                                                           ('listener', {'port': self.tester.get_port()}),
+                                                           ('listener', {'role': 'edge', 'port': edge_port})]),
+                                         wait=True)
+        for a in addresses:
+            interior.wait_address(a, subscribers=1)
+
+        for r in receivers:
+            r.close()
+        conn.close()
+
+
+class EdgeAddressUpdateWindowTest(TestCase):
+    """
+    Address tracking updates are coalesced by an interior router with
+    edgeAddressUpdateWindowSeconds set, and still reach the edge.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(EdgeAddressUpdateWindowTest, cls).setUpClass()
+
+        edge_port = cls.tester.get_port()
+        cls.INT_A = cls.tester.qdrouterd('INT.A.window',
+                                         Qdrouterd.Config([('router', {'mode': 'interior', 'id': 'INT.A.window',
+                                                                       'edgeAddressUpdateWindowSeconds': 1}),
+                                                           ('listener', {'port': cls.tester.get_port()}),
+                                                           ('listener', {'role': 'edge', 'port': edge_port})]),
+                                         wait=True)
+        cls.EA1 = cls.tester.qdrouterd('EA1.window',
+                                       Qdrouterd.Config([('router', {'mode': 'edge', 'id': 'EA1.window'}),
+                                                         ('listener', {'port': cls.tester.get_port()}),
+                                                         ('connector', {'role': 'edge', 'port': edge_port})]),
+                                       wait=True)
+
+    def test_01_sender_on_edge(self):
+        # the receiver closing part way through must reach the edge for the
+        # remaining deliveries to be released
+        test = MobileAddressTest(self.INT_A.addresses[0],
+                                 self.EA1.addresses[0],
+                                 "window.sender")
+        test.run()
+        self.assertEqual(None, test.error)
+
+
 class Timeout(object):
     def __init__(self, parent):
         self.parent = parent
@@ -370,7 +370,17 @@ class ExchangeBindingsTest(TestCase):
                                 receivedCount=5,
                                 forwardedCount=4,
                                 divertedCount=0,
-                                droppedCount=1)
+                                droppedCount=1,
+                                routeCacheHits=0,
+                                routeCacheMisses=5)
+
+        # a repeated subject is routed from the route cache
+        sender.send(Message(subject='a.b', body='E'))
+        self.assertEqual('E', nhop1.receive(timeout=TIMEOUT).body)
+        self._validate_exchange(router, name="Exchange1",
+                                receivedCount=6,
+                                routeCacheHits=1,
+                                routeCacheMisses=5)
         conn.close()
 
     def test_forwarding_mqtt(self):
@@ -706,6 +716,75 @@ class ExchangeBindingsTest(TestCase):
             router.teardown()
 
 
+    def test_forwarding_headers(self):
+        """
+        Forwarding over a headers exchange
+        """
+        config = [
+            ('exchange', {'address':          'AddressH',
+                          'name':             'ExchangeH',
+                          'matchMethod':      'headers',
+                          'alternateAddress': 'altNextHop'}),
+            ('binding', {'name':           'binding1',
+                         'exchangeName':   'ExchangeH',
+                         'bindingKey':     'color=red,size=10',
+                         'nextHopAddress': 'nextHop1'}),
+            ('binding', {'name':           'binding2',
+                         'exchangeName':   'ExchangeH',
+                         'bindingKey':     'x-match=any,color=blue,urgent',
+                         'nextHopAddress': 'nextHop2'}),
+            ('binding', {'name':           'binding3',
+                         'exchangeName':   'ExchangeH',
+                         'bindingKey':     'color',
+                         'nextHopAddress': 'nextHop1'})
+        ]
+        router = self._create_router('H', config)
+
+        # invalid headers key
+        self.assertRaises(Exception, self.run_qdmanage, router,
+                          "create --type " + _BINDING_TYPE +
+                          " exchangeName=ExchangeH"
+                          " bindingKey=x-match=some,a=b"
+                          " nextHopAddress=Nope")
+
+        conn = BlockingConnection(router.addresses[0])
+        sender = conn.create_sender(address="AddressH", options=AtMostOnce())
+        nhop1 = conn.create_receiver(address="nextHop1", credit=100)
+        nhop2 = conn.create_receiver(address="nextHop2", credit=100)
+        alt = conn.create_receiver(address="altNextHop", credit=100)
+
+        # matches binding1 and binding3, one copy to nextHop1
+        sender.send(Message(properties={'color': 'red', 'size': 10}, body='A'))
+        self.assertEqual('A', nhop1.receive(timeout=TIMEOUT).body)
+
+        # matches binding2 (any) and binding3
+        sender.send(Message(properties={'color': 'blue'}, body='B'))
+        self.assertEqual('B', nhop1.receive(timeout=TIMEOUT).body)
+        self.assertEqual('B', nhop2.receive(timeout=TIMEOUT).body)
+
+        # matches binding2 only
+        sender.send(Message(properties={'urgent': True}, body='C'))
+        self.assertEqual('C', nhop2.receive(timeout=TIMEOUT).body)
+
+        # no match -> alternate
+        sender.send(Message(properties={'size': 10}, body='D'))
+        self.assertEqual('D', alt.receive(timeout=TIMEOUT).body)
+
+        self.assertRaises(Timeout, nhop1.receive, timeout=0.25)
+        self.assertRaises(Timeout, nhop2.receive, timeout=0.25)
+        self.assertRaises(Timeout, alt.receive, timeout=0.25)
+
+        self._validate_binding(router, name='binding1', matchedCount=1)
+        self._validate_binding(router, name='binding2', matchedCount=2)
+        self._validate_binding(router, name='binding3', matchedCount=2)
+        self._validate_exchange(router, name="ExchangeH",
+                                matchMethod='headers',
+                                receivedCount=4,
+                                forwardedCount=4,
+                                divertedCount=1,
+                                droppedCount=0)
+        conn.close()
+
 if __name__ == '__main__':
     unittest.main(main_module())
 
@@ -163,6 +163,10 @@ class RouterTestHttp(TestCase):
             data = result.read().decode('utf-8')
             assert('connections' in data)
             assert('deliveries_ingress' in data)
+            assert('address_deliveries_ingress{address="' in data)
+            assert('connection_links{connection="' in data)
+            assert('worker_thread_busy_microseconds{thread="0"}' in data)
+            assert('worker_thread_events_by_type{thread="' in data)
 
         # Sequential calls on multiple ports
         for port in r.ports: test(port)
@@ -172,6 +172,52 @@ class RouterMessageLogTestSome(RouterMessageLogTestBase):
                         u'Sent Message{user-id=b"testuser", subject="test-subject", reply-to="hello_world"}' in log[2]]
         self.assertTrue(test_message, message_logs)
 
+class RouterMessageLogTestSampled(RouterMessageLogTestBase):
+    """System tests to check that message logging can be sampled"""
+    @classmethod
+    def setUpClass(cls):
+        """Start a router and a messenger"""
+        super(RouterMessageLogTestSampled, cls).setUpClass()
+        name = "test-router"
+        config = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'QDR'}),
+            # The received message is passed over and the sent one logged
+            ('listener', {'port': cls.tester.get_port(), 'messageLoggingComponents': 'message-id',
+                          'messageLoggingSample': 2}),
+            # No message has this address
+            ('listener', {'port': cls.tester.get_port(), 'messageLoggingComponents': 'all',
+                          'messageLoggingAddress': 'unrelated/#'}),
+
+            ('address', {'prefix': 'closest', 'distribution': 'closest'}),
+        ])
+        cls.router = cls.tester.qdrouterd(name, config)
+        cls.router.wait_ready()
+
+    def address(self):
+        return self.router.addresses[0]
+
+    def message_logs(self):
+        logs = json.loads(self.run_qdmanage("get-log"))
+        return [log for log in logs if log[0] == u'MESSAGE']
+
+    def test_log_message_sampled(self):
+        test = LogMessageTest(self.router.addresses[0])
+        test.run()
+        self.assertTrue(test.message_received)
+
+        test_message = [log for log in self.message_logs() if "message-id=\"123455\"" in log[2]]
+        self.assertEqual(1, len(test_message), test_message)
+        self.assertTrue(u'Sent Message' in test_message[0][2], test_message)
+
+    def test_log_message_address(self):
+        test = LogMessageTest(self.router.addresses[1])
+        test.run()
+        self.assertTrue(test.message_received)
+
+        test_message = [log for log in self.message_logs() if "subject=\"test-subject\"" in log[2]]
+        self.assertEqual([], test_message)
+
+
 class LogMessageTest(MessagingHandler):
     def __init__(self, address):
         super(LogMessageTest, self).__init__(auto_accept=False)
@@ -25,7 +25,7 @@ from __future__ import absolute_import
 from __future__ import print_function
 
 import unittest2 as unittest
-import system_test, re, os, json
+import system_test, re, os, json, mmap, struct, time
 from proton.handlers import MessagingHandler
 from proton.reactor import Container
 from proton import Message
@@ -48,6 +48,9 @@ LINK = ROUTER + '.link'
 ADDRESS = ROUTER + '.address'
 NODE = ROUTER + '.node'
 CONFIG_ADDRESS = ROUTER + '.config.address'
+ALLOCATOR = PREFIX + 'allocator'
+LOG_STATS = PREFIX + 'logStats'
+WORKER_THREAD = PREFIX + 'workerThread'
 
 def short_name(name):
     if name.startswith(PREFIX):
@@ -278,6 +281,23 @@ class ManagementTest(system_test.TestCase):
         self.assertRaises(NotFoundStatus, self.node.read,
                           type=CONFIG_ADDRESS, name='patternAddr')
 
+    def test_bulk_config_address(self):
+        """Create and delete several config addresses in one request each"""
+        entities = [dict(name='bulkAddr%d' % i, prefix='bulk%d' % i) for i in range(3)]
+        entities.append(dict(name='bulkAddr0', prefix='bulkDup'))    # Duplicate name
+        results = self.node.bulk_create(entities, CONFIG_ADDRESS)
+        self.assertEqual([201, 201, 201, 400], [r['statusCode'] for r in results])
+        self.assertEqual(['bulk0', 'bulk1', 'bulk2'], [r['attributes']['prefix'] for r in results[:3]])
+        self.assertNotIn('attributes', results[3])
+        self.assert_read_ok(CONFIG_ADDRESS, 'bulkAddr2', dict(prefix='bulk2'))
+
+        identity = self.node.read(CONFIG_ADDRESS, 'bulkAddr1').identity
+        results = self.node.bulk_delete([dict(name='bulkAddr0'), dict(identity=identity),
+                                         dict(name='bulkAddr2'), dict(name='bulkAddr2')], CONFIG_ADDRESS)
+        self.assertEqual([204, 204, 204, 404], [r['statusCode'] for r in results])
+        for i in range(3):
+            self.assertRaises(NotFoundStatus, self.node.read, type=CONFIG_ADDRESS, name='bulkAddr%d' % i)
+
     def test_dummy(self):
         """Test all operations on the dummy test entity"""
         entity = self.node.read(type=LISTENER, name='l0')
@@ -356,6 +376,100 @@ class ManagementTest(system_test.TestCase):
         response = self.node.query(type='org.apache.qpid.dispatch.connection')
         self.assertTrue(response.results)
 
+    def test_link_filter(self):
+        """Verify a query filter returns only the matching links"""
+        links = self.node.query(type=LINK).get_dicts()
+        outgoing = self.node.query(type=LINK, filter={'linkDir': 'out'}).get_dicts()
+        self.assertEqual([l['identity'] for l in links if l['linkDir'] == 'out'],
+                         [l['identity'] for l in outgoing])
+        self.assertFalse(self.node.query(type=LINK, filter={'noSuchAttribute': 1}).results)
+
+    def test_address_paging(self):
+        """Verify paging through addresses returns each address once"""
+        names = [a['name'] for a in self.node.query(type=ADDRESS).get_dicts()]
+        paged = []
+        while True:
+            page = self.node.query(type=ADDRESS, attribute_names=['name'], offset=len(paged), count=2).results
+            if not page:
+                break
+            paged.extend(r[0] for r in page)
+        self.assertEqual(names, paged)
+
+    def test_query_pages(self):
+        """Verify a paged query streams the same rows in several responses"""
+        names = [a['name'] for a in self.node.query(type=ADDRESS, attribute_names=['name']).get_dicts()]
+        self.assertTrue(len(names) > 4)
+        paged = self.node.query(type=ADDRESS, attribute_names=['name'], page_size=2)
+        self.assertEqual(['name'], paged.attribute_names)
+        self.assertEqual(names, [r[0] for r in paged.results])
+        # count and offset still apply across the pages
+        self.assertEqual(names[1:4], [r[0] for r in self.node.query(type=ADDRESS, attribute_names=['name'],
+                                                                    offset=1, count=3, page_size=2).results])
+
+    def test_query_snapshot(self):
+        """Verify queries are answered from a shared snapshot when enabled"""
+        conf = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'snapshot', 'managementSnapshotMillis': 60000}),
+            ('listener', {'port': self.get_port(), 'role': 'normal'})
+        ])
+        router = self.tester.qdrouterd('snapshot', conf, wait=True)
+        node = self.cleanup(Node.connect(router.addresses[0]))
+        links = node.query(type=LINK, attribute_names=['identity']).results
+        # A new connection adds links, but the snapshot is still fresh
+        other = self.cleanup(Node.connect(router.addresses[0]))
+        self.assertEqual(links, other.query(type=LINK, attribute_names=['identity']).results)
+        self.assertEqual(links[1:], other.query(type=LINK, attribute_names=['identity'], offset=1).results)
+        # A different attribute list takes its own snapshot
+        self.assertTrue(len(other.query(type=LINK, attribute_names=['name']).results) > len(links))
+
+    def test_stats_page(self):
+        """Verify the shared statistics page is mapped and updated"""
+        path = os.path.abspath('stats.page')
+        conf = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'statspage', 'statsPagePath': path, 'statsPageMillis': 10}),
+            ('listener', {'port': self.get_port(), 'role': 'normal'})
+        ])
+        router = self.tester.qdrouterd('statspage', conf, wait=True)
+        self.cleanup(Node.connect(router.addresses[0]))
+        header = struct.Struct("=IIQIIIIQQQQQQIIq")
+        with open(path, "rb") as f:
+            page = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        fields = header.unpack_from(page, 0)
+        self.assertEqual((0x47505351, 1), fields[:2])
+        self.assertEqual(router.pid, fields[15])
+        sequence = fields[11]
+        time.sleep(0.1)
+        fields = header.unpack_from(page, 0)
+        self.assertTrue(fields[11] > sequence)
+        self.assertTrue(fields[13] > 0)     # allocator records
+        connections = struct.unpack_from("=Q", page, fields[7])[0]
+        self.assertTrue(connections >= 1)
+        router.teardown()
+        self.assertFalse(os.path.exists(path))
+
+    def test_refresh_by_type(self):
+        """Verify entities queried or read by type are refreshed from C"""
+        allocators = self.node.query(type=ALLOCATOR, attribute_names=['identity', 'typeName', 'typeSize']).get_dicts()
+        self.assertTrue(allocators)
+        for a in allocators:
+            self.assertEqual(a['identity'], 'allocator/%s' % a['typeName'])
+            self.assertTrue(a['typeSize'] > 0)
+        stats = self.node.read(type=LOG_STATS, identity='logStats/ROUTER')
+        self.assertTrue(stats.infoCount > 0)
+
+    def test_worker_thread(self):
+        """Verify server threads report their utilization and events"""
+        threads = self.node.query(type=WORKER_THREAD).get_dicts()
+        self.assertTrue(threads)
+        self.assertEqual(len(threads), len(set(t['threadIndex'] for t in threads)))
+        for t in threads:
+            self.assertEqual(t['identity'], 'workerThread/%d' % t['threadIndex'])
+            self.assertTrue(t['utilization'] >= 0 and t['utilization'] <= 100)
+            self.assertTrue(sum(t['eventCounts'].values()) >= t['events'])
+        # This request was handled by some thread
+        self.assertTrue(sum(t['batches'] for t in threads) > 0)
+        self.assertTrue(sum(t['deliveriesIn'] for t in threads) > 0)
+
     def test_router(self):
         """Verify router counts match entity counts"""
         entities = self.node.query().get_entities()
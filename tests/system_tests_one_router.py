@@ -29,7 +29,7 @@ from proton.handlers import MessagingHandler, TransactionHandler
 from proton.reactor import Container, AtMostOnce, AtLeastOnce, DynamicNodeProperties, LinkOption, ApplicationEvent, EventInjector
 from proton.utils import BlockingConnection, SyncRequestResponse
 from qpid_dispatch.management.client import Node
-import os, json
+import os, json, time
 
 CONNECTION_PROPERTIES_UNICODE_STRING = {u'connection': u'properties', u'int_property': 6451}
 CONNECTION_PROPERTIES_SYMBOL = dict()
@@ -79,10 +79,19 @@ class OneRouterTest(TestCase):
             ('listener', {'port': cls.tester.get_port(), 'maxFrameSize': '2048', 'stripAnnotations': 'out'}),
             ('listener', {'port': cls.tester.get_port(), 'maxFrameSize': '2048', 'stripAnnotations': 'in'}),
 
+            # Autotuned session windows
+            ('listener', {'port': cls.tester.get_port(), 'maxFrameSize': '2048', 'stripAnnotations': 'no',
+                          'sessionWindowMin': 16384, 'sessionWindowMax': 1048576}),
+
             ('address', {'prefix': 'closest', 'distribution': 'closest'}),
             ('address', {'prefix': 'balanced', 'distribution': 'balanced'}),
             ('address', {'prefix': 'multicast', 'distribution': 'multicast'}),
-            ('address', {'prefix': 'unavailable', 'distribution': 'unavailable'})
+            ('address', {'prefix': 'unavailable', 'distribution': 'unavailable'}),
+            ('address', {'prefix': 'conflate', 'distribution': 'closest', 'presettledDropPolicy': 'conflate'}),
+            ('address', {'prefix': 'queued', 'distribution': 'closest', 'queueMaxDepth': 10}),
+            ('address', {'prefix': 'mcastall', 'distribution': 'multicast', 'multicastSettlement': 'allAccept'}),
+            ('address', {'prefix': 'ordered', 'distribution': 'closest', 'priorityOrdered': True}),
+            ('address', {'prefix': 'affinity', 'distribution': 'balanced', 'groupAffinity': True})
         ])
         cls.router = cls.tester.qdrouterd(name, config)
         cls.router.wait_ready()
@@ -93,6 +102,7 @@ class OneRouterTest(TestCase):
         cls.both_strip_addr = cls.router.addresses[2]
         cls.out_strip_addr  = cls.router.addresses[3]
         cls.in_strip_addr   = cls.router.addresses[4]
+        cls.autotune_addr   = cls.router.addresses[5]
 
 
     def test_01_listen_error(self):
@@ -443,6 +453,42 @@ class OneRouterTest(TestCase):
         test.run()
         self.assertEqual(None, test.error)
 
+    def test_44_conflated_presettled(self):
+        test = ConflatedPresettledTest(self.address + '/conflate/1', 300, 3)
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_45_queued_while_no_credit(self):
+        test = QueuedWhileNoCreditTest(self.address + '/queued/1', 10)
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_46_multicast_all_accept(self):
+        test = MulticastAllAcceptTest(self.address + '/mcastall/1')
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_47_priority_ordered_link(self):
+        test = PriorityOrderedLinkTest(self.address + '/ordered/1', 40, 5)
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_48_expired_while_queued(self):
+        test = ExpiredWhileQueuedTest(self.address, "closest/expired", 10)
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_50_group_affinity(self):
+        test = GroupAffinityTest(self.address + '/affinity/1', 3, 6, 10)
+        test.run()
+        self.assertEqual(None, test.error)
+
+    def test_51_session_window_autotune(self):
+        # Large messages stream through a connection whose session windows are autotuned
+        test = LargeMessageStreamTest(self.autotune_addr)
+        test.run()
+        self.assertEqual(None, test.error)
+
 
 class Entity(object):
     def __init__(self, status_code, status_description, attrs):
@@ -488,6 +534,10 @@ class RouterProxy(object):
         ap = {'operation': 'QUERY', 'type': 'org.apache.qpid.dispatch.router.link'}
         return Message(properties=ap, reply_to=self.reply_addr)
 
+    def query_router(self):
+        ap = {'operation': 'QUERY', 'type': 'org.apache.qpid.dispatch.router'}
+        return Message(properties=ap, reply_to=self.reply_addr)
+
 
 class SemanticsClosest(MessagingHandler):
     def __init__(self, address):
@@ -1120,6 +1170,386 @@ class DroppedPresettledTest(MessagingHandler):
                                                        PresettledCustomTimeout(
                                                            self))
 
+class ConflatedPresettledCredit(object):
+    def __init__(self, parent):
+        self.parent = parent
+
+    def on_timer_task(self, event):
+        self.parent.grant_credit(event)
+
+
+class ConflatedPresettledTest(MessagingHandler):
+    """
+    Send more presettled messages over several group-ids than the receiver's
+    link can hold before the receiver gives any credit.  With the conflate
+    drop policy, the receiver must get fewer messages than were sent and the
+    last message of each group must not be lost.
+    """
+    def __init__(self, addr, n_messages, n_groups):
+        super(ConflatedPresettledTest, self).__init__(prefetch=0)
+        self.addr = addr
+        self.n_messages = n_messages
+        self.n_groups = n_groups
+        self.sender = None
+        self.receiver = None
+        self.conn = None
+        self.n_sent = 0
+        self.n_received = 0
+        self.latest = {}
+        self.error = None
+        self.timer = None
+        self.check_timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d received=%d" % (self.n_sent, self.n_received)
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.addr)
+        self.receiver = event.container.create_receiver(self.conn, self.addr)
+
+    def on_link_opened(self, event):
+        if event.receiver == self.receiver:
+            self.sender = event.container.create_sender(self.conn, self.addr)
+
+    def on_sendable(self, event):
+        while self.n_sent < self.n_messages and self.sender.credit > 0:
+            msg = Message(group_id='g%d' % (self.n_sent % self.n_groups),
+                          body={'sequence': self.n_sent})
+            dlv = self.sender.send(msg)
+            dlv.settle()
+            self.n_sent += 1
+        if self.n_sent == self.n_messages and not self.check_timer:
+            self.check_timer = event.reactor.schedule(2, ConflatedPresettledCredit(self))
+
+    def grant_credit(self, event):
+        if self.receiver.credit == 0 and self.n_received == 0:
+            self.receiver.flow(self.n_messages)
+            event.reactor.schedule(2, ConflatedPresettledCredit(self))
+            return
+
+        expected = dict(('g%d' % (seq % self.n_groups), seq)
+                        for seq in range(self.n_messages - self.n_groups, self.n_messages))
+        if self.n_received >= self.n_messages:
+            self.error = "Expected conflation, all %d messages were received" % self.n_received
+        elif self.latest != expected:
+            self.error = "Latest messages per group %r, expected %r" % (self.latest, expected)
+        self.timer.cancel()
+        self.conn.close()
+
+    def on_message(self, event):
+        self.n_received += 1
+        self.latest[event.message.group_id] = event.message.body['sequence']
+
+
+class QueuedWhileNoCreditTest(MessagingHandler):
+    """
+    Send unsettled messages to an address with an in-router queue while its
+    only consumer has given no credit.  The router must accept every message
+    that fits in the queue, and deliver them all once the consumer gives credit.
+    """
+    def __init__(self, addr, n_messages):
+        super(QueuedWhileNoCreditTest, self).__init__(prefetch=0, auto_accept=False)
+        self.addr = addr
+        self.n_messages = n_messages
+        self.sender = None
+        self.receiver = None
+        self.conn = None
+        self.n_sent = 0
+        self.n_accepted = 0
+        self.n_received = 0
+        self.error = None
+        self.timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d accepted=%d received=%d" % \
+                     (self.n_sent, self.n_accepted, self.n_received)
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.addr)
+        self.receiver = event.container.create_receiver(self.conn, self.addr)
+
+    def on_link_opened(self, event):
+        if event.receiver == self.receiver:
+            self.sender = event.container.create_sender(self.conn, self.addr)
+
+    def on_sendable(self, event):
+        while self.n_sent < self.n_messages and self.sender.credit > 0:
+            self.sender.send(Message(body={'sequence': self.n_sent}))
+            self.n_sent += 1
+
+    def on_accepted(self, event):
+        self.n_accepted += 1
+        if self.n_accepted == self.n_messages:
+            if self.n_received > 0:
+                self.error = "Messages were received before any credit was given"
+                self.timer.cancel()
+                self.conn.close()
+                return
+            self.receiver.flow(self.n_messages)
+
+    def on_message(self, event):
+        if event.message.body['sequence'] != self.n_received:
+            self.error = "Expected sequence %d, got %r" % (self.n_received, event.message.body['sequence'])
+        self.n_received += 1
+        if self.n_received == self.n_messages or self.error:
+            self.timer.cancel()
+            self.conn.close()
+
+
+class MulticastAllAcceptTest(MessagingHandler):
+    """
+    Send two unsettled messages to a multicast address settled by allAccept.
+    Both consumers accept the first; one consumer rejects the second.  The
+    producer must see the first accepted and the second settled as modified.
+    """
+    def __init__(self, addr):
+        super(MulticastAllAcceptTest, self).__init__(auto_accept=False)
+        self.addr = addr
+        self.sender = None
+        self.receivers = []
+        self.n_opened = 0
+        self.conn = None
+        self.n_sent = 0
+        self.sequences = {}
+        self.outcomes = {}
+        self.error = None
+        self.timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d outcomes=%r" % (self.n_sent, self.outcomes)
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.addr)
+        self.receivers = [event.container.create_receiver(self.conn, self.addr) for i in range(2)]
+
+    def on_link_opened(self, event):
+        if event.receiver in self.receivers:
+            self.n_opened += 1
+            if self.n_opened == len(self.receivers):
+                self.sender = event.container.create_sender(self.conn, self.addr)
+
+    def on_sendable(self, event):
+        while self.n_sent < 2 and self.sender.credit > 0:
+            dlv = self.sender.send(Message(body={'sequence': self.n_sent}))
+            self.sequences[dlv] = self.n_sent
+            self.n_sent += 1
+
+    def on_message(self, event):
+        if event.message.body['sequence'] == 1 and event.receiver == self.receivers[1]:
+            self.reject(event.delivery)
+        else:
+            self.accept(event.delivery)
+
+    def outcome(self, event, outcome):
+        self.outcomes[self.sequences[event.delivery]] = outcome
+        if len(self.outcomes) == 2:
+            if self.outcomes != {0: 'accepted', 1: 'modified'}:
+                self.error = "Unexpected outcomes %r" % self.outcomes
+            self.timer.cancel()
+            self.conn.close()
+
+    def on_accepted(self, event):
+        self.outcome(event, 'accepted')
+
+    def on_rejected(self, event):
+        self.outcome(event, 'rejected')
+
+    def on_released(self, event):
+        self.outcome(event, 'modified' if event.delivery.remote_state == Delivery.MODIFIED else 'released')
+
+
+class PriorityOrderedLinkTest(MessagingHandler):
+    """
+    Queue low-priority messages, then high-priority ones, on the link of a
+    consumer that has given no credit, at an address whose consumer links are
+    ordered by priority.  Once the consumer gives credit the high-priority
+    messages must arrive ahead of the low-priority backlog.
+    """
+    def __init__(self, addr, n_low, n_high):
+        super(PriorityOrderedLinkTest, self).__init__(prefetch=0)
+        self.addr = addr
+        self.n_low = n_low
+        self.n_high = n_high
+        self.sender = None
+        self.receiver = None
+        self.conn = None
+        self.n_sent = 0
+        self.received = []
+        self.error = None
+        self.timer = None
+        self.credit_timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d received=%d" % (self.n_sent, len(self.received))
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.addr)
+        self.receiver = event.container.create_receiver(self.conn, self.addr)
+
+    def on_link_opened(self, event):
+        if event.receiver == self.receiver:
+            self.sender = event.container.create_sender(self.conn, self.addr)
+
+    def on_sendable(self, event):
+        while self.n_sent < self.n_low + self.n_high and self.sender.credit > 0:
+            priority = 9 if self.n_sent >= self.n_low else 1
+            dlv = self.sender.send(Message(priority=priority, body={'priority': priority}))
+            dlv.settle()
+            self.n_sent += 1
+        if self.n_sent == self.n_low + self.n_high and not self.credit_timer:
+            self.credit_timer = event.reactor.schedule(2, ConflatedPresettledCredit(self))
+
+    def grant_credit(self, event):
+        self.receiver.flow(self.n_low + self.n_high)
+
+    def on_message(self, event):
+        self.received.append(event.message.body['priority'])
+        if len(self.received) == self.n_low + self.n_high:
+            late = [i for i, p in enumerate(self.received) if p == 9 and i >= self.n_low]
+            if late:
+                self.error = "High-priority messages were not moved ahead: %r" % self.received
+            self.timer.cancel()
+            self.conn.close()
+
+
+class GroupAffinityTest(MessagingHandler):
+    """
+    Send several messages of each of a number of groups to an address with
+    group affinity that has a few consumers.  Every message of a group must
+    arrive at the same consumer.
+    """
+    def __init__(self, addr, n_receivers, n_groups, per_group):
+        super(GroupAffinityTest, self).__init__()
+        self.addr = addr
+        self.n_receivers = n_receivers
+        self.n_groups = n_groups
+        self.per_group = per_group
+        self.receivers = []
+        self.sender = None
+        self.conn = None
+        self.n_opened = 0
+        self.n_sent = 0
+        self.n_received = 0
+        self.group_receivers = {}
+        self.error = None
+        self.timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d received=%d" % (self.n_sent, self.n_received)
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.addr)
+        for i in range(self.n_receivers):
+            self.receivers.append(event.container.create_receiver(self.conn, self.addr, name="R%d" % i))
+
+    def on_link_opened(self, event):
+        if event.receiver in self.receivers:
+            self.n_opened += 1
+            if self.n_opened == self.n_receivers:
+                self.sender = event.container.create_sender(self.conn, self.addr)
+
+    def on_sendable(self, event):
+        total = self.n_groups * self.per_group
+        while self.n_sent < total and self.sender.credit > 0:
+            group = "group-%d" % (self.n_sent % self.n_groups)
+            self.sender.send(Message(group_id=group, body=group))
+            self.n_sent += 1
+
+    def on_message(self, event):
+        group = event.message.group_id
+        name = event.receiver.name
+        if self.group_receivers.setdefault(group, name) != name:
+            self.error = "Group %s arrived at %s and %s" % (group, self.group_receivers[group], name)
+        self.n_received += 1
+        if self.error or self.n_received == self.n_groups * self.per_group:
+            self.timer.cancel()
+            self.conn.close()
+
+
+class ExpiredWhileQueuedTest(MessagingHandler):
+    """
+    Queue unsettled messages with a short ttl on the link of a consumer that
+    has given no credit.  When the consumer gives credit after they have
+    expired the router must release them all instead of sending them.
+    """
+    def __init__(self, address, dest, count):
+        super(ExpiredWhileQueuedTest, self).__init__(prefetch=0)
+        self.address = address
+        self.dest = dest
+        self.count = count
+        self.sender = None
+        self.receiver = None
+        self.conn = None
+        self.n_sent = 0
+        self.n_received = 0
+        self.n_released = 0
+        self.error = None
+        self.timer = None
+        self.credit_timer = None
+
+    def run(self):
+        Container(self).run()
+
+    def timeout(self):
+        self.error = "Timeout Expired: sent=%d received=%d released=%d" % \
+                     (self.n_sent, self.n_received, self.n_released)
+        self.conn.close()
+
+    def on_start(self, event):
+        self.timer = event.reactor.schedule(TIMEOUT, Timeout(self))
+        self.conn = event.container.connect(self.address)
+        self.receiver = event.container.create_receiver(self.conn, self.dest)
+
+    def on_link_opened(self, event):
+        if event.receiver == self.receiver:
+            self.sender = event.container.create_sender(self.conn, self.dest)
+
+    def on_sendable(self, event):
+        while self.n_sent < self.count and self.sender.credit > 0:
+            self.sender.send(Message(ttl=0.5, body={'sequence': self.n_sent}))
+            self.n_sent += 1
+        if self.n_sent == self.count and not self.credit_timer:
+            self.credit_timer = event.reactor.schedule(2, ConflatedPresettledCredit(self))
+
+    def grant_credit(self, event):
+        self.receiver.flow(self.count)
+
+    def on_message(self, event):
+        self.n_received += 1
+        self.error = "Received an expired message %r" % event.message.body
+
+    def on_released(self, event):
+        self.n_released += 1
+        if self.n_released == self.count:
+            self.timer.cancel()
+            self.conn.close()
+
+
 class MulticastUnsettled ( MessagingHandler ) :
     def __init__ ( self,
                    addr,
@@ -3061,5 +3491,243 @@ class UnsettledLargeMessageTest(MessagingHandler):
             self.recv_conn.close()
 
 
+class AddressGracePeriodTest(TestCase):
+    """
+    An address left without consumers is kept for addressGracePeriodSeconds
+    and freed only if it is still idle then.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(AddressGracePeriodTest, cls).setUpClass()
+        cls.router = cls.tester.qdrouterd('AddressGracePeriod', Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'AddressGracePeriod', 'addressGracePeriodSeconds': 2}),
+            ('listener', {'port': cls.tester.get_port()}),
+        ]), wait=True)
+
+    def _addresses(self, node):
+        return [a['name'] for a in node.query(type='org.apache.qpid.dispatch.router.address',
+                                               attribute_names=['name']).get_dicts()]
+
+    def _attach_receiver(self, address):
+        conn = BlockingConnection(self.router.addresses[0], timeout=TIMEOUT)
+        conn.create_receiver(address)
+        conn.close()
+
+    def test_idle_address_freed_after_grace_period(self):
+        node = Node.connect(self.router.addresses[0], timeout=TIMEOUT)
+        self._attach_receiver('grace/idle')
+        self.assertIn('M0grace/idle', self._addresses(node))
+
+        deadline = time.time() + TIMEOUT
+        while 'M0grace/idle' in self._addresses(node):
+            self.assertTrue(time.time() < deadline, "idle address was never freed")
+            time.sleep(0.5)
+        node.close()
+
+    def test_address_reused_within_grace_period(self):
+        node = Node.connect(self.router.addresses[0], timeout=TIMEOUT)
+        for i in range(3):
+            self._attach_receiver('grace/reused')
+            time.sleep(0.3)
+            self.assertIn('M0grace/reused', self._addresses(node))
+        node.close()
+
+
+class ProducerCreditReleaseTest(TestCase):
+    """
+    With producerCreditRelease set, producers blocked on an address with no
+    consumers get their credit back in slices once a consumer arrives.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(ProducerCreditReleaseTest, cls).setUpClass()
+        cls.router = cls.tester.qdrouterd('ProducerCreditRelease', Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'ProducerCreditRelease', 'producerCreditRelease': 5}),
+            ('listener', {'port': cls.tester.get_port()}),
+        ]), wait=True)
+
+    def test_blocked_producers_all_delivered(self):
+        test = BlockedProducersTest(self.router.addresses[0], 'credit/paced', 4, 20, release_cap=5)
+        test.run()
+        self.assertEqual(None, test.error)
+
+
+class OverloadControlTest(TestCase):
+    """
+    With overloadBufferMegabytes set, producer credit is withheld while the
+    router's message buffers are over the threshold and given back once they
+    drain.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(OverloadControlTest, cls).setUpClass()
+        cls.router = cls.tester.qdrouterd('OverloadControl', Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'OverloadControl', 'overloadBufferMegabytes': 1}),
+            ('listener', {'port': cls.tester.get_port(), 'linkCapacity': 100}),
+        ]), wait=True)
+
+    def test_credit_withheld_and_restored(self):
+        test = OverloadCreditTest(self.router.addresses[0], 'overload/credit', 100, 50000)
+        test.run()
+        self.assertEqual(None, test.error)
+
+
+class OverloadCreditTest(MessagingHandler):
+    """
+    A producer fills a consumer's queue, which has no credit, with large
+    messages until the router reports an overload.  The consumer then takes
+    them all.  The credit the producer is owed for them must be withheld
+    while the router is overloaded and all of it restored once it is not.
+    """
+    def __init__(self, address, dest, count, size):
+        super(OverloadCreditTest, self).__init__(prefetch=0)
+        self.address  = address
+        self.dest     = dest
+        self.count    = count
+        self.body     = "X" * size
+        self.sent     = 0
+        self.received = 0
+        self.polling  = False
+        self.draining = False
+        self.conn     = None
+        self.sender   = None
+        self.receiver = None
+        self.mgmt_tx  = None
+        self.mgmt_rx  = None
+        self.proxy    = None
+        self.timer    = None
+        self.error    = None
+
+    def timeout(self, name):
+        if name == 'poll':
+            self.mgmt_tx.send(self.proxy.query_router())
+        else:
+            self.error = "Timeout: sent %d, received %d, draining %s" % (self.sent, self.received, self.draining)
+            self.conn.close()
+
+    def on_start(self, event):
+        self.container = event.container
+        self.timer    = event.reactor.schedule(TIMEOUT, MultiTimeout(self, 'test'))
+        self.conn     = event.container.connect(self.address)
+        self.receiver = event.container.create_receiver(self.conn, self.dest)
+        self.mgmt_rx  = event.container.create_receiver(self.conn, dynamic=True)
+        self.mgmt_tx  = event.container.create_sender(self.conn, '$management')
+
+    def on_link_opened(self, event):
+        if event.receiver == self.mgmt_rx:
+            self.mgmt_rx.flow(10)
+            self.proxy  = RouterProxy(self.mgmt_rx.remote_source.address)
+            self.sender = event.container.create_sender(self.conn, self.dest)
+
+    def on_sendable(self, event):
+        if event.sender != self.sender:
+            return
+        while self.sender.credit > 0 and self.sent < self.count:
+            self.sender.send(Message(body=self.body))
+            self.sent += 1
+        if self.sent == self.count and not self.polling:
+            self.polling = True
+            self.container.schedule(0.1, MultiTimeout(self, 'poll'))
+
+    def on_message(self, event):
+        if event.receiver != self.mgmt_rx:
+            self.received += 1
+            return
+
+        self.mgmt_rx.flow(1)
+        router = self.proxy.response(event.message)[0]
+        if not self.draining:
+            if router.overloadLevel > 0:
+                # The router is backed up: let the consumer take everything
+                self.draining = True
+                self.receiver.flow(self.count)
+        elif self.received == self.count and router.overloadLevel == 0 and self.sender.credit == self.count:
+            if router.creditWithheld == 0:
+                self.error = "No credit was withheld while the router was overloaded"
+            self.timer.cancel()
+            self.conn.close()
+            return
+        self.container.schedule(0.1, MultiTimeout(self, 'poll'))
+
+    def run(self):
+        Container(self).run()
+
+
+class BlockedProducersTest(MessagingHandler):
+    """
+    Several senders attach to an address before it has a consumer, then a
+    receiver attaches and must get every message of every sender.  With a
+    release_cap the senders hold back until the first slice of credit has
+    arrived, which must come to no more than the cap in total.
+    """
+    def __init__(self, address, dest, senders, count, release_cap=None):
+        super(BlockedProducersTest, self).__init__()
+        self.address     = address
+        self.dest        = dest
+        self.n_senders   = senders
+        self.count       = count
+        self.release_cap = release_cap
+        self.measured    = release_cap is None
+        self.measuring   = False
+        self.senders     = []
+        self.sent        = {}
+        self.received    = 0
+        self.conn        = None
+        self.receiver    = None
+        self.timer       = None
+        self.error       = None
+
+    def timeout(self, name):
+        if name == 'receiver':
+            self.receiver = self.container.create_receiver(self.conn, self.dest)
+        elif name == 'measure':
+            # Within the first slice: the next is QDR_CREDIT_RELEASE_MSEC after it
+            released = sum(sender.credit for sender in self.senders)
+            if released > self.release_cap:
+                self.error = "First slice released %d credit, more than %d" % (released, self.release_cap)
+                self.timer.cancel()
+                self.conn.close()
+                return
+            self.measured = True
+            for sender in self.senders:
+                self.send(sender)
+        else:
+            self.error = "Timeout: received %d of %d" % (self.received, self.n_senders * self.count)
+            self.conn.close()
+
+    def on_start(self, event):
+        self.container = event.container
+        self.timer = event.reactor.schedule(TIMEOUT, MultiTimeout(self, 'test'))
+        self.conn  = event.container.connect(self.address)
+        for i in range(self.n_senders):
+            sender = event.container.create_sender(self.conn, self.dest)
+            self.senders.append(sender)
+            self.sent[sender.name] = 0
+        # Let the senders block on the address before it has a consumer
+        event.reactor.schedule(1, MultiTimeout(self, 'receiver'))
+
+    def send(self, sender):
+        while sender.credit > 0 and self.sent[sender.name] < self.count:
+            sender.send(Message(body="message %d" % self.sent[sender.name]))
+            self.sent[sender.name] += 1
+
+    def on_sendable(self, event):
+        if not self.measured:
+            if not self.measuring:
+                self.measuring = True
+                event.reactor.schedule(0.05, MultiTimeout(self, 'measure'))
+            return
+        self.send(event.sender)
+
+    def on_message(self, event):
+        self.received += 1
+        if self.received == self.n_senders * self.count:
+            self.timer.cancel()
+            self.conn.close()
+
+    def run(self):
+        Container(self).run()
+
+
 if __name__ == '__main__':
     unittest.main(main_module())
@@ -22,11 +22,18 @@ from __future__ import division
 from __future__ import absolute_import
 from __future__ import print_function
 
+import os
+import select
+import socket
+import tempfile
+import time
+
 import unittest2 as unittest
-from proton import Message
+from proton import Connection, Endpoint, Message, Transport
 from proton.handlers import MessagingHandler
 from proton.reactor import Container
-from system_test import TestCase, Qdrouterd, main_module
+from qpid_dispatch.management.client import Node
+from system_test import TestCase, Qdrouterd, main_module, retry, wait_port, TIMEOUT
 from qpid_dispatch_internal.policy.policy_util import is_ipv6_enabled
 
 class ProtocolFamilyTest(TestCase):
@@ -147,5 +154,112 @@ class SimpleSndRecv(MessagingHandler):
         Container(self).run()
 
 
+class LocalClient(object):
+    """
+    An AMQP connection over a Unix domain socket, pumping a proton transport
+    by hand as the proton reactor only connects to network addresses.
+    """
+    def __init__(self, sock, container_id):
+        self.sock = sock
+        self.connection = Connection()
+        self.connection.container = container_id
+        self.transport = Transport()
+        self.transport.sasl().allowed_mechs('ANONYMOUS')
+        self.transport.bind(self.connection)
+        self.connection.open()
+
+    def pump(self):
+        pending = self.transport.pending()
+        if pending > 0:
+            self.sock.sendall(self.transport.peek(pending))
+            self.transport.pop(pending)
+        readable = select.select([self.sock], [], [], 0.1)[0]
+        if readable and self.transport.capacity() > 0:
+            data = self.sock.recv(self.transport.capacity())
+            if data:
+                self.transport.push(data)
+            else:
+                self.transport.close_tail()
+
+    def pump_until(self, condition):
+        deadline = time.time() + TIMEOUT
+        while not condition():
+            if time.time() > deadline:
+                raise Exception("Timed out on the local connection")
+            self.pump()
+
+
+class LocalListenerTest(TestCase):
+    """
+    A listener with socketAddressFamily local accepts AMQP on a Unix domain socket
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(LocalListenerTest, cls).setUpClass()
+        # Kept short, a socket path is limited to about a hundred bytes
+        cls.path = os.path.join(tempfile.mkdtemp(), "qdrouterd.sock")
+        port = cls.tester.get_port()
+        cls.address = "amqp://127.0.0.1:%s" % port
+        config = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'QDR.Local'}),
+            ('listener', {'port': port}),
+            ('listener', {'name': 'localListener', 'host': cls.path, 'socketAddressFamily': 'local'}),
+        ])
+        # The framework knows listeners by their ports, which the local one has not
+        cls.router = cls.tester.qdrouterd('LocalListener', config, wait=False)
+        wait_port(port)
+
+    def connect(self):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            sock.connect(self.path)
+            return sock
+        except socket.error:
+            sock.close()
+            return None
+
+    def test_01_send_receive(self):
+        sock = retry(self.connect)
+        self.assertIsNotNone(sock, "Cannot connect to %s" % self.path)
+        try:
+            client = LocalClient(sock, 'LocalClient')
+            session = client.connection.session()
+            session.open()
+            receiver = session.receiver('local-receiver')
+            receiver.source.address = 'local.address'
+            receiver.flow(1)
+            receiver.open()
+            sender = session.sender('local-sender')
+            sender.target.address = 'local.address'
+            sender.open()
+
+            client.pump_until(lambda: sender.credit > 0)
+            sender.delivery(b'tag-1')
+            sender.send(Message(body="over a unix socket").encode())
+            sender.advance()
+
+            client.pump_until(lambda: receiver.current and not receiver.current.partial)
+            message = Message()
+            message.decode(receiver.recv(receiver.current.pending))
+            self.assertEqual("over a unix socket", message.body)
+
+            node = Node.connect(self.address, timeout=TIMEOUT)
+            containers = [r[0] for r in node.query(type='org.apache.qpid.dispatch.connection',
+                                                   attribute_names=['container']).results]
+            self.assertIn('LocalClient', containers)
+
+            client.connection.close()
+            client.pump_until(lambda: client.connection.state & Endpoint.REMOTE_CLOSED)
+        finally:
+            sock.close()
+
+    def test_02_delete_listener(self):
+        self.assertTrue(os.path.exists(self.path))
+        node = Node.connect(self.address, timeout=TIMEOUT)
+        node.delete(type='org.apache.qpid.dispatch.listener', name='localListener')
+        self.assertTrue(retry(lambda: not os.path.exists(self.path)),
+                        "Socket %s was not removed" % self.path)
+
+
 if __name__ == '__main__':
     unittest.main(main_module())
@@ -23,7 +23,8 @@ from __future__ import absolute_import
 from __future__ import print_function
 
 import unittest2 as unittest
-from system_test import TestCase, Qdrouterd, main_module
+from system_test import TestCase, Qdrouterd, QdManager, main_module
+from proton import Message
 from proton.utils import BlockingConnection
 import subprocess
 X86_64_ARCH = "x86_64"
@@ -398,5 +399,88 @@ class ConnectorSettingsNondefaultTest(TestCase):
             self.assertTrue(" incoming-window=10," in begin_lines[0])
 
 
+class ListenerAdmissionPacingTest(TestCase):
+    """System tests pacing incoming connections with maxAcceptRate"""
+    @classmethod
+    def setUpClass(cls):
+        """Start a router with one unpaced and one paced listener"""
+        super(ListenerAdmissionPacingTest, cls).setUpClass()
+        name = "ListenerAdmissionPacing"
+        config = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'QDR'}),
+            ('listener', {'host': '0.0.0.0', 'port': cls.tester.get_port()}),
+            ('listener', {'name': 'paced', 'host': '0.0.0.0', 'port': cls.tester.get_port(),
+                          'maxAcceptRate': '2', 'maxPendingAccepts': '100'}),
+        ])
+        cls.router = cls.tester.qdrouterd(name, config)
+        cls.router.wait_ready()
+
+    def test_paced_connections_all_admitted(self):
+        # A burst beyond the rate waits for admission but every connection gets in
+        conns = [BlockingConnection(self.router.addresses[1]) for _ in range(6)]
+        for c in conns:
+            c.close()
+
+        qd_manager = QdManager(self, self.router.addresses[0])
+        listeners = qd_manager.query('org.apache.qpid.dispatch.listener')
+        paced = [l for l in listeners if l['name'] == 'paced'][0]
+        self.assertTrue(paced['connectionsAdmitted'] >= 6)
+        self.assertTrue(paced['connectionsDeferred'] > 0)
+        self.assertEqual(0, paced['connectionsRefused'])
+        self.assertEqual(0, paced['pendingAccepts'])
+
+
+class ConnectionBudgetTest(TestCase):
+    """System tests bounding the work done per connection with connectionDeliveryBudget"""
+    @classmethod
+    def setUpClass(cls):
+        """Start a router with small per-connection delivery and event budgets"""
+        super(ConnectionBudgetTest, cls).setUpClass()
+        name = "ConnectionBudget"
+        config = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'QDR',
+                        'connectionDeliveryBudget': '3', 'connectionBatchEvents': '8'}),
+            ('listener', {'host': '0.0.0.0', 'port': cls.tester.get_port()}),
+        ])
+        cls.router = cls.tester.qdrouterd(name, config)
+        cls.router.wait_ready()
+
+    def test_budgeted_connection_delivers_all(self):
+        # Output cut short by the budget is rescheduled until every message is sent
+        count = 200
+        conn = BlockingConnection(self.router.addresses[0])
+        receiver = conn.create_receiver("budget/1", credit=count)
+        sender = conn.create_sender("budget/1")
+        for i in range(count):
+            sender.send(Message(body=i))
+        for i in range(count):
+            msg = receiver.receive(timeout=10)
+            self.assertEqual(i, msg.body)
+            receiver.accept()
+        conn.close()
+
+
+class LivenessTimeoutTest(TestCase):
+    """System tests for the millisecond livenessTimeoutMillis idle timeout"""
+    @classmethod
+    def setUpClass(cls):
+        """Start a router with a listener using a sub-second idle timeout"""
+        super(LivenessTimeoutTest, cls).setUpClass()
+        name = "LivenessTimeout"
+        config = Qdrouterd.Config([
+            ('router', {'mode': 'standalone', 'id': 'QDR'}),
+            ('listener', {'host': '0.0.0.0', 'port': cls.tester.get_port(),
+                          'idleTimeoutSeconds': '16', 'livenessTimeoutMillis': '400'}),
+        ])
+        cls.router = cls.tester.qdrouterd(name, config)
+        cls.router.wait_ready()
+
+    def test_liveness_timeout_advertised(self):
+        # The router advertises the millisecond timeout in its Open, in place of idleTimeoutSeconds
+        conn = BlockingConnection(self.router.addresses[0])
+        self.assertAlmostEqual(0.4, conn.conn.transport.remote_idle_timeout, places=3)
+        conn.close()
+
+
 if __name__ == '__main__':
     unittest.main(main_module())
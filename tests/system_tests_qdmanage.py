@@ -31,7 +31,7 @@ from qpid_dispatch_internal.management.qdrouter import QdSchema
 
 DUMMY = "org.apache.qpid.dispatch.dummy"
 
-TOTAL_ENTITIES=29   # for tests that check the total # of entities
+TOTAL_ENTITIES=30   # for tests that check the total # of entities
 
 
 class QdmanageTest(TestCase):
@@ -46,7 +46,7 @@ class QdmanageTest(TestCase):
         super(QdmanageTest, cls).setUpClass()
         cls.inter_router_port = cls.tester.get_port()
         config_1 = Qdrouterd.Config([
-            ('router', {'mode': 'interior', 'id': 'R1'}),
+            ('router', {'mode': 'interior', 'id': 'R1', 'coreActionStats': 'yes'}),
             ('sslProfile', {'name': 'server-ssl',
                              'caCertFile': cls.ssl_file('ca-certificate.pem'),
                              'certFile': cls.ssl_file('server-certificate.pem'),
@@ -231,6 +231,29 @@ class QdmanageTest(TestCase):
         self.assertEquals(['AGENT', 'debug'], log[0:2])
         self.assertRegexpMatches(log[2], 'get-log')
 
+    def test_get_core_action_stats(self):
+        stats = json.loads(self.run_qdmanage('QUERY --type=router.coreAction'))
+        ticks = [s for s in stats if s['name'] == 'process_tick']
+        self.assertEqual(len(ticks), 1)
+        self.assertTrue(ticks[0]['actionCount'] > 0)
+        self.assertEqual(sum(ticks[0]['serviceTimeHistogram']), ticks[0]['actionCount'])
+        self.assertEqual(sum(ticks[0]['queueDelayHistogram']), ticks[0]['actionCount'])
+
+    def test_allocator_tracking(self):
+        name = 'allocator/qd_iterator_t'
+        allocator = json.loads(self.run_qdmanage('UPDATE --type=allocator --name=%s tracking=true' % name))
+        self.assertTrue(allocator['tracking'])
+        for i in range(5):
+            self.run_qdmanage('QUERY --type=allocator')
+        allocator = json.loads(self.run_qdmanage('READ --type=allocator --name=%s' % name))
+        self.assertTrue(allocator['tracking'])
+        self.assertTrue(allocator['threadAllocRate'])
+        self.assertTrue(sum(allocator['allocSites'].values()) > 0)
+        self.run_qdmanage('UPDATE --type=allocator --name=%s tracking=false' % name)
+        allocator = json.loads(self.run_qdmanage('READ --type=allocator --name=%s' % name))
+        self.assertFalse(allocator['tracking'])
+        self.assertEqual(allocator['threadAllocRate'], {})
+
     def test_get_logstats(self):
         query_command = 'QUERY --type=logStats'
         logs = json.loads(self.run_qdmanage(query_command))
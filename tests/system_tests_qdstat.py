@@ -27,7 +27,8 @@ import re
 import system_test
 import unittest
 from subprocess import PIPE
-from proton import Url, SSLDomain, SSLUnavailable, SASL
+from proton import Url, SSLDomain, SSLUnavailable, SASL, Message
+from proton.utils import BlockingConnection
 from system_test import main_module, SkipIfNeeded
 
 class QdstatTest(system_test.TestCase):
@@ -125,6 +126,56 @@ class QdstatTest(system_test.TestCase):
     def test_log(self):
         self.run_qdstat(['--log',  '--limit=5'], r'AGENT \(debug\).*GET-LOG')
 
+
+class QdstatLatencyTest(system_test.TestCase):
+    """qdstat --latency on a router timing its deliveries"""
+    @classmethod
+    def setUpClass(cls):
+        super(QdstatLatencyTest, cls).setUpClass()
+        config = system_test.Qdrouterd.Config([
+            ('router', {'id': 'QDR.L', 'workerThreads': 1, 'deliveryLatencyStats': True}),
+            ('listener', {'port': cls.tester.get_port()}),
+        ])
+        cls.router = cls.tester.qdrouterd('test-router-latency', config)
+        config = system_test.Qdrouterd.Config([
+            ('router', {'id': 'QDR.LO', 'workerThreads': 1, 'deliveryLatencyStats': False}),
+            ('listener', {'port': cls.tester.get_port()}),
+        ])
+        cls.router_off = cls.tester.qdrouterd('test-router-latency-off', config)
+
+    def run_qdstat(self, args, router=None):
+        router = router or self.router
+        p = self.popen(
+            ['qdstat', '--bus', str(router.addresses[0]), '--timeout', str(system_test.TIMEOUT)] + args,
+            name='qdstat-'+self.id(), stdout=PIPE, expect=None,
+            universal_newlines=True)
+        out = p.communicate()[0]
+        assert p.returncode == 0, "qdstat exit status %s, output:\n%s" % (p.returncode, out)
+        return out
+
+    def send_unsettled(self, router, address, count=10):
+        bc = BlockingConnection(router.addresses[0], timeout=system_test.TIMEOUT)
+        receiver = bc.create_receiver(address)
+        sender = bc.create_sender(address)
+        for i in range(count):
+            sender.send(Message(body="latency %d" % i))
+            receiver.receive()
+            receiver.accept()
+        bc.close()
+
+    def test_latency(self):
+        self.send_unsettled(self.router, "latency/timed")
+        out = self.run_qdstat(['--latency', '-v'])
+        self.assertIn("Router Delivery Latency by Stage", out)
+        for head in ['dlv', 'ingress-p50', 'core-p99', 'egress-avg', 'downstream-max']:
+            self.assertIn(head, out)
+        self.assertRegexpMatches(out, r'(?s)Addresses.*latency/timed')
+
+    def test_latency_off(self):
+        self.send_unsettled(self.router_off, "latency/untimed")
+        out = self.run_qdstat(['--latency'], self.router_off)
+        self.assertIn("No delivery latency measured", out)
+
 class QdstatLinkPriorityTest(system_test.TestCase):
     """Need 2 routers to get inter-router links for the link priority test"""
     @classmethod
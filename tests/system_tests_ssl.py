@@ -672,6 +672,24 @@ class RouterTestSslInterRouter(RouterTestSslBase):
                             "%s should not be connected" % node)
         self.assertEqual(len(router_nodes), 4)
 
+    @SkipIfNeeded(not SASL.extended(), "Cyrus library not available. skipping test")
+    def test_ssl_profile_handshake_counts(self):
+        """
+        Validates that the TLS handshakes of the inter-router connections are
+        counted against the sslProfile of the listener they arrived on
+        """
+        if not SASL.extended():
+            self.skipTest("Cyrus library not available. skipping test")
+
+        url = Url("amqp://0.0.0.0:%d/$management" % self.PORT_NO_SSL)
+        node = Node.connect(url)
+        response = node.query(type="org.apache.qpid.dispatch.sslProfile",
+                              attribute_names=["name", "resumedHandshakes", "fullHandshakes"])
+        node.close()
+        profiles = dict((p['name'], p) for p in response.get_dicts())
+        counted = profiles['ssl-profile-tls-all']
+        self.assertTrue(counted['resumedHandshakes'] + counted['fullHandshakes'] >= 1)
+
 
 if __name__ == '__main__':
     unittest.main(main_module())
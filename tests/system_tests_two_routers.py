@@ -268,6 +268,148 @@ class TwoRouterTest(TestCase):
         self.assertEqual(None, test.error)
 
 
+class ConnectRaceTest(TestCase):
+    """
+    Router B names Router A by a host that may resolve to several addresses, only one of which
+    is listening, and races its connection attempts to them.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(ConnectRaceTest, cls).setUpClass()
+        inter_router_port = cls.tester.get_port()
+
+        cls.router_a = cls.tester.qdrouterd('RaceA', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.RaceA'}),
+            ('listener', {'port': cls.tester.get_port()}),
+            ('listener', {'role': 'inter-router', 'host': '127.0.0.1', 'port': inter_router_port})]), wait=True)
+
+        cls.router_b = cls.tester.qdrouterd('RaceB', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.RaceB'}),
+            ('listener', {'port': cls.tester.get_port()}),
+            ('connector', {'name': 'connectorToRaceA', 'role': 'inter-router', 'host': 'localhost',
+                           'port': inter_router_port, 'connectRaceMillis': 100})]), wait=True)
+
+    def test_01_race_connects(self):
+        self.router_a.wait_router_connected('QDR.RaceB')
+        self.router_b.wait_router_connected('QDR.RaceA')
+
+        node = Node.connect(self.router_b.addresses[0], timeout=TIMEOUT)
+        outs = node.query(type='org.apache.qpid.dispatch.connection', attribute_names=['role', 'dir'])
+        inter_router = [r for r in outs.results if r[0] == 'inter-router' and r[1] == 'out']
+        self.assertEqual(1, len(inter_router))
+
+
+class CompactAnnotationsTest(TestCase):
+    """
+    Both routers enable compact annotations, so the trace and ingress cross the
+    inter-router connection as compact identifiers.  The receiver's router must
+    turn them back into the router ID strings.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(CompactAnnotationsTest, cls).setUpClass()
+        inter_router_port = cls.tester.get_port()
+
+        cls.router_a = cls.tester.qdrouterd('CompactA', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.A', 'compactAnnotations': True}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('listener', {'role': 'inter-router', 'port': inter_router_port})]), wait=True)
+
+        cls.router_b = cls.tester.qdrouterd('CompactB', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.B', 'compactAnnotations': True}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('connector', {'name': 'connectorToA', 'role': 'inter-router', 'port': inter_router_port})]), wait=True)
+
+        cls.router_a.wait_router_connected('QDR.B')
+        cls.router_b.wait_router_connected('QDR.A')
+
+    def test_01_annotations_restored(self):
+        test = MessageAnnotationsTest(self.router_a.addresses[0], self.router_b.addresses[0])
+        test.run()
+        self.assertEqual(None, test.error)
+
+
+class CompressionTest(TestCase):
+    """
+    The inter-router connector and listener both enable compression, so large
+    messages cross between the routers compressed and small ones as they are.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(CompressionTest, cls).setUpClass()
+        inter_router_port = cls.tester.get_port()
+
+        cls.router_a = cls.tester.qdrouterd('CompressA', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.A'}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('listener', {'role': 'inter-router', 'port': inter_router_port, 'compression': True})]), wait=True)
+
+        cls.router_b = cls.tester.qdrouterd('CompressB', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.B'}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('connector', {'name': 'connectorToA', 'role': 'inter-router', 'port': inter_router_port,
+                           'compression': True})]), wait=True)
+
+        cls.router_a.wait_router_connected('QDR.B')
+        cls.router_b.wait_router_connected('QDR.A')
+
+    def test_01_large_messages(self):
+        test = LargeMessageStreamTest(self.router_a.addresses[0], self.router_b.addresses[0])
+        test.run()
+        self.assertEqual(None, test.error)
+
+        node = Node.connect(self.router_a.addresses[0], timeout=TIMEOUT)
+        outs = node.query(type='org.apache.qpid.dispatch.connection', attribute_names=['role', 'compressionOut'])
+        counts = [r[1] for r in outs.results if r[0] == 'inter-router'][0]
+        if counts[0] == 0:
+            self.skipTest("The router was built without compression support")
+        self.assertTrue(0 < counts[1] < counts[0])
+
+    def test_02_small_message(self):
+        test = MessageAnnotationsTest(self.router_a.addresses[0], self.router_b.addresses[0])
+        test.run()
+        self.assertEqual(None, test.error)
+
+
+class FrameStatsTest(TestCase):
+    """
+    The inter-router connector autotunes its frame size.  Its first connection has
+    no message sizes to go on and advertises maxFrameSize; both ends count frames.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(FrameStatsTest, cls).setUpClass()
+        inter_router_port = cls.tester.get_port()
+
+        cls.router_a = cls.tester.qdrouterd('FrameStatsA', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.A'}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('listener', {'role': 'inter-router', 'port': inter_router_port})]), wait=True)
+
+        cls.router_b = cls.tester.qdrouterd('FrameStatsB', Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.B'}),
+            ('listener', {'port': cls.tester.get_port(), 'stripAnnotations': 'no'}),
+            ('connector', {'name': 'connectorToA', 'role': 'inter-router', 'port': inter_router_port,
+                           'maxFrameSize': 65536, 'maxFrameSizeMin': 1024})]), wait=True)
+
+        cls.router_a.wait_router_connected('QDR.B')
+        cls.router_b.wait_router_connected('QDR.A')
+
+    def test_01_frame_stats(self):
+        test = MessageAnnotationsTest(self.router_a.addresses[0], self.router_b.addresses[0])
+        test.run()
+        self.assertEqual(None, test.error)
+
+        node = Node.connect(self.router_b.addresses[0], timeout=TIMEOUT)
+        outs = node.query(type='org.apache.qpid.dispatch.connection',
+                          attribute_names=['role', 'maxFrameSize', 'framesIn', 'framesOut', 'bytesPerFrameIn'])
+        stats = [r[1:] for r in outs.results if r[0] == 'inter-router'][0]
+        self.assertEqual(65536, stats[0])
+        self.assertTrue(stats[1] > 0)
+        self.assertTrue(stats[2] > 0)
+        self.assertTrue(stats[3] > 0)
+
+
 class Timeout(object):
     def __init__(self, parent):
         self.parent = parent
@@ -370,6 +512,8 @@ class LargeMessageStreamTest(MessagingHandler):
             self.n_sent += 1
 
     def on_message(self, event):
+        if event.message.body != self.body:
+            self.error = "Received a corrupted message body"
         self.n_received += 1
         self.check_if_done()
 
@@ -1436,6 +1580,82 @@ class TwoRouterConnection(TestCase):
 
         self.assertTrue(self.success)
 
+class DataConnectionStripingTest(TestCase):
+    """
+    Router B reaches router A over one inter-router connection plus two
+    inter-router-data connections to the same listener.  Deliveries must be
+    spread over the data connections while every address stays in order.
+    """
+    @classmethod
+    def setUpClass(cls):
+        super(DataConnectionStripingTest, cls).setUpClass()
+        inter_router_port = cls.tester.get_port()
+
+        config_a = Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.A'}),
+            ('listener', {'port': cls.tester.get_port()}),
+            ('listener', {'role': 'inter-router', 'port': inter_router_port}),
+        ])
+        config_b = Qdrouterd.Config([
+            ('router', {'mode': 'interior', 'id': 'QDR.B'}),
+            ('listener', {'port': cls.tester.get_port()}),
+            ('connector', {'name': 'toA', 'role': 'inter-router', 'port': inter_router_port}),
+            ('connector', {'name': 'toA-data-1', 'role': 'inter-router-data', 'port': inter_router_port}),
+            ('connector', {'name': 'toA-data-2', 'role': 'inter-router-data', 'port': inter_router_port}),
+        ])
+        cls.router_a = cls.tester.qdrouterd('StripeA', config_a, wait=True)
+        cls.router_b = cls.tester.qdrouterd('StripeB', config_b, wait=True)
+        cls.router_a.wait_router_connected('QDR.B')
+        cls.router_b.wait_router_connected('QDR.A')
+
+    def _data_connection_ids(self, router):
+        node = Node.connect(router.addresses[0], timeout=TIMEOUT)
+        conns = node.query(type='org.apache.qpid.dispatch.connection',
+                           attribute_names=['identity', 'role']).get_dicts()
+        node.close()
+        return [c['identity'] for c in conns if c['role'] == 'inter-router-data']
+
+    def test_01_deliveries_striped_in_order(self):
+        # Both ends see the two data connections
+        for router in [self.router_a, self.router_b]:
+            for _ in range(int(TIMEOUT * 10)):
+                if len(self._data_connection_ids(router)) == 2:
+                    break
+                sleep(0.1)
+            self.assertEqual(2, len(self._data_connection_ids(router)))
+
+        addresses = ['stripe.%d' % i for i in range(16)]
+        rx_conn = BlockingConnection(self.router_a.addresses[0])
+        receivers = dict((a, rx_conn.create_receiver(a)) for a in addresses)
+        for a in addresses:
+            self.router_b.wait_address(a, remotes=1)
+
+        tx_conn = BlockingConnection(self.router_b.addresses[0])
+        for a in addresses:
+            sender = tx_conn.create_sender(a)
+            for seq in range(5):
+                sender.send(Message(body=seq))
+
+        for a in addresses:
+            for seq in range(5):
+                msg = receivers[a].receive(timeout=TIMEOUT)
+                self.assertEqual(seq, msg.body)
+                receivers[a].accept()
+        tx_conn.close()
+        rx_conn.close()
+
+        # Some of the traffic went over the data connections
+        data_ids = self._data_connection_ids(self.router_b)
+        node = Node.connect(self.router_b.addresses[0], timeout=TIMEOUT)
+        links = node.query(type='org.apache.qpid.dispatch.router.link',
+                           attribute_names=['linkType', 'linkDir', 'connectionId', 'deliveryCount']).get_dicts()
+        node.close()
+        striped = sum(l['deliveryCount'] for l in links
+                      if l['linkType'] == 'inter-router' and l['linkDir'] == 'out'
+                      and l['connectionId'] in data_ids)
+        self.assertTrue(striped > 0)
+
+
 class PropagationTest(TestCase):
 
     inter_router_port = None
@@ -285,6 +285,42 @@ static char* test_big(void *context)
 }
 
 
+static char* test_levels(void *context)
+{
+    fire_mask = fired = 0;
+
+    qd_timer_schedule(timers[0], 100000);
+    qd_timer_schedule(timers[1], 5000);
+    qd_timer_schedule(timers[2], 70);
+    if (timeout != 70) return "Incorrect timeout 70";
+    qd_timer_schedule(timers[3], 5000);
+    qd_timer_cancel(timers[3]);
+
+    time_value += 69;
+    qd_timer_visit();
+    if (fired != 0) return "Premature firing";
+    time_value += 1;
+    qd_timer_visit();
+    if (fire_mask != 4) return "Incorrect fire mask 4";
+    if (timeout != 4930) return "Incorrect timeout 4930";
+
+    time_value += 4929;
+    qd_timer_visit();
+    if (fire_mask != 4) return "Premature firing 2";
+    time_value += 1;
+    qd_timer_visit();
+    if (fire_mask != 6) return "Incorrect fire mask 6";
+    if (timeout != 95000) return "Incorrect timeout 95000";
+
+    time_value += 200000;
+    qd_timer_visit();
+    if (fire_mask != 7) return "Incorrect fire mask 7";
+    if (fired != 3) return "Cancelled timer fired";
+
+    return 0;
+}
+
+
 int timer_tests()
 {
     char *test_group = "timer_tests";
@@ -319,6 +355,7 @@ int timer_tests()
     TEST_CASE(test_two_duplicate, 0);
     TEST_CASE(test_separated, 0);
     TEST_CASE(test_big, 0);
+    TEST_CASE(test_levels, 0);
 
     int i;
     for (i = 0; i < 16; i++)
@@ -354,6 +354,55 @@ static char* test_bitmask(void *context)
 }
 
 
+static char* test_bitmask_word_boundaries(void *context)
+{
+    const int width = qd_bitmask_width();
+    int bits[] = {0, 63, 64, 65, 127, width - 1};
+    const int nbits = sizeof(bits) / sizeof(bits[0]);
+    int num, c, i;
+
+    qd_bitmask_t *bm = qd_bitmask(0);
+    for (i = 0; i < nbits; i++)
+        qd_bitmask_set_bit(bm, bits[i]);
+
+    i = 0;
+    for (QD_BITMASK_EACH(bm, num, c)) {
+        if (i >= nbits || num != bits[i]) {
+            qd_bitmask_free(bm);
+            return "Bits iterated out of order";
+        }
+        i++;
+    }
+    if (i != qd_bitmask_cardinality(bm)) {
+        qd_bitmask_free(bm);
+        return "Not all bits iterated";
+    }
+
+    qd_bitmask_clear_bit(bm, 0);
+    qd_bitmask_clear_bit(bm, 63);
+    if (!qd_bitmask_first_set(bm, &num) || num != 64) {
+        qd_bitmask_free(bm);
+        return "Expected first set bit to be 64";
+    }
+
+    qd_bitmask_set_all(bm);
+    i = 0;
+    for (QD_BITMASK_EACH(bm, num, c)) {
+        if (num != i) {
+            qd_bitmask_free(bm);
+            return "Expected every bit to be set";
+        }
+        i++;
+    }
+    if (i != width) {
+        qd_bitmask_free(bm);
+        return "Expected to iterate the full width";
+    }
+
+    qd_bitmask_free(bm);
+    return 0;
+}
+
 int tool_tests(void)
 {
     int result = 0;
@@ -363,6 +412,7 @@ int tool_tests(void)
     TEST_CASE(test_deq_basic2, 0);
     TEST_CASE(test_deq_multi, 0);
     TEST_CASE(test_bitmask, 0);
+    TEST_CASE(test_bitmask_word_boundaries, 0);
 
     return result;
 }
@@ -0,0 +1,323 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# Index mode: build a time-sorted index of the AMQP frames in any number of
+# (possibly multi-GB) log files.
+# Each log file is cut into chunks on line boundaries and the chunks are parsed
+# in parallel, each streaming its rows to a scratch file so that memory stays
+# bounded by the chunk size rather than by the log size. The scratch files are
+# then merged by time into one index whose rows carry the line number and byte
+# offset of each frame in its log file.
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import heapq
+import io
+import multiprocessing
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import common
+import nicknamer
+import parser
+
+# Log keys, as in parser.parse_log_file
+KEY_AMQP = "SERVER (trace) ["
+KEY_RESTART = "SERVER (info) Container Name:"
+KEY_ROUTER_LS = "ROUTER_LS (info)"
+IN_PROGRESS_KEYS = [KEY_AMQP, KEY_ROUTER_LS]
+DATA_KEYS = [' @transfer', ' @disposition', ' @flow', 'EMPTY FRAME']
+
+FRAMES_FN = "frames.tsv"
+CONNECTIONS_FN = "connections.tsv"
+
+FRAMES_HEADER = ["time", "router", "line", "offset", "connection", "channel", "handle",
+                 "direction", "performative", "detail"]
+CONNECTIONS_HEADER = ["connection", "first_time", "last_time", "first_line", "frames", "transfers"]
+
+
+class ChunkResult():
+    """
+    What a worker learned about its chunk beyond the rows it wrote.
+    Line numbers and router instances in the rows are relative to the chunk
+    and are made absolute during the merge.
+    """
+    def __init__(self, log_index, chunk_index, scratch_fn):
+        self.log_index = log_index
+        self.chunk_index = chunk_index
+        self.scratch_fn = scratch_fn
+        self.lines = 0
+        self.restarts = 0
+        # a line that opens an in-progress router appeared before the first restart
+        self.opened_before_restart = False
+        self.opened = False
+        self.data_skipped = 0
+
+
+def clean(value):
+    return ("%s" % value).replace('\t', ' ').replace('\n', ' ')
+
+
+def frame_detail(plf):
+    """
+    The facts worth searching for in a frame, with full rather than nicknamed names
+    """
+    res = plf.data
+    resdict = res.described_type.dict
+    if res.name == "open":
+        return "container-id=%s" % plf.resdict_value(resdict, "container-id", "unknown")
+    if res.name == "attach":
+        return "%s name=%s source=%s target=%s" % (
+            res.role, plf.resdict_value(resdict, "name", "None"), res.source, res.target)
+    if res.name == "flow":
+        return "delivery-count=%s link-credit=%s%s" % (
+            res.flow_deliverycnt, res.flow_linkcredit, " drain" if res.flow_drain else "")
+    if res.name == "transfer":
+        return "delivery-id=%s settled=%s%s%s size=%s" % (
+            res.delivery_id, res.settled, " more" if res.transfer_more else "",
+            " aborted" if res.transfer_aborted else "", res.transfer_size)
+    if res.name == "disposition":
+        return "%s first=%s last=%s settled=%s state=%s" % (
+            res.role, res.first, res.last, res.settled, res.disposition_state)
+    return ""
+
+
+def index_chunk(task):
+    """
+    Parse the lines of one chunk of a log file and write a row per AMQP frame to a
+    scratch file. Runs in a worker process.
+    :param task: (log file name, log index, chunk index, start offset, end offset, scratch file name, args)
+    :return: ChunkResult
+    """
+    fn, log_index, chunk_index, start, end, scratch_fn, args = task
+    result = ChunkResult(log_index, chunk_index, scratch_fn)
+
+    # The shorteners keep every name and frame they see; a fresh set per chunk keeps
+    # the worker's memory bounded by the chunk size.
+    comn = common.Common()
+    comn.args = args
+    comn.shorteners = nicknamer.Shorteners()
+    skip_data = getattr(args, 'skip_all_data', False)
+
+    with io.open(fn, 'rb') as infile, io.open(scratch_fn, 'w', encoding='utf-8') as outfile:
+        infile.seek(start)
+        offset = start
+        while offset < end:
+            raw = infile.readline()
+            if not raw:
+                break
+            line_offset = offset
+            offset += len(raw)
+            result.lines += 1
+            line = raw.decode('utf-8', 'replace')
+
+            if not result.opened and (any(s in line for s in IN_PROGRESS_KEYS) or ("[" in line and "]" in line)):
+                result.opened = True
+                if result.restarts == 0:
+                    result.opened_before_restart = True
+
+            if KEY_RESTART in line:
+                result.opened = True
+                result.restarts += 1
+            elif KEY_ROUTER_LS in line:
+                pass
+            elif "[" in line and "]" in line:
+                if skip_data and any(s in line for s in DATA_KEYS):
+                    result.data_skipped += 1
+                    continue
+                try:
+                    plf = parser.ParsedLogLine(log_index, 0, result.lines, line, comn, None)
+                except ValueError:
+                    continue
+                except Exception as e:
+                    sys.stderr.write("Failed to parse file '%s', byte offset %d : %s. Analysis continuing...\n" %
+                                     (fn, line_offset, e))
+                    continue
+                if not plf.data.name:
+                    continue
+                outfile.write("\t".join([
+                    plf.datetime.strftime('%Y-%m-%d %H:%M:%S.%f'),
+                    "%d" % result.restarts,
+                    "%d" % result.lines,
+                    "%d" % line_offset,
+                    clean(plf.data.conn_num),
+                    clean(plf.data.channel),
+                    clean(plf.data.handle),
+                    clean(plf.data.direction),
+                    plf.data.name,
+                    clean(frame_detail(plf))]) + "\n")
+    return result
+
+
+def chunk_bounds(fn, chunk_size):
+    """
+    Cut a file into byte ranges of about chunk_size that start and end on line boundaries
+    """
+    size = os.path.getsize(fn)
+    bounds = [0]
+    with io.open(fn, 'rb') as infile:
+        while bounds[-1] + chunk_size < size:
+            infile.seek(bounds[-1] + chunk_size)
+            infile.readline()
+            pos = infile.tell()
+            if pos >= size:
+                break
+            bounds.append(pos)
+    bounds.append(size)
+    return [(bounds[i], bounds[i + 1]) for i in range(len(bounds) - 1)]
+
+
+def file_rows(chunk_results):
+    """
+    Generate the rows of one log file in log order, with absolute line numbers and
+    router instances. Instances follow parser.parse_log_file: a file whose first
+    router line is not a restart holds an in-progress instance 0 and its first
+    restart begins instance 1.
+    Rows are (time, router, line, offset, connection, channel, handle, direction,
+    performative, detail).
+    """
+    letter = common.log_letter_of(chunk_results[0].log_index)
+    lines_before = 0
+    instance = 0
+    opened = False
+    for cr in chunk_results:
+        # the instance of the chunk's first restart
+        first_restart = instance + (1 if (opened or cr.opened_before_restart) else 0)
+        with io.open(cr.scratch_fn, 'r', encoding='utf-8') as infile:
+            for row in infile:
+                f = row.rstrip('\n').split('\t')
+                restarts = int(f[1])
+                inst = instance if restarts == 0 else first_restart + restarts - 1
+                router = "%s%d" % (letter, inst)
+                yield (f[0], router, lines_before + int(f[2]), int(f[3]),
+                       "%s_%s" % (router, f[4]), f[5], f[6], f[7], f[8], f[9])
+        if cr.restarts > 0:
+            instance = first_restart + cr.restarts - 1
+        opened = opened or cr.opened
+        lines_before += cr.lines
+
+
+def main_except(odir, log_fns, args, jobs, chunk_mb):
+    """
+    Index the log files into directory odir
+    """
+    if os.path.exists(odir):
+        sys.exit('ERROR: output directory %s exists' % odir)
+    for fn in log_fns:
+        if not os.path.exists(fn):
+            sys.exit('ERROR: log file %s was not found!' % fn)
+    if len(log_fns) > 26:
+        sys.exit('ERROR: too many log files')
+
+    t_start = time.time()
+    os.makedirs(odir)
+    scratch = tempfile.mkdtemp(dir=odir)
+    try:
+        tasks = []
+        for log_index, fn in enumerate(log_fns):
+            for chunk_index, (start, end) in enumerate(chunk_bounds(fn, max(1, int(chunk_mb * 1024 * 1024)))):
+                scratch_fn = os.path.join(scratch, "%d.%d.tsv" % (log_index, chunk_index))
+                tasks.append((fn, log_index, chunk_index, start, end, scratch_fn, args))
+
+        # Largest-first would balance better, but chunks are of a size already
+        pool = multiprocessing.Pool(jobs)
+        try:
+            results = pool.map(index_chunk, tasks, chunksize=1)
+        finally:
+            pool.close()
+            pool.join()
+
+        per_file = [[] for _ in log_fns]
+        for cr in results:
+            per_file[cr.log_index].append(cr)
+        for crs in per_file:
+            crs.sort(key=lambda cr: cr.chunk_index)
+
+        # Each file's rows are already in time order, a heap merge keeps them streaming
+        connections = {}
+        n_frames = 0
+        with io.open(os.path.join(odir, FRAMES_FN), 'w', encoding='utf-8') as frames:
+            frames.write("\t".join(FRAMES_HEADER) + "\n")
+            for row in heapq.merge(*[file_rows(crs) for crs in per_file if crs]):
+                n_frames += 1
+                frames.write("\t".join(["%s" % f for f in row]) + "\n")
+                conn = connections.get(row[4])
+                if conn is None:
+                    conn = [row[0], row[0], row[2], 0, 0]
+                    connections[row[4]] = conn
+                conn[1] = row[0]
+                conn[3] += 1
+                if row[8] == "transfer":
+                    conn[4] += 1
+
+        with io.open(os.path.join(odir, CONNECTIONS_FN), 'w', encoding='utf-8') as conns:
+            conns.write("\t".join(CONNECTIONS_HEADER) + "\n")
+            for name in sorted(connections):
+                conns.write("\t".join([name] + ["%s" % f for f in connections[name]]) + "\n")
+
+        n_lines = sum(cr.lines for cr in results)
+        n_skipped = sum(cr.data_skipped for cr in results)
+    finally:
+        shutil.rmtree(scratch, ignore_errors=True)
+
+    print("Indexed %d frames from %d lines of %d log files in %d chunks, %.1f seconds" %
+          (n_frames, n_lines, len(log_fns), len(tasks), time.time() - t_start))
+    if n_skipped > 0:
+        print("Skipped %d transfer, disposition, flow and EMPTY FRAME lines" % n_skipped)
+    print("Frames:      %s" % os.path.join(odir, FRAMES_FN))
+    print("Connections: %s" % os.path.join(odir, CONNECTIONS_FN))
+    return 0
+
+
+if __name__ == "__main__":
+    class dummy_args():
+        skip_all_data = False
+        skip_detail = False
+        skip_msg_progress = False
+        split = False
+        time_start = None
+        time_end = None
+
+    print("Index versus parse_log_file test")
+    fn = 'test_data/A-two-instances.log'
+    comn = common.Common()
+    comn.args = dummy_args()
+    routers = parser.parse_log_file(fn, 0, comn)
+    expected = sorted((plf.lineno, plf.data.conn_id) for rtr in routers for plf in rtr.lines if plf.data.name)
+
+    # tiny chunks so that restarts and in-progress routers straddle chunk boundaries
+    odir = tempfile.mkdtemp()
+    shutil.rmtree(odir)
+    try:
+        main_except(odir, [fn], dummy_args(), 4, 0.001)
+        with io.open(os.path.join(odir, FRAMES_FN), 'r', encoding='utf-8') as frames:
+            next(frames)
+            indexed = sorted((int(f[2]), f[4]) for f in (r.rstrip('\n').split('\t') for r in frames))
+        if indexed != expected:
+            print("ERROR: index does not match parse_log_file")
+    finally:
+        shutil.rmtree(odir, ignore_errors=True)
@@ -36,6 +36,7 @@ from __future__ import print_function
 import argparse
 import ast
 import cgi
+import multiprocessing
 import os
 import sys
 import traceback
@@ -43,6 +44,7 @@ import traceback
 import amqp_detail
 import common
 import datetime
+from log_index import main_except as index_main
 from log_splitter import main_except as splitter_main
 import parser
 import router
@@ -98,6 +100,13 @@ def main_except(argv):
     p.add_argument('--split', '-sp',
                    action='store_true',
                    help='A single file is split into per-connection data.')
+    p.add_argument('--index', '-ix', metavar='DIR',
+                   help='Write a time-sorted index of the AMQP frames in all files to directory DIR. '
+                        'Files are parsed in parallel with bounded memory; no web page is produced.')
+    p.add_argument('--jobs', '-j', type=int, default=multiprocessing.cpu_count(),
+                   help='Index mode: number of parallel parsers (default: %(default)s)')
+    p.add_argument('--chunk-mb', '-cm', type=float, default=64,
+                   help='Index mode: megabytes of log parsed per task (default: %(default)s)')
     p.add_argument('--time-start', '-ts',
                    help='Ignore log records earlier than this. Format: "2018-08-13 13:15:00.123456"')
     p.add_argument('--time-end', '-te',
@@ -126,6 +135,10 @@ def main_except(argv):
             sys.exit('--split mode takes only one file name')
         return splitter_main(comn.args.files[0])
 
+    # process index function
+    if comn.args.index:
+        return index_main(comn.args.index, comn.args.files, comn.args, comn.args.jobs, comn.args.chunk_mb)
+
     # process the log files and add the results to router_array
     for log_i in range(len(comn.args.files)):
         arg_log_file = comn.args.files[log_i]
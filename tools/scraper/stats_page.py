@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# Sample the shared statistics page a router maps when its statsPagePath is
+# set (see src/stats_page.h for the layout), e.g.
+#
+#   python stats_page.py /dev/shm/qdrouterd.stats 1
+#
+# prints the per-second rates of the router, thread and link counters every
+# interval seconds.  With no interval the page is printed once.
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import mmap
+import struct
+import sys
+import time
+
+MAGIC, VERSION = 0x47505351, 1
+
+HEADER = struct.Struct("=IIQIIIIQQQQQQIIq")
+ROUTER_FIELDS = ["connections", "links", "addresses", "deliveries_ingress", "deliveries_egress",
+                 "deliveries_transit", "deliveries_ingress_route_container",
+                 "deliveries_egress_route_container", "presettled_deliveries",
+                 "dropped_presettled_deliveries", "accepted_deliveries", "rejected_deliveries",
+                 "released_deliveries", "modified_deliveries", "action_queue_depth",
+                 "action_park_count"]
+ROUTER = struct.Struct("=%dQ" % len(ROUTER_FIELDS))
+THREAD_FIELDS = ["batches", "events"]
+THREAD = struct.Struct("=QQ")
+ALLOC_FIELDS = ["type_name", "type_size", "in_use_bytes", "cached_bytes", "local_hits", "local_misses"]
+ALLOC = struct.Struct("=48s5Q")
+LINK_FIELDS = ["identity", "connection", "direction", "undelivered", "unsettled", "pad",
+               "deliveries", "presettled", "accepted", "rejected", "released", "modified"]
+LINK = struct.Struct("=QQIIII6Q")
+
+
+class StatsPage(object):
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        (magic, version, self.size, self.thread_slots, self.alloc_slots, self.link_slots, _,
+         self.router_offset, self.thread_offset, self.alloc_offset, self.link_offset,
+         _, _, _, _, self.pid) = HEADER.unpack_from(self.map, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("%s is not a version %d statistics page" % (path, VERSION))
+
+    def _records(self, layout, fields, offset, count):
+        return [dict(zip(fields, layout.unpack_from(self.map, offset + i * layout.size)))
+                for i in range(count)]
+
+    def sample(self):
+        """A consistent copy of the page as a dict of sections"""
+        while True:
+            header = HEADER.unpack_from(self.map, 0)
+            sequence = header[11]
+            if sequence % 2:
+                continue
+            result = {
+                "update_msec": header[12],
+                "router": dict(zip(ROUTER_FIELDS, ROUTER.unpack_from(self.map, self.router_offset))),
+                "allocators": self._records(ALLOC, ALLOC_FIELDS, self.alloc_offset, header[13]),
+                "links": self._records(LINK, LINK_FIELDS, self.link_offset, header[14]),
+            }
+            if HEADER.unpack_from(self.map, 0)[11] == sequence:
+                break
+        # Thread records are written by their own threads, outside the sequence
+        result["threads"] = self._records(THREAD, THREAD_FIELDS, self.thread_offset, self.thread_slots)
+        for a in result["allocators"]:
+            a["type_name"] = a["type_name"].split(b"\0")[0].decode("utf-8")
+        return result
+
+
+def print_sample(sample, previous, seconds, out):
+    def rate(now, before, key):
+        if before is None:
+            return now[key]
+        return (now[key] - before[key]) / seconds
+
+    router, before = sample["router"], previous and previous["router"]
+    out.write("router: %d connections, %d links, %d addresses, core queue %d\n" %
+              (router["connections"], router["links"], router["addresses"], router["action_queue_depth"]))
+    out.write("  ingress %.1f egress %.1f transit %.1f\n" %
+              (rate(router, before, "deliveries_ingress"), rate(router, before, "deliveries_egress"),
+               rate(router, before, "deliveries_transit")))
+    for i, t in enumerate(sample["threads"]):
+        if t["batches"]:
+            t0 = previous and previous["threads"][i]
+            out.write("  thread %d: batches %.1f events %.1f\n" %
+                      (i, rate(t, t0, "batches"), rate(t, t0, "events")))
+    links = dict((l["identity"], l) for l in previous["links"]) if previous else {}
+    for l in sample["links"]:
+        out.write("  link %d conn %d %s: deliveries %.1f undelivered %d unsettled %d\n" %
+                  (l["identity"], l["connection"], "out" if l["direction"] else "in",
+                   rate(l, links.get(l["identity"]), "deliveries"), l["undelivered"], l["unsettled"]))
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        sys.stderr.write("usage: %s <stats page> [interval seconds]\n" % argv[0])
+        return 1
+    page = StatsPage(argv[1])
+    if len(argv) == 2:
+        print_sample(page.sample(), None, 1, sys.stdout)
+        return 0
+    interval = float(argv[2])
+    previous = None
+    while True:
+        sample = page.sample()
+        print_sample(sample, previous, interval, sys.stdout)
+        sys.stdout.flush()
+        previous = sample
+        time.sleep(interval)
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# Decode the delivery trace events returned by the router's GET-TRACE
+# management operation, e.g.
+#
+#   qdmanage GET-TRACE --type=management > trace.json
+#   python trace_ring.py trace.json
+#
+# Events are grouped by message and printed as a timeline with the time elapsed
+# since the message was received, followed by a summary of the slowest stages.
+
+from __future__ import unicode_literals
+from __future__ import division
+from __future__ import absolute_import
+from __future__ import print_function
+
+import json
+import sys
+from collections import defaultdict
+
+THREAD, EVENT, TIMESTAMP, MESSAGE, DELIVERY, CONNECTION, LINK = range(7)
+
+STAGES = [("receive", "forward"), ("forward", "send"), ("send", "settle")]
+
+
+def load(path):
+    with (sys.stdin if path == "-" else open(path)) as f:
+        return json.load(f)
+
+
+def by_message(events):
+    messages = defaultdict(list)
+    for e in events:
+        messages[e[MESSAGE]].append(e)
+    return messages
+
+
+def usec(us):
+    return "%.1f" % us
+
+
+def print_timelines(messages, out):
+    for msg_id, events in sorted(messages.items(), key=lambda kv: kv[1][0][TIMESTAMP]):
+        start = events[0][TIMESTAMP]
+        out.write("message %x\n" % msg_id)
+        for e in events:
+            out.write("  +%10s us  %-8s dlv:%x conn:%d link:%d thread:%d\n" %
+                      (usec(e[TIMESTAMP] - start), e[EVENT], e[DELIVERY],
+                       e[CONNECTION], e[LINK], e[THREAD]))
+
+
+def stage_latencies(messages):
+    """Per stage, the list of (latency us, message id) where both ends were recorded"""
+    latencies = defaultdict(list)
+    for msg_id, events in messages.items():
+        first = {}
+        for e in events:
+            first.setdefault(e[EVENT], e[TIMESTAMP])
+        for begin, end in STAGES:
+            if begin in first and end in first:
+                latencies[(begin, end)].append((first[end] - first[begin], msg_id))
+    return latencies
+
+
+def print_summary(messages, out, top=5):
+    latencies = stage_latencies(messages)
+    out.write("\n%d messages\n" % len(messages))
+    for stage in STAGES:
+        samples = sorted(latencies.get(stage, []), reverse=True)
+        if not samples:
+            continue
+        mean = sum(s[0] for s in samples) / len(samples)
+        out.write("%s -> %s: %d samples, mean %s us, max %s us\n" %
+                  (stage[0], stage[1], len(samples), usec(mean), usec(samples[0][0])))
+        for us, msg_id in samples[:top]:
+            out.write("    %10s us  message %x\n" % (usec(us), msg_id))
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write("usage: %s <GET-TRACE json file or ->\n" % argv[0])
+        return 1
+    messages = by_message(load(argv[1]))
+    print_timelines(messages, sys.stdout)
+    print_summary(messages, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))